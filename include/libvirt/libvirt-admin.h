@@ -189,6 +189,113 @@ virAdmServerPtr virAdmConnectLookupServer(virAdmConnectPtr conn,
 
 # define VIR_THREADPOOL_JOB_QUEUE_DEPTH "jobQueueDepth"
 
+/**
+ * VIR_THREADPOOL_IO_LOOPS:
+ * Macro for the server ioLoops attribute: represents the number of event
+ * loop threads the server spreads client socket I/O over, as
+ * VIR_TYPED_PARAM_UINT. Zero means all client I/O is handled by the main
+ * event loop of the daemon.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_IO_LOOPS "ioLoops"
+
+/**
+ * VIR_THREADPOOL_WORKERS_BUSY:
+ * Macro for the threadpool busyWorkers attribute: represents the current
+ * number of workers, both ordinary and priority ones, running a job, as
+ * VIR_TYPED_PARAM_UINT.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_WORKERS_BUSY "busyWorkers"
+
+/**
+ * VIR_THREADPOOL_JOB_QUEUE_OLDEST_AGE:
+ * Macro for the threadpool jobQueueOldestAge attribute: represents how long
+ * the oldest job in the queue has been waiting for a worker, in milliseconds,
+ * as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_QUEUE_OLDEST_AGE "jobQueueOldestAge"
+
+/**
+ * VIR_THREADPOOL_JOB_LONGEST_RUNNING:
+ * Macro for the threadpool jobLongestRunning attribute: represents how long
+ * the longest running job has been holding its worker, in milliseconds, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_LONGEST_RUNNING "jobLongestRunning"
+
+/**
+ * VIR_THREADPOOL_JOBS_DONE:
+ * Macro for the threadpool jobsDone attribute: represents the number of jobs
+ * processed since the daemon started, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOBS_DONE "jobsDone"
+
+/**
+ * VIR_THREADPOOL_JOB_WAIT_TIME:
+ * Macro for the threadpool jobWaitTime attribute: represents the total time
+ * processed jobs spent in the queue waiting for a worker, in milliseconds, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_JOB_WAIT_TIME "jobWaitTime"
+
+/**
+ * VIR_THREADPOOL_WORKERS_BUSY_TIME:
+ * Macro for the threadpool workersBusyTime attribute: represents the total
+ * time workers spent running jobs, in milliseconds, as
+ * VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_THREADPOOL_WORKERS_BUSY_TIME "workersBusyTime"
+
+/**
+ * VIR_THREADPOOL_ADAPTIVE_LATENCY:
+ * Macro for the threadpool adaptiveLatency attribute: represents the job
+ * queue latency target of the adaptive sizing mode, in milliseconds, as
+ * VIR_TYPED_PARAM_UINT. When non-zero, the threadpool only spawns a new worker
+ * once queued jobs wait longer than this, and retires workers which stay idle,
+ * always within the VIR_THREADPOOL_WORKERS_MIN and VIR_THREADPOOL_WORKERS_MAX
+ * limits. Zero disables adaptive sizing.
+ */
+
+# define VIR_THREADPOOL_ADAPTIVE_LATENCY "adaptiveLatency"
+
+/**
+ * VIR_THREADPOOL_WORKERS_BULK:
+ * Macro for the threadpool bulkWorkers attribute: represents the maximum
+ * number of workers allowed to run bulk procedures, such as saving a domain,
+ * refreshing a storage pool or collecting the statistics of all domains, at
+ * once, as VIR_TYPED_PARAM_UINT. Other procedures queued behind waiting bulk
+ * ones are dispatched to the remaining workers. Zero means no limit.
+ */
+
+# define VIR_THREADPOOL_WORKERS_BULK "bulkWorkers"
+
 /* Tunables for a server workerpool */
 int virAdmServerGetThreadPoolParameters(virAdmServerPtr srv,
                                         virTypedParameterPtr *params,
@@ -345,6 +452,17 @@ virAdmServerLookupClient(virAdmServerPtr srv,
 
 # define VIR_CLIENT_INFO_SELINUX_CONTEXT "selinux_context"
 
+/**
+ * VIR_CLIENT_INFO_REJECTED_CALLS:
+ * Macro represents the number of calls of the client which were rejected for
+ * exceeding the request rate limits of the server, as VIR_TYPED_PARAM_ULLONG.
+ *
+ * NOTE: This attribute is read-only and any attempt to set it will be denied
+ * by daemon
+ */
+
+# define VIR_CLIENT_INFO_REJECTED_CALLS "rejected_calls"
+
 int virAdmClientGetInfo(virAdmClientPtr client,
                         virTypedParameterPtr *params,
                         int *nparams,
@@ -420,6 +538,92 @@ int virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
                                    const char *filters,
                                    unsigned int flags);
 
+/* Statistics of the RPC message buffer pool */
+
+/**
+ * VIR_MESSAGE_POOL_HITS:
+ * Macro for the number of message buffers which were handed out from
+ * the pool without allocating memory, as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_HITS "hits"
+
+/**
+ * VIR_MESSAGE_POOL_MISSES:
+ * Macro for the number of message buffers which had to be freshly
+ * allocated, because the pool had none of a suitable size, as
+ * VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_MISSES "misses"
+
+/**
+ * VIR_MESSAGE_POOL_RECYCLED:
+ * Macro for the number of message buffers which were given back to the
+ * pool when a message was done with, as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_RECYCLED "recycled"
+
+/**
+ * VIR_MESSAGE_POOL_DISCARDED:
+ * Macro for the number of message buffers which were freed because the
+ * pool was already full, as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_DISCARDED "discarded"
+
+/**
+ * VIR_MESSAGE_POOL_CACHED:
+ * Macro for the number of message buffers currently held by the pool,
+ * as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_CACHED "cached"
+
+/**
+ * VIR_MESSAGE_POOL_CACHED_BYTES:
+ * Macro for the amount of memory in bytes currently held by the pool,
+ * as VIR_TYPED_PARAM_ULLONG.
+ */
+
+# define VIR_MESSAGE_POOL_CACHED_BYTES "cachedBytes"
+
+int virAdmConnectGetMessagePoolStats(virAdmConnectPtr conn,
+                                     virTypedParameterPtr *params,
+                                     int *nparams,
+                                     unsigned int flags);
+
+int virAdmConnectGetLoggingBuffer(virAdmConnectPtr conn,
+                                  char **buffer,
+                                  unsigned int flags);
+
+int virAdmServerGetRPCStats(virAdmServerPtr srv,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags);
+
+/* Allocation profiling */
+
+typedef enum {
+    /* clear the data collected so far */
+    VIR_ADMIN_ALLOC_PROFILE_RESET = (1 << 0),
+} virAdmConnectSetAllocProfileFlags;
+
+int virAdmConnectSetAllocProfile(virAdmConnectPtr conn,
+                                 unsigned int rate,
+                                 unsigned int flags);
+
+int virAdmConnectGetAllocStats(virAdmConnectPtr conn,
+                               virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags);
+
+int virAdmConnectGetMemoryStats(virAdmConnectPtr conn,
+                                virTypedParameterPtr *params,
+                                int *nparams,
+                                unsigned int flags);
+
 # ifdef __cplusplus
 }
 # endif
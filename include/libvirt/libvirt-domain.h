@@ -830,6 +830,12 @@ typedef enum {
      */
     VIR_MIGRATE_TLS               = (1 << 16),
 
+    /* Send memory pages to the destination host through several network
+     * connections. See VIR_MIGRATE_PARAM_PARALLEL_* parameters for
+     * configuring the parallel migration.
+     */
+    VIR_MIGRATE_PARALLEL          = (1 << 17),
+
 } virDomainMigrateFlags;
 
 
@@ -1015,6 +1021,14 @@ typedef enum {
  */
 # define VIR_MIGRATE_PARAM_AUTO_CONVERGE_INCREMENT  "auto_converge.increment"
 
+/**
+ * VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS:
+ *
+ * virDomainMigrate* params field: number of connections used during parallel
+ * migration. As VIR_TYPED_PARAM_INT.
+ */
+# define VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS     "parallel.connections"
+
 /* Domain migration. */
 virDomainPtr virDomainMigrate (virDomainPtr domain, virConnectPtr dconn,
                                unsigned long flags, const char *dname,
@@ -1045,6 +1059,14 @@ int virDomainMigrateToURI3(virDomainPtr domain,
                            virTypedParameterPtr params,
                            unsigned int nparams,
                            unsigned int flags);
+int virConnectMigrateDomains(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             const char *dconnuri,
+                             virTypedParameterPtr params,
+                             unsigned int nparams,
+                             unsigned int concurrency,
+                             unsigned int flags);
 
 int virDomainMigrateGetMaxDowntime(virDomainPtr domain,
                                    unsigned long long *downtime,
@@ -1796,6 +1818,18 @@ typedef enum {
 int                     virConnectListAllDomains (virConnectPtr conn,
                                                   virDomainPtr **domains,
                                                   unsigned int flags);
+int                     virConnectListAllDomainsPage (virConnectPtr conn,
+                                                      const char *prefix,
+                                                      const char *cursor,
+                                                      unsigned int maxdomains,
+                                                      virDomainPtr **domains,
+                                                      char **next,
+                                                      unsigned int flags);
+int                     virConnectGetDomainsChangedSince (virConnectPtr conn,
+                                                          unsigned long long generation,
+                                                          unsigned long long *newgeneration,
+                                                          virDomainPtr **changed,
+                                                          unsigned int flags);
 int                     virDomainCreate         (virDomainPtr domain);
 int                     virDomainCreateWithFlags (virDomainPtr domain,
                                                   unsigned int flags);
@@ -2017,6 +2051,8 @@ typedef enum {
     /* Additionally, these flags may be bitwise-OR'd in.  */
     VIR_DOMAIN_DEVICE_MODIFY_FORCE = (1 << 2), /* Forcibly modify device
                                                   (ex. force eject a cdrom) */
+    VIR_DOMAIN_DEVICE_MODIFY_ASYNC = (1 << 3), /* Don't wait for the guest to
+                                                  release a detached device */
 } virDomainDeviceModifyFlags;
 
 int virDomainAttachDevice(virDomainPtr domain, const char *xml);
@@ -2024,6 +2060,10 @@ int virDomainDetachDevice(virDomainPtr domain, const char *xml);
 
 int virDomainAttachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
+int virDomainAttachDevices(virDomainPtr domain,
+                           const char **xmls,
+                           unsigned int nxmls,
+                           unsigned int flags);
 int virDomainDetachDeviceFlags(virDomainPtr domain,
                                const char *xml, unsigned int flags);
 int virDomainUpdateDeviceFlags(virDomainPtr domain,
@@ -2048,6 +2088,10 @@ typedef enum {
     VIR_DOMAIN_STATS_INTERFACE = (1 << 4), /* return domain interfaces info */
     VIR_DOMAIN_STATS_BLOCK = (1 << 5), /* return domain block info */
     VIR_DOMAIN_STATS_PERF = (1 << 6), /* return domain perf event info */
+    VIR_DOMAIN_STATS_PRESSURE = (1 << 7), /* return domain pressure stall info */
+    VIR_DOMAIN_STATS_RESCTRL = (1 << 8), /* return domain resctrl monitoring info */
+    VIR_DOMAIN_STATS_VCPU_KVM = (1 << 9), /* return detailed KVM vCPU info */
+    VIR_DOMAIN_STATS_JOBS = (1 << 10), /* return domain job and monitor accounting */
 } virDomainStatsTypes;
 
 typedef enum {
@@ -2080,6 +2124,36 @@ int virDomainListGetStats(virDomainPtr *doms,
 
 void virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats);
 
+/**
+ * virConnectDomainStatsCallback:
+ * @conn: connection object
+ * @stats: array of @nstats stats records
+ * @nstats: number of records in @stats
+ * @opaque: application specified data
+ *
+ * The callback signature to use when registering for periodic domain
+ * statistics with virConnectDomainStatsRegister(). Each record only
+ * carries the typed parameters whose value changed since the previous
+ * invocation of the callback; domains with no changes are left out.
+ * The records are owned by libvirt and must not be freed by the
+ * callback, nor used after it returns.
+ */
+typedef void (*virConnectDomainStatsCallback)(virConnectPtr conn,
+                                              virDomainStatsRecordPtr *stats,
+                                              int nstats,
+                                              void *opaque);
+
+int virConnectDomainStatsRegister(virConnectPtr conn,
+                                  unsigned int stats,
+                                  unsigned int interval,
+                                  virConnectDomainStatsCallback cb,
+                                  void *opaque,
+                                  virFreeCallback freecb,
+                                  unsigned int flags);
+
+int virConnectDomainStatsDeregister(virConnectPtr conn,
+                                    int callbackID);
+
 /*
  * Perf Event API
  */
@@ -2347,6 +2421,9 @@ typedef enum {
      * exists as long as sync is active */
     VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT = 4,
 
+    /* Backup (virDomainBackupBegin), job ends on completion */
+    VIR_DOMAIN_BLOCK_JOB_TYPE_BACKUP = 5,
+
 # ifdef VIR_ENUM_SENTINELS
     VIR_DOMAIN_BLOCK_JOB_TYPE_LAST
 # endif
@@ -2524,6 +2601,9 @@ int virDomainBlockCommit(virDomainPtr dom, const char *disk, const char *base,
                          const char *top, unsigned long bandwidth,
                          unsigned int flags);
 
+int virDomainBackupBegin(virDomainPtr dom, const char *backupXML,
+                         const char *checkpointXML, unsigned int flags);
+
 
 /* Block I/O throttling support */
 
@@ -3376,6 +3456,17 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_MEMORY_ITERATION         "memory_iteration"
 
+/**
+ * VIR_DOMAIN_JOB_MEMORY_CONVERGE_TIME:
+ *
+ * virDomainGetJobStats field: estimated time (ms) left until the transfer
+ * of domain's memory converges during live migration, as
+ * VIR_TYPED_PARAM_ULLONG. The estimate is based on the current transfer
+ * bandwidth and dirty page rate. This field is missing when migration is
+ * not expected to converge or when there is not enough data to estimate it.
+ */
+# define VIR_DOMAIN_JOB_MEMORY_CONVERGE_TIME     "memory_converge_time"
+
 /**
  * VIR_DOMAIN_JOB_DISK_TOTAL:
  *
@@ -3467,6 +3558,59 @@ typedef enum {
  */
 # define VIR_DOMAIN_JOB_AUTO_CONVERGE_THROTTLE  "auto_converge_throttle"
 
+/**
+ * VIR_DOMAIN_JOB_START_TIME_INIT:
+ *
+ * virDomainGetJobStats field: time (ms) spent initializing the domain
+ * object and checking the emulator capabilities while starting the
+ * domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_INIT          "start_time_init"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_PREPARE_DOMAIN:
+ *
+ * virDomainGetJobStats field: time (ms) spent preparing the live domain
+ * definition while starting the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_PREPARE_DOMAIN "start_time_prepare_domain"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_PREPARE_HOST:
+ *
+ * virDomainGetJobStats field: time (ms) spent preparing host resources,
+ * such as network interfaces, host devices and disk images, while
+ * starting the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_PREPARE_HOST  "start_time_prepare_host"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_LAUNCH:
+ *
+ * virDomainGetJobStats field: time (ms) spent starting external helper
+ * processes, executing the emulator and placing it into cgroups and
+ * security labels while starting the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_LAUNCH        "start_time_launch"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_MONITOR:
+ *
+ * virDomainGetJobStats field: time (ms) spent waiting for the monitor
+ * of the emulator and setting up the domain through it while starting
+ * the domain, as VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_MONITOR       "start_time_monitor"
+
+/**
+ * VIR_DOMAIN_JOB_START_TIME_FINISH:
+ *
+ * virDomainGetJobStats field: time (ms) spent starting virtual CPUs and
+ * refreshing the domain state at the end of starting the domain, as
+ * VIR_TYPED_PARAM_ULLONG.
+ */
+# define VIR_DOMAIN_JOB_START_TIME_FINISH        "start_time_finish"
+
 
 /**
  * virConnectDomainEventGenericCallback:
@@ -4435,6 +4579,20 @@ typedef enum {
 # endif
 } virDomainEventID;
 
+/**
+ * VIR_DOMAIN_EVENT_ID_FLAG_COALESCE:
+ *
+ * Bit that can be OR'ed into the eventID passed to
+ * virConnectDomainEventRegisterAny() to ask for coalesced delivery of
+ * high frequency events.  For VIR_DOMAIN_EVENT_ID_BLOCK_JOB,
+ * VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2 and VIR_DOMAIN_EVENT_ID_BALLOON_CHANGE
+ * the callback is invoked at most once per second for each domain (and
+ * disk, for block job events); while the callback is being throttled
+ * only the most recent event is remembered and it is delivered when the
+ * second is up.  Other event IDs are not affected.
+ */
+# define VIR_DOMAIN_EVENT_ID_FLAG_COALESCE (1 << 30)
+
 
 /* Use VIR_DOMAIN_EVENT_CALLBACK() to cast the 'cb' parameter  */
 int virConnectDomainEventRegisterAny(virConnectPtr conn,
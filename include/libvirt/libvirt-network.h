@@ -181,6 +181,29 @@ int                     virNetworkUpdate(virNetworkPtr network,
                                          const char *xml,
                                          unsigned int flags);
 
+/**
+ * virNetworkUpdateItem:
+ *
+ * A single update of a <network> definition for virNetworkUpdateBatch().
+ * The fields have the same meaning as the arguments of virNetworkUpdate().
+ */
+typedef struct _virNetworkUpdateItem virNetworkUpdateItem;
+typedef virNetworkUpdateItem *virNetworkUpdateItemPtr;
+struct _virNetworkUpdateItem {
+    unsigned int command; /* virNetworkUpdateCommand */
+    unsigned int section; /* virNetworkUpdateSection */
+    int parentIndex;
+    const char *xml;
+};
+
+/*
+ * Apply several updates to an existing network definition at once
+ */
+int                     virNetworkUpdateBatch(virNetworkPtr network,
+                                              virNetworkUpdateItemPtr items,
+                                              unsigned int nitems,
+                                              unsigned int flags);
+
 /*
  * Activate persistent network
  */
@@ -307,6 +330,12 @@ int virNetworkGetDHCPLeases(virNetworkPtr network,
                             virNetworkDHCPLeasePtr **leases,
                             unsigned int flags);
 
+int virConnectGetAllDHCPLeases(virConnectPtr conn,
+                               virNetworkPtr *nets,
+                               const char **macs,
+                               virNetworkDHCPLeasePtr **leases,
+                               unsigned int flags);
+
 /**
  * virConnectNetworkEventGenericCallback:
  * @conn: the connection pointer
@@ -23,6 +23,17 @@ AC_DEFUN([LIBVIRT_CHECK_GNUTLS],[
   dnl Require gnutls >= 3.2.0 because of 3.2.11 in Ubuntu 14.04
   dnl That should have all the functions we use (in >= 2.12)
   dnl and also use nettle, because it's >= 3.0
+
+  if test "$with_gnutls" = "yes" ; then
+    dnl Newer gnutls can offload record encryption to the kernel
+    old_CFLAGS="$CFLAGS"
+    old_LIBS="$LIBS"
+    CFLAGS="$CFLAGS $GNUTLS_CFLAGS"
+    LIBS="$LIBS $GNUTLS_LIBS"
+    AC_CHECK_FUNCS([gnutls_transport_is_ktls_enabled])
+    CFLAGS="$old_CFLAGS"
+    LIBS="$old_LIBS"
+  fi
 ])
 
 AC_DEFUN([LIBVIRT_RESULT_GNUTLS],[
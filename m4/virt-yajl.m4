@@ -19,6 +19,8 @@ dnl
 
 AC_DEFUN([LIBVIRT_ARG_YAJL],[
   LIBVIRT_ARG_WITH_FEATURE([YAJL], [yajl], [check])
+  LIBVIRT_ARG_ENABLE([JSON_SCANNER],
+                     [parse common JSON documents without yajl], [no])
 ])
 
 AC_DEFUN([LIBVIRT_CHECK_YAJL],[
@@ -48,6 +50,15 @@ AC_DEFUN([LIBVIRT_CHECK_YAJL],[
                         [yajl_parse_complete], [yajl/yajl_common.h],
                         [YAJL2], [yajl],
                         [yajl_tree_parse], [yajl/yajl_common.h])
+
+  dnl The scanner only takes the fast path, yajl handles everything else
+  if test "x$enable_json_scanner" = "xyes"; then
+    if test "x$with_yajl" != "xyes"; then
+      AC_MSG_ERROR([the JSON scanner requires yajl])
+    fi
+    AC_DEFINE_UNQUOTED([ENABLE_JSON_SCANNER], 1,
+                       [whether JSON documents are scanned before using yajl])
+  fi
 ])
 
 AC_DEFUN([LIBVIRT_RESULT_YAJL],[
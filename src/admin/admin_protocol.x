@@ -48,6 +48,18 @@ const ADMIN_CLIENT_INFO_PARAMETERS_MAX = 64;
 /* Upper limit on number of client processing controls */
 const ADMIN_SERVER_CLIENT_LIMITS_MAX = 32;
 
+/* Upper limit on number of message pool statistics */
+const ADMIN_CONNECT_MESSAGE_POOL_STATS_MAX = 32;
+
+/* Upper limit on number of RPC statistics of a server */
+const ADMIN_SERVER_RPC_STATS_MAX = 16384;
+
+/* Upper limit on number of allocation profiling statistics */
+const ADMIN_CONNECT_ALLOC_STATS_MAX = 16384;
+
+/* Upper limit on number of memory usage statistics */
+const ADMIN_CONNECT_MEMORY_STATS_MAX = 4096;
+
 /* A long string, which may NOT be NULL. */
 typedef string admin_nonnull_string<ADMIN_STRING_MAX>;
 
@@ -211,6 +223,52 @@ struct admin_connect_set_logging_filters_args {
     unsigned int flags;
 };
 
+struct admin_connect_get_message_pool_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_message_pool_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_MESSAGE_POOL_STATS_MAX>;
+};
+
+struct admin_connect_get_logging_buffer_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_logging_buffer_ret {
+    admin_nonnull_string buffer;
+};
+
+struct admin_server_get_rpc_stats_args {
+    admin_nonnull_server srv;
+    unsigned int flags;
+};
+
+struct admin_server_get_rpc_stats_ret {
+    admin_typed_param params<ADMIN_SERVER_RPC_STATS_MAX>;
+};
+
+struct admin_connect_get_alloc_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_alloc_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_ALLOC_STATS_MAX>;
+};
+
+struct admin_connect_set_alloc_profile_args {
+    unsigned int rate;
+    unsigned int flags;
+};
+
+struct admin_connect_get_memory_stats_args {
+    unsigned int flags;
+};
+
+struct admin_connect_get_memory_stats_ret {
+    admin_typed_param params<ADMIN_CONNECT_MEMORY_STATS_MAX>;
+};
+
 /* Define the program number, protocol version and procedure numbers here. */
 const ADMIN_PROGRAM = 0x06900690;
 const ADMIN_PROTOCOL_VERSION = 1;
@@ -316,5 +374,35 @@ enum admin_procedure {
     /**
      * @generate: both
      */
-    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17
+    ADMIN_PROC_CONNECT_SET_LOGGING_FILTERS = 17,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_MESSAGE_POOL_STATS = 18,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_LOGGING_BUFFER = 19,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_SERVER_GET_RPC_STATS = 20,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_ALLOC_STATS = 21,
+
+    /**
+     * @generate: both
+     */
+    ADMIN_PROC_CONNECT_SET_ALLOC_PROFILE = 22,
+
+    /**
+     * @generate: none
+     */
+    ADMIN_PROC_CONNECT_GET_MEMORY_STATS = 23
 };
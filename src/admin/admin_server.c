@@ -29,8 +29,13 @@
 #include "virerror.h"
 #include "viridentity.h"
 #include "virlog.h"
+#include "virhash.h"
+#include "virjson.h"
+#include "virobject.h"
 #include "rpc/virnetdaemon.h"
+#include "rpc/virnetmessage.h"
 #include "rpc/virnetserver.h"
+#include "rpc/virnetserverprogram.h"
 #include "virstring.h"
 #include "virthreadpool.h"
 #include "virtypedparam.h"
@@ -86,6 +91,9 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
     size_t freeWorkers;
     size_t nPrioWorkers;
     size_t jobQueueDepth;
+    virThreadPoolStats stats;
+    unsigned int adaptiveLatency;
+    size_t bulkWorkers;
     virTypedParameterPtr tmpparams = NULL;
 
     virCheckFlags(0, -1);
@@ -129,6 +137,54 @@ adminServerGetThreadPoolParameters(virNetServerPtr srv,
                               jobQueueDepth) < 0)
         goto cleanup;
 
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_IO_LOOPS,
+                              virNetServerGetIOLoops(srv)) < 0)
+        goto cleanup;
+
+    virNetServerGetThreadPoolStats(srv, &stats, &adaptiveLatency,
+                                   &bulkWorkers);
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_WORKERS_BUSY,
+                              stats.busyWorkers) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOB_QUEUE_OLDEST_AGE,
+                                stats.jobQueueOldestAge) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOB_LONGEST_RUNNING,
+                                stats.jobLongestRunning) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOBS_DONE,
+                                stats.jobsDone) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_JOB_WAIT_TIME,
+                                stats.jobWaitTime) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams,
+                                &maxparams, VIR_THREADPOOL_WORKERS_BUSY_TIME,
+                                stats.workersBusyTime) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_ADAPTIVE_LATENCY,
+                              adaptiveLatency) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams,
+                              &maxparams, VIR_THREADPOOL_WORKERS_BULK,
+                              bulkWorkers) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -158,6 +214,10 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                VIR_TYPED_PARAM_UINT,
                                VIR_THREADPOOL_WORKERS_PRIORITY,
                                VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_ADAPTIVE_LATENCY,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_THREADPOOL_WORKERS_BULK,
+                               VIR_TYPED_PARAM_UINT,
                                NULL) < 0)
         return -1;
 
@@ -177,6 +237,16 @@ adminServerSetThreadPoolParameters(virNetServerPtr srv,
                                             maxWorkers, prioWorkers) < 0)
         return -1;
 
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_ADAPTIVE_LATENCY)) &&
+        virNetServerSetThreadPoolAdaptiveLatency(srv, param->value.ui) < 0)
+        return -1;
+
+    if ((param = virTypedParamsGet(params, nparams,
+                                   VIR_THREADPOOL_WORKERS_BULK)) &&
+        virNetServerSetThreadPoolBulkWorkers(srv, param->value.ui) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -294,6 +364,11 @@ adminClientGetInfo(virNetServerClientPtr client,
                                 VIR_CLIENT_INFO_SELINUX_CONTEXT, attr) < 0))
         goto cleanup;
 
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_CLIENT_INFO_REJECTED_CALLS,
+                                virNetServerClientGetRejectedCalls(client)) < 0)
+        goto cleanup;
+
     *params = tmpparams;
     tmpparams = NULL;
     ret = 0;
@@ -388,3 +463,294 @@ adminServerSetClientLimits(virNetServerPtr srv,
 
     return 0;
 }
+
+int
+adminConnectGetMessagePoolStats(virTypedParameterPtr *params,
+                                int *nparams,
+                                unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virNetMessagePoolStats stats;
+    virTypedParameterPtr tmpparams = NULL;
+
+    virCheckFlags(0, -1);
+
+    virNetMessagePoolGetStats(&stats);
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_HITS,
+                                stats.hits) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_MISSES,
+                                stats.misses) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_RECYCLED,
+                                stats.recycled) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_DISCARDED,
+                                stats.discarded) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_CACHED,
+                                stats.cached) < 0)
+        goto cleanup;
+
+    if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                VIR_MESSAGE_POOL_CACHED_BYTES,
+                                stats.cachedBytes) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(*params, tmpparams);
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    return ret;
+}
+
+int
+adminServerGetRPCStats(virNetServerPtr srv,
+                       virTypedParameterPtr *params,
+                       int *nparams,
+                       unsigned int flags)
+{
+    static const struct {
+        const char *name;
+        unsigned int percent;
+    } percentiles[] = {
+        { "p50", 50 }, { "p90", 90 }, { "p99", 99 }, { "max", 100 },
+    };
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virNetServerProgramPtr *progs = NULL;
+    virNetServerProgramProcStatsPtr stats = NULL;
+    size_t nstats = 0;
+    int nprogs;
+    unsigned int count = 0;
+    size_t i, j, k;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    virCheckFlags(0, -1);
+
+    if ((nprogs = virNetServerGetPrograms(srv, &progs)) < 0)
+        return -1;
+
+    for (i = 0; i < nprogs; i++) {
+        unsigned int program = virNetServerProgramGetID(progs[i]);
+
+        VIR_FREE(stats);
+        if (virNetServerProgramGetStats(progs[i], &stats, &nstats) < 0)
+            goto cleanup;
+
+        for (j = 0; j < nstats; j++, count++) {
+            const struct {
+                const char *name;
+                const unsigned int *buckets;
+            } latencies[] = {
+                { "queue", stats[j].queue }, { "exec", stats[j].exec },
+            };
+
+#define ADD_RPC_UINT(suffix, value) \
+    do { \
+        snprintf(field, sizeof(field), "rpc.%u.%s", count, suffix); \
+        if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams, \
+                                  field, value) < 0) \
+            goto cleanup; \
+    } while (0)
+
+            ADD_RPC_UINT("program", program);
+            ADD_RPC_UINT("procedure", stats[j].procedure);
+            ADD_RPC_UINT("calls", stats[j].calls);
+            ADD_RPC_UINT("errors", stats[j].errors);
+
+#undef ADD_RPC_UINT
+
+            for (k = 0; k < ARRAY_CARDINALITY(latencies) * ARRAY_CARDINALITY(percentiles); k++) {
+                size_t l = k / ARRAY_CARDINALITY(percentiles);
+                size_t p = k % ARRAY_CARDINALITY(percentiles);
+
+                snprintf(field, sizeof(field), "rpc.%u.%s.%s", count,
+                         latencies[l].name, percentiles[p].name);
+                if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams, field,
+                                            virNetServerProgramLatencyPercentile(latencies[l].buckets,
+                                                                                 percentiles[p].percent)) < 0)
+                    goto cleanup;
+            }
+        }
+    }
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              "rpc.count", count) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(*params, tmpparams);
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    VIR_FREE(stats);
+    virObjectListFreeCount(progs, nprogs);
+    return ret;
+}
+
+/* keep the reply well within ADMIN_CONNECT_ALLOC_STATS_MAX */
+#define ADMIN_ALLOC_STATS_SITES_MAX 2000
+
+int
+adminConnectGetAllocStats(virTypedParameterPtr *params,
+                          int *nparams,
+                          unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virAllocProfileEntryPtr domains = NULL;
+    virAllocProfileEntryPtr sites = NULL;
+    size_t ndomains = 0;
+    size_t nsites = 0;
+    unsigned long long dropped = 0;
+    size_t i;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    virCheckFlags(0, -1);
+
+    if (virAllocProfileGetStats(&domains, &ndomains,
+                                &sites, &nsites, &dropped) < 0)
+        return -1;
+
+    if (nsites > ADMIN_ALLOC_STATS_SITES_MAX)
+        nsites = ADMIN_ALLOC_STATS_SITES_MAX;
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              "rate", virAllocProfileGetRate()) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "dropped", dropped) < 0)
+        goto cleanup;
+
+#define ADD_ALLOC_PARAM(type, prefix, suffix, value) \
+    do { \
+        snprintf(field, sizeof(field), "%s.%zu.%s", prefix, i, suffix); \
+        if (virTypedParamsAdd ## type(&tmpparams, nparams, &maxparams, \
+                                      field, value) < 0) \
+            goto cleanup; \
+    } while (0)
+
+    for (i = 0; i < ndomains; i++) {
+        const char *name = virErrorDomainTypeToString(domains[i].domcode);
+
+        ADD_ALLOC_PARAM(String, "domain", "name",
+                        name && *name ? name : "none");
+        ADD_ALLOC_PARAM(ULLong, "domain", "allocs", domains[i].allocs);
+        ADD_ALLOC_PARAM(ULLong, "domain", "bytes", domains[i].bytes);
+    }
+
+    for (i = 0; i < nsites; i++) {
+        ADD_ALLOC_PARAM(String, "site", "file", sites[i].filename);
+        ADD_ALLOC_PARAM(String, "site", "function",
+                        NULLSTR(sites[i].funcname));
+        ADD_ALLOC_PARAM(UInt, "site", "line", sites[i].linenr);
+        ADD_ALLOC_PARAM(ULLong, "site", "allocs", sites[i].allocs);
+        ADD_ALLOC_PARAM(ULLong, "site", "bytes", sites[i].bytes);
+    }
+
+#undef ADD_ALLOC_PARAM
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              "domain.count", ndomains) < 0 ||
+        virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              "site.count", nsites) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(*params, tmpparams);
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    VIR_FREE(domains);
+    VIR_FREE(sites);
+    return ret;
+}
+
+int
+adminConnectGetMemoryStats(virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    int ret = -1;
+    int maxparams = 0;
+    virTypedParameterPtr tmpparams = NULL;
+    virClassStatsPtr classes = NULL;
+    size_t nclasses = 0;
+    unsigned long long classBytes = 0;
+    size_t hashTables, hashEntries;
+    unsigned long long hashBytes;
+    size_t jsonValues, jsonArenas;
+    unsigned long long jsonBytes;
+    size_t i;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+
+    virCheckFlags(0, -1);
+
+    if (virClassGetStats(&classes, &nclasses) < 0)
+        return -1;
+
+    virHashGetUsage(&hashTables, &hashEntries, &hashBytes);
+    virJSONValueGetUsage(&jsonValues, &jsonArenas, &jsonBytes);
+
+    for (i = 0; i < nclasses; i++) {
+        unsigned long long bytes = (unsigned long long)classes[i].instances *
+            classes[i].objectSize;
+
+        snprintf(field, sizeof(field), "class.%zu.name", i);
+        if (virTypedParamsAddString(&tmpparams, nparams, &maxparams,
+                                    field, classes[i].name) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "class.%zu.instances", i);
+        if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                    field, classes[i].instances) < 0)
+            goto cleanup;
+
+        snprintf(field, sizeof(field), "class.%zu.bytes", i);
+        if (virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                    field, bytes) < 0)
+            goto cleanup;
+
+        classBytes += bytes;
+    }
+
+    if (virTypedParamsAddUInt(&tmpparams, nparams, &maxparams,
+                              "class.count", nclasses) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "class.bytes", classBytes) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "hash.tables", hashTables) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "hash.entries", hashEntries) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "hash.bytes", hashBytes) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "json.values", jsonValues) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "json.arenas", jsonArenas) < 0 ||
+        virTypedParamsAddULLong(&tmpparams, nparams, &maxparams,
+                                "json.bytes", jsonBytes) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(*params, tmpparams);
+    ret = 0;
+
+ cleanup:
+    virTypedParamsFree(tmpparams, *nparams);
+    VIR_FREE(classes);
+    return ret;
+}
@@ -72,4 +72,21 @@ int adminServerSetClientLimits(virNetServerPtr srv,
                                int nparams,
                                unsigned int flags);
 
+int adminServerGetRPCStats(virNetServerPtr srv,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags);
+
+int adminConnectGetMessagePoolStats(virTypedParameterPtr *params,
+                                    int *nparams,
+                                    unsigned int flags);
+
+int adminConnectGetAllocStats(virTypedParameterPtr *params,
+                              int *nparams,
+                              unsigned int flags);
+
+int adminConnectGetMemoryStats(virTypedParameterPtr *params,
+                               int *nparams,
+                               unsigned int flags);
+
 #endif /* __ADMIN_SERVER_H__ */
@@ -463,6 +463,17 @@ adminConnectSetLoggingFilters(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
     return virLogSetFilters(filters);
 }
 
+static int
+adminConnectSetAllocProfile(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
+                            unsigned int rate,
+                            unsigned int flags)
+{
+    virCheckFlags(VIR_ADMIN_ALLOC_PROFILE_RESET, -1);
+
+    return virAllocProfileSetRate(rate,
+                                  !!(flags & VIR_ADMIN_ALLOC_PROFILE_RESET));
+}
+
 static int
 adminDispatchConnectGetLoggingOutputs(virNetServerPtr server ATTRIBUTE_UNUSED,
                                       virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -485,6 +496,37 @@ adminDispatchConnectGetLoggingOutputs(virNetServerPtr server ATTRIBUTE_UNUSED,
     return 0;
 }
 
+static int
+adminConnectGetLoggingBuffer(char **buffer, unsigned int flags)
+{
+    virCheckFlags(0, -1);
+
+    if (!(*buffer = virLogGetBuffer()))
+        return -1;
+
+    return 0;
+}
+
+static int
+adminDispatchConnectGetLoggingBuffer(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                     virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                     virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                     virNetMessageErrorPtr rerr,
+                                     admin_connect_get_logging_buffer_args *args,
+                                     admin_connect_get_logging_buffer_ret *ret)
+{
+    char *buffer = NULL;
+
+    if (adminConnectGetLoggingBuffer(&buffer, args->flags) < 0) {
+        virNetMessageSaveError(rerr);
+        return -1;
+    }
+
+    VIR_STEAL_PTR(ret->buffer, buffer);
+
+    return 0;
+}
+
 static int
 adminDispatchConnectGetLoggingFilters(virNetServerPtr server ATTRIBUTE_UNUSED,
                                       virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -515,4 +557,159 @@ adminDispatchConnectGetLoggingFilters(virNetServerPtr server ATTRIBUTE_UNUSED,
 
     return 0;
 }
+
+static int
+adminDispatchConnectGetMessagePoolStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                        virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                        virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                        virNetMessageErrorPtr rerr,
+                                        admin_connect_get_message_pool_stats_args *args,
+                                        admin_connect_get_message_pool_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetMessagePoolStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_CONNECT_MESSAGE_POOL_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of message pool statistics %d exceeds max "
+                         "allowed limit: %d"), nparams,
+                       ADMIN_CONNECT_MESSAGE_POOL_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminDispatchServerGetRpcStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                               virNetServerClientPtr client,
+                               virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                               virNetMessageErrorPtr rerr,
+                               admin_server_get_rpc_stats_args *args,
+                               admin_server_get_rpc_stats_ret *ret)
+{
+    int rv = -1;
+    virNetServerPtr srv = NULL;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    struct daemonAdmClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!(srv = virNetDaemonGetServer(priv->dmn, args->srv.name)))
+        goto cleanup;
+
+    if (adminServerGetRPCStats(srv, &params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_SERVER_RPC_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of RPC statistics %d exceeds max "
+                         "allowed limit: %d"), nparams,
+                       ADMIN_SERVER_RPC_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    virObjectUnref(srv);
+    return rv;
+}
+
+static int
+adminDispatchConnectGetAllocStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                  virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                  virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                  virNetMessageErrorPtr rerr,
+                                  admin_connect_get_alloc_stats_args *args,
+                                  admin_connect_get_alloc_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetAllocStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_CONNECT_ALLOC_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of allocation statistics %d exceeds max "
+                         "allowed limit: %d"), nparams,
+                       ADMIN_CONNECT_ALLOC_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
+
+static int
+adminDispatchConnectGetMemoryStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                   virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                   virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                   virNetMessageErrorPtr rerr,
+                                   admin_connect_get_memory_stats_args *args,
+                                   admin_connect_get_memory_stats_ret *ret)
+{
+    int rv = -1;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+
+    if (adminConnectGetMemoryStats(&params, &nparams, args->flags) < 0)
+        goto cleanup;
+
+    if (nparams > ADMIN_CONNECT_MEMORY_STATS_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of memory statistics %d exceeds max "
+                         "allowed limit: %d"), nparams,
+                       ADMIN_CONNECT_MEMORY_STATS_MAX);
+        goto cleanup;
+    }
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &ret->params.params_val,
+                                &ret->params.params_len, 0) < 0)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virTypedParamsFree(params, nparams);
+    return rv;
+}
 #include "admin_server_dispatch_stubs.h"
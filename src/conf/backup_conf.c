@@ -0,0 +1,410 @@
+/*
+ * backup_conf.c: domain backup XML processing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+#include "virbitmap.h"
+#include "virbuffer.h"
+#include "domain_conf.h"
+#include "backup_conf.h"
+#include "virlog.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virxml.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN
+
+VIR_LOG_INIT("conf.backup_conf");
+
+VIR_ENUM_IMPL(virDomainBackupType, VIR_DOMAIN_BACKUP_TYPE_LAST,
+              "default",
+              "push")
+
+static void
+virDomainBackupDiskDefClear(virDomainBackupDiskDefPtr disk)
+{
+    VIR_FREE(disk->name);
+    VIR_FREE(disk->exportname);
+}
+
+void
+virDomainBackupDefFree(virDomainBackupDefPtr def)
+{
+    size_t i;
+
+    if (!def)
+        return;
+
+    VIR_FREE(def->incremental);
+    if (def->server)
+        virStorageNetHostDefFree(1, def->server);
+    for (i = 0; i < def->ndisks; i++)
+        virDomainBackupDiskDefClear(&def->disks[i]);
+    VIR_FREE(def->disks);
+    VIR_FREE(def);
+}
+
+static int
+virDomainBackupServerParseXML(xmlNodePtr node,
+                              virDomainBackupDefPtr def)
+{
+    int ret = -1;
+    char *transport = NULL;
+    char *port = NULL;
+    virStorageNetHostDefPtr server;
+
+    if (VIR_ALLOC(server) < 0)
+        return -1;
+    def->server = server;
+
+    server->transport = VIR_STORAGE_NET_HOST_TRANS_TCP;
+    if ((transport = virXMLPropString(node, "transport"))) {
+        server->transport = virStorageNetHostTransportTypeFromString(transport);
+        if (server->transport != VIR_STORAGE_NET_HOST_TRANS_TCP &&
+            server->transport != VIR_STORAGE_NET_HOST_TRANS_UNIX) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("unsupported backup server transport '%s'"),
+                           transport);
+            goto cleanup;
+        }
+    }
+
+    if (server->transport == VIR_STORAGE_NET_HOST_TRANS_UNIX) {
+        if (!(server->socket = virXMLPropString(node, "socket"))) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("missing socket for unix transport"));
+            goto cleanup;
+        }
+    } else {
+        if (!(server->name = virXMLPropString(node, "name"))) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("missing name for backup server"));
+            goto cleanup;
+        }
+
+        if ((port = virXMLPropString(node, "port")) &&
+            virStringParsePort(port, &server->port) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(transport);
+    VIR_FREE(port);
+    return ret;
+}
+
+static int
+virDomainBackupDiskDefParseXML(xmlNodePtr node,
+                               virDomainBackupDiskDefPtr def)
+{
+    int ret = -1;
+    char *backup = NULL;
+
+    if (!(def->name = virXMLPropString(node, "name"))) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("missing name from disk backup element"));
+        goto cleanup;
+    }
+
+    if ((backup = virXMLPropString(node, "backup")) &&
+        (def->backup = virTristateBoolTypeFromString(backup)) <= 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("invalid disk backup setting '%s'"), backup);
+        goto cleanup;
+    }
+
+    def->exportname = virXMLPropString(node, "exportname");
+    if (def->exportname && def->backup == VIR_TRISTATE_BOOL_NO) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("export name '%s' requires backup of disk '%s'"),
+                       def->exportname, def->name);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(backup);
+    if (ret < 0)
+        virDomainBackupDiskDefClear(def);
+    return ret;
+}
+
+static virDomainBackupDefPtr
+virDomainBackupDefParse(xmlXPathContextPtr ctxt,
+                        unsigned int flags)
+{
+    virDomainBackupDefPtr def = NULL;
+    virDomainBackupDefPtr ret = NULL;
+    xmlNodePtr *nodes = NULL;
+    xmlNodePtr node;
+    char *mode = NULL;
+    size_t i;
+    int n;
+
+    virCheckFlags(0, NULL);
+
+    if (VIR_ALLOC(def) < 0)
+        goto cleanup;
+
+    def->type = VIR_DOMAIN_BACKUP_TYPE_PUSH;
+    if ((mode = virXMLPropString(ctxt->node, "mode")) &&
+        virDomainBackupTypeTypeFromString(mode) != VIR_DOMAIN_BACKUP_TYPE_PUSH) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unsupported backup mode '%s'"), mode);
+        goto cleanup;
+    }
+
+    def->incremental = virXPathString("string(./incremental)", ctxt);
+
+    if (!(node = virXPathNode("./server", ctxt))) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("missing <server> element of push mode backup"));
+        goto cleanup;
+    }
+    if (virDomainBackupServerParseXML(node, def) < 0)
+        goto cleanup;
+
+    if ((n = virXPathNodeSet("./disks/*", ctxt, &nodes)) < 0)
+        goto cleanup;
+    if (n && VIR_ALLOC_N(def->disks, n) < 0)
+        goto cleanup;
+    def->ndisks = n;
+    for (i = 0; i < def->ndisks; i++) {
+        if (virDomainBackupDiskDefParseXML(nodes[i], &def->disks[i]) < 0)
+            goto cleanup;
+    }
+
+    VIR_STEAL_PTR(ret, def);
+
+ cleanup:
+    VIR_FREE(mode);
+    VIR_FREE(nodes);
+    virDomainBackupDefFree(def);
+
+    return ret;
+}
+
+virDomainBackupDefPtr
+virDomainBackupDefParseNode(xmlDocPtr xml,
+                            xmlNodePtr root,
+                            unsigned int flags)
+{
+    xmlXPathContextPtr ctxt = NULL;
+    virDomainBackupDefPtr def = NULL;
+
+    if (!virXMLNodeNameEqual(root, "domainbackup")) {
+        virReportError(VIR_ERR_XML_ERROR, "%s", _("domainbackup"));
+        goto cleanup;
+    }
+
+    ctxt = xmlXPathNewContext(xml);
+    if (ctxt == NULL) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    ctxt->node = root;
+    def = virDomainBackupDefParse(ctxt, flags);
+ cleanup:
+    xmlXPathFreeContext(ctxt);
+    return def;
+}
+
+virDomainBackupDefPtr
+virDomainBackupDefParseString(const char *xmlStr,
+                              unsigned int flags)
+{
+    virDomainBackupDefPtr ret = NULL;
+    xmlDocPtr xml;
+    int keepBlanksDefault = xmlKeepBlanksDefault(0);
+
+    if ((xml = virXMLParse(NULL, xmlStr, _("(domain_backup)")))) {
+        xmlKeepBlanksDefault(keepBlanksDefault);
+        ret = virDomainBackupDefParseNode(xml, xmlDocGetRootElement(xml),
+                                          flags);
+        xmlFreeDoc(xml);
+    }
+    xmlKeepBlanksDefault(keepBlanksDefault);
+
+    return ret;
+}
+
+
+static int
+virDomainBackupCompareDiskIndex(const void *a, const void *b)
+{
+    const virDomainBackupDiskDef *diska = a;
+    const virDomainBackupDiskDef *diskb = b;
+
+    /* Integer overflow shouldn't be a problem here.  */
+    return diska->idx - diskb->idx;
+}
+
+/* Align def->disks to @dom.  Sort the list of def->disks, filling in
+ * any missing disks.  Disks without explicit setting are backed up,
+ * except for empty and read-only disks, and are exported under their
+ * target name.  Convert paths to disk targets for uniformity.  Issue an
+ * error and return -1 if any def->disks[n]->name appears more than once
+ * or does not map to dom->disks.  */
+int
+virDomainBackupAlignDisks(virDomainBackupDefPtr def,
+                          virDomainDefPtr dom)
+{
+    int ret = -1;
+    virBitmapPtr map = NULL;
+    size_t i;
+    int ndisks;
+
+    if (def->ndisks > dom->ndisks) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("too many disk backup requests for domain"));
+        goto cleanup;
+    }
+
+    if (!dom->ndisks) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(map = virBitmapNew(dom->ndisks)))
+        goto cleanup;
+
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainBackupDiskDefPtr disk = &def->disks[i];
+        int idx = virDomainDiskIndexByName(dom, disk->name, false);
+
+        if (idx < 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("no disk named '%s'"), disk->name);
+            goto cleanup;
+        }
+
+        if (virBitmapIsBitSet(map, idx)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("disk '%s' specified twice"),
+                           disk->name);
+            goto cleanup;
+        }
+        ignore_value(virBitmapSetBit(map, idx));
+        disk->idx = idx;
+
+        if (STRNEQ(disk->name, dom->disks[idx]->dst)) {
+            VIR_FREE(disk->name);
+            if (VIR_STRDUP(disk->name, dom->disks[idx]->dst) < 0)
+                goto cleanup;
+        }
+    }
+
+    ndisks = def->ndisks;
+    if (VIR_EXPAND_N(def->disks, def->ndisks,
+                     dom->ndisks - def->ndisks) < 0)
+        goto cleanup;
+
+    for (i = 0; i < dom->ndisks; i++) {
+        virDomainBackupDiskDefPtr disk;
+
+        if (virBitmapIsBitSet(map, i))
+            continue;
+        disk = &def->disks[ndisks++];
+        if (VIR_STRDUP(disk->name, dom->disks[i]->dst) < 0)
+            goto cleanup;
+        disk->idx = i;
+
+        if (virStorageSourceIsEmpty(dom->disks[i]->src) ||
+            dom->disks[i]->src->readonly)
+            disk->backup = VIR_TRISTATE_BOOL_NO;
+    }
+
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainBackupDiskDefPtr disk = &def->disks[i];
+
+        if (disk->backup == VIR_TRISTATE_BOOL_ABSENT)
+            disk->backup = VIR_TRISTATE_BOOL_YES;
+
+        if (disk->backup == VIR_TRISTATE_BOOL_YES &&
+            !disk->exportname &&
+            VIR_STRDUP(disk->exportname, disk->name) < 0)
+            goto cleanup;
+    }
+
+    qsort(&def->disks[0], def->ndisks, sizeof(def->disks[0]),
+          virDomainBackupCompareDiskIndex);
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(map);
+    return ret;
+}
+
+
+char *
+virDomainBackupDefFormat(virDomainBackupDefPtr def,
+                         unsigned int flags)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virCheckFlags(0, NULL);
+
+    virBufferAsprintf(&buf, "<domainbackup mode='%s'>\n",
+                      virDomainBackupTypeTypeToString(def->type));
+    virBufferAdjustIndent(&buf, 2);
+
+    virBufferEscapeString(&buf, "<incremental>%s</incremental>\n",
+                          def->incremental);
+
+    if (def->server) {
+        virBufferAsprintf(&buf, "<server transport='%s'",
+                          virStorageNetHostTransportTypeToString(def->server->transport));
+        virBufferEscapeString(&buf, " name='%s'", def->server->name);
+        if (def->server->port)
+            virBufferAsprintf(&buf, " port='%u'", def->server->port);
+        virBufferEscapeString(&buf, " socket='%s'", def->server->socket);
+        virBufferAddLit(&buf, "/>\n");
+    }
+
+    if (def->ndisks) {
+        virBufferAddLit(&buf, "<disks>\n");
+        virBufferAdjustIndent(&buf, 2);
+        for (i = 0; i < def->ndisks; i++) {
+            virDomainBackupDiskDefPtr disk = &def->disks[i];
+
+            virBufferEscapeString(&buf, "<disk name='%s'", disk->name);
+            if (disk->backup)
+                virBufferAsprintf(&buf, " backup='%s'",
+                                  virTristateBoolTypeToString(disk->backup));
+            virBufferEscapeString(&buf, " exportname='%s'", disk->exportname);
+            virBufferAddLit(&buf, "/>\n");
+        }
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disks>\n");
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domainbackup>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
@@ -0,0 +1,70 @@
+/*
+ * backup_conf.h: domain backup XML processing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __BACKUP_CONF_H
+# define __BACKUP_CONF_H
+
+# include "internal.h"
+# include "domain_conf.h"
+# include "virstoragefile.h"
+
+/* Items related to backup state */
+
+typedef enum {
+    VIR_DOMAIN_BACKUP_TYPE_DEFAULT = 0,
+    VIR_DOMAIN_BACKUP_TYPE_PUSH,
+
+    VIR_DOMAIN_BACKUP_TYPE_LAST
+} virDomainBackupType;
+
+/* Stores disk-backup information */
+typedef struct _virDomainBackupDiskDef virDomainBackupDiskDef;
+typedef virDomainBackupDiskDef *virDomainBackupDiskDefPtr;
+struct _virDomainBackupDiskDef {
+    char *name;         /* name matching the <target dev='...' of the domain */
+    int idx;            /* index within dom->disks that matches name */
+    int backup;         /* virTristateBool */
+    char *exportname;   /* NBD export receiving the data of the disk */
+};
+
+/* Stores the complete backup description */
+typedef struct _virDomainBackupDef virDomainBackupDef;
+typedef virDomainBackupDef *virDomainBackupDefPtr;
+struct _virDomainBackupDef {
+    int type;               /* virDomainBackupType */
+    char *incremental;      /* name of the checkpoint to start from */
+    virStorageNetHostDefPtr server; /* NBD server receiving the data */
+
+    size_t ndisks; /* should not exceed dom->ndisks */
+    virDomainBackupDiskDef *disks;
+};
+
+virDomainBackupDefPtr virDomainBackupDefParseString(const char *xmlStr,
+                                                    unsigned int flags);
+virDomainBackupDefPtr virDomainBackupDefParseNode(xmlDocPtr xml,
+                                                  xmlNodePtr root,
+                                                  unsigned int flags);
+void virDomainBackupDefFree(virDomainBackupDefPtr def);
+char *virDomainBackupDefFormat(virDomainBackupDefPtr def,
+                               unsigned int flags);
+int virDomainBackupAlignDisks(virDomainBackupDefPtr def,
+                              virDomainDefPtr dom);
+
+VIR_ENUM_DECL(virDomainBackupType)
+
+#endif /* __BACKUP_CONF_H */
@@ -0,0 +1,524 @@
+/*
+ * checkpoint_conf.c: domain checkpoint XML processing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <sys/time.h>
+
+#include "internal.h"
+#include "virbitmap.h"
+#include "virbuffer.h"
+#include "datatypes.h"
+#include "domain_conf.h"
+#include "checkpoint_conf.h"
+#include "virlog.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virxml.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_DOMAIN_CHECKPOINT
+
+VIR_LOG_INIT("conf.checkpoint_conf");
+
+VIR_ENUM_IMPL(virDomainCheckpointType, VIR_DOMAIN_CHECKPOINT_TYPE_LAST,
+              "default",
+              "no",
+              "bitmap")
+
+struct _virDomainCheckpointObjList {
+    /* name string -> virDomainCheckpointDef mapping
+     * for O(1), lockless lookup-by-name */
+    virHashTable *objs;
+};
+
+
+/* Checkpoint Def functions */
+static void
+virDomainCheckpointDiskDefClear(virDomainCheckpointDiskDefPtr disk)
+{
+    VIR_FREE(disk->name);
+    VIR_FREE(disk->bitmap);
+}
+
+void virDomainCheckpointDefFree(virDomainCheckpointDefPtr def)
+{
+    size_t i;
+
+    if (!def)
+        return;
+
+    VIR_FREE(def->name);
+    VIR_FREE(def->description);
+    for (i = 0; i < def->ndisks; i++)
+        virDomainCheckpointDiskDefClear(&def->disks[i]);
+    VIR_FREE(def->disks);
+    VIR_FREE(def);
+}
+
+static int
+virDomainCheckpointDiskDefParseXML(xmlNodePtr node,
+                                   virDomainCheckpointDiskDefPtr def)
+{
+    int ret = -1;
+    char *checkpoint = NULL;
+
+    def->name = virXMLPropString(node, "name");
+    if (!def->name) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("missing name from disk checkpoint element"));
+        goto cleanup;
+    }
+
+    checkpoint = virXMLPropString(node, "checkpoint");
+    if (checkpoint) {
+        def->type = virDomainCheckpointTypeTypeFromString(checkpoint);
+        if (def->type <= 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("unknown disk checkpoint setting '%s'"),
+                           checkpoint);
+            goto cleanup;
+        }
+    }
+
+    def->bitmap = virXMLPropString(node, "bitmap");
+    if (def->bitmap) {
+        if (def->type == VIR_DOMAIN_CHECKPOINT_TYPE_NONE) {
+            virReportError(VIR_ERR_XML_ERROR,
+                           _("bitmap '%s' requires checkpoint of disk '%s'"),
+                           def->bitmap, def->name);
+            goto cleanup;
+        }
+        def->type = VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(checkpoint);
+    if (ret < 0)
+        virDomainCheckpointDiskDefClear(def);
+    return ret;
+}
+
+/* flags is bitwise-or of virDomainCheckpointParseFlags.  */
+static virDomainCheckpointDefPtr
+virDomainCheckpointDefParse(xmlXPathContextPtr ctxt,
+                            unsigned int flags)
+{
+    virDomainCheckpointDefPtr def = NULL;
+    virDomainCheckpointDefPtr ret = NULL;
+    xmlNodePtr *nodes = NULL;
+    size_t i;
+    int n;
+    struct timeval tv;
+
+    if (VIR_ALLOC(def) < 0)
+        goto cleanup;
+
+    gettimeofday(&tv, NULL);
+
+    def->name = virXPathString("string(./name)", ctxt);
+    if (def->name == NULL) {
+        if (flags & VIR_DOMAIN_CHECKPOINT_PARSE_REDEFINE) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("a redefined checkpoint must have a name"));
+            goto cleanup;
+        }
+        if (virAsprintf(&def->name, "%lld", (long long)tv.tv_sec) < 0)
+            goto cleanup;
+    }
+
+    /* The name is used for the metadata file and as the default name of
+     * the dirty bitmaps */
+    if (!*def->name || strchr(def->name, '/')) {
+        virReportError(VIR_ERR_XML_ERROR,
+                       _("invalid checkpoint name '%s'"), def->name);
+        goto cleanup;
+    }
+
+    def->description = virXPathString("string(./description)", ctxt);
+
+    if (flags & VIR_DOMAIN_CHECKPOINT_PARSE_REDEFINE) {
+        if (virXPathLongLong("string(./creationTime)", ctxt,
+                             &def->creationTime) < 0) {
+            virReportError(VIR_ERR_XML_ERROR, "%s",
+                           _("missing creationTime from existing checkpoint"));
+            goto cleanup;
+        }
+    } else {
+        def->creationTime = tv.tv_sec;
+    }
+
+    if ((n = virXPathNodeSet("./disks/*", ctxt, &nodes)) < 0)
+        goto cleanup;
+    if (n && VIR_ALLOC_N(def->disks, n) < 0)
+        goto cleanup;
+    def->ndisks = n;
+    for (i = 0; i < def->ndisks; i++) {
+        if (virDomainCheckpointDiskDefParseXML(nodes[i], &def->disks[i]) < 0)
+            goto cleanup;
+    }
+
+    VIR_STEAL_PTR(ret, def);
+
+ cleanup:
+    VIR_FREE(nodes);
+    virDomainCheckpointDefFree(def);
+
+    return ret;
+}
+
+virDomainCheckpointDefPtr
+virDomainCheckpointDefParseNode(xmlDocPtr xml,
+                                xmlNodePtr root,
+                                unsigned int flags)
+{
+    xmlXPathContextPtr ctxt = NULL;
+    virDomainCheckpointDefPtr def = NULL;
+
+    if (!virXMLNodeNameEqual(root, "domaincheckpoint")) {
+        virReportError(VIR_ERR_XML_ERROR, "%s", _("domaincheckpoint"));
+        goto cleanup;
+    }
+
+    ctxt = xmlXPathNewContext(xml);
+    if (ctxt == NULL) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    ctxt->node = root;
+    def = virDomainCheckpointDefParse(ctxt, flags);
+ cleanup:
+    xmlXPathFreeContext(ctxt);
+    return def;
+}
+
+virDomainCheckpointDefPtr
+virDomainCheckpointDefParseString(const char *xmlStr,
+                                  unsigned int flags)
+{
+    virDomainCheckpointDefPtr ret = NULL;
+    xmlDocPtr xml;
+    int keepBlanksDefault = xmlKeepBlanksDefault(0);
+
+    if ((xml = virXMLParse(NULL, xmlStr, _("(domain_checkpoint)")))) {
+        xmlKeepBlanksDefault(keepBlanksDefault);
+        ret = virDomainCheckpointDefParseNode(xml, xmlDocGetRootElement(xml),
+                                              flags);
+        xmlFreeDoc(xml);
+    }
+    xmlKeepBlanksDefault(keepBlanksDefault);
+
+    return ret;
+}
+
+
+static int
+virDomainCheckpointCompareDiskIndex(const void *a, const void *b)
+{
+    const virDomainCheckpointDiskDef *diska = a;
+    const virDomainCheckpointDiskDef *diskb = b;
+
+    /* Integer overflow shouldn't be a problem here.  */
+    return diska->idx - diskb->idx;
+}
+
+/* Align def->disks to @dom.  Sort the list of def->disks, filling in
+ * any missing disks. Disks without explicit setting get a bitmap named
+ * after the checkpoint, except for empty and read-only disks, which do
+ * not change.  Convert paths to disk targets for uniformity.  Issue an
+ * error and return -1 if any def->disks[n]->name appears more than once
+ * or does not map to dom->disks.  */
+int
+virDomainCheckpointAlignDisks(virDomainCheckpointDefPtr def,
+                              virDomainDefPtr dom)
+{
+    int ret = -1;
+    virBitmapPtr map = NULL;
+    size_t i;
+    int ndisks;
+
+    if (def->ndisks > dom->ndisks) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("too many disk checkpoint requests for domain"));
+        goto cleanup;
+    }
+
+    /* Unlikely to have a guest without disks but technically possible.  */
+    if (!dom->ndisks) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(map = virBitmapNew(dom->ndisks)))
+        goto cleanup;
+
+    /* Double check requested disks.  */
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainCheckpointDiskDefPtr disk = &def->disks[i];
+        int idx = virDomainDiskIndexByName(dom, disk->name, false);
+
+        if (idx < 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("no disk named '%s'"), disk->name);
+            goto cleanup;
+        }
+
+        if (virBitmapIsBitSet(map, idx)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("disk '%s' specified twice"),
+                           disk->name);
+            goto cleanup;
+        }
+        ignore_value(virBitmapSetBit(map, idx));
+        disk->idx = idx;
+
+        if (STRNEQ(disk->name, dom->disks[idx]->dst)) {
+            VIR_FREE(disk->name);
+            if (VIR_STRDUP(disk->name, dom->disks[idx]->dst) < 0)
+                goto cleanup;
+        }
+    }
+
+    /* Provide defaults for all remaining disks.  */
+    ndisks = def->ndisks;
+    if (VIR_EXPAND_N(def->disks, def->ndisks,
+                     dom->ndisks - def->ndisks) < 0)
+        goto cleanup;
+
+    for (i = 0; i < dom->ndisks; i++) {
+        virDomainCheckpointDiskDefPtr disk;
+
+        if (virBitmapIsBitSet(map, i))
+            continue;
+        disk = &def->disks[ndisks++];
+        if (VIR_STRDUP(disk->name, dom->disks[i]->dst) < 0)
+            goto cleanup;
+        disk->idx = i;
+
+        /* Don't track empty or read-only drives */
+        if (virStorageSourceIsEmpty(dom->disks[i]->src) ||
+            dom->disks[i]->src->readonly)
+            disk->type = VIR_DOMAIN_CHECKPOINT_TYPE_NONE;
+    }
+
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainCheckpointDiskDefPtr disk = &def->disks[i];
+
+        if (disk->type == VIR_DOMAIN_CHECKPOINT_TYPE_DEFAULT)
+            disk->type = VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP;
+
+        if (disk->type == VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP &&
+            !disk->bitmap &&
+            VIR_STRDUP(disk->bitmap, def->name) < 0)
+            goto cleanup;
+    }
+
+    qsort(&def->disks[0], def->ndisks, sizeof(def->disks[0]),
+          virDomainCheckpointCompareDiskIndex);
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(map);
+    return ret;
+}
+
+
+virDomainCheckpointDiskDefPtr
+virDomainCheckpointDefFindDisk(virDomainCheckpointDefPtr def,
+                               const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < def->ndisks; i++) {
+        if (STREQ(def->disks[i].name, name))
+            return &def->disks[i];
+    }
+
+    return NULL;
+}
+
+
+static void
+virDomainCheckpointDiskDefFormat(virBufferPtr buf,
+                                 virDomainCheckpointDiskDefPtr disk)
+{
+    if (!disk->name)
+        return;
+
+    virBufferEscapeString(buf, "<disk name='%s'", disk->name);
+    if (disk->type > 0)
+        virBufferAsprintf(buf, " checkpoint='%s'",
+                          virDomainCheckpointTypeTypeToString(disk->type));
+    virBufferEscapeString(buf, " bitmap='%s'", disk->bitmap);
+    virBufferAddLit(buf, "/>\n");
+}
+
+
+char *
+virDomainCheckpointDefFormat(virDomainCheckpointDefPtr def,
+                             unsigned int flags)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virCheckFlags(0, NULL);
+
+    virBufferAddLit(&buf, "<domaincheckpoint>\n");
+    virBufferAdjustIndent(&buf, 2);
+
+    virBufferEscapeString(&buf, "<name>%s</name>\n", def->name);
+    if (def->description)
+        virBufferEscapeString(&buf, "<description>%s</description>\n",
+                              def->description);
+    virBufferAsprintf(&buf, "<creationTime>%lld</creationTime>\n",
+                      def->creationTime);
+
+    if (def->ndisks) {
+        virBufferAddLit(&buf, "<disks>\n");
+        virBufferAdjustIndent(&buf, 2);
+        for (i = 0; i < def->ndisks; i++)
+            virDomainCheckpointDiskDefFormat(&buf, &def->disks[i]);
+        virBufferAdjustIndent(&buf, -2);
+        virBufferAddLit(&buf, "</disks>\n");
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domaincheckpoint>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/* Checkpoint Obj List functions */
+static void
+virDomainCheckpointObjListDataFree(void *payload,
+                                   const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainCheckpointDefFree(payload);
+}
+
+virDomainCheckpointObjListPtr
+virDomainCheckpointObjListNew(void)
+{
+    virDomainCheckpointObjListPtr checkpoints;
+    if (VIR_ALLOC(checkpoints) < 0)
+        return NULL;
+    checkpoints->objs = virHashCreate(10, virDomainCheckpointObjListDataFree);
+    if (!checkpoints->objs) {
+        VIR_FREE(checkpoints);
+        return NULL;
+    }
+    return checkpoints;
+}
+
+void
+virDomainCheckpointObjListFree(virDomainCheckpointObjListPtr checkpoints)
+{
+    if (!checkpoints)
+        return;
+    virHashFree(checkpoints->objs);
+    VIR_FREE(checkpoints);
+}
+
+/* Takes ownership of @def on success */
+int
+virDomainCheckpointAssignDef(virDomainCheckpointObjListPtr checkpoints,
+                             virDomainCheckpointDefPtr def)
+{
+    if (virHashLookup(checkpoints->objs, def->name) != NULL) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unexpected domain checkpoint %s already exists"),
+                       def->name);
+        return -1;
+    }
+
+    return virHashAddEntry(checkpoints->objs, def->name, def);
+}
+
+virDomainCheckpointDefPtr
+virDomainCheckpointFindByName(virDomainCheckpointObjListPtr checkpoints,
+                              const char *name)
+{
+    return virHashLookup(checkpoints->objs, name);
+}
+
+void
+virDomainCheckpointObjListRemove(virDomainCheckpointObjListPtr checkpoints,
+                                 virDomainCheckpointDefPtr def)
+{
+    virHashRemoveEntry(checkpoints->objs, def->name);
+}
+
+int
+virDomainCheckpointObjListNum(virDomainCheckpointObjListPtr checkpoints)
+{
+    return virHashSize(checkpoints->objs);
+}
+
+int
+virDomainCheckpointForEach(virDomainCheckpointObjListPtr checkpoints,
+                           virHashIterator iter,
+                           void *data)
+{
+    return virHashForEach(checkpoints->objs, iter, data);
+}
+
+int
+virDomainListCheckpoints(virDomainCheckpointObjListPtr checkpoints,
+                         virDomainPtr dom,
+                         virDomainCheckpointPtr **chks,
+                         unsigned int flags)
+{
+    virHashKeyValuePairPtr items = NULL;
+    virDomainCheckpointPtr *list = NULL;
+    int count = virHashSize(checkpoints->objs);
+    int ret = -1;
+    size_t i;
+
+    virCheckFlags(0, -1);
+
+    if (!chks || count < 0)
+        return count;
+
+    if (!(items = virHashGetItems(checkpoints->objs, NULL)) ||
+        VIR_ALLOC_N(list, count + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < count; i++) {
+        if (!(list[i] = virGetDomainCheckpoint(dom, items[i].key)))
+            goto cleanup;
+    }
+
+    VIR_STEAL_PTR(*chks, list);
+    ret = count;
+
+ cleanup:
+    VIR_FREE(items);
+    if (list) {
+        for (i = 0; i < count; i++)
+            virObjectUnref(list[i]);
+        VIR_FREE(list);
+    }
+    return ret;
+}
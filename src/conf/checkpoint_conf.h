@@ -0,0 +1,97 @@
+/*
+ * checkpoint_conf.h: domain checkpoint XML processing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __CHECKPOINT_CONF_H
+# define __CHECKPOINT_CONF_H
+
+# include "internal.h"
+# include "domain_conf.h"
+
+/* Items related to checkpoint state */
+
+typedef enum {
+    VIR_DOMAIN_CHECKPOINT_TYPE_DEFAULT = 0,
+    VIR_DOMAIN_CHECKPOINT_TYPE_NONE,
+    VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP,
+
+    VIR_DOMAIN_CHECKPOINT_TYPE_LAST
+} virDomainCheckpointType;
+
+/* Stores disk-checkpoint information */
+typedef struct _virDomainCheckpointDiskDef virDomainCheckpointDiskDef;
+typedef virDomainCheckpointDiskDef *virDomainCheckpointDiskDefPtr;
+struct _virDomainCheckpointDiskDef {
+    char *name;     /* name matching the <target dev='...' of the domain */
+    int idx;        /* index within dom->disks that matches name */
+    int type;       /* virDomainCheckpointType */
+    char *bitmap;   /* name of the dirty bitmap tracking changes */
+};
+
+/* Stores the complete checkpoint metadata */
+typedef struct _virDomainCheckpointDef virDomainCheckpointDef;
+typedef virDomainCheckpointDef *virDomainCheckpointDefPtr;
+struct _virDomainCheckpointDef {
+    char *name;
+    char *description;
+    long long creationTime; /* in seconds */
+
+    size_t ndisks; /* should not exceed dom->ndisks */
+    virDomainCheckpointDiskDef *disks;
+};
+
+virDomainCheckpointObjListPtr virDomainCheckpointObjListNew(void);
+void virDomainCheckpointObjListFree(virDomainCheckpointObjListPtr checkpoints);
+
+typedef enum {
+    VIR_DOMAIN_CHECKPOINT_PARSE_REDEFINE = 1 << 0,
+} virDomainCheckpointParseFlags;
+
+virDomainCheckpointDefPtr virDomainCheckpointDefParseString(const char *xmlStr,
+                                                            unsigned int flags);
+virDomainCheckpointDefPtr virDomainCheckpointDefParseNode(xmlDocPtr xml,
+                                                          xmlNodePtr root,
+                                                          unsigned int flags);
+void virDomainCheckpointDefFree(virDomainCheckpointDefPtr def);
+char *virDomainCheckpointDefFormat(virDomainCheckpointDefPtr def,
+                                   unsigned int flags);
+int virDomainCheckpointAlignDisks(virDomainCheckpointDefPtr def,
+                                  virDomainDefPtr dom);
+virDomainCheckpointDiskDefPtr
+virDomainCheckpointDefFindDisk(virDomainCheckpointDefPtr def,
+                               const char *name);
+
+int virDomainCheckpointAssignDef(virDomainCheckpointObjListPtr checkpoints,
+                                 virDomainCheckpointDefPtr def);
+virDomainCheckpointDefPtr
+virDomainCheckpointFindByName(virDomainCheckpointObjListPtr checkpoints,
+                              const char *name);
+void virDomainCheckpointObjListRemove(virDomainCheckpointObjListPtr checkpoints,
+                                      virDomainCheckpointDefPtr def);
+int virDomainCheckpointObjListNum(virDomainCheckpointObjListPtr checkpoints);
+int virDomainCheckpointForEach(virDomainCheckpointObjListPtr checkpoints,
+                               virHashIterator iter,
+                               void *data);
+
+int virDomainListCheckpoints(virDomainCheckpointObjListPtr checkpoints,
+                             virDomainPtr dom,
+                             virDomainCheckpointPtr **chks,
+                             unsigned int flags);
+
+VIR_ENUM_DECL(virDomainCheckpointType)
+
+#endif /* __CHECKPOINT_CONF_H */
@@ -23,6 +23,8 @@
 
 #include <config.h>
 
+#include <strings.h>
+
 #include "viralloc.h"
 #include "virlog.h"
 #include "virstring.h"
@@ -372,31 +374,33 @@ virDomainPCIAddressBusSetModel(virDomainPCIAddressBusPtr bus,
 }
 
 
+/* Mask of the slots of @bus from @slot up to bus->maxSlot */
+static uint32_t
+virDomainPCIAddressBusSlotMask(virDomainPCIAddressBusPtr bus,
+                               size_t slot)
+{
+    if (slot > bus->maxSlot)
+        return 0;
+
+    return ((1ULL << (bus->maxSlot + 1)) - 1) & ~((1ULL << slot) - 1);
+}
+
+
 bool
 virDomainPCIAddressBusIsFullyReserved(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
-
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (!bus->slot[i].functions)
-            return false;
-    }
+    uint32_t mask = virDomainPCIAddressBusSlotMask(bus, bus->minSlot);
 
-    return true;
+    return (bus->usedSlots & mask) == mask;
 }
 
 
 static bool ATTRIBUTE_NONNULL(1)
 virDomainPCIAddressBusIsEmpty(virDomainPCIAddressBusPtr bus)
 {
-    size_t i;
-
-    for (i = bus->minSlot; i <= bus->maxSlot; i++) {
-        if (bus->slot[i].functions)
-            return false;
-    }
+    uint32_t mask = virDomainPCIAddressBusSlotMask(bus, bus->minSlot);
 
-    return true;
+    return !(bus->usedSlots & mask);
 }
 
 
@@ -655,6 +659,7 @@ virDomainPCIAddressReserveAddrInternal(virDomainPCIAddressSetPtr addrs,
 
     /* mark the requested function as reserved */
     bus->slot[addr->slot].functions |= (1 << addr->function);
+    bus->usedSlots |= 1U << addr->slot;
     VIR_DEBUG("Reserving PCI address %s (aggregate='%s')", addrStr,
               bus->slot[addr->slot].aggregate ? "true" : "false");
 
@@ -724,7 +729,11 @@ void
 virDomainPCIAddressReleaseAddr(virDomainPCIAddressSetPtr addrs,
                                virPCIDeviceAddressPtr addr)
 {
-    addrs->buses[addr->bus].slot[addr->slot].functions &= ~(1 << addr->function);
+    virDomainPCIAddressBusPtr bus = &addrs->buses[addr->bus];
+
+    bus->slot[addr->slot].functions &= ~(1 << addr->function);
+    if (!bus->slot[addr->slot].functions)
+        bus->usedSlots &= ~(1U << addr->slot);
 }
 
 virDomainPCIAddressSetPtr
@@ -765,63 +774,72 @@ virDomainPCIAddressFindUnusedFunctionOnBus(virDomainPCIAddressBusPtr bus,
                                            virDomainPCIConnectFlags flags,
                                            bool *found)
 {
-    int ret = -1;
-    char *addrStr = NULL;
+    uint32_t freeSlots;
 
     *found = false;
 
-    if (!(addrStr = virPCIDeviceAddressAsString(searchAddr)))
-        goto cleanup;
-
-    if (!virDomainPCIAddressFlagsCompatible(searchAddr, addrStr, bus->flags,
+    /* no error is reported, so the address string isn't needed */
+    if (!virDomainPCIAddressFlagsCompatible(searchAddr, NULL, bus->flags,
                                             flags, false, false)) {
         VIR_DEBUG("PCI bus %.4x:%.2x is not compatible with the device",
                   searchAddr->domain, searchAddr->bus);
-    } else {
-        while (searchAddr->slot <= bus->maxSlot) {
-            if (bus->slot[searchAddr->slot].functions == 0) {
+        return 0;
+    }
+
+    freeSlots = ~bus->usedSlots &
+                virDomainPCIAddressBusSlotMask(bus, searchAddr->slot);
+
+    /* Without aggregation only a completely unused slot will do, which
+     * the bitmap gives away directly */
+    if (!(flags & VIR_PCI_CONNECT_AGGREGATE_SLOT)) {
+        if (freeSlots) {
+            searchAddr->slot = ffs(freeSlots) - 1;
+            *found = true;
+        } else {
+            VIR_DEBUG("PCI bus %.4x:%.2x has no free slot",
+                      searchAddr->domain, searchAddr->bus);
+        }
+        return 0;
+    }
+
+    while (searchAddr->slot <= bus->maxSlot) {
+        if (bus->slot[searchAddr->slot].functions == 0) {
+            *found = true;
+            break;
+        }
+
+        if (bus->slot[searchAddr->slot].aggregate) {
+            /* slot and device are okay with aggregating devices */
+            if ((bus->slot[searchAddr->slot].functions &
+                 (1 << searchAddr->function)) == 0) {
                 *found = true;
                 break;
             }
 
-            if (flags & VIR_PCI_CONNECT_AGGREGATE_SLOT &&
-                bus->slot[searchAddr->slot].aggregate) {
-                /* slot and device are okay with aggregating devices */
-                if ((bus->slot[searchAddr->slot].functions &
-                     (1 << searchAddr->function)) == 0) {
-                    *found = true;
-                    break;
-                }
-
-                /* also check for *any* unused function if caller
-                 * sent function = -1
-                 */
-                if (function == -1) {
-                    while (searchAddr->function < 8) {
-                        if ((bus->slot[searchAddr->slot].functions &
-                             (1 << searchAddr->function)) == 0) {
-                            *found = true;
-                            break; /* out of inner while */
-                        }
-                        searchAddr->function++;
+            /* also check for *any* unused function if caller
+             * sent function = -1
+             */
+            if (function == -1) {
+                while (searchAddr->function < 8) {
+                    if ((bus->slot[searchAddr->slot].functions &
+                         (1 << searchAddr->function)) == 0) {
+                        *found = true;
+                        break; /* out of inner while */
                     }
-                    if (*found)
-                       break; /* out of outer while */
-                    searchAddr->function = 0; /* reset for next try */
+                    searchAddr->function++;
                 }
+                if (*found)
+                   break; /* out of outer while */
+                searchAddr->function = 0; /* reset for next try */
             }
-
-            VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
-                      searchAddr->domain, searchAddr->bus, searchAddr->slot);
-            searchAddr->slot++;
         }
-    }
 
-    ret = 0;
+        VIR_DEBUG("PCI slot %.4x:%.2x:%.2x already in use",
+                  searchAddr->domain, searchAddr->bus, searchAddr->slot);
+        searchAddr->slot++;
+    }
 
- cleanup:
-    VIR_FREE(addrStr);
-    return ret;
+    return 0;
 }
 
 
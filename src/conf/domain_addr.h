@@ -102,6 +102,10 @@ typedef struct {
      * bit is set, that function is in use by a device.
      */
     virDomainPCIAddressSlot slot[VIR_PCI_ADDRESS_SLOT_LAST + 1];
+    /* One bit per slot, set if any function of the slot is in use, so
+     * that free slots can be found without looking at each of them.
+     */
+    uint32_t usedSlots;
 
     /* See virDomainDeviceInfo::isolationGroup */
     unsigned int isolationGroup;
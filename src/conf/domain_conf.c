@@ -35,6 +35,7 @@
 #include "domain_addr.h"
 #include "domain_conf.h"
 #include "snapshot_conf.h"
+#include "checkpoint_conf.h"
 #include "viralloc.h"
 #include "virxml.h"
 #include "viruuid.h"
@@ -59,11 +60,15 @@
 #include "virnetdevmacvlan.h"
 #include "virhostdev.h"
 #include "virmdev.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
 VIR_LOG_INIT("conf.domain_conf");
 
+/* shared by all disks without any block I/O tuning */
+static const virDomainBlockIoTuneInfo virDomainBlockIoTuneDefault;
+
 /* This structure holds various callbacks and data needed
  * while parsing and creating domain XMLs */
 struct _virDomainXMLOption {
@@ -394,7 +399,8 @@ VIR_ENUM_IMPL(virDomainFSDriver, VIR_DOMAIN_FS_DRIVER_TYPE_LAST,
               "handle",
               "loop",
               "nbd",
-              "ploop")
+              "ploop",
+              "overlay")
 
 VIR_ENUM_IMPL(virDomainFSAccessMode, VIR_DOMAIN_FS_ACCESSMODE_LAST,
               "passthrough",
@@ -841,6 +847,10 @@ VIR_ENUM_IMPL(virDomainCpuPlacementMode, VIR_DOMAIN_CPU_PLACEMENT_MODE_LAST,
               "static",
               "auto");
 
+VIR_ENUM_IMPL(virDomainCputuneProfile, VIR_DOMAIN_CPUTUNE_PROFILE_LAST,
+              "none",
+              "dedicated");
+
 VIR_ENUM_IMPL(virDomainDiskTray, VIR_DOMAIN_DISK_TRAY_LAST,
               "closed",
               "open");
@@ -870,6 +880,11 @@ VIR_ENUM_IMPL(virDomainTPMVersion, VIR_DOMAIN_TPM_VERSION_LAST,
 VIR_ENUM_IMPL(virDomainIOMMUModel, VIR_DOMAIN_IOMMU_MODEL_LAST,
               "intel")
 
+VIR_ENUM_IMPL(virDomainIOThreadsAuto, VIR_DOMAIN_IOTHREADS_AUTO_LAST,
+              "none",
+              "per-disk",
+              "shared")
+
 VIR_ENUM_IMPL(virDomainVsockModel, VIR_DOMAIN_VSOCK_MODEL_LAST,
               "default",
               "virtio")
@@ -924,7 +939,7 @@ VIR_ENUM_IMPL(virDomainHPTResizing,
  * <mirror> XML (remaining types are not two-phase). */
 VIR_ENUM_DECL(virDomainBlockJob)
 VIR_ENUM_IMPL(virDomainBlockJob, VIR_DOMAIN_BLOCK_JOB_TYPE_LAST,
-              "", "", "copy", "", "active-commit")
+              "", "", "copy", "", "active-commit", "")
 
 VIR_ENUM_IMPL(virDomainMemoryModel,
               VIR_DOMAIN_MEMORY_MODEL_LAST,
@@ -1798,7 +1813,9 @@ virDomainDiskDefFree(virDomainDiskDefPtr def)
     VIR_FREE(def->vendor);
     VIR_FREE(def->product);
     VIR_FREE(def->domain_name);
-    VIR_FREE(def->blkdeviotune.group_name);
+    if (def->blkdeviotune)
+        VIR_FREE(def->blkdeviotune->group_name);
+    VIR_FREE(def->blkdeviotune);
     VIR_FREE(def->virtio);
     virDomainDeviceInfoClear(&def->info);
     virObjectUnref(def->privateData);
@@ -2867,7 +2884,7 @@ virDomainIOThreadIDDefArrayFree(virDomainIOThreadIDDefPtr *def,
 }
 
 
-static int
+int
 virDomainIOThreadIDDefArrayInit(virDomainDefPtr def,
                                 unsigned int iothreads)
 {
@@ -2979,6 +2996,37 @@ virDomainSEVDefFree(virDomainSEVDefPtr def)
 }
 
 
+/* Number of flag combinations virDomainDefXMLCacheStore keeps the
+ * XML for */
+#define VIR_DOMAIN_DEF_XML_CACHE_SIZE 4
+
+typedef struct _virDomainDefXMLCacheEntry virDomainDefXMLCacheEntry;
+struct _virDomainDefXMLCacheEntry {
+    unsigned int flags;
+    unsigned int generation;
+    char *xml;
+};
+
+struct _virDomainDefXMLCache {
+    virDomainDefXMLCacheEntry entries[VIR_DOMAIN_DEF_XML_CACHE_SIZE];
+    size_t next;
+};
+
+
+static void
+virDomainDefXMLCacheFree(virDomainDefXMLCachePtr cache)
+{
+    size_t i;
+
+    if (!cache)
+        return;
+
+    for (i = 0; i < VIR_DOMAIN_DEF_XML_CACHE_SIZE; i++)
+        VIR_FREE(cache->entries[i].xml);
+    VIR_FREE(cache);
+}
+
+
 void virDomainDefFree(virDomainDefPtr def)
 {
     size_t i;
@@ -3165,6 +3213,8 @@ void virDomainDefFree(virDomainDefPtr def)
 
     xmlFreeNode(def->metadata);
 
+    virDomainDefXMLCacheFree(def->xmlCache);
+
     VIR_FREE(def);
 }
 
@@ -3181,6 +3231,7 @@ static void virDomainObjDispose(void *obj)
         (dom->privateDataFreeFunc)(dom->privateData);
 
     virDomainSnapshotObjListFree(dom->snapshots);
+    virDomainCheckpointObjListFree(dom->checkpoints);
 }
 
 virDomainObjPtr
@@ -3210,6 +3261,9 @@ virDomainObjNew(virDomainXMLOptionPtr xmlopt)
     if (!(domain->snapshots = virDomainSnapshotObjListNew()))
         goto error;
 
+    if (!(domain->checkpoints = virDomainCheckpointObjListNew()))
+        goto error;
+
     virObjectLock(domain);
     virDomainObjSetState(domain, VIR_DOMAIN_SHUTOFF,
                                  VIR_DOMAIN_SHUTOFF_UNKNOWN);
@@ -3275,6 +3329,8 @@ void virDomainObjAssignDef(virDomainObjPtr domain,
             domain->def = def;
         }
     }
+
+    virDomainObjMarkChanged(domain);
 }
 
 
@@ -3358,12 +3414,15 @@ virDomainObjWaitUntil(virDomainObjPtr vm,
  * @param caps pointer to capabilities info
  * @param xmlopt pointer to XML parser configuration object
  * @param domain domain object pointer
+ * @param parseOpaque opaque data passed to the post parse callbacks, which
+ *                    spares them looking up what the caller already has
  * @return 0 on success, -1 on failure
  */
 int
 virDomainObjSetDefTransient(virCapsPtr caps,
                             virDomainXMLOptionPtr xmlopt,
-                            virDomainObjPtr domain)
+                            virDomainObjPtr domain,
+                            void *parseOpaque)
 {
     int ret = -1;
 
@@ -3373,7 +3432,8 @@ virDomainObjSetDefTransient(virCapsPtr caps,
     if (domain->newDef)
         return 0;
 
-    if (!(domain->newDef = virDomainDefCopy(domain->def, caps, xmlopt, NULL, false)))
+    if (!(domain->newDef = virDomainDefCopy(domain->def, caps, xmlopt,
+                                            parseOpaque, false)))
         goto out;
 
     ret = 0;
@@ -3415,7 +3475,7 @@ virDomainObjGetPersistentDef(virCapsPtr caps,
                              virDomainObjPtr domain)
 {
     if (virDomainObjIsActive(domain) &&
-        virDomainObjSetDefTransient(caps, xmlopt, domain) < 0)
+        virDomainObjSetDefTransient(caps, xmlopt, domain, NULL) < 0)
         return NULL;
 
     if (domain->newDef)
@@ -6207,6 +6267,34 @@ virDomainDefLifecycleActionValidate(const virDomainDef *def)
 }
 
 
+static int
+virDomainDefCputuneValidate(const virDomainDef *def)
+{
+    size_t i;
+
+    if (def->cputune.profile != VIR_DOMAIN_CPUTUNE_PROFILE_DEDICATED)
+        return 0;
+
+    if (def->placement_mode == VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("cputune profile 'dedicated' is not supported with "
+                         "automatic vCPU placement"));
+        return -1;
+    }
+
+    for (i = 0; i < def->maxvcpus; i++) {
+        if (!def->vcpus[i]->cpumask && !def->cpumask) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("cputune profile 'dedicated' requires vCPU %zu "
+                             "to be pinned to host CPUs"), i);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
 static int
 virDomainDefMemtuneValidate(const virDomainDef *def)
 {
@@ -6294,6 +6382,9 @@ virDomainDefValidateInternal(const virDomainDef *def)
     if (virDomainDefLifecycleActionValidate(def) < 0)
         return -1;
 
+    if (virDomainDefCputuneValidate(def) < 0)
+        return -1;
+
     if (virDomainDefMemtuneValidate(def) < 0)
         return -1;
 
@@ -8897,16 +8988,19 @@ virDomainDiskBackingStoreParse(xmlXPathContextPtr ctxt,
 
 #define PARSE_IOTUNE(val) \
     if (virXPathULongLong("string(./iotune/" #val ")", \
-                          ctxt, &def->blkdeviotune.val) == -2) { \
+                          ctxt, &iotune.val) == -2) { \
         virReportError(VIR_ERR_XML_ERROR, \
                        _("disk iotune field '%s' must be an integer"), #val); \
-        return -1; \
+        goto cleanup; \
     }
 
 static int
 virDomainDiskDefIotuneParse(virDomainDiskDefPtr def,
                             xmlXPathContextPtr ctxt)
 {
+    virDomainBlockIoTuneInfo iotune = { 0 };
+    int ret = -1;
+
     PARSE_IOTUNE(total_bytes_sec);
     PARSE_IOTUNE(read_bytes_sec);
     PARSE_IOTUNE(write_bytes_sec);
@@ -8930,50 +9024,62 @@ virDomainDiskDefIotuneParse(virDomainDiskDefPtr def,
     PARSE_IOTUNE(read_iops_sec_max_length);
     PARSE_IOTUNE(write_iops_sec_max_length);
 
-    def->blkdeviotune.group_name =
+    iotune.group_name =
         virXPathString("string(./iotune/group_name)", ctxt);
 
-    if ((def->blkdeviotune.total_bytes_sec &&
-         def->blkdeviotune.read_bytes_sec) ||
-        (def->blkdeviotune.total_bytes_sec &&
-         def->blkdeviotune.write_bytes_sec)) {
+    if ((iotune.total_bytes_sec &&
+         iotune.read_bytes_sec) ||
+        (iotune.total_bytes_sec &&
+         iotune.write_bytes_sec)) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("total and read/write bytes_sec "
                          "cannot be set at the same time"));
-        return -1;
+        goto cleanup;
     }
 
-    if ((def->blkdeviotune.total_iops_sec &&
-         def->blkdeviotune.read_iops_sec) ||
-        (def->blkdeviotune.total_iops_sec &&
-         def->blkdeviotune.write_iops_sec)) {
+    if ((iotune.total_iops_sec &&
+         iotune.read_iops_sec) ||
+        (iotune.total_iops_sec &&
+         iotune.write_iops_sec)) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("total and read/write iops_sec "
                          "cannot be set at the same time"));
-        return -1;
+        goto cleanup;
     }
 
-    if ((def->blkdeviotune.total_bytes_sec_max &&
-         def->blkdeviotune.read_bytes_sec_max) ||
-        (def->blkdeviotune.total_bytes_sec_max &&
-         def->blkdeviotune.write_bytes_sec_max)) {
+    if ((iotune.total_bytes_sec_max &&
+         iotune.read_bytes_sec_max) ||
+        (iotune.total_bytes_sec_max &&
+         iotune.write_bytes_sec_max)) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("total and read/write bytes_sec_max "
                          "cannot be set at the same time"));
-        return -1;
+        goto cleanup;
     }
 
-    if ((def->blkdeviotune.total_iops_sec_max &&
-         def->blkdeviotune.read_iops_sec_max) ||
-        (def->blkdeviotune.total_iops_sec_max &&
-         def->blkdeviotune.write_iops_sec_max)) {
+    if ((iotune.total_iops_sec_max &&
+         iotune.read_iops_sec_max) ||
+        (iotune.total_iops_sec_max &&
+         iotune.write_iops_sec_max)) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
                        _("total and read/write iops_sec_max "
                          "cannot be set at the same time"));
-        return -1;
+        goto cleanup;
     }
 
-    return 0;
+    /* most disks aren't tuned at all, don't waste memory on them */
+    if (memcmp(&iotune, &virDomainBlockIoTuneDefault, sizeof(iotune)) != 0) {
+        if (VIR_ALLOC(def->blkdeviotune) < 0)
+            goto cleanup;
+        *def->blkdeviotune = iotune;
+        iotune.group_name = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(iotune.group_name);
+    return ret;
 }
 #undef PARSE_IOTUNE
 
@@ -17832,7 +17938,7 @@ virDomainIdmapDefParseXML(xmlXPathContextPtr ctxt,
  *
  * Format is :
  *
- *     <iothreads>4</iothreads>
+ *     <iothreads auto='shared'>4</iothreads>
  *     <iothreadids>
  *       <iothread id='1'/>
  *       <iothread id='3'/>
@@ -17890,6 +17996,15 @@ virDomainDefParseIOThreads(virDomainDefPtr def,
     }
     VIR_FREE(tmp);
 
+    tmp = virXPathString("string(./iothreads[1]/@auto)", ctxt);
+    if (tmp &&
+        (def->iothreadsAuto = virDomainIOThreadsAutoTypeFromString(tmp)) <= 0) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown iothreads auto policy '%s'"), tmp);
+        goto error;
+    }
+    VIR_FREE(tmp);
+
     /* Extract any iothread id's defined */
     if ((n = virXPathNodeSet("./iothreadids/iothread", ctxt, &nodes)) < 0)
         goto error;
@@ -17923,6 +18038,7 @@ virDomainDefParseIOThreads(virDomainDefPtr def,
 
  error:
     VIR_FREE(nodes);
+    VIR_FREE(tmp);
     return -1;
 }
 
@@ -19453,6 +19569,15 @@ virDomainDefParseXML(xmlDocPtr xml,
         VIR_FREE(tmp);
     }
 
+    if ((n = virXPathUInt("string(./memoryBacking/allocation/@threads)",
+                          ctxt, &def->mem.allocation_threads)) == -2 ||
+        (n == 0 && def->mem.allocation_threads == 0)) {
+        virReportError(VIR_ERR_XML_ERROR, "%s",
+                       _("memoryBacking/allocation/threads must be "
+                         "a positive integer"));
+        goto error;
+    }
+
     if (virXPathNode("./memoryBacking/hugepages", ctxt)) {
         /* hugepages will be used */
         if ((n = virXPathNodeSet("./memoryBacking/hugepages/page", ctxt, &nodes)) < 0) {
@@ -19545,6 +19670,16 @@ virDomainDefParseXML(xmlDocPtr xml,
         goto error;
 
     /* Extract cpu tunables. */
+    if ((tmp = virXPathString("string(./cputune/@profile)", ctxt))) {
+        if ((def->cputune.profile =
+             virDomainCputuneProfileTypeFromString(tmp)) <= 0) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("unsupported cputune profile '%s'"), tmp);
+            goto error;
+        }
+        VIR_FREE(tmp);
+    }
+
     if ((n = virXPathULongLong("string(./cputune/shares[1])", ctxt,
                                &def->cputune.shares)) < -1) {
         virReportError(VIR_ERR_XML_ERROR, "%s",
@@ -20188,6 +20323,15 @@ virDomainDefParseXML(xmlDocPtr xml,
                                      virDomainLockFailureTypeFromString) < 0)
         goto error;
 
+    if ((tmp = virXPathString("string(./startup/@priority)", ctxt))) {
+        if (virStrToLong_i(tmp, NULL, 10, &def->startupPriority) < 0) {
+            virReportError(VIR_ERR_XML_ERROR,
+                           _("invalid startup priority '%s'"), tmp);
+            goto error;
+        }
+        VIR_FREE(tmp);
+    }
+
     if (virDomainPMStateParseXML(ctxt,
                                  "string(./pm/suspend-to-mem/@enabled)",
                                  &def->pm.s3) < 0)
@@ -23793,18 +23937,22 @@ virDomainDiskBackingStoreFormat(virBufferPtr buf,
 
 
 #define FORMAT_IOTUNE(val) \
-        if (disk->blkdeviotune.val) { \
+        if (iotune->val) { \
             virBufferAsprintf(&childBuf, "<" #val ">%llu</" #val ">\n", \
-                              disk->blkdeviotune.val); \
+                              iotune->val); \
         }
 
 static int
 virDomainDiskDefFormatIotune(virBufferPtr buf,
                              virDomainDiskDefPtr disk)
 {
+    const virDomainBlockIoTuneInfo *iotune = disk->blkdeviotune;
     virBuffer childBuf = VIR_BUFFER_INITIALIZER;
     int ret = -1;
 
+    if (!iotune)
+        return 0;
+
     virBufferSetChildIndent(&childBuf, buf);
 
     FORMAT_IOTUNE(total_bytes_sec);
@@ -23821,14 +23969,14 @@ virDomainDiskDefFormatIotune(virBufferPtr buf,
     FORMAT_IOTUNE(read_iops_sec_max);
     FORMAT_IOTUNE(write_iops_sec_max);
 
-    if (disk->blkdeviotune.size_iops_sec) {
+    if (iotune->size_iops_sec) {
         virBufferAsprintf(&childBuf, "<size_iops_sec>%llu</size_iops_sec>\n",
-                          disk->blkdeviotune.size_iops_sec);
+                          iotune->size_iops_sec);
     }
 
-    if (disk->blkdeviotune.group_name) {
+    if (iotune->group_name) {
         virBufferEscapeString(&childBuf, "<group_name>%s</group_name>\n",
-                              disk->blkdeviotune.group_name);
+                              iotune->group_name);
     }
 
     FORMAT_IOTUNE(total_bytes_sec_max_length);
@@ -27302,7 +27450,17 @@ virDomainCputuneDefFormat(virBufferPtr buf,
     if (virBufferCheckError(&childrenBuf) < 0)
         return -1;
 
-    if (virBufferUse(&childrenBuf)) {
+    if (def->cputune.profile) {
+        virBufferAsprintf(buf, "<cputune profile='%s'",
+                          virDomainCputuneProfileTypeToString(def->cputune.profile));
+        if (virBufferUse(&childrenBuf)) {
+            virBufferAddLit(buf, ">\n");
+            virBufferAddBuffer(buf, &childrenBuf);
+            virBufferAddLit(buf, "</cputune>\n");
+        } else {
+            virBufferAddLit(buf, "/>\n");
+        }
+    } else if (virBufferUse(&childrenBuf)) {
         virBufferAddLit(buf, "<cputune>\n");
         virBufferAddBuffer(buf, &childrenBuf);
         virBufferAddLit(buf, "</cputune>\n");
@@ -27475,9 +27633,16 @@ virDomainMemtuneFormat(virBufferPtr buf,
     if (mem->access)
         virBufferAsprintf(&childBuf, "<access mode='%s'/>\n",
                           virDomainMemoryAccessTypeToString(mem->access));
-    if (mem->allocation)
-        virBufferAsprintf(&childBuf, "<allocation mode='%s'/>\n",
-                          virDomainMemoryAllocationTypeToString(mem->allocation));
+    if (mem->allocation || mem->allocation_threads) {
+        virBufferAddLit(&childBuf, "<allocation");
+        if (mem->allocation)
+            virBufferAsprintf(&childBuf, " mode='%s'",
+                              virDomainMemoryAllocationTypeToString(mem->allocation));
+        if (mem->allocation_threads)
+            virBufferAsprintf(&childBuf, " threads='%u'",
+                              mem->allocation_threads);
+        virBufferAddLit(&childBuf, "/>\n");
+    }
     if (mem->discard)
         virBufferAddLit(&childBuf, "<discard/>\n");
 
@@ -27683,9 +27848,12 @@ virDomainDefFormatInternal(virDomainDefPtr def,
     if (virDomainCpuDefFormat(buf, def) < 0)
         goto error;
 
-    if (def->niothreadids > 0) {
-        virBufferAsprintf(buf, "<iothreads>%zu</iothreads>\n",
-                          def->niothreadids);
+    if (def->niothreadids > 0 || def->iothreadsAuto) {
+        virBufferAddLit(buf, "<iothreads");
+        if (def->iothreadsAuto)
+            virBufferAsprintf(buf, " auto='%s'",
+                              virDomainIOThreadsAutoTypeToString(def->iothreadsAuto));
+        virBufferAsprintf(buf, ">%zu</iothreads>\n", def->niothreadids);
         if (virDomainDefIothreadShouldFormat(def)) {
             virBufferAddLit(buf, "<iothreadids>\n");
             virBufferAdjustIndent(buf, 2);
@@ -28157,6 +28325,10 @@ virDomainDefFormatInternal(virDomainDefPtr def,
                                       virDomainLockFailureTypeToString) < 0)
         goto error;
 
+    if (def->startupPriority)
+        virBufferAsprintf(buf, "<startup priority='%d'/>\n",
+                          def->startupPriority);
+
     if (def->pm.s3 || def->pm.s4) {
         virBufferAddLit(buf, "<pm>\n");
         virBufferAdjustIndent(buf, 2);
@@ -28382,6 +28554,113 @@ virDomainDefFormat(virDomainDefPtr def, virCapsPtr caps, unsigned int flags)
 }
 
 
+/**
+ * virDomainDefBumpGeneration:
+ * @def: domain definition
+ *
+ * Invalidates the XML cached for @def. Code changing a definition in
+ * place has to call this unless it saves the definition afterwards
+ * with virDomainSaveConfig or one of the virDomainSaveStatus functions,
+ * which do it themselves.
+ */
+void
+virDomainDefBumpGeneration(virDomainDefPtr def)
+{
+    size_t i;
+
+    def->generation++;
+
+    if (!def->xmlCache)
+        return;
+
+    for (i = 0; i < VIR_DOMAIN_DEF_XML_CACHE_SIZE; i++)
+        VIR_FREE(def->xmlCache->entries[i].xml);
+}
+
+
+/**
+ * virDomainDefXMLCacheLookup:
+ * @def: domain definition
+ * @flags: flags the XML was formatted with
+ * @xml: filled with a copy of the XML
+ *
+ * Looks up the XML stored by virDomainDefXMLCacheStore for @flags
+ * since the generation of @def was last bumped. The caller has to
+ * make sure @def is not changed concurrently, usually by holding the
+ * lock of the domain object.
+ *
+ * Returns 1 if the XML was found, 0 if not and -1 on error.
+ */
+int
+virDomainDefXMLCacheLookup(virDomainDefPtr def,
+                           unsigned int flags,
+                           char **xml)
+{
+    size_t i;
+
+    *xml = NULL;
+
+    if (!def->xmlCache)
+        return 0;
+
+    for (i = 0; i < VIR_DOMAIN_DEF_XML_CACHE_SIZE; i++) {
+        virDomainDefXMLCacheEntry *entry = &def->xmlCache->entries[i];
+
+        if (entry->xml &&
+            entry->flags == flags &&
+            entry->generation == def->generation) {
+            if (VIR_STRDUP(*xml, entry->xml) < 0)
+                return -1;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virDomainDefXMLCacheStore:
+ * @def: domain definition
+ * @flags: flags @xml was formatted with
+ * @xml: formatted XML of @def
+ *
+ * Remembers a copy of @xml until the generation of @def is bumped.
+ * Only the latest few flag combinations are kept. Failing to store
+ * the XML is not an error.
+ */
+void
+virDomainDefXMLCacheStore(virDomainDefPtr def,
+                          unsigned int flags,
+                          const char *xml)
+{
+    virDomainDefXMLCacheEntry *entry = NULL;
+    size_t i;
+
+    if (!def->xmlCache && VIR_ALLOC_QUIET(def->xmlCache) < 0)
+        return;
+
+    for (i = 0; i < VIR_DOMAIN_DEF_XML_CACHE_SIZE; i++) {
+        if (def->xmlCache->entries[i].flags == flags) {
+            entry = &def->xmlCache->entries[i];
+            break;
+        }
+    }
+
+    if (!entry) {
+        entry = &def->xmlCache->entries[def->xmlCache->next];
+        def->xmlCache->next = (def->xmlCache->next + 1) %
+                              VIR_DOMAIN_DEF_XML_CACHE_SIZE;
+    }
+
+    VIR_FREE(entry->xml);
+    if (VIR_STRDUP_QUIET(entry->xml, xml) < 0)
+        return;
+    entry->flags = flags;
+    entry->generation = def->generation;
+}
+
+
 char *
 virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
                    virDomainObjPtr obj,
@@ -28393,6 +28672,9 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
     int reason;
     size_t i;
 
+    /* Status XML is formatted over and over with little change */
+    virBufferSizeHint(&buf, obj->statusSize);
+
     state = virDomainObjGetState(obj, &reason);
     virBufferAsprintf(&buf, "<domstatus state='%s' reason='%s' pid='%lld'>\n",
                       virDomainStateTypeToString(state),
@@ -28419,6 +28701,8 @@ virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
     if (virBufferCheckError(&buf) < 0)
         goto error;
 
+    obj->statusSize = virBufferUse(&buf);
+
     return virBufferContentAndReset(&buf);
 
  error:
@@ -28577,6 +28861,8 @@ virDomainSaveConfig(const char *configDir,
     int ret = -1;
     char *xml;
 
+    virDomainDefBumpGeneration(def);
+
     if (!(xml = virDomainDefFormat(def, caps, VIR_DOMAIN_DEF_FORMAT_SECURE)))
         goto cleanup;
 
@@ -28589,34 +28875,345 @@ virDomainSaveConfig(const char *configDir,
     return ret;
 }
 
+/*
+ * Status XML writes queued by virDomainSaveStatusDeferred. Pending writes
+ * are keyed by the file name so that a newer status of a domain replaces
+ * an older one which was not written yet.
+ */
+typedef struct _virDomainStatusWrite virDomainStatusWrite;
+typedef virDomainStatusWrite *virDomainStatusWritePtr;
+struct _virDomainStatusWrite {
+    char *path;
+    char *warnName;
+    char *xml;
+};
+
+static virMutex virDomainStatusLock;
+static virCond virDomainStatusCond; /* signals new pending writes */
+static virCond virDomainStatusDoneCond; /* signals finished writes */
+static virHashTablePtr virDomainStatusPending;
+static char *virDomainStatusWriting; /* file being written by the thread */
+static bool virDomainStatusWriterUsed;
+
+
+static void
+virDomainStatusWriteFree(virDomainStatusWritePtr write)
+{
+    if (!write)
+        return;
+
+    VIR_FREE(write->path);
+    VIR_FREE(write->warnName);
+    VIR_FREE(write->xml);
+    VIR_FREE(write);
+}
+
+
+static void
+virDomainStatusWriteHashFree(void *payload,
+                             const void *name ATTRIBUTE_UNUSED)
+{
+    virDomainStatusWriteFree(payload);
+}
+
+
+static int
+virDomainStatusWriteAny(const void *payload ATTRIBUTE_UNUSED,
+                        const void *name ATTRIBUTE_UNUSED,
+                        const void *data ATTRIBUTE_UNUSED)
+{
+    return 1;
+}
+
+
+static int
+virDomainStatusWriteRun(virDomainStatusWritePtr write)
+{
+    int ret;
+
+    PROBE_QUIET(DOMAIN_STATUS_WRITE_BEGIN, "path=%s", write->path);
+    ret = virXMLSaveFile(write->path, write->warnName, "edit", write->xml);
+    PROBE_QUIET(DOMAIN_STATUS_WRITE_END, "path=%s ret=%d", write->path, ret);
+
+    return ret;
+}
+
+
+static void
+virDomainStatusWriter(void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainStatusWritePtr write;
+
+    virMutexLock(&virDomainStatusLock);
+
+    while (true) {
+        while (!(write = virHashSearch(virDomainStatusPending,
+                                       virDomainStatusWriteAny,
+                                       NULL, NULL)))
+            ignore_value(virCondWait(&virDomainStatusCond,
+                                     &virDomainStatusLock));
+
+        virHashSteal(virDomainStatusPending, write->path);
+        virDomainStatusWriting = write->path;
+        virMutexUnlock(&virDomainStatusLock);
+
+        if (virDomainStatusWriteRun(write) < 0) {
+            VIR_WARN("Failed to write status file '%s': %s",
+                     write->path, virGetLastErrorMessage());
+            virResetLastError();
+        }
+
+        virMutexLock(&virDomainStatusLock);
+        virDomainStatusWriting = NULL;
+        virDomainStatusWriteFree(write);
+        virCondBroadcast(&virDomainStatusDoneCond);
+    }
+}
+
+
+static int
+virDomainStatusWriterOnceInit(void)
+{
+    virThread thread;
+
+    if (virMutexInit(&virDomainStatusLock) < 0 ||
+        virCondInit(&virDomainStatusCond) < 0 ||
+        virCondInit(&virDomainStatusDoneCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize status writer"));
+        return -1;
+    }
+
+    if (!(virDomainStatusPending = virHashCreate(32, virDomainStatusWriteHashFree)))
+        return -1;
+
+    if (virThreadCreate(&thread, false, virDomainStatusWriter, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot create status writer thread"));
+        virHashFree(virDomainStatusPending);
+        virDomainStatusPending = NULL;
+        return -1;
+    }
+
+    virDomainStatusWriterUsed = true;
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virDomainStatusWriter)
+
+
+/*
+ * Takes the pending write of @path out of the queue and waits until the
+ * writer thread is done with @path. Returns the pending write, if any.
+ * The caller must hold virDomainStatusLock.
+ */
+static virDomainStatusWritePtr
+virDomainStatusWriteTake(const char *path)
+{
+    while (STREQ_NULLABLE(virDomainStatusWriting, path))
+        ignore_value(virCondWait(&virDomainStatusDoneCond,
+                                 &virDomainStatusLock));
+
+    return virHashSteal(virDomainStatusPending, path);
+}
+
+
+static unsigned int
+virDomainSaveStatusFlags(void)
+{
+    return VIR_DOMAIN_DEF_FORMAT_SECURE |
+           VIR_DOMAIN_DEF_FORMAT_STATUS |
+           VIR_DOMAIN_DEF_FORMAT_ACTUAL_NET |
+           VIR_DOMAIN_DEF_FORMAT_PCI_ORIG_STATES |
+           VIR_DOMAIN_DEF_FORMAT_CLOCK_ADJUST;
+}
+
+
+/**
+ * virDomainSaveStatus:
+ * @xmlopt: XML parser configuration
+ * @statusDir: directory with status files
+ * @obj: locked domain object
+ * @caps: capabilities
+ *
+ * Writes the live status of @obj to @statusDir and makes sure it is on
+ * disk before returning. A write queued by virDomainSaveStatusDeferred
+ * for the same domain is superseded.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
 virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
                     const char *statusDir,
                     virDomainObjPtr obj,
                     virCapsPtr caps)
 {
-    unsigned int flags = (VIR_DOMAIN_DEF_FORMAT_SECURE |
-                          VIR_DOMAIN_DEF_FORMAT_STATUS |
-                          VIR_DOMAIN_DEF_FORMAT_ACTUAL_NET |
-                          VIR_DOMAIN_DEF_FORMAT_PCI_ORIG_STATES |
-                          VIR_DOMAIN_DEF_FORMAT_CLOCK_ADJUST);
-
     int ret = -1;
     char *xml;
 
-    if (!(xml = virDomainObjFormat(xmlopt, obj, caps, flags)))
+    PROBE_QUIET(DOMAIN_STATUS_SAVE_BEGIN, "name=%s", obj->def->name);
+
+    virDomainDefBumpGeneration(obj->def);
+    virDomainObjMarkChanged(obj);
+
+    if (!(xml = virDomainObjFormat(xmlopt, obj, caps,
+                                   virDomainSaveStatusFlags())))
         goto cleanup;
 
+    virDomainSaveStatusDiscard(statusDir, obj);
+
     if (virDomainSaveXML(statusDir, obj->def, xml))
         goto cleanup;
 
     ret = 0;
  cleanup:
+    PROBE_QUIET(DOMAIN_STATUS_SAVE_END, "name=%s ret=%d", obj->def->name, ret);
     VIR_FREE(xml);
     return ret;
 }
 
 
+/**
+ * virDomainSaveStatusDeferred:
+ * @xmlopt: XML parser configuration
+ * @statusDir: directory with status files
+ * @obj: locked domain object
+ * @caps: capabilities
+ *
+ * Formats the live status of @obj and leaves writing it to a background
+ * thread. Rapid updates of a domain are coalesced, only the most recent
+ * status which wasn't written yet is written. Use this where losing the
+ * latest update on a crash is acceptable, virDomainSaveStatusFlush can
+ * be used to make sure the status is on disk.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainSaveStatusDeferred(virDomainXMLOptionPtr xmlopt,
+                            const char *statusDir,
+                            virDomainObjPtr obj,
+                            virCapsPtr caps)
+{
+    virDomainStatusWritePtr write = NULL;
+    virDomainStatusWritePtr old;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    int ret = -1;
+
+    virDomainDefBumpGeneration(obj->def);
+    virDomainObjMarkChanged(obj);
+
+    if (!statusDir)
+        return 0;
+
+    if (virDomainStatusWriterInitialize() < 0)
+        return virDomainSaveStatus(xmlopt, statusDir, obj, caps);
+
+    if (virFileMakePath(statusDir) < 0) {
+        virReportSystemError(errno,
+                             _("cannot create config directory '%s'"),
+                             statusDir);
+        return -1;
+    }
+
+    virUUIDFormat(obj->def->uuid, uuidstr);
+
+    if (VIR_ALLOC(write) < 0 ||
+        !(write->path = virDomainConfigFile(statusDir, obj->def->name)) ||
+        VIR_STRDUP(write->warnName,
+                   virXMLPickShellSafeComment(obj->def->name, uuidstr)) < 0 ||
+        !(write->xml = virDomainObjFormat(xmlopt, obj, caps,
+                                          virDomainSaveStatusFlags())))
+        goto cleanup;
+
+    virMutexLock(&virDomainStatusLock);
+    if ((old = virHashSteal(virDomainStatusPending, write->path)))
+        VIR_DEBUG("Coalescing status writes of '%s'", write->path);
+    virDomainStatusWriteFree(old);
+
+    if (virHashAddEntry(virDomainStatusPending, write->path, write) < 0) {
+        virMutexUnlock(&virDomainStatusLock);
+        goto cleanup;
+    }
+    write = NULL;
+    virCondSignal(&virDomainStatusCond);
+    virMutexUnlock(&virDomainStatusLock);
+
+    ret = 0;
+
+ cleanup:
+    virDomainStatusWriteFree(write);
+    return ret;
+}
+
+
+/**
+ * virDomainSaveStatusFlush:
+ * @statusDir: directory with status files
+ * @obj: locked domain object
+ *
+ * Barrier for virDomainSaveStatusDeferred: makes sure the status of
+ * @obj queued for writing is on disk before returning.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainSaveStatusFlush(const char *statusDir,
+                         virDomainObjPtr obj)
+{
+    virDomainStatusWritePtr write;
+    char *path;
+    int ret = 0;
+
+    if (!statusDir || !virDomainStatusWriterUsed)
+        return 0;
+
+    if (!(path = virDomainConfigFile(statusDir, obj->def->name)))
+        return -1;
+
+    virMutexLock(&virDomainStatusLock);
+    write = virDomainStatusWriteTake(path);
+    virMutexUnlock(&virDomainStatusLock);
+
+    if (write)
+        ret = virDomainStatusWriteRun(write);
+
+    virDomainStatusWriteFree(write);
+    VIR_FREE(path);
+    return ret;
+}
+
+
+/**
+ * virDomainSaveStatusDiscard:
+ * @statusDir: directory with status files
+ * @obj: locked domain object
+ *
+ * Drops the status of @obj queued by virDomainSaveStatusDeferred and
+ * waits until any write of it in progress finishes. This has to be
+ * called before the status file is written directly or removed.
+ */
+void
+virDomainSaveStatusDiscard(const char *statusDir,
+                           virDomainObjPtr obj)
+{
+    char *path;
+
+    if (!statusDir || !virDomainStatusWriterUsed)
+        return;
+
+    if (!(path = virDomainConfigFile(statusDir, obj->def->name))) {
+        virResetLastError();
+        return;
+    }
+
+    virMutexLock(&virDomainStatusLock);
+    virDomainStatusWriteFree(virDomainStatusWriteTake(path));
+    virMutexUnlock(&virDomainStatusLock);
+
+    VIR_FREE(path);
+}
+
+
 int
 virDomainDeleteConfig(const char *configDir,
                       const char *autostartDir,
@@ -28979,12 +29576,13 @@ virDomainDefCopy(virDomainDefPtr src,
 virDomainDefPtr
 virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                               virCapsPtr caps,
-                              virDomainXMLOptionPtr xmlopt)
+                              virDomainXMLOptionPtr xmlopt,
+                              void *parseOpaque)
 {
     virDomainDefPtr cur;
 
     cur = virDomainObjGetPersistentDef(caps, xmlopt, dom);
-    return virDomainDefCopy(cur, caps, xmlopt, NULL, false);
+    return virDomainDefCopy(cur, caps, xmlopt, parseOpaque, false);
 }
 
 
@@ -28998,6 +29596,50 @@ virDomainObjGetState(virDomainObjPtr dom, int *reason)
 }
 
 
+/*
+ * Process wide, so that generations never repeat as domains move
+ * between being defined, undefined and defined again.
+ */
+static virMutex virDomainObjChangeLock = VIR_MUTEX_INITIALIZER;
+static unsigned long long virDomainObjChangeCounter;
+
+
+/**
+ * virDomainObjMarkChanged:
+ * @obj: locked domain object
+ *
+ * Records that the state or the definition of @obj changed, by giving
+ * it a change generation newer than any handed out before. Used to let
+ * management applications fetch only the domains which changed, see
+ * virDomainObjListExportChanged.
+ */
+void
+virDomainObjMarkChanged(virDomainObjPtr obj)
+{
+    virMutexLock(&virDomainObjChangeLock);
+    obj->changeGeneration = ++virDomainObjChangeCounter;
+    virMutexUnlock(&virDomainObjChangeLock);
+}
+
+
+/**
+ * virDomainObjGetChangeGeneration:
+ *
+ * Returns the newest change generation handed out so far.
+ */
+unsigned long long
+virDomainObjGetChangeGeneration(void)
+{
+    unsigned long long ret;
+
+    virMutexLock(&virDomainObjChangeLock);
+    ret = virDomainObjChangeCounter;
+    virMutexUnlock(&virDomainObjChangeLock);
+
+    return ret;
+}
+
+
 void
 virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
 {
@@ -29039,6 +29681,8 @@ virDomainObjSetState(virDomainObjPtr dom, virDomainState state, int reason)
         dom->state.reason = reason;
     else
         dom->state.reason = 0;
+
+    virDomainObjMarkChanged(dom);
 }
 
 
@@ -29371,93 +30015,88 @@ virDomainNetFindByName(virDomainDefPtr def,
 
 
 /**
- * virDomainDeviceDefCopy:
+ * virDomainDeviceDefFormat:
+ * @buf: buffer to format the device into
+ * @dev: device to format
  * @caps: Capabilities
- * @def: Domain definition to which @src belongs
- * @src: source to be copied
+ * @xmlopt: XML parser configuration
+ * @flags: bitwise-OR of virDomainDefFormatFlags
  *
- * virDomainDeviceDefCopy does a deep copy of only the parts of a
- * DeviceDef that are valid when just the flag VIR_DOMAIN_DEF_PARSE_INACTIVE is
- * set. This means that any part of the device xml that is conditionally
- * parsed/formatted based on some other flag being set (or on the INACTIVE
- * flag being reset) *will not* be copied to the destination. Caveat emptor.
+ * Formats the XML of a single device @dev the same way it would appear
+ * in the XML of its domain.
  *
- * Returns a pointer to copied @src or NULL in case of error.
+ * Returns 0 on success, -1 on error.
  */
-virDomainDeviceDefPtr
-virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
-                       const virDomainDef *def,
-                       virCapsPtr caps,
-                       virDomainXMLOptionPtr xmlopt)
+int
+virDomainDeviceDefFormat(virBufferPtr buf,
+                         virDomainDeviceDefPtr dev,
+                         virCapsPtr caps,
+                         virDomainXMLOptionPtr xmlopt,
+                         unsigned int flags)
 {
-    virDomainDeviceDefPtr ret = NULL;
-    virBuffer buf = VIR_BUFFER_INITIALIZER;
-    int flags = VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_SECURE;
-    char *xmlStr = NULL;
     int rc = -1;
-    char *netprefix;
 
-    switch ((virDomainDeviceType) src->type) {
+    switch ((virDomainDeviceType) dev->type) {
     case VIR_DOMAIN_DEVICE_DISK:
-        rc = virDomainDiskDefFormat(&buf, src->data.disk, flags, xmlopt);
+        rc = virDomainDiskDefFormat(buf, dev->data.disk, flags, xmlopt);
         break;
     case VIR_DOMAIN_DEVICE_LEASE:
-        rc = virDomainLeaseDefFormat(&buf, src->data.lease);
+        rc = virDomainLeaseDefFormat(buf, dev->data.lease);
         break;
     case VIR_DOMAIN_DEVICE_FS:
-        rc = virDomainFSDefFormat(&buf, src->data.fs, flags);
+        rc = virDomainFSDefFormat(buf, dev->data.fs, flags);
         break;
     case VIR_DOMAIN_DEVICE_NET:
-        netprefix = caps->host.netprefix;
-        rc = virDomainNetDefFormat(&buf, src->data.net, netprefix, flags);
+        rc = virDomainNetDefFormat(buf, dev->data.net,
+                                   caps->host.netprefix, flags);
         break;
     case VIR_DOMAIN_DEVICE_INPUT:
-        rc = virDomainInputDefFormat(&buf, src->data.input, flags);
+        rc = virDomainInputDefFormat(buf, dev->data.input, flags);
         break;
     case VIR_DOMAIN_DEVICE_SOUND:
-        rc = virDomainSoundDefFormat(&buf, src->data.sound, flags);
+        rc = virDomainSoundDefFormat(buf, dev->data.sound, flags);
         break;
     case VIR_DOMAIN_DEVICE_VIDEO:
-        rc = virDomainVideoDefFormat(&buf, src->data.video, flags);
+        rc = virDomainVideoDefFormat(buf, dev->data.video, flags);
         break;
     case VIR_DOMAIN_DEVICE_HOSTDEV:
-        rc = virDomainHostdevDefFormat(&buf, src->data.hostdev, flags);
+        rc = virDomainHostdevDefFormat(buf, dev->data.hostdev, flags);
         break;
     case VIR_DOMAIN_DEVICE_WATCHDOG:
-        rc = virDomainWatchdogDefFormat(&buf, src->data.watchdog, flags);
+        rc = virDomainWatchdogDefFormat(buf, dev->data.watchdog, flags);
         break;
     case VIR_DOMAIN_DEVICE_CONTROLLER:
-        rc = virDomainControllerDefFormat(&buf, src->data.controller, flags);
+        rc = virDomainControllerDefFormat(buf, dev->data.controller, flags);
         break;
     case VIR_DOMAIN_DEVICE_GRAPHICS:
-        rc = virDomainGraphicsDefFormat(&buf, src->data.graphics, flags);
+        rc = virDomainGraphicsDefFormat(buf, dev->data.graphics, flags);
         break;
     case VIR_DOMAIN_DEVICE_HUB:
-        rc = virDomainHubDefFormat(&buf, src->data.hub, flags);
+        rc = virDomainHubDefFormat(buf, dev->data.hub, flags);
         break;
     case VIR_DOMAIN_DEVICE_REDIRDEV:
-        rc = virDomainRedirdevDefFormat(&buf, src->data.redirdev, flags);
+        rc = virDomainRedirdevDefFormat(buf, dev->data.redirdev, flags);
         break;
     case VIR_DOMAIN_DEVICE_RNG:
-        rc = virDomainRNGDefFormat(&buf, src->data.rng, flags);
+        rc = virDomainRNGDefFormat(buf, dev->data.rng, flags);
         break;
     case VIR_DOMAIN_DEVICE_CHR:
-        rc = virDomainChrDefFormat(&buf, src->data.chr, flags);
+        rc = virDomainChrDefFormat(buf, dev->data.chr, flags);
         break;
     case VIR_DOMAIN_DEVICE_TPM:
-        rc = virDomainTPMDefFormat(&buf, src->data.tpm, flags);
+        rc = virDomainTPMDefFormat(buf, dev->data.tpm, flags);
         break;
     case VIR_DOMAIN_DEVICE_PANIC:
-        rc = virDomainPanicDefFormat(&buf, src->data.panic);
+        rc = virDomainPanicDefFormat(buf, dev->data.panic);
         break;
     case VIR_DOMAIN_DEVICE_MEMORY:
-        rc = virDomainMemoryDefFormat(&buf, src->data.memory, flags);
+        rc = virDomainMemoryDefFormat(buf, dev->data.memory, flags);
         break;
     case VIR_DOMAIN_DEVICE_SHMEM:
-        rc = virDomainShmemDefFormat(&buf, src->data.shmem, flags);
+        rc = virDomainShmemDefFormat(buf, dev->data.shmem, flags);
         break;
     case VIR_DOMAIN_DEVICE_VSOCK:
-        rc = virDomainVsockDefFormat(&buf, src->data.vsock);
+        rc = virDomainVsockDefFormat(buf, dev->data.vsock);
         break;
 
     case VIR_DOMAIN_DEVICE_NONE:
@@ -29467,13 +30106,42 @@ virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
     case VIR_DOMAIN_DEVICE_IOMMU:
     case VIR_DOMAIN_DEVICE_LAST:
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Copying definition of '%d' type "
+                       _("Formatting definition of '%d' type "
                          "is not implemented yet."),
-                       src->type);
-        goto cleanup;
+                       dev->type);
+        return -1;
     }
 
-    if (rc < 0)
+    return rc;
+}
+
+
+/**
+ * virDomainDeviceDefCopy:
+ * @caps: Capabilities
+ * @def: Domain definition to which @src belongs
+ * @src: source to be copied
+ *
+ * virDomainDeviceDefCopy does a deep copy of only the parts of a
+ * DeviceDef that are valid when just the flag VIR_DOMAIN_DEF_PARSE_INACTIVE is
+ * set. This means that any part of the device xml that is conditionally
+ * parsed/formatted based on some other flag being set (or on the INACTIVE
+ * flag being reset) *will not* be copied to the destination. Caveat emptor.
+ *
+ * Returns a pointer to copied @src or NULL in case of error.
+ */
+virDomainDeviceDefPtr
+virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
+                       const virDomainDef *def,
+                       virCapsPtr caps,
+                       virDomainXMLOptionPtr xmlopt)
+{
+    virDomainDeviceDefPtr ret = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    int flags = VIR_DOMAIN_DEF_FORMAT_INACTIVE | VIR_DOMAIN_DEF_FORMAT_SECURE;
+    char *xmlStr = NULL;
+
+    if (virDomainDeviceDefFormat(&buf, src, caps, xmlopt, flags) < 0)
         goto cleanup;
 
     xmlStr = virBufferContentAndReset(&buf);
@@ -29943,16 +30611,40 @@ virDomainDiskSetBlockIOTune(virDomainDiskDefPtr disk,
 {
     char *tmp_group = NULL;
 
+    if (!disk->blkdeviotune &&
+        VIR_ALLOC(disk->blkdeviotune) < 0)
+        return -1;
+
     if (VIR_STRDUP(tmp_group, info->group_name) < 0)
         return -1;
 
-    VIR_FREE(disk->blkdeviotune.group_name);
-    disk->blkdeviotune = *info;
-    VIR_STEAL_PTR(disk->blkdeviotune.group_name, tmp_group);
+    VIR_FREE(disk->blkdeviotune->group_name);
+    *disk->blkdeviotune = *info;
+    VIR_STEAL_PTR(disk->blkdeviotune->group_name, tmp_group);
 
     return 0;
 }
 
+
+/**
+ * virDomainDiskGetBlockIoTune:
+ * @disk: disk definition
+ *
+ * The block I/O tuning of a disk is only allocated once some of it is
+ * set. Disks without any share an all-zero default, so that callers
+ * reading the settings don't need to care.
+ *
+ * Returns: the block I/O tuning of @disk, which must not be modified
+ */
+const virDomainBlockIoTuneInfo *
+virDomainDiskGetBlockIoTune(const virDomainDiskDef *disk)
+{
+    if (!disk->blkdeviotune)
+        return &virDomainBlockIoTuneDefault;
+
+    return disk->blkdeviotune;
+}
+
 #define HOSTNAME_CHARS \
     "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-"
 
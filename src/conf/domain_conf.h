@@ -127,6 +127,9 @@ typedef virDomainSnapshotObj *virDomainSnapshotObjPtr;
 typedef struct _virDomainSnapshotObjList virDomainSnapshotObjList;
 typedef virDomainSnapshotObjList *virDomainSnapshotObjListPtr;
 
+typedef struct _virDomainCheckpointObjList virDomainCheckpointObjList;
+typedef virDomainCheckpointObjList *virDomainCheckpointObjListPtr;
+
 typedef struct _virDomainRNGDef virDomainRNGDef;
 typedef virDomainRNGDef *virDomainRNGDefPtr;
 
@@ -648,7 +651,9 @@ struct _virDomainDiskDef {
         unsigned int physical_block_size;
     } blockio;
 
-    virDomainBlockIoTuneInfo blkdeviotune;
+    /* NULL unless any tuning is set, use virDomainDiskGetBlockIoTune()
+     * to read it */
+    virDomainBlockIoTuneInfoPtr blkdeviotune;
 
     char *driverName;
 
@@ -860,6 +865,7 @@ typedef enum {
     VIR_DOMAIN_FS_DRIVER_TYPE_LOOP,
     VIR_DOMAIN_FS_DRIVER_TYPE_NBD,
     VIR_DOMAIN_FS_DRIVER_TYPE_PLOOP,
+    VIR_DOMAIN_FS_DRIVER_TYPE_OVERLAY,
 
     VIR_DOMAIN_FS_DRIVER_TYPE_LAST
 } virDomainFSDriverType;
@@ -2217,11 +2223,27 @@ struct _virDomainIOThreadIDDef {
 
 void virDomainIOThreadIDDefFree(virDomainIOThreadIDDefPtr def);
 
+typedef enum {
+    VIR_DOMAIN_IOTHREADS_AUTO_NONE = 0,
+    VIR_DOMAIN_IOTHREADS_AUTO_PER_DISK, /* one IOThread per disk */
+    VIR_DOMAIN_IOTHREADS_AUTO_SHARED, /* disks spread over the IOThreads */
+
+    VIR_DOMAIN_IOTHREADS_AUTO_LAST
+} virDomainIOThreadsAuto;
+
+
+typedef enum {
+    VIR_DOMAIN_CPUTUNE_PROFILE_NONE = 0,
+    VIR_DOMAIN_CPUTUNE_PROFILE_DEDICATED,
+
+    VIR_DOMAIN_CPUTUNE_PROFILE_LAST
+} virDomainCputuneProfile;
 
 typedef struct _virDomainCputune virDomainCputune;
 typedef virDomainCputune *virDomainCputunePtr;
 
 struct _virDomainCputune {
+    int profile; /* enum virDomainCputuneProfile */
     unsigned long long shares;
     bool sharesSpecified;
     unsigned long long period;
@@ -2298,6 +2320,8 @@ struct _virDomainMemtune {
     int source; /* enum virDomainMemorySource */
     int access; /* enum virDomainMemoryAccess */
     int allocation; /* enum virDomainMemoryAllocation */
+    unsigned int allocation_threads; /* host threads preallocating memory,
+                                        0 for the hypervisor default */
 
     virTristateBool discard;
 };
@@ -2381,6 +2405,9 @@ struct _virDomainVirtioOptions {
     virTristateSwitch ats;
 };
 
+typedef struct _virDomainDefXMLCache virDomainDefXMLCache;
+typedef virDomainDefXMLCache *virDomainDefXMLCachePtr;
+
 /*
  * Guest VM main configuration
  *
@@ -2402,6 +2429,16 @@ struct _virDomainDef {
     char *title;
     char *description;
 
+    /* Only virtType, id, uuid and name are filled in, the rest is
+     * parsed from the config file when the domain is looked up,
+     * see virDomainObjListSetLazyLoad */
+    bool stub;
+
+    /* Formatted XML, valid as long as the generation is unchanged,
+     * see virDomainDefBumpGeneration */
+    unsigned int generation;
+    virDomainDefXMLCachePtr xmlCache;
+
     virDomainBlkiotune blkio;
     virDomainMemtune mem;
 
@@ -2414,6 +2451,7 @@ struct _virDomainDef {
 
     size_t niothreadids;
     virDomainIOThreadIDDefPtr *iothreadids;
+    int iothreadsAuto; /* enum virDomainIOThreadsAuto */
 
     virDomainCputune cputune;
 
@@ -2430,6 +2468,7 @@ struct _virDomainDef {
     int onCrash;
 
     int onLockFailure; /* enum virDomainLockFailureAction */
+    int startupPriority; /* higher ones are autostarted first */
 
     virDomainPowerManagement pm;
 
@@ -2605,10 +2644,19 @@ struct _virDomainObj {
     virDomainDefPtr newDef; /* New definition to activate at shutdown */
 
     virDomainSnapshotObjListPtr snapshots;
+    virDomainCheckpointObjListPtr checkpoints;
     virDomainSnapshotObjPtr current_snapshot;
 
     bool hasManagedSave;
 
+    unsigned int lastUsed; /* for evicting lazily loaded definitions */
+
+    /* Change generation of the last state or definition change,
+     * see virDomainObjMarkChanged */
+    unsigned long long changeGeneration;
+
+    size_t statusSize; /* length of the last status XML, to pre-size buffers */
+
     void *privateData;
     void (*privateDataFreeFunc)(void *);
 
@@ -2907,6 +2955,11 @@ void virDomainRedirdevDefFree(virDomainRedirdevDefPtr def);
 void virDomainRedirFilterDefFree(virDomainRedirFilterDefPtr def);
 void virDomainShmemDefFree(virDomainShmemDefPtr def);
 void virDomainDeviceDefFree(virDomainDeviceDefPtr def);
+int virDomainDeviceDefFormat(virBufferPtr buf,
+                             virDomainDeviceDefPtr dev,
+                             virCapsPtr caps,
+                             virDomainXMLOptionPtr xmlopt,
+                             unsigned int flags);
 virDomainDeviceDefPtr virDomainDeviceDefCopy(virDomainDeviceDefPtr src,
                                              const virDomainDef *def,
                                              virCapsPtr caps,
@@ -2942,7 +2995,8 @@ void virDomainObjAssignDef(virDomainObjPtr domain,
                            virDomainDefPtr *oldDef);
 int virDomainObjSetDefTransient(virCapsPtr caps,
                                 virDomainXMLOptionPtr xmlopt,
-                                virDomainObjPtr domain);
+                                virDomainObjPtr domain,
+                                void *parseOpaque);
 void virDomainObjRemoveTransientDef(virDomainObjPtr domain);
 virDomainDefPtr
 virDomainObjGetPersistentDef(virCapsPtr caps,
@@ -2968,7 +3022,8 @@ virDomainDefPtr virDomainDefCopy(virDomainDefPtr src,
                                  bool migratable);
 virDomainDefPtr virDomainObjCopyPersistentDef(virDomainObjPtr dom,
                                               virCapsPtr caps,
-                                              virDomainXMLOptionPtr xmlopt);
+                                              virDomainXMLOptionPtr xmlopt,
+                                              void *parseOpaque);
 
 typedef enum {
     /* parse internal domain status information */
@@ -3079,6 +3134,8 @@ int virDomainDefAddImplicitDevices(virDomainDefPtr def);
 
 virDomainIOThreadIDDefPtr virDomainIOThreadIDFind(const virDomainDef *def,
                                                   unsigned int iothread_id);
+int virDomainIOThreadIDDefArrayInit(virDomainDefPtr def,
+                                    unsigned int iothreads);
 virDomainIOThreadIDDefPtr virDomainIOThreadIDAdd(virDomainDefPtr def,
                                                  unsigned int iothread_id);
 void virDomainIOThreadIDDel(virDomainDefPtr def, unsigned int iothread_id);
@@ -3092,6 +3149,14 @@ char *virDomainObjFormat(virDomainXMLOptionPtr xmlopt,
                          virDomainObjPtr obj,
                          virCapsPtr caps,
                          unsigned int flags);
+
+void virDomainDefBumpGeneration(virDomainDefPtr def);
+int virDomainDefXMLCacheLookup(virDomainDefPtr def,
+                               unsigned int flags,
+                               char **xml);
+void virDomainDefXMLCacheStore(virDomainDefPtr def,
+                               unsigned int flags,
+                               const char *xml);
 int virDomainDefFormatInternal(virDomainDefPtr def,
                                virCapsPtr caps,
                                unsigned int flags,
@@ -3266,6 +3331,16 @@ int virDomainSaveStatus(virDomainXMLOptionPtr xmlopt,
                         const char *statusDir,
                         virDomainObjPtr obj,
                         virCapsPtr caps) ATTRIBUTE_RETURN_CHECK;
+int virDomainSaveStatusDeferred(virDomainXMLOptionPtr xmlopt,
+                                const char *statusDir,
+                                virDomainObjPtr obj,
+                                virCapsPtr caps)
+    ATTRIBUTE_RETURN_CHECK;
+int virDomainSaveStatusFlush(const char *statusDir,
+                             virDomainObjPtr obj)
+    ATTRIBUTE_RETURN_CHECK;
+void virDomainSaveStatusDiscard(const char *statusDir,
+                                virDomainObjPtr obj);
 
 typedef void (*virDomainLoadConfigNotify)(virDomainObjPtr dom,
                                           int newDomain,
@@ -3334,6 +3409,10 @@ virDomainState
 virDomainObjGetState(virDomainObjPtr obj, int *reason)
         ATTRIBUTE_NONNULL(1);
 
+void virDomainObjMarkChanged(virDomainObjPtr obj)
+        ATTRIBUTE_NONNULL(1);
+unsigned long long virDomainObjGetChangeGeneration(void);
+
 virSecurityLabelDefPtr
 virDomainDefGetSecurityLabelDef(virDomainDefPtr def, const char *model);
 
@@ -3450,6 +3529,7 @@ VIR_ENUM_DECL(virDomainMemoryBackingModel)
 VIR_ENUM_DECL(virDomainMemorySource)
 VIR_ENUM_DECL(virDomainMemoryAllocation)
 VIR_ENUM_DECL(virDomainIOMMUModel)
+VIR_ENUM_DECL(virDomainIOThreadsAuto)
 VIR_ENUM_DECL(virDomainVsockModel)
 VIR_ENUM_DECL(virDomainShmemModel)
 VIR_ENUM_DECL(virDomainLaunchSecurity)
@@ -3476,6 +3556,7 @@ VIR_ENUM_DECL(virDomainTimerTrack)
 VIR_ENUM_DECL(virDomainTimerTickpolicy)
 VIR_ENUM_DECL(virDomainTimerMode)
 VIR_ENUM_DECL(virDomainCpuPlacementMode)
+VIR_ENUM_DECL(virDomainCputuneProfile)
 
 VIR_ENUM_DECL(virDomainStartupPolicy)
 
@@ -3568,6 +3649,9 @@ virDomainGetBlkioParametersAssignFromDef(virDomainDefPtr def,
 
 int virDomainDiskSetBlockIOTune(virDomainDiskDefPtr disk,
                                 virDomainBlockIoTuneInfo *info);
+const virDomainBlockIoTuneInfo *
+virDomainDiskGetBlockIoTune(const virDomainDiskDef *disk)
+    ATTRIBUTE_NONNULL(1);
 
 char *
 virDomainGenerateMachineName(const char *drivername,
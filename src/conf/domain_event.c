@@ -61,6 +61,7 @@ static virClassPtr virDomainEventJobCompletedClass;
 static virClassPtr virDomainEventDeviceRemovalFailedClass;
 static virClassPtr virDomainEventMetadataChangeClass;
 static virClassPtr virDomainEventBlockThresholdClass;
+static virClassPtr virDomainStatsEventClass;
 
 static void virDomainEventDispose(void *obj);
 static void virDomainEventLifecycleDispose(void *obj);
@@ -83,6 +84,7 @@ static void virDomainEventJobCompletedDispose(void *obj);
 static void virDomainEventDeviceRemovalFailedDispose(void *obj);
 static void virDomainEventMetadataChangeDispose(void *obj);
 static void virDomainEventBlockThresholdDispose(void *obj);
+static void virDomainStatsEventDispose(void *obj);
 
 static void
 virDomainEventDispatchDefaultFunc(virConnectPtr conn,
@@ -96,6 +98,12 @@ virDomainQemuMonitorEventDispatchFunc(virConnectPtr conn,
                                       virConnectObjectEventGenericCallback cb,
                                       void *cbopaque);
 
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEventPtr event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque);
+
 struct _virDomainEvent {
     virObjectEvent parent;
 
@@ -227,6 +235,16 @@ struct _virDomainQemuMonitorEvent {
 typedef struct _virDomainQemuMonitorEvent virDomainQemuMonitorEvent;
 typedef virDomainQemuMonitorEvent *virDomainQemuMonitorEventPtr;
 
+struct _virDomainStatsEvent {
+    virObjectEvent parent;
+
+    /* NULL terminated, as returned by virConnectGetAllDomainStats */
+    virDomainStatsRecordPtr *records;
+    int nrecords;
+};
+typedef struct _virDomainStatsEvent virDomainStatsEvent;
+typedef virDomainStatsEvent *virDomainStatsEventPtr;
+
 struct _virDomainEventTunable {
     virDomainEvent parent;
 
@@ -337,6 +355,8 @@ virDomainEventsOnceInit(void)
         return -1;
     if (!VIR_CLASS_NEW(virDomainEventBlockThreshold, virDomainEventClass))
         return -1;
+    if (!VIR_CLASS_NEW(virDomainStatsEvent, virClassForObjectEvent()))
+        return -1;
     return 0;
 }
 
@@ -492,6 +512,15 @@ virDomainQemuMonitorEventDispose(void *obj)
     VIR_FREE(event->details);
 }
 
+static void
+virDomainStatsEventDispose(void *obj)
+{
+    virDomainStatsEventPtr event = obj;
+    VIR_DEBUG("obj=%p", event);
+
+    virDomainStatsRecordListFree(event->records);
+}
+
 static void
 virDomainEventTunableDispose(void *obj)
 {
@@ -923,7 +952,9 @@ virDomainEventBlockJobNew(int event,
                                  id, name, uuid)))
         return NULL;
 
-    if (VIR_STRDUP(ev->disk, disk) < 0) {
+    if (VIR_STRDUP(ev->disk, disk) < 0 ||
+        virObjectEventSetCoalesceKey((virObjectEventPtr)ev,
+                                     disk ? disk : "") < 0) {
         virObjectUnref(ev);
         return NULL;
     }
@@ -1240,6 +1271,10 @@ virDomainEventBalloonChangeNewFromDom(virDomainPtr dom,
                                  dom->id, dom->name, dom->uuid)))
         return NULL;
 
+    if (virObjectEventSetCoalesceKey((virObjectEventPtr)ev, "") < 0) {
+        virObjectUnref(ev);
+        return NULL;
+    }
     ev->actual = actual;
 
     return (virObjectEventPtr)ev;
@@ -1258,6 +1293,10 @@ virDomainEventBalloonChangeNewFromObj(virDomainObjPtr obj,
                                  obj->def->id, obj->def->name, obj->def->uuid)))
         return NULL;
 
+    if (virObjectEventSetCoalesceKey((virObjectEventPtr)ev, "") < 0) {
+        virObjectUnref(ev);
+        return NULL;
+    }
     ev->actual = actual;
 
     return (virObjectEventPtr)ev;
@@ -2074,7 +2113,7 @@ virDomainEventStateRegister(virConnectPtr conn,
                                          VIR_DOMAIN_EVENT_ID_LIFECYCLE,
                                          VIR_OBJECT_EVENT_CALLBACK(callback),
                                          opaque, freecb,
-                                         true, &callbackID, false);
+                                         true, false, &callbackID, false);
 }
 
 
@@ -2091,7 +2130,7 @@ virDomainEventStateRegister(virConnectPtr conn,
  *
  * Register the function @cb with connection @conn, from @state, for
  * events of type @eventID, and return the registration handle in
- * @callbackID.
+ * @callbackID.  @eventID may include VIR_DOMAIN_EVENT_ID_FLAG_COALESCE.
  *
  * Returns: the number of callbacks now registered, or -1 on error
  */
@@ -2106,6 +2145,7 @@ virDomainEventStateRegisterID(virConnectPtr conn,
                               int *callbackID)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool coalesce = !!(eventID & VIR_DOMAIN_EVENT_ID_FLAG_COALESCE);
 
     if (virDomainEventsInitialize() < 0)
         return -1;
@@ -2113,11 +2153,11 @@ virDomainEventStateRegisterID(virConnectPtr conn,
     if (dom)
         virUUIDFormat(dom->uuid, uuidstr);
     return virObjectEventStateRegisterID(conn, state, dom ? uuidstr : NULL,
-                                         NULL, NULL,
-                                         virDomainEventClass, eventID,
+                                         NULL, NULL, virDomainEventClass,
+                                         eventID & ~VIR_DOMAIN_EVENT_ID_FLAG_COALESCE,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         false, callbackID, false);
+                                         false, coalesce, callbackID, false);
 }
 
 
@@ -2137,7 +2177,7 @@ virDomainEventStateRegisterID(virConnectPtr conn,
  * Register the function @cb with connection @conn, from @state, for
  * events of type @eventID, and return the registration handle in
  * @callbackID.  This version is intended for use on the client side
- * of RPC.
+ * of RPC.  @eventID may include VIR_DOMAIN_EVENT_ID_FLAG_COALESCE.
  *
  * Returns: the number of callbacks now registered, or -1 on error
  */
@@ -2154,6 +2194,7 @@ virDomainEventStateRegisterClient(virConnectPtr conn,
                                   bool remoteID)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    bool coalesce = !!(eventID & VIR_DOMAIN_EVENT_ID_FLAG_COALESCE);
 
     if (virDomainEventsInitialize() < 0)
         return -1;
@@ -2161,11 +2202,12 @@ virDomainEventStateRegisterClient(virConnectPtr conn,
     if (dom)
         virUUIDFormat(dom->uuid, uuidstr);
     return virObjectEventStateRegisterID(conn, state, dom ? uuidstr : NULL,
-                                         NULL, NULL,
-                                         virDomainEventClass, eventID,
+                                         NULL, NULL, virDomainEventClass,
+                                         eventID & ~VIR_DOMAIN_EVENT_ID_FLAG_COALESCE,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         legacy, callbackID, remoteID);
+                                         legacy, coalesce, callbackID,
+                                         remoteID);
 }
 
 
@@ -2343,5 +2385,88 @@ virDomainQemuMonitorEventStateRegisterID(virConnectPtr conn,
                                          virDomainQemuMonitorEventClass, 0,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          data, freecb,
-                                         false, callbackID, false);
+                                         false, false, callbackID, false);
+}
+
+
+/**
+ * virDomainStatsEventNew:
+ * @key: key of the subscription the records are for
+ * @records: NULL terminated list of stats records
+ * @nrecords: number of entries in @records
+ *
+ * Create a new event carrying one sample of a domain stats
+ * subscription. On success, the event takes over @records.
+ *
+ * Returns the new event, or NULL on error.
+ */
+virObjectEventPtr
+virDomainStatsEventNew(const char *key,
+                       virDomainStatsRecordPtr *records,
+                       int nrecords)
+{
+    virDomainStatsEventPtr ev;
+
+    if (virDomainEventsInitialize() < 0)
+        return NULL;
+
+    if (!(ev = virObjectEventNew(virDomainStatsEventClass,
+                                 virDomainStatsEventDispatchFunc,
+                                 0, -1, key, NULL, key)))
+        return NULL;
+
+    ev->records = records;
+    ev->nrecords = nrecords;
+
+    return (virObjectEventPtr)ev;
+}
+
+
+static void
+virDomainStatsEventDispatchFunc(virConnectPtr conn,
+                                virObjectEventPtr event,
+                                virConnectObjectEventGenericCallback cb,
+                                void *cbopaque)
+{
+    virDomainStatsEventPtr statsEvent = (virDomainStatsEventPtr)event;
+
+    ((virConnectDomainStatsCallback)cb)(conn, statsEvent->records,
+                                        statsEvent->nrecords, cbopaque);
+}
+
+
+/**
+ * virDomainStatsEventStateRegisterID:
+ * @conn: connection to associate with callback
+ * @state: object event state
+ * @key: key of the subscription
+ * @cb: function to invoke with each sample
+ * @opaque: data blob to pass to callback
+ * @freecb: callback to free @opaque
+ * @callbackID: filled with callback ID
+ *
+ * Register the function @cb with connection @conn, from @state, for
+ * the samples of the domain stats subscription identified by @key.
+ * Every subscription has its own key, so registering never finds a
+ * duplicate.
+ *
+ * Returns: the number of callbacks now registered, or -1 on error
+ */
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventStatePtr state,
+                                   const char *key,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+{
+    if (virDomainEventsInitialize() < 0)
+        return -1;
+
+    return virObjectEventStateRegisterID(conn, state, key, NULL, NULL,
+                                         virDomainStatsEventClass, 0,
+                                         VIR_OBJECT_EVENT_CALLBACK(cb),
+                                         opaque, freecb,
+                                         false, false, callbackID, false);
 }
@@ -327,4 +327,21 @@ virDomainQemuMonitorEventNew(int id,
                              const char *details)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4);
 
+virObjectEventPtr
+virDomainStatsEventNew(const char *key,
+                       virDomainStatsRecordPtr *records,
+                       int nrecords)
+    ATTRIBUTE_NONNULL(1);
+
+int
+virDomainStatsEventStateRegisterID(virConnectPtr conn,
+                                   virObjectEventStatePtr state,
+                                   const char *key,
+                                   virConnectDomainStatsCallback cb,
+                                   void *opaque,
+                                   virFreeCallback freecb,
+                                   int *callbackID)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_NONNULL(4) ATTRIBUTE_NONNULL(7);
+
 #endif
@@ -1347,6 +1347,7 @@ virNetworkForwardDefParseXML(const char *networkName,
     char *forwardDev = NULL;
     char *forwardManaged = NULL;
     char *forwardDriverName = NULL;
+    char *forwardPrebind = NULL;
     char *type = NULL;
     xmlNodePtr save = ctxt->node;
 
@@ -1384,6 +1385,28 @@ virNetworkForwardDefParseXML(const char *networkName,
         def->driverName = driverName;
     }
 
+    forwardPrebind = virXPathString("string(./driver/@prebind)", ctxt);
+    if (forwardPrebind) {
+        if (virStrToLong_uip(forwardPrebind, NULL, 10, &def->prebind) < 0) {
+            virReportError(VIR_ERR_XML_ERROR,
+                           _("Invalid forward <driver prebind='%s'/> "
+                             "in network %s"),
+                           forwardPrebind, networkName);
+            goto cleanup;
+        }
+
+        if (def->prebind &&
+            (def->type != VIR_NETWORK_FORWARD_HOSTDEV ||
+             def->driverName != VIR_NETWORK_FORWARD_DRIVER_NAME_VFIO)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("forward <driver prebind='%s'/> requires "
+                             "mode='hostdev' and <driver name='vfio'/> "
+                             "in network %s"),
+                           forwardPrebind, networkName);
+            goto cleanup;
+        }
+    }
+
     /* bridge and hostdev modes can use a pool of physical interfaces */
     nForwardIfs = virXPathNodeSet("./interface", ctxt, &forwardIfNodes);
     if (nForwardIfs < 0) {
@@ -1571,6 +1594,7 @@ virNetworkForwardDefParseXML(const char *networkName,
     VIR_FREE(forwardDev);
     VIR_FREE(forwardManaged);
     VIR_FREE(forwardDriverName);
+    VIR_FREE(forwardPrebind);
     VIR_FREE(forwardPfNodes);
     VIR_FREE(forwardIfNodes);
     VIR_FREE(forwardAddrNodes);
@@ -2447,7 +2471,10 @@ virNetworkDefFormatBuf(virBufferPtr buf,
                                def->forward.driverName);
                 goto error;
             }
-            virBufferAsprintf(buf, "<driver name='%s'/>\n", driverName);
+            virBufferAsprintf(buf, "<driver name='%s'", driverName);
+            if (def->forward.prebind)
+                virBufferAsprintf(buf, " prebind='%u'", def->forward.prebind);
+            virBufferAddLit(buf, "/>\n");
         }
         if (def->forward.type == VIR_NETWORK_FORWARD_NAT) {
             if (virNetworkForwardNatDefFormat(buf, &def->forward) < 0)
@@ -187,6 +187,7 @@ struct _virNetworkForwardIfDef {
         char *dev;      /* name of device */
     }device;
     int connections; /* how many guest interfaces are connected to this device? */
+    bool prebound; /* bound to the stub driver ahead of use (hostdev only) */
 };
 
 typedef struct _virNetworkForwardPfDef virNetworkForwardPfDef;
@@ -202,6 +203,8 @@ struct _virNetworkForwardDef {
     int type;     /* One of virNetworkForwardType constants */
     bool managed;  /* managed attribute for hostdev mode */
     int driverName; /* enum virNetworkForwardDriverNameType */
+    unsigned int prebind; /* unused VFs to keep bound to the stub driver */
+    bool prebindRunning; /* is a thread topping up the prebound VFs? */
 
     /* If there are multiple forward devices (i.e. a pool of
      * interfaces), they will be listed here.
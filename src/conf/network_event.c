@@ -156,7 +156,7 @@ virNetworkEventStateRegisterID(virConnectPtr conn,
                                          virNetworkEventClass, eventID,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         false, callbackID, false);
+                                         false, false, callbackID, false);
 }
 
 
@@ -200,7 +200,7 @@ virNetworkEventStateRegisterClient(virConnectPtr conn,
                                          virNetworkEventClass, eventID,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         false, callbackID, true);
+                                         false, false, callbackID, true);
 }
 
 
@@ -2757,7 +2757,7 @@ virNodeDeviceGetPCIIOMMUGroupCaps(virNodeDevCapPCIDevPtr pci_dev)
 }
 
 
-static int
+int
 virNodeDeviceGetPCIMdevTypesCaps(const char *sysfspath,
                                  virNodeDevCapPCIDevPtr pci_dev)
 {
@@ -2818,6 +2818,14 @@ virNodeDeviceGetPCIDynamicCaps(const char *sysfsPath ATTRIBUTE_UNUSED,
 }
 
 
+int
+virNodeDeviceGetPCIMdevTypesCaps(const char *sysfspath ATTRIBUTE_UNUSED,
+                                 virNodeDevCapPCIDevPtr pci_dev ATTRIBUTE_UNUSED)
+{
+    return -1;
+}
+
+
 int virNodeDeviceGetSCSITargetCaps(const char *sysfsPath ATTRIBUTE_UNUSED,
                                    virNodeDevCapSCSITargetPtr scsi_target ATTRIBUTE_UNUSED)
 {
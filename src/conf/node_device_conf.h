@@ -171,6 +171,7 @@ struct _virNodeDevCapPCIDev {
     int hdrType; /* enum virPCIHeaderType or -1 */
     virMediatedDeviceTypePtr *mdev_types;
     size_t nmdev_types;
+    bool detailsPending; /* names and config space not read yet */
 };
 
 typedef struct _virNodeDevCapUSBDev virNodeDevCapUSBDev;
@@ -389,6 +390,10 @@ int
 virNodeDeviceGetPCIDynamicCaps(const char *sysfsPath,
                                virNodeDevCapPCIDevPtr pci_dev);
 
+int
+virNodeDeviceGetPCIMdevTypesCaps(const char *sysfspath,
+                                 virNodeDevCapPCIDevPtr pci_dev);
+
 int
 virNodeDeviceUpdateCaps(virNodeDeviceDefPtr def);
 
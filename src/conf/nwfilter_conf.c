@@ -3000,7 +3000,7 @@ virNWFilterRuleDefDetailsFormat(virBufferPtr buf,
 }
 
 
-static int
+int
 virNWFilterRuleDefFormat(virBufferPtr buf,
                          virNWFilterRuleDefPtr def)
 {
@@ -34,11 +34,24 @@
 #include "virerror.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virtime.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 VIR_LOG_INIT("conf.object_event");
 
+/* How long a coalescing callback is kept quiet after each delivery */
+#define VIR_OBJECT_EVENT_COALESCE_WINDOW 1000 /* milliseconds */
+
+struct _virObjectEventCoalesce {
+    unsigned long long sent; /* when the last event was delivered */
+    virObjectEventPtr pending; /* latest event held back since then */
+};
+typedef struct _virObjectEventCoalesce virObjectEventCoalesce;
+typedef virObjectEventCoalesce *virObjectEventCoalescePtr;
+
 struct _virObjectEventCallback {
     int callbackID;
     virClassPtr klass;
@@ -54,14 +67,27 @@ struct _virObjectEventCallback {
     virFreeCallback freecb;
     bool deleted;
     bool legacy; /* true if end user does not know callbackID */
+    bool coalesce; /* true if bursts of events are to be collapsed */
+    virHashTablePtr coalesced; /* coalescing key -> virObjectEventCoalesce */
+    char *indexKey; /* name of the bucket in the list index */
 };
 typedef struct _virObjectEventCallback virObjectEventCallback;
 typedef virObjectEventCallback *virObjectEventCallbackPtr;
 
+/* Callbacks sharing event ID and object filter, in registration order */
+struct _virObjectEventCallbackBucket {
+    size_t count;
+    virObjectEventCallbackPtr *callbacks;
+};
+typedef struct _virObjectEventCallbackBucket virObjectEventCallbackBucket;
+typedef virObjectEventCallbackBucket *virObjectEventCallbackBucketPtr;
+
 struct _virObjectEventCallbackList {
     unsigned int nextID;
     size_t count;
     virObjectEventCallbackPtr *callbacks;
+    /* virObjectEventCallbackIndexKey() -> virObjectEventCallbackBucket */
+    virHashTablePtr index;
 };
 
 struct _virObjectEventQueue {
@@ -127,6 +153,17 @@ virObjectEventDispose(void *obj)
 
     VIR_FREE(event->meta.name);
     VIR_FREE(event->meta.key);
+    VIR_FREE(event->coalesceKey);
+}
+
+
+static void
+virObjectEventCoalesceFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    virObjectEventCoalescePtr entry = payload;
+
+    virObjectUnref(entry->pending);
+    VIR_FREE(entry);
 }
 
 /**
@@ -143,9 +180,93 @@ virObjectEventCallbackFree(virObjectEventCallbackPtr cb)
 
     virObjectUnref(cb->conn);
     VIR_FREE(cb->key);
+    virHashFree(cb->coalesced);
+    VIR_FREE(cb->indexKey);
     VIR_FREE(cb);
 }
 
+
+static void
+virObjectEventCallbackBucketFree(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED)
+{
+    virObjectEventCallbackBucketPtr bucket = payload;
+
+    VIR_FREE(bucket->callbacks);
+    VIR_FREE(bucket);
+}
+
+
+/**
+ * virObjectEventCallbackIndexKey:
+ * @eventID: the event ID
+ * @key: key of the object, or NULL for callbacks without object filter
+ *
+ * Returns the name of the index bucket for callbacks registered for
+ * @eventID and @key, or NULL on OOM.  No error is reported.
+ */
+static char *
+virObjectEventCallbackIndexKey(int eventID,
+                               const char *key)
+{
+    char *ret;
+
+    if (key)
+        ignore_value(virAsprintfQuiet(&ret, "%d:%s", eventID, key));
+    else
+        ignore_value(virAsprintfQuiet(&ret, "%d", eventID));
+    return ret;
+}
+
+
+static int
+virObjectEventCallbackListIndexAdd(virObjectEventCallbackListPtr cbList,
+                                   virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+
+    if (!(cb->indexKey = virObjectEventCallbackIndexKey(cb->eventID,
+                                                        cb->key_filter ?
+                                                        cb->key : NULL))) {
+        virReportOOMError();
+        return -1;
+    }
+
+    if (!(bucket = virHashLookup(cbList->index, cb->indexKey))) {
+        if (VIR_ALLOC(bucket) < 0)
+            return -1;
+        if (virHashAddEntry(cbList->index, cb->indexKey, bucket) < 0) {
+            VIR_FREE(bucket);
+            return -1;
+        }
+    }
+
+    return VIR_APPEND_ELEMENT_COPY(bucket->callbacks, bucket->count, cb);
+}
+
+
+static void
+virObjectEventCallbackListIndexRemove(virObjectEventCallbackListPtr cbList,
+                                      virObjectEventCallbackPtr cb)
+{
+    virObjectEventCallbackBucketPtr bucket;
+    size_t i;
+
+    if (!cb->indexKey ||
+        !(bucket = virHashLookup(cbList->index, cb->indexKey)))
+        return;
+
+    for (i = 0; i < bucket->count; i++) {
+        if (bucket->callbacks[i] == cb) {
+            VIR_DELETE_ELEMENT(bucket->callbacks, i, bucket->count);
+            break;
+        }
+    }
+
+    if (bucket->count == 0)
+        virHashRemoveEntry(cbList->index, cb->indexKey);
+}
+
 /**
  * virObjectEventCallbackListFree:
  * @list: event callback list head
@@ -163,9 +284,12 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
         virFreeCallback freecb = list->callbacks[i]->freecb;
         if (freecb)
             (*freecb)(list->callbacks[i]->opaque);
+        virHashFree(list->callbacks[i]->coalesced);
+        VIR_FREE(list->callbacks[i]->indexKey);
         VIR_FREE(list->callbacks[i]);
     }
     VIR_FREE(list->callbacks);
+    virHashFree(list->index);
     VIR_FREE(list);
 }
 
@@ -177,6 +301,7 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
  * @klass: the base event class
  * @eventID: the event ID
  * @key: optional key of per-object filtering
+ * @coalesce: whether the callbacks coalesce events
  * @serverFilter: true if server supports object filtering
  *
  * Internal function to count how many callbacks remain registered for
@@ -190,7 +315,9 @@ virObjectEventCallbackListFree(virObjectEventCallbackListPtr list)
  * with virObjectEventStateSetRemote().  Note that this function
  * intentionally ignores the legacy field, since RPC calls use only a
  * single callback on the server to manage both legacy and modern
- * global domain lifecycle events.
+ * global domain lifecycle events.  Similarly, @coalesce only matters
+ * when @serverFilter is true: the server then does the coalescing
+ * itself and needs a separate callback for it.
  */
 static int
 virObjectEventCallbackListCount(virConnectPtr conn,
@@ -198,6 +325,7 @@ virObjectEventCallbackListCount(virConnectPtr conn,
                                 virClassPtr klass,
                                 int eventID,
                                 const char *key,
+                                bool coalesce,
                                 bool serverFilter)
 {
     size_t i;
@@ -214,6 +342,7 @@ virObjectEventCallbackListCount(virConnectPtr conn,
             !cb->deleted &&
             (!serverFilter ||
              (cb->remoteID >= 0 &&
+              cb->coalesce == coalesce &&
               ((key && cb->key_filter && STREQ(cb->key, key)) ||
                (!key && !cb->key_filter)))))
             ret++;
@@ -248,6 +377,7 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
                 (virObjectEventCallbackListCount(conn, cbList, cb->klass,
                                                  cb->eventID,
                                                  cb->key_filter ? cb->key : NULL,
+                                                 cb->coalesce,
                                                  cb->remoteID >= 0) - 1);
 
             /* @doFreeCb inhibits calling @freecb from error paths in
@@ -255,6 +385,7 @@ virObjectEventCallbackListRemoveID(virConnectPtr conn,
              * function won't end up with a double free error */
             if (doFreeCb && cb->freecb)
                 (*cb->freecb)(cb->opaque);
+            virObjectEventCallbackListIndexRemove(cbList, cb);
             virObjectEventCallbackFree(cb);
             VIR_DELETE_ELEMENT(cbList->callbacks, i, cbList->count);
             return ret;
@@ -284,6 +415,7 @@ virObjectEventCallbackListMarkDeleteID(virConnectPtr conn,
                 virObjectEventCallbackListCount(conn, cbList, cb->klass,
                                                 cb->eventID,
                                                 cb->key_filter ? cb->key : NULL,
+                                                cb->coalesce,
                                                 cb->remoteID >= 0);
         }
     }
@@ -304,6 +436,8 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
             virFreeCallback freecb = cbList->callbacks[n]->freecb;
             if (freecb)
                 (*freecb)(cbList->callbacks[n]->opaque);
+            virObjectEventCallbackListIndexRemove(cbList,
+                                                  cbList->callbacks[n]);
             virObjectEventCallbackFree(cbList->callbacks[n]);
 
             VIR_DELETE_ELEMENT(cbList->callbacks, n, cbList->count);
@@ -323,6 +457,7 @@ virObjectEventCallbackListPurgeMarked(virObjectEventCallbackListPtr cbList)
  * @eventID: the event ID
  * @callback: the callback to locate
  * @legacy: true if callback is tracked by function instead of callbackID
+ * @coalesce: true if callback coalesces events
  * @remoteID: optionally return a known remoteID
  *
  * Internal function to determine if @callback already has a
@@ -340,6 +475,7 @@ virObjectEventCallbackLookup(virConnectPtr conn,
                              int eventID,
                              virConnectObjectEventGenericCallback callback,
                              bool legacy,
+                             bool coalesce,
                              int *remoteID)
 {
     size_t i;
@@ -355,6 +491,7 @@ virObjectEventCallbackLookup(virConnectPtr conn,
         if (cb->klass == klass &&
             cb->eventID == eventID &&
             cb->conn == conn &&
+            cb->coalesce == coalesce &&
             ((key && cb->key_filter && STREQ(cb->key, key)) ||
              (!key && !cb->key_filter))) {
             if (remoteID)
@@ -381,6 +518,7 @@ virObjectEventCallbackLookup(virConnectPtr conn,
  * @opaque: opaque data to pass to @callback
  * @freecb: callback to free @opaque
  * @legacy: true if callback is tracked by function instead of callbackID
+ * @coalesce: true if bursts of events are to be collapsed
  * @callbackID: filled with callback ID
  * @serverFilter: true if server supports object filtering
  *
@@ -398,6 +536,7 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
                                 void *opaque,
                                 virFreeCallback freecb,
                                 bool legacy,
+                                bool coalesce,
                                 int *callbackID,
                                 bool serverFilter)
 {
@@ -407,9 +546,9 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
 
     VIR_DEBUG("conn=%p cblist=%p key=%p filter=%p filter_opaque=%p "
               "klass=%p eventID=%d callback=%p opaque=%p "
-              "legacy=%d callbackID=%p serverFilter=%d",
+              "legacy=%d coalesce=%d callbackID=%p serverFilter=%d",
               conn, cbList, key, filter, filter_opaque, klass, eventID,
-              callback, opaque, legacy, callbackID, serverFilter);
+              callback, opaque, legacy, coalesce, callbackID, serverFilter);
 
     /* Check incoming */
     if (!cbList)
@@ -420,6 +559,7 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     if (!filter &&
         virObjectEventCallbackLookup(conn, cbList, key,
                                      klass, eventID, callback, legacy,
+                                     coalesce,
                                      serverFilter ? &remoteID : NULL) != -1) {
         virReportError(VIR_ERR_INVALID_ARG, "%s",
                        _("event callback already tracked"));
@@ -445,9 +585,15 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
     cb->filter = filter;
     cb->filter_opaque = filter_opaque;
     cb->legacy = legacy;
+    cb->coalesce = coalesce;
+
+    if (virObjectEventCallbackListIndexAdd(cbList, cb) < 0)
+        goto cleanup;
 
-    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0)
+    if (VIR_APPEND_ELEMENT(cbList->callbacks, cbList->count, cb) < 0) {
+        virObjectEventCallbackListIndexRemove(cbList, cb);
         goto cleanup;
+    }
 
     /* When additional filtering is being done, every client callback
      * is matched to exactly one server callback.  */
@@ -455,7 +601,7 @@ virObjectEventCallbackListAddID(virConnectPtr conn,
         ret = 1;
     } else {
         ret = virObjectEventCallbackListCount(conn, cbList, klass, eventID,
-                                              key, serverFilter);
+                                              key, coalesce, serverFilter);
         if (serverFilter && remoteID < 0)
             ret++;
     }
@@ -572,6 +718,10 @@ virObjectEventStateNew(void)
     if (VIR_ALLOC(state->callbacks) < 0)
         goto error;
 
+    if (!(state->callbacks->index =
+          virHashCreate(32, virObjectEventCallbackBucketFree)))
+        goto error;
+
     if (!(state->queue = virObjectEventQueueNew()))
         goto error;
 
@@ -639,6 +789,26 @@ virObjectEventNew(virClassPtr klass,
 }
 
 
+/**
+ * virObjectEventSetCoalesceKey:
+ * @event: the event
+ * @key: what @event describes within its object, may be empty
+ *
+ * Allow @event to be coalesced for callbacks registered with coalescing
+ * enabled: of several events with the same ID, object and @key that
+ * arrive in short succession only the latest is delivered.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virObjectEventSetCoalesceKey(virObjectEventPtr event,
+                             const char *key)
+{
+    VIR_FREE(event->coalesceKey);
+    return VIR_STRDUP(event->coalesceKey, key);
+}
+
+
 /**
  * virObjectEventQueuePush:
  * @evtQueue: the object event queue
@@ -685,28 +855,149 @@ virObjectEventDispatchMatchCallback(virObjectEventPtr event,
 }
 
 
+/**
+ * virObjectEventCallbackCoalesce:
+ * @cb: coalescing callback about to receive @event
+ * @event: the event
+ * @now: current time in milliseconds
+ *
+ * Records delivery of @event to @cb, unless @cb already received an
+ * event with the same coalescing key within the coalescing window, in
+ * which case @event replaces whatever event was held back for that key
+ * until the window expires.  Failure to record anything is not fatal,
+ * the event is simply delivered right away.
+ *
+ * Returns true if @event was held back, false if it must be
+ * dispatched now.
+ */
+static bool
+virObjectEventCallbackCoalesce(virObjectEventCallbackPtr cb,
+                               virObjectEventPtr event,
+                               unsigned long long now)
+{
+    virObjectEventCoalescePtr entry;
+    char *key = NULL;
+    bool ret = false;
+
+    if (virAsprintfQuiet(&key, "%s:%s",
+                         event->meta.key, event->coalesceKey) < 0)
+        return false;
+
+    if (!cb->coalesced &&
+        !(cb->coalesced = virHashCreate(8, virObjectEventCoalesceFree))) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    if (!(entry = virHashLookup(cb->coalesced, key))) {
+        if (VIR_ALLOC_QUIET(entry) < 0)
+            goto cleanup;
+        if (virHashAddEntry(cb->coalesced, key, entry) < 0) {
+            virResetLastError();
+            VIR_FREE(entry);
+            goto cleanup;
+        }
+        entry->sent = now;
+        goto cleanup;
+    }
+
+    if (!entry->pending &&
+        now - entry->sent >= VIR_OBJECT_EVENT_COALESCE_WINDOW) {
+        entry->sent = now;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("holding back event %p for callback %d", event, cb->callbackID);
+    virObjectUnref(entry->pending);
+    entry->pending = virObjectRef(event);
+    ret = true;
+
+ cleanup:
+    VIR_FREE(key);
+    return ret;
+}
+
+
+static void
+virObjectEventStateDispatchCallback(virObjectEventStatePtr state,
+                                    virObjectEventPtr event,
+                                    virObjectEventCallbackPtr cb,
+                                    unsigned long long *now)
+{
+    if (!virObjectEventDispatchMatchCallback(event, cb))
+        return;
+
+    if (cb->coalesce && event->coalesceKey &&
+        (*now || virTimeMillisNowRaw(now) == 0) &&
+        virObjectEventCallbackCoalesce(cb, event, *now))
+        return;
+
+    /* Drop the lock whle dispatching, for sake of re-entrancy */
+    virObjectUnlock(state);
+    event->dispatch(cb->conn, event, cb->cb, cb->opaque);
+    virObjectLock(state);
+}
+
+
 static void
 virObjectEventStateDispatchCallbacks(virObjectEventStatePtr state,
                                      virObjectEventPtr event,
                                      virObjectEventCallbackListPtr callbacks)
 {
-    size_t i;
-    /* Cache this now, since we may be dropping the lock,
-       and have more callbacks added. We're guaranteed not
-       to have any removed */
-    size_t cbCount = callbacks->count;
-
-    for (i = 0; i < cbCount; i++) {
-        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
-
-        if (!virObjectEventDispatchMatchCallback(event, cb))
-            continue;
+    virObjectEventCallbackBucketPtr global = NULL;
+    virObjectEventCallbackBucketPtr local = NULL;
+    size_t nglobal = 0;
+    size_t nlocal = 0;
+    size_t i = 0;
+    size_t j = 0;
+    char *globalKey = virObjectEventCallbackIndexKey(event->eventID, NULL);
+    char *localKey = virObjectEventCallbackIndexKey(event->eventID,
+                                                    event->meta.key);
+    unsigned long long now = 0;
+
+    PROBE_QUIET(OBJECT_EVENT_DISPATCH_BEGIN, "event=%p eventID=%d name=%s",
+                event, event->eventID, event->meta.name);
+
+    if (!globalKey || !localKey) {
+        /* Cache this now, since we may be dropping the lock,
+           and have more callbacks added. We're guaranteed not
+           to have any removed */
+        size_t cbCount = callbacks->count;
+
+        for (i = 0; i < cbCount; i++)
+            virObjectEventStateDispatchCallback(state, event,
+                                                callbacks->callbacks[i], &now);
+        goto cleanup;
+    }
 
-        /* Drop the lock whle dispatching, for sake of re-entrancy */
-        virObjectUnlock(state);
-        event->dispatch(cb->conn, event, cb->cb, cb->opaque);
-        virObjectLock(state);
+    /* Only callbacks for this event ID, either without object filter
+     * or filtering on this very object, can possibly match.  Walk both
+     * buckets by callbackID so that callbacks are still invoked in the
+     * order they were registered.  As above, callbacks added while the
+     * lock is dropped are not considered.  */
+    if ((global = virHashLookup(callbacks->index, globalKey)))
+        nglobal = global->count;
+    if ((local = virHashLookup(callbacks->index, localKey)))
+        nlocal = local->count;
+
+    while (i < nglobal || j < nlocal) {
+        virObjectEventCallbackPtr cb;
+
+        if (j == nlocal ||
+            (i < nglobal &&
+             global->callbacks[i]->callbackID < local->callbacks[j]->callbackID))
+            cb = global->callbacks[i++];
+        else
+            cb = local->callbacks[j++];
+
+        virObjectEventStateDispatchCallback(state, event, cb, &now);
     }
+
+ cleanup:
+    PROBE_QUIET(OBJECT_EVENT_DISPATCH_END, "event=%p eventID=%d name=%s",
+                event, event->eventID, event->meta.name);
+    VIR_FREE(globalKey);
+    VIR_FREE(localKey);
 }
 
 
@@ -783,6 +1074,103 @@ virObjectEventStateQueue(virObjectEventStatePtr state,
 }
 
 
+struct virObjectEventCoalesceData {
+    unsigned long long now;
+    long long next; /* milliseconds until the next entry expires */
+    virObjectEventPtr *events;
+    size_t nevents;
+};
+
+
+static int
+virObjectEventCoalesceExpired(const void *payload,
+                              const void *name ATTRIBUTE_UNUSED,
+                              const void *opaque)
+{
+    const virObjectEventCoalesce *entry = payload;
+    const struct virObjectEventCoalesceData *data = opaque;
+
+    return !entry->pending &&
+        data->now - entry->sent >= VIR_OBJECT_EVENT_COALESCE_WINDOW;
+}
+
+
+static int
+virObjectEventCoalesceCollect(void *payload,
+                              const void *name ATTRIBUTE_UNUSED,
+                              void *opaque)
+{
+    virObjectEventCoalescePtr entry = payload;
+    struct virObjectEventCoalesceData *data = opaque;
+    long long left;
+
+    if (entry->pending &&
+        data->now - entry->sent >= VIR_OBJECT_EVENT_COALESCE_WINDOW) {
+        if (VIR_APPEND_ELEMENT_QUIET(data->events, data->nevents,
+                                     entry->pending) < 0)
+            return 0;
+        entry->sent = data->now;
+    }
+
+    left = VIR_OBJECT_EVENT_COALESCE_WINDOW - (data->now - entry->sent);
+    if (left < 0)
+        left = 0;
+    if (data->next < 0 || left < data->next)
+        data->next = left;
+
+    return 0;
+}
+
+
+/**
+ * virObjectEventStateCoalesceDispatch:
+ * @state: the event state object
+ *
+ * Deliver events that coalescing callbacks held back once their window
+ * has expired, and forget about keys that went quiet.  Must be called
+ * with @state locked and isDispatching set.
+ *
+ * Returns the number of milliseconds until this has to be done again,
+ * or -1 if there is nothing left being coalesced.
+ */
+static long long
+virObjectEventStateCoalesceDispatch(virObjectEventStatePtr state)
+{
+    virObjectEventCallbackListPtr callbacks = state->callbacks;
+    struct virObjectEventCoalesceData data = { .next = -1 };
+    size_t cbCount = callbacks->count;
+    size_t i, j;
+
+    if (virTimeMillisNowRaw(&data.now) < 0)
+        return -1;
+
+    for (i = 0; i < cbCount; i++) {
+        virObjectEventCallbackPtr cb = callbacks->callbacks[i];
+
+        if (!cb->coalesced || cb->deleted)
+            continue;
+
+        virHashRemoveSet(cb->coalesced, virObjectEventCoalesceExpired, &data);
+        virHashForEach(cb->coalesced, virObjectEventCoalesceCollect, &data);
+
+        for (j = 0; j < data.nevents; j++) {
+            virObjectEventPtr event = data.events[j];
+
+            if (!cb->deleted) {
+                virObjectUnlock(state);
+                event->dispatch(cb->conn, event, cb->cb, cb->opaque);
+                virObjectLock(state);
+            }
+            virObjectUnref(event);
+        }
+        VIR_FREE(data.events);
+        data.nevents = 0;
+    }
+
+    return data.next;
+}
+
+
 static void
 virObjectEventStateCleanupTimer(virObjectEventStatePtr state, bool clear_queue)
 {
@@ -806,6 +1194,7 @@ static void
 virObjectEventStateFlush(virObjectEventStatePtr state)
 {
     virObjectEventQueue tempQueue;
+    long long next;
 
     /* We need to lock as well as ref due to the fact that we might
      * unref the state we're working on in this very function */
@@ -825,6 +1214,7 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
     virObjectEventStateQueueDispatch(state,
                                      &tempQueue,
                                      state->callbacks);
+    next = virObjectEventStateCoalesceDispatch(state);
 
     /* Purge any deleted callbacks */
     virObjectEventCallbackListPurgeMarked(state->callbacks);
@@ -833,6 +1223,11 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
      * well like virObjectEventStateDeregisterID() would do. */
     virObjectEventStateCleanupTimer(state, true);
 
+    /* Come back for events held back by coalescing callbacks, unless
+     * new events got queued meanwhile and the timer already fires. */
+    if (state->timer != -1 && state->queue->count == 0 && next >= 0)
+        virEventUpdateTimeout(state->timer, next);
+
     state->isDispatching = false;
     virObjectUnlock(state);
     virObjectUnref(state);
@@ -850,6 +1245,7 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
  * @opaque: data blob to pass to @callback
  * @freecb: callback to free @opaque
  * @legacy: true if callback is tracked by function instead of callbackID
+ * @coalesce: true if bursts of events are to be collapsed
  * @callbackID: filled with callback ID
  * @serverFilter: true if server supports object filtering
  *
@@ -857,6 +1253,12 @@ virObjectEventStateFlush(virObjectEventStatePtr state)
  * events of type @eventID, and return the registration handle in
  * @callbackID.
  *
+ * If @coalesce is true, events that were given a coalescing key with
+ * virObjectEventSetCoalesceKey() are delivered to @cb at most once per
+ * VIR_OBJECT_EVENT_COALESCE_WINDOW for each object and key; events
+ * arriving in between replace each other and only the latest one is
+ * delivered once the window expires.
+ *
  * The return value is only important when registering client-side
  * mirroring of remote events (since the public API is documented to
  * return the callbackID rather than a count).  A return of 1 means
@@ -885,6 +1287,7 @@ virObjectEventStateRegisterID(virConnectPtr conn,
                               void *opaque,
                               virFreeCallback freecb,
                               bool legacy,
+                              bool coalesce,
                               int *callbackID,
                               bool serverFilter)
 {
@@ -911,7 +1314,8 @@ virObjectEventStateRegisterID(virConnectPtr conn,
                                           key, filter, filter_opaque,
                                           klass, eventID,
                                           cb, opaque, freecb,
-                                          legacy, callbackID, serverFilter);
+                                          legacy, coalesce, callbackID,
+                                          serverFilter);
 
     if (ret < 0)
         virObjectEventStateCleanupTimer(state, false);
@@ -988,7 +1392,7 @@ virObjectEventStateCallbackID(virConnectPtr conn,
     virObjectLock(state);
     ret = virObjectEventCallbackLookup(conn, state->callbacks, NULL,
                                        klass, eventID, callback, true,
-                                       remoteID);
+                                       false, remoteID);
     virObjectUnlock(state);
 
     if (ret < 0)
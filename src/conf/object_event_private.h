@@ -51,6 +51,7 @@ struct _virObjectEvent {
     virObjectMeta meta;
     int remoteID;
     virObjectEventDispatchFunc dispatch;
+    char *coalesceKey; /* set if the event may be coalesced */
 };
 
 /**
@@ -82,10 +83,11 @@ virObjectEventStateRegisterID(virConnectPtr conn,
                               void *opaque,
                               virFreeCallback freecb,
                               bool legacy,
+                              bool coalesce,
                               int *callbackID,
                               bool remoteFilter)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(6)
-    ATTRIBUTE_NONNULL(8) ATTRIBUTE_NONNULL(12);
+    ATTRIBUTE_NONNULL(8) ATTRIBUTE_NONNULL(13);
 
 int
 virObjectEventStateCallbackID(virConnectPtr conn,
@@ -108,4 +110,9 @@ virObjectEventNew(virClassPtr klass,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5)
     ATTRIBUTE_NONNULL(7);
 
+int
+virObjectEventSetCoalesceKey(virObjectEventPtr event,
+                             const char *key)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 #endif
@@ -186,7 +186,7 @@ virSecretEventStateRegisterID(virConnectPtr conn,
                                          virSecretEventClass, eventID,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         false, callbackID, false);
+                                         false, false, callbackID, false);
 }
 
 
@@ -231,7 +231,7 @@ virSecretEventStateRegisterClient(virConnectPtr conn,
                                          virSecretEventClass, eventID,
                                          VIR_OBJECT_EVENT_CALLBACK(cb),
                                          opaque, freecb,
-                                         false, callbackID, true);
+                                         false, false, callbackID, true);
 }
 
 
@@ -61,6 +61,19 @@ struct _virStorageVolSource {
 
 typedef struct _virStorageVolDef virStorageVolDef;
 typedef virStorageVolDef *virStorageVolDefPtr;
+/* Identity of the file a volume was probed from, used to tell whether
+ * an incremental pool refresh has to probe it again */
+typedef struct _virStorageVolStamp virStorageVolStamp;
+typedef virStorageVolStamp *virStorageVolStampPtr;
+struct _virStorageVolStamp {
+    bool valid;
+    unsigned long long dev;
+    unsigned long long ino;
+    unsigned long long size;
+    struct timespec mtime;
+    struct timespec ctime;
+};
+
 struct _virStorageVolDef {
     char *name;
     char *key;
@@ -71,6 +84,8 @@ struct _virStorageVolDef {
 
     virStorageVolSource source;
     virStorageSource target;
+
+    virStorageVolStamp stamp;
 };
 
 typedef struct _virStorageVolDefList virStorageVolDefList;
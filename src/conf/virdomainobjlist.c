@@ -30,33 +30,97 @@
 #include "snapshot_conf.h"
 #include "viralloc.h"
 #include "virfile.h"
+#include "virhashcode.h"
+#include "intprops.h"
+#include "viratomic.h"
 #include "virlog.h"
+#include "virrandom.h"
 #include "virstring.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_DOMAIN
 
 VIR_LOG_INIT("conf.virdomainobjlist");
 
+/* Number of shards each of the lookup tables is split into. Must
+ * be a power of two. */
+#define VIR_DOMAIN_OBJ_LIST_SHARDS 16
+
+/* Number of removed domains remembered for
+ * virDomainObjListExportChanged */
+#define VIR_DOMAIN_OBJ_LIST_REMOVED_MAX 1024
+
+#define VIR_DOMAIN_OBJ_LIST_CONFIG_PARSE_FLAGS \
+    (VIR_DOMAIN_DEF_PARSE_INACTIVE | \
+     VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE | \
+     VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)
+
 static virClassPtr virDomainObjListClass;
 static void virDomainObjListDispose(void *obj);
 
 
+/*
+ * A shard owns a slice of one of the lookup tables. Its lock is
+ * a leaf lock: while holding it nothing may be locked, in
+ * particular not a domain object, so that lookups never wait
+ * for the list lock or for a domain being defined or undefined.
+ */
+typedef struct _virDomainObjListRemoved virDomainObjListRemoved;
+typedef virDomainObjListRemoved *virDomainObjListRemovedPtr;
+struct _virDomainObjListRemoved {
+    virDomainDefPtr def; /* stub, only virtType, uuid and name */
+    unsigned long long generation;
+};
+
+typedef struct _virDomainObjListShard virDomainObjListShard;
+typedef virDomainObjListShard *virDomainObjListShardPtr;
+struct _virDomainObjListShard {
+    virMutex lock;
+    virHashTablePtr table;
+};
+
 struct _virDomainObjList {
-    virObjectRWLockable parent;
+    virObjectLockable parent;
 
-    /* uuid string -> virDomainObj  mapping
-     * for O(1), lockless lookup-by-uuid */
-    virHashTable *objs;
+    /* The object lock serializes modifications that must check
+     * both tables atomically (add, rename, load). Lookups and
+     * iteration only take shard locks. */
+
+    uint32_t seed;
 
-    /* name -> virDomainObj mapping for O(1),
-     * lockless lookup-by-name */
-    virHashTable *objsName;
+    /* uuid string -> virDomainObj  mapping
+     * for O(1) lookup-by-uuid */
+    virDomainObjListShardPtr objs[VIR_DOMAIN_OBJ_LIST_SHARDS];
+
+    /* name -> virDomainObj mapping for O(1)
+     * lookup-by-name */
+    virDomainObjListShardPtr objsName[VIR_DOMAIN_OBJ_LIST_SHARDS];
+
+    /* id string -> virDomainObj mapping for O(1) lookup-by-id of
+     * active domains. Kept up to date by virDomainObjListSetID, filled
+     * in by lookups otherwise. Entries may be stale, lookups check the
+     * ID of the object found. */
+    virDomainObjListShardPtr objsID[VIR_DOMAIN_OBJ_LIST_SHARDS];
+
+    /* Lazy loading of inactive definitions, set up once by
+     * virDomainObjListSetLazyLoad before any domain is loaded */
+    char *lazyConfigDir;
+    virCapsPtr lazyCaps;
+    virDomainXMLOptionPtr lazyXMLOpt;
+    unsigned int lazyMaxDefs; /* 0 if lazy loading is disabled */
+    volatile int lazyTick;
+
+    /* Recently removed domains, oldest first. Protected by the
+     * object lock. Changes up to removedFloor are forgotten. */
+    virDomainObjListRemovedPtr removed;
+    size_t nremoved;
+    unsigned long long removedFloor;
 };
 
 
 static int virDomainObjListOnceInit(void)
 {
-    if (!VIR_CLASS_NEW(virDomainObjList, virClassForObjectRWLockable()))
+    if (!VIR_CLASS_NEW(virDomainObjList, virClassForObjectLockable()))
         return -1;
 
     return 0;
@@ -64,20 +128,171 @@ static int virDomainObjListOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virDomainObjList)
 
+
+static void
+virDomainObjListShardFree(virDomainObjListShardPtr shard)
+{
+    if (!shard)
+        return;
+
+    virHashFree(shard->table);
+    virMutexDestroy(&shard->lock);
+    VIR_FREE(shard);
+}
+
+
+static virDomainObjListShardPtr
+virDomainObjListShardNew(void)
+{
+    virDomainObjListShardPtr shard;
+
+    if (VIR_ALLOC(shard) < 0)
+        return NULL;
+
+    if (virMutexInit(&shard->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        VIR_FREE(shard);
+        return NULL;
+    }
+
+    if (!(shard->table = virHashCreate(8, virObjectFreeHashData))) {
+        virDomainObjListShardFree(shard);
+        return NULL;
+    }
+
+    return shard;
+}
+
+
+static virDomainObjListShardPtr
+virDomainObjListGetShard(virDomainObjListPtr doms,
+                         virDomainObjListShardPtr *shards,
+                         const char *key)
+{
+    uint32_t code = virHashCodeGen(key, strlen(key), doms->seed);
+
+    return shards[code & (VIR_DOMAIN_OBJ_LIST_SHARDS - 1)];
+}
+
+
+/*
+ * Returns the object stored under @key with an extra reference,
+ * but not locked, or NULL if there is none.
+ */
+static virDomainObjPtr
+virDomainObjListShardLookup(virDomainObjListShardPtr shard,
+                            const char *key)
+{
+    virDomainObjPtr obj;
+
+    virMutexLock(&shard->lock);
+    obj = virObjectRef(virHashLookup(shard->table, key));
+    virMutexUnlock(&shard->lock);
+
+    return obj;
+}
+
+
+/*
+ * Stores @obj under @key. On success the table holds a reference
+ * to @obj which is dropped once the entry is removed.
+ */
+static int
+virDomainObjListShardAdd(virDomainObjListShardPtr shard,
+                         const char *key,
+                         virDomainObjPtr obj)
+{
+    int ret;
+
+    virMutexLock(&shard->lock);
+    if ((ret = virHashAddEntry(shard->table, key, obj)) == 0)
+        virObjectRef(obj);
+    virMutexUnlock(&shard->lock);
+
+    return ret;
+}
+
+
+static void
+virDomainObjListShardRemove(virDomainObjListShardPtr shard,
+                            const char *key)
+{
+    virMutexLock(&shard->lock);
+    virHashRemoveEntry(shard->table, key);
+    virMutexUnlock(&shard->lock);
+}
+
+
+/*
+ * Stores @obj under @id in the ID table, replacing any other object
+ * stored there.
+ */
+static void
+virDomainObjListIDAdd(virDomainObjListPtr doms,
+                      int id,
+                      virDomainObjPtr obj)
+{
+    char key[INT_BUFSIZE_BOUND(int)];
+    virDomainObjListShardPtr shard;
+
+    snprintf(key, sizeof(key), "%d", id);
+    shard = virDomainObjListGetShard(doms, doms->objsID, key);
+
+    virMutexLock(&shard->lock);
+    if (virHashUpdateEntry(shard->table, key, obj) == 0)
+        virObjectRef(obj);
+    else
+        virResetLastError(); /* lookups fall back to a scan */
+    virMutexUnlock(&shard->lock);
+}
+
+
+/*
+ * Removes the entry for @id from the ID table if @obj is stored
+ * there.
+ */
+static void
+virDomainObjListIDRemove(virDomainObjListPtr doms,
+                         int id,
+                         virDomainObjPtr obj)
+{
+    char key[INT_BUFSIZE_BOUND(int)];
+    virDomainObjListShardPtr shard;
+
+    if (id < 0)
+        return;
+
+    snprintf(key, sizeof(key), "%d", id);
+    shard = virDomainObjListGetShard(doms, doms->objsID, key);
+
+    virMutexLock(&shard->lock);
+    if (virHashLookup(shard->table, key) == obj)
+        virHashRemoveEntry(shard->table, key);
+    virMutexUnlock(&shard->lock);
+}
+
+
 virDomainObjListPtr virDomainObjListNew(void)
 {
     virDomainObjListPtr doms;
+    size_t i;
 
     if (virDomainObjListInitialize() < 0)
         return NULL;
 
-    if (!(doms = virObjectRWLockableNew(virDomainObjListClass)))
+    if (!(doms = virObjectLockableNew(virDomainObjListClass)))
         return NULL;
 
-    if (!(doms->objs = virHashCreate(50, virObjectFreeHashData)) ||
-        !(doms->objsName = virHashCreate(50, virObjectFreeHashData))) {
-        virObjectUnref(doms);
-        return NULL;
+    doms->seed = virRandomBits(32);
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_SHARDS; i++) {
+        if (!(doms->objs[i] = virDomainObjListShardNew()) ||
+            !(doms->objsName[i] = virDomainObjListShardNew()) ||
+            !(doms->objsID[i] = virDomainObjListShardNew())) {
+            virObjectUnref(doms);
+            return NULL;
+        }
     }
 
     return doms;
@@ -87,9 +302,154 @@ virDomainObjListPtr virDomainObjListNew(void)
 static void virDomainObjListDispose(void *obj)
 {
     virDomainObjListPtr doms = obj;
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_SHARDS; i++) {
+        virDomainObjListShardFree(doms->objs[i]);
+        virDomainObjListShardFree(doms->objsName[i]);
+        virDomainObjListShardFree(doms->objsID[i]);
+    }
+
+    VIR_FREE(doms->lazyConfigDir);
+    virObjectUnref(doms->lazyCaps);
+    virObjectUnref(doms->lazyXMLOpt);
 
-    virHashFree(doms->objs);
-    virHashFree(doms->objsName);
+    for (i = 0; i < doms->nremoved; i++)
+        virDomainDefFree(doms->removed[i].def);
+    VIR_FREE(doms->removed);
+}
+
+
+/**
+ * virDomainObjListSetLazyLoad:
+ * @doms: Domain object list
+ * @configDir: directory holding the persistent configs
+ * @caps: capabilities used for parsing the configs
+ * @xmlopt: XML parser configuration
+ * @maxDefs: number of inactive definitions to keep parsed
+ *
+ * Make virDomainObjListLoadAllConfigs keep only the name, UUID and
+ * state of inactive persistent domains. Their definition is parsed
+ * from @configDir again when the domain is looked up or collected and
+ * once more than @maxDefs of them are parsed and not in use, the least
+ * recently used ones are dropped again. A @maxDefs of 0 disables lazy
+ * loading. Only affects configs loaded afterwards, so it must be called
+ * before the inactive configs are loaded; the active domains may
+ * already be in @doms.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainObjListSetLazyLoad(virDomainObjListPtr doms,
+                            const char *configDir,
+                            virCapsPtr caps,
+                            virDomainXMLOptionPtr xmlopt,
+                            unsigned int maxDefs)
+{
+    char *dir = NULL;
+
+    if (maxDefs && VIR_STRDUP(dir, configDir) < 0)
+        return -1;
+
+    virObjectLock(doms);
+
+    VIR_FREE(doms->lazyConfigDir);
+    virObjectUnref(doms->lazyCaps);
+    virObjectUnref(doms->lazyXMLOpt);
+
+    VIR_STEAL_PTR(doms->lazyConfigDir, dir);
+    doms->lazyCaps = maxDefs ? virObjectRef(caps) : NULL;
+    doms->lazyXMLOpt = maxDefs ? virObjectRef(xmlopt) : NULL;
+    doms->lazyMaxDefs = maxDefs;
+
+    virObjectUnlock(doms);
+    return 0;
+}
+
+
+struct virDomainObjListSnapshotData {
+    virDomainObjPtr *vms;
+    size_t nvms;
+};
+
+
+static int
+virDomainObjListSnapshotIterator(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED,
+                                 void *opaque)
+{
+    struct virDomainObjListSnapshotData *data = opaque;
+
+    data->vms[data->nvms++] = virObjectRef(payload);
+    return 0;
+}
+
+
+/*
+ * virDomainObjListSnapshot:
+ * @doms: Domain object list
+ * @vms: filled with the domain objects
+ * @nvms: filled with the number of entries in @vms
+ *
+ * Collect a reference to every domain in @doms, one shard at a
+ * time, so that concurrent define/undefine is never blocked by
+ * iteration. Domains added while collecting may be missed and
+ * domains removed meanwhile may still be returned, so callers
+ * have to check the ->removing flag where it matters. The caller
+ * must release the array with virObjectListFreeCount.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+static int
+virDomainObjListSnapshot(virDomainObjListPtr doms,
+                         virDomainObjPtr **vms,
+                         size_t *nvms)
+{
+    struct virDomainObjListSnapshotData data = { NULL, 0 };
+    size_t alloc = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_DOMAIN_OBJ_LIST_SHARDS; i++) {
+        virDomainObjListShardPtr shard = doms->objs[i];
+
+        virMutexLock(&shard->lock);
+        if (VIR_RESIZE_N(data.vms, alloc, data.nvms,
+                         virHashSize(shard->table)) < 0) {
+            virMutexUnlock(&shard->lock);
+            virObjectListFreeCount(data.vms, data.nvms);
+            return -1;
+        }
+        virHashForEach(shard->table, virDomainObjListSnapshotIterator, &data);
+        virMutexUnlock(&shard->lock);
+    }
+
+    *vms = data.vms;
+    *nvms = data.nvms;
+    return 0;
+}
+
+
+/*
+ * Call @iter on a snapshot of the domains in @doms. The
+ * iterator is called without any lock held.
+ */
+static int
+virDomainObjListIterate(virDomainObjListPtr doms,
+                        virHashIterator iter,
+                        void *opaque)
+{
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    size_t i;
+
+    if (virDomainObjListSnapshot(doms, &vms, &nvms) < 0)
+        return -1;
+
+    for (i = 0; i < nvms; i++)
+        iter(vms[i], NULL, opaque);
+
+    virObjectListFreeCount(vms, nvms);
+    return 0;
 }
 
 
@@ -110,90 +470,360 @@ static int virDomainObjListSearchID(const void *payload,
 }
 
 
-virDomainObjPtr
-virDomainObjListFindByID(virDomainObjListPtr doms,
-                         int id)
+/*
+ * Whether the definition of the locked @vm may be replaced by a stub.
+ * Apart from the two lookup tables, at most @refs - 2 references may
+ * be held, all of them by the caller, so that no other thread can be
+ * in the middle of using the definition.
+ */
+static bool
+virDomainObjListCanStub(virDomainObjPtr vm,
+                        int refs)
 {
-    virDomainObjPtr obj;
+    return vm->persistent &&
+           !vm->removing &&
+           !vm->newDef &&
+           !vm->def->stub &&
+           !virDomainObjIsActive(vm) &&
+           virObjectGetRefs(vm) <= refs;
+}
 
-    virObjectRWLockRead(doms);
-    obj = virHashSearch(doms->objs, virDomainObjListSearchID, &id, NULL);
-    virObjectRef(obj);
-    virObjectRWUnlock(doms);
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            virObjectUnref(obj);
-            obj = NULL;
+
+static int
+virDomainObjListStubDef(virDomainObjPtr vm)
+{
+    virDomainDefPtr stub;
+
+    if (!(stub = virDomainDefNew()))
+        return -1;
+
+    if (VIR_STRDUP(stub->name, vm->def->name) < 0) {
+        virDomainDefFree(stub);
+        return -1;
+    }
+    stub->virtType = vm->def->virtType;
+    stub->id = vm->def->id;
+    memcpy(stub->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+    stub->stub = true;
+
+    VIR_DEBUG("Dropping definition of domain '%s'", vm->def->name);
+
+    virDomainDefFree(vm->def);
+    vm->def = stub;
+    return 0;
+}
+
+
+/*
+ * Parse the definition of the locked @vm from its config file if only
+ * its stub is loaded.
+ *
+ * Returns 1 if the definition was parsed, 0 if it was loaded already
+ * and -1 on error.
+ */
+static int
+virDomainObjListLoadDefLocked(virDomainObjListPtr doms,
+                              virDomainObjPtr vm)
+{
+    char *configFile = NULL;
+    virDomainDefPtr def = NULL;
+    int ret = -1;
+
+    if (doms->lazyMaxDefs)
+        vm->lastUsed = virAtomicIntInc(&doms->lazyTick);
+
+    if (!vm->def->stub)
+        return 0;
+
+    VIR_DEBUG("Loading definition of domain '%s'", vm->def->name);
+
+    if ((configFile = virDomainConfigFile(doms->lazyConfigDir,
+                                          vm->def->name)) == NULL)
+        goto cleanup;
+
+    if (!(def = virDomainDefParseFile(configFile, doms->lazyCaps,
+                                      doms->lazyXMLOpt, NULL,
+                                      VIR_DOMAIN_OBJ_LIST_CONFIG_PARSE_FLAGS)))
+        goto cleanup;
+
+    if (STRNEQ(def->name, vm->def->name) ||
+        memcmp(def->uuid, vm->def->uuid, VIR_UUID_BUFLEN) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("config file '%s' does not describe domain '%s' "
+                         "any more"),
+                       configFile, vm->def->name);
+        goto cleanup;
+    }
+
+    virDomainDefFree(vm->def);
+    VIR_STEAL_PTR(vm->def, def);
+    ret = 1;
+
+ cleanup:
+    VIR_FREE(configFile);
+    virDomainDefFree(def);
+    return ret;
+}
+
+
+/**
+ * virDomainObjListLoadDef:
+ * @doms: Domain object list
+ * @vm: locked domain object from @doms
+ *
+ * Make sure the full definition of @vm is loaded. Only needed for
+ * domains which were not obtained by a lookup or by
+ * virDomainObjListCollect, such as those passed to the callback of
+ * virDomainObjListForEach.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virDomainObjListLoadDef(virDomainObjListPtr doms,
+                        virDomainObjPtr vm)
+{
+    if (virDomainObjListLoadDefLocked(doms, vm) < 0)
+        return -1;
+    return 0;
+}
+
+
+typedef struct _virDomainObjListEvictEntry virDomainObjListEvictEntry;
+struct _virDomainObjListEvictEntry {
+    virDomainObjPtr vm;
+    unsigned int lastUsed;
+};
+
+
+static int
+virDomainObjListEvictCompare(const void *a,
+                             const void *b)
+{
+    const virDomainObjListEvictEntry *ea = a;
+    const virDomainObjListEvictEntry *eb = b;
+
+    if (ea->lastUsed < eb->lastUsed)
+        return -1;
+    if (ea->lastUsed > eb->lastUsed)
+        return 1;
+    return 0;
+}
+
+
+/*
+ * Replace the least recently used inactive definitions by stubs until
+ * at most doms->lazyMaxDefs of them which are not in use are parsed.
+ * Locks every domain in turn, so the caller must not hold any domain
+ * lock.
+ */
+static void
+virDomainObjListEvict(virDomainObjListPtr doms)
+{
+    virDomainObjPtr *vms = NULL;
+    virDomainObjListEvictEntry *entries = NULL;
+    size_t nvms = 0;
+    size_t nentries = 0;
+    size_t i;
+
+    if (virDomainObjListSnapshot(doms, &vms, &nvms) < 0 ||
+        VIR_ALLOC_N(entries, nvms) < 0)
+        goto error;
+
+    /* the snapshot holds the third reference */
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (virDomainObjListCanStub(vms[i], 3)) {
+            entries[nentries].vm = vms[i];
+            entries[nentries++].lastUsed = vms[i]->lastUsed;
         }
+        virObjectUnlock(vms[i]);
     }
 
-    return obj;
+    if (nentries > doms->lazyMaxDefs) {
+        qsort(entries, nentries, sizeof(*entries),
+              virDomainObjListEvictCompare);
+
+        for (i = 0; i < nentries - doms->lazyMaxDefs; i++) {
+            virDomainObjPtr vm = entries[i].vm;
+            int rc = 0;
+
+            virObjectLock(vm);
+            if (virDomainObjListCanStub(vm, 3))
+                rc = virDomainObjListStubDef(vm);
+            virObjectUnlock(vm);
+
+            if (rc < 0)
+                goto error;
+        }
+    }
+
+ cleanup:
+    VIR_FREE(entries);
+    virObjectListFreeCount(vms, nvms);
+    return;
+
+ error:
+    /* keeping too many definitions around is not fatal */
+    VIR_WARN("Unable to drop inactive domain definitions: %s",
+             virGetLastErrorMessage());
+    virResetLastError();
+    goto cleanup;
 }
 
 
+/*
+ * Lock an object returned by a lookup, dropping it if it is being
+ * removed. If @load is true, the full definition is loaded as well
+ * and the object is dropped if that fails.
+ */
 static virDomainObjPtr
-virDomainObjListFindByUUIDLocked(virDomainObjListPtr doms,
-                                 const unsigned char *uuid)
+virDomainObjListFindLock(virDomainObjListPtr doms,
+                         virDomainObjPtr obj,
+                         bool load)
 {
-    char uuidstr[VIR_UUID_STRING_BUFLEN];
-    virDomainObjPtr obj;
+    int rc;
 
-    virUUIDFormat(uuid, uuidstr);
-    obj = virHashLookup(doms->objs, uuidstr);
-    virObjectRef(obj);
-    if (obj) {
+    if (!obj)
+        return NULL;
+
+    virObjectLock(obj);
+    if (obj->removing)
+        goto drop;
+
+    if (!load)
+        return obj;
+
+    if ((rc = virDomainObjListLoadDefLocked(doms, obj)) < 0)
+        goto drop;
+
+    if (rc > 0) {
+        /* Our reference keeps @obj from being evicted meanwhile */
+        virObjectUnlock(obj);
+        virDomainObjListEvict(doms);
         virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            virObjectUnref(obj);
-            obj = NULL;
-        }
+        if (obj->removing)
+            goto drop;
     }
+
     return obj;
+
+ drop:
+    virObjectUnlock(obj);
+    virObjectUnref(obj);
+    return NULL;
 }
 
 
 /**
  * @doms: Domain object list
- * @uuid: UUID to search the doms->objs table
+ * @id: ID of an active domain
  *
- * Lookup the @uuid in the doms->objs hash table and return a
- * locked and ref counted domain object if found. Caller is
- * expected to use the virDomainObjEndAPI when done with the object.
+ * Lookup the @id in the doms->objsID hash table and return a locked
+ * and ref counted domain object if found. If the ID table has no
+ * entry for @id or a stale one, all domains are searched and the ID
+ * table is updated with the result. Caller is expected to use the
+ * virDomainObjEndAPI when done with the object.
  */
 virDomainObjPtr
-virDomainObjListFindByUUID(virDomainObjListPtr doms,
-                           const unsigned char *uuid)
+virDomainObjListFindByID(virDomainObjListPtr doms,
+                         int id)
 {
-    virDomainObjPtr obj;
+    virDomainObjPtr *vms = NULL;
+    virDomainObjPtr obj = NULL;
+    char key[INT_BUFSIZE_BOUND(int)];
+    size_t nvms = 0;
+    size_t i;
 
-    virObjectRWLockRead(doms);
-    obj = virDomainObjListFindByUUIDLocked(doms, uuid);
-    virObjectRWUnlock(doms);
+    snprintf(key, sizeof(key), "%d", id);
+    obj = virDomainObjListShardLookup(virDomainObjListGetShard(doms,
+                                                               doms->objsID,
+                                                               key),
+                                      key);
+    if ((obj = virDomainObjListFindLock(doms, obj, true))) {
+        if (virDomainObjIsActive(obj) && obj->def->id == id)
+            return obj;
+
+        /* Stale entry, the domain was given another ID meanwhile */
+        virDomainObjListIDRemove(doms, id, obj);
+        virDomainObjEndAPI(&obj);
+    }
+
+    if (virDomainObjListSnapshot(doms, &vms, &nvms) < 0)
+        return NULL;
+
+    for (i = 0; i < nvms; i++) {
+        if (virDomainObjListSearchID(vms[i], NULL, &id)) {
+            obj = virObjectRef(vms[i]);
+            break;
+        }
+    }
+    virObjectListFreeCount(vms, nvms);
+
+    if ((obj = virDomainObjListFindLock(doms, obj, true)) &&
+        virDomainObjIsActive(obj) && obj->def->id == id)
+        virDomainObjListIDAdd(doms, id, obj);
 
     return obj;
 }
 
 
+/**
+ * virDomainObjListSetID:
+ * @doms: Domain object list
+ * @vm: locked domain object from @doms
+ * @id: new ID of @vm, -1 once it is stopped
+ *
+ * Sets the ID of @vm and updates the ID table of @doms accordingly,
+ * so that virDomainObjListFindByID does not need to search all the
+ * domains for @vm. Drivers should use it rather than setting the ID
+ * themselves when starting and stopping domains.
+ */
+void
+virDomainObjListSetID(virDomainObjListPtr doms,
+                      virDomainObjPtr vm,
+                      int id)
+{
+    virDomainObjListIDRemove(doms, vm->def->id, vm);
+
+    vm->def->id = id;
+
+    if (id >= 0 && !vm->removing)
+        virDomainObjListIDAdd(doms, id, vm);
+}
+
+
 static virDomainObjPtr
-virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
-                                 const char *name)
+virDomainObjListFindByUUIDInternal(virDomainObjListPtr doms,
+                                   const unsigned char *uuid,
+                                   bool load)
 {
-    virDomainObjPtr obj;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
 
-    obj = virHashLookup(doms->objsName, name);
-    virObjectRef(obj);
-    if (obj) {
-        virObjectLock(obj);
-        if (obj->removing) {
-            virObjectUnlock(obj);
-            virObjectUnref(obj);
-            obj = NULL;
-        }
-    }
-    return obj;
+    virUUIDFormat(uuid, uuidstr);
+    shard = virDomainObjListGetShard(doms, doms->objs, uuidstr);
+
+    return virDomainObjListFindLock(doms,
+                                    virDomainObjListShardLookup(shard,
+                                                                uuidstr),
+                                    load);
+}
+
+
+/**
+ * @doms: Domain object list
+ * @uuid: UUID to search the doms->objs table
+ *
+ * Lookup the @uuid in the doms->objs hash table and return a
+ * locked and ref counted domain object if found. Only the shard
+ * holding @uuid is locked during the lookup. Caller is
+ * expected to use the virDomainObjEndAPI when done with the object.
+ */
+virDomainObjPtr
+virDomainObjListFindByUUID(virDomainObjListPtr doms,
+                           const unsigned char *uuid)
+{
+    return virDomainObjListFindByUUIDInternal(doms, uuid, true);
 }
 
 
@@ -202,20 +832,21 @@ virDomainObjListFindByNameLocked(virDomainObjListPtr doms,
  * @name: Name to search the doms->objsName table
  *
  * Lookup the @name in the doms->objsName hash table and return a
- * locked and ref counted domain object if found. Caller is expected
+ * locked and ref counted domain object if found. Only the shard
+ * holding @name is locked during the lookup. Caller is expected
  * to use the virDomainObjEndAPI when done with the object.
  */
 virDomainObjPtr
 virDomainObjListFindByName(virDomainObjListPtr doms,
                            const char *name)
 {
-    virDomainObjPtr obj;
+    virDomainObjListShardPtr shard;
 
-    virObjectRWLockRead(doms);
-    obj = virDomainObjListFindByNameLocked(doms, name);
-    virObjectRWUnlock(doms);
+    shard = virDomainObjListGetShard(doms, doms->objsName, name);
 
-    return obj;
+    return virDomainObjListFindLock(doms,
+                                    virDomainObjListShardLookup(shard, name),
+                                    true);
 }
 
 
@@ -240,17 +871,20 @@ virDomainObjListAddObjLocked(virDomainObjListPtr doms,
                              virDomainObjPtr vm)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr uuidShard;
+    virDomainObjListShardPtr nameShard;
 
     virUUIDFormat(vm->def->uuid, uuidstr);
-    if (virHashAddEntry(doms->objs, uuidstr, vm) < 0)
+    uuidShard = virDomainObjListGetShard(doms, doms->objs, uuidstr);
+    nameShard = virDomainObjListGetShard(doms, doms->objsName, vm->def->name);
+
+    if (virDomainObjListShardAdd(uuidShard, uuidstr, vm) < 0)
         return -1;
-    virObjectRef(vm);
 
-    if (virHashAddEntry(doms->objsName, vm->def->name, vm) < 0) {
-        virHashRemoveEntry(doms->objs, uuidstr);
+    if (virDomainObjListShardAdd(nameShard, vm->def->name, vm) < 0) {
+        virDomainObjListShardRemove(uuidShard, uuidstr);
         return -1;
     }
-    virObjectRef(vm);
 
     return 0;
 }
@@ -284,8 +918,11 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
     if (oldDef)
         *oldDef = NULL;
 
-    /* See if a VM with matching UUID already exists */
-    if ((vm = virDomainObjListFindByUUIDLocked(doms, def->uuid))) {
+    /* See if a VM with matching UUID already exists. Its definition is
+     * about to be replaced and only needs to be loaded if it becomes
+     * the persistent definition of a running domain. */
+    if ((vm = virDomainObjListFindByUUIDInternal(doms, def->uuid,
+                                                 !!(flags & VIR_DOMAIN_OBJ_LIST_ADD_LIVE)))) {
         /* UUID matches, but if names don't match, refuse it */
         if (STRNEQ(vm->def->name, def->name)) {
             virUUIDFormat(vm->def->uuid, uuidstr);
@@ -317,7 +954,7 @@ virDomainObjListAddLocked(virDomainObjListPtr doms,
                               oldDef);
     } else {
         /* UUID does not match, but if a name matches, refuse it */
-        if ((vm = virDomainObjListFindByNameLocked(doms, def->name))) {
+        if ((vm = virDomainObjListFindByName(doms, def->name))) {
             virUUIDFormat(vm->def->uuid, uuidstr);
             virReportError(VIR_ERR_OPERATION_FAILED,
                            _("domain '%s' already exists with uuid %s"),
@@ -351,17 +988,57 @@ virDomainObjPtr virDomainObjListAdd(virDomainObjListPtr doms,
 {
     virDomainObjPtr ret;
 
-    virObjectRWLockWrite(doms);
+    virObjectLock(doms);
     ret = virDomainObjListAddLocked(doms, def, xmlopt, flags, oldDef);
-    virObjectRWUnlock(doms);
+    virObjectUnlock(doms);
     return ret;
 }
 
 
+/*
+ * Remembers the locked @dom as removed, with the list locked. The
+ * removal of domains which can't be remembered any more is simply
+ * reported as unknown.
+ */
+static void
+virDomainObjListRecordRemoval(virDomainObjListPtr doms,
+                              virDomainObjPtr dom)
+{
+    virDomainObjListRemoved entry = { NULL, 0 };
+
+    virDomainObjMarkChanged(dom);
+    entry.generation = dom->changeGeneration;
+
+    if (!(entry.def = virDomainDefNew()) ||
+        VIR_STRDUP(entry.def->name, dom->def->name) < 0)
+        goto forget;
+    entry.def->virtType = dom->def->virtType;
+    entry.def->id = -1;
+    memcpy(entry.def->uuid, dom->def->uuid, VIR_UUID_BUFLEN);
+    entry.def->stub = true;
+
+    if (doms->nremoved == VIR_DOMAIN_OBJ_LIST_REMOVED_MAX) {
+        doms->removedFloor = doms->removed[0].generation;
+        virDomainDefFree(doms->removed[0].def);
+        VIR_DELETE_ELEMENT(doms->removed, 0, doms->nremoved);
+    }
+
+    if (VIR_APPEND_ELEMENT(doms->removed, doms->nremoved, entry) < 0)
+        goto forget;
+
+    return;
+
+ forget:
+    virResetLastError();
+    virDomainDefFree(entry.def);
+    doms->removedFloor = entry.generation;
+}
+
+
 /* The caller must hold lock on 'doms' in addition to 'virDomainObjListRemove'
  * requirements
  *
- * Can be used to remove current element while iterating with
+ * Can also be used to remove current element while iterating with
  * virDomainObjListForEach
  */
 void
@@ -372,8 +1049,15 @@ virDomainObjListRemoveLocked(virDomainObjListPtr doms,
 
     virUUIDFormat(dom->def->uuid, uuidstr);
 
-    virHashRemoveEntry(doms->objs, uuidstr);
-    virHashRemoveEntry(doms->objsName, dom->def->name);
+    virDomainObjListRecordRemoval(doms, dom);
+
+    virDomainObjListShardRemove(virDomainObjListGetShard(doms, doms->objs,
+                                                         uuidstr),
+                                uuidstr);
+    virDomainObjListShardRemove(virDomainObjListGetShard(doms, doms->objsName,
+                                                         dom->def->name),
+                                dom->def->name);
+    virDomainObjListIDRemove(doms, dom->def->id, dom);
 }
 
 
@@ -397,11 +1081,11 @@ virDomainObjListRemove(virDomainObjListPtr doms,
     dom->removing = true;
     virObjectRef(dom);
     virObjectUnlock(dom);
-    virObjectRWLockWrite(doms);
+    virObjectLock(doms);
     virObjectLock(dom);
     virDomainObjListRemoveLocked(doms, dom);
     virObjectUnref(dom);
-    virObjectRWUnlock(doms);
+    virObjectUnlock(doms);
 }
 
 
@@ -409,8 +1093,8 @@ virDomainObjListRemove(virDomainObjListPtr doms,
  * virDomainObjListRename:
  *
  * The caller must hold a lock on dom. Callbacks should not
- * sleep/wait otherwise operations on all domains will be blocked
- * as the callback is called with domains lock hold. Domain lock
+ * sleep/wait otherwise defining and undefining domains will be
+ * blocked as the callback is called with domains lock hold. Domain lock
  * is dropped/reacquired during this operation thus domain
  * consistency must not rely on this lock solely.
  */
@@ -424,6 +1108,9 @@ virDomainObjListRename(virDomainObjListPtr doms,
 {
     int ret = -1;
     char *old_name = NULL;
+    virDomainObjListShardPtr oldShard;
+    virDomainObjListShardPtr newShard;
+    virDomainObjPtr other;
     int rc;
 
     if (STREQ(dom->def->name, new_name)) {
@@ -440,72 +1127,114 @@ virDomainObjListRename(virDomainObjListPtr doms,
      * hold a lock on dom but not refcount it. */
     virObjectRef(dom);
     virObjectUnlock(dom);
-    virObjectRWLockWrite(doms);
+    virObjectLock(doms);
     virObjectLock(dom);
     virObjectUnref(dom);
 
-    if (virHashLookup(doms->objsName, new_name) != NULL) {
+    oldShard = virDomainObjListGetShard(doms, doms->objsName, old_name);
+    newShard = virDomainObjListGetShard(doms, doms->objsName, new_name);
+
+    if ((other = virDomainObjListShardLookup(newShard, new_name))) {
+        virObjectUnref(other);
         virReportError(VIR_ERR_OPERATION_INVALID,
                        _("domain with name '%s' already exists"),
                        new_name);
         goto cleanup;
     }
 
-    if (virHashAddEntry(doms->objsName, new_name, dom) < 0)
-        goto cleanup;
-
-    /* Increment the refcnt for @new_name. We're about to remove
+    /* Adding @new_name increments the refcnt. We're about to remove
      * the @old_name which will cause the refcnt to be decremented
      * via the virObjectUnref call made during the virObjectFreeHashData
      * as a result of removing something from the object list hash
      * table as set up during virDomainObjListNew. */
-    virObjectRef(dom);
+    if (virDomainObjListShardAdd(newShard, new_name, dom) < 0)
+        goto cleanup;
 
     rc = callback(dom, new_name, flags, opaque);
-    virHashRemoveEntry(doms->objsName, rc < 0 ? new_name : old_name);
+    if (rc < 0)
+        virDomainObjListShardRemove(newShard, new_name);
+    else
+        virDomainObjListShardRemove(oldShard, old_name);
     if (rc < 0)
         goto cleanup;
 
+    virDomainObjMarkChanged(dom);
+
     ret = 0;
  cleanup:
-    virObjectRWUnlock(doms);
+    virObjectUnlock(doms);
     VIR_FREE(old_name);
     return ret;
 }
 
 
+typedef struct _virDomainObjListLoadData virDomainObjListLoadData;
+typedef virDomainObjListLoadData *virDomainObjListLoadDataPtr;
+struct _virDomainObjListLoadData {
+    const char *configDir;
+    const char *autostartDir;
+    bool liveStatus;
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+
+    char **names;
+    size_t nnames;
+
+    /* results, indexed the same way as @names */
+    virDomainDefPtr *defs;      /* !liveStatus */
+    int *autostart;             /* !liveStatus */
+    virDomainObjPtr *objs;      /* liveStatus */
+};
+
+
+static int
+virDomainObjListParseConfig(virDomainObjListLoadDataPtr data,
+                            size_t idx)
+{
+    char *configFile = NULL, *autostartLink = NULL;
+    const char *name = data->names[idx];
+    virDomainDefPtr def = NULL;
+    int ret = -1;
+
+    if ((configFile = virDomainConfigFile(data->configDir, name)) == NULL)
+        goto cleanup;
+    if (!(def = virDomainDefParseFile(configFile, data->caps, data->xmlopt,
+                                      NULL,
+                                      VIR_DOMAIN_OBJ_LIST_CONFIG_PARSE_FLAGS)))
+        goto cleanup;
+
+    if ((autostartLink = virDomainConfigFile(data->autostartDir, name)) == NULL)
+        goto cleanup;
+
+    if ((data->autostart[idx] = virFileLinkPointsTo(autostartLink,
+                                                    configFile)) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(data->defs[idx], def);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(configFile);
+    VIR_FREE(autostartLink);
+    virDomainDefFree(def);
+    return ret;
+}
+
+
 static virDomainObjPtr
 virDomainObjListLoadConfig(virDomainObjListPtr doms,
-                           virCapsPtr caps,
                            virDomainXMLOptionPtr xmlopt,
-                           const char *configDir,
-                           const char *autostartDir,
-                           const char *name,
+                           virDomainDefPtr *def,
+                           int autostart,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
-{
-    char *configFile = NULL, *autostartLink = NULL;
-    virDomainDefPtr def = NULL;
+{
     virDomainObjPtr dom;
-    int autostart;
     virDomainDefPtr oldDef = NULL;
 
-    if ((configFile = virDomainConfigFile(configDir, name)) == NULL)
-        goto error;
-    if (!(def = virDomainDefParseFile(configFile, caps, xmlopt, NULL,
-                                      VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
-
-    if ((autostartLink = virDomainConfigFile(autostartDir, name)) == NULL)
-        goto error;
-
-    if ((autostart = virFileLinkPointsTo(autostartLink, configFile)) < 0)
-        goto error;
-
-    if (!(dom = virDomainObjListAddLocked(doms, def, xmlopt, 0, &oldDef)))
-        goto error;
+    if (!(dom = virDomainObjListAddLocked(doms, *def, xmlopt, 0, &oldDef)))
+        return NULL;
+    *def = NULL;
 
     dom->autostart = autostart;
 
@@ -513,45 +1242,58 @@ virDomainObjListLoadConfig(virDomainObjListPtr doms,
         (*notify)(dom, oldDef == NULL, opaque);
 
     virDomainDefFree(oldDef);
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
     return dom;
+}
 
- error:
-    VIR_FREE(configFile);
-    VIR_FREE(autostartLink);
-    virDomainDefFree(def);
-    return NULL;
+
+static int
+virDomainObjListParseStatus(virDomainObjListLoadDataPtr data,
+                            size_t idx)
+{
+    char *statusFile = NULL;
+
+    if ((statusFile = virDomainConfigFile(data->configDir,
+                                          data->names[idx])) == NULL)
+        return -1;
+
+    data->objs[idx] = virDomainObjParseFile(statusFile, data->caps,
+                                            data->xmlopt,
+                                            VIR_DOMAIN_DEF_PARSE_STATUS |
+                                            VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
+                                            VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
+                                            VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
+                                            VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL);
+    VIR_FREE(statusFile);
+
+    if (!data->objs[idx])
+        return -1;
+
+    /* the object is added to the list by a different thread */
+    virObjectUnlock(data->objs[idx]);
+    return 0;
 }
 
 
 static virDomainObjPtr
 virDomainObjListLoadStatus(virDomainObjListPtr doms,
-                           const char *statusDir,
-                           const char *name,
-                           virCapsPtr caps,
-                           virDomainXMLOptionPtr xmlopt,
+                           virDomainObjPtr *objptr,
                            virDomainLoadConfigNotify notify,
                            void *opaque)
 {
-    char *statusFile = NULL;
-    virDomainObjPtr obj = NULL;
+    virDomainObjPtr obj = *objptr;
+    virDomainObjPtr other;
+    virDomainObjListShardPtr shard;
     char uuidstr[VIR_UUID_STRING_BUFLEN];
 
-    if ((statusFile = virDomainConfigFile(statusDir, name)) == NULL)
-        goto error;
-
-    if (!(obj = virDomainObjParseFile(statusFile, caps, xmlopt,
-                                      VIR_DOMAIN_DEF_PARSE_STATUS |
-                                      VIR_DOMAIN_DEF_PARSE_ACTUAL_NET |
-                                      VIR_DOMAIN_DEF_PARSE_PCI_ORIG_STATES |
-                                      VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE |
-                                      VIR_DOMAIN_DEF_PARSE_ALLOW_POST_PARSE_FAIL)))
-        goto error;
+    *objptr = NULL;
+    virObjectLock(obj);
 
     virUUIDFormat(obj->def->uuid, uuidstr);
 
-    if (virHashLookup(doms->objs, uuidstr) != NULL) {
+    shard = virDomainObjListGetShard(doms, doms->objs, uuidstr);
+
+    if ((other = virDomainObjListShardLookup(shard, uuidstr))) {
+        virObjectUnref(other);
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("unexpected domain %s already exists"),
                        obj->def->name);
@@ -564,16 +1306,50 @@ virDomainObjListLoadStatus(virDomainObjListPtr doms,
     if (notify)
         (*notify)(obj, 1, opaque);
 
-    VIR_FREE(statusFile);
     return obj;
 
  error:
     virDomainObjEndAPI(&obj);
-    VIR_FREE(statusFile);
     return NULL;
 }
 
 
+static int
+virDomainObjListLoadName(size_t i,
+                         void *opaque)
+{
+    virDomainObjListLoadDataPtr data = opaque;
+    int rc;
+
+    VIR_INFO("Loading config file '%s.xml'", data->names[i]);
+
+    if (data->liveStatus)
+        rc = virDomainObjListParseStatus(data, i);
+    else
+        rc = virDomainObjListParseConfig(data, i);
+
+    /* NB: ignoring errors, so one malformed config doesn't
+       kill the whole process */
+    if (rc < 0) {
+        VIR_ERROR(_("Failed to load config for domain '%s'"),
+                  data->names[i]);
+        virResetLastError();
+    }
+
+    return 0;
+}
+
+
+/**
+ * virDomainObjListLoadAllConfigs:
+ *
+ * Loads all domain configs, or status files if @liveStatus is true,
+ * from @configDir into @doms. The files are parsed by several threads in
+ * parallel, which is fine since parsing only reads @caps and @xmlopt and
+ * the parser callbacks have to cope with concurrent API calls anyway.
+ * The domains are added to @doms and @notify is called from the calling
+ * thread.
+ */
 int
 virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                const char *configDir,
@@ -584,8 +1360,17 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                virDomainLoadConfigNotify notify,
                                void *opaque)
 {
+    virDomainObjListLoadData data = {
+        .configDir = configDir,
+        .autostartDir = autostartDir,
+        .liveStatus = liveStatus,
+        .caps = caps,
+        .xmlopt = xmlopt,
+    };
     DIR *dir;
     struct dirent *entry;
+    char *name = NULL;
+    size_t i;
     int ret = -1;
     int rc;
 
@@ -594,45 +1379,87 @@ virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
     if ((rc = virDirOpenIfExists(&dir, configDir)) <= 0)
         return rc;
 
-    virObjectRWLockWrite(doms);
-
     while ((ret = virDirRead(dir, &entry, configDir)) > 0) {
-        virDomainObjPtr dom;
-
         if (!virFileStripSuffix(entry->d_name, ".xml"))
             continue;
 
-        /* NB: ignoring errors, so one malformed config doesn't
-           kill the whole process */
-        VIR_INFO("Loading config file '%s.xml'", entry->d_name);
-        if (liveStatus)
-            dom = virDomainObjListLoadStatus(doms,
-                                             configDir,
-                                             entry->d_name,
-                                             caps,
-                                             xmlopt,
-                                             notify,
-                                             opaque);
-        else
-            dom = virDomainObjListLoadConfig(doms,
-                                             caps,
-                                             xmlopt,
-                                             configDir,
-                                             autostartDir,
-                                             entry->d_name,
-                                             notify,
-                                             opaque);
+        if (VIR_STRDUP(name, entry->d_name) < 0 ||
+            VIR_APPEND_ELEMENT(data.names, data.nnames, name) < 0) {
+            VIR_FREE(name);
+            ret = -1;
+            break;
+        }
+    }
+
+    VIR_DIR_CLOSE(dir);
+
+    if (data.nnames == 0)
+        goto cleanup;
+
+    if ((liveStatus && VIR_ALLOC_N(data.objs, data.nnames) < 0) ||
+        (!liveStatus && (VIR_ALLOC_N(data.defs, data.nnames) < 0 ||
+                         VIR_ALLOC_N(data.autostart, data.nnames) < 0))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virThreadParallelRun(data.nnames, virDomainObjListLoadName,
+                             &data, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    virObjectLock(doms);
+
+    for (i = 0; i < data.nnames; i++) {
+        virDomainObjPtr dom;
+
+        if (liveStatus) {
+            if (!data.objs[i])
+                continue;
+            dom = virDomainObjListLoadStatus(doms, &data.objs[i],
+                                             notify, opaque);
+        } else {
+            if (!data.defs[i])
+                continue;
+            dom = virDomainObjListLoadConfig(doms, xmlopt, &data.defs[i],
+                                             data.autostart[i],
+                                             notify, opaque);
+        }
+
         if (dom) {
-            if (!liveStatus)
+            if (!liveStatus) {
                 dom->persistent = 1;
+
+                /* LoadConfig returned the third reference. Keeping the
+                 * full definition if the stub can't be allocated is
+                 * harmless. */
+                if (doms->lazyMaxDefs &&
+                    virDomainObjListCanStub(dom, 3) &&
+                    virDomainObjListStubDef(dom) < 0)
+                    virResetLastError();
+            }
             virDomainObjEndAPI(&dom);
         } else {
-            VIR_ERROR(_("Failed to load config for domain '%s'"), entry->d_name);
+            VIR_ERROR(_("Failed to load config for domain '%s'"),
+                      data.names[i]);
         }
     }
 
-    VIR_DIR_CLOSE(dir);
-    virObjectRWUnlock(doms);
+    virObjectUnlock(doms);
+
+ cleanup:
+    for (i = 0; i < data.nnames; i++) {
+        if (data.defs)
+            virDomainDefFree(data.defs[i]);
+        if (data.objs)
+            virObjectUnref(data.objs[i]);
+        VIR_FREE(data.names[i]);
+    }
+    VIR_FREE(data.names);
+    VIR_FREE(data.defs);
+    VIR_FREE(data.autostart);
+    VIR_FREE(data.objs);
     return ret;
 }
 
@@ -676,9 +1503,8 @@ virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                              virConnectPtr conn)
 {
     struct virDomainObjListData data = { filter, conn, active, 0 };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCount, &data);
-    virObjectRWUnlock(doms);
+    if (virDomainObjListIterate(doms, virDomainObjListCount, &data) < 0)
+        return -1;
     return data.count;
 }
 
@@ -720,9 +1546,8 @@ virDomainObjListGetActiveIDs(virDomainObjListPtr doms,
 {
     struct virDomainIDData data = { filter, conn,
                                     0, maxids, ids };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyActiveIDs, &data);
-    virObjectRWUnlock(doms);
+    if (virDomainObjListIterate(doms, virDomainObjListCopyActiveIDs, &data) < 0)
+        return -1;
     return data.numids;
 }
 
@@ -774,9 +1599,9 @@ virDomainObjListGetInactiveNames(virDomainObjListPtr doms,
     struct virDomainNameData data = { filter, conn,
                                       0, 0, maxnames, names };
     size_t i;
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListCopyInactiveNames, &data);
-    virObjectRWUnlock(doms);
+    if (virDomainObjListIterate(doms, virDomainObjListCopyInactiveNames,
+                                &data) < 0)
+        data.oom = 1;
     if (data.oom) {
         for (i = 0; i < data.numnames; i++)
             VIR_FREE(data.names[i]);
@@ -807,6 +1632,21 @@ virDomainObjListHelper(void *payload,
 }
 
 
+/**
+ * virDomainObjListForEach:
+ * @doms: Domain object list
+ * @callback: function to call for each domain
+ * @opaque: data passed to @callback
+ *
+ * Call @callback on a snapshot of the domains in @doms. No list
+ * lock is held while the callbacks run, so domains may be defined
+ * or undefined meanwhile and @callback may be passed a domain that
+ * is just being removed. Only the stub of a lazily loaded definition
+ * may be set, see virDomainObjListLoadDef.
+ *
+ * Returns 0 on success, -1 if collecting the domains or any of the
+ * callbacks failed.
+ */
 int
 virDomainObjListForEach(virDomainObjListPtr doms,
                         virDomainObjListIterator callback,
@@ -815,9 +1655,8 @@ virDomainObjListForEach(virDomainObjListPtr doms,
     struct virDomainListIterData data = {
         callback, opaque, 0,
     };
-    virObjectRWLockRead(doms);
-    virHashForEach(doms->objs, virDomainObjListHelper, &data);
-    virObjectRWUnlock(doms);
+    if (virDomainObjListIterate(doms, virDomainObjListHelper, &data) < 0)
+        return -1;
     return data.ret;
 }
 
@@ -886,46 +1725,67 @@ virDomainObjMatchFilter(virDomainObjPtr vm,
 #undef MATCH
 
 
-struct virDomainListData {
-    virDomainObjPtr *vms;
-    size_t nvms;
-};
+/*
+ * Whether the locked @vm is to be listed. If @load is true, its full
+ * definition is loaded, too, and @loaded set if it had to be parsed.
+ */
+static bool
+virDomainObjListWanted(virDomainObjListPtr domlist,
+                       virDomainObjPtr vm,
+                       virConnectPtr conn,
+                       virDomainObjListACLFilter filter,
+                       unsigned int flags,
+                       bool load,
+                       bool *loaded)
+{
+    int rc;
 
+    /* do not list the object if:
+     * 1) it's being removed.
+     * 2) connection does not have ACL to see it
+     * 3) it doesn't match the filter
+     * 4) its definition is needed but can't be loaded
+     */
+    if (vm->removing ||
+        (filter && !filter(conn, vm->def)) ||
+        !virDomainObjMatchFilter(vm, flags))
+        return false;
 
-static int
-virDomainObjListCollectIterator(void *payload,
-                                const void *name ATTRIBUTE_UNUSED,
-                                void *opaque)
-{
-    struct virDomainListData *data = opaque;
+    if (!load)
+        return true;
 
-    data->vms[data->nvms++] = virObjectRef(payload);
-    return 0;
+    if ((rc = virDomainObjListLoadDefLocked(domlist, vm)) < 0) {
+        VIR_WARN("Unable to load definition of domain '%s': %s",
+                 vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+        return false;
+    }
+
+    if (rc > 0)
+        *loaded = true;
+    return true;
 }
 
 
 static void
-virDomainObjListFilter(virDomainObjPtr **list,
+virDomainObjListFilter(virDomainObjListPtr domlist,
+                       virDomainObjPtr **list,
                        size_t *nvms,
                        virConnectPtr conn,
                        virDomainObjListACLFilter filter,
-                       unsigned int flags)
+                       unsigned int flags,
+                       bool load)
 {
     size_t i = 0;
+    bool loaded = false;
 
     while (i < *nvms) {
         virDomainObjPtr vm = (*list)[i];
 
         virObjectLock(vm);
 
-        /* do not list the object if:
-         * 1) it's being removed.
-         * 2) connection does not have ACL to see it
-         * 3) it doesn't match the filter
-         */
-        if (vm->removing ||
-            (filter && !filter(conn, vm->def)) ||
-            !virDomainObjMatchFilter(vm, flags)) {
+        if (!virDomainObjListWanted(domlist, vm, conn, filter, flags,
+                                    load, &loaded)) {
             virObjectUnlock(vm);
             virObjectUnref(vm);
             VIR_DELETE_ELEMENT(*list, i, *nvms);
@@ -935,6 +1795,34 @@ virDomainObjListFilter(virDomainObjPtr **list,
         virObjectUnlock(vm);
         i++;
     }
+
+    /* the domains left in @list are referenced and can't be evicted */
+    if (loaded)
+        virDomainObjListEvict(domlist);
+}
+
+
+static int
+virDomainObjListCollectInternal(virDomainObjListPtr domlist,
+                                virConnectPtr conn,
+                                virDomainObjPtr **vms,
+                                size_t *nvms,
+                                virDomainObjListACLFilter filter,
+                                unsigned int flags,
+                                bool load)
+{
+    virDomainObjPtr *list = NULL;
+    size_t nlist = 0;
+
+    if (virDomainObjListSnapshot(domlist, &list, &nlist) < 0)
+        return -1;
+
+    virDomainObjListFilter(domlist, &list, &nlist, conn, filter, flags, load);
+
+    *nvms = nlist;
+    *vms = list;
+
+    return 0;
 }
 
 
@@ -946,24 +1834,182 @@ virDomainObjListCollect(virDomainObjListPtr domlist,
                         virDomainObjListACLFilter filter,
                         unsigned int flags)
 {
-    struct virDomainListData data = { NULL, 0 };
+    return virDomainObjListCollectInternal(domlist, conn, vms, nvms,
+                                           filter, flags, true);
+}
+
+
+typedef struct _virDomainObjListAutostartData virDomainObjListAutostartData;
+typedef virDomainObjListAutostartData *virDomainObjListAutostartDataPtr;
+struct _virDomainObjListAutostartData {
+    virDomainObjListIterator callback;
+    void *opaque;
+
+    virMutex lock;
+    virCond cond;
+    size_t running;
+    int ret;
+};
+
+
+typedef struct _virDomainObjListAutostartEntry virDomainObjListAutostartEntry;
+struct _virDomainObjListAutostartEntry {
+    virDomainObjPtr vm;
+    int priority;
+    size_t index;
+};
+
+
+static int
+virDomainObjListAutostartCompare(const void *a,
+                                 const void *b)
+{
+    const virDomainObjListAutostartEntry *ea = a;
+    const virDomainObjListAutostartEntry *eb = b;
+
+    /* higher priorities first, keep the order of the list otherwise */
+    if (ea->priority != eb->priority)
+        return ea->priority > eb->priority ? -1 : 1;
+    if (ea->index < eb->index)
+        return -1;
+    return ea->index > eb->index;
+}
+
+
+static void
+virDomainObjListAutostartWorker(void *jobdata,
+                                void *opaque)
+{
+    virDomainObjPtr vm = jobdata;
+    virDomainObjListAutostartDataPtr data = opaque;
+    int rc = data->callback(vm, data->opaque);
+
+    virMutexLock(&data->lock);
+    if (rc < 0)
+        data->ret = -1;
+    if (--data->running == 0)
+        virCondSignal(&data->cond);
+    virMutexUnlock(&data->lock);
+}
+
+
+/**
+ * virDomainObjListForEachAutostart:
+ * @doms: Domain object list
+ * @nworkers: how many callbacks may run at once
+ * @callback: function to call for each domain
+ * @opaque: data passed to @callback
+ *
+ * Call @callback on the inactive domains marked for autostart, by
+ * decreasing startup priority. The callbacks for all domains of one
+ * priority have returned before those for a lower priority are called,
+ * so domains may depend on the ones with a higher priority. Within a
+ * priority up to @nworkers callbacks run in parallel.
+ *
+ * Returns 0 on success, -1 if collecting the domains or any of the
+ * callbacks failed.
+ */
+int
+virDomainObjListForEachAutostart(virDomainObjListPtr doms,
+                                 size_t nworkers,
+                                 virDomainObjListIterator callback,
+                                 void *opaque)
+{
+    virDomainObjListAutostartData data = {
+        .callback = callback, .opaque = opaque,
+    };
+    virDomainObjListAutostartEntry *entries = NULL;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virThreadPoolPtr pool = NULL;
+    size_t i;
+    size_t j;
+    int ret = -1;
 
-    virObjectRWLockRead(domlist);
-    sa_assert(domlist->objs);
-    if (VIR_ALLOC_N(data.vms, virHashSize(domlist->objs)) < 0) {
-        virObjectRWUnlock(domlist);
+    if (virDomainObjListCollectInternal(doms, NULL, &vms, &nvms, NULL,
+                                        VIR_CONNECT_LIST_DOMAINS_INACTIVE |
+                                        VIR_CONNECT_LIST_DOMAINS_AUTOSTART,
+                                        true) < 0)
         return -1;
+
+    if (nvms == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(entries, nvms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        entries[i].vm = vms[i];
+        entries[i].priority = vms[i]->def->startupPriority;
+        entries[i].index = i;
+        virObjectUnlock(vms[i]);
     }
 
-    virHashForEach(domlist->objs, virDomainObjListCollectIterator, &data);
-    virObjectRWUnlock(domlist);
+    qsort(entries, nvms, sizeof(*entries), virDomainObjListAutostartCompare);
 
-    virDomainObjListFilter(&data.vms, &data.nvms, conn, filter, flags);
+    if (nworkers <= 1) {
+        ret = 0;
+        for (i = 0; i < nvms; i++) {
+            if (callback(entries[i].vm, opaque) < 0)
+                ret = -1;
+        }
+        goto cleanup;
+    }
 
-    *nvms = data.nvms;
-    *vms = data.vms;
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        goto cleanup;
+    }
+    if (virCondInit(&data.cond) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize condition"));
+        virMutexDestroy(&data.lock);
+        goto cleanup;
+    }
 
-    return 0;
+    if (nworkers > nvms)
+        nworkers = nvms;
+
+    if (!(pool = virThreadPoolNew(0, nworkers, 0,
+                                  virDomainObjListAutostartWorker, &data)))
+        goto destroy;
+
+    for (i = 0; i < nvms; i = j) {
+        VIR_DEBUG("Autostarting domains of priority %d", entries[i].priority);
+
+        virMutexLock(&data.lock);
+        for (j = i; j < nvms && entries[j].priority == entries[i].priority; j++) {
+            if (virThreadPoolSendJob(pool, 0, entries[j].vm) < 0) {
+                data.ret = -1;
+                continue;
+            }
+            data.running++;
+        }
+
+        while (data.running > 0) {
+            if (virCondWait(&data.cond, &data.lock) < 0) {
+                virReportSystemError(errno, "%s",
+                                     _("cannot wait on condition"));
+                data.ret = -1;
+                break;
+            }
+        }
+        virMutexUnlock(&data.lock);
+    }
+
+    /* joins the workers, so no callback may be running past this point */
+    virThreadPoolFree(pool);
+    ret = data.ret;
+
+ destroy:
+    virCondDestroy(&data.cond);
+    virMutexDestroy(&data.lock);
+ cleanup:
+    VIR_FREE(entries);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
 }
 
 
@@ -979,41 +2025,37 @@ virDomainObjListConvert(virDomainObjListPtr domlist,
                         bool skip_missing)
 {
     char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjListShardPtr shard;
     virDomainObjPtr vm;
     size_t i;
 
     *nvms = 0;
     *vms = NULL;
 
-    virObjectRWLockRead(domlist);
     for (i = 0; i < ndoms; i++) {
         virDomainPtr dom = doms[i];
 
         virUUIDFormat(dom->uuid, uuidstr);
+        shard = virDomainObjListGetShard(domlist, domlist->objs, uuidstr);
 
-        if (!(vm = virHashLookup(domlist->objs, uuidstr))) {
+        if (!(vm = virDomainObjListShardLookup(shard, uuidstr))) {
             if (skip_missing)
                 continue;
 
-            virObjectRWUnlock(domlist);
             virReportError(VIR_ERR_NO_DOMAIN,
                            _("no domain with matching uuid '%s' (%s)"),
                            uuidstr, dom->name);
             goto error;
         }
 
-        virObjectRef(vm);
-
         if (VIR_APPEND_ELEMENT(*vms, *nvms, vm) < 0) {
-            virObjectRWUnlock(domlist);
             virObjectUnref(vm);
             goto error;
         }
     }
-    virObjectRWUnlock(domlist);
 
     sa_assert(*vms);
-    virDomainObjListFilter(vms, nvms, conn, filter, flags);
+    virDomainObjListFilter(domlist, vms, nvms, conn, filter, flags, true);
 
     return 0;
 
@@ -1039,7 +2081,9 @@ virDomainObjListExport(virDomainObjListPtr domlist,
     size_t i;
     int ret = -1;
 
-    if (virDomainObjListCollect(domlist, conn, &vms, &nvms, filter, flags) < 0)
+    /* only the name, UUID and ID are needed */
+    if (virDomainObjListCollectInternal(domlist, conn, &vms, &nvms,
+                                        filter, flags, false) < 0)
         return -1;
 
     if (domains) {
@@ -1068,3 +2112,114 @@ virDomainObjListExport(virDomainObjListPtr domlist,
     virObjectListFreeCount(vms, nvms);
     return ret;
 }
+
+
+/**
+ * virDomainObjListExportChanged:
+ * @domlist: Domain object list
+ * @conn: connection to create the domain objects for
+ * @since: change generation returned by a previous call, or 0
+ * @generation: filled with the change generation to pass next time
+ * @domains: filled with the changed domains
+ * @filter: function to filter domains by ACL, or NULL
+ *
+ * Collect the domains whose state or definition changed after the
+ * change generation @since, and those removed since then, which are
+ * returned with an ID of -1 and can't be looked up any more. With
+ * @since being 0 only the existing domains are collected.
+ *
+ * Returns the number of domains in @domains, or -1 on error, which
+ * is VIR_ERR_OPERATION_INVALID if the removals since @since were
+ * forgotten already.
+ */
+int
+virDomainObjListExportChanged(virDomainObjListPtr domlist,
+                              virConnectPtr conn,
+                              unsigned long long since,
+                              unsigned long long *generation,
+                              virDomainPtr **domains,
+                              virDomainObjListACLFilter filter)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    virDomainObjPtr *vms = NULL;
+    virDomainPtr *doms = NULL;
+    size_t nvms = 0;
+    size_t ndoms = 0;
+    size_t alloc = 0;
+    size_t i;
+    int ret = -1;
+
+    /* Read first, so that anything changing from now on is
+     * reported again by the next call at worst */
+    *generation = virDomainObjGetChangeGeneration();
+
+    virObjectLock(domlist);
+
+    if (since && since < domlist->removedFloor) {
+        virObjectUnlock(domlist);
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("changes since generation %llu are no longer known"),
+                       since);
+        return -1;
+    }
+
+    for (i = 0; since && i < domlist->nremoved; i++) {
+        virDomainObjListRemovedPtr entry = domlist->removed + i;
+        virDomainObjPtr vm;
+
+        if (entry->generation <= since ||
+            (filter && !filter(conn, entry->def)))
+            continue;
+
+        /* Defined again meanwhile, which is reported below */
+        virUUIDFormat(entry->def->uuid, uuidstr);
+        if ((vm = virDomainObjListShardLookup(virDomainObjListGetShard(domlist,
+                                                                       domlist->objs,
+                                                                       uuidstr),
+                                              uuidstr))) {
+            virObjectUnref(vm);
+            continue;
+        }
+
+        if (VIR_RESIZE_N(doms, alloc, ndoms, 2) < 0 ||
+            !(doms[ndoms] = virGetDomain(conn, entry->def->name,
+                                         entry->def->uuid, -1))) {
+            virObjectUnlock(domlist);
+            goto cleanup;
+        }
+        ndoms++;
+    }
+
+    virObjectUnlock(domlist);
+
+    if (virDomainObjListSnapshot(domlist, &vms, &nvms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+
+        virObjectLock(vm);
+        if (vm->changeGeneration > since &&
+            (!filter || filter(conn, vm->def))) {
+            if (VIR_RESIZE_N(doms, alloc, ndoms, 2) < 0 ||
+                !(doms[ndoms] = virGetDomain(conn, vm->def->name,
+                                             vm->def->uuid, vm->def->id))) {
+                virObjectUnlock(vm);
+                goto cleanup;
+            }
+            ndoms++;
+        }
+        virObjectUnlock(vm);
+    }
+
+    if (!doms && VIR_ALLOC_N(doms, 1) < 0)
+        goto cleanup;
+
+    VIR_STEAL_PTR(*domains, doms);
+    ret = ndoms;
+
+ cleanup:
+    virObjectListFreeCount(doms, ndoms);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
@@ -34,6 +34,9 @@ virDomainObjListPtr virDomainObjListNew(void);
 
 virDomainObjPtr virDomainObjListFindByID(virDomainObjListPtr doms,
                                          int id);
+void virDomainObjListSetID(virDomainObjListPtr doms,
+                           virDomainObjPtr vm,
+                           int id);
 virDomainObjPtr virDomainObjListFindByUUID(virDomainObjListPtr doms,
                                            const unsigned char *uuid);
 virDomainObjPtr virDomainObjListFindByName(virDomainObjListPtr doms,
@@ -74,6 +77,14 @@ int virDomainObjListLoadAllConfigs(virDomainObjListPtr doms,
                                    virDomainLoadConfigNotify notify,
                                    void *opaque);
 
+int virDomainObjListSetLazyLoad(virDomainObjListPtr doms,
+                                const char *configDir,
+                                virCapsPtr caps,
+                                virDomainXMLOptionPtr xmlopt,
+                                unsigned int maxDefs);
+int virDomainObjListLoadDef(virDomainObjListPtr doms,
+                            virDomainObjPtr vm);
+
 int virDomainObjListNumOfDomains(virDomainObjListPtr doms,
                                  bool active,
                                  virDomainObjListACLFilter filter,
@@ -97,6 +108,11 @@ int virDomainObjListForEach(virDomainObjListPtr doms,
                             virDomainObjListIterator callback,
                             void *opaque);
 
+int virDomainObjListForEachAutostart(virDomainObjListPtr doms,
+                                     size_t nworkers,
+                                     virDomainObjListIterator callback,
+                                     void *opaque);
+
 # define VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE \
                 (VIR_CONNECT_LIST_DOMAINS_ACTIVE | \
                  VIR_CONNECT_LIST_DOMAINS_INACTIVE)
@@ -142,6 +158,12 @@ int virDomainObjListExport(virDomainObjListPtr doms,
                            virDomainPtr **domains,
                            virDomainObjListACLFilter filter,
                            unsigned int flags);
+int virDomainObjListExportChanged(virDomainObjListPtr domlist,
+                                  virConnectPtr conn,
+                                  unsigned long long since,
+                                  unsigned long long *generation,
+                                  virDomainPtr **domains,
+                                  virDomainObjListACLFilter filter);
 int virDomainObjListConvert(virDomainObjListPtr domlist,
                             virConnectPtr conn,
                             virDomainPtr *doms,
@@ -27,6 +27,7 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virhash.h"
+#include "virlease.h"
 #include "virlog.h"
 #include "virstring.h"
 
@@ -286,6 +287,9 @@ virNetworkObjMacMgrAdd(virNetworkObjPtr obj,
     if (virMacMapWriteFile(obj->macmap, file) < 0)
         goto cleanup;
 
+    /* a failed rebuild drops the index, NSS then reads the files */
+    ignore_value(virLeaseIndexBuild(dnsmasqStateDir, NULL));
+
     ret = 0;
  cleanup:
     VIR_FREE(file);
@@ -317,6 +321,9 @@ virNetworkObjMacMgrDel(virNetworkObjPtr obj,
     if (virMacMapWriteFile(obj->macmap, file) < 0)
         goto cleanup;
 
+    /* a failed rebuild drops the index, NSS then reads the files */
+    ignore_value(virLeaseIndexBuild(dnsmasqStateDir, NULL));
+
     ret = 0;
  cleanup:
     VIR_FREE(file);
@@ -1216,6 +1223,51 @@ virNetworkObjUpdate(virNetworkObjPtr obj,
                     int parentIndex,
                     const char *xml,
                     unsigned int flags)  /* virNetworkUpdateFlags */
+{
+    virNetworkUpdateItem item = {
+        .command = command,
+        .section = section,
+        .parentIndex = parentIndex,
+        .xml = xml,
+    };
+
+    return virNetworkObjUpdateBatch(obj, &item, 1, flags);
+}
+
+
+static int
+virNetworkObjUpdateDef(virNetworkDefPtr def,
+                       const virNetworkUpdateItem *items,
+                       size_t nitems,
+                       unsigned int flags)
+{
+    size_t i;
+
+    for (i = 0; i < nitems; i++) {
+        if (virNetworkDefUpdateSection(def, items[i].command, items[i].section,
+                                       items[i].parentIndex, items[i].xml,
+                                       flags) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * virNetworkObjUpdateBatch:
+ *
+ * Like virNetworkObjUpdate, but apply all the @nitems updates in
+ * @items in order. The defs are copied and validated only once for
+ * the whole batch, and either all the updates are applied or none.
+ *
+ * Returns: -1 on error, 0 on success.
+ */
+int
+virNetworkObjUpdateBatch(virNetworkObjPtr obj,
+                         const virNetworkUpdateItem *items,
+                         size_t nitems,
+                         unsigned int flags)  /* virNetworkUpdateFlags */
 {
     int ret = -1;
     virNetworkDefPtr livedef = NULL, configdef = NULL;
@@ -1230,10 +1282,8 @@ virNetworkObjUpdate(virNetworkObjPtr obj,
         /* work on a copy of the def */
         if (!(livedef = virNetworkDefCopy(obj->def, 0)))
             goto cleanup;
-        if (virNetworkDefUpdateSection(livedef, command, section,
-                                       parentIndex, xml, flags) < 0) {
+        if (virNetworkObjUpdateDef(livedef, items, nitems, flags) < 0)
             goto cleanup;
-        }
         /* run a final format/parse cycle to make sure we didn't
          * add anything illegal to the def
          */
@@ -1250,10 +1300,8 @@ virNetworkObjUpdate(virNetworkObjPtr obj,
                                             VIR_NETWORK_XML_INACTIVE))) {
             goto cleanup;
         }
-        if (virNetworkDefUpdateSection(configdef, command, section,
-                                       parentIndex, xml, flags) < 0) {
+        if (virNetworkObjUpdateDef(configdef, items, nitems, flags) < 0)
             goto cleanup;
-        }
         if (!(checkdef = virNetworkDefCopy(configdef,
                                            VIR_NETWORK_XML_INACTIVE))) {
             goto cleanup;
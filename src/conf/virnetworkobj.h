@@ -187,6 +187,12 @@ virNetworkObjUpdate(virNetworkObjPtr obj,
                     const char *xml,
                     unsigned int flags);  /* virNetworkUpdateFlags */
 
+int
+virNetworkObjUpdateBatch(virNetworkObjPtr obj,
+                         const virNetworkUpdateItem *items,
+                         size_t nitems,
+                         unsigned int flags);  /* virNetworkUpdateFlags */
+
 int
 virNetworkObjListExport(virConnectPtr conn,
                         virNetworkObjListPtr netobjs,
@@ -41,6 +41,7 @@ static virClassPtr virStoragePoolObjClass;
 static virClassPtr virStoragePoolObjListClass;
 static virClassPtr virStorageVolObjClass;
 static virClassPtr virStorageVolObjListClass;
+static virClassPtr virStorageVolIndexClass;
 
 static void
 virStoragePoolObjDispose(void *opaque);
@@ -50,6 +51,8 @@ static void
 virStorageVolObjDispose(void *opaque);
 static void
 virStorageVolObjListDispose(void *opaque);
+static void
+virStorageVolIndexDispose(void *opaque);
 
 
 
@@ -79,6 +82,22 @@ struct _virStorageVolObjList {
     virHashTable *objsPath;
 };
 
+/* Volumes of all the pools of a virStoragePoolObjList, so that looking
+ * a volume up by its key or path does not have to walk every pool. The
+ * index is only a hint: entries are checked against the pool they name
+ * and a miss has to be confirmed by searching the pools. */
+typedef struct _virStorageVolIndex virStorageVolIndex;
+typedef virStorageVolIndex *virStorageVolIndexPtr;
+struct _virStorageVolIndex {
+    virObjectLockable parent;
+
+    /* key string -> pool name string mapping */
+    virHashTable *keys;
+
+    /* path string -> pool name string mapping */
+    virHashTable *paths;
+};
+
 struct _virStoragePoolObj {
     virObjectLockable parent;
 
@@ -92,6 +111,9 @@ struct _virStoragePoolObj {
     virStoragePoolDefPtr newDef;
 
     virStorageVolObjListPtr volumes;
+
+    /* index of the list the pool belongs to, or NULL */
+    virStorageVolIndexPtr volIndex;
 };
 
 struct _virStoragePoolObjList {
@@ -104,6 +126,8 @@ struct _virStoragePoolObjList {
     /* name string -> virStoragePoolObj mapping
      * for (1), lockless lookup-by-name */
     virHashTable *objsName;
+
+    virStorageVolIndexPtr volIndex;
 };
 
 
@@ -207,12 +231,124 @@ virStoragePoolObjOnceInit(void)
     if (!VIR_CLASS_NEW(virStoragePoolObjList, virClassForObjectRWLockable()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virStorageVolIndex, virClassForObjectLockable()))
+        return -1;
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virStoragePoolObj)
 
 
+static virStorageVolIndexPtr
+virStorageVolIndexNew(void)
+{
+    virStorageVolIndexPtr idx;
+
+    if (!(idx = virObjectLockableNew(virStorageVolIndexClass)))
+        return NULL;
+
+    if (!(idx->keys = virHashCreate(50, virHashValueFree)) ||
+        !(idx->paths = virHashCreate(50, virHashValueFree))) {
+        virObjectUnref(idx);
+        return NULL;
+    }
+
+    return idx;
+}
+
+
+static void
+virStorageVolIndexDispose(void *opaque)
+{
+    virStorageVolIndexPtr idx = opaque;
+
+    virHashFree(idx->keys);
+    virHashFree(idx->paths);
+}
+
+
+/* Point @key and @path at pool @poolname, replacing whatever pool
+ * they pointed at before. Failing to do so only makes the lookups
+ * slower, so errors are not reported to the caller. */
+static void
+virStorageVolIndexAdd(virStorageVolIndexPtr idx,
+                      const char *poolname,
+                      virStorageVolDefPtr voldef)
+{
+    char *keyval = NULL;
+    char *pathval = NULL;
+
+    if (!idx)
+        return;
+
+    if (VIR_STRDUP(keyval, poolname) < 0 ||
+        VIR_STRDUP(pathval, poolname) < 0)
+        goto cleanup;
+
+    virObjectLock(idx);
+    if (voldef->key &&
+        virHashUpdateEntry(idx->keys, voldef->key, keyval) == 0)
+        keyval = NULL;
+    if (voldef->target.path &&
+        virHashUpdateEntry(idx->paths, voldef->target.path, pathval) == 0)
+        pathval = NULL;
+    virObjectUnlock(idx);
+
+ cleanup:
+    VIR_FREE(keyval);
+    VIR_FREE(pathval);
+}
+
+
+static void
+virStorageVolIndexRemoveEntry(virHashTablePtr table,
+                              const char *name,
+                              const char *poolname)
+{
+    const char *cur;
+
+    if (!name)
+        return;
+
+    /* The entry may have been taken over by another pool with a volume
+     * of the same key or path, leave it be then. */
+    if ((cur = virHashLookup(table, name)) && STREQ(cur, poolname))
+        virHashRemoveEntry(table, name);
+}
+
+
+static void
+virStorageVolIndexRemove(virStorageVolIndexPtr idx,
+                         const char *poolname,
+                         virStorageVolDefPtr voldef)
+{
+    if (!idx)
+        return;
+
+    virObjectLock(idx);
+    virStorageVolIndexRemoveEntry(idx->keys, voldef->key, poolname);
+    virStorageVolIndexRemoveEntry(idx->paths, voldef->target.path, poolname);
+    virObjectUnlock(idx);
+}
+
+
+/* Returns a copy of the name of the pool indexed under @name in @table */
+static char *
+virStorageVolIndexLookup(virStorageVolIndexPtr idx,
+                         virHashTablePtr table,
+                         const char *name)
+{
+    char *poolname = NULL;
+
+    virObjectLock(idx);
+    ignore_value(VIR_STRDUP_QUIET(poolname, virHashLookup(table, name)));
+    virObjectUnlock(idx);
+
+    return poolname;
+}
+
+
 virStoragePoolObjPtr
 virStoragePoolObjNew(void)
 {
@@ -366,6 +502,7 @@ virStoragePoolObjDispose(void *opaque)
 
     virStoragePoolObjClearVols(obj);
     virObjectUnref(obj->volumes);
+    virObjectUnref(obj->volIndex);
 
     virStoragePoolDefFree(obj->def);
     virStoragePoolDefFree(obj->newDef);
@@ -382,6 +519,7 @@ virStoragePoolObjListDispose(void *opaque)
 
     virHashFree(pools->objs);
     virHashFree(pools->objsName);
+    virObjectUnref(pools->volIndex);
 }
 
 
@@ -397,7 +535,8 @@ virStoragePoolObjListNew(void)
         return NULL;
 
     if (!(pools->objs = virHashCreate(20, virObjectFreeHashData)) ||
-        !(pools->objsName = virHashCreate(20, virObjectFreeHashData))) {
+        !(pools->objsName = virHashCreate(20, virObjectFreeHashData)) ||
+        !(pools->volIndex = virStorageVolIndexNew())) {
         virObjectUnref(pools);
         return NULL;
     }
@@ -598,6 +737,74 @@ virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
 }
 
 
+static virStoragePoolObjPtr
+virStoragePoolObjFindByVol(virStoragePoolObjListPtr pools,
+                           virHashTablePtr table,
+                           const char *name,
+                           virStorageVolDefPtr (*findVol)(virStoragePoolObjPtr,
+                                                          const char *),
+                           virStorageVolDefPtr *voldef)
+{
+    virStoragePoolObjPtr obj = NULL;
+    char *poolname;
+
+    *voldef = NULL;
+
+    if (!(poolname = virStorageVolIndexLookup(pools->volIndex, table, name)))
+        return NULL;
+
+    if ((obj = virStoragePoolObjFindByName(pools, poolname)) &&
+        (!virStoragePoolObjIsActive(obj) || !(*voldef = findVol(obj, name))))
+        virStoragePoolObjEndAPI(&obj);
+
+    VIR_FREE(poolname);
+    return obj;
+}
+
+
+/**
+ * virStoragePoolObjFindByVolKey
+ * @pools: Storage pool object list pointer
+ * @key: Storage volume key to find
+ * @voldef: filled with the volume definition
+ *
+ * Lookup the active pool holding the volume with @key in the index of
+ * volumes of @pools without walking every pool. A volume that is not
+ * indexed may still be found by searching the pools.
+ *
+ * Returns: Locked and reffed storage pool object or NULL if not found
+ */
+virStoragePoolObjPtr
+virStoragePoolObjFindByVolKey(virStoragePoolObjListPtr pools,
+                              const char *key,
+                              virStorageVolDefPtr *voldef)
+{
+    return virStoragePoolObjFindByVol(pools, pools->volIndex->keys, key,
+                                      virStorageVolDefFindByKey, voldef);
+}
+
+
+/**
+ * virStoragePoolObjFindByVolPath
+ * @pools: Storage pool object list pointer
+ * @path: Storage volume target path to find
+ * @voldef: filled with the volume definition
+ *
+ * Like virStoragePoolObjFindByVolKey, but lookup the volume by its
+ * target @path, which is compared as is.
+ *
+ * Returns: Locked and reffed storage pool object or NULL if not found
+ */
+virStoragePoolObjPtr
+virStoragePoolObjFindByVolPath(virStoragePoolObjListPtr pools,
+                               const char *path,
+                               virStorageVolDefPtr *voldef)
+{
+    return virStoragePoolObjFindByVol(pools, pools->volIndex->paths, path,
+                                      virStorageVolDefFindByPath, voldef);
+}
+
+
 static virStoragePoolObjPtr
 virStoragePoolSourceFindDuplicateDevices(virStoragePoolObjPtr obj,
                                          virStoragePoolDefPtr def)
@@ -615,9 +822,26 @@ virStoragePoolSourceFindDuplicateDevices(virStoragePoolObjPtr obj,
 }
 
 
+static int
+virStoragePoolObjClearVolIndexCb(void *payload,
+                                 const void *name ATTRIBUTE_UNUSED,
+                                 void *opaque)
+{
+    virStorageVolObjPtr volobj = payload;
+    virStoragePoolObjPtr obj = opaque;
+
+    virStorageVolIndexRemove(obj->volIndex, obj->def->name, volobj->voldef);
+    return 0;
+}
+
+
 void
 virStoragePoolObjClearVols(virStoragePoolObjPtr obj)
 {
+    if (obj->volIndex)
+        virHashForEach(obj->volumes->objsKey,
+                       virStoragePoolObjClearVolIndexCb, obj);
+
     virHashRemoveAll(obj->volumes->objsKey);
     virHashRemoveAll(obj->volumes->objsName);
     virHashRemoveAll(obj->volumes->objsPath);
@@ -654,6 +878,7 @@ virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
     virObjectRef(volobj);
 
     volobj->voldef = voldef;
+    virStorageVolIndexAdd(obj->volIndex, obj->def->name, voldef);
     virObjectRWUnlock(volumes);
     virStorageVolObjEndAPI(&volobj);
     return 0;
@@ -685,6 +910,7 @@ virStoragePoolObjRemoveVol(virStoragePoolObjPtr obj,
 
     virObjectRef(volobj);
     virObjectLock(volobj);
+    virStorageVolIndexRemove(obj->volIndex, obj->def->name, voldef);
     virHashRemoveEntry(volumes->objsKey, voldef->key);
     virHashRemoveEntry(volumes->objsName, voldef->name);
     virHashRemoveEntry(volumes->objsPath, voldef->target.path);
@@ -1562,6 +1788,7 @@ virStoragePoolObjAssignDef(virStoragePoolObjListPtr pools,
     }
     virObjectRef(obj);
     obj->def = def;
+    obj->volIndex = virObjectRef(pools->volIndex);
     virObjectRWUnlock(pools);
     return obj;
 
@@ -33,6 +33,14 @@ typedef virStoragePoolObjList *virStoragePoolObjListPtr;
 typedef struct _virStorageDriverState virStorageDriverState;
 typedef virStorageDriverState *virStorageDriverStatePtr;
 
+typedef struct _virStoragePoolWatch virStoragePoolWatch;
+typedef virStoragePoolWatch *virStoragePoolWatchPtr;
+struct _virStoragePoolWatch {
+    char *name; /* of the pool */
+    int wd; /* inotify watch descriptor, or -1 */
+    bool dirty; /* changed since the last refresh */
+};
+
 struct _virStorageDriverState {
     virMutex lock;
 
@@ -45,6 +53,17 @@ struct _virStorageDriverState {
 
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr storageEventState;
+
+    /* Directories of active pools which are refreshed incrementally
+     * whenever they change, protected by watchLock */
+    virMutex watchLock;
+    int inotifyFD;
+    int inotifyWatch;
+    int refreshTimer;
+    bool refreshPending; /* refreshTimer fires soon for dirty pools */
+    bool refreshRunning; /* a refresh thread is still busy */
+    size_t nwatches;
+    virStoragePoolWatchPtr *watches;
 };
 
 typedef bool
@@ -120,6 +139,16 @@ virStoragePoolObjPtr
 virStoragePoolObjFindByName(virStoragePoolObjListPtr pools,
                             const char *name);
 
+virStoragePoolObjPtr
+virStoragePoolObjFindByVolKey(virStoragePoolObjListPtr pools,
+                              const char *key,
+                              virStorageVolDefPtr *voldef);
+
+virStoragePoolObjPtr
+virStoragePoolObjFindByVolPath(virStoragePoolObjListPtr pools,
+                               const char *path,
+                               virStorageVolDefPtr *voldef);
+
 int
 virStoragePoolObjAddVol(virStoragePoolObjPtr obj,
                         virStorageVolDefPtr voldef);
@@ -320,19 +320,17 @@ x86DataCpuidNext(virCPUx86DataIteratorPtr iterator)
 }
 
 
+/* CPUID leaves in virCPUx86Data are always sorted by
+ * virCPUx86CPUIDSorter, see virCPUx86DataAddCPUIDInt */
 static virCPUx86CPUID *
 x86DataCpuid(const virCPUx86Data *data,
              const virCPUx86CPUID *cpuid)
 {
-    size_t i;
-
-    for (i = 0; i < data->len; i++) {
-        if (data->data[i].eax_in == cpuid->eax_in &&
-            data->data[i].ecx_in == cpuid->ecx_in)
-            return data->data + i;
-    }
+    if (!data->len)
+        return NULL;
 
-    return NULL;
+    return bsearch(cpuid, data->data, data->len,
+                   sizeof(virCPUx86CPUID), virCPUx86CPUIDSorter);
 }
 
 static void
@@ -376,20 +374,28 @@ static int
 virCPUx86DataAddCPUIDInt(virCPUx86Data *data,
                          const virCPUx86CPUID *cpuid)
 {
-    virCPUx86CPUID *existing;
+    size_t lo = 0;
+    size_t hi = data->len;
+    int cmp;
 
-    if ((existing = x86DataCpuid(data, cpuid))) {
-        x86cpuidSetBits(existing, cpuid);
-    } else {
-        if (VIR_APPEND_ELEMENT_COPY(data->data, data->len,
-                                    *((virCPUx86CPUID *)cpuid)) < 0)
-            return -1;
+    /* keep the leaves sorted so that they can be looked up by bsearch and
+     * two sets of leaves can be walked in lockstep */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
 
-        qsort(data->data, data->len,
-              sizeof(virCPUx86CPUID), virCPUx86CPUIDSorter);
+        if ((cmp = virCPUx86CPUIDSorter(data->data + mid, cpuid)) == 0) {
+            x86cpuidSetBits(data->data + mid, cpuid);
+            return 0;
+        }
+
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
 
-    return 0;
+    return VIR_INSERT_ELEMENT_COPY(data->data, lo, data->len,
+                                   *((virCPUx86CPUID *)cpuid));
 }
 
 
@@ -398,18 +404,11 @@ x86DataAdd(virCPUx86Data *data1,
            const virCPUx86Data *data2)
 {
     virCPUx86DataIterator iter = virCPUx86DataIteratorInit(data2);
-    virCPUx86CPUID *cpuid1;
     virCPUx86CPUID *cpuid2;
 
     while ((cpuid2 = x86DataCpuidNext(&iter))) {
-        cpuid1 = x86DataCpuid(data1, cpuid2);
-
-        if (cpuid1) {
-            x86cpuidSetBits(cpuid1, cpuid2);
-        } else {
-            if (virCPUx86DataAddCPUIDInt(data1, cpuid2) < 0)
-                return -1;
-        }
+        if (virCPUx86DataAddCPUIDInt(data1, cpuid2) < 0)
+            return -1;
     }
 
     return 0;
@@ -420,13 +419,21 @@ static void
 x86DataSubtract(virCPUx86Data *data1,
                 const virCPUx86Data *data2)
 {
-    virCPUx86DataIterator iter = virCPUx86DataIteratorInit(data1);
-    virCPUx86CPUID *cpuid1;
-    virCPUx86CPUID *cpuid2;
+    size_t i = 0;
+    size_t j = 0;
+    int cmp;
 
-    while ((cpuid1 = x86DataCpuidNext(&iter))) {
-        cpuid2 = x86DataCpuid(data2, cpuid1);
-        x86cpuidClearBits(cpuid1, cpuid2);
+    /* both lists are sorted, walk them in lockstep */
+    while (i < data1->len && j < data2->len) {
+        cmp = virCPUx86CPUIDSorter(data1->data + i, data2->data + j);
+
+        if (cmp == 0)
+            x86cpuidClearBits(data1->data + i, data2->data + j);
+
+        if (cmp <= 0)
+            i++;
+        if (cmp >= 0)
+            j++;
     }
 }
 
@@ -435,16 +442,23 @@ static void
 x86DataIntersect(virCPUx86Data *data1,
                  const virCPUx86Data *data2)
 {
-    virCPUx86DataIterator iter = virCPUx86DataIteratorInit(data1);
-    virCPUx86CPUID *cpuid1;
-    virCPUx86CPUID *cpuid2;
+    size_t i = 0;
+    size_t j = 0;
+    int cmp;
 
-    while ((cpuid1 = x86DataCpuidNext(&iter))) {
-        cpuid2 = x86DataCpuid(data2, cpuid1);
-        if (cpuid2)
-            x86cpuidAndBits(cpuid1, cpuid2);
-        else
-            x86cpuidClearBits(cpuid1, cpuid1);
+    while (i < data1->len) {
+        cmp = j < data2->len ? virCPUx86CPUIDSorter(data1->data + i,
+                                                     data2->data + j) : -1;
+
+        if (cmp == 0)
+            x86cpuidAndBits(data1->data + i, data2->data + j);
+        else if (cmp < 0)
+            x86cpuidClearBits(data1->data + i, data1->data + i);
+
+        if (cmp <= 0)
+            i++;
+        if (cmp >= 0)
+            j++;
     }
 }
 
@@ -462,13 +476,23 @@ static bool
 x86DataIsSubset(const virCPUx86Data *data,
                 const virCPUx86Data *subset)
 {
-    virCPUx86DataIterator iter = virCPUx86DataIteratorInit((virCPUx86Data *)subset);
-    const virCPUx86CPUID *cpuid;
-    const virCPUx86CPUID *cpuidSubset;
+    size_t i = 0;
+    size_t j;
+    int cmp = 0;
+
+    for (j = 0; j < subset->len; j++) {
+        const virCPUx86CPUID *cpuidSubset = subset->data + j;
+
+        if (x86cpuidMatch(cpuidSubset, &cpuidNull))
+            continue;
+
+        /* both lists are sorted, skip leaves missing in subset */
+        while (i < data->len &&
+               (cmp = virCPUx86CPUIDSorter(data->data + i, cpuidSubset)) < 0)
+            i++;
 
-    while ((cpuidSubset = x86DataCpuidNext(&iter))) {
-        if (!(cpuid = x86DataCpuid(data, cpuidSubset)) ||
-            !x86cpuidMatchMasked(cpuid, cpuidSubset))
+        if (i == data->len || cmp != 0 ||
+            !x86cpuidMatchMasked(data->data + i, cpuidSubset))
             return false;
     }
 
@@ -32,6 +32,7 @@
 extern virClassPtr virConnectClass;
 extern virClassPtr virDomainClass;
 extern virClassPtr virDomainSnapshotClass;
+extern virClassPtr virDomainCheckpointClass;
 extern virClassPtr virInterfaceClass;
 extern virClassPtr virNetworkClass;
 extern virClassPtr virNodeDeviceClass;
@@ -307,6 +308,21 @@ extern virClassPtr virAdmClientClass;
         } \
     } while (0)
 
+# define virCheckDomainCheckpointReturn(obj, retval) \
+    do { \
+        virDomainCheckpointPtr _chk = (obj); \
+        if (!virObjectIsClass(_chk, virDomainCheckpointClass) || \
+            !virObjectIsClass(_chk->domain, virDomainClass) || \
+            !virObjectIsClass(_chk->domain->conn, virConnectClass)) { \
+            virReportErrorHelper(VIR_FROM_DOMAIN_CHECKPOINT, \
+                                 VIR_ERR_INVALID_DOMAIN_CHECKPOINT, \
+                                 __FILE__, __FUNCTION__, __LINE__, \
+                                 __FUNCTION__); \
+            virDispatchError(NULL); \
+            return retval; \
+        } \
+    } while (0)
+
 
 /* Helper macros to implement VIR_DOMAIN_DEBUG using just C99.  This
  * assumes you pass fewer than 15 arguments to VIR_DOMAIN_DEBUG, but
@@ -678,6 +694,17 @@ struct _virDomainSnapshot {
     virDomainPtr domain;
 };
 
+/**
+ * _virDomainCheckpoint
+ *
+ * Internal structure associated with a domain checkpoint
+ */
+struct _virDomainCheckpoint {
+    virObject parent;
+    char *name;
+    virDomainPtr domain;
+};
+
 /**
 * _virNWFilter:
 *
@@ -745,6 +772,8 @@ virNWFilterBindingPtr virGetNWFilterBinding(virConnectPtr conn,
                                             const char *filtername);
 virDomainSnapshotPtr virGetDomainSnapshot(virDomainPtr domain,
                                           const char *name);
+virDomainCheckpointPtr virGetDomainCheckpoint(virDomainPtr domain,
+                                              const char *name);
 
 virAdmConnectPtr virAdmConnectNew(void);
 
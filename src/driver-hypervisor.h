@@ -299,6 +299,22 @@ typedef int
                                virDomainPtr **domains,
                                unsigned int flags);
 
+typedef int
+(*virDrvConnectListAllDomainsPage)(virConnectPtr conn,
+                                   const char *prefix,
+                                   const char *cursor,
+                                   unsigned int maxdomains,
+                                   virDomainPtr **domains,
+                                   char **next,
+                                   unsigned int flags);
+
+typedef int
+(*virDrvConnectGetDomainsChangedSince)(virConnectPtr conn,
+                                       unsigned long long generation,
+                                       unsigned long long *newgeneration,
+                                       virDomainPtr **changed,
+                                       unsigned int flags);
+
 typedef int
 (*virDrvConnectNumOfDefinedDomains)(virConnectPtr conn);
 
@@ -427,6 +443,12 @@ typedef int
                                  const char *xml,
                                  unsigned int flags);
 
+typedef int
+(*virDrvDomainAttachDevices)(virDomainPtr domain,
+                             const char **xmls,
+                             unsigned int nxmls,
+                             unsigned int flags);
+
 typedef int
 (*virDrvDomainDetachDevice)(virDomainPtr domain,
                             const char *xml);
@@ -1321,6 +1343,58 @@ typedef int
                                         int *nparams,
                                         unsigned int flags);
 
+typedef int
+(*virDrvConnectDomainStatsRegister)(virConnectPtr conn,
+                                    unsigned int stats,
+                                    unsigned int interval,
+                                    virConnectDomainStatsCallback cb,
+                                    void *opaque,
+                                    virFreeCallback freecb,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvConnectDomainStatsDeregister)(virConnectPtr conn,
+                                      int callbackID);
+
+typedef int
+(*virDrvConnectMigrateDomains)(virConnectPtr conn,
+                               virDomainPtr *doms,
+                               unsigned int ndoms,
+                               const char *dconnuri,
+                               virTypedParameterPtr params,
+                               int nparams,
+                               unsigned int concurrency,
+                               unsigned int flags);
+
+typedef virDomainCheckpointPtr
+(*virDrvDomainCheckpointCreateXML)(virDomainPtr domain,
+                                   const char *xmlDesc,
+                                   unsigned int flags);
+
+typedef char *
+(*virDrvDomainCheckpointGetXMLDesc)(virDomainCheckpointPtr checkpoint,
+                                    unsigned int flags);
+
+typedef int
+(*virDrvDomainListAllCheckpoints)(virDomainPtr domain,
+                                  virDomainCheckpointPtr **checkpoints,
+                                  unsigned int flags);
+
+typedef virDomainCheckpointPtr
+(*virDrvDomainCheckpointLookupByName)(virDomainPtr domain,
+                                      const char *name,
+                                      unsigned int flags);
+
+typedef int
+(*virDrvDomainCheckpointDelete)(virDomainCheckpointPtr checkpoint,
+                                unsigned int flags);
+
+typedef int
+(*virDrvDomainBackupBegin)(virDomainPtr domain,
+                           const char *backupXML,
+                           const char *checkpointXML,
+                           unsigned int flags);
+
 
 typedef struct _virHypervisorDriver virHypervisorDriver;
 typedef virHypervisorDriver *virHypervisorDriverPtr;
@@ -1572,6 +1646,18 @@ struct _virHypervisorDriver {
     virDrvConnectBaselineHypervisorCPU connectBaselineHypervisorCPU;
     virDrvNodeGetSEVInfo nodeGetSEVInfo;
     virDrvDomainGetLaunchSecurityInfo domainGetLaunchSecurityInfo;
+    virDrvConnectDomainStatsRegister connectDomainStatsRegister;
+    virDrvConnectDomainStatsDeregister connectDomainStatsDeregister;
+    virDrvConnectMigrateDomains connectMigrateDomains;
+    virDrvDomainCheckpointCreateXML domainCheckpointCreateXML;
+    virDrvDomainCheckpointGetXMLDesc domainCheckpointGetXMLDesc;
+    virDrvDomainListAllCheckpoints domainListAllCheckpoints;
+    virDrvDomainCheckpointLookupByName domainCheckpointLookupByName;
+    virDrvDomainCheckpointDelete domainCheckpointDelete;
+    virDrvDomainBackupBegin domainBackupBegin;
+    virDrvDomainAttachDevices domainAttachDevices;
+    virDrvConnectListAllDomainsPage connectListAllDomainsPage;
+    virDrvConnectGetDomainsChangedSince connectGetDomainsChangedSince;
 };
 
 
@@ -118,6 +118,19 @@ typedef int
                               virNetworkDHCPLeasePtr **leases,
                               unsigned int flags);
 
+typedef int
+(*virDrvConnectGetAllDHCPLeases)(virConnectPtr conn,
+                                 virNetworkPtr *nets,
+                                 const char **macs,
+                                 virNetworkDHCPLeasePtr **leases,
+                                 unsigned int flags);
+
+typedef int
+(*virDrvNetworkUpdateBatch)(virNetworkPtr network,
+                            virNetworkUpdateItemPtr items,
+                            unsigned int nitems,
+                            unsigned int flags);
+
 typedef struct _virNetworkDriver virNetworkDriver;
 typedef virNetworkDriver *virNetworkDriverPtr;
 
@@ -151,6 +164,8 @@ struct _virNetworkDriver {
     virDrvNetworkIsActive networkIsActive;
     virDrvNetworkIsPersistent networkIsPersistent;
     virDrvNetworkGetDHCPLeases networkGetDHCPLeases;
+    virDrvNetworkUpdateBatch networkUpdateBatch;
+    virDrvConnectGetAllDHCPLeases connectGetAllDHCPLeases;
 };
 
 
@@ -38,6 +38,7 @@
 #include "esx_vi.h"
 #include "esx_vi_methods.h"
 #include "esx_util.h"
+#include "esx_stream.h"
 #include "vircrypto.h"
 #include "virstring.h"
 
@@ -1439,6 +1440,177 @@ esxStorageVolGetXMLDesc(virStorageVolPtr volume,
 
 
 
+/*
+ * Looks up the URL of the file holding the data of a volume and its size.
+ * Virtual disks consist of a descriptor, the volume itself, and a flat
+ * extent holding the actual data that is transferred instead.
+ */
+static int
+esxStorageVolLookupTransfer(virStorageVolPtr volume, char **url,
+                            unsigned long long *size, bool *isDisk)
+{
+    int result = -1;
+    esxPrivate *priv = volume->conn->privateData;
+    char *datastorePath = NULL;
+    esxVI_FileInfo *fileInfo = NULL;
+    esxVI_VmDiskFileInfo *vmDiskFileInfo = NULL;
+    char *fileName = NULL;
+    virBuffer buffer = VIR_BUFFER_INITIALIZER;
+
+    if (virAsprintf(&datastorePath, "[%s] %s", volume->pool, volume->name) < 0)
+        goto cleanup;
+
+    if (esxVI_LookupFileInfoByDatastorePath(priv->primary, datastorePath,
+                                            false, &fileInfo,
+                                            esxVI_Occurrence_RequiredItem) < 0) {
+        goto cleanup;
+    }
+
+    vmDiskFileInfo = esxVI_VmDiskFileInfo_DynamicCast(fileInfo);
+
+    if (vmDiskFileInfo) {
+        if (!virFileHasSuffix(volume->name, ".vmdk")) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Volume name '%s' has unsupported suffix, "
+                             "expecting '.vmdk'"), volume->name);
+            goto cleanup;
+        }
+
+        if (virAsprintf(&fileName, "%.*s-flat.vmdk",
+                        (int)(strlen(volume->name) - strlen(".vmdk")),
+                        volume->name) < 0) {
+            goto cleanup;
+        }
+
+        /* Scale from kilobyte to byte */
+        *size = vmDiskFileInfo->capacityKb->value * 1024;
+        *isDisk = true;
+    } else {
+        if (VIR_STRDUP(fileName, volume->name) < 0)
+            goto cleanup;
+
+        *size = fileInfo->fileSize->value;
+        *isDisk = false;
+    }
+
+    virBufferAsprintf(&buffer, "%s://%s:%d/folder/", priv->parsedUri->transport,
+                      volume->conn->uri->server, volume->conn->uri->port);
+    virBufferURIEncodeString(&buffer, fileName);
+    virBufferAddLit(&buffer, "?dcPath=");
+    virBufferURIEncodeString(&buffer, priv->primary->datacenterPath);
+    virBufferAddLit(&buffer, "&dsName=");
+    virBufferURIEncodeString(&buffer, volume->pool);
+
+    if (virBufferCheckError(&buffer) < 0)
+        goto cleanup;
+
+    *url = virBufferContentAndReset(&buffer);
+
+    result = 0;
+
+ cleanup:
+    virBufferFreeAndReset(&buffer);
+    VIR_FREE(datastorePath);
+    VIR_FREE(fileName);
+    esxVI_FileInfo_Free(&fileInfo);
+
+    return result;
+}
+
+
+
+static int
+esxStorageVolDownload(virStorageVolPtr volume,
+                      virStreamPtr stream,
+                      unsigned long long offset,
+                      unsigned long long length,
+                      unsigned int flags)
+{
+    int result = -1;
+    esxPrivate *priv = volume->conn->privateData;
+    char *url = NULL;
+    unsigned long long size;
+    bool isDisk;
+
+    virCheckFlags(0, -1);
+
+    if (esxStorageVolLookupTransfer(volume, &url, &size, &isDisk) < 0)
+        goto cleanup;
+
+    if (offset > size) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Offset %llu is beyond the end of volume '%s'"),
+                       offset, volume->name);
+        goto cleanup;
+    }
+
+    if (length == 0 || length > size - offset)
+        length = size - offset;
+
+    if (esxStreamOpenDownload(stream, priv, url, offset, length) < 0)
+        goto cleanup;
+
+    result = 0;
+
+ cleanup:
+    VIR_FREE(url);
+
+    return result;
+}
+
+
+
+static int
+esxStorageVolUpload(virStorageVolPtr volume,
+                    virStreamPtr stream,
+                    unsigned long long offset,
+                    unsigned long long length,
+                    unsigned int flags)
+{
+    int result = -1;
+    esxPrivate *priv = volume->conn->privateData;
+    char *url = NULL;
+    unsigned long long size;
+    bool isDisk;
+
+    virCheckFlags(0, -1);
+
+    /* The datastore file access only allows to replace a file as a whole */
+    if (offset > 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("Uploading at an offset is not supported"));
+        goto cleanup;
+    }
+
+    if (esxStorageVolLookupTransfer(volume, &url, &size, &isDisk) < 0)
+        goto cleanup;
+
+    if (isDisk) {
+        /* A shorter extent would not match the descriptor anymore */
+        if (length == 0)
+            length = size;
+
+        if (length != size) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("Upload to virtual disk '%s' must cover its "
+                             "capacity of %llu bytes"), volume->name, size);
+            goto cleanup;
+        }
+    }
+
+    if (esxStreamOpenUpload(stream, priv, url, length) < 0)
+        goto cleanup;
+
+    result = 0;
+
+ cleanup:
+    VIR_FREE(url);
+
+    return result;
+}
+
+
+
 static char *
 esxStorageVolGetPath(virStorageVolPtr volume)
 {
@@ -1470,4 +1642,6 @@ virStorageDriver esxStorageBackendVMFS = {
     .storageVolGetInfo = esxStorageVolGetInfo, /* 0.8.4 */
     .storageVolGetXMLDesc = esxStorageVolGetXMLDesc, /* 0.8.4 */
     .storageVolGetPath = esxStorageVolGetPath, /* 0.8.4 */
+    .storageVolDownload = esxStorageVolDownload, /* 5.0.0 */
+    .storageVolUpload = esxStorageVolUpload, /* 5.0.0 */
 };
@@ -451,6 +451,52 @@ esxStorageVolWipe(virStorageVolPtr volume, unsigned int flags)
 
 
 
+static int
+esxStorageVolDownload(virStorageVolPtr volume, virStreamPtr stream,
+                      unsigned long long offset, unsigned long long length,
+                      unsigned int flags)
+{
+    esxPrivate *priv = volume->conn->privateData;
+    virStorageDriverPtr backend = volume->privateData;
+
+    virCheckNonNullArgReturn(volume->privateData, -1);
+
+    if (!backend->storageVolDownload) {
+        virReportUnsupportedError();
+        return -1;
+    }
+
+    if (esxVI_EnsureSession(priv->primary) < 0)
+        return -1;
+
+    return backend->storageVolDownload(volume, stream, offset, length, flags);
+}
+
+
+
+static int
+esxStorageVolUpload(virStorageVolPtr volume, virStreamPtr stream,
+                    unsigned long long offset, unsigned long long length,
+                    unsigned int flags)
+{
+    esxPrivate *priv = volume->conn->privateData;
+    virStorageDriverPtr backend = volume->privateData;
+
+    virCheckNonNullArgReturn(volume->privateData, -1);
+
+    if (!backend->storageVolUpload) {
+        virReportUnsupportedError();
+        return -1;
+    }
+
+    if (esxVI_EnsureSession(priv->primary) < 0)
+        return -1;
+
+    return backend->storageVolUpload(volume, stream, offset, length, flags);
+}
+
+
+
 static int
 esxStorageVolGetInfo(virStorageVolPtr volume, virStorageVolInfoPtr info)
 {
@@ -539,6 +585,8 @@ virStorageDriver esxStorageDriver = {
     .storageVolCreateXMLFrom = esxStorageVolCreateXMLFrom, /* 0.8.7 */
     .storageVolDelete = esxStorageVolDelete, /* 0.8.7 */
     .storageVolWipe = esxStorageVolWipe, /* 0.8.7 */
+    .storageVolDownload = esxStorageVolDownload, /* 5.0.0 */
+    .storageVolUpload = esxStorageVolUpload, /* 5.0.0 */
     .storageVolGetInfo = esxStorageVolGetInfo, /* 0.8.4 */
     .storageVolGetXMLDesc = esxStorageVolGetXMLDesc, /* 0.8.4 */
     .storageVolGetPath = esxStorageVolGetPath, /* 0.8.4 */
@@ -63,6 +63,9 @@
  * this means that the typically maximum backlog size should be 16kb as well.
  */
 
+#define ESX_STREAM_RANGE_SIZE (4 * 1024 * 1024)
+#define ESX_STREAM_MAX_RANGES 4
+
 enum _esxStreamMode {
     ESX_STREAM_MODE_UPLOAD = 1,
     ESX_STREAM_MODE_DOWNLOAD = 2
@@ -390,6 +393,32 @@ virStreamDriver esxStreamDriver = {
     .streamAbort = esxStreamAbort,
 };
 
+static int
+esxStreamSetupCURL(esxVI_CURL *curl, esxPrivate *priv, const char *url)
+{
+#if LIBCURL_VERSION_NUM < 0x071301 /* 7.19.1 */
+    char *userpwd = NULL;
+#endif
+
+    curl_easy_setopt(curl->handle, CURLOPT_URL, url);
+
+#if LIBCURL_VERSION_NUM >= 0x071301 /* 7.19.1 */
+    curl_easy_setopt(curl->handle, CURLOPT_USERNAME,
+                     priv->primary->username);
+    curl_easy_setopt(curl->handle, CURLOPT_PASSWORD,
+                     priv->primary->password);
+#else
+    if (virAsprintf(&userpwd, "%s:%s", priv->primary->username,
+                    priv->primary->password) < 0)
+        return -1;
+
+    curl_easy_setopt(curl->handle, CURLOPT_USERPWD, userpwd);
+    VIR_FREE(userpwd);
+#endif
+
+    return 0;
+}
+
 static int
 esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
               unsigned long long offset, unsigned long long length, int mode)
@@ -397,7 +426,6 @@ esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
     int result = -1;
     esxStreamPrivate *streamPriv;
     char *range = NULL;
-    char *userpwd = NULL;
     esxVI_MultiCURL *multi = NULL;
 
     /* FIXME: Although there is already some code in place to deal with
@@ -414,7 +442,9 @@ esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
 
     streamPriv->mode = mode;
 
-    if (length > 0) {
+    if (mode == ESX_STREAM_MODE_UPLOAD) {
+        /* The range is implied, uploads replace the whole file */
+    } else if (length > 0) {
         if (virAsprintf(&range, "%llu-%llu", offset, offset + length - 1) < 0)
             goto cleanup;
     } else if (offset > 0) {
@@ -431,6 +461,11 @@ esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
         curl_easy_setopt(streamPriv->curl->handle, CURLOPT_READFUNCTION,
                          esxVI_CURL_ReadStream);
         curl_easy_setopt(streamPriv->curl->handle, CURLOPT_READDATA, streamPriv);
+
+        if (length > 0) {
+            curl_easy_setopt(streamPriv->curl->handle, CURLOPT_INFILESIZE_LARGE,
+                             (curl_off_t)length);
+        }
     } else {
         curl_easy_setopt(streamPriv->curl->handle, CURLOPT_UPLOAD, 0);
         curl_easy_setopt(streamPriv->curl->handle, CURLOPT_HTTPGET, 1);
@@ -439,22 +474,11 @@ esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
         curl_easy_setopt(streamPriv->curl->handle, CURLOPT_WRITEDATA, streamPriv);
     }
 
-    curl_easy_setopt(streamPriv->curl->handle, CURLOPT_URL, url);
     curl_easy_setopt(streamPriv->curl->handle, CURLOPT_RANGE, range);
 
-#if LIBCURL_VERSION_NUM >= 0x071301 /* 7.19.1 */
-    curl_easy_setopt(streamPriv->curl->handle, CURLOPT_USERNAME,
-                     priv->primary->username);
-    curl_easy_setopt(streamPriv->curl->handle, CURLOPT_PASSWORD,
-                     priv->primary->password);
-#else
-    if (virAsprintf(&userpwd, "%s:%s", priv->primary->username,
-                    priv->primary->password) < 0)
+    if (esxStreamSetupCURL(streamPriv->curl, priv, url) < 0)
         goto cleanup;
 
-    curl_easy_setopt(streamPriv->curl->handle, CURLOPT_USERPWD, userpwd);
-#endif
-
     if (esxVI_MultiCURL_Alloc(&multi) < 0 ||
         esxVI_MultiCURL_Add(multi, streamPriv->curl) < 0)
         goto cleanup;
@@ -473,20 +497,378 @@ esxStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
     }
 
     VIR_FREE(range);
-    VIR_FREE(userpwd);
+
+    return result;
+}
+
+/*
+ * Downloads of a known length larger than ESX_STREAM_RANGE_SIZE are split
+ * into ranges of that size that are requested by up to ESX_STREAM_MAX_RANGES
+ * parallel HTTP range requests on one multi handle. Each request writes into
+ * a buffer of its own. esxRangeStreamRecv hands out the buffers in order and
+ * reuses a buffer for the request of the next range once it got received
+ * completely. This keeps several requests in flight to hide the latency of
+ * the host, while the amount of buffered data stays bounded.
+ */
+
+typedef struct _esxStreamRange esxStreamRange;
+typedef struct _esxRangeStreamPrivate esxRangeStreamPrivate;
+
+struct _esxStreamRange {
+    esxVI_CURL *curl;
+    bool active; /* a request is assigned to this range */
+    bool done; /* the request has completed */
+    unsigned long long offset;
+    size_t length;
+
+    /* Downloaded data that has not been esxRangeStreamRecv'ed completely */
+    char *data;
+    size_t used;
+    size_t read;
+};
+
+struct _esxRangeStreamPrivate {
+    virMutex lock;
+    esxVI_MultiCURL *multi;
+    esxStreamRange ranges[ESX_STREAM_MAX_RANGES];
+    size_t current; /* index of the range to be received next */
+    unsigned long long next; /* offset of the next range to request */
+    unsigned long long end;
+};
+
+static size_t
+esxVI_CURL_WriteRange(char *input, size_t size, size_t nmemb, void *userdata)
+{
+    esxStreamRange *range = userdata;
+    size_t input_size = size * nmemb;
+
+    /* Refuse more data than requested, this aborts the transfer */
+    if (input_size > range->length - range->used)
+        return 0;
+
+    memcpy(range->data + range->used, input, input_size);
+    range->used += input_size;
+
+    return input_size;
+}
+
+static int
+esxRangeStreamStart(esxRangeStreamPrivate *priv, esxStreamRange *range)
+{
+    char *value = NULL;
+    unsigned long long length = priv->end - priv->next;
+
+    if (length > ESX_STREAM_RANGE_SIZE)
+        length = ESX_STREAM_RANGE_SIZE;
+
+    if (virAsprintf(&value, "%llu-%llu", priv->next,
+                    priv->next + length - 1) < 0)
+        return -1;
+
+    range->offset = priv->next;
+    range->length = length;
+    range->used = 0;
+    range->read = 0;
+    range->done = false;
+
+    curl_easy_setopt(range->curl->handle, CURLOPT_RANGE, value);
+
+    VIR_FREE(value);
+
+    if (esxVI_MultiCURL_Add(priv->multi, range->curl) < 0)
+        return -1;
+
+    range->active = true;
+    priv->next += length;
+
+    return 0;
+}
+
+static int
+esxRangeStreamCheckMessages(esxRangeStreamPrivate *priv)
+{
+    int messagesInQueue;
+    CURLMsg *msg;
+    esxStreamRange *range;
+    long responseCode;
+    size_t i;
+
+    while ((msg = curl_multi_info_read(priv->multi->handle,
+                                       &messagesInQueue))) {
+        if (msg->msg != CURLMSG_DONE)
+            continue;
+
+        range = NULL;
+
+        for (i = 0; i < ESX_STREAM_MAX_RANGES; ++i) {
+            if (priv->ranges[i].active &&
+                priv->ranges[i].curl->handle == msg->easy_handle) {
+                range = &priv->ranges[i];
+                break;
+            }
+        }
+
+        if (!range)
+            continue;
+
+        responseCode = 0;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE,
+                          &responseCode);
+
+        if (responseCode != 0 && responseCode != 206) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unexpected HTTP response code %lu"),
+                           responseCode);
+            return -1;
+        }
+
+        if (msg->data.result != CURLE_OK) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Could not complete transfer: %s (%d)"),
+                           curl_easy_strerror(msg->data.result),
+                           msg->data.result);
+            return -1;
+        }
+
+        if (range->used != range->length) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Got %zu instead of %zu bytes at offset %llu"),
+                           range->used, range->length, range->offset);
+            return -1;
+        }
+
+        range->done = true;
+    }
+
+    return 0;
+}
+
+static int
+esxRangeStreamRecvFlags(virStreamPtr stream,
+                        char *data,
+                        size_t nbytes,
+                        unsigned int flags)
+{
+    int result = -1;
+    esxRangeStreamPrivate *priv = stream->privateData;
+    esxStreamRange *range;
+    int runningHandles = 0;
+
+    virCheckFlags(0, -1);
+
+    if (nbytes == 0)
+        return 0;
+
+    if (!priv) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("Stream is not open"));
+        return -1;
+    }
+
+    virMutexLock(&priv->lock);
+
+    while (true) {
+        range = &priv->ranges[priv->current];
+
+        if (!range->active) {
+            /* All ranges have been received */
+            result = 0;
+            break;
+        }
+
+        if (range->read < range->used) {
+            if (nbytes > range->used - range->read)
+                nbytes = range->used - range->read;
+
+            memcpy(data, range->data + range->read, nbytes);
+            range->read += nbytes;
+            result = nbytes;
+            break;
+        }
+
+        if (range->done) {
+            /* Reuse the buffer for the next range that is not requested yet */
+            if (esxVI_MultiCURL_Remove(priv->multi, range->curl) < 0)
+                goto cleanup;
+
+            range->active = false;
+
+            if (priv->next < priv->end &&
+                esxRangeStreamStart(priv, range) < 0) {
+                goto cleanup;
+            }
+
+            priv->current = (priv->current + 1) % ESX_STREAM_MAX_RANGES;
+            continue;
+        }
+
+        if (esxVI_MultiCURL_Wait(priv->multi, &runningHandles) < 0 ||
+            esxRangeStreamCheckMessages(priv) < 0) {
+            goto cleanup;
+        }
+    }
+
+ cleanup:
+    virMutexUnlock(&priv->lock);
+
+    return result;
+}
+
+static int
+esxRangeStreamRecv(virStreamPtr stream,
+                   char *data,
+                   size_t nbytes)
+{
+    return esxRangeStreamRecvFlags(stream, data, nbytes, 0);
+}
+
+static void
+esxFreeRangeStreamPrivate(esxRangeStreamPrivate **priv)
+{
+    esxStreamRange *range;
+    size_t i;
+
+    if (!priv || !*priv)
+        return;
+
+    for (i = 0; i < ESX_STREAM_MAX_RANGES; ++i) {
+        range = &(*priv)->ranges[i];
+
+        if (range->curl && range->curl->multi)
+            esxVI_MultiCURL_Remove((*priv)->multi, range->curl);
+
+        esxVI_CURL_Free(&range->curl);
+        VIR_FREE(range->data);
+    }
+
+    esxVI_MultiCURL_Free(&(*priv)->multi);
+    virMutexDestroy(&(*priv)->lock);
+    VIR_FREE(*priv);
+}
+
+static int
+esxRangeStreamClose(virStreamPtr stream, bool finish)
+{
+    int result = 0;
+    esxRangeStreamPrivate *priv = stream->privateData;
+
+    if (!priv)
+        return 0;
+
+    virMutexLock(&priv->lock);
+
+    if (finish && priv->ranges[priv->current].active) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Stream has untransferred data left"));
+        result = -1;
+    }
+
+    stream->privateData = NULL;
+
+    virMutexUnlock(&priv->lock);
+
+    esxFreeRangeStreamPrivate(&priv);
+
+    return result;
+}
+
+static int
+esxRangeStreamFinish(virStreamPtr stream)
+{
+    return esxRangeStreamClose(stream, true);
+}
+
+static int
+esxRangeStreamAbort(virStreamPtr stream)
+{
+    return esxRangeStreamClose(stream, false);
+}
+
+virStreamDriver esxRangeStreamDriver = {
+    .streamRecv = esxRangeStreamRecv,
+    .streamRecvFlags = esxRangeStreamRecvFlags,
+    .streamFinish = esxRangeStreamFinish,
+    .streamAbort = esxRangeStreamAbort,
+};
+
+static int
+esxRangeStreamOpen(virStreamPtr stream, esxPrivate *priv, const char *url,
+                   unsigned long long offset, unsigned long long length)
+{
+    int result = -1;
+    esxRangeStreamPrivate *streamPriv;
+    esxStreamRange *range;
+    size_t i;
+
+    /* FIXME: Non-blocking streams are not supported here either */
+    if (stream->flags & VIR_STREAM_NONBLOCK) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("Non-blocking streams are not supported yet"));
+        return -1;
+    }
+
+    if (VIR_ALLOC(streamPriv) < 0)
+        return -1;
+
+    if (virMutexInit(&streamPriv->lock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Could not initialize stream mutex"));
+        VIR_FREE(streamPriv);
+        return -1;
+    }
+
+    streamPriv->next = offset;
+    streamPriv->end = offset + length;
+
+    if (esxVI_MultiCURL_Alloc(&streamPriv->multi) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ESX_STREAM_MAX_RANGES; ++i) {
+        range = &streamPriv->ranges[i];
+
+        if (esxVI_CURL_Alloc(&range->curl) < 0 ||
+            esxVI_CURL_Connect(range->curl, priv->parsedUri) < 0 ||
+            esxStreamSetupCURL(range->curl, priv, url) < 0 ||
+            VIR_ALLOC_N(range->data, ESX_STREAM_RANGE_SIZE) < 0) {
+            goto cleanup;
+        }
+
+        curl_easy_setopt(range->curl->handle, CURLOPT_UPLOAD, 0);
+        curl_easy_setopt(range->curl->handle, CURLOPT_HTTPGET, 1);
+        curl_easy_setopt(range->curl->handle, CURLOPT_WRITEFUNCTION,
+                         esxVI_CURL_WriteRange);
+        curl_easy_setopt(range->curl->handle, CURLOPT_WRITEDATA, range);
+
+        if (streamPriv->next < streamPriv->end &&
+            esxRangeStreamStart(streamPriv, range) < 0) {
+            goto cleanup;
+        }
+    }
+
+    stream->driver = &esxRangeStreamDriver;
+    stream->privateData = streamPriv;
+
+    result = 0;
+
+ cleanup:
+    if (result < 0)
+        esxFreeRangeStreamPrivate(&streamPriv);
 
     return result;
 }
 
 int
-esxStreamOpenUpload(virStreamPtr stream, esxPrivate *priv, const char *url)
+esxStreamOpenUpload(virStreamPtr stream, esxPrivate *priv, const char *url,
+                    unsigned long long length)
 {
-    return esxStreamOpen(stream, priv, url, 0, 0, ESX_STREAM_MODE_UPLOAD);
+    return esxStreamOpen(stream, priv, url, 0, length, ESX_STREAM_MODE_UPLOAD);
 }
 
 int
 esxStreamOpenDownload(virStreamPtr stream, esxPrivate *priv, const char *url,
                       unsigned long long offset, unsigned long long length)
 {
+    if (length > ESX_STREAM_RANGE_SIZE)
+        return esxRangeStreamOpen(stream, priv, url, offset, length);
+
     return esxStreamOpen(stream, priv, url, offset, length, ESX_STREAM_MODE_DOWNLOAD);
 }
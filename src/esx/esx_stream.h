@@ -25,7 +25,8 @@
 # include "internal.h"
 # include "esx_private.h"
 
-int esxStreamOpenUpload(virStreamPtr stream, esxPrivate *priv, const char *url);
+int esxStreamOpenUpload(virStreamPtr stream, esxPrivate *priv, const char *url,
+                        unsigned long long length);
 int esxStreamOpenDownload(virStreamPtr stream, esxPrivate *priv, const char *url,
                           unsigned long long offset, unsigned long long length);
 
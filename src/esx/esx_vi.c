@@ -966,6 +966,9 @@ ESX_VI__TEMPLATE__FREE(Context,
     if (item->sessionLock)
         virMutexDestroy(item->sessionLock);
 
+    if (item->vmCacheLock)
+        virMutexDestroy(item->vmCacheLock);
+
     esxVI_CURL_Free(&item->curl);
     VIR_FREE(item->url);
     VIR_FREE(item->ipAddress);
@@ -987,6 +990,11 @@ ESX_VI__TEMPLATE__FREE(Context,
     esxVI_SelectionSpec_Free(&item->selectSet_computeResourceToHost);
     esxVI_SelectionSpec_Free(&item->selectSet_computeResourceToParentToParent);
     esxVI_SelectionSpec_Free(&item->selectSet_datacenterToNetwork);
+    VIR_FREE(item->vmCacheLock);
+    esxVI_ManagedObjectReference_Free(&item->vmCacheCollector);
+    esxVI_ManagedObjectReference_Free(&item->vmCacheFilter);
+    VIR_FREE(item->vmCacheVersion);
+    esxVI_ObjectContent_Free(&item->vmCacheList);
 })
 
 int
@@ -1030,6 +1038,16 @@ esxVI_Context_Connect(esxVI_Context *ctx, const char *url,
         goto cleanup;
     }
 
+    if (VIR_ALLOC(ctx->vmCacheLock) < 0)
+        goto cleanup;
+
+    if (virMutexInit(ctx->vmCacheLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Could not initialize virtual machine cache mutex"));
+        VIR_FREE(ctx->vmCacheLock);
+        goto cleanup;
+    }
+
     if (esxVI_RetrieveServiceContent(ctx, &ctx->service) < 0)
         goto cleanup;
 
@@ -2057,6 +2075,436 @@ esxVI_BuildSelectSetCollection(esxVI_Context *ctx)
 
 
 
+/*
+ * The virtual machines of the host system are looked up for nearly every
+ * call, mostly for the same few properties. A property filter for these
+ * properties of all virtual machines is installed on a dedicated property
+ * collector and its updates are applied to a per-context copy of the list.
+ * Bringing that copy up-to-date takes a single WaitForUpdatesEx call that
+ * returns no updates at all in the common case, instead of one or two
+ * RetrieveProperties calls per lookup. WaitForUpdatesEx exists since
+ * VI API 4.1, older versions always use RetrieveProperties.
+ */
+static const char *esxVI_VirtualMachineCache_Properties[] = {
+    "configStatus",
+    "name",
+    "config.uuid",
+    "runtime.powerState",
+    "config.hardware.memoryMB",
+    "config.hardware.numCPU",
+    "config.memoryAllocation.limit",
+    NULL
+};
+
+/* Must be called with vmCacheLock held */
+static void
+esxVI_VirtualMachineCache_Reset(esxVI_Context *ctx)
+{
+    /*
+     * The property collector is not destroyed here, it belongs to the
+     * session and goes away with it.
+     */
+    esxVI_ManagedObjectReference_Free(&ctx->vmCacheCollector);
+    esxVI_ManagedObjectReference_Free(&ctx->vmCacheFilter);
+    VIR_FREE(ctx->vmCacheVersion);
+    esxVI_ObjectContent_Free(&ctx->vmCacheList);
+}
+
+
+
+/* Must be called with vmCacheLock held */
+static int
+esxVI_VirtualMachineCache_Start(esxVI_Context *ctx)
+{
+    int result = -1;
+    esxVI_ObjectSpec *objectSpec = NULL;
+    bool objectSpec_isAppended = false;
+    esxVI_PropertySpec *propertySpec = NULL;
+    bool propertySpec_isAppended = false;
+    esxVI_PropertyFilterSpec *propertyFilterSpec = NULL;
+    size_t i;
+
+    if (esxVI_ObjectSpec_Alloc(&objectSpec) < 0)
+        return -1;
+
+    objectSpec->obj = ctx->hostSystem->_reference;
+    objectSpec->skip = esxVI_Boolean_False;
+    objectSpec->selectSet = ctx->selectSet_hostSystemToVm;
+
+    if (esxVI_PropertySpec_Alloc(&propertySpec) < 0)
+        goto cleanup;
+
+    propertySpec->type = (char *)"VirtualMachine";
+
+    for (i = 0; esxVI_VirtualMachineCache_Properties[i]; i++) {
+        if (esxVI_String_AppendValueToList
+              (&propertySpec->pathSet,
+               esxVI_VirtualMachineCache_Properties[i]) < 0) {
+            goto cleanup;
+        }
+    }
+
+    if (esxVI_PropertyFilterSpec_Alloc(&propertyFilterSpec) < 0 ||
+        esxVI_PropertySpec_AppendToList(&propertyFilterSpec->propSet,
+                                        propertySpec) < 0) {
+        goto cleanup;
+    }
+
+    propertySpec_isAppended = true;
+
+    if (esxVI_ObjectSpec_AppendToList(&propertyFilterSpec->objectSet,
+                                      objectSpec) < 0) {
+        goto cleanup;
+    }
+
+    objectSpec_isAppended = true;
+
+    if (esxVI_CreatePropertyCollector(ctx, ctx->service->propertyCollector,
+                                      &ctx->vmCacheCollector) < 0 ||
+        esxVI_CreateFilter(ctx, ctx->vmCacheCollector, propertyFilterSpec,
+                           esxVI_Boolean_False, &ctx->vmCacheFilter) < 0 ||
+        VIR_STRDUP(ctx->vmCacheVersion, "") < 0) {
+        goto cleanup;
+    }
+
+    result = 0;
+
+ cleanup:
+    /*
+     * Remove values borrowed from the context from the data structures to
+     * prevent them from being freed by esxVI_PropertyFilterSpec_Free().
+     */
+    objectSpec->obj = NULL;
+    objectSpec->selectSet = NULL;
+
+    if (propertySpec)
+        propertySpec->type = NULL;
+
+    if (!objectSpec_isAppended)
+        esxVI_ObjectSpec_Free(&objectSpec);
+
+    if (!propertySpec_isAppended)
+        esxVI_PropertySpec_Free(&propertySpec);
+
+    esxVI_PropertyFilterSpec_Free(&propertyFilterSpec);
+
+    return result;
+}
+
+
+
+static int
+esxVI_VirtualMachineCache_ApplyChange(esxVI_ObjectContent *virtualMachine,
+                                      esxVI_PropertyChange *propertyChange)
+{
+    esxVI_DynamicProperty **next;
+    esxVI_DynamicProperty *dynamicProperty = NULL;
+
+    /*
+     * The filter doesn't request partial updates, so changes are reported
+     * for exactly the properties in the filter.
+     */
+    if (!virStringListHasString(esxVI_VirtualMachineCache_Properties,
+                                propertyChange->name)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected change of property '%s'"),
+                       propertyChange->name);
+        return -1;
+    }
+
+    for (next = &virtualMachine->propSet; *next; next = &(*next)->_next) {
+        if (STREQ((*next)->name, propertyChange->name)) {
+            dynamicProperty = *next;
+            *next = dynamicProperty->_next;
+            dynamicProperty->_next = NULL;
+            esxVI_DynamicProperty_Free(&dynamicProperty);
+            break;
+        }
+    }
+
+    if ((propertyChange->op != esxVI_PropertyChangeOp_Add &&
+         propertyChange->op != esxVI_PropertyChangeOp_Assign) ||
+        !propertyChange->val) {
+        return 0;
+    }
+
+    if (esxVI_DynamicProperty_Alloc(&dynamicProperty) < 0 ||
+        VIR_STRDUP(dynamicProperty->name, propertyChange->name) < 0 ||
+        esxVI_AnyType_DeepCopy(&dynamicProperty->val,
+                               propertyChange->val) < 0 ||
+        esxVI_DynamicProperty_AppendToList(&virtualMachine->propSet,
+                                           dynamicProperty) < 0) {
+        esxVI_DynamicProperty_Free(&dynamicProperty);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+
+/* Must be called with vmCacheLock held */
+static int
+esxVI_VirtualMachineCache_ApplyUpdate(esxVI_Context *ctx,
+                                      esxVI_ObjectUpdate *objectUpdate)
+{
+    esxVI_ObjectContent **next;
+    esxVI_ObjectContent *virtualMachine = NULL;
+    esxVI_PropertyChange *propertyChange;
+
+    if (STRNEQ(objectUpdate->obj->type, "VirtualMachine"))
+        return 0;
+
+    for (next = &ctx->vmCacheList; *next; next = &(*next)->_next) {
+        if (STREQ((*next)->obj->value, objectUpdate->obj->value)) {
+            virtualMachine = *next;
+            break;
+        }
+    }
+
+    switch (objectUpdate->kind) {
+      case esxVI_ObjectUpdateKind_Enter:
+        if (virtualMachine)
+            break;
+
+        if (esxVI_ObjectContent_Alloc(&virtualMachine) < 0)
+            return -1;
+
+        if (esxVI_ManagedObjectReference_DeepCopy(&virtualMachine->obj,
+                                                  objectUpdate->obj) < 0 ||
+            esxVI_ObjectContent_AppendToList(&ctx->vmCacheList,
+                                             virtualMachine) < 0) {
+            esxVI_ObjectContent_Free(&virtualMachine);
+            return -1;
+        }
+
+        break;
+
+      case esxVI_ObjectUpdateKind_Leave:
+        if (virtualMachine) {
+            *next = virtualMachine->_next;
+            virtualMachine->_next = NULL;
+            esxVI_ObjectContent_Free(&virtualMachine);
+        }
+
+        return 0;
+
+      case esxVI_ObjectUpdateKind_Modify:
+        if (!virtualMachine) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Update of unknown virtual machine '%s'"),
+                           objectUpdate->obj->value);
+            return -1;
+        }
+
+        break;
+
+      case esxVI_ObjectUpdateKind_Undefined:
+      default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected kind of update of virtual machine '%s'"),
+                       objectUpdate->obj->value);
+        return -1;
+    }
+
+    for (propertyChange = objectUpdate->changeSet; propertyChange;
+         propertyChange = propertyChange->_next) {
+        if (esxVI_VirtualMachineCache_ApplyChange(virtualMachine,
+                                                  propertyChange) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+
+/* Must be called with vmCacheLock held */
+static int
+esxVI_VirtualMachineCache_Update(esxVI_Context *ctx)
+{
+    int result = -1;
+    esxVI_WaitOptions *waitOptions = NULL;
+    esxVI_UpdateSet *updateSet = NULL;
+    esxVI_PropertyFilterUpdate *propertyFilterUpdate;
+    esxVI_ObjectUpdate *objectUpdate;
+
+    if (!ctx->vmCacheCollector && esxVI_VirtualMachineCache_Start(ctx) < 0)
+        goto cleanup;
+
+    /* Don't block, just collect the updates since the last version */
+    if (esxVI_WaitOptions_Alloc(&waitOptions) < 0 ||
+        esxVI_Int_Alloc(&waitOptions->maxWaitSeconds) < 0) {
+        goto cleanup;
+    }
+
+    waitOptions->maxWaitSeconds->value = 0;
+
+    /*
+     * A large set of updates may be split over several update sets, the
+     * last call returns none.
+     */
+    while (true) {
+        esxVI_UpdateSet_Free(&updateSet);
+
+        if (esxVI_WaitForUpdatesEx(ctx, ctx->vmCacheCollector,
+                                   ctx->vmCacheVersion, waitOptions,
+                                   &updateSet) < 0) {
+            goto cleanup;
+        }
+
+        if (!updateSet)
+            break;
+
+        for (propertyFilterUpdate = updateSet->filterSet;
+             propertyFilterUpdate;
+             propertyFilterUpdate = propertyFilterUpdate->_next) {
+            for (objectUpdate = propertyFilterUpdate->objectSet;
+                 objectUpdate; objectUpdate = objectUpdate->_next) {
+                if (esxVI_VirtualMachineCache_ApplyUpdate(ctx,
+                                                          objectUpdate) < 0) {
+                    goto cleanup;
+                }
+            }
+        }
+
+        VIR_FREE(ctx->vmCacheVersion);
+
+        if (VIR_STRDUP(ctx->vmCacheVersion, updateSet->version) < 0)
+            goto cleanup;
+    }
+
+    result = 0;
+
+ cleanup:
+    if (result < 0)
+        esxVI_VirtualMachineCache_Reset(ctx);
+
+    esxVI_WaitOptions_Free(&waitOptions);
+    esxVI_UpdateSet_Free(&updateSet);
+
+    return result;
+}
+
+
+
+/*
+ * Copies the cached virtual machines, or the one with the given UUID, with
+ * the properties in propertyNameList to virtualMachineList. Returns 1 on
+ * success, 0 if the cache cannot answer the lookup and -1 on error.
+ */
+static int
+esxVI_VirtualMachineCache_Lookup(esxVI_Context *ctx,
+                                 const unsigned char *uuid,
+                                 esxVI_String *propertyNameList,
+                                 esxVI_ObjectContent **virtualMachineList)
+{
+    int result = -1;
+    esxVI_String *propertyName;
+    esxVI_ObjectContent *candidate;
+    esxVI_ObjectContent *virtualMachine = NULL;
+    esxVI_DynamicProperty *dynamicProperty;
+    esxVI_DynamicProperty *copy = NULL;
+    unsigned char uuid_candidate[VIR_UUID_BUFLEN];
+
+    if (!ctx->vmCacheLock ||
+        ctx->apiVersion < 1000000 * 4 + 1000 * 1 /* 4.1 */) {
+        return 0;
+    }
+
+    for (propertyName = propertyNameList; propertyName;
+         propertyName = propertyName->_next) {
+        if (!virStringListHasString(esxVI_VirtualMachineCache_Properties,
+                                    propertyName->value)) {
+            return 0;
+        }
+    }
+
+    virMutexLock(ctx->vmCacheLock);
+
+    if (esxVI_VirtualMachineCache_Update(ctx) < 0) {
+        VIR_DEBUG("Could not update the virtual machine cache: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+        result = 0;
+        goto cleanup;
+    }
+
+    for (candidate = ctx->vmCacheList; candidate;
+         candidate = candidate->_next) {
+        if (uuid) {
+            const char *uuid_string = NULL;
+
+            for (dynamicProperty = candidate->propSet; dynamicProperty;
+                 dynamicProperty = dynamicProperty->_next) {
+                if (STREQ(dynamicProperty->name, "config.uuid") &&
+                    dynamicProperty->val->type == esxVI_Type_String) {
+                    uuid_string = dynamicProperty->val->string;
+                    break;
+                }
+            }
+
+            if (!uuid_string ||
+                virUUIDParse(uuid_string, uuid_candidate) < 0 ||
+                memcmp(uuid, uuid_candidate, VIR_UUID_BUFLEN) != 0) {
+                continue;
+            }
+        }
+
+        if (esxVI_ObjectContent_Alloc(&virtualMachine) < 0 ||
+            esxVI_ManagedObjectReference_DeepCopy(&virtualMachine->obj,
+                                                  candidate->obj) < 0) {
+            goto cleanup;
+        }
+
+        for (dynamicProperty = candidate->propSet; dynamicProperty;
+             dynamicProperty = dynamicProperty->_next) {
+            if (!esxVI_String_ListContainsValue(propertyNameList,
+                                                dynamicProperty->name)) {
+                continue;
+            }
+
+            if (esxVI_DynamicProperty_DeepCopy(&copy, dynamicProperty) < 0 ||
+                esxVI_DynamicProperty_AppendToList(&virtualMachine->propSet,
+                                                   copy) < 0) {
+                goto cleanup;
+            }
+
+            copy = NULL;
+        }
+
+        if (esxVI_ObjectContent_AppendToList(virtualMachineList,
+                                             virtualMachine) < 0) {
+            goto cleanup;
+        }
+
+        virtualMachine = NULL;
+
+        if (uuid)
+            break;
+    }
+
+    /* Unknown UUIDs are left to the datacenter wide search */
+    if (uuid && !*virtualMachineList)
+        result = 0;
+    else
+        result = 1;
+
+ cleanup:
+    virMutexUnlock(ctx->vmCacheLock);
+
+    if (result < 0)
+        esxVI_ObjectContent_Free(virtualMachineList);
+
+    esxVI_DynamicProperty_Free(&copy);
+    esxVI_ObjectContent_Free(&virtualMachine);
+
+    return result;
+}
+
+
+
 /*
  * Cannot use the SessionIsActive() function here, because at least
  * ESX Server 3.5.0 build-64607 and ESX 4.0.0 build-171294 return an
@@ -2124,6 +2572,11 @@ esxVI_EnsureSession(esxVI_Context *ctx)
     if (!currentSession) {
         esxVI_UserSession_Free(&ctx->session);
 
+        /* The property collector of the cache went away with the session */
+        virMutexLock(ctx->vmCacheLock);
+        esxVI_VirtualMachineCache_Reset(ctx);
+        virMutexUnlock(ctx->vmCacheLock);
+
         if (esxVI_Login(ctx, ctx->username, escapedPassword, NULL,
                         &ctx->session) < 0) {
             goto cleanup;
@@ -2882,6 +3335,15 @@ esxVI_LookupVirtualMachineList(esxVI_Context *ctx,
                                esxVI_String *propertyNameList,
                                esxVI_ObjectContent **virtualMachineList)
 {
+    int rc;
+
+    ESX_VI_CHECK_ARG_LIST(virtualMachineList);
+
+    if ((rc = esxVI_VirtualMachineCache_Lookup(ctx, NULL, propertyNameList,
+                                               virtualMachineList)) != 0) {
+        return rc < 0 ? -1 : 0;
+    }
+
     /* FIXME: Switch from ctx->hostSystem to ctx->computeResource->resourcePool
      *        for cluster support */
     return esxVI_LookupObjectContentByType(ctx, ctx->hostSystem->_reference,
@@ -2901,9 +3363,15 @@ esxVI_LookupVirtualMachineByUuid(esxVI_Context *ctx, const unsigned char *uuid,
     int result = -1;
     esxVI_ManagedObjectReference *managedObjectReference = NULL;
     char uuid_string[VIR_UUID_STRING_BUFLEN] = "";
+    int rc;
 
     ESX_VI_CHECK_ARG_LIST(virtualMachine);
 
+    if ((rc = esxVI_VirtualMachineCache_Lookup(ctx, uuid, propertyNameList,
+                                               virtualMachine)) != 0) {
+        return rc < 0 ? -1 : 0;
+    }
+
     virUUIDFormat(uuid, uuid_string);
 
     if (esxVI_FindByUuid(ctx, ctx->datacenter->_reference, uuid_string,
@@ -4460,7 +4928,8 @@ esxVI_WaitForTaskCompletion(esxVI_Context *ctx,
 
     objectSpec_isAppended = true;
 
-    if (esxVI_CreateFilter(ctx, propertyFilterSpec, esxVI_Boolean_True,
+    if (esxVI_CreateFilter(ctx, ctx->service->propertyCollector,
+                           propertyFilterSpec, esxVI_Boolean_True,
                            &propertyFilter) < 0) {
         goto cleanup;
     }
@@ -210,6 +210,11 @@ struct _esxVI_Context {
     esxVI_SelectionSpec *selectSet_datacenterToNetwork;
     bool hasQueryVirtualDiskUuid;
     bool hasSessionIsActive;
+    virMutexPtr vmCacheLock; /* protects the virtual machine cache below */
+    esxVI_ManagedObjectReference *vmCacheCollector;
+    esxVI_ManagedObjectReference *vmCacheFilter;
+    char *vmCacheVersion;
+    esxVI_ObjectContent *vmCacheList;
 };
 
 int esxVI_Context_Alloc(esxVI_Context **ctx);
@@ -24,6 +24,10 @@
 #include <config.h>
 
 #include <netcf.h>
+#if defined(__linux__) && defined(HAVE_LIBNL)
+# include <net/if.h>
+# include <linux/rtnetlink.h>
+#endif
 
 #include "virerror.h"
 #include "datatypes.h"
@@ -34,6 +38,10 @@
 #include "virstring.h"
 #include "viraccessapicheck.h"
 #include "virinterfaceobj.h"
+#include "virhash.h"
+#include "virnetlink.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_INTERFACE
 
@@ -41,12 +49,47 @@ VIR_LOG_INIT("interface.interface_backend_netcf");
 
 #define INTERFACE_DRIVER_NAME "netcf"
 
+/* Listing the interfaces and getting the live state of one makes netcf
+ * re-read the host configuration and query the kernel. The results are
+ * therefore cached until a netlink notification or a change made through
+ * this driver shows them stale, but for NETCF_CACHE_LIFETIME ms at most,
+ * which bounds how long edits of the host configuration files made
+ * behind our back go unnoticed. */
+#define NETCF_CACHE_LIFETIME (60 * 1000)
+
+typedef struct _virNetcfIfaceInfo virNetcfIfaceInfo;
+typedef virNetcfIfaceInfo *virNetcfIfaceInfoPtr;
+struct _virNetcfIfaceInfo {
+    char *name;
+    char *mac;
+    bool active;
+};
+
+typedef struct _virNetcfStateEntry virNetcfStateEntry;
+typedef virNetcfStateEntry *virNetcfStateEntryPtr;
+struct _virNetcfStateEntry {
+    char *xml;
+    char *mac;
+    char **deps;    /* interfaces the state of which @xml reports */
+    unsigned long long expires;
+};
+
 /* Main driver state */
 typedef struct
 {
     virObjectLockable parent;
     struct netcf *netcf;
     bool privileged;
+
+    /* Protects the fields below. It is taken by the netlink event
+     * callback, so it must never be held while calling netcf. */
+    virMutex cacheLock;
+    int netlinkWatch;               /* nothing is cached while 0 */
+    unsigned long long cacheGen;    /* bumped on every invalidation */
+    virNetcfIfaceInfoPtr ifaces;
+    size_t nifaces;
+    unsigned long long ifacesExpires;
+    virHashTablePtr states;         /* name -> virNetcfStateEntry */
 } virNetcfDriverState, *virNetcfDriverStatePtr;
 
 static virClassPtr virNetcfDriverStateClass;
@@ -66,6 +109,36 @@ VIR_ONCE_GLOBAL_INIT(virNetcfDriverState)
 static virNetcfDriverStatePtr driver;
 
 
+static void
+netcfIfaceInfoListFree(virNetcfIfaceInfoPtr ifaces,
+                       size_t nifaces)
+{
+    size_t i;
+
+    for (i = 0; i < nifaces; i++) {
+        VIR_FREE(ifaces[i].name);
+        VIR_FREE(ifaces[i].mac);
+    }
+    VIR_FREE(ifaces);
+}
+
+
+static void
+netcfStateEntryFree(void *payload,
+                    const void *name ATTRIBUTE_UNUSED)
+{
+    virNetcfStateEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->xml);
+    VIR_FREE(entry->mac);
+    virStringListFree(entry->deps);
+    VIR_FREE(entry);
+}
+
+
 static void
 virNetcfDriverStateDispose(void *obj)
 {
@@ -73,9 +146,207 @@ virNetcfDriverStateDispose(void *obj)
 
     if (_driver->netcf)
         ncf_close(_driver->netcf);
+
+    netcfIfaceInfoListFree(_driver->ifaces, _driver->nifaces);
+    virHashFree(_driver->states);
+    virMutexDestroy(&_driver->cacheLock);
 }
 
 
+static int
+netcfStateEntryDependsOn(const void *payload,
+                         const void *name ATTRIBUTE_UNUSED,
+                         const void *data)
+{
+    const virNetcfStateEntry *entry = payload;
+
+    return virStringListHasString((const char **) entry->deps, data);
+}
+
+
+/* Must be called with cacheLock held. Drops the cached state of every
+ * interface reporting @ifname, or of all of them if @ifname is NULL,
+ * and the list of interfaces too if @list is set. */
+static void
+netcfCacheInvalidateLocked(const char *ifname,
+                           bool list)
+{
+    driver->cacheGen++;
+
+    if (list) {
+        netcfIfaceInfoListFree(driver->ifaces, driver->nifaces);
+        driver->ifaces = NULL;
+        driver->nifaces = 0;
+        driver->ifacesExpires = 0;
+    }
+
+    if (ifname)
+        virHashRemoveSet(driver->states, netcfStateEntryDependsOn, ifname);
+    else
+        virHashRemoveAll(driver->states);
+}
+
+
+static void
+netcfCacheFlush(void)
+{
+    virMutexLock(&driver->cacheLock);
+    netcfCacheInvalidateLocked(NULL, true);
+    virMutexUnlock(&driver->cacheLock);
+}
+
+
+static unsigned long long
+netcfCacheGeneration(void)
+{
+    unsigned long long gen;
+
+    virMutexLock(&driver->cacheLock);
+    gen = driver->cacheGen;
+    virMutexUnlock(&driver->cacheLock);
+
+    return gen;
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+static void
+netcfNetlinkEventCallback(struct nlmsghdr *hdr,
+                          unsigned int length,
+                          struct sockaddr_nl *peer ATTRIBUTE_UNUSED,
+                          bool *handled ATTRIBUTE_UNUSED,
+                          void *opaque ATTRIBUTE_UNUSED)
+{
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL };
+    struct ifaddrmsg *ifa;
+    char ifname[IF_NAMESIZE] = "";
+    char master[IF_NAMESIZE] = "";
+    bool known = true;
+
+    if (length < sizeof(*hdr) || hdr->nlmsg_len > length)
+        return;
+
+    switch (hdr->nlmsg_type) {
+    case RTM_NEWLINK:
+    case RTM_DELLINK:
+        if (nlmsg_parse(hdr, sizeof(struct ifinfomsg),
+                        tb, IFLA_MAX, NULL) < 0 ||
+            !tb[IFLA_IFNAME] ||
+            virStrcpyStatic(ifname, nla_data(tb[IFLA_IFNAME])) < 0)
+            known = false;
+        /* the state of a bridge or bond reports its slaves too */
+        if (tb[IFLA_MASTER] &&
+            !if_indextoname(nla_get_u32(tb[IFLA_MASTER]), master))
+            known = false;
+        break;
+
+    case RTM_NEWADDR:
+    case RTM_DELADDR:
+        if (hdr->nlmsg_len < NLMSG_LENGTH(sizeof(*ifa)))
+            return;
+        ifa = nlmsg_data(hdr);
+        if (!if_indextoname(ifa->ifa_index, ifname))
+            known = false;
+        break;
+
+    default:
+        return;
+    }
+
+    VIR_DEBUG("netlink message %d for interface '%s' master '%s'",
+              hdr->nlmsg_type, ifname, master);
+
+    virMutexLock(&driver->cacheLock);
+    if (!known) {
+        netcfCacheInvalidateLocked(NULL, true);
+    } else {
+        /* addresses are not part of the list, links coming and going or
+         * changing their state are */
+        bool list = hdr->nlmsg_type == RTM_NEWLINK ||
+                    hdr->nlmsg_type == RTM_DELLINK;
+
+        netcfCacheInvalidateLocked(ifname, list);
+        if (*master)
+            netcfCacheInvalidateLocked(master, false);
+    }
+    virMutexUnlock(&driver->cacheLock);
+}
+
+
+static void
+netcfNetlinkEventRemoveCallback(int watch ATTRIBUTE_UNUSED,
+                                const virMacAddr *macaddr ATTRIBUTE_UNUSED,
+                                void *opaque ATTRIBUTE_UNUSED)
+{
+    /* without notifications nothing can be cached any more */
+    virMutexLock(&driver->cacheLock);
+    driver->netlinkWatch = 0;
+    netcfCacheInvalidateLocked(NULL, true);
+    virMutexUnlock(&driver->cacheLock);
+}
+
+
+static void
+netcfCacheStart(void)
+{
+    int watch;
+
+    if (!virNetlinkEventServiceIsRunning(NETLINK_ROUTE)) {
+        VIR_DEBUG("netlink event service not running, "
+                  "interface state will not be cached");
+        return;
+    }
+
+    if (virNetlinkEventServiceAddMembership(NETLINK_ROUTE, RTNLGRP_LINK) < 0 ||
+        virNetlinkEventServiceAddMembership(NETLINK_ROUTE, RTNLGRP_IPV4_IFADDR) < 0 ||
+        virNetlinkEventServiceAddMembership(NETLINK_ROUTE, RTNLGRP_IPV6_IFADDR) < 0)
+        goto error;
+
+    if ((watch = virNetlinkEventAddClient(netcfNetlinkEventCallback,
+                                          netcfNetlinkEventRemoveCallback,
+                                          NULL, NULL, NETLINK_ROUTE)) < 0)
+        goto error;
+
+    virMutexLock(&driver->cacheLock);
+    driver->netlinkWatch = watch;
+    virMutexUnlock(&driver->cacheLock);
+    return;
+
+ error:
+    VIR_WARN("interface state will not be cached: %s",
+             virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
+static void
+netcfCacheStop(void)
+{
+    int watch;
+
+    virMutexLock(&driver->cacheLock);
+    watch = driver->netlinkWatch;
+    driver->netlinkWatch = 0;
+    netcfCacheInvalidateLocked(NULL, true);
+    virMutexUnlock(&driver->cacheLock);
+
+    if (watch > 0)
+        virNetlinkEventRemoveClient(watch, NULL, NETLINK_ROUTE);
+}
+#else /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+static void
+netcfCacheStart(void)
+{
+}
+
+
+static void
+netcfCacheStop(void)
+{
+}
+#endif /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
 static int
 netcfStateInitialize(bool privileged,
                      virStateInhibitCallback callback ATTRIBUTE_UNUSED,
@@ -89,15 +360,29 @@ netcfStateInitialize(bool privileged,
 
     driver->privileged = privileged;
 
+    if (virMutexInit(&driver->cacheLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize mutex"));
+        goto error;
+    }
+
+    if (!(driver->states = virHashCreate(16, netcfStateEntryFree)))
+        goto error;
+
     /* open netcf */
     if (ncf_init(&driver->netcf, NULL) != 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("failed to initialize netcf"));
-        virObjectUnref(driver);
-        driver = NULL;
-        return -1;
+        goto error;
     }
+
+    netcfCacheStart();
     return 0;
+
+ error:
+    virObjectUnref(driver);
+    driver = NULL;
+    return -1;
 }
 
 
@@ -107,6 +392,8 @@ netcfStateCleanup(void)
     if (!driver)
         return -1;
 
+    netcfCacheStop();
+
     if (virObjectUnref(driver)) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Attempt to close netcf state driver "
@@ -127,6 +414,7 @@ netcfStateReload(void)
         return 0;
 
     virObjectLock(driver);
+    netcfCacheFlush();
     ncf_close(driver->netcf);
     if (ncf_init(&driver->netcf, NULL) != 0) {
         /* this isn't a good situation, because we can't shut down the
@@ -328,19 +616,19 @@ netcfInterfaceObjIsActive(struct netcf_if *iface,
     return ret;
 }
 
-static int netcfConnectNumOfInterfacesImpl(virConnectPtr conn,
-                                           int status,
-                                           virInterfaceObjListFilter filter)
+/* Appends the interfaces netcf reports with @status to @ifaces.
+ * Caller must hold the driver lock. */
+static int
+netcfListInterfacesStatus(int status,
+                          virNetcfIfaceInfoPtr *ifaces,
+                          size_t *nifaces)
 {
     int count;
-    int want = 0;
     int ret = -1;
     size_t i;
     char **names = NULL;
+    virNetcfIfaceInfo info = { NULL, NULL, false };
 
-    /* List all interfaces, in case we might support new filter flags
-     * beyond active|inactive in future.
-     */
     count = ncf_num_of_interfaces(driver->netcf, status);
     if (count < 0) {
         const char *errmsg, *details;
@@ -371,7 +659,6 @@ static int netcfConnectNumOfInterfacesImpl(virConnectPtr conn,
     }
 
     for (i = 0; i < count; i++) {
-        virInterfaceDefPtr def;
         struct netcf_if *iface;
 
         iface = ncf_lookup_by_name(driver->netcf, names[i]);
@@ -394,24 +681,23 @@ static int netcfConnectNumOfInterfacesImpl(virConnectPtr conn,
             }
         }
 
-        if (!(def = netcfGetMinimalDefForDevice(iface))) {
+        if (VIR_STRDUP(info.mac, ncf_if_mac_string(iface)) < 0) {
             ncf_if_free(iface);
             goto cleanup;
         }
         ncf_if_free(iface);
 
-        if (!filter(conn, def)) {
-            virInterfaceDefFree(def);
-            continue;
-        }
-        virInterfaceDefFree(def);
-
-        want++;
+        VIR_STEAL_PTR(info.name, names[i]);
+        info.active = status == NETCF_IFACE_ACTIVE;
+        if (VIR_APPEND_ELEMENT(*ifaces, *nifaces, info) < 0)
+            goto cleanup;
     }
 
-    ret = want;
+    ret = 0;
 
  cleanup:
+    VIR_FREE(info.name);
+    VIR_FREE(info.mac);
     if (names && count > 0)
         for (i = 0; i < count; i++)
             VIR_FREE(names[i]);
@@ -420,103 +706,149 @@ static int netcfConnectNumOfInterfacesImpl(virConnectPtr conn,
 }
 
 
-static int netcfConnectListInterfacesImpl(virConnectPtr conn,
-                                          int status,
-                                          char **const names, int nnames,
-                                          virInterfaceObjListFilter filter)
+static int
+netcfIfaceInfoListCopy(virNetcfIfaceInfoPtr src,
+                       size_t nsrc,
+                       virNetcfIfaceInfoPtr *dst,
+                       size_t *ndst)
 {
-    int count = 0;
-    int want = 0;
-    int ret = -1;
+    virNetcfIfaceInfoPtr ifaces = NULL;
     size_t i;
-    char **allnames = NULL;
 
-    count = ncf_num_of_interfaces(driver->netcf, status);
-    if (count < 0) {
-        const char *errmsg, *details;
-        int errcode = ncf_error(driver->netcf, &errmsg, &details);
-        virReportError(netcf_to_vir_err(errcode),
-                       _("failed to get number of host interfaces: %s%s%s"),
-                       errmsg, details ? " - " : "",
-                       details ? details : "");
-        goto cleanup;
-    }
+    if (VIR_ALLOC_N(ifaces, nsrc) < 0)
+        return -1;
 
-    if (count == 0) {
-        ret = 0;
-        goto cleanup;
+    for (i = 0; i < nsrc; i++) {
+        if (VIR_STRDUP(ifaces[i].name, src[i].name) < 0 ||
+            VIR_STRDUP(ifaces[i].mac, src[i].mac) < 0) {
+            netcfIfaceInfoListFree(ifaces, nsrc);
+            return -1;
+        }
+        ifaces[i].active = src[i].active;
     }
 
-    if (VIR_ALLOC_N(allnames, count) < 0)
-        goto cleanup;
+    *dst = ifaces;
+    *ndst = nsrc;
+    return 0;
+}
 
-    if ((count = ncf_list_interfaces(driver->netcf, count, allnames, status)) < 0) {
-        const char *errmsg, *details;
-        int errcode = ncf_error(driver->netcf, &errmsg, &details);
-        virReportError(netcf_to_vir_err(errcode),
-                       _("failed to list host interfaces: %s%s%s"),
-                       errmsg, details ? " - " : "",
-                       details ? details : "");
-        goto cleanup;
+
+/* Gets the list of all interfaces, from the cache if it is valid.
+ * Caller must hold the driver lock. */
+static int
+netcfGetInterfaces(virNetcfIfaceInfoPtr *ifaces,
+                   size_t *nifaces)
+{
+    virNetcfIfaceInfoPtr list = NULL;
+    size_t nlist = 0;
+    unsigned long long now;
+    unsigned long long gen;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virMutexLock(&driver->cacheLock);
+    if (driver->ifacesExpires > now) {
+        ret = netcfIfaceInfoListCopy(driver->ifaces, driver->nifaces,
+                                     ifaces, nifaces);
+        virMutexUnlock(&driver->cacheLock);
+        return ret;
     }
+    gen = driver->cacheGen;
+    virMutexUnlock(&driver->cacheLock);
 
-    if (count == 0) {
-        ret = 0;
+    if (netcfListInterfacesStatus(NETCF_IFACE_ACTIVE, &list, &nlist) < 0 ||
+        netcfListInterfacesStatus(NETCF_IFACE_INACTIVE, &list, &nlist) < 0)
         goto cleanup;
+
+    virMutexLock(&driver->cacheLock);
+    /* don't keep what a notification invalidated while we were asking */
+    if (driver->netlinkWatch > 0 && driver->cacheGen == gen) {
+        netcfIfaceInfoListFree(driver->ifaces, driver->nifaces);
+        driver->ifaces = NULL;
+        driver->nifaces = 0;
+        if (netcfIfaceInfoListCopy(list, nlist,
+                                   &driver->ifaces, &driver->nifaces) < 0) {
+            driver->ifacesExpires = 0;
+            virMutexUnlock(&driver->cacheLock);
+            goto cleanup;
+        }
+        driver->ifacesExpires = now + NETCF_CACHE_LIFETIME;
     }
+    virMutexUnlock(&driver->cacheLock);
 
-    for (i = 0; i < count && want < nnames; i++) {
-        virInterfaceDefPtr def;
-        struct netcf_if *iface;
+    VIR_STEAL_PTR(*ifaces, list);
+    *nifaces = nlist;
+    nlist = 0;
+    ret = 0;
 
-        iface = ncf_lookup_by_name(driver->netcf, allnames[i]);
-        if (!iface) {
-            const char *errmsg, *details;
-            int errcode = ncf_error(driver->netcf, &errmsg, &details);
-            if (errcode != NETCF_NOERROR) {
-                virReportError(netcf_to_vir_err(errcode),
-                               _("couldn't find interface named '%s': %s%s%s"),
-                               allnames[i], errmsg,
-                               details ? " - " : "", details ? details : "");
-                goto cleanup;
-            } else {
-                /* Ignore the NETCF_NOERROR, as the interface is very likely
-                 * deleted by other management apps (e.g. virt-manager).
-                 */
-                VIR_WARN("couldn't find interface named '%s', might be "
-                         "deleted by other process", allnames[i]);
-                continue;
-            }
-        }
+ cleanup:
+    netcfIfaceInfoListFree(list, nlist);
+    return ret;
+}
 
-        if (!(def = netcfGetMinimalDefForDevice(iface))) {
-            ncf_if_free(iface);
-            goto cleanup;
-        }
-        ncf_if_free(iface);
 
-        if (!filter(conn, def)) {
-            virInterfaceDefFree(def);
+static bool
+netcfIfaceInfoFilter(virConnectPtr conn,
+                     virNetcfIfaceInfoPtr info,
+                     virInterfaceObjListFilter filter)
+{
+    /* the access drivers only look at the name and MAC address */
+    virInterfaceDef def = { .name = info->name, .mac = info->mac };
+
+    return filter(conn, &def);
+}
+
+
+static int netcfConnectNumOfInterfacesImpl(virConnectPtr conn,
+                                           bool active,
+                                           virInterfaceObjListFilter filter)
+{
+    virNetcfIfaceInfoPtr ifaces = NULL;
+    size_t nifaces = 0;
+    size_t i;
+    int want = 0;
+
+    if (netcfGetInterfaces(&ifaces, &nifaces) < 0)
+        return -1;
+
+    for (i = 0; i < nifaces; i++) {
+        if (ifaces[i].active != active ||
+            !netcfIfaceInfoFilter(conn, &ifaces[i], filter))
             continue;
-        }
-        virInterfaceDefFree(def);
 
-        names[want++] = allnames[i];
-        allnames[i] = NULL;
+        want++;
     }
 
-    ret = want;
+    netcfIfaceInfoListFree(ifaces, nifaces);
+    return want;
+}
 
- cleanup:
-    if (allnames && count > 0)
-        for (i = 0; i < count; i++)
-            VIR_FREE(allnames[i]);
-    VIR_FREE(allnames);
-    if (ret < 0) {
-        for (i = 0; i < nnames; i++)
-            VIR_FREE(names[i]);
+
+static int netcfConnectListInterfacesImpl(virConnectPtr conn,
+                                          bool active,
+                                          char **const names, int nnames,
+                                          virInterfaceObjListFilter filter)
+{
+    virNetcfIfaceInfoPtr ifaces = NULL;
+    size_t nifaces = 0;
+    size_t i;
+    int want = 0;
+
+    if (netcfGetInterfaces(&ifaces, &nifaces) < 0)
+        return -1;
+
+    for (i = 0; i < nifaces && want < nnames; i++) {
+        if (ifaces[i].active != active ||
+            !netcfIfaceInfoFilter(conn, &ifaces[i], filter))
+            continue;
+
+        VIR_STEAL_PTR(names[want++], ifaces[i].name);
     }
-    return ret;
+
+    netcfIfaceInfoListFree(ifaces, nifaces);
+    return want;
 }
 
 
@@ -529,7 +861,7 @@ static int netcfConnectNumOfInterfaces(virConnectPtr conn)
 
     virObjectLock(driver);
     count = netcfConnectNumOfInterfacesImpl(conn,
-                                            NETCF_IFACE_ACTIVE,
+                                            true,
                                             virConnectNumOfInterfacesCheckACL);
     virObjectUnlock(driver);
     return count;
@@ -544,7 +876,7 @@ static int netcfConnectListInterfaces(virConnectPtr conn, char **const names, in
 
     virObjectLock(driver);
     count = netcfConnectListInterfacesImpl(conn,
-                                           NETCF_IFACE_ACTIVE,
+                                           true,
                                            names, nnames,
                                            virConnectListInterfacesCheckACL);
     virObjectUnlock(driver);
@@ -561,7 +893,7 @@ static int netcfConnectNumOfDefinedInterfaces(virConnectPtr conn)
 
     virObjectLock(driver);
     count = netcfConnectNumOfInterfacesImpl(conn,
-                                            NETCF_IFACE_INACTIVE,
+                                            false,
                                             virConnectNumOfDefinedInterfacesCheckACL);
     virObjectUnlock(driver);
     return count;
@@ -576,7 +908,7 @@ static int netcfConnectListDefinedInterfaces(virConnectPtr conn, char **const na
 
     virObjectLock(driver);
     count = netcfConnectListInterfacesImpl(conn,
-                                           NETCF_IFACE_INACTIVE,
+                                           false,
                                            names, nnames,
                                            virConnectListDefinedInterfacesCheckACL);
     virObjectUnlock(driver);
@@ -590,15 +922,13 @@ netcfConnectListAllInterfaces(virConnectPtr conn,
                               virInterfacePtr **ifaces,
                               unsigned int flags)
 {
-    int count;
     size_t i;
-    unsigned int ncf_flags = 0;
-    struct netcf_if *iface = NULL;
+    virNetcfIfaceInfoPtr infos = NULL;
+    size_t ninfos = 0;
     virInterfacePtr *tmp_iface_objs = NULL;
     virInterfacePtr iface_obj = NULL;
     int niface_objs = 0;
     int ret = -1;
-    char **names = NULL;
 
     virCheckFlags(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE, -1);
 
@@ -607,95 +937,29 @@ netcfConnectListAllInterfaces(virConnectPtr conn,
 
     virObjectLock(driver);
 
-    /* let netcf pre-filter for this flag to save time */
-    if (MATCH(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE)) {
-        if (MATCH(VIR_CONNECT_LIST_INTERFACES_ACTIVE))
-            ncf_flags |= NETCF_IFACE_ACTIVE;
-        if (MATCH(VIR_CONNECT_LIST_INTERFACES_INACTIVE))
-            ncf_flags |= NETCF_IFACE_INACTIVE;
-    } else {
-        ncf_flags = NETCF_IFACE_ACTIVE | NETCF_IFACE_INACTIVE;
-    }
-
-    if ((count = ncf_num_of_interfaces(driver->netcf, ncf_flags)) < 0) {
-        const char *errmsg, *details;
-        int errcode = ncf_error(driver->netcf, &errmsg, &details);
-
-        virReportError(netcf_to_vir_err(errcode),
-                       _("failed to get number of host interfaces: %s%s%s"),
-                       errmsg, details ? " - " : "",
-                       details ? details : "");
+    if (netcfGetInterfaces(&infos, &ninfos) < 0)
         goto cleanup;
-    }
 
-    if (count == 0) {
-        ret = 0;
+    if (ifaces && VIR_ALLOC_N(tmp_iface_objs, ninfos + 1) < 0)
         goto cleanup;
-    }
 
-    if (VIR_ALLOC_N(names, count) < 0)
-        goto cleanup;
-
-    if ((count = ncf_list_interfaces(driver->netcf, count,
-                                     names, ncf_flags)) < 0) {
-        const char *errmsg, *details;
-        int errcode = ncf_error(driver->netcf, &errmsg, &details);
-
-        virReportError(netcf_to_vir_err(errcode),
-                       _("failed to list host interfaces: %s%s%s"),
-                       errmsg, details ? " - " : "",
-                       details ? details : "");
-        goto cleanup;
-    }
-
-    if (ifaces && VIR_ALLOC_N(tmp_iface_objs, count + 1) < 0)
-        goto cleanup;
-
-    for (i = 0; i < count; i++) {
-        virInterfaceDefPtr def;
-
-        iface = ncf_lookup_by_name(driver->netcf, names[i]);
-        if (!iface) {
-            const char *errmsg, *details;
-            int errcode = ncf_error(driver->netcf, &errmsg, &details);
-            if (errcode != NETCF_NOERROR) {
-                virReportError(netcf_to_vir_err(errcode),
-                               _("couldn't find interface named '%s': %s%s%s"),
-                               names[i], errmsg,
-                               details ? " - " : "", details ? details : "");
-                goto cleanup;
-            } else {
-                /* Ignore the NETCF_NOERROR, as the interface is very likely
-                 * deleted by other management apps (e.g. virt-manager).
-                 */
-                VIR_WARN("couldn't find interface named '%s', might be "
-                         "deleted by other process", names[i]);
-                continue;
-            }
-        }
-
-        if (!(def = netcfGetMinimalDefForDevice(iface)))
-            goto cleanup;
+    for (i = 0; i < ninfos; i++) {
+        if (MATCH(VIR_CONNECT_LIST_INTERFACES_FILTERS_ACTIVE) &&
+            !((MATCH(VIR_CONNECT_LIST_INTERFACES_ACTIVE) && infos[i].active) ||
+              (MATCH(VIR_CONNECT_LIST_INTERFACES_INACTIVE) && !infos[i].active)))
+            continue;
 
-        if (!virConnectListAllInterfacesCheckACL(conn, def)) {
-            ncf_if_free(iface);
-            iface = NULL;
-            virInterfaceDefFree(def);
+        if (!netcfIfaceInfoFilter(conn, &infos[i],
+                                  virConnectListAllInterfacesCheckACL))
             continue;
-        }
 
         if (ifaces) {
-            if (!(iface_obj = virGetInterface(conn, def->name, def->mac))) {
-                virInterfaceDefFree(def);
+            if (!(iface_obj = virGetInterface(conn, infos[i].name,
+                                              infos[i].mac)))
                 goto cleanup;
-            }
             tmp_iface_objs[niface_objs] = iface_obj;
         }
         niface_objs++;
-
-        virInterfaceDefFree(def);
-        ncf_if_free(iface);
-        iface = NULL;
     }
 
     if (tmp_iface_objs) {
@@ -708,12 +972,7 @@ netcfConnectListAllInterfaces(virConnectPtr conn,
     ret = niface_objs;
 
  cleanup:
-    ncf_if_free(iface);
-
-    if (names && count > 0)
-        for (i = 0; i < count; i++)
-            VIR_FREE(names[i]);
-    VIR_FREE(names);
+    netcfIfaceInfoListFree(infos, ninfos);
 
     if (tmp_iface_objs) {
         for (i = 0; i < niface_objs; i++)
@@ -813,6 +1072,113 @@ static virInterfacePtr netcfInterfaceLookupByMACString(virConnectPtr conn,
     return ret;
 }
 
+static int
+netcfStateEntryAddDeps(virNetcfStateEntryPtr entry,
+                       virInterfaceDefPtr def)
+{
+    size_t i;
+
+    if (def->name && virStringListAdd(&entry->deps, def->name) < 0)
+        return -1;
+
+    switch ((virInterfaceType) def->type) {
+    case VIR_INTERFACE_TYPE_BRIDGE:
+        for (i = 0; i < def->data.bridge.nbItf; i++) {
+            if (netcfStateEntryAddDeps(entry, def->data.bridge.itf[i]) < 0)
+                return -1;
+        }
+        break;
+    case VIR_INTERFACE_TYPE_BOND:
+        for (i = 0; i < def->data.bond.nbItf; i++) {
+            if (netcfStateEntryAddDeps(entry, def->data.bond.itf[i]) < 0)
+                return -1;
+        }
+        break;
+    case VIR_INTERFACE_TYPE_VLAN:
+        if (def->data.vlan.dev_name &&
+            virStringListAdd(&entry->deps, def->data.vlan.dev_name) < 0)
+            return -1;
+        break;
+    case VIR_INTERFACE_TYPE_ETHERNET:
+    case VIR_INTERFACE_TYPE_LAST:
+        break;
+    }
+
+    return 0;
+}
+
+
+/* Returns 1 and copies of the cached live state XML of @name and its
+ * MAC address if there are any, 0 if there are not, -1 on error. */
+static int
+netcfStateCacheLookup(const char *name,
+                      char **xml,
+                      char **mac)
+{
+    virNetcfStateEntryPtr entry;
+    unsigned long long now;
+    int ret = 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virMutexLock(&driver->cacheLock);
+    if ((entry = virHashLookup(driver->states, name))) {
+        if (entry->expires <= now) {
+            virHashRemoveEntry(driver->states, name);
+        } else if (VIR_STRDUP(*xml, entry->xml) < 0 ||
+                   VIR_STRDUP(*mac, entry->mac) < 0) {
+            VIR_FREE(*xml);
+            ret = -1;
+        } else {
+            ret = 1;
+        }
+    }
+    virMutexUnlock(&driver->cacheLock);
+
+    return ret;
+}
+
+
+/* Caches @xml as the live state of @name described by @def, unless the
+ * cache was invalidated since @gen was obtained. */
+static int
+netcfStateCacheStore(const char *name,
+                     virInterfaceDefPtr def,
+                     const char *xml,
+                     unsigned long long gen)
+{
+    virNetcfStateEntryPtr entry = NULL;
+    unsigned long long now;
+    int ret = -1;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (VIR_ALLOC(entry) < 0 ||
+        VIR_STRDUP(entry->xml, xml) < 0 ||
+        VIR_STRDUP(entry->mac, def->mac) < 0 ||
+        netcfStateEntryAddDeps(entry, def) < 0)
+        goto cleanup;
+    entry->expires = now + NETCF_CACHE_LIFETIME;
+
+    virMutexLock(&driver->cacheLock);
+    if (driver->netlinkWatch > 0 && driver->cacheGen == gen) {
+        if (virHashUpdateEntry(driver->states, name, entry) < 0) {
+            virMutexUnlock(&driver->cacheLock);
+            goto cleanup;
+        }
+        entry = NULL;
+    }
+    virMutexUnlock(&driver->cacheLock);
+
+    ret = 0;
+ cleanup:
+    netcfStateEntryFree(entry, NULL);
+    return ret;
+}
+
+
 static char *netcfInterfaceGetXMLDesc(virInterfacePtr ifinfo,
                                       unsigned int flags)
 {
@@ -820,12 +1186,31 @@ static char *netcfInterfaceGetXMLDesc(virInterfacePtr ifinfo,
     char *xmlstr = NULL;
     virInterfaceDefPtr ifacedef = NULL;
     char *ret = NULL;
+    char *mac = NULL;
     bool active;
+    unsigned long long gen;
+    int rc;
 
     virCheckFlags(VIR_INTERFACE_XML_INACTIVE, NULL);
 
     virObjectLock(driver);
 
+    if (!(flags & VIR_INTERFACE_XML_INACTIVE)) {
+        if ((rc = netcfStateCacheLookup(ifinfo->name, &ret, &mac)) < 0)
+            goto cleanup;
+
+        if (rc > 0) {
+            /* the access drivers only look at the name and MAC address */
+            virInterfaceDef def = { .name = ifinfo->name, .mac = mac };
+
+            if (virInterfaceGetXMLDescEnsureACL(ifinfo->conn, &def) < 0)
+                VIR_FREE(ret);
+            goto cleanup;
+        }
+    }
+
+    gen = netcfCacheGeneration();
+
     iface = interfaceDriverGetNetcfIF(driver->netcf, ifinfo);
     if (!iface) {
         /* helper already reported error */
@@ -865,9 +1250,14 @@ static char *netcfInterfaceGetXMLDesc(virInterfacePtr ifinfo,
         goto cleanup;
     }
 
+    if (!(flags & VIR_INTERFACE_XML_INACTIVE) && active &&
+        netcfStateCacheStore(ifinfo->name, ifacedef, ret, gen) < 0)
+        VIR_FREE(ret);
+
  cleanup:
     ncf_if_free(iface);
     VIR_FREE(xmlstr);
+    VIR_FREE(mac);
     virInterfaceDefFree(ifacedef);
     virObjectUnlock(driver);
     return ret;
@@ -902,6 +1292,8 @@ static virInterfacePtr netcfInterfaceDefineXML(virConnectPtr conn,
     }
 
     iface = ncf_define(driver->netcf, xmlstr);
+    /* even a failed change may have been partially applied */
+    netcfCacheFlush();
     if (!iface) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
@@ -944,6 +1336,7 @@ static int netcfInterfaceUndefine(virInterfacePtr ifinfo)
        goto cleanup;
 
     ret = ncf_if_undefine(iface);
+    netcfCacheFlush();
     if (ret < 0) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
@@ -996,6 +1389,7 @@ static int netcfInterfaceCreate(virInterfacePtr ifinfo,
     }
 
     ret = ncf_if_up(iface);
+    netcfCacheFlush();
     if (ret < 0) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
@@ -1048,6 +1442,7 @@ static int netcfInterfaceDestroy(virInterfacePtr ifinfo,
     }
 
     ret = ncf_if_down(iface);
+    netcfCacheFlush();
     if (ret < 0) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
@@ -1136,6 +1531,7 @@ static int netcfInterfaceChangeCommit(virConnectPtr conn, unsigned int flags)
     virObjectLock(driver);
 
     ret = ncf_change_commit(driver->netcf, 0);
+    netcfCacheFlush();
     if (ret < 0) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
@@ -1161,6 +1557,7 @@ static int netcfInterfaceChangeRollback(virConnectPtr conn, unsigned int flags)
     virObjectLock(driver);
 
     ret = ncf_change_rollback(driver->netcf, 0);
+    netcfCacheFlush();
     if (ret < 0) {
         const char *errmsg, *details;
         int errcode = ncf_error(driver->netcf, &errmsg, &details);
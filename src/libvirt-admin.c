@@ -42,6 +42,14 @@
 #define VIRTLOGD_ADMIN_SOCK_NAME "virtlogd-admin-sock"
 #define VIRTLOCKD_ADMIN_SOCK_NAME "virtlockd-admin-sock"
 
+/* The daemons serving a single driver name their admin socket after
+ * themselves */
+static const char *virAdmSplitDaemons[] = {
+    "virtinterfaced", "virtlxcd", "virtnetworkd", "virtnodedevd",
+    "virtnwfilterd", "virtproxyd", "virtqemud", "virtsecretd",
+    "virtstoraged", "virtxend", NULL,
+};
+
 
 VIR_LOG_INIT("libvirt-admin");
 
@@ -108,6 +116,7 @@ getSocketPath(virURIPtr uri)
 {
     char *rundir = virGetUserRuntimeDirectory();
     char *sock_path = NULL;
+    char *split_sockbase = NULL;
     size_t i = 0;
 
     if (!uri)
@@ -136,6 +145,11 @@ getSocketPath(virURIPtr uri)
             sockbase = VIRTLOGD_ADMIN_SOCK_NAME;
         } else if (STREQ_NULLABLE(uri->scheme, "virtlockd")) {
             sockbase = VIRTLOCKD_ADMIN_SOCK_NAME;
+        } else if (uri->scheme &&
+                   virStringListHasString(virAdmSplitDaemons, uri->scheme)) {
+            if (virAsprintf(&split_sockbase, "%s-admin-sock", uri->scheme) < 0)
+                goto error;
+            sockbase = split_sockbase;
         } else {
             virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
                            _("Unsupported URI scheme '%s'"),
@@ -160,6 +174,7 @@ getSocketPath(virURIPtr uri)
     }
 
  cleanup:
+    VIR_FREE(split_sockbase);
     VIR_FREE(rundir);
     return sock_path;
 
@@ -790,6 +805,8 @@ virAdmConnectLookupServer(virAdmConnectPtr conn,
  *      VIR_THREADPOOL_WORKERS_PRIORITY
  *      VIR_THREADPOOL_WORKERS_FREE
  *      VIR_THREADPOOL_WORKERS_CURRENT
+ *      VIR_THREADPOOL_JOB_QUEUE_DEPTH
+ *      VIR_THREADPOOL_IO_LOOPS
  *
  * Returns 0 on success, -1 in case of an error.
  */
@@ -1251,3 +1268,320 @@ virAdmConnectSetLoggingFilters(virAdmConnectPtr conn,
     virDispatchError(NULL);
     return -1;
 }
+
+/**
+ * virAdmConnectGetLoggingBuffer:
+ * @conn: pointer to an active admin connection
+ * @buffer: pointer to a variable to store the contents of the daemon's
+ *          logging buffer (allocated automatically)
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves the messages kept in memory by the daemon's 'buffer' logging
+ * output, oldest first. The output has to be defined using
+ * virAdmConnectSetLoggingOutputs or the daemon's configuration file, for
+ * example as "1:buffer:1048576" to keep the last MiB of messages. Combined
+ * with logging filters this allows debug messages of selected categories
+ * to be recorded at all times and fetched only once something went wrong.
+ *
+ * Caller is responsible for freeing @buffer.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmConnectGetLoggingBuffer(virAdmConnectPtr conn,
+                              char **buffer,
+                              unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, buffer=%p, flags=0x%x", conn, buffer, flags);
+
+    virResetLastError();
+
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(buffer, error);
+
+    if (remoteAdminConnectGetLoggingBuffer(conn, buffer, flags) < 0)
+        goto error;
+
+    return 0;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetMessagePoolStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned parameters
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves statistics about the pool the daemon uses to recycle RPC
+ * message buffers. Upon successful completion, @params will be allocated
+ * automatically to hold all returned data, setting @nparams accordingly.
+ * When extracting parameters from @params, following search keys are
+ * supported:
+ *      VIR_MESSAGE_POOL_HITS
+ *      VIR_MESSAGE_POOL_MISSES
+ *      VIR_MESSAGE_POOL_RECYCLED
+ *      VIR_MESSAGE_POOL_DISCARDED
+ *      VIR_MESSAGE_POOL_CACHED
+ *      VIR_MESSAGE_POOL_CACHED_BYTES
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmConnectGetMessagePoolStats(virAdmConnectPtr conn,
+                                 virTypedParameterPtr *params,
+                                 int *nparams,
+                                 unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetMessagePoolStats(conn, params, nparams,
+                                                     flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmServerGetRPCStats:
+ * @srv: a valid server object reference
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned parameters
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves call counts and latencies of every RPC procedure the server
+ * @srv dispatched at least once since the daemon started. Upon
+ * successful completion, @params will be allocated automatically to
+ * hold all returned data, setting @nparams accordingly.
+ *
+ * The returned parameters are:
+ *
+ * "rpc.count" - number of procedures reported, as unsigned int.
+ * "rpc.<num>.program" - RPC program number the procedure belongs to,
+ *                       as unsigned int.
+ * "rpc.<num>.procedure" - procedure number, as unsigned int.
+ * "rpc.<num>.calls" - number of calls, as unsigned int.
+ * "rpc.<num>.errors" - number of calls resulting in an error, as
+ *                      unsigned int.
+ * "rpc.<num>.queue.p50", "rpc.<num>.queue.p90", "rpc.<num>.queue.p99",
+ * "rpc.<num>.queue.max" - percentiles and maximum of the time calls
+ *                         waited for a worker thread, in microseconds,
+ *                         as unsigned long long.
+ * "rpc.<num>.exec.p50", "rpc.<num>.exec.p90", "rpc.<num>.exec.p99",
+ * "rpc.<num>.exec.max" - percentiles and maximum of the time the calls
+ *                        took to execute, in microseconds, as unsigned
+ *                        long long.
+ *
+ * Latencies are tracked in power of two buckets, so each reported value
+ * is the upper bound of the bucket it falls in.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmServerGetRPCStats(virAdmServerPtr srv,
+                        virTypedParameterPtr *params,
+                        int *nparams,
+                        unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("srv=%p, params=%p, nparams=%p, flags=0x%x",
+              srv, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckAdmServerGoto(srv, error);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminServerGetRPCStats(srv, params, nparams, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectSetAllocProfile:
+ * @conn: pointer to an active admin connection
+ * @rate: sample every @rate-th memory allocation, 0 to stop profiling
+ * @flags: bitwise-OR of virAdmConnectSetAllocProfileFlags
+ *
+ * Enables or disables accounting of the daemon's memory allocations per
+ * call-site and per error domain (VIR_FROM_*). Only every @rate-th
+ * allocation is sampled and accounted @rate times, so higher values
+ * lower the overhead at the expense of accuracy. Passing
+ * VIR_ADMIN_ALLOC_PROFILE_RESET in @flags clears the data collected so
+ * far. The data is retrieved with virAdmConnectGetAllocStats.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmConnectSetAllocProfile(virAdmConnectPtr conn,
+                             unsigned int rate,
+                             unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, rate=%u, flags=0x%x", conn, rate, flags);
+
+    virResetLastError();
+    virCheckAdmConnectReturn(conn, -1);
+
+    if ((ret = remoteAdminConnectSetAllocProfile(conn, rate, flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetAllocStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned parameters
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves the allocation profile collected by the daemon since
+ * profiling was enabled by virAdmConnectSetAllocProfile. Upon successful
+ * completion, @params will be allocated automatically to hold all
+ * returned data, setting @nparams accordingly. Allocations are counted
+ * when memory is allocated or reallocated, freeing memory is not tracked.
+ *
+ * The returned parameters are:
+ *
+ * "rate" - current sampling rate, 0 if profiling is disabled, as
+ *          unsigned int.
+ * "dropped" - number of allocations which could not be attributed to a
+ *             call-site because too many distinct ones were seen, as
+ *             unsigned long long.
+ * "domain.count" - number of error domains reported, as unsigned int.
+ * "domain.<num>.name" - name of the error domain, as string.
+ * "domain.<num>.allocs" - number of allocations, as unsigned long long.
+ * "domain.<num>.bytes" - number of bytes allocated, as unsigned long long.
+ * "site.count" - number of call-sites reported, as unsigned int.
+ * "site.<num>.file", "site.<num>.function" - source file and function of
+ *                                            the call-site, as string.
+ * "site.<num>.line" - source line of the call-site, as unsigned int.
+ * "site.<num>.allocs" - number of allocations, as unsigned long long.
+ * "site.<num>.bytes" - number of bytes allocated, as unsigned long long.
+ *
+ * Both error domains and call-sites are sorted by the number of bytes
+ * allocated, highest first. Only the top call-sites are reported.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmConnectGetAllocStats(virAdmConnectPtr conn,
+                           virTypedParameterPtr *params,
+                           int *nparams,
+                           unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetAllocStats(conn, params, nparams,
+                                               flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
+
+/**
+ * virAdmConnectGetMemoryStats:
+ * @conn: pointer to an active admin connection
+ * @params: pointer to a list of typed parameters which will be allocated
+ *          to store all returned parameters
+ * @nparams: pointer which will hold the number of params returned in @params
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Retrieves an overview of what the daemon's memory is used for: the
+ * number of live objects of every object class and the memory taken by
+ * hash tables and JSON values. Sizes are approximate, they only account
+ * for the structures themselves and not for everything they point to.
+ * Upon successful completion, @params will be allocated automatically to
+ * hold all returned data, setting @nparams accordingly.
+ *
+ * The returned parameters are:
+ *
+ * "class.count" - number of object classes reported, as unsigned int.
+ * "class.bytes" - memory taken by the objects of all classes, as
+ *                 unsigned long long.
+ * "class.<num>.name" - name of the object class, as string.
+ * "class.<num>.instances" - number of live objects of the class, as
+ *                           unsigned long long.
+ * "class.<num>.bytes" - memory taken by those objects, as
+ *                       unsigned long long.
+ * "hash.tables", "hash.entries" - number of hash tables and of the
+ *                                 entries they hold, as unsigned long long.
+ * "hash.bytes" - memory taken by hash tables, as unsigned long long.
+ * "json.values" - number of individually allocated JSON values, as
+ *                 unsigned long long.
+ * "json.arenas" - number of arenas holding parsed JSON documents, as
+ *                 unsigned long long.
+ * "json.bytes" - memory taken by JSON values and arenas, as
+ *                unsigned long long.
+ *
+ * Only classes with live objects are reported, sorted by the memory
+ * their objects take, highest first.
+ *
+ * Returns 0 on success, -1 in case of an error.
+ */
+int
+virAdmConnectGetMemoryStats(virAdmConnectPtr conn,
+                            virTypedParameterPtr *params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    int ret = -1;
+
+    VIR_DEBUG("conn=%p, params=%p, nparams=%p, flags=0x%x",
+              conn, params, nparams, flags);
+
+    virResetLastError();
+
+    virCheckAdmConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(params, error);
+    virCheckNonNullArgGoto(nparams, error);
+
+    if ((ret = remoteAdminConnectGetMemoryStats(conn, params, nparams,
+                                                flags)) < 0)
+        goto error;
+
+    return ret;
+ error:
+    virDispatchError(NULL);
+    return -1;
+}
@@ -27,6 +27,7 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virlog.h"
+#include "virstring.h"
 #include "virtypedparam.h"
 
 VIR_LOG_INIT("libvirt.domain");
@@ -4260,6 +4261,94 @@ virDomainMigrateToURI3(virDomainPtr domain,
 }
 
 
+/**
+ * virConnectMigrateDomains:
+ * @conn: pointer to the hypervisor connection
+ * @doms: array of domains to migrate
+ * @ndoms: number of domains in @doms
+ * @dconnuri: URI for target libvirtd
+ * @params: (optional) migration parameters
+ * @nparams: (optional) number of migration parameters in @params
+ * @concurrency: maximum number of migrations running at the same time,
+ *               0 lets the hypervisor driver choose
+ * @flags: bitwise-OR of virDomainMigrateFlags
+ *
+ * Migrates all domains in @doms from the host @conn is connected to to the
+ * destination host given by @dconnuri, for example to evacuate a host for
+ * maintenance. This is similar to calling virDomainMigrateToURI3 with the
+ * VIR_MIGRATE_PEER2PEER flag (which is implied) for each domain, but the
+ * source libvirt daemon uses a single connection to the destination for all
+ * of them and schedules up to @concurrency migrations at a time.
+ *
+ * @params and @flags apply to all domains. The parameters which only make
+ * sense for a single domain, i.e., VIR_MIGRATE_PARAM_DEST_NAME,
+ * VIR_MIGRATE_PARAM_DEST_XML, and VIR_MIGRATE_PARAM_PERSIST_XML, are
+ * rejected.
+ *
+ * All domains are attempted even if some of their migrations fail. The error
+ * of the first failed migration is reported and the other failures are
+ * logged.
+ *
+ * Returns 0 if all domains were migrated, -1 upon error.
+ */
+int
+virConnectMigrateDomains(virConnectPtr conn,
+                         virDomainPtr *doms,
+                         unsigned int ndoms,
+                         const char *dconnuri,
+                         virTypedParameterPtr params,
+                         unsigned int nparams,
+                         unsigned int concurrency,
+                         unsigned int flags)
+{
+    size_t i;
+
+    VIR_DEBUG("conn=%p, doms=%p, ndoms=%u, dconnuri=%s, params=%p, "
+              "nparams=%u, concurrency=%u, flags=0x%x",
+              conn, doms, ndoms, NULLSTR(dconnuri), params, nparams,
+              concurrency, flags);
+    VIR_TYPED_PARAMS_DEBUG(params, nparams);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckReadOnlyGoto(conn->flags, error);
+    virCheckNonNullArgGoto(doms, error);
+    virCheckNonZeroArgGoto(ndoms, error);
+    virCheckNonNullArgGoto(dconnuri, error);
+
+    for (i = 0; i < ndoms; i++) {
+        virCheckDomainGoto(doms[i], error);
+
+        if (doms[i]->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("domain '%s' belongs to a different connection"),
+                           doms[i]->name);
+            goto error;
+        }
+    }
+
+    VIR_EXCLUSIVE_FLAGS_GOTO(VIR_MIGRATE_NON_SHARED_DISK,
+                             VIR_MIGRATE_NON_SHARED_INC,
+                             error);
+
+    flags |= VIR_MIGRATE_PEER2PEER;
+
+    if (conn->driver && conn->driver->connectMigrateDomains) {
+        if (conn->driver->connectMigrateDomains(conn, doms, ndoms, dconnuri,
+                                                params, nparams, concurrency,
+                                                flags) < 0)
+            goto error;
+        return 0;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /*
  * Not for public use.  This function is part of the internal
  * implementation of migration in the remote case.
@@ -6504,6 +6593,249 @@ virConnectListAllDomains(virConnectPtr conn,
 }
 
 
+static int
+virConnectListAllDomainsPageCompare(const void *a,
+                                    const void *b)
+{
+    virDomainPtr da = *(virDomainPtr *)a;
+    virDomainPtr db = *(virDomainPtr *)b;
+
+    return strcmp(da->name, db->name);
+}
+
+
+/*
+ * Pages through the full list of domains reported by the driver, for
+ * drivers which can list all their domains in one go anyway.
+ */
+static int
+virConnectListAllDomainsPageFallback(virConnectPtr conn,
+                                     const char *prefix,
+                                     const char *cursor,
+                                     unsigned int maxdomains,
+                                     virDomainPtr **domains,
+                                     char **next,
+                                     unsigned int flags)
+{
+    virDomainPtr *all = NULL;
+    virDomainPtr *page = NULL;
+    int nall;
+    size_t npage = 0;
+    size_t i;
+    int ret = -1;
+
+    if ((nall = conn->driver->connectListAllDomains(conn, &all, flags)) < 0)
+        return -1;
+
+    qsort(all, nall, sizeof(*all), virConnectListAllDomainsPageCompare);
+
+    if (VIR_ALLOC_N(page, MIN(nall, maxdomains) + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nall; i++) {
+        if (cursor && strcmp(all[i]->name, cursor) <= 0)
+            continue;
+        if (prefix && !STRPREFIX(all[i]->name, prefix))
+            continue;
+
+        if (npage == maxdomains) {
+            /* More remain, resume after the last one returned */
+            if (VIR_STRDUP(*next, page[npage - 1]->name) < 0)
+                goto cleanup;
+            break;
+        }
+
+        VIR_STEAL_PTR(page[npage], all[i]);
+        npage++;
+    }
+
+    VIR_STEAL_PTR(*domains, page);
+    ret = npage;
+
+ cleanup:
+    virObjectListFreeCount(page, npage);
+    virObjectListFreeCount(all, nall);
+    return ret;
+}
+
+
+/**
+ * virConnectListAllDomainsPage:
+ * @conn: Pointer to the hypervisor connection.
+ * @prefix: only list domains whose name starts with @prefix, or NULL
+ * @cursor: value of @next returned for the previous page, or NULL to
+ *          start from the first page
+ * @maxdomains: maximum number of domains to return in this page
+ * @domains: Pointer to a variable to store the array containing domain
+ *           objects of this page
+ * @next: Pointer to a variable to store the cursor of the next page
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ *
+ * Collect one page of a possibly-filtered list of all domains, sorted by
+ * name. This is meant for hosts running so many domains that listing
+ * them with virConnectListAllDomains() would be too costly, or would
+ * exceed the limits of the remote protocol. @flags filter the domains
+ * exactly as for virConnectListAllDomains().
+ *
+ * The first page is requested with a NULL @cursor. If more domains remain
+ * after this page, @next is set to an allocated string which is to be
+ * passed as @cursor to request the following page, otherwise @next is set
+ * to NULL. A page may hold fewer than @maxdomains domains even when more
+ * remain, so iteration must continue until @next is NULL. Domains created
+ * or renamed while paging may or may not be listed.
+ *
+ * Example of usage:
+ *
+ *   virDomainPtr *domains;
+ *   char *cursor = NULL;
+ *   char *next = NULL;
+ *   size_t i;
+ *   int ret;
+ *
+ *   do {
+ *       ret = virConnectListAllDomainsPage(conn, "web-", cursor, 100,
+ *                                          &domains, &next, 0);
+ *       free(cursor);
+ *       if (ret < 0)
+ *           error();
+ *       for (i = 0; i < ret; i++) {
+ *           do_something_with_domain(domains[i]);
+ *           virDomainFree(domains[i]);
+ *       }
+ *       free(domains);
+ *       cursor = next;
+ *   } while (cursor);
+ *
+ * Returns the number of domains in this page or -1 and sets @domains
+ * and @next to NULL in case of error. On success, the array stored into
+ * @domains is guaranteed to have an extra allocated element set to NULL
+ * but not included in the return count. The caller is responsible for
+ * calling virDomainFree() on each array element, then calling free() on
+ * @domains and on @next.
+ */
+int
+virConnectListAllDomainsPage(virConnectPtr conn,
+                             const char *prefix,
+                             const char *cursor,
+                             unsigned int maxdomains,
+                             virDomainPtr **domains,
+                             char **next,
+                             unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, prefix=%s, cursor=%s, maxdomains=%u, domains=%p, "
+              "next=%p, flags=0x%x", conn, NULLSTR(prefix), NULLSTR(cursor),
+              maxdomains, domains, next, flags);
+
+    virResetLastError();
+
+    if (domains)
+        *domains = NULL;
+    if (next)
+        *next = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(domains, error);
+    virCheckNonNullArgGoto(next, error);
+    virCheckPositiveArgGoto(maxdomains, error);
+
+    if (conn->driver->connectListAllDomainsPage) {
+        int ret;
+        ret = conn->driver->connectListAllDomainsPage(conn, prefix, cursor,
+                                                      maxdomains, domains,
+                                                      next, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    if (conn->driver->connectListAllDomains) {
+        int ret;
+        ret = virConnectListAllDomainsPageFallback(conn, prefix, cursor,
+                                                   maxdomains, domains,
+                                                   next, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectGetDomainsChangedSince:
+ * @conn: Pointer to the hypervisor connection.
+ * @generation: value of @newgeneration returned by a previous call, or 0
+ * @newgeneration: Pointer to a variable to store the generation to pass
+ *                 as @generation to the next call
+ * @changed: Pointer to a variable to store the array containing the
+ *           changed domain objects
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Collect the domains whose state or definition changed since the
+ * previous call returned @generation, so that a management application
+ * can keep its list of domains up to date without listing all of them
+ * over and over again. Domains created, started, stopped, paused,
+ * modified, renamed or undefined since then are all returned, though a
+ * domain may also be returned when nothing observable changed. Domains
+ * which no longer exist are returned too; looking them up by UUID
+ * fails with VIR_ERR_NO_DOMAIN.
+ *
+ * With @generation being 0 all existing domains are returned, which
+ * is how the list is initially set up. Generations are only meaningful
+ * for the connection they were returned on; after reconnecting the
+ * list has to be set up again. The same is true if this API fails with
+ * VIR_ERR_OPERATION_INVALID, meaning that too many domains were removed
+ * since @generation for all of them to be known.
+ *
+ * Returns the number of changed domains or -1 and sets @changed to NULL
+ * in case of error. On success, the array stored into @changed is
+ * guaranteed to have an extra allocated element set to NULL but not
+ * included in the return count. The caller is responsible for calling
+ * virDomainFree() on each array element, then calling free() on
+ * @changed.
+ */
+int
+virConnectGetDomainsChangedSince(virConnectPtr conn,
+                                 unsigned long long generation,
+                                 unsigned long long *newgeneration,
+                                 virDomainPtr **changed,
+                                 unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, generation=%llu, newgeneration=%p, changed=%p, "
+              "flags=0x%x", conn, generation, newgeneration, changed, flags);
+
+    virResetLastError();
+
+    if (changed)
+        *changed = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(newgeneration, error);
+    virCheckNonNullArgGoto(changed, error);
+
+    if (conn->driver->connectGetDomainsChangedSince) {
+        int ret;
+        ret = conn->driver->connectGetDomainsChangedSince(conn, generation,
+                                                          newgeneration,
+                                                          changed, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainCreate:
  * @domain: pointer to a defined domain
@@ -8170,6 +8502,69 @@ virDomainAttachDeviceFlags(virDomainPtr domain,
 }
 
 
+/**
+ * virDomainAttachDevices:
+ * @domain: pointer to domain object
+ * @xmls: array of XML descriptions of one device each
+ * @nxmls: number of devices in @xmls
+ * @flags: bitwise-OR of virDomainDeviceModifyFlags
+ *
+ * Attach several virtual devices to a domain, in the order they are
+ * listed in @xmls.  Each of them is attached as if by
+ * virDomainAttachDeviceFlags() with the same @flags, except that
+ * the whole operation is done as a single job, the domain state and
+ * configuration are written only once, and the persistent configuration
+ * is only changed if every device in @xmls could be added to it and,
+ * if VIR_DOMAIN_AFFECT_LIVE is used, attached to the running domain.
+ *
+ * This is much faster than separate virDomainAttachDeviceFlags() calls
+ * when many devices are added at once.
+ *
+ * If attaching a device to the running domain fails, the devices
+ * preceding it in @xmls stay attached, and an error is returned.
+ *
+ * Returns 0 in case of success, -1 in case of failure.
+ */
+int
+virDomainAttachDevices(virDomainPtr domain,
+                       const char **xmls,
+                       unsigned int nxmls,
+                       unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DOMAIN_DEBUG(domain, "xmls=%p, nxmls=%u, flags=0x%x",
+                     xmls, nxmls, flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(domain, -1);
+    conn = domain->conn;
+
+    virCheckNonNullArgGoto(xmls, error);
+    virCheckNonZeroArgGoto(nxmls, error);
+    virCheckReadOnlyGoto(conn->flags, error);
+
+    for (i = 0; i < nxmls; i++)
+        virCheckNonNullArgGoto(xmls[i], error);
+
+    if (conn->driver->domainAttachDevices) {
+        int ret;
+        ret = conn->driver->domainAttachDevices(domain, xmls, nxmls, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(domain->conn);
+    return -1;
+}
+
+
 /**
  * virDomainDetachDevice:
  * @domain: pointer to domain object
@@ -8251,6 +8646,14 @@ virDomainDetachDevice(virDomainPtr domain, const char *xml)
  * a synchronous removal. In other words, this API may wait a bit for the
  * removal to complete in case it was not synchronous.
  *
+ * With VIR_DOMAIN_DEVICE_MODIFY_ASYNC in @flags the API does not wait and
+ * returns right after requesting the removal, just like
+ * virDomainDetachDeviceAlias() does. The caller then has to wait for the
+ * VIR_DOMAIN_EVENT_ID_DEVICE_REMOVED event to signal the actual removal
+ * or for VIR_DOMAIN_EVENT_ID_DEVICE_REMOVAL_FAILED to signal that the
+ * guest rejected it. Other modifications of the domain are not held back
+ * until the guest releases the device then.
+ *
  * Be aware that hotplug changes might not persist across a domain going
  * into S4 state (also known as hibernation) unless you also modify the
  * persistent domain definition.
@@ -9173,6 +9576,10 @@ virDomainMigrateStartPostCopy(virDomainPtr domain,
  * The reference can be released once the object is no longer required
  * by calling virDomainFree().
  *
+ * @eventID may have VIR_DOMAIN_EVENT_ID_FLAG_COALESCE set, in which case
+ * bursts of block job and balloon change events are collapsed so that
+ * only the latest one is delivered at most once per second.
+ *
  * The return value from this method is a positive integer identifier
  * for the callback. To unregister a callback, this callback ID should
  * be passed to the virConnectDomainEventDeregisterAny() method.
@@ -9204,7 +9611,8 @@ virConnectDomainEventRegisterAny(virConnectPtr conn,
     }
     virCheckNonNullArgGoto(cb, error);
     virCheckNonNegativeArgGoto(eventID, error);
-    if (eventID >= VIR_DOMAIN_EVENT_ID_LAST) {
+    if ((eventID & ~VIR_DOMAIN_EVENT_ID_FLAG_COALESCE) >=
+        VIR_DOMAIN_EVENT_ID_LAST) {
         virReportInvalidArg(eventID,
                             _("eventID must be less than %d"),
                             VIR_DOMAIN_EVENT_ID_LAST);
@@ -10444,6 +10852,72 @@ virDomainBlockCommit(virDomainPtr dom, const char *disk,
 }
 
 
+/**
+ * virDomainBackupBegin:
+ * @dom: pointer to domain object
+ * @backupXML: description of the requested backup
+ * @checkpointXML: optional description of a checkpoint to create
+ * @flags: extra flags; not used yet, so callers should always pass 0
+ *
+ * Start a point-in-time backup job of the disks of a running domain.
+ * The data is pushed to the destination described by @backupXML, which
+ * must be an NBD server reachable from the hypervisor and exporting one
+ * volume per backed up disk, each at least as large as the disk.
+ *
+ * If @backupXML names an <incremental> checkpoint, only the blocks written
+ * since that checkpoint (see virDomainCheckpointCreateXML()) are copied,
+ * otherwise the whole disk is copied.  When an incremental backup completes
+ * successfully, the checkpoint starts tracking changes anew from the point
+ * in time of the backup.
+ *
+ * If @checkpointXML is not NULL, a new checkpoint is created atomically with
+ * the start of the backup, so that the next backup can be incremental
+ * relative to this one.
+ *
+ * The backup of each disk runs as a block job of type
+ * VIR_DOMAIN_BLOCK_JOB_TYPE_BACKUP, which can be monitored with
+ * virDomainGetBlockJobInfo(), throttled with virDomainBlockJobSetSpeed()
+ * and aborted with virDomainBlockJobAbort().  Completion is reported by the
+ * VIR_DOMAIN_EVENT_ID_BLOCK_JOB_2 event.
+ *
+ * Returns 0 if the backup has started, -1 on failure.
+ */
+int
+virDomainBackupBegin(virDomainPtr dom,
+                     const char *backupXML,
+                     const char *checkpointXML,
+                     unsigned int flags)
+{
+    virConnectPtr conn;
+
+    VIR_DOMAIN_DEBUG(dom, "backupXML=%s, checkpointXML=%s, flags=0x%x",
+                     backupXML, NULLSTR(checkpointXML), flags);
+
+    virResetLastError();
+
+    virCheckDomainReturn(dom, -1);
+    conn = dom->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+    virCheckNonNullArgGoto(backupXML, error);
+
+    if (conn->driver->domainBackupBegin) {
+        int ret;
+        ret = conn->driver->domainBackupBegin(dom, backupXML, checkpointXML,
+                                              flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(dom->conn);
+    return -1;
+}
+
+
 /**
  * virDomainOpenGraphics:
  * @dom: pointer to domain object
@@ -11498,6 +11972,131 @@ virConnectGetDomainCapabilities(virConnectPtr conn,
  *     "perf.emulation_faults" - The count of emulation faults as unsigned
  *                               long long. It is produced by the
  *                               emulation_faults perf event
+ *     "perf.vcpu.<num>.<event>" - The count of perf event <event> of the
+ *                                 thread of vCPU <num> as unsigned long
+ *                                 long. Only reported if the hypervisor is
+ *                                 configured to count events per vCPU.
+ *
+ * VIR_DOMAIN_STATS_PRESSURE:
+ *     Return pressure stall information (PSI) of the domain's cgroup. This
+ *     is only available on hosts using cgroup v2 with PSI support. The
+ *     typed parameter keys are in this format:
+ *
+ *     "pressure.<res>.some.avg10" - share of wall time in which at least some
+ *                                   tasks of the domain were stalled on
+ *                                   resource <res> in the last 10 seconds,
+ *                                   as a percentage in double. <res> is one
+ *                                   of "cpu", "memory" or "io".
+ *     "pressure.<res>.some.avg60" - same as above over 60 seconds as double.
+ *     "pressure.<res>.some.avg300" - same as above over 300 seconds as
+ *                                    double.
+ *     "pressure.<res>.some.total" - total stall time in microseconds as
+ *                                   unsigned long long.
+ *     "pressure.<res>.full.avg10",
+ *     "pressure.<res>.full.avg60",
+ *     "pressure.<res>.full.avg300",
+ *     "pressure.<res>.full.total" - the same values for the time in which
+ *                                   all non-idle tasks of the domain were
+ *                                   stalled. Present only if the host
+ *                                   reports them for <res>.
+ *     "pressure.io.rd.reqs" - number of read requests issued by the domain
+ *                             as unsigned long long.
+ *     "pressure.io.rd.bytes" - number of bytes read by the domain as
+ *                              unsigned long long.
+ *     "pressure.io.wr.reqs" - number of write requests issued by the domain
+ *                             as unsigned long long.
+ *     "pressure.io.wr.bytes" - number of bytes written by the domain as
+ *                              unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_RESCTRL:
+ *     Return the last level cache occupancy and memory bandwidth usage of
+ *     the resctrl monitoring groups of the domain. Each group of vCPUs using
+ *     its own cache allocation is monitored separately, all the other threads
+ *     of the domain are monitored together. The typed parameter keys are in
+ *     this format:
+ *
+ *     "resctrl.monitor.count" - number of monitoring groups as unsigned int.
+ *     "resctrl.monitor.<num>.name" - name of the group as string, "domain"
+ *                                    for the threads not using a cache
+ *                                    allocation of their own.
+ *     "resctrl.monitor.<num>.vcpus" - list of the vCPUs of the group as
+ *                                     string. Missing for the "domain"
+ *                                     group.
+ *     "resctrl.monitor.<num>.bank.count" - number of last level caches the
+ *                                          group is monitored on as unsigned
+ *                                          int.
+ *     "resctrl.monitor.<num>.bank.<index>.id" - host cache id of the bank as
+ *                                               unsigned int.
+ *     "resctrl.monitor.<num>.bank.<index>.llc_occupancy" - bytes of the cache
+ *                                                          occupied by the
+ *                                                          group as unsigned
+ *                                                          long long.
+ *     "resctrl.monitor.<num>.bank.<index>.mbm_total_bytes" - total memory
+ *                                                            bandwidth used
+ *                                                            by the group
+ *                                                            through the
+ *                                                            cache, in bytes
+ *                                                            as unsigned long
+ *                                                            long.
+ *     "resctrl.monitor.<num>.bank.<index>.mbm_local_bytes" - the same for the
+ *                                                            memory of the
+ *                                                            local NUMA node.
+ *     Counters the host doesn't support are left out.
+ *
+ * VIR_DOMAIN_STATS_VCPU_KVM:
+ *     Return scheduling and KVM statistics of the threads of the online
+ *     vCPUs. The KVM counters are read from debugfs and are only available
+ *     if it's mounted and the kernel provides per vCPU counters. The typed
+ *     parameter keys are in this format:
+ *
+ *     "vcpu.<num>.steal" - time in nanoseconds the vCPU was ready to run
+ *                          but waited for a host CPU, which the guest sees
+ *                          as steal time, as unsigned long long.
+ *     "vcpu.<num>.timeslices" - number of timeslices the vCPU ran on a host
+ *                               CPU as unsigned long long.
+ *     "vcpu.<num>.kvm.exits" - number of exits to KVM as unsigned long long.
+ *     "vcpu.<num>.kvm.halt_exits" - number of exits due to the guest
+ *                                   halting the vCPU.
+ *     "vcpu.<num>.kvm.halt_successful_poll" - number of halts which ended
+ *                                             while KVM was polling.
+ *     "vcpu.<num>.kvm.halt_attempted_poll" - number of halts KVM polled.
+ *     "vcpu.<num>.kvm.halt_poll_invalid" - number of halt polls which
+ *                                          were aborted.
+ *     "vcpu.<num>.kvm.halt_wakeup" - number of wakeups of a halted vCPU.
+ *     "vcpu.<num>.kvm.halt_poll_success_ns" - nanoseconds spent in halt
+ *                                             polls which succeeded.
+ *     "vcpu.<num>.kvm.halt_poll_fail_ns" - nanoseconds spent in halt polls
+ *                                          which failed.
+ *     "vcpu.<num>.kvm.irq_exits" - number of exits due to host interrupts.
+ *     "vcpu.<num>.kvm.io_exits" - number of port I/O exits to QEMU.
+ *     "vcpu.<num>.kvm.mmio_exits" - number of MMIO exits to QEMU.
+ *     "vcpu.<num>.kvm.signal_exits" - number of exits due to signals.
+ *     All the KVM counters are unsigned long long.
+ *
+ * VIR_DOMAIN_STATS_JOBS:
+ *     Return cumulative accounting of the jobs which serialize access to the
+ *     domain and of its monitor usage since the domain object was created.
+ *     All times are in milliseconds. The typed parameter keys are in this
+ *     format:
+ *
+ *     "job.wait.count" - number of jobs acquired as unsigned long long.
+ *     "job.wait.time" - total time spent waiting to acquire jobs,
+ *                       including those which timed out, as unsigned
+ *                       long long.
+ *     "job.wait.timeouts" - number of jobs which could not be acquired as
+ *                           unsigned long long.
+ *     "job.count" - number of job types reported below as unsigned int.
+ *     "job.<num>.name" - name of the job type, e.g. "modify", "query",
+ *                        "agent query" or "async migration out", as
+ *                        string.
+ *     "job.<num>.count" - number of finished jobs of this type as unsigned
+ *                         long long.
+ *     "job.<num>.time" - total time jobs of this type were held as unsigned
+ *                        long long.
+ *     "monitor.calls" - number of round trips to the monitor as unsigned
+ *                       long long.
+ *     "monitor.time" - total time the monitor was busy as unsigned long
+ *                      long.
  *
  * Note that entire stats groups or individual stat fields may be missing from
  * the output in case they are not supported by the given hypervisor, are not
@@ -11705,6 +12304,111 @@ virDomainStatsRecordListFree(virDomainStatsRecordPtr *stats)
 }
 
 
+/**
+ * virConnectDomainStatsRegister:
+ * @conn: pointer to the hypervisor connection
+ * @stats: stats to report, binary-OR of virDomainStatsTypes
+ * @interval: sampling interval in milliseconds
+ * @cb: callback invoked with each sample
+ * @opaque: opaque data to pass on to the callback
+ * @freecb: optional function to deallocate opaque when not used anymore
+ * @flags: extra flags; binary-OR of virConnectGetAllDomainStatsFlags
+ *
+ * Subscribes to periodic statistics of all domains on the host. Every
+ * @interval milliseconds the hypervisor gathers the statistics selected
+ * by @stats and @flags, as virConnectGetAllDomainStats() would, and
+ * passes them to @cb. Sampling is done by the hypervisor itself, so
+ * subscribers asking for the same @stats and @flags share the cost of
+ * querying the domains. This function requires that an event loop has
+ * been previously registered with virEventRegisterImpl() or
+ * virEventRegisterDefaultImpl().
+ *
+ * The first invocation of @cb reports every statistic of every domain
+ * matching @flags. Later invocations only report the typed parameters
+ * whose value changed since the previous one; domains without changes
+ * are left out and samples without any change are not delivered at
+ * all. Collection never waits for a domain busy with another job, as
+ * if VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT was given; the stats
+ * needing such a job are reported at a later sample instead.
+ *
+ * The returned callback ID is to be passed to
+ * virConnectDomainStatsDeregister() to end the subscription.
+ *
+ * Returns a callback identifier on success, -1 on failure.
+ */
+int
+virConnectDomainStatsRegister(virConnectPtr conn,
+                              unsigned int stats,
+                              unsigned int interval,
+                              virConnectDomainStatsCallback cb,
+                              void *opaque,
+                              virFreeCallback freecb,
+                              unsigned int flags)
+{
+    VIR_DEBUG("conn=%p, stats=0x%x, interval=%u, cb=%p, opaque=%p, "
+              "freecb=%p, flags=0x%x",
+              conn, stats, interval, cb, opaque, freecb, flags);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(cb, error);
+    virCheckNonZeroArgGoto(interval, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsRegister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsRegister(conn, stats, interval,
+                                                       cb, opaque, freecb,
+                                                       flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
+/**
+ * virConnectDomainStatsDeregister:
+ * @conn: pointer to the hypervisor connection
+ * @callbackID: the callback identifier
+ *
+ * Ends a subscription to domain statistics. The @callbackID parameter
+ * should be the value obtained from a previous
+ * virConnectDomainStatsRegister() call.
+ *
+ * Returns 0 on success, -1 on failure.
+ */
+int
+virConnectDomainStatsDeregister(virConnectPtr conn,
+                                int callbackID)
+{
+    VIR_DEBUG("conn=%p, callbackID=%d", conn, callbackID);
+
+    virResetLastError();
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNegativeArgGoto(callbackID, error);
+
+    if (conn->driver && conn->driver->connectDomainStatsDeregister) {
+        int ret;
+        ret = conn->driver->connectDomainStatsDeregister(conn, callbackID);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virDomainGetFSInfo:
  * @dom: a domain object
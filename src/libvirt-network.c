@@ -557,6 +557,69 @@ virNetworkUpdate(virNetworkPtr network,
 }
 
 
+/**
+ * virNetworkUpdateBatch:
+ * @network: pointer to a defined network
+ * @items: array of updates to perform
+ * @nitems: number of updates in @items
+ * @flags: bitwise OR of virNetworkUpdateFlags.
+ *
+ * Update the definition of an existing network like virNetworkUpdate()
+ * does for each of @items, in order. Either all of them are applied,
+ * or none if one of them fails.
+ *
+ * This is much cheaper than separate virNetworkUpdate() calls when
+ * adding many DHCP hosts or DNS records, because the running network
+ * (its dnsmasq instance, firewall rules, etc.) is only updated once
+ * after all the changes were made.
+ *
+ * Returns 0 in case of success, -1 in case of error
+ */
+int
+virNetworkUpdateBatch(virNetworkPtr network,
+                      virNetworkUpdateItemPtr items,
+                      unsigned int nitems,
+                      unsigned int flags)
+{
+    virConnectPtr conn;
+    size_t i;
+
+    VIR_DEBUG("network=%p, items=%p, nitems=%u, flags=0x%x",
+              network, items, nitems, flags);
+
+    virResetLastError();
+
+    virCheckNetworkReturn(network, -1);
+    conn = network->conn;
+
+    virCheckReadOnlyGoto(conn->flags, error);
+    virCheckNonNullArgGoto(items, error);
+    virCheckNonZeroArgGoto(nitems, error);
+
+    for (i = 0; i < nitems; i++) {
+        VIR_DEBUG("item=%zu, command=%u, section=%u, parentIndex=%d, xml=%s",
+                  i, items[i].command, items[i].section,
+                  items[i].parentIndex, NULLSTR(items[i].xml));
+        virCheckNonNullArgGoto(items[i].xml, error);
+    }
+
+    if (conn->networkDriver && conn->networkDriver->networkUpdateBatch) {
+        int ret;
+        ret = conn->networkDriver->networkUpdateBatch(network, items, nitems,
+                                                      flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(network->conn);
+    return -1;
+}
+
+
 /**
  * virNetworkCreate:
  * @network: pointer to a defined network
@@ -1227,6 +1290,75 @@ virNetworkGetDHCPLeases(virNetworkPtr network,
 }
 
 
+/**
+ * virConnectGetAllDHCPLeases:
+ * @conn: pointer to the hypervisor connection
+ * @nets: NULL terminated array of networks, NULL or empty for all active ones
+ * @macs: NULL terminated array of ASCII formatted MAC addresses, or NULL
+ * @leases: Pointer to a variable to store the array of obtained leases
+ * @flags: Extra flags, not used yet, so callers should always pass 0
+ *
+ * Fetches the leases of guests in all the networks of @nets at once, as
+ * virNetworkGetDHCPLeases() does for a single network. If @macs is given
+ * and not empty, the returned list only contains the leases of the guest interfaces with
+ * one of the MAC addresses in @macs. The network of a lease is identified
+ * by its @iface field, the bridge of the network. Networks the caller is
+ * not allowed to read the leases of are skipped.
+ *
+ * This is much cheaper than a virNetworkGetDHCPLeases() call for every
+ * guest interface, as the leases of each network are only looked up once.
+ *
+ * Returns the number of leases found or -1 and sets @leases to NULL in
+ * case of error. On success, the array stored into @leases is guaranteed to
+ * have an extra allocated element set to NULL but not included in the return
+ * count, to make iteration easier. The caller is responsible for calling
+ * virNetworkDHCPLeaseFree() on each array element, then calling free() on @leases.
+ */
+int
+virConnectGetAllDHCPLeases(virConnectPtr conn,
+                           virNetworkPtr *nets,
+                           const char **macs,
+                           virNetworkDHCPLeasePtr **leases,
+                           unsigned int flags)
+{
+    virNetworkPtr *next;
+
+    VIR_DEBUG("conn=%p, nets=%p, macs=%p, leases=%p, flags=0x%x",
+              conn, nets, macs, leases, flags);
+
+    virResetLastError();
+
+    if (leases)
+        *leases = NULL;
+
+    virCheckConnectReturn(conn, -1);
+    virCheckNonNullArgGoto(leases, error);
+
+    for (next = nets; next && *next; next++) {
+        if ((*next)->conn != conn) {
+            virReportError(VIR_ERR_INVALID_ARG, "%s",
+                           _("networks must be from the same connection"));
+            goto error;
+        }
+    }
+
+    if (conn->networkDriver && conn->networkDriver->connectGetAllDHCPLeases) {
+        int ret;
+        ret = conn->networkDriver->connectGetAllDHCPLeases(conn, nets, macs,
+                                                           leases, flags);
+        if (ret < 0)
+            goto error;
+        return ret;
+    }
+
+    virReportUnsupportedError();
+
+ error:
+    virDispatchError(conn);
+    return -1;
+}
+
+
 /**
  * virNetworkDHCPLeaseFree:
  * @lease: pointer to a leases object
@@ -577,7 +577,7 @@ virStreamSendAll(virStreamPtr stream,
                  void *opaque)
 {
     char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -711,7 +711,7 @@ int virStreamSparseSendAll(virStreamPtr stream,
                            void *opaque)
 {
     char *bytes = NULL;
-    size_t bufLen = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t bufLen = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     int ret = -1;
     unsigned long long dataLen = 0;
 
@@ -853,7 +853,7 @@ virStreamRecvAll(virStreamPtr stream,
                  void *opaque)
 {
     char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     int ret = -1;
     VIR_DEBUG("stream=%p, handler=%p, opaque=%p", stream, handler, opaque);
 
@@ -971,7 +971,7 @@ virStreamSparseRecvAll(virStreamPtr stream,
                        void *opaque)
 {
     char *bytes = NULL;
-    size_t want = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    size_t want = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
     const unsigned int flags = VIR_STREAM_RECV_STOP_AT_HOLE;
     int ret = -1;
 
@@ -123,6 +123,33 @@ typedef enum {
      * Support for driver close callback rpc
      */
     VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK = 15,
+
+    /*
+     * Remote party accepts stream data packets of up to
+     * VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX bytes. By asking for this
+     * feature a client announces that it accepts them too.
+     */
+    VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS = 16,
+
+    /*
+     * Remote party can decompress message payloads flagged with
+     * VIR_NET_MESSAGE_TYPE_COMPRESSED. By asking for this feature a
+     * client announces that it accepts compressed replies.
+     */
+    VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION = 17,
+
+    /*
+     * Support for REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED,
+     * sending domain statistics with a dictionary of field names
+     */
+    VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS = 18,
+
+    /*
+     * Remote party can unpack events sent together in a single
+     * REMOTE_PROC_EVENT_BATCH message. By asking for this feature a
+     * client announces that it accepts them.
+     */
+    VIR_DRV_FEATURE_REMOTE_EVENT_BATCH = 19,
 } virDrvFeature;
 
 
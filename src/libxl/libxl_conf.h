@@ -40,6 +40,8 @@
 # include "virhostdev.h"
 # include "locking/lock_manager.h"
 # include "virfirmware.h"
+# include "virthreadpool.h"
+# include "virhash.h"
 # include "libxl_capabilities.h"
 # include "libxl_logger.h"
 
@@ -61,6 +63,9 @@
 # define LIBXL_CHANNEL_DIR LIBXL_LIB_DIR "/channel/target"
 # define LIBXL_BOOTLOADER_PATH "pygrub"
 
+/* Maximum number of threads handling domain events concurrently */
+# define LIBXL_EVENT_WORKERS_MAX 4
+
 
 typedef struct _libxlDriverPrivate libxlDriverPrivate;
 typedef libxlDriverPrivate *libxlDriverPrivatePtr;
@@ -143,6 +148,14 @@ struct _libxlDriverPrivate {
 
     /* Immutable pointer. lockless access */
     virLockManagerPluginPtr lockManager;
+
+    /* Immutable pointer, self-locking APIs */
+    virThreadPoolPtr eventPool;
+
+    /* Pending events of the domains being handled in eventPool,
+     * keyed by domain ID. Require eventLock */
+    virMutex eventLock;
+    virHashTablePtr eventQueues;
 };
 
 # define LIBXL_SAVE_MAGIC "libvirt-xml\n \0 \r"
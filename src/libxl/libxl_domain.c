@@ -28,6 +28,7 @@
 #include "libxl_domain.h"
 #include "libxl_capabilities.h"
 
+#include "intprops.h"
 #include "viralloc.h"
 #include "viratomic.h"
 #include "virfile.h"
@@ -454,26 +455,27 @@ libxlDomainShutdownHandleRestart(libxlDriverPrivatePtr driver,
 }
 
 
-struct libxlShutdownThreadInfo
-{
+/* Events of one domain waiting to be handled in the event pool */
+typedef struct _libxlDomainEventQueue libxlDomainEventQueue;
+typedef libxlDomainEventQueue *libxlDomainEventQueuePtr;
+struct _libxlDomainEventQueue {
     libxlDriverPrivatePtr driver;
-    libxl_event *event;
+    int domid;
+    libxl_event **events;
+    size_t nevents;
 };
 
 
 static void
-libxlDomainShutdownThread(void *opaque)
+libxlDomainHandleShutdown(libxlDriverPrivatePtr driver,
+                          libxlDriverConfigPtr cfg,
+                          libxl_event *ev)
 {
-    struct libxlShutdownThreadInfo *shutdown_info = opaque;
     virDomainObjPtr vm = NULL;
-    libxl_event *ev = shutdown_info->event;
-    libxlDriverPrivatePtr driver = shutdown_info->driver;
     virObjectEventPtr dom_event = NULL;
     libxl_shutdown_reason xl_reason = ev->u.domain_shutdown.shutdown_reason;
-    libxlDriverConfigPtr cfg;
     libxl_domain_config d_config;
 
-    cfg = libxlDriverConfigGet(driver);
     libxl_domain_config_init(&d_config);
 
     vm = virDomainObjListFindByID(driver->domains, ev->domid);
@@ -604,8 +606,73 @@ libxlDomainShutdownThread(void *opaque)
     virDomainObjEndAPI(&vm);
     virObjectEventStateQueue(driver->domainEventState, dom_event);
     libxl_event_free(cfg->ctx, ev);
-    VIR_FREE(shutdown_info);
     libxl_domain_config_dispose(&d_config);
+}
+
+
+void
+libxlDomainEventQueueFree(void *payload,
+                          const void *name ATTRIBUTE_UNUSED)
+{
+    libxlDomainEventQueuePtr queue = payload;
+    libxlDriverConfigPtr cfg;
+    size_t i;
+
+    if (!queue)
+        return;
+
+    if (queue->nevents) {
+        cfg = libxlDriverConfigGet(queue->driver);
+        for (i = 0; i < queue->nevents; i++)
+            libxl_event_free(cfg->ctx, queue->events[i]);
+        virObjectUnref(cfg);
+    }
+    VIR_FREE(queue->events);
+    VIR_FREE(queue);
+}
+
+
+static void
+libxlDomainEventQueueKey(int domid,
+                         char *key,
+                         size_t keylen)
+{
+    snprintf(key, keylen, "%d", domid);
+}
+
+
+/*
+ * Handle the queued events of one domain in the event pool. Events of
+ * a domain are handled in the order they were received, by a single
+ * worker at a time, while the events of different domains are handled
+ * concurrently.
+ */
+void
+libxlDomainEventWorker(void *jobdata, void *opaque)
+{
+    libxlDomainEventQueuePtr queue = jobdata;
+    libxlDriverPrivatePtr driver = opaque;
+    libxlDriverConfigPtr cfg = libxlDriverConfigGet(driver);
+    char key[INT_BUFSIZE_BOUND(int)];
+    libxl_event *ev;
+
+    libxlDomainEventQueueKey(queue->domid, key, sizeof(key));
+
+    for (;;) {
+        virMutexLock(&driver->eventLock);
+        if (queue->nevents == 0) {
+            /* Frees the queue, later events of the domain start a new one */
+            virHashRemoveEntry(driver->eventQueues, key);
+            virMutexUnlock(&driver->eventLock);
+            break;
+        }
+        ev = queue->events[0];
+        VIR_DELETE_ELEMENT(queue->events, 0, queue->nevents);
+        virMutexUnlock(&driver->eventLock);
+
+        libxlDomainHandleShutdown(driver, cfg, ev);
+    }
+
     virObjectUnref(cfg);
 }
 
@@ -616,8 +683,10 @@ void
 libxlDomainEventHandler(void *data, VIR_LIBXL_EVENT_CONST libxl_event *event)
 {
     libxlDriverPrivatePtr driver = data;
-    struct libxlShutdownThreadInfo *shutdown_info = NULL;
-    virThread thread;
+    libxlDomainEventQueuePtr queue;
+    /* Cast away any const */
+    libxl_event *ev = (libxl_event *)event;
+    char key[INT_BUFSIZE_BOUND(int)];
     libxlDriverConfigPtr cfg;
 
     if (event->type != LIBXL_EVENT_TYPE_DOMAIN_SHUTDOWN) {
@@ -626,34 +695,58 @@ libxlDomainEventHandler(void *data, VIR_LIBXL_EVENT_CONST libxl_event *event)
     }
 
     /*
-     * Start a thread to handle shutdown.  We don't want to be tying up
-     * libxl's event machinery by doing a potentially lengthy shutdown.
+     * Hand the event over to the event pool.  We don't want to be tying
+     * up libxl's event machinery by doing a potentially lengthy shutdown.
+     * If a worker is already handling events of the domain, the event is
+     * appended to its queue so that the events of a domain are handled
+     * in order.
      */
-    if (VIR_ALLOC(shutdown_info) < 0)
-        goto error;
+    libxlDomainEventQueueKey(ev->domid, key, sizeof(key));
 
-    shutdown_info->driver = driver;
-    shutdown_info->event = (libxl_event *)event;
-    if (virThreadCreate(&thread, false, libxlDomainShutdownThread,
-                        shutdown_info) < 0) {
+    virMutexLock(&driver->eventLock);
+    if ((queue = virHashLookup(driver->eventQueues, key))) {
+        if (VIR_APPEND_ELEMENT(queue->events, queue->nevents, ev) < 0)
+            goto error_unlock;
+        virMutexUnlock(&driver->eventLock);
+        return;
+    }
+
+    if (VIR_ALLOC(queue) < 0)
+        goto error_unlock;
+    queue->driver = driver;
+    queue->domid = ev->domid;
+
+    if (virHashAddEntry(driver->eventQueues, key, queue) < 0) {
+        VIR_FREE(queue);
+        goto error_unlock;
+    }
+
+    if (VIR_APPEND_ELEMENT(queue->events, queue->nevents, ev) < 0) {
+        virHashRemoveEntry(driver->eventQueues, key);
+        goto error_unlock;
+    }
+
+    if (virThreadPoolSendJob(driver->eventPool, 0, queue) < 0) {
         /*
-         * Not much we can do on error here except log it.
+         * Not much we can do on error here except log it.  Removing
+         * the queue frees the event as well.
          */
-        VIR_ERROR(_("Failed to create thread to handle domain shutdown"));
-        goto error;
+        VIR_ERROR(_("Failed to queue shutdown of domain %d"), queue->domid);
+        virHashRemoveEntry(driver->eventQueues, key);
     }
+    virMutexUnlock(&driver->eventLock);
 
     /*
-     * libxlShutdownThreadInfo and libxl_event are freed in shutdown thread
+     * The queue and libxl_event are freed in the event pool
      */
     return;
 
+ error_unlock:
+    virMutexUnlock(&driver->eventLock);
  error:
     cfg = libxlDriverConfigGet(driver);
-    /* Cast away any const */
-    libxl_event_free(cfg->ctx, (libxl_event *)event);
+    libxl_event_free(cfg->ctx, ev);
     virObjectUnref(cfg);
-    VIR_FREE(shutdown_info);
 }
 
 char *
@@ -804,7 +897,7 @@ libxlDomainCleanup(libxlDriverPrivatePtr driver,
     VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
     libxlLoggerCloseFile(cfg->logger, vm->def->id);
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (priv->deathW) {
         libxl_evdisable_domain_death(cfg->ctx, priv->deathW);
@@ -1253,7 +1346,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
         VIR_FREE(managed_save_path);
     }
 
-    if (virDomainObjSetDefTransient(cfg->caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(cfg->caps, driver->xmlopt, vm, NULL) < 0)
         goto cleanup;
 
     /* Run an early hook to set-up missing devices */
@@ -1364,7 +1457,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
      * The domain has been successfully created with libxl, so it should
      * be cleaned up if there are any subsequent failures.
      */
-    vm->def->id = domid;
+    virDomainObjListSetID(driver->domains, vm, domid);
     config_json = libxl_domain_config_to_json(cfg->ctx, &d_config);
 
     libxlLoggerOpenFile(cfg->logger, domid, vm->def->name, config_json);
@@ -1436,7 +1529,7 @@ libxlDomainStart(libxlDriverPrivatePtr driver,
  destroy_dom:
     ret = -1;
     libxlDomainDestroyInternal(driver, vm);
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_FAILED);
 
  cleanup_dom:
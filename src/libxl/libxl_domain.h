@@ -131,6 +131,12 @@ void
 libxlDomainEventHandler(void *data,
                         VIR_LIBXL_EVENT_CONST libxl_event *event);
 
+void
+libxlDomainEventWorker(void *jobdata, void *opaque);
+
+void
+libxlDomainEventQueueFree(void *payload, const void *name);
+
 int
 libxlDomainAutoCoreDump(libxlDriverPrivatePtr driver,
                         virDomainObjPtr vm);
@@ -403,7 +403,7 @@ libxlReconnectDomain(virDomainObjPtr vm,
     }
 
     /* Update domid in case it changed (e.g. reboot) while we were gone? */
-    vm->def->id = d_info.domid;
+    virDomainObjListSetID(driver->domains, vm, d_info.domid);
 
     libxlLoggerOpenFile(cfg->logger, vm->def->id, vm->def->name, NULL);
 
@@ -478,6 +478,11 @@ libxlStateCleanup(void)
     if (!libxl_driver)
         return -1;
 
+    /* Stop handling events before freeing what the handlers use */
+    virThreadPoolFree(libxl_driver->eventPool);
+    virHashFree(libxl_driver->eventQueues);
+    virMutexDestroy(&libxl_driver->eventLock);
+
     virObjectUnref(libxl_driver->hostdevMgr);
     virObjectUnref(libxl_driver->config);
     virObjectUnref(libxl_driver->xmlopt);
@@ -658,6 +663,25 @@ libxlStateInitialize(bool privileged,
         return -1;
     }
 
+    if (virMutexInit(&libxl_driver->eventLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "%s", _("cannot initialize mutex"));
+        virMutexDestroy(&libxl_driver->lock);
+        VIR_FREE(libxl_driver);
+        return -1;
+    }
+
+    if (!(libxl_driver->eventQueues = virHashCreate(10,
+                                                    libxlDomainEventQueueFree)))
+        goto error;
+
+    if (!(libxl_driver->eventPool = virThreadPoolNew(0,
+                                                     LIBXL_EVENT_WORKERS_MAX,
+                                                     0,
+                                                     libxlDomainEventWorker,
+                                                     libxl_driver)))
+        goto error;
+
     /* Allocate bitmap for vnc port reservation */
     if (!(libxl_driver->reservedGraphicsPorts =
           virPortAllocatorRangeNew(_("VNC"),
@@ -801,8 +825,8 @@ libxlStateAutoStart(void)
     if (!libxl_driver)
         return;
 
-    virDomainObjListForEach(libxl_driver->domains, libxlAutostartDomain,
-                            libxl_driver);
+    virDomainObjListForEachAutostart(libxl_driver->domains, 1,
+                                     libxlAutostartDomain, libxl_driver);
 }
 
 static int
@@ -823,8 +847,8 @@ libxlStateReload(void)
                                    libxl_driver->xmlopt,
                                    NULL, libxl_driver);
 
-    virDomainObjListForEach(libxl_driver->domains, libxlAutostartDomain,
-                            libxl_driver);
+    virDomainObjListForEachAutostart(libxl_driver->domains, 1,
+                                     libxlAutostartDomain, libxl_driver);
 
     virObjectUnref(cfg);
     return 0;
@@ -1525,7 +1549,7 @@ libxlDomainPMWakeup(virDomainPtr dom, unsigned int flags)
 
  destroy_dom:
     libxlDomainDestroyInternal(driver, vm);
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
     virDomainObjSetState(vm, VIR_DOMAIN_SHUTOFF, VIR_DOMAIN_SHUTOFF_FAILED);
 
  endjob:
@@ -4095,7 +4119,7 @@ libxlDomainAttachDeviceFlags(virDomainPtr dom, const char *xml,
 
         /* Make a copy for updated domain. */
         if (!(vmdef = virDomainObjCopyPersistentDef(vm, cfg->caps,
-                                                    driver->xmlopt)))
+                                                    driver->xmlopt, NULL)))
             goto endjob;
 
         if (libxlDomainAttachDeviceConfig(vmdef, dev) < 0)
@@ -4185,7 +4209,7 @@ libxlDomainDetachDeviceFlags(virDomainPtr dom, const char *xml,
 
         /* Make a copy for updated domain. */
         if (!(vmdef = virDomainObjCopyPersistentDef(vm, cfg->caps,
-                                                    driver->xmlopt)))
+                                                    driver->xmlopt, NULL)))
             goto endjob;
 
         if (libxlDomainDetachDeviceConfig(vmdef, dev) < 0)
@@ -4272,7 +4296,7 @@ libxlDomainUpdateDeviceFlags(virDomainPtr dom, const char *xml,
 
         /* Make a copy for updated domain. */
         if (!(vmdef = virDomainObjCopyPersistentDef(vm, cfg->caps,
-                                                    driver->xmlopt)))
+                                                    driver->xmlopt, NULL)))
             goto cleanup;
 
         if ((ret = libxlDomainUpdateDeviceConfig(vmdef, dev)) < 0)
@@ -5688,6 +5712,364 @@ libxlConnectListAllDomains(virConnectPtr conn,
     return ret;
 }
 
+#define LIBXL_DOMAIN_STATS_SUPPORTED \
+    (VIR_DOMAIN_STATS_STATE | \
+     VIR_DOMAIN_STATS_CPU_TOTAL | \
+     VIR_DOMAIN_STATS_VCPU | \
+     VIR_DOMAIN_STATS_INTERFACE | \
+     VIR_DOMAIN_STATS_BLOCK)
+
+static int
+libxlDomainGetStatsState(virDomainObjPtr vm,
+                         virDomainStatsRecordPtr record,
+                         int *maxparams)
+{
+    if (virTypedParamsAddInt(&record->params, &record->nparams, maxparams,
+                             "state.state", vm->state.state) < 0 ||
+        virTypedParamsAddInt(&record->params, &record->nparams, maxparams,
+                             "state.reason", vm->state.reason) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+libxlDomainGetStatsCPU(libxl_dominfo *d_info,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams)
+{
+    if (!d_info)
+        return 0;
+
+    return virTypedParamsAddULLong(&record->params, &record->nparams,
+                                   maxparams, "cpu.time", d_info->cpu_time);
+}
+
+static int
+libxlDomainGetStatsVcpu(libxlDriverConfigPtr cfg,
+                        virDomainObjPtr vm,
+                        virDomainStatsRecordPtr record,
+                        int *maxparams)
+{
+    libxl_vcpuinfo *vcpuinfo;
+    int maxcpu, hostcpus;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    int ret = -1;
+
+    if (virTypedParamsAddUInt(&record->params, &record->nparams, maxparams,
+                              "vcpu.current",
+                              virDomainDefGetVcpus(vm->def)) < 0 ||
+        virTypedParamsAddUInt(&record->params, &record->nparams, maxparams,
+                              "vcpu.maximum",
+                              virDomainDefGetVcpusMax(vm->def)) < 0)
+        return -1;
+
+    if (!virDomainObjIsActive(vm))
+        return 0;
+
+    if (!(vcpuinfo = libxl_list_vcpu(cfg->ctx, vm->def->id, &maxcpu,
+                                     &hostcpus))) {
+        /* The domain may be going away, leave out its vCPU data */
+        VIR_DEBUG("Failed to list vcpus for domain '%d'", vm->def->id);
+        return 0;
+    }
+
+    for (i = 0; i < maxcpu; i++) {
+        int state = VIR_VCPU_OFFLINE;
+
+        if (vcpuinfo[i].running)
+            state = VIR_VCPU_RUNNING;
+        else if (vcpuinfo[i].blocked)
+            state = VIR_VCPU_BLOCKED;
+
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%u.state", vcpuinfo[i].vcpuid);
+        if (virTypedParamsAddInt(&record->params, &record->nparams,
+                                 maxparams, param_name, state) < 0)
+            goto cleanup;
+
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%u.time", vcpuinfo[i].vcpuid);
+        if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                    maxparams, param_name,
+                                    vcpuinfo[i].vcpu_time) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    libxl_vcpuinfo_list_free(vcpuinfo, maxcpu);
+    return ret;
+}
+
+#define LIBXL_ADD_NAME_PARAM(type, num, name) \
+do { \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "%s.%zu.name", type, num); \
+    if (virTypedParamsAddString(&record->params, &record->nparams, \
+                                maxparams, param_name, name) < 0) \
+        return -1; \
+} while (0)
+
+#define LIBXL_ADD_COUNT_PARAM(type, count) \
+do { \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
+    if (virTypedParamsAddUInt(&record->params, &record->nparams, \
+                              maxparams, param_name, count) < 0) \
+        return -1; \
+} while (0)
+
+#define LIBXL_ADD_LLONG_PARAM(type, num, name, value) \
+do { \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "%s.%zu.%s", type, num, name); \
+    if (virTypedParamsAddLLong(&record->params, &record->nparams, \
+                               maxparams, param_name, value) < 0) \
+        return -1; \
+} while (0)
+
+static int
+libxlDomainGetStatsInterface(virDomainObjPtr vm,
+                             virDomainStatsRecordPtr record,
+                             int *maxparams)
+{
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+
+    if (!virDomainObjIsActive(vm))
+        return 0;
+
+    LIBXL_ADD_COUNT_PARAM("net", vm->def->nnets);
+
+    for (i = 0; i < vm->def->nnets; i++) {
+        virDomainNetDefPtr net = vm->def->nets[i];
+        virDomainInterfaceStatsStruct tmp;
+
+        if (!net->ifname)
+            continue;
+
+        LIBXL_ADD_NAME_PARAM("net", i, net->ifname);
+
+        if (virNetDevTapInterfaceStats(net->ifname, &tmp,
+                                       !virDomainNetTypeSharesHostView(net)) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        LIBXL_ADD_LLONG_PARAM("net", i, "rx.bytes", tmp.rx_bytes);
+        LIBXL_ADD_LLONG_PARAM("net", i, "rx.pkts", tmp.rx_packets);
+        LIBXL_ADD_LLONG_PARAM("net", i, "rx.errs", tmp.rx_errs);
+        LIBXL_ADD_LLONG_PARAM("net", i, "rx.drop", tmp.rx_drop);
+        LIBXL_ADD_LLONG_PARAM("net", i, "tx.bytes", tmp.tx_bytes);
+        LIBXL_ADD_LLONG_PARAM("net", i, "tx.pkts", tmp.tx_packets);
+        LIBXL_ADD_LLONG_PARAM("net", i, "tx.errs", tmp.tx_errs);
+        LIBXL_ADD_LLONG_PARAM("net", i, "tx.drop", tmp.tx_drop);
+    }
+
+    return 0;
+}
+
+static int
+libxlDomainGetStatsBlock(virDomainObjPtr vm,
+                         virDomainStatsRecordPtr record,
+                         int *maxparams)
+{
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+
+    LIBXL_ADD_COUNT_PARAM("block", vm->def->ndisks);
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        libxlBlockStats blkstats;
+        int rc;
+
+        LIBXL_ADD_NAME_PARAM("block", i, disk->dst);
+
+        if (!virDomainObjIsActive(vm))
+            continue;
+
+        memset(&blkstats, 0, sizeof(blkstats));
+        rc = libxlDomainBlockStatsGatherSingle(vm, disk->dst, &blkstats);
+        VIR_FREE(blkstats.backend);
+        if (rc < 0) {
+            /* Not every disk driver provides statistics */
+            virResetLastError();
+            continue;
+        }
+
+        LIBXL_ADD_LLONG_PARAM("block", i, "rd.reqs", blkstats.rd_req);
+        LIBXL_ADD_LLONG_PARAM("block", i, "rd.bytes", blkstats.rd_bytes);
+        LIBXL_ADD_LLONG_PARAM("block", i, "wr.reqs", blkstats.wr_req);
+        LIBXL_ADD_LLONG_PARAM("block", i, "wr.bytes", blkstats.wr_bytes);
+        LIBXL_ADD_LLONG_PARAM("block", i, "fl.reqs", blkstats.f_req);
+    }
+
+    return 0;
+}
+
+#undef LIBXL_ADD_LLONG_PARAM
+#undef LIBXL_ADD_COUNT_PARAM
+#undef LIBXL_ADD_NAME_PARAM
+
+static int
+libxlDomainGetStatsOne(virConnectPtr conn,
+                       libxlDriverConfigPtr cfg,
+                       virDomainObjPtr vm,
+                       libxl_dominfo *d_info,
+                       unsigned int stats,
+                       virDomainStatsRecordPtr *record)
+{
+    virDomainStatsRecordPtr tmp;
+    int maxparams = 0;
+    int ret = -1;
+
+    if (VIR_ALLOC(tmp) < 0)
+        return -1;
+
+    if ((stats & VIR_DOMAIN_STATS_STATE) &&
+        libxlDomainGetStatsState(vm, tmp, &maxparams) < 0)
+        goto cleanup;
+
+    if ((stats & VIR_DOMAIN_STATS_CPU_TOTAL) &&
+        libxlDomainGetStatsCPU(d_info, tmp, &maxparams) < 0)
+        goto cleanup;
+
+    if ((stats & VIR_DOMAIN_STATS_VCPU) &&
+        libxlDomainGetStatsVcpu(cfg, vm, tmp, &maxparams) < 0)
+        goto cleanup;
+
+    if ((stats & VIR_DOMAIN_STATS_INTERFACE) &&
+        libxlDomainGetStatsInterface(vm, tmp, &maxparams) < 0)
+        goto cleanup;
+
+    if ((stats & VIR_DOMAIN_STATS_BLOCK) &&
+        libxlDomainGetStatsBlock(vm, tmp, &maxparams) < 0)
+        goto cleanup;
+
+    if (!(tmp->dom = virGetDomain(conn, vm->def->name,
+                                  vm->def->uuid, vm->def->id)))
+        goto cleanup;
+
+    VIR_STEAL_PTR(*record, tmp);
+    ret = 0;
+
+ cleanup:
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+    return ret;
+}
+
+static int
+libxlConnectGetAllDomainStats(virConnectPtr conn,
+                              virDomainPtr *doms,
+                              unsigned int ndoms,
+                              unsigned int stats,
+                              virDomainStatsRecordPtr **retStats,
+                              unsigned int flags)
+{
+    libxlDriverPrivatePtr driver = conn->privateData;
+    libxlDriverConfigPtr cfg = NULL;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    libxl_dominfo *info = NULL;
+    int ninfo = 0;
+    bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    int nstats = 0;
+    size_t i;
+    int j;
+    int ret = -1;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
+
+    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
+        return -1;
+
+    if (!stats) {
+        stats = LIBXL_DOMAIN_STATS_SUPPORTED;
+    } else if (enforce && (stats & ~LIBXL_DOMAIN_STATS_SUPPORTED)) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon"),
+                       stats & ~LIBXL_DOMAIN_STATS_SUPPORTED);
+        return -1;
+    }
+    stats &= LIBXL_DOMAIN_STATS_SUPPORTED;
+
+    if (ndoms) {
+        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
+                                    &nvms, virConnectGetAllDomainStatsCheckACL,
+                                    lflags, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
+                                    virConnectGetAllDomainStatsCheckACL,
+                                    lflags) < 0)
+            return -1;
+    }
+
+    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
+        goto cleanup;
+
+    cfg = libxlDriverConfigGet(driver);
+
+    /* A single query provides the CPU time of all the domains */
+    if ((stats & VIR_DOMAIN_STATS_CPU_TOTAL) &&
+        !(info = libxl_list_domain(cfg->ctx, &ninfo))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("libxl_list_domain failed"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nvms; i++) {
+        virDomainObjPtr vm = vms[i];
+        libxl_dominfo *d_info = NULL;
+        virDomainStatsRecordPtr tmp = NULL;
+        int rc;
+
+        virObjectLock(vm);
+
+        if (virDomainObjIsActive(vm)) {
+            for (j = 0; j < ninfo; j++) {
+                if (info[j].domid == vm->def->id) {
+                    d_info = &info[j];
+                    break;
+                }
+            }
+        }
+
+        rc = libxlDomainGetStatsOne(conn, cfg, vm, d_info, stats, &tmp);
+        virObjectUnlock(vm);
+
+        if (rc < 0)
+            goto cleanup;
+
+        if (tmp)
+            tmpstats[nstats++] = tmp;
+    }
+
+    VIR_STEAL_PTR(*retStats, tmpstats);
+    ret = nstats;
+
+ cleanup:
+    if (info)
+        libxl_dominfo_list_free(info, ninfo);
+    virObjectUnref(cfg);
+    virDomainStatsRecordListFree(tmpstats);
+    virObjectListFreeCount(vms, nvms);
+    return ret;
+}
+
 /* Which features are supported by this driver? */
 static int
 libxlConnectSupportsFeature(virConnectPtr conn, int feature)
@@ -5711,6 +6093,10 @@ libxlConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
+    case VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
         return 0;
@@ -6599,6 +6985,7 @@ static virHypervisorDriver libxlHypervisorDriver = {
     .connectGetDomainCapabilities = libxlConnectGetDomainCapabilities, /* 2.0.0 */
     .connectCompareCPU = libxlConnectCompareCPU, /* 2.3.0 */
     .connectBaselineCPU = libxlConnectBaselineCPU, /* 2.3.0 */
+    .connectGetAllDomainStats = libxlConnectGetAllDomainStats, /* 5.0.0 */
 };
 
 static virConnectDriver libxlConnectDriver = {
@@ -40,6 +40,33 @@ VIR_LOG_INIT("locking.lock_daemon_dispatch");
 #define DEFAULT_OFFSET 0
 #define METADATA_OFFSET 1
 
+static int
+virLockDaemonAcquireResource(virLockSpacePtr lockspace,
+                             const char *name,
+                             pid_t owner,
+                             unsigned int flags)
+{
+    unsigned int newFlags;
+    off_t start = DEFAULT_OFFSET;
+    off_t len = 1;
+
+    virCheckFlags(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
+                  VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE |
+                  VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_METADATA, -1);
+
+    newFlags = 0;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
+        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
+    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_METADATA)
+        start = METADATA_OFFSET;
+
+    return virLockSpaceAcquireResource(lockspace, name, owner,
+                                       start, len, newFlags);
+}
+
+
 static int
 virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNUSED,
                                             virNetServerClientPtr client,
@@ -48,20 +75,12 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNU
                                             virLockSpaceProtocolAcquireResourceArgs *args)
 {
     int rv = -1;
-    unsigned int flags = args->flags;
     virLockDaemonClientPtr priv =
         virNetServerClientGetPrivateData(client);
     virLockSpacePtr lockspace;
-    unsigned int newFlags;
-    off_t start = DEFAULT_OFFSET;
-    off_t len = 1;
 
     virMutexLock(&priv->lock);
 
-    virCheckFlagsGoto(VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED |
-                      VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE |
-                      VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_METADATA, cleanup);
-
     if (priv->restricted) {
         virReportError(VIR_ERR_OPERATION_DENIED, "%s",
                        _("lock manager connection has been restricted"));
@@ -81,19 +100,10 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNU
         goto cleanup;
     }
 
-    newFlags = 0;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_SHARED)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_SHARED;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_AUTOCREATE)
-        newFlags |= VIR_LOCK_SPACE_ACQUIRE_AUTOCREATE;
-    if (flags & VIR_LOCK_SPACE_PROTOCOL_ACQUIRE_RESOURCE_METADATA)
-        start = METADATA_OFFSET;
-
-    if (virLockSpaceAcquireResource(lockspace,
-                                    args->name,
-                                    priv->ownerPid,
-                                    start, len,
-                                    newFlags) < 0)
+    if (virLockDaemonAcquireResource(lockspace,
+                                     args->name,
+                                     priv->ownerPid,
+                                     args->flags) < 0)
         goto cleanup;
 
     rv = 0;
@@ -106,6 +116,88 @@ virLockSpaceProtocolDispatchAcquireResource(virNetServerPtr server ATTRIBUTE_UNU
 }
 
 
+static int
+virLockSpaceProtocolDispatchAcquireResources(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             virLockSpaceProtocolAcquireResourcesArgs *args)
+{
+    int rv = -1;
+    unsigned int flags = args->flags;
+    virLockDaemonClientPtr priv =
+        virNetServerClientGetPrivateData(client);
+    virLockSpaceProtocolResource *resources = args->resources.resources_val;
+    size_t nresources = args->resources.resources_len;
+    virLockSpacePtr *lockspaces = NULL;
+    ssize_t lastGood = -1;
+    ssize_t i;
+
+    virMutexLock(&priv->lock);
+
+    virCheckFlagsGoto(0, cleanup);
+
+    if (priv->restricted) {
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("lock manager connection has been restricted"));
+        goto cleanup;
+    }
+
+    if (!priv->ownerId) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("lock owner details have not been registered"));
+        goto cleanup;
+    }
+
+    if (nresources && VIR_ALLOC_N(lockspaces, nresources) < 0)
+        goto cleanup;
+
+    /* Resolve all lockspaces first, so that a bogus path is
+     * reported before any lock is taken */
+    for (i = 0; i < nresources; i++) {
+        if (!(lockspaces[i] = virLockDaemonFindLockSpace(lockDaemon,
+                                                         resources[i].path))) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Lockspace for path %s does not exist"),
+                           resources[i].path);
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < nresources; i++) {
+        if (virLockDaemonAcquireResource(lockspaces[i],
+                                         resources[i].name,
+                                         priv->ownerPid,
+                                         resources[i].flags) < 0)
+            goto cleanup;
+        lastGood = i;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0) {
+        virErrorPtr origerr;
+
+        /* The caller gets either all of the locks or none */
+        virErrorPreserveLast(&origerr);
+        for (i = lastGood; i >= 0; i--) {
+            if (virLockSpaceReleaseResource(lockspaces[i],
+                                            resources[i].name,
+                                            priv->ownerPid) < 0)
+                VIR_WARN("Unable to release resource lockspace=%s name=%s",
+                         resources[i].path, resources[i].name);
+        }
+        virErrorRestore(&origerr);
+
+        virNetMessageSaveError(rerr);
+    }
+    VIR_FREE(lockspaces);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+
 static int
 virLockSpaceProtocolDispatchCreateResource(virNetServerPtr server ATTRIBUTE_UNUSED,
                                            virNetServerClientPtr client,
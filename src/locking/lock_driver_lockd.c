@@ -83,6 +83,10 @@ struct _virLockManagerLockDaemonDriver {
     bool autoDiskLease;
     bool requireLeaseForDisks;
 
+    /* Set once virtlockd turned out not to know
+     * VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES */
+    bool noAcquireResources;
+
     char *fileLockSpaceDir;
     char *lvmLockSpaceDir;
     char *scsiLockSpaceDir;
@@ -765,6 +769,44 @@ static int virLockManagerLockDaemonReleaseImpl(virNetClientPtr client,
 }
 
 
+/*
+ * Acquire all resources in a single round trip. virtlockd either
+ * grants all of them, or none.
+ */
+static int virLockManagerLockDaemonAcquireAllImpl(virNetClientPtr client,
+                                                  virNetClientProgramPtr program,
+                                                  int counter,
+                                                  virLockManagerLockDaemonPrivatePtr priv)
+{
+    virLockSpaceProtocolAcquireResourcesArgs args;
+    size_t i;
+    int rv;
+
+    memset(&args, 0, sizeof(args));
+
+    if (VIR_ALLOC_N(args.resources.resources_val, priv->nresources) < 0)
+        return -1;
+    args.resources.resources_len = priv->nresources;
+
+    for (i = 0; i < priv->nresources; i++) {
+        args.resources.resources_val[i].path = priv->resources[i].lockspace;
+        args.resources.resources_val[i].name = priv->resources[i].name;
+        args.resources.resources_val[i].flags = priv->resources[i].flags;
+    }
+
+    rv = virNetClientProgramCall(program,
+                                 client,
+                                 counter,
+                                 VIR_LOCK_SPACE_PROTOCOL_PROC_ACQUIRE_RESOURCES,
+                                 0, NULL, NULL, NULL,
+                                 (xdrproc_t)xdr_virLockSpaceProtocolAcquireResourcesArgs, &args,
+                                 (xdrproc_t)xdr_void, NULL);
+
+    VIR_FREE(args.resources.resources_val);
+    return rv;
+}
+
+
 static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
                                            const char *state ATTRIBUTE_UNUSED,
                                            unsigned int flags,
@@ -799,7 +841,26 @@ static int virLockManagerLockDaemonAcquire(virLockManagerPtr lock,
         (*fd = virNetClientDupFD(client, false)) < 0)
         goto cleanup;
 
-    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY)) {
+    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY) &&
+        !driver->noAcquireResources &&
+        priv->nresources > 1 &&
+        priv->nresources <= VIR_LOCK_SPACE_PROTOCOL_RESOURCES_MAX) {
+        if (virLockManagerLockDaemonAcquireAllImpl(client, program,
+                                                   counter++, priv) == 0) {
+            lastGood = priv->nresources - 1;
+        } else if (virGetLastErrorCode() == VIR_ERR_RPC) {
+            /* Most likely an older virtlockd which doesn't know the
+             * procedure; it didn't take any of the locks either way */
+            VIR_DEBUG("Falling back to acquiring resources one by one");
+            driver->noAcquireResources = true;
+            virResetLastError();
+        } else {
+            goto cleanup;
+        }
+    }
+
+    if (!(flags & VIR_LOCK_MANAGER_ACQUIRE_REGISTER_ONLY) &&
+        lastGood < 0) {
         for (i = 0; i < priv->nresources; i++) {
             virLockSpaceProtocolAcquireResourceArgs args;
 
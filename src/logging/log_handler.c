@@ -43,6 +43,14 @@ VIR_LOG_INIT("logging.log_handler");
 
 #define DEFAULT_MODE 0600
 
+/* Amount of data to move out of a pipe in one go, matching the
+ * default pipe capacity on Linux */
+#define VIR_LOG_HANDLER_CHUNK (64 * 1024)
+
+/* Upper bound on data drained from a single pipe per wakeup, so that
+ * one chatty guest doesn't starve the others */
+#define VIR_LOG_HANDLER_DRAIN_MAX (16 * VIR_LOG_HANDLER_CHUNK)
+
 typedef struct _virLogHandlerLogFile virLogHandlerLogFile;
 typedef virLogHandlerLogFile *virLogHandlerLogFilePtr;
 
@@ -142,8 +150,8 @@ virLogHandlerDomainLogFileEvent(int watch,
 {
     virLogHandlerPtr handler = opaque;
     virLogHandlerLogFilePtr logfile;
-    char buf[1024];
     ssize_t len;
+    size_t total = 0;
 
     virObjectLock(handler);
     logfile = virLogHandlerGetLogFileFromWatch(handler, watch);
@@ -153,19 +161,15 @@ virLogHandlerDomainLogFileEvent(int watch,
         return;
     }
 
- reread:
-    len = read(fd, buf, sizeof(buf));
-    if (len < 0) {
-        if (errno == EINTR)
-            goto reread;
-
-        virReportSystemError(errno, "%s",
-                             _("Unable to read from log pipe"));
-        goto error;
-    }
-
-    if (virRotatingFileWriterAppend(logfile->file, buf, len) != len)
-        goto error;
+    /* Coalesce whatever has accumulated in the pipe since the last
+     * wakeup, stopping as soon as a short transfer shows it's drained */
+    do {
+        if ((len = virRotatingFileWriterAppendFD(logfile->file, fd,
+                                                 VIR_LOG_HANDLER_CHUNK)) < 0)
+            goto error;
+        total += len;
+    } while (len == VIR_LOG_HANDLER_CHUNK &&
+             total < VIR_LOG_HANDLER_DRAIN_MAX);
 
     if (events & VIR_EVENT_HANDLE_HANGUP)
         goto error;
@@ -272,6 +276,12 @@ virLogHandlerLogFilePostExecRestart(virLogHandlerPtr handler,
                              _("Cannot enable close-on-exec flag"));
         goto error;
     }
+    /* Older daemons handed over blocking pipes */
+    if (virSetNonBlock(file->pipefd) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode on log pipe"));
+        goto error;
+    }
 
     return file;
 
@@ -389,6 +399,11 @@ virLogHandlerDomainOpenLogFile(virLogHandlerPtr handler,
                              _("Cannot open fifo pipe"));
         goto error;
     }
+    if (virSetNonBlock(pipefd[0]) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Cannot enable non-blocking mode on log pipe"));
+        goto error;
+    }
     if (VIR_ALLOC(file) < 0)
         goto error;
 
@@ -260,6 +260,29 @@ int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo)
 }
 
 
+int virLXCCgroupGetCpuset(virBitmapPtr *cpus)
+{
+    int ret = -1;
+    virCgroupPtr cgroup;
+    char *str = NULL;
+
+    if (virCgroupNewSelf(&cgroup) < 0)
+        return -1;
+
+    if (virCgroupGetCpusetCpus(cgroup, &str) < 0)
+        goto cleanup;
+
+    if (virBitmapParse(str, cpus, VIR_DOMAIN_CPUMASK_LEN) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(str);
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 
 typedef struct _virLXCCgroupDevicePolicy virLXCCgroupDevicePolicy;
 typedef virLXCCgroupDevicePolicy *virLXCCgroupDevicePolicyPtr;
@@ -37,6 +37,7 @@ int virLXCCgroupSetup(virDomainDefPtr def,
                       virBitmapPtr nodemask);
 
 int virLXCCgroupGetMeminfo(virLXCMeminfoPtr meminfo);
+int virLXCCgroupGetCpuset(virBitmapPtr *cpus);
 
 int
 virLXCSetupHostUSBDeviceCgroup(virUSBDevicePtr dev,
@@ -56,6 +56,7 @@
 #include "virerror.h"
 #include "virlog.h"
 #include "lxc_container.h"
+#include "lxc_fuse.h"
 #include "viralloc.h"
 #include "virnetdevveth.h"
 #include "viruuid.h"
@@ -658,6 +659,71 @@ static int lxcContainerResolveSymlinks(virDomainFSDefPtr fs, bool gentle)
     return 0;
 }
 
+/* Stacks a private writable layer, kept in the state directory, over
+ * the root directory from the configuration which then stays untouched
+ * and can be shared by many containers. */
+static int lxcContainerPrepareRootOverlay(virDomainDefPtr def,
+                                          virDomainFSDefPtr root)
+{
+    int ret = -1;
+    char *base = NULL;
+    char *upper = NULL;
+    char *work = NULL;
+    char *dst = NULL;
+    char *opts = NULL;
+
+    if (STREQ(root->src->path, "/") ||
+        strpbrk(root->src->path, ",:")) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Cannot use '%s' as the lower layer of an overlay"),
+                       root->src->path);
+        return -1;
+    }
+
+    if (virAsprintf(&base, "%s/%s.overlay", LXC_STATE_DIR, def->name) < 0 ||
+        virAsprintf(&upper, "%s/upper", base) < 0 ||
+        virAsprintf(&work, "%s/work", base) < 0 ||
+        virAsprintf(&dst, "%s/%s.root", LXC_STATE_DIR, def->name) < 0 ||
+        virAsprintf(&opts, "lowerdir=%s,upperdir=%s,workdir=%s",
+                    root->src->path, upper, work) < 0)
+        goto cleanup;
+
+    /* Never resume from the layer of an earlier run */
+    if (virFileDeleteTree(base) < 0)
+        goto cleanup;
+
+    if (virFileMakePath(upper) < 0 ||
+        virFileMakePath(work) < 0 ||
+        virFileMakePath(dst) < 0) {
+        virReportSystemError(errno,
+                             _("Failed to create overlay directories for %s"),
+                             root->src->path);
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Mount overlay of %s on %s", root->src->path, dst);
+
+    if (mount("overlay", dst, "overlay", 0, opts) < 0) {
+        virReportSystemError(errno,
+                             _("Failed to mount overlay of %s on %s"),
+                             root->src->path, dst);
+        goto cleanup;
+    }
+
+    VIR_FREE(root->src->path);
+    VIR_STEAL_PTR(root->src->path, dst);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(base);
+    VIR_FREE(upper);
+    VIR_FREE(work);
+    VIR_FREE(dst);
+    VIR_FREE(opts);
+    return ret;
+}
+
 static int lxcContainerPrepareRoot(virDomainDefPtr def,
                                    virDomainFSDefPtr root,
                                    const char *sec_mount_options)
@@ -667,6 +733,10 @@ static int lxcContainerPrepareRoot(virDomainDefPtr def,
 
     VIR_DEBUG("Prepare root %d", root->type);
 
+    if (root->type == VIR_DOMAIN_FS_TYPE_MOUNT &&
+        root->fsdriver == VIR_DOMAIN_FS_DRIVER_TYPE_OVERLAY)
+        return lxcContainerPrepareRootOverlay(def, root);
+
     if (root->type == VIR_DOMAIN_FS_TYPE_MOUNT)
         return 0;
 
@@ -1017,25 +1087,36 @@ static int lxcContainerMountBasicFS(bool userns_enabled,
 static int lxcContainerMountProcFuse(virDomainDefPtr def,
                                      const char *stateDir)
 {
-    int ret;
-    char *meminfo_path = NULL;
+    int ret = 0;
+    char *fuse_path = NULL;
+    char *proc_path = NULL;
+    size_t i;
 
-    VIR_DEBUG("Mount /proc/meminfo stateDir=%s", stateDir);
+    for (i = 0; lxcFuseProcFiles[i] && ret == 0; i++) {
+        VIR_DEBUG("Mount /proc/%s stateDir=%s", lxcFuseProcFiles[i], stateDir);
 
-    if ((ret = virAsprintf(&meminfo_path,
-                           "/.oldroot/%s/%s.fuse/meminfo",
-                           stateDir,
-                           def->name)) < 0)
-        return ret;
+        if ((ret = virAsprintf(&fuse_path,
+                               "/.oldroot/%s/%s.fuse/%s",
+                               stateDir,
+                               def->name,
+                               lxcFuseProcFiles[i])) < 0 ||
+            (ret = virAsprintf(&proc_path, "/proc/%s",
+                               lxcFuseProcFiles[i])) < 0)
+            break;
 
-    if ((ret = mount(meminfo_path, "/proc/meminfo",
-                     NULL, MS_BIND, NULL)) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to mount %s on /proc/meminfo"),
-                             meminfo_path);
+        if ((ret = mount(fuse_path, proc_path,
+                         NULL, MS_BIND, NULL)) < 0) {
+            virReportSystemError(errno,
+                                 _("Failed to mount %s on %s"),
+                                 fuse_path, proc_path);
+        }
+
+        VIR_FREE(fuse_path);
+        VIR_FREE(proc_path);
     }
 
-    VIR_FREE(meminfo_path);
+    VIR_FREE(fuse_path);
+    VIR_FREE(proc_path);
     return ret;
 }
 #else
@@ -1567,6 +1648,12 @@ static int lxcContainerMountFSTmpfs(virDomainFSDefPtr fs,
 static int lxcContainerMountFS(virDomainFSDefPtr fs,
                                char *sec_mount_options)
 {
+    if (fs->fsdriver == VIR_DOMAIN_FS_DRIVER_TYPE_OVERLAY) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("The overlay driver is only supported for the root filesystem"));
+        return -1;
+    }
+
     switch (fs->type) {
     case VIR_DOMAIN_FS_TYPE_MOUNT:
         if (lxcContainerMountFSBind(fs, "/.oldroot") < 0)
@@ -33,12 +33,22 @@
 #include "virfile.h"
 #include "virbuffer.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_LXC
 
 #if WITH_FUSE
 
-static const char *fuse_meminfo_path = "/meminfo";
+/* How long the cgroup values are reused, in milliseconds */
+# define LXC_FUSE_CACHE_TTL 1000
+
+const char *const lxcFuseProcFiles[] = { "meminfo", "cpuinfo", "stat", NULL };
+
+static bool lxcProcIsEmulated(const char *path)
+{
+    return path[0] == '/' &&
+        virStringListHasString((const char **)lxcFuseProcFiles, path + 1);
+}
 
 static int lxcProcGetattr(const char *path, struct stat *stbuf)
 {
@@ -46,7 +56,8 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     char *mempath = NULL;
     struct stat sb;
     struct fuse_context *context = fuse_get_context();
-    virDomainDefPtr def = (virDomainDefPtr)context->private_data;
+    virLXCFusePtr fuse = context->private_data;
+    virDomainDefPtr def = fuse->def;
 
     memset(stbuf, 0, sizeof(struct stat));
     if (virAsprintf(&mempath, "/proc/%s", path) < 0)
@@ -57,7 +68,7 @@ static int lxcProcGetattr(const char *path, struct stat *stbuf)
     if (STREQ(path, "/")) {
         stbuf->st_mode = S_IFDIR | 0755;
         stbuf->st_nlink = 2;
-    } else if (STREQ(path, fuse_meminfo_path)) {
+    } else if (lxcProcIsEmulated(path)) {
         if (stat(mempath, &sb) < 0) {
             res = -errno;
             goto cleanup;
@@ -87,12 +98,15 @@ static int lxcProcReaddir(const char *path, void *buf,
                           off_t offset ATTRIBUTE_UNUSED,
                           struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
+    size_t i;
+
     if (STRNEQ(path, "/"))
         return -ENOENT;
 
     filler(buf, ".", NULL, 0);
     filler(buf, "..", NULL, 0);
-    filler(buf, fuse_meminfo_path + 1, NULL, 0);
+    for (i = 0; lxcFuseProcFiles[i]; i++)
+        filler(buf, lxcFuseProcFiles[i], NULL, 0);
 
     return 0;
 }
@@ -100,7 +114,7 @@ static int lxcProcReaddir(const char *path, void *buf,
 static int lxcProcOpen(const char *path ATTRIBUTE_UNUSED,
                        struct fuse_file_info *fi ATTRIBUTE_UNUSED)
 {
-    if (STRNEQ(path, fuse_meminfo_path))
+    if (!lxcProcIsEmulated(path))
         return -ENOENT;
 
     if ((fi->flags & 3) != O_RDONLY)
@@ -125,7 +139,80 @@ static int lxcProcHostRead(char *path, char *buf, size_t size, off_t offset)
     return res;
 }
 
-static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
+static int lxcProcCopyBuffer(virBufferPtr buffer,
+                             char *buf, size_t size, off_t offset)
+{
+    size_t len;
+
+    if (virBufferCheckError(buffer) < 0)
+        return -errno;
+
+    len = virBufferUse(buffer);
+    if (offset >= len)
+        return 0;
+
+    len -= offset;
+    if (len > size)
+        len = size;
+    memcpy(buf, virBufferCurrentContent(buffer) + offset, len);
+
+    return len;
+}
+
+/* The cgroup values are cached for LXC_FUSE_CACHE_TTL so that agents
+ * polling the files don't make every read walk the cgroup files. */
+static int lxcProcGetMeminfo(virLXCFusePtr fuse, virLXCMeminfoPtr meminfo)
+{
+    int ret = -1;
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    virMutexLock(&fuse->lock);
+
+    if (now >= fuse->meminfoExpires) {
+        fuse->meminfoExpires = 0;
+        if (virLXCCgroupGetMeminfo(&fuse->meminfo) < 0)
+            goto cleanup;
+        fuse->meminfoExpires = now + LXC_FUSE_CACHE_TTL;
+    }
+
+    *meminfo = fuse->meminfo;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&fuse->lock);
+    return ret;
+}
+
+static virBitmapPtr lxcProcGetCpuset(virLXCFusePtr fuse)
+{
+    virBitmapPtr cpus = NULL;
+    unsigned long long now;
+
+    if (virTimeMillisNow(&now) < 0)
+        return NULL;
+
+    virMutexLock(&fuse->lock);
+
+    if (now >= fuse->cpusExpires) {
+        virBitmapFree(fuse->cpus);
+        fuse->cpus = NULL;
+        fuse->cpusExpires = 0;
+        if (virLXCCgroupGetCpuset(&fuse->cpus) < 0)
+            goto cleanup;
+        fuse->cpusExpires = now + LXC_FUSE_CACHE_TTL;
+    }
+
+    cpus = virBitmapNewCopy(fuse->cpus);
+
+ cleanup:
+    virMutexUnlock(&fuse->lock);
+    return cpus;
+}
+
+static int lxcProcReadMeminfo(char *hostpath, virLXCFusePtr fuse,
                               char *buf, size_t size, off_t offset)
 {
     int res;
@@ -133,10 +220,11 @@ static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
     char *line = NULL;
     size_t n;
     struct virLXCMeminfo meminfo;
+    virDomainDefPtr def = fuse->def;
     virBuffer buffer = VIR_BUFFER_INITIALIZER;
     virBufferPtr new_meminfo = &buffer;
 
-    if (virLXCCgroupGetMeminfo(&meminfo) < 0) {
+    if (lxcProcGetMeminfo(fuse, &meminfo) < 0) {
         virErrorSetErrnoFromLastError();
         return -errno;
     }
@@ -242,6 +330,140 @@ static int lxcProcReadMeminfo(char *hostpath, virDomainDefPtr def,
     return res;
 }
 
+/* Only the processors the container may run on are listed, renumbered
+ * from zero like the CPUs of a virtual machine would be. */
+static int lxcProcReadCpuinfo(char *hostpath, virLXCFusePtr fuse,
+                              char *buf, size_t size, off_t offset)
+{
+    int res;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    virBitmapPtr cpus;
+    virBuffer buffer = VIR_BUFFER_INITIALIZER;
+    size_t ncpus = 0;
+    bool keep = true;
+
+    if (!(cpus = lxcProcGetCpuset(fuse))) {
+        virErrorSetErrnoFromLastError();
+        return -errno;
+    }
+
+    fd = fopen(hostpath, "r");
+    if (fd == NULL) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        res = -errno;
+        goto cleanup;
+    }
+
+    /* The description of a processor starts with its number and ends
+     * with an empty line */
+    while (getline(&line, &n, fd) > 0) {
+        char *ptr = strchr(line, ':');
+        unsigned int cpu;
+
+        if (ptr && STRPREFIX(line, "processor") &&
+            virStrToLong_ui(ptr + 1, &ptr, 10, &cpu) == 0) {
+            if ((keep = virBitmapIsBitSet(cpus, cpu)))
+                virBufferAsprintf(&buffer, "processor\t: %zu\n", ncpus++);
+            continue;
+        }
+
+        if (keep)
+            virBufferAdd(&buffer, line, -1);
+
+        if (line[0] == '\n')
+            keep = true;
+    }
+
+    res = lxcProcCopyBuffer(&buffer, buf, size, offset);
+
+ cleanup:
+    VIR_FREE(line);
+    virBufferFreeAndReset(&buffer);
+    VIR_FORCE_FCLOSE(fd);
+    virBitmapFree(cpus);
+    return res;
+}
+
+/* Same as for cpuinfo, the summary line is recomputed from the times of
+ * the processors left. */
+static int lxcProcReadStat(char *hostpath, virLXCFusePtr fuse,
+                           char *buf, size_t size, off_t offset)
+{
+    int res;
+    FILE *fd = NULL;
+    char *line = NULL;
+    size_t n;
+    size_t i;
+    virBitmapPtr cpus;
+    virBuffer buffer = VIR_BUFFER_INITIALIZER;
+    virBuffer cpulines = VIR_BUFFER_INITIALIZER;
+    virBuffer rest = VIR_BUFFER_INITIALIZER;
+    unsigned long long total[10] = { 0 };
+    size_t ntotal = 0;
+    size_t ncpus = 0;
+
+    if (!(cpus = lxcProcGetCpuset(fuse))) {
+        virErrorSetErrnoFromLastError();
+        return -errno;
+    }
+
+    fd = fopen(hostpath, "r");
+    if (fd == NULL) {
+        virReportSystemError(errno, _("Cannot open %s"), hostpath);
+        res = -errno;
+        goto cleanup;
+    }
+
+    while (getline(&line, &n, fd) > 0) {
+        char *ptr;
+        unsigned int cpu;
+
+        if (STRPREFIX(line, "cpu "))
+            continue;
+
+        if (!STRPREFIX(line, "cpu") ||
+            virStrToLong_ui(line + 3, &ptr, 10, &cpu) < 0) {
+            virBufferAdd(&rest, line, -1);
+            continue;
+        }
+
+        if (!virBitmapIsBitSet(cpus, cpu))
+            continue;
+
+        virBufferAsprintf(&cpulines, "cpu%zu", ncpus++);
+        for (i = 0; i < ARRAY_CARDINALITY(total); i++) {
+            unsigned long long val;
+
+            if (virStrToLong_ull(ptr, &ptr, 10, &val) < 0)
+                break;
+            virBufferAsprintf(&cpulines, " %llu", val);
+            total[i] += val;
+        }
+        virBufferAddChar(&cpulines, '\n');
+        ntotal = i;
+    }
+
+    virBufferAddLit(&buffer, "cpu ");
+    for (i = 0; i < ntotal; i++)
+        virBufferAsprintf(&buffer, " %llu", total[i]);
+    virBufferAddChar(&buffer, '\n');
+    virBufferAddBuffer(&buffer, &cpulines);
+    virBufferAddBuffer(&buffer, &rest);
+
+    res = lxcProcCopyBuffer(&buffer, buf, size, offset);
+
+ cleanup:
+    VIR_FREE(line);
+    virBufferFreeAndReset(&buffer);
+    virBufferFreeAndReset(&cpulines);
+    virBufferFreeAndReset(&rest);
+    VIR_FORCE_FCLOSE(fd);
+    virBitmapFree(cpus);
+    return res;
+}
+
 static int lxcProcRead(const char *path ATTRIBUTE_UNUSED,
                        char *buf ATTRIBUTE_UNUSED,
                        size_t size ATTRIBUTE_UNUSED,
@@ -251,16 +473,22 @@ static int lxcProcRead(const char *path ATTRIBUTE_UNUSED,
     int res = -ENOENT;
     char *hostpath = NULL;
     struct fuse_context *context = NULL;
-    virDomainDefPtr def = NULL;
+    virLXCFusePtr fuse = NULL;
 
     if (virAsprintf(&hostpath, "/proc/%s", path) < 0)
         return -errno;
 
     context = fuse_get_context();
-    def = (virDomainDefPtr)context->private_data;
+    fuse = context->private_data;
 
-    if (STREQ(path, fuse_meminfo_path)) {
-        if ((res = lxcProcReadMeminfo(hostpath, def, buf, size, offset)) < 0)
+    if (STREQ(path, "/meminfo")) {
+        if ((res = lxcProcReadMeminfo(hostpath, fuse, buf, size, offset)) < 0)
+            res = lxcProcHostRead(hostpath, buf, size, offset);
+    } else if (STREQ(path, "/cpuinfo")) {
+        if ((res = lxcProcReadCpuinfo(hostpath, fuse, buf, size, offset)) < 0)
+            res = lxcProcHostRead(hostpath, buf, size, offset);
+    } else if (STREQ(path, "/stat")) {
+        if ((res = lxcProcReadStat(hostpath, fuse, buf, size, offset)) < 0)
             res = lxcProcHostRead(hostpath, buf, size, offset);
     }
 
@@ -288,9 +516,11 @@ static void lxcFuseRun(void *opaque)
 {
     virLXCFusePtr fuse = opaque;
 
-    if (fuse_loop(fuse->fuse) < 0)
+    /* readers don't wait for each other, the cgroup values they share
+     * are protected by fuse->lock */
+    if (fuse_loop_mt(fuse->fuse) < 0)
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("fuse_loop failed"));
+                       _("fuse_loop_mt failed"));
 
     lxcFuseDestroy(fuse);
 }
@@ -331,7 +561,7 @@ int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def)
         goto cleanup1;
 
     fuse->fuse = fuse_new(fuse->ch, &args, &lxcProcOper,
-                          sizeof(lxcProcOper), fuse->def);
+                          sizeof(lxcProcOper), fuse);
     if (fuse->fuse == NULL) {
         fuse_unmount(fuse->mountpoint, fuse->ch);
         goto cleanup1;
@@ -374,6 +604,7 @@ void lxcFreeFuse(virLXCFusePtr *f)
         virMutexUnlock(&fuse->lock);
 
         VIR_FREE(fuse->mountpoint);
+        virBitmapFree(fuse->cpus);
         VIR_FREE(*f);
     }
 }
@@ -32,6 +32,7 @@
 
 # include "lxc_conf.h"
 # include "viralloc.h"
+# include "virbitmap.h"
 
 struct virLXCMeminfo {
     unsigned long long memtotal;
@@ -54,9 +55,19 @@ struct virLXCFuse {
     struct fuse *fuse;
     struct fuse_chan *ch;
     virMutex lock;
+
+    /* cgroup values shared by the FUSE worker threads, they are
+     * refreshed once expired and protected by @lock */
+    struct virLXCMeminfo meminfo;
+    unsigned long long meminfoExpires;
+    virBitmapPtr cpus;
+    unsigned long long cpusExpires;
 };
 typedef struct virLXCFuse *virLXCFusePtr;
 
+/* NULL terminated list of the files of /proc replaced by the FUSE ones */
+extern const char *const lxcFuseProcFiles[];
+
 int lxcSetupFuse(virLXCFusePtr *f, virDomainDefPtr def);
 int lxcStartFuse(virLXCFusePtr f);
 void lxcFreeFuse(virLXCFusePtr *f);
@@ -54,6 +54,7 @@
 #include "viriptables.h"
 #include "virlog.h"
 #include "virdnsmasq.h"
+#include "virlease.h"
 #include "configmake.h"
 #include "virnetlink.h"
 #include "virnetdev.h"
@@ -70,6 +71,7 @@
 #include "network_event.h"
 #include "virhook.h"
 #include "virjson.h"
+#include "stat-time.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 #define MAX_BRIDGE_ID 256
@@ -85,6 +87,32 @@
 
 VIR_LOG_INIT("network.bridge_driver");
 
+/* Parsed contents of the custom lease file of a network, valid as
+ * long as the file keeps the identity it had when it was read */
+typedef struct _networkLeaseCacheEntry networkLeaseCacheEntry;
+typedef networkLeaseCacheEntry *networkLeaseCacheEntryPtr;
+struct _networkLeaseCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    virJSONValuePtr leases;
+};
+
+
+static void
+networkLeaseCacheEntryFree(void *payload,
+                           const void *name ATTRIBUTE_UNUSED)
+{
+    networkLeaseCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    virJSONValueFree(entry->leases);
+    VIR_FREE(entry);
+}
+
 static virNetworkDriverStatePtr network_driver;
 
 
@@ -373,6 +401,9 @@ networkRemoveInactive(virNetworkDriverStatePtr driver,
     /* MAC map manager */
     unlink(macMapFile);
 
+    /* a failed rebuild drops the index, NSS then reads the files */
+    ignore_value(virLeaseIndexBuild(driver->dnsmasqStateDir, NULL));
+
     /* radvd */
     unlink(radvdconfigfile);
     virPidFileDelete(driver->pidDir, radvdpidbase);
@@ -734,6 +765,10 @@ networkStateInitialize(bool privileged,
     if (!(network_driver->networks = virNetworkObjListNew()))
         goto error;
 
+    if (!(network_driver->leaseCache =
+          virHashCreate(16, networkLeaseCacheEntryFree)))
+        goto error;
+
     if (virNetworkObjLoadAllState(network_driver->networks,
                                   network_driver->stateDir) < 0)
         goto error;
@@ -863,6 +898,8 @@ networkStateCleanup(void)
 
     virObjectUnref(network_driver->dnsmasqCaps);
 
+    virHashFree(network_driver->leaseCache);
+
     virMutexDestroy(&network_driver->lock);
 
     VIR_FREE(network_driver);
@@ -1083,7 +1120,7 @@ networkDnsmasqConfContents(virNetworkObjPtr obj,
                            const char *pidfile,
                            char **configstr,
                            dnsmasqContext *dctx,
-                           dnsmasqCapsPtr caps ATTRIBUTE_UNUSED)
+                           dnsmasqCapsPtr caps)
 {
     virNetworkDefPtr def = virNetworkObjGetDef(obj);
     virBuffer configbuf = VIR_BUFFER_INITIALIZER;
@@ -1490,20 +1527,36 @@ networkDnsmasqConfContents(virNetworkObjPtr obj,
     if (networkBuildDnsmasqHostsList(dctx, dns) < 0)
         goto cleanup;
 
+    /* With inotify watched directories each host is a file of its
+     * own, which dnsmasq reads as soon as it appears, so that adding
+     * hosts at runtime needs neither rewriting all the hosts nor a
+     * reload.
+     */
+    dctx->hostsdir = dnsmasqCapsGet(caps, DNSMASQ_CAPS_HOSTSDIR);
+
     /* Even if there are currently no static hosts, if we're
      * listening for DHCP, we should write a 0-length hosts
      * file to allow for runtime additions.
      */
-    if (ipv4def || ipv6def)
-        virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
-                          dctx->hostsfile->path);
+    if (ipv4def || ipv6def) {
+        if (dctx->hostsdir)
+            virBufferAsprintf(&configbuf, "dhcp-hostsdir=%s\n",
+                              dctx->hostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "dhcp-hostsfile=%s\n",
+                              dctx->hostsfile->path);
+    }
 
     /* Likewise, always create this file and put it on the
      * commandline, to allow for runtime additions.
      */
     if (wantDNS) {
-        virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
-                          dctx->addnhostsfile->path);
+        if (dctx->hostsdir)
+            virBufferAsprintf(&configbuf, "hostsdir=%s\n",
+                              dctx->addnhostsfile->dir);
+        else
+            virBufferAsprintf(&configbuf, "addn-hosts=%s\n",
+                              dctx->addnhostsfile->path);
     }
 
     /* Are we doing RA instead of radvd? */
@@ -1694,7 +1747,8 @@ networkStartDhcpDaemon(virNetworkDriverStatePtr driver,
 /* networkRefreshDhcpDaemon:
  *  Update dnsmasq config files, then send a SIGHUP so that it rereads
  *  them.   This only works for the dhcp-hostsfile and the
- *  addn-hosts file.
+ *  addn-hosts file. When dnsmasq watches the host directories
+ *  instead, the SIGHUP is only needed if some hosts were removed.
  *
  *  Returns 0 on success, -1 on failure.
  */
@@ -1708,6 +1762,7 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     pid_t dnsmasqPid;
     virNetworkIPDefPtr ipdef, ipv4def, ipv6def;
     dnsmasqContext *dctx = NULL;
+    bool reload;
 
     /* if no IP addresses specified, nothing to do */
     if (!virNetworkDefGetIPByIndex(def, AF_UNSPEC, 0))
@@ -1724,6 +1779,9 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
         goto cleanup;
     }
 
+    /* keep the format the running dnsmasq was started with */
+    dctx->hostsdir = virFileIsDir(dctx->hostsfile->dir);
+
     /* Look for first IPv4 address that has dhcp defined.
      * We only support dhcp-host config on one IPv4 subnetwork
      * and on one IPv6 subnetwork.
@@ -1753,9 +1811,15 @@ networkRefreshDhcpDaemon(virNetworkDriverStatePtr driver,
     if (networkBuildDnsmasqHostsList(dctx, &def->dns) < 0)
         goto cleanup;
 
-    if ((ret = dnsmasqSave(dctx)) < 0)
+    if ((ret = dnsmasqSaveChanges(dctx, &reload)) < 0)
         goto cleanup;
 
+    if (!reload) {
+        VIR_DEBUG("dnsmasq for network %s picks up the hosts by itself",
+                  def->name);
+        goto cleanup;
+    }
+
     dnsmasqPid = virNetworkObjGetDnsmasqPid(obj);
     ret = kill(dnsmasqPid, SIGHUP);
  cleanup:
@@ -2798,6 +2862,176 @@ networkCreateInterfacePool(virNetworkDefPtr netdef)
 }
 
 
+/* networkPrebindNext:
+ * @netdef: the live definition of a hostdev network
+ * @visited: VFs already tried during this run of the prebind thread
+ *
+ * Returns the next VF that should be bound to vfio-pci ahead of use,
+ * or NULL if the pool already holds netdef->forward.prebind unused
+ * prebound VFs or there is nothing left to try.
+ */
+static virNetworkForwardIfDefPtr
+networkPrebindNext(virNetworkDefPtr netdef,
+                   bool *visited)
+{
+    virNetworkForwardIfDefPtr next = NULL;
+    size_t nprebound = 0;
+    size_t i;
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        virNetworkForwardIfDefPtr thisIf = &netdef->forward.ifs[i];
+
+        if (thisIf->type != VIR_NETWORK_FORWARD_HOSTDEV_DEVICE_PCI ||
+            thisIf->connections > 0)
+            continue;
+
+        if (thisIf->prebound)
+            nprebound++;
+        else if (!next && !visited[i])
+            next = thisIf;
+    }
+
+    if (nprebound >= netdef->forward.prebind)
+        return NULL;
+
+    if (next)
+        visited[next - netdef->forward.ifs] = true;
+    return next;
+}
+
+
+static void
+networkPrebindThread(void *opaque)
+{
+    virNetworkObjPtr obj = opaque;
+    virNetworkDefPtr netdef;
+    virNetworkForwardIfDefPtr thisIf;
+    bool *visited = NULL;
+    size_t nvisited = 0;
+
+    virObjectLock(obj);
+
+    while (virNetworkObjIsActive(obj)) {
+        virPCIDevicePtr pci;
+
+        netdef = virNetworkObjGetDef(obj);
+        /* the pool is rebuilt whenever the network is restarted */
+        if (nvisited != netdef->forward.nifs) {
+            VIR_FREE(visited);
+            if (VIR_ALLOC_N(visited, netdef->forward.nifs) < 0)
+                break;
+            nvisited = netdef->forward.nifs;
+        }
+
+        if (!(thisIf = networkPrebindNext(netdef, visited)))
+            break;
+
+        VIR_DEBUG("Prebinding VF %04x:%02x:%02x.%x of network %s",
+                  thisIf->device.pci.domain, thisIf->device.pci.bus,
+                  thisIf->device.pci.slot, thisIf->device.pci.function,
+                  netdef->name);
+
+        /* The network lock is held across the bind so that nobody can
+         * hand this VF to a domain while its driver is being changed */
+        if ((pci = virPCIDeviceNew(thisIf->device.pci.domain,
+                                   thisIf->device.pci.bus,
+                                   thisIf->device.pci.slot,
+                                   thisIf->device.pci.function)))
+            virPCIDeviceSetStubDriver(pci, VIR_PCI_STUB_DRIVER_VFIO);
+
+        if (!pci || virPCIDeviceDetach(pci, NULL, NULL) < 0) {
+            VIR_WARN("Unable to prebind VF %04x:%02x:%02x.%x of network %s: %s",
+                     thisIf->device.pci.domain, thisIf->device.pci.bus,
+                     thisIf->device.pci.slot, thisIf->device.pci.function,
+                     netdef->name, virGetLastErrorMessage());
+            virResetLastError();
+        } else {
+            thisIf->prebound = true;
+        }
+        virPCIDeviceFree(pci);
+    }
+
+    if ((netdef = virNetworkObjGetDef(obj)))
+        netdef->forward.prebindRunning = false;
+    VIR_FREE(visited);
+    virObjectUnlock(obj);
+    virObjectUnref(obj);
+}
+
+
+/* networkPrebindStart:
+ * @obj: a locked, active hostdev network
+ *
+ * Starts a background thread which binds unused VFs of the network
+ * to vfio-pci until forward.prebind of them are waiting to be used,
+ * unless such a thread is already running.
+ */
+static void
+networkPrebindStart(virNetworkObjPtr obj)
+{
+    virNetworkDefPtr netdef = virNetworkObjGetDef(obj);
+    virThread thread;
+
+    if (netdef->forward.type != VIR_NETWORK_FORWARD_HOSTDEV ||
+        netdef->forward.prebind == 0 ||
+        netdef->forward.prebindRunning)
+        return;
+
+    virObjectRef(obj);
+    if (virThreadCreate(&thread, false, networkPrebindThread, obj) < 0) {
+        VIR_WARN("Unable to start VF prebind thread for network %s",
+                 netdef->name);
+        virObjectUnref(obj);
+        return;
+    }
+    netdef->forward.prebindRunning = true;
+}
+
+
+/* networkPrebindRelease:
+ * @netdef: the live definition of a hostdev network
+ *
+ * Gives back the unused prebound VFs to their host drivers.
+ */
+static void
+networkPrebindRelease(virNetworkDefPtr netdef)
+{
+    size_t i;
+
+    for (i = 0; i < netdef->forward.nifs; i++) {
+        virNetworkForwardIfDefPtr thisIf = &netdef->forward.ifs[i];
+        virPCIDevicePtr pci;
+
+        if (!thisIf->prebound)
+            continue;
+        thisIf->prebound = false;
+
+        /* a VF still assigned to a domain is returned by the hypervisor
+         * driver when the domain lets go of it */
+        if (thisIf->connections > 0)
+            continue;
+
+        if (!(pci = virPCIDeviceNew(thisIf->device.pci.domain,
+                                    thisIf->device.pci.bus,
+                                    thisIf->device.pci.slot,
+                                    thisIf->device.pci.function))) {
+            virResetLastError();
+            continue;
+        }
+        virPCIDeviceSetStubDriver(pci, VIR_PCI_STUB_DRIVER_VFIO);
+        virPCIDeviceSetUnbindFromStub(pci, true);
+        virPCIDeviceSetReprobe(pci, true);
+        if (virPCIDeviceReattach(pci, NULL, NULL) < 0) {
+            VIR_WARN("Unable to reattach prebound VF %s of network %s: %s",
+                     virPCIDeviceGetName(pci), netdef->name,
+                     virGetLastErrorMessage());
+            virResetLastError();
+        }
+        virPCIDeviceFree(pci);
+    }
+}
+
+
 static int
 networkStartNetworkExternal(virNetworkObjPtr obj)
 {
@@ -2806,18 +3040,26 @@ networkStartNetworkExternal(virNetworkObjPtr obj)
      * failure, undo anything you've done, and return -1. On success
      * return 0.
      */
-    return networkCreateInterfacePool(virNetworkObjGetDef(obj));
+    if (networkCreateInterfacePool(virNetworkObjGetDef(obj)) < 0)
+        return -1;
+
+    networkPrebindStart(obj);
+    return 0;
 }
 
 
 static int
-networkShutdownNetworkExternal(virNetworkObjPtr obj ATTRIBUTE_UNUSED)
+networkShutdownNetworkExternal(virNetworkObjPtr obj)
 {
     /* put anything here that needs to be done each time a network of
      * type BRIDGE, PRIVATE, VEPA, HOSTDEV or PASSTHROUGH is shutdown. On
      * failure, undo anything you've done, and return -1. On success
      * return 0.
      */
+    virNetworkDefPtr def = virNetworkObjGetDef(obj);
+
+    if (def->forward.type == VIR_NETWORK_FORWARD_HOSTDEV)
+        networkPrebindRelease(def);
     return 0;
 }
 
@@ -3759,34 +4001,38 @@ networkUndefine(virNetworkPtr net)
 }
 
 
+static bool
+networkUpdateHasSection(const virNetworkUpdateItem *items,
+                        size_t nitems,
+                        unsigned int section)
+{
+    size_t i;
+
+    for (i = 0; i < nitems; i++) {
+        if (items[i].section == section)
+            return true;
+    }
+
+    return false;
+}
+
+
 static int
-networkUpdate(virNetworkPtr net,
-              unsigned int command,
-              unsigned int section,
-              int parentIndex,
-              const char *xml,
-              unsigned int flags)
+networkUpdateItems(virNetworkObjPtr obj,
+                   const virNetworkUpdateItem *items,
+                   size_t nitems,
+                   unsigned int flags)
 {
     virNetworkDriverStatePtr driver = networkGetDriver();
-    virNetworkObjPtr obj = NULL;
-    virNetworkDefPtr def;
+    virNetworkDefPtr def = virNetworkObjGetDef(obj);
     int isActive, ret = -1;
     size_t i;
     virNetworkIPDefPtr ipdef;
     bool oldDhcpActive = false;
     bool needFirewallRefresh = false;
 
-
-    virCheckFlags(VIR_NETWORK_UPDATE_AFFECT_LIVE |
-                  VIR_NETWORK_UPDATE_AFFECT_CONFIG,
-                  -1);
-
-    if (!(obj = networkObjFromNetwork(net)))
-        goto cleanup;
-    def = virNetworkObjGetDef(obj);
-
-    if (virNetworkUpdateEnsureACL(net->conn, def, flags) < 0)
-        goto cleanup;
+#define HAS_SECTION(section) \
+    networkUpdateHasSection(items, nitems, VIR_NETWORK_SECTION_ ## section)
 
     /* see if we are listening for dhcp pre-modification */
     for (i = 0;
@@ -3819,21 +4065,17 @@ networkUpdate(virNetworkPtr net,
         case VIR_NETWORK_FORWARD_NONE:
         case VIR_NETWORK_FORWARD_NAT:
         case VIR_NETWORK_FORWARD_ROUTE:
-            switch (section) {
-            case VIR_NETWORK_SECTION_FORWARD:
-            case VIR_NETWORK_SECTION_FORWARD_INTERFACE:
-            case VIR_NETWORK_SECTION_IP:
-            case VIR_NETWORK_SECTION_IP_DHCP_RANGE:
-            case VIR_NETWORK_SECTION_IP_DHCP_HOST:
+            if (HAS_SECTION(FORWARD) ||
+                HAS_SECTION(FORWARD_INTERFACE) ||
+                HAS_SECTION(IP) ||
+                HAS_SECTION(IP_DHCP_RANGE) ||
+                HAS_SECTION(IP_DHCP_HOST)) {
                 /* these could affect the firewall rules, so remove the
                  * old rules (and remember to load new ones after the
                  * update).
                  */
                 networkRemoveFirewallRules(def);
                 needFirewallRefresh = true;
-                break;
-            default:
-                break;
             }
             break;
 
@@ -3853,7 +4095,7 @@ networkUpdate(virNetworkPtr net,
     }
 
     /* update the network config in memory/on disk */
-    if (virNetworkObjUpdate(obj, command, section, parentIndex, xml, flags) < 0) {
+    if (virNetworkObjUpdateBatch(obj, items, nitems, flags) < 0) {
         if (needFirewallRefresh)
             ignore_value(networkAddFirewallRules(def));
         goto cleanup;
@@ -3875,16 +4117,16 @@ networkUpdate(virNetworkPtr net,
 
     if (isActive && (flags & VIR_NETWORK_UPDATE_AFFECT_LIVE)) {
         /* rewrite dnsmasq host files, restart dnsmasq, update iptables
-         * rules, etc, according to which section was modified. Note that
-         * some sections require multiple actions, so a single switch
-         * statement is inadequate.
+         * rules, etc, according to which sections were modified. Note
+         * that some sections require multiple actions, so a single
+         * if/else chain is inadequate.
          */
-        if (section == VIR_NETWORK_SECTION_BRIDGE ||
-            section == VIR_NETWORK_SECTION_DOMAIN ||
-            section == VIR_NETWORK_SECTION_IP ||
-            section == VIR_NETWORK_SECTION_IP_DHCP_RANGE ||
-            section == VIR_NETWORK_SECTION_DNS_TXT ||
-            section == VIR_NETWORK_SECTION_DNS_SRV) {
+        if (HAS_SECTION(BRIDGE) ||
+            HAS_SECTION(DOMAIN) ||
+            HAS_SECTION(IP) ||
+            HAS_SECTION(IP_DHCP_RANGE) ||
+            HAS_SECTION(DNS_TXT) ||
+            HAS_SECTION(DNS_SRV)) {
             /* these sections all change things on the dnsmasq
              * commandline (i.e. in the .conf file), so we need to
              * kill and restart dnsmasq, because dnsmasq sets its uid
@@ -3894,7 +4136,7 @@ networkUpdate(virNetworkPtr net,
             if (networkRestartDhcpDaemon(driver, obj) < 0)
                 goto cleanup;
 
-        } else if (section == VIR_NETWORK_SECTION_IP_DHCP_HOST) {
+        } else if (HAS_SECTION(IP_DHCP_HOST)) {
             /* if we previously weren't listening for dhcp and now we
              * are (or vice-versa) then we need to do a restart,
              * otherwise we just need to do a refresh (redo the config
@@ -3916,7 +4158,7 @@ networkUpdate(virNetworkPtr net,
                 goto cleanup;
             }
 
-        } else if (section == VIR_NETWORK_SECTION_DNS_HOST) {
+        } else if (HAS_SECTION(DNS_HOST)) {
             /* this section only changes data in an external file
              * (not the .conf file) so we can just update the config
              * files and send SIGHUP to dnsmasq.
@@ -3926,7 +4168,7 @@ networkUpdate(virNetworkPtr net,
 
         }
 
-        if (section == VIR_NETWORK_SECTION_IP) {
+        if (HAS_SECTION(IP)) {
             /* only a change in IP addresses will affect radvd, and all of radvd's
              * config is stored in the conf file which will be re-read with a SIGHUP.
              */
@@ -3945,6 +4187,71 @@ networkUpdate(virNetworkPtr net,
         goto cleanup;
 
     ret = 0;
+ cleanup:
+    return ret;
+
+#undef HAS_SECTION
+}
+
+
+static int
+networkUpdate(virNetworkPtr net,
+              unsigned int command,
+              unsigned int section,
+              int parentIndex,
+              const char *xml,
+              unsigned int flags)
+{
+    virNetworkObjPtr obj = NULL;
+    virNetworkUpdateItem item = {
+        .command = command,
+        .section = section,
+        .parentIndex = parentIndex,
+        .xml = xml,
+    };
+    int ret = -1;
+
+    virCheckFlags(VIR_NETWORK_UPDATE_AFFECT_LIVE |
+                  VIR_NETWORK_UPDATE_AFFECT_CONFIG,
+                  -1);
+
+    if (!(obj = networkObjFromNetwork(net)))
+        goto cleanup;
+
+    if (virNetworkUpdateEnsureACL(net->conn, virNetworkObjGetDef(obj),
+                                  flags) < 0)
+        goto cleanup;
+
+    ret = networkUpdateItems(obj, &item, 1, flags);
+
+ cleanup:
+    virNetworkObjEndAPI(&obj);
+    return ret;
+}
+
+
+static int
+networkUpdateBatch(virNetworkPtr net,
+                   virNetworkUpdateItemPtr items,
+                   unsigned int nitems,
+                   unsigned int flags)
+{
+    virNetworkObjPtr obj = NULL;
+    int ret = -1;
+
+    virCheckFlags(VIR_NETWORK_UPDATE_AFFECT_LIVE |
+                  VIR_NETWORK_UPDATE_AFFECT_CONFIG,
+                  -1);
+
+    if (!(obj = networkObjFromNetwork(net)))
+        goto cleanup;
+
+    if (virNetworkUpdateBatchEnsureACL(net->conn, virNetworkObjGetDef(obj),
+                                       flags) < 0)
+        goto cleanup;
+
+    ret = networkUpdateItems(obj, items, nitems, flags);
+
  cleanup:
     virNetworkObjEndAPI(&obj);
     return ret;
@@ -4183,87 +4490,101 @@ networkSetAutostart(virNetworkPtr net,
 }
 
 
-static int
-networkGetDHCPLeases(virNetworkPtr net,
-                     const char *mac,
-                     virNetworkDHCPLeasePtr **leases,
-                     unsigned int flags)
+static bool
+networkLeaseCacheEntryMatch(networkLeaseCacheEntryPtr entry,
+                            const struct stat *st)
 {
-    virNetworkDriverStatePtr driver = networkGetDriver();
-    size_t i, j;
-    size_t nleases = 0;
-    int rv = -1;
-    size_t size = 0;
-    int custom_lease_file_len = 0;
-    bool need_results = !!leases;
-    long long currtime = 0;
-    long long expirytime_tmp = -1;
-    bool ipv6 = false;
-    char *lease_entries = NULL;
-    char *custom_lease_file = NULL;
-    const char *ip_tmp = NULL;
-    const char *mac_tmp = NULL;
-    virJSONValuePtr lease_tmp = NULL;
-    virJSONValuePtr leases_array = NULL;
-    virNetworkIPDefPtr ipdef_tmp = NULL;
-    virNetworkDHCPLeasePtr lease = NULL;
-    virNetworkDHCPLeasePtr *leases_ret = NULL;
-    virNetworkObjPtr obj;
-    virNetworkDefPtr def;
-    virMacAddr mac_addr;
+    struct timespec mtime = get_stat_mtime(st);
 
-    virCheckFlags(0, -1);
+    return entry->dev == st->st_dev &&
+           entry->ino == st->st_ino &&
+           entry->mtime.tv_sec == mtime.tv_sec &&
+           entry->mtime.tv_nsec == mtime.tv_nsec &&
+           entry->size == st->st_size;
+}
 
-    /* only to check if the MAC is valid */
-    if (mac && virMacAddrParse(mac, &mac_addr) < 0) {
-        virReportError(VIR_ERR_INVALID_MAC, "%s", mac);
-        return -1;
-    }
 
-    if (!(obj = networkObjFromNetwork(net)))
-        return -1;
-    def = virNetworkObjGetDef(obj);
+/*
+ * Reads and parses the custom lease file @path, whose identity
+ * was @st just before.
+ */
+static networkLeaseCacheEntryPtr
+networkLeaseCacheEntryNew(const char *path,
+                          const struct stat *st)
+{
+    networkLeaseCacheEntryPtr entry = NULL;
+    char *lease_entries = NULL;
+    int len;
 
-    if (virNetworkGetDHCPLeasesEnsureACL(net->conn, def) < 0)
-        goto cleanup;
+    if (VIR_ALLOC(entry) < 0)
+        return NULL;
 
-    /* Retrieve custom leases file location */
-    custom_lease_file = networkDnsmasqLeaseFileNameCustom(driver, def->bridge);
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->mtime = get_stat_mtime(st);
+    entry->size = st->st_size;
 
-    /* Read entire contents */
-    if ((custom_lease_file_len = virFileReadAllQuiet(custom_lease_file,
-                                                     VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
-                                                     &lease_entries)) < 0) {
-        /* Not all networks are guaranteed to have leases file.
-         * Only those which run dnsmasq. Therefore, if we failed
-         * to read the leases file, don't report error. Return 0
-         * leases instead. */
-        if (errno == ENOENT) {
-            rv = 0;
-        } else {
-            virReportSystemError(errno,
-                                 _("Unable to read leases file: %s"),
-                                 custom_lease_file);
-        }
+    if ((len = virFileReadAllQuiet(path,
+                                   VIR_NETWORK_DHCP_LEASE_FILE_SIZE_MAX,
+                                   &lease_entries)) < 0) {
+        /* The file may have been removed in the meantime */
+        if (errno == ENOENT)
+            return entry;
+
+        virReportSystemError(errno,
+                             _("Unable to read leases file: %s"), path);
         goto error;
     }
 
-    if (custom_lease_file_len) {
-        if (!(leases_array = virJSONValueFromString(lease_entries))) {
+    if (len) {
+        if (!(entry->leases = virJSONValueFromString(lease_entries))) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("invalid json in file: %s"), custom_lease_file);
+                           _("invalid json in file: %s"), path);
             goto error;
         }
 
-        if (!virJSONValueIsArray(leases_array)) {
+        if (!virJSONValueIsArray(entry->leases)) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("Malformed lease_entries array"));
             goto error;
         }
-        size = virJSONValueArraySize(leases_array);
     }
 
-    currtime = (long long)time(NULL);
+    VIR_FREE(lease_entries);
+    return entry;
+
+ error:
+    VIR_FREE(lease_entries);
+    networkLeaseCacheEntryFree(entry, NULL);
+    return NULL;
+}
+
+
+/*
+ * Appends to @leases the unexpired leases in @leases_array of the
+ * network @def, whose MAC address is @mac or is in @macs, or any if
+ * both are NULL. Only counts them if @leases is NULL.
+ */
+static int
+networkDHCPLeasesFilter(virNetworkDefPtr def,
+                        virJSONValuePtr leases_array,
+                        const char *mac,
+                        virHashTablePtr macs,
+                        virNetworkDHCPLeasePtr **leases,
+                        size_t *nleases)
+{
+    size_t i, j;
+    size_t size = leases_array ? virJSONValueArraySize(leases_array) : 0;
+    long long currtime = (long long)time(NULL);
+    long long expirytime_tmp = -1;
+    bool ipv6 = false;
+    const char *ip_tmp = NULL;
+    const char *mac_tmp = NULL;
+    virJSONValuePtr lease_tmp = NULL;
+    virNetworkIPDefPtr ipdef_tmp = NULL;
+    virNetworkDHCPLeasePtr lease = NULL;
+    virMacAddr mac_addr;
+    char mac_str[VIR_MAC_STRING_BUFLEN];
 
     for (i = 0; i < size; i++) {
         if (!(lease_tmp = virJSONValueArrayGet(leases_array, i))) {
@@ -4283,6 +4604,11 @@ networkGetDHCPLeases(virNetworkPtr net,
         if (mac && virMacAddrCompare(mac, mac_tmp))
             continue;
 
+        if (macs &&
+            (virMacAddrParse(mac_tmp, &mac_addr) < 0 ||
+             !virHashLookup(macs, virMacAddrFormat(&mac_addr, mac_str))))
+            continue;
+
         if (virJSONValueObjectGetNumberLong(lease_tmp, "expiry-time", &expirytime_tmp) < 0) {
             /* A lease cannot be present without expiry-time */
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -4294,65 +4620,180 @@ networkGetDHCPLeases(virNetworkPtr net,
         if (expirytime_tmp < currtime)
             continue;
 
-        if (need_results) {
-            if (VIR_ALLOC(lease) < 0)
-                goto error;
+        if (!leases) {
+            (*nleases)++;
+            continue;
+        }
 
-            lease->expirytime = expirytime_tmp;
+        if (VIR_ALLOC(lease) < 0)
+            goto error;
 
-            if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address"))) {
-                /* A lease without ip-address makes no sense */
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("found lease without ip-address"));
-                goto error;
-            }
+        lease->expirytime = expirytime_tmp;
 
-            /* Unlike IPv4, IPv6 uses ':' instead of '.' as separator */
-            ipv6 = strchr(ip_tmp, ':') ? true : false;
-            lease->type = ipv6 ? VIR_IP_ADDR_TYPE_IPV6 : VIR_IP_ADDR_TYPE_IPV4;
+        if (!(ip_tmp = virJSONValueObjectGetString(lease_tmp, "ip-address"))) {
+            /* A lease without ip-address makes no sense */
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("found lease without ip-address"));
+            goto error;
+        }
 
-            /* Obtain prefix */
-            for (j = 0; j < def->nips; j++) {
-                ipdef_tmp = &def->ips[j];
+        /* Unlike IPv4, IPv6 uses ':' instead of '.' as separator */
+        ipv6 = strchr(ip_tmp, ':') ? true : false;
+        lease->type = ipv6 ? VIR_IP_ADDR_TYPE_IPV6 : VIR_IP_ADDR_TYPE_IPV4;
 
-                if (ipv6 && VIR_SOCKET_ADDR_IS_FAMILY(&ipdef_tmp->address,
-                                                      AF_INET6)) {
-                    lease->prefix = ipdef_tmp->prefix;
-                    break;
-                }
-                if (!ipv6 && VIR_SOCKET_ADDR_IS_FAMILY(&ipdef_tmp->address,
-                                                      AF_INET)) {
-                    lease->prefix = virSocketAddrGetIPPrefix(&ipdef_tmp->address,
-                                                             &ipdef_tmp->netmask,
-                                                             ipdef_tmp->prefix);
-                    break;
-                }
+        /* Obtain prefix */
+        for (j = 0; j < def->nips; j++) {
+            ipdef_tmp = &def->ips[j];
+
+            if (ipv6 && VIR_SOCKET_ADDR_IS_FAMILY(&ipdef_tmp->address,
+                                                  AF_INET6)) {
+                lease->prefix = ipdef_tmp->prefix;
+                break;
             }
+            if (!ipv6 && VIR_SOCKET_ADDR_IS_FAMILY(&ipdef_tmp->address,
+                                                  AF_INET)) {
+                lease->prefix = virSocketAddrGetIPPrefix(&ipdef_tmp->address,
+                                                         &ipdef_tmp->netmask,
+                                                         ipdef_tmp->prefix);
+                break;
+            }
+        }
 
-            if ((VIR_STRDUP(lease->mac, mac_tmp) < 0) ||
-                (VIR_STRDUP(lease->ipaddr, ip_tmp) < 0) ||
-                (VIR_STRDUP(lease->iface, def->bridge) < 0))
-                goto error;
+        if ((VIR_STRDUP(lease->mac, mac_tmp) < 0) ||
+            (VIR_STRDUP(lease->ipaddr, ip_tmp) < 0) ||
+            (VIR_STRDUP(lease->iface, def->bridge) < 0))
+            goto error;
 
-            /* Fields that can be NULL */
-            if ((VIR_STRDUP(lease->iaid,
-                            virJSONValueObjectGetString(lease_tmp, "iaid")) < 0) ||
-                (VIR_STRDUP(lease->clientid,
-                            virJSONValueObjectGetString(lease_tmp, "client-id")) < 0) ||
-                (VIR_STRDUP(lease->hostname,
-                            virJSONValueObjectGetString(lease_tmp, "hostname")) < 0))
-                goto error;
+        /* Fields that can be NULL */
+        if ((VIR_STRDUP(lease->iaid,
+                        virJSONValueObjectGetString(lease_tmp, "iaid")) < 0) ||
+            (VIR_STRDUP(lease->clientid,
+                        virJSONValueObjectGetString(lease_tmp, "client-id")) < 0) ||
+            (VIR_STRDUP(lease->hostname,
+                        virJSONValueObjectGetString(lease_tmp, "hostname")) < 0))
+            goto error;
 
-            if (VIR_INSERT_ELEMENT(leases_ret, nleases, nleases, lease) < 0)
-                goto error;
+        if (VIR_APPEND_ELEMENT(*leases, *nleases, lease) < 0)
+            goto error;
+    }
+
+    return 0;
+
+ error:
+    virNetworkDHCPLeaseFree(lease);
+    return -1;
+}
+
+
+/*
+ * Appends to @leases the matching leases of the network @def, see
+ * networkDHCPLeasesFilter. The custom lease file, which is rewritten
+ * by the leases helper whenever dnsmasq reports a change, is only
+ * parsed again when it changed since the last lookup.
+ */
+static int
+networkDHCPLeasesGather(virNetworkDriverStatePtr driver,
+                        virNetworkDefPtr def,
+                        const char *mac,
+                        virHashTablePtr macs,
+                        virNetworkDHCPLeasePtr **leases,
+                        size_t *nleases)
+{
+    networkLeaseCacheEntryPtr entry;
+    char *custom_lease_file = NULL;
+    struct stat st;
+    int ret = -1;
 
+    /* Only networks with a bridge can run dnsmasq */
+    if (!def->bridge)
+        return 0;
+
+    /* Retrieve custom leases file location */
+    if (!(custom_lease_file = networkDnsmasqLeaseFileNameCustom(driver,
+                                                                def->bridge)))
+        return -1;
+
+    if (stat(custom_lease_file, &st) < 0) {
+        /* Not all networks are guaranteed to have leases file.
+         * Only those which run dnsmasq. Therefore, if there is
+         * no leases file, don't report error. Return 0 leases
+         * instead. */
+        if (errno == ENOENT) {
+            networkDriverLock(driver);
+            virHashRemoveEntry(driver->leaseCache, def->bridge);
+            networkDriverUnlock(driver);
+            ret = 0;
         } else {
-            nleases++;
+            virReportSystemError(errno,
+                                 _("Unable to read leases file: %s"),
+                                 custom_lease_file);
+        }
+        goto cleanup;
+    }
+
+    networkDriverLock(driver);
+
+    entry = virHashLookup(driver->leaseCache, def->bridge);
+    if (!entry || !networkLeaseCacheEntryMatch(entry, &st)) {
+        networkDriverUnlock(driver);
+
+        VIR_DEBUG("Parsing leases file %s", custom_lease_file);
+        if (!(entry = networkLeaseCacheEntryNew(custom_lease_file, &st)))
+            goto cleanup;
+
+        networkDriverLock(driver);
+        if (virHashUpdateEntry(driver->leaseCache, def->bridge, entry) < 0) {
+            networkDriverUnlock(driver);
+            networkLeaseCacheEntryFree(entry, NULL);
+            goto cleanup;
         }
+    }
 
-        VIR_FREE(lease);
+    ret = networkDHCPLeasesFilter(def, entry->leases, mac, macs,
+                                  leases, nleases);
+
+    networkDriverUnlock(driver);
+
+ cleanup:
+    VIR_FREE(custom_lease_file);
+    return ret;
+}
+
+
+static int
+networkGetDHCPLeases(virNetworkPtr net,
+                     const char *mac,
+                     virNetworkDHCPLeasePtr **leases,
+                     unsigned int flags)
+{
+    virNetworkDriverStatePtr driver = networkGetDriver();
+    size_t i;
+    size_t nleases = 0;
+    int rv = -1;
+    virNetworkDHCPLeasePtr *leases_ret = NULL;
+    virNetworkObjPtr obj;
+    virNetworkDefPtr def;
+    virMacAddr mac_addr;
+
+    virCheckFlags(0, -1);
+
+    /* only to check if the MAC is valid */
+    if (mac && virMacAddrParse(mac, &mac_addr) < 0) {
+        virReportError(VIR_ERR_INVALID_MAC, "%s", mac);
+        return -1;
     }
 
+    if (!(obj = networkObjFromNetwork(net)))
+        return -1;
+    def = virNetworkObjGetDef(obj);
+
+    if (virNetworkGetDHCPLeasesEnsureACL(net->conn, def) < 0)
+        goto cleanup;
+
+    if (networkDHCPLeasesGather(driver, def, mac, NULL,
+                                leases ? &leases_ret : NULL, &nleases) < 0)
+        goto error;
+
     if (leases_ret) {
         /* NULL terminated array */
         ignore_value(VIR_REALLOC_N(leases_ret, nleases + 1));
@@ -4363,11 +4804,6 @@ networkGetDHCPLeases(virNetworkPtr net,
     rv = nleases;
 
  cleanup:
-    VIR_FREE(lease);
-    VIR_FREE(lease_entries);
-    VIR_FREE(custom_lease_file);
-    virJSONValueFree(leases_array);
-
     virNetworkObjEndAPI(&obj);
 
     return rv;
@@ -4382,6 +4818,97 @@ networkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static int
+networkConnectGetAllDHCPLeases(virConnectPtr conn,
+                               virNetworkPtr *nets,
+                               const char **macs,
+                               virNetworkDHCPLeasePtr **leases,
+                               unsigned int flags)
+{
+    virNetworkDriverStatePtr driver = networkGetDriver();
+    size_t i;
+    size_t nleases = 0;
+    int rv = -1;
+    virNetworkDHCPLeasePtr *leases_ret = NULL;
+    virNetworkPtr *allnets = NULL;
+    int nallnets = 0;
+    virHashTablePtr machash = NULL;
+    virNetworkObjPtr obj;
+    virNetworkDefPtr def;
+    virMacAddr mac_addr;
+    char mac_str[VIR_MAC_STRING_BUFLEN];
+
+    virCheckFlags(0, -1);
+
+    if (virConnectGetAllDHCPLeasesEnsureACL(conn) < 0)
+        return -1;
+
+    if (macs && *macs) {
+        if (!(machash = virHashCreate(16, NULL)))
+            goto cleanup;
+
+        for (i = 0; macs[i]; i++) {
+            if (virMacAddrParse(macs[i], &mac_addr) < 0) {
+                virReportError(VIR_ERR_INVALID_MAC, "%s", macs[i]);
+                goto cleanup;
+            }
+
+            if (virHashUpdateEntry(machash,
+                                   virMacAddrFormat(&mac_addr, mac_str),
+                                   (void *) 1) < 0)
+                goto cleanup;
+        }
+    }
+
+    if (!nets || !*nets) {
+        if ((nallnets = virNetworkObjListExport(conn, driver->networks,
+                                                &allnets,
+                                                virConnectGetAllDHCPLeasesCheckACL,
+                                                VIR_CONNECT_LIST_NETWORKS_ACTIVE)) < 0)
+            goto cleanup;
+        nets = allnets;
+    }
+
+    for (i = 0; nets[i]; i++) {
+        if (!(obj = networkObjFromNetwork(nets[i])))
+            goto cleanup;
+        def = virNetworkObjGetDef(obj);
+
+        if (virConnectGetAllDHCPLeasesCheckACL(conn, def) &&
+            networkDHCPLeasesGather(driver, def, NULL, machash,
+                                    &leases_ret, &nleases) < 0) {
+            virNetworkObjEndAPI(&obj);
+            goto cleanup;
+        }
+
+        virNetworkObjEndAPI(&obj);
+    }
+
+    if (leases_ret) {
+        /* NULL terminated array */
+        ignore_value(VIR_REALLOC_N(leases_ret, nleases + 1));
+        *leases = leases_ret;
+        leases_ret = NULL;
+    }
+
+    rv = nleases;
+
+ cleanup:
+    if (leases_ret) {
+        for (i = 0; i < nleases; i++)
+            virNetworkDHCPLeaseFree(leases_ret[i]);
+        VIR_FREE(leases_ret);
+    }
+    if (allnets) {
+        for (i = 0; i < nallnets; i++)
+            virObjectUnref(allnets[i]);
+        VIR_FREE(allnets);
+    }
+    virHashFree(machash);
+    return rv;
+}
+
+
 /* A unified function to log network connections and disconnections */
 
 static void
@@ -4553,11 +5080,16 @@ networkAllocateActualDevice(virDomainDefPtr dom,
         if (networkCreateInterfacePool(netdef) < 0)
             goto error;
 
-        /* pick first dev with 0 connections */
+        /* pick first dev with 0 connections, preferring one that
+         * is already bound to the stub driver */
         for (i = 0; i < netdef->forward.nifs; i++) {
             if (netdef->forward.ifs[i].connections == 0) {
-                dev = &netdef->forward.ifs[i];
-                break;
+                if (!dev)
+                    dev = &netdef->forward.ifs[i];
+                if (netdef->forward.ifs[i].prebound) {
+                    dev = &netdef->forward.ifs[i];
+                    break;
+                }
             }
         }
         if (!dev) {
@@ -4836,6 +5368,9 @@ networkAllocateActualDevice(virDomainDefPtr dom,
             goto error;
         }
         networkLogAllocation(netdef, actualType, dev, iface, true);
+        /* replace the VF we just gave away */
+        if (actualType == VIR_DOMAIN_NET_TYPE_HOSTDEV)
+            networkPrebindStart(obj);
     }
 
     ret = 0;
@@ -5701,6 +6236,8 @@ static virNetworkDriver networkDriver = {
     .networkIsActive = networkIsActive, /* 0.7.3 */
     .networkIsPersistent = networkIsPersistent, /* 0.7.3 */
     .networkGetDHCPLeases = networkGetDHCPLeases, /* 1.2.6 */
+    .networkUpdateBatch = networkUpdateBatch, /* 4.10.0 */
+    .connectGetAllDHCPLeases = networkConnectGetAllDHCPLeases, /* 4.10.0 */
 };
 
 
@@ -27,6 +27,7 @@
 # include "internal.h"
 # include "virthread.h"
 # include "virdnsmasq.h"
+# include "virhash.h"
 # include "virnetworkobj.h"
 # include "object_event.h"
 
@@ -53,6 +54,9 @@ struct _virNetworkDriverState {
      */
     dnsmasqCapsPtr dnsmasqCaps;
 
+    /* Require lock: parsed custom lease files, by bridge name */
+    virHashTablePtr leaseCache;
+
     /* Immutable pointer, self-locking APIs */
     virObjectEventStatePtr networkEventState;
 };
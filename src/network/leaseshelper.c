@@ -241,6 +241,11 @@ main(int argc, char **argv)
         /* Write to file */
         if (virFileRewriteStr(custom_lease_file, 0644, leases_str) < 0)
             goto cleanup;
+
+        /* Let the NSS module find the lease without parsing all files.
+         * A failed rebuild drops the index, NSS then reads the files. */
+        ignore_value(virLeaseIndexBuild(LOCALSTATEDIR "/lib/libvirt/dnsmasq",
+                                        NULL));
         break;
 
     case VIR_LEASE_ACTION_LAST:
@@ -321,6 +321,11 @@ nodeDeviceGetXMLDesc(virNodeDevicePtr device,
     if (nodeDeviceUpdateDriverName(def) < 0)
         goto cleanup;
 
+#ifdef WITH_UDEV
+    if (udevNodeDeviceFillDetails(def) < 0)
+        goto cleanup;
+#endif
+
     if (virNodeDeviceUpdateCaps(def) < 0)
         goto cleanup;
 
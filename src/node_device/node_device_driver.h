@@ -38,6 +38,9 @@ halNodeRegister(void);
 # ifdef WITH_UDEV
 int
 udevNodeRegister(void);
+
+int
+udevNodeDeviceFillDetails(virNodeDeviceDefPtr def);
 # endif
 
 void
@@ -43,6 +43,7 @@
 #include "virstring.h"
 #include "virnetdev.h"
 #include "virmdev.h"
+#include "virhostcpu.h"
 
 #define VIR_FROM_THIS VIR_FROM_NODEDEV
 
@@ -389,41 +390,27 @@ udevTranslatePCIIds(unsigned int vendor,
 }
 
 
+/* udevFillPCIDetails:
+ * @pci_dev: PCI capability of a device found by udevProcessPCI
+ *
+ * Translates the vendor and product IDs and reads the config space of
+ * the device. Both are rather expensive and only show up in the device
+ * XML, so they are left out of the enumeration and done on demand.
+ */
 static int
-udevProcessPCI(struct udev_device *device,
-               virNodeDeviceDefPtr def)
+udevFillPCIDetails(virNodeDevCapPCIDevPtr pci_dev)
 {
-    virNodeDevCapPCIDevPtr pci_dev = &def->caps->data.pci_dev;
     virPCIEDeviceInfoPtr pci_express = NULL;
     virPCIDevicePtr pciDev = NULL;
     int ret = -1;
-    char *p;
     bool privileged;
 
     nodeDeviceLock();
     privileged = driver->privileged;
     nodeDeviceUnlock();
 
-    if (udevGetUintProperty(device, "PCI_CLASS", &pci_dev->class, 16) < 0)
-        goto cleanup;
-
-    if ((p = strrchr(def->sysfs_path, '/')) == NULL ||
-        virStrToLong_ui(p + 1, &p, 16, &pci_dev->domain) < 0 || p == NULL ||
-        virStrToLong_ui(p + 1, &p, 16, &pci_dev->bus) < 0 || p == NULL ||
-        virStrToLong_ui(p + 1, &p, 16, &pci_dev->slot) < 0 || p == NULL ||
-        virStrToLong_ui(p + 1, &p, 16, &pci_dev->function) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("failed to parse the PCI address from sysfs path: '%s'"),
-                       def->sysfs_path);
-        goto cleanup;
-    }
-
-    if (udevGetUintSysfsAttr(device, "vendor", &pci_dev->vendor, 16) < 0)
-        goto cleanup;
-
-    if (udevGetUintSysfsAttr(device, "device", &pci_dev->product, 16) < 0)
-        goto cleanup;
-
+    VIR_FREE(pci_dev->vendor_name);
+    VIR_FREE(pci_dev->product_name);
     if (udevTranslatePCIIds(pci_dev->vendor,
                             pci_dev->product,
                             &pci_dev->vendor_name,
@@ -431,19 +418,6 @@ udevProcessPCI(struct udev_device *device,
         goto cleanup;
     }
 
-    if (udevGenerateDeviceName(device, def, NULL) != 0)
-        goto cleanup;
-
-    /* The default value is -1, because it can't be 0
-     * as zero is valid node number. */
-    pci_dev->numa_node = -1;
-    if (udevGetIntSysfsAttr(device, "numa_node",
-                            &pci_dev->numa_node, 10) < 0)
-        goto cleanup;
-
-    if (virNodeDeviceGetPCIDynamicCaps(def->sysfs_path, pci_dev) < 0)
-        goto cleanup;
-
     if (!(pciDev = virPCIDeviceNew(pci_dev->domain,
                                    pci_dev->bus,
                                    pci_dev->slot,
@@ -474,12 +448,14 @@ udevProcessPCI(struct udev_device *device,
 
                 pci_express->link_sta->port = -1; /* PCIe can't negotiate port. Yet :) */
             }
+            virPCIEDeviceInfoFree(pci_dev->pci_express);
             pci_dev->flags |= VIR_NODE_DEV_CAP_FLAG_PCIE;
             pci_dev->pci_express = pci_express;
             pci_express = NULL;
         }
     }
 
+    pci_dev->detailsPending = false;
     ret = 0;
 
  cleanup:
@@ -489,6 +465,79 @@ udevProcessPCI(struct udev_device *device,
 }
 
 
+static int
+udevProcessPCI(struct udev_device *device,
+               virNodeDeviceDefPtr def)
+{
+    virNodeDevCapPCIDevPtr pci_dev = &def->caps->data.pci_dev;
+    char *p;
+
+    if (udevGetUintProperty(device, "PCI_CLASS", &pci_dev->class, 16) < 0)
+        return -1;
+
+    if ((p = strrchr(def->sysfs_path, '/')) == NULL ||
+        virStrToLong_ui(p + 1, &p, 16, &pci_dev->domain) < 0 || p == NULL ||
+        virStrToLong_ui(p + 1, &p, 16, &pci_dev->bus) < 0 || p == NULL ||
+        virStrToLong_ui(p + 1, &p, 16, &pci_dev->slot) < 0 || p == NULL ||
+        virStrToLong_ui(p + 1, &p, 16, &pci_dev->function) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to parse the PCI address from sysfs path: '%s'"),
+                       def->sysfs_path);
+        return -1;
+    }
+
+    if (udevGetUintSysfsAttr(device, "vendor", &pci_dev->vendor, 16) < 0)
+        return -1;
+
+    if (udevGetUintSysfsAttr(device, "device", &pci_dev->product, 16) < 0)
+        return -1;
+
+    if (udevGenerateDeviceName(device, def, NULL) != 0)
+        return -1;
+
+    /* The default value is -1, because it can't be 0
+     * as zero is valid node number. */
+    pci_dev->numa_node = -1;
+    if (udevGetIntSysfsAttr(device, "numa_node",
+                            &pci_dev->numa_node, 10) < 0)
+        return -1;
+
+    /* SR-IOV and IOMMU group data is refreshed whenever the device is
+     * looked at anyway, only the mdev types are needed up front so that
+     * listing devices by the mdev_types capability works. */
+    if (virNodeDeviceGetPCIMdevTypesCaps(def->sysfs_path, pci_dev) < 0)
+        return -1;
+
+    pci_dev->detailsPending = true;
+    return 0;
+}
+
+
+/**
+ * udevNodeDeviceFillDetails:
+ * @def: node device definition
+ *
+ * Fills in the capability data udevProcessPCI left out during the
+ * enumeration, if it wasn't done already.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+udevNodeDeviceFillDetails(virNodeDeviceDefPtr def)
+{
+    virNodeDevCapsDefPtr cap;
+
+    for (cap = def->caps; cap; cap = cap->next) {
+        if (cap->data.type == VIR_NODE_DEV_CAP_PCI_DEV &&
+            cap->data.pci_dev.detailsPending &&
+            udevFillPCIDetails(&cap->data.pci_dev) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 drmGetMinorType(int minor)
 {
@@ -1539,6 +1588,10 @@ nodeStateCleanup(void)
     virMutexDestroy(&driver->lock);
     VIR_FREE(driver);
 
+    /* Nobody would invalidate the caches anymore */
+    ignore_value(virPCIDeviceCacheSetEnabled(false));
+    ignore_value(virMediatedDeviceTypeCacheSetEnabled(false));
+
     udevPCITranslateDeinit();
     return 0;
 }
@@ -1548,9 +1601,28 @@ static int
 udevHandleOneDevice(struct udev_device *device)
 {
     const char *action = udev_device_get_action(device);
+    const char *subsystem = udev_device_get_subsystem(device);
 
     VIR_DEBUG("udev action: '%s'", action);
 
+    /* CPU and memory hotplug change the host topology */
+    if (STREQ_NULLABLE(subsystem, "cpu") ||
+        STREQ_NULLABLE(subsystem, "memory"))
+        virHostCPUInvalidateTopologyCache();
+
+    /* PCI hotplug changes what's behind a PCI address and may change
+     * the layout of IOMMU groups */
+    if (STREQ_NULLABLE(subsystem, "pci") &&
+        STRNEQ(action, "bind") && STRNEQ(action, "unbind"))
+        virPCIDeviceCacheInvalidate();
+
+    /* Creating or removing an mdev changes available_instances of its
+     * type, the types of a parent come and go with its vendor driver */
+    if (STREQ_NULLABLE(subsystem, "pci") ||
+        (STREQ_NULLABLE(subsystem, "mdev") &&
+         (STREQ(action, "add") || STREQ(action, "remove"))))
+        virMediatedDeviceTypeCacheInvalidate();
+
     if (STREQ(action, "add") || STREQ(action, "change"))
         return udevAddOneDevice(device);
 
@@ -1921,6 +1993,12 @@ nodeStateInitialize(bool privileged,
 
     virObjectUnlock(priv);
 
+    /* From now on we hear about PCI hotplug and mdev creation and can
+     * keep the PCI device and mdev type caches up to date */
+    if (virPCIDeviceCacheSetEnabled(true) < 0 ||
+        virMediatedDeviceTypeCacheSetEnabled(true) < 0)
+        goto cleanup;
+
     /* Create a fictional 'computer' device to root the device tree. */
     if (udevSetupSystemDev() != 0)
         goto cleanup;
@@ -54,6 +54,14 @@
 #include <netinet/udp.h>
 #include <net/if.h>
 
+#ifdef __linux__
+# include <sys/mman.h>
+# include <sys/socket.h>
+# include <linux/filter.h>
+# include <linux/if_ether.h>
+# include <linux/if_packet.h>
+#endif
+
 #include "viralloc.h"
 #include "virlog.h"
 #include "datatypes.h"
@@ -70,6 +78,7 @@
 #include "configmake.h"
 #include "virtime.h"
 #include "virstring.h"
+#include "intprops.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -81,6 +90,25 @@ VIR_LOG_INIT("nwfilter.nwfilter_dhcpsnoop");
 # define LEASEFILE LEASEFILE_DIR "nwfilter.leases"
 # define TMPLEASEFILE LEASEFILE_DIR "nwfilter.ltmp"
 
+/*
+ * On Linux all snooped interfaces are served by a small, fixed number of
+ * threads that each read from an AF_PACKET socket with a TPACKET_V3
+ * receive ring. The per-interface libpcap threads are only used if the
+ * rings cannot be set up.
+ */
+# if defined(__linux__) && defined(TP_STATUS_BLK_TMO) && defined(PACKET_FANOUT)
+#  define SNOOP_RING_SUPPORTED 1
+# endif
+
+typedef struct _virNWFilterSnoopReq virNWFilterSnoopReq;
+typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
+
+typedef struct _virNWFilterSnoopRing virNWFilterSnoopRing;
+typedef virNWFilterSnoopRing *virNWFilterSnoopRingPtr;
+
+typedef struct _virNWFilterSnoopRingReq virNWFilterSnoopRingReq;
+typedef virNWFilterSnoopRingReq *virNWFilterSnoopRingReqPtr;
+
 struct virNWFilterSnoopState {
     /* lease file */
     int                  leaseFD;
@@ -93,6 +121,20 @@ struct virNWFilterSnoopState {
     virMutex             snoopLock;  /* protects SnoopReqs and IfNameToKey */
     virHashTablePtr      active;
     virMutex             activeLock; /* protects Active */
+    /* lease lines not yet written to the lease file */
+    virBuffer            leaseQueue;
+# ifdef SNOOP_RING_SUPPORTED
+    /* shared packet rings */
+    virNWFilterSnoopRingPtr rings;
+    size_t               nRings;
+    int                  ringsQuit;
+    virThreadPoolPtr     decoder;
+    /* reqs served by the rings; protected by SnoopLock */
+    virNWFilterSnoopReqPtr *ringReqs;
+    size_t               nRingReqs;
+    virHashTablePtr      ifindexToReq;
+    virMutex             ringLock;   /* protects IfindexToReq */
+# endif
 };
 
 # define virNWFilterSnoopLock() \
@@ -114,9 +156,6 @@ struct virNWFilterSnoopState {
 
 # define VIR_IFKEY_LEN   ((VIR_UUID_STRING_BUFLEN) + (VIR_MAC_STRING_BUFLEN))
 
-typedef struct _virNWFilterSnoopReq virNWFilterSnoopReq;
-typedef virNWFilterSnoopReq *virNWFilterSnoopReqPtr;
-
 typedef struct _virNWFilterSnoopIPLease virNWFilterSnoopIPLease;
 typedef virNWFilterSnoopIPLease *virNWFilterSnoopIPLeasePtr;
 
@@ -149,6 +188,8 @@ struct _virNWFilterSnoopReq {
     virCond                              threadStatusCond;
 
     int                                  jobCompletionStatus;
+    /* state used while the packet rings serve the req */
+    virNWFilterSnoopRingReqPtr           ring;
     /* the number of submitted jobs in the worker's queue */
     /*
      * protect those members that can change while the
@@ -169,6 +210,7 @@ struct _virNWFilterSnoopReq {
  * Note about lock-order:
  * 1st: virNWFilterSnoopLock()
  * 2nd: virNWFilterSnoopReqLock(req)
+ * 3rd: the ring lock
  *
  * Rationale: Former protects the SnoopReqs hash, latter its contents
  */
@@ -245,6 +287,7 @@ struct _virNWFilterDHCPDecodeJob {
     int caplen;
     bool fromVM;
     int *qCtr;
+    virNWFilterSnoopReqPtr req; /* set if the job holds a reference */
 };
 
 # define DHCP_PKT_RATE          10 /* pkts/sec */
@@ -277,9 +320,9 @@ struct _virNWFilterSnoopRateLimitConf {
     time_t prev;
     unsigned int pkt_ctr;
     time_t burst;
-    const unsigned int rate;
-    const unsigned int burstRate;
-    const unsigned int burstInterval;
+    unsigned int rate;
+    unsigned int burstRate;
+    unsigned int burstInterval;
 };
 # define SNOOP_POLL_MAX_TIMEOUT_MS  (10 * 1000) /* milliseconds */
 
@@ -296,6 +339,44 @@ struct _virNWFilterSnoopPcapConf {
     unsigned long long penaltyTimeoutAbs;
 };
 
+# ifdef SNOOP_RING_SUPPORTED
+#  define SNOOP_RING_THREADS           2
+#  define SNOOP_RING_BLOCK_SIZE        (64 * 1024)
+#  define SNOOP_RING_BLOCK_NR          8
+#  define SNOOP_RING_FRAME_SIZE        2048
+#  define SNOOP_RING_BLOCK_TMO_MS      50 /* hand over partial blocks */
+#  define SNOOP_RING_POLL_TIMEOUT_MS   1000
+#  define SNOOP_RING_HOUSEKEEPING_MS   1000 /* lease timers & lease file */
+
+struct _virNWFilterSnoopRing {
+    int fd;
+    unsigned char *map;
+    size_t mapLen;
+    unsigned int block; /* next block to look at */
+    bool housekeeper;
+    virThread thread;
+};
+
+enum {
+    SNOOP_RING_FROM_VM,
+    SNOOP_RING_TO_VM,
+
+    SNOOP_RING_LAST
+};
+
+struct _virNWFilterSnoopRingReq {
+    char *key; /* threadkey the req was attached with; NULL if detached */
+    /* protected by the ring lock */
+    int ifindex;
+    virMacAddr mac;
+    virNWFilterSnoopRateLimitConf rateLimit[SNOOP_RING_LAST];
+    unsigned long long penaltyTimeoutAbs[SNOOP_RING_LAST];
+    time_t lastWarned;
+    /* number of jobs in the decoder's queue */
+    int qCtr[SNOOP_RING_LAST];
+};
+# endif /* SNOOP_RING_SUPPORTED */
+
 /* local function prototypes */
 static int virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
                                        virSocketAddrPtr ipaddr,
@@ -307,12 +388,24 @@ static void virNWFilterSnoopReqUnlock(virNWFilterSnoopReqPtr req);
 
 static void virNWFilterSnoopLeaseFileLoad(void);
 static void virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl);
+static void virNWFilterSnoopLeaseFileFlush(void);
 
 /* local variables */
 static struct virNWFilterSnoopState virNWFilterSnoopState = {
     .leaseFD = -1,
+    .leaseQueue = VIR_BUFFER_INITIALIZER,
 };
 
+static bool
+virNWFilterSnoopRingsActive(void)
+{
+# ifdef SNOOP_RING_SUPPORTED
+    return virNWFilterSnoopState.nRings > 0;
+# else
+    return false;
+# endif
+}
+
 static const unsigned char dhcp_magic[4] = { 99, 130, 83, 99 };
 
 
@@ -491,12 +584,17 @@ virNWFilterSnoopIPLeaseInstallRule(virNWFilterSnoopIPLeasePtr ipl,
         goto exit_snooprequnlock;
     }
 
-    /* instantiate the filters */
+    /* update the filters in place if possible, instantiate them otherwise */
 
     if (req->binding->portdevname) {
-        rc = virNWFilterInstantiateFilterLate(req->driver,
-                                              req->binding,
-                                              req->ifindex);
+        rc = virNWFilterUpdateVarLate(req->binding, NWFILTER_VARNAME_IP,
+                                      virNWFilterIPAddrMapGetIPAddr(req->binding->portdevname));
+        if (rc <= 0)
+            rc = virNWFilterInstantiateFilterLate(req->driver,
+                                                  req->binding,
+                                                  req->ifindex);
+        else
+            rc = 0;
     }
 
  exit_snooprequnlock:
@@ -642,6 +740,12 @@ virNWFilterSnoopReqFree(virNWFilterSnoopReqPtr req)
     virCondDestroy(&req->threadStatusCond);
     virFreeError(req->threadError);
 
+# ifdef SNOOP_RING_SUPPORTED
+    if (req->ring)
+        VIR_FREE(req->ring->key);
+    VIR_FREE(req->ring);
+# endif
+
     VIR_FREE(req);
 }
 
@@ -873,14 +977,21 @@ virNWFilterSnoopReqLeaseDel(virNWFilterSnoopReqPtr req,
      * is only generated after req->binding is filled in during
      * virNWFilterDHCPSnoopReq processing */
     if ((virNWFilterIPAddrMapDelIPAddr(req->binding->portdevname, ipstr)) > 0) {
-        ret = virNWFilterInstantiateFilterLate(req->driver,
-                                               req->binding,
-                                               req->ifindex);
+        ret = virNWFilterUpdateVarLate(req->binding, NWFILTER_VARNAME_IP,
+                                       virNWFilterIPAddrMapGetIPAddr(req->binding->portdevname));
+        if (ret <= 0)
+            ret = virNWFilterInstantiateFilterLate(req->driver,
+                                                   req->binding,
+                                                   req->ifindex);
+        else
+            ret = 0;
     } else {
         virNWFilterVarValuePtr dhcpsrvrs =
             virHashLookup(req->binding->filterparams,
                           NWFILTER_VARNAME_DHCPSERVER);
 
+        virNWFilterInstStateReset(req->binding->portdevname);
+
         if (req->techdriver &&
             req->techdriver->applyDHCPOnlyRules(req->binding->portdevname,
                                                 &req->binding->mac,
@@ -1186,6 +1297,7 @@ static void virNWFilterDHCPDecodeWorker(void *jobdata, void *opaque)
  */
 static int
 virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
+                                    virNWFilterSnoopReqPtr req,
                                     virNWFilterSnoopEthHdrPtr pep,
                                     int len, pcap_direction_t dir,
                                     int *qCtr)
@@ -1203,13 +1315,21 @@ virNWFilterSnoopDHCPDecodeJobSubmit(virThreadPoolPtr pool,
     job->caplen = len;
     job->fromVM = (dir == PCAP_D_IN);
     job->qCtr = qCtr;
+    job->req = req;
+
+    if (req)
+        virNWFilterSnoopReqGet(req);
 
     ret = virThreadPoolSendJob(pool, 0, job);
 
-    if (ret == 0)
+    if (ret == 0) {
         virAtomicIntInc(qCtr);
-    else
+    } else {
+        /* the submitter holds another reference, this can't be the last */
+        if (req)
+            ignore_value(virAtomicIntDecAndTest(&req->refctr));
         VIR_FREE(job);
+    }
 
     return ret;
 }
@@ -1263,16 +1383,17 @@ virNWFilterSnoopRateLimit(virNWFilterSnoopRateLimitConfPtr rl)
 /*
  * virNWFilterSnoopRatePenalty
  *
- * @pc: pointer to the virNWFilterSnoopPcapConf
+ * @penaltyTimeoutAbs: pointer to the absolute end of the penalty, e.g.
+ *                     the one of a virNWFilterSnoopPcapConf
  * @diff: the amount of pkts beyond the rate, i.e., if the rate is 10
  *        and 13 pkts have been received now in one seconds, then
  *        this should be 3.
  *
- * Adjusts the timeout the virNWFilterSnooPcapConf will be penalized for
- * sending too many packets.
+ * Adjusts the timeout the sender will be penalized for sending too
+ * many packets.
  */
 static void
-virNWFilterSnoopRatePenalty(virNWFilterSnoopPcapConfPtr pc,
+virNWFilterSnoopRatePenalty(unsigned long long *penaltyTimeoutAbs,
                             unsigned int diff, unsigned int limit)
 {
     if (diff > limit) {
@@ -1280,10 +1401,10 @@ virNWFilterSnoopRatePenalty(virNWFilterSnoopPcapConfPtr pc,
 
         if (virTimeMillisNowRaw(&now) < 0) {
             usleep(PCAP_FLOOD_TIMEOUT_MS); /* 1 ms */
-            pc->penaltyTimeoutAbs = 0;
+            *penaltyTimeoutAbs = 0;
         } else {
             /* don't listen to the fd for 1 ms */
-            pc->penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
+            *penaltyTimeoutAbs = now + PCAP_FLOOD_TIMEOUT_MS;
         }
     }
 }
@@ -1525,7 +1646,8 @@ virNWFilterDHCPSnoopThread(void *req0)
 
                 diff = virNWFilterSnoopRateLimit(&pcapConf[i].rateLimit);
                 if (diff > 0) {
-                    virNWFilterSnoopRatePenalty(&pcapConf[i], diff,
+                    virNWFilterSnoopRatePenalty(&pcapConf[i].penaltyTimeoutAbs,
+                                                diff,
                                                 DHCP_PKT_RATE);
                     /* rate-limited warnings */
                     if (time(0) - last_displayed > 10) {
@@ -1536,7 +1658,7 @@ virNWFilterDHCPSnoopThread(void *req0)
                     continue;
                 }
 
-                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, packet,
+                if (virNWFilterSnoopDHCPDecodeJobSubmit(worker, NULL, packet,
                                                       hdr->caplen,
                                                       pcapConf[i].dir,
                                                       &pcapConf[i].qCtr) < 0) {
@@ -1583,6 +1705,532 @@ virNWFilterDHCPSnoopThread(void *req0)
     return;
 }
 
+# ifdef SNOOP_RING_SUPPORTED
+/*
+ * Classic BPF program accepting IPv4/UDP frames between the DHCP client
+ * and server ports in either direction; it truncates them the same way
+ * the libpcap snaplen does.
+ */
+static struct sock_filter virNWFilterSnoopRingFilter[] = {
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),               /* ether type */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, ETHERTYPE_IP, 0, 13),
+    BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),               /* IP protocol */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 11),
+    BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),               /* fragment */
+    BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 9, 0),
+    BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 14),              /* IP hdr len */
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 14),               /* src port */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 67, 0, 2),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),               /* dst port */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 68, 3, 4),
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 68, 0, 3),
+    BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),               /* dst port */
+    BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 67, 0, 1),
+    BPF_STMT(BPF_RET | BPF_K, PCAP_PBUFSIZE),             /* accept */
+    BPF_STMT(BPF_RET | BPF_K, 0),                         /* drop */
+};
+
+static void
+virNWFilterSnoopRingClose(virNWFilterSnoopRingPtr ring)
+{
+    if (ring->map)
+        munmap(ring->map, ring->mapLen);
+    ring->map = NULL;
+
+    VIR_FORCE_CLOSE(ring->fd);
+}
+
+/*
+ * Open a packet socket with a TPACKET_V3 receive ring. The socket is not
+ * bound to an interface; the sockets of all rings join the same fanout
+ * group so that each frame is only seen by one of them.
+ */
+static int
+virNWFilterSnoopRingOpen(virNWFilterSnoopRingPtr ring, int group)
+{
+    struct sock_fprog prog = {
+        .len = ARRAY_CARDINALITY(virNWFilterSnoopRingFilter),
+        .filter = virNWFilterSnoopRingFilter,
+    };
+    struct tpacket_req3 treq = {
+        .tp_block_size = SNOOP_RING_BLOCK_SIZE,
+        .tp_block_nr = SNOOP_RING_BLOCK_NR,
+        .tp_frame_size = SNOOP_RING_FRAME_SIZE,
+        .tp_frame_nr = (SNOOP_RING_BLOCK_SIZE / SNOOP_RING_FRAME_SIZE) *
+                       SNOOP_RING_BLOCK_NR,
+        .tp_retire_blk_tov = SNOOP_RING_BLOCK_TMO_MS,
+    };
+    int version = TPACKET_V3;
+    int fanout = (group & 0xffff) | (PACKET_FANOUT_HASH << 16);
+
+    ring->fd = socket(AF_PACKET, SOCK_RAW | SOCK_CLOEXEC, htons(ETH_P_ALL));
+    if (ring->fd < 0) {
+        virReportSystemError(errno, "%s", _("cannot open packet socket"));
+        return -1;
+    }
+
+    /* attach the filter first so that nothing else gets queued */
+    if (setsockopt(ring->fd, SOL_SOCKET, SO_ATTACH_FILTER,
+                   &prog, sizeof(prog)) < 0 ||
+        setsockopt(ring->fd, SOL_PACKET, PACKET_VERSION,
+                   &version, sizeof(version)) < 0 ||
+        setsockopt(ring->fd, SOL_PACKET, PACKET_RX_RING,
+                   &treq, sizeof(treq)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot set up packet receive ring"));
+        goto error;
+    }
+
+    ring->mapLen = (size_t)treq.tp_block_size * treq.tp_block_nr;
+    ring->map = mmap(NULL, ring->mapLen, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, ring->fd, 0);
+    if (ring->map == MAP_FAILED) {
+        ring->map = NULL;
+        virReportSystemError(errno, "%s",
+                             _("cannot map packet receive ring"));
+        goto error;
+    }
+
+    if (setsockopt(ring->fd, SOL_PACKET, PACKET_FANOUT,
+                   &fanout, sizeof(fanout)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot join packet fanout group"));
+        goto error;
+    }
+
+    return 0;
+
+ error:
+    virNWFilterSnoopRingClose(ring);
+    return -1;
+}
+
+/*
+ * Worker function of the decoder shared by all reqs served by the
+ * rings; every job holds a reference to its req.
+ */
+static void
+virNWFilterSnoopRingDecodeWorker(void *jobdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    virNWFilterDHCPDecodeJobPtr job = jobdata;
+    virNWFilterSnoopReqPtr req = job->req;
+
+    virNWFilterDHCPDecodeWorker(job, req);
+
+    virNWFilterSnoopReqPut(req);
+}
+
+/*
+ * Hand a frame seen on the interface with the given index to the decoder
+ * if a req is attached to that interface.
+ * Call this function with the ring lock held.
+ */
+static void
+virNWFilterSnoopRingDispatch(int ifindex, bool fromVM,
+                             virNWFilterSnoopEthHdrPtr pep, int len)
+{
+    char key[INT_BUFSIZE_BOUND(ifindex)];
+    virNWFilterSnoopReqPtr req;
+    virNWFilterSnoopRingReqPtr rr;
+    int dir = fromVM ? SNOOP_RING_FROM_VM : SNOOP_RING_TO_VM;
+    unsigned long long now;
+    unsigned int diff;
+
+    snprintf(key, sizeof(key), "%d", ifindex);
+
+    if (!(req = virHashLookup(virNWFilterSnoopState.ifindexToReq, key)))
+        return;
+    rr = req->ring;
+
+    /* don't want to hear about another VM's DHCP requests */
+    if (fromVM && virMacAddrCmp(&rr->mac, &pep->eh_src) != 0)
+        return;
+
+    if (rr->penaltyTimeoutAbs[dir] != 0) {
+        if (virTimeMillisNowRaw(&now) == 0 &&
+            now < rr->penaltyTimeoutAbs[dir])
+            return;
+        rr->penaltyTimeoutAbs[dir] = 0;
+    }
+
+    if (virAtomicIntGet(&rr->qCtr[dir]) > MAX_QUEUED_JOBS) {
+        if (time(0) - rr->lastWarned > 10) {
+            rr->lastWarned = time(0);
+            VIR_WARN("Decoder for interface index %d has a job queue "
+                     "that is too long", ifindex);
+        }
+        return;
+    }
+
+    diff = virNWFilterSnoopRateLimit(&rr->rateLimit[dir]);
+    if (diff > 0) {
+        virNWFilterSnoopRatePenalty(&rr->penaltyTimeoutAbs[dir], diff,
+                                    DHCP_PKT_RATE);
+        if (time(0) - rr->lastWarned > 10) {
+            rr->lastWarned = time(0);
+            VIR_WARN("Too many DHCP packets on interface index %d",
+                     ifindex);
+        }
+        return;
+    }
+
+    if (virNWFilterSnoopDHCPDecodeJobSubmit(virNWFilterSnoopState.decoder,
+                                            req, pep, len,
+                                            fromVM ? PCAP_D_IN : PCAP_D_OUT,
+                                            &rr->qCtr[dir]) < 0)
+        VIR_WARN("Job submission failed on interface index %d", ifindex);
+}
+
+/*
+ * Dispatch all frames of a block the kernel handed over to us.
+ */
+static void
+virNWFilterSnoopRingReadBlock(struct tpacket_block_desc *pbd)
+{
+    struct tpacket3_hdr *ppd;
+    struct sockaddr_ll *sll;
+    uint32_t i;
+
+    VIR_WARNINGS_NO_CAST_ALIGN
+    ppd = (struct tpacket3_hdr *)((unsigned char *)pbd +
+                                  pbd->hdr.bh1.offset_to_first_pkt);
+    VIR_WARNINGS_RESET
+
+    virMutexLock(&virNWFilterSnoopState.ringLock);
+
+    for (i = 0; i < pbd->hdr.bh1.num_pkts; i++) {
+        VIR_WARNINGS_NO_CAST_ALIGN
+        sll = (struct sockaddr_ll *)((unsigned char *)ppd +
+                                     TPACKET_ALIGN(sizeof(*ppd)));
+        VIR_WARNINGS_RESET
+
+        /* frames the tap device sends are those going to the VM */
+        virNWFilterSnoopRingDispatch(sll->sll_ifindex,
+                                     sll->sll_pkttype != PACKET_OUTGOING,
+                                     (virNWFilterSnoopEthHdrPtr)
+                                     ((unsigned char *)ppd + ppd->tp_mac),
+                                     ppd->tp_snaplen);
+
+        VIR_WARNINGS_NO_CAST_ALIGN
+        ppd = (struct tpacket3_hdr *)((unsigned char *)ppd +
+                                      ppd->tp_next_offset);
+        VIR_WARNINGS_RESET
+    }
+
+    virMutexUnlock(&virNWFilterSnoopState.ringLock);
+}
+
+/*
+ * Stop the rings from serving the req. The rings' reference to the req
+ * is handed to the caller.
+ * Call this function with the SnoopLock held.
+ */
+static void
+virNWFilterSnoopRingDetach(virNWFilterSnoopReqPtr req)
+{
+    char key[INT_BUFSIZE_BOUND(int)];
+    size_t i;
+
+    for (i = 0; i < virNWFilterSnoopState.nRingReqs; i++) {
+        if (virNWFilterSnoopState.ringReqs[i] == req)
+            break;
+    }
+    if (i == virNWFilterSnoopState.nRingReqs)
+        return;
+
+    VIR_DELETE_ELEMENT(virNWFilterSnoopState.ringReqs, i,
+                       virNWFilterSnoopState.nRingReqs);
+
+    snprintf(key, sizeof(key), "%d", req->ring->ifindex);
+
+    virMutexLock(&virNWFilterSnoopState.ringLock);
+
+    /* the index may have been taken over by another interface */
+    if (virHashLookup(virNWFilterSnoopState.ifindexToReq, key) == req)
+        ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifindexToReq,
+                                        key));
+
+    virMutexUnlock(&virNWFilterSnoopState.ringLock);
+
+    VIR_FREE(req->ring->key);
+
+    virAtomicIntDecAndTest(&virNWFilterSnoopState.nThreads);
+}
+
+/*
+ * Have the rings serve the req's interface. The caller's reference to
+ * the req is handed over to the rings upon success.
+ * Call this function with the SnoopLock and the req's lock held and
+ * req->threadkey set.
+ */
+static int
+virNWFilterSnoopRingAttach(virNWFilterSnoopReqPtr req)
+{
+    virNWFilterSnoopRingReqPtr rr;
+    char ifindex[INT_BUFSIZE_BOUND(int)];
+    char *key = NULL;
+    size_t i;
+    int rc;
+
+    if (!req->ring && VIR_ALLOC(req->ring) < 0)
+        return -1;
+    rr = req->ring;
+
+    if (VIR_STRDUP(key, req->threadkey) < 0)
+        return -1;
+
+    if (VIR_APPEND_ELEMENT_COPY(virNWFilterSnoopState.ringReqs,
+                                virNWFilterSnoopState.nRingReqs, req) < 0)
+        goto error;
+
+    snprintf(ifindex, sizeof(ifindex), "%d", req->ifindex);
+
+    virMutexLock(&virNWFilterSnoopState.ringLock);
+
+    rr->ifindex = req->ifindex;
+    virMacAddrSet(&rr->mac, &req->binding->mac);
+    for (i = 0; i < SNOOP_RING_LAST; i++) {
+        virNWFilterSnoopRateLimitConf rl = {
+            .prev = time(0),
+            .rate = DHCP_PKT_RATE,
+            .burstRate = DHCP_PKT_BURST,
+            .burstInterval = DHCP_BURST_INTERVAL_S,
+        };
+
+        rr->rateLimit[i] = rl;
+        rr->penaltyTimeoutAbs[i] = 0;
+    }
+
+    /* an interface that went away may still be mapped to the index */
+    rc = virHashUpdateEntry(virNWFilterSnoopState.ifindexToReq, ifindex, req);
+
+    virMutexUnlock(&virNWFilterSnoopState.ringLock);
+
+    if (rc < 0) {
+        VIR_DELETE_ELEMENT(virNWFilterSnoopState.ringReqs,
+                           virNWFilterSnoopState.nRingReqs - 1,
+                           virNWFilterSnoopState.nRingReqs);
+        goto error;
+    }
+
+    rr->key = key;
+    req->jobCompletionStatus = 0;
+
+    virAtomicIntInc(&virNWFilterSnoopState.nThreads);
+
+    return 0;
+
+ error:
+    VIR_FREE(key);
+    return -1;
+}
+
+/*
+ * Run the lease timers of all reqs served by the rings and detach those
+ * that were cancelled or whose rules could not be instantiated, then
+ * write out the leases queued since the last run.
+ */
+static void
+virNWFilterSnoopRingHousekeeping(void)
+{
+    size_t i = 0;
+
+    virNWFilterSnoopLock();
+
+    while (i < virNWFilterSnoopState.nRingReqs) {
+        virNWFilterSnoopReqPtr req = virNWFilterSnoopState.ringReqs[i];
+
+        if (virNWFilterSnoopIsActive(req->ring->key) &&
+            req->jobCompletionStatus == 0) {
+            virNWFilterSnoopReqLeaseTimerRun(req);
+            i++;
+            continue;
+        }
+
+        /* what the per-interface thread does when it ends */
+        virNWFilterSnoopRingDetach(req);
+
+        /* protect req->binding->portdevname & req->threadkey */
+        virNWFilterSnoopReqLock(req);
+
+        virNWFilterSnoopCancel(&req->threadkey);
+
+        if (req->binding->portdevname) {
+            ignore_value(virHashRemoveEntry(virNWFilterSnoopState.ifnameToKey,
+                                            req->binding->portdevname));
+            VIR_FREE(req->binding->portdevname);
+        }
+
+        virNWFilterSnoopReqUnlock(req);
+
+        virNWFilterSnoopReqPut(req);
+    }
+
+    virNWFilterSnoopLeaseFileFlush();
+
+    virNWFilterSnoopUnlock();
+}
+
+/*
+ * The thread reading one of the rings. The first ring's thread also
+ * does the housekeeping for all of them.
+ */
+static void
+virNWFilterSnoopRingThread(void *opaque)
+{
+    virNWFilterSnoopRingPtr ring = opaque;
+    struct pollfd pfd = {
+        .fd = ring->fd,
+        .events = POLLIN | POLLERR,
+    };
+    struct tpacket_block_desc *pbd;
+    unsigned long long now, lastRun = 0;
+
+    while (!virAtomicIntGet(&virNWFilterSnoopState.ringsQuit)) {
+        VIR_WARNINGS_NO_CAST_ALIGN
+        pbd = (struct tpacket_block_desc *)
+            (ring->map + (size_t)ring->block * SNOOP_RING_BLOCK_SIZE);
+        VIR_WARNINGS_RESET
+
+        if (!(pbd->hdr.bh1.block_status & TP_STATUS_USER)) {
+            if (poll(&pfd, 1, SNOOP_RING_POLL_TIMEOUT_MS) < 0 &&
+                errno != EAGAIN && errno != EINTR) {
+                char ebuf[1024];
+
+                VIR_WARN("poll on DHCP snooping socket failed: %s",
+                         virStrerror(errno, ebuf, sizeof(ebuf)));
+            }
+        } else {
+            __sync_synchronize();
+
+            virNWFilterSnoopRingReadBlock(pbd);
+
+            /* hand the block back to the kernel */
+            __sync_synchronize();
+            pbd->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            ring->block = (ring->block + 1) % SNOOP_RING_BLOCK_NR;
+        }
+
+        if (ring->housekeeper &&
+            virTimeMillisNowRaw(&now) == 0 &&
+            now - lastRun >= SNOOP_RING_HOUSEKEEPING_MS) {
+            virNWFilterSnoopRingHousekeeping();
+            lastRun = now;
+        }
+    }
+}
+
+/*
+ * Set up the rings and start their threads. Failure to do so is not an
+ * error; the per-interface libpcap threads are used instead.
+ */
+static void
+virNWFilterSnoopRingsStart(void)
+{
+    virNWFilterSnoopRingPtr rings = NULL;
+    size_t i, nthreads = 0;
+
+    if (virMutexInit(&virNWFilterSnoopState.ringLock) < 0)
+        return;
+
+    if (!(virNWFilterSnoopState.ifindexToReq = virHashCreate(0, NULL)))
+        goto error;
+
+    /* decoding may instantiate rules, don't let one interface stall all */
+    virNWFilterSnoopState.decoder =
+        virThreadPoolNew(1, SNOOP_RING_THREADS, 0,
+                         virNWFilterSnoopRingDecodeWorker, NULL);
+    if (!virNWFilterSnoopState.decoder)
+        goto error;
+
+    if (VIR_ALLOC_N(rings, SNOOP_RING_THREADS) < 0)
+        goto error;
+
+    for (i = 0; i < SNOOP_RING_THREADS; i++)
+        rings[i].fd = -1;
+
+    for (i = 0; i < SNOOP_RING_THREADS; i++) {
+        if (virNWFilterSnoopRingOpen(&rings[i], getpid()) < 0)
+            goto error;
+    }
+
+    rings[0].housekeeper = true;
+
+    for (nthreads = 0; nthreads < SNOOP_RING_THREADS; nthreads++) {
+        if (virThreadCreate(&rings[nthreads].thread, true,
+                            virNWFilterSnoopRingThread,
+                            &rings[nthreads]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("cannot create DHCP snooping thread"));
+            goto error;
+        }
+    }
+
+    virNWFilterSnoopState.rings = rings;
+    virNWFilterSnoopState.nRings = SNOOP_RING_THREADS;
+
+    VIR_DEBUG("Snooping DHCP traffic with %zu packet rings",
+              virNWFilterSnoopState.nRings);
+
+    return;
+
+ error:
+    VIR_WARN("Cannot set up packet rings for DHCP snooping, "
+             "using libpcap: %s", virGetLastErrorMessage());
+    virResetLastError();
+
+    virAtomicIntSet(&virNWFilterSnoopState.ringsQuit, 1);
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&rings[i].thread);
+    virAtomicIntSet(&virNWFilterSnoopState.ringsQuit, 0);
+
+    for (i = 0; rings && i < SNOOP_RING_THREADS; i++)
+        virNWFilterSnoopRingClose(&rings[i]);
+    VIR_FREE(rings);
+
+    virThreadPoolFree(virNWFilterSnoopState.decoder);
+    virNWFilterSnoopState.decoder = NULL;
+
+    virHashFree(virNWFilterSnoopState.ifindexToReq);
+    virNWFilterSnoopState.ifindexToReq = NULL;
+
+    virMutexDestroy(&virNWFilterSnoopState.ringLock);
+}
+
+/*
+ * Stop the rings; all reqs must have been detached before.
+ */
+static void
+virNWFilterSnoopRingsStop(void)
+{
+    size_t i;
+
+    if (!virNWFilterSnoopRingsActive())
+        return;
+
+    virAtomicIntSet(&virNWFilterSnoopState.ringsQuit, 1);
+
+    for (i = 0; i < virNWFilterSnoopState.nRings; i++)
+        virThreadJoin(&virNWFilterSnoopState.rings[i].thread);
+
+    virThreadPoolFree(virNWFilterSnoopState.decoder);
+    virNWFilterSnoopState.decoder = NULL;
+
+    for (i = 0; i < virNWFilterSnoopState.nRings; i++)
+        virNWFilterSnoopRingClose(&virNWFilterSnoopState.rings[i]);
+    VIR_FREE(virNWFilterSnoopState.rings);
+    virNWFilterSnoopState.nRings = 0;
+
+    VIR_FREE(virNWFilterSnoopState.ringReqs);
+    virNWFilterSnoopState.nRingReqs = 0;
+
+    virHashFree(virNWFilterSnoopState.ifindexToReq);
+    virNWFilterSnoopState.ifindexToReq = NULL;
+
+    virMutexDestroy(&virNWFilterSnoopState.ringLock);
+}
+# endif /* SNOOP_RING_SUPPORTED */
+
 static void
 virNWFilterSnoopIFKeyFMT(char *ifkey, const unsigned char *vmuuid,
                          const virMacAddr *macaddr)
@@ -1674,6 +2322,43 @@ virNWFilterDHCPSnoopReq(virNWFilterTechDriverPtr techdriver,
     /* prevent thread from holding req */
     virNWFilterSnoopReqLock(req);
 
+# ifdef SNOOP_RING_SUPPORTED
+    if (virNWFilterSnoopRingsActive()) {
+        if (req->ring && req->ring->key) {
+            /* the rings did not notice yet that the previous snoop ended */
+            virNWFilterSnoopRingDetach(req);
+            virNWFilterSnoopReqPut(req);
+        }
+
+        req->threadkey = virNWFilterSnoopActivate(req);
+        if (!req->threadkey) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Activation of snoop request failed on "
+                             "interface '%s'"), req->binding->portdevname);
+            goto exit_snoopreq_unlock;
+        }
+
+        if (virNWFilterSnoopRingAttach(req) < 0)
+            goto exit_snoop_cancel;
+
+        if (virNWFilterSnoopReqRestore(req) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Restoring of leases failed on "
+                             "interface '%s'"), req->binding->portdevname);
+            virNWFilterSnoopRingDetach(req);
+            goto exit_snoop_cancel;
+        }
+
+        virNWFilterSnoopReqUnlock(req);
+
+        virNWFilterSnoopUnlock();
+
+        /* do not 'put' the req -- the rings will do this */
+
+        return 0;
+    }
+# endif /* SNOOP_RING_SUPPORTED */
+
     if (virThreadCreate(&thread, false, virNWFilterDHCPSnoopThread,
                         req) != 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -1752,53 +2437,106 @@ virNWFilterSnoopLeaseFileOpen(void)
 }
 
 /*
- * Write a single lease to the given file.
- *
+ * Format a single lease as a line of the lease file.
  */
 static int
-virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
-                               virNWFilterSnoopIPLeasePtr ipl)
+virNWFilterSnoopLeaseFormat(virBufferPtr buf, const char *ifkey,
+                            virNWFilterSnoopIPLeasePtr ipl)
 {
-    char *lbuf = NULL;
     char *ipstr, *dhcpstr;
-    int len;
-    int ret = 0;
+    int ret = -1;
 
     ipstr = virSocketAddrFormat(&ipl->ipAddress);
     dhcpstr = virSocketAddrFormat(&ipl->ipServer);
 
-    if (!dhcpstr || !ipstr) {
-        ret = -1;
+    if (!dhcpstr || !ipstr)
         goto cleanup;
-    }
 
     /* time intf ip dhcpserver */
-    len = virAsprintf(&lbuf, "%u %s %s %s\n", ipl->timeout,
+    virBufferAsprintf(buf, "%u %s %s %s\n", ipl->timeout,
                       ifkey, ipstr, dhcpstr);
+    ret = 0;
 
-    if (len < 0) {
-        ret = -1;
+ cleanup:
+    VIR_FREE(dhcpstr);
+    VIR_FREE(ipstr);
+
+    return ret;
+}
+
+/*
+ * Write the formatted leases to the given file with a single write
+ * and empty the buffer.
+ */
+static int
+virNWFilterSnoopLeaseFileWriteBuf(int lfd, virBufferPtr buf)
+{
+    size_t len;
+    int ret = -1;
+
+    if (virBufferCheckError(buf) < 0)
+        goto cleanup;
+
+    len = virBufferUse(buf);
+    if (len == 0) {
+        ret = 0;
         goto cleanup;
     }
 
-    if (safewrite(lfd, lbuf, len) != len) {
+    if (safewrite(lfd, virBufferCurrentContent(buf), len) != len) {
         virReportSystemError(errno, "%s", _("lease file write failed"));
-        ret = -1;
         goto cleanup;
     }
 
     ignore_value(fsync(lfd));
+    ret = 0;
 
  cleanup:
-    VIR_FREE(lbuf);
-    VIR_FREE(dhcpstr);
-    VIR_FREE(ipstr);
+    virBufferFreeAndReset(buf);
 
     return ret;
 }
 
+/*
+ * Write a single lease to the given file.
+ *
+ */
+static int
+virNWFilterSnoopLeaseFileWrite(int lfd, const char *ifkey,
+                               virNWFilterSnoopIPLeasePtr ipl)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+    if (virNWFilterSnoopLeaseFormat(&buf, ifkey, ipl) < 0) {
+        virBufferFreeAndReset(&buf);
+        return -1;
+    }
+
+    return virNWFilterSnoopLeaseFileWriteBuf(lfd, &buf);
+}
+
+/*
+ * Write the leases queued by virNWFilterSnoopLeaseFileSave().
+ * Call this function with the SnoopLock held.
+ */
+static void
+virNWFilterSnoopLeaseFileFlush(void)
+{
+    virBufferPtr queue = &virNWFilterSnoopState.leaseQueue;
+
+    if (!virBufferUse(queue) && !virBufferError(queue))
+        return;
+
+    if (virNWFilterSnoopState.leaseFD < 0)
+        virNWFilterSnoopLeaseFileOpen();
+    ignore_value(virNWFilterSnoopLeaseFileWriteBuf(virNWFilterSnoopState.leaseFD,
+                                                   queue));
+}
+
 /*
  * Append a single lease to the end of the lease file.
+ * While the packet rings are used, the lease is only queued; their
+ * housekeeping writes all queued leases at once.
  * To keep a limited number of dead leases, re-read the lease
  * file if the threshold of active leases versus written ones
  * exceeds a threshold.
@@ -1810,11 +2548,17 @@ virNWFilterSnoopLeaseFileSave(virNWFilterSnoopIPLeasePtr ipl)
 
     virNWFilterSnoopLock();
 
-    if (virNWFilterSnoopState.leaseFD < 0)
-        virNWFilterSnoopLeaseFileOpen();
-    if (virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
-                                       req->ifkey, ipl) < 0)
-        goto err_exit;
+    if (virNWFilterSnoopRingsActive()) {
+        if (virNWFilterSnoopLeaseFormat(&virNWFilterSnoopState.leaseQueue,
+                                        req->ifkey, ipl) < 0)
+            goto err_exit;
+    } else {
+        if (virNWFilterSnoopState.leaseFD < 0)
+            virNWFilterSnoopLeaseFileOpen();
+        if (virNWFilterSnoopLeaseFileWrite(virNWFilterSnoopState.leaseFD,
+                                           req->ifkey, ipl) < 0)
+            goto err_exit;
+    }
 
     /* keep dead leases at < ~95% of file size */
     if (virAtomicIntInc(&virNWFilterSnoopState.wLeases) >=
@@ -1857,7 +2601,7 @@ virNWFilterSnoopPruneIter(const void *payload,
 }
 
 /*
- * Iterator to write all leases of a single request to a file.
+ * Iterator to format all leases of a single request into a buffer.
  * Call this function with the SnoopLock held.
  */
 static int
@@ -1866,14 +2610,14 @@ virNWFilterSnoopSaveIter(void *payload,
                          void *data)
 {
     virNWFilterSnoopReqPtr req = payload;
-    int tfd = *(int *)data;
+    virBufferPtr buf = data;
     virNWFilterSnoopIPLeasePtr ipl;
 
     /* protect req->start */
     virNWFilterSnoopReqLock(req);
 
     for (ipl = req->start; ipl; ipl = ipl->next)
-        ignore_value(virNWFilterSnoopLeaseFileWrite(tfd, req->ifkey, ipl));
+        ignore_value(virNWFilterSnoopLeaseFormat(buf, req->ifkey, ipl));
 
     virNWFilterSnoopReqUnlock(req);
     return 0;
@@ -1887,6 +2631,7 @@ virNWFilterSnoopSaveIter(void *payload,
 static void
 virNWFilterSnoopLeaseFileRefresh(void)
 {
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
     int tfd;
 
     if (virFileMakePathWithMode(LEASEFILE_DIR, 0700) < 0) {
@@ -1904,13 +2649,17 @@ virNWFilterSnoopLeaseFileRefresh(void)
         return;
     }
 
+    /* the queued leases are part of what is written now */
+    virBufferFreeAndReset(&virNWFilterSnoopState.leaseQueue);
+
     if (virNWFilterSnoopState.snoopReqs) {
         /* clean up the requests */
         virHashRemoveSet(virNWFilterSnoopState.snoopReqs,
                          virNWFilterSnoopPruneIter, NULL);
         /* now save them */
         virHashForEach(virNWFilterSnoopState.snoopReqs,
-                       virNWFilterSnoopSaveIter, (void *)&tfd);
+                       virNWFilterSnoopSaveIter, &buf);
+        ignore_value(virNWFilterSnoopLeaseFileWriteBuf(tfd, &buf));
     }
 
     if (VIR_CLOSE(tfd) < 0) {
@@ -2096,6 +2845,10 @@ virNWFilterDHCPSnoopInit(void)
     virNWFilterSnoopLeaseFileLoad();
     virNWFilterSnoopLeaseFileOpen();
 
+# ifdef SNOOP_RING_SUPPORTED
+    virNWFilterSnoopRingsStart();
+# endif
+
     return 0;
 
  err_exit:
@@ -2183,8 +2936,13 @@ virNWFilterDHCPSnoopShutdown(void)
     virNWFilterSnoopEndThreads();
     virNWFilterSnoopJoinThreads();
 
+# ifdef SNOOP_RING_SUPPORTED
+    virNWFilterSnoopRingsStop();
+# endif
+
     virNWFilterSnoopLock();
 
+    virNWFilterSnoopLeaseFileFlush();
     virNWFilterSnoopLeaseFileClose();
     virHashFree(virNWFilterSnoopState.ifnameToKey);
     virHashFree(virNWFilterSnoopState.snoopReqs);
@@ -43,6 +43,7 @@
 #include "virfile.h"
 #include "virstring.h"
 #include "viraccessapicheck.h"
+#include "virconf.h"
 
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_dhcpsnoop.h"
@@ -172,6 +173,31 @@ virNWFilterTriggerRebuildImpl(void *opaque)
 }
 
 
+static int
+nwfilterLoadDriverConfig(const char *filename,
+                         char **backend)
+{
+    virConfPtr conf;
+    int ret = -1;
+
+    /* Avoid error from non-existent or unreadable file. */
+    if (access(filename, R_OK) == -1)
+        return 0;
+
+    conf = virConfReadFile(filename, 0);
+    if (!conf)
+        return -1;
+
+    if (virConfGetValueString(conf, "firewall_backend", backend) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virConfFree(conf);
+    return ret;
+}
+
+
 /**
  * nwfilterStateInitialize:
  *
@@ -183,6 +209,7 @@ nwfilterStateInitialize(bool privileged,
                         void *opaque ATTRIBUTE_UNUSED)
 {
     DBusConnection *sysbus = NULL;
+    char *backend = NULL;
 
     if (virDBusHasSystemBus() &&
         !(sysbus = virDBusGetSystemBus()))
@@ -213,8 +240,13 @@ nwfilterStateInitialize(bool privileged,
     if (virNWFilterDHCPSnoopInit() < 0)
         goto err_exit_learnshutdown;
 
-    if (virNWFilterTechDriversInit(privileged) < 0)
+    if (nwfilterLoadDriverConfig(SYSCONFDIR "/libvirt/nwfilter.conf",
+                                 &backend) < 0 ||
+        virNWFilterTechDriversInit(privileged, backend) < 0) {
+        VIR_FREE(backend);
         goto err_dhcpsnoop_shutdown;
+    }
+    VIR_FREE(backend);
 
     if (virNWFilterConfLayerInit(virNWFilterTriggerRebuildImpl,
                                  driver) < 0)
@@ -2910,7 +2910,7 @@ ebtablesApplyBasicRules(const char *ifname,
     if (ebiptablesAllTeardown(ifname) < 0)
         goto error;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
 
@@ -2983,7 +2983,7 @@ ebtablesApplyDHCPOnlyRules(const char *ifname,
     if (ebiptablesAllTeardown(ifname) < 0)
         goto error;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
     ebtablesCreateTmpRootChainFW(fw, false, ifname);
@@ -3087,7 +3087,7 @@ ebtablesApplyDropAllRules(const char *ifname)
     if (ebiptablesAllTeardown(ifname) < 0)
         goto error;
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
 
     ebtablesCreateTmpRootChainFW(fw, true, ifname);
     ebtablesCreateTmpRootChainFW(fw, false, ifname);
@@ -3425,7 +3425,7 @@ ebiptablesApplyNewRules(const char *ifname,
     ebtablesRemoveTmpRootChainFW(fw, true, ifname);
     ebtablesRemoveTmpRootChainFW(fw, false, ifname);
 
-    virFirewallStartTransaction(fw, 0);
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
 
     /* walk the list of rules and increase the priority
      * of rules in case the chain priority is of higher value;
@@ -32,6 +32,7 @@
 #include "virerror.h"
 #include "nwfilter_gentech_driver.h"
 #include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_nftables_driver.h"
 #include "nwfilter_dhcpsnoop.h"
 #include "nwfilter_ipaddrmap.h"
 #include "nwfilter_learnipaddr.h"
@@ -39,6 +40,7 @@
 #include "datatypes.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
+#include "vircrypto.h"
 
 #define VIR_FROM_THIS VIR_FROM_NWFILTER
 
@@ -54,9 +56,13 @@ static int _virNWFilterTeardownFilter(const char *ifname);
 
 static virNWFilterTechDriverPtr filter_tech_drivers[] = {
     &ebiptables_driver,
+    &nftables_driver,
     NULL
 };
 
+/* The driver instantiating the filters of all interfaces */
+static const char *techDriverName = EBIPTABLES_DRIVER_ID;
+
 /* Serializes instantiation of filters. This is necessary
  * to avoid lock ordering deadlocks. eg virNWFilterInstantiateFilterUpdate
  * will hold a lock on a virNWFilterObjPtr. This in turn invokes
@@ -73,15 +79,80 @@ static virNWFilterTechDriverPtr filter_tech_drivers[] = {
  */
 static virMutex updateMutex;
 
-int virNWFilterTechDriversInit(bool privileged)
+/* A digest of the rules last instantiated on each interface, keyed by
+ * interface name. It allows to skip interfaces whose rules do not change
+ * when a filter they reference is updated. */
+typedef struct _virNWFilterInstState virNWFilterInstState;
+typedef virNWFilterInstState *virNWFilterInstStatePtr;
+struct _virNWFilterInstState {
+    char *active;   /* rules in effect */
+    char *pending;  /* rules applied but not switched to yet */
+};
+
+static virMutex instStatesLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr instStates;
+
+
+static void
+virNWFilterInstStateFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    virNWFilterInstStatePtr state = payload;
+
+    if (!state)
+        return;
+
+    VIR_FREE(state->active);
+    VIR_FREE(state->pending);
+    VIR_FREE(state);
+}
+
+/**
+ * virNWFilterTechDriversInit:
+ * @privileged: whether the driver runs privileged
+ * @drvname: name of the driver to instantiate filters with, or NULL for
+ *           the default
+ *
+ * Initialize the technology drivers. The ebiptables driver is always
+ * initialized since other drivers hand it the rules at the iptables
+ * level.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNWFilterTechDriversInit(bool privileged, const char *drvname)
 {
     size_t i = 0;
     VIR_DEBUG("Initializing NWFilter technology drivers");
-    if (virMutexInitRecursive(&updateMutex) < 0)
+
+    if (!drvname)
+        drvname = EBIPTABLES_DRIVER_ID;
+
+    for (i = 0; filter_tech_drivers[i]; i++) {
+        if (STREQ(filter_tech_drivers[i]->name, drvname))
+            break;
+    }
+    if (!filter_tech_drivers[i]) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("unknown nwfilter firewall backend '%s'"), drvname);
         return -1;
+    }
+    techDriverName = filter_tech_drivers[i]->name;
 
+    if (!(instStates = virHashCreate(0, virNWFilterInstStateFree)))
+        return -1;
+
+    if (virMutexInitRecursive(&updateMutex) < 0) {
+        virHashFree(instStates);
+        instStates = NULL;
+        return -1;
+    }
+
+    VIR_DEBUG("Instantiating filters with the %s driver", techDriverName);
+
+    i = 0;
     while (filter_tech_drivers[i]) {
-        if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED))
+        if (!(filter_tech_drivers[i]->flags & TECHDRV_FLAG_INITIALIZED) &&
+            (filter_tech_drivers[i] == &ebiptables_driver ||
+             STREQ(filter_tech_drivers[i]->name, techDriverName)))
             filter_tech_drivers[i]->init(privileged);
         i++;
     }
@@ -98,6 +169,11 @@ void virNWFilterTechDriversShutdown(void)
         i++;
     }
     virMutexDestroy(&updateMutex);
+
+    virMutexLock(&instStatesLock);
+    virHashFree(instStates);
+    instStates = NULL;
+    virMutexUnlock(&instStatesLock);
 }
 
 
@@ -301,6 +377,156 @@ virNWFilterInstReset(virNWFilterInstPtr inst)
 }
 
 
+/**
+ * virNWFilterInstDigest:
+ * @inst: the expanded rules of a filter
+ *
+ * Compute a digest of the rules and the values of the variables they
+ * access, which is equal for instantiations yielding the same firewall
+ * rules.
+ *
+ * Returns the digest or NULL on error
+ */
+static char *
+virNWFilterInstDigest(virNWFilterInstPtr inst)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *content = NULL;
+    char *digest = NULL;
+    size_t i, j;
+    unsigned int k;
+
+    for (i = 0; i < inst->nrules; i++) {
+        virNWFilterRuleInstPtr rule = inst->rules[i];
+
+        virBufferAsprintf(&buf, "%s %d %d\n", rule->chainSuffix,
+                          rule->chainPriority, rule->priority);
+        virNWFilterRuleDefFormat(&buf, rule->def);
+
+        for (j = 0; j < rule->def->nVarAccess; j++) {
+            virNWFilterVarAccessPtr access = rule->def->varAccess[j];
+            virNWFilterVarValuePtr value;
+
+            virNWFilterVarAccessPrint(access, &buf);
+            value = virHashLookup(rule->vars,
+                                  virNWFilterVarAccessGetVarName(access));
+            for (k = 0; value && k < virNWFilterVarValueGetCardinality(value); k++)
+                virBufferAsprintf(&buf, " %s",
+                                  virNWFilterVarValueGetNthValue(value, k));
+            virBufferAddChar(&buf, '\n');
+        }
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    content = virBufferContentAndReset(&buf);
+    ignore_value(virCryptoHashString(VIR_CRYPTO_HASH_SHA256,
+                                     content ? content : "", &digest));
+    VIR_FREE(content);
+    return digest;
+}
+
+
+static bool
+virNWFilterInstStateIsActive(const char *ifname,
+                             const char *digest)
+{
+    virNWFilterInstStatePtr state;
+    bool ret = false;
+
+    virMutexLock(&instStatesLock);
+    if (instStates && (state = virHashLookup(instStates, ifname)))
+        ret = STREQ_NULLABLE(state->active, digest);
+    virMutexUnlock(&instStatesLock);
+
+    return ret;
+}
+
+
+/*
+ * Record @digest as the rules of the interface; they are in effect if
+ * @active is true and only applied otherwise. Consumes @digest.
+ */
+static void
+virNWFilterInstStateSet(const char *ifname,
+                        char *digest,
+                        bool active)
+{
+    virNWFilterInstStatePtr state;
+
+    virMutexLock(&instStatesLock);
+
+    if (!instStates)
+        goto cleanup;
+
+    if (!(state = virHashLookup(instStates, ifname))) {
+        if (VIR_ALLOC(state) < 0 ||
+            virHashAddEntry(instStates, ifname, state) < 0) {
+            virResetLastError();
+            VIR_FREE(state);
+            goto cleanup;
+        }
+    }
+
+    if (active) {
+        VIR_FREE(state->active);
+        VIR_FREE(state->pending);
+        VIR_STEAL_PTR(state->active, digest);
+    } else {
+        VIR_FREE(state->pending);
+        VIR_STEAL_PTR(state->pending, digest);
+    }
+
+ cleanup:
+    virMutexUnlock(&instStatesLock);
+    VIR_FREE(digest);
+}
+
+
+/*
+ * Make the applied rules of the interface the active ones if @commit is
+ * true, forget about them otherwise.
+ */
+static void
+virNWFilterInstStateSwitch(const char *ifname,
+                           bool commit)
+{
+    virNWFilterInstStatePtr state;
+
+    virMutexLock(&instStatesLock);
+
+    if (instStates && (state = virHashLookup(instStates, ifname)) &&
+        state->pending) {
+        if (commit) {
+            VIR_FREE(state->active);
+            VIR_STEAL_PTR(state->active, state->pending);
+        } else {
+            VIR_FREE(state->pending);
+        }
+    }
+
+    virMutexUnlock(&instStatesLock);
+}
+
+
+/**
+ * virNWFilterInstStateReset:
+ * @ifname: name of the interface
+ *
+ * Forget which rules were instantiated on the interface; call this
+ * whenever rules other than those of its filter are applied to it.
+ */
+void
+virNWFilterInstStateReset(const char *ifname)
+{
+    virMutexLock(&instStatesLock);
+    if (instStates)
+        ignore_value(virHashRemoveEntry(instStates, ifname));
+    virMutexUnlock(&instStatesLock);
+}
+
+
 
 static int
 virNWFilterDefToInst(virNWFilterDriverStatePtr driver,
@@ -580,6 +806,7 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     virNWFilterInst inst;
     bool instantiate = true;
     char *buf;
+    char *digest = NULL;
     virNWFilterVarValuePtr lv;
     const char *learning;
     bool reportIP = false;
@@ -610,6 +837,10 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     if (learning == NULL)
         learning = NWFILTER_DFLT_LEARN;
 
+    /* while the IP address is learned other rules are in effect */
+    if (virHashSize(missing_vars) > 0)
+        virNWFilterInstStateReset(binding->portdevname);
+
     if (virHashSize(missing_vars) == 1) {
         if (virHashLookup(missing_vars,
                           NWFILTER_STD_VAR_IP) != NULL) {
@@ -658,9 +889,19 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
     if (rc < 0)
         goto err_exit;
 
+    if (!(digest = virNWFilterInstDigest(&inst)))
+        virResetLastError();
+
     switch (useNewFilter) {
     case INSTANTIATE_FOLLOW_NEWFILTER:
         instantiate = *foundNewFilter;
+        /* the updated filter may not change the rules of this interface */
+        if (instantiate && digest &&
+            virNWFilterInstStateIsActive(binding->portdevname, digest)) {
+            VIR_DEBUG("Rules of interface %s are unchanged",
+                      binding->portdevname);
+            instantiate = *foundNewFilter = false;
+        }
         break;
     case INSTANTIATE_ALWAYS:
         instantiate = true;
@@ -683,12 +924,20 @@ virNWFilterDoInstantiate(virNWFilterTechDriverPtr techdriver,
             rc = -1;
         }
 
+        if (rc == 0) {
+            virNWFilterInstStateSet(binding->portdevname, digest, teardownOld);
+            digest = NULL;
+        } else {
+            virNWFilterInstStateReset(binding->portdevname);
+        }
+
         virNWFilterUnlockIface(binding->portdevname);
     }
 
  err_exit:
     virNWFilterInstReset(&inst);
     virHashFree(missing_vars);
+    VIR_FREE(digest);
 
     return rc;
 
@@ -720,7 +969,7 @@ virNWFilterInstantiateFilterUpdate(virNWFilterDriverStatePtr driver,
                                    bool *foundNewFilter)
 {
     int rc;
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     virNWFilterTechDriverPtr techdriver;
     virNWFilterObjPtr obj;
     virNWFilterDefPtr filter;
@@ -850,6 +1099,64 @@ virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
 }
 
 
+/**
+ * virNWFilterUpdateVarLate:
+ * @binding: the binding whose filters reference the variable
+ * @varname: name of the variable
+ * @value: the new value of the variable
+ *
+ * Try to have the technology driver apply the new value of a variable
+ * to the active rules of the interface without rebuilding them; this is
+ * used when e.g. the IP addresses of a VM change after they were
+ * learned. On success the new value is recorded in the filter
+ * parameters of @binding.
+ *
+ * Returns 1 if the rules now use the new value, 0 if the filters of the
+ * interface need to be instantiated again and -1 on error.
+ */
+int
+virNWFilterUpdateVarLate(virNWFilterBindingDefPtr binding,
+                         const char *varname,
+                         virNWFilterVarValuePtr value)
+{
+    virNWFilterTechDriverPtr techdriver;
+    virNWFilterVarValuePtr copy = NULL;
+    int rc = 0;
+
+    virNWFilterReadLockFilterUpdates();
+    virMutexLock(&updateMutex);
+
+    techdriver = virNWFilterTechDriverForName(techDriverName);
+    if (!techdriver || !techdriver->updateVariable || !value)
+        goto cleanup;
+
+    if (virNWFilterLockIface(binding->portdevname) < 0) {
+        rc = -1;
+        goto cleanup;
+    }
+
+    rc = techdriver->updateVariable(binding->portdevname, varname, value);
+
+    virNWFilterUnlockIface(binding->portdevname);
+
+    if (rc <= 0)
+        goto cleanup;
+
+    /* keep the parameters in sync like virNWFilterVarHashmapAddStdValues */
+    if (!(copy = virNWFilterVarValueCopy(value)) ||
+        virHashUpdateEntry(binding->filterparams, varname, copy) < 0) {
+        virNWFilterVarValueFree(copy);
+        rc = -1;
+    }
+
+ cleanup:
+    virNWFilterUnlockFilterUpdates();
+    virMutexUnlock(&updateMutex);
+
+    return rc;
+}
+
+
 int
 virNWFilterInstantiateFilter(virNWFilterDriverStatePtr driver,
                              virNWFilterBindingDefPtr binding)
@@ -882,7 +1189,7 @@ virNWFilterUpdateInstantiateFilter(virNWFilterDriverStatePtr driver,
 static int
 virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -901,6 +1208,8 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
     else if (virNWFilterHasLearnReq(ifindex))
         return 0;
 
+    virNWFilterInstStateSwitch(binding->portdevname, false);
+
     return techdriver->tearNewRules(binding->portdevname);
 }
 
@@ -908,7 +1217,7 @@ virNWFilterRollbackUpdateFilter(virNWFilterBindingDefPtr binding)
 static int
 virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     int ifindex;
     virNWFilterTechDriverPtr techdriver;
 
@@ -927,6 +1236,8 @@ virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
     else if (virNWFilterHasLearnReq(ifindex))
         return 0;
 
+    virNWFilterInstStateSwitch(binding->portdevname, true);
+
     return techdriver->tearOldRules(binding->portdevname);
 }
 
@@ -934,7 +1245,7 @@ virNWFilterTearOldFilter(virNWFilterBindingDefPtr binding)
 static int
 _virNWFilterTeardownFilter(const char *ifname)
 {
-    const char *drvname = EBIPTABLES_DRIVER_ID;
+    const char *drvname = techDriverName;
     virNWFilterTechDriverPtr techdriver;
     techdriver = virNWFilterTechDriverForName(drvname);
 
@@ -950,6 +1261,8 @@ _virNWFilterTeardownFilter(const char *ifname)
 
     virNWFilterTerminateLearnReq(ifname);
 
+    virNWFilterInstStateReset(ifname);
+
     if (virNWFilterLockIface(ifname) < 0)
         return -1;
 
@@ -973,6 +1286,64 @@ virNWFilterTeardownFilter(virNWFilterBindingDefPtr binding)
     return ret;
 }
 
+
+#define FILTER_AFFECTED     ((void *)1)
+#define FILTER_NOT_AFFECTED ((void *)2)
+
+/**
+ * virNWFilterIsAffected:
+ * @driver: the driver state pointer
+ * @filtername: name of the filter
+ * @affected: cache of the filters already looked at
+ *
+ * Determine whether the filter or any filter it references, directly or
+ * indirectly, is being updated. The result for every filter visited is
+ * kept in @affected so that filters shared by many bindings are only
+ * looked at once per rebuild.
+ *
+ * Returns 1 if affected, 0 if not and -1 on error
+ */
+static int
+virNWFilterIsAffected(virNWFilterDriverStatePtr driver,
+                      const char *filtername,
+                      virHashTablePtr affected)
+{
+    virNWFilterObjPtr obj;
+    virNWFilterDefPtr def;
+    void *cached;
+    size_t i;
+    int ret = 0;
+
+    if ((cached = virHashLookup(affected, filtername)))
+        return cached == FILTER_AFFECTED;
+
+    if (!(obj = virNWFilterObjListFindInstantiateFilter(driver->nwfilters,
+                                                        filtername)))
+        return -1;
+
+    if (virNWFilterObjGetNewDef(obj)) {
+        ret = 1;
+    } else {
+        def = virNWFilterObjGetDef(obj);
+        for (i = 0; i < def->nentries && ret == 0; i++) {
+            if (def->filterEntries[i]->include)
+                ret = virNWFilterIsAffected(driver,
+                                            def->filterEntries[i]->include->filterref,
+                                            affected);
+        }
+    }
+
+    virNWFilterObjUnlock(obj);
+
+    if (ret >= 0 &&
+        virHashAddEntry(affected, filtername,
+                        ret ? FILTER_AFFECTED : FILTER_NOT_AFFECTED) < 0)
+        return -1;
+
+    return ret;
+}
+
+
 enum {
     STEP_APPLY_NEW,
     STEP_ROLLBACK,
@@ -984,6 +1355,7 @@ static int
 virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
                     virNWFilterBindingDefPtr binding,
                     virHashTablePtr skipInterfaces,
+                    virHashTablePtr affected,
                     int step)
 {
     bool skipIface;
@@ -992,9 +1364,14 @@ virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
 
     switch (step) {
     case STEP_APPLY_NEW:
-        ret = virNWFilterUpdateInstantiateFilter(driver,
-                                                 binding,
-                                                 &skipIface);
+        ret = virNWFilterIsAffected(driver, binding->filter, affected);
+        if (ret > 0) {
+            ret = virNWFilterUpdateInstantiateFilter(driver,
+                                                     binding,
+                                                     &skipIface);
+        } else if (ret == 0) {
+            skipIface = true;
+        }
         if (ret == 0 && skipIface) {
             /* filter tree unchanged -- no update needed */
             ret = virHashAddEntry(skipInterfaces,
@@ -1026,6 +1403,7 @@ virNWFilterBuildOne(virNWFilterDriverStatePtr driver,
 struct virNWFilterBuildData {
     virNWFilterDriverStatePtr driver;
     virHashTablePtr skipInterfaces;
+    virHashTablePtr affected;
     int step;
 };
 
@@ -1036,7 +1414,8 @@ virNWFilterBuildIter(virNWFilterBindingObjPtr binding, void *opaque)
     virNWFilterBindingDefPtr def = virNWFilterBindingObjGetDef(binding);
 
     return virNWFilterBuildOne(data->driver, def,
-                               data->skipInterfaces, data->step);
+                               data->skipInterfaces, data->affected,
+                               data->step);
 }
 
 int
@@ -1051,8 +1430,11 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
     VIR_DEBUG("Build all filters newFilters=%d", newFilters);
 
     if (newFilters) {
-        if (!(data.skipInterfaces = virHashCreate(0, NULL)))
+        if (!(data.skipInterfaces = virHashCreate(0, NULL)) ||
+            !(data.affected = virHashCreate(0, NULL))) {
+            virHashFree(data.skipInterfaces);
             return -1;
+        }
 
         data.step = STEP_APPLY_NEW;
         if (virNWFilterBindingObjListForEach(driver->bindings,
@@ -1073,6 +1455,7 @@ virNWFilterBuildAll(virNWFilterDriverStatePtr driver,
         }
 
         virHashFree(data.skipInterfaces);
+        virHashFree(data.affected);
     } else {
         data.step = STEP_APPLY_CURRENT;
         if (virNWFilterBindingObjListForEach(driver->bindings,
@@ -30,7 +30,7 @@
 
 virNWFilterTechDriverPtr virNWFilterTechDriverForName(const char *name);
 
-int virNWFilterTechDriversInit(bool privileged);
+int virNWFilterTechDriversInit(bool privileged, const char *drvname);
 void virNWFilterTechDriversShutdown(void);
 
 enum instCase {
@@ -49,8 +49,14 @@ int virNWFilterInstantiateFilterLate(virNWFilterDriverStatePtr driver,
                                      virNWFilterBindingDefPtr binding,
                                      int ifindex);
 
+int virNWFilterUpdateVarLate(virNWFilterBindingDefPtr binding,
+                             const char *varname,
+                             virNWFilterVarValuePtr value);
+
 int virNWFilterTeardownFilter(virNWFilterBindingDefPtr binding);
 
+void virNWFilterInstStateReset(const char *ifname);
+
 virHashTablePtr virNWFilterCreateVarHashmap(const char *macaddr,
                                             const virNWFilterVarValue *value);
 
@@ -0,0 +1,2353 @@
+/*
+ * nwfilter_nftables_driver.c: driver for nftables on tap devices
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * All ethernet level rules live in the 'bridge libvirt_nwfilter' table.
+ * Its two base chains dispatch frames through one verdict map per
+ * direction, keyed by the name of the tap device, to a small per
+ * interface link chain. The link chain jumps to the root chain of the
+ * active generation ('a' or 'b') of the interface's rules, so that new
+ * rules can be built next to the active ones and be activated by
+ * rewriting a single rule. Variables that are only matched as a whole
+ * against an IPv4 address are kept in a named set, allowing changes of
+ * e.g. the learned IP addresses of a VM to be applied without rebuilding
+ * any chain. Every change is loaded into the kernel as one atomic nft
+ * script.
+ *
+ * Rules at the iptables / ip6tables level are handed to the ebiptables
+ * driver.
+ */
+
+#include <config.h>
+
+#include "internal.h"
+
+#include "virbuffer.h"
+#include "viralloc.h"
+#include "virlog.h"
+#include "virerror.h"
+#include "nwfilter_conf.h"
+#include "nwfilter_ebiptables_driver.h"
+#include "nwfilter_nftables_driver.h"
+#include "vircommand.h"
+#include "virhash.h"
+#include "intprops.h"
+#include "virsocketaddr.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NWFILTER
+
+VIR_LOG_INIT("nwfilter.nwfilter_nftables_driver");
+
+#define NFT_TABLE_NAME "libvirt_nwfilter"
+#define NFT_TABLE      "bridge " NFT_TABLE_NAME
+
+#define NFT_MAX_NAME_LENGTH 256 /* see NFT_NAME_MAXLEN in linux/netfilter/nf_tables.h */
+
+/* characters the names we embed into nftables object names may contain */
+#define NFT_VALID_NAME \
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_.-"
+
+#define NFT_OTHER_GEN(gen) ((gen) == 'a' ? 'b' : 'a')
+
+enum {
+    NFT_DIR_FROM_VM = 0, /* frames sent by the VM */
+    NFT_DIR_TO_VM,       /* frames sent to the VM */
+
+    NFT_DIR_LAST
+};
+
+static const char *nftablesDirChain[NFT_DIR_LAST] = { "from", "to" };
+static const char *nftablesDirMap[NFT_DIR_LAST] = { "from-vm-if", "to-vm-if" };
+static const char *nftablesDirBaseChain[NFT_DIR_LAST] = { "from-vm", "to-vm" };
+static const char *nftablesDirHook[NFT_DIR_LAST] = {
+    "type filter hook prerouting priority -300;",
+    "type filter hook postrouting priority 300;",
+};
+static const char *nftablesDirIfMatch[NFT_DIR_LAST] = { "iifname", "oifname" };
+
+#define PRINT_NFT_LINK_CHAIN(buf, dir, ifname) \
+    snprintf(buf, sizeof(buf), "%s/%s", nftablesDirChain[dir], ifname)
+#define PRINT_NFT_CHAIN(buf, gen, dir, ifname, suffix) \
+    snprintf(buf, sizeof(buf), "%c/%s/%s%s%s", gen, nftablesDirChain[dir], \
+             ifname, (suffix) ? "/" : "", (suffix) ? (suffix) : "")
+#define PRINT_NFT_SET(buf, ifname, varname) \
+    snprintf(buf, sizeof(buf), "ip/%s/%s", ifname, varname)
+
+#define NFT_CMP_OP(item) (ENTRY_WANT_NEG_SIGN(item) ? "!= " : "")
+
+/* The sub chains of a root chain and which frames are sent to them. As
+ * for the ebtables driver, the chain is selected by prefix matching the
+ * name of the filter. */
+static const struct {
+    const char *prefix;
+    const char *match;
+} nftablesSubChainProtos[] = {
+    { "ipv4", "ether type 0x0800" },
+    { "ipv6", "ether type 0x86dd" },
+    { "arp",  "ether type 0x0806" },
+    { "rarp", "ether type 0x8035" },
+    { "vlan", "ether type 0x8100" },
+    { "stp",  "ether daddr " NWFILTER_MAC_BGA },
+    { "mac",  NULL },
+};
+
+typedef struct _nftablesIface nftablesIface;
+typedef nftablesIface *nftablesIfacePtr;
+struct _nftablesIface {
+    char gen;                    /* generation of the active chains */
+    bool linked[NFT_DIR_LAST];   /* link chain and map element exist */
+
+    char **chains;      /* chains holding the active rules */
+    char **newChains;   /* chains of the other generation */
+    char **sets;        /* variables that have a set in the table */
+    char **setVars;     /* variables the active rules keep in sets */
+    char **newSetVars;  /* variables the new rules keep in sets */
+
+    bool hasNew;        /* new rules are waiting to be activated */
+    bool iptables;      /* the ebiptables driver may hold active rules */
+    bool newIptables;   /* the ebiptables driver holds new rules */
+};
+
+typedef struct _nftablesSubChain nftablesSubChain;
+typedef nftablesSubChain *nftablesSubChainPtr;
+struct _nftablesSubChain {
+    virNWFilterChainPriority priority;
+    int dir;
+    const char *match;
+    const char *suffix;
+};
+
+typedef struct _nftablesAddrItem nftablesAddrItem;
+struct _nftablesAddrItem {
+    nwItemDescPtr addr;
+    nwItemDescPtr mask;
+};
+
+/* Serializes access to the nftables table and the cache below */
+static virMutex nftablesLock = VIR_MUTEX_INITIALIZER;
+
+/* Objects each interface has in the table, keyed by interface name */
+static virHashTablePtr nftablesIfaces;
+
+static int nftablesTearNewRules(const char *ifname);
+
+
+static void
+nftablesIfaceFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    nftablesIfacePtr iface = payload;
+
+    if (!iface)
+        return;
+
+    virStringListFree(iface->chains);
+    virStringListFree(iface->newChains);
+    virStringListFree(iface->sets);
+    virStringListFree(iface->setVars);
+    virStringListFree(iface->newSetVars);
+    VIR_FREE(iface);
+}
+
+
+static void
+nftablesIfaceReset(nftablesIfacePtr iface)
+{
+    virStringListFree(iface->chains);
+    virStringListFree(iface->newChains);
+    virStringListFree(iface->sets);
+    virStringListFree(iface->setVars);
+    virStringListFree(iface->newSetVars);
+    iface->chains = iface->newChains = NULL;
+    iface->sets = iface->setVars = iface->newSetVars = NULL;
+    iface->hasNew = false;
+}
+
+
+/*
+ * Call this function while holding nftablesLock
+ */
+static nftablesIfacePtr
+nftablesIfaceGet(const char *ifname)
+{
+    nftablesIfacePtr iface;
+
+    if ((iface = virHashLookup(nftablesIfaces, ifname)))
+        return iface;
+
+    if (VIR_ALLOC(iface) < 0)
+        return NULL;
+
+    iface->gen = 'a';
+    /* we cannot know what an earlier run left in {ip,ip6}tables */
+    iface->iptables = true;
+
+    if (virHashAddEntry(nftablesIfaces, ifname, iface) < 0) {
+        VIR_FREE(iface);
+        return NULL;
+    }
+
+    return iface;
+}
+
+
+static bool
+nftablesHaveEbiptables(void)
+{
+    return !!(ebiptables_driver.flags & TECHDRV_FLAG_INITIALIZED);
+}
+
+
+static int
+nftablesCheckName(const char *name)
+{
+    if (!*name || strspn(name, NFT_VALID_NAME) != strlen(name)) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("'%s' cannot be used in the name of an nftables "
+                         "object"), name);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * nftablesRunScript:
+ * @buf: buffer holding the nft commands to run
+ *
+ * Load all commands in @buf as a single transaction; either all of them
+ * take effect or none does. The buffer is reset.
+ *
+ * Returns 0 on success, -1 on failure with an error reported
+ */
+static int
+nftablesRunScript(virBufferPtr buf)
+{
+    virCommandPtr cmd = NULL;
+    char *script = NULL;
+    char *error = NULL;
+    int status;
+    int ret = -1;
+
+    if (virBufferCheckError(buf) < 0)
+        return -1;
+
+    if (!(script = virBufferContentAndReset(buf)))
+        return 0;
+
+    VIR_DEBUG("Loading nftables script:\n%s", script);
+
+    cmd = virCommandNewArgList(NFT_PATH, "-f", "/dev/stdin", NULL);
+    virCommandSetInputBuffer(cmd, script);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0)
+        goto cleanup;
+
+    if (status != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to load nftables rules: %s"),
+                       NULLSTR(error));
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandFree(cmd);
+    VIR_FREE(script);
+    VIR_FREE(error);
+    return ret;
+}
+
+
+static void
+nftablesRemoveChainsCmds(virBufferPtr buf, char **chains)
+{
+    size_t i;
+
+    for (i = 0; chains && chains[i]; i++)
+        virBufferAsprintf(buf, "flush chain " NFT_TABLE " %s\n", chains[i]);
+    for (i = 0; chains && chains[i]; i++)
+        virBufferAsprintf(buf, "delete chain " NFT_TABLE " %s\n", chains[i]);
+}
+
+
+static void
+nftablesRemoveSetsCmds(virBufferPtr buf,
+                       const char *ifname,
+                       char **sets,
+                       char **keep)
+{
+    char set[NFT_MAX_NAME_LENGTH];
+    size_t i;
+
+    for (i = 0; sets && sets[i]; i++) {
+        if (virStringListHasString((const char **)keep, sets[i]))
+            continue;
+        PRINT_NFT_SET(set, ifname, sets[i]);
+        virBufferAsprintf(buf, "delete set " NFT_TABLE " %s\n", set);
+    }
+}
+
+
+static void
+nftablesUnlinkCmds(virBufferPtr buf,
+                   nftablesIfacePtr iface,
+                   const char *ifname)
+{
+    char link[NFT_MAX_NAME_LENGTH];
+    int dir;
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        if (!iface->linked[dir])
+            continue;
+        PRINT_NFT_LINK_CHAIN(link, dir, ifname);
+        virBufferAsprintf(buf, "flush chain " NFT_TABLE " %s\n", link);
+    }
+}
+
+
+static void
+nftablesLinkCmds(virBufferPtr buf,
+                 nftablesIfacePtr iface,
+                 const char *ifname,
+                 int dir,
+                 const char *chain)
+{
+    char link[NFT_MAX_NAME_LENGTH];
+
+    PRINT_NFT_LINK_CHAIN(link, dir, ifname);
+
+    if (!iface->linked[dir]) {
+        virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", link);
+        virBufferAsprintf(buf,
+                          "add element " NFT_TABLE " %s { \"%s\" : jump %s }\n",
+                          nftablesDirMap[dir], ifname, link);
+    }
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s jump %s\n", link, chain);
+}
+
+
+/*
+ * Remove everything the table holds for the interface
+ */
+static void
+nftablesTeardownCmds(virBufferPtr buf,
+                     nftablesIfacePtr iface,
+                     const char *ifname)
+{
+    char link[NFT_MAX_NAME_LENGTH];
+    int dir;
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        if (!iface->linked[dir])
+            continue;
+        virBufferAsprintf(buf, "delete element " NFT_TABLE " %s { \"%s\" }\n",
+                          nftablesDirMap[dir], ifname);
+    }
+    nftablesUnlinkCmds(buf, iface, ifname);
+    nftablesRemoveChainsCmds(buf, iface->chains);
+    nftablesRemoveChainsCmds(buf, iface->newChains);
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        if (!iface->linked[dir])
+            continue;
+        PRINT_NFT_LINK_CHAIN(link, dir, ifname);
+        virBufferAsprintf(buf, "delete chain " NFT_TABLE " %s\n", link);
+    }
+    nftablesRemoveSetsCmds(buf, ifname, iface->sets, NULL);
+}
+
+
+static bool
+nftablesValueIsIPv4(const virNWFilterVarValue *value)
+{
+    unsigned int i, n = virNWFilterVarValueGetCardinality(value);
+
+    if (n == 0)
+        return false;
+
+    for (i = 0; i < n; i++) {
+        const char *addr = virNWFilterVarValueGetNthValue(value, i);
+
+        if (!addr || virSocketAddrNumericFamily(addr) != AF_INET)
+            return false;
+    }
+
+    return true;
+}
+
+
+static void
+nftablesFillSetCmds(virBufferPtr buf,
+                    const char *ifname,
+                    const char *varname,
+                    const virNWFilterVarValue *value,
+                    bool create)
+{
+    char set[NFT_MAX_NAME_LENGTH];
+    unsigned int i, j, n = virNWFilterVarValueGetCardinality(value);
+
+    PRINT_NFT_SET(set, ifname, varname);
+
+    if (create)
+        virBufferAsprintf(buf, "add set " NFT_TABLE " %s { type ipv4_addr; }\n",
+                          set);
+    virBufferAsprintf(buf, "flush set " NFT_TABLE " %s\n", set);
+
+    if (n == 0)
+        return;
+
+    virBufferAsprintf(buf, "add element " NFT_TABLE " %s { ", set);
+    for (i = 0; i < n; i++) {
+        const char *addr = virNWFilterVarValueGetNthValue(value, i);
+
+        for (j = 0; j < i; j++) {
+            if (STREQ(addr, virNWFilterVarValueGetNthValue(value, j)))
+                break;
+        }
+        if (j < i)
+            continue;
+
+        virBufferAsprintf(buf, "%s%s", i ? ", " : "", addr);
+    }
+    virBufferAddLit(buf, " }\n");
+}
+
+
+static int
+nftablesPrintDataType(virNWFilterVarCombIterPtr vars,
+                      char *buf, int bufsize,
+                      nwItemDescPtr item,
+                      bool asHex)
+{
+    char *data;
+
+    if ((item->flags & NWFILTER_ENTRY_ITEM_FLAG_HAS_VAR)) {
+        const char *val;
+
+        if (!(val = virNWFilterVarCombIterGetVarValue(vars, item->varAccess)))
+            return -1;
+
+        if (virStrcpy(buf, val, bufsize) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Buffer too small to print variable "
+                             "'%s' into"),
+                           virNWFilterVarAccessGetVarName(item->varAccess));
+            return -1;
+        }
+        return 0;
+    }
+
+    switch (item->datatype) {
+    case DATATYPE_IPADDR:
+    case DATATYPE_IPV6ADDR:
+        if (!(data = virSocketAddrFormat(&item->u.ipaddr)))
+            return -1;
+        if (virStrcpy(buf, data, bufsize) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Buffer too small for IP address"));
+            VIR_FREE(data);
+            return -1;
+        }
+        VIR_FREE(data);
+        break;
+
+    case DATATYPE_MACADDR:
+    case DATATYPE_MACMASK:
+        if (bufsize < VIR_MAC_STRING_BUFLEN) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Buffer too small for MAC address"));
+            return -1;
+        }
+        virMacAddrFormat(&item->u.macaddr, buf);
+        break;
+
+    case DATATYPE_IPV6MASK:
+    case DATATYPE_IPMASK:
+    case DATATYPE_UINT8:
+    case DATATYPE_UINT8_HEX:
+        if (snprintf(buf, bufsize, asHex ? "0x%x" : "%u",
+                     item->u.u8) >= bufsize)
+            goto too_small;
+        break;
+
+    case DATATYPE_UINT16:
+    case DATATYPE_UINT16_HEX:
+        if (snprintf(buf, bufsize, asHex ? "0x%x" : "%u",
+                     item->u.u16) >= bufsize)
+            goto too_small;
+        break;
+
+    case DATATYPE_UINT32:
+    case DATATYPE_UINT32_HEX:
+        if (snprintf(buf, bufsize, asHex ? "0x%x" : "%u",
+                     item->u.u32) >= bufsize)
+            goto too_small;
+        break;
+
+    case DATATYPE_IPSETNAME:
+    case DATATYPE_IPSETFLAGS:
+    case DATATYPE_STRING:
+    case DATATYPE_STRINGCOPY:
+    case DATATYPE_BOOLEAN:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot print data type %x"), item->datatype);
+        return -1;
+    case DATATYPE_LAST:
+    default:
+        virReportEnumRangeError(virNWFilterAttrDataType, item->datatype);
+        return -1;
+    }
+
+    return 0;
+
+ too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("Buffer too small for number"));
+    return -1;
+}
+
+
+static const char *
+nftablesItemVarName(const nwItemDesc *item)
+{
+    if (!HAS_ENTRY_ITEM(item) ||
+        !(item->flags & NWFILTER_ENTRY_ITEM_FLAG_HAS_VAR))
+        return NULL;
+
+    return virNWFilterVarAccessGetVarName(item->varAccess);
+}
+
+
+static int
+nftablesHandleItem(virBufferPtr buf,
+                   virNWFilterVarCombIterPtr vars,
+                   nwItemDescPtr item,
+                   const char *expr,
+                   bool asHex)
+{
+    char value[MAX(INT_BUFSIZE_BOUND(uint32_t), VIR_MAC_STRING_BUFLEN)];
+
+    if (!HAS_ENTRY_ITEM(item))
+        return 0;
+
+    if (nftablesPrintDataType(vars, value, sizeof(value), item, asHex) < 0)
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s", expr, NFT_CMP_OP(item), value);
+    return 0;
+}
+
+
+static int
+nftablesHandleRange(virBufferPtr buf,
+                    virNWFilterVarCombIterPtr vars,
+                    nwItemDescPtr lo,
+                    nwItemDescPtr hi,
+                    const char *expr)
+{
+    char number[INT_BUFSIZE_BOUND(uint32_t)];
+    char numberalt[INT_BUFSIZE_BOUND(uint32_t)];
+
+    if (!HAS_ENTRY_ITEM(lo))
+        return 0;
+
+    if (nftablesPrintDataType(vars, number, sizeof(number), lo, false) < 0)
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s", expr, NFT_CMP_OP(lo), number);
+
+    if (HAS_ENTRY_ITEM(hi)) {
+        if (nftablesPrintDataType(vars, numberalt, sizeof(numberalt),
+                                  hi, false) < 0)
+            return -1;
+        virBufferAsprintf(buf, "-%s", numberalt);
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesHandleMAC(virBufferPtr buf,
+                  virNWFilterVarCombIterPtr vars,
+                  nwItemDescPtr addr,
+                  nwItemDescPtr mask,
+                  const char *expr)
+{
+    char macaddr[VIR_MAC_STRING_BUFLEN];
+    char macmask[VIR_MAC_STRING_BUFLEN];
+    virMacAddr mac, macm;
+    size_t i;
+
+    if (!HAS_ENTRY_ITEM(addr))
+        return 0;
+
+    if (nftablesPrintDataType(vars, macaddr, sizeof(macaddr), addr, false) < 0)
+        return -1;
+
+    if (!HAS_ENTRY_ITEM(mask)) {
+        virBufferAsprintf(buf, " %s %s%s", expr, NFT_CMP_OP(addr), macaddr);
+        return 0;
+    }
+
+    if (nftablesPrintDataType(vars, macmask, sizeof(macmask), mask, false) < 0)
+        return -1;
+
+    if (virMacAddrParse(macaddr, &mac) < 0 ||
+        virMacAddrParse(macmask, &macm) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Cannot parse MAC address '%s/%s'"),
+                       macaddr, macmask);
+        return -1;
+    }
+
+    /* nftables wants the value to compare against to be masked, too */
+    for (i = 0; i < VIR_MAC_BUFLEN; i++)
+        mac.addr[i] &= macm.addr[i];
+    virMacAddrFormat(&mac, macaddr);
+
+    virBufferAsprintf(buf, " %s and %s %s %s", expr, macmask,
+                      ENTRY_WANT_NEG_SIGN(addr) ? "!=" : "==", macaddr);
+    return 0;
+}
+
+
+static int
+nftablesHandleEthHdr(virBufferPtr buf,
+                     virNWFilterVarCombIterPtr vars,
+                     ethHdrDataDefPtr ethHdr,
+                     bool reverse)
+{
+    if (nftablesHandleMAC(buf, vars,
+                          &ethHdr->dataSrcMACAddr, &ethHdr->dataSrcMACMask,
+                          reverse ? "ether daddr" : "ether saddr") < 0 ||
+        nftablesHandleMAC(buf, vars,
+                          &ethHdr->dataDstMACAddr, &ethHdr->dataDstMACMask,
+                          reverse ? "ether saddr" : "ether daddr") < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesHandleIPAddr(virBufferPtr buf,
+                     virNWFilterVarCombIterPtr vars,
+                     nwItemDescPtr addr,
+                     nwItemDescPtr mask,
+                     const char *expr,
+                     const char *ifname,
+                     char **setVars)
+{
+    char ipaddr[INET6_ADDRSTRLEN];
+    char number[INT_BUFSIZE_BOUND(uint32_t)];
+    const char *varname;
+    char set[NFT_MAX_NAME_LENGTH];
+
+    if (!HAS_ENTRY_ITEM(addr))
+        return 0;
+
+    if ((varname = nftablesItemVarName(addr)) &&
+        virStringListHasString((const char **)setVars, varname)) {
+        PRINT_NFT_SET(set, ifname, varname);
+        virBufferAsprintf(buf, " %s @%s", expr, set);
+        return 0;
+    }
+
+    if (nftablesPrintDataType(vars, ipaddr, sizeof(ipaddr), addr, false) < 0)
+        return -1;
+
+    virBufferAsprintf(buf, " %s %s%s", expr, NFT_CMP_OP(addr), ipaddr);
+
+    if (mask && HAS_ENTRY_ITEM(mask)) {
+        if (nftablesPrintDataType(vars, number, sizeof(number),
+                                  mask, false) < 0)
+            return -1;
+        virBufferAsprintf(buf, "/%s", number);
+    }
+
+    return 0;
+}
+
+
+static const char *
+nftablesL4ProtoName(const char *proto)
+{
+    static const struct {
+        const char *number;
+        const char *name;
+    } protos[] = {
+        { "6", "tcp" },
+        { "17", "udp" },
+        { "33", "dccp" },
+        { "132", "sctp" },
+        { "136", "udplite" },
+    };
+    size_t i;
+
+    for (i = 0; i < ARRAY_CARDINALITY(protos); i++) {
+        if (STREQ(proto, protos[i].number) || STREQ(proto, protos[i].name))
+            return protos[i].name;
+    }
+
+    return NULL;
+}
+
+
+static int
+nftablesHandleL4(virBufferPtr buf,
+                 virNWFilterVarCombIterPtr vars,
+                 nwItemDescPtr protocol,
+                 portDataDefPtr portData,
+                 const char *expr,
+                 bool reverse)
+{
+    char number[INT_BUFSIZE_BOUND(uint32_t)];
+    char portexpr[32];
+    const char *l4proto = NULL;
+
+    if (HAS_ENTRY_ITEM(protocol)) {
+        if (nftablesPrintDataType(vars, number, sizeof(number),
+                                  protocol, false) < 0)
+            return -1;
+
+        virBufferAsprintf(buf, " %s %s%s", expr, NFT_CMP_OP(protocol), number);
+
+        if (!ENTRY_WANT_NEG_SIGN(protocol))
+            l4proto = nftablesL4ProtoName(number);
+    }
+
+    if (!HAS_ENTRY_ITEM(&portData->dataSrcPortStart) &&
+        !HAS_ENTRY_ITEM(&portData->dataDstPortStart))
+        return 0;
+
+    if (!l4proto) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("matching ports requires the protocol to be one "
+                         "of tcp, udp, dccp, sctp or udplite"));
+        return -1;
+    }
+
+    snprintf(portexpr, sizeof(portexpr), "%s %s",
+             l4proto, reverse ? "dport" : "sport");
+    if (nftablesHandleRange(buf, vars,
+                            &portData->dataSrcPortStart,
+                            &portData->dataSrcPortEnd,
+                            portexpr) < 0)
+        return -1;
+
+    snprintf(portexpr, sizeof(portexpr), "%s %s",
+             l4proto, reverse ? "sport" : "dport");
+    if (nftablesHandleRange(buf, vars,
+                            &portData->dataDstPortStart,
+                            &portData->dataDstPortEnd,
+                            portexpr) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+nftablesHandleICMPv6(virBufferPtr buf,
+                     virNWFilterVarCombIterPtr vars,
+                     ipv6HdrFilterDefPtr ipv6Hdr)
+{
+    char number[INT_BUFSIZE_BOUND(uint32_t)];
+    char numberalt[INT_BUFSIZE_BOUND(uint32_t)];
+    bool hasType = HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart) ||
+                   HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeEnd);
+    bool hasCode = HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart) ||
+                   HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeEnd);
+    bool neg = ENTRY_WANT_NEG_SIGN(&ipv6Hdr->dataICMPTypeStart);
+
+    if (!hasType && !hasCode)
+        return 0;
+
+    if (neg && hasCode) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("negated ICMPv6 matches cannot include the code"));
+        return -1;
+    }
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart)) {
+        if (nftablesPrintDataType(vars, number, sizeof(number),
+                                  &ipv6Hdr->dataICMPTypeStart, false) < 0)
+            return -1;
+    } else {
+        ignore_value(virStrcpyStatic(number, "0"));
+    }
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeEnd)) {
+        if (nftablesPrintDataType(vars, numberalt, sizeof(numberalt),
+                                  &ipv6Hdr->dataICMPTypeEnd, false) < 0)
+            return -1;
+    } else if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPTypeStart)) {
+        ignore_value(virStrcpyStatic(numberalt, number));
+    } else {
+        ignore_value(virStrcpyStatic(numberalt, "255"));
+    }
+
+    virBufferAsprintf(buf, " icmpv6 type %s%s", neg ? "!= " : "", number);
+    if (STRNEQ(number, numberalt))
+        virBufferAsprintf(buf, "-%s", numberalt);
+
+    if (!hasCode)
+        return 0;
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart)) {
+        if (nftablesPrintDataType(vars, number, sizeof(number),
+                                  &ipv6Hdr->dataICMPCodeStart, false) < 0)
+            return -1;
+    } else {
+        ignore_value(virStrcpyStatic(number, "0"));
+    }
+
+    if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeEnd)) {
+        if (nftablesPrintDataType(vars, numberalt, sizeof(numberalt),
+                                  &ipv6Hdr->dataICMPCodeEnd, false) < 0)
+            return -1;
+    } else if (HAS_ENTRY_ITEM(&ipv6Hdr->dataICMPCodeStart)) {
+        ignore_value(virStrcpyStatic(numberalt, number));
+    } else {
+        ignore_value(virStrcpyStatic(numberalt, "255"));
+    }
+
+    virBufferAsprintf(buf, " icmpv6 code %s", number);
+    if (STRNEQ(number, numberalt))
+        virBufferAsprintf(buf, "-%s", numberalt);
+
+    return 0;
+}
+
+
+static bool
+nftablesHasSTPFields(stpHdrFilterDefPtr stpHdr)
+{
+    return HAS_ENTRY_ITEM(&stpHdr->dataType) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataFlags) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataRootPri) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataRootAddr) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataRootCost) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataSndrPrio) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataSndrAddr) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataPort) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataAge) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataMaxAge) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataHelloTime) ||
+           HAS_ENTRY_ITEM(&stpHdr->dataFwdDelay);
+}
+
+
+static bool
+nftablesHasARPFields(arpHdrFilterDefPtr arpHdr)
+{
+    return HAS_ENTRY_ITEM(&arpHdr->dataHWType) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataProtocolType) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataOpcode) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataARPSrcMACAddr) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataARPSrcIPAddr) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataARPDstMACAddr) ||
+           HAS_ENTRY_ITEM(&arpHdr->dataARPDstIPAddr);
+}
+
+
+/*
+ * nftablesCreateRuleInstance:
+ * @buf: the buffer to add the nft command to
+ * @chain: the chain to add the rule to
+ * @rule: the rule of the filter to convert
+ * @vars: the values of the variables to use
+ * @reverse: whether to swap source and destination
+ * @ifname: the name of the interface the rule applies to
+ * @setVars: variables whose values are matched through a set
+ *
+ * Convert a single ethernet level rule into an nft 'add rule' command.
+ *
+ * Returns 0 on success, -1 with an error reported otherwise
+ */
+static int
+nftablesCreateRuleInstance(virBufferPtr buf,
+                           const char *chain,
+                           virNWFilterRuleDefPtr rule,
+                           virNWFilterVarCombIterPtr vars,
+                           bool reverse,
+                           const char *ifname,
+                           char **setVars)
+{
+    virBuffer match = VIR_BUFFER_INITIALIZER;
+    const char *verdict;
+    char *content = NULL;
+    int ret = -1;
+
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_MAC:
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.ethHdrFilter.ethHdr, reverse) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.ethHdrFilter.dataProtocolID,
+                               "ether type", true) < 0)
+            goto cleanup;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_VLAN:
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.vlanHdrFilter.ethHdr, reverse) < 0)
+            goto cleanup;
+
+        if (!HAS_ENTRY_ITEM(&rule->p.vlanHdrFilter.dataVlanID) &&
+            !HAS_ENTRY_ITEM(&rule->p.vlanHdrFilter.dataVlanEncap))
+            virBufferAddLit(&match, " ether type 0x8100");
+
+        if (nftablesHandleItem(&match, vars,
+                               &rule->p.vlanHdrFilter.dataVlanID,
+                               "vlan id", false) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.vlanHdrFilter.dataVlanEncap,
+                               "vlan type", true) < 0)
+            goto cleanup;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_STP:
+        if (nftablesHasSTPFields(&rule->p.stpHdrFilter)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("the nftables driver cannot match on STP "
+                             "header fields"));
+            goto cleanup;
+        }
+
+        /* cannot handle inout direction with srcmask set in reverse dir.
+           since this clashes with the destination address below... */
+        if (reverse &&
+            HAS_ENTRY_ITEM(&rule->p.stpHdrFilter.ethHdr.dataSrcMACAddr)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("STP filtering in %s direction with "
+                             "source MAC address set is not supported"),
+                           virNWFilterRuleDirectionTypeToString(
+                               VIR_NWFILTER_RULE_DIRECTION_INOUT));
+            goto cleanup;
+        }
+
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.stpHdrFilter.ethHdr, reverse) < 0)
+            goto cleanup;
+
+        virBufferAddLit(&match, " ether daddr " NWFILTER_MAC_BGA);
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_ARP:
+    case VIR_NWFILTER_RULE_PROTOCOL_RARP:
+        if (rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_RARP &&
+            nftablesHasARPFields(&rule->p.arpHdrFilter)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("the nftables driver cannot match on RARP "
+                             "header fields"));
+            goto cleanup;
+        }
+
+        if (HAS_ENTRY_ITEM(&rule->p.arpHdrFilter.dataGratuitousARP) &&
+            rule->p.arpHdrFilter.dataGratuitousARP.u.boolean) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("the nftables driver cannot match on "
+                             "gratuitous ARP"));
+            goto cleanup;
+        }
+
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.arpHdrFilter.ethHdr, reverse) < 0)
+            goto cleanup;
+
+        virBufferAsprintf(&match, " ether type 0x%04x",
+                          rule->prtclType == VIR_NWFILTER_RULE_PROTOCOL_ARP
+                          ? ETHERTYPE_ARP : ETHERTYPE_REVARP);
+
+        if (nftablesHandleItem(&match, vars,
+                               &rule->p.arpHdrFilter.dataHWType,
+                               "arp htype", false) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.arpHdrFilter.dataOpcode,
+                               "arp operation", false) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.arpHdrFilter.dataProtocolType,
+                               "arp ptype", true) < 0 ||
+            nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.arpHdrFilter.dataARPSrcIPAddr,
+                                 &rule->p.arpHdrFilter.dataARPSrcIPMask,
+                                 reverse ? "arp daddr ip" : "arp saddr ip",
+                                 ifname, setVars) < 0 ||
+            nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.arpHdrFilter.dataARPDstIPAddr,
+                                 &rule->p.arpHdrFilter.dataARPDstIPMask,
+                                 reverse ? "arp saddr ip" : "arp daddr ip",
+                                 ifname, setVars) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.arpHdrFilter.dataARPSrcMACAddr,
+                               reverse ? "arp daddr ether" : "arp saddr ether",
+                               false) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.arpHdrFilter.dataARPDstMACAddr,
+                               reverse ? "arp saddr ether" : "arp daddr ether",
+                               false) < 0)
+            goto cleanup;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IP:
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.ipHdrFilter.ethHdr, reverse) < 0)
+            goto cleanup;
+
+        virBufferAddLit(&match, " ether type 0x0800");
+
+        if (nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.ipHdrFilter.ipHdr.dataSrcIPAddr,
+                                 &rule->p.ipHdrFilter.ipHdr.dataSrcIPMask,
+                                 reverse ? "ip daddr" : "ip saddr",
+                                 ifname, setVars) < 0 ||
+            nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.ipHdrFilter.ipHdr.dataDstIPAddr,
+                                 &rule->p.ipHdrFilter.ipHdr.dataDstIPMask,
+                                 reverse ? "ip saddr" : "ip daddr",
+                                 ifname, setVars) < 0 ||
+            nftablesHandleL4(&match, vars,
+                             &rule->p.ipHdrFilter.ipHdr.dataProtocolID,
+                             &rule->p.ipHdrFilter.portData,
+                             "ip protocol", reverse) < 0 ||
+            nftablesHandleItem(&match, vars,
+                               &rule->p.ipHdrFilter.ipHdr.dataDSCP,
+                               "ip dscp", true) < 0)
+            goto cleanup;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_IPV6:
+        if (nftablesHandleEthHdr(&match, vars,
+                                 &rule->p.ipv6HdrFilter.ethHdr, reverse) < 0)
+            goto cleanup;
+
+        virBufferAddLit(&match, " ether type 0x86dd");
+
+        if (nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.ipv6HdrFilter.ipHdr.dataSrcIPAddr,
+                                 &rule->p.ipv6HdrFilter.ipHdr.dataSrcIPMask,
+                                 reverse ? "ip6 daddr" : "ip6 saddr",
+                                 ifname, NULL) < 0 ||
+            nftablesHandleIPAddr(&match, vars,
+                                 &rule->p.ipv6HdrFilter.ipHdr.dataDstIPAddr,
+                                 &rule->p.ipv6HdrFilter.ipHdr.dataDstIPMask,
+                                 reverse ? "ip6 saddr" : "ip6 daddr",
+                                 ifname, NULL) < 0 ||
+            nftablesHandleL4(&match, vars,
+                             &rule->p.ipv6HdrFilter.ipHdr.dataProtocolID,
+                             &rule->p.ipv6HdrFilter.portData,
+                             "ip6 nexthdr", reverse) < 0 ||
+            nftablesHandleICMPv6(&match, vars, &rule->p.ipv6HdrFilter) < 0)
+            goto cleanup;
+        break;
+
+    case VIR_NWFILTER_RULE_PROTOCOL_NONE:
+        break;
+
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected rule protocol %d"),
+                       rule->prtclType);
+        goto cleanup;
+    }
+
+    switch (rule->action) {
+    case VIR_NWFILTER_RULE_ACTION_DROP:
+    case VIR_NWFILTER_RULE_ACTION_REJECT:
+        /* REJECT not supported at the ethernet level */
+        verdict = "drop";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_ACCEPT:
+        verdict = "accept";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_RETURN:
+        verdict = "return";
+        break;
+    case VIR_NWFILTER_RULE_ACTION_CONTINUE:
+        verdict = "continue";
+        break;
+    default:
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected rule action %d"), rule->action);
+        goto cleanup;
+    }
+
+    if (virBufferCheckError(&match) < 0)
+        goto cleanup;
+
+    content = virBufferContentAndReset(&match);
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s%s %s\n",
+                      chain, content ? content : "", verdict);
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&match);
+    VIR_FREE(content);
+    return ret;
+}
+
+
+static size_t
+nftablesGetAddrItems(virNWFilterRuleDefPtr rule,
+                     nftablesAddrItem *items)
+{
+    switch ((int)rule->prtclType) {
+    case VIR_NWFILTER_RULE_PROTOCOL_IP:
+        items[0].addr = &rule->p.ipHdrFilter.ipHdr.dataSrcIPAddr;
+        items[0].mask = &rule->p.ipHdrFilter.ipHdr.dataSrcIPMask;
+        items[1].addr = &rule->p.ipHdrFilter.ipHdr.dataDstIPAddr;
+        items[1].mask = &rule->p.ipHdrFilter.ipHdr.dataDstIPMask;
+        return 2;
+    case VIR_NWFILTER_RULE_PROTOCOL_ARP:
+        items[0].addr = &rule->p.arpHdrFilter.dataARPSrcIPAddr;
+        items[0].mask = &rule->p.arpHdrFilter.dataARPSrcIPMask;
+        items[1].addr = &rule->p.arpHdrFilter.dataARPDstIPAddr;
+        items[1].mask = &rule->p.arpHdrFilter.dataARPDstIPMask;
+        return 2;
+    }
+
+    return 0;
+}
+
+
+static bool
+nftablesRuleRefsVar(const virNWFilterRuleDef *rule,
+                    const char *varname)
+{
+    size_t i;
+
+    for (i = 0; i < rule->nVarAccess; i++) {
+        if (STREQ(virNWFilterVarAccessGetVarName(rule->varAccess[i]), varname))
+            return true;
+    }
+
+    return false;
+}
+
+
+/*
+ * A set can only stand in for a variable in a rule if the rule matches
+ * the variable as a whole against a single IPv4 address field and the
+ * variable is not iterated over together with another one.
+ */
+static bool
+nftablesRuleCanUseSet(virNWFilterRuleDefPtr rule,
+                      const char *varname)
+{
+    nftablesAddrItem items[2];
+    size_t nitems, i;
+    size_t nrefs = 0, naccess = 0;
+
+    if (!virNWFilterRuleIsProtocolEthernet(rule))
+        return false;
+
+    nitems = nftablesGetAddrItems(rule, items);
+    for (i = 0; i < nitems; i++) {
+        nwItemDescPtr item = items[i].addr;
+
+        if (STRNEQ_NULLABLE(nftablesItemVarName(item), varname))
+            continue;
+
+        if (HAS_ENTRY_ITEM(items[i].mask) ||
+            ENTRY_WANT_NEG_SIGN(item) ||
+            virNWFilterVarAccessGetType(item->varAccess) !=
+                VIR_NWFILTER_VAR_ACCESS_ITERATOR ||
+            virNWFilterVarAccessGetIterId(item->varAccess) != 0)
+            return false;
+        nrefs++;
+    }
+
+    if (nrefs != 1)
+        return false;
+
+    for (i = 0; i < rule->nVarAccess; i++) {
+        virNWFilterVarAccessPtr access = rule->varAccess[i];
+
+        if (STREQ(virNWFilterVarAccessGetVarName(access), varname)) {
+            naccess++;
+            continue;
+        }
+        if (virNWFilterVarAccessGetType(access) ==
+                VIR_NWFILTER_VAR_ACCESS_ITERATOR &&
+            virNWFilterVarAccessGetIterId(access) == 0)
+            return false;
+    }
+
+    return naccess == 1;
+}
+
+
+/*
+ * Determine the variables that can be kept in sets and add the commands
+ * creating and filling them; the sets are shared with the active rules
+ * of the interface, which pick up the new values right away.
+ */
+static int
+nftablesAddSetsCmds(virBufferPtr buf,
+                    const char *ifname,
+                    virNWFilterRuleInstPtr *rules,
+                    size_t nrules,
+                    char ***setVars)
+{
+    char **candidates = NULL;
+    nftablesAddrItem items[2];
+    size_t i, j, k, nitems;
+    int ret = -1;
+
+    for (i = 0; i < nrules; i++) {
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+
+        nitems = nftablesGetAddrItems(rules[i]->def, items);
+        for (k = 0; k < nitems; k++) {
+            const char *varname = nftablesItemVarName(items[k].addr);
+
+            if (varname &&
+                !virStringListHasString((const char **)candidates, varname) &&
+                virStringListAdd(&candidates, varname) < 0)
+                goto cleanup;
+        }
+    }
+
+    for (i = 0; candidates && candidates[i]; i++) {
+        const virNWFilterVarValue *value = NULL;
+        bool usable = true;
+
+        for (j = 0; j < nrules && usable; j++) {
+            const virNWFilterVarValue *val;
+
+            if (!nftablesRuleRefsVar(rules[j]->def, candidates[i]))
+                continue;
+
+            val = virHashLookup(rules[j]->vars, candidates[i]);
+            if (!nftablesRuleCanUseSet(rules[j]->def, candidates[i]) ||
+                !val ||
+                (value && !virNWFilterVarValueEqual(value, val)))
+                usable = false;
+            value = val;
+        }
+
+        if (!usable || !value || !nftablesValueIsIPv4(value))
+            continue;
+
+        nftablesFillSetCmds(buf, ifname, candidates[i], value, true);
+
+        if (virStringListAdd(setVars, candidates[i]) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virStringListFree(candidates);
+    return ret;
+}
+
+
+static int
+nftablesRuleInstCommand(virBufferPtr buf,
+                        const char *ifname,
+                        char gen,
+                        virNWFilterRuleInstPtr rule,
+                        char **chains,
+                        char **setVars)
+{
+    virNWFilterVarAccessPtr *varAccess = NULL;
+    size_t nVarAccess = 0;
+    virNWFilterVarCombIterPtr vciter = NULL, tmp;
+    char chain[NFT_MAX_NAME_LENGTH];
+    const char *suffix = NULL;
+    size_t i;
+    int ret = -1;
+
+    /* rules of sub chains with an unknown protocol prefix are ignored as
+     * no frames would ever reach them; variables kept in sets are matched
+     * as a whole and must not be iterated over */
+    for (i = 0; i < rule->def->nVarAccess; i++) {
+        const char *varname =
+            virNWFilterVarAccessGetVarName(rule->def->varAccess[i]);
+
+        if (virStringListHasString((const char **)setVars, varname))
+            continue;
+        if (VIR_APPEND_ELEMENT_COPY(varAccess, nVarAccess,
+                                    rule->def->varAccess[i]) < 0)
+            goto cleanup;
+    }
+
+    if (STRNEQ(rule->chainSuffix,
+               virNWFilterChainSuffixTypeToString(VIR_NWFILTER_CHAINSUFFIX_ROOT)))
+        suffix = rule->chainSuffix;
+
+    /* rule->vars holds all the variables names that this rule will access.
+     * iterate over all combinations of the variables' values and instantiate
+     * the filtering rule with each combination.
+     */
+    tmp = vciter = virNWFilterVarCombIterCreate(rule->vars,
+                                                varAccess, nVarAccess);
+    if (!vciter)
+        goto cleanup;
+
+    do {
+        if (rule->def->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+            rule->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            PRINT_NFT_CHAIN(chain, gen, NFT_DIR_FROM_VM, ifname, suffix);
+            if (virStringListHasString((const char **)chains, chain) &&
+                nftablesCreateRuleInstance(buf, chain, rule->def, tmp,
+                                           rule->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT,
+                                           ifname, setVars) < 0)
+                goto cleanup;
+        }
+
+        if (rule->def->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+            rule->def->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT) {
+            PRINT_NFT_CHAIN(chain, gen, NFT_DIR_TO_VM, ifname, suffix);
+            if (virStringListHasString((const char **)chains, chain) &&
+                nftablesCreateRuleInstance(buf, chain, rule->def, tmp,
+                                           false, ifname, setVars) < 0)
+                goto cleanup;
+        }
+
+        tmp = virNWFilterVarCombIterNext(tmp);
+    } while (tmp != NULL);
+
+    ret = 0;
+ cleanup:
+    virNWFilterVarCombIterFree(vciter);
+    VIR_FREE(varAccess);
+    return ret;
+}
+
+
+static int
+nftablesRuleInstSortPtr(const void *a, const void *b)
+{
+    virNWFilterRuleInst * const *insta = a;
+    virNWFilterRuleInst * const *instb = b;
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    bool root_a = STREQ((*insta)->chainSuffix, root);
+    bool root_b = STREQ((*instb)->chainSuffix, root);
+
+    /* ensure root chain commands appear before all others since
+       we will need them to create the child chains */
+    if (root_a != root_b)
+        return root_a ? -1 : 1;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return (*insta)->priority - (*instb)->priority;
+}
+
+
+static int
+nftablesSubChainSort(const void *a, const void *b)
+{
+    const nftablesSubChain *insta = a;
+    const nftablesSubChain *instb = b;
+
+    /* priorities are limited to range [-1000, 1000] */
+    return insta->priority - instb->priority;
+}
+
+
+static bool
+nftablesRuleHasDir(virNWFilterRuleDefPtr rule, int dir)
+{
+    if (dir == NFT_DIR_FROM_VM)
+        return rule->tt == VIR_NWFILTER_RULE_DIRECTION_OUT ||
+               rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT;
+
+    return rule->tt == VIR_NWFILTER_RULE_DIRECTION_IN ||
+           rule->tt == VIR_NWFILTER_RULE_DIRECTION_INOUT;
+}
+
+
+static int
+nftablesGetSubChains(virNWFilterRuleInstPtr *rules,
+                     size_t nrules,
+                     int dir,
+                     nftablesSubChainPtr *subchains,
+                     size_t *nsubchains)
+{
+    const char *root = virNWFilterChainSuffixTypeToString(
+                                     VIR_NWFILTER_CHAINSUFFIX_ROOT);
+    size_t i, j;
+
+    for (i = 0; i < nrules; i++) {
+        nftablesSubChain sub;
+        size_t proto;
+
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def) ||
+            !nftablesRuleHasDir(rules[i]->def, dir) ||
+            STREQ(rules[i]->chainSuffix, root))
+            continue;
+
+        for (j = 0; j < *nsubchains; j++) {
+            if ((*subchains)[j].dir == dir &&
+                STREQ((*subchains)[j].suffix, rules[i]->chainSuffix))
+                break;
+        }
+        if (j < *nsubchains)
+            continue;
+
+        for (proto = 0; proto < ARRAY_CARDINALITY(nftablesSubChainProtos); proto++) {
+            if (STRPREFIX(rules[i]->chainSuffix,
+                          nftablesSubChainProtos[proto].prefix))
+                break;
+        }
+        if (proto == ARRAY_CARDINALITY(nftablesSubChainProtos))
+            continue;
+
+        if (nftablesCheckName(rules[i]->chainSuffix) < 0)
+            return -1;
+
+        sub.priority = rules[i]->chainPriority;
+        sub.dir = dir;
+        sub.match = nftablesSubChainProtos[proto].match;
+        sub.suffix = rules[i]->chainSuffix;
+
+        if (VIR_APPEND_ELEMENT(*subchains, *nsubchains, sub) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+nftablesCreateSubChainCmds(virBufferPtr buf,
+                           const char *ifname,
+                           char gen,
+                           nftablesSubChainPtr sub,
+                           char ***chains)
+{
+    char rootchain[NFT_MAX_NAME_LENGTH];
+    char chain[NFT_MAX_NAME_LENGTH];
+
+    PRINT_NFT_CHAIN(rootchain, gen, sub->dir, ifname, NULL);
+    PRINT_NFT_CHAIN(chain, gen, sub->dir, ifname, sub->suffix);
+
+    virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", chain);
+    virBufferAsprintf(buf, "add rule " NFT_TABLE " %s%s%s jump %s\n",
+                      rootchain, sub->match ? " " : "",
+                      sub->match ? sub->match : "", chain);
+
+    return virStringListAdd(chains, chain);
+}
+
+
+static int
+nftablesApplyNewRules(const char *ifname,
+                      virNWFilterRuleInstPtr *rules,
+                      size_t nrules)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    nftablesSubChainPtr subchains = NULL;
+    size_t nsubchains = 0;
+    virNWFilterRuleInstPtr *l3rules = NULL;
+    size_t nl3rules = 0;
+    char **chains = NULL;
+    char **setVars = NULL;
+    char chain[NFT_MAX_NAME_LENGTH];
+    char gen;
+    size_t i, j;
+    int dir;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    if (nrules)
+        qsort(rules, nrules, sizeof(rules[0]), nftablesRuleInstSortPtr);
+
+    /* walk the list of rules and increase the priority
+     * of rules in case the chain priority is of higher value;
+     * this preserves the order of the rules and ensures that
+     * the chain will be created before the chain's rules
+     * are created; don't adjust rules in the root chain
+     */
+    for (i = 0; i < nrules; i++) {
+        if (rules[i]->chainPriority > rules[i]->priority &&
+            !strstr("root", rules[i]->chainSuffix))
+            rules[i]->priority = rules[i]->chainPriority;
+    }
+
+    for (i = 0; i < nrules; i++) {
+        if (virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+        if (VIR_APPEND_ELEMENT_COPY(l3rules, nl3rules, rules[i]) < 0)
+            goto cleanup;
+    }
+
+    if (nl3rules && !nftablesHaveEbiptables()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("iptables and ip6tables rules require the "
+                         "ebiptables driver, which is not available"));
+        goto cleanup;
+    }
+
+    virMutexLock(&nftablesLock);
+
+    if (!(iface = nftablesIfaceGet(ifname)))
+        goto unlock;
+
+    gen = NFT_OTHER_GEN(iface->gen);
+
+    /* cleanup whatever may exist */
+    nftablesRemoveChainsCmds(&buf, iface->newChains);
+
+    if (nftablesAddSetsCmds(&buf, ifname, rules, nrules, &setVars) < 0)
+        goto unlock;
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        for (i = 0; i < nrules; i++) {
+            if (virNWFilterRuleIsProtocolEthernet(rules[i]->def) &&
+                nftablesRuleHasDir(rules[i]->def, dir))
+                break;
+        }
+        if (i == nrules)
+            continue;
+
+        PRINT_NFT_CHAIN(chain, gen, dir, ifname, NULL);
+        virBufferAsprintf(&buf, "add chain " NFT_TABLE " %s\n", chain);
+        if (virStringListAdd(&chains, chain) < 0)
+            goto unlock;
+
+        if (nftablesGetSubChains(rules, nrules, dir,
+                                 &subchains, &nsubchains) < 0)
+            goto unlock;
+    }
+
+    if (nsubchains > 0)
+        qsort(subchains, nsubchains, sizeof(subchains[0]),
+              nftablesSubChainSort);
+
+    /* interleave the rules with the creation of the sub chains so that
+     * the jumps into the sub chains end up at the right position */
+    for (i = 0, j = 0; i < nrules; i++) {
+        if (!virNWFilterRuleIsProtocolEthernet(rules[i]->def))
+            continue;
+
+        while (j < nsubchains &&
+               subchains[j].priority <= rules[i]->priority) {
+            if (nftablesCreateSubChainCmds(&buf, ifname, gen,
+                                           &subchains[j], &chains) < 0)
+                goto unlock;
+            j++;
+        }
+
+        if (nftablesRuleInstCommand(&buf, ifname, gen,
+                                    rules[i], chains, setVars) < 0)
+            goto unlock;
+    }
+    while (j < nsubchains) {
+        if (nftablesCreateSubChainCmds(&buf, ifname, gen,
+                                       &subchains[j], &chains) < 0)
+            goto unlock;
+        j++;
+    }
+
+    if (nftablesRunScript(&buf) < 0)
+        goto unlock;
+
+    for (i = 0; setVars && setVars[i]; i++) {
+        if (!virStringListHasString((const char **)iface->sets, setVars[i]) &&
+            virStringListAdd(&iface->sets, setVars[i]) < 0)
+            goto unlock;
+    }
+
+    virStringListFree(iface->newChains);
+    VIR_STEAL_PTR(iface->newChains, chains);
+    virStringListFree(iface->newSetVars);
+    VIR_STEAL_PTR(iface->newSetVars, setVars);
+    iface->hasNew = true;
+    iface->newIptables = nl3rules > 0;
+
+    ret = 0;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+
+    if (ret == 0 && nl3rules > 0 &&
+        ebiptables_driver.applyNewRules(ifname, l3rules, nl3rules) < 0) {
+        nftablesTearNewRules(ifname);
+        ret = -1;
+    }
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(subchains);
+    VIR_FREE(l3rules);
+    virStringListFree(chains);
+    virStringListFree(setVars);
+    return ret;
+}
+
+
+
+/*
+ * Forget the variables in @vars that have a set in the table, unless
+ * @keep still references them
+ */
+static void
+nftablesForgetSets(nftablesIfacePtr iface,
+                   char **vars,
+                   char **keep)
+{
+    size_t i;
+
+    for (i = 0; vars && vars[i]; i++) {
+        if (!virStringListHasString((const char **)keep, vars[i]))
+            virStringListRemove(&iface->sets, vars[i]);
+    }
+}
+
+
+static int
+nftablesTearNewRules(const char *ifname)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    bool iptables = false;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    if (!(iface = virHashLookup(nftablesIfaces, ifname))) {
+        virMutexUnlock(&nftablesLock);
+        return 0;
+    }
+
+    iptables = iface->newIptables;
+
+    nftablesRemoveChainsCmds(&buf, iface->newChains);
+    nftablesRemoveSetsCmds(&buf, ifname, iface->newSetVars, iface->setVars);
+
+    if (nftablesRunScript(&buf) < 0)
+        goto unlock;
+
+    nftablesForgetSets(iface, iface->newSetVars, iface->setVars);
+    virStringListFree(iface->newChains);
+    virStringListFree(iface->newSetVars);
+    iface->newChains = iface->newSetVars = NULL;
+    iface->hasNew = false;
+    iface->newIptables = false;
+
+    ret = 0;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+
+    if (ret == 0 && iptables &&
+        ebiptables_driver.tearNewRules(ifname) < 0)
+        ret = -1;
+
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+static int
+nftablesTearOldRules(const char *ifname)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    char chain[NFT_MAX_NAME_LENGTH];
+    char gen;
+    bool iptables = false, newIptables = false;
+    int dir;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    /* switch to new rules only if there are any */
+    if (!(iface = virHashLookup(nftablesIfaces, ifname)) || !iface->hasNew) {
+        virMutexUnlock(&nftablesLock);
+        return 0;
+    }
+
+    gen = NFT_OTHER_GEN(iface->gen);
+
+    nftablesUnlinkCmds(&buf, iface, ifname);
+    nftablesRemoveChainsCmds(&buf, iface->chains);
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        PRINT_NFT_CHAIN(chain, gen, dir, ifname, NULL);
+        if (!virStringListHasString((const char **)iface->newChains, chain))
+            continue;
+        nftablesLinkCmds(&buf, iface, ifname, dir, chain);
+    }
+
+    nftablesRemoveSetsCmds(&buf, ifname, iface->setVars, iface->newSetVars);
+
+    if (nftablesRunScript(&buf) < 0)
+        goto unlock;
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        PRINT_NFT_CHAIN(chain, gen, dir, ifname, NULL);
+        if (virStringListHasString((const char **)iface->newChains, chain))
+            iface->linked[dir] = true;
+    }
+
+    nftablesForgetSets(iface, iface->setVars, iface->newSetVars);
+    virStringListFree(iface->chains);
+    VIR_STEAL_PTR(iface->chains, iface->newChains);
+    virStringListFree(iface->setVars);
+    VIR_STEAL_PTR(iface->setVars, iface->newSetVars);
+    iface->gen = gen;
+    iface->hasNew = false;
+
+    iptables = iface->iptables;
+    newIptables = iface->newIptables;
+    iface->iptables = newIptables;
+    iface->newIptables = false;
+
+    ret = 0;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+
+    if (ret == 0 && (iptables || newIptables) && nftablesHaveEbiptables() &&
+        ebiptables_driver.tearOldRules(ifname) < 0)
+        ret = -1;
+
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+/*
+ * Run @buf after adding the commands that remove everything the table
+ * holds for the interface. Call this function while holding nftablesLock.
+ */
+static int
+nftablesReplaceAll(virBufferPtr buf,
+                   nftablesIfacePtr iface,
+                   const char *ifname,
+                   virBufferPtr rules)
+{
+    char *content = NULL;
+    int ret = -1;
+
+    nftablesUnlinkCmds(buf, iface, ifname);
+    nftablesRemoveChainsCmds(buf, iface->chains);
+    nftablesRemoveChainsCmds(buf, iface->newChains);
+    nftablesRemoveSetsCmds(buf, ifname, iface->sets, NULL);
+
+    if (virBufferCheckError(rules) < 0)
+        goto cleanup;
+    content = virBufferContentAndReset(rules);
+    virBufferAdd(buf, content, -1);
+
+    if (nftablesRunScript(buf) < 0)
+        goto cleanup;
+
+    nftablesIfaceReset(iface);
+    iface->gen = 'a';
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(content);
+    return ret;
+}
+
+
+/*
+ * Add the commands creating the root chain of generation 'a' for the
+ * given direction and linking it into the table; the chain is recorded
+ * in @chains.
+ */
+static int
+nftablesBasicChainCmds(virBufferPtr buf,
+                       nftablesIfacePtr iface,
+                       const char *ifname,
+                       int dir,
+                       char *chain,
+                       size_t chainlen,
+                       char ***chains)
+{
+    snprintf(chain, chainlen, "a/%s/%s", nftablesDirChain[dir], ifname);
+
+    virBufferAsprintf(buf, "add chain " NFT_TABLE " %s\n", chain);
+    nftablesLinkCmds(buf, iface, ifname, dir, chain);
+
+    return virStringListAdd(chains, chain);
+}
+
+
+/*
+ * Replace all rules of the interface with the ones in @rules, which
+ * create and populate the root chains of generation 'a' listed in
+ * @chains.
+ */
+static int
+nftablesApplySimpleRules(const char *ifname,
+                         virBufferPtr rules,
+                         char **chains)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    bool iptables;
+    int dir;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    if (!(iface = nftablesIfaceGet(ifname)))
+        goto unlock;
+
+    iptables = iface->iptables || iface->newIptables;
+
+    if (nftablesReplaceAll(&buf, iface, ifname, rules) < 0)
+        goto unlock;
+
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        char chain[NFT_MAX_NAME_LENGTH];
+
+        PRINT_NFT_CHAIN(chain, 'a', dir, ifname, NULL);
+        if (virStringListHasString((const char **)chains, chain))
+            iface->linked[dir] = true;
+    }
+    if (virStringListCopy(&iface->chains, (const char **)chains) < 0)
+        goto unlock;
+    iface->iptables = iface->newIptables = false;
+
+    ret = 0;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+
+    /* the rules above replace whatever filter was active, including the
+     * part of it that was handed to the ebiptables driver */
+    if (ret == 0 && iptables && nftablesHaveEbiptables())
+        ignore_value(ebiptables_driver.allTeardown(ifname));
+
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+/**
+ * nftablesApplyBasicRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply basic filtering rules on the given interface
+ * - filtering for MAC address spoofing
+ * - allowing IPv4 & ARP traffic
+ */
+static int
+nftablesApplyBasicRules(const char *ifname,
+                        const virMacAddr *macaddr)
+{
+    virBuffer rules = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    char chain[NFT_MAX_NAME_LENGTH];
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    char **chains = NULL;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    virMutexLock(&nftablesLock);
+    iface = nftablesIfaceGet(ifname);
+    if (iface &&
+        nftablesBasicChainCmds(&rules, iface, ifname, NFT_DIR_FROM_VM,
+                               chain, sizeof(chain), &chains) < 0)
+        iface = NULL;
+    virMutexUnlock(&nftablesLock);
+    if (!iface)
+        goto cleanup;
+
+    virBufferAsprintf(&rules,
+                      "add rule " NFT_TABLE " %s ether saddr != %s drop\n",
+                      chain, macaddr_str);
+    virBufferAsprintf(&rules,
+                      "add rule " NFT_TABLE " %s ether type 0x0800 accept\n",
+                      chain);
+    virBufferAsprintf(&rules,
+                      "add rule " NFT_TABLE " %s ether type 0x0806 accept\n",
+                      chain);
+    virBufferAsprintf(&rules, "add rule " NFT_TABLE " %s drop\n", chain);
+
+    if (nftablesApplySimpleRules(ifname, &rules, chains) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&rules);
+    virStringListFree(chains);
+    return ret;
+}
+
+
+/**
+ * nftablesApplyDHCPOnlyRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ * @macaddr: MAC address the VM is using in packets sent through the
+ *    interface
+ * @dhcpsrvrs: The DHCP server(s) from which the VM may receive traffic;
+ *    may be NULL
+ * @leaveTemporary: Whether to leave the table names with their temporary
+ *    names (parameter is ignored; the rules are always activated at once)
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM can only send and receive
+ * DHCP traffic and nothing else.
+ */
+static int
+nftablesApplyDHCPOnlyRules(const char *ifname,
+                           const virMacAddr *macaddr,
+                           virNWFilterVarValuePtr dhcpsrvrs,
+                           bool leaveTemporary ATTRIBUTE_UNUSED)
+{
+    virBuffer rules = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    char chain_in[NFT_MAX_NAME_LENGTH];
+    char chain_out[NFT_MAX_NAME_LENGTH];
+    char macaddr_str[VIR_MAC_STRING_BUFLEN];
+    const char *dstmacs[] = { macaddr_str, "ff:ff:ff:ff:ff:ff" };
+    unsigned int i, j, n = 0;
+    char **chains = NULL;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    if (dhcpsrvrs) {
+        n = virNWFilterVarValueGetCardinality(dhcpsrvrs);
+        for (i = 0; i < n; i++) {
+            const char *srv = virNWFilterVarValueGetNthValue(dhcpsrvrs, i);
+
+            if (!srv || virSocketAddrNumericFamily(srv) != AF_INET) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("invalid DHCP server address '%s'"),
+                               NULLSTR(srv));
+                return -1;
+            }
+        }
+    }
+
+    virMacAddrFormat(macaddr, macaddr_str);
+
+    virMutexLock(&nftablesLock);
+    iface = nftablesIfaceGet(ifname);
+    if (iface &&
+        (nftablesBasicChainCmds(&rules, iface, ifname, NFT_DIR_FROM_VM,
+                                chain_in, sizeof(chain_in), &chains) < 0 ||
+         nftablesBasicChainCmds(&rules, iface, ifname, NFT_DIR_TO_VM,
+                                chain_out, sizeof(chain_out), &chains) < 0))
+        iface = NULL;
+    virMutexUnlock(&nftablesLock);
+    if (!iface)
+        goto cleanup;
+
+    virBufferAsprintf(&rules,
+                      "add rule " NFT_TABLE " %s ether saddr %s "
+                      "ether type 0x0800 ip protocol udp "
+                      "udp sport 68 udp dport 67 accept\n",
+                      chain_in, macaddr_str);
+    virBufferAsprintf(&rules, "add rule " NFT_TABLE " %s drop\n", chain_in);
+
+    /* add an additional rule for each of the DHCP servers, or a single
+     * one accepting replies from any server if there are none */
+    i = 0;
+    do {
+        const char *srv = n ? virNWFilterVarValueGetNthValue(dhcpsrvrs, i) : NULL;
+
+        for (j = 0; j < ARRAY_CARDINALITY(dstmacs); j++) {
+            virBufferAsprintf(&rules,
+                              "add rule " NFT_TABLE " %s ether daddr %s "
+                              "ether type 0x0800 ip protocol udp ",
+                              chain_out, dstmacs[j]);
+            if (srv)
+                virBufferAsprintf(&rules, "ip saddr %s ", srv);
+            virBufferAddLit(&rules, "udp sport 67 udp dport 68 accept\n");
+        }
+        i++;
+    } while (i < n);
+
+    virBufferAsprintf(&rules, "add rule " NFT_TABLE " %s drop\n", chain_out);
+
+    if (nftablesApplySimpleRules(ifname, &rules, chains) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&rules);
+    virStringListFree(chains);
+    return ret;
+}
+
+
+/**
+ * nftablesApplyDropAllRules
+ *
+ * @ifname: name of the backend-interface to which to apply the rules
+ *
+ * Returns 0 on success, -1 on failure with the rules removed
+ *
+ * Apply filtering rules so that the VM cannot receive or send traffic.
+ */
+static int
+nftablesApplyDropAllRules(const char *ifname)
+{
+    virBuffer rules = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    char chain_in[NFT_MAX_NAME_LENGTH];
+    char chain_out[NFT_MAX_NAME_LENGTH];
+    char **chains = NULL;
+    int ret = -1;
+
+    if (nftablesCheckName(ifname) < 0)
+        return -1;
+
+    virMutexLock(&nftablesLock);
+    iface = nftablesIfaceGet(ifname);
+    if (iface &&
+        (nftablesBasicChainCmds(&rules, iface, ifname, NFT_DIR_FROM_VM,
+                                chain_in, sizeof(chain_in), &chains) < 0 ||
+         nftablesBasicChainCmds(&rules, iface, ifname, NFT_DIR_TO_VM,
+                                chain_out, sizeof(chain_out), &chains) < 0))
+        iface = NULL;
+    virMutexUnlock(&nftablesLock);
+    if (!iface)
+        goto cleanup;
+
+    virBufferAsprintf(&rules, "add rule " NFT_TABLE " %s drop\n", chain_in);
+    virBufferAsprintf(&rules, "add rule " NFT_TABLE " %s drop\n", chain_out);
+
+    if (nftablesApplySimpleRules(ifname, &rules, chains) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&rules);
+    virStringListFree(chains);
+    return ret;
+}
+
+
+static int
+nftablesAllTeardown(const char *ifname)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    bool iptables = true;
+    int ret = -1;
+
+    virMutexLock(&nftablesLock);
+
+    if ((iface = virHashLookup(nftablesIfaces, ifname))) {
+        iptables = iface->iptables || iface->newIptables;
+
+        nftablesTeardownCmds(&buf, iface, ifname);
+
+        if (nftablesRunScript(&buf) < 0)
+            goto unlock;
+
+        ignore_value(virHashRemoveEntry(nftablesIfaces, ifname));
+    }
+
+    ret = 0;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+
+    if (ret == 0 && iptables && nftablesHaveEbiptables())
+        ignore_value(ebiptables_driver.allTeardown(ifname));
+
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+static int
+nftablesCanApplyBasicRules(void)
+{
+    return true;
+}
+
+
+static int
+nftablesUpdateVariable(const char *ifname,
+                       const char *varname,
+                       virNWFilterVarValuePtr value)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    nftablesIfacePtr iface;
+    int ret = 0;
+
+    if (!value || !nftablesValueIsIPv4(value))
+        return 0;
+
+    virMutexLock(&nftablesLock);
+
+    /* the set must be used by the active rules and, if there are any,
+     * also by the new ones */
+    if (!(iface = virHashLookup(nftablesIfaces, ifname)) ||
+        !virStringListHasString((const char **)iface->sets, varname) ||
+        !virStringListHasString((const char **)iface->setVars, varname) ||
+        (iface->hasNew &&
+         !virStringListHasString((const char **)iface->newSetVars, varname)))
+        goto unlock;
+
+    nftablesFillSetCmds(&buf, ifname, varname, value, false);
+
+    if (nftablesRunScript(&buf) < 0) {
+        ret = -1;
+        goto unlock;
+    }
+
+    VIR_DEBUG("Updated set of variable %s of interface %s in place",
+              varname, ifname);
+    ret = 1;
+
+ unlock:
+    virMutexUnlock(&nftablesLock);
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+/*
+ * Learn about the objects a previous run of libvirtd left in the table
+ * so that they can be cleaned up
+ */
+static int
+nftablesLoadState(void)
+{
+    virCommandPtr cmd = NULL;
+    char *output = NULL;
+    char **lines = NULL;
+    nftablesIfacePtr iface = NULL;
+    int status;
+    size_t i;
+    int ret = -1;
+
+    cmd = virCommandNewArgList(NFT_PATH, "list", "table", NFT_TABLE, NULL);
+    virCommandSetOutputBuffer(cmd, &output);
+    virCommandSetErrorBuffer(cmd, NULL);
+
+    if (virCommandRun(cmd, &status) < 0)
+        goto cleanup;
+
+    /* the table does not exist yet */
+    if (status != 0 || !output) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(lines = virStringSplit(output, "\n", 0)))
+        goto cleanup;
+
+    for (i = 0; lines[i]; i++) {
+        const char *line = lines[i];
+        char **parts = NULL;
+        size_t nparts;
+        int dir;
+
+        virSkipSpaces(&line);
+
+        if (STRPREFIX(line, "chain ")) {
+            iface = NULL;
+            line += strlen("chain ");
+        } else if (STRPREFIX(line, "set ")) {
+            line += strlen("set ");
+        } else if (iface && STRPREFIX(line, "jump ") &&
+                   (line[5] == 'a' || line[5] == 'b') && line[6] == '/') {
+            iface->gen = line[5];
+            continue;
+        } else {
+            continue;
+        }
+
+        if (!(parts = virStringSplitCount(line, "/", 0, &nparts)))
+            goto cleanup;
+
+        /* strip the ' {' following the name */
+        if (nparts > 0) {
+            char *end = strchr(parts[nparts - 1], ' ');
+            if (end)
+                *end = '\0';
+        }
+
+        if (nparts == 3 && STREQ(parts[0], "ip")) {
+            nftablesIfacePtr setif;
+
+            if (!(setif = nftablesIfaceGet(parts[1])) ||
+                virStringListAdd(&setif->sets, parts[2]) < 0)
+                goto error;
+        } else if (nparts == 2 &&
+                   ((dir = STREQ(parts[0], "from") ? NFT_DIR_FROM_VM :
+                     STREQ(parts[0], "to") ? NFT_DIR_TO_VM : -1) >= 0)) {
+            if (!(iface = nftablesIfaceGet(parts[1])))
+                goto error;
+            iface->linked[dir] = true;
+        } else if (nparts >= 3 &&
+                   (STREQ(parts[0], "a") || STREQ(parts[0], "b"))) {
+            nftablesIfacePtr chainif;
+            char *chain = NULL;
+
+            if (!(chainif = nftablesIfaceGet(parts[2])) ||
+                !(chain = virStringListJoin((const char **)parts, "/")) ||
+                virStringListAdd(&chainif->chains, chain) < 0) {
+                VIR_FREE(chain);
+                goto error;
+            }
+            VIR_FREE(chain);
+        }
+
+        virStringListFree(parts);
+        continue;
+
+ error:
+        virStringListFree(parts);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandFree(cmd);
+    VIR_FREE(output);
+    virStringListFree(lines);
+    return ret;
+}
+
+
+/*
+ * Move the chains that do not belong to the active generation of each
+ * interface to the list of chains to remove when new rules are applied
+ */
+static int
+nftablesSortStaleChains(void *payload,
+                        const void *name ATTRIBUTE_UNUSED,
+                        void *opaque ATTRIBUTE_UNUSED)
+{
+    nftablesIfacePtr iface = payload;
+    char **chains = NULL;
+    size_t i;
+
+    VIR_STEAL_PTR(chains, iface->chains);
+
+    for (i = 0; chains && chains[i]; i++) {
+        if (virStringListAdd(chains[i][0] == iface->gen ?
+                             &iface->chains : &iface->newChains,
+                             chains[i]) < 0) {
+            virStringListFree(chains);
+            return -1;
+        }
+    }
+
+    virStringListFree(chains);
+    return 0;
+}
+
+
+static int
+nftablesCreateTable(void)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    int dir;
+
+    virBufferAddLit(&buf, "add table " NFT_TABLE "\n");
+    for (dir = 0; dir < NFT_DIR_LAST; dir++) {
+        virBufferAsprintf(&buf,
+                          "add map " NFT_TABLE " %s "
+                          "{ type ifname : verdict; }\n",
+                          nftablesDirMap[dir]);
+        virBufferAsprintf(&buf, "add chain " NFT_TABLE " %s { %s }\n",
+                          nftablesDirBaseChain[dir], nftablesDirHook[dir]);
+        virBufferAsprintf(&buf, "flush chain " NFT_TABLE " %s\n",
+                          nftablesDirBaseChain[dir]);
+        virBufferAsprintf(&buf, "add rule " NFT_TABLE " %s %s vmap @%s\n",
+                          nftablesDirBaseChain[dir],
+                          nftablesDirIfMatch[dir], nftablesDirMap[dir]);
+    }
+
+    return nftablesRunScript(&buf);
+}
+
+
+static int
+nftablesDriverInit(bool privileged)
+{
+    if (!privileged)
+        return 0;
+
+    if (!(nftablesIfaces = virHashCreate(32, nftablesIfaceFree)))
+        return -1;
+
+    if (nftablesLoadState() < 0 ||
+        virHashForEach(nftablesIfaces, nftablesSortStaleChains, NULL) < 0 ||
+        nftablesCreateTable() < 0) {
+        virHashFree(nftablesIfaces);
+        nftablesIfaces = NULL;
+        return -1;
+    }
+
+    nftables_driver.flags = TECHDRV_FLAG_INITIALIZED;
+
+    return 0;
+}
+
+
+static void
+nftablesDriverShutdown(void)
+{
+    virHashFree(nftablesIfaces);
+    nftablesIfaces = NULL;
+    nftables_driver.flags = 0;
+}
+
+
+virNWFilterTechDriver nftables_driver = {
+    .name = NFTABLES_DRIVER_ID,
+    .flags = 0,
+
+    .init     = nftablesDriverInit,
+    .shutdown = nftablesDriverShutdown,
+
+    .applyNewRules       = nftablesApplyNewRules,
+    .tearNewRules        = nftablesTearNewRules,
+    .tearOldRules        = nftablesTearOldRules,
+    .allTeardown         = nftablesAllTeardown,
+
+    .canApplyBasicRules  = nftablesCanApplyBasicRules,
+    .applyBasicRules     = nftablesApplyBasicRules,
+    .applyDHCPOnlyRules  = nftablesApplyDHCPOnlyRules,
+    .applyDropAllRules   = nftablesApplyDropAllRules,
+    .removeBasicRules    = nftablesAllTeardown,
+
+    .updateVariable      = nftablesUpdateVariable,
+};
@@ -0,0 +1,30 @@
+/*
+ * nwfilter_nftables_driver.h: driver for nftables on tap devices
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef VIR_NWFILTER_NFTABLES_DRIVER_H__
+# define VIR_NWFILTER_NFTABLES_DRIVER_H__
+
+# include "nwfilter_tech_driver.h"
+
+extern virNWFilterTechDriver nftables_driver;
+
+# define NFTABLES_DRIVER_ID "nftables"
+
+#endif /* VIR_NWFILTER_NFTABLES_DRIVER_H__ */
@@ -70,6 +70,15 @@ typedef int (*virNWFilterRemoveBasicRules)(const char *ifname);
 
 typedef int (*virNWFilterDropAllRules)(const char *ifname);
 
+/*
+ * Change the value of a variable the rules of an interface reference
+ * without rebuilding them. Returns 1 if the active rules use the new
+ * value, 0 if they need to be rebuilt and -1 on error.
+ */
+typedef int (*virNWFilterUpdateVariable)(const char *ifname,
+                                         const char *varname,
+                                         virNWFilterVarValuePtr value);
+
 enum techDrvFlags {
     TECHDRV_FLAG_INITIALIZED = (1 << 0),
 };
@@ -91,6 +100,8 @@ struct _virNWFilterTechDriver {
     virNWFilterApplyDHCPOnlyRules applyDHCPOnlyRules;
     virNWFilterDropAllRules applyDropAllRules;
     virNWFilterRemoveBasicRules removeBasicRules;
+
+    virNWFilterUpdateVariable updateVariable;
 };
 
 #endif /* __NWFILTER_TECH_DRIVER_H__ */
@@ -41,6 +41,7 @@
 #include "virtime.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virhash.h"
 #include "base64.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
@@ -61,6 +62,13 @@ VIR_LOG_INIT("qemu.qemu_agent");
  */
 #define QEMU_AGENT_MAX_RESPONSE (10 * 1024 * 1024)
 
+/* Replies to the informational commands listed in
+ * qemuAgentCacheableCommands are reused for this many
+ * milliseconds, so that frequent pollers don't keep
+ * the guest agent busy.
+ */
+#define QEMU_AGENT_CACHE_TIME 2000
+
 /* When you are the first to uncomment this,
  * don't forget to uncomment the corresponding
  * part in qemuAgentIOProcessEvent as well.
@@ -129,6 +137,28 @@ struct _qemuAgent {
      * but fire up an event on qemu monitor instead.
      * Take that as indication of successful completion */
     qemuAgentEvent await_event;
+
+    /* Set once guest-sync succeeded and cleared whenever a
+     * reply may be lost or stale, so that guest-sync is only
+     * sent when needed */
+    bool inSync;
+
+    /* Recent replies to cacheable commands indexed by the
+     * command name, see qemuAgentCacheEntry */
+    virHashTablePtr cache;
+};
+
+typedef struct _qemuAgentCacheEntry qemuAgentCacheEntry;
+typedef qemuAgentCacheEntry *qemuAgentCacheEntryPtr;
+struct _qemuAgentCacheEntry {
+    virJSONValuePtr reply;
+    unsigned long long expires;
+};
+
+static const char *qemuAgentCacheableCommands[] = {
+    "guest-get-fsinfo",
+    "guest-get-host-name",
+    "guest-network-get-interfaces",
 };
 
 static virClassPtr qemuAgentClass;
@@ -175,6 +205,37 @@ static void qemuAgentDispose(void *obj)
     virCondDestroy(&mon->notify);
     VIR_FREE(mon->buffer);
     virResetError(&mon->lastError);
+    virHashFree(mon->cache);
+}
+
+
+static void
+qemuAgentCacheEntryFree(void *payload,
+                        const void *name ATTRIBUTE_UNUSED)
+{
+    qemuAgentCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    virJSONValueFree(entry->reply);
+    VIR_FREE(entry);
+}
+
+
+/**
+ * qemuAgentResetSync:
+ * @mon: Monitor
+ *
+ * Forget that the agent is in sync with us and drop all cached
+ * replies. Called whenever the agent may have lost track of the
+ * commands we've sent or the guest has changed state.
+ */
+static void
+qemuAgentResetSync(qemuAgentPtr mon)
+{
+    mon->inSync = false;
+    virHashRemoveAll(mon->cache);
 }
 
 static int
@@ -337,6 +398,7 @@ qemuAgentIOProcessLine(qemuAgentPtr mon,
         } else {
             /* we are out of sync */
             VIR_DEBUG("Ignoring delayed reply");
+            mon->inSync = false;
         }
         ret = 0;
     } else {
@@ -695,6 +757,11 @@ qemuAgentOpen(virDomainObjPtr vm,
         virObjectUnref(mon);
         return NULL;
     }
+    if (!(mon->cache = virHashCreate(ARRAY_CARDINALITY(qemuAgentCacheableCommands),
+                                     qemuAgentCacheEntryFree))) {
+        virObjectUnref(mon);
+        return NULL;
+    }
     mon->vm = vm;
     mon->cb = cb;
 
@@ -873,6 +940,9 @@ static int qemuAgentSend(qemuAgentPtr mon,
     ret = 0;
 
  cleanup:
+    /* the reply may still arrive and be mistaken for the next one */
+    if (ret < 0)
+        mon->inSync = false;
     mon->msg = NULL;
     qemuAgentUpdateWatch(mon);
 
@@ -942,6 +1012,7 @@ qemuAgentGuestSync(qemuAgentPtr mon)
         }
     }
 
+    mon->inSync = true;
     ret = 0;
 
  cleanup:
@@ -1059,17 +1130,54 @@ qemuAgentCheckError(virJSONValuePtr cmd,
     return 0;
 }
 
+static bool
+qemuAgentCommandIsCacheable(virJSONValuePtr cmd)
+{
+    const char *name = virJSONValueObjectGetString(cmd, "execute");
+    size_t i;
+
+    if (!name || virJSONValueObjectHasKey(cmd, "arguments"))
+        return false;
+
+    for (i = 0; i < ARRAY_CARDINALITY(qemuAgentCacheableCommands); i++) {
+        if (STREQ(name, qemuAgentCacheableCommands[i]))
+            return true;
+    }
+
+    return false;
+}
+
+/**
+ * qemuAgentCommandFull:
+ * @mon: Monitor
+ * @cmd: command to execute
+ * @reply: filled with the reply
+ * @needReply: whether a reply is required even when awaiting an event
+ * @seconds: timeout, see qemuAgentSend
+ * @cache: whether the reply may be served from or stored in the cache
+ *
+ * Execute @cmd in the guest agent. The guest-sync handshake is done
+ * only if the agent might be out of sync with us. Any command which
+ * is not served from the cache may change the guest state, therefore
+ * executing it invalidates all cached replies.
+ *
+ * Returns 0 on success, -2 on timeout, -1 otherwise.
+ */
 static int
-qemuAgentCommand(qemuAgentPtr mon,
-                 virJSONValuePtr cmd,
-                 virJSONValuePtr *reply,
-                 bool needReply,
-                 int seconds)
+qemuAgentCommandFull(qemuAgentPtr mon,
+                     virJSONValuePtr cmd,
+                     virJSONValuePtr *reply,
+                     bool needReply,
+                     int seconds,
+                     bool cache)
 {
     int ret = -1;
     qemuAgentMessage msg;
     char *cmdstr = NULL;
     int await_event = mon->await_event;
+    const char *name = qemuAgentCommandName(cmd);
+    qemuAgentCacheEntryPtr entry = NULL;
+    unsigned long long now;
 
     *reply = NULL;
 
@@ -1079,7 +1187,25 @@ qemuAgentCommand(qemuAgentPtr mon,
         return -1;
     }
 
-    if (qemuAgentGuestSync(mon) < 0)
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (cache && !(cache = qemuAgentCommandIsCacheable(cmd)))
+        VIR_DEBUG("Command '%s' can't be cached", name);
+
+    if (cache &&
+        (entry = virHashLookup(mon->cache, name)) &&
+        entry->expires > now) {
+        VIR_DEBUG("Using cached reply to command '%s'", name);
+        if (!(*reply = virJSONValueCopy(entry->reply)))
+            return -1;
+        return 0;
+    }
+
+    virHashRemoveAll(mon->cache);
+
+    if (!mon->inSync &&
+        qemuAgentGuestSync(mon) < 0)
         return -1;
 
     memset(&msg, 0, sizeof(msg));
@@ -1103,6 +1229,7 @@ qemuAgentCommand(qemuAgentPtr mon,
         if (!msg.rxObject) {
             if (await_event && !needReply) {
                 VIR_DEBUG("Woken up by event %d", await_event);
+                mon->inSync = false;
             } else {
                 if (mon->running)
                     virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -1118,6 +1245,18 @@ qemuAgentCommand(qemuAgentPtr mon,
         }
     }
 
+    if (ret == 0 && cache && *reply) {
+        if (VIR_ALLOC(entry) < 0 ||
+            !(entry->reply = virJSONValueCopy(*reply))) {
+            qemuAgentCacheEntryFree(entry, NULL);
+            goto cleanup;
+        }
+        entry->expires = now + QEMU_AGENT_CACHE_TIME;
+
+        if (virHashAddEntry(mon->cache, name, entry) < 0)
+            qemuAgentCacheEntryFree(entry, NULL);
+    }
+
  cleanup:
     VIR_FREE(cmdstr);
     VIR_FREE(msg.txBuffer);
@@ -1125,6 +1264,16 @@ qemuAgentCommand(qemuAgentPtr mon,
     return ret;
 }
 
+static int
+qemuAgentCommand(qemuAgentPtr mon,
+                 virJSONValuePtr cmd,
+                 virJSONValuePtr *reply,
+                 bool needReply,
+                 int seconds)
+{
+    return qemuAgentCommandFull(mon, cmd, reply, needReply, seconds, false);
+}
+
 static virJSONValuePtr ATTRIBUTE_SENTINEL
 qemuAgentMakeCommand(const char *cmdname,
                      ...)
@@ -1191,6 +1340,10 @@ void qemuAgentNotifyEvent(qemuAgentPtr mon,
     virObjectLock(mon);
 
     VIR_DEBUG("mon=%p event=%d await_event=%d", mon, event, mon->await_event);
+
+    /* the guest agent is going away or restarting */
+    qemuAgentResetSync(mon);
+
     if (mon->await_event == event) {
         mon->await_event = QEMU_AGENT_EVENT_NONE;
         /* somebody waiting for this event, wake him up. */
@@ -1695,8 +1848,8 @@ qemuAgentGetHostname(qemuAgentPtr mon,
     if (!cmd)
         return ret;
 
-    if (qemuAgentCommand(mon, cmd, &reply, true,
-                         VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK) < 0)
+    if (qemuAgentCommandFull(mon, cmd, &reply, true,
+                             VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK, true) < 0)
         goto cleanup;
 
     if (!(data = virJSONValueObjectGet(reply, "return"))) {
@@ -1835,8 +1988,8 @@ qemuAgentGetFSInfo(qemuAgentPtr mon, virDomainFSInfoPtr **info,
     if (!cmd)
         return ret;
 
-    if (qemuAgentCommand(mon, cmd, &reply, true,
-                         VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK) < 0)
+    if (qemuAgentCommandFull(mon, cmd, &reply, true,
+                             VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK, true) < 0)
         goto cleanup;
 
     if (!(data = virJSONValueObjectGet(reply, "return"))) {
@@ -2034,8 +2187,8 @@ qemuAgentGetInterfaces(qemuAgentPtr mon,
     if (!(cmd = qemuAgentMakeCommand("guest-network-get-interfaces", NULL)))
         goto cleanup;
 
-    if (qemuAgentCommand(mon, cmd, &reply, false,
-                         VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK) < 0)
+    if (qemuAgentCommandFull(mon, cmd, &reply, false,
+                             VIR_DOMAIN_QEMU_AGENT_COMMAND_BLOCK, true) < 0)
         goto cleanup;
 
     if (!(ret_array = virJSONValueObjectGet(reply, "return"))) {
@@ -35,6 +35,9 @@ VIR_LOG_INIT("qemu.qemu_block");
 /* qemu declares the buffer for node names as a 32 byte array */
 static const size_t qemuBlockNodeNameBufSize = 32;
 
+/* IANA assigned port of the NBD protocol */
+#define QEMU_BLOCK_NBD_DEFAULT_PORT 10809
+
 static int
 qemuBlockNodeNameValidate(const char *nn)
 {
@@ -1747,6 +1750,100 @@ qemuBlockSnapshotAddLegacy(virJSONValuePtr actions,
 }
 
 
+/**
+ * qemuBlockDirtyBitmapAdd:
+ * @actions: transaction actions
+ * @disk: disk to track
+ * @bitmap: name of the new bitmap
+ *
+ * Adds an action creating a persistent dirty bitmap @bitmap tracking the
+ * guest writes to @disk.  Persistent bitmaps are stored in the qcow2 image
+ * when QEMU exits.
+ */
+int
+qemuBlockDirtyBitmapAdd(virJSONValuePtr actions,
+                        virDomainDiskDefPtr disk,
+                        const char *bitmap)
+{
+    char *device = NULL;
+    int ret = -1;
+
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+        return -1;
+
+    if (qemuMonitorJSONTransactionAdd(actions, "block-dirty-bitmap-add",
+                                      "s:node", device,
+                                      "s:name", bitmap,
+                                      "b:persistent", true,
+                                      NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(device);
+    return ret;
+}
+
+
+/**
+ * qemuBlockBackupAdd:
+ * @actions: transaction actions
+ * @disk: disk to back up
+ * @server: NBD server receiving the data
+ * @exportname: NBD export of @server receiving the data
+ * @bitmap: dirty bitmap selecting the data to copy, NULL for full backup
+ *
+ * Adds an action starting a backup block job of @disk, which pushes the
+ * point in time state of the disk to an existing NBD export.  With @bitmap
+ * only the clusters marked in the bitmap are copied and QEMU clears the
+ * bitmap when the job completes successfully.
+ */
+int
+qemuBlockBackupAdd(virJSONValuePtr actions,
+                   virDomainDiskDefPtr disk,
+                   virStorageNetHostDefPtr server,
+                   const char *exportname,
+                   const char *bitmap)
+{
+    char *device = NULL;
+    char *target = NULL;
+    int ret = -1;
+
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+        return -1;
+
+    if (server->transport == VIR_STORAGE_NET_HOST_TRANS_UNIX) {
+        if (virAsprintf(&target, "nbd:unix:%s:exportname=%s",
+                        server->socket, exportname) < 0)
+            goto cleanup;
+    } else {
+        if (virAsprintf(&target, "nbd:%s:%u:exportname=%s",
+                        server->name,
+                        server->port ? server->port : QEMU_BLOCK_NBD_DEFAULT_PORT,
+                        exportname) < 0)
+            goto cleanup;
+    }
+
+    if (qemuMonitorJSONTransactionAdd(actions, "drive-backup",
+                                      "s:device", device,
+                                      "s:target", target,
+                                      "s:format", "raw",
+                                      "s:mode", "existing",
+                                      "s:sync", bitmap ? "incremental" : "full",
+                                      "S:bitmap", bitmap,
+                                      NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(device);
+    VIR_FREE(target);
+    return ret;
+}
+
+
 /**
  * qemuBlockStorageGetCopyOnReadProps:
  * @disk: disk with copy-on-read enabled
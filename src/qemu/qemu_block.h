@@ -125,4 +125,16 @@ qemuBlockSnapshotAddLegacy(virJSONValuePtr actions,
                            virStorageSourcePtr newsrc,
                            bool reuse);
 
+int
+qemuBlockDirtyBitmapAdd(virJSONValuePtr actions,
+                        virDomainDiskDefPtr disk,
+                        const char *bitmap);
+
+int
+qemuBlockBackupAdd(virJSONValuePtr actions,
+                   virDomainDiskDefPtr disk,
+                   virStorageNetHostDefPtr server,
+                   const char *exportname,
+                   const char *bitmap);
+
 #endif /* __QEMU_BLOCK_H__ */
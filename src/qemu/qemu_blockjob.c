@@ -127,6 +127,12 @@ qemuBlockJobEventProcess(virQEMUDriverPtr driver,
      * to match.  */
     switch ((virConnectDomainEventBlockJobStatus) status) {
     case VIR_DOMAIN_BLOCK_JOB_COMPLETED:
+        /* A backup only reads the disk, the backing chain is unchanged */
+        if (type == VIR_DOMAIN_BLOCK_JOB_TYPE_BACKUP) {
+            diskPriv->blockjob = false;
+            break;
+        }
+
         if (disk->mirrorState == VIR_DOMAIN_DISK_MIRROR_STATE_PIVOT) {
             if (vm->newDef) {
                 virStorageSourcePtr copy = NULL;
@@ -258,3 +264,186 @@ qemuBlockJobSyncEnd(virDomainObjPtr vm,
     qemuBlockJobUpdate(vm, asyncJob, disk, NULL);
     QEMU_DOMAIN_DISK_PRIVATE(disk)->blockJobSync = false;
 }
+
+
+/* Maximum age of block job progress returned from qemuBlockJobGetInfo
+ * without asking qemu, in milliseconds */
+#define QEMU_BLOCKJOB_INFO_MAX_AGE 250
+
+
+/**
+ * qemuBlockJobInfoInvalidate:
+ * @disk: domain disk
+ *
+ * Make sure the next call to qemuBlockJobGetInfo for @disk asks qemu about
+ * the progress of the block job rather than using the cached data. To be
+ * called whenever the job is changed by libvirt, e.g., its speed is set.
+ */
+void
+qemuBlockJobInfoInvalidate(virDomainDiskDefPtr disk)
+{
+    QEMU_DOMAIN_DISK_PRIVATE(disk)->blockJobInfoTime = 0;
+}
+
+
+/**
+ * qemuBlockJobStarted:
+ * @disk: domain disk
+ *
+ * Mark a block job started by libvirt on @disk as running. From now on the
+ * state of the job is tracked from events emitted by qemu.
+ */
+void
+qemuBlockJobStarted(virDomainDiskDefPtr disk)
+{
+    qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+
+    diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_RUNNING;
+    diskPriv->blockJobInfoTime = 0;
+}
+
+
+/**
+ * qemuBlockJobStateUpdate:
+ * @disk: domain disk
+ * @status: block job status (virConnectDomainEventBlockJobStatus)
+ *
+ * Update the tracked state of the block job on @disk in response to one of
+ * the BLOCK_JOB_* events. Called from the event handler as soon as the event
+ * is received, i.e., independently of when the event is processed.
+ */
+void
+qemuBlockJobStateUpdate(virDomainDiskDefPtr disk,
+                        int status)
+{
+    qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+
+    switch ((virConnectDomainEventBlockJobStatus) status) {
+    case VIR_DOMAIN_BLOCK_JOB_COMPLETED:
+    case VIR_DOMAIN_BLOCK_JOB_FAILED:
+    case VIR_DOMAIN_BLOCK_JOB_CANCELED:
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_NONE;
+        break;
+
+    case VIR_DOMAIN_BLOCK_JOB_READY:
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_READY;
+        break;
+
+    case VIR_DOMAIN_BLOCK_JOB_LAST:
+        break;
+    }
+
+    diskPriv->blockJobInfoTime = 0;
+}
+
+
+/**
+ * qemuBlockJobStatusChange:
+ * @disk: domain disk
+ * @status: new status of the job (qemuMonitorJobStatus)
+ *
+ * Update the tracked state of the block job on @disk in response to
+ * JOB_STATUS_CHANGE event.
+ */
+void
+qemuBlockJobStatusChange(virDomainDiskDefPtr disk,
+                         int status)
+{
+    qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+
+    switch ((qemuMonitorJobStatus) status) {
+    case QEMU_MONITOR_JOB_STATUS_READY:
+    case QEMU_MONITOR_JOB_STATUS_STANDBY:
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_READY;
+        break;
+
+    case QEMU_MONITOR_JOB_STATUS_CREATED:
+    case QEMU_MONITOR_JOB_STATUS_RUNNING:
+    case QEMU_MONITOR_JOB_STATUS_PAUSED:
+    case QEMU_MONITOR_JOB_STATUS_WAITING:
+    case QEMU_MONITOR_JOB_STATUS_PENDING:
+    case QEMU_MONITOR_JOB_STATUS_ABORTING:
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_RUNNING;
+        break;
+
+    case QEMU_MONITOR_JOB_STATUS_CONCLUDED:
+    case QEMU_MONITOR_JOB_STATUS_NULL:
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_NONE;
+        break;
+
+    case QEMU_MONITOR_JOB_STATUS_UNDEFINED:
+    case QEMU_MONITOR_JOB_STATUS_LAST:
+        break;
+    }
+
+    diskPriv->blockJobInfoTime = 0;
+}
+
+
+/**
+ * qemuBlockJobGetInfo:
+ * @driver: qemu driver
+ * @vm: domain
+ * @asyncJob: qemu asynchronous job type
+ * @disk: domain disk
+ * @info: filled with the progress of the block job
+ *
+ * Get information about the block job running on @disk. The answer comes
+ * from the state tracked from qemu events whenever possible: no job is
+ * reported without asking qemu once the job finished and up to
+ * QEMU_BLOCKJOB_INFO_MAX_AGE old progress is reported for running jobs.
+ * The caller must hold a job on @vm.
+ *
+ * Returns 1 if a job is running on @disk, 0 if there is no job, and -1 on
+ * error.
+ */
+int
+qemuBlockJobGetInfo(virQEMUDriverPtr driver,
+                    virDomainObjPtr vm,
+                    qemuDomainAsyncJob asyncJob,
+                    virDomainDiskDefPtr disk,
+                    qemuMonitorBlockJobInfoPtr info)
+{
+    qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+    unsigned long long now;
+    int rc;
+
+    if (diskPriv->blockJobState == QEMU_BLOCKJOB_STATE_NONE)
+        return 0;
+
+    if (virTimeMillisNow(&now) < 0)
+        return -1;
+
+    if (diskPriv->blockJobState != QEMU_BLOCKJOB_STATE_UNKNOWN &&
+        diskPriv->blockJobInfoTime &&
+        now - diskPriv->blockJobInfoTime < QEMU_BLOCKJOB_INFO_MAX_AGE) {
+        VIR_DEBUG("Using cached info about block job on disk %s", disk->dst);
+        *info = diskPriv->blockJobInfo;
+        return 1;
+    }
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        return -1;
+    rc = qemuMonitorGetBlockJobInfo(qemuDomainGetMonitor(vm),
+                                    disk->info.alias, info);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        return -1;
+
+    if (rc == 0) {
+        /* An event announcing the end of a tracked job may still be on its
+         * way, qemu knows better. Untracked jobs are not cached at all. */
+        if (diskPriv->blockJobState != QEMU_BLOCKJOB_STATE_UNKNOWN)
+            diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_NONE;
+        return 0;
+    }
+
+    if (info->ready == 1)
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_READY;
+    else if (diskPriv->blockJobState == QEMU_BLOCKJOB_STATE_UNKNOWN)
+        diskPriv->blockJobState = QEMU_BLOCKJOB_STATE_RUNNING;
+
+    diskPriv->blockJobInfo = *info;
+    diskPriv->blockJobInfoTime = now;
+
+    return 1;
+}
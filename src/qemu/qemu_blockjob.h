@@ -26,6 +26,32 @@
 # include "qemu_conf.h"
 # include "qemu_domain.h"
 
+/*
+ * State of a block job as known from events emitted by qemu. Only jobs
+ * started by libvirt are tracked, the state of other jobs is unknown and
+ * has to be queried from qemu.
+ */
+typedef enum {
+    QEMU_BLOCKJOB_STATE_UNKNOWN = 0,
+    QEMU_BLOCKJOB_STATE_NONE, /* no job is running on the disk */
+    QEMU_BLOCKJOB_STATE_RUNNING,
+    QEMU_BLOCKJOB_STATE_READY, /* job can be pivoted or completed */
+
+    QEMU_BLOCKJOB_STATE_LAST
+} qemuBlockJobState;
+
+void qemuBlockJobStarted(virDomainDiskDefPtr disk);
+void qemuBlockJobStateUpdate(virDomainDiskDefPtr disk,
+                             int status);
+void qemuBlockJobStatusChange(virDomainDiskDefPtr disk,
+                              int status);
+void qemuBlockJobInfoInvalidate(virDomainDiskDefPtr disk);
+int qemuBlockJobGetInfo(virQEMUDriverPtr driver,
+                        virDomainObjPtr vm,
+                        qemuDomainAsyncJob asyncJob,
+                        virDomainDiskDefPtr disk,
+                        qemuMonitorBlockJobInfoPtr info);
+
 int qemuBlockJobUpdate(virDomainObjPtr vm,
                        qemuDomainAsyncJob asyncJob,
                        virDomainDiskDefPtr disk,
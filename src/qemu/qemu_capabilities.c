@@ -25,6 +25,7 @@
 
 #include "qemu_capabilities.h"
 #include "viralloc.h"
+#include "viratomic.h"
 #include "vircrypto.h"
 #include "virlog.h"
 #include "virerror.h"
@@ -42,6 +43,7 @@
 #include "virhostcpu.h"
 #include "qemu_monitor.h"
 #include "virstring.h"
+#include "virtime.h"
 #include "qemu_hostdev.h"
 #include "qemu_domain.h"
 #define __QEMU_CAPSPRIV_H_ALLOW__
@@ -52,6 +54,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <stdarg.h>
 #include <sys/utsname.h>
 
@@ -509,6 +512,8 @@ VIR_ENUM_IMPL(virQEMUCaps, QEMU_CAPS_LAST,
               "vfio-pci.display",
               "blockdev",
               "vfio-ap",
+              "query-named-block-nodes.flat",
+              "memory-backend-file.prealloc-threads",
     );
 
 
@@ -580,6 +585,18 @@ struct _virQEMUCaps {
 
     virQEMUCapsHostCPUData kvmCPU;
     virQEMUCapsHostCPUData tcgCPU;
+
+    /* shared with all copies of the object, see virQEMUCapsGetFragment */
+    virQEMUCapsFragmentsPtr fragments;
+};
+
+/* Upper bound of command line fragments cached per QEMU binary */
+#define VIR_QEMU_CAPS_FRAGMENTS_MAX 1024
+
+struct _virQEMUCapsFragments {
+    virObjectLockable parent;
+
+    virHashTablePtr table;
 };
 
 struct virQEMUCapsSearchData {
@@ -589,13 +606,18 @@ struct virQEMUCapsSearchData {
 
 
 static virClassPtr virQEMUCapsClass;
+static virClassPtr virQEMUCapsFragmentsClass;
 static void virQEMUCapsDispose(void *obj);
+static void virQEMUCapsFragmentsDispose(void *obj);
 
 static int virQEMUCapsOnceInit(void)
 {
     if (!VIR_CLASS_NEW(virQEMUCaps, virClassForObject()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virQEMUCapsFragments, virClassForObjectLockable()))
+        return -1;
+
     return 0;
 }
 
@@ -743,32 +765,39 @@ virQEMUCapsFindBinaryForArch(virArch hostarch,
 }
 
 static int
-virQEMUCapsInitGuest(virCapsPtr caps,
-                     virFileCachePtr cache,
-                     virArch hostarch,
-                     virArch guestarch)
+virQEMUCapsFindGuestBinary(virArch hostarch,
+                           virArch guestarch,
+                           char **binary)
 {
-    char *binary = NULL;
-    virQEMUCapsPtr qemuCaps = NULL;
-    int ret = -1;
-
     /* Check for existence of base emulator, or alternate base
      * which can be used with magic cpu choice
      */
-    binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
+    *binary = virQEMUCapsFindBinaryForArch(hostarch, guestarch);
 
     /* RHEL doesn't follow the usual naming for QEMU binaries and ships
      * a single binary named qemu-kvm outside of $PATH instead */
-    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !binary) {
-        if (VIR_STRDUP(binary, "/usr/libexec/qemu-kvm") < 0)
+    if (virQEMUCapsGuestIsNative(hostarch, guestarch) && !*binary) {
+        if (VIR_STRDUP(*binary, "/usr/libexec/qemu-kvm") < 0)
             return -1;
     }
 
+    return 0;
+}
+
+static int
+virQEMUCapsInitGuest(virCapsPtr caps,
+                     virFileCachePtr cache,
+                     const char *binary,
+                     virArch guestarch)
+{
+    virQEMUCapsPtr qemuCaps = NULL;
+    int ret = -1;
+
     /* Ignore binary if extracting version info fails */
     if (binary) {
         if (!(qemuCaps = virQEMUCapsCacheLookup(cache, binary))) {
             virResetLastError();
-            VIR_FREE(binary);
+            binary = NULL;
         }
     }
 
@@ -776,7 +805,6 @@ virQEMUCapsInitGuest(virCapsPtr caps,
                                          binary, qemuCaps,
                                          guestarch);
 
-    VIR_FREE(binary);
     virObjectUnref(qemuCaps);
 
     return ret;
@@ -889,6 +917,11 @@ virQEMUCapsInit(virFileCachePtr cache)
     virCapsPtr caps;
     size_t i;
     virArch hostarch = virArchFromHost();
+    char *binaries[VIR_ARCH_LAST] = { NULL };
+    const char *names[VIR_ARCH_LAST];
+    size_t nnames = 0;
+    unsigned long long start = 0;
+    unsigned long long now = 0;
 
     if ((caps = virCapabilitiesNew(hostarch,
                                    true, true)) == NULL)
@@ -928,17 +961,37 @@ virQEMUCapsInit(virFileCachePtr cache)
      * so just probe for them all - we gracefully fail
      * if a qemu-system-$ARCH binary can't be found
      */
-    for (i = 0; i < VIR_ARCH_LAST; i++)
-        if (virQEMUCapsInitGuest(caps, cache,
-                                 hostarch,
-                                 i) < 0)
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        if (virQEMUCapsFindGuestBinary(hostarch, i, &binaries[i]) < 0)
+            goto error;
+
+        if (binaries[i])
+            names[nnames++] = binaries[i];
+    }
+
+    /* Probing a binary which is not cached yet means starting QEMU,
+     * do that for all of them at once rather than one by one */
+    ignore_value(virTimeMillisNowRaw(&start));
+    if (virFileCachePrefetch(cache, names, nnames) < 0)
+        goto error;
+    ignore_value(virTimeMillisNowRaw(&now));
+    VIR_DEBUG("Capabilities of %zu emulator binaries ready in %llu ms",
+              nnames, now - start);
+
+    for (i = 0; i < VIR_ARCH_LAST; i++) {
+        if (virQEMUCapsInitGuest(caps, cache, binaries[i], i) < 0)
             goto error;
+    }
 
+ cleanup:
+    for (i = 0; i < VIR_ARCH_LAST; i++)
+        VIR_FREE(binaries[i]);
     return caps;
 
  error:
     virObjectUnref(caps);
-    return NULL;
+    caps = NULL;
+    goto cleanup;
 }
 
 
@@ -1239,6 +1292,7 @@ static struct virQEMUCapsStringFlags virQEMUCapsQMPSchemaQueries[] = {
     { "nbd-server-start/arg-type/tls-creds", QEMU_CAPS_NBD_TLS },
     { "screendump/arg-type/device", QEMU_CAPS_SCREENDUMP_DEVICE },
     { "block-commit/arg-type/*top",  QEMU_CAPS_ACTIVE_COMMIT },
+    { "query-named-block-nodes/arg-type/flat", QEMU_CAPS_QMP_QUERY_NAMED_BLOCK_NODES_FLAT },
 };
 
 typedef struct _virQEMUCapsObjectTypeProps virQEMUCapsObjectTypeProps;
@@ -1354,6 +1408,7 @@ static virQEMUCapsObjectTypeProps virQEMUCapsDeviceProps[] = {
 
 static struct virQEMUCapsStringFlags virQEMUCapsObjectPropsMemoryBackendFile[] = {
     { "discard-data", QEMU_CAPS_OBJECT_MEMORY_FILE_DISCARD },
+    { "prealloc-threads", QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS },
 };
 
 static struct virQEMUCapsStringFlags virQEMUCapsObjectPropsSPAPRMachine[] = {
@@ -1440,6 +1495,12 @@ virQEMUCapsNew(void)
     if (!(qemuCaps->flags = virBitmapNew(QEMU_CAPS_LAST)))
         goto error;
 
+    if (!(qemuCaps->fragments = virObjectLockableNew(virQEMUCapsFragmentsClass)))
+        goto error;
+
+    if (!(qemuCaps->fragments->table = virHashCreate(32, virHashValueFree)))
+        goto error;
+
     return qemuCaps;
 
  error:
@@ -1513,6 +1574,10 @@ virQEMUCapsPtr virQEMUCapsNewCopy(virQEMUCapsPtr qemuCaps)
 
     ret->usedQMP = qemuCaps->usedQMP;
 
+    /* copies describe the very same binary */
+    virObjectUnref(ret->fragments);
+    ret->fragments = virObjectRef(qemuCaps->fragments);
+
     if (VIR_STRDUP(ret->binary, qemuCaps->binary) < 0)
         goto error;
 
@@ -1606,6 +1671,98 @@ void virQEMUCapsDispose(void *obj)
 
     virQEMUCapsHostCPUDataClear(&qemuCaps->kvmCPU);
     virQEMUCapsHostCPUDataClear(&qemuCaps->tcgCPU);
+
+    virObjectUnref(qemuCaps->fragments);
+}
+
+
+static void
+virQEMUCapsFragmentsDispose(void *obj)
+{
+    virQEMUCapsFragmentsPtr fragments = obj;
+
+    virHashFree(fragments->table);
+}
+
+
+/**
+ * virQEMUCapsGetFragmentsID:
+ * @qemuCaps: QEMU capabilities
+ *
+ * Returns a string identifying the set of capabilities @qemuCaps has,
+ * which must be a part of the key of any command line fragment stored by
+ * virQEMUCapsAddFragment, since copies of @qemuCaps share the cache while
+ * their capabilities may differ.
+ */
+char *
+virQEMUCapsGetFragmentsID(virQEMUCapsPtr qemuCaps)
+{
+    return virBitmapToString(qemuCaps->flags, false, true);
+}
+
+
+/**
+ * virQEMUCapsGetFragment:
+ * @qemuCaps: QEMU capabilities
+ * @key: key of the fragment
+ *
+ * Looks up a command line fragment, or any other text derived from the
+ * capabilities such as formatted domain capabilities, stored by
+ * virQEMUCapsAddFragment. Fragments are shared by all copies of the capabilities of a QEMU binary
+ * and thrown away together with them when the binary changes and its
+ * capabilities are probed again.
+ *
+ * Returns a copy of the fragment or NULL if there's none or on OOM.
+ */
+char *
+virQEMUCapsGetFragment(virQEMUCapsPtr qemuCaps,
+                       const char *key)
+{
+    char *ret = NULL;
+
+    virObjectLock(qemuCaps->fragments);
+    ignore_value(VIR_STRDUP_QUIET(ret, virHashLookup(qemuCaps->fragments->table,
+                                                     key)));
+    virObjectUnlock(qemuCaps->fragments);
+
+    return ret;
+}
+
+
+/**
+ * virQEMUCapsAddFragment:
+ * @qemuCaps: QEMU capabilities
+ * @key: key of the fragment
+ * @fragment: the command line fragment
+ *
+ * Stores a copy of @fragment so that it can be looked up by @key.  When
+ * the cache is full it's emptied first.  Failures are not reported, the
+ * fragment is merely not cached.
+ */
+void
+virQEMUCapsAddFragment(virQEMUCapsPtr qemuCaps,
+                       const char *key,
+                       const char *fragment)
+{
+    char *copy;
+
+    if (VIR_STRDUP_QUIET(copy, fragment) < 0)
+        return;
+
+    virObjectLock(qemuCaps->fragments);
+
+    if (virHashSize(qemuCaps->fragments->table) >= VIR_QEMU_CAPS_FRAGMENTS_MAX) {
+        VIR_DEBUG("Dropping %d cached command line fragments of '%s'",
+                  VIR_QEMU_CAPS_FRAGMENTS_MAX, NULLSTR(qemuCaps->binary));
+        virHashRemoveAll(qemuCaps->fragments->table);
+    }
+
+    if (virHashUpdateEntry(qemuCaps->fragments->table, key, copy) < 0) {
+        virResetLastError();
+        VIR_FREE(copy);
+    }
+
+    virObjectUnlock(qemuCaps->fragments);
 }
 
 void
@@ -3796,176 +3953,887 @@ virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps)
 }
 
 
-static int
-virQEMUCapsSaveFile(void *data,
-                    const char *filename,
-                    void *privData ATTRIBUTE_UNUSED)
-{
-    virQEMUCapsPtr qemuCaps = data;
-    char *xml = NULL;
-    int ret = -1;
+/*
+ * The cache is stored in a binary form which is mapped into memory and
+ * decoded without any parsing, the XML form is written next to it only
+ * to ease debugging. The binary form is specific to the host and the
+ * libvirt build which wrote it: values are stored in native byte order
+ * and capabilities flags by their numbers. Caches written by a different
+ * build are refused on load or thrown away as outdated by
+ * virQEMUCapsIsValid anyway.
+ */
+#define VIR_QEMU_CAPS_CACHE_MAGIC "LVQEMUCP"
+#define VIR_QEMU_CAPS_CACHE_VERSION 1
+
+typedef struct _virQEMUCapsCacheWriter virQEMUCapsCacheWriter;
+typedef virQEMUCapsCacheWriter *virQEMUCapsCacheWriterPtr;
+struct _virQEMUCapsCacheWriter {
+    char *data;
+    size_t len;
+    size_t alloc;
+    bool error;
+};
 
-    xml = virQEMUCapsFormatCache(qemuCaps);
+typedef struct _virQEMUCapsCacheReader virQEMUCapsCacheReader;
+typedef virQEMUCapsCacheReader *virQEMUCapsCacheReaderPtr;
+struct _virQEMUCapsCacheReader {
+    const char *data;
+    size_t len;
+    size_t pos;
+};
 
-    if (virFileWriteStr(filename, xml, 0600) < 0) {
-        virReportSystemError(errno,
-                             _("Failed to save '%s' for '%s'"),
-                             filename, qemuCaps->binary);
-        goto cleanup;
-    }
 
-    VIR_DEBUG("Saved caps '%s' for '%s' with (%lld, %lld)",
-              filename, qemuCaps->binary,
-              (long long)qemuCaps->ctime,
-              (long long)qemuCaps->libvirtCtime);
+static void
+virQEMUCapsCacheWrite(virQEMUCapsCacheWriterPtr w,
+                      const void *data,
+                      size_t len)
+{
+    if (w->error)
+        return;
 
-    ret = 0;
- cleanup:
-    VIR_FREE(xml);
-    return ret;
+    if (VIR_RESIZE_N(w->data, w->alloc, w->len, len) < 0) {
+        w->error = true;
+        return;
+    }
+
+    memcpy(w->data + w->len, data, len);
+    w->len += len;
 }
 
 
-static bool
-virQEMUCapsIsValid(void *data,
-                   void *privData)
+static void
+virQEMUCapsCacheWriteUInt(virQEMUCapsCacheWriterPtr w,
+                          unsigned int val)
 {
-    virQEMUCapsPtr qemuCaps = data;
-    virQEMUCapsCachePrivPtr priv = privData;
-    bool kvmUsable;
-    struct stat sb;
+    uint32_t tmp = val;
 
-    if (!qemuCaps->binary)
-        return true;
+    virQEMUCapsCacheWrite(w, &tmp, sizeof(tmp));
+}
 
-    if (qemuCaps->libvirtCtime != virGetSelfLastChanged() ||
-        qemuCaps->libvirtVersion != LIBVIR_VERSION_NUMBER) {
-        VIR_DEBUG("Outdated capabilities for '%s': libvirt changed "
-                  "(%lld vs %lld, %lu vs %lu)",
-                  qemuCaps->binary,
-                  (long long)qemuCaps->libvirtCtime,
-                  (long long)virGetSelfLastChanged(),
-                  (unsigned long)qemuCaps->libvirtVersion,
-                  (unsigned long)LIBVIR_VERSION_NUMBER);
-        return false;
-    }
 
-    if (stat(qemuCaps->binary, &sb) < 0) {
-        char ebuf[1024];
-        VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
-                  qemuCaps->binary,
-                  virStrerror(errno, ebuf, sizeof(ebuf)));
-        return false;
-    }
+static void
+virQEMUCapsCacheWriteLLong(virQEMUCapsCacheWriterPtr w,
+                           long long val)
+{
+    int64_t tmp = val;
 
-    if (sb.st_ctime != qemuCaps->ctime) {
-        VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
-                  "(%lld vs %lld)",
-                  qemuCaps->binary,
-                  (long long)sb.st_ctime, (long long)qemuCaps->ctime);
-        return false;
-    }
+    virQEMUCapsCacheWrite(w, &tmp, sizeof(tmp));
+}
 
-    if (!virQEMUCapsGuestIsNative(priv->hostArch, qemuCaps->arch)) {
-        VIR_DEBUG("Guest arch (%s) is not native to host arch (%s), "
-                  "skipping KVM-related checks",
-                  virArchToString(qemuCaps->arch),
-                  virArchToString(priv->hostArch));
-        return true;
-    }
 
-    kvmUsable = virFileAccessibleAs("/dev/kvm", R_OK | W_OK,
-                                    priv->runUid, priv->runGid) == 0;
+/* NULL strings are stored with the length of UINT32_MAX */
+static void
+virQEMUCapsCacheWriteString(virQEMUCapsCacheWriterPtr w,
+                            const char *str)
+{
+    size_t len = str ? strlen(str) : UINT32_MAX;
 
-    if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
-        kvmUsable) {
-        VIR_DEBUG("KVM was not enabled when probing '%s', "
-                  "but it should be usable now",
-                  qemuCaps->binary);
-        return false;
+    if (len >= UINT32_MAX && str) {
+        w->error = true;
+        return;
     }
 
-    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
-        !kvmUsable) {
-        VIR_DEBUG("KVM was enabled when probing '%s', "
-                  "but it is not available now",
-                  qemuCaps->binary);
-        return false;
-    }
+    virQEMUCapsCacheWriteUInt(w, len);
+    if (str)
+        virQEMUCapsCacheWrite(w, str, len);
+}
 
-    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM)) {
-        if (priv->microcodeVersion != qemuCaps->microcodeVersion) {
-            VIR_DEBUG("Outdated capabilities for '%s': microcode version "
-                      "changed (%u vs %u)",
-                      qemuCaps->binary,
-                      priv->microcodeVersion,
-                      qemuCaps->microcodeVersion);
-            return false;
-        }
 
-        if (STRNEQ_NULLABLE(priv->kernelVersion, qemuCaps->kernelVersion)) {
-            VIR_DEBUG("Outdated capabilities for '%s': kernel version changed "
-                      "('%s' vs '%s')",
-                      qemuCaps->binary,
-                      priv->kernelVersion,
-                      qemuCaps->kernelVersion);
-            return false;
-        }
+static const void *
+virQEMUCapsCacheRead(virQEMUCapsCacheReaderPtr r,
+                     size_t len)
+{
+    const void *ret;
+
+    if (r->len - r->pos < len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("truncated QEMU capabilities cache"));
+        return NULL;
     }
 
-    return true;
+    ret = r->data + r->pos;
+    r->pos += len;
+    return ret;
 }
 
 
-static void virQEMUCapsMonitorNotify(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
-                                     virDomainObjPtr vm ATTRIBUTE_UNUSED,
-                                     void *opaque ATTRIBUTE_UNUSED)
+static int
+virQEMUCapsCacheReadUInt(virQEMUCapsCacheReaderPtr r,
+                         unsigned int *val)
 {
-}
+    const void *data;
+    uint32_t tmp;
 
-static qemuMonitorCallbacks callbacks = {
-    .eofNotify = virQEMUCapsMonitorNotify,
-    .errorNotify = virQEMUCapsMonitorNotify,
-};
+    if (!(data = virQEMUCapsCacheRead(r, sizeof(tmp))))
+        return -1;
+
+    memcpy(&tmp, data, sizeof(tmp));
+    *val = tmp;
+    return 0;
+}
 
 
-/**
- * virQEMUCapsInitQMPArch:
- * @qemuCaps: QEMU capabilities
- * @mon: QEMU monitor
- *
- * Initialize the architecture for @qemuCaps by asking @mon.
- *
- * Returns: 0 on success, <0 on failure
- */
 static int
-virQEMUCapsInitQMPArch(virQEMUCapsPtr qemuCaps,
-                            qemuMonitorPtr mon)
+virQEMUCapsCacheReadLLong(virQEMUCapsCacheReaderPtr r,
+                          long long *val)
 {
-    char *archstr = NULL;
-    int ret = -1;
+    const void *data;
+    int64_t tmp;
 
-    if (!(archstr = qemuMonitorGetTargetArch(mon)))
-        goto cleanup;
+    if (!(data = virQEMUCapsCacheRead(r, sizeof(tmp))))
+        return -1;
 
-    if ((qemuCaps->arch = virQEMUCapsArchFromString(archstr)) == VIR_ARCH_NONE) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unknown QEMU arch %s"), archstr);
-        goto cleanup;
-    }
+    memcpy(&tmp, data, sizeof(tmp));
+    *val = tmp;
+    return 0;
+}
 
-    ret = 0;
 
- cleanup:
-    VIR_FREE(archstr);
-    return ret;
+static int
+virQEMUCapsCacheReadBool(virQEMUCapsCacheReaderPtr r,
+                         bool *val)
+{
+    unsigned int tmp;
+
+    if (virQEMUCapsCacheReadUInt(r, &tmp) < 0)
+        return -1;
+
+    *val = !!tmp;
+    return 0;
 }
 
 
-/**
- * virQEMUCapsInitQMPBasicArch:
- * @qemuCaps: QEMU capabilities
- *
+static int
+virQEMUCapsCacheReadString(virQEMUCapsCacheReaderPtr r,
+                           char **str)
+{
+    const char *data;
+    unsigned int len;
+
+    *str = NULL;
+
+    if (virQEMUCapsCacheReadUInt(r, &len) < 0)
+        return -1;
+
+    if (len == UINT32_MAX)
+        return 0;
+
+    if (!(data = virQEMUCapsCacheRead(r, len)) ||
+        VIR_STRNDUP(*str, data, len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+/* Counts of items are checked against the remaining data so that a
+ * corrupted file can't make us allocate huge arrays. */
+static int
+virQEMUCapsCacheReadCount(virQEMUCapsCacheReaderPtr r,
+                          size_t *count)
+{
+    unsigned int tmp;
+
+    if (virQEMUCapsCacheReadUInt(r, &tmp) < 0)
+        return -1;
+
+    if (tmp > (r->len - r->pos) / sizeof(uint32_t)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("malformed QEMU capabilities cache"));
+        return -1;
+    }
+
+    *count = tmp;
+    return 0;
+}
+
+
+static void
+virQEMUCapsFormatHostCPUModelInfoBinary(virQEMUCapsCacheWriterPtr w,
+                                        virQEMUCapsPtr qemuCaps,
+                                        virDomainVirtType type)
+{
+    qemuMonitorCPUModelInfoPtr model = virQEMUCapsGetHostCPUData(qemuCaps,
+                                                                 type)->info;
+    size_t i;
+
+    virQEMUCapsCacheWriteUInt(w, !!model);
+    if (!model)
+        return;
+
+    virQEMUCapsCacheWriteString(w, model->name);
+    virQEMUCapsCacheWriteUInt(w, model->migratability);
+    virQEMUCapsCacheWriteUInt(w, model->nprops);
+
+    for (i = 0; i < model->nprops; i++) {
+        qemuMonitorCPUPropertyPtr prop = model->props + i;
+
+        virQEMUCapsCacheWriteString(w, prop->name);
+        virQEMUCapsCacheWriteUInt(w, prop->type);
+
+        switch (prop->type) {
+        case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+            virQEMUCapsCacheWriteUInt(w, prop->value.boolean);
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_STRING:
+            virQEMUCapsCacheWriteString(w, prop->value.string);
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+            virQEMUCapsCacheWriteLLong(w, prop->value.number);
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_LAST:
+            break;
+        }
+
+        virQEMUCapsCacheWriteUInt(w, prop->migratable);
+    }
+}
+
+
+static int
+virQEMUCapsLoadHostCPUModelInfoBinary(virQEMUCapsCacheReaderPtr r,
+                                      virQEMUCapsPtr qemuCaps,
+                                      virDomainVirtType type)
+{
+    qemuMonitorCPUModelInfoPtr model = NULL;
+    bool present;
+    unsigned int val;
+    size_t i;
+    int ret = -1;
+
+    if (virQEMUCapsCacheReadBool(r, &present) < 0)
+        return -1;
+
+    if (!present)
+        return 0;
+
+    if (VIR_ALLOC(model) < 0 ||
+        virQEMUCapsCacheReadString(r, &model->name) < 0 ||
+        virQEMUCapsCacheReadBool(r, &model->migratability) < 0 ||
+        virQEMUCapsCacheReadCount(r, &model->nprops) < 0)
+        goto cleanup;
+
+    if (model->nprops > 0 &&
+        VIR_ALLOC_N(model->props, model->nprops) < 0)
+        goto cleanup;
+
+    for (i = 0; i < model->nprops; i++) {
+        qemuMonitorCPUPropertyPtr prop = model->props + i;
+
+        if (virQEMUCapsCacheReadString(r, &prop->name) < 0 ||
+            virQEMUCapsCacheReadUInt(r, &val) < 0)
+            goto cleanup;
+
+        prop->type = val;
+        switch (prop->type) {
+        case QEMU_MONITOR_CPU_PROPERTY_BOOLEAN:
+            if (virQEMUCapsCacheReadBool(r, &prop->value.boolean) < 0)
+                goto cleanup;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_STRING:
+            if (virQEMUCapsCacheReadString(r, &prop->value.string) < 0)
+                goto cleanup;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_NUMBER:
+            if (virQEMUCapsCacheReadLLong(r, &prop->value.number) < 0)
+                goto cleanup;
+            break;
+
+        case QEMU_MONITOR_CPU_PROPERTY_LAST:
+        default:
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("invalid CPU model property type %u in QEMU "
+                             "capabilities cache"), val);
+            goto cleanup;
+        }
+
+        if (virQEMUCapsCacheReadUInt(r, &val) < 0)
+            goto cleanup;
+        prop->migratable = val;
+    }
+
+    if (!model->name) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("missing host CPU model name in QEMU "
+                         "capabilities cache"));
+        goto cleanup;
+    }
+
+    virQEMUCapsSetCPUModelInfo(qemuCaps, type, model);
+    model = NULL;
+    ret = 0;
+
+ cleanup:
+    qemuMonitorCPUModelInfoFree(model);
+    return ret;
+}
+
+
+static void
+virQEMUCapsFormatCPUModelsBinary(virQEMUCapsCacheWriterPtr w,
+                                 virQEMUCapsPtr qemuCaps,
+                                 virDomainVirtType type)
+{
+    virDomainCapsCPUModelsPtr cpus;
+    size_t i;
+
+    if (type == VIR_DOMAIN_VIRT_KVM)
+        cpus = qemuCaps->kvmCPUModels;
+    else
+        cpus = qemuCaps->tcgCPUModels;
+
+    if (!cpus) {
+        virQEMUCapsCacheWriteUInt(w, 0);
+        return;
+    }
+
+    virQEMUCapsCacheWriteUInt(w, cpus->nmodels);
+    for (i = 0; i < cpus->nmodels; i++) {
+        virDomainCapsCPUModelPtr cpu = cpus->models + i;
+        size_t nblockers = virStringListLength((const char * const *)cpu->blockers);
+        size_t j;
+
+        virQEMUCapsCacheWriteString(w, cpu->name);
+        virQEMUCapsCacheWriteUInt(w, cpu->usable);
+        virQEMUCapsCacheWriteUInt(w, nblockers);
+        for (j = 0; j < nblockers; j++)
+            virQEMUCapsCacheWriteString(w, cpu->blockers[j]);
+    }
+}
+
+
+static int
+virQEMUCapsLoadCPUModelsBinary(virQEMUCapsCacheReaderPtr r,
+                               virQEMUCapsPtr qemuCaps,
+                               virDomainVirtType type)
+{
+    virDomainCapsCPUModelsPtr cpus;
+    char *name = NULL;
+    char **blockers = NULL;
+    size_t nmodels;
+    size_t i;
+    int ret = -1;
+
+    if (virQEMUCapsCacheReadCount(r, &nmodels) < 0)
+        return -1;
+
+    if (!nmodels)
+        return 0;
+
+    if (!(cpus = virDomainCapsCPUModelsNew(nmodels)))
+        return -1;
+
+    if (type == VIR_DOMAIN_VIRT_KVM)
+        qemuCaps->kvmCPUModels = cpus;
+    else
+        qemuCaps->tcgCPUModels = cpus;
+
+    for (i = 0; i < nmodels; i++) {
+        unsigned int usable;
+        size_t nblockers;
+        size_t j;
+
+        if (virQEMUCapsCacheReadString(r, &name) < 0 ||
+            virQEMUCapsCacheReadUInt(r, &usable) < 0 ||
+            virQEMUCapsCacheReadCount(r, &nblockers) < 0)
+            goto cleanup;
+
+        if (!name || usable >= VIR_DOMCAPS_CPU_USABLE_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed CPU model in QEMU capabilities cache"));
+            goto cleanup;
+        }
+
+        if (nblockers) {
+            if (VIR_ALLOC_N(blockers, nblockers + 1) < 0)
+                goto cleanup;
+
+            for (j = 0; j < nblockers; j++) {
+                if (virQEMUCapsCacheReadString(r, &blockers[j]) < 0)
+                    goto cleanup;
+
+                if (!blockers[j]) {
+                    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                                   _("missing blocker name in QEMU "
+                                     "capabilities cache"));
+                    goto cleanup;
+                }
+            }
+        }
+
+        if (virDomainCapsCPUModelsAddSteal(cpus, &name, usable, &blockers) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(name);
+    virStringListFree(blockers);
+    return ret;
+}
+
+
+/**
+ * virQEMUCapsFormatCacheBinary:
+ * @qemuCaps: capabilities to store
+ * @data: filled with the binary form of @qemuCaps
+ * @len: filled with the length of @data
+ *
+ * Formats the binary counterpart of virQEMUCapsFormatCache.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsFormatCacheBinary(virQEMUCapsPtr qemuCaps,
+                             char **data,
+                             size_t *len)
+{
+    virQEMUCapsCacheWriter w = { NULL, 0, 0, false };
+    virSEVCapabilityPtr sev = qemuCaps->sevCapabilities;
+    ssize_t flag = -1;
+    size_t i;
+
+    virQEMUCapsCacheWrite(&w, VIR_QEMU_CAPS_CACHE_MAGIC,
+                          strlen(VIR_QEMU_CAPS_CACHE_MAGIC));
+    virQEMUCapsCacheWriteUInt(&w, VIR_QEMU_CAPS_CACHE_VERSION);
+    virQEMUCapsCacheWriteUInt(&w, QEMU_CAPS_LAST);
+
+    virQEMUCapsCacheWriteLLong(&w, qemuCaps->ctime);
+    virQEMUCapsCacheWriteLLong(&w, qemuCaps->libvirtCtime);
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->libvirtVersion);
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->usedQMP);
+
+    virQEMUCapsCacheWriteUInt(&w, virBitmapCountBits(qemuCaps->flags));
+    while ((flag = virBitmapNextSetBit(qemuCaps->flags, flag)) >= 0)
+        virQEMUCapsCacheWriteUInt(&w, flag);
+
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->version);
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->kvmVersion);
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->microcodeVersion);
+    virQEMUCapsCacheWriteString(&w, qemuCaps->package);
+    virQEMUCapsCacheWriteString(&w, qemuCaps->kernelVersion);
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->arch);
+
+    virQEMUCapsFormatHostCPUModelInfoBinary(&w, qemuCaps, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsFormatHostCPUModelInfoBinary(&w, qemuCaps, VIR_DOMAIN_VIRT_QEMU);
+
+    virQEMUCapsFormatCPUModelsBinary(&w, qemuCaps, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsFormatCPUModelsBinary(&w, qemuCaps, VIR_DOMAIN_VIRT_QEMU);
+
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->nmachineTypes);
+    for (i = 0; i < qemuCaps->nmachineTypes; i++) {
+        struct virQEMUCapsMachineType *machine = qemuCaps->machineTypes + i;
+
+        virQEMUCapsCacheWriteString(&w, machine->name);
+        virQEMUCapsCacheWriteString(&w, machine->alias);
+        virQEMUCapsCacheWriteUInt(&w, machine->maxCpus);
+        virQEMUCapsCacheWriteUInt(&w, machine->hotplugCpus);
+        virQEMUCapsCacheWriteUInt(&w, machine->qemuDefault);
+    }
+
+    virQEMUCapsCacheWriteUInt(&w, qemuCaps->ngicCapabilities);
+    for (i = 0; i < qemuCaps->ngicCapabilities; i++) {
+        virQEMUCapsCacheWriteUInt(&w, qemuCaps->gicCapabilities[i].version);
+        virQEMUCapsCacheWriteUInt(&w,
+                                  qemuCaps->gicCapabilities[i].implementation);
+    }
+
+    virQEMUCapsCacheWriteUInt(&w, !!sev);
+    if (sev) {
+        virQEMUCapsCacheWriteUInt(&w, sev->cbitpos);
+        virQEMUCapsCacheWriteUInt(&w, sev->reduced_phys_bits);
+        virQEMUCapsCacheWriteString(&w, sev->pdh);
+        virQEMUCapsCacheWriteString(&w, sev->cert_chain);
+    }
+
+    if (w.error) {
+        VIR_FREE(w.data);
+        return -1;
+    }
+
+    *data = w.data;
+    *len = w.len;
+    return 0;
+}
+
+
+/**
+ * virQEMUCapsLoadCacheBinary:
+ * @hostArch: architecture of the host
+ * @qemuCaps: capabilities to fill in
+ * @data: binary form of the capabilities
+ * @len: length of @data
+ *
+ * Loads capabilities formatted by virQEMUCapsFormatCacheBinary.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virQEMUCapsLoadCacheBinary(virArch hostArch,
+                           virQEMUCapsPtr qemuCaps,
+                           const char *data,
+                           size_t len)
+{
+    virQEMUCapsCacheReader r = { data, len, 0 };
+    const char *magic;
+    unsigned int version;
+    unsigned int nflags;
+    unsigned int val;
+    long long l;
+    size_t n;
+    size_t i;
+
+    if (!(magic = virQEMUCapsCacheRead(&r, strlen(VIR_QEMU_CAPS_CACHE_MAGIC))) ||
+        memcmp(magic, VIR_QEMU_CAPS_CACHE_MAGIC,
+               strlen(VIR_QEMU_CAPS_CACHE_MAGIC)) != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("not a QEMU capabilities cache"));
+        return -1;
+    }
+
+    if (virQEMUCapsCacheReadUInt(&r, &version) < 0 ||
+        virQEMUCapsCacheReadUInt(&r, &nflags) < 0)
+        return -1;
+
+    if (version != VIR_QEMU_CAPS_CACHE_VERSION || nflags != QEMU_CAPS_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("QEMU capabilities cache was written by a different "
+                         "libvirt (format %u, %u flags)"), version, nflags);
+        return -1;
+    }
+
+    if (virQEMUCapsCacheReadLLong(&r, &l) < 0)
+        return -1;
+    qemuCaps->ctime = (time_t)l;
+
+    if (virQEMUCapsCacheReadLLong(&r, &l) < 0)
+        return -1;
+    qemuCaps->libvirtCtime = (time_t)l;
+
+    if (virQEMUCapsCacheReadUInt(&r, &qemuCaps->libvirtVersion) < 0 ||
+        virQEMUCapsCacheReadBool(&r, &qemuCaps->usedQMP) < 0 ||
+        virQEMUCapsCacheReadCount(&r, &n) < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        if (virQEMUCapsCacheReadUInt(&r, &val) < 0)
+            return -1;
+
+        if (val >= QEMU_CAPS_LAST) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unknown qemu capabilities flag %u"), val);
+            return -1;
+        }
+        virQEMUCapsSet(qemuCaps, val);
+    }
+
+    if (virQEMUCapsCacheReadUInt(&r, &qemuCaps->version) < 0 ||
+        virQEMUCapsCacheReadUInt(&r, &qemuCaps->kvmVersion) < 0 ||
+        virQEMUCapsCacheReadUInt(&r, &qemuCaps->microcodeVersion) < 0 ||
+        virQEMUCapsCacheReadString(&r, &qemuCaps->package) < 0 ||
+        virQEMUCapsCacheReadString(&r, &qemuCaps->kernelVersion) < 0 ||
+        virQEMUCapsCacheReadUInt(&r, &val) < 0)
+        return -1;
+
+    if (val == VIR_ARCH_NONE || val >= VIR_ARCH_LAST) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unknown arch %u in QEMU capabilities cache"), val);
+        return -1;
+    }
+    qemuCaps->arch = val;
+
+    if (virQEMUCapsLoadHostCPUModelInfoBinary(&r, qemuCaps,
+                                              VIR_DOMAIN_VIRT_KVM) < 0 ||
+        virQEMUCapsLoadHostCPUModelInfoBinary(&r, qemuCaps,
+                                              VIR_DOMAIN_VIRT_QEMU) < 0)
+        return -1;
+
+    if (virQEMUCapsLoadCPUModelsBinary(&r, qemuCaps, VIR_DOMAIN_VIRT_KVM) < 0 ||
+        virQEMUCapsLoadCPUModelsBinary(&r, qemuCaps, VIR_DOMAIN_VIRT_QEMU) < 0)
+        return -1;
+
+    if (virQEMUCapsCacheReadCount(&r, &n) < 0)
+        return -1;
+
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->machineTypes, n) < 0)
+            return -1;
+        qemuCaps->nmachineTypes = n;
+
+        for (i = 0; i < n; i++) {
+            struct virQEMUCapsMachineType *machine = qemuCaps->machineTypes + i;
+
+            if (virQEMUCapsCacheReadString(&r, &machine->name) < 0 ||
+                virQEMUCapsCacheReadString(&r, &machine->alias) < 0 ||
+                virQEMUCapsCacheReadUInt(&r, &machine->maxCpus) < 0 ||
+                virQEMUCapsCacheReadBool(&r, &machine->hotplugCpus) < 0 ||
+                virQEMUCapsCacheReadBool(&r, &machine->qemuDefault) < 0)
+                return -1;
+
+            if (!machine->name) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("missing machine name in QEMU capabilities cache"));
+                return -1;
+            }
+        }
+    }
+
+    if (virQEMUCapsCacheReadCount(&r, &n) < 0)
+        return -1;
+
+    if (n > 0) {
+        if (VIR_ALLOC_N(qemuCaps->gicCapabilities, n) < 0)
+            return -1;
+        qemuCaps->ngicCapabilities = n;
+
+        for (i = 0; i < n; i++) {
+            virGICCapabilityPtr cap = &qemuCaps->gicCapabilities[i];
+
+            if (virQEMUCapsCacheReadUInt(&r, &val) < 0)
+                return -1;
+            cap->version = val;
+
+            if (virQEMUCapsCacheReadUInt(&r, &val) < 0)
+                return -1;
+            cap->implementation = val;
+        }
+    }
+
+    if (virQEMUCapsCacheReadUInt(&r, &val) < 0)
+        return -1;
+
+    if (val) {
+        VIR_AUTOPTR(virSEVCapability) sev = NULL;
+
+        if (VIR_ALLOC(sev) < 0 ||
+            virQEMUCapsCacheReadUInt(&r, &sev->cbitpos) < 0 ||
+            virQEMUCapsCacheReadUInt(&r, &sev->reduced_phys_bits) < 0 ||
+            virQEMUCapsCacheReadString(&r, &sev->pdh) < 0 ||
+            virQEMUCapsCacheReadString(&r, &sev->cert_chain) < 0)
+            return -1;
+
+        if (!sev->pdh || !sev->cert_chain) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("missing SEV platform data in QEMU "
+                             "capabilities cache"));
+            return -1;
+        }
+
+        VIR_STEAL_PTR(qemuCaps->sevCapabilities, sev);
+    }
+
+    if (r.pos != r.len) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("trailing data in QEMU capabilities cache"));
+        return -1;
+    }
+
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_KVM);
+    virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_QEMU);
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsSaveFileHelper(int fd, const void *opaque)
+{
+    const virQEMUCapsCacheWriter *w = opaque;
+
+    if (safewrite(fd, w->data, w->len) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+virQEMUCapsSaveFile(void *data,
+                    const char *filename,
+                    void *privData ATTRIBUTE_UNUSED)
+{
+    virQEMUCapsPtr qemuCaps = data;
+    virQEMUCapsCacheWriter w = { NULL, 0, 0, false };
+    char *xmlFile = NULL;
+    char *xml = NULL;
+    int ret = -1;
+
+    if (virQEMUCapsFormatCacheBinary(qemuCaps, &w.data, &w.len) < 0 ||
+        virFileRewrite(filename, 0600, virQEMUCapsSaveFileHelper, &w) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Saved caps '%s' for '%s' with (%lld, %lld)",
+              filename, qemuCaps->binary,
+              (long long)qemuCaps->ctime,
+              (long long)qemuCaps->libvirtCtime);
+
+    /* The XML form is never loaded, failing to write it is harmless */
+    if (virFileHasSuffix(filename, ".bin") &&
+        (virAsprintf(&xmlFile, "%.*s.xml",
+                     (int)(strlen(filename) - strlen(".bin")), filename) < 0 ||
+         !(xml = virQEMUCapsFormatCache(qemuCaps)) ||
+         virFileWriteStr(xmlFile, xml, 0600) < 0)) {
+        VIR_WARN("Failed to save '%s' for '%s': %s",
+                 NULLSTR(xmlFile), qemuCaps->binary,
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(w.data);
+    VIR_FREE(xmlFile);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static bool
+virQEMUCapsIsValid(void *data,
+                   void *privData)
+{
+    virQEMUCapsPtr qemuCaps = data;
+    virQEMUCapsCachePrivPtr priv = privData;
+    bool kvmUsable;
+    struct stat sb;
+
+    if (!qemuCaps->binary)
+        return true;
+
+    if (qemuCaps->libvirtCtime != virGetSelfLastChanged() ||
+        qemuCaps->libvirtVersion != LIBVIR_VERSION_NUMBER) {
+        VIR_DEBUG("Outdated capabilities for '%s': libvirt changed "
+                  "(%lld vs %lld, %lu vs %lu)",
+                  qemuCaps->binary,
+                  (long long)qemuCaps->libvirtCtime,
+                  (long long)virGetSelfLastChanged(),
+                  (unsigned long)qemuCaps->libvirtVersion,
+                  (unsigned long)LIBVIR_VERSION_NUMBER);
+        return false;
+    }
+
+    if (stat(qemuCaps->binary, &sb) < 0) {
+        char ebuf[1024];
+        VIR_DEBUG("Failed to stat QEMU binary '%s': %s",
+                  qemuCaps->binary,
+                  virStrerror(errno, ebuf, sizeof(ebuf)));
+        return false;
+    }
+
+    if (sb.st_ctime != qemuCaps->ctime) {
+        VIR_DEBUG("Outdated capabilities for '%s': QEMU binary changed "
+                  "(%lld vs %lld)",
+                  qemuCaps->binary,
+                  (long long)sb.st_ctime, (long long)qemuCaps->ctime);
+        return false;
+    }
+
+    if (!virQEMUCapsGuestIsNative(priv->hostArch, qemuCaps->arch)) {
+        VIR_DEBUG("Guest arch (%s) is not native to host arch (%s), "
+                  "skipping KVM-related checks",
+                  virArchToString(qemuCaps->arch),
+                  virArchToString(priv->hostArch));
+        return true;
+    }
+
+    kvmUsable = virFileAccessibleAs("/dev/kvm", R_OK | W_OK,
+                                    priv->runUid, priv->runGid) == 0;
+
+    if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
+        kvmUsable) {
+        VIR_DEBUG("KVM was not enabled when probing '%s', "
+                  "but it should be usable now",
+                  qemuCaps->binary);
+        return false;
+    }
+
+    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM) &&
+        !kvmUsable) {
+        VIR_DEBUG("KVM was enabled when probing '%s', "
+                  "but it is not available now",
+                  qemuCaps->binary);
+        return false;
+    }
+
+    if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM)) {
+        if (priv->microcodeVersion != qemuCaps->microcodeVersion) {
+            VIR_DEBUG("Outdated capabilities for '%s': microcode version "
+                      "changed (%u vs %u)",
+                      qemuCaps->binary,
+                      priv->microcodeVersion,
+                      qemuCaps->microcodeVersion);
+            return false;
+        }
+
+        if (STRNEQ_NULLABLE(priv->kernelVersion, qemuCaps->kernelVersion)) {
+            VIR_DEBUG("Outdated capabilities for '%s': kernel version changed "
+                      "('%s' vs '%s')",
+                      qemuCaps->binary,
+                      priv->kernelVersion,
+                      qemuCaps->kernelVersion);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+static void virQEMUCapsMonitorNotify(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
+                                     virDomainObjPtr vm ATTRIBUTE_UNUSED,
+                                     void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+static qemuMonitorCallbacks callbacks = {
+    .eofNotify = virQEMUCapsMonitorNotify,
+    .errorNotify = virQEMUCapsMonitorNotify,
+};
+
+
+/**
+ * virQEMUCapsInitQMPArch:
+ * @qemuCaps: QEMU capabilities
+ * @mon: QEMU monitor
+ *
+ * Initialize the architecture for @qemuCaps by asking @mon.
+ *
+ * Returns: 0 on success, <0 on failure
+ */
+static int
+virQEMUCapsInitQMPArch(virQEMUCapsPtr qemuCaps,
+                            qemuMonitorPtr mon)
+{
+    char *archstr = NULL;
+    int ret = -1;
+
+    if (!(archstr = qemuMonitorGetTargetArch(mon)))
+        goto cleanup;
+
+    if ((qemuCaps->arch = virQEMUCapsArchFromString(archstr)) == VIR_ARCH_NONE) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unknown QEMU arch %s"), archstr);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(archstr);
+    return ret;
+}
+
+
+/**
+ * virQEMUCapsInitQMPBasicArch:
+ * @qemuCaps: QEMU capabilities
+ *
  * Initialize @qemuCaps with basic architecture-dependent capabilities.
  */
 void
@@ -4241,6 +5109,8 @@ struct _virQEMUCapsInitQMPCommand {
 };
 
 
+static volatile int virQEMUCapsProbeCounter;
+
 static void
 virQEMUCapsInitQMPCommandAbort(virQEMUCapsInitQMPCommandPtr cmd)
 {
@@ -4298,6 +5168,7 @@ virQEMUCapsInitQMPCommandNew(char *binary,
                              char **qmperr)
 {
     virQEMUCapsInitQMPCommandPtr cmd = NULL;
+    unsigned int probe;
 
     if (VIR_ALLOC(cmd) < 0)
         goto error;
@@ -4309,11 +5180,15 @@ virQEMUCapsInitQMPCommandNew(char *binary,
     cmd->runGid = runGid;
     cmd->qmperr = qmperr;
 
+    /* Several binaries may be probed at the same time, each of them
+     * needs its own monitor socket and pidfile. */
+    probe = virAtomicIntInc(&virQEMUCapsProbeCounter);
+
     /* the ".sock" sufix is important to avoid a possible clash with a qemu
      * domain called "capabilities"
      */
-    if (virAsprintf(&cmd->monpath, "%s/%s", libDir,
-                    "capabilities.monitor.sock") < 0)
+    if (virAsprintf(&cmd->monpath, "%s/capabilities.%u.monitor.sock",
+                    libDir, probe) < 0)
         goto error;
     if (virAsprintf(&cmd->monarg, "unix:%s,server,nowait", cmd->monpath) < 0)
         goto error;
@@ -4324,7 +5199,8 @@ virQEMUCapsInitQMPCommandNew(char *binary,
      * -daemonize we need QEMU to be allowed to create them, rather
      * than libvirtd. So we're using libDir which QEMU can write to
      */
-    if (virAsprintf(&cmd->pidfile, "%s/%s", libDir, "capabilities.pidfile") < 0)
+    if (virAsprintf(&cmd->pidfile, "%s/capabilities.%u.pidfile",
+                    libDir, probe) < 0)
         goto error;
 
     virPidFileForceCleanupPath(cmd->pidfile);
@@ -4436,6 +5312,11 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
                    char **qmperr)
 {
     virQEMUCapsInitQMPCommandPtr cmd = NULL;
+    unsigned long long start = 0;
+    unsigned long long launched = 0;
+    unsigned long long probed = 0;
+    unsigned long long tcgLaunched = 0;
+    unsigned long long tcgProbed = 0;
     int ret = -1;
     int rc;
 
@@ -4443,15 +5324,22 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
                                              runUid, runGid, qmperr)))
         goto cleanup;
 
+    ignore_value(virTimeMillisNowRaw(&start));
+
     if ((rc = virQEMUCapsInitQMPCommandRun(cmd, false)) != 0) {
         if (rc == 1)
             ret = 0;
         goto cleanup;
     }
 
+    ignore_value(virTimeMillisNowRaw(&launched));
+
     if (virQEMUCapsInitQMPMonitor(qemuCaps, cmd->mon) < 0)
         goto cleanup;
 
+    ignore_value(virTimeMillisNowRaw(&probed));
+    tcgLaunched = tcgProbed = probed;
+
     if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM)) {
         virQEMUCapsInitQMPCommandAbort(cmd);
         if ((rc = virQEMUCapsInitQMPCommandRun(cmd, true)) != 0) {
@@ -4460,10 +5348,20 @@ virQEMUCapsInitQMP(virQEMUCapsPtr qemuCaps,
             goto cleanup;
         }
 
+        ignore_value(virTimeMillisNowRaw(&tcgLaunched));
+
         if (virQEMUCapsInitQMPMonitorTCG(qemuCaps, cmd->mon) < 0)
             goto cleanup;
+
+        ignore_value(virTimeMillisNowRaw(&tcgProbed));
     }
 
+    VIR_DEBUG("QMP probing of '%s' took %llu ms: start %llu ms, "
+              "query %llu ms, TCG start %llu ms, TCG query %llu ms",
+              qemuCaps->binary, tcgProbed - start, launched - start,
+              probed - launched, tcgLaunched - probed,
+              tcgProbed - tcgLaunched);
+
     ret = 0;
 
  cleanup:
@@ -4504,6 +5402,11 @@ virQEMUCapsNewForBinaryInternal(virArch hostArch,
     virQEMUCapsPtr qemuCaps;
     struct stat sb;
     char *qmperr = NULL;
+    unsigned long long start = 0;
+    unsigned long long probed = 0;
+    unsigned long long now = 0;
+
+    ignore_value(virTimeMillisNowRaw(&start));
 
     if (!(qemuCaps = virQEMUCapsNew()))
         goto error;
@@ -4546,9 +5449,16 @@ virQEMUCapsNewForBinaryInternal(virArch hostArch,
     qemuCaps->libvirtCtime = virGetSelfLastChanged();
     qemuCaps->libvirtVersion = LIBVIR_VERSION_NUMBER;
 
+    ignore_value(virTimeMillisNowRaw(&probed));
+
     virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_KVM);
     virQEMUCapsInitHostCPUModel(qemuCaps, hostArch, VIR_DOMAIN_VIRT_QEMU);
 
+    ignore_value(virTimeMillisNowRaw(&now));
+    VIR_DEBUG("Capabilities of '%s' probed in %llu ms: QMP %llu ms, "
+              "host CPU model %llu ms",
+              binary, now - start, probed - start, now - probed);
+
     if (virQEMUCapsGet(qemuCaps, QEMU_CAPS_KVM)) {
         qemuCaps->microcodeVersion = microcodeVersion;
 
@@ -4582,6 +5492,44 @@ virQEMUCapsNewData(const char *binary,
 }
 
 
+static int
+virQEMUCapsLoadCacheFile(virArch hostArch,
+                         virQEMUCapsPtr qemuCaps,
+                         const char *filename)
+{
+    struct stat sb;
+    void *data = MAP_FAILED;
+    int fd = -1;
+    int ret = -1;
+
+    if ((fd = open(filename, O_RDONLY)) < 0 ||
+        fstat(fd, &sb) < 0) {
+        virReportSystemError(errno, _("cannot read '%s'"), filename);
+        goto cleanup;
+    }
+
+    if (sb.st_size <= 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("QEMU capabilities cache '%s' is empty"), filename);
+        goto cleanup;
+    }
+
+    if ((data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE,
+                     fd, 0)) == MAP_FAILED) {
+        virReportSystemError(errno, _("cannot map '%s'"), filename);
+        goto cleanup;
+    }
+
+    ret = virQEMUCapsLoadCacheBinary(hostArch, qemuCaps, data, sb.st_size);
+
+ cleanup:
+    if (data != MAP_FAILED)
+        munmap(data, sb.st_size);
+    VIR_FORCE_CLOSE(fd);
+    return ret;
+}
+
+
 static void *
 virQEMUCapsLoadFile(const char *filename,
                     const char *binary,
@@ -4596,7 +5544,7 @@ virQEMUCapsLoadFile(const char *filename,
     if (VIR_STRDUP(qemuCaps->binary, binary) < 0)
         goto error;
 
-    if (virQEMUCapsLoadCache(priv->hostArch, qemuCaps, filename) < 0)
+    if (virQEMUCapsLoadCacheFile(priv->hostArch, qemuCaps, filename) < 0)
         goto error;
 
  cleanup:
@@ -4647,12 +5595,36 @@ virQEMUCapsFilterByMachineType(virQEMUCapsPtr qemuCaps,
 }
 
 
+/* The files checked by virQEMUCapsIsValid, the rest of its inputs are
+ * fixed while the daemon runs */
+static char **
+virQEMUCapsWatchPaths(void *data,
+                      void *privData ATTRIBUTE_UNUSED)
+{
+    virQEMUCapsPtr qemuCaps = data;
+    char **paths = NULL;
+
+    if (VIR_ALLOC_N(paths, 1) < 0)
+        return NULL;
+
+    if ((qemuCaps->binary &&
+         virStringListAdd(&paths, qemuCaps->binary) < 0) ||
+        virStringListAdd(&paths, "/dev/kvm") < 0) {
+        virStringListFree(paths);
+        return NULL;
+    }
+
+    return paths;
+}
+
+
 virFileCacheHandlers qemuCapsCacheHandlers = {
     .isValid = virQEMUCapsIsValid,
     .newData = virQEMUCapsNewData,
     .loadFile = virQEMUCapsLoadFile,
     .saveFile = virQEMUCapsSaveFile,
     .privFree = virQEMUCapsCachePrivFree,
+    .watchPaths = virQEMUCapsWatchPaths,
 };
 
 
@@ -4671,7 +5643,7 @@ virQEMUCapsCacheNew(const char *libDir,
     if (virAsprintf(&capsCacheDir, "%s/capabilities", cacheDir) < 0)
         goto error;
 
-    if (!(cache = virFileCacheNew(capsCacheDir, "xml", &qemuCapsCacheHandlers)))
+    if (!(cache = virFileCacheNew(capsCacheDir, "bin", &qemuCapsCacheHandlers)))
         goto error;
 
     if (VIR_ALLOC(priv) < 0)
@@ -493,6 +493,8 @@ typedef enum { /* virQEMUCapsFlags grouping marker for syntax-check */
     QEMU_CAPS_VFIO_PCI_DISPLAY, /* -device vfio-pci.display */
     QEMU_CAPS_BLOCKDEV, /* -blockdev and blockdev-add are supported */
     QEMU_CAPS_DEVICE_VFIO_AP, /* -device vfio-ap */
+    QEMU_CAPS_QMP_QUERY_NAMED_BLOCK_NODES_FLAT, /* query-named-block-nodes supports flat */
+    QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS, /* -object memory-backend-*,prealloc-threads= */
 
     QEMU_CAPS_LAST /* this must always be the last item */
 } virQEMUCapsFlags;
@@ -500,6 +502,9 @@ typedef enum { /* virQEMUCapsFlags grouping marker for syntax-check */
 typedef struct _virQEMUCaps virQEMUCaps;
 typedef virQEMUCaps *virQEMUCapsPtr;
 
+typedef struct _virQEMUCapsFragments virQEMUCapsFragments;
+typedef virQEMUCapsFragments *virQEMUCapsFragmentsPtr;
+
 virQEMUCapsPtr virQEMUCapsNew(void);
 
 void virQEMUCapsSet(virQEMUCapsPtr qemuCaps,
@@ -521,6 +526,13 @@ bool virQEMUCapsSupportsVmport(virQEMUCapsPtr qemuCaps,
 
 char *virQEMUCapsFlagsString(virQEMUCapsPtr qemuCaps);
 
+char *virQEMUCapsGetFragmentsID(virQEMUCapsPtr qemuCaps);
+char *virQEMUCapsGetFragment(virQEMUCapsPtr qemuCaps,
+                             const char *key);
+void virQEMUCapsAddFragment(virQEMUCapsPtr qemuCaps,
+                            const char *key,
+                            const char *fragment);
+
 const char *virQEMUCapsGetBinary(virQEMUCapsPtr qemuCaps);
 virArch virQEMUCapsGetArch(virQEMUCapsPtr qemuCaps);
 unsigned int virQEMUCapsGetVersion(virQEMUCapsPtr qemuCaps);
@@ -43,6 +43,13 @@ int virQEMUCapsLoadCache(virArch hostArch,
                          virQEMUCapsPtr qemuCaps,
                          const char *filename);
 char *virQEMUCapsFormatCache(virQEMUCapsPtr qemuCaps);
+int virQEMUCapsLoadCacheBinary(virArch hostArch,
+                               virQEMUCapsPtr qemuCaps,
+                               const char *data,
+                               size_t len);
+int virQEMUCapsFormatCacheBinary(virQEMUCapsPtr qemuCaps,
+                                 char **data,
+                                 size_t *len);
 
 int
 virQEMUCapsInitQMPMonitor(virQEMUCapsPtr qemuCaps,
@@ -35,6 +35,7 @@
 #include "viralloc.h"
 #include "virlog.h"
 #include "virarch.h"
+#include "vircrypto.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "virnetdev.h"
@@ -170,6 +171,7 @@ VIR_ENUM_IMPL(qemuDomainFSDriver, VIR_DOMAIN_FS_DRIVER_TYPE_LAST,
               "handle",
               NULL,
               NULL,
+              NULL,
               NULL);
 
 VIR_ENUM_DECL(qemuNumaPolicy)
@@ -1046,44 +1048,52 @@ qemuGetDriveSourceString(virStorageSourcePtr src,
 static bool
 qemuDiskConfigBlkdeviotuneHasBasic(virDomainDiskDefPtr disk)
 {
-    return disk->blkdeviotune.total_bytes_sec ||
-           disk->blkdeviotune.read_bytes_sec ||
-           disk->blkdeviotune.write_bytes_sec ||
-           disk->blkdeviotune.total_iops_sec ||
-           disk->blkdeviotune.read_iops_sec ||
-           disk->blkdeviotune.write_iops_sec;
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
+    return iotune->total_bytes_sec ||
+           iotune->read_bytes_sec ||
+           iotune->write_bytes_sec ||
+           iotune->total_iops_sec ||
+           iotune->read_iops_sec ||
+           iotune->write_iops_sec;
 }
 
 
 static bool
 qemuDiskConfigBlkdeviotuneHasMax(virDomainDiskDefPtr disk)
 {
-    return disk->blkdeviotune.total_bytes_sec_max ||
-           disk->blkdeviotune.read_bytes_sec_max ||
-           disk->blkdeviotune.write_bytes_sec_max ||
-           disk->blkdeviotune.total_iops_sec_max ||
-           disk->blkdeviotune.read_iops_sec_max ||
-           disk->blkdeviotune.write_iops_sec_max ||
-           disk->blkdeviotune.size_iops_sec;
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
+    return iotune->total_bytes_sec_max ||
+           iotune->read_bytes_sec_max ||
+           iotune->write_bytes_sec_max ||
+           iotune->total_iops_sec_max ||
+           iotune->read_iops_sec_max ||
+           iotune->write_iops_sec_max ||
+           iotune->size_iops_sec;
 }
 
 
 static bool
 qemuDiskConfigBlkdeviotuneHasMaxLength(virDomainDiskDefPtr disk)
 {
-    return disk->blkdeviotune.total_bytes_sec_max_length ||
-           disk->blkdeviotune.read_bytes_sec_max_length ||
-           disk->blkdeviotune.write_bytes_sec_max_length ||
-           disk->blkdeviotune.total_iops_sec_max_length ||
-           disk->blkdeviotune.read_iops_sec_max_length ||
-           disk->blkdeviotune.write_iops_sec_max_length;
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
+    return iotune->total_bytes_sec_max_length ||
+           iotune->read_bytes_sec_max_length ||
+           iotune->write_bytes_sec_max_length ||
+           iotune->total_iops_sec_max_length ||
+           iotune->read_iops_sec_max_length ||
+           iotune->write_iops_sec_max_length;
 }
 
 
 bool
 qemuDiskConfigBlkdeviotuneEnabled(virDomainDiskDefPtr disk)
 {
-    return !!disk->blkdeviotune.group_name ||
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
+    return !!iotune->group_name ||
            qemuDiskConfigBlkdeviotuneHasBasic(disk) ||
            qemuDiskConfigBlkdeviotuneHasMax(disk) ||
            qemuDiskConfigBlkdeviotuneHasMaxLength(disk);
@@ -1102,8 +1112,10 @@ static int
 qemuCheckDiskConfigBlkdeviotune(virDomainDiskDefPtr disk,
                                 virQEMUCapsPtr qemuCaps)
 {
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
     /* group_name by itself is ignored by qemu */
-    if (disk->blkdeviotune.group_name &&
+    if (iotune->group_name &&
         !qemuDiskConfigBlkdeviotuneHasBasic(disk) &&
         !qemuDiskConfigBlkdeviotuneHasMax(disk) &&
         !qemuDiskConfigBlkdeviotuneHasMaxLength(disk)) {
@@ -1113,19 +1125,19 @@ qemuCheckDiskConfigBlkdeviotune(virDomainDiskDefPtr disk,
         return -1;
     }
 
-    if (disk->blkdeviotune.total_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.read_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.write_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.total_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.read_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.write_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.total_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.read_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.write_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.total_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.read_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.write_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
-        disk->blkdeviotune.size_iops_sec > QEMU_BLOCK_IOTUNE_MAX) {
+    if (iotune->total_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->read_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->write_bytes_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->total_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->read_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->write_iops_sec > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->total_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->read_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->write_bytes_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->total_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->read_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->write_iops_sec_max > QEMU_BLOCK_IOTUNE_MAX ||
+        iotune->size_iops_sec > QEMU_BLOCK_IOTUNE_MAX) {
         virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
                       _("block I/O throttle limit must "
                         "be no more than %llu using QEMU"), QEMU_BLOCK_IOTUNE_MAX);
@@ -1143,7 +1155,7 @@ qemuCheckDiskConfigBlkdeviotune(virDomainDiskDefPtr disk,
         }
 
         /* block I/O group 2.4 */
-        if (disk->blkdeviotune.group_name &&
+        if (iotune->group_name &&
             !virQEMUCapsGet(qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_GROUP)) {
             virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
                            _("the block I/O throttling group parameter is "
@@ -1597,10 +1609,12 @@ static void
 qemuBuildDiskThrottling(virDomainDiskDefPtr disk,
                         virBufferPtr buf)
 {
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
 #define IOTUNE_ADD(_field, _label) \
-    if (disk->blkdeviotune._field) { \
+    if (iotune->_field) { \
         virBufferAsprintf(buf, ",throttling." _label "=%llu", \
-                          disk->blkdeviotune._field); \
+                          iotune->_field); \
     }
 
     IOTUNE_ADD(total_bytes_sec, "bps-total");
@@ -1618,9 +1632,9 @@ qemuBuildDiskThrottling(virDomainDiskDefPtr disk,
     IOTUNE_ADD(write_iops_sec_max, "iops-write-max");
 
     IOTUNE_ADD(size_iops_sec, "iops-size");
-    if (disk->blkdeviotune.group_name) {
+    if (iotune->group_name) {
         virBufferAddLit(buf, ",throttling.group=");
-        virQEMUBuildBufferEscapeComma(buf, disk->blkdeviotune.group_name);
+        virQEMUBuildBufferEscapeComma(buf, iotune->group_name);
     }
 
     IOTUNE_ADD(total_bytes_sec_max_length, "bps-total-max-length");
@@ -2416,11 +2430,184 @@ qemuBuildDiskSourceCommandLine(virCommandPtr cmd,
 }
 
 
+/* State of the lookups of -device strings in the cache of command line
+ * fragments kept by qemuCaps, see the command_line_cache option */
+typedef struct _qemuBuildFragmentCache qemuBuildFragmentCache;
+typedef qemuBuildFragmentCache *qemuBuildFragmentCachePtr;
+struct _qemuBuildFragmentCache {
+    virCapsPtr caps;
+    virDomainXMLOptionPtr xmlopt;
+    virQEMUCapsPtr qemuCaps;
+
+    /* hash of everything besides the device itself which
+     * the -device strings depend on */
+    char *context;
+};
+
+
+static void
+qemuBuildFragmentCacheClear(qemuBuildFragmentCachePtr cache)
+{
+    virObjectUnref(cache->caps);
+    VIR_FREE(cache->context);
+}
+
+
+static int
+qemuBuildFragmentCacheInit(qemuBuildFragmentCachePtr cache,
+                           virQEMUDriverPtr driver,
+                           const virDomainDef *def,
+                           virQEMUCapsPtr qemuCaps)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *flags = NULL;
+    size_t i;
+    int ret = -1;
+
+    memset(cache, 0, sizeof(*cache));
+    cache->xmlopt = driver->xmlopt;
+    cache->qemuCaps = qemuCaps;
+
+    if (!(cache->caps = virQEMUDriverGetCapabilities(driver, false)))
+        goto cleanup;
+
+    if (!(flags = virQEMUCapsGetFragmentsID(qemuCaps)))
+        goto cleanup;
+
+    virBufferAsprintf(&buf, "%s\n%s\n%s\n%zu\n",
+                      flags, NULLSTR(def->os.machine),
+                      virArchToString(def->os.arch), def->niothreadids);
+
+    /* device addresses refer to the controllers by their aliases */
+    for (i = 0; i < def->ncontrollers; i++) {
+        virDomainDeviceDef dev = {
+            .type = VIR_DOMAIN_DEVICE_CONTROLLER,
+            .data.controller = def->controllers[i],
+        };
+
+        if (virDomainDeviceDefFormat(&buf, &dev, cache->caps,
+                                     cache->xmlopt, 0) < 0)
+            goto cleanup;
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256,
+                            virBufferCurrentContent(&buf),
+                            &cache->context) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0)
+        qemuBuildFragmentCacheClear(cache);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(flags);
+    return ret;
+}
+
+
+/**
+ * qemuBuildFragmentCacheLookup:
+ * @cache: fragment cache state, may be NULL
+ * @dev: the device
+ * @flags: virDomainDefFormatFlags to format @dev with
+ * @params: any other input the fragment depends on
+ * @key: filled with the key to store the fragment with
+ *
+ * Looks up the fragment for @dev in the cache. The XML of @dev formatted
+ * with @flags must cover everything the fragment is built from apart
+ * from @params and the context of @cache.
+ *
+ * Returns the cached fragment or NULL. @key is NULL when @cache is
+ * NULL or the key could not be computed, the fragment is not cached
+ * then.
+ */
+static char *
+qemuBuildFragmentCacheLookup(qemuBuildFragmentCachePtr cache,
+                             virDomainDeviceDefPtr dev,
+                             unsigned int flags,
+                             const char *params,
+                             char **key)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *ret = NULL;
+
+    *key = NULL;
+
+    if (!cache)
+        return NULL;
+
+    virBufferAsprintf(&buf, "%s\n%s\n%s\n", cache->context,
+                      virDomainDeviceTypeToString(dev->type), params);
+
+    if (virDomainDeviceDefFormat(&buf, dev, cache->caps,
+                                 cache->xmlopt, flags) < 0 ||
+        virBufferCheckError(&buf) < 0 ||
+        virCryptoHashString(VIR_CRYPTO_HASH_SHA256,
+                            virBufferCurrentContent(&buf), key) < 0) {
+        /* the fragment is built the usual way */
+        virResetLastError();
+        goto cleanup;
+    }
+
+    ret = virQEMUCapsGetFragment(cache->qemuCaps, *key);
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+static char *
+qemuBuildDiskDeviceStrCached(qemuBuildFragmentCachePtr cache,
+                             const virDomainDef *def,
+                             virDomainDiskDefPtr disk,
+                             unsigned int bootindex,
+                             virQEMUCapsPtr qemuCaps)
+{
+    virDomainDeviceDef dev = { .type = VIR_DOMAIN_DEVICE_DISK,
+                               .data.disk = disk };
+    char *backendAlias = NULL;
+    char *params = NULL;
+    char *key = NULL;
+    char *ret = NULL;
+
+    if (cache) {
+        /* node names of -blockdev are not part of the XML */
+        if (qemuDomainDiskGetBackendAlias(disk, qemuCaps, &backendAlias) < 0)
+            goto cleanup;
+
+        if (virAsprintf(&params, "%u %s", bootindex, NULLSTR(backendAlias)) < 0)
+            goto cleanup;
+
+        if ((ret = qemuBuildFragmentCacheLookup(cache, &dev, 0,
+                                                params, &key)))
+            goto cleanup;
+    }
+
+    if (!(ret = qemuBuildDiskDeviceStr(def, disk, bootindex, qemuCaps)))
+        goto cleanup;
+
+    if (key)
+        virQEMUCapsAddFragment(qemuCaps, key, ret);
+
+ cleanup:
+    VIR_FREE(backendAlias);
+    VIR_FREE(params);
+    VIR_FREE(key);
+    return ret;
+}
+
+
 static int
 qemuBuildDiskCommandLine(virCommandPtr cmd,
                          const virDomainDef *def,
                          virDomainDiskDefPtr disk,
                          virQEMUCapsPtr qemuCaps,
+                         qemuBuildFragmentCachePtr cache,
                          unsigned int bootindex)
 {
     char *optstr;
@@ -2433,8 +2620,8 @@ qemuBuildDiskCommandLine(virCommandPtr cmd,
             virQEMUCapsGet(qemuCaps, QEMU_CAPS_BLOCKDEV)) {
             virCommandAddArg(cmd, "-device");
 
-            if (!(optstr = qemuBuildDiskDeviceStr(def, disk, bootindex,
-                                                  qemuCaps)))
+            if (!(optstr = qemuBuildDiskDeviceStrCached(cache, def, disk,
+                                                        bootindex, qemuCaps)))
                 return -1;
             virCommandAddArg(cmd, optstr);
             VIR_FREE(optstr);
@@ -2448,7 +2635,8 @@ qemuBuildDiskCommandLine(virCommandPtr cmd,
 static int
 qemuBuildDisksCommandLine(virCommandPtr cmd,
                           const virDomainDef *def,
-                          virQEMUCapsPtr qemuCaps)
+                          virQEMUCapsPtr qemuCaps,
+                          qemuBuildFragmentCachePtr cache)
 {
     size_t i;
     unsigned int bootCD = 0;
@@ -2501,7 +2689,8 @@ qemuBuildDisksCommandLine(virCommandPtr cmd,
         if (disk->device == VIR_DOMAIN_DISK_DEVICE_FLOPPY)
             bootindex = 0;
 
-        if (qemuBuildDiskCommandLine(cmd, def, disk, qemuCaps, bootindex) < 0)
+        if (qemuBuildDiskCommandLine(cmd, def, disk, qemuCaps, cache,
+                                     bootindex) < 0)
             return -1;
     }
 
@@ -3316,6 +3505,28 @@ qemuBuildMemoryBackendProps(virJSONValuePtr *backendProps,
         backendType = "memory-backend-ram";
     }
 
+    /* -mem-prealloc makes QEMU preallocate every backend, but only
+     * the backends themselves know how many threads to use */
+    if (def->mem.allocation_threads &&
+        (prealloc ||
+         def->mem.allocation == VIR_DOMAIN_MEMORY_ALLOCATION_IMMEDIATE)) {
+        if (!virQEMUCapsGet(qemuCaps, QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("this QEMU doesn't support setting the number "
+                             "of memory preallocation threads"));
+            goto cleanup;
+        }
+
+        if (virJSONValueObjectAdd(props,
+                                  "B:prealloc", !prealloc,
+                                  "u:prealloc-threads",
+                                  def->mem.allocation_threads,
+                                  NULL) < 0)
+            goto cleanup;
+
+        prealloc = true;
+    }
+
     if (virJSONValueObjectAdd(props, "U:size", mem->size * 1024, NULL) < 0)
         goto cleanup;
 
@@ -3339,7 +3550,7 @@ qemuBuildMemoryBackendProps(virJSONValuePtr *backendProps,
 
     /* If none of the following is requested... */
     if (!needHugepage && !mem->sourceNodes && !nodeSpecified &&
-        !mem->nvdimmPath &&
+        !mem->nvdimmPath && !(prealloc && def->mem.allocation_threads) &&
         memAccess == VIR_DOMAIN_MEMORY_ACCESS_DEFAULT &&
         def->mem.source != VIR_DOMAIN_MEMORY_SOURCE_FILE && !force) {
         /* report back that using the new backend is not necessary
@@ -8266,6 +8477,48 @@ qemuInterfaceVhostuserConnect(virQEMUDriverPtr driver,
     return ret;
 }
 
+static char *
+qemuBuildNicDevStrCached(qemuBuildFragmentCachePtr cache,
+                         virDomainDefPtr def,
+                         virDomainNetDefPtr net,
+                         unsigned int bootindex,
+                         size_t vhostfdSize,
+                         virQEMUCapsPtr qemuCaps)
+{
+    virDomainDeviceDef dev = { .type = VIR_DOMAIN_DEVICE_NET,
+                               .data.net = net };
+    char *params = NULL;
+    char *key = NULL;
+    char *ret = NULL;
+
+    if (cache) {
+        /* The live XML contains the generated name of the tap device,
+         * use the inactive one and add the bits of the live one
+         * the -device string is made of. */
+        if (virAsprintf(&params, "%u %zu %s %s", bootindex, vhostfdSize,
+                        NULLSTR(net->info.alias),
+                        virDomainNetTypeToString(virDomainNetGetActualType(net))) < 0)
+            goto cleanup;
+
+        if ((ret = qemuBuildFragmentCacheLookup(cache, &dev,
+                                                VIR_DOMAIN_DEF_FORMAT_INACTIVE,
+                                                params, &key)))
+            goto cleanup;
+    }
+
+    if (!(ret = qemuBuildNicDevStr(def, net, bootindex, vhostfdSize, qemuCaps)))
+        goto cleanup;
+
+    if (key)
+        virQEMUCapsAddFragment(qemuCaps, key, ret);
+
+ cleanup:
+    VIR_FREE(params);
+    VIR_FREE(key);
+    return ret;
+}
+
+
 static int
 qemuBuildInterfaceCommandLine(virQEMUDriverPtr driver,
                               virLogManagerPtr logManager,
@@ -8274,6 +8527,7 @@ qemuBuildInterfaceCommandLine(virQEMUDriverPtr driver,
                               virDomainDefPtr def,
                               virDomainNetDefPtr net,
                               virQEMUCapsPtr qemuCaps,
+                              qemuBuildFragmentCachePtr cache,
                               unsigned int bootindex,
                               virNetDevVPortProfileOp vmop,
                               bool standalone,
@@ -8551,8 +8805,9 @@ qemuBuildInterfaceCommandLine(virQEMUDriverPtr driver,
      *   New way: -netdev type=tap,id=netdev1 -device e1000,id=netdev1
      */
     if (qemuDomainSupportsNicdev(def, net)) {
-        if (!(nic = qemuBuildNicDevStr(def, net, bootindex,
-                                       net->driver.virtio.queues, qemuCaps)))
+        if (!(nic = qemuBuildNicDevStrCached(cache, def, net, bootindex,
+                                             net->driver.virtio.queues,
+                                             qemuCaps)))
             goto cleanup;
         virCommandAddArgList(cmd, "-device", nic, NULL);
     } else if (!requireNicdev) {
@@ -8607,6 +8862,7 @@ qemuBuildNetCommandLine(virQEMUDriverPtr driver,
                         virCommandPtr cmd,
                         virDomainDefPtr def,
                         virQEMUCapsPtr qemuCaps,
+                        qemuBuildFragmentCachePtr cache,
                         virNetDevVPortProfileOp vmop,
                         bool standalone,
                         size_t *nnicindexes,
@@ -8632,7 +8888,7 @@ qemuBuildNetCommandLine(virQEMUDriverPtr driver,
             virDomainNetDefPtr net = def->nets[i];
 
             if (qemuBuildInterfaceCommandLine(driver, logManager, secManager, cmd, def, net,
-                                              qemuCaps, bootNet, vmop,
+                                              qemuCaps, cache, bootNet, vmop,
                                               standalone, nnicindexes,
                                               nicindexes) < 0)
                 goto error;
@@ -10205,6 +10461,8 @@ qemuBuildCommandLine(virQEMUDriverPtr driver,
     virDomainDefPtr def = vm->def;
     virQEMUCapsPtr qemuCaps = priv->qemuCaps;
     bool chardevStdioLogd = priv->chardevStdioLogd;
+    qemuBuildFragmentCache fragments;
+    qemuBuildFragmentCachePtr fragmentCache = NULL;
 
     VIR_DEBUG("driver=%p def=%p mon=%p json=%d "
               "qemuCaps=%p migrateURI=%s snapshot=%p vmop=%d",
@@ -10319,14 +10577,20 @@ qemuBuildCommandLine(virQEMUDriverPtr driver,
     if (qemuBuildHubCommandLine(cmd, def, qemuCaps) < 0)
         goto error;
 
-    if (qemuBuildDisksCommandLine(cmd, def, qemuCaps) < 0)
+    if (cfg->commandLineCache) {
+        if (qemuBuildFragmentCacheInit(&fragments, driver, def, qemuCaps) < 0)
+            goto error;
+        fragmentCache = &fragments;
+    }
+
+    if (qemuBuildDisksCommandLine(cmd, def, qemuCaps, fragmentCache) < 0)
         goto error;
 
     if (qemuBuildFSDevCommandLine(cmd, def, qemuCaps) < 0)
         goto error;
 
     if (qemuBuildNetCommandLine(driver, logManager, secManager, cmd, def,
-                                qemuCaps, vmop, standalone,
+                                qemuCaps, fragmentCache, vmop, standalone,
                                 nnicindexes, nicindexes, &bootHostdevNet) < 0)
         goto error;
 
@@ -10434,10 +10698,14 @@ qemuBuildCommandLine(virQEMUDriverPtr driver,
         cfg->logTimestamp)
         virCommandAddArgList(cmd, "-msg", "timestamp=on", NULL);
 
+    if (fragmentCache)
+        qemuBuildFragmentCacheClear(fragmentCache);
     virObjectUnref(cfg);
     return cmd;
 
  error:
+    if (fragmentCache)
+        qemuBuildFragmentCacheClear(fragmentCache);
     virObjectUnref(cfg);
     virCommandFree(cmd);
     return NULL;
@@ -45,6 +45,7 @@
 #include "cpu/cpu.h"
 #include "domain_nwfilter.h"
 #include "virfile.h"
+#include "virhostcpu.h"
 #include "virsocketaddr.h"
 #include "virstring.h"
 #include "viratomic.h"
@@ -181,6 +182,8 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
             goto error;
         if (virAsprintf(&cfg->snapshotDir, "%s/snapshot", cfg->libDir) < 0)
             goto error;
+        if (virAsprintf(&cfg->checkpointDir, "%s/checkpoint", cfg->libDir) < 0)
+            goto error;
         if (virAsprintf(&cfg->autoDumpPath, "%s/dump", cfg->libDir) < 0)
             goto error;
         if (virAsprintf(&cfg->channelTargetDir,
@@ -244,6 +247,8 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
             goto error;
         if (virAsprintf(&cfg->snapshotDir, "%s/qemu/snapshot", cfg->configBaseDir) < 0)
             goto error;
+        if (virAsprintf(&cfg->checkpointDir, "%s/qemu/checkpoint", cfg->configBaseDir) < 0)
+            goto error;
         if (virAsprintf(&cfg->autoDumpPath, "%s/qemu/dump", cfg->configBaseDir) < 0)
             goto error;
         if (virAsprintf(&cfg->channelTargetDir,
@@ -316,6 +321,7 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
 
     cfg->migrationPortMin = QEMU_MIGRATION_PORT_MIN;
     cfg->migrationPortMax = QEMU_MIGRATION_PORT_MAX;
+    cfg->migrationConnCacheTimeout = 30;
 
     /* For privileged driver, try and find hugetlbfs mounts automatically.
      * Non-privileged driver requires admin to create a dir for the
@@ -338,6 +344,12 @@ virQEMUDriverConfigPtr virQEMUDriverConfigNew(bool privileged)
 
     cfg->keepAliveInterval = 5;
     cfg->keepAliveCount = 5;
+    cfg->maxStatsWorkers = 4;
+    cfg->maxReconnectWorkers = 16;
+    cfg->autoStartParallel = 1;
+    cfg->pressureTriggerWindow = 1000;
+    cfg->numaRebalanceThreshold = 25;
+    cfg->numaRebalanceMemory = true;
     cfg->seccompSandbox = -1;
 
     cfg->logTimestamp = true;
@@ -385,6 +397,7 @@ static void virQEMUDriverConfigDispose(void *obj)
     VIR_FREE(cfg->cacheDir);
     VIR_FREE(cfg->saveDir);
     VIR_FREE(cfg->snapshotDir);
+    VIR_FREE(cfg->checkpointDir);
     VIR_FREE(cfg->channelTargetDir);
     VIR_FREE(cfg->nvramDir);
 
@@ -503,6 +516,7 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
     int rv;
     size_t i, j;
     char *stdioHandler = NULL;
+    char *numaRebalancePolicy = NULL;
     char *user = NULL, *group = NULL;
     char *swtpm_user = NULL, *swtpm_group = NULL;
     char **controllers = NULL;
@@ -718,6 +732,14 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         goto cleanup;
     }
 
+    if (virConfGetValueUInt(conf, "migration_max_auto_downtime",
+                            &cfg->migrationMaxAutoDowntime) < 0)
+        goto cleanup;
+
+    if (virConfGetValueUInt(conf, "migration_connection_cache_timeout",
+                            &cfg->migrationConnCacheTimeout) < 0)
+        goto cleanup;
+
     if (virConfGetValueString(conf, "user", &user) < 0)
         goto cleanup;
     if (user && virGetUserID(user, &cfg->user) < 0)
@@ -766,6 +788,8 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
         goto cleanup;
     if (virConfGetValueBool(conf, "auto_start_bypass_cache", &cfg->autoStartBypassCache) < 0)
         goto cleanup;
+    if (virConfGetValueUInt(conf, "auto_start_parallel", &cfg->autoStartParallel) < 0)
+        goto cleanup;
 
     if (virConfGetValueStringList(conf, "hugetlbfs_mount", true,
                                   &hugetlbfs) < 0)
@@ -857,6 +881,63 @@ int virQEMUDriverConfigLoadFile(virQEMUDriverConfigPtr cfg,
 
     if (virConfGetValueUInt(conf, "max_queued", &cfg->maxQueuedJobs) < 0)
         goto cleanup;
+    if (virConfGetValueUInt(conf, "max_stats_workers", &cfg->maxStatsWorkers) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "max_reconnect_workers",
+                            &cfg->maxReconnectWorkers) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "status_journal_entries",
+                            &cfg->statusJournalEntries) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "max_inactive_definitions",
+                            &cfg->maxInactiveDefs) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "pressure_trigger_stall_ms",
+                            &cfg->pressureTriggerStall) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "pressure_trigger_window_ms",
+                            &cfg->pressureTriggerWindow) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "numa_rebalance_interval",
+                            &cfg->numaRebalanceInterval) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "numa_rebalance_threshold",
+                            &cfg->numaRebalanceThreshold) < 0)
+        goto cleanup;
+    if (virConfGetValueString(conf, "numa_rebalance_policy",
+                              &numaRebalancePolicy) < 0)
+        goto cleanup;
+    if (numaRebalancePolicy) {
+        if (STREQ(numaRebalancePolicy, "memory")) {
+            cfg->numaRebalanceMemory = true;
+        } else if (STREQ(numaRebalancePolicy, "threads")) {
+            cfg->numaRebalanceMemory = false;
+        } else {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("Unknown NUMA rebalance policy %s"),
+                           numaRebalancePolicy);
+            VIR_FREE(numaRebalancePolicy);
+            goto cleanup;
+        }
+        VIR_FREE(numaRebalancePolicy);
+    }
+    if (virConfGetValueBool(conf, "reserve_hugepages",
+                            &cfg->reserveHugepages) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "reserve_hugepages_timeout",
+                            &cfg->reserveHugepagesTimeout) < 0)
+        goto cleanup;
+    if (virConfGetValueBool(conf, "resctrl_monitoring",
+                            &cfg->resctrlMonitoring) < 0)
+        goto cleanup;
+    if (virConfGetValueBool(conf, "perf_vcpu_events",
+                            &cfg->perfVcpuEvents) < 0)
+        goto cleanup;
+    if (virConfGetValueBool(conf, "command_line_cache",
+                            &cfg->commandLineCache) < 0)
+        goto cleanup;
+    if (virConfGetValueUInt(conf, "stats_cache_ms", &cfg->statsCacheMs) < 0)
+        goto cleanup;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &cfg->keepAliveInterval) < 0)
         goto cleanup;
@@ -1055,6 +1136,24 @@ virQEMUDriverConfigValidate(virQEMUDriverConfigPtr cfg)
         return -1;
     }
 
+    if (cfg->pressureTriggerStall) {
+        if (cfg->pressureTriggerWindow < 500 ||
+            cfg->pressureTriggerWindow > 10000) {
+            virReportError(VIR_ERR_CONF_SYNTAX,
+                           _("pressure_trigger_window_ms must be between "
+                             "500 and 10000, got %u"),
+                           cfg->pressureTriggerWindow);
+            return -1;
+        }
+
+        if (cfg->pressureTriggerStall > cfg->pressureTriggerWindow) {
+            virReportError(VIR_ERR_CONF_SYNTAX, "%s",
+                           _("pressure_trigger_stall_ms must not be larger "
+                             "than pressure_trigger_window_ms"));
+            return -1;
+        }
+    }
+
     return 0;
 }
 
@@ -1627,6 +1726,117 @@ qemuRemoveSharedDevice(virQEMUDriverPtr driver,
 }
 
 
+void
+qemuDedicatedCPUsEntryFree(void *payload, const void *name ATTRIBUTE_UNUSED)
+{
+    virBitmapFree(payload);
+}
+
+
+static int
+qemuDedicatedCPUsOverlap(const void *payload,
+                         const void *name ATTRIBUTE_UNUSED,
+                         const void *data)
+{
+    return virBitmapOverlaps((virBitmapPtr) payload, (virBitmapPtr) data);
+}
+
+
+static int
+qemuDedicatedCPUsSubtract(void *payload,
+                          const void *name ATTRIBUTE_UNUSED,
+                          void *data)
+{
+    virBitmapSubtract(data, payload);
+    return 0;
+}
+
+
+/* qemuDedicatedCPUsReserve:
+ * @driver: Pointer to qemu driver struct
+ * @name: The domain name
+ * @cpus: host CPUs the vCPUs of the domain are pinned to
+ * @housekeeping: filled with the host CPUs not dedicated to any domain
+ *
+ * Record @cpus as dedicated to domain @name unless any of them is
+ * dedicated to a different domain already.  The check and the update
+ * are done under the driver lock so that domains started concurrently
+ * can't end up with overlapping reservations.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDedicatedCPUsReserve(virQEMUDriverPtr driver,
+                         const char *name,
+                         virBitmapPtr cpus,
+                         virBitmapPtr *housekeeping)
+{
+    virBitmapPtr copy = NULL;
+    virBitmapPtr online = NULL;
+    void *owner = NULL;
+    char *str = NULL;
+    int ret = -1;
+
+    qemuDriverLock(driver);
+
+    ignore_value(virHashRemoveEntry(driver->dedicatedCPUs, name));
+
+    if (virHashSearch(driver->dedicatedCPUs, qemuDedicatedCPUsOverlap,
+                      cpus, &owner)) {
+        str = virBitmapFormat(cpus);
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("host CPUs '%s' overlap with the CPUs dedicated "
+                         "to domain '%s'"), NULLSTR(str), (char *) owner);
+        goto cleanup;
+    }
+
+    if (!(online = virHostCPUGetOnlineBitmap()))
+        goto cleanup;
+
+    virBitmapSubtract(online, cpus);
+    virHashForEach(driver->dedicatedCPUs, qemuDedicatedCPUsSubtract, online);
+
+    if (virBitmapIsAllClear(online)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("no host CPUs would be left for housekeeping"));
+        goto cleanup;
+    }
+
+    if (!(copy = virBitmapNewCopy(cpus)) ||
+        virHashAddEntry(driver->dedicatedCPUs, name, copy) < 0)
+        goto cleanup;
+    copy = NULL;
+
+    *housekeeping = online;
+    online = NULL;
+    ret = 0;
+
+ cleanup:
+    qemuDriverUnlock(driver);
+    VIR_FREE(owner);
+    VIR_FREE(str);
+    virBitmapFree(copy);
+    virBitmapFree(online);
+    return ret;
+}
+
+
+/* qemuDedicatedCPUsRelease:
+ * @driver: Pointer to qemu driver struct
+ * @name: The domain name
+ *
+ * Drop the host CPUs dedicated to domain @name, if any.
+ */
+void
+qemuDedicatedCPUsRelease(virQEMUDriverPtr driver,
+                         const char *name)
+{
+    qemuDriverLock(driver);
+    ignore_value(virHashRemoveEntry(driver->dedicatedCPUs, name));
+    qemuDriverUnlock(driver);
+}
+
+
 int
 qemuSetUnprivSGIO(virDomainDeviceDefPtr dev)
 {
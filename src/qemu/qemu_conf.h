@@ -67,6 +67,9 @@ typedef virQEMUDriver *virQEMUDriverPtr;
 typedef struct _virQEMUDriverConfig virQEMUDriverConfig;
 typedef virQEMUDriverConfig *virQEMUDriverConfigPtr;
 
+typedef struct _qemuProcessReconnectQueue qemuProcessReconnectQueue;
+typedef qemuProcessReconnectQueue *qemuProcessReconnectQueuePtr;
+
 /* Main driver config. The data in these object
  * instances is immutable, so can be accessed
  * without locking. Threads must, however, hold
@@ -111,6 +114,7 @@ struct _virQEMUDriverConfig {
     char *cacheDir;
     char *saveDir;
     char *snapshotDir;
+    char *checkpointDir;
     char *channelTargetDir;
     char *nvramDir;
     char *swtpmStorageDir;
@@ -172,6 +176,21 @@ struct _virQEMUDriverConfig {
     bool dumpGuestCore;
 
     unsigned int maxQueuedJobs;
+    unsigned int maxStatsWorkers;
+    unsigned int maxReconnectWorkers;
+    unsigned int statusJournalEntries;
+    unsigned int maxInactiveDefs;
+    unsigned int pressureTriggerStall;
+    unsigned int pressureTriggerWindow;
+    unsigned int numaRebalanceInterval;
+    unsigned int numaRebalanceThreshold;
+    bool numaRebalanceMemory;
+    bool reserveHugepages;
+    unsigned int reserveHugepagesTimeout;
+    bool resctrlMonitoring;
+    bool perfVcpuEvents;
+    bool commandLineCache;
+    unsigned int statsCacheMs;
 
     char **securityDriverNames;
     bool securityDefaultConfined;
@@ -184,6 +203,7 @@ struct _virQEMUDriverConfig {
     char *autoDumpPath;
     bool autoDumpBypassCache;
     bool autoStartBypassCache;
+    unsigned int autoStartParallel;
 
     char *lockManagerName;
     char *metadataLockManagerName;
@@ -198,6 +218,8 @@ struct _virQEMUDriverConfig {
     char *migrationAddress;
     unsigned int migrationPortMin;
     unsigned int migrationPortMax;
+    unsigned int migrationMaxAutoDowntime;
+    unsigned int migrationConnCacheTimeout;
 
     bool logTimestamp;
     bool stdioLogD;
@@ -218,6 +240,15 @@ struct _virQEMUDriverConfig {
     gid_t swtpm_group;
 };
 
+typedef struct _qemuDomainStatsSubs qemuDomainStatsSubs;
+typedef qemuDomainStatsSubs *qemuDomainStatsSubsPtr;
+
+typedef struct _qemuMigrationConnPool qemuMigrationConnPool;
+typedef qemuMigrationConnPool *qemuMigrationConnPoolPtr;
+
+typedef struct _qemuNumaBalancer qemuNumaBalancer;
+typedef qemuNumaBalancer *qemuNumaBalancerPtr;
+
 /* Main driver state */
 struct _virQEMUDriver {
     virMutex lock;
@@ -229,6 +260,14 @@ struct _virQEMUDriver {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workerPool;
 
+    /* Immutable pointer, self-locking APIs. NULL when domain stats
+     * are not collected in parallel */
+    virThreadPoolPtr statsPool;
+
+    /* Immutable pointer, self-locking APIs. Set once domains are being
+     * reconnected on daemon start */
+    qemuProcessReconnectQueuePtr reconnectQueue;
+
     /* Atomic increment only */
     int lastvmid;
 
@@ -273,6 +312,11 @@ struct _virQEMUDriver {
     /* Immutable pointer. Unsafe APIs. XXX */
     virHashTablePtr sharedDevices;
 
+    /* Immutable pointer. Require lock to access the table. Maps names
+     * of running domains with the dedicated cputune profile to the host
+     * CPUs reserved for them */
+    virHashTablePtr dedicatedCPUs;
+
     /* Immutable pointer, immutable object */
     virPortAllocatorRangePtr remotePorts;
 
@@ -293,6 +337,15 @@ struct _virQEMUDriver {
 
     /* Immutable pointer, self-locking APIs */
     virHashAtomicPtr migrationErrors;
+
+    /* Immutable pointer, self-locking APIs */
+    qemuDomainStatsSubsPtr statsSubs;
+
+    /* Immutable pointer, self-locking APIs */
+    qemuMigrationConnPoolPtr migrationConns;
+
+    /* Immutable pointer, NULL unless numa_rebalance_interval is set */
+    qemuNumaBalancerPtr numaBalancer;
 };
 
 typedef struct _qemuDomainCmdlineDef qemuDomainCmdlineDef;
@@ -361,6 +414,19 @@ int qemuRemoveSharedDisk(virQEMUDriverPtr driver,
 
 int qemuSetUnprivSGIO(virDomainDeviceDefPtr dev);
 
+void qemuDedicatedCPUsEntryFree(void *payload, const void *name);
+
+int qemuDedicatedCPUsReserve(virQEMUDriverPtr driver,
+                             const char *name,
+                             virBitmapPtr cpus,
+                             virBitmapPtr *housekeeping)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_NONNULL(4);
+
+void qemuDedicatedCPUsRelease(virQEMUDriverPtr driver,
+                              const char *name)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int qemuDriverAllocateID(virQEMUDriverPtr driver);
 virDomainXMLOptionPtr virQEMUDriverCreateXMLConf(virQEMUDriverPtr driver);
 
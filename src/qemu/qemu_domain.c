@@ -36,6 +36,7 @@
 #include "qemu_security.h"
 #include "qemu_extdevice.h"
 #include "viralloc.h"
+#include "intprops.h"
 #include "virlog.h"
 #include "virerror.h"
 #include "c-ctype.h"
@@ -57,6 +58,11 @@
 #include "secret_util.h"
 #include "logging/log_manager.h"
 #include "locking/domain_lock.h"
+#include "virprobe.h"
+
+#ifdef WITH_DTRACE_PROBES
+# include "libvirt_qemu_probes.h"
+#endif
 
 #ifdef MAJOR_IN_MKDEV
 # include <sys/mkdev.h>
@@ -113,6 +119,21 @@ VIR_ENUM_IMPL(qemuDomainNamespace, QEMU_DOMAIN_NS_LAST,
               "mount",
 );
 
+VIR_ENUM_IMPL(qemuDomainVcpuKVMStat, QEMU_DOMAIN_VCPU_KVM_STAT_LAST,
+              "exits",
+              "halt_exits",
+              "halt_successful_poll",
+              "halt_attempted_poll",
+              "halt_poll_invalid",
+              "halt_wakeup",
+              "halt_poll_success_ns",
+              "halt_poll_fail_ns",
+              "irq_exits",
+              "io_exits",
+              "mmio_exits",
+              "signal_exits",
+);
+
 
 #define PROC_MOUNTS "/proc/mounts"
 #define DEVPREFIX "/dev/"
@@ -310,6 +331,42 @@ qemuDomainObjInitJob(qemuDomainObjPrivatePtr priv)
     return 0;
 }
 
+/* Account a job of @counter which was held since @started */
+static void
+qemuDomainJobAcctAdd(qemuDomainJobAcctCounterPtr counter,
+                     unsigned long long started)
+{
+    unsigned long long now;
+
+    if (!started || virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    counter->count++;
+    if (now > started)
+        counter->time += now - started;
+}
+
+
+/* Account the time it took to acquire a job requested at @queued */
+static void
+qemuDomainJobAcctWait(qemuDomainObjPrivatePtr priv,
+                      unsigned long long queued,
+                      bool acquired)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    if (acquired)
+        priv->jobAcct.waits++;
+    else
+        priv->jobAcct.timeouts++;
+    if (now > queued)
+        priv->jobAcct.waitTime += now - queued;
+}
+
+
 static void
 qemuDomainObjResetJob(qemuDomainObjPrivatePtr priv)
 {
@@ -434,6 +491,45 @@ qemuDomainJobInfoUpdateDowntime(qemuDomainJobInfoPtr jobInfo)
     return 0;
 }
 
+/**
+ * qemuDomainJobInfoEstimateConvergence:
+ * @jobInfo: migration job info with up to date statistics
+ * @remaining: filled in with the estimated time (ms) left until the memory
+ *             transfer converges
+ *
+ * Every pass over memory sends the pages dirtied during the previous one,
+ * so the amount of data left shrinks by the difference between the transfer
+ * bandwidth and the dirty rate each second.
+ *
+ * Returns true if migration is expected to converge, false if it is not or
+ * when there is not enough data for the estimate.
+ */
+bool
+qemuDomainJobInfoEstimateConvergence(qemuDomainJobInfoPtr jobInfo,
+                                     unsigned long long *remaining)
+{
+    qemuMonitorMigrationStatsPtr stats = &jobInfo->stats.mig;
+    unsigned long long pageSize = stats->ram_page_size;
+    unsigned long long dirty;
+
+    /* The dirty rate is only known after the first pass */
+    if (jobInfo->statsType != QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION ||
+        stats->ram_iteration < 2 ||
+        stats->ram_bps == 0)
+        return false;
+
+    if (pageSize == 0)
+        pageSize = virGetSystemPageSize();
+
+    dirty = stats->ram_dirty_rate * pageSize;
+    if (dirty >= stats->ram_bps)
+        return false;
+
+    *remaining = stats->ram_remaining * 1000 / (stats->ram_bps - dirty);
+    return true;
+}
+
+
 static virDomainJobType
 qemuDomainJobStatusToType(qemuDomainJobStatus status)
 {
@@ -494,6 +590,7 @@ qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
         info->memRemaining = info->memTotal - info->memProcessed;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_START:
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -519,6 +616,7 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
     int npar = 0;
     unsigned long long mirrorRemaining = mirrorStats->total -
                                          mirrorStats->transferred;
+    unsigned long long convergeTime;
 
     if (virTypedParamsAddInt(&par, &npar, &maxpar,
                              VIR_DOMAIN_JOB_OPERATION,
@@ -612,6 +710,13 @@ qemuDomainMigrationJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                                 stats->ram_iteration) < 0)
         goto error;
 
+    if (jobInfo->status == QEMU_DOMAIN_JOB_STATUS_MIGRATING &&
+        qemuDomainJobInfoEstimateConvergence(jobInfo, &convergeTime) &&
+        virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_MEMORY_CONVERGE_TIME,
+                                convergeTime) < 0)
+        goto error;
+
     if (stats->ram_page_size > 0 &&
         virTypedParamsAddULLong(&par, &npar, &maxpar,
                                 VIR_DOMAIN_JOB_MEMORY_PAGE_SIZE,
@@ -723,6 +828,59 @@ qemuDomainDumpJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
 }
 
 
+/* Typed parameters reporting the phases of qemuDomainJobStartPhase */
+static const char *qemuDomainJobStartPhaseParams[] = {
+    VIR_DOMAIN_JOB_START_TIME_INIT,
+    VIR_DOMAIN_JOB_START_TIME_PREPARE_DOMAIN,
+    VIR_DOMAIN_JOB_START_TIME_PREPARE_HOST,
+    VIR_DOMAIN_JOB_START_TIME_LAUNCH,
+    VIR_DOMAIN_JOB_START_TIME_MONITOR,
+    VIR_DOMAIN_JOB_START_TIME_FINISH,
+};
+verify(ARRAY_CARDINALITY(qemuDomainJobStartPhaseParams) ==
+       QEMU_DOMAIN_JOB_START_PHASE_LAST);
+
+
+static int
+qemuDomainStartJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
+                               int *type,
+                               virTypedParameterPtr *params,
+                               int *nparams)
+{
+    qemuDomainJobStartStats *stats = &jobInfo->stats.start;
+    virTypedParameterPtr par = NULL;
+    int maxpar = 0;
+    int npar = 0;
+    size_t i;
+
+    if (virTypedParamsAddInt(&par, &npar, &maxpar,
+                             VIR_DOMAIN_JOB_OPERATION,
+                             jobInfo->operation) < 0)
+        goto error;
+
+    if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                VIR_DOMAIN_JOB_TIME_ELAPSED,
+                                jobInfo->timeElapsed) < 0)
+        goto error;
+
+    for (i = 0; i < QEMU_DOMAIN_JOB_START_PHASE_LAST; i++) {
+        if (virTypedParamsAddULLong(&par, &npar, &maxpar,
+                                    qemuDomainJobStartPhaseParams[i],
+                                    stats->phases[i]) < 0)
+            goto error;
+    }
+
+    *type = qemuDomainJobStatusToType(jobInfo->status);
+    *params = par;
+    *nparams = npar;
+    return 0;
+
+ error:
+    virTypedParamsFree(par, npar);
+    return -1;
+}
+
+
 int
 qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
                           int *type,
@@ -737,6 +895,9 @@ qemuDomainJobInfoToParams(qemuDomainJobInfoPtr jobInfo,
     case QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP:
         return qemuDomainDumpJobInfoToParams(jobInfo, type, params, nparams);
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_START:
+        return qemuDomainStartJobInfoToParams(jobInfo, type, params, nparams);
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("invalid job statistics type"));
@@ -1133,6 +1294,7 @@ static virObjectPtr
 qemuDomainVcpuPrivateNew(void)
 {
     qemuDomainVcpuPrivatePtr priv;
+    size_t i;
 
     if (qemuDomainVcpuPrivateInitialize() < 0)
         return NULL;
@@ -1140,6 +1302,13 @@ qemuDomainVcpuPrivateNew(void)
     if (!(priv = virObjectNew(qemuDomainVcpuPrivateClass)))
         return NULL;
 
+    virProcessStatFileInit(&priv->statFile);
+    virProcessStatFileInit(&priv->schedFile);
+    virProcessStatFileInit(&priv->schedstatFile);
+
+    for (i = 0; i < QEMU_DOMAIN_VCPU_KVM_STAT_LAST; i++)
+        priv->kvmStatFds[i] = -1;
+
     return (virObjectPtr) priv;
 }
 
@@ -1151,10 +1320,166 @@ qemuDomainVcpuPrivateDispose(void *obj)
 
     VIR_FREE(priv->type);
     VIR_FREE(priv->alias);
+    virProcessStatFileClose(&priv->statFile);
+    virProcessStatFileClose(&priv->schedFile);
+    virProcessStatFileClose(&priv->schedstatFile);
+    qemuDomainVcpuCloseKVMStats(priv);
+    virPerfFree(priv->perf);
     return;
 }
 
 
+#define QEMU_KVM_DEBUGFS_DIR "/sys/kernel/debug/kvm"
+
+/* KVM names the debugfs directory of a vCPU after its KVM vCPU id, which
+ * is the APIC ID on x86 and the QEMU CPU index elsewhere. */
+static unsigned int
+qemuDomainVcpuGetKVMId(virDomainDefPtr def,
+                       unsigned int vcpuid)
+{
+    virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(def, vcpuid);
+    qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    unsigned int index = vcpupriv->qemu_id >= 0 ? vcpupriv->qemu_id : vcpuid;
+    unsigned int threadBits = 0;
+    unsigned int coreBits = 0;
+
+    if (!ARCH_IS_X86(def->os.arch) || !def->cpu || !def->cpu->sockets)
+        return index;
+
+    while ((1U << threadBits) < def->cpu->threads)
+        threadBits++;
+    while ((1U << coreBits) < def->cpu->cores)
+        coreBits++;
+
+    return ((index / (def->cpu->cores * def->cpu->threads)) << (coreBits + threadBits)) |
+           (((index / def->cpu->threads) % def->cpu->cores) << threadBits) |
+           (index % def->cpu->threads);
+}
+
+
+static void
+qemuDomainFindKVMDebugfsDir(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    DIR *dir = NULL;
+    struct dirent *ent;
+    char *prefix = NULL;
+
+    priv->kvmDebugfsChecked = true;
+
+    /* debugfs is usually accessible to root only, don't make noise */
+    if (virDirOpenQuiet(&dir, QEMU_KVM_DEBUGFS_DIR) < 0) {
+        VIR_DEBUG("Cannot open %s", QEMU_KVM_DEBUGFS_DIR);
+        virResetLastError();
+        return;
+    }
+
+    if (virAsprintf(&prefix, "%lld-", (long long) vm->pid) < 0)
+        goto cleanup;
+
+    while (virDirRead(dir, &ent, NULL) > 0) {
+        if (STRPREFIX(ent->d_name, prefix)) {
+            ignore_value(virAsprintf(&priv->kvmDebugfsDir, "%s/%s",
+                                     QEMU_KVM_DEBUGFS_DIR, ent->d_name));
+            break;
+        }
+    }
+
+ cleanup:
+    virResetLastError();
+    VIR_FREE(prefix);
+    VIR_DIR_CLOSE(dir);
+}
+
+
+/**
+ * qemuDomainVcpuOpenKVMStats:
+ * @vm: domain object
+ * @vcpuid: vCPU index
+ *
+ * Open the KVM debugfs counters of vCPU @vcpuid unless it was already
+ * tried since the vCPU was started. Counters which are not available,
+ * e.g. because debugfs is not mounted or the kernel doesn't provide per
+ * vCPU counters, are silently skipped.
+ */
+void
+qemuDomainVcpuOpenKVMStats(virDomainObjPtr vm,
+                           unsigned int vcpuid)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, vcpuid);
+    qemuDomainVcpuPrivatePtr vcpupriv;
+    char *path = NULL;
+    size_t i;
+
+    if (!vcpu)
+        return;
+
+    vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    if (vcpupriv->kvmStatsOpened)
+        return;
+    vcpupriv->kvmStatsOpened = true;
+
+    if (!priv->kvmDebugfsChecked)
+        qemuDomainFindKVMDebugfsDir(vm);
+
+    if (!priv->kvmDebugfsDir)
+        return;
+
+    for (i = 0; i < QEMU_DOMAIN_VCPU_KVM_STAT_LAST; i++) {
+        if (virAsprintfQuiet(&path, "%s/vcpu%u/%s", priv->kvmDebugfsDir,
+                             qemuDomainVcpuGetKVMId(vm->def, vcpuid),
+                             qemuDomainVcpuKVMStatTypeToString(i)) < 0)
+            break;
+
+        vcpupriv->kvmStatFds[i] = open(path, O_RDONLY | O_CLOEXEC);
+        VIR_FREE(path);
+    }
+}
+
+
+void
+qemuDomainVcpuCloseKVMStats(qemuDomainVcpuPrivatePtr vcpupriv)
+{
+    size_t i;
+
+    for (i = 0; i < QEMU_DOMAIN_VCPU_KVM_STAT_LAST; i++)
+        VIR_FORCE_CLOSE(vcpupriv->kvmStatFds[i]);
+    vcpupriv->kvmStatsOpened = false;
+}
+
+
+/**
+ * qemuDomainVcpuReadKVMStat:
+ * @vcpupriv: vCPU private data
+ * @stat: counter to read
+ * @value: filled with the value of the counter
+ *
+ * Returns 0 on success, -1 if the counter is not available. No error is
+ * reported.
+ */
+int
+qemuDomainVcpuReadKVMStat(qemuDomainVcpuPrivatePtr vcpupriv,
+                          qemuDomainVcpuKVMStat stat,
+                          unsigned long long *value)
+{
+    char buf[INT_BUFSIZE_BOUND(unsigned long long) + 1];
+    ssize_t len;
+
+    if (vcpupriv->kvmStatFds[stat] < 0)
+        return -1;
+
+    if ((len = pread(vcpupriv->kvmStatFds[stat], buf, sizeof(buf) - 1, 0)) <= 0)
+        return -1;
+    buf[len] = '\0';
+
+    if (virStrToLong_ull(buf, NULL, 10, value) < 0)
+        return -1;
+
+    return 0;
+}
+
+
 static virClassPtr qemuDomainChrSourcePrivateClass;
 static void qemuDomainChrSourcePrivateDispose(void *obj);
 
@@ -1908,6 +2233,7 @@ qemuDomainObjPrivateAlloc(void *opaque)
 
     priv->migMaxBandwidth = QEMU_DOMAIN_MIG_BANDWIDTH_MAX;
     priv->driver = opaque;
+    virProcessStatFileInit(&priv->statFile);
 
     return priv;
 
@@ -1916,6 +2242,41 @@ qemuDomainObjPrivateAlloc(void *opaque)
     return NULL;
 }
 
+
+struct _qemuDomainStatsCache {
+    /* 0 while nothing is cached, otherwise when it was fetched */
+    unsigned long long blockFetched;
+    bool blockBacking; /* the backing chain is included */
+    int nblockstats; /* count of supported fields */
+    virHashTablePtr blockstats; /* see qemuMonitorGetAllBlockStatsCapacity */
+
+    unsigned long long memFetched;
+    int nmemstats;
+    virDomainMemoryStatStruct memstats[VIR_DOMAIN_MEMORY_STAT_NR];
+
+    virHashTablePtr netstats; /* ifname -> qemuDomainStatsCacheNet */
+};
+
+typedef struct _qemuDomainStatsCacheNet qemuDomainStatsCacheNet;
+typedef qemuDomainStatsCacheNet *qemuDomainStatsCacheNetPtr;
+struct _qemuDomainStatsCacheNet {
+    unsigned long long fetched;
+    virDomainInterfaceStatsStruct stats;
+};
+
+
+static void
+qemuDomainStatsCacheFree(qemuDomainStatsCachePtr cache)
+{
+    if (!cache)
+        return;
+
+    virHashFree(cache->blockstats);
+    virHashFree(cache->netstats);
+    VIR_FREE(cache);
+}
+
+
 /**
  * qemuDomainObjPrivateDataClear:
  * @priv: domain private data
@@ -1926,6 +2287,8 @@ qemuDomainObjPrivateAlloc(void *opaque)
 void
 qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
 {
+    size_t i;
+
     virStringListFree(priv->qemuDevices);
     priv->qemuDevices = NULL;
 
@@ -1934,6 +2297,11 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     virPerfFree(priv->perf);
     priv->perf = NULL;
 
+    for (i = 0; i < priv->nresctrlMonitors; i++)
+        virObjectUnref(priv->resctrlMonitors[i]);
+    VIR_FREE(priv->resctrlMonitors);
+    priv->nresctrlMonitors = 0;
+
     VIR_FREE(priv->machineName);
 
     virObjectUnref(priv->qemuCaps);
@@ -1949,6 +2317,15 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     priv->autoNodeset = NULL;
     virBitmapFree(priv->autoCpuset);
     priv->autoCpuset = NULL;
+    virBitmapFree(priv->housekeepingCPUs);
+    priv->housekeepingCPUs = NULL;
+
+    VIR_FREE(priv->kvmDebugfsDir);
+    priv->kvmDebugfsChecked = false;
+
+    qemuDomainStatsCacheFree(priv->statsCache);
+    priv->statsCache = NULL;
+    priv->balloonStatsExpiry = 0;
 
     /* remove address data */
     virDomainPCIAddressSetFree(priv->pciaddrs);
@@ -1969,6 +2346,8 @@ qemuDomainObjPrivateDataClear(qemuDomainObjPrivatePtr priv)
     virBitmapFree(priv->migrationCaps);
     priv->migrationCaps = NULL;
 
+    virProcessStatFileClose(&priv->statFile);
+
     qemuDomainObjResetJob(priv);
     qemuDomainObjResetAsyncJob(priv);
 }
@@ -2455,6 +2834,9 @@ qemuDomainObjPrivateXMLFormat(virBufferPtr buf,
     if (priv->fakeReboot)
         virBufferAddLit(buf, "<fakereboot/>\n");
 
+    if (priv->journalSeq)
+        virBufferAsprintf(buf, "<journal seq='%llu'/>\n", priv->journalSeq);
+
     if (priv->qemuDevices && *priv->qemuDevices) {
         char **tmp = priv->qemuDevices;
         virBufferAddLit(buf, "<devices>\n");
@@ -2935,6 +3317,13 @@ qemuDomainObjPrivateXMLParse(xmlXPathContextPtr ctxt,
 
     priv->fakeReboot = virXPathBoolean("boolean(./fakereboot)", ctxt) == 1;
 
+    if (virXPathULongLong("string(./journal/@seq)", ctxt,
+                          &priv->journalSeq) == -2) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("invalid status journal sequence number"));
+        goto error;
+    }
+
     if ((n = virXPathNodeSet("./devices/device", ctxt, &nodes)) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("failed to parse qemu device list"));
@@ -6644,66 +7033,346 @@ virDomainDefParserConfig virQEMUDriverDomainDefParserConfig = {
 };
 
 
-static void
-qemuDomainObjSaveJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
-{
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+/*
+ * Status journal
+ *
+ * Job changes are frequent but touch only a tiny part of the status XML.
+ * When status_journal_entries is set, each job change appends a <delta>
+ * element with the current job and domain state to $stateDir/$name.journal
+ * instead of rewriting the whole status XML. Every entry carries a
+ * sequence number and the status XML records the last sequence number it
+ * already contains, so stale entries are ignored on replay. Once the
+ * journal holds status_journal_entries entries, the status XML is saved
+ * and the journal removed.
+ */
+#define QEMU_DOMAIN_STATUS_JOURNAL_END "</delta>\n"
+#define QEMU_DOMAIN_STATUS_JOURNAL_MAX (10 * 1024 * 1024)
 
-    if (virDomainObjIsActive(obj)) {
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
-            VIR_WARN("Failed to save status on vm %s", obj->def->name);
-    }
+static char *
+qemuDomainStatusJournalPath(virQEMUDriverConfigPtr cfg,
+                            virDomainObjPtr vm)
+{
+    char *path;
 
-    virObjectUnref(cfg);
+    ignore_value(virAsprintf(&path, "%s/%s.journal",
+                             cfg->stateDir, vm->def->name));
+    return path;
 }
 
-void
-qemuDomainObjSetJobPhase(virQEMUDriverPtr driver,
-                         virDomainObjPtr obj,
-                         int phase)
+
+static int
+qemuDomainStatusJournalAppend(virQEMUDriverPtr driver,
+                              virQEMUDriverConfigPtr cfg,
+                              virDomainObjPtr vm,
+                              bool durable)
 {
-    qemuDomainObjPrivatePtr priv = obj->privateData;
-    unsigned long long me = virThreadSelfID();
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *path = NULL;
+    char *entry = NULL;
+    int state;
+    int reason;
+    int fd = -1;
+    int ret = -1;
 
-    if (!priv->job.asyncJob)
-        return;
+    if (priv->journalEntries >= cfg->statusJournalEntries) {
+        /* compact the journal, the status XML records the last entry */
+        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
+                                vm, driver->caps) < 0)
+            return -1;
+        qemuDomainStatusJournalRemove(driver, vm);
+        return 0;
+    }
 
-    VIR_DEBUG("Setting '%s' phase to '%s'",
-              qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
-              qemuDomainAsyncJobPhaseToString(priv->job.asyncJob, phase));
+    if (!(path = qemuDomainStatusJournalPath(cfg, vm)))
+        goto cleanup;
 
-    if (priv->job.asyncOwner && me != priv->job.asyncOwner) {
-        VIR_WARN("'%s' async job is owned by thread %llu",
-                 qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
-                 priv->job.asyncOwner);
+    state = virDomainObjGetState(vm, &reason);
+    virBufferAsprintf(&buf, "<delta seq='%llu' state='%s' reason='%s'>\n",
+                      priv->journalSeq + 1,
+                      virDomainStateTypeToString(state),
+                      virDomainStateReasonToString(state, reason));
+    virBufferAdjustIndent(&buf, 2);
+    if (qemuDomainObjPrivateXMLFormatJob(&buf, vm, priv) < 0)
+        goto cleanup;
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, QEMU_DOMAIN_STATUS_JOURNAL_END);
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+    entry = virBufferContentAndReset(&buf);
+
+    if ((fd = open(path, O_WRONLY | O_APPEND | O_CREAT, S_IRUSR | S_IWUSR)) < 0) {
+        virReportSystemError(errno, _("cannot open status journal '%s'"),
+                             path);
+        goto cleanup;
     }
 
-    priv->job.phase = phase;
-    priv->job.asyncOwner = me;
-    qemuDomainObjSaveJob(driver, obj);
-}
+    if (safewrite(fd, entry, strlen(entry)) < 0 ||
+        (durable && fdatasync(fd) < 0)) {
+        virReportSystemError(errno, _("cannot write status journal '%s'"),
+                             path);
+        goto cleanup;
+    }
 
-void
-qemuDomainObjSetAsyncJobMask(virDomainObjPtr obj,
-                             unsigned long long allowedJobs)
-{
-    qemuDomainObjPrivatePtr priv = obj->privateData;
+    if (VIR_CLOSE(fd) < 0) {
+        virReportSystemError(errno, _("cannot close status journal '%s'"),
+                             path);
+        goto cleanup;
+    }
 
-    if (!priv->job.asyncJob)
-        return;
+    priv->journalSeq++;
+    priv->journalEntries++;
+    ret = 0;
 
-    priv->job.mask = allowedJobs | JOB_MASK(QEMU_JOB_DESTROY);
+ cleanup:
+    VIR_FORCE_CLOSE(fd);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(entry);
+    VIR_FREE(path);
+    return ret;
 }
 
-void
-qemuDomainObjDiscardAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
-{
-    qemuDomainObjPrivatePtr priv = obj->privateData;
 
-    if (priv->job.active == QEMU_JOB_ASYNC_NESTED)
+static int
+qemuDomainStatusJournalApply(virDomainObjPtr vm,
+                             xmlXPathContextPtr ctxt)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    char *tmp = NULL;
+    int state;
+    int reason;
+    size_t i;
+    int ret = -1;
+
+    if (!(tmp = virXPathString("string(./@state)", ctxt)) ||
+        (state = virDomainStateTypeFromString(tmp)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid domain state '%s'"), NULLSTR(tmp));
+        goto cleanup;
+    }
+    VIR_FREE(tmp);
+
+    if (!(tmp = virXPathString("string(./@reason)", ctxt)) ||
+        (reason = virDomainStateReasonFromString(state, tmp)) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("invalid domain state reason '%s'"), NULLSTR(tmp));
+        goto cleanup;
+    }
+
+    qemuDomainObjResetJob(priv);
+    qemuDomainObjResetAsyncJob(priv);
+    for (i = 0; i < vm->def->ndisks; i++)
+        QEMU_DOMAIN_DISK_PRIVATE(vm->def->disks[i])->migrating = false;
+
+    if (qemuDomainObjPrivateXMLParseJob(vm, priv, ctxt) < 0)
+        goto cleanup;
+
+    virDomainObjSetState(vm, state, reason);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(tmp);
+    return ret;
+}
+
+
+/**
+ * qemuDomainStatusJournalReplay:
+ * @driver: qemu driver data
+ * @vm: domain object
+ *
+ * Applies the most recent status journal entry of @vm which is newer
+ * than its status XML. An incomplete entry left behind by a crash is
+ * ignored. The journal is folded into the status XML afterwards.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainStatusJournalReplay(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    xmlDocPtr xml = NULL;
+    xmlXPathContextPtr ctxt = NULL;
+    unsigned long long seq;
+    char *path = NULL;
+    char *content = NULL;
+    char *last = NULL;
+    char *entry;
+    char *end;
+    int ret = -1;
+
+    if (!(path = qemuDomainStatusJournalPath(cfg, vm)))
+        goto cleanup;
+
+    if (!virFileExists(path)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virFileReadAll(path, QEMU_DOMAIN_STATUS_JOURNAL_MAX, &content) < 0)
+        goto cleanup;
+
+    /* entries are self contained, each of them is terminated by
+     * QEMU_DOMAIN_STATUS_JOURNAL_END, which is not valid within one */
+    for (entry = content;
+         (end = strstr(entry, QEMU_DOMAIN_STATUS_JOURNAL_END));
+         entry = end + strlen(QEMU_DOMAIN_STATUS_JOURNAL_END))
+        last = entry;
+
+    if (*entry)
+        VIR_WARN("Ignoring incomplete status journal entry of domain %s",
+                 vm->def->name);
+
+    if (last) {
+        end = strstr(last, QEMU_DOMAIN_STATUS_JOURNAL_END);
+        end[strlen(QEMU_DOMAIN_STATUS_JOURNAL_END)] = '\0';
+
+        if (!(xml = virXMLParseStringCtxt(last, _("(status journal)"), &ctxt)))
+            goto cleanup;
+
+        if (virXPathULongLong("string(./@seq)", ctxt, &seq) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("invalid status journal sequence number"));
+            goto cleanup;
+        }
+
+        if (seq > priv->journalSeq) {
+            VIR_DEBUG("Replaying status journal entry %llu of domain %s",
+                      seq, vm->def->name);
+            if (qemuDomainStatusJournalApply(vm, ctxt) < 0)
+                goto cleanup;
+            priv->journalSeq = seq;
+        }
+    }
+
+    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
+                            vm, driver->caps) < 0)
+        goto cleanup;
+    qemuDomainStatusJournalRemove(driver, vm);
+
+    ret = 0;
+
+ cleanup:
+    xmlXPathFreeContext(ctxt);
+    xmlFreeDoc(xml);
+    VIR_FREE(content);
+    VIR_FREE(path);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/**
+ * qemuDomainStatusJournalRemove:
+ * @driver: qemu driver data
+ * @vm: domain object
+ *
+ * Removes the status journal of @vm. Entries it contains must already be
+ * recorded in the status XML or be no longer needed.
+ */
+void
+qemuDomainStatusJournalRemove(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    char ebuf[1024];
+    char *path;
+
+    priv->journalEntries = 0;
+
+    if ((path = qemuDomainStatusJournalPath(cfg, vm)) &&
+        unlink(path) < 0 && errno != ENOENT) {
+        VIR_WARN("Failed to remove status journal '%s': %s",
+                 path, virStrerror(errno, ebuf, sizeof(ebuf)));
+    }
+
+    VIR_FREE(path);
+    virObjectUnref(cfg);
+}
+
+
+/*
+ * Saves the job status of @obj, either to the status journal or to the
+ * status XML. Unless @durable is true, the status XML is written by a
+ * background thread and rapid job changes coalesce into a single write.
+ * Async job phases need to be @durable since they are what we recover
+ * from after a daemon restart.
+ */
+static void
+qemuDomainObjSaveJob(virQEMUDriverPtr driver,
+                     virDomainObjPtr obj,
+                     bool durable)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    int rc;
+
+    if (virDomainObjIsActive(obj)) {
+        if (cfg->statusJournalEntries)
+            rc = qemuDomainStatusJournalAppend(driver, cfg, obj, durable);
+        else if (durable)
+            rc = virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
+                                     obj, driver->caps);
+        else
+            rc = virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                             obj, driver->caps);
+        if (rc < 0)
+            VIR_WARN("Failed to save status on vm %s", obj->def->name);
+    }
+
+    virObjectUnref(cfg);
+}
+
+void
+qemuDomainObjSetJobPhase(virQEMUDriverPtr driver,
+                         virDomainObjPtr obj,
+                         int phase)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    unsigned long long me = virThreadSelfID();
+
+    if (!priv->job.asyncJob)
+        return;
+
+    VIR_DEBUG("Setting '%s' phase to '%s'",
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+              qemuDomainAsyncJobPhaseToString(priv->job.asyncJob, phase));
+
+    if (priv->job.asyncOwner && me != priv->job.asyncOwner) {
+        VIR_WARN("'%s' async job is owned by thread %llu",
+                 qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+                 priv->job.asyncOwner);
+    }
+
+    priv->job.phase = phase;
+    priv->job.asyncOwner = me;
+    qemuDomainObjSaveJob(driver, obj, true);
+}
+
+void
+qemuDomainObjSetAsyncJobMask(virDomainObjPtr obj,
+                             unsigned long long allowedJobs)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    if (!priv->job.asyncJob)
+        return;
+
+    priv->job.mask = allowedJobs | JOB_MASK(QEMU_JOB_DESTROY);
+}
+
+void
+qemuDomainObjDiscardAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    if (priv->job.active == QEMU_JOB_ASYNC_NESTED)
         qemuDomainObjResetJob(priv);
     qemuDomainObjResetAsyncJob(priv);
-    qemuDomainObjSaveJob(driver, obj);
+    qemuDomainObjSaveJob(driver, obj, true);
 }
 
 void
@@ -6741,8 +7410,10 @@ qemuDomainObjCanSetJob(qemuDomainObjPrivatePtr priv,
                        qemuDomainJob job,
                        qemuDomainAgentJob agentJob)
 {
-    return ((job == QEMU_JOB_NONE ||
-             priv->job.active == QEMU_JOB_NONE) &&
+    return (!priv->reconnectPending &&
+            (job == QEMU_JOB_NONE ||
+             (priv->job.active == QEMU_JOB_NONE &&
+              priv->job.nshared == 0)) &&
             (agentJob == QEMU_AGENT_JOB_NONE ||
              priv->job.agentActive == QEMU_AGENT_JOB_NONE));
 }
@@ -6783,6 +7454,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = obj->privateData;
     unsigned long long now;
     unsigned long long then;
+    unsigned long long queued;
     bool nested = job == QEMU_JOB_ASYNC_NESTED;
     bool async = job == QEMU_JOB_ASYNC;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
@@ -6808,9 +7480,17 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         return -1;
     }
 
+    PROBE_QUIET(QEMU_JOB_ACQUIRE_BEGIN,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, job, agentJob, asyncJob);
+
     priv->jobs_queued++;
+    queued = now;
     then = now + QEMU_JOB_WAIT_TIME;
 
+    if (priv->reconnectPending)
+        qemuProcessReconnectPrioritize(driver, obj);
+
  retry:
     if ((!async && job != QEMU_JOB_DESTROY) &&
         cfg->maxQueuedJobs &&
@@ -6828,11 +7508,24 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     while (!qemuDomainObjCanSetJob(priv, job, agentJob)) {
+        int rc;
+
         if (nowait)
             goto cleanup;
 
         VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
-        if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
+
+        /* holds back new shared jobs so that they can't starve us */
+        if (job)
+            priv->job.nwaiting++;
+        rc = virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then);
+        if (job) {
+            priv->job.nwaiting--;
+            if (rc < 0)
+                virCondBroadcast(&priv->job.cond);
+        }
+
+        if (rc < 0)
             goto error;
     }
 
@@ -6842,6 +7535,7 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
         goto retry;
 
     ignore_value(virTimeMillisNow(&now));
+    qemuDomainJobAcctWait(priv, queued, true);
 
     if (job) {
         qemuDomainObjResetJob(priv);
@@ -6886,12 +7580,16 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
     }
 
     if (qemuDomainTrackJob(job))
-        qemuDomainObjSaveJob(driver, obj);
+        qemuDomainObjSaveJob(driver, obj, false);
 
+    PROBE_QUIET(QEMU_JOB_ACQUIRE_END,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d ret=%d",
+                obj, obj->def->name, job, agentJob, asyncJob, 0);
     virObjectUnref(cfg);
     return 0;
 
  error:
+    qemuDomainJobAcctWait(priv, queued, false);
     ignore_value(virTimeMillisNow(&now));
     if (priv->job.active && priv->job.started)
         duration = now - priv->job.started;
@@ -6980,6 +7678,9 @@ qemuDomainObjBeginJobInternal(virQEMUDriverPtr driver,
 
  cleanup:
     priv->jobs_queued--;
+    PROBE_QUIET(QEMU_JOB_ACQUIRE_END,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d ret=%d",
+                obj, obj->def->name, job, agentJob, asyncJob, ret);
     virObjectUnref(cfg);
     return ret;
 }
@@ -7109,6 +7810,163 @@ qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
                                          QEMU_ASYNC_JOB_NONE, true);
 }
 
+/**
+ * qemuDomainObjBeginSharedJob:
+ *
+ * @driver: qemu driver
+ * @obj: domain object
+ *
+ * Acquires a QEMU_JOB_QUERY job which, unlike the one acquired by
+ * qemuDomainObjBeginJob, can run along with other shared jobs. Only
+ * use it for APIs which merely read the state of the domain, possibly
+ * by entering the monitor, and don't rely on the domain state not
+ * changing between monitor calls except by the threads holding a job.
+ * The QEMU monitor handles commands from several threads at once.
+ *
+ * Shared jobs wait for regular jobs to finish and new ones are not
+ * started as long as a regular job is waiting for them to finish.
+ *
+ * To end the job call qemuDomainObjEndSharedJob.
+ *
+ * Returns 0 on success, -2 if the job could not be acquired in time,
+ * -1 on other errors.
+ */
+int
+qemuDomainObjBeginSharedJob(virQEMUDriverPtr driver,
+                            virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    unsigned long long queued;
+    unsigned long long then;
+    const char *blocker;
+    int ret = -1;
+
+    VIR_DEBUG("Starting shared job (vm=%p name=%s, current job=%s "
+              "async=%s shared=%u)",
+              obj, obj->def->name,
+              qemuDomainJobTypeToString(priv->job.active),
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+              priv->job.nshared);
+
+    PROBE_QUIET(QEMU_JOB_ACQUIRE_BEGIN,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, QEMU_JOB_QUERY,
+                QEMU_AGENT_JOB_NONE, QEMU_ASYNC_JOB_NONE);
+
+    if (virTimeMillisNow(&queued) < 0)
+        goto cleanup;
+    then = queued + QEMU_JOB_WAIT_TIME;
+
+    priv->jobs_queued++;
+
+    if (priv->reconnectPending)
+        qemuProcessReconnectPrioritize(driver, obj);
+
+    if (cfg->maxQueuedJobs &&
+        priv->jobs_queued > cfg->maxQueuedJobs) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("cannot acquire state change lock "
+                         "due to max_queued limit"));
+        ret = -2;
+        goto error;
+    }
+
+ retry:
+    while (!qemuDomainNestedJobAllowed(priv, QEMU_JOB_QUERY)) {
+        VIR_DEBUG("Waiting for async job (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWaitUntil(&priv->job.asyncCond, &obj->parent.lock, then) < 0)
+            goto timeout;
+    }
+
+    while (priv->reconnectPending ||
+           priv->job.active != QEMU_JOB_NONE ||
+           priv->job.nwaiting > 0) {
+        VIR_DEBUG("Waiting for job (vm=%p name=%s)", obj, obj->def->name);
+        if (virCondWaitUntil(&priv->job.cond, &obj->parent.lock, then) < 0)
+            goto timeout;
+    }
+
+    if (!qemuDomainNestedJobAllowed(priv, QEMU_JOB_QUERY))
+        goto retry;
+
+    qemuDomainJobAcctWait(priv, queued, true);
+    if (priv->job.nshared++ == 0)
+        ignore_value(virTimeMillisNow(&priv->jobAcct.sharedStarted));
+    VIR_DEBUG("Started shared job (async=%s vm=%p name=%s shared=%u)",
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+              obj, obj->def->name, priv->job.nshared);
+
+    ret = 0;
+    goto cleanup;
+
+ timeout:
+    qemuDomainJobAcctWait(priv, queued, false);
+    if (errno != ETIMEDOUT) {
+        virReportSystemError(errno, "%s", _("cannot acquire job mutex"));
+        goto error;
+    }
+
+    if (!(blocker = priv->job.ownerAPI))
+        blocker = priv->job.asyncOwnerAPI;
+
+    if (blocker) {
+        virReportError(VIR_ERR_OPERATION_TIMEOUT,
+                       _("cannot acquire state change "
+                         "lock (held by monitor=%s)"),
+                       blocker);
+    } else {
+        virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                       _("cannot acquire state change lock"));
+    }
+    ret = -2;
+
+ error:
+    priv->jobs_queued--;
+
+ cleanup:
+    PROBE_QUIET(QEMU_JOB_ACQUIRE_END,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d ret=%d",
+                obj, obj->def->name, QEMU_JOB_QUERY,
+                QEMU_AGENT_JOB_NONE, QEMU_ASYNC_JOB_NONE, ret);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+/*
+ * obj must be locked and have a reference before calling
+ *
+ * To be called after completing the work associated with the
+ * earlier qemuDomainObjBeginSharedJob() call
+ */
+void
+qemuDomainObjEndSharedJob(virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+
+    priv->jobs_queued--;
+    priv->job.nshared--;
+
+    PROBE_QUIET(QEMU_JOB_RELEASE,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, QEMU_JOB_QUERY,
+                QEMU_AGENT_JOB_NONE, QEMU_ASYNC_JOB_NONE);
+
+    /* Shared jobs overlap, account the time the job was held shared */
+    if (priv->job.nshared == 0) {
+        qemuDomainJobAcctAdd(&priv->jobAcct.job[QEMU_JOB_QUERY],
+                             priv->jobAcct.sharedStarted);
+        priv->jobAcct.sharedStarted = 0;
+    }
+
+    VIR_DEBUG("Stopping shared job (async=%s vm=%p name=%s shared=%u)",
+              qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
+              obj, obj->def->name, priv->job.nshared);
+
+    if (priv->job.nshared == 0)
+        virCondBroadcast(&priv->job.cond);
+}
+
 /*
  * obj must be locked and have a reference before calling
  *
@@ -7128,9 +7986,15 @@ qemuDomainObjEndJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    PROBE_QUIET(QEMU_JOB_RELEASE,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, job,
+                QEMU_AGENT_JOB_NONE, QEMU_ASYNC_JOB_NONE);
+
+    qemuDomainJobAcctAdd(&priv->jobAcct.job[job], priv->job.started);
     qemuDomainObjResetJob(priv);
     if (qemuDomainTrackJob(job))
-        qemuDomainObjSaveJob(driver, obj);
+        qemuDomainObjSaveJob(driver, obj, false);
     /* We indeed need to wake up ALL threads waiting because
      * grabbing a job requires checking more variables. */
     virCondBroadcast(&priv->job.cond);
@@ -7149,6 +8013,13 @@ qemuDomainObjEndAgentJob(virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    PROBE_QUIET(QEMU_JOB_RELEASE,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, QEMU_JOB_NONE,
+                agentJob, QEMU_ASYNC_JOB_NONE);
+
+    qemuDomainJobAcctAdd(&priv->jobAcct.agentJob[agentJob],
+                         priv->job.agentStarted);
     qemuDomainObjResetAgentJob(priv);
     /* We indeed need to wake up ALL threads waiting because
      * grabbing a job requires checking more variables. */
@@ -7171,10 +8042,17 @@ qemuDomainObjEndJobWithAgent(virQEMUDriverPtr driver,
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    PROBE_QUIET(QEMU_JOB_RELEASE,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, job, agentJob, QEMU_ASYNC_JOB_NONE);
+
+    qemuDomainJobAcctAdd(&priv->jobAcct.job[job], priv->job.started);
+    qemuDomainJobAcctAdd(&priv->jobAcct.agentJob[agentJob],
+                         priv->job.agentStarted);
     qemuDomainObjResetJob(priv);
     qemuDomainObjResetAgentJob(priv);
     if (qemuDomainTrackJob(job))
-        qemuDomainObjSaveJob(driver, obj);
+        qemuDomainObjSaveJob(driver, obj, false);
     /* We indeed need to wake up ALL threads waiting because
      * grabbing a job requires checking more variables. */
     virCondBroadcast(&priv->job.cond);
@@ -7191,8 +8069,15 @@ qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver, virDomainObjPtr obj)
               qemuDomainAsyncJobTypeToString(priv->job.asyncJob),
               obj, obj->def->name);
 
+    PROBE_QUIET(QEMU_JOB_RELEASE,
+                "vm=%p name=%s job=%d agentJob=%d asyncJob=%d",
+                obj, obj->def->name, QEMU_JOB_ASYNC,
+                QEMU_AGENT_JOB_NONE, priv->job.asyncJob);
+
+    qemuDomainJobAcctAdd(&priv->jobAcct.asyncJob[priv->job.asyncJob],
+                         priv->job.asyncStarted);
     qemuDomainObjResetAsyncJob(priv);
-    qemuDomainObjSaveJob(driver, obj);
+    qemuDomainObjSaveJob(driver, obj, true);
     virCondBroadcast(&priv->job.asyncCond);
 }
 
@@ -7245,7 +8130,12 @@ qemuDomainObjEnterMonitorInternal(virQEMUDriverPtr driver,
               priv->mon, obj, obj->def->name);
     virObjectLock(priv->mon);
     virObjectRef(priv->mon);
-    ignore_value(virTimeMillisNow(&priv->monStart));
+    PROBE_QUIET(QEMU_MONITOR_ENTER, "vm=%p name=%s mon=%p",
+                obj, obj->def->name, priv->mon);
+    priv->jobAcct.monCalls++;
+    /* threads holding shared jobs may be in the monitor already */
+    if (priv->monUsers++ == 0)
+        ignore_value(virTimeMillisNow(&priv->monStart));
     virObjectUnlock(obj);
 
     return 0;
@@ -7266,8 +8156,17 @@ qemuDomainObjExitMonitorInternal(virQEMUDriverPtr driver,
     virObjectLock(obj);
     VIR_DEBUG("Exited monitor (mon=%p vm=%p name=%s)",
               priv->mon, obj, obj->def->name);
+    PROBE_QUIET(QEMU_MONITOR_EXIT, "vm=%p name=%s mon=%p",
+                obj, obj->def->name, priv->mon);
 
-    priv->monStart = 0;
+    if (--priv->monUsers == 0) {
+        unsigned long long now;
+
+        if (priv->monStart && virTimeMillisNowRaw(&now) == 0 &&
+            now > priv->monStart)
+            priv->jobAcct.monTime += now - priv->monStart;
+        priv->monStart = 0;
+    }
     if (!hasRefs)
         priv->mon = NULL;
 
@@ -7657,6 +8556,10 @@ qemuDomainDefFormatXML(virQEMUDriverPtr driver,
 }
 
 
+/*
+ * The formatted XML is cached in the definition unless it depends on
+ * the host or the QEMU binary as well.
+ */
 char *qemuDomainFormatXML(virQEMUDriverPtr driver,
                           virDomainObjPtr vm,
                           unsigned int flags)
@@ -7664,6 +8567,9 @@ char *qemuDomainFormatXML(virQEMUDriverPtr driver,
     virDomainDefPtr def;
     qemuDomainObjPrivatePtr priv = vm->privateData;
     virCPUDefPtr origCPU = NULL;
+    bool cache = !(flags & (VIR_DOMAIN_XML_UPDATE_CPU |
+                            VIR_DOMAIN_XML_MIGRATABLE));
+    char *xml;
 
     if ((flags & VIR_DOMAIN_XML_INACTIVE) && vm->newDef) {
         def = vm->newDef;
@@ -7672,7 +8578,16 @@ char *qemuDomainFormatXML(virQEMUDriverPtr driver,
         origCPU = priv->origCPU;
     }
 
-    return qemuDomainDefFormatXMLInternal(driver, def, origCPU, flags);
+    if (cache && virDomainDefXMLCacheLookup(def, flags, &xml) != 0)
+        return xml;
+
+    if (!(xml = qemuDomainDefFormatXMLInternal(driver, def, origCPU, flags)))
+        return NULL;
+
+    if (cache)
+        virDomainDefXMLCacheStore(def, flags, xml);
+
+    return xml;
 }
 
 char *
@@ -8152,6 +9067,138 @@ qemuDomainSnapshotWriteMetadata(virDomainObjPtr vm,
     return ret;
 }
 
+/**
+ * qemuDomainSnapshotLoadIfNeeded:
+ * @vm: domain object, locked
+ *
+ * Parse the snapshot metadata of @vm from the snapshot directory unless
+ * it was already done.  Reading every snapshot file of every domain at
+ * daemon startup is expensive for domains with many snapshots, so it's
+ * deferred until the snapshot list of @vm is first needed.
+ *
+ * Malformed snapshot files are skipped, as one broken file should not
+ * hide the remaining snapshots.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainSnapshotLoadIfNeeded(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverPtr driver = priv->driver;
+    virQEMUDriverConfigPtr cfg = NULL;
+    char *snapDir = NULL;
+    DIR *dir = NULL;
+    struct dirent *entry;
+    char *xmlStr = NULL;
+    char *fullpath = NULL;
+    virDomainSnapshotDefPtr def = NULL;
+    virDomainSnapshotObjPtr snap = NULL;
+    virDomainSnapshotObjPtr current = NULL;
+    unsigned int flags = (VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE |
+                          VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
+                          VIR_DOMAIN_SNAPSHOT_PARSE_INTERNAL);
+    int ret = -1;
+    virCapsPtr caps = NULL;
+    int rc;
+    int direrr;
+
+    if (priv->snapshotsLoaded)
+        return 0;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virAsprintf(&snapDir, "%s/%s", cfg->snapshotDir, vm->def->name) < 0)
+        goto cleanup;
+
+    if ((rc = virDirOpenIfExists(&dir, snapDir)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        priv->snapshotsLoaded = true;
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+        goto cleanup;
+
+    VIR_INFO("Scanning for snapshots for domain %s in %s", vm->def->name,
+             snapDir);
+
+    while ((direrr = virDirRead(dir, &entry, NULL)) > 0) {
+        /* NB: ignoring errors, so one malformed config doesn't
+           hide the remaining snapshots */
+        VIR_INFO("Loading snapshot file '%s'", entry->d_name);
+
+        if (virAsprintf(&fullpath, "%s/%s", snapDir, entry->d_name) < 0)
+            continue;
+
+        if (virFileReadAll(fullpath, 1024*1024*1, &xmlStr) < 0) {
+            /* Nothing we can do here, skip this one */
+            VIR_FREE(fullpath);
+            continue;
+        }
+
+        def = virDomainSnapshotDefParseString(xmlStr, caps,
+                                              driver->xmlopt,
+                                              flags);
+        if (def == NULL) {
+            /* Nothing we can do here, skip this one */
+            VIR_WARN("Failed to parse snapshot XML from file '%s'", fullpath);
+            VIR_FREE(fullpath);
+            VIR_FREE(xmlStr);
+            continue;
+        }
+
+        snap = virDomainSnapshotAssignDef(vm->snapshots, def);
+        if (snap == NULL) {
+            virDomainSnapshotDefFree(def);
+        } else if (snap->def->current) {
+            current = snap;
+            if (!vm->current_snapshot)
+                vm->current_snapshot = snap;
+        }
+
+        VIR_FREE(fullpath);
+        VIR_FREE(xmlStr);
+    }
+    if (direrr < 0)
+        VIR_WARN("Failed to fully read directory %s", snapDir);
+
+    if (vm->current_snapshot != current) {
+        VIR_WARN("Too many snapshots claiming to be current for domain %s",
+                 vm->def->name);
+        vm->current_snapshot = NULL;
+    }
+
+    if (virDomainSnapshotUpdateRelations(vm->snapshots) < 0)
+        VIR_WARN("Snapshots have inconsistent relations for domain %s",
+                 vm->def->name);
+
+    /* FIXME: qemu keeps internal track of snapshots.  We can get access
+     * to this info via the "info snapshots" monitor command for running
+     * domains, or via "qemu-img snapshot -l" for shutoff domains.  It would
+     * be nice to update our internal state based on that, but there is a
+     * a problem.  qemu doesn't track all of the same metadata that we do.
+     * In particular we wouldn't be able to fill in the <parent>, which is
+     * pretty important in our metadata.
+     */
+
+    /* Errors of individual snapshots are not fatal, don't let them leak
+     * into the API call which triggered the loading. */
+    virResetLastError();
+
+    priv->snapshotsLoaded = true;
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(snapDir);
+    virObjectUnref(caps);
+    virObjectUnref(cfg);
+    return ret;
+}
+
 /* The domain is expected to be locked and inactive. Return -1 on normal
  * failure, 1 if we skipped a disk due to try_all.  */
 static int
@@ -8335,6 +9382,9 @@ qemuDomainSnapshotDiscardAllMetadata(virQEMUDriverPtr driver,
 {
     virQEMUSnapRemove rem;
 
+    if (qemuDomainSnapshotLoadIfNeeded(vm) < 0)
+        return -1;
+
     rem.driver = driver;
     rem.vm = vm;
     rem.metadata_only = true;
@@ -8346,6 +9396,154 @@ qemuDomainSnapshotDiscardAllMetadata(virQEMUDriverPtr driver,
 }
 
 
+int
+qemuDomainCheckpointWriteMetadata(virDomainObjPtr vm,
+                                  virDomainCheckpointDefPtr def,
+                                  const char *checkpointDir)
+{
+    char *newxml = NULL;
+    char *chkDir = NULL;
+    char *chkFile = NULL;
+    int ret = -1;
+
+    if (!(newxml = virDomainCheckpointDefFormat(def, 0)))
+        return -1;
+
+    if (virAsprintf(&chkDir, "%s/%s", checkpointDir, vm->def->name) < 0)
+        goto cleanup;
+    if (virFileMakePath(chkDir) < 0) {
+        virReportSystemError(errno, _("cannot create checkpoint directory '%s'"),
+                             chkDir);
+        goto cleanup;
+    }
+
+    if (virAsprintf(&chkFile, "%s/%s.xml", chkDir, def->name) < 0)
+        goto cleanup;
+
+    ret = virXMLSaveFile(chkFile, NULL, "checkpoint-edit", newxml);
+
+ cleanup:
+    VIR_FREE(chkFile);
+    VIR_FREE(chkDir);
+    VIR_FREE(newxml);
+    return ret;
+}
+
+
+/* Discard one checkpoint (or its metadata).  Removing the dirty bitmaps
+ * requires a running domain, the caller must hold a job in that case.
+ * @def is freed on success.  */
+int
+qemuDomainCheckpointDiscard(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm,
+                            virDomainCheckpointDefPtr def,
+                            bool metadata_only)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    char *chkFile = NULL;
+    char *device = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (!metadata_only) {
+        if (!virDomainObjIsActive(vm)) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("deleting the bitmaps of a checkpoint requires "
+                             "a running domain"));
+            goto cleanup;
+        }
+
+        for (i = 0; i < def->ndisks; i++) {
+            virDomainCheckpointDiskDefPtr chkdisk = &def->disks[i];
+            virDomainDiskDefPtr disk;
+
+            if (chkdisk->type != VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP)
+                continue;
+
+            /* The disk might have been unplugged, along with its bitmap */
+            if (!(disk = virDomainDiskByName(vm->def, chkdisk->name, false)))
+                continue;
+
+            if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+                goto cleanup;
+
+            qemuDomainObjEnterMonitor(driver, vm);
+            rc = qemuMonitorBlockDirtyBitmapRemove(priv->mon, device,
+                                                   chkdisk->bitmap);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+                goto cleanup;
+            VIR_FREE(device);
+        }
+    }
+
+    if (virAsprintf(&chkFile, "%s/%s/%s.xml", cfg->checkpointDir,
+                    vm->def->name, def->name) < 0)
+        goto cleanup;
+
+    if (unlink(chkFile) < 0 && errno != ENOENT)
+        VIR_WARN("Failed to unlink %s", chkFile);
+    virDomainCheckpointObjListRemove(vm->checkpoints, def);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(device);
+    VIR_FREE(chkFile);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+static int
+qemuDomainCheckpointDiscardFile(void *payload,
+                                const void *name ATTRIBUTE_UNUSED,
+                                void *data)
+{
+    virDomainCheckpointDefPtr def = payload;
+    const char *chkDir = data;
+    char *chkFile = NULL;
+
+    if (virAsprintf(&chkFile, "%s/%s.xml", chkDir, def->name) < 0)
+        return 0;
+
+    if (unlink(chkFile) < 0 && errno != ENOENT)
+        VIR_WARN("Failed to unlink %s", chkFile);
+
+    VIR_FREE(chkFile);
+    return 0;
+}
+
+
+/* Remove the metadata of all checkpoints of a domain which is going away,
+ * keeping the dirty bitmaps in the disk images.  */
+int
+qemuDomainCheckpointDiscardAllMetadata(virQEMUDriverPtr driver,
+                                       virDomainObjPtr vm)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    char *chkDir = NULL;
+    int ret = -1;
+
+    if (virAsprintf(&chkDir, "%s/%s", cfg->checkpointDir, vm->def->name) < 0)
+        goto cleanup;
+
+    virDomainCheckpointForEach(vm->checkpoints,
+                               qemuDomainCheckpointDiscardFile, chkDir);
+
+    if (rmdir(chkDir) < 0 && errno != ENOENT)
+        VIR_WARN("unable to remove checkpoint directory %s", chkDir);
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(chkDir);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
 static void
 qemuDomainRemoveInactiveCommon(virQEMUDriverPtr driver,
                                virDomainObjPtr vm)
@@ -8369,6 +9567,10 @@ qemuDomainRemoveInactiveCommon(virQEMUDriverPtr driver,
             VIR_WARN("unable to remove snapshot directory %s", snapDir);
         VIR_FREE(snapDir);
     }
+
+    if (qemuDomainCheckpointDiscardAllMetadata(driver, vm) < 0)
+        VIR_WARN("unable to remove all checkpoints for domain %s",
+                 vm->def->name);
     qemuExtDevicesCleanupHost(driver, vm->def);
 
     virObjectUnref(cfg);
@@ -8718,20 +9920,38 @@ qemuDomainStorageAlias(const char *device, int depth)
 }
 
 
+/**
+ * qemuDomainDetermineDiskChainProbe:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @disk: disk definition
+ * @report_broken: report broken chain verbosely
+ * @detected: filled with the image the detection started at
+ *
+ * First half of qemuDomainDetermineDiskChain(): checks the existing part
+ * of the backing chain of @disk and detects the rest of it from the image
+ * metadata.  Apart from @disk nothing in @vm is modified so that several
+ * disks of one domain can be probed concurrently.  Images detected by this
+ * function, if any, must be passed to qemuDomainDetermineDiskChainFinish()
+ * via @detected, which is set to NULL if there is nothing left to be done.
+ *
+ * Returns 0 on success, -1 on error.
+ */
 int
-qemuDomainDetermineDiskChain(virQEMUDriverPtr driver,
-                             virDomainObjPtr vm,
-                             virDomainDiskDefPtr disk,
-                             bool report_broken)
+qemuDomainDetermineDiskChainProbe(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm,
+                                  virDomainDiskDefPtr disk,
+                                  bool report_broken,
+                                  virStorageSourcePtr *detected)
 {
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     virStorageSourcePtr src = disk->src;
-    virStorageSourcePtr n;
-    qemuDomainObjPrivatePtr priv = vm->privateData;
     int ret = -1;
     uid_t uid;
     gid_t gid;
 
+    *detected = NULL;
+
     if (virStorageSourceIsEmpty(src)) {
         ret = 0;
         goto cleanup;
@@ -8803,7 +10023,47 @@ qemuDomainDetermineDiskChain(virQEMUDriverPtr driver,
     if (virStorageFileGetMetadata(src, uid, gid, report_broken) < 0)
         goto cleanup;
 
-    for (n = src->backingStore; virStorageSourceIsBacking(n); n = n->backingStore) {
+    *detected = src;
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/**
+ * qemuDomainDetermineDiskChainFinish:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @disk: disk definition
+ * @detected: image returned by qemuDomainDetermineDiskChainProbe()
+ *
+ * Second half of qemuDomainDetermineDiskChain(): validates the images
+ * detected below @detected and prepares them for use by qemu, which also
+ * allocates their node names.  Unlike the probe this must be called for
+ * one disk at a time, in the order the disks are expected to get their
+ * node names.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuDomainDetermineDiskChainFinish(virQEMUDriverPtr driver,
+                                   virDomainObjPtr vm,
+                                   virDomainDiskDefPtr disk,
+                                   virStorageSourcePtr detected)
+{
+    virQEMUDriverConfigPtr cfg;
+    virStorageSourcePtr n;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    int ret = -1;
+
+    if (!detected)
+        return 0;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    for (n = detected->backingStore; virStorageSourceIsBacking(n); n = n->backingStore) {
         if (qemuDomainValidateStorageSource(n, priv->qemuCaps) < 0)
             goto cleanup;
 
@@ -8823,6 +10083,22 @@ qemuDomainDetermineDiskChain(virQEMUDriverPtr driver,
 }
 
 
+int
+qemuDomainDetermineDiskChain(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             virDomainDiskDefPtr disk,
+                             bool report_broken)
+{
+    virStorageSourcePtr detected;
+
+    if (qemuDomainDetermineDiskChainProbe(driver, vm, disk,
+                                          report_broken, &detected) < 0)
+        return -1;
+
+    return qemuDomainDetermineDiskChainFinish(driver, vm, disk, detected);
+}
+
+
 /**
  * qemuDomainDiskGetBackendAlias:
  * @disk: disk definition
@@ -8956,6 +10232,10 @@ bool
 qemuDomainDiskChangeSupported(virDomainDiskDefPtr disk,
                               virDomainDiskDefPtr orig_disk)
 {
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+    const virDomainBlockIoTuneInfo *orig_iotune =
+        virDomainDiskGetBlockIoTune(orig_disk);
+
 #define CHECK_EQ(field, field_name, nullable) \
     do { \
         if (nullable && !disk->field) \
@@ -8993,48 +10273,48 @@ qemuDomainDiskChangeSupported(virDomainDiskDefPtr disk,
     CHECK_EQ(blockio.physical_block_size,
              "blockio physical_block_size", false);
 
-    CHECK_EQ(blkdeviotune.total_bytes_sec,
-             "blkdeviotune total_bytes_sec",
-             true);
-    CHECK_EQ(blkdeviotune.read_bytes_sec,
-             "blkdeviotune read_bytes_sec",
-             true);
-    CHECK_EQ(blkdeviotune.write_bytes_sec,
-             "blkdeviotune write_bytes_sec",
-             true);
-    CHECK_EQ(blkdeviotune.total_iops_sec,
-             "blkdeviotune total_iops_sec",
-             true);
-    CHECK_EQ(blkdeviotune.read_iops_sec,
-             "blkdeviotune read_iops_sec",
-             true);
-    CHECK_EQ(blkdeviotune.write_iops_sec,
-             "blkdeviotune write_iops_sec",
-             true);
-    CHECK_EQ(blkdeviotune.total_bytes_sec_max,
-             "blkdeviotune total_bytes_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.read_bytes_sec_max,
-             "blkdeviotune read_bytes_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.write_bytes_sec_max,
-             "blkdeviotune write_bytes_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.total_iops_sec_max,
-             "blkdeviotune total_iops_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.read_iops_sec_max,
-             "blkdeviotune read_iops_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.write_iops_sec_max,
-             "blkdeviotune write_iops_sec_max",
-             true);
-    CHECK_EQ(blkdeviotune.size_iops_sec,
-             "blkdeviotune size_iops_sec",
-             true);
-    CHECK_EQ(blkdeviotune.group_name,
-             "blkdeviotune group_name",
-             true);
+#define CHECK_IOTUNE_EQ(field, field_name) \
+    do { \
+        if (!iotune->field) \
+            break; \
+        if (iotune->field != orig_iotune->field) { \
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, \
+                           _("cannot modify field '%s' of the disk"), \
+                           field_name); \
+            return false; \
+        } \
+    } while (0)
+
+    CHECK_IOTUNE_EQ(total_bytes_sec,
+                    "blkdeviotune total_bytes_sec");
+    CHECK_IOTUNE_EQ(read_bytes_sec,
+                    "blkdeviotune read_bytes_sec");
+    CHECK_IOTUNE_EQ(write_bytes_sec,
+                    "blkdeviotune write_bytes_sec");
+    CHECK_IOTUNE_EQ(total_iops_sec,
+                    "blkdeviotune total_iops_sec");
+    CHECK_IOTUNE_EQ(read_iops_sec,
+                    "blkdeviotune read_iops_sec");
+    CHECK_IOTUNE_EQ(write_iops_sec,
+                    "blkdeviotune write_iops_sec");
+    CHECK_IOTUNE_EQ(total_bytes_sec_max,
+                    "blkdeviotune total_bytes_sec_max");
+    CHECK_IOTUNE_EQ(read_bytes_sec_max,
+                    "blkdeviotune read_bytes_sec_max");
+    CHECK_IOTUNE_EQ(write_bytes_sec_max,
+                    "blkdeviotune write_bytes_sec_max");
+    CHECK_IOTUNE_EQ(total_iops_sec_max,
+                    "blkdeviotune total_iops_sec_max");
+    CHECK_IOTUNE_EQ(read_iops_sec_max,
+                    "blkdeviotune read_iops_sec_max");
+    CHECK_IOTUNE_EQ(write_iops_sec_max,
+                    "blkdeviotune write_iops_sec_max");
+    CHECK_IOTUNE_EQ(size_iops_sec,
+                    "blkdeviotune size_iops_sec");
+    CHECK_IOTUNE_EQ(group_name,
+                    "blkdeviotune group_name");
+
+#undef CHECK_IOTUNE_EQ
 
     if (disk->serial && STRNEQ_NULLABLE(disk->serial, orig_disk->serial)) {
         virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
@@ -9981,7 +11261,11 @@ qemuDomainUpdateCurrentMemorySize(virQEMUDriverPtr driver,
     /* if no balloning is available, the current size equals to the current
      * full memory size */
     if (!virDomainDefHasMemballoon(vm->def)) {
-        vm->def->mem.cur_balloon = virDomainDefGetMemoryTotal(vm->def);
+        balloon = virDomainDefGetMemoryTotal(vm->def);
+        if (vm->def->mem.cur_balloon != balloon) {
+            vm->def->mem.cur_balloon = balloon;
+            virDomainDefBumpGeneration(vm->def);
+        }
         return 0;
     }
 
@@ -10011,7 +11295,10 @@ qemuDomainUpdateCurrentMemorySize(virQEMUDriverPtr driver,
         if (ret < 0)
             return -1;
 
-        vm->def->mem.cur_balloon = balloon;
+        if (vm->def->mem.cur_balloon != balloon) {
+            vm->def->mem.cur_balloon = balloon;
+            virDomainDefBumpGeneration(vm->def);
+        }
     }
 
     return 0;
@@ -13578,3 +14865,391 @@ qemuDomainIsUsingNoShutdown(qemuDomainObjPrivatePtr priv)
 {
     return priv->monJSON && priv->allowReboot == VIR_TRISTATE_BOOL_YES;
 }
+
+
+/**
+ * qemuDomainStatsCacheGet:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @fetched: when the stats were fetched, 0 if they were not
+ *
+ * Returns the stats cache of @vm if it is enabled and the stats fetched
+ * at @fetched are fresh enough or, when @fetched is NULL, if the cache
+ * is enabled at all, allocating it if needed. Returns NULL otherwise,
+ * without reporting an error.
+ */
+static qemuDomainStatsCachePtr
+qemuDomainStatsCacheGet(virQEMUDriverPtr driver,
+                        virDomainObjPtr vm,
+                        unsigned long long *fetched)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    unsigned int window = cfg->statsCacheMs;
+    unsigned long long now;
+
+    virObjectUnref(cfg);
+
+    if (!window || !virDomainObjIsActive(vm))
+        return NULL;
+
+    if (!priv->statsCache &&
+        VIR_ALLOC_QUIET(priv->statsCache) < 0)
+        return NULL;
+
+    if (!fetched)
+        return priv->statsCache;
+
+    if (!*fetched ||
+        virTimeMillisNowRaw(&now) < 0 ||
+        now - *fetched >= window)
+        return NULL;
+
+    return priv->statsCache;
+}
+
+
+static int
+qemuDomainStatsCacheCopyBlockOne(void *payload,
+                                 const void *name,
+                                 void *opaque)
+{
+    virHashTablePtr dst = opaque;
+    qemuBlockStatsPtr copy;
+
+    if (VIR_ALLOC_QUIET(copy) < 0)
+        return -1;
+
+    *copy = *(qemuBlockStatsPtr) payload;
+
+    if (virHashAddEntry(dst, name, copy) < 0) {
+        VIR_FREE(copy);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virHashTablePtr
+qemuDomainStatsCacheCopyBlock(virHashTablePtr src)
+{
+    virHashTablePtr dst;
+
+    if (!(dst = virHashCreate(virHashSize(src), virHashValueFree)))
+        return NULL;
+
+    if (virHashForEach(src, qemuDomainStatsCacheCopyBlockOne, dst) < 0) {
+        virHashFree(dst);
+        return NULL;
+    }
+
+    return dst;
+}
+
+
+/**
+ * qemuDomainStatsCacheGetBlock:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @backing: the stats of the backing chains are needed
+ * @nstats: filled with the count of supported fields
+ *
+ * Returns a copy of the block stats of @vm recently fetched by
+ * qemuMonitorGetAllBlockStatsCapacity, or NULL if there are none.
+ * No error is reported.
+ */
+virHashTablePtr
+qemuDomainStatsCacheGetBlock(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             bool backing,
+                             int *nstats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainStatsCachePtr cache;
+    virHashTablePtr ret;
+
+    if (!priv->statsCache ||
+        !(cache = qemuDomainStatsCacheGet(driver, vm,
+                                          &priv->statsCache->blockFetched)) ||
+        (backing && !cache->blockBacking))
+        return NULL;
+
+    if (!(ret = qemuDomainStatsCacheCopyBlock(cache->blockstats))) {
+        virResetLastError();
+        return NULL;
+    }
+
+    *nstats = cache->nblockstats;
+    return ret;
+}
+
+
+/**
+ * qemuDomainStatsCacheSetBlock:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @stats: block stats as fetched by qemuMonitorGetAllBlockStatsCapacity
+ * @backing: @stats include the backing chains
+ * @nstats: count of supported fields
+ *
+ * Remembers a copy of @stats if the stats cache is enabled.
+ */
+void
+qemuDomainStatsCacheSetBlock(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             virHashTablePtr stats,
+                             bool backing,
+                             int nstats)
+{
+    qemuDomainStatsCachePtr cache;
+    virHashTablePtr copy;
+
+    if (!stats || !(cache = qemuDomainStatsCacheGet(driver, vm, NULL)))
+        return;
+
+    if (!(copy = qemuDomainStatsCacheCopyBlock(stats)) ||
+        virTimeMillisNowRaw(&cache->blockFetched) < 0) {
+        virHashFree(copy);
+        virResetLastError();
+        cache->blockFetched = 0;
+        return;
+    }
+
+    virHashFree(cache->blockstats);
+    cache->blockstats = copy;
+    cache->blockBacking = backing;
+    cache->nblockstats = nstats;
+}
+
+
+/**
+ * qemuDomainStatsCacheGetMemory:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @stats: array to fill
+ * @nr_stats: size of @stats
+ *
+ * Fills @stats with the memory stats of @vm recently fetched.
+ *
+ * Returns the count of filled stats or -1 if there are none, without
+ * reporting an error.
+ */
+int
+qemuDomainStatsCacheGetMemory(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              unsigned int nr_stats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainStatsCachePtr cache;
+    unsigned int n;
+
+    if (!priv->statsCache ||
+        !(cache = qemuDomainStatsCacheGet(driver, vm,
+                                          &priv->statsCache->memFetched)))
+        return -1;
+
+    n = MIN(nr_stats, cache->nmemstats);
+    memcpy(stats, cache->memstats, n * sizeof(*stats));
+    return n;
+}
+
+
+/**
+ * qemuDomainStatsCacheSetMemory:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @stats: memory stats of @vm
+ * @nstats: count of @stats
+ *
+ * Remembers @stats if the stats cache is enabled.
+ */
+void
+qemuDomainStatsCacheSetMemory(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              int nstats)
+{
+    qemuDomainStatsCachePtr cache;
+
+    if (nstats < 0 || !(cache = qemuDomainStatsCacheGet(driver, vm, NULL)))
+        return;
+
+    if (virTimeMillisNowRaw(&cache->memFetched) < 0) {
+        cache->memFetched = 0;
+        return;
+    }
+
+    cache->nmemstats = MIN(nstats, VIR_DOMAIN_MEMORY_STAT_NR);
+    memcpy(cache->memstats, stats, cache->nmemstats * sizeof(*stats));
+}
+
+
+/**
+ * qemuDomainBalloonStatsGet:
+ * @vm: domain object
+ * @stats: filled with the guest memory stats of @vm
+ * @nr_stats: count of @stats
+ *
+ * The guest only refreshes its memory stats once per balloon period and
+ * asking QEMU before then just yields the numbers reported last.
+ *
+ * Returns the count of stats copied to @stats if the ones reported last
+ * are still current, -1 otherwise, without reporting an error.
+ */
+int
+qemuDomainBalloonStatsGet(virDomainObjPtr vm,
+                          virDomainMemoryStatPtr stats,
+                          unsigned int nr_stats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long now;
+    unsigned int n;
+
+    if (!priv->balloonStatsExpiry ||
+        virTimeMillisNowRaw(&now) < 0 ||
+        now >= priv->balloonStatsExpiry)
+        return -1;
+
+    n = MIN(nr_stats, priv->nballoonStats);
+    memcpy(stats, priv->balloonStats, n * sizeof(*stats));
+    return n;
+}
+
+
+/**
+ * qemuDomainBalloonStatsSet:
+ * @vm: domain object
+ * @stats: guest memory stats of @vm as read from the balloon
+ * @nstats: count of @stats
+ *
+ * Remembers @stats until the guest is due to report new ones. That is
+ * only done if QEMU tells about changes of the balloon size by an event,
+ * which invalidates them, as the current size is among @stats.
+ */
+void
+qemuDomainBalloonStatsSet(virDomainObjPtr vm,
+                          virDomainMemoryStatPtr stats,
+                          int nstats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long updated = 0;
+    unsigned long long now;
+    int period;
+    size_t i;
+
+    priv->balloonStatsExpiry = 0;
+
+    if (nstats <= 0 ||
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT) ||
+        !vm->def->memballoon ||
+        (period = vm->def->memballoon->period) <= 0 ||
+        virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    for (i = 0; i < nstats; i++) {
+        if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_LAST_UPDATE)
+            updated = stats[i].val * 1000;
+    }
+
+    if (!updated || updated > now)
+        updated = now;
+
+    priv->nballoonStats = MIN(nstats, VIR_DOMAIN_MEMORY_STAT_NR);
+    memcpy(priv->balloonStats, stats, priv->nballoonStats * sizeof(*stats));
+    priv->balloonStatsExpiry = updated + period * 1000ULL;
+}
+
+
+/**
+ * qemuDomainBalloonStatsInvalidate:
+ * @vm: domain object
+ *
+ * Forgets the guest memory stats of @vm remembered last, for instance
+ * because the balloon size or the stats period changed.
+ */
+void
+qemuDomainBalloonStatsInvalidate(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+
+    priv->balloonStatsExpiry = 0;
+}
+
+
+/**
+ * qemuDomainStatsCacheGetInterface:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @ifname: name of the host side of the interface
+ * @stats: filled with the stats of @ifname
+ *
+ * Returns 0 if @stats was filled with the stats of @ifname recently
+ * fetched, -1 if there are none, without reporting an error.
+ */
+int
+qemuDomainStatsCacheGetInterface(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainStatsCacheNetPtr net;
+
+    if (!ifname || !priv->statsCache || !priv->statsCache->netstats ||
+        !(net = virHashLookup(priv->statsCache->netstats, ifname)) ||
+        !qemuDomainStatsCacheGet(driver, vm, &net->fetched))
+        return -1;
+
+    *stats = net->stats;
+    return 0;
+}
+
+
+/**
+ * qemuDomainStatsCacheSetInterface:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @ifname: name of the host side of the interface
+ * @stats: stats of @ifname
+ *
+ * Remembers @stats if the stats cache is enabled.
+ */
+void
+qemuDomainStatsCacheSetInterface(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats)
+{
+    qemuDomainStatsCachePtr cache;
+    qemuDomainStatsCacheNetPtr net;
+
+    if (!ifname || !(cache = qemuDomainStatsCacheGet(driver, vm, NULL)))
+        return;
+
+    if (!cache->netstats &&
+        !(cache->netstats = virHashCreate(4, virHashValueFree)))
+        goto error;
+
+    if (!(net = virHashLookup(cache->netstats, ifname))) {
+        if (VIR_ALLOC(net) < 0)
+            goto error;
+
+        if (virHashAddEntry(cache->netstats, ifname, net) < 0) {
+            VIR_FREE(net);
+            goto error;
+        }
+    }
+
+    if (virTimeMillisNowRaw(&net->fetched) < 0) {
+        net->fetched = 0;
+        goto error;
+    }
+
+    net->stats = *stats;
+    return;
+
+ error:
+    virResetLastError();
+}
@@ -27,9 +27,11 @@
 # include "virthread.h"
 # include "vircgroup.h"
 # include "virperf.h"
+# include "virresctrl.h"
 # include "domain_addr.h"
 # include "domain_conf.h"
 # include "snapshot_conf.h"
+# include "checkpoint_conf.h"
 # include "qemu_monitor.h"
 # include "qemu_agent.h"
 # include "qemu_conf.h"
@@ -37,6 +39,7 @@
 # include "qemu_migration_params.h"
 # include "virmdev.h"
 # include "virchrdev.h"
+# include "virprocess.h"
 # include "virobject.h"
 # include "logging/log_manager.h"
 
@@ -125,9 +128,29 @@ typedef enum {
     QEMU_DOMAIN_JOB_STATS_TYPE_MIGRATION,
     QEMU_DOMAIN_JOB_STATS_TYPE_SAVEDUMP,
     QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP,
+    QEMU_DOMAIN_JOB_STATS_TYPE_START,
 } qemuDomainJobStatsType;
 
 
+/* Phases of qemuProcessStart, in the order they run */
+typedef enum {
+    QEMU_DOMAIN_JOB_START_PHASE_INIT = 0,
+    QEMU_DOMAIN_JOB_START_PHASE_PREPARE_DOMAIN,
+    QEMU_DOMAIN_JOB_START_PHASE_PREPARE_HOST,
+    QEMU_DOMAIN_JOB_START_PHASE_LAUNCH,
+    QEMU_DOMAIN_JOB_START_PHASE_MONITOR,
+    QEMU_DOMAIN_JOB_START_PHASE_FINISH,
+
+    QEMU_DOMAIN_JOB_START_PHASE_LAST
+} qemuDomainJobStartPhase;
+
+typedef struct _qemuDomainJobStartStats qemuDomainJobStartStats;
+struct _qemuDomainJobStartStats {
+    unsigned long long mark; /* When the current phase began */
+    unsigned long long phases[QEMU_DOMAIN_JOB_START_PHASE_LAST]; /* ms */
+};
+
+
 typedef struct _qemuDomainMirrorStats qemuDomainMirrorStats;
 typedef qemuDomainMirrorStats *qemuDomainMirrorStatsPtr;
 struct _qemuDomainMirrorStats {
@@ -156,9 +179,12 @@ struct _qemuDomainJobInfo {
     bool timeDeltaSet;
     /* Raw values from QEMU */
     qemuDomainJobStatsType statsType;
+    unsigned long long statsFetched; /* When stats were last fetched from
+                                        QEMU, 0 if they are outdated. */
     union {
         qemuMonitorMigrationStats mig;
         qemuMonitorDumpStats dump;
+        qemuDomainJobStartStats start;
     } stats;
     qemuDomainMirrorStats mirrorStats;
 };
@@ -180,6 +206,10 @@ struct _qemuDomainJobObj {
     const char *agentOwnerAPI;          /* The API which owns the agent job */
     unsigned long long agentStarted;    /* When the current agent job started */
 
+    /* The following members are for shared QEMU_JOB_QUERY jobs */
+    unsigned int nshared;               /* Number of running shared jobs */
+    unsigned int nwaiting;              /* Threads waiting for a QEMU_JOB_* */
+
     /* The following members are for QEMU_ASYNC_JOB_* */
     virCond asyncCond;                  /* Use to coordinate with async jobs */
     qemuDomainAsyncJob asyncJob;        /* Currently active async job */
@@ -201,6 +231,31 @@ struct _qemuDomainJobObj {
     unsigned long apiFlags; /* flags passed to the API which started the async job */
 };
 
+typedef struct _qemuDomainJobAcctCounter qemuDomainJobAcctCounter;
+typedef qemuDomainJobAcctCounter *qemuDomainJobAcctCounterPtr;
+struct _qemuDomainJobAcctCounter {
+    unsigned long long count;           /* Number of finished jobs */
+    unsigned long long time;            /* Milliseconds the jobs were held */
+};
+
+/* Cumulative job and monitor accounting kept for the lifetime of the
+ * domain object, all times are in milliseconds */
+typedef struct _qemuDomainJobAcct qemuDomainJobAcct;
+typedef qemuDomainJobAcct *qemuDomainJobAcctPtr;
+struct _qemuDomainJobAcct {
+    unsigned long long waits;           /* Jobs acquired */
+    unsigned long long waitTime;        /* Time spent acquiring jobs */
+    unsigned long long timeouts;        /* Jobs which could not be acquired */
+
+    qemuDomainJobAcctCounter job[QEMU_JOB_LAST];
+    qemuDomainJobAcctCounter agentJob[QEMU_AGENT_JOB_LAST];
+    qemuDomainJobAcctCounter asyncJob[QEMU_ASYNC_JOB_LAST];
+    unsigned long long sharedStarted;   /* When the first shared job started */
+
+    unsigned long long monCalls;        /* Monitor round trips */
+    unsigned long long monTime;         /* Time the monitor was in use */
+};
+
 typedef void (*qemuDomainCleanupCallback)(virQEMUDriverPtr driver,
                                           virDomainObjPtr vm);
 
@@ -268,12 +323,17 @@ struct _qemuDomainSecretInfo {
     } s;
 };
 
+/* Statistics recently gathered for a running domain, see stats_cache_ms */
+typedef struct _qemuDomainStatsCache qemuDomainStatsCache;
+typedef qemuDomainStatsCache *qemuDomainStatsCachePtr;
+
 typedef struct _qemuDomainObjPrivate qemuDomainObjPrivate;
 typedef qemuDomainObjPrivate *qemuDomainObjPrivatePtr;
 struct _qemuDomainObjPrivate {
     virQEMUDriverPtr driver;
 
     qemuDomainJobObj job;
+    qemuDomainJobAcct jobAcct;
 
     virBitmapPtr namespaces;
 
@@ -282,6 +342,7 @@ struct _qemuDomainObjPrivate {
     bool monJSON;
     bool monError;
     unsigned long long monStart;
+    unsigned int monUsers;              /* Threads in the monitor */
 
     qemuAgentPtr agent;
     bool agentError;
@@ -317,6 +378,25 @@ struct _qemuDomainObjPrivate {
 
     virPerfPtr perf;
 
+    /* resctrl monitoring groups: [0] monitors the threads not covered by
+     * any <cachetune>, [i + 1] the vCPUs of def->resctrls[i]. Items are
+     * NULL where no group exists. */
+    virResctrlMonitorPtr *resctrlMonitors;
+    size_t nresctrlMonitors;
+
+    /* KVM debugfs directory of the domain, looked up once the vCPU
+     * counters are first needed */
+    char *kvmDebugfsDir;
+    bool kvmDebugfsChecked;
+
+    qemuDomainStatsCachePtr statsCache;
+
+    /* guest memory stats last read from the balloon, still current until
+     * balloonStatsExpiry (ms since epoch, 0 if they aren't) */
+    virDomainMemoryStatStruct balloonStats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int nballoonStats;
+    unsigned long long balloonStatsExpiry;
+
     qemuDomainUnpluggingDevice unplug;
 
     char **qemuDevices; /* NULL-terminated list of devices aliases known to QEMU */
@@ -327,6 +407,10 @@ struct _qemuDomainObjPrivate {
     virBitmapPtr autoNodeset;
     virBitmapPtr autoCpuset;
 
+    /* host CPUs not dedicated to any domain, set for domains with the
+     * dedicated cputune profile */
+    virBitmapPtr housekeepingCPUs;
+
     bool signalIOError; /* true if the domain condition should be signalled on
                            I/O error */
     bool signalStop; /* true if the domain condition should be signalled on
@@ -343,6 +427,14 @@ struct _qemuDomainObjPrivate {
     /* note whether memory device alias does not correspond to slot number */
     bool memAliasOrderMismatch;
 
+    /* waiting to be reconnected on daemon start, no job can be started */
+    bool reconnectPending;
+
+    /* sequence number of the last status journal entry and the number
+     * of entries written since the status XML was last saved */
+    unsigned long long journalSeq;
+    unsigned int journalEntries;
+
     /* for migrations using TLS with a secret (not to be saved in our */
     /* private XML). */
     qemuDomainSecretInfoPtr migSecinfo;
@@ -370,6 +462,13 @@ struct _qemuDomainObjPrivate {
     /* qemuProcessStartCPUs stores the reason for starting vCPUs here for the
      * RESUME event handler to use it */
     virDomainRunningReason runningReason;
+
+    /* true once the snapshot metadata was read from the snapshot
+     * directory, see qemuDomainSnapshotLoadIfNeeded */
+    bool snapshotsLoaded;
+
+    /* cached /proc/<pid>/stat of the qemu process */
+    virProcessStatFile statFile;
 };
 
 # define QEMU_DOMAIN_PRIVATE(vm) \
@@ -394,6 +493,11 @@ struct _qemuDomainDiskPrivate {
     char *blockJobError; /* block job completed event error */
     bool blockJobSync; /* the block job needs synchronized termination */
 
+    /* block job state tracked from events, see qemuBlockJobGetInfo */
+    int blockJobState; /* qemuBlockJobState */
+    qemuMonitorBlockJobInfo blockJobInfo; /* last progress read from qemu */
+    unsigned long long blockJobInfoTime; /* when blockJobInfo was read, 0 if never */
+
     bool migrating; /* the disk is being migrated */
     virStorageSourcePtr migrSource; /* disk source object used for NBD migration */
 
@@ -422,6 +526,25 @@ struct _qemuDomainStorageSourcePrivate {
 
 virObjectPtr qemuDomainStorageSourcePrivateNew(void);
 
+/* Per vCPU counters KVM exposes in debugfs */
+typedef enum {
+    QEMU_DOMAIN_VCPU_KVM_STAT_EXITS = 0,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_EXITS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_SUCCESSFUL_POLL,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_ATTEMPTED_POLL,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_POLL_INVALID,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_WAKEUP,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_POLL_SUCCESS_NS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_HALT_POLL_FAIL_NS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_IRQ_EXITS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_IO_EXITS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_MMIO_EXITS,
+    QEMU_DOMAIN_VCPU_KVM_STAT_SIGNAL_EXITS,
+
+    QEMU_DOMAIN_VCPU_KVM_STAT_LAST
+} qemuDomainVcpuKVMStat;
+VIR_ENUM_DECL(qemuDomainVcpuKVMStat)
+
 typedef struct _qemuDomainVcpuPrivate qemuDomainVcpuPrivate;
 typedef qemuDomainVcpuPrivate *qemuDomainVcpuPrivatePtr;
 struct _qemuDomainVcpuPrivate {
@@ -433,6 +556,19 @@ struct _qemuDomainVcpuPrivate {
     char *alias;
     virTristateBool halted;
 
+    /* cached /proc stat files of the vcpu thread */
+    virProcessStatFile statFile;
+    virProcessStatFile schedFile;
+    virProcessStatFile schedstatFile;
+
+    /* cached descriptors of the KVM debugfs counters of the vcpu, -1 for
+     * those not available; see qemuDomainVcpuOpenKVMStats */
+    int kvmStatFds[QEMU_DOMAIN_VCPU_KVM_STAT_LAST];
+    bool kvmStatsOpened;
+
+    /* perf events of the vcpu thread, see perf_vcpu_events in qemu.conf */
+    virPerfPtr perf;
+
     /* information for hotpluggable cpus */
     char *type;
     int socket_id;
@@ -445,6 +581,13 @@ struct _qemuDomainVcpuPrivate {
 # define QEMU_DOMAIN_VCPU_PRIVATE(vcpu) \
     ((qemuDomainVcpuPrivatePtr) (vcpu)->privateData)
 
+void qemuDomainVcpuOpenKVMStats(virDomainObjPtr vm,
+                                unsigned int vcpuid);
+void qemuDomainVcpuCloseKVMStats(qemuDomainVcpuPrivatePtr vcpupriv);
+int qemuDomainVcpuReadKVMStat(qemuDomainVcpuPrivatePtr vcpupriv,
+                              qemuDomainVcpuKVMStat stat,
+                              unsigned long long *value);
+
 
 struct qemuDomainDiskInfo {
     bool removable;
@@ -551,10 +694,14 @@ int qemuDomainObjBeginJobNowait(virQEMUDriverPtr driver,
                                 virDomainObjPtr obj,
                                 qemuDomainJob job)
     ATTRIBUTE_RETURN_CHECK;
+int qemuDomainObjBeginSharedJob(virQEMUDriverPtr driver,
+                                virDomainObjPtr obj)
+    ATTRIBUTE_RETURN_CHECK;
 
 void qemuDomainObjEndJob(virQEMUDriverPtr driver,
                          virDomainObjPtr obj);
 void qemuDomainObjEndAgentJob(virDomainObjPtr obj);
+void qemuDomainObjEndSharedJob(virDomainObjPtr obj);
 void qemuDomainObjEndJobWithAgent(virQEMUDriverPtr driver,
                                   virDomainObjPtr obj);
 void qemuDomainObjEndAsyncJob(virQEMUDriverPtr driver,
@@ -565,6 +712,11 @@ void qemuDomainObjSetJobPhase(virQEMUDriverPtr driver,
                               int phase);
 void qemuDomainObjSetAsyncJobMask(virDomainObjPtr obj,
                                   unsigned long long allowedJobs);
+int qemuDomainStatusJournalReplay(virQEMUDriverPtr driver,
+                                  virDomainObjPtr vm);
+void qemuDomainStatusJournalRemove(virQEMUDriverPtr driver,
+                                   virDomainObjPtr vm);
+
 void qemuDomainObjRestoreJob(virDomainObjPtr obj,
                              qemuDomainJobObjPtr job);
 void qemuDomainObjDiscardAsyncJob(virQEMUDriverPtr driver,
@@ -673,6 +825,8 @@ int qemuDomainSnapshotWriteMetadata(virDomainObjPtr vm,
                                     virDomainXMLOptionPtr xmlopt,
                                     char *snapshotDir);
 
+int qemuDomainSnapshotLoadIfNeeded(virDomainObjPtr vm);
+
 int qemuDomainSnapshotForEachQcow2(virQEMUDriverPtr driver,
                                    virDomainObjPtr vm,
                                    virDomainSnapshotObjPtr snap,
@@ -702,6 +856,18 @@ int qemuDomainSnapshotDiscardAll(void *payload,
 int qemuDomainSnapshotDiscardAllMetadata(virQEMUDriverPtr driver,
                                          virDomainObjPtr vm);
 
+int qemuDomainCheckpointWriteMetadata(virDomainObjPtr vm,
+                                      virDomainCheckpointDefPtr def,
+                                      const char *checkpointDir);
+
+int qemuDomainCheckpointDiscard(virQEMUDriverPtr driver,
+                                virDomainObjPtr vm,
+                                virDomainCheckpointDefPtr def,
+                                bool metadata_only);
+
+int qemuDomainCheckpointDiscardAllMetadata(virQEMUDriverPtr driver,
+                                           virDomainObjPtr vm);
+
 void qemuDomainRemoveInactive(virQEMUDriverPtr driver,
                               virDomainObjPtr vm);
 
@@ -731,6 +897,15 @@ int qemuDomainDetermineDiskChain(virQEMUDriverPtr driver,
                                  virDomainObjPtr vm,
                                  virDomainDiskDefPtr disk,
                                  bool report_broken);
+int qemuDomainDetermineDiskChainProbe(virQEMUDriverPtr driver,
+                                      virDomainObjPtr vm,
+                                      virDomainDiskDefPtr disk,
+                                      bool report_broken,
+                                      virStorageSourcePtr *detected);
+int qemuDomainDetermineDiskChainFinish(virQEMUDriverPtr driver,
+                                       virDomainObjPtr vm,
+                                       virDomainDiskDefPtr disk,
+                                       virStorageSourcePtr detected);
 
 bool qemuDomainDiskChangeSupported(virDomainDiskDefPtr disk,
                                    virDomainDiskDefPtr orig_disk);
@@ -793,6 +968,9 @@ int qemuDomainJobInfoUpdateTime(qemuDomainJobInfoPtr jobInfo)
     ATTRIBUTE_NONNULL(1);
 int qemuDomainJobInfoUpdateDowntime(qemuDomainJobInfoPtr jobInfo)
     ATTRIBUTE_NONNULL(1);
+bool qemuDomainJobInfoEstimateConvergence(qemuDomainJobInfoPtr jobInfo,
+                                          unsigned long long *remaining)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 int qemuDomainJobInfoToInfo(qemuDomainJobInfoPtr jobInfo,
                             virDomainJobInfoPtr info)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
@@ -1092,4 +1270,47 @@ qemuDomainRunningReasonToResumeEvent(virDomainRunningReason reason);
 bool
 qemuDomainIsUsingNoShutdown(qemuDomainObjPrivatePtr priv);
 
+virHashTablePtr
+qemuDomainStatsCacheGetBlock(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             bool backing,
+                             int *nstats);
+void
+qemuDomainStatsCacheSetBlock(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             virHashTablePtr stats,
+                             bool backing,
+                             int nstats);
+int
+qemuDomainStatsCacheGetMemory(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              unsigned int nr_stats);
+void
+qemuDomainStatsCacheSetMemory(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              int nstats);
+int
+qemuDomainStatsCacheGetInterface(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats);
+void
+qemuDomainStatsCacheSetInterface(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats);
+
+int
+qemuDomainBalloonStatsGet(virDomainObjPtr vm,
+                          virDomainMemoryStatPtr stats,
+                          unsigned int nr_stats);
+void
+qemuDomainBalloonStatsSet(virDomainObjPtr vm,
+                          virDomainMemoryStatPtr stats,
+                          int nstats);
+void
+qemuDomainBalloonStatsInvalidate(virDomainObjPtr vm);
+
 #endif /* __QEMU_DOMAIN_H__ */
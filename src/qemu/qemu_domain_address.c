@@ -2935,6 +2935,110 @@ qemuDomainAssignUSBAddresses(virDomainDefPtr def,
 }
 
 
+static bool
+qemuDomainDiskNeedsIOThread(virDomainDiskDefPtr disk)
+{
+    return disk->bus == VIR_DOMAIN_DISK_BUS_VIRTIO &&
+           !disk->iothread &&
+           (disk->info.type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_PCI ||
+            disk->info.type == VIR_DOMAIN_DEVICE_ADDRESS_TYPE_CCW);
+}
+
+
+/**
+ * qemuDomainAssignDiskIOThread:
+ * @def: domain definition
+ * @disk: disk definition, not necessarily part of @def yet
+ * @qemuCaps: QEMU capabilities, may be NULL
+ *
+ * If automatic IOThread assignment is requested for @def, assign the
+ * IOThread serving the fewest disks of @def to @disk, provided it is a
+ * virtio disk with an address already assigned and no IOThread of its
+ * own. Unless set, the number of queues of @disk is set to the number of
+ * vCPUs as well.
+ */
+void
+qemuDomainAssignDiskIOThread(virDomainDefPtr def,
+                             virDomainDiskDefPtr disk,
+                             virQEMUCapsPtr qemuCaps)
+{
+    unsigned int iothread = 0;
+    size_t best = 0;
+    size_t i;
+    size_t j;
+
+    if (!def->iothreadsAuto ||
+        def->niothreadids == 0 ||
+        !qemuCaps ||
+        !virQEMUCapsGet(qemuCaps, QEMU_CAPS_OBJECT_IOTHREAD) ||
+        !qemuDomainDiskNeedsIOThread(disk))
+        return;
+
+    for (i = 0; i < def->niothreadids; i++) {
+        unsigned int id = def->iothreadids[i]->iothread_id;
+        size_t ndisks = 0;
+
+        for (j = 0; j < def->ndisks; j++) {
+            if (def->disks[j] != disk && def->disks[j]->iothread == id)
+                ndisks++;
+        }
+
+        if (!iothread || ndisks < best) {
+            iothread = id;
+            best = ndisks;
+        }
+    }
+
+    VIR_DEBUG("assigning iothread %u to disk %s", iothread, disk->dst);
+    disk->iothread = iothread;
+
+    if (!disk->queues &&
+        virQEMUCapsGet(qemuCaps, QEMU_CAPS_VIRTIO_BLK_NUM_QUEUES))
+        disk->queues = virDomainDefGetVcpusMax(def);
+}
+
+
+static int
+qemuDomainAssignIOThreads(virDomainDefPtr def,
+                          virQEMUCapsPtr qemuCaps)
+{
+    unsigned int iothreads = 0;
+    size_t i;
+
+    if (!def->iothreadsAuto ||
+        !virQEMUCapsGet(qemuCaps, QEMU_CAPS_OBJECT_IOTHREAD))
+        return 0;
+
+    switch ((virDomainIOThreadsAuto) def->iothreadsAuto) {
+    case VIR_DOMAIN_IOTHREADS_AUTO_PER_DISK:
+        /* disks already assigned to an iothread keep theirs */
+        for (i = 0; i < def->ndisks; i++) {
+            if (qemuDomainDiskNeedsIOThread(def->disks[i]))
+                iothreads++;
+        }
+        iothreads += def->niothreadids;
+        break;
+
+    case VIR_DOMAIN_IOTHREADS_AUTO_SHARED:
+        iothreads = 1;
+        break;
+
+    case VIR_DOMAIN_IOTHREADS_AUTO_NONE:
+    case VIR_DOMAIN_IOTHREADS_AUTO_LAST:
+        break;
+    }
+
+    if (iothreads > def->niothreadids &&
+        virDomainIOThreadIDDefArrayInit(def, iothreads) < 0)
+        return -1;
+
+    for (i = 0; i < def->ndisks; i++)
+        qemuDomainAssignDiskIOThread(def, def->disks[i], qemuCaps);
+
+    return 0;
+}
+
+
 int
 qemuDomainAssignAddresses(virDomainDefPtr def,
                           virQEMUCapsPtr qemuCaps,
@@ -2962,6 +3066,9 @@ qemuDomainAssignAddresses(virDomainDefPtr def,
     if (qemuDomainAssignMemorySlots(def) < 0)
         return -1;
 
+    if (qemuDomainAssignIOThreads(def, qemuCaps) < 0)
+        return -1;
+
     return 0;
 }
 
@@ -46,6 +46,11 @@ int qemuDomainAssignAddresses(virDomainDefPtr def,
                               bool newDomain)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
 
+void qemuDomainAssignDiskIOThread(virDomainDefPtr def,
+                                  virDomainDiskDefPtr disk,
+                                  virQEMUCapsPtr qemuCaps)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 int qemuDomainEnsurePCIAddress(virDomainObjPtr obj,
                                virDomainDeviceDefPtr dev,
                                virQEMUDriverPtr driver)
@@ -53,6 +53,7 @@
 #include "qemu_process.h"
 #include "qemu_migration.h"
 #include "qemu_migration_params.h"
+#include "qemu_numa.h"
 #include "qemu_blockjob.h"
 #include "qemu_security.h"
 
@@ -70,6 +71,7 @@
 #include "viruuid.h"
 #include "domain_conf.h"
 #include "domain_audit.h"
+#include "backup_conf.h"
 #include "node_device_conf.h"
 #include "virpci.h"
 #include "virusb.h"
@@ -133,6 +135,8 @@ VIR_LOG_INIT("qemu.qemu_driver");
 
 static void qemuProcessEventHandler(void *data, void *opaque);
 
+static void qemuDomainGetStatsJobHandler(void *data, void *opaque);
+
 static int qemuStateCleanup(void);
 
 static int qemuDomainObjStart(virConnectPtr conn,
@@ -156,6 +160,12 @@ static int qemuGetDHCPInterfaces(virDomainPtr dom,
 static int qemuARPGetInterfaces(virDomainObjPtr vm,
                                 virDomainInterfacePtr **ifaces);
 
+static qemuDomainStatsSubsPtr qemuDomainStatsSubsNew(void);
+static void qemuDomainStatsSubsStop(qemuDomainStatsSubsPtr subs);
+static void qemuDomainStatsPressureWatch(virQEMUDriverPtr driver,
+                                         virDomainObjPtr vm,
+                                         unsigned int resources);
+
 static virQEMUDriverPtr qemu_driver;
 
 /**
@@ -187,13 +197,31 @@ qemuDomObjFromDomain(virDomainPtr domain)
     return vm;
 }
 
+/* Same as qemuDomObjFromDomain, but also makes sure the snapshot
+ * metadata of the domain was loaded from disk. */
+static virDomainObjPtr
+qemuDomObjFromDomainSnapshots(virDomainPtr domain)
+{
+    virDomainObjPtr vm;
+
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        return NULL;
+
+    if (qemuDomainSnapshotLoadIfNeeded(vm) < 0) {
+        virDomainObjEndAPI(&vm);
+        return NULL;
+    }
+
+    return vm;
+}
+
 /* Looks up the domain object from snapshot and unlocks the
  * driver. The returned domain object is locked and ref'd and the
  * caller must call virDomainObjEndAPI() on it. */
 static virDomainObjPtr
 qemuDomObjFromSnapshot(virDomainSnapshotPtr snapshot)
 {
-    return qemuDomObjFromDomain(snapshot->domain);
+    return qemuDomObjFromDomainSnapshots(snapshot->domain);
 }
 
 
@@ -238,6 +266,13 @@ qemuAutostartDomain(virDomainObjPtr vm,
     virResetLastError();
     if (vm->autostart &&
         !virDomainObjIsActive(vm)) {
+        if (virDomainObjListLoadDef(driver->domains, vm) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to load config of VM '%s': %s"),
+                           vm->def->name, virGetLastErrorMessage());
+            goto cleanup;
+        }
+
         if (qemuProcessBeginJob(driver, vm,
                                 VIR_DOMAIN_JOB_OPERATION_START, flags) < 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -267,7 +302,11 @@ qemuAutostartDomain(virDomainObjPtr vm,
 static void
 qemuAutostartDomains(virQEMUDriverPtr driver)
 {
-    virDomainObjListForEach(driver->domains, qemuAutostartDomain, driver);
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+
+    virDomainObjListForEachAutostart(driver->domains, cfg->autoStartParallel,
+                                     qemuAutostartDomain, driver);
+    virObjectUnref(cfg);
 }
 
 
@@ -411,84 +450,60 @@ qemuSecurityInit(virQEMUDriverPtr driver)
 
 
 static int
-qemuDomainSnapshotLoad(virDomainObjPtr vm,
-                       void *data)
+qemuDomainCheckpointLoad(virDomainObjPtr vm,
+                         void *data)
 {
     char *baseDir = (char *)data;
-    char *snapDir = NULL;
+    char *chkDir = NULL;
     DIR *dir = NULL;
     struct dirent *entry;
     char *xmlStr;
     char *fullpath;
-    virDomainSnapshotDefPtr def = NULL;
-    virDomainSnapshotObjPtr snap = NULL;
-    virDomainSnapshotObjPtr current = NULL;
-    unsigned int flags = (VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE |
-                          VIR_DOMAIN_SNAPSHOT_PARSE_DISKS |
-                          VIR_DOMAIN_SNAPSHOT_PARSE_INTERNAL);
+    virDomainCheckpointDefPtr def = NULL;
     int ret = -1;
-    virCapsPtr caps = NULL;
     int direrr;
 
     virObjectLock(vm);
-    if (virAsprintf(&snapDir, "%s/%s", baseDir, vm->def->name) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to allocate memory for "
-                       "snapshot directory for domain %s"),
-                       vm->def->name);
-        goto cleanup;
-    }
-
-    if (!(caps = virQEMUDriverGetCapabilities(qemu_driver, false)))
+    if (virAsprintf(&chkDir, "%s/%s", baseDir, vm->def->name) < 0)
         goto cleanup;
 
-    VIR_INFO("Scanning for snapshots for domain %s in %s", vm->def->name,
-             snapDir);
+    VIR_INFO("Scanning for checkpoints for domain %s in %s", vm->def->name,
+             chkDir);
 
-    if (virDirOpenIfExists(&dir, snapDir) <= 0)
+    if (virDirOpenIfExists(&dir, chkDir) <= 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &entry, NULL)) > 0) {
         /* NB: ignoring errors, so one malformed config doesn't
            kill the whole process */
-        VIR_INFO("Loading snapshot file '%s'", entry->d_name);
+        VIR_INFO("Loading checkpoint file '%s'", entry->d_name);
 
-        if (virAsprintf(&fullpath, "%s/%s", snapDir, entry->d_name) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Failed to allocate memory for path"));
+        if (virAsprintf(&fullpath, "%s/%s", chkDir, entry->d_name) < 0)
             continue;
-        }
 
         if (virFileReadAll(fullpath, 1024*1024*1, &xmlStr) < 0) {
             /* Nothing we can do here, skip this one */
             virReportSystemError(errno,
-                                 _("Failed to read snapshot file %s"),
+                                 _("Failed to read checkpoint file %s"),
                                  fullpath);
             VIR_FREE(fullpath);
             continue;
         }
 
-        def = virDomainSnapshotDefParseString(xmlStr, caps,
-                                              qemu_driver->xmlopt,
-                                              flags);
+        def = virDomainCheckpointDefParseString(xmlStr,
+                                                VIR_DOMAIN_CHECKPOINT_PARSE_REDEFINE);
         if (def == NULL) {
             /* Nothing we can do here, skip this one */
             virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("Failed to parse snapshot XML from file '%s'"),
+                           _("Failed to parse checkpoint XML from file '%s'"),
                            fullpath);
             VIR_FREE(fullpath);
             VIR_FREE(xmlStr);
             continue;
         }
 
-        snap = virDomainSnapshotAssignDef(vm->snapshots, def);
-        if (snap == NULL) {
-            virDomainSnapshotDefFree(def);
-        } else if (snap->def->current) {
-            current = snap;
-            if (!vm->current_snapshot)
-                vm->current_snapshot = snap;
-        }
+        if (virDomainCheckpointAssignDef(vm->checkpoints, def) < 0)
+            virDomainCheckpointDefFree(def);
 
         VIR_FREE(fullpath);
         VIR_FREE(xmlStr);
@@ -496,36 +511,14 @@ qemuDomainSnapshotLoad(virDomainObjPtr vm,
     if (direrr < 0)
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to fully read directory %s"),
-                       snapDir);
-
-    if (vm->current_snapshot != current) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Too many snapshots claiming to be current for domain %s"),
-                       vm->def->name);
-        vm->current_snapshot = NULL;
-    }
-
-    if (virDomainSnapshotUpdateRelations(vm->snapshots) < 0)
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Snapshots have inconsistent relations for domain %s"),
-                       vm->def->name);
-
-    /* FIXME: qemu keeps internal track of snapshots.  We can get access
-     * to this info via the "info snapshots" monitor command for running
-     * domains, or via "qemu-img snapshot -l" for shutoff domains.  It would
-     * be nice to update our internal state based on that, but there is a
-     * a problem.  qemu doesn't track all of the same metadata that we do.
-     * In particular we wouldn't be able to fill in the <parent>, which is
-     * pretty important in our metadata.
-     */
+                       chkDir);
 
     virResetLastError();
 
     ret = 0;
  cleanup:
     VIR_DIR_CLOSE(dir);
-    VIR_FREE(snapDir);
-    virObjectUnref(caps);
+    VIR_FREE(chkDir);
     virObjectUnlock(vm);
     return ret;
 }
@@ -616,6 +609,12 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->domainEventState)
         goto error;
 
+    if (!(qemu_driver->statsSubs = qemuDomainStatsSubsNew()))
+        goto error;
+
+    if (!(qemu_driver->migrationConns = qemuMigrationConnPoolNew()))
+        goto error;
+
     /* read the host sysinfo */
     if (privileged)
         qemu_driver->hostsysinfo = virSysinfoRead();
@@ -658,6 +657,11 @@ qemuStateInitialize(bool privileged,
                              cfg->snapshotDir);
         goto error;
     }
+    if (virFileMakePath(cfg->checkpointDir) < 0) {
+        virReportSystemError(errno, _("Failed to create checkpoint dir %s"),
+                             cfg->checkpointDir);
+        goto error;
+    }
     if (virFileMakePath(cfg->autoDumpPath) < 0) {
         virReportSystemError(errno, _("Failed to create dump dir %s"),
                              cfg->autoDumpPath);
@@ -731,6 +735,9 @@ qemuStateInitialize(bool privileged,
     if (!(qemu_driver->sharedDevices = virHashCreate(30, qemuSharedDeviceEntryFree)))
         goto error;
 
+    if (!(qemu_driver->dedicatedCPUs = virHashCreate(30, qemuDedicatedCPUsEntryFree)))
+        goto error;
+
     if (qemuMigrationDstErrorInit(qemu_driver) < 0)
         goto error;
 
@@ -765,6 +772,13 @@ qemuStateInitialize(bool privileged,
                                  (int)cfg->group);
             goto error;
         }
+        if (chown(cfg->checkpointDir, cfg->user, cfg->group) < 0) {
+            virReportSystemError(errno,
+                                 _("unable to set ownership of '%s' to %d:%d"),
+                                 cfg->checkpointDir, (int)cfg->user,
+                                 (int)cfg->group);
+            goto error;
+        }
         if (chown(cfg->autoDumpPath, cfg->user, cfg->group) < 0) {
             virReportSystemError(errno,
                                  _("unable to set ownership of '%s' to %d:%d"),
@@ -891,6 +905,13 @@ qemuStateInitialize(bool privileged,
                             NULL);
 
     /* Then inactive persistent configs */
+    if (virDomainObjListSetLazyLoad(qemu_driver->domains,
+                                    cfg->configDir,
+                                    qemu_driver->caps,
+                                    qemu_driver->xmlopt,
+                                    cfg->maxInactiveDefs) < 0)
+        goto error;
+
     if (virDomainObjListLoadAllConfigs(qemu_driver->domains,
                                        cfg->configDir,
                                        cfg->autostartDir, false,
@@ -900,8 +921,8 @@ qemuStateInitialize(bool privileged,
         goto error;
 
     virDomainObjListForEach(qemu_driver->domains,
-                            qemuDomainSnapshotLoad,
-                            cfg->snapshotDir);
+                            qemuDomainCheckpointLoad,
+                            cfg->checkpointDir);
 
     virDomainObjListForEach(qemu_driver->domains,
                             qemuDomainManagedSaveLoad,
@@ -914,8 +935,18 @@ qemuStateInitialize(bool privileged,
     if (!qemu_driver->workerPool)
         goto error;
 
+    if (cfg->maxStatsWorkers > 1 &&
+        !(qemu_driver->statsPool = virThreadPoolNew(0, cfg->maxStatsWorkers, 0,
+                                                    qemuDomainGetStatsJobHandler,
+                                                    qemu_driver)))
+        goto error;
+
     qemuProcessReconnectAll(qemu_driver);
 
+    if (cfg->numaRebalanceInterval &&
+        !(qemu_driver->numaBalancer = qemuNumaBalancerNew(qemu_driver)))
+        goto error;
+
     return 0;
 
  error:
@@ -1055,10 +1086,25 @@ qemuStateCleanup(void)
     if (!qemu_driver)
         return -1;
 
+    qemuNumaBalancerFree(qemu_driver->numaBalancer);
+
+    if (qemu_driver->statsSubs) {
+        qemuDomainStatsSubsStop(qemu_driver->statsSubs);
+        virObjectUnref(qemu_driver->statsSubs);
+    }
+
+    if (qemu_driver->migrationConns) {
+        qemuMigrationConnPoolClose(qemu_driver->migrationConns);
+        virObjectUnref(qemu_driver->migrationConns);
+    }
+
     virThreadPoolFree(qemu_driver->workerPool);
+    virThreadPoolFree(qemu_driver->statsPool);
+    virObjectUnref(qemu_driver->reconnectQueue);
     virObjectUnref(qemu_driver->config);
     virObjectUnref(qemu_driver->hostdevMgr);
     virHashFree(qemu_driver->sharedDevices);
+    virHashFree(qemu_driver->dedicatedCPUs);
     virObjectUnref(qemu_driver->caps);
     virObjectUnref(qemu_driver->qemuCapsCache);
 
@@ -1192,6 +1238,10 @@ qemuConnectSupportsFeature(virConnectPtr conn, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
+    case VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
     default:
         return 0;
     }
@@ -1293,9 +1343,10 @@ static char *qemuConnectGetCapabilities(virConnectPtr conn) {
 
 static int
 qemuGetSchedInfo(unsigned long long *cpuWait,
+                 virProcessStatFilePtr file,
                  pid_t pid, pid_t tid)
 {
-    char *proc = NULL;
+    virProcessStatFile tmpfile;
     char *data = NULL;
     char **lines = NULL;
     size_t i;
@@ -1304,24 +1355,25 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
 
     *cpuWait = 0;
 
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/sched", (int)pid, (int)tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/sched", (int)pid);
-    if (ret < 0)
-        goto cleanup;
-    ret = -1;
+    if (!file) {
+        virProcessStatFileInit(&tmpfile);
+        file = &tmpfile;
+    }
 
-    /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
-    if (access(proc, R_OK) < 0) {
-        ret = 0;
+    if (VIR_ALLOC_N(data, 1 << 16) < 0)
         goto cleanup;
-    }
 
-    if (virFileReadAll(proc, (1<<16), &data) < 0)
+    if (virProcessStatFileRead(file, pid, tid, "sched", data, 1 << 16) < 0) {
+        /* The file is not guaranteed to exist (needs CONFIG_SCHED_DEBUG) */
+        if (errno == ENOENT) {
+            ret = 0;
+        } else {
+            virReportSystemError(errno,
+                                 _("unable to read sched info of %d/%d"),
+                                 (int)pid, (int)tid);
+        }
         goto cleanup;
+    }
 
     lines = virStringSplit(data, "\n", 0);
     if (!lines)
@@ -1360,40 +1412,36 @@ qemuGetSchedInfo(unsigned long long *cpuWait,
     ret = 0;
 
  cleanup:
+    if (file == &tmpfile)
+        virProcessStatFileClose(&tmpfile);
     VIR_FREE(data);
-    VIR_FREE(proc);
     virStringListFree(lines);
     return ret;
 }
 
 
+/* @file caches the descriptor of the stat file across calls; NULL reads it
+ * with a descriptor that is closed right away. */
 static int
 qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
+                   virProcessStatFilePtr file,
                    pid_t pid, int tid)
 {
-    char *proc;
-    FILE *pidinfo;
+    virProcessStatFile tmpfile;
+    char data[1024];
     unsigned long long usertime = 0, systime = 0;
     long rss = 0;
     int cpu = 0;
-    int ret;
-
-    /* In general, we cannot assume pid_t fits in int; but /proc parsing
-     * is specific to Linux where int works fine.  */
-    if (tid)
-        ret = virAsprintf(&proc, "/proc/%d/task/%d/stat", (int)pid, tid);
-    else
-        ret = virAsprintf(&proc, "/proc/%d/stat", (int)pid);
-    if (ret < 0)
-        return -1;
 
-    pidinfo = fopen(proc, "r");
-    VIR_FREE(proc);
+    if (!file) {
+        virProcessStatFileInit(&tmpfile);
+        file = &tmpfile;
+    }
 
     /* See 'man proc' for information about what all these fields are. We're
      * only interested in a very few of them */
-    if (!pidinfo ||
-        fscanf(pidinfo,
+    if (virProcessStatFileRead(file, pid, tid, "stat", data, sizeof(data)) < 0 ||
+        sscanf(data,
                /* pid -> stime */
                "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu"
                /* cutime -> endcode */
@@ -1404,6 +1452,9 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
         VIR_WARN("cannot parse process status data");
     }
 
+    if (file == &tmpfile)
+        virProcessStatFileClose(&tmpfile);
+
     /* We got jiffies
      * We want nanoseconds
      * _SC_CLK_TCK is jiffies per second
@@ -1422,8 +1473,6 @@ qemuGetProcessInfo(unsigned long long *cpuTime, int *lastCpu, long *vm_rss,
     VIR_DEBUG("Got status for %d/%d user=%llu sys=%llu cpu=%d rss=%ld",
               (int)pid, tid, usertime, systime, cpu, rss);
 
-    VIR_FORCE_FCLOSE(pidinfo);
-
     return 0;
 }
 
@@ -1456,6 +1505,7 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
 
     for (i = 0; i < virDomainDefGetVcpusMax(vm->def) && ncpuinfo < maxinfo; i++) {
         virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
+        qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
         pid_t vcpupid = qemuDomainGetVcpuPid(vm, i);
         virVcpuInfoPtr vcpuinfo = info + ncpuinfo;
 
@@ -1468,6 +1518,7 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
 
             if (qemuGetProcessInfo(&vcpuinfo->cpuTime,
                                    &vcpuinfo->cpu, NULL,
+                                   &vcpupriv->statFile,
                                    vm->pid, vcpupid) < 0) {
                 virReportSystemError(errno, "%s",
                                      _("cannot get vCPU placement & pCPU time"));
@@ -1487,7 +1538,8 @@ qemuDomainHelperGetVcpus(virDomainObjPtr vm,
         }
 
         if (cpuwait) {
-            if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), vm->pid, vcpupid) < 0)
+            if (qemuGetSchedInfo(&(cpuwait[ncpuinfo]), &vcpupriv->schedFile,
+                                 vm->pid, vcpupid) < 0)
                 return -1;
         }
 
@@ -2460,6 +2512,7 @@ static int qemuDomainSetMemoryStatsPeriod(virDomainPtr dom, int period,
         }
 
         def->memballoon->period = period;
+        qemuDomainBalloonStatsInvalidate(vm);
         if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
             goto endjob;
     }
@@ -2620,7 +2673,9 @@ qemuDomainGetInfo(virDomainPtr dom,
     }
 
     if (virDomainObjIsActive(vm)) {
-        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL, vm->pid, 0) < 0) {
+        if (qemuGetProcessInfo(&(info->cpuTime), NULL, NULL,
+                               &QEMU_DOMAIN_PRIVATE(vm)->statFile,
+                               vm->pid, 0) < 0) {
             virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                            _("cannot read cputime for domain"));
             goto cleanup;
@@ -2742,6 +2797,7 @@ typedef enum {
      */
     QEMU_SAVE_FORMAT_XZ = 3,
     QEMU_SAVE_FORMAT_LZOP = 4,
+    QEMU_SAVE_FORMAT_ZSTD = 5,
     /* Note: add new members only at the end.
        These values are used in the on-disk format.
        Do not change or re-use numbers. */
@@ -2755,7 +2811,8 @@ VIR_ENUM_IMPL(qemuSaveCompression, QEMU_SAVE_FORMAT_LAST,
               "gzip",
               "bzip2",
               "xz",
-              "lzop")
+              "lzop",
+              "zstd")
 
 VIR_ENUM_DECL(qemuDumpFormat)
 VIR_ENUM_IMPL(qemuDumpFormat, VIR_DOMAIN_CORE_DUMP_FORMAT_LAST,
@@ -3700,10 +3757,15 @@ qemuDumpToFd(virQEMUDriverPtr driver,
              virDomainObjPtr vm,
              int fd,
              qemuDomainAsyncJob asyncJob,
-             const char *dumpformat)
+             const char *dumpformat,
+             const char *compressor)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
     bool detach = false;
+    int pipeFD[2] = { -1, -1 };
+    int qemufd = fd;
+    virCommandPtr cmd = NULL;
+    char *errbuf = NULL;
     int ret = -1;
 
     if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_GUEST_MEMORY)) {
@@ -3714,16 +3776,41 @@ qemuDumpToFd(virQEMUDriverPtr driver,
 
     detach = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DUMP_COMPLETED);
 
-    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
-        return -1;
+    if (compressor) {
+        if (pipe(pipeFD) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Failed to create pipe for dump"));
+            return -1;
+        }
+        qemufd = pipeFD[1];
+    }
+
+    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def,
+                                    qemufd) < 0)
+        goto cleanup;
 
     if (detach)
         priv->job.current->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_MEMDUMP;
     else
         VIR_FREE(priv->job.current);
 
+    /* QEMU writes the dump on a single thread, the compression is left
+     * to a program which can use all host CPUs instead */
+    if (compressor) {
+        cmd = qemuMigrationSrcCompressorNew(compressor, pipeFD[0], &fd,
+                                            &errbuf);
+        if (virSetCloseExec(pipeFD[1]) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to set cloexec flag"));
+            goto cleanup;
+        }
+        if (virCommandRunAsync(cmd, NULL) < 0)
+            goto cleanup;
+        VIR_FORCE_CLOSE(pipeFD[0]);
+    }
+
     if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
-        return -1;
+        goto cleanup;
 
     if (dumpformat) {
         ret = qemuMonitorGetDumpGuestMemoryCapability(priv->mon, dumpformat);
@@ -3739,15 +3826,33 @@ qemuDumpToFd(virQEMUDriverPtr driver,
         }
     }
 
-    ret = qemuMonitorDumpToFd(priv->mon, fd, dumpformat, detach);
+    ret = qemuMonitorDumpToFd(priv->mon, qemufd, dumpformat, detach);
 
-    if ((qemuDomainObjExitMonitor(driver, vm) < 0) || ret < 0)
+    if ((qemuDomainObjExitMonitor(driver, vm) < 0) || ret < 0) {
+        ret = -1;
         goto cleanup;
+    }
+
+    /* QEMU has its own copy, the compressor sees the end of the dump
+     * once QEMU closes it */
+    VIR_FORCE_CLOSE(pipeFD[1]);
 
     if (detach)
         ret = qemuDumpWaitForCompletion(vm);
 
+    if (ret == 0 && cmd && virCommandWait(cmd, NULL) < 0)
+        ret = -1;
+
  cleanup:
+    if (ret < 0 && cmd)
+        virCommandAbort(cmd);
+    VIR_FORCE_CLOSE(pipeFD[0]);
+    VIR_FORCE_CLOSE(pipeFD[1]);
+    if (cmd) {
+        VIR_DEBUG("Compression binary stderr: %s", NULLSTR(errbuf));
+        VIR_FREE(errbuf);
+        virCommandFree(cmd);
+    }
     return ret;
 }
 
@@ -3804,12 +3909,15 @@ doCoreDump(virQEMUDriverPtr driver,
             goto cleanup;
         }
 
-        /* qemu dumps in "elf" without dumpformat set */
+        /* qemu dumps in "elf" without dumpformat set, the kdump formats
+         * are compressed already */
         if (STREQ(memory_dump_format, "elf"))
             memory_dump_format = NULL;
+        else
+            VIR_FREE(compressedpath);
 
         ret = qemuDumpToFd(driver, vm, fd, QEMU_ASYNC_JOB_DUMP,
-                           memory_dump_format);
+                           memory_dump_format, compressedpath);
     } else {
         if (dumpformat != VIR_DOMAIN_CORE_DUMP_FORMAT_RAW) {
             virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
@@ -5029,6 +5137,13 @@ qemuDomainPinVcpuLive(virDomainObjPtr vm,
         goto cleanup;
     }
 
+    if (def->cputune.profile == VIR_DOMAIN_CPUTUNE_PROFILE_DEDICATED) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("cannot change pinning of vCPUs of a running "
+                         "domain with the 'dedicated' cputune profile"));
+        goto cleanup;
+    }
+
     if (!(tmpmap = virBitmapNewCopy(cpumap)))
         goto cleanup;
 
@@ -5498,7 +5613,7 @@ qemuDomainGetIOThreadsLive(virQEMUDriverPtr driver,
     size_t i;
     int ret = -1;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     if (!virDomainObjIsActive(vm)) {
@@ -5553,7 +5668,7 @@ qemuDomainGetIOThreadsLive(virQEMUDriverPtr driver,
     ret = niothreads;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
 
  cleanup:
     if (info_ret) {
@@ -7504,6 +7619,9 @@ qemuDomainUndefineFlags(virDomainPtr dom,
         goto endjob;
     }
 
+    if (qemuDomainSnapshotLoadIfNeeded(vm) < 0)
+        goto endjob;
+
     if (!virDomainObjIsActive(vm) &&
         (nsnapshots = virDomainSnapshotObjListNum(vm->snapshots, NULL, 0))) {
         if (!(flags & VIR_DOMAIN_UNDEFINE_SNAPSHOTS_METADATA)) {
@@ -8466,13 +8584,16 @@ qemuDomainUpdateDeviceConfig(virDomainDefPtr vmdef,
 static int
 qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
                                     virQEMUDriverPtr driver,
-                                    const char *xml,
+                                    const char **xmls,
+                                    size_t nxmls,
                                     unsigned int flags)
 {
     virDomainDefPtr vmdef = NULL;
     virQEMUDriverConfigPtr cfg = NULL;
     virDomainDeviceDefPtr devConf = NULL;
     virDomainDeviceDefPtr devLive = NULL;
+    size_t i;
+    int rc = 0;
     int ret = -1;
     virCapsPtr caps = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
@@ -8490,60 +8611,72 @@ qemuDomainAttachDeviceLiveAndConfig(virDomainObjPtr vm,
      * rely on the correct vm->def or vm->newDef being passed, so call the
      * device parse based on which definition is in use */
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt, NULL);
         if (!vmdef)
             goto cleanup;
 
-        if (!(devConf = virDomainDeviceDefParse(xml, vmdef, caps,
-                                                driver->xmlopt, parse_flags)))
-            goto cleanup;
+        for (i = 0; i < nxmls; i++) {
+            if (!(devConf = virDomainDeviceDefParse(xmls[i], vmdef, caps,
+                                                    driver->xmlopt,
+                                                    parse_flags)))
+                goto cleanup;
 
-        if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         false) < 0)
-            goto cleanup;
+            if (virDomainDefCompatibleDevice(vmdef, devConf, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             false) < 0)
+                goto cleanup;
 
-        if ((ret = qemuDomainAttachDeviceConfig(vmdef, devConf, caps,
-                                                parse_flags,
-                                                driver->xmlopt)) < 0)
-            goto cleanup;
+            if (qemuDomainAttachDeviceConfig(vmdef, devConf, caps,
+                                             parse_flags,
+                                             driver->xmlopt) < 0)
+                goto cleanup;
+
+            virDomainDeviceDefFree(devConf);
+            devConf = NULL;
+        }
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
-        if (!(devLive = virDomainDeviceDefParse(xml, vm->def, caps,
-                                                driver->xmlopt, parse_flags)))
-            goto cleanup;
-
-        if (virDomainDeviceValidateAliasForHotplug(vm, devLive, flags) < 0)
-            goto cleanup;
+        for (i = 0; i < nxmls && rc == 0; i++) {
+            if (!(devLive = virDomainDeviceDefParse(xmls[i], vm->def, caps,
+                                                    driver->xmlopt,
+                                                    parse_flags)) ||
+                virDomainDeviceValidateAliasForHotplug(vm, devLive, flags) < 0 ||
+                virDomainDefCompatibleDevice(vm->def, devLive, NULL,
+                                             VIR_DOMAIN_DEVICE_ACTION_ATTACH,
+                                             true) < 0 ||
+                qemuDomainAttachDeviceLive(vm, devLive, driver) < 0)
+                rc = -1;
 
-        if (virDomainDefCompatibleDevice(vm->def, devLive, NULL,
-                                         VIR_DOMAIN_DEVICE_ACTION_ATTACH,
-                                         true) < 0)
-            goto cleanup;
+            virDomainDeviceDefFree(devLive);
+            devLive = NULL;
+        }
 
-        if ((ret = qemuDomainAttachDeviceLive(vm, devLive, driver)) < 0)
-            goto cleanup;
         /*
          * update domain status forcibly because the domain status may be
          * changed even if we failed to attach the device. For example,
-         * a new controller may be created.
+         * a new controller may be created. Only once for all the devices
+         * which got attached, though.
          */
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
-            ret = -1;
+        if ((rc == 0 || i > 1) &&
+            virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+            goto cleanup;
+
+        if (rc < 0)
             goto cleanup;
-        }
     }
 
     /* Finally, if no error until here, we can save config. */
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
-        ret = virDomainSaveConfig(cfg->configDir, driver->caps, vmdef);
-        if (!ret) {
-            virDomainObjAssignDef(vm, vmdef, false, NULL);
-            vmdef = NULL;
-        }
+        if (virDomainSaveConfig(cfg->configDir, driver->caps, vmdef) < 0)
+            goto cleanup;
+
+        virDomainObjAssignDef(vm, vmdef, false, NULL);
+        vmdef = NULL;
     }
 
+    ret = 0;
+
  cleanup:
     virDomainDefFree(vmdef);
     virDomainDeviceDefFree(devConf);
@@ -8577,7 +8710,46 @@ qemuDomainAttachDeviceFlags(virDomainPtr dom,
     if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
         goto endjob;
 
-    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xml, flags) < 0)
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, &xml, 1, flags) < 0)
+        goto endjob;
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virNWFilterUnlockFilterUpdates();
+    return ret;
+}
+
+
+static int
+qemuDomainAttachDevices(virDomainPtr dom,
+                        const char **xmls,
+                        unsigned int nxmls,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+
+    virNWFilterReadLockFilterUpdates();
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainAttachDevicesEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjUpdateModificationImpact(vm, &flags) < 0)
+        goto endjob;
+
+    if (qemuDomainAttachDeviceLiveAndConfig(vm, driver, xmls, nxmls, flags) < 0)
         goto endjob;
 
     ret = 0;
@@ -8658,7 +8830,7 @@ static int qemuDomainUpdateDeviceFlags(virDomainPtr dom,
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt, NULL);
         if (!vmdef)
             goto endjob;
 
@@ -8721,10 +8893,18 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
     virDomainDeviceDefPtr dev = NULL, dev_copy = NULL;
     unsigned int parse_flags = VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
     virDomainDefPtr vmdef = NULL;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool async = false;
     int ret = -1;
 
     virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+                  VIR_DOMAIN_AFFECT_CONFIG |
+                  VIR_DOMAIN_DEVICE_MODIFY_ASYNC, -1);
+
+    /* Without the DEVICE_DELETED event nothing would finish the removal */
+    if (flags & VIR_DOMAIN_DEVICE_MODIFY_ASYNC &&
+        virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DEVICE_DEL_EVENT))
+        async = true;
 
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto cleanup;
@@ -8754,7 +8934,7 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
 
     if (flags & VIR_DOMAIN_AFFECT_CONFIG) {
         /* Make a copy for updated domain. */
-        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt);
+        vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt, NULL);
         if (!vmdef)
             goto cleanup;
 
@@ -8765,7 +8945,7 @@ qemuDomainDetachDeviceLiveAndConfig(virQEMUDriverPtr driver,
     }
 
     if (flags & VIR_DOMAIN_AFFECT_LIVE) {
-        if (qemuDomainDetachDeviceLive(vm, dev_copy, driver, false) < 0)
+        if (qemuDomainDetachDeviceLive(vm, dev_copy, driver, async) < 0)
             goto cleanup;
         /*
          * update domain status forcibly because the domain status may be
@@ -8830,7 +9010,7 @@ qemuDomainDetachDeviceAliasLiveAndConfig(virQEMUDriverPtr driver,
     if (persistentDef) {
         virDomainDeviceDef dev;
 
-        if (!(vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt)))
+        if (!(vmdef = virDomainObjCopyPersistentDef(vm, caps, driver->xmlopt, NULL)))
             goto cleanup;
 
         if (virDomainDefFindDevice(vmdef, alias, &dev, true) < 0)
@@ -10100,6 +10280,7 @@ qemuDomainSetPerfEvents(virDomainPtr dom,
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
     size_t i;
+    size_t j;
     virDomainObjPtr vm = NULL;
     virQEMUDriverConfigPtr cfg = NULL;
     qemuDomainObjPrivatePtr priv;
@@ -10164,6 +10345,20 @@ qemuDomainSetPerfEvents(virDomainPtr dom,
             if (enabled && virPerfEventEnable(priv->perf, type, vm->pid) < 0)
                 goto endjob;
 
+            for (j = 0; j < virDomainDefGetVcpusMax(def); j++) {
+                qemuDomainVcpuPrivatePtr vcpupriv =
+                    QEMU_DOMAIN_VCPU_PRIVATE(virDomainDefGetVcpu(def, j));
+
+                if (!vcpupriv->perf)
+                    continue;
+
+                if (!enabled && virPerfEventDisable(vcpupriv->perf, type) < 0)
+                    goto endjob;
+                if (enabled &&
+                    virPerfEventEnable(vcpupriv->perf, type, vcpupriv->tid) < 0)
+                    goto endjob;
+            }
+
             def->perf.events[type] = enabled ?
                 VIR_TRISTATE_BOOL_YES : VIR_TRISTATE_BOOL_NO;
         }
@@ -10442,7 +10637,8 @@ qemuDomainSetSchedulerParametersFlags(virDomainPtr dom,
     if (persistentDef) {
         /* Make a copy for updated domain. */
         if (!(persistentDefCopy = virDomainObjCopyPersistentDef(vm, caps,
-                                                                driver->xmlopt)))
+                                                                driver->xmlopt,
+                                                                NULL)))
             goto endjob;
     }
 
@@ -11045,6 +11241,29 @@ qemuDomainBlockStatsGatherTotals(qemuBlockStatsPtr data,
 }
 
 
+/* Disks hotplugged since @blockstats were cached are missing from them */
+static bool
+qemuDomainBlockStatsCovered(virDomainObjPtr vm,
+                            bool blockdev,
+                            virHashTablePtr blockstats)
+{
+    size_t i;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        const char *entryname = disk->info.alias;
+
+        if (blockdev)
+            entryname = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+
+        if (entryname && !virHashLookup(blockstats, entryname))
+            return false;
+    }
+
+    return true;
+}
+
+
 /**
  * qemuDomainBlocksStatsGather:
  * @driver: driver object
@@ -11065,14 +11284,15 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
                             qemuBlockStatsPtr *retstats)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
     bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
     virDomainDiskDefPtr disk = NULL;
     virHashTablePtr blockstats = NULL;
     qemuBlockStatsPtr stats;
     size_t i;
     int nstats;
-    int rc = 0;
     const char *entryname = NULL;
+    bool cached;
     int ret = -1;
 
     if (*path) {
@@ -11094,18 +11314,35 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
         }
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    nstats = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats, false);
+    /* Stats shared with other APIs through the stats cache have to
+     * carry the capacity, which is what the bulk stats need. */
+    cached = !!(blockstats = qemuDomainStatsCacheGetBlock(driver, vm, false,
+                                                          &nstats));
+    if (cfg->statsCacheMs)
+        capacity = true;
 
-    if (capacity && nstats >= 0) {
-        if (blockdev)
-            rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, blockstats);
+ refetch:
+    if (!blockstats) {
+        qemuDomainObjEnterMonitor(driver, vm);
+        if (capacity)
+            nstats = qemuMonitorGetAllBlockStatsCapacity(priv->mon, &blockstats,
+                                                         false, blockdev);
         else
-            rc = qemuMonitorBlockStatsUpdateCapacity(priv->mon, blockstats, false);
+            nstats = qemuMonitorGetAllBlockStatsInfo(priv->mon, &blockstats,
+                                                     false);
+
+        if (qemuDomainObjExitMonitor(driver, vm) < 0 || nstats < 0)
+            goto cleanup;
+
+        qemuDomainStatsCacheSetBlock(driver, vm, blockstats, false, nstats);
     }
 
-    if (qemuDomainObjExitMonitor(driver, vm) < 0 || nstats < 0 || rc < 0)
-        goto cleanup;
+    if (cached && !qemuDomainBlockStatsCovered(vm, blockdev, blockstats)) {
+        virHashFree(blockstats);
+        blockstats = NULL;
+        cached = false;
+        goto refetch;
+    }
 
     if (VIR_ALLOC(*retstats) < 0)
         goto cleanup;
@@ -11157,6 +11394,7 @@ qemuDomainBlocksStatsGather(virQEMUDriverPtr driver,
 
  cleanup:
     virHashFree(blockstats);
+    virObjectUnref(cfg);
     return ret;
 }
 
@@ -11181,7 +11419,7 @@ qemuDomainBlockStats(virDomainPtr dom,
     if (virDomainBlockStatsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
@@ -11200,7 +11438,7 @@ qemuDomainBlockStats(virDomainPtr dom,
     ret = 0;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -11235,7 +11473,7 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
     if (virDomainBlockStatsFlagsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
@@ -11282,7 +11520,7 @@ qemuDomainBlockStatsFlags(virDomainPtr dom,
     *nparams = nstats;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
 
  cleanup:
     VIR_FREE(blockstats);
@@ -11295,6 +11533,7 @@ qemuDomainInterfaceStats(virDomainPtr dom,
                          const char *device,
                          virDomainInterfaceStatsPtr stats)
 {
+    virQEMUDriverPtr driver = dom->conn->privateData;
     virDomainObjPtr vm;
     virDomainNetDefPtr net = NULL;
     int ret = -1;
@@ -11311,6 +11550,11 @@ qemuDomainInterfaceStats(virDomainPtr dom,
     if (!(net = virDomainNetFind(vm->def, device)))
         goto cleanup;
 
+    if (qemuDomainStatsCacheGetInterface(driver, vm, net->ifname, stats) == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
     if (virDomainNetGetActualType(net) == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
         if (virNetDevOpenvswitchInterfaceStats(net->ifname, stats) < 0)
             goto cleanup;
@@ -11320,6 +11564,8 @@ qemuDomainInterfaceStats(virDomainPtr dom,
             goto cleanup;
     }
 
+    qemuDomainStatsCacheSetInterface(driver, vm, net->ifname, stats);
+
     ret = 0;
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -11647,35 +11893,45 @@ qemuDomainGetInterfaceParameters(virDomainPtr dom,
     return ret;
 }
 
-/* This functions assumes that job QEMU_JOB_QUERY is started by a caller */
 static int
-qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
-                              virDomainObjPtr vm,
-                              virDomainMemoryStatPtr stats,
-                              unsigned int nr_stats)
-
+qemuDomainMemoryStatsFetch(virQEMUDriverPtr driver,
+                           virDomainObjPtr vm,
+                           virDomainMemoryStatPtr stats,
+                           unsigned int nr_stats)
 {
     int ret = -1;
     long rss;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        return -1;
-
     if (vm->def->memballoon &&
         vm->def->memballoon->model == VIR_DOMAIN_MEMBALLOON_MODEL_VIRTIO) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
-                                        vm->def->memballoon, stats, nr_stats);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            ret = -1;
+        if ((ret = qemuDomainBalloonStatsGet(vm, stats, nr_stats)) < 0) {
+            virDomainMemoryStatStruct all[VIR_DOMAIN_MEMORY_STAT_NR];
 
-        if (ret < 0 || ret >= nr_stats)
+            qemuDomainObjEnterMonitor(driver, vm);
+            ret = qemuMonitorGetMemoryStats(qemuDomainGetMonitor(vm),
+                                            vm->def->memballoon, all,
+                                            VIR_DOMAIN_MEMORY_STAT_NR);
+            if (qemuDomainObjExitMonitor(driver, vm) < 0)
+                ret = -1;
+
+            if (ret < 0)
+                return ret;
+
+            qemuDomainBalloonStatsSet(vm, all, ret);
+
+            ret = MIN(ret, nr_stats);
+            memcpy(stats, all, ret * sizeof(*stats));
+        }
+
+        if (ret >= nr_stats)
             return ret;
     } else {
         ret = 0;
     }
 
-    if (qemuGetProcessInfo(NULL, NULL, &rss, vm->pid, 0) < 0) {
+    if (qemuGetProcessInfo(NULL, NULL, &rss,
+                           &QEMU_DOMAIN_PRIVATE(vm)->statFile,
+                           vm->pid, 0) < 0) {
         virReportError(VIR_ERR_OPERATION_FAILED, "%s",
                        _("cannot get RSS for domain"));
     } else {
@@ -11687,6 +11943,46 @@ qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
     return ret;
 }
 
+
+/* This functions assumes that job QEMU_JOB_QUERY is started by a caller */
+static int
+qemuDomainMemoryStatsInternal(virQEMUDriverPtr driver,
+                              virDomainObjPtr vm,
+                              virDomainMemoryStatPtr stats,
+                              unsigned int nr_stats)
+
+{
+    virQEMUDriverConfigPtr cfg;
+    virDomainMemoryStatStruct all[VIR_DOMAIN_MEMORY_STAT_NR];
+    bool cache;
+    int ret;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        return -1;
+
+    if ((ret = qemuDomainStatsCacheGetMemory(driver, vm, stats, nr_stats)) >= 0)
+        return ret;
+
+    cfg = virQEMUDriverGetConfig(driver);
+    cache = cfg->statsCacheMs > 0;
+    virObjectUnref(cfg);
+
+    if (!cache)
+        return qemuDomainMemoryStatsFetch(driver, vm, stats, nr_stats);
+
+    /* Cache all the stats no matter how many the caller wants, the
+     * first @nr_stats of them are the ones it would get otherwise. */
+    if ((ret = qemuDomainMemoryStatsFetch(driver, vm, all,
+                                          VIR_DOMAIN_MEMORY_STAT_NR)) < 0)
+        return -1;
+
+    qemuDomainStatsCacheSetMemory(driver, vm, all, ret);
+
+    ret = MIN(ret, nr_stats);
+    memcpy(stats, all, ret * sizeof(*stats));
+    return ret;
+}
+
 static int
 qemuDomainMemoryStats(virDomainPtr dom,
                       virDomainMemoryStatPtr stats,
@@ -11705,12 +12001,12 @@ qemuDomainMemoryStats(virDomainPtr dom,
     if (virDomainMemoryStatsEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     ret = qemuDomainMemoryStatsInternal(driver, vm, stats, nr_stats);
 
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -12066,7 +12362,7 @@ qemuDomainGetBlockInfo(virDomainPtr dom,
     if (virDomainGetBlockInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     if (!(disk = virDomainDiskByName(vm->def, path, false))) {
@@ -12139,7 +12435,7 @@ qemuDomainGetBlockInfo(virDomainPtr dom,
     ret = 0;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
  cleanup:
     VIR_FREE(entry);
     virDomainObjEndAPI(&vm);
@@ -12937,6 +13233,99 @@ qemuDomainMigratePerform3Params(virDomainPtr dom,
 }
 
 
+static int
+qemuConnectMigrateDomains(virConnectPtr conn,
+                          virDomainPtr *doms,
+                          unsigned int ndoms,
+                          const char *dconnuri,
+                          virTypedParameterPtr params,
+                          int nparams,
+                          unsigned int concurrency,
+                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    const char *uri = NULL;
+    const char *graphicsuri = NULL;
+    const char *listenAddress = NULL;
+    int nmigrate_disks;
+    const char **migrate_disks = NULL;
+    unsigned long long bandwidth = 0;
+    int nbdPort = 0;
+    size_t i;
+    int ret = -1;
+
+    virCheckFlags(QEMU_MIGRATION_FLAGS, -1);
+    if (virTypedParamsValidate(params, nparams, QEMU_MIGRATION_PARAMETERS) < 0)
+        return ret;
+
+    if (virTypedParamsGet(params, nparams, VIR_MIGRATE_PARAM_DEST_NAME) ||
+        virTypedParamsGet(params, nparams, VIR_MIGRATE_PARAM_DEST_XML) ||
+        virTypedParamsGet(params, nparams, VIR_MIGRATE_PARAM_PERSIST_XML)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("per-domain XML and name parameters are not "
+                         "supported when migrating multiple domains"));
+        return ret;
+    }
+
+    if (virTypedParamsGetString(params, nparams,
+                                VIR_MIGRATE_PARAM_URI,
+                                &uri) < 0 ||
+        virTypedParamsGetULLong(params, nparams,
+                                VIR_MIGRATE_PARAM_BANDWIDTH,
+                                &bandwidth) < 0 ||
+        virTypedParamsGetString(params, nparams,
+                                VIR_MIGRATE_PARAM_GRAPHICS_URI,
+                                &graphicsuri) < 0 ||
+        virTypedParamsGetString(params, nparams,
+                                VIR_MIGRATE_PARAM_LISTEN_ADDRESS,
+                                &listenAddress) < 0 ||
+        virTypedParamsGetInt(params, nparams,
+                             VIR_MIGRATE_PARAM_DISKS_PORT,
+                             &nbdPort) < 0)
+        goto cleanup;
+
+    nmigrate_disks = virTypedParamsGetStringList(params, nparams,
+                                                 VIR_MIGRATE_PARAM_MIGRATE_DISKS,
+                                                 &migrate_disks);
+
+    if (nmigrate_disks < 0)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(vms, ndoms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ndoms; i++) {
+        virDomainObjPtr vm;
+
+        if (!(vm = qemuDomObjFromDomain(doms[i])))
+            goto cleanup;
+
+        if (virConnectMigrateDomainsEnsureACL(conn, vm->def) < 0) {
+            virDomainObjEndAPI(&vm);
+            goto cleanup;
+        }
+
+        virObjectUnlock(vm);
+        vms[nvms++] = vm;
+    }
+
+    ret = qemuMigrationSrcPerformDomains(driver, conn, vms, nvms, dconnuri,
+                                         uri, graphicsuri, listenAddress,
+                                         nmigrate_disks, migrate_disks, nbdPort,
+                                         params, nparams, flags, bandwidth,
+                                         concurrency);
+
+ cleanup:
+    for (i = 0; i < nvms; i++)
+        virObjectUnref(vms[i]);
+    VIR_FREE(vms);
+    VIR_FREE(migrate_disks);
+    return ret;
+}
+
+
 static virDomainPtr
 qemuDomainMigrateFinish3(virConnectPtr dconn,
                          const char *dname,
@@ -13514,8 +13903,8 @@ qemuDomainGetJobInfoMigrationStats(virQEMUDriverPtr driver,
         jobInfo->status == QEMU_DOMAIN_JOB_STATUS_POSTCOPY) {
         if (events &&
             jobInfo->status != QEMU_DOMAIN_JOB_STATUS_ACTIVE &&
-            qemuMigrationAnyFetchStats(driver, vm, QEMU_ASYNC_JOB_NONE,
-                                       jobInfo, NULL) < 0)
+            qemuMigrationAnyFetchCachedStats(driver, vm, QEMU_ASYNC_JOB_NONE,
+                                             jobInfo) < 0)
             return -1;
 
         if (jobInfo->status == QEMU_DOMAIN_JOB_STATUS_ACTIVE &&
@@ -13608,7 +13997,7 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
         return -1;
     }
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         return -1;
 
     if (virDomainObjCheckActive(vm) < 0)
@@ -13633,6 +14022,11 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
             goto cleanup;
         break;
 
+    case QEMU_DOMAIN_JOB_STATS_TYPE_START:
+        if (qemuDomainJobInfoUpdateTime(jobInfo) < 0)
+            goto cleanup;
+        break;
+
     case QEMU_DOMAIN_JOB_STATS_TYPE_NONE:
         break;
     }
@@ -13640,7 +14034,7 @@ qemuDomainGetJobStatsInternal(virQEMUDriverPtr driver,
     ret = 0;
 
  cleanup:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
     return ret;
 }
 
@@ -13850,7 +14244,7 @@ qemuDomainMigrateGetMaxDowntime(virDomainPtr dom,
     if (virDomainMigrateGetMaxDowntimeEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
@@ -13876,7 +14270,7 @@ qemuDomainMigrateGetMaxDowntime(virDomainPtr dom,
     ret = 0;
 
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndSharedJob(vm);
 
  cleanup:
     qemuMigrationParamsFree(migParams);
@@ -15334,7 +15728,7 @@ qemuDomainSnapshotCreateXML(virDomainPtr domain,
     if (redefine)
         parse_flags |= VIR_DOMAIN_SNAPSHOT_PARSE_REDEFINE;
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         goto cleanup;
 
     cfg = virQEMUDriverGetConfig(driver);
@@ -15594,7 +15988,7 @@ qemuDomainSnapshotListNames(virDomainPtr domain,
     virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
                   VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return -1;
 
     if (virDomainSnapshotListNamesEnsureACL(domain->conn, vm->def) < 0)
@@ -15619,7 +16013,7 @@ qemuDomainSnapshotNum(virDomainPtr domain,
     virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
                   VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return -1;
 
     if (virDomainSnapshotNumEnsureACL(domain->conn, vm->def) < 0)
@@ -15644,7 +16038,7 @@ qemuDomainListAllSnapshots(virDomainPtr domain,
     virCheckFlags(VIR_DOMAIN_SNAPSHOT_LIST_ROOTS |
                   VIR_DOMAIN_SNAPSHOT_FILTERS_ALL, -1);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return -1;
 
     if (virDomainListAllSnapshotsEnsureACL(domain->conn, vm->def) < 0)
@@ -15758,7 +16152,7 @@ qemuDomainSnapshotLookupByName(virDomainPtr domain,
 
     virCheckFlags(0, NULL);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return NULL;
 
     if (virDomainSnapshotLookupByNameEnsureACL(domain->conn, vm->def) < 0)
@@ -15784,7 +16178,7 @@ qemuDomainHasCurrentSnapshot(virDomainPtr domain,
 
     virCheckFlags(0, -1);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return -1;
 
     if (virDomainHasCurrentSnapshotEnsureACL(domain->conn, vm->def) < 0)
@@ -15841,7 +16235,7 @@ qemuDomainSnapshotCurrent(virDomainPtr domain,
 
     virCheckFlags(0, NULL);
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
+    if (!(vm = qemuDomObjFromDomainSnapshots(domain)))
         return NULL;
 
     if (virDomainSnapshotCurrentEnsureACL(domain->conn, vm->def) < 0)
@@ -16539,284 +16933,266 @@ qemuDomainSnapshotDelete(virDomainSnapshotPtr snapshot,
     return ret;
 }
 
-static int qemuDomainQemuMonitorCommand(virDomainPtr domain, const char *cmd,
-                                        char **result, unsigned int flags)
-{
-    virQEMUDriverPtr driver = domain->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    bool hmp;
 
-    virCheckFlags(VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP, -1);
+/* Looks up checkpoint definition from VM and name */
+static virDomainCheckpointDefPtr
+qemuCheckpointObjFromName(virDomainObjPtr vm,
+                          const char *name)
+{
+    virDomainCheckpointDefPtr def;
 
-    if (!(vm = qemuDomObjFromDomain(domain)))
-        goto cleanup;
+    if (!(def = virDomainCheckpointFindByName(vm->checkpoints, name)))
+        virReportError(VIR_ERR_NO_DOMAIN_CHECKPOINT,
+                       _("no domain checkpoint with matching name '%s'"),
+                       name);
 
-    if (virDomainQemuMonitorCommandEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+    return def;
+}
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
-        goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+/* Validates the disks of an aligned checkpoint @def and adds the actions
+ * creating its bitmaps to @actions.  The domain is expected to be locked
+ * and active. */
+static int
+qemuDomainCheckpointPrepare(virDomainObjPtr vm,
+                            virDomainCheckpointDefPtr def,
+                            virJSONValuePtr actions)
+{
+    size_t i;
 
-    priv = vm->privateData;
+    if (virDomainCheckpointFindByName(vm->checkpoints, def->name)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("domain checkpoint '%s' already exists"),
+                       def->name);
+        return -1;
+    }
 
-    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_MONITOR, NULL);
+    for (i = 0; i < def->ndisks; i++) {
+        virDomainCheckpointDiskDefPtr chkdisk = &def->disks[i];
+        virDomainDiskDefPtr disk = vm->def->disks[chkdisk->idx];
 
-    hmp = !!(flags & VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP);
+        if (chkdisk->type != VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP)
+            continue;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorArbitraryCommand(priv->mon, cmd, result, hmp);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+        if (disk->src->format != VIR_STORAGE_FILE_QCOW2) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                           _("checkpoint of disk '%s' requires qcow2 format"),
+                           disk->dst);
+            return -1;
+        }
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+        if (qemuBlockDirtyBitmapAdd(actions, disk, chkdisk->bitmap) < 0)
+            return -1;
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return 0;
 }
 
 
-static virDomainPtr qemuDomainQemuAttach(virConnectPtr conn,
-                                         unsigned int pid_value,
-                                         unsigned int flags)
+static virDomainCheckpointPtr
+qemuDomainCheckpointCreateXML(virDomainPtr domain,
+                              const char *xmlDesc,
+                              unsigned int flags)
 {
-    virQEMUDriverPtr driver = conn->privateData;
+    virQEMUDriverPtr driver = domain->conn->privateData;
     virDomainObjPtr vm = NULL;
-    virDomainDefPtr def = NULL;
-    virDomainPtr dom = NULL;
-    virDomainChrSourceDefPtr monConfig = NULL;
-    bool monJSON = false;
-    pid_t pid = pid_value;
-    char *pidfile = NULL;
-    virQEMUCapsPtr qemuCaps = NULL;
-    virCapsPtr caps = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virQEMUDriverConfigPtr cfg = NULL;
+    virDomainCheckpointDefPtr def = NULL;
+    virDomainCheckpointDefPtr other = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+    virJSONValuePtr actions = NULL;
+    bool redefine = !!(flags & VIR_DOMAIN_CHECKPOINT_CREATE_REDEFINE);
+    unsigned int parse_flags = 0;
+    int rc;
 
-    virCheckFlags(0, NULL);
+    virCheckFlags(VIR_DOMAIN_CHECKPOINT_CREATE_REDEFINE, NULL);
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
-        goto cleanup;
+    if (redefine)
+        parse_flags |= VIR_DOMAIN_CHECKPOINT_PARSE_REDEFINE;
 
-    if (!(def = qemuParseCommandLinePid(driver->qemuCapsCache,
-                                        caps, driver->xmlopt, pid,
-                                        &pidfile, &monConfig, &monJSON)))
+    if (!(vm = qemuDomObjFromDomain(domain)))
         goto cleanup;
 
-    if (virDomainQemuAttachEnsureACL(conn, def) < 0)
-        goto cleanup;
+    priv = vm->privateData;
+    cfg = virQEMUDriverGetConfig(driver);
 
-    if (!monConfig) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("No monitor connection for pid %u"), pid_value);
-        goto cleanup;
-    }
-    if (monConfig->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Cannot connect to monitor connection of type '%s' "
-                         "for pid %u"),
-                       virDomainChrTypeToString(monConfig->type),
-                       pid_value);
+    if (virDomainCheckpointCreateXMLEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
-    }
 
-    if (!(def->name) &&
-        virAsprintf(&def->name, "attach-pid-%u", pid_value) < 0)
+    if (!(def = virDomainCheckpointDefParseString(xmlDesc, parse_flags)))
         goto cleanup;
 
-    if (!(qemuCaps = virQEMUCapsCacheLookup(driver->qemuCapsCache,
-                                            def->emulator)))
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
 
-    if (qemuAssignDeviceAliases(def, qemuCaps) < 0)
-        goto cleanup;
+    if (redefine) {
+        /* Only the metadata changes, the bitmaps must already exist */
+        if (virDomainCheckpointAlignDisks(def, vm->def) < 0)
+            goto endjob;
+        other = virDomainCheckpointFindByName(vm->checkpoints, def->name);
+    } else {
+        if (virDomainObjCheckActive(vm) < 0)
+            goto endjob;
 
-    if (!(vm = virDomainObjListAdd(driver->domains, def,
-                                   driver->xmlopt,
-                                   VIR_DOMAIN_OBJ_LIST_ADD_LIVE |
-                                   VIR_DOMAIN_OBJ_LIST_ADD_CHECK_LIVE,
-                                   NULL)))
-        goto cleanup;
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_TRANSACTION)) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                           _("checkpoints are not supported with this "
+                             "QEMU binary"));
+            goto endjob;
+        }
 
-    def = NULL;
+        if (virDomainCheckpointAlignDisks(def, vm->def) < 0)
+            goto endjob;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0) {
-        qemuDomainRemoveInactive(driver, vm);
-        goto cleanup;
+        if (!(actions = virJSONValueNewArray()) ||
+            qemuDomainCheckpointPrepare(vm, def, actions) < 0)
+            goto endjob;
     }
 
-    if (qemuProcessAttach(conn, driver, vm, pid,
-                          pidfile, monConfig, monJSON) < 0) {
-        monConfig = NULL;
-        qemuDomainRemoveInactive(driver, vm);
-        qemuDomainObjEndJob(driver, vm);
-        goto cleanup;
+    if (qemuDomainCheckpointWriteMetadata(vm, def, cfg->checkpointDir) < 0)
+        goto endjob;
+
+    if (actions && virJSONValueArraySize(actions) > 0) {
+        qemuDomainObjEnterMonitor(driver, vm);
+        rc = qemuMonitorTransaction(priv->mon, &actions);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            rc = -1;
+        if (rc < 0) {
+            ignore_value(qemuDomainCheckpointDiscard(driver, vm, def, true));
+            goto endjob;
+        }
     }
 
-    monConfig = NULL;
+    if (other)
+        virDomainCheckpointObjListRemove(vm->checkpoints, other);
+    if (virDomainCheckpointAssignDef(vm->checkpoints, def) < 0)
+        goto endjob;
 
-    dom = virGetDomain(conn, vm->def->name, vm->def->uuid, vm->def->id);
+    checkpoint = virGetDomainCheckpoint(domain, def->name);
+    def = NULL;
 
+ endjob:
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virDomainDefFree(def);
-    virDomainChrSourceDefFree(monConfig);
+    virJSONValueFree(actions);
+    virDomainCheckpointDefFree(def);
     virDomainObjEndAPI(&vm);
-    VIR_FREE(pidfile);
-    virObjectUnref(caps);
-    virObjectUnref(qemuCaps);
-    return dom;
+    virObjectUnref(cfg);
+    return checkpoint;
 }
 
 
-static int
-qemuDomainOpenConsole(virDomainPtr dom,
-                      const char *dev_name,
-                      virStreamPtr st,
-                      unsigned int flags)
+static char *
+qemuDomainCheckpointGetXMLDesc(virDomainCheckpointPtr checkpoint,
+                               unsigned int flags)
 {
     virDomainObjPtr vm = NULL;
-    int ret = -1;
-    size_t i;
-    virDomainChrDefPtr chr = NULL;
-    qemuDomainObjPrivatePtr priv;
+    virDomainCheckpointDefPtr def;
+    char *xml = NULL;
 
-    virCheckFlags(VIR_DOMAIN_CONSOLE_SAFE |
-                  VIR_DOMAIN_CONSOLE_FORCE, -1);
+    virCheckFlags(0, NULL);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    if (!(vm = qemuDomObjFromDomain(checkpoint->domain)))
+        return NULL;
 
-    if (virDomainOpenConsoleEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainCheckpointGetXMLDescEnsureACL(checkpoint->domain->conn,
+                                               vm->def) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
+    if (!(def = qemuCheckpointObjFromName(vm, checkpoint->name)))
         goto cleanup;
 
-    priv = vm->privateData;
+    xml = virDomainCheckpointDefFormat(def, 0);
 
-    if (dev_name) {
-        for (i = 0; !chr && i < vm->def->nconsoles; i++) {
-            if (vm->def->consoles[i]->info.alias &&
-                STREQ(dev_name, vm->def->consoles[i]->info.alias))
-                chr = vm->def->consoles[i];
-        }
-        for (i = 0; !chr && i < vm->def->nserials; i++) {
-            if (STREQ(dev_name, vm->def->serials[i]->info.alias))
-                chr = vm->def->serials[i];
-        }
-        for (i = 0; !chr && i < vm->def->nparallels; i++) {
-            if (STREQ(dev_name, vm->def->parallels[i]->info.alias))
-                chr = vm->def->parallels[i];
-        }
-    } else {
-        if (vm->def->nconsoles)
-            chr = vm->def->consoles[0];
-        else if (vm->def->nserials)
-            chr = vm->def->serials[0];
-    }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return xml;
+}
 
-    if (!chr) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot find character device %s"),
-                       NULLSTR(dev_name));
-        goto cleanup;
-    }
 
-    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_PTY) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("character device %s is not using a PTY"),
-                       dev_name ? dev_name : NULLSTR(chr->info.alias));
-        goto cleanup;
-    }
+static int
+qemuDomainListAllCheckpoints(virDomainPtr domain,
+                             virDomainCheckpointPtr **checkpoints,
+                             unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int n = -1;
 
-    /* handle mutually exclusive access to console devices */
-    ret = virChrdevOpen(priv->devs,
-                        chr->source,
-                        st,
-                        (flags & VIR_DOMAIN_CONSOLE_FORCE) != 0);
+    virCheckFlags(0, -1);
 
-    if (ret == 1) {
-        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                       _("Active console session exists for this domain"));
-        ret = -1;
-    }
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        return -1;
+
+    if (virDomainListAllCheckpointsEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    n = virDomainListCheckpoints(vm->checkpoints, domain, checkpoints, flags);
 
  cleanup:
     virDomainObjEndAPI(&vm);
-    return ret;
+    return n;
 }
 
-static int
-qemuDomainOpenChannel(virDomainPtr dom,
-                      const char *name,
-                      virStreamPtr st,
-                      unsigned int flags)
+
+static virDomainCheckpointPtr
+qemuDomainCheckpointLookupByName(virDomainPtr domain,
+                                 const char *name,
+                                 unsigned int flags)
 {
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    size_t i;
-    virDomainChrDefPtr chr = NULL;
-    qemuDomainObjPrivatePtr priv;
+    virDomainObjPtr vm;
+    virDomainCheckpointDefPtr def;
+    virDomainCheckpointPtr checkpoint = NULL;
 
-    virCheckFlags(VIR_DOMAIN_CHANNEL_FORCE, -1);
+    virCheckFlags(0, NULL);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        return NULL;
 
-    if (virDomainOpenChannelEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainCheckpointLookupByNameEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
+    if (!(def = qemuCheckpointObjFromName(vm, name)))
         goto cleanup;
 
-    priv = vm->privateData;
+    checkpoint = virGetDomainCheckpoint(domain, def->name);
 
-    if (name) {
-        for (i = 0; !chr && i < vm->def->nchannels; i++) {
-            if (STREQ(name, vm->def->channels[i]->info.alias))
-                chr = vm->def->channels[i];
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return checkpoint;
+}
 
-            if (vm->def->channels[i]->targetType == \
-                VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO &&
-                STREQ_NULLABLE(name, vm->def->channels[i]->target.name))
-                chr = vm->def->channels[i];
-        }
-    } else {
-        if (vm->def->nchannels)
-            chr = vm->def->channels[0];
-    }
 
-    if (!chr) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot find channel %s"),
-                       NULLSTR(name));
+static int
+qemuDomainCheckpointDelete(virDomainCheckpointPtr checkpoint,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = checkpoint->domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    virDomainCheckpointDefPtr def;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_CHECKPOINT_DELETE_METADATA_ONLY, -1);
+
+    if (!(vm = qemuDomObjFromDomain(checkpoint->domain)))
+        return -1;
+
+    if (virDomainCheckpointDeleteEnsureACL(checkpoint->domain->conn,
+                                           vm->def) < 0)
         goto cleanup;
-    }
 
-    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("channel %s is not using a UNIX socket"),
-                       name ? name : NULLSTR(chr->info.alias));
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
-    }
 
-    /* handle mutually exclusive access to channel devices */
-    ret = virChrdevOpen(priv->devs,
-                        chr->source,
-                        st,
-                        (flags & VIR_DOMAIN_CHANNEL_FORCE) != 0);
+    if (!(def = qemuCheckpointObjFromName(vm, checkpoint->name)))
+        goto endjob;
 
-    if (ret == 1) {
-        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
-                       _("Active channel stream exists for this domain"));
-        ret = -1;
-    }
+    ret = qemuDomainCheckpointDiscard(driver, vm, def,
+                                      !!(flags & VIR_DOMAIN_CHECKPOINT_DELETE_METADATA_ONLY));
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
 
  cleanup:
     virDomainObjEndAPI(&vm);
@@ -16824,626 +17200,581 @@ qemuDomainOpenChannel(virDomainPtr dom,
 }
 
 
-/* Called while holding the VM job lock, to implement a block job
- * abort with pivot; this updates the VM definition as appropriate, on
- * either success or failure.  */
 static int
-qemuDomainBlockPivot(virQEMUDriverPtr driver,
-                     virDomainObjPtr vm,
-                     const char *device,
-                     virDomainDiskDefPtr disk)
+qemuDomainBackupBegin(virDomainPtr domain,
+                      const char *backupXML,
+                      const char *checkpointXML,
+                      unsigned int flags)
 {
-    int ret = -1, rc;
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    qemuMonitorBlockJobInfo info;
-    virStorageSourcePtr oldsrc = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virQEMUDriverConfigPtr cfg = NULL;
+    virDomainBackupDefPtr backup = NULL;
+    virDomainCheckpointDefPtr incremental = NULL;
+    virDomainCheckpointDefPtr chkdef = NULL;
+    virJSONValuePtr actions = NULL;
+    bool metadata = false;
+    size_t i;
+    int rc;
+    int ret = -1;
 
-    if (!disk->mirror) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("pivot of disk '%s' requires an active copy job"),
-                       disk->dst);
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomObjFromDomain(domain)))
         goto cleanup;
-    }
 
-    /* Probe the status, if needed.  */
-    if (!disk->mirrorState) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        rc = qemuMonitorGetBlockJobInfo(priv->mon, disk->info.alias, &info);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto cleanup;
-        if (rc < 0)
-            goto cleanup;
-        if (rc == 1 &&
-            (info.ready == 1 ||
-             (info.ready == -1 &&
-              info.end == info.cur &&
-              (info.type == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY ||
-               info.type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT))))
-            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-    }
+    priv = vm->privateData;
+    cfg = virQEMUDriverGetConfig(driver);
 
-    if (disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY) {
-        virReportError(VIR_ERR_BLOCK_COPY_ACTIVE,
-                       _("disk '%s' not ready for pivot yet"),
-                       disk->dst);
+    if (virDomainBackupBeginEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
-    }
 
-    /* When pivoting to a shareable disk we need to make sure that the disk can
-     * be safely shared, since block copy might have changed the format. */
-    if (disk->src->shared && !disk->src->readonly &&
-        !qemuBlockStorageSourceSupportsConcurrentAccess(disk->mirror)) {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("can't pivot a shared disk to a storage volume not "
-                         "supporting sharing"));
+    if (!(backup = virDomainBackupDefParseString(backupXML, 0)))
         goto cleanup;
-    }
 
-    /* For active commit, the mirror is part of the already labeled
-     * chain.  For blockcopy, we previously labeled only the top-level
-     * image; but if the user is reusing an external image that
-     * includes a backing file, the pivot may result in qemu needing
-     * to open the entire backing chain, so we need to label the
-     * entire chain.  This action is safe even if the backing chain
-     * has already been labeled; but only necessary when we know for
-     * sure that there is a backing chain.  */
-    if (disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY) {
-        oldsrc = disk->src;
-        disk->src = disk->mirror;
+    if (checkpointXML &&
+        !(chkdef = virDomainCheckpointDefParseString(checkpointXML, 0)))
+        goto cleanup;
 
-        if (qemuDomainDetermineDiskChain(driver, vm, disk, true) < 0)
-            goto cleanup;
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
 
-        if (disk->mirror->format &&
-            disk->mirror->format != VIR_STORAGE_FILE_RAW &&
-            (qemuDomainNamespaceSetupDisk(vm, disk->src) < 0 ||
-             qemuSetupDiskCgroup(vm, disk) < 0 ||
-             qemuSecuritySetDiskLabel(driver, vm, disk) < 0))
-            goto cleanup;
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-        disk->src = oldsrc;
-        oldsrc = NULL;
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_TRANSACTION)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("backup is not supported with this QEMU binary"));
+        goto endjob;
     }
 
-    /* Attempt the pivot.  Record the attempt now, to prevent duplicate
-     * attempts; but the actual disk change will be made when emitting
-     * the event.
-     * XXX On libvirtd restarts, if we missed the qemu event, we need
-     * to double check what state qemu is in.
-     * XXX We should be using qemu's rerror flag to make sure the job
-     * remains alive until we know its final state.
-     * XXX If the abort command is synchronous but the qemu event says
-     * that pivot failed, we need to reflect that failure into the
-     * overall return value.  */
-    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_PIVOT;
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorDrivePivot(priv->mon, device);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0) {
-        ret = -1;
-        goto cleanup;
-    }
-
-    if (ret < 0) {
-        /* The pivot failed. The block job in QEMU remains in the synchronised
-         * phase. Reset the state we changed and return the error to the user */
-        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-    }
-
- cleanup:
-    if (oldsrc)
-        disk->src = oldsrc;
-
-    virObjectUnref(cfg);
-    return ret;
-}
-
-
-/* bandwidth in MiB/s per public API. Caller must lock vm beforehand,
- * and not access it afterwards.  */
-static int
-qemuDomainBlockPullCommon(virQEMUDriverPtr driver,
-                          virDomainObjPtr vm,
-                          const char *path,
-                          const char *base,
-                          unsigned long bandwidth,
-                          unsigned int flags)
-{
-    qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-    char *device = NULL;
-    virDomainDiskDefPtr disk;
-    virStorageSourcePtr baseSource = NULL;
-    unsigned int baseIndex = 0;
-    char *basePath = NULL;
-    char *backingPath = NULL;
-    unsigned long long speed = bandwidth;
-    int ret = -1;
-
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE && !base) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("flag VIR_DOMAIN_BLOCK_REBASE_RELATIVE is valid only "
-                         "with non-null base"));
-        goto cleanup;
-    }
-
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
-
-    if (virDomainObjCheckActive(vm) < 0)
+    if (virDomainBackupAlignDisks(backup, vm->def) < 0)
         goto endjob;
 
-    if (qemuDomainSupportsBlockJobs(vm) < 0)
-        goto endjob;
-
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+    if (backup->incremental &&
+        !(incremental = qemuCheckpointObjFromName(vm, backup->incremental)))
         goto endjob;
 
-    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+    if (!(actions = virJSONValueNewArray()))
         goto endjob;
 
-    if (qemuDomainDiskBlockJobIsActive(disk))
-        goto endjob;
+    for (i = 0; i < backup->ndisks; i++) {
+        virDomainBackupDiskDefPtr backupdisk = &backup->disks[i];
+        virDomainDiskDefPtr disk = vm->def->disks[backupdisk->idx];
+        const char *bitmap = NULL;
 
-    if (base &&
-        (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
-         !(baseSource = virStorageFileChainLookup(disk->src, disk->src,
-                                                  base, baseIndex, NULL))))
-        goto endjob;
+        if (backupdisk->backup != VIR_TRISTATE_BOOL_YES)
+            continue;
 
-    if (baseSource) {
-        if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
-            if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
-                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                               _("this QEMU binary doesn't support relative "
-                                 "block pull/rebase"));
-                goto endjob;
-            }
+        if (qemuDomainDiskBlockJobIsActive(disk))
+            goto endjob;
 
-            if (virStorageFileGetRelativeBackingPath(disk->src->backingStore,
-                                                     baseSource,
-                                                     &backingPath) < 0)
-                goto endjob;
+        if (incremental) {
+            virDomainCheckpointDiskDefPtr chkdisk;
 
-            if (!backingPath) {
-                virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                               _("can't keep relative backing relationship"));
+            chkdisk = virDomainCheckpointDefFindDisk(incremental, disk->dst);
+            if (!chkdisk || chkdisk->type != VIR_DOMAIN_CHECKPOINT_TYPE_BITMAP) {
+                virReportError(VIR_ERR_OPERATION_INVALID,
+                               _("disk '%s' is not tracked by checkpoint '%s'"),
+                               disk->dst, incremental->name);
                 goto endjob;
             }
+            bitmap = chkdisk->bitmap;
         }
+
+        if (qemuBlockBackupAdd(actions, disk, backup->server,
+                               backupdisk->exportname, bitmap) < 0)
+            goto endjob;
     }
 
-    /* Convert bandwidth MiB to bytes, if needed */
-    if (!(flags & VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
+    if (virJSONValueArraySize(actions) == 0) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("no disks selected for backup"));
+        goto endjob;
+    }
+
+    /* The new checkpoint starts tracking changes at the same point in time
+     * as the backup copies, so it is created by the same transaction */
+    if (chkdef) {
+        if (virDomainCheckpointAlignDisks(chkdef, vm->def) < 0 ||
+            qemuDomainCheckpointPrepare(vm, chkdef, actions) < 0 ||
+            qemuDomainCheckpointWriteMetadata(vm, chkdef,
+                                              cfg->checkpointDir) < 0)
             goto endjob;
-        }
-        speed <<= 20;
+        metadata = true;
     }
 
     qemuDomainObjEnterMonitor(driver, vm);
-    if (baseSource)
-        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                             baseSource);
-    if (!baseSource || basePath)
-        ret = qemuMonitorBlockStream(priv->mon, device, basePath, backingPath,
-                                     speed);
+    rc = qemuMonitorTransaction(priv->mon, &actions);
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-
-    if (ret < 0)
+        rc = -1;
+    if (rc < 0)
         goto endjob;
 
-    QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+    for (i = 0; i < backup->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[backup->disks[i].idx];
+
+        if (backup->disks[i].backup != VIR_TRISTATE_BOOL_YES)
+            continue;
+
+        QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+        qemuBlockJobStarted(disk);
+    }
+
+    if (chkdef) {
+        if (virDomainCheckpointAssignDef(vm->checkpoints, chkdef) < 0)
+            VIR_WARN("Unable to track checkpoint '%s' of vm %s",
+                     chkdef->name, vm->def->name);
+        else
+            chkdef = NULL;
+    }
+    metadata = false;
 
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
 
+    ret = 0;
+
  endjob:
+    if (metadata) {
+        /* the definition is not in the list yet, only the file is removed */
+        ignore_value(qemuDomainCheckpointDiscard(driver, vm, chkdef, true));
+    }
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virObjectUnref(cfg);
-    VIR_FREE(basePath);
-    VIR_FREE(backingPath);
-    VIR_FREE(device);
+    virJSONValueFree(actions);
+    virDomainCheckpointDefFree(chkdef);
+    virDomainBackupDefFree(backup);
     virDomainObjEndAPI(&vm);
+    virObjectUnref(cfg);
     return ret;
 }
 
-
-static int
-qemuDomainBlockJobAbort(virDomainPtr dom,
-                        const char *path,
-                        unsigned int flags)
+static int qemuDomainQemuMonitorCommand(virDomainPtr domain, const char *cmd,
+                                        char **result, unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    char *device = NULL;
-    virDomainDiskDefPtr disk = NULL;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-    bool save = false;
-    bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
-    bool async = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC);
-    virDomainObjPtr vm;
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    virDomainObjPtr vm = NULL;
     int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    bool hmp;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC |
-                  VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT, -1);
+    virCheckFlags(VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP, -1);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        goto cleanup;
 
-    if (virDomainBlockJobAbortEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainQemuMonitorCommandEnsureACL(domain->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    if (qemuDomainSupportsBlockJobs(vm) < 0)
-        goto endjob;
-
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
-
-    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
-        goto endjob;
-
-    if (disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_NONE &&
-        disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       _("another job on disk '%s' is still being ended"),
-                       disk->dst);
-        goto endjob;
-    }
-
-    if (!async)
-        qemuBlockJobSyncBegin(disk);
-
-    if (pivot) {
-        if ((ret = qemuDomainBlockPivot(driver, vm, device, disk)) < 0)
-            goto endjob;
-    } else {
-        if (disk->mirror) {
-            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_ABORT;
-            save = true;
-        }
-
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorBlockJobCancel(qemuDomainGetMonitor(vm), device);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0) {
-            ret = -1;
-            goto endjob;
-        }
+    priv = vm->privateData;
 
-        if (ret < 0) {
-            if (disk->mirror)
-                disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
-            goto endjob;
-        }
-    }
+    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_MONITOR, NULL);
 
-    /* If we have made changes to XML due to a copy job, make a best
-     * effort to save it now.  But we can ignore failure, since there
-     * will be further changes when the event marks completion.  */
-    if (save)
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
+    hmp = !!(flags & VIR_DOMAIN_QEMU_MONITOR_COMMAND_HMP);
 
-    /*
-     * With the ABORT_ASYNC flag we don't need to do anything, the event will
-     * come from qemu and will update the XML as appropriate, but without the
-     * ABORT_ASYNC flag, we must block to guarantee synchronous operation.  We
-     * do the waiting while still holding the VM job, to prevent newly
-     * scheduled block jobs from confusing us. */
-    if (!async) {
-        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
-        qemuBlockJobUpdate(vm, QEMU_ASYNC_JOB_NONE, disk, NULL);
-        while (diskPriv->blockjob) {
-            if (virDomainObjWait(vm) < 0) {
-                ret = -1;
-                goto endjob;
-            }
-            qemuBlockJobUpdate(vm, QEMU_ASYNC_JOB_NONE, disk, NULL);
-        }
-    }
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorArbitraryCommand(priv->mon, cmd, result, hmp);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
 
  endjob:
-    if (disk)
-        qemuBlockJobSyncEnd(vm, QEMU_ASYNC_JOB_NONE, disk);
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virObjectUnref(cfg);
-    VIR_FREE(device);
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
 
-static int
-qemuBlockJobInfoTranslate(qemuMonitorBlockJobInfoPtr rawInfo,
-                          virDomainBlockJobInfoPtr info,
-                          virDomainDiskDefPtr disk,
-                          bool reportBytes)
+static virDomainPtr qemuDomainQemuAttach(virConnectPtr conn,
+                                         unsigned int pid_value,
+                                         unsigned int flags)
 {
-    info->cur = rawInfo->cur;
-    info->end = rawInfo->end;
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainObjPtr vm = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainPtr dom = NULL;
+    virDomainChrSourceDefPtr monConfig = NULL;
+    bool monJSON = false;
+    pid_t pid = pid_value;
+    char *pidfile = NULL;
+    virQEMUCapsPtr qemuCaps = NULL;
+    virCapsPtr caps = NULL;
 
-    /* Fix job completeness reporting. If cur == end mgmt
-     * applications think job is completed. Except when both cur
-     * and end are zero, in which case qemu hasn't started the
-     * job yet. */
-    if (!info->cur && !info->end) {
-        if (rawInfo->ready > 0) {
-            info->cur = info->end = 1;
-        } else if (!rawInfo->ready) {
-            info->end = 1;
-        }
-    }
-
-    info->type = rawInfo->type;
-    if (info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT &&
-        disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT)
-        info->type = disk->mirrorJob;
-
-    if (rawInfo->bandwidth && !reportBytes)
-        rawInfo->bandwidth = VIR_DIV_UP(rawInfo->bandwidth, 1024 * 1024);
-    info->bandwidth = rawInfo->bandwidth;
-    if (info->bandwidth != rawInfo->bandwidth) {
-        virReportError(VIR_ERR_OVERFLOW,
-                       _("bandwidth %llu cannot be represented in result"),
-                       rawInfo->bandwidth);
-        return -1;
-    }
-
-    return 0;
-}
+    virCheckFlags(0, NULL);
 
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+        goto cleanup;
 
-static int
-qemuDomainGetBlockJobInfo(virDomainPtr dom,
-                          const char *path,
-                          virDomainBlockJobInfoPtr info,
-                          unsigned int flags)
-{
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    virDomainDiskDefPtr disk;
-    int ret = -1;
-    qemuMonitorBlockJobInfo rawInfo;
+    if (!(def = qemuParseCommandLinePid(driver->qemuCapsCache,
+                                        caps, driver->xmlopt, pid,
+                                        &pidfile, &monConfig, &monJSON)))
+        goto cleanup;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, -1);
+    if (virDomainQemuAttachEnsureACL(conn, def) < 0)
+        goto cleanup;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+    if (!monConfig) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("No monitor connection for pid %u"), pid_value);
+        goto cleanup;
+    }
+    if (monConfig->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Cannot connect to monitor connection of type '%s' "
+                         "for pid %u"),
+                       virDomainChrTypeToString(monConfig->type),
+                       pid_value);
+        goto cleanup;
+    }
 
-    if (virDomainGetBlockJobInfoEnsureACL(dom->conn, vm->def) < 0)
+    if (!(def->name) &&
+        virAsprintf(&def->name, "attach-pid-%u", pid_value) < 0)
         goto cleanup;
 
+    if (!(qemuCaps = virQEMUCapsCacheLookup(driver->qemuCapsCache,
+                                            def->emulator)))
+        goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (qemuAssignDeviceAliases(def, qemuCaps) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (!(vm = virDomainObjListAdd(driver->domains, def,
+                                   driver->xmlopt,
+                                   VIR_DOMAIN_OBJ_LIST_ADD_LIVE |
+                                   VIR_DOMAIN_OBJ_LIST_ADD_CHECK_LIVE,
+                                   NULL)))
+        goto cleanup;
 
-    if (qemuDomainSupportsBlockJobs(vm) < 0)
-        goto endjob;
+    def = NULL;
 
-    if (!(disk = virDomainDiskByName(vm->def, path, true))) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("disk %s not found in the domain"), path);
-        goto endjob;
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0) {
+        qemuDomainRemoveInactive(driver, vm);
+        goto cleanup;
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorGetBlockJobInfo(qemuDomainGetMonitor(vm),
-                                     disk->info.alias, &rawInfo);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    if (ret <= 0)
-        goto endjob;
-
-    if (qemuBlockJobInfoTranslate(&rawInfo, info, disk,
-                                  flags & VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES) < 0) {
-        ret = -1;
-        goto endjob;
+    if (qemuProcessAttach(conn, driver, vm, pid,
+                          pidfile, monConfig, monJSON) < 0) {
+        monConfig = NULL;
+        qemuDomainRemoveInactive(driver, vm);
+        qemuDomainObjEndJob(driver, vm);
+        goto cleanup;
     }
 
-    /* Snoop block copy operations, so future cancel operations can
-     * avoid checking if pivot is safe.  Save the change to XML, but
-     * we can ignore failure because it is only an optimization.  We
-     * hold the vm lock, so modifying the in-memory representation is
-     * safe, even if we are a query rather than a modify job. */
-    if (disk->mirror &&
-        rawInfo.ready != 0 &&
-        info->cur == info->end && !disk->mirrorState) {
-        virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    monConfig = NULL;
+
+    dom = virGetDomain(conn, vm->def->name, vm->def->uuid, vm->def->id);
 
-        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
-        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
-        virObjectUnref(cfg);
-    }
- endjob:
     qemuDomainObjEndJob(driver, vm);
 
  cleanup:
+    virDomainDefFree(def);
+    virDomainChrSourceDefFree(monConfig);
     virDomainObjEndAPI(&vm);
-    return ret;
+    VIR_FREE(pidfile);
+    virObjectUnref(caps);
+    virObjectUnref(qemuCaps);
+    return dom;
 }
 
 
 static int
-qemuDomainBlockJobSetSpeed(virDomainPtr dom,
-                           const char *path,
-                           unsigned long bandwidth,
-                           unsigned int flags)
+qemuDomainOpenConsole(virDomainPtr dom,
+                      const char *dev_name,
+                      virStreamPtr st,
+                      unsigned int flags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainDiskDefPtr disk;
+    virDomainObjPtr vm = NULL;
     int ret = -1;
-    virDomainObjPtr vm;
-    char *device = NULL;
-    unsigned long long speed = bandwidth;
-
-    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES, -1);
+    size_t i;
+    virDomainChrDefPtr chr = NULL;
+    qemuDomainObjPrivatePtr priv;
 
-    /* Convert bandwidth MiB to bytes, if needed */
-    if (!(flags & VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            return -1;
-        }
-        speed <<= 20;
-    }
+    virCheckFlags(VIR_DOMAIN_CONSOLE_SAFE |
+                  VIR_DOMAIN_CONSOLE_FORCE, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
-
-    if (virDomainBlockJobSetSpeedEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+    if (virDomainOpenConsoleEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        goto cleanup;
 
-    if (qemuDomainSupportsBlockJobs(vm) < 0)
-        goto endjob;
+    priv = vm->privateData;
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
+    if (dev_name) {
+        for (i = 0; !chr && i < vm->def->nconsoles; i++) {
+            if (vm->def->consoles[i]->info.alias &&
+                STREQ(dev_name, vm->def->consoles[i]->info.alias))
+                chr = vm->def->consoles[i];
+        }
+        for (i = 0; !chr && i < vm->def->nserials; i++) {
+            if (STREQ(dev_name, vm->def->serials[i]->info.alias))
+                chr = vm->def->serials[i];
+        }
+        for (i = 0; !chr && i < vm->def->nparallels; i++) {
+            if (STREQ(dev_name, vm->def->parallels[i]->info.alias))
+                chr = vm->def->parallels[i];
+        }
+    } else {
+        if (vm->def->nconsoles)
+            chr = vm->def->consoles[0];
+        else if (vm->def->nserials)
+            chr = vm->def->serials[0];
+    }
 
-    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
-        goto endjob;
+    if (!chr) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot find character device %s"),
+                       NULLSTR(dev_name));
+        goto cleanup;
+    }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorBlockJobSetSpeed(qemuDomainGetMonitor(vm),
-                                      device,
-                                      speed);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_PTY) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("character device %s is not using a PTY"),
+                       dev_name ? dev_name : NULLSTR(chr->info.alias));
+        goto cleanup;
+    }
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    /* handle mutually exclusive access to console devices */
+    ret = virChrdevOpen(priv->devs,
+                        chr->source,
+                        st,
+                        (flags & VIR_DOMAIN_CONSOLE_FORCE) != 0);
+
+    if (ret == 1) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("Active console session exists for this domain"));
+        ret = -1;
+    }
 
  cleanup:
-    VIR_FREE(device);
     virDomainObjEndAPI(&vm);
-
     return ret;
 }
 
-
 static int
-qemuDomainBlockCopyValidateMirror(virStorageSourcePtr mirror,
-                                  const char *dst,
-                                  bool *reuse)
+qemuDomainOpenChannel(virDomainPtr dom,
+                      const char *name,
+                      virStreamPtr st,
+                      unsigned int flags)
 {
-    int desttype = virStorageSourceGetActualType(mirror);
-    struct stat st;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    size_t i;
+    virDomainChrDefPtr chr = NULL;
+    qemuDomainObjPrivatePtr priv;
 
-    if (virStorageFileAccess(mirror, F_OK) < 0) {
-        if (errno != ENOENT) {
-            virReportSystemError(errno, "%s",
-                                 _("unable to verify existence of "
-                                   "block copy target"));
-            return -1;
-        }
+    virCheckFlags(VIR_DOMAIN_CHANNEL_FORCE, -1);
 
-        if (*reuse || desttype == VIR_STORAGE_TYPE_BLOCK) {
-            virReportSystemError(errno,
-                                 _("missing destination file for disk %s: %s"),
-                                 dst, mirror->path);
-            return -1;
-        }
-    } else {
-        if (virStorageFileStat(mirror, &st) < 0) {
-            virReportSystemError(errno,
-                                 _("unable to stat block copy target '%s'"),
-                                 mirror->path);
-            return -1;
-        }
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
 
-        if (S_ISBLK(st.st_mode)) {
-            /* if the target is a block device, assume that we are reusing it,
-             * so there are no attempts to create it */
-            *reuse = true;
-        } else {
-            if (st.st_size && !(*reuse)) {
-                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                               _("external destination file for disk %s already "
-                                 "exists and is not a block device: %s"),
-                               dst, mirror->path);
-                return -1;
-            }
+    if (virDomainOpenChannelEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-            if (desttype == VIR_STORAGE_TYPE_BLOCK) {
-                virReportError(VIR_ERR_INVALID_ARG,
-                               _("blockdev flag requested for disk %s, but file "
-                                 "'%s' is not a block device"),
-                               dst, mirror->path);
-                return -1;
-            }
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (name) {
+        for (i = 0; !chr && i < vm->def->nchannels; i++) {
+            if (STREQ(name, vm->def->channels[i]->info.alias))
+                chr = vm->def->channels[i];
+
+            if (vm->def->channels[i]->targetType == \
+                VIR_DOMAIN_CHR_CHANNEL_TARGET_TYPE_VIRTIO &&
+                STREQ_NULLABLE(name, vm->def->channels[i]->target.name))
+                chr = vm->def->channels[i];
         }
+    } else {
+        if (vm->def->nchannels)
+            chr = vm->def->channels[0];
     }
 
-    return 0;
+    if (!chr) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("cannot find channel %s"),
+                       NULLSTR(name));
+        goto cleanup;
+    }
+
+    if (chr->source->type != VIR_DOMAIN_CHR_TYPE_UNIX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("channel %s is not using a UNIX socket"),
+                       name ? name : NULLSTR(chr->info.alias));
+        goto cleanup;
+    }
+
+    /* handle mutually exclusive access to channel devices */
+    ret = virChrdevOpen(priv->devs,
+                        chr->source,
+                        st,
+                        (flags & VIR_DOMAIN_CHANNEL_FORCE) != 0);
+
+    if (ret == 1) {
+        virReportError(VIR_ERR_OPERATION_FAILED, "%s",
+                       _("Active channel stream exists for this domain"));
+        ret = -1;
+    }
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
 }
 
 
-/* bandwidth in bytes/s.  Caller must lock vm beforehand, and not
- * access mirror afterwards.  */
+/* Called while holding the VM job lock, to implement a block job
+ * abort with pivot; this updates the VM definition as appropriate, on
+ * either success or failure.  */
 static int
-qemuDomainBlockCopyCommon(virDomainObjPtr vm,
-                          virConnectPtr conn,
-                          const char *path,
-                          virStorageSourcePtr mirror,
-                          unsigned long long bandwidth,
-                          unsigned int granularity,
-                          unsigned long long buf_size,
-                          unsigned int flags,
-                          bool keepParentLabel)
+qemuDomainBlockPivot(virQEMUDriverPtr driver,
+                     virDomainObjPtr vm,
+                     const char *device,
+                     virDomainDiskDefPtr disk)
 {
-    virQEMUDriverPtr driver = conn->privateData;
-    qemuDomainObjPrivatePtr priv;
-    char *device = NULL;
-    virDomainDiskDefPtr disk = NULL;
-    int ret = -1;
-    bool need_unlink = false;
-    virQEMUDriverConfigPtr cfg = NULL;
-    const char *format = NULL;
-    virErrorPtr monitor_error = NULL;
-    bool reuse = !!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT);
+    int ret = -1, rc;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuMonitorBlockJobInfo info;
+    virStorageSourcePtr oldsrc = NULL;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
-    /* Preliminaries: find the disk we are editing, sanity checks */
-    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
+    if (!disk->mirror) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("pivot of disk '%s' requires an active copy job"),
+                       disk->dst);
+        goto cleanup;
+    }
 
-    priv = vm->privateData;
-    cfg = virQEMUDriverGetConfig(driver);
+    /* Probe the status, if needed.  */
+    if (!disk->mirrorState) {
+        if ((rc = qemuBlockJobGetInfo(driver, vm, QEMU_ASYNC_JOB_NONE,
+                                      disk, &info)) < 0)
+            goto cleanup;
+        if (rc == 1 &&
+            (info.ready == 1 ||
+             (info.ready == -1 &&
+              info.end == info.cur &&
+              (info.type == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY ||
+               info.type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT))))
+            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
+    }
 
-    if (virStorageSourceIsRelative(mirror)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("absolute path must be used as block copy target"));
+    if (disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY) {
+        virReportError(VIR_ERR_BLOCK_COPY_ACTIVE,
+                       _("disk '%s' not ready for pivot yet"),
+                       disk->dst);
         goto cleanup;
     }
 
-    if (bandwidth > LLONG_MAX) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("bandwidth must be less than "
-                         "'%llu' bytes/s (%llu MiB/s)"),
-                       LLONG_MAX, LLONG_MAX >> 20);
+    /* When pivoting to a shareable disk we need to make sure that the disk can
+     * be safely shared, since block copy might have changed the format. */
+    if (disk->src->shared && !disk->src->readonly &&
+        !qemuBlockStorageSourceSupportsConcurrentAccess(disk->mirror)) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("can't pivot a shared disk to a storage volume not "
+                         "supporting sharing"));
+        goto cleanup;
+    }
+
+    /* For active commit, the mirror is part of the already labeled
+     * chain.  For blockcopy, we previously labeled only the top-level
+     * image; but if the user is reusing an external image that
+     * includes a backing file, the pivot may result in qemu needing
+     * to open the entire backing chain, so we need to label the
+     * entire chain.  This action is safe even if the backing chain
+     * has already been labeled; but only necessary when we know for
+     * sure that there is a backing chain.  */
+    if (disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_COPY) {
+        oldsrc = disk->src;
+        disk->src = disk->mirror;
+
+        if (qemuDomainDetermineDiskChain(driver, vm, disk, true) < 0)
+            goto cleanup;
+
+        if (disk->mirror->format &&
+            disk->mirror->format != VIR_STORAGE_FILE_RAW &&
+            (qemuDomainNamespaceSetupDisk(vm, disk->src) < 0 ||
+             qemuSetupDiskCgroup(vm, disk) < 0 ||
+             qemuSecuritySetDiskLabel(driver, vm, disk) < 0))
+            goto cleanup;
+
+        disk->src = oldsrc;
+        oldsrc = NULL;
+    }
+
+    /* Attempt the pivot.  Record the attempt now, to prevent duplicate
+     * attempts; but the actual disk change will be made when emitting
+     * the event.
+     * XXX On libvirtd restarts, if we missed the qemu event, we need
+     * to double check what state qemu is in.
+     * XXX We should be using qemu's rerror flag to make sure the job
+     * remains alive until we know its final state.
+     * XXX If the abort command is synchronous but the qemu event says
+     * that pivot failed, we need to reflect that failure into the
+     * overall return value.  */
+    disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_PIVOT;
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorDrivePivot(priv->mon, device);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (ret < 0) {
+        /* The pivot failed. The block job in QEMU remains in the synchronised
+         * phase. Reset the state we changed and return the error to the user */
+        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
+    }
+
+ cleanup:
+    if (oldsrc)
+        disk->src = oldsrc;
+
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
+/* bandwidth in MiB/s per public API. Caller must lock vm beforehand,
+ * and not access it afterwards.  */
+static int
+qemuDomainBlockPullCommon(virQEMUDriverPtr driver,
+                          virDomainObjPtr vm,
+                          const char *path,
+                          const char *base,
+                          unsigned long bandwidth,
+                          unsigned int flags)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    char *device = NULL;
+    virDomainDiskDefPtr disk;
+    virStorageSourcePtr baseSource = NULL;
+    unsigned int baseIndex = 0;
+    char *basePath = NULL;
+    char *backingPath = NULL;
+    unsigned long long speed = bandwidth;
+    int ret = -1;
+
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE && !base) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("flag VIR_DOMAIN_BLOCK_REBASE_RELATIVE is valid only "
+                         "with non-null base"));
         goto cleanup;
     }
 
@@ -17453,6 +17784,9 @@ qemuDomainBlockCopyCommon(virDomainObjPtr vm,
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
+    if (qemuDomainSupportsBlockJobs(vm) < 0)
+        goto endjob;
+
     if (!(disk = qemuDomainDiskByName(vm->def, path)))
         goto endjob;
 
@@ -17462,568 +17796,467 @@ qemuDomainBlockCopyCommon(virDomainObjPtr vm,
     if (qemuDomainDiskBlockJobIsActive(disk))
         goto endjob;
 
-    if (disk->device == VIR_DOMAIN_DISK_DEVICE_LUN &&
-        qemuDomainDefValidateDiskLunSource(mirror) < 0)
+    if (base &&
+        (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
+         !(baseSource = virStorageFileChainLookup(disk->src, disk->src,
+                                                  base, baseIndex, NULL))))
         goto endjob;
 
-    if (!(virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_MIRROR) &&
-          virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKJOB_ASYNC))) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                       _("block copy is not supported with this QEMU binary"));
-        goto endjob;
-    }
-    if (!(flags & VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB) &&
-        vm->persistent) {
-        /* XXX if qemu ever lets us start a new domain with mirroring
-         * already active, we can relax this; but for now, the risk of
-         * 'managedsave' due to libvirt-guests means we can't risk
-         * this on persistent domains.  */
-        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                       _("domain is not transient"));
-        goto endjob;
-    }
-
-    /* clear the _SHALLOW flag if there is only one layer */
-    if (!virStorageSourceHasBacking(disk->src))
-        flags &= ~VIR_DOMAIN_BLOCK_COPY_SHALLOW;
-
-    /* unless the user provides a pre-created file, shallow copy into a raw
-     * file is not possible */
-    if ((flags & VIR_DOMAIN_BLOCK_COPY_SHALLOW) && !reuse &&
-        mirror->format == VIR_STORAGE_FILE_RAW) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("shallow copy of disk '%s' into a raw file "
-                         "is not possible"),
-                       disk->dst);
-        goto endjob;
-    }
-
-    /* Prepare the destination file.  */
-    /* XXX Allow non-file mirror destinations */
-    if (!virStorageSourceIsLocalStorage(mirror)) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("non-file destination not supported yet"));
-        goto endjob;
-    }
-
-    if (qemuDomainStorageFileInit(driver, vm, mirror, NULL) < 0)
-        goto endjob;
+    if (baseSource) {
+        if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
+            if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                               _("this QEMU binary doesn't support relative "
+                                 "block pull/rebase"));
+                goto endjob;
+            }
 
-    if (qemuDomainBlockCopyValidateMirror(mirror, disk->dst, &reuse) < 0)
-        goto endjob;
+            if (virStorageFileGetRelativeBackingPath(disk->src->backingStore,
+                                                     baseSource,
+                                                     &backingPath) < 0)
+                goto endjob;
 
-    if (!mirror->format) {
-        if (!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT)) {
-            mirror->format = disk->src->format;
-        } else {
-            /* If the user passed the REUSE_EXT flag, then either they
-             * can also pass the RAW flag or use XML to tell us the format.
-             * So if we get here, we assume it is safe for us to probe the
-             * format from the file that we will be using.  */
-            mirror->format = virStorageFileProbeFormat(mirror->path, cfg->user,
-                                                       cfg->group);
+            if (!backingPath) {
+                virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                               _("can't keep relative backing relationship"));
+                goto endjob;
+            }
         }
     }
 
-    /* pre-create the image file */
-    if (!reuse) {
-        if (virStorageFileCreate(mirror) < 0) {
-            virReportSystemError(errno, "%s", _("failed to create copy target"));
+    /* Convert bandwidth MiB to bytes, if needed */
+    if (!(flags & VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
             goto endjob;
         }
-
-        need_unlink = true;
-    }
-
-    if (mirror->format > 0)
-        format = virStorageFileFormatTypeToString(mirror->format);
-
-    if (virStorageSourceInitChainElement(mirror, disk->src,
-                                         keepParentLabel) < 0)
-        goto endjob;
-
-    if (qemuDomainDiskChainElementPrepare(driver, vm, mirror, false, true) < 0) {
-        qemuDomainDiskChainElementRevoke(driver, vm, mirror);
-        goto endjob;
+        speed <<= 20;
     }
 
-    /* Actually start the mirroring */
     qemuDomainObjEnterMonitor(driver, vm);
-    /* qemuMonitorDriveMirror needs to honor the REUSE_EXT flag as specified
-     * by the user regardless of how @reuse was modified */
-    ret = qemuMonitorDriveMirror(priv->mon, device, mirror->path, format,
-                                 bandwidth, granularity, buf_size, flags);
-    virDomainAuditDisk(vm, NULL, mirror, "mirror", ret >= 0);
+    if (baseSource)
+        basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                             baseSource);
+    if (!baseSource || basePath)
+        ret = qemuMonitorBlockStream(priv->mon, device, basePath, backingPath,
+                                     speed);
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
         ret = -1;
-    if (ret < 0) {
-        monitor_error = virSaveLastError();
-        qemuDomainDiskChainElementRevoke(driver, vm, mirror);
+
+    if (ret < 0)
         goto endjob;
-    }
 
-    /* Update vm in place to match changes.  */
-    need_unlink = false;
-    virStorageFileDeinit(mirror);
-    disk->mirror = mirror;
-    mirror = NULL;
-    disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
     QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+    qemuBlockJobStarted(disk);
 
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
 
  endjob:
-    if (need_unlink && virStorageFileUnlink(mirror) < 0)
-        VIR_WARN("%s", _("unable to remove just-created copy target"));
-    virStorageFileDeinit(mirror);
     qemuDomainObjEndJob(driver, vm);
-    if (monitor_error) {
-        virSetError(monitor_error);
-        virFreeError(monitor_error);
-    }
 
  cleanup:
-    VIR_FREE(device);
     virObjectUnref(cfg);
-    virStorageSourceFree(mirror);
+    VIR_FREE(basePath);
+    VIR_FREE(backingPath);
+    VIR_FREE(device);
+    virDomainObjEndAPI(&vm);
     return ret;
 }
 
+
 static int
-qemuDomainBlockRebase(virDomainPtr dom, const char *path, const char *base,
-                      unsigned long bandwidth, unsigned int flags)
+qemuDomainBlockJobAbort(virDomainPtr dom,
+                        const char *path,
+                        unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
+    char *device = NULL;
+    virDomainDiskDefPtr disk = NULL;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    bool save = false;
+    bool pivot = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT);
+    bool async = !!(flags & VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC);
     virDomainObjPtr vm;
     int ret = -1;
-    unsigned long long speed = bandwidth;
-    virStorageSourcePtr dest = NULL;
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
-                  VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY_RAW |
-                  VIR_DOMAIN_BLOCK_REBASE_RELATIVE |
-                  VIR_DOMAIN_BLOCK_REBASE_COPY_DEV |
-                  VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES, -1);
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_ABORT_ASYNC |
+                  VIR_DOMAIN_BLOCK_JOB_ABORT_PIVOT, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         return -1;
 
-    if (virDomainBlockRebaseEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainBlockJobAbortEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    /* For normal rebase (enhanced blockpull), the common code handles
-     * everything, including vm cleanup. */
-    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_COPY))
-        return qemuDomainBlockPullCommon(driver, vm, path, base, bandwidth, flags);
-
-    /* If we got here, we are doing a block copy rebase. */
-    if (VIR_ALLOC(dest) < 0)
-        goto cleanup;
-    dest->type = (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_DEV) ?
-        VIR_STORAGE_TYPE_BLOCK : VIR_STORAGE_TYPE_FILE;
-    if (VIR_STRDUP(dest->path, base) < 0)
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_RAW)
-        dest->format = VIR_STORAGE_FILE_RAW;
-
-    /* Convert bandwidth MiB to bytes, if necessary */
-    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES)) {
-        if (speed > LLONG_MAX >> 20) {
-            virReportError(VIR_ERR_OVERFLOW,
-                           _("bandwidth must be less than %llu"),
-                           LLONG_MAX >> 20);
-            goto cleanup;
-        }
-        speed <<= 20;
-    }
 
-    /* XXX: If we are doing a shallow copy but not reusing an external
-     * file, we should attempt to pre-create the destination with a
-     * relative backing chain instead of qemu's default of absolute */
-    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Relative backing during copy not supported yet"));
-        goto cleanup;
-    }
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-    /* We rely on the fact that VIR_DOMAIN_BLOCK_REBASE_SHALLOW
-     * and VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT map to the same values
-     * as for block copy. */
-    flags &= (VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
-              VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT);
-    ret = qemuDomainBlockCopyCommon(vm, dom->conn, path, dest,
-                                    speed, 0, 0, flags, true);
-    dest = NULL;
+    if (qemuDomainSupportsBlockJobs(vm) < 0)
+        goto endjob;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    virStorageSourceFree(dest);
-    return ret;
-}
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
 
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+        goto endjob;
 
-static int
-qemuDomainBlockCopy(virDomainPtr dom, const char *disk, const char *destxml,
-                    virTypedParameterPtr params, int nparams,
-                    unsigned int flags)
-{
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
-    unsigned long long bandwidth = 0;
-    unsigned int granularity = 0;
-    unsigned long long buf_size = 0;
-    virDomainDiskDefPtr diskdef = NULL;
-    virStorageSourcePtr dest = NULL;
-    size_t i;
+    if (disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_NONE &&
+        disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("another job on disk '%s' is still being ended"),
+                       disk->dst);
+        goto endjob;
+    }
 
-    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
-                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
-    if (virTypedParamsValidate(params, nparams,
-                               VIR_DOMAIN_BLOCK_COPY_BANDWIDTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_COPY_GRANULARITY,
-                               VIR_TYPED_PARAM_UINT,
-                               VIR_DOMAIN_BLOCK_COPY_BUF_SIZE,
-                               VIR_TYPED_PARAM_ULLONG,
-                               NULL) < 0)
-        return -1;
+    if (!async)
+        qemuBlockJobSyncBegin(disk);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+    if (pivot) {
+        if ((ret = qemuDomainBlockPivot(driver, vm, device, disk)) < 0)
+            goto endjob;
+    } else {
+        if (disk->mirror) {
+            disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_ABORT;
+            save = true;
+        }
 
-    if (virDomainBlockCopyEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        qemuDomainObjEnterMonitor(driver, vm);
+        ret = qemuMonitorBlockJobCancel(qemuDomainGetMonitor(vm), device);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0) {
+            ret = -1;
+            goto endjob;
+        }
+        qemuBlockJobInfoInvalidate(disk);
 
-    for (i = 0; i < nparams; i++) {
-        virTypedParameterPtr param = &params[i];
-
-        /* Typed params (wisely) refused to expose unsigned long, but
-         * back-compat demands that we stick with a maximum of
-         * unsigned long bandwidth in MiB/s, while our value is
-         * unsigned long long in bytes/s.  Hence, we have to do
-         * overflow detection if this is a 32-bit server handling a
-         * 64-bit client.  */
-        if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BANDWIDTH)) {
-            if (sizeof(unsigned long)< sizeof(bandwidth) &&
-                param->value.ul > ULONG_MAX * (1ULL << 20)) {
-                virReportError(VIR_ERR_OVERFLOW,
-                               _("bandwidth must be less than %llu bytes"),
-                               ULONG_MAX * (1ULL << 20));
-                goto cleanup;
-            }
-            bandwidth = param->value.ul;
-        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_GRANULARITY)) {
-            if (param->value.ui != VIR_ROUND_UP_POWER_OF_TWO(param->value.ui)) {
-                virReportError(VIR_ERR_INVALID_ARG, "%s",
-                               _("granularity must be power of 2"));
-                goto cleanup;
-            }
-            granularity = param->value.ui;
-        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BUF_SIZE)) {
-            buf_size = param->value.ul;
+        if (ret < 0) {
+            if (disk->mirror)
+                disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+            goto endjob;
         }
     }
 
-    if (!(diskdef = virDomainDiskDefParse(destxml, vm->def, driver->xmlopt,
-                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
-                                          VIR_DOMAIN_DEF_PARSE_DISK_SOURCE)))
-        goto cleanup;
+    /* If we have made changes to XML due to a copy job, make a best
+     * effort to save it now.  But we can ignore failure, since there
+     * will be further changes when the event marks completion.  */
+    if (save)
+        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
 
-    VIR_STEAL_PTR(dest, diskdef->src);
+    /*
+     * With the ABORT_ASYNC flag we don't need to do anything, the event will
+     * come from qemu and will update the XML as appropriate, but without the
+     * ABORT_ASYNC flag, we must block to guarantee synchronous operation.  We
+     * do the waiting while still holding the VM job, to prevent newly
+     * scheduled block jobs from confusing us. */
+    if (!async) {
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        qemuBlockJobUpdate(vm, QEMU_ASYNC_JOB_NONE, disk, NULL);
+        while (diskPriv->blockjob) {
+            if (virDomainObjWait(vm) < 0) {
+                ret = -1;
+                goto endjob;
+            }
+            qemuBlockJobUpdate(vm, QEMU_ASYNC_JOB_NONE, disk, NULL);
+        }
+    }
 
-    ret = qemuDomainBlockCopyCommon(vm, dom->conn, disk, dest, bandwidth,
-                                    granularity, buf_size, flags, false);
+ endjob:
+    if (disk)
+        qemuBlockJobSyncEnd(vm, QEMU_ASYNC_JOB_NONE, disk);
+    qemuDomainObjEndJob(driver, vm);
 
  cleanup:
-    virDomainDiskDefFree(diskdef);
+    virObjectUnref(cfg);
+    VIR_FREE(device);
     virDomainObjEndAPI(&vm);
     return ret;
 }
 
 
 static int
-qemuDomainBlockPull(virDomainPtr dom, const char *path, unsigned long bandwidth,
-                    unsigned int flags)
+qemuBlockJobInfoTranslate(qemuMonitorBlockJobInfoPtr rawInfo,
+                          virDomainBlockJobInfoPtr info,
+                          virDomainDiskDefPtr disk,
+                          bool reportBytes)
 {
-    virDomainObjPtr vm;
-    virCheckFlags(VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES, -1);
+    info->cur = rawInfo->cur;
+    info->end = rawInfo->end;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+    /* Fix job completeness reporting. If cur == end mgmt
+     * applications think job is completed. Except when both cur
+     * and end are zero, in which case qemu hasn't started the
+     * job yet. */
+    if (!info->cur && !info->end) {
+        if (rawInfo->ready > 0) {
+            info->cur = info->end = 1;
+        } else if (!rawInfo->ready) {
+            info->end = 1;
+        }
+    }
 
-    if (virDomainBlockPullEnsureACL(dom->conn, vm->def) < 0) {
-        virDomainObjEndAPI(&vm);
+    info->type = rawInfo->type;
+    if (info->type == VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT &&
+        disk->mirrorJob == VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT)
+        info->type = disk->mirrorJob;
+
+    if (rawInfo->bandwidth && !reportBytes)
+        rawInfo->bandwidth = VIR_DIV_UP(rawInfo->bandwidth, 1024 * 1024);
+    info->bandwidth = rawInfo->bandwidth;
+    if (info->bandwidth != rawInfo->bandwidth) {
+        virReportError(VIR_ERR_OVERFLOW,
+                       _("bandwidth %llu cannot be represented in result"),
+                       rawInfo->bandwidth);
         return -1;
     }
 
-    return qemuDomainBlockPullCommon(dom->conn->privateData,
-                                     vm, path, NULL, bandwidth, flags);
+    return 0;
 }
 
 
 static int
-qemuDomainBlockCommit(virDomainPtr dom,
-                      const char *path,
-                      const char *base,
-                      const char *top,
-                      unsigned long bandwidth,
-                      unsigned int flags)
+qemuDomainGetBlockJobInfo(virDomainPtr dom,
+                          const char *path,
+                          virDomainBlockJobInfoPtr info,
+                          unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
-    virQEMUDriverConfigPtr cfg = NULL;
-    qemuDomainObjPrivatePtr priv;
-    virDomainObjPtr vm = NULL;
-    char *device = NULL;
+    virDomainObjPtr vm;
+    virDomainDiskDefPtr disk;
     int ret = -1;
-    virDomainDiskDefPtr disk = NULL;
-    virStorageSourcePtr topSource;
-    unsigned int topIndex = 0;
-    virStorageSourcePtr baseSource = NULL;
-    unsigned int baseIndex = 0;
-    virStorageSourcePtr top_parent = NULL;
-    bool clean_access = false;
-    char *topPath = NULL;
-    char *basePath = NULL;
-    char *backingPath = NULL;
-    virStorageSourcePtr mirror = NULL;
-    unsigned long long speed = bandwidth;
+    qemuMonitorBlockJobInfo rawInfo;
 
-    /* XXX Add support for COMMIT_DELETE */
-    virCheckFlags(VIR_DOMAIN_BLOCK_COMMIT_SHALLOW |
-                  VIR_DOMAIN_BLOCK_COMMIT_ACTIVE |
-                  VIR_DOMAIN_BLOCK_COMMIT_RELATIVE |
-                  VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES, -1);
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
-    priv = vm->privateData;
-    cfg = virQEMUDriverGetConfig(driver);
+        return -1;
 
-    if (virDomainBlockCommitEnsureACL(dom->conn, vm->def) < 0)
+    if (virDomainGetBlockJobInfoEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
         goto cleanup;
 
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
-    /* Ensure that no one backports commit to RHEL 6.2, where cancel
-     * behaved differently */
-    if (!(virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCK_COMMIT) &&
-          virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKJOB_ASYNC))) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                       _("online commit not supported with this QEMU binary"));
+
+    if (qemuDomainSupportsBlockJobs(vm) < 0)
+        goto endjob;
+
+    if (!(disk = virDomainDiskByName(vm->def, path, true))) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("disk %s not found in the domain"), path);
         goto endjob;
     }
 
-    /* Convert bandwidth MiB to bytes, if necessary */
-    if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES)) {
+    ret = qemuBlockJobGetInfo(driver, vm, QEMU_ASYNC_JOB_NONE, disk, &rawInfo);
+    if (ret <= 0)
+        goto endjob;
+
+    if (qemuBlockJobInfoTranslate(&rawInfo, info, disk,
+                                  flags & VIR_DOMAIN_BLOCK_JOB_INFO_BANDWIDTH_BYTES) < 0) {
+        ret = -1;
+        goto endjob;
+    }
+
+    /* Snoop block copy operations, so future cancel operations can
+     * avoid checking if pivot is safe.  Save the change to XML, but
+     * we can ignore failure because it is only an optimization.  We
+     * hold the vm lock, so modifying the in-memory representation is
+     * safe, even if we are a query rather than a modify job. */
+    if (disk->mirror &&
+        rawInfo.ready != 0 &&
+        info->cur == info->end && !disk->mirrorState) {
+        virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+
+        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_READY;
+        ignore_value(virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps));
+        virObjectUnref(cfg);
+    }
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainBlockJobSetSpeed(virDomainPtr dom,
+                           const char *path,
+                           unsigned long bandwidth,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainDiskDefPtr disk;
+    int ret = -1;
+    virDomainObjPtr vm;
+    char *device = NULL;
+    unsigned long long speed = bandwidth;
+
+    virCheckFlags(VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES, -1);
+
+    /* Convert bandwidth MiB to bytes, if needed */
+    if (!(flags & VIR_DOMAIN_BLOCK_JOB_SPEED_BANDWIDTH_BYTES)) {
         if (speed > LLONG_MAX >> 20) {
             virReportError(VIR_ERR_OVERFLOW,
                            _("bandwidth must be less than %llu"),
                            LLONG_MAX >> 20);
-            goto endjob;
+            return -1;
         }
         speed <<= 20;
     }
 
-    if (!(disk = qemuDomainDiskByName(vm->def, path)))
-        goto endjob;
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
 
-    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+    if (virDomainBlockJobSetSpeedEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    if (!disk->src->path) {
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("disk %s has no source file to be committed"),
-                       disk->dst);
+    if (qemuDomainSupportsBlockJobs(vm) < 0)
         goto endjob;
-    }
 
-    if (qemuDomainDiskBlockJobIsActive(disk))
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
         goto endjob;
 
-    if (!top || STREQ(top, disk->dst))
-        topSource = disk->src;
-    else if (virStorageFileParseChainIndex(disk->dst, top, &topIndex) < 0 ||
-             !(topSource = virStorageFileChainLookup(disk->src, NULL,
-                                                     top, topIndex,
-                                                     &top_parent)))
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
         goto endjob;
 
-    if (topSource == disk->src) {
-        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_ACTIVE_COMMIT)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("active commit not supported with this QEMU binary"));
-            goto endjob;
-        }
-        /* XXX Should we auto-pivot when COMMIT_ACTIVE is not specified? */
-        if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE)) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("commit of '%s' active layer requires active flag"),
-                           disk->dst);
-            goto endjob;
-        }
-    } else if (flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("active commit requested but '%s' is not active"),
-                       topSource->path);
-        goto endjob;
-    }
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorBlockJobSetSpeed(qemuDomainGetMonitor(vm),
+                                      device,
+                                      speed);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
 
-    if (!virStorageSourceHasBacking(topSource)) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("top '%s' in chain for '%s' has no backing file"),
-                       topSource->path, path);
-        goto endjob;
-    }
+    qemuBlockJobInfoInvalidate(disk);
 
-    if (!base && (flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW))
-        baseSource = topSource->backingStore;
-    else if (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
-             !(baseSource = virStorageFileChainLookup(disk->src, topSource,
-                                                      base, baseIndex, NULL)))
-        goto endjob;
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
 
-    if ((flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW) &&
-        baseSource != topSource->backingStore) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("base '%s' is not immediately below '%s' in chain "
-                         "for '%s'"),
-                       base, topSource->path, path);
-        goto endjob;
-    }
+ cleanup:
+    VIR_FREE(device);
+    virDomainObjEndAPI(&vm);
 
-    /* For an active commit, clone enough of the base to act as the mirror */
-    if (topSource == disk->src) {
-        if (!(mirror = virStorageSourceCopy(baseSource, false)))
-            goto endjob;
-        if (virStorageSourceInitChainElement(mirror,
-                                             disk->src,
-                                             true) < 0)
-            goto endjob;
-    }
+    return ret;
+}
 
-    if (flags & VIR_DOMAIN_BLOCK_COMMIT_RELATIVE &&
-        topSource != disk->src) {
-        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("this qemu doesn't support relative block commit"));
-            goto endjob;
-        }
 
-        if (virStorageFileGetRelativeBackingPath(topSource, baseSource,
-                                                 &backingPath) < 0)
-            goto endjob;
+static int
+qemuDomainBlockCopyValidateMirror(virStorageSourcePtr mirror,
+                                  const char *dst,
+                                  bool *reuse)
+{
+    int desttype = virStorageSourceGetActualType(mirror);
+    struct stat st;
 
-        if (!backingPath) {
-            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
-                           _("can't keep relative backing relationship"));
-            goto endjob;
+    if (virStorageFileAccess(mirror, F_OK) < 0) {
+        if (errno != ENOENT) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to verify existence of "
+                                   "block copy target"));
+            return -1;
         }
-    }
-
-    /* For the commit to succeed, we must allow qemu to open both the
-     * 'base' image and the parent of 'top' as read/write; 'top' might
-     * not have a parent, or might already be read-write.  XXX It
-     * would also be nice to revert 'base' to read-only, as well as
-     * revoke access to files removed from the chain, when the commit
-     * operation succeeds, but doing that requires tracking the
-     * operation in XML across libvirtd restarts.  */
-    clean_access = true;
-    if (qemuDomainDiskChainElementPrepare(driver, vm, baseSource, false, false) < 0 ||
-        (top_parent && top_parent != disk->src &&
-         qemuDomainDiskChainElementPrepare(driver, vm, top_parent, false, false) < 0))
-        goto endjob;
-
-    /* Start the commit operation.  Pass the user's original spelling,
-     * if any, through to qemu, since qemu may behave differently
-     * depending on whether the input was specified as relative or
-     * absolute (that is, our absolute top_canon may do the wrong
-     * thing if the user specified a relative name).  Be prepared for
-     * a ready event to occur while locks are dropped.  */
-    if (mirror) {
-        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
-        disk->mirror = mirror;
-        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT;
-    }
-    qemuDomainObjEnterMonitor(driver, vm);
-    basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                         baseSource);
-    topPath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
-                                        topSource);
-    if (basePath && topPath)
-        ret = qemuMonitorBlockCommit(priv->mon, device,
-                                     topPath, basePath, backingPath,
-                                     speed);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0) {
-        ret = -1;
-        goto endjob;
-    }
 
-    if (ret == 0) {
-        QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
-        mirror = NULL;
+        if (*reuse || desttype == VIR_STORAGE_TYPE_BLOCK) {
+            virReportSystemError(errno,
+                                 _("missing destination file for disk %s: %s"),
+                                 dst, mirror->path);
+            return -1;
+        }
     } else {
-        disk->mirror = NULL;
-        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
-    }
-
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
-        VIR_WARN("Unable to save status on vm %s after block job",
-                 vm->def->name);
+        if (virStorageFileStat(mirror, &st) < 0) {
+            virReportSystemError(errno,
+                                 _("unable to stat block copy target '%s'"),
+                                 mirror->path);
+            return -1;
+        }
 
- endjob:
-    if (ret < 0 && clean_access) {
-        virErrorPtr orig_err = virSaveLastError();
-        /* Revert access to read-only, if possible.  */
-        qemuDomainDiskChainElementPrepare(driver, vm, baseSource, true, false);
-        if (top_parent && top_parent != disk->src)
-            qemuDomainDiskChainElementPrepare(driver, vm, top_parent, true, false);
+        if (S_ISBLK(st.st_mode)) {
+            /* if the target is a block device, assume that we are reusing it,
+             * so there are no attempts to create it */
+            *reuse = true;
+        } else {
+            if (st.st_size && !(*reuse)) {
+                virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                               _("external destination file for disk %s already "
+                                 "exists and is not a block device: %s"),
+                               dst, mirror->path);
+                return -1;
+            }
 
-        if (orig_err) {
-            virSetError(orig_err);
-            virFreeError(orig_err);
+            if (desttype == VIR_STORAGE_TYPE_BLOCK) {
+                virReportError(VIR_ERR_INVALID_ARG,
+                               _("blockdev flag requested for disk %s, but file "
+                                 "'%s' is not a block device"),
+                               dst, mirror->path);
+                return -1;
+            }
         }
     }
-    virStorageSourceFree(mirror);
-    qemuDomainObjEndJob(driver, vm);
 
- cleanup:
-    VIR_FREE(topPath);
-    VIR_FREE(basePath);
-    VIR_FREE(backingPath);
-    VIR_FREE(device);
-    virObjectUnref(cfg);
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return 0;
 }
 
+
+/* bandwidth in bytes/s.  Caller must lock vm beforehand, and not
+ * access mirror afterwards.  */
 static int
-qemuDomainOpenGraphics(virDomainPtr dom,
-                       unsigned int idx,
-                       int fd,
-                       unsigned int flags)
+qemuDomainBlockCopyCommon(virDomainObjPtr vm,
+                          virConnectPtr conn,
+                          const char *path,
+                          virStorageSourcePtr mirror,
+                          unsigned long long bandwidth,
+                          unsigned int granularity,
+                          unsigned long long buf_size,
+                          unsigned int flags,
+                          bool keepParentLabel)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
+    virQEMUDriverPtr driver = conn->privateData;
     qemuDomainObjPrivatePtr priv;
-    const char *protocol;
+    char *device = NULL;
+    virDomainDiskDefPtr disk = NULL;
+    int ret = -1;
+    bool need_unlink = false;
+    virQEMUDriverConfigPtr cfg = NULL;
+    const char *format = NULL;
+    virErrorPtr monitor_error = NULL;
+    bool reuse = !!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT);
 
-    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+    /* Preliminaries: find the disk we are editing, sanity checks */
+    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+    priv = vm->privateData;
+    cfg = virQEMUDriverGetConfig(driver);
 
-    if (virDomainOpenGraphicsEnsureACL(dom->conn, vm->def) < 0)
+    if (virStorageSourceIsRelative(mirror)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("absolute path must be used as block copy target"));
+        goto cleanup;
+    }
+
+    if (bandwidth > LLONG_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("bandwidth must be less than "
+                         "'%llu' bytes/s (%llu MiB/s)"),
+                       LLONG_MAX, LLONG_MAX >> 20);
         goto cleanup;
+    }
 
     if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
@@ -18031,2583 +18264,4893 @@ qemuDomainOpenGraphics(virDomainPtr dom,
     if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
 
-    priv = vm->privateData;
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
 
-    if (idx >= vm->def->ngraphics) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("No graphics backend with index %d"), idx);
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
         goto endjob;
-    }
-    switch (vm->def->graphics[idx]->type) {
-    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
-        protocol = "vnc";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
-        protocol = "spice";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
-    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Can only open VNC or SPICE graphics backends, not %s"),
-                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
+
+    if (qemuDomainDiskBlockJobIsActive(disk))
         goto endjob;
-    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
-    default:
-        virReportEnumRangeError(virDomainGraphicsType,
-                                vm->def->graphics[idx]->type);
+
+    if (disk->device == VIR_DOMAIN_DISK_DEVICE_LUN &&
+        qemuDomainDefValidateDiskLunSource(mirror) < 0)
+        goto endjob;
+
+    if (!(virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_MIRROR) &&
+          virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKJOB_ASYNC))) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("block copy is not supported with this QEMU binary"));
+        goto endjob;
+    }
+    if (!(flags & VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB) &&
+        vm->persistent) {
+        /* XXX if qemu ever lets us start a new domain with mirroring
+         * already active, we can relax this; but for now, the risk of
+         * 'managedsave' due to libvirt-guests means we can't risk
+         * this on persistent domains.  */
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("domain is not transient"));
         goto endjob;
     }
 
-    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
+    /* clear the _SHALLOW flag if there is only one layer */
+    if (!virStorageSourceHasBacking(disk->src))
+        flags &= ~VIR_DOMAIN_BLOCK_COPY_SHALLOW;
+
+    /* unless the user provides a pre-created file, shallow copy into a raw
+     * file is not possible */
+    if ((flags & VIR_DOMAIN_BLOCK_COPY_SHALLOW) && !reuse &&
+        mirror->format == VIR_STORAGE_FILE_RAW) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("shallow copy of disk '%s' into a raw file "
+                         "is not possible"),
+                       disk->dst);
+        goto endjob;
+    }
+
+    /* Prepare the destination file.  */
+    /* XXX Allow non-file mirror destinations */
+    if (!virStorageSourceIsLocalStorage(mirror)) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("non-file destination not supported yet"));
+        goto endjob;
+    }
+
+    if (qemuDomainStorageFileInit(driver, vm, mirror, NULL) < 0)
+        goto endjob;
+
+    if (qemuDomainBlockCopyValidateMirror(mirror, disk->dst, &reuse) < 0)
+        goto endjob;
+
+    if (!mirror->format) {
+        if (!(flags & VIR_DOMAIN_BLOCK_COPY_REUSE_EXT)) {
+            mirror->format = disk->src->format;
+        } else {
+            /* If the user passed the REUSE_EXT flag, then either they
+             * can also pass the RAW flag or use XML to tell us the format.
+             * So if we get here, we assume it is safe for us to probe the
+             * format from the file that we will be using.  */
+            mirror->format = virStorageFileProbeFormat(mirror->path, cfg->user,
+                                                       cfg->group);
+        }
+    }
+
+    /* pre-create the image file */
+    if (!reuse) {
+        if (virStorageFileCreate(mirror) < 0) {
+            virReportSystemError(errno, "%s", _("failed to create copy target"));
+            goto endjob;
+        }
+
+        need_unlink = true;
+    }
+
+    if (mirror->format > 0)
+        format = virStorageFileFormatTypeToString(mirror->format);
+
+    if (virStorageSourceInitChainElement(mirror, disk->src,
+                                         keepParentLabel) < 0)
+        goto endjob;
+
+    if (qemuDomainDiskChainElementPrepare(driver, vm, mirror, false, true) < 0) {
+        qemuDomainDiskChainElementRevoke(driver, vm, mirror);
         goto endjob;
+    }
 
+    /* Actually start the mirroring */
     qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorOpenGraphics(priv->mon, protocol, fd, "graphicsfd",
-                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) != 0);
+    /* qemuMonitorDriveMirror needs to honor the REUSE_EXT flag as specified
+     * by the user regardless of how @reuse was modified */
+    ret = qemuMonitorDriveMirror(priv->mon, device, mirror->path, format,
+                                 bandwidth, granularity, buf_size, flags);
+    virDomainAuditDisk(vm, NULL, mirror, "mirror", ret >= 0);
     if (qemuDomainObjExitMonitor(driver, vm) < 0)
         ret = -1;
+    if (ret < 0) {
+        monitor_error = virSaveLastError();
+        qemuDomainDiskChainElementRevoke(driver, vm, mirror);
+        goto endjob;
+    }
+
+    /* Update vm in place to match changes.  */
+    need_unlink = false;
+    virStorageFileDeinit(mirror);
+    disk->mirror = mirror;
+    mirror = NULL;
+    disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
+    QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+    qemuBlockJobStarted(disk);
+
+    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        VIR_WARN("Unable to save status on vm %s after state change",
+                 vm->def->name);
 
  endjob:
+    if (need_unlink && virStorageFileUnlink(mirror) < 0)
+        VIR_WARN("%s", _("unable to remove just-created copy target"));
+    virStorageFileDeinit(mirror);
     qemuDomainObjEndJob(driver, vm);
+    if (monitor_error) {
+        virSetError(monitor_error);
+        virFreeError(monitor_error);
+    }
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    VIR_FREE(device);
+    virObjectUnref(cfg);
+    virStorageSourceFree(mirror);
     return ret;
 }
 
 static int
-qemuDomainOpenGraphicsFD(virDomainPtr dom,
-                         unsigned int idx,
-                         unsigned int flags)
+qemuDomainBlockRebase(virDomainPtr dom, const char *path, const char *base,
+                      unsigned long bandwidth, unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
+    virDomainObjPtr vm;
     int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    const char *protocol;
-    int pair[2] = {-1, -1};
+    unsigned long long speed = bandwidth;
+    virStorageSourcePtr dest = NULL;
 
-    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+    virCheckFlags(VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
+                  VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY_RAW |
+                  VIR_DOMAIN_BLOCK_REBASE_RELATIVE |
+                  VIR_DOMAIN_BLOCK_REBASE_COPY_DEV |
+                  VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
         return -1;
 
-    if (virDomainOpenGraphicsFdEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (virDomainObjCheckActive(vm) < 0)
+    if (virDomainBlockRebaseEnsureACL(dom->conn, vm->def) < 0)
         goto cleanup;
 
-    priv = vm->privateData;
-
-    if (idx >= vm->def->ngraphics) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("No graphics backend with index %d"), idx);
-        goto cleanup;
-    }
-    switch (vm->def->graphics[idx]->type) {
-    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
-        protocol = "vnc";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
-        protocol = "spice";
-        break;
-    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
-    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
-    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
-        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
-                       _("Can only open VNC or SPICE graphics backends, not %s"),
-                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
-        goto cleanup;
-    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
-    default:
-        virReportEnumRangeError(virDomainGraphicsType,
-                                vm->def->graphics[idx]->type);
-        goto cleanup;
-    }
+    /* For normal rebase (enhanced blockpull), the common code handles
+     * everything, including vm cleanup. */
+    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_COPY))
+        return qemuDomainBlockPullCommon(driver, vm, path, base, bandwidth, flags);
 
-    if (qemuSecuritySetSocketLabel(driver->securityManager, vm->def) < 0)
+    /* If we got here, we are doing a block copy rebase. */
+    if (VIR_ALLOC(dest) < 0)
         goto cleanup;
-
-    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+    dest->type = (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_DEV) ?
+        VIR_STORAGE_TYPE_BLOCK : VIR_STORAGE_TYPE_FILE;
+    if (VIR_STRDUP(dest->path, base) < 0)
         goto cleanup;
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_COPY_RAW)
+        dest->format = VIR_STORAGE_FILE_RAW;
 
-    if (qemuSecurityClearSocketLabel(driver->securityManager, vm->def) < 0)
-        goto cleanup;
+    /* Convert bandwidth MiB to bytes, if necessary */
+    if (!(flags & VIR_DOMAIN_BLOCK_REBASE_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            goto cleanup;
+        }
+        speed <<= 20;
+    }
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorOpenGraphics(priv->mon, protocol, pair[1], "graphicsfd",
-                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH));
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
-    qemuDomainObjEndJob(driver, vm);
-    if (ret < 0)
+    /* XXX: If we are doing a shallow copy but not reusing an external
+     * file, we should attempt to pre-create the destination with a
+     * relative backing chain instead of qemu's default of absolute */
+    if (flags & VIR_DOMAIN_BLOCK_REBASE_RELATIVE) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Relative backing during copy not supported yet"));
         goto cleanup;
+    }
 
-    ret = pair[0];
-    pair[0] = -1;
+    /* We rely on the fact that VIR_DOMAIN_BLOCK_REBASE_SHALLOW
+     * and VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT map to the same values
+     * as for block copy. */
+    flags &= (VIR_DOMAIN_BLOCK_REBASE_SHALLOW |
+              VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT);
+    ret = qemuDomainBlockCopyCommon(vm, dom->conn, path, dest,
+                                    speed, 0, 0, flags, true);
+    dest = NULL;
 
  cleanup:
-    VIR_FORCE_CLOSE(pair[0]);
-    VIR_FORCE_CLOSE(pair[1]);
     virDomainObjEndAPI(&vm);
+    virStorageSourceFree(dest);
     return ret;
 }
 
-typedef enum {
-    QEMU_BLOCK_IOTUNE_SET_BYTES            = 1 << 0,
-    QEMU_BLOCK_IOTUNE_SET_IOPS             = 1 << 1,
-    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX        = 1 << 2,
-    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX         = 1 << 3,
-    QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS        = 1 << 4,
-    QEMU_BLOCK_IOTUNE_SET_GROUP_NAME       = 1 << 5,
-    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH = 1 << 6,
-    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH  = 1 << 7,
-} qemuBlockIoTuneSetFlags;
-
 
-/* If the user didn't specify bytes limits, inherit previous values;
- * likewise if the user didn't specify iops limits.  */
 static int
-qemuDomainSetBlockIoTuneDefaults(virDomainBlockIoTuneInfoPtr newinfo,
-                                 virDomainBlockIoTuneInfoPtr oldinfo,
-                                 qemuBlockIoTuneSetFlags set_fields)
+qemuDomainBlockCopy(virDomainPtr dom, const char *disk, const char *destxml,
+                    virTypedParameterPtr params, int nparams,
+                    unsigned int flags)
 {
-#define SET_IOTUNE_DEFAULTS(BOOL, FIELD) \
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) { \
-        newinfo->total_##FIELD = oldinfo->total_##FIELD; \
-        newinfo->read_##FIELD = oldinfo->read_##FIELD; \
-        newinfo->write_##FIELD = oldinfo->write_##FIELD; \
-    }
-
-    SET_IOTUNE_DEFAULTS(BYTES, bytes_sec);
-    SET_IOTUNE_DEFAULTS(BYTES_MAX, bytes_sec_max);
-    SET_IOTUNE_DEFAULTS(IOPS, iops_sec);
-    SET_IOTUNE_DEFAULTS(IOPS_MAX, iops_sec_max);
-#undef SET_IOTUNE_DEFAULTS
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    unsigned long long bandwidth = 0;
+    unsigned int granularity = 0;
+    unsigned long long buf_size = 0;
+    virDomainDiskDefPtr diskdef = NULL;
+    virStorageSourcePtr dest = NULL;
+    size_t i;
 
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))
-        newinfo->size_iops_sec = oldinfo->size_iops_sec;
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME) &&
-        VIR_STRDUP(newinfo->group_name, oldinfo->group_name) < 0)
+    virCheckFlags(VIR_DOMAIN_BLOCK_COPY_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COPY_REUSE_EXT |
+                  VIR_DOMAIN_BLOCK_COPY_TRANSIENT_JOB, -1);
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_BLOCK_COPY_BANDWIDTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_COPY_GRANULARITY,
+                               VIR_TYPED_PARAM_UINT,
+                               VIR_DOMAIN_BLOCK_COPY_BUF_SIZE,
+                               VIR_TYPED_PARAM_ULLONG,
+                               NULL) < 0)
         return -1;
 
-    /* The length field is handled a bit differently. If not defined/set,
-     * QEMU will default these to 0 or 1 depending on whether something in
-     * the same family is set or not.
-     *
-     * Similar to other values, if nothing in the family is defined/set,
-     * then take whatever is in the oldinfo.
-     *
-     * To clear an existing limit, a 0 is provided; however, passing that
-     * 0 onto QEMU if there's a family value defined/set (or defaulted)
-     * will cause an error. So, to mimic that, if our oldinfo was set and
-     * our newinfo is clearing, then set max_length based on whether we
-     * have a value in the family set/defined. */
-#define SET_MAX_LENGTH(BOOL, FIELD) \
-    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) \
-        newinfo->FIELD##_max_length = oldinfo->FIELD##_max_length; \
-    else if ((set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL) && \
-             oldinfo->FIELD##_max_length && \
-             !newinfo->FIELD##_max_length) \
-        newinfo->FIELD##_max_length = (newinfo->FIELD || \
-                                       newinfo->FIELD##_max) ? 1 : 0;
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
 
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, total_bytes_sec);
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, read_bytes_sec);
-    SET_MAX_LENGTH(BYTES_MAX_LENGTH, write_bytes_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, total_iops_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, read_iops_sec);
-    SET_MAX_LENGTH(IOPS_MAX_LENGTH, write_iops_sec);
+    if (virDomainBlockCopyEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-#undef SET_MAX_LENGTH
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = &params[i];
 
-    return 0;
+        /* Typed params (wisely) refused to expose unsigned long, but
+         * back-compat demands that we stick with a maximum of
+         * unsigned long bandwidth in MiB/s, while our value is
+         * unsigned long long in bytes/s.  Hence, we have to do
+         * overflow detection if this is a 32-bit server handling a
+         * 64-bit client.  */
+        if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BANDWIDTH)) {
+            if (sizeof(unsigned long)< sizeof(bandwidth) &&
+                param->value.ul > ULONG_MAX * (1ULL << 20)) {
+                virReportError(VIR_ERR_OVERFLOW,
+                               _("bandwidth must be less than %llu bytes"),
+                               ULONG_MAX * (1ULL << 20));
+                goto cleanup;
+            }
+            bandwidth = param->value.ul;
+        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_GRANULARITY)) {
+            if (param->value.ui != VIR_ROUND_UP_POWER_OF_TWO(param->value.ui)) {
+                virReportError(VIR_ERR_INVALID_ARG, "%s",
+                               _("granularity must be power of 2"));
+                goto cleanup;
+            }
+            granularity = param->value.ui;
+        } else if (STREQ(param->field, VIR_DOMAIN_BLOCK_COPY_BUF_SIZE)) {
+            buf_size = param->value.ul;
+        }
+    }
+
+    if (!(diskdef = virDomainDiskDefParse(destxml, vm->def, driver->xmlopt,
+                                          VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                          VIR_DOMAIN_DEF_PARSE_DISK_SOURCE)))
+        goto cleanup;
+
+    VIR_STEAL_PTR(dest, diskdef->src);
+
+    ret = qemuDomainBlockCopyCommon(vm, dom->conn, disk, dest, bandwidth,
+                                    granularity, buf_size, flags, false);
+
+ cleanup:
+    virDomainDiskDefFree(diskdef);
+    virDomainObjEndAPI(&vm);
+    return ret;
 }
 
 
 static int
-qemuDomainSetBlockIoTune(virDomainPtr dom,
-                         const char *path,
-                         virTypedParameterPtr params,
-                         int nparams,
-                         unsigned int flags)
+qemuDomainBlockPull(virDomainPtr dom, const char *path, unsigned long bandwidth,
+                    unsigned int flags)
+{
+    virDomainObjPtr vm;
+    virCheckFlags(VIR_DOMAIN_BLOCK_PULL_BANDWIDTH_BYTES, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainBlockPullEnsureACL(dom->conn, vm->def) < 0) {
+        virDomainObjEndAPI(&vm);
+        return -1;
+    }
+
+    return qemuDomainBlockPullCommon(dom->conn->privateData,
+                                     vm, path, NULL, bandwidth, flags);
+}
+
+
+static int
+qemuDomainBlockCommit(virDomainPtr dom,
+                      const char *path,
+                      const char *base,
+                      const char *top,
+                      unsigned long bandwidth,
+                      unsigned int flags)
 {
     virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
+    virQEMUDriverConfigPtr cfg = NULL;
     qemuDomainObjPrivatePtr priv;
-    virDomainDefPtr def = NULL;
-    virDomainDefPtr persistentDef = NULL;
-    virDomainBlockIoTuneInfo info;
-    char *drivealias = NULL;
-    const char *qdevid = NULL;
+    virDomainObjPtr vm = NULL;
+    char *device = NULL;
     int ret = -1;
-    size_t i;
-    virDomainDiskDefPtr conf_disk = NULL;
-    virDomainDiskDefPtr disk;
-    qemuBlockIoTuneSetFlags set_fields = 0;
-    bool supportMaxOptions = true;
-    bool supportGroupNameOption = true;
-    bool supportMaxLengthOptions = true;
-    virQEMUDriverConfigPtr cfg = NULL;
-    virObjectEventPtr event = NULL;
-    virTypedParameterPtr eventParams = NULL;
-    int eventNparams = 0;
-    int eventMaxparams = 0;
-
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG, -1);
-    if (virTypedParamsValidate(params, nparams,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_SIZE_IOPS_SEC,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
-                               VIR_TYPED_PARAM_STRING,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX_LENGTH,
-                               VIR_TYPED_PARAM_ULLONG,
-                               NULL) < 0)
-        return -1;
+    virDomainDiskDefPtr disk = NULL;
+    virStorageSourcePtr topSource;
+    unsigned int topIndex = 0;
+    virStorageSourcePtr baseSource = NULL;
+    unsigned int baseIndex = 0;
+    virStorageSourcePtr top_parent = NULL;
+    bool clean_access = false;
+    char *topPath = NULL;
+    char *basePath = NULL;
+    char *backingPath = NULL;
+    virStorageSourcePtr mirror = NULL;
+    unsigned long long speed = bandwidth;
 
-    memset(&info, 0, sizeof(info));
+    /* XXX Add support for COMMIT_DELETE */
+    virCheckFlags(VIR_DOMAIN_BLOCK_COMMIT_SHALLOW |
+                  VIR_DOMAIN_BLOCK_COMMIT_ACTIVE |
+                  VIR_DOMAIN_BLOCK_COMMIT_RELATIVE |
+                  VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES, -1);
 
     if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
-
-    if (virDomainSetBlockIoTuneEnsureACL(dom->conn, vm->def, flags) < 0)
         goto cleanup;
-
+    priv = vm->privateData;
     cfg = virQEMUDriverGetConfig(driver);
 
+    if (virDomainBlockCommitEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
     if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
         goto cleanup;
 
-    priv = vm->privateData;
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+    /* Ensure that no one backports commit to RHEL 6.2, where cancel
+     * behaved differently */
+    if (!(virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCK_COMMIT) &&
+          virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKJOB_ASYNC))) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("online commit not supported with this QEMU binary"));
+        goto endjob;
+    }
+
+    /* Convert bandwidth MiB to bytes, if necessary */
+    if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_BANDWIDTH_BYTES)) {
+        if (speed > LLONG_MAX >> 20) {
+            virReportError(VIR_ERR_OVERFLOW,
+                           _("bandwidth must be less than %llu"),
+                           LLONG_MAX >> 20);
+            goto endjob;
+        }
+        speed <<= 20;
+    }
+
+    if (!(disk = qemuDomainDiskByName(vm->def, path)))
+        goto endjob;
+
+    if (!(device = qemuAliasDiskDriveFromDisk(disk)))
+        goto endjob;
+
+    if (!disk->src->path) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("disk %s has no source file to be committed"),
+                       disk->dst);
+        goto endjob;
+    }
+
+    if (qemuDomainDiskBlockJobIsActive(disk))
+        goto endjob;
+
+    if (!top || STREQ(top, disk->dst))
+        topSource = disk->src;
+    else if (virStorageFileParseChainIndex(disk->dst, top, &topIndex) < 0 ||
+             !(topSource = virStorageFileChainLookup(disk->src, NULL,
+                                                     top, topIndex,
+                                                     &top_parent)))
+        goto endjob;
+
+    if (topSource == disk->src) {
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_ACTIVE_COMMIT)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("active commit not supported with this QEMU binary"));
+            goto endjob;
+        }
+        /* XXX Should we auto-pivot when COMMIT_ACTIVE is not specified? */
+        if (!(flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("commit of '%s' active layer requires active flag"),
+                           disk->dst);
+            goto endjob;
+        }
+    } else if (flags & VIR_DOMAIN_BLOCK_COMMIT_ACTIVE) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("active commit requested but '%s' is not active"),
+                       topSource->path);
+        goto endjob;
+    }
+
+    if (!virStorageSourceHasBacking(topSource)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("top '%s' in chain for '%s' has no backing file"),
+                       topSource->path, path);
+        goto endjob;
+    }
+
+    if (!base && (flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW))
+        baseSource = topSource->backingStore;
+    else if (virStorageFileParseChainIndex(disk->dst, base, &baseIndex) < 0 ||
+             !(baseSource = virStorageFileChainLookup(disk->src, topSource,
+                                                      base, baseIndex, NULL)))
+        goto endjob;
+
+    if ((flags & VIR_DOMAIN_BLOCK_COMMIT_SHALLOW) &&
+        baseSource != topSource->backingStore) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("base '%s' is not immediately below '%s' in chain "
+                         "for '%s'"),
+                       base, topSource->path, path);
+        goto endjob;
+    }
+
+    /* For an active commit, clone enough of the base to act as the mirror */
+    if (topSource == disk->src) {
+        if (!(mirror = virStorageSourceCopy(baseSource, false)))
+            goto endjob;
+        if (virStorageSourceInitChainElement(mirror,
+                                             disk->src,
+                                             true) < 0)
+            goto endjob;
+    }
+
+    if (flags & VIR_DOMAIN_BLOCK_COMMIT_RELATIVE &&
+        topSource != disk->src) {
+        if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_CHANGE_BACKING_FILE)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("this qemu doesn't support relative block commit"));
+            goto endjob;
+        }
+
+        if (virStorageFileGetRelativeBackingPath(topSource, baseSource,
+                                                 &backingPath) < 0)
+            goto endjob;
+
+        if (!backingPath) {
+            virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                           _("can't keep relative backing relationship"));
+            goto endjob;
+        }
+    }
+
+    /* For the commit to succeed, we must allow qemu to open both the
+     * 'base' image and the parent of 'top' as read/write; 'top' might
+     * not have a parent, or might already be read-write.  XXX It
+     * would also be nice to revert 'base' to read-only, as well as
+     * revoke access to files removed from the chain, when the commit
+     * operation succeeds, but doing that requires tracking the
+     * operation in XML across libvirtd restarts.  */
+    clean_access = true;
+    if (qemuDomainDiskChainElementPrepare(driver, vm, baseSource, false, false) < 0 ||
+        (top_parent && top_parent != disk->src &&
+         qemuDomainDiskChainElementPrepare(driver, vm, top_parent, false, false) < 0))
+        goto endjob;
+
+    /* Start the commit operation.  Pass the user's original spelling,
+     * if any, through to qemu, since qemu may behave differently
+     * depending on whether the input was specified as relative or
+     * absolute (that is, our absolute top_canon may do the wrong
+     * thing if the user specified a relative name).  Be prepared for
+     * a ready event to occur while locks are dropped.  */
+    if (mirror) {
+        disk->mirrorState = VIR_DOMAIN_DISK_MIRROR_STATE_NONE;
+        disk->mirror = mirror;
+        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_ACTIVE_COMMIT;
+    }
+    qemuDomainObjEnterMonitor(driver, vm);
+    basePath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                         baseSource);
+    topPath = qemuMonitorDiskNameLookup(priv->mon, device, disk->src,
+                                        topSource);
+    if (basePath && topPath)
+        ret = qemuMonitorBlockCommit(priv->mon, device,
+                                     topPath, basePath, backingPath,
+                                     speed);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0) {
+        ret = -1;
+        goto endjob;
+    }
+
+    if (ret == 0) {
+        QEMU_DOMAIN_DISK_PRIVATE(disk)->blockjob = true;
+        qemuBlockJobStarted(disk);
+        mirror = NULL;
+    } else {
+        disk->mirror = NULL;
+        disk->mirrorJob = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
+    }
+
+    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        VIR_WARN("Unable to save status on vm %s after block job",
+                 vm->def->name);
+
+ endjob:
+    if (ret < 0 && clean_access) {
+        virErrorPtr orig_err = virSaveLastError();
+        /* Revert access to read-only, if possible.  */
+        qemuDomainDiskChainElementPrepare(driver, vm, baseSource, true, false);
+        if (top_parent && top_parent != disk->src)
+            qemuDomainDiskChainElementPrepare(driver, vm, top_parent, true, false);
+
+        if (orig_err) {
+            virSetError(orig_err);
+            virFreeError(orig_err);
+        }
+    }
+    virStorageSourceFree(mirror);
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    VIR_FREE(topPath);
+    VIR_FREE(basePath);
+    VIR_FREE(backingPath);
+    VIR_FREE(device);
+    virObjectUnref(cfg);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainOpenGraphics(virDomainPtr dom,
+                       unsigned int idx,
+                       int fd,
+                       unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    const char *protocol;
+
+    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainOpenGraphicsEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    priv = vm->privateData;
+
+    if (idx >= vm->def->ngraphics) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No graphics backend with index %d"), idx);
+        goto endjob;
+    }
+    switch (vm->def->graphics[idx]->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        protocol = "vnc";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        protocol = "spice";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Can only open VNC or SPICE graphics backends, not %s"),
+                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
+        goto endjob;
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+    default:
+        virReportEnumRangeError(virDomainGraphicsType,
+                                vm->def->graphics[idx]->type);
+        goto endjob;
+    }
+
+    if (qemuSecuritySetImageFDLabel(driver->securityManager, vm->def, fd) < 0)
+        goto endjob;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorOpenGraphics(priv->mon, protocol, fd, "graphicsfd",
+                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH) != 0);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainOpenGraphicsFD(virDomainPtr dom,
+                         unsigned int idx,
+                         unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    const char *protocol;
+    int pair[2] = {-1, -1};
+
+    virCheckFlags(VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainOpenGraphicsFdEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (idx >= vm->def->ngraphics) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("No graphics backend with index %d"), idx);
+        goto cleanup;
+    }
+    switch (vm->def->graphics[idx]->type) {
+    case VIR_DOMAIN_GRAPHICS_TYPE_VNC:
+        protocol = "vnc";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SPICE:
+        protocol = "spice";
+        break;
+    case VIR_DOMAIN_GRAPHICS_TYPE_SDL:
+    case VIR_DOMAIN_GRAPHICS_TYPE_RDP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_DESKTOP:
+    case VIR_DOMAIN_GRAPHICS_TYPE_EGL_HEADLESS:
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED,
+                       _("Can only open VNC or SPICE graphics backends, not %s"),
+                       virDomainGraphicsTypeToString(vm->def->graphics[idx]->type));
+        goto cleanup;
+    case VIR_DOMAIN_GRAPHICS_TYPE_LAST:
+    default:
+        virReportEnumRangeError(virDomainGraphicsType,
+                                vm->def->graphics[idx]->type);
+        goto cleanup;
+    }
+
+    if (qemuSecuritySetSocketLabel(driver->securityManager, vm->def) < 0)
+        goto cleanup;
+
+    if (socketpair(PF_UNIX, SOCK_STREAM, 0, pair) < 0)
+        goto cleanup;
+
+    if (qemuSecurityClearSocketLabel(driver->securityManager, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorOpenGraphics(priv->mon, protocol, pair[1], "graphicsfd",
+                                  (flags & VIR_DOMAIN_OPEN_GRAPHICS_SKIPAUTH));
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+    qemuDomainObjEndJob(driver, vm);
+    if (ret < 0)
+        goto cleanup;
+
+    ret = pair[0];
+    pair[0] = -1;
+
+ cleanup:
+    VIR_FORCE_CLOSE(pair[0]);
+    VIR_FORCE_CLOSE(pair[1]);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+typedef enum {
+    QEMU_BLOCK_IOTUNE_SET_BYTES            = 1 << 0,
+    QEMU_BLOCK_IOTUNE_SET_IOPS             = 1 << 1,
+    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX        = 1 << 2,
+    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX         = 1 << 3,
+    QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS        = 1 << 4,
+    QEMU_BLOCK_IOTUNE_SET_GROUP_NAME       = 1 << 5,
+    QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH = 1 << 6,
+    QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH  = 1 << 7,
+} qemuBlockIoTuneSetFlags;
+
+
+/* If the user didn't specify bytes limits, inherit previous values;
+ * likewise if the user didn't specify iops limits.  */
+static int
+qemuDomainSetBlockIoTuneDefaults(virDomainBlockIoTuneInfoPtr newinfo,
+                                 const virDomainBlockIoTuneInfo *oldinfo,
+                                 qemuBlockIoTuneSetFlags set_fields)
+{
+#define SET_IOTUNE_DEFAULTS(BOOL, FIELD) \
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) { \
+        newinfo->total_##FIELD = oldinfo->total_##FIELD; \
+        newinfo->read_##FIELD = oldinfo->read_##FIELD; \
+        newinfo->write_##FIELD = oldinfo->write_##FIELD; \
+    }
+
+    SET_IOTUNE_DEFAULTS(BYTES, bytes_sec);
+    SET_IOTUNE_DEFAULTS(BYTES_MAX, bytes_sec_max);
+    SET_IOTUNE_DEFAULTS(IOPS, iops_sec);
+    SET_IOTUNE_DEFAULTS(IOPS_MAX, iops_sec_max);
+#undef SET_IOTUNE_DEFAULTS
+
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))
+        newinfo->size_iops_sec = oldinfo->size_iops_sec;
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME) &&
+        VIR_STRDUP(newinfo->group_name, oldinfo->group_name) < 0)
+        return -1;
+
+    /* The length field is handled a bit differently. If not defined/set,
+     * QEMU will default these to 0 or 1 depending on whether something in
+     * the same family is set or not.
+     *
+     * Similar to other values, if nothing in the family is defined/set,
+     * then take whatever is in the oldinfo.
+     *
+     * To clear an existing limit, a 0 is provided; however, passing that
+     * 0 onto QEMU if there's a family value defined/set (or defaulted)
+     * will cause an error. So, to mimic that, if our oldinfo was set and
+     * our newinfo is clearing, then set max_length based on whether we
+     * have a value in the family set/defined. */
+#define SET_MAX_LENGTH(BOOL, FIELD) \
+    if (!(set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL)) \
+        newinfo->FIELD##_max_length = oldinfo->FIELD##_max_length; \
+    else if ((set_fields & QEMU_BLOCK_IOTUNE_SET_##BOOL) && \
+             oldinfo->FIELD##_max_length && \
+             !newinfo->FIELD##_max_length) \
+        newinfo->FIELD##_max_length = (newinfo->FIELD || \
+                                       newinfo->FIELD##_max) ? 1 : 0;
+
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, total_bytes_sec);
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, read_bytes_sec);
+    SET_MAX_LENGTH(BYTES_MAX_LENGTH, write_bytes_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, total_iops_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, read_iops_sec);
+    SET_MAX_LENGTH(IOPS_MAX_LENGTH, write_iops_sec);
+
+#undef SET_MAX_LENGTH
+
+    return 0;
+}
+
+
+static int
+qemuDomainSetBlockIoTune(virDomainPtr dom,
+                         const char *path,
+                         virTypedParameterPtr params,
+                         int nparams,
+                         unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr persistentDef = NULL;
+    virDomainBlockIoTuneInfo info;
+    char *drivealias = NULL;
+    const char *qdevid = NULL;
+    int ret = -1;
+    size_t i;
+    virDomainDiskDefPtr conf_disk = NULL;
+    virDomainDiskDefPtr disk;
+    qemuBlockIoTuneSetFlags set_fields = 0;
+    bool supportMaxOptions = true;
+    bool supportGroupNameOption = true;
+    bool supportMaxLengthOptions = true;
+    virQEMUDriverConfigPtr cfg = NULL;
+    virObjectEventPtr event = NULL;
+    virTypedParameterPtr eventParams = NULL;
+    int eventNparams = 0;
+    int eventMaxparams = 0;
+
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+    if (virTypedParamsValidate(params, nparams,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_SIZE_IOPS_SEC,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
+                               VIR_TYPED_PARAM_STRING,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_BYTES_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_TOTAL_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_READ_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               VIR_DOMAIN_BLOCK_IOTUNE_WRITE_IOPS_SEC_MAX_LENGTH,
+                               VIR_TYPED_PARAM_ULLONG,
+                               NULL) < 0)
+        return -1;
+
+    memset(&info, 0, sizeof(info));
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    if (virDomainSetBlockIoTuneEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    priv = vm->privateData;
+
+    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
+        goto endjob;
+
+    if (virTypedParamsAddString(&eventParams, &eventNparams, &eventMaxparams,
+                                VIR_DOMAIN_TUNABLE_BLKDEV_DISK, path) < 0)
+        goto endjob;
+
+#define SET_IOTUNE_FIELD(FIELD, BOOL, CONST) \
+    if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_##CONST)) { \
+        info.FIELD = param->value.ul; \
+        set_fields |= QEMU_BLOCK_IOTUNE_SET_##BOOL; \
+        if (virTypedParamsAddULLong(&eventParams, &eventNparams, \
+                                    &eventMaxparams, \
+                                    VIR_DOMAIN_TUNABLE_BLKDEV_##CONST, \
+                                    param->value.ul) < 0) \
+            goto endjob; \
+        continue; \
+    }
+
+    for (i = 0; i < nparams; i++) {
+        virTypedParameterPtr param = &params[i];
+
+        if (param->value.ul > QEMU_BLOCK_IOTUNE_MAX) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("block I/O throttle limit value must"
+                             " be no more than %llu"), QEMU_BLOCK_IOTUNE_MAX);
+            goto endjob;
+        }
+
+        SET_IOTUNE_FIELD(total_bytes_sec, BYTES, TOTAL_BYTES_SEC);
+        SET_IOTUNE_FIELD(read_bytes_sec, BYTES, READ_BYTES_SEC);
+        SET_IOTUNE_FIELD(write_bytes_sec, BYTES, WRITE_BYTES_SEC);
+        SET_IOTUNE_FIELD(total_iops_sec, IOPS, TOTAL_IOPS_SEC);
+        SET_IOTUNE_FIELD(read_iops_sec, IOPS, READ_IOPS_SEC);
+        SET_IOTUNE_FIELD(write_iops_sec, IOPS, WRITE_IOPS_SEC);
+
+        SET_IOTUNE_FIELD(total_bytes_sec_max, BYTES_MAX,
+                         TOTAL_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(read_bytes_sec_max, BYTES_MAX,
+                         READ_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(write_bytes_sec_max, BYTES_MAX,
+                         WRITE_BYTES_SEC_MAX);
+        SET_IOTUNE_FIELD(total_iops_sec_max, IOPS_MAX,
+                         TOTAL_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(read_iops_sec_max, IOPS_MAX,
+                         READ_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(write_iops_sec_max, IOPS_MAX,
+                         WRITE_IOPS_SEC_MAX);
+        SET_IOTUNE_FIELD(size_iops_sec, SIZE_IOPS, SIZE_IOPS_SEC);
+
+        /* NB: Cannot use macro since this is a value.s not a value.ul */
+        if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME)) {
+            if (VIR_STRDUP(info.group_name, param->value.s) < 0)
+                goto endjob;
+            set_fields |= QEMU_BLOCK_IOTUNE_SET_GROUP_NAME;
+            if (virTypedParamsAddString(&eventParams, &eventNparams,
+                                        &eventMaxparams,
+                                        VIR_DOMAIN_TUNABLE_BLKDEV_GROUP_NAME,
+                                        param->value.s) < 0)
+                goto endjob;
+            continue;
+        }
+
+        SET_IOTUNE_FIELD(total_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         TOTAL_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(read_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         READ_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(write_bytes_sec_max_length, BYTES_MAX_LENGTH,
+                         WRITE_BYTES_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(total_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         TOTAL_IOPS_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(read_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         READ_IOPS_SEC_MAX_LENGTH);
+        SET_IOTUNE_FIELD(write_iops_sec_max_length, IOPS_MAX_LENGTH,
+                         WRITE_IOPS_SEC_MAX_LENGTH);
+    }
+
+#undef SET_IOTUNE_FIELD
+
+    if ((info.total_bytes_sec && info.read_bytes_sec) ||
+        (info.total_bytes_sec && info.write_bytes_sec)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of bytes_sec "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
+
+    if ((info.total_iops_sec && info.read_iops_sec) ||
+        (info.total_iops_sec && info.write_iops_sec)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of iops_sec "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
+
+    if ((info.total_bytes_sec_max && info.read_bytes_sec_max) ||
+        (info.total_bytes_sec_max && info.write_bytes_sec_max)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of bytes_sec_max "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
+
+    if ((info.total_iops_sec_max && info.read_iops_sec_max) ||
+        (info.total_iops_sec_max && info.write_iops_sec_max)) {
+        virReportError(VIR_ERR_INVALID_ARG, "%s",
+                       _("total and read/write of iops_sec_max "
+                         "cannot be set at the same time"));
+        goto endjob;
+    }
+
+    if (def) {
+        supportMaxOptions = virQEMUCapsGet(priv->qemuCaps,
+                                           QEMU_CAPS_DRIVE_IOTUNE_MAX);
+        supportGroupNameOption = virQEMUCapsGet(priv->qemuCaps,
+                                                QEMU_CAPS_DRIVE_IOTUNE_GROUP);
+        supportMaxLengthOptions =
+            virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH);
+
+        if (!supportMaxOptions &&
+            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX |
+                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX |
+                           QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("a block I/O throttling parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
+
+        if (!supportGroupNameOption &&
+            (set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME)) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("the block I/O throttling group parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
+
+        if (!supportMaxLengthOptions &&
+            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH |
+                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH))) {
+            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                           _("a block I/O throttling length parameter is not "
+                             "supported with this QEMU binary"));
+             goto endjob;
+        }
+
+        if (!(disk = qemuDomainDiskByName(def, path)))
+            goto endjob;
+
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
+            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+        } else {
+            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
+                goto endjob;
+        }
+
+        if (qemuDomainSetBlockIoTuneDefaults(&info,
+                                             virDomainDiskGetBlockIoTune(disk),
+                                             set_fields) < 0)
+            goto endjob;
+
+#define CHECK_MAX(val, _bool) \
+        do { \
+            if (info.val##_max) { \
+                if (!info.val) { \
+                    if (QEMU_BLOCK_IOTUNE_SET_##_bool) { \
+                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                       _("cannot reset '%s' when " \
+                                         "'%s' is set"), \
+                                       #val, #val "_max"); \
+                    } else { \
+                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                       _("value '%s' cannot be set if " \
+                                         "'%s' is not set"), \
+                                       #val "_max", #val); \
+                    } \
+                    goto endjob; \
+                } \
+                if (info.val##_max < info.val) { \
+                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
+                                   _("value '%s' cannot be " \
+                                     "smaller than '%s'"), \
+                                   #val "_max", #val); \
+                    goto endjob; \
+                } \
+            } \
+        } while (false)
+
+        CHECK_MAX(total_bytes_sec, BYTES);
+        CHECK_MAX(read_bytes_sec, BYTES);
+        CHECK_MAX(write_bytes_sec, BYTES);
+        CHECK_MAX(total_iops_sec, IOPS);
+        CHECK_MAX(read_iops_sec, IOPS);
+        CHECK_MAX(write_iops_sec, IOPS);
+
+#undef CHECK_MAX
+
+         /* NB: Let's let QEMU decide how to handle issues with _length
+          * via the JSON error code from the block_set_io_throttle call */
+
+        qemuDomainObjEnterMonitor(driver, vm);
+        ret = qemuMonitorSetBlockIoThrottle(priv->mon, drivealias, qdevid,
+                                            &info, supportMaxOptions,
+                                            set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME,
+                                            supportMaxLengthOptions);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            ret = -1;
+        if (ret < 0)
+            goto endjob;
+        ret = -1;
+
+        if (virDomainDiskSetBlockIOTune(disk, &info) < 0)
+            goto endjob;
+
+        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
+                                vm, driver->caps) < 0)
+            goto endjob;
+
+        if (eventNparams) {
+            event = virDomainEventTunableNewFromDom(dom, eventParams, eventNparams);
+            eventNparams = 0;
+            virObjectEventStateQueue(driver->domainEventState, event);
+        }
+    }
+
+    if (persistentDef) {
+        if (!(conf_disk = virDomainDiskByName(persistentDef, path, true))) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("missing persistent configuration for disk '%s'"),
+                           path);
+            goto endjob;
+        }
+
+        if (qemuDomainSetBlockIoTuneDefaults(&info,
+                                             virDomainDiskGetBlockIoTune(conf_disk),
+                                             set_fields) < 0)
+            goto endjob;
+
+        if (virDomainDiskSetBlockIOTune(conf_disk, &info) < 0)
+            goto endjob;
+
+        if (virDomainSaveConfig(cfg->configDir, driver->caps,
+                                persistentDef) < 0)
+            goto endjob;
+    }
+
+    ret = 0;
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    VIR_FREE(info.group_name);
+    VIR_FREE(drivealias);
+    virDomainObjEndAPI(&vm);
+    if (eventNparams)
+        virTypedParamsFree(eventParams, eventNparams);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+static int
+qemuDomainGetBlockIoTune(virDomainPtr dom,
+                         const char *path,
+                         virTypedParameterPtr params,
+                         int *nparams,
+                         unsigned int flags)
+{
+    virDomainDiskDefPtr disk;
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainDefPtr persistentDef = NULL;
+    virDomainBlockIoTuneInfo reply = {0};
+    char *drivealias = NULL;
+    const char *qdevid = NULL;
+    int ret = -1;
+    int maxparams;
+
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG |
+                  VIR_TYPED_PARAM_STRING_OKAY, -1);
+
+    /* We don't return strings, and thus trivially support this flag.  */
+    flags &= ~VIR_TYPED_PARAM_STRING_OKAY;
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    priv = vm->privateData;
+
+    if (virDomainGetBlockIoTuneEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
+        goto cleanup;
+
+    /* the API check guarantees that only one of the definitions will be set */
+    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
+        goto endjob;
+
+    if (def) {
+        /* If the VM is running, we can check if the current VM can use
+         * optional parameters or not. */
+        maxparams = QEMU_NB_BLOCK_IO_TUNE_BASE_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_MAX_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_GROUP))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_GROUP_PARAMS;
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH))
+            maxparams += QEMU_NB_BLOCK_IO_TUNE_LENGTH_PARAMS;
+    } else {
+        maxparams = QEMU_NB_BLOCK_IO_TUNE_ALL_PARAMS;
+    }
+
+    if (*nparams == 0) {
+        *nparams = maxparams;
+        ret = 0;
+        goto endjob;
+    } else if (*nparams < maxparams) {
+        maxparams = *nparams;
+    }
+
+    *nparams = 0;
+
+    if (def) {
+        if (!(disk = qemuDomainDiskByName(def, path)))
+            goto endjob;
+
+        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
+            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+        } else {
+            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
+                goto endjob;
+        }
+        qemuDomainObjEnterMonitor(driver, vm);
+        ret = qemuMonitorGetBlockIoThrottle(priv->mon, drivealias, qdevid, &reply);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto endjob;
+        if (ret < 0)
+            goto endjob;
+    }
+
+    if (persistentDef) {
+        if (!(disk = virDomainDiskByName(persistentDef, path, true))) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("disk '%s' was not found in the domain config"),
+                           path);
+            goto endjob;
+        }
+        reply = *virDomainDiskGetBlockIoTune(disk);
+
+        /* Group name needs to be copied since qemuMonitorGetBlockIoThrottle
+         * allocates it as well */
+        if (VIR_STRDUP(reply.group_name,
+                       virDomainDiskGetBlockIoTune(disk)->group_name) < 0)
+            goto endjob;
+    }
+
+#define BLOCK_IOTUNE_ASSIGN(name, var) \
+    if (*nparams < maxparams && \
+        virTypedParameterAssign(&params[(*nparams)++], \
+                                VIR_DOMAIN_BLOCK_IOTUNE_ ## name, \
+                                VIR_TYPED_PARAM_ULLONG, \
+                                reply.var) < 0) \
+        goto endjob
+
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC, total_bytes_sec);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC, read_bytes_sec);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC, write_bytes_sec);
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC, total_iops_sec);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC, read_iops_sec);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC, write_iops_sec);
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX, total_bytes_sec_max);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX, read_bytes_sec_max);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX, write_bytes_sec_max);
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX, total_iops_sec_max);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX, read_iops_sec_max);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX, write_iops_sec_max);
+
+    BLOCK_IOTUNE_ASSIGN(SIZE_IOPS_SEC, size_iops_sec);
+
+    if (*nparams < maxparams) {
+        if (virTypedParameterAssign(&params[(*nparams)++],
+                                    VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
+                                    VIR_TYPED_PARAM_STRING,
+                                    reply.group_name) < 0)
+            goto endjob;
+
+        reply.group_name = NULL;
+    }
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX_LENGTH, total_bytes_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX_LENGTH, read_bytes_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX_LENGTH, write_bytes_sec_max_length);
+
+    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX_LENGTH, total_iops_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX_LENGTH, read_iops_sec_max_length);
+    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX_LENGTH, write_iops_sec_max_length);
+#undef BLOCK_IOTUNE_ASSIGN
+
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndSharedJob(vm);
+
+ cleanup:
+    VIR_FREE(reply.group_name);
+    VIR_FREE(drivealias);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainGetDiskErrors(virDomainPtr dom,
+                        virDomainDiskErrorPtr errors,
+                        unsigned int nerrors,
+                        unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuDomainObjPrivatePtr priv;
+    virHashTablePtr table = NULL;
+    bool blockdev = false;
+    int ret = -1;
+    size_t i;
+    int n = 0;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    priv = vm->privateData;
+    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+
+    if (virDomainGetDiskErrorsEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginSharedJob(driver, vm) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!errors) {
+        ret = vm->def->ndisks;
+        goto endjob;
+    }
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    table = qemuMonitorGetBlockInfo(priv->mon);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        goto endjob;
+    if (!table)
+        goto endjob;
+
+    for (i = n = 0; i < vm->def->ndisks; i++) {
+        struct qemuDomainDiskInfo *info;
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
+        const char *entryname = disk->info.alias;
+
+        if (blockdev)
+            entryname = diskPriv->qomName;
+
+        if ((info = virHashLookup(table, entryname)) &&
+            info->io_status != VIR_DOMAIN_DISK_ERROR_NONE) {
+            if (n == nerrors)
+                break;
+
+            if (VIR_STRDUP(errors[n].disk, disk->dst) < 0)
+                goto endjob;
+            errors[n].error = info->io_status;
+            n++;
+        }
+    }
+
+    ret = n;
+
+ endjob:
+    qemuDomainObjEndSharedJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virHashFree(table);
+    if (ret < 0) {
+        for (i = 0; i < n; i++)
+            VIR_FREE(errors[i].disk);
+    }
+    return ret;
+}
+
+static int
+qemuDomainSetMetadata(virDomainPtr dom,
+                      int type,
+                      const char *metadata,
+                      const char *key,
+                      const char *uri,
+                      unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    virQEMUDriverConfigPtr cfg = NULL;
+    virCapsPtr caps = NULL;
+    int ret = -1;
+
+    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
+                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return -1;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (virDomainSetMetadataEnsureACL(dom->conn, vm->def, flags) < 0)
+        goto cleanup;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    ret = virDomainObjSetMetadata(vm, type, metadata, key, uri, caps,
+                                  driver->xmlopt, cfg->stateDir,
+                                  cfg->configDir, flags);
+
+    if (ret == 0) {
+        virObjectEventPtr ev = NULL;
+        ev = virDomainEventMetadataChangeNewFromObj(vm, type, uri);
+        virObjectEventStateQueue(driver->domainEventState, ev);
+    }
+
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    virObjectUnref(caps);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+static char *
+qemuDomainGetMetadata(virDomainPtr dom,
+                      int type,
+                      const char *uri,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm;
+    char *ret = NULL;
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return NULL;
+
+    if (virDomainGetMetadataEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    ret = virDomainObjGetMetadata(vm, type, uri, flags);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuDomainGetCPUStats(virDomainPtr domain,
+                      virTypedParameterPtr params,
+                      unsigned int nparams,
+                      int start_cpu,
+                      unsigned int ncpus,
+                      unsigned int flags)
+{
+    virDomainObjPtr vm = NULL;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+    virBitmapPtr guestvcpus = NULL;
+
+    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
+
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        return -1;
+
+    priv = vm->privateData;
+
+    if (virDomainGetCPUStatsEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto cleanup;
+
+    if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT)) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       "%s", _("cgroup CPUACCT controller is not mounted"));
+        goto cleanup;
+    }
+
+    if (qemuDomainHasVcpuPids(vm) &&
+        !(guestvcpus = virDomainDefGetOnlineVcpumap(vm->def)))
+        goto cleanup;
+
+    if (start_cpu == -1)
+        ret = virCgroupGetDomainTotalCpuStats(priv->cgroup,
+                                              params, nparams);
+    else
+        ret = virCgroupGetPercpuStats(priv->cgroup, params, nparams,
+                                      start_cpu, ncpus, guestvcpus);
+ cleanup:
+    virBitmapFree(guestvcpus);
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainPMSuspendForDuration(virDomainPtr dom,
+                               unsigned int target,
+                               unsigned long long duration,
+                               unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    qemuAgentPtr agent;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (duration) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Duration not supported. Use 0 for now"));
+        return -1;
+    }
+
+    if (!(target == VIR_NODE_SUSPEND_TARGET_MEM ||
+          target == VIR_NODE_SUSPEND_TARGET_DISK ||
+          target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Unknown suspend target: %u"),
+                       target);
+        return -1;
+    }
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainPMSuspendForDurationEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (vm->def->pm.s3 || vm->def->pm.s4) {
+        if (vm->def->pm.s3 == VIR_TRISTATE_BOOL_NO &&
+            (target == VIR_NODE_SUSPEND_TARGET_MEM ||
+             target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("S3 state is disabled for this domain"));
+            goto endjob;
+        }
+
+        if (vm->def->pm.s4 == VIR_TRISTATE_BOOL_NO &&
+            target == VIR_NODE_SUSPEND_TARGET_DISK) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("S4 state is disabled for this domain"));
+            goto endjob;
+        }
+    }
+
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
+
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentSuspend(agent, target);
+    qemuDomainObjExitAgent(vm, agent);
+
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuDomainPMWakeup(virDomainPtr dom,
+                   unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    qemuDomainObjPrivatePtr priv;
+
+    virCheckFlags(0, -1);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainPMWakeupEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    priv = vm->privateData;
+
+    qemuDomainObjEnterMonitor(driver, vm);
+    ret = qemuMonitorSystemWakeup(priv->mon);
+    if (qemuDomainObjExitMonitor(driver, vm) < 0)
+        ret = -1;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+static int
+qemuConnectListAllDomains(virConnectPtr conn,
+                          virDomainPtr **domains,
+                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    int ret = -1;
+
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+
+    if (virConnectListAllDomainsEnsureACL(conn) < 0)
+        goto cleanup;
+
+    ret = virDomainObjListExport(driver->domains, conn, domains,
+                                 virConnectListAllDomainsCheckACL, flags);
+
+ cleanup:
+    return ret;
+}
+
+
+static int
+qemuConnectGetDomainsChangedSince(virConnectPtr conn,
+                                  unsigned long long generation,
+                                  unsigned long long *newgeneration,
+                                  virDomainPtr **changed,
+                                  unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    if (virConnectGetDomainsChangedSinceEnsureACL(conn) < 0)
+        return -1;
+
+    return virDomainObjListExportChanged(driver->domains, conn, generation,
+                                         newgeneration, changed,
+                                         virConnectGetDomainsChangedSinceCheckACL);
+}
+
+static char *
+qemuDomainQemuAgentCommand(virDomainPtr domain,
+                           const char *cmd,
+                           int timeout,
+                           unsigned int flags)
+{
+    virQEMUDriverPtr driver = domain->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+    char *result = NULL;
+    qemuAgentPtr agent;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomObjFromDomain(domain)))
+        goto cleanup;
+
+    if (virDomainQemuAgentCommandEnsureACL(domain->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
+
+    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_GA_COMMAND, NULL);
+
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentArbitraryCommand(agent, cmd, &result, timeout);
+    qemuDomainObjExitAgent(vm, agent);
+    if (ret < 0)
+        VIR_FREE(result);
+
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return result;
+}
+
+
+static int
+qemuConnectDomainQemuMonitorEventRegister(virConnectPtr conn,
+                                          virDomainPtr dom,
+                                          const char *event,
+                                          virConnectDomainQemuMonitorEventCallback callback,
+                                          void *opaque,
+                                          virFreeCallback freecb,
+                                          unsigned int flags)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    int ret = -1;
+
+    if (virConnectDomainQemuMonitorEventRegisterEnsureACL(conn) < 0)
+        goto cleanup;
+
+    if (virDomainQemuMonitorEventStateRegisterID(conn,
+                                                 driver->domainEventState,
+                                                 dom, event, callback,
+                                                 opaque, freecb, flags,
+                                                 &ret) < 0)
+        ret = -1;
+
+ cleanup:
+    return ret;
+}
+
+
+static int
+qemuConnectDomainQemuMonitorEventDeregister(virConnectPtr conn,
+                                            int callbackID)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    int ret = -1;
+
+    if (virConnectDomainQemuMonitorEventDeregisterEnsureACL(conn) < 0)
+        goto cleanup;
+
+    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, true) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    return ret;
+}
+
+
+static int
+qemuDomainFSTrim(virDomainPtr dom,
+                 const char *mountPoint,
+                 unsigned long long minimum,
+                 unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    qemuAgentPtr agent;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (mountPoint) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("Specifying mount point "
+                         "is not supported for now"));
+        return -1;
+    }
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
+
+    if (virDomainFSTrimEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    agent = qemuDomainObjEnterAgent(vm);
+    ret = qemuAgentFSTrim(agent, minimum);
+    qemuDomainObjExitAgent(vm, agent);
+
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
+
+
+static int
+qemuNodeGetInfo(virConnectPtr conn,
+                virNodeInfoPtr nodeinfo)
+{
+    if (virNodeGetInfoEnsureACL(conn) < 0)
+        return -1;
+
+    return virCapabilitiesGetNodeInfo(nodeinfo);
+}
+
+
+static int
+qemuNodeGetCPUStats(virConnectPtr conn,
+                    int cpuNum,
+                    virNodeCPUStatsPtr params,
+                    int *nparams,
+                    unsigned int flags)
+{
+    if (virNodeGetCPUStatsEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostCPUGetStats(cpuNum, params, nparams, flags);
+}
+
+
+static int
+qemuNodeGetMemoryStats(virConnectPtr conn,
+                       int cellNum,
+                       virNodeMemoryStatsPtr params,
+                       int *nparams,
+                       unsigned int flags)
+{
+    if (virNodeGetMemoryStatsEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemGetStats(cellNum, params, nparams, flags);
+}
+
+
+static int
+qemuNodeGetCellsFreeMemory(virConnectPtr conn,
+                           unsigned long long *freeMems,
+                           int startCell,
+                           int maxCells)
+{
+    if (virNodeGetCellsFreeMemoryEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemGetCellsFree(freeMems, startCell, maxCells);
+}
+
+
+static unsigned long long
+qemuNodeGetFreeMemory(virConnectPtr conn)
+{
+    unsigned long long freeMem;
+
+    if (virNodeGetFreeMemoryEnsureACL(conn) < 0)
+        return 0;
+
+    if (virHostMemGetInfo(NULL, &freeMem) < 0)
+        return 0;
+
+    return freeMem;
+}
+
+
+static int
+qemuNodeGetMemoryParameters(virConnectPtr conn,
+                            virTypedParameterPtr params,
+                            int *nparams,
+                            unsigned int flags)
+{
+    if (virNodeGetMemoryParametersEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemGetParameters(params, nparams, flags);
+}
+
+
+static int
+qemuNodeSetMemoryParameters(virConnectPtr conn,
+                            virTypedParameterPtr params,
+                            int nparams,
+                            unsigned int flags)
+{
+    if (virNodeSetMemoryParametersEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostMemSetParameters(params, nparams, flags);
+}
+
+
+static int
+qemuNodeGetCPUMap(virConnectPtr conn,
+                  unsigned char **cpumap,
+                  unsigned int *online,
+                  unsigned int flags)
+{
+    if (virNodeGetCPUMapEnsureACL(conn) < 0)
+        return -1;
+
+    return virHostCPUGetMap(cpumap, online, flags);
+}
+
+
+static int
+qemuNodeSuspendForDuration(virConnectPtr conn,
+                           unsigned int target,
+                           unsigned long long duration,
+                           unsigned int flags)
+{
+    if (virNodeSuspendForDurationEnsureACL(conn) < 0)
+        return -1;
+
+    return virNodeSuspend(target, duration, flags);
+}
+
+static int
+qemuConnectGetCPUModelNames(virConnectPtr conn,
+                            const char *archName,
+                            char ***models,
+                            unsigned int flags)
+{
+    virArch arch;
+
+    virCheckFlags(0, -1);
+    if (virConnectGetCPUModelNamesEnsureACL(conn) < 0)
+        return -1;
+
+    if (!(arch = virArchFromString(archName))) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("cannot find architecture %s"),
+                       archName);
+        return -1;
+    }
+
+    return virCPUGetModels(arch, models);
+}
+
+
+static char *
+qemuDomainGetHostname(virDomainPtr dom,
+                      unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuAgentPtr agent;
+    char *hostname = NULL;
+
+    virCheckFlags(0, NULL);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return NULL;
+
+    if (virDomainGetHostnameEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    if (!qemuDomainAgentAvailable(vm, true))
+        goto endjob;
+
+    agent = qemuDomainObjEnterAgent(vm);
+    ignore_value(qemuAgentGetHostname(agent, &hostname));
+    qemuDomainObjExitAgent(vm, agent);
+
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
+
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return hostname;
+}
+
+
+static int
+qemuDomainGetTime(virDomainPtr dom,
+                  long long *seconds,
+                  unsigned int *nseconds,
+                  unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm = NULL;
+    qemuAgentPtr agent;
+    int ret = -1;
+    int rv;
+
+    virCheckFlags(0, ret);
+
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return ret;
+
+    if (virDomainGetTimeEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
+
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
 
-    if (virTypedParamsAddString(&eventParams, &eventNparams, &eventMaxparams,
-                                VIR_DOMAIN_TUNABLE_BLKDEV_DISK, path) < 0)
+    agent = qemuDomainObjEnterAgent(vm);
+    rv = qemuAgentGetTime(agent, seconds, nseconds);
+    qemuDomainObjExitAgent(vm, agent);
+
+    if (rv < 0)
         goto endjob;
 
-#define SET_IOTUNE_FIELD(FIELD, BOOL, CONST) \
-    if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_##CONST)) { \
-        info.FIELD = param->value.ul; \
-        set_fields |= QEMU_BLOCK_IOTUNE_SET_##BOOL; \
-        if (virTypedParamsAddULLong(&eventParams, &eventNparams, \
-                                    &eventMaxparams, \
-                                    VIR_DOMAIN_TUNABLE_BLKDEV_##CONST, \
-                                    param->value.ul) < 0) \
-            goto endjob; \
-        continue; \
-    }
+    ret = 0;
 
-    for (i = 0; i < nparams; i++) {
-        virTypedParameterPtr param = &params[i];
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
 
-        if (param->value.ul > QEMU_BLOCK_IOTUNE_MAX) {
-            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                           _("block I/O throttle limit value must"
-                             " be no more than %llu"), QEMU_BLOCK_IOTUNE_MAX);
-            goto endjob;
-        }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-        SET_IOTUNE_FIELD(total_bytes_sec, BYTES, TOTAL_BYTES_SEC);
-        SET_IOTUNE_FIELD(read_bytes_sec, BYTES, READ_BYTES_SEC);
-        SET_IOTUNE_FIELD(write_bytes_sec, BYTES, WRITE_BYTES_SEC);
-        SET_IOTUNE_FIELD(total_iops_sec, IOPS, TOTAL_IOPS_SEC);
-        SET_IOTUNE_FIELD(read_iops_sec, IOPS, READ_IOPS_SEC);
-        SET_IOTUNE_FIELD(write_iops_sec, IOPS, WRITE_IOPS_SEC);
 
-        SET_IOTUNE_FIELD(total_bytes_sec_max, BYTES_MAX,
-                         TOTAL_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(read_bytes_sec_max, BYTES_MAX,
-                         READ_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(write_bytes_sec_max, BYTES_MAX,
-                         WRITE_BYTES_SEC_MAX);
-        SET_IOTUNE_FIELD(total_iops_sec_max, IOPS_MAX,
-                         TOTAL_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(read_iops_sec_max, IOPS_MAX,
-                         READ_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(write_iops_sec_max, IOPS_MAX,
-                         WRITE_IOPS_SEC_MAX);
-        SET_IOTUNE_FIELD(size_iops_sec, SIZE_IOPS, SIZE_IOPS_SEC);
+static int
+qemuDomainSetTime(virDomainPtr dom,
+                  long long seconds,
+                  unsigned int nseconds,
+                  unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    qemuDomainObjPrivatePtr priv;
+    virDomainObjPtr vm;
+    qemuAgentPtr agent;
+    bool rtcSync = flags & VIR_DOMAIN_TIME_SYNC;
+    int ret = -1;
+    int rv;
 
-        /* NB: Cannot use macro since this is a value.s not a value.ul */
-        if (STREQ(param->field, VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME)) {
-            if (VIR_STRDUP(info.group_name, param->value.s) < 0)
-                goto endjob;
-            set_fields |= QEMU_BLOCK_IOTUNE_SET_GROUP_NAME;
-            if (virTypedParamsAddString(&eventParams, &eventNparams,
-                                        &eventMaxparams,
-                                        VIR_DOMAIN_TUNABLE_BLKDEV_GROUP_NAME,
-                                        param->value.s) < 0)
-                goto endjob;
-            continue;
-        }
+    virCheckFlags(VIR_DOMAIN_TIME_SYNC, ret);
 
-        SET_IOTUNE_FIELD(total_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         TOTAL_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(read_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         READ_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(write_bytes_sec_max_length, BYTES_MAX_LENGTH,
-                         WRITE_BYTES_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(total_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         TOTAL_IOPS_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(read_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         READ_IOPS_SEC_MAX_LENGTH);
-        SET_IOTUNE_FIELD(write_iops_sec_max_length, IOPS_MAX_LENGTH,
-                         WRITE_IOPS_SEC_MAX_LENGTH);
-    }
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        return ret;
 
-#undef SET_IOTUNE_FIELD
+    if (virDomainSetTimeEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-    if ((info.total_bytes_sec && info.read_bytes_sec) ||
-        (info.total_bytes_sec && info.write_bytes_sec)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of bytes_sec "
-                         "cannot be set at the same time"));
+    priv = vm->privateData;
+
+    if (qemuDomainObjBeginJobWithAgent(driver, vm,
+                                       QEMU_JOB_MODIFY,
+                                       QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
-    }
 
-    if ((info.total_iops_sec && info.read_iops_sec) ||
-        (info.total_iops_sec && info.write_iops_sec)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of iops_sec "
-                         "cannot be set at the same time"));
+    /* On x86, the rtc-reset-reinjection QMP command must be called after
+     * setting the time to avoid trouble down the line. If the command is
+     * not available, don't set the time at all and report an error */
+    if (ARCH_IS_X86(vm->def->os.arch) &&
+        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION))
+    {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("cannot set time: qemu doesn't support "
+                         "rtc-reset-reinjection command"));
         goto endjob;
     }
 
-    if ((info.total_bytes_sec_max && info.read_bytes_sec_max) ||
-        (info.total_bytes_sec_max && info.write_bytes_sec_max)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of bytes_sec_max "
-                         "cannot be set at the same time"));
+    if (!qemuDomainAgentAvailable(vm, true))
         goto endjob;
-    }
 
-    if ((info.total_iops_sec_max && info.read_iops_sec_max) ||
-        (info.total_iops_sec_max && info.write_iops_sec_max)) {
-        virReportError(VIR_ERR_INVALID_ARG, "%s",
-                       _("total and read/write of iops_sec_max "
-                         "cannot be set at the same time"));
+    agent = qemuDomainObjEnterAgent(vm);
+    rv = qemuAgentSetTime(agent, seconds, nseconds, rtcSync);
+    qemuDomainObjExitAgent(vm, agent);
+
+    if (rv < 0)
+        goto endjob;
+
+    if (virDomainObjCheckActive(vm) < 0)
         goto endjob;
+
+    /* Don't try to call rtc-reset-reinjection if it's not available */
+    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION)) {
+        qemuDomainObjEnterMonitor(driver, vm);
+        rv = qemuMonitorRTCResetReinjection(priv->mon);
+        if (qemuDomainObjExitMonitor(driver, vm) < 0)
+            goto endjob;
+
+        if (rv < 0)
+            goto endjob;
     }
 
-    if (def) {
-        supportMaxOptions = virQEMUCapsGet(priv->qemuCaps,
-                                           QEMU_CAPS_DRIVE_IOTUNE_MAX);
-        supportGroupNameOption = virQEMUCapsGet(priv->qemuCaps,
-                                                QEMU_CAPS_DRIVE_IOTUNE_GROUP);
-        supportMaxLengthOptions =
-            virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH);
+    ret = 0;
 
-        if (!supportMaxOptions &&
-            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX |
-                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX |
-                           QEMU_BLOCK_IOTUNE_SET_SIZE_IOPS))) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("a block I/O throttling parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
+ endjob:
+    qemuDomainObjEndJobWithAgent(driver, vm);
 
-        if (!supportGroupNameOption &&
-            (set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME)) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("the block I/O throttling group parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-        if (!supportMaxLengthOptions &&
-            (set_fields & (QEMU_BLOCK_IOTUNE_SET_BYTES_MAX_LENGTH |
-                           QEMU_BLOCK_IOTUNE_SET_IOPS_MAX_LENGTH))) {
-            virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
-                           _("a block I/O throttling length parameter is not "
-                             "supported with this QEMU binary"));
-             goto endjob;
-        }
 
-        if (!(disk = qemuDomainDiskByName(def, path)))
-            goto endjob;
+static int
+qemuDomainFSFreeze(virDomainPtr dom,
+                   const char **mountpoints,
+                   unsigned int nmountpoints,
+                   unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
 
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
-            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-        } else {
-            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
-                goto endjob;
-        }
+    virCheckFlags(0, -1);
 
-        if (qemuDomainSetBlockIoTuneDefaults(&info, &disk->blkdeviotune,
-                                             set_fields) < 0)
-            goto endjob;
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
 
-#define CHECK_MAX(val, _bool) \
-        do { \
-            if (info.val##_max) { \
-                if (!info.val) { \
-                    if (QEMU_BLOCK_IOTUNE_SET_##_bool) { \
-                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                       _("cannot reset '%s' when " \
-                                         "'%s' is set"), \
-                                       #val, #val "_max"); \
-                    } else { \
-                        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                       _("value '%s' cannot be set if " \
-                                         "'%s' is not set"), \
-                                       #val "_max", #val); \
-                    } \
-                    goto endjob; \
-                } \
-                if (info.val##_max < info.val) { \
-                    virReportError(VIR_ERR_CONFIG_UNSUPPORTED, \
-                                   _("value '%s' cannot be " \
-                                     "smaller than '%s'"), \
-                                   #val "_max", #val); \
-                    goto endjob; \
-                } \
-            } \
-        } while (false)
+    if (virDomainFSFreezeEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-        CHECK_MAX(total_bytes_sec, BYTES);
-        CHECK_MAX(read_bytes_sec, BYTES);
-        CHECK_MAX(write_bytes_sec, BYTES);
-        CHECK_MAX(total_iops_sec, IOPS);
-        CHECK_MAX(read_iops_sec, IOPS);
-        CHECK_MAX(write_iops_sec, IOPS);
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
 
-#undef CHECK_MAX
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
 
-         /* NB: Let's let QEMU decide how to handle issues with _length
-          * via the JSON error code from the block_set_io_throttle call */
+    ret = qemuDomainSnapshotFSFreeze(driver, vm, mountpoints, nmountpoints);
 
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorSetBlockIoThrottle(priv->mon, drivealias, qdevid,
-                                            &info, supportMaxOptions,
-                                            set_fields & QEMU_BLOCK_IOTUNE_SET_GROUP_NAME,
-                                            supportMaxLengthOptions);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            ret = -1;
-        if (ret < 0)
-            goto endjob;
-        ret = -1;
+ endjob:
+    qemuDomainObjEndAgentJob(vm);
 
-        if (virDomainDiskSetBlockIOTune(disk, &info) < 0)
-            goto endjob;
+ cleanup:
+    virDomainObjEndAPI(&vm);
+    return ret;
+}
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir,
-                                vm, driver->caps) < 0)
-            goto endjob;
 
-        if (eventNparams) {
-            event = virDomainEventTunableNewFromDom(dom, eventParams, eventNparams);
-            eventNparams = 0;
-            virObjectEventStateQueue(driver->domainEventState, event);
-        }
+static int
+qemuDomainFSThaw(virDomainPtr dom,
+                 const char **mountpoints,
+                 unsigned int nmountpoints,
+                 unsigned int flags)
+{
+    virQEMUDriverPtr driver = dom->conn->privateData;
+    virDomainObjPtr vm;
+    int ret = -1;
+
+    virCheckFlags(0, -1);
+
+    if (mountpoints || nmountpoints) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("specifying mountpoints is not supported"));
+        return ret;
     }
 
-    if (persistentDef) {
-        if (!(conf_disk = virDomainDiskByName(persistentDef, path, true))) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("missing persistent configuration for disk '%s'"),
-                           path);
-            goto endjob;
-        }
+    if (!(vm = qemuDomObjFromDomain(dom)))
+        goto cleanup;
 
-        if (qemuDomainSetBlockIoTuneDefaults(&info, &conf_disk->blkdeviotune,
-                                             set_fields) < 0)
-            goto endjob;
+    if (virDomainFSThawEnsureACL(dom->conn, vm->def) < 0)
+        goto cleanup;
 
-        if (virDomainDiskSetBlockIOTune(conf_disk, &info) < 0)
-            goto endjob;
+    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+        goto cleanup;
 
-        if (virDomainSaveConfig(cfg->configDir, driver->caps,
-                                persistentDef) < 0)
-            goto endjob;
-    }
+    if (virDomainObjCheckActive(vm) < 0)
+        goto endjob;
+
+    ret = qemuDomainSnapshotFSThaw(driver, vm, true);
 
-    ret = 0;
  endjob:
-    qemuDomainObjEndJob(driver, vm);
+    qemuDomainObjEndAgentJob(vm);
 
  cleanup:
-    VIR_FREE(info.group_name);
-    VIR_FREE(drivealias);
     virDomainObjEndAPI(&vm);
-    if (eventNparams)
-        virTypedParamsFree(eventParams, eventNparams);
-    virObjectUnref(cfg);
     return ret;
 }
 
+
 static int
-qemuDomainGetBlockIoTune(virDomainPtr dom,
-                         const char *path,
-                         virTypedParameterPtr params,
-                         int *nparams,
-                         unsigned int flags)
+qemuNodeGetFreePages(virConnectPtr conn,
+                     unsigned int npages,
+                     unsigned int *pages,
+                     int startCell,
+                     unsigned int cellCount,
+                     unsigned long long *counts,
+                     unsigned int flags)
 {
-    virDomainDiskDefPtr disk;
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuDomainObjPrivatePtr priv = NULL;
-    virDomainDefPtr def = NULL;
-    virDomainDefPtr persistentDef = NULL;
-    virDomainBlockIoTuneInfo reply = {0};
-    char *drivealias = NULL;
-    const char *qdevid = NULL;
-    int ret = -1;
-    int maxparams;
+    virCheckFlags(0, -1);
 
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG |
-                  VIR_TYPED_PARAM_STRING_OKAY, -1);
+    if (virNodeGetFreePagesEnsureACL(conn) < 0)
+        return -1;
 
-    /* We don't return strings, and thus trivially support this flag.  */
-    flags &= ~VIR_TYPED_PARAM_STRING_OKAY;
+    return virHostMemGetFreePages(npages, pages, startCell, cellCount, counts);
+}
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
 
-    priv = vm->privateData;
+/* The formatted domain capabilities are cached along with the QEMU
+ * capabilities they were built from and thrown away when the binary is
+ * probed again. Firmware images are checked by the cheap existence test
+ * virQEMUCapsFillDomainCaps does, so that installing one is noticed. */
+static char *
+qemuConnectGetDomainCapabilitiesKey(virQEMUCapsPtr qemuCaps,
+                                    virQEMUDriverConfigPtr cfg,
+                                    const char *machine,
+                                    virArch arch,
+                                    virDomainVirtType virttype)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *id;
+    size_t i;
 
-    if (virDomainGetBlockIoTuneEnsureACL(dom->conn, vm->def) < 0)
+    if (!(id = virQEMUCapsGetFragmentsID(qemuCaps)))
+        return NULL;
+
+    virBufferAsprintf(&buf, "domcaps\n%s\n%s\n%s\n%s\n", id,
+                      NULLSTR(machine), virArchToString(arch),
+                      virDomainVirtTypeToString(virttype));
+    for (i = 0; i < cfg->nfirmwares; i++)
+        virBufferAddChar(&buf, virFileExists(cfg->firmwares[i]->name) ? '1' : '0');
+
+    VIR_FREE(id);
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static char *
+qemuConnectGetDomainCapabilities(virConnectPtr conn,
+                                 const char *emulatorbin,
+                                 const char *arch_str,
+                                 const char *machine,
+                                 const char *virttype_str,
+                                 unsigned int flags)
+{
+    char *ret = NULL;
+    virQEMUDriverPtr driver = conn->privateData;
+    virQEMUCapsPtr qemuCaps = NULL;
+    virArch arch;
+    virDomainVirtType virttype;
+    virDomainCapsPtr domCaps = NULL;
+    virQEMUDriverConfigPtr cfg = NULL;
+    virCapsPtr caps = NULL;
+    char *key = NULL;
+
+    virCheckFlags(0, ret);
+
+    if (virConnectGetDomainCapabilitiesEnsureACL(conn) < 0)
+        return ret;
+
+    cfg = virQEMUDriverGetConfig(driver);
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto cleanup;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    qemuCaps = virQEMUCapsCacheLookupDefault(driver->qemuCapsCache,
+                                             emulatorbin,
+                                             arch_str,
+                                             virttype_str,
+                                             machine,
+                                             &arch, &virttype, &machine);
+    if (!qemuCaps)
         goto cleanup;
 
-    /* the API check guarantees that only one of the definitions will be set */
-    if (virDomainObjGetDefs(vm, flags, &def, &persistentDef) < 0)
-        goto endjob;
+    if (!(key = qemuConnectGetDomainCapabilitiesKey(qemuCaps, cfg, machine,
+                                                    arch, virttype)))
+        goto cleanup;
 
-    if (def) {
-        /* If the VM is running, we can check if the current VM can use
-         * optional parameters or not. */
-        maxparams = QEMU_NB_BLOCK_IO_TUNE_BASE_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_MAX_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_GROUP))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_GROUP_PARAMS;
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_DRIVE_IOTUNE_MAX_LENGTH))
-            maxparams += QEMU_NB_BLOCK_IO_TUNE_LENGTH_PARAMS;
-    } else {
-        maxparams = QEMU_NB_BLOCK_IO_TUNE_ALL_PARAMS;
-    }
+    if ((ret = virQEMUCapsGetFragment(qemuCaps, key)))
+        goto cleanup;
 
-    if (*nparams == 0) {
-        *nparams = maxparams;
-        ret = 0;
-        goto endjob;
-    } else if (*nparams < maxparams) {
-        maxparams = *nparams;
-    }
+    if (!(domCaps = virDomainCapsNew(virQEMUCapsGetBinary(qemuCaps), machine,
+                                     arch, virttype)))
+        goto cleanup;
 
-    *nparams = 0;
+    if (virQEMUCapsFillDomainCaps(caps, domCaps, qemuCaps,
+                                  cfg->firmwares, cfg->nfirmwares) < 0)
+        goto cleanup;
 
-    if (def) {
-        if (!(disk = qemuDomainDiskByName(def, path)))
-            goto endjob;
+    if ((ret = virDomainCapsFormat(domCaps)))
+        virQEMUCapsAddFragment(qemuCaps, key, ret);
 
-        if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV)) {
-            qdevid = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-        } else {
-            if (!(drivealias = qemuAliasDiskDriveFromDisk(disk)))
-                goto endjob;
-        }
-        qemuDomainObjEnterMonitor(driver, vm);
-        ret = qemuMonitorGetBlockIoThrottle(priv->mon, drivealias, qdevid, &reply);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto endjob;
-        if (ret < 0)
-            goto endjob;
-    }
+ cleanup:
+    VIR_FREE(key);
+    virObjectUnref(cfg);
+    virObjectUnref(caps);
+    virObjectUnref(domCaps);
+    virObjectUnref(qemuCaps);
+    return ret;
+}
 
-    if (persistentDef) {
-        if (!(disk = virDomainDiskByName(persistentDef, path, true))) {
-            virReportError(VIR_ERR_INVALID_ARG,
-                           _("disk '%s' was not found in the domain config"),
-                           path);
-            goto endjob;
-        }
-        reply = disk->blkdeviotune;
 
-        /* Group name needs to be copied since qemuMonitorGetBlockIoThrottle
-         * allocates it as well */
-        if (VIR_STRDUP(reply.group_name, disk->blkdeviotune.group_name) < 0)
-            goto endjob;
-    }
+static int
+qemuDomainGetStatsState(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                        virDomainObjPtr dom,
+                        virDomainStatsRecordPtr record,
+                        int *maxparams,
+                        unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.state",
+                             dom->state.state) < 0)
+        return -1;
+
+    if (virTypedParamsAddInt(&record->params,
+                             &record->nparams,
+                             maxparams,
+                             "state.reason",
+                             dom->state.reason) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+typedef enum {
+    QEMU_DOMAIN_STATS_HAVE_JOB = 1 << 0, /* job is entered, monitor can be
+                                            accessed */
+    QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
+                                            block stats */
+    QEMU_DOMAIN_STATS_PRESSURE_TRIGGER = 1 << 2, /* arm PSI triggers for
+                                                    stats subscriptions */
+} qemuDomainStatsFlags;
+
 
-#define BLOCK_IOTUNE_ASSIGN(name, var) \
-    if (*nparams < maxparams && \
-        virTypedParameterAssign(&params[(*nparams)++], \
-                                VIR_DOMAIN_BLOCK_IOTUNE_ ## name, \
-                                VIR_TYPED_PARAM_ULLONG, \
-                                reply.var) < 0) \
-        goto endjob
+#define HAVE_JOB(flags) ((flags) & QEMU_DOMAIN_STATS_HAVE_JOB)
 
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC, total_bytes_sec);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC, read_bytes_sec);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC, write_bytes_sec);
+static int
+qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                      virDomainObjPtr dom,
+                      virDomainStatsRecordPtr record,
+                      int *maxparams,
+                      unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virCgroupStats stats;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC, total_iops_sec);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC, read_iops_sec);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC, write_iops_sec);
+    if (!priv->cgroup)
+        return 0;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX, total_bytes_sec_max);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX, read_bytes_sec_max);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX, write_bytes_sec_max);
+    if (virCgroupGetStatsSnapshot(priv->cgroup,
+                                  1 << VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  &stats) < 0 ||
+        !(stats.controllers & (1 << VIR_CGROUP_CONTROLLER_CPUACCT)))
+        return 0;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX, total_iops_sec_max);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX, read_iops_sec_max);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX, write_iops_sec_max);
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.time",
+                                stats.cpuUsage) < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(SIZE_IOPS_SEC, size_iops_sec);
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.user",
+                                stats.cpuUser) < 0)
+        return -1;
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "cpu.system",
+                                stats.cpuSystem) < 0)
+        return -1;
 
-    if (*nparams < maxparams) {
-        if (virTypedParameterAssign(&params[(*nparams)++],
-                                    VIR_DOMAIN_BLOCK_IOTUNE_GROUP_NAME,
-                                    VIR_TYPED_PARAM_STRING,
-                                    reply.group_name) < 0)
-            goto endjob;
+    return 0;
+}
 
-        reply.group_name = NULL;
+static int
+qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int privflags)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
+    int nr_stats;
+    unsigned long long cur_balloon = 0;
+    size_t i;
+    int err = 0;
+
+    if (!virDomainDefHasMemballoon(dom->def)) {
+        cur_balloon = virDomainDefGetMemoryTotal(dom->def);
+    } else if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT)) {
+        cur_balloon = dom->def->mem.cur_balloon;
+    } else {
+        err = -1;
     }
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_BYTES_SEC_MAX_LENGTH, total_bytes_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(READ_BYTES_SEC_MAX_LENGTH, read_bytes_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(WRITE_BYTES_SEC_MAX_LENGTH, write_bytes_sec_max_length);
+    if (!err && virTypedParamsAddULLong(&record->params,
+                                        &record->nparams,
+                                        maxparams,
+                                        "balloon.current",
+                                        cur_balloon) < 0)
+        return -1;
 
-    BLOCK_IOTUNE_ASSIGN(TOTAL_IOPS_SEC_MAX_LENGTH, total_iops_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(READ_IOPS_SEC_MAX_LENGTH, read_iops_sec_max_length);
-    BLOCK_IOTUNE_ASSIGN(WRITE_IOPS_SEC_MAX_LENGTH, write_iops_sec_max_length);
-#undef BLOCK_IOTUNE_ASSIGN
+    if (virTypedParamsAddULLong(&record->params,
+                                &record->nparams,
+                                maxparams,
+                                "balloon.maximum",
+                                virDomainDefGetMemoryTotal(dom->def)) < 0)
+        return -1;
 
-    ret = 0;
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    /* recently fetched stats do not need the monitor */
+    if (HAVE_JOB(privflags))
+        nr_stats = qemuDomainMemoryStatsInternal(driver, dom, stats,
+                                                 VIR_DOMAIN_MEMORY_STAT_NR);
+    else
+        nr_stats = qemuDomainStatsCacheGetMemory(driver, dom, stats,
+                                                 VIR_DOMAIN_MEMORY_STAT_NR);
+    if (nr_stats < 0)
+        return 0;
 
- cleanup:
-    VIR_FREE(reply.group_name);
-    VIR_FREE(drivealias);
-    virDomainObjEndAPI(&vm);
-    return ret;
+#define STORE_MEM_RECORD(TAG, NAME) \
+    if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG) \
+        if (virTypedParamsAddULLong(&record->params, \
+                                    &record->nparams, \
+                                    maxparams, \
+                                    "balloon." NAME, \
+                                    stats[i].val) < 0) \
+            return -1;
+
+    for (i = 0; i < nr_stats; i++) {
+        STORE_MEM_RECORD(SWAP_IN, "swap_in")
+        STORE_MEM_RECORD(SWAP_OUT, "swap_out")
+        STORE_MEM_RECORD(MAJOR_FAULT, "major_fault")
+        STORE_MEM_RECORD(MINOR_FAULT, "minor_fault")
+        STORE_MEM_RECORD(UNUSED, "unused")
+        STORE_MEM_RECORD(AVAILABLE, "available")
+        STORE_MEM_RECORD(RSS, "rss")
+        STORE_MEM_RECORD(LAST_UPDATE, "last-update")
+        STORE_MEM_RECORD(USABLE, "usable")
+        STORE_MEM_RECORD(DISK_CACHES, "disk_caches")
+    }
+
+#undef STORE_MEM_RECORD
+
+    return 0;
 }
 
+
 static int
-qemuDomainGetDiskErrors(virDomainPtr dom,
-                        virDomainDiskErrorPtr errors,
-                        unsigned int nerrors,
-                        unsigned int flags)
+qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
+                       virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams,
+                       unsigned int privflags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuDomainObjPrivatePtr priv;
-    virHashTablePtr table = NULL;
-    bool blockdev = false;
-    int ret = -1;
+    virDomainVcpuDefPtr vcpu;
+    qemuDomainVcpuPrivatePtr vcpupriv;
     size_t i;
-    int n = 0;
-
-    virCheckFlags(0, -1);
-
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    int ret = -1;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    virVcpuInfoPtr cpuinfo = NULL;
+    unsigned long long *cpuwait = NULL;
 
-    priv = vm->privateData;
-    blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.current",
+                              virDomainDefGetVcpus(dom->def)) < 0)
+        return -1;
 
-    if (virDomainGetDiskErrorsEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (virTypedParamsAddUInt(&record->params,
+                              &record->nparams,
+                              maxparams,
+                              "vcpu.maximum",
+                              virDomainDefGetVcpusMax(dom->def)) < 0)
+        return -1;
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY) < 0)
+    if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
+        VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
         goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
+        qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
+            /* it's ok to be silent and go ahead, because halted vcpu info
+             * wasn't here from the beginning */
+            virResetLastError();
+    }
 
-    if (!errors) {
-        ret = vm->def->ndisks;
-        goto endjob;
+    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
+                                 virDomainDefGetVcpus(dom->def),
+                                 NULL, 0) < 0) {
+        virResetLastError();
+        ret = 0; /* it's ok to be silent and go ahead */
+        goto cleanup;
     }
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    table = qemuMonitorGetBlockInfo(priv->mon);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        goto endjob;
-    if (!table)
-        goto endjob;
+    for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%u.state", cpuinfo[i].number);
+        if (virTypedParamsAddInt(&record->params,
+                                 &record->nparams,
+                                 maxparams,
+                                 param_name,
+                                 cpuinfo[i].state) < 0)
+            goto cleanup;
 
-    for (i = n = 0; i < vm->def->ndisks; i++) {
-        struct qemuDomainDiskInfo *info;
-        virDomainDiskDefPtr disk = vm->def->disks[i];
-        qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
-        const char *entryname = disk->info.alias;
+        /* stats below are available only if the VM is alive */
+        if (!virDomainObjIsActive(dom))
+            continue;
 
-        if (blockdev)
-            entryname = diskPriv->qomName;
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%u.time", cpuinfo[i].number);
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    param_name,
+                                    cpuinfo[i].cpuTime) < 0)
+            goto cleanup;
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "vcpu.%u.wait", cpuinfo[i].number);
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    param_name,
+                                    cpuwait[i]) < 0)
+            goto cleanup;
 
-        if ((info = virHashLookup(table, entryname)) &&
-            info->io_status != VIR_DOMAIN_DISK_ERROR_NONE) {
-            if (n == nerrors)
-                break;
+        /* state below is extracted from the individual vcpu structs */
+        if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
+            continue;
 
-            if (VIR_STRDUP(errors[n].disk, disk->dst) < 0)
-                goto endjob;
-            errors[n].error = info->io_status;
-            n++;
+        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+
+        if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
+            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                     "vcpu.%u.halted", cpuinfo[i].number);
+            if (virTypedParamsAddBoolean(&record->params,
+                                         &record->nparams,
+                                         maxparams,
+                                         param_name,
+                                         vcpupriv->halted == VIR_TRISTATE_BOOL_YES) < 0)
+                goto cleanup;
         }
     }
 
-    ret = n;
-
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
-    virHashFree(table);
-    if (ret < 0) {
-        for (i = 0; i < n; i++)
-            VIR_FREE(errors[i].disk);
-    }
+    VIR_FREE(cpuinfo);
+    VIR_FREE(cpuwait);
     return ret;
 }
 
-static int
-qemuDomainSetMetadata(virDomainPtr dom,
-                      int type,
-                      const char *metadata,
-                      const char *key,
-                      const char *uri,
-                      unsigned int flags)
-{
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    virQEMUDriverConfigPtr cfg = NULL;
-    virCapsPtr caps = NULL;
-    int ret = -1;
+#define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count) \
+do { \
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
+    if (virTypedParamsAddUInt(&(record)->params, \
+                              &(record)->nparams, \
+                              maxparams, \
+                              param_name, \
+                              count) < 0) \
+        goto cleanup; \
+} while (0)
 
-    virCheckFlags(VIR_DOMAIN_AFFECT_LIVE |
-                  VIR_DOMAIN_AFFECT_CONFIG, -1);
+#define QEMU_ADD_NAME_PARAM(record, maxparams, type, subtype, num, name) \
+do { \
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "%s.%zu.%s", type, num, subtype); \
+    if (virTypedParamsAddString(&(record)->params, \
+                                &(record)->nparams, \
+                                maxparams, \
+                                param_name, \
+                                name) < 0) \
+        goto cleanup; \
+} while (0)
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return -1;
+#define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value) \
+do { \
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "net.%zu.%s", num, name); \
+    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
+                                              &(record)->nparams, \
+                                              maxparams, \
+                                              param_name, \
+                                              value) < 0) \
+        return -1; \
+} while (0)
 
-    cfg = virQEMUDriverGetConfig(driver);
+/* Host interface statistics dumped once for all domains of a stats
+ * sweep, see qemuDomainStatsIfStatsNew. The stats workers have no way
+ * to receive extra arguments, so the tables are handed over to the
+ * thread collecting the stats of a domain via thread local storage. */
+typedef struct _qemuDomainStatsIfTables qemuDomainStatsIfTables;
+typedef qemuDomainStatsIfTables *qemuDomainStatsIfTablesPtr;
+struct _qemuDomainStatsIfTables {
+    virHashTablePtr tap; /* see virNetDevTapInterfaceStatsAll */
+    virHashTablePtr ovs; /* see virNetDevOpenvswitchInterfaceStatsAll */
+};
 
-    if (virDomainSetMetadataEnsureACL(dom->conn, vm->def, flags) < 0)
-        goto cleanup;
+static virThreadLocal qemuDomainStatsIfStatsLocal;
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
-        goto cleanup;
+static int
+qemuDomainStatsIfStatsOnceInit(void)
+{
+    if (virThreadLocalInit(&qemuDomainStatsIfStatsLocal, NULL) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize thread local variable"));
+        return -1;
+    }
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
+    return 0;
+}
 
-    ret = virDomainObjSetMetadata(vm, type, metadata, key, uri, caps,
-                                  driver->xmlopt, cfg->stateDir,
-                                  cfg->configDir, flags);
+VIR_ONCE_GLOBAL_INIT(qemuDomainStatsIfStats)
 
-    if (ret == 0) {
-        virObjectEventPtr ev = NULL;
-        ev = virDomainEventMetadataChangeNewFromObj(vm, type, uri);
-        virObjectEventStateQueue(driver->domainEventState, ev);
-    }
 
-    qemuDomainObjEndJob(driver, vm);
+static void
+qemuDomainStatsIfStatsFree(qemuDomainStatsIfTablesPtr tables)
+{
+    if (!tables)
+        return;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    virObjectUnref(caps);
-    virObjectUnref(cfg);
-    return ret;
+    virHashFree(tables->tap);
+    virHashFree(tables->ovs);
+    VIR_FREE(tables);
 }
 
-static char *
-qemuDomainGetMetadata(virDomainPtr dom,
-                      int type,
-                      const char *uri,
-                      unsigned int flags)
+
+/**
+ * qemuDomainStatsIfStatsNew:
+ *
+ * Dump the statistics of all host interfaces, and of all OVS interfaces
+ * if OVSDB is reachable, if the interface stats of @nvms domains are
+ * about to be collected. Querying each interface of each domain
+ * separately is considerably more expensive as soon as there are a few
+ * domains.
+ *
+ * Returns the tables, or NULL if it's not worth it. Interfaces missing
+ * from the tables are queried one by one.
+ */
+static qemuDomainStatsIfTablesPtr
+qemuDomainStatsIfStatsNew(unsigned int stats,
+                          size_t nvms)
 {
-    virDomainObjPtr vm;
-    char *ret = NULL;
+    qemuDomainStatsIfTablesPtr tables;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
+    if (!(stats & VIR_DOMAIN_STATS_INTERFACE) || nvms < 2)
         return NULL;
 
-    if (virDomainGetMetadataEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (qemuDomainStatsIfStatsInitialize() < 0 ||
+        VIR_ALLOC(tables) < 0) {
+        virResetLastError();
+        return NULL;
+    }
 
-    ret = virDomainObjGetMetadata(vm, type, uri, flags);
+    if (!(tables->tap = virNetDevTapInterfaceStatsAll())) {
+        VIR_DEBUG("Unable to dump host interface stats: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    if (!(tables->ovs = virNetDevOpenvswitchInterfaceStatsAll())) {
+        VIR_DEBUG("Unable to dump OVS interface stats: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    return tables;
 }
 
 
-static int
-qemuDomainGetCPUStats(virDomainPtr domain,
-                      virTypedParameterPtr params,
-                      unsigned int nparams,
-                      int start_cpu,
-                      unsigned int ncpus,
-                      unsigned int flags)
+static void
+qemuDomainStatsIfStatsSet(qemuDomainStatsIfTablesPtr tables)
 {
-    virDomainObjPtr vm = NULL;
-    int ret = -1;
-    qemuDomainObjPrivatePtr priv;
-    virBitmapPtr guestvcpus = NULL;
-
-    virCheckFlags(VIR_TYPED_PARAM_STRING_OKAY, -1);
-
-    if (!(vm = qemuDomObjFromDomain(domain)))
-        return -1;
-
-    priv = vm->privateData;
-
-    if (virDomainGetCPUStatsEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
+    if (qemuDomainStatsIfStatsInitialize() < 0 ||
+        virThreadLocalSet(&qemuDomainStatsIfStatsLocal, tables) < 0)
+        virResetLastError();
+}
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto cleanup;
 
-    if (!virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUACCT)) {
-        virReportError(VIR_ERR_OPERATION_INVALID,
-                       "%s", _("cgroup CPUACCT controller is not mounted"));
-        goto cleanup;
+static qemuDomainStatsIfTablesPtr
+qemuDomainStatsIfStatsGet(void)
+{
+    if (qemuDomainStatsIfStatsInitialize() < 0) {
+        virResetLastError();
+        return NULL;
     }
 
-    if (qemuDomainHasVcpuPids(vm) &&
-        !(guestvcpus = virDomainDefGetOnlineVcpumap(vm->def)))
-        goto cleanup;
-
-    if (start_cpu == -1)
-        ret = virCgroupGetDomainTotalCpuStats(priv->cgroup,
-                                              params, nparams);
-    else
-        ret = virCgroupGetPercpuStats(priv->cgroup, params, nparams,
-                                      start_cpu, ncpus, guestvcpus);
- cleanup:
-    virBitmapFree(guestvcpus);
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return virThreadLocalGet(&qemuDomainStatsIfStatsLocal);
 }
 
+
 static int
-qemuDomainPMSuspendForDuration(virDomainPtr dom,
-                               unsigned int target,
-                               unsigned long long duration,
-                               unsigned int flags)
+qemuDomainGetStatsInterface(virQEMUDriverPtr driver,
+                            virDomainObjPtr dom,
+                            virDomainStatsRecordPtr record,
+                            int *maxparams,
+                            unsigned int privflags ATTRIBUTE_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    qemuAgentPtr agent;
+    size_t i;
+    struct _virDomainInterfaceStats tmp;
+    qemuDomainStatsIfTablesPtr ifstats = qemuDomainStatsIfStatsGet();
     int ret = -1;
 
-    virCheckFlags(0, -1);
-
-    if (duration) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Duration not supported. Use 0 for now"));
-        return -1;
-    }
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if (!(target == VIR_NODE_SUSPEND_TARGET_MEM ||
-          target == VIR_NODE_SUSPEND_TARGET_DISK ||
-          target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("Unknown suspend target: %u"),
-                       target);
-        return -1;
-    }
+    QEMU_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    /* Check the path is one of the domain's network interfaces. */
+    for (i = 0; i < dom->def->nnets; i++) {
+        virDomainNetDefPtr net = dom->def->nets[i];
+        virDomainNetType actualType;
 
-    if (virDomainPMSuspendForDurationEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        if (!net->ifname)
+            continue;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+        memset(&tmp, 0, sizeof(tmp));
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        actualType = virDomainNetGetActualType(net);
 
-    if (vm->def->pm.s3 || vm->def->pm.s4) {
-        if (vm->def->pm.s3 == VIR_TRISTATE_BOOL_NO &&
-            (target == VIR_NODE_SUSPEND_TARGET_MEM ||
-             target == VIR_NODE_SUSPEND_TARGET_HYBRID)) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("S3 state is disabled for this domain"));
-            goto endjob;
-        }
+        QEMU_ADD_NAME_PARAM(record, maxparams,
+                            "net", "name", i, net->ifname);
 
-        if (vm->def->pm.s4 == VIR_TRISTATE_BOOL_NO &&
-            target == VIR_NODE_SUSPEND_TARGET_DISK) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("S4 state is disabled for this domain"));
-            goto endjob;
-        }
-    }
+        if (qemuDomainStatsCacheGetInterface(driver, dom, net->ifname,
+                                             &tmp) < 0) {
+            /* The interface may have been created after the dump */
+            if (actualType == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
+                if ((!ifstats || !ifstats->ovs ||
+                     virNetDevOpenvswitchInterfaceStatsLookup(ifstats->ovs,
+                                                              net->ifname,
+                                                              &tmp) < 0) &&
+                    virNetDevOpenvswitchInterfaceStats(net->ifname, &tmp) < 0) {
+                    virResetLastError();
+                    continue;
+                }
+            } else {
+                bool swapped = !virDomainNetTypeSharesHostView(net);
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+                if ((!ifstats || !ifstats->tap ||
+                     virNetDevTapInterfaceStatsLookup(ifstats->tap, net->ifname,
+                                                      &tmp, swapped) < 0) &&
+                    virNetDevTapInterfaceStats(net->ifname, &tmp, swapped) < 0) {
+                    virResetLastError();
+                    continue;
+                }
+            }
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentSuspend(agent, target);
-    qemuDomainObjExitAgent(vm, agent);
+            qemuDomainStatsCacheSetInterface(driver, dom, net->ifname, &tmp);
+        }
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.bytes", tmp.rx_bytes);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.pkts", tmp.rx_packets);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.errs", tmp.rx_errs);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "rx.drop", tmp.rx_drop);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.bytes", tmp.tx_bytes);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.pkts", tmp.tx_packets);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.errs", tmp.tx_errs);
+        QEMU_ADD_NET_PARAM(record, maxparams, i,
+                           "tx.drop", tmp.tx_drop);
+    }
 
+    ret = 0;
  cleanup:
-    virDomainObjEndAPI(&vm);
     return ret;
 }
 
+#undef QEMU_ADD_NET_PARAM
+
+#define QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, num, name, value) \
+    do { \
+        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+                 "block.%zu.%s", num, name); \
+        if (virTypedParamsAddUInt(&(record)->params, \
+                                  &(record)->nparams, \
+                                  maxparams, \
+                                  param_name, \
+                                  value) < 0) \
+            goto cleanup; \
+    } while (0)
+
+/* expects a LL, but typed parameter must be ULL */
+#define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value) \
+do { \
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "block.%zu.%s", num, name); \
+    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
+                                              &(record)->nparams, \
+                                              maxparams, \
+                                              param_name, \
+                                              value) < 0) \
+        goto cleanup; \
+} while (0)
+
+#define QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, num, name, value) \
+do { \
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+             "block.%zu.%s", num, name); \
+    if (virTypedParamsAddULLong(&(record)->params, \
+                                &(record)->nparams, \
+                                maxparams, \
+                                param_name, \
+                                value) < 0) \
+        goto cleanup; \
+} while (0)
+
+/* refresh information by opening images on the disk */
 static int
-qemuDomainPMWakeup(virDomainPtr dom,
-                   unsigned int flags)
+qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
+                                   virQEMUDriverConfigPtr cfg,
+                                   virDomainObjPtr dom,
+                                   virDomainStatsRecordPtr record,
+                                   int *maxparams,
+                                   virStorageSourcePtr src,
+                                   size_t block_idx)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
     int ret = -1;
-    qemuDomainObjPrivatePtr priv;
 
-    virCheckFlags(0, -1);
+    if (virStorageSourceIsEmpty(src))
+        return 0;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    if (qemuStorageLimitsRefresh(driver, cfg, dom, src) < 0) {
+        virResetLastError();
+        return 0;
+    }
 
-    if (virDomainPMWakeupEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (src->allocation)
+        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                 "allocation", src->allocation);
+    if (src->capacity)
+        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                 "capacity", src->capacity);
+    if (src->physical)
+        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                 "physical", src->physical);
+    ret = 0;
+ cleanup:
+    return ret;
+}
 
-    if (qemuDomainObjBeginJob(driver, vm, QEMU_JOB_MODIFY) < 0)
-        goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+/**
+ * qemuDomainGetStatsOneBlockRefreshNamed:
+ * @src: disk source structure
+ * @alias: disk alias
+ * @stats: hash table containing stats for all disks
+ * @nodedata: reply containing 'query-named-block-nodes' data
+ *
+ * Refresh disk block stats data (qemuBlockStatsPtr) which are present only
+ * in the reply of 'query-named-block-nodes' in cases when the data was gathered
+ * by using query-block originally.
+ */
+static void
+qemuDomainGetStatsOneBlockRefreshNamed(virStorageSourcePtr src,
+                                       const char *alias,
+                                       virHashTablePtr stats,
+                                       virHashTablePtr nodedata)
+{
+    qemuBlockStatsPtr entry;
 
-    priv = vm->privateData;
+    virJSONValuePtr data;
+    unsigned long long tmp;
 
-    qemuDomainObjEnterMonitor(driver, vm);
-    ret = qemuMonitorSystemWakeup(priv->mon);
-    if (qemuDomainObjExitMonitor(driver, vm) < 0)
-        ret = -1;
+    if (!nodedata || !src->nodestorage)
+        return;
 
- endjob:
-    qemuDomainObjEndJob(driver, vm);
+    if (!(entry = virHashLookup(stats, alias)))
+        return;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    if (!(data = virHashLookup(nodedata, src->nodestorage)))
+        return;
+
+    if (virJSONValueObjectGetNumberUlong(data, "write_threshold", &tmp) == 0)
+        entry->write_threshold = tmp;
 }
 
+
 static int
-qemuConnectListAllDomains(virConnectPtr conn,
-                          virDomainPtr **domains,
-                          unsigned int flags)
+qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
+                           virQEMUDriverConfigPtr cfg,
+                           virDomainObjPtr dom,
+                           virDomainStatsRecordPtr record,
+                           int *maxparams,
+                           const char *entryname,
+                           virStorageSourcePtr src,
+                           size_t block_idx,
+                           virHashTablePtr stats)
 {
-    virQEMUDriverPtr driver = conn->privateData;
+    qemuBlockStats *entry;
     int ret = -1;
 
-    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ALL, -1);
+    /* the VM is offline so we have to go and load the stast from the disk by
+     * ourselves */
+    if (!virDomainObjIsActive(dom)) {
+        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, record,
+                                                 maxparams, src, block_idx);
+        goto cleanup;
+    }
 
-    if (virConnectListAllDomainsEnsureACL(conn) < 0)
+    /* In case where qemu didn't provide the stats we stop here rather than
+     * trying to refresh the stats from the disk. Inability to provide stats is
+     * usually caused by blocked storage so this would make libvirtd hang */
+    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname))) {
+        ret = 0;
         goto cleanup;
+    }
 
-    ret = virDomainObjListExport(driver->domains, conn, domains,
-                                 virConnectListAllDomainsCheckACL, flags);
+    QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                             "allocation", entry->wr_highest_offset);
+
+    if (entry->capacity)
+        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                 "capacity", entry->capacity);
+    if (entry->physical) {
+        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                 "physical", entry->physical);
+    } else {
+        if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0) {
+            QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
+                                     "physical", src->physical);
+        } else {
+            virResetLastError();
+        }
+    }
 
+    ret = 0;
  cleanup:
     return ret;
 }
 
-static char *
-qemuDomainQemuAgentCommand(virDomainPtr domain,
-                           const char *cmd,
-                           int timeout,
-                           unsigned int flags)
+
+static int
+qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
+                                            virHashTablePtr stats,
+                                            size_t recordnr,
+                                            virDomainStatsRecordPtr records,
+                                            int *nrecords)
 {
-    virQEMUDriverPtr driver = domain->conn->privateData;
-    virDomainObjPtr vm;
+    qemuBlockStats *entry;
     int ret = -1;
-    char *result = NULL;
-    qemuAgentPtr agent;
-
-    virCheckFlags(0, NULL);
-
-    if (!(vm = qemuDomObjFromDomain(domain)))
-        goto cleanup;
 
-    if (virDomainQemuAgentCommandEnsureACL(domain->conn, vm->def) < 0)
-        goto cleanup;
-
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
+    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname))) {
+        ret = 0;
         goto cleanup;
+    }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
-
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
-
-    qemuDomainObjTaint(driver, vm, VIR_DOMAIN_TAINT_CUSTOM_GA_COMMAND, NULL);
-
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentArbitraryCommand(agent, cmd, &result, timeout);
-    qemuDomainObjExitAgent(vm, agent);
-    if (ret < 0)
-        VIR_FREE(result);
-
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    if (entry->write_threshold)
+        QEMU_ADD_BLOCK_PARAM_ULL(records, nrecords, recordnr, "threshold",
+                                 entry->write_threshold);
 
+    ret = 0;
  cleanup:
-    virDomainObjEndAPI(&vm);
-    return result;
-}
-
-
-static int
-qemuConnectDomainQemuMonitorEventRegister(virConnectPtr conn,
-                                          virDomainPtr dom,
-                                          const char *event,
-                                          virConnectDomainQemuMonitorEventCallback callback,
-                                          void *opaque,
-                                          virFreeCallback freecb,
-                                          unsigned int flags)
+    return ret;
+}
+
+
+static int
+qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
+                                      virHashTablePtr stats,
+                                      size_t recordnr,
+                                      virDomainStatsRecordPtr records,
+                                      int *nrecords)
 {
-    virQEMUDriverPtr driver = conn->privateData;
+    qemuBlockStats *entry;
     int ret = -1;
 
-    if (virConnectDomainQemuMonitorEventRegisterEnsureACL(conn) < 0)
+    /* In case where qemu didn't provide the stats we stop here rather than
+     * trying to refresh the stats from the disk. Inability to provide stats is
+     * usually caused by blocked storage so this would make libvirtd hang */
+    if (!stats || !frontendname || !(entry = virHashLookup(stats, frontendname))) {
+        ret = 0;
         goto cleanup;
+    }
 
-    if (virDomainQemuMonitorEventStateRegisterID(conn,
-                                                 driver->domainEventState,
-                                                 dom, event, callback,
-                                                 opaque, freecb, flags,
-                                                 &ret) < 0)
-        ret = -1;
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.reqs", entry->rd_req);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.bytes", entry->rd_bytes);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.times", entry->rd_total_times);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.reqs", entry->wr_req);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.bytes", entry->wr_bytes);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.times", entry->wr_total_times);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.reqs", entry->flush_req);
+    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.times", entry->flush_total_times);
 
+    ret = 0;
  cleanup:
     return ret;
 }
 
 
 static int
-qemuConnectDomainQemuMonitorEventDeregister(virConnectPtr conn,
-                                            int callbackID)
+qemuDomainGetStatsBlockExportHeader(virDomainDiskDefPtr disk,
+                                    virStorageSourcePtr src,
+                                    size_t recordnr,
+                                    virDomainStatsRecordPtr records,
+                                    int *nrecords)
 {
-    virQEMUDriverPtr driver = conn->privateData;
     int ret = -1;
 
-    if (virConnectDomainQemuMonitorEventDeregisterEnsureACL(conn) < 0)
-        goto cleanup;
+    QEMU_ADD_NAME_PARAM(records, nrecords, "block", "name", recordnr, disk->dst);
 
-    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
-                                        callbackID, true) < 0)
-        goto cleanup;
+    if (virStorageSourceIsLocalStorage(src) && src->path)
+        QEMU_ADD_NAME_PARAM(records, nrecords, "block", "path", recordnr, src->path);
+    if (src->id)
+        QEMU_ADD_BLOCK_PARAM_UI(records, nrecords, recordnr, "backingIndex",
+                                src->id);
 
     ret = 0;
-
  cleanup:
     return ret;
 }
 
 
 static int
-qemuDomainFSTrim(virDomainPtr dom,
-                 const char *mountPoint,
-                 unsigned long long minimum,
-                 unsigned int flags)
+qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
+                                  virHashTablePtr stats,
+                                  virHashTablePtr nodestats,
+                                  virDomainStatsRecordPtr records,
+                                  int *nrecords,
+                                  size_t *recordnr,
+                                  bool visitBacking,
+                                  virQEMUDriverPtr driver,
+                                  virQEMUDriverConfigPtr cfg,
+                                  virDomainObjPtr dom,
+                                  bool blockdev)
+
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    qemuAgentPtr agent;
+    char *alias = NULL;
+    virStorageSourcePtr n;
+    const char *frontendalias;
+    const char *backendalias;
+    const char *backendstoragealias;
     int ret = -1;
 
-    virCheckFlags(0, -1);
+    for (n = disk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
+        if (blockdev) {
+            frontendalias = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
+            backendalias = n->nodeformat;
+            backendstoragealias = n->nodestorage;
+        } else {
+            /* alias may be NULL if the VM is not running */
+            if (disk->info.alias &&
+                !(alias = qemuDomainStorageAlias(disk->info.alias, n->id)))
+                goto cleanup;
 
-    if (mountPoint) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("Specifying mount point "
-                         "is not supported for now"));
-        return -1;
-    }
+            qemuDomainGetStatsOneBlockRefreshNamed(n, alias, stats, nodestats);
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+            frontendalias = alias;
+            backendalias = alias;
+            backendstoragealias = alias;
+        }
 
-    if (virDomainFSTrimEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        if (qemuDomainGetStatsBlockExportHeader(disk, n, *recordnr,
+                                                records, nrecords) < 0)
+            goto cleanup;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+        /* The following stats make sense only for the frontend device */
+        if (n == disk->src) {
+            if (qemuDomainGetStatsBlockExportFrontend(frontendalias, stats, *recordnr,
+                                                      records, nrecords) < 0)
+                goto cleanup;
+        }
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, records, nrecords,
+                                       backendalias, n, *recordnr,
+                                       stats) < 0)
+            goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        if (qemuDomainGetStatsBlockExportBackendStorage(backendstoragealias,
+                                                        stats, *recordnr,
+                                                        records, nrecords) < 0)
+            goto cleanup;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ret = qemuAgentFSTrim(agent, minimum);
-    qemuDomainObjExitAgent(vm, agent);
+        VIR_FREE(alias);
+        (*recordnr)++;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+        if (!visitBacking)
+            break;
+    }
+
+    ret = 0;
 
  cleanup:
-    virDomainObjEndAPI(&vm);
+    VIR_FREE(alias);
     return ret;
 }
 
 
 static int
-qemuNodeGetInfo(virConnectPtr conn,
-                virNodeInfoPtr nodeinfo)
-{
-    if (virNodeGetInfoEnsureACL(conn) < 0)
-        return -1;
-
-    return virCapabilitiesGetNodeInfo(nodeinfo);
-}
-
-
-static int
-qemuNodeGetCPUStats(virConnectPtr conn,
-                    int cpuNum,
-                    virNodeCPUStatsPtr params,
-                    int *nparams,
-                    unsigned int flags)
+qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
+                        virDomainObjPtr dom,
+                        virDomainStatsRecordPtr record,
+                        int *maxparams,
+                        unsigned int privflags)
 {
-    if (virNodeGetCPUStatsEnsureACL(conn) < 0)
-        return -1;
-
-    return virHostCPUGetStats(cpuNum, params, nparams, flags);
-}
+    size_t i;
+    int ret = -1;
+    int rc;
+    virHashTablePtr stats = NULL;
+    virHashTablePtr nodestats = NULL;
+    virJSONValuePtr nodedata = NULL;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    bool fetchnodedata = virQEMUCapsGet(priv->qemuCaps,
+                                        QEMU_CAPS_QUERY_NAMED_BLOCK_NODES) && !blockdev;
+    int count_index = -1;
+    size_t visited = 0;
+    bool visitBacking = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
 
+    /* The named block nodes are not cached, without -blockdev they
+     * provide the write thresholds, see
+     * qemuDomainGetStatsOneBlockRefreshNamed. */
+    if (!fetchnodedata)
+        stats = qemuDomainStatsCacheGetBlock(driver, dom, visitBacking, &rc);
 
-static int
-qemuNodeGetMemoryStats(virConnectPtr conn,
-                       int cellNum,
-                       virNodeMemoryStatsPtr params,
-                       int *nparams,
-                       unsigned int flags)
-{
-    if (virNodeGetMemoryStatsEnsureACL(conn) < 0)
-        return -1;
+    if (!stats && HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
+        qemuDomainObjEnterMonitor(driver, dom);
 
-    return virHostMemGetStats(cellNum, params, nparams, flags);
-}
+        rc = qemuMonitorGetAllBlockStatsCapacity(priv->mon, &stats,
+                                                 visitBacking, blockdev);
 
+        if (fetchnodedata)
+            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
 
-static int
-qemuNodeGetCellsFreeMemory(virConnectPtr conn,
-                           unsigned long long *freeMems,
-                           int startCell,
-                           int maxCells)
-{
-    if (virNodeGetCellsFreeMemoryEnsureACL(conn) < 0)
-        return -1;
+        if (qemuDomainObjExitMonitor(driver, dom) < 0)
+            goto cleanup;
 
-    return virHostMemGetCellsFree(freeMems, startCell, maxCells);
-}
+        /* failure to retrieve stats is fine at this point */
+        if (rc < 0 || (fetchnodedata && !nodedata))
+            virResetLastError();
+        else
+            qemuDomainStatsCacheSetBlock(driver, dom, stats, visitBacking, rc);
+    }
 
+    if (nodedata &&
+        !(nodestats = qemuBlockGetNodeData(nodedata)))
+        goto cleanup;
 
-static unsigned long long
-qemuNodeGetFreeMemory(virConnectPtr conn)
-{
-    unsigned long long freeMem;
+    /* When listing backing chains, it's easier to fix up the count
+     * after the iteration than it is to iterate twice; but we still
+     * want count listed first.  */
+    count_index = record->nparams;
+    QEMU_ADD_COUNT_PARAM(record, maxparams, "block", 0);
 
-    if (virNodeGetFreeMemoryEnsureACL(conn) < 0)
-        return 0;
+    for (i = 0; i < dom->def->ndisks; i++) {
+        if (qemuDomainGetStatsBlockExportDisk(dom->def->disks[i], stats, nodestats,
+                                              record, maxparams, &visited,
+                                              visitBacking, driver, cfg, dom,
+                                              blockdev) < 0)
+            goto cleanup;
+    }
 
-    if (virHostMemGetInfo(NULL, &freeMem) < 0)
-        return 0;
+    record->params[count_index].value.ui = visited;
+    ret = 0;
 
-    return freeMem;
+ cleanup:
+    virHashFree(stats);
+    virHashFree(nodestats);
+    virJSONValueFree(nodedata);
+    virObjectUnref(cfg);
+    return ret;
 }
 
+#undef QEMU_ADD_BLOCK_PARAM_LL
 
-static int
-qemuNodeGetMemoryParameters(virConnectPtr conn,
-                            virTypedParameterPtr params,
-                            int *nparams,
-                            unsigned int flags)
-{
-    if (virNodeGetMemoryParametersEnsureACL(conn) < 0)
-        return -1;
+#undef QEMU_ADD_BLOCK_PARAM_ULL
 
-    return virHostMemGetParameters(params, nparams, flags);
-}
+#undef QEMU_ADD_NAME_PARAM
 
+#undef QEMU_ADD_COUNT_PARAM
 
 static int
-qemuNodeSetMemoryParameters(virConnectPtr conn,
-                            virTypedParameterPtr params,
-                            int nparams,
-                            unsigned int flags)
+qemuDomainGetStatsPerfEvents(virPerfPtr perf,
+                             const char *prefix,
+                             virDomainStatsRecordPtr record,
+                             int *maxparams)
 {
-    if (virNodeSetMemoryParametersEnsureACL(conn) < 0)
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    uint64_t values[VIR_PERF_EVENT_LAST] = { 0 };
+    size_t i;
+
+    if (virPerfReadEvents(perf, values) < 0)
         return -1;
 
-    return virHostMemSetParameters(params, nparams, flags);
-}
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        if (!virPerfEventIsEnabled(perf, i))
+             continue;
 
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.%s",
+                 prefix, virPerfEventTypeToString(i));
 
-static int
-qemuNodeGetCPUMap(virConnectPtr conn,
-                  unsigned char **cpumap,
-                  unsigned int *online,
-                  unsigned int flags)
-{
-    if (virNodeGetCPUMapEnsureACL(conn) < 0)
-        return -1;
+        if (virTypedParamsAddULLong(&record->params,
+                                    &record->nparams,
+                                    maxparams,
+                                    param_name,
+                                    values[i]) < 0)
+            return -1;
+    }
 
-    return virHostCPUGetMap(cpumap, online, flags);
+    return 0;
 }
 
-
 static int
-qemuNodeSuspendForDuration(virConnectPtr conn,
-                           unsigned int target,
-                           unsigned long long duration,
-                           unsigned int flags)
+qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                       virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams,
+                       unsigned int privflags ATTRIBUTE_UNUSED)
 {
-    if (virNodeSuspendForDurationEnsureACL(conn) < 0)
+    char prefix[VIR_TYPED_PARAM_FIELD_LENGTH];
+    size_t i;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+
+    if (!priv->perf)
+        return 0;
+
+    if (qemuDomainGetStatsPerfEvents(priv->perf, "perf",
+                                     record, maxparams) < 0)
         return -1;
 
-    return virNodeSuspend(target, duration, flags);
+    for (i = 0; i < virDomainDefGetVcpusMax(dom->def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(dom->def, i);
+        qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+
+        if (!vcpu->online || !vcpupriv->perf)
+            continue;
+
+        snprintf(prefix, VIR_TYPED_PARAM_FIELD_LENGTH, "perf.vcpu.%zu", i);
+        if (qemuDomainGetStatsPerfEvents(vcpupriv->perf, prefix,
+                                         record, maxparams) < 0)
+            return -1;
+    }
+
+    return 0;
 }
 
 static int
-qemuConnectGetCPUModelNames(virConnectPtr conn,
-                            const char *archName,
-                            char ***models,
-                            unsigned int flags)
+qemuDomainGetStatsPressureStall(virCgroupPressureResource resource,
+                                const char *kind,
+                                virCgroupPressureStallPtr stall,
+                                virDomainStatsRecordPtr record,
+                                int *maxparams)
 {
-    virArch arch;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    const char *res = virCgroupPressureResourceTypeToString(resource);
 
-    virCheckFlags(0, -1);
-    if (virConnectGetCPUModelNamesEnsureACL(conn) < 0)
-        return -1;
+#define QEMU_ADD_PRESSURE_PARAM(type, name, value) \
+    do { \
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
+                 "pressure.%s.%s.%s", res, kind, name); \
+        if (virTypedParamsAdd##type(&record->params, \
+                                    &record->nparams, \
+                                    maxparams, \
+                                    param_name, \
+                                    value) < 0) \
+            return -1; \
+    } while (0)
 
-    if (!(arch = virArchFromString(archName))) {
-        virReportError(VIR_ERR_INVALID_ARG,
-                       _("cannot find architecture %s"),
-                       archName);
-        return -1;
-    }
+    QEMU_ADD_PRESSURE_PARAM(Double, "avg10", stall->avg10);
+    QEMU_ADD_PRESSURE_PARAM(Double, "avg60", stall->avg60);
+    QEMU_ADD_PRESSURE_PARAM(Double, "avg300", stall->avg300);
+    QEMU_ADD_PRESSURE_PARAM(ULLong, "total", stall->total);
 
-    return virCPUGetModels(arch, models);
-}
+#undef QEMU_ADD_PRESSURE_PARAM
 
+    return 0;
+}
 
-static char *
-qemuDomainGetHostname(virDomainPtr dom,
-                      unsigned int flags)
+static int
+qemuDomainGetStatsPressure(virQEMUDriverPtr driver,
+                           virDomainObjPtr dom,
+                           virDomainStatsRecordPtr record,
+                           int *maxparams,
+                           unsigned int privflags)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuAgentPtr agent;
-    char *hostname = NULL;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    virCgroupPressure pressure;
+    virCgroupStats stats;
+    unsigned int resources = 0;
+    size_t i;
+    int rc;
 
-    virCheckFlags(0, NULL);
+    if (!virDomainObjIsActive(dom) || !priv->cgroup)
+        return 0;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return NULL;
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++) {
+        if ((rc = virCgroupGetPressure(priv->cgroup, i, &pressure)) < 0)
+            return -1;
 
-    if (virDomainGetHostnameEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        /* PSI not available on this host or for this controller */
+        if (rc > 0)
+            continue;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
-        goto cleanup;
+        resources |= 1 << i;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        if (qemuDomainGetStatsPressureStall(i, "some", &pressure.some,
+                                            record, maxparams) < 0)
+            return -1;
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+        if (pressure.hasFull &&
+            qemuDomainGetStatsPressureStall(i, "full", &pressure.full,
+                                            record, maxparams) < 0)
+            return -1;
+    }
 
-    agent = qemuDomainObjEnterAgent(vm);
-    ignore_value(qemuAgentGetHostname(agent, &hostname));
-    qemuDomainObjExitAgent(vm, agent);
+    /* Report the IO counters along with the IO pressure so that
+     * consumers can tell stalls of an idle disk from a saturated one */
+    if (resources & (1 << VIR_CGROUP_PRESSURE_IO)) {
+        if (virCgroupGetStatsSnapshot(priv->cgroup,
+                                      1 << VIR_CGROUP_CONTROLLER_BLKIO,
+                                      &stats) == 0 &&
+            (stats.controllers & (1 << VIR_CGROUP_CONTROLLER_BLKIO))) {
+            if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, "pressure.io.rd.reqs",
+                                        stats.blkioRequestsRead) < 0 ||
+                virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, "pressure.io.rd.bytes",
+                                        stats.blkioBytesRead) < 0 ||
+                virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, "pressure.io.wr.reqs",
+                                        stats.blkioRequestsWrite) < 0 ||
+                virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, "pressure.io.wr.bytes",
+                                        stats.blkioBytesWrite) < 0)
+                return -1;
+        }
+    }
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    if (resources && (privflags & QEMU_DOMAIN_STATS_PRESSURE_TRIGGER))
+        qemuDomainStatsPressureWatch(driver, dom, resources);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return hostname;
+    return 0;
 }
 
+static const char *qemuDomainResctrlMonitorFeatures[] = {
+    "llc_occupancy", "mbm_total_bytes", "mbm_local_bytes", NULL
+};
 
 static int
-qemuDomainGetTime(virDomainPtr dom,
-                  long long *seconds,
-                  unsigned int *nseconds,
-                  unsigned int flags)
+qemuDomainGetStatsResctrlMonitor(virResctrlMonitorPtr monitor,
+                                 virBitmapPtr vcpus,
+                                 size_t num,
+                                 virDomainStatsRecordPtr record,
+                                 int *maxparams)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm = NULL;
-    qemuAgentPtr agent;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    virResctrlMonitorStatsPtr *stats = NULL;
+    size_t nstats = 0;
+    VIR_AUTOFREE(char *) vcpustr = NULL;
+    size_t i;
+    size_t j;
     int ret = -1;
-    int rv;
 
-    virCheckFlags(0, ret);
-
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return ret;
+    if (virResctrlMonitorGetStats(monitor, qemuDomainResctrlMonitorFeatures,
+                                  &stats, &nstats) < 0)
+        return -1;
 
-    if (virDomainGetTimeEnsureACL(dom->conn, vm->def) < 0)
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+             "resctrl.monitor.%zu.name", num);
+    if (virTypedParamsAddString(&record->params, &record->nparams,
+                                maxparams, param_name,
+                                vcpus ? virResctrlMonitorGetID(monitor) :
+                                "domain") < 0)
         goto cleanup;
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_QUERY) < 0)
-        goto cleanup;
+    if (vcpus) {
+        if (!(vcpustr = virBitmapFormat(vcpus)))
+            goto cleanup;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "resctrl.monitor.%zu.vcpus", num);
+        if (virTypedParamsAddString(&record->params, &record->nparams,
+                                    maxparams, param_name, vcpustr) < 0)
+            goto cleanup;
+    }
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+             "resctrl.monitor.%zu.bank.count", num);
+    if (virTypedParamsAddUInt(&record->params, &record->nparams,
+                              maxparams, param_name, nstats) < 0)
+        goto cleanup;
 
-    agent = qemuDomainObjEnterAgent(vm);
-    rv = qemuAgentGetTime(agent, seconds, nseconds);
-    qemuDomainObjExitAgent(vm, agent);
+    for (i = 0; i < nstats; i++) {
+        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                 "resctrl.monitor.%zu.bank.%zu.id", num, i);
+        if (virTypedParamsAddUInt(&record->params, &record->nparams,
+                                  maxparams, param_name, stats[i]->id) < 0)
+            goto cleanup;
 
-    if (rv < 0)
-        goto endjob;
+        for (j = 0; j < stats[i]->nvals; j++) {
+            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                     "resctrl.monitor.%zu.bank.%zu.%s",
+                     num, i, stats[i]->features[j]);
+            if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, param_name,
+                                        stats[i]->vals[j]) < 0)
+                goto cleanup;
+        }
+    }
 
     ret = 0;
-
- endjob:
-    qemuDomainObjEndAgentJob(vm);
-
  cleanup:
-    virDomainObjEndAPI(&vm);
+    virResctrlMonitorFreeStats(stats, nstats);
     return ret;
 }
 
+static int
+qemuDomainGetStatsResctrl(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int privflags ATTRIBUTE_UNUSED)
+{
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    size_t count = 0;
+    size_t i;
+
+    if (!virDomainObjIsActive(dom))
+        return 0;
+
+    for (i = 0; i < priv->nresctrlMonitors; i++) {
+        if (priv->resctrlMonitors[i])
+            count++;
+    }
+
+    if (!count)
+        return 0;
+
+    if (virTypedParamsAddUInt(&record->params, &record->nparams, maxparams,
+                              "resctrl.monitor.count", count) < 0)
+        return -1;
+
+    count = 0;
+    for (i = 0; i < priv->nresctrlMonitors; i++) {
+        if (!priv->resctrlMonitors[i])
+            continue;
+
+        if (qemuDomainGetStatsResctrlMonitor(priv->resctrlMonitors[i],
+                                             i ? dom->def->resctrls[i - 1]->vcpus : NULL,
+                                             count++, record, maxparams) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+typedef int
+(*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int flags);
+
+struct qemuDomainGetStatsWorker {
+    qemuDomainGetStatsFunc func;
+    unsigned int stats;
+    bool monitor;
+};
 
 static int
-qemuDomainSetTime(virDomainPtr dom,
-                  long long seconds,
-                  unsigned int nseconds,
-                  unsigned int flags)
+qemuDomainGetStatsVcpuKVM(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                          virDomainObjPtr dom,
+                          virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int privflags ATTRIBUTE_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    qemuDomainObjPrivatePtr priv;
-    virDomainObjPtr vm;
-    qemuAgentPtr agent;
-    bool rtcSync = flags & VIR_DOMAIN_TIME_SYNC;
-    int ret = -1;
-    int rv;
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    char buf[128];
+    unsigned long long runtime;
+    unsigned long long delay;
+    unsigned long long slices;
+    unsigned long long value;
+    size_t i;
+    size_t j;
 
-    virCheckFlags(VIR_DOMAIN_TIME_SYNC, ret);
+    if (!virDomainObjIsActive(dom))
+        return 0;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        return ret;
+    for (i = 0; i < virDomainDefGetVcpusMax(dom->def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(dom->def, i);
+        qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
 
-    if (virDomainSetTimeEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+        if (!vcpu->online || vcpupriv->tid <= 0)
+            continue;
 
-    priv = vm->privateData;
+        /* run time, run queue delay and number of timeslices; the time a
+         * vCPU spends runnable but not running is what the guest sees as
+         * steal time */
+        if (virProcessStatFileRead(&vcpupriv->schedstatFile, dom->pid,
+                                   vcpupriv->tid, "schedstat",
+                                   buf, sizeof(buf)) > 0 &&
+            sscanf(buf, "%llu %llu %llu", &runtime, &delay, &slices) == 3) {
+            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                     "vcpu.%zu.steal", i);
+            if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, param_name, delay) < 0)
+                return -1;
 
-    if (qemuDomainObjBeginJobWithAgent(driver, vm,
-                                       QEMU_JOB_MODIFY,
-                                       QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                     "vcpu.%zu.timeslices", i);
+            if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, param_name, slices) < 0)
+                return -1;
+        }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+        qemuDomainVcpuOpenKVMStats(dom, i);
 
-    /* On x86, the rtc-reset-reinjection QMP command must be called after
-     * setting the time to avoid trouble down the line. If the command is
-     * not available, don't set the time at all and report an error */
-    if (ARCH_IS_X86(vm->def->os.arch) &&
-        !virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION))
-    {
-        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
-                       _("cannot set time: qemu doesn't support "
-                         "rtc-reset-reinjection command"));
-        goto endjob;
-    }
+        for (j = 0; j < QEMU_DOMAIN_VCPU_KVM_STAT_LAST; j++) {
+            if (qemuDomainVcpuReadKVMStat(vcpupriv, j, &value) < 0)
+                continue;
 
-    if (!qemuDomainAgentAvailable(vm, true))
-        goto endjob;
+            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
+                     "vcpu.%zu.kvm.%s", i, qemuDomainVcpuKVMStatTypeToString(j));
+            if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                        maxparams, param_name, value) < 0)
+                return -1;
+        }
+    }
 
-    agent = qemuDomainObjEnterAgent(vm);
-    rv = qemuAgentSetTime(agent, seconds, nseconds, rtcSync);
-    qemuDomainObjExitAgent(vm, agent);
+    return 0;
+}
 
-    if (rv < 0)
-        goto endjob;
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+static int
+qemuDomainGetStatsJobsAdd(virDomainStatsRecordPtr record,
+                          int *maxparams,
+                          unsigned int *njobs,
+                          const char *prefix,
+                          const char *name,
+                          qemuDomainJobAcctCounterPtr counter)
+{
+    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
+    VIR_AUTOFREE(char *) fullname = NULL;
 
-    /* Don't try to call rtc-reset-reinjection if it's not available */
-    if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_RTC_RESET_REINJECTION)) {
-        qemuDomainObjEnterMonitor(driver, vm);
-        rv = qemuMonitorRTCResetReinjection(priv->mon);
-        if (qemuDomainObjExitMonitor(driver, vm) < 0)
-            goto endjob;
+    if (!counter->count)
+        return 0;
 
-        if (rv < 0)
-            goto endjob;
-    }
+    if (virAsprintf(&fullname, "%s%s", prefix, name) < 0)
+        return -1;
 
-    ret = 0;
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "job.%u.name", *njobs);
+    if (virTypedParamsAddString(&record->params, &record->nparams,
+                                maxparams, param_name, fullname) < 0)
+        return -1;
 
- endjob:
-    qemuDomainObjEndJobWithAgent(driver, vm);
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "job.%u.count", *njobs);
+    if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                maxparams, param_name, counter->count) < 0)
+        return -1;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "job.%u.time", *njobs);
+    if (virTypedParamsAddULLong(&record->params, &record->nparams,
+                                maxparams, param_name, counter->time) < 0)
+        return -1;
+
+    (*njobs)++;
+    return 0;
 }
 
 
 static int
-qemuDomainFSFreeze(virDomainPtr dom,
-                   const char **mountpoints,
-                   unsigned int nmountpoints,
-                   unsigned int flags)
+qemuDomainGetStatsJobs(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
+                       virDomainObjPtr dom,
+                       virDomainStatsRecordPtr record,
+                       int *maxparams,
+                       unsigned int privflags ATTRIBUTE_UNUSED)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
+    qemuDomainObjPrivatePtr priv = dom->privateData;
+    qemuDomainJobAcctPtr acct = &priv->jobAcct;
+    unsigned int njobs = 0;
+    size_t i;
 
-    virCheckFlags(0, -1);
+    if (virTypedParamsAddULLong(&record->params, &record->nparams, maxparams,
+                                "job.wait.count", acct->waits) < 0 ||
+        virTypedParamsAddULLong(&record->params, &record->nparams, maxparams,
+                                "job.wait.time", acct->waitTime) < 0 ||
+        virTypedParamsAddULLong(&record->params, &record->nparams, maxparams,
+                                "job.wait.timeouts", acct->timeouts) < 0)
+        return -1;
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
+    for (i = 0; i < QEMU_JOB_LAST; i++) {
+        if (qemuDomainGetStatsJobsAdd(record, maxparams, &njobs, "",
+                                      qemuDomainJobTypeToString(i),
+                                      &acct->job[i]) < 0)
+            return -1;
+    }
 
-    if (virDomainFSFreezeEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    for (i = 0; i < QEMU_AGENT_JOB_LAST; i++) {
+        if (qemuDomainGetStatsJobsAdd(record, maxparams, &njobs, "agent ",
+                                      qemuDomainAgentJobTypeToString(i),
+                                      &acct->agentJob[i]) < 0)
+            return -1;
+    }
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+    for (i = 0; i < QEMU_ASYNC_JOB_LAST; i++) {
+        if (qemuDomainGetStatsJobsAdd(record, maxparams, &njobs, "async ",
+                                      qemuDomainAsyncJobTypeToString(i),
+                                      &acct->asyncJob[i]) < 0)
+            return -1;
+    }
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
+    if (virTypedParamsAddUInt(&record->params, &record->nparams, maxparams,
+                              "job.count", njobs) < 0 ||
+        virTypedParamsAddULLong(&record->params, &record->nparams, maxparams,
+                                "monitor.calls", acct->monCalls) < 0 ||
+        virTypedParamsAddULLong(&record->params, &record->nparams, maxparams,
+                                "monitor.time", acct->monTime) < 0)
+        return -1;
 
-    ret = qemuDomainSnapshotFSFreeze(driver, vm, mountpoints, nmountpoints);
+    return 0;
+}
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
-}
+static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
+    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false },
+    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false },
+    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true },
+    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true },
+    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
+    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
+    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
+    { qemuDomainGetStatsPressure, VIR_DOMAIN_STATS_PRESSURE, false },
+    { qemuDomainGetStatsResctrl, VIR_DOMAIN_STATS_RESCTRL, false },
+    { qemuDomainGetStatsVcpuKVM, VIR_DOMAIN_STATS_VCPU_KVM, false },
+    { qemuDomainGetStatsJobs, VIR_DOMAIN_STATS_JOBS, false },
+    { NULL, 0, false }
+};
 
 
 static int
-qemuDomainFSThaw(virDomainPtr dom,
-                 const char **mountpoints,
-                 unsigned int nmountpoints,
-                 unsigned int flags)
+qemuDomainGetStatsCheckSupport(unsigned int *stats,
+                               bool enforce)
 {
-    virQEMUDriverPtr driver = dom->conn->privateData;
-    virDomainObjPtr vm;
-    int ret = -1;
+    unsigned int supportedstats = 0;
+    size_t i;
 
-    virCheckFlags(0, -1);
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        supportedstats |= qemuDomainGetStatsWorkers[i].stats;
 
-    if (mountpoints || nmountpoints) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
-                       _("specifying mountpoints is not supported"));
-        return ret;
+    if (*stats == 0) {
+        *stats = supportedstats;
+        return 0;
     }
 
-    if (!(vm = qemuDomObjFromDomain(dom)))
-        goto cleanup;
-
-    if (virDomainFSThawEnsureACL(dom->conn, vm->def) < 0)
-        goto cleanup;
+    if (enforce &&
+        *stats & ~supportedstats) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                       _("Stats types bits 0x%x are not supported by this daemon"),
+                       *stats & ~supportedstats);
+        return -1;
+    }
 
-    if (qemuDomainObjBeginAgentJob(driver, vm, QEMU_AGENT_JOB_MODIFY) < 0)
-        goto cleanup;
+    *stats &= supportedstats;
+    return 0;
+}
 
-    if (virDomainObjCheckActive(vm) < 0)
-        goto endjob;
 
-    ret = qemuDomainSnapshotFSThaw(driver, vm, true);
+static bool
+qemuDomainGetStatsNeedMonitor(unsigned int stats)
+{
+    size_t i;
 
- endjob:
-    qemuDomainObjEndAgentJob(vm);
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
+        if (stats & qemuDomainGetStatsWorkers[i].stats &&
+            qemuDomainGetStatsWorkers[i].monitor)
+            return true;
 
- cleanup:
-    virDomainObjEndAPI(&vm);
-    return ret;
+    return false;
 }
 
 
 static int
-qemuNodeGetFreePages(virConnectPtr conn,
-                     unsigned int npages,
-                     unsigned int *pages,
-                     int startCell,
-                     unsigned int cellCount,
-                     unsigned long long *counts,
-                     unsigned int flags)
+qemuDomainGetStatsParams(virQEMUDriverPtr driver,
+                         virDomainObjPtr dom,
+                         unsigned int stats,
+                         virDomainStatsRecordPtr record,
+                         unsigned int flags)
 {
-    virCheckFlags(0, -1);
+    int maxparams = 0;
+    size_t i;
 
-    if (virNodeGetFreePagesEnsureACL(conn) < 0)
-        return -1;
+    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
+        if (stats & qemuDomainGetStatsWorkers[i].stats) {
+            if (qemuDomainGetStatsWorkers[i].func(driver, dom, record,
+                                                  &maxparams, flags) < 0)
+                return -1;
+        }
+    }
 
-    return virHostMemGetFreePages(npages, pages, startCell, cellCount, counts);
+    return 0;
 }
 
 
-static char *
-qemuConnectGetDomainCapabilities(virConnectPtr conn,
-                                 const char *emulatorbin,
-                                 const char *arch_str,
-                                 const char *machine,
-                                 const char *virttype_str,
-                                 unsigned int flags)
+static int
+qemuDomainGetStats(virConnectPtr conn,
+                   virDomainObjPtr dom,
+                   unsigned int stats,
+                   virDomainStatsRecordPtr *record,
+                   unsigned int flags)
 {
-    char *ret = NULL;
-    virQEMUDriverPtr driver = conn->privateData;
-    virQEMUCapsPtr qemuCaps = NULL;
-    virArch arch;
-    virDomainVirtType virttype;
-    virDomainCapsPtr domCaps = NULL;
-    virQEMUDriverConfigPtr cfg = NULL;
-    virCapsPtr caps = NULL;
-
-    virCheckFlags(0, ret);
-
-    if (virConnectGetDomainCapabilitiesEnsureACL(conn) < 0)
-        return ret;
-
-    cfg = virQEMUDriverGetConfig(driver);
+    virDomainStatsRecordPtr tmp;
+    int ret = -1;
 
-    if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
+    if (VIR_ALLOC(tmp) < 0)
         goto cleanup;
 
-    qemuCaps = virQEMUCapsCacheLookupDefault(driver->qemuCapsCache,
-                                             emulatorbin,
-                                             arch_str,
-                                             virttype_str,
-                                             machine,
-                                             &arch, &virttype, &machine);
-    if (!qemuCaps)
+    if (qemuDomainGetStatsParams(conn->privateData, dom, stats, tmp, flags) < 0)
         goto cleanup;
 
-    if (!(domCaps = virDomainCapsNew(virQEMUCapsGetBinary(qemuCaps), machine,
-                                     arch, virttype)))
+    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
+                                  dom->def->uuid, dom->def->id)))
         goto cleanup;
 
-    if (virQEMUCapsFillDomainCaps(caps, domCaps, qemuCaps,
-                                  cfg->firmwares, cfg->nfirmwares) < 0)
-        goto cleanup;
+    *record = tmp;
+    tmp = NULL;
+    ret = 0;
 
-    ret = virDomainCapsFormat(domCaps);
  cleanup:
-    virObjectUnref(cfg);
-    virObjectUnref(caps);
-    virObjectUnref(domCaps);
-    virObjectUnref(qemuCaps);
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
+
     return ret;
 }
 
 
 static int
-qemuDomainGetStatsState(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
-                        virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
-                        unsigned int privflags ATTRIBUTE_UNUSED)
+qemuDomainGetStatsOne(virConnectPtr conn,
+                      virDomainObjPtr vm,
+                      unsigned int stats,
+                      unsigned int flags,
+                      unsigned int privflags,
+                      virDomainStatsRecordPtr *record)
 {
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.state",
-                             dom->state.state) < 0)
-        return -1;
+    virQEMUDriverPtr driver = conn->privateData;
+    unsigned int domflags = 0;
+    int ret;
 
-    if (virTypedParamsAddInt(&record->params,
-                             &record->nparams,
-                             maxparams,
-                             "state.reason",
-                             dom->state.reason) < 0)
-        return -1;
+    virObjectLock(vm);
 
-    return 0;
-}
+    if (HAVE_JOB(privflags)) {
+        int rv;
 
+        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
+            rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
+        else
+            rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
 
-typedef enum {
-    QEMU_DOMAIN_STATS_HAVE_JOB = 1 << 0, /* job is entered, monitor can be
-                                            accessed */
-    QEMU_DOMAIN_STATS_BACKING  = 1 << 1, /* include backing chain in
-                                            block stats */
-} qemuDomainStatsFlags;
+        if (rv == 0)
+            domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    }
+    /* else: without a job it's still possible to gather some data */
+
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    ret = qemuDomainGetStats(conn, vm, stats, record, domflags);
+
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+
+    virObjectUnlock(vm);
+    return ret;
+}
 
 
-#define HAVE_JOB(flags) ((flags) & QEMU_DOMAIN_STATS_HAVE_JOB)
+/* Collecting the stats of a domain mostly means waiting for its
+ * monitor, so with many domains the collection is spread over
+ * statsPool, one job per domain.  */
+typedef struct _qemuDomainGetStatsBatch qemuDomainGetStatsBatch;
+typedef qemuDomainGetStatsBatch *qemuDomainGetStatsBatchPtr;
+struct _qemuDomainGetStatsBatch {
+    virMutex lock;
+    virCond cond;
+    size_t pending;
+};
 
+typedef struct _qemuDomainGetStatsJob qemuDomainGetStatsJob;
+typedef qemuDomainGetStatsJob *qemuDomainGetStatsJobPtr;
+struct _qemuDomainGetStatsJob {
+    qemuDomainGetStatsBatchPtr batch;
+    virConnectPtr conn;
+    virDomainObjPtr vm;
+    unsigned int stats;
+    unsigned int flags;
+    unsigned int privflags;
+    qemuDomainStatsIfTablesPtr ifstats;
 
-static int
-qemuDomainGetStatsCpu(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
-                      virDomainObjPtr dom,
-                      virDomainStatsRecordPtr record,
-                      int *maxparams,
-                      unsigned int privflags ATTRIBUTE_UNUSED)
+    /* Filled in by the worker */
+    virDomainStatsRecordPtr record;
+    int rc;
+    virErrorPtr err;
+};
+
+
+static void
+qemuDomainGetStatsJobRun(qemuDomainGetStatsJobPtr job)
 {
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    unsigned long long cpu_time = 0;
-    unsigned long long user_time = 0;
-    unsigned long long sys_time = 0;
-    int err = 0;
+    qemuDomainStatsIfStatsSet(job->ifstats);
+    job->rc = qemuDomainGetStatsOne(job->conn, job->vm, job->stats,
+                                    job->flags, job->privflags,
+                                    &job->record);
+    qemuDomainStatsIfStatsSet(NULL);
+    if (job->rc < 0)
+        job->err = virSaveLastError();
+}
 
-    if (!priv->cgroup)
-        return 0;
 
-    err = virCgroupGetCpuacctUsage(priv->cgroup, &cpu_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.time",
-                                        cpu_time) < 0)
-        return -1;
+static void
+qemuDomainGetStatsJobHandler(void *data,
+                             void *opaque ATTRIBUTE_UNUSED)
+{
+    qemuDomainGetStatsJobPtr job = data;
+    qemuDomainGetStatsBatchPtr batch = job->batch;
 
-    err = virCgroupGetCpuacctStat(priv->cgroup, &user_time, &sys_time);
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.user",
-                                        user_time) < 0)
-        return -1;
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "cpu.system",
-                                        sys_time) < 0)
-        return -1;
+    qemuDomainGetStatsJobRun(job);
+    virResetLastError();
 
-    return 0;
+    virMutexLock(&batch->lock);
+    if (--batch->pending == 0)
+        virCondSignal(&batch->cond);
+    virMutexUnlock(&batch->lock);
 }
 
+
+/**
+ * qemuDomainGetStatsParallel:
+ *
+ * Collect the stats of @vms using the stats worker pool and store the
+ * resulting records in @records, in the order of @vms. Fails if the
+ * collection failed for any of the domains, reporting the error of the
+ * first one.
+ */
 static int
-qemuDomainGetStatsBalloon(virQEMUDriverPtr driver,
-                          virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
-                          unsigned int privflags)
-{
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    virDomainMemoryStatStruct stats[VIR_DOMAIN_MEMORY_STAT_NR];
-    int nr_stats;
-    unsigned long long cur_balloon = 0;
+qemuDomainGetStatsParallel(virQEMUDriverPtr driver,
+                           virConnectPtr conn,
+                           virDomainObjPtr *vms,
+                           size_t nvms,
+                           unsigned int stats,
+                           unsigned int flags,
+                           unsigned int privflags,
+                           qemuDomainStatsIfTablesPtr ifstats,
+                           virDomainStatsRecordPtr *records)
+{
+    qemuDomainGetStatsBatch batch;
+    qemuDomainGetStatsJobPtr jobs = NULL;
+    virErrorPtr err = NULL;
+    size_t nrecords = 0;
     size_t i;
-    int err = 0;
+    int ret = -1;
 
-    if (!virDomainDefHasMemballoon(dom->def)) {
-        cur_balloon = virDomainDefGetMemoryTotal(dom->def);
-    } else if (virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BALLOON_EVENT)) {
-        cur_balloon = dom->def->mem.cur_balloon;
-    } else {
-        err = -1;
-    }
+    memset(&batch, 0, sizeof(batch));
 
-    if (!err && virTypedParamsAddULLong(&record->params,
-                                        &record->nparams,
-                                        maxparams,
-                                        "balloon.current",
-                                        cur_balloon) < 0)
+    if (VIR_ALLOC_N(jobs, nvms) < 0)
         return -1;
 
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                "balloon.maximum",
-                                virDomainDefGetMemoryTotal(dom->def)) < 0)
+    if (virMutexInit(&batch.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(jobs);
+        return -1;
+    }
+    if (virCondInit(&batch.cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&batch.lock);
+        VIR_FREE(jobs);
         return -1;
+    }
 
-    if (!HAVE_JOB(privflags) || !virDomainObjIsActive(dom))
-        return 0;
+    virMutexLock(&batch.lock);
+    for (i = 0; i < nvms; i++) {
+        jobs[i].batch = &batch;
+        jobs[i].conn = conn;
+        jobs[i].vm = vms[i];
+        jobs[i].stats = stats;
+        jobs[i].flags = flags;
+        jobs[i].privflags = privflags;
+        jobs[i].ifstats = ifstats;
+
+        batch.pending++;
+        if (virThreadPoolSendJob(driver->statsPool, 0, &jobs[i]) < 0) {
+            /* Not worth failing the whole call over */
+            batch.pending--;
+            virMutexUnlock(&batch.lock);
+            virResetLastError();
+            qemuDomainGetStatsJobRun(&jobs[i]);
+            virMutexLock(&batch.lock);
+        }
+    }
 
-    nr_stats = qemuDomainMemoryStatsInternal(driver, dom, stats,
-                                             VIR_DOMAIN_MEMORY_STAT_NR);
-    if (nr_stats < 0)
-        return 0;
+    while (batch.pending) {
+        if (virCondWait(&batch.cond, &batch.lock) < 0) {
+            /* The jobs still point to @batch, so there is no way out */
+            VIR_ERROR(_("failed to wait on condition"));
+            abort();
+        }
+    }
+    virMutexUnlock(&batch.lock);
 
-#define STORE_MEM_RECORD(TAG, NAME) \
-    if (stats[i].tag == VIR_DOMAIN_MEMORY_STAT_ ##TAG) \
-        if (virTypedParamsAddULLong(&record->params, \
-                                    &record->nparams, \
-                                    maxparams, \
-                                    "balloon." NAME, \
-                                    stats[i].val) < 0) \
-            return -1;
+    for (i = 0; i < nvms; i++) {
+        if (jobs[i].rc < 0) {
+            if (!err)
+                VIR_STEAL_PTR(err, jobs[i].err);
+            continue;
+        }
 
-    for (i = 0; i < nr_stats; i++) {
-        STORE_MEM_RECORD(SWAP_IN, "swap_in")
-        STORE_MEM_RECORD(SWAP_OUT, "swap_out")
-        STORE_MEM_RECORD(MAJOR_FAULT, "major_fault")
-        STORE_MEM_RECORD(MINOR_FAULT, "minor_fault")
-        STORE_MEM_RECORD(UNUSED, "unused")
-        STORE_MEM_RECORD(AVAILABLE, "available")
-        STORE_MEM_RECORD(RSS, "rss")
-        STORE_MEM_RECORD(LAST_UPDATE, "last-update")
-        STORE_MEM_RECORD(USABLE, "usable")
-        STORE_MEM_RECORD(DISK_CACHES, "disk_caches")
+        if (jobs[i].record)
+            records[nrecords++] = jobs[i].record;
+        jobs[i].record = NULL;
     }
 
-#undef STORE_MEM_RECORD
+    if (err) {
+        virSetError(err);
+        goto cleanup;
+    }
 
-    return 0;
+    ret = nrecords;
+
+ cleanup:
+    for (i = 0; i < nvms; i++) {
+        virFreeError(jobs[i].err);
+        if (jobs[i].record) {
+            virTypedParamsFree(jobs[i].record->params, jobs[i].record->nparams);
+            virObjectUnref(jobs[i].record->dom);
+            VIR_FREE(jobs[i].record);
+        }
+    }
+    virFreeError(err);
+    virCondDestroy(&batch.cond);
+    virMutexDestroy(&batch.lock);
+    VIR_FREE(jobs);
+    return ret;
 }
 
 
 static int
-qemuDomainGetStatsVcpu(virQEMUDriverPtr driver,
-                       virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
-                       unsigned int privflags)
+qemuConnectGetAllDomainStats(virConnectPtr conn,
+                             virDomainPtr *doms,
+                             unsigned int ndoms,
+                             unsigned int stats,
+                             virDomainStatsRecordPtr **retStats,
+                             unsigned int flags)
 {
-    virDomainVcpuDefPtr vcpu;
-    qemuDomainVcpuPrivatePtr vcpupriv;
+    virQEMUDriverPtr driver = conn->privateData;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms;
+    virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainStatsIfTablesPtr ifstats = NULL;
+    bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+    int nstats = 0;
     size_t i;
     int ret = -1;
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
-    virVcpuInfoPtr cpuinfo = NULL;
-    unsigned long long *cpuwait = NULL;
+    unsigned int privflags = 0;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.current",
-                              virDomainDefGetVcpus(dom->def)) < 0)
-        return -1;
+    virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                  VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
+                  VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
 
-    if (virTypedParamsAddUInt(&record->params,
-                              &record->nparams,
-                              maxparams,
-                              "vcpu.maximum",
-                              virDomainDefGetVcpusMax(dom->def)) < 0)
+    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
         return -1;
 
-    if (VIR_ALLOC_N(cpuinfo, virDomainDefGetVcpus(dom->def)) < 0 ||
-        VIR_ALLOC_N(cpuwait, virDomainDefGetVcpus(dom->def)) < 0)
-        goto cleanup;
+    if (qemuDomainGetStatsCheckSupport(&stats, enforce) < 0)
+        return -1;
 
-    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom) &&
-        qemuDomainRefreshVcpuHalted(driver, dom, QEMU_ASYNC_JOB_NONE) < 0) {
-            /* it's ok to be silent and go ahead, because halted vcpu info
-             * wasn't here from the beginning */
-            virResetLastError();
+    if (ndoms) {
+        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
+                                    &nvms, virConnectGetAllDomainStatsCheckACL,
+                                    lflags, true) < 0)
+            return -1;
+    } else {
+        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
+                                    virConnectGetAllDomainStatsCheckACL,
+                                    lflags) < 0)
+            return -1;
     }
 
-    if (qemuDomainHelperGetVcpus(dom, cpuinfo, cpuwait,
-                                 virDomainDefGetVcpus(dom->def),
-                                 NULL, 0) < 0) {
-        virResetLastError();
-        ret = 0; /* it's ok to be silent and go ahead */
+    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
         goto cleanup;
-    }
 
-    for (i = 0; i < virDomainDefGetVcpus(dom->def); i++) {
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.state", cpuinfo[i].number);
-        if (virTypedParamsAddInt(&record->params,
-                                 &record->nparams,
-                                 maxparams,
-                                 param_name,
-                                 cpuinfo[i].state) < 0)
-            goto cleanup;
+    if (qemuDomainGetStatsNeedMonitor(stats))
+        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
 
-        /* stats below are available only if the VM is alive */
-        if (!virDomainObjIsActive(dom))
-            continue;
+    ifstats = qemuDomainStatsIfStatsNew(stats, nvms);
 
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.time", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuinfo[i].cpuTime) < 0)
-            goto cleanup;
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                 "vcpu.%u.wait", cpuinfo[i].number);
-        if (virTypedParamsAddULLong(&record->params,
-                                    &record->nparams,
-                                    maxparams,
-                                    param_name,
-                                    cpuwait[i]) < 0)
+    if (driver->statsPool && nvms > 1) {
+        if ((nstats = qemuDomainGetStatsParallel(driver, conn, vms, nvms,
+                                                 stats, flags, privflags,
+                                                 ifstats, tmpstats)) < 0)
             goto cleanup;
+    } else {
+        qemuDomainStatsIfStatsSet(ifstats);
+        for (i = 0; i < nvms; i++) {
+            virDomainStatsRecordPtr tmp = NULL;
+
+            if (qemuDomainGetStatsOne(conn, vms[i], stats, flags,
+                                      privflags, &tmp) < 0) {
+                qemuDomainStatsIfStatsSet(NULL);
+                goto cleanup;
+            }
+
+            if (tmp)
+                tmpstats[nstats++] = tmp;
+        }
+        qemuDomainStatsIfStatsSet(NULL);
+    }
+
+    *retStats = tmpstats;
+    tmpstats = NULL;
+
+    ret = nstats;
+
+ cleanup:
+    qemuDomainStatsIfStatsFree(ifstats);
+    virDomainStatsRecordListFree(tmpstats);
+    virObjectListFreeCount(vms, nvms);
+
+    return ret;
+}
+
+
+/* Domain stats subscriptions.
+ *
+ * A single thread, started with the first subscription, samples the
+ * domains on behalf of every subscriber. Subscriptions due at the same
+ * time and asking for the same stats and flags share one sample. Each
+ * subscription remembers the values it delivered last, so that only
+ * changed values are queued as a virDomainStatsEvent for its key.  */
+typedef struct _qemuDomainStatsSample qemuDomainStatsSample;
+typedef qemuDomainStatsSample *qemuDomainStatsSamplePtr;
+struct _qemuDomainStatsSample {
+    char *name;
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    int id;
+    virTypedParameterPtr params;
+    int nparams;
+};
+
+/* PSI triggers registered for one run of a domain's qemu process */
+typedef struct _qemuDomainPressureTrigger qemuDomainPressureTrigger;
+typedef qemuDomainPressureTrigger *qemuDomainPressureTriggerPtr;
+struct _qemuDomainPressureTrigger {
+    unsigned char uuid[VIR_UUID_BUFLEN];
+    pid_t pid;
+    int fds[VIR_CGROUP_PRESSURE_LAST];
+};
+
+typedef struct _qemuDomainStatsSub qemuDomainStatsSub;
+typedef qemuDomainStatsSub *qemuDomainStatsSubPtr;
+struct _qemuDomainStatsSub {
+    virObject parent;
+
+    /* Immutable */
+    virConnectPtr conn;
+    char *key;
+    int callbackID;
+    unsigned int stats;
+    unsigned int flags;
+    unsigned int interval;
+
+    /* Protected by the lock of qemuDomainStatsSubs */
+    unsigned long long next;
+
+    /* Only accessed by the sampling thread; uuid -> qemuDomainStatsSample */
+    virHashTablePtr last;
+};
+
+struct _qemuDomainStatsSubs {
+    virObjectLockable parent;
+
+    virCond cond;
+    virThread thread;
+    bool started;
+    bool quit;
+    unsigned int lastKey;
+
+    qemuDomainStatsSubPtr *subs;
+    size_t nsubs;
+
+    /* PSI triggers of running domains, see qemuDomainStatsPressureWatch.
+     * Only the pressure thread closes and removes triggers. */
+    virThread pressureThread;
+    bool pressureStarted;
+    int pressureWakeup[2];
+    qemuDomainPressureTriggerPtr *triggers;
+    size_t ntriggers;
+};
+
+static virClassPtr qemuDomainStatsSubClass;
+static virClassPtr qemuDomainStatsSubsClass;
+
+static void qemuDomainStatsSubDispose(void *obj);
+static void qemuDomainStatsSubsDispose(void *obj);
 
-        /* state below is extracted from the individual vcpu structs */
-        if (!(vcpu = virDomainDefGetVcpu(dom->def, cpuinfo[i].number)))
-            continue;
+static int
+qemuDomainStatsSubsOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuDomainStatsSub, virClassForObject()))
+        return -1;
 
-        vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    if (!VIR_CLASS_NEW(qemuDomainStatsSubs, virClassForObjectLockable()))
+        return -1;
 
-        if (vcpupriv->halted != VIR_TRISTATE_BOOL_ABSENT) {
-            snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH,
-                     "vcpu.%u.halted", cpuinfo[i].number);
-            if (virTypedParamsAddBoolean(&record->params,
-                                         &record->nparams,
-                                         maxparams,
-                                         param_name,
-                                         vcpupriv->halted == VIR_TRISTATE_BOOL_YES) < 0)
-                goto cleanup;
-        }
-    }
+    return 0;
+}
 
-    ret = 0;
+VIR_ONCE_GLOBAL_INIT(qemuDomainStatsSubs)
 
- cleanup:
-    VIR_FREE(cpuinfo);
-    VIR_FREE(cpuwait);
-    return ret;
+
+static void
+qemuDomainStatsSampleFree(qemuDomainStatsSamplePtr sample)
+{
+    if (!sample)
+        return;
+
+    VIR_FREE(sample->name);
+    virTypedParamsFree(sample->params, sample->nparams);
+    VIR_FREE(sample);
 }
 
-#define QEMU_ADD_COUNT_PARAM(record, maxparams, type, count) \
-do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "%s.count", type); \
-    if (virTypedParamsAddUInt(&(record)->params, \
-                              &(record)->nparams, \
-                              maxparams, \
-                              param_name, \
-                              count) < 0) \
-        goto cleanup; \
-} while (0)
 
-#define QEMU_ADD_NAME_PARAM(record, maxparams, type, subtype, num, name) \
-do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "%s.%zu.%s", type, num, subtype); \
-    if (virTypedParamsAddString(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                name) < 0) \
-        goto cleanup; \
-} while (0)
+static void
+qemuDomainStatsSampleHashFree(void *payload,
+                              const void *name ATTRIBUTE_UNUSED)
+{
+    qemuDomainStatsSampleFree(payload);
+}
 
-#define QEMU_ADD_NET_PARAM(record, maxparams, num, name, value) \
-do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "net.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
-        return -1; \
-} while (0)
 
-static int
-qemuDomainGetStatsInterface(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
-                            virDomainObjPtr dom,
-                            virDomainStatsRecordPtr record,
-                            int *maxparams,
-                            unsigned int privflags ATTRIBUTE_UNUSED)
+static void
+qemuDomainStatsSampleListFree(qemuDomainStatsSamplePtr *samples,
+                              size_t nsamples)
 {
     size_t i;
-    struct _virDomainInterfaceStats tmp;
-    int ret = -1;
 
-    if (!virDomainObjIsActive(dom))
-        return 0;
+    for (i = 0; i < nsamples; i++)
+        qemuDomainStatsSampleFree(samples[i]);
+    VIR_FREE(samples);
+}
 
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "net", dom->def->nnets);
 
-    /* Check the path is one of the domain's network interfaces. */
-    for (i = 0; i < dom->def->nnets; i++) {
-        virDomainNetDefPtr net = dom->def->nets[i];
-        virDomainNetType actualType;
+static qemuDomainStatsSamplePtr
+qemuDomainStatsSampleCopy(qemuDomainStatsSamplePtr src)
+{
+    qemuDomainStatsSamplePtr dst;
 
-        if (!net->ifname)
-            continue;
+    if (VIR_ALLOC(dst) < 0)
+        return NULL;
 
-        memset(&tmp, 0, sizeof(tmp));
+    if (VIR_STRDUP(dst->name, src->name) < 0 ||
+        virTypedParamsCopy(&dst->params, src->params, src->nparams) < 0) {
+        qemuDomainStatsSampleFree(dst);
+        return NULL;
+    }
+    dst->nparams = src->nparams;
+    memcpy(dst->uuid, src->uuid, VIR_UUID_BUFLEN);
+    dst->id = src->id;
 
-        actualType = virDomainNetGetActualType(net);
+    return dst;
+}
 
-        QEMU_ADD_NAME_PARAM(record, maxparams,
-                            "net", "name", i, net->ifname);
 
-        if (actualType == VIR_DOMAIN_NET_TYPE_VHOSTUSER) {
-            if (virNetDevOpenvswitchInterfaceStats(net->ifname, &tmp) < 0) {
-                virResetLastError();
-                continue;
-            }
-        } else {
-            if (virNetDevTapInterfaceStats(net->ifname, &tmp,
-                                           !virDomainNetTypeSharesHostView(net)) < 0) {
-                virResetLastError();
-                continue;
-            }
-        }
+static void
+qemuDomainStatsSubDispose(void *obj)
+{
+    qemuDomainStatsSubPtr sub = obj;
 
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.bytes", tmp.rx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.pkts", tmp.rx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.errs", tmp.rx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "rx.drop", tmp.rx_drop);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.bytes", tmp.tx_bytes);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.pkts", tmp.tx_packets);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.errs", tmp.tx_errs);
-        QEMU_ADD_NET_PARAM(record, maxparams, i,
-                           "tx.drop", tmp.tx_drop);
-    }
+    virObjectUnref(sub->conn);
+    VIR_FREE(sub->key);
+    virHashFree(sub->last);
+}
 
-    ret = 0;
- cleanup:
-    return ret;
+
+static void
+qemuDomainPressureTriggerFree(qemuDomainPressureTriggerPtr trigger)
+{
+    size_t i;
+
+    if (!trigger)
+        return;
+
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++)
+        VIR_FORCE_CLOSE(trigger->fds[i]);
+    VIR_FREE(trigger);
 }
 
-#undef QEMU_ADD_NET_PARAM
 
-#define QEMU_ADD_BLOCK_PARAM_UI(record, maxparams, num, name, value) \
-    do { \
-        char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-        snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-                 "block.%zu.%s", num, name); \
-        if (virTypedParamsAddUInt(&(record)->params, \
-                                  &(record)->nparams, \
-                                  maxparams, \
-                                  param_name, \
-                                  value) < 0) \
-            goto cleanup; \
-    } while (0)
+static void
+qemuDomainStatsSubsDispose(void *obj)
+{
+    qemuDomainStatsSubsPtr subs = obj;
+    size_t i;
 
-/* expects a LL, but typed parameter must be ULL */
-#define QEMU_ADD_BLOCK_PARAM_LL(record, maxparams, num, name, value) \
-do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (value >= 0 && virTypedParamsAddULLong(&(record)->params, \
-                                              &(record)->nparams, \
-                                              maxparams, \
-                                              param_name, \
-                                              value) < 0) \
-        goto cleanup; \
-} while (0)
+    virObjectListFreeCount(subs->subs, subs->nsubs);
+    for (i = 0; i < subs->ntriggers; i++)
+        qemuDomainPressureTriggerFree(subs->triggers[i]);
+    VIR_FREE(subs->triggers);
+    VIR_FORCE_CLOSE(subs->pressureWakeup[0]);
+    VIR_FORCE_CLOSE(subs->pressureWakeup[1]);
+    virCondDestroy(&subs->cond);
+}
 
-#define QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, num, name, value) \
-do { \
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH]; \
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, \
-             "block.%zu.%s", num, name); \
-    if (virTypedParamsAddULLong(&(record)->params, \
-                                &(record)->nparams, \
-                                maxparams, \
-                                param_name, \
-                                value) < 0) \
-        goto cleanup; \
-} while (0)
 
-/* refresh information by opening images on the disk */
-static int
-qemuDomainGetStatsOneBlockFallback(virQEMUDriverPtr driver,
-                                   virQEMUDriverConfigPtr cfg,
-                                   virDomainObjPtr dom,
-                                   virDomainStatsRecordPtr record,
-                                   int *maxparams,
-                                   virStorageSourcePtr src,
-                                   size_t block_idx)
+static qemuDomainStatsSubsPtr
+qemuDomainStatsSubsNew(void)
 {
-    int ret = -1;
+    qemuDomainStatsSubsPtr subs;
 
-    if (virStorageSourceIsEmpty(src))
-        return 0;
+    if (qemuDomainStatsSubsInitialize() < 0)
+        return NULL;
 
-    if (qemuStorageLimitsRefresh(driver, cfg, dom, src) < 0) {
-        virResetLastError();
-        return 0;
+    if (!(subs = virObjectLockableNew(qemuDomainStatsSubsClass)))
+        return NULL;
+
+    subs->pressureWakeup[0] = subs->pressureWakeup[1] = -1;
+
+    if (virCondInit(&subs->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virObjectUnref(subs);
+        return NULL;
     }
 
-    if (src->allocation)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                 "allocation", src->allocation);
-    if (src->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                 "capacity", src->capacity);
-    if (src->physical)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                 "physical", src->physical);
-    ret = 0;
- cleanup:
-    return ret;
+    return subs;
 }
 
 
-/**
- * qemuDomainGetStatsOneBlockRefreshNamed:
- * @src: disk source structure
- * @alias: disk alias
- * @stats: hash table containing stats for all disks
- * @nodedata: reply containing 'query-named-block-nodes' data
- *
- * Refresh disk block stats data (qemuBlockStatsPtr) which are present only
- * in the reply of 'query-named-block-nodes' in cases when the data was gathered
- * by using query-block originally.
- */
 static void
-qemuDomainGetStatsOneBlockRefreshNamed(virStorageSourcePtr src,
-                                       const char *alias,
-                                       virHashTablePtr stats,
-                                       virHashTablePtr nodedata)
+qemuDomainStatsSubsStop(qemuDomainStatsSubsPtr subs)
 {
-    qemuBlockStatsPtr entry;
+    bool started;
+    bool pressureStarted;
+    char c = 0;
 
-    virJSONValuePtr data;
-    unsigned long long tmp;
+    virObjectLock(subs);
+    subs->quit = true;
+    started = subs->started;
+    pressureStarted = subs->pressureStarted;
+    virCondSignal(&subs->cond);
+    if (pressureStarted)
+        ignore_value(safewrite(subs->pressureWakeup[1], &c, 1));
+    virObjectUnlock(subs);
 
-    if (!nodedata || !src->nodestorage)
-        return;
+    if (started)
+        virThreadJoin(&subs->thread);
+    if (pressureStarted)
+        virThreadJoin(&subs->pressureThread);
+}
 
-    if (!(entry = virHashLookup(stats, alias)))
-        return;
 
-    if (!(data = virHashLookup(nodedata, src->nodestorage)))
-        return;
+static bool
+qemuDomainStatsParamEqual(virTypedParameterPtr a,
+                          virTypedParameterPtr b)
+{
+    if (a->type != b->type)
+        return false;
+
+    switch ((virTypedParameterType) a->type) {
+    case VIR_TYPED_PARAM_INT:
+        return a->value.i == b->value.i;
+    case VIR_TYPED_PARAM_UINT:
+        return a->value.ui == b->value.ui;
+    case VIR_TYPED_PARAM_LLONG:
+        return a->value.l == b->value.l;
+    case VIR_TYPED_PARAM_ULLONG:
+        return a->value.ul == b->value.ul;
+    case VIR_TYPED_PARAM_DOUBLE:
+        return a->value.d == b->value.d;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        return a->value.b == b->value.b;
+    case VIR_TYPED_PARAM_STRING:
+        return STREQ_NULLABLE(a->value.s, b->value.s);
+    case VIR_TYPED_PARAM_LAST:
+        break;
+    }
 
-    if (virJSONValueObjectGetNumberUlong(data, "write_threshold", &tmp) == 0)
-        entry->write_threshold = tmp;
+    return false;
+}
+
+
+/* Sample the stats of a single locked domain, without waiting for a job */
+static qemuDomainStatsSamplePtr
+qemuDomainStatsSampleDomain(virQEMUDriverPtr driver,
+                            virDomainObjPtr vm,
+                            unsigned int stats,
+                            unsigned int flags)
+{
+    virDomainStatsRecord record;
+    qemuDomainStatsSamplePtr sample = NULL;
+    unsigned int domflags = 0;
+
+    memset(&record, 0, sizeof(record));
+
+    if (qemuDomainGetStatsNeedMonitor(stats) &&
+        qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY) == 0)
+        domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+
+    if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
+        domflags |= QEMU_DOMAIN_STATS_BACKING;
+
+    domflags |= QEMU_DOMAIN_STATS_PRESSURE_TRIGGER;
+
+    if (qemuDomainGetStatsParams(driver, vm, stats, &record, domflags) < 0)
+        goto cleanup;
+
+    if (VIR_ALLOC(sample) < 0 ||
+        VIR_STRDUP(sample->name, vm->def->name) < 0) {
+        qemuDomainStatsSampleFree(sample);
+        sample = NULL;
+        goto cleanup;
+    }
+    memcpy(sample->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+    sample->id = vm->def->id;
+    VIR_STEAL_PTR(sample->params, record.params);
+    sample->nparams = record.nparams;
+    record.nparams = 0;
+
+ cleanup:
+    if (HAVE_JOB(domflags))
+        qemuDomainObjEndJob(driver, vm);
+    virTypedParamsFree(record.params, record.nparams);
+    return sample;
 }
 
 
 static int
-qemuDomainGetStatsOneBlock(virQEMUDriverPtr driver,
-                           virQEMUDriverConfigPtr cfg,
-                           virDomainObjPtr dom,
-                           virDomainStatsRecordPtr record,
-                           int *maxparams,
-                           const char *entryname,
-                           virStorageSourcePtr src,
-                           size_t block_idx,
-                           virHashTablePtr stats)
+qemuDomainStatsSampleAll(virQEMUDriverPtr driver,
+                         unsigned int stats,
+                         unsigned int flags,
+                         qemuDomainStatsSamplePtr **samples,
+                         size_t *nsamples)
 {
-    qemuBlockStats *entry;
-    int ret = -1;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms;
+    qemuDomainStatsSamplePtr *list = NULL;
+    qemuDomainStatsIfTablesPtr ifstats = NULL;
+    size_t nlist = 0;
+    size_t i;
+    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
+                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
 
-    /* the VM is offline so we have to go and load the stast from the disk by
-     * ourselves */
-    if (!virDomainObjIsActive(dom)) {
-        ret = qemuDomainGetStatsOneBlockFallback(driver, cfg, dom, record,
-                                                 maxparams, src, block_idx);
-        goto cleanup;
-    }
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms,
+                                NULL, lflags) < 0)
+        return -1;
 
-    /* In case where qemu didn't provide the stats we stop here rather than
-     * trying to refresh the stats from the disk. Inability to provide stats is
-     * usually caused by blocked storage so this would make libvirtd hang */
-    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname))) {
-        ret = 0;
-        goto cleanup;
+    if (VIR_ALLOC_N(list, nvms) < 0) {
+        virObjectListFreeCount(vms, nvms);
+        return -1;
     }
 
-    QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                             "allocation", entry->wr_highest_offset);
+    ifstats = qemuDomainStatsIfStatsNew(stats, nvms);
+    qemuDomainStatsIfStatsSet(ifstats);
 
-    if (entry->capacity)
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                 "capacity", entry->capacity);
-    if (entry->physical) {
-        QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                 "physical", entry->physical);
-    } else {
-        if (qemuDomainStorageUpdatePhysical(driver, cfg, dom, src) == 0) {
-            QEMU_ADD_BLOCK_PARAM_ULL(record, maxparams, block_idx,
-                                     "physical", src->physical);
-        } else {
+    for (i = 0; i < nvms; i++) {
+        qemuDomainStatsSamplePtr sample;
+
+        virObjectLock(vms[i]);
+        sample = qemuDomainStatsSampleDomain(driver, vms[i], stats, flags);
+
+        /* A domain failing to report its stats is left out of this
+         * sample rather than holding back all others */
+        if (!sample) {
+            VIR_WARN("Unable to sample stats of domain %s: %s",
+                     vms[i]->def->name, virGetLastErrorMessage());
             virResetLastError();
         }
+        virObjectUnlock(vms[i]);
+
+        if (sample)
+            list[nlist++] = sample;
     }
 
-    ret = 0;
- cleanup:
-    return ret;
+    qemuDomainStatsIfStatsSet(NULL);
+    qemuDomainStatsIfStatsFree(ifstats);
+
+    virObjectListFreeCount(vms, nvms);
+    *samples = list;
+    *nsamples = nlist;
+    return 0;
 }
 
 
+/* Build the record for the values of @sample which differ from @prev */
 static int
-qemuDomainGetStatsBlockExportBackendStorage(const char *entryname,
-                                            virHashTablePtr stats,
-                                            size_t recordnr,
-                                            virDomainStatsRecordPtr records,
-                                            int *nrecords)
+qemuDomainStatsSampleDelta(virConnectPtr conn,
+                           qemuDomainStatsSamplePtr sample,
+                           qemuDomainStatsSamplePtr prev,
+                           virDomainStatsRecordPtr *record)
 {
-    qemuBlockStats *entry;
+    virDomainStatsRecordPtr tmp = NULL;
+    size_t i;
     int ret = -1;
 
-    if (!stats || !entryname || !(entry = virHashLookup(stats, entryname))) {
-        ret = 0;
+    *record = NULL;
+
+    if (VIR_ALLOC(tmp) < 0 ||
+        VIR_ALLOC_N(tmp->params, sample->nparams) < 0)
         goto cleanup;
-    }
 
-    if (entry->write_threshold)
-        QEMU_ADD_BLOCK_PARAM_ULL(records, nrecords, recordnr, "threshold",
-                                 entry->write_threshold);
+    for (i = 0; i < sample->nparams; i++) {
+        virTypedParameterPtr param = sample->params + i;
+        virTypedParameterPtr old = NULL;
+        virTypedParameterPtr dst = tmp->params + tmp->nparams;
 
-    ret = 0;
- cleanup:
-    return ret;
-}
+        if (prev)
+            old = virTypedParamsGet(prev->params, prev->nparams, param->field);
 
+        if (old && qemuDomainStatsParamEqual(param, old))
+            continue;
 
-static int
-qemuDomainGetStatsBlockExportFrontend(const char *frontendname,
-                                      virHashTablePtr stats,
-                                      size_t recordnr,
-                                      virDomainStatsRecordPtr records,
-                                      int *nrecords)
-{
-    qemuBlockStats *entry;
-    int ret = -1;
+        *dst = *param;
+        if (param->type == VIR_TYPED_PARAM_STRING &&
+            VIR_STRDUP(dst->value.s, param->value.s) < 0) {
+            dst->value.s = NULL;
+            goto cleanup;
+        }
+        tmp->nparams++;
+    }
 
-    /* In case where qemu didn't provide the stats we stop here rather than
-     * trying to refresh the stats from the disk. Inability to provide stats is
-     * usually caused by blocked storage so this would make libvirtd hang */
-    if (!stats || !frontendname || !(entry = virHashLookup(stats, frontendname))) {
+    if (tmp->nparams == 0) {
         ret = 0;
         goto cleanup;
     }
 
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.reqs", entry->rd_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.bytes", entry->rd_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "rd.times", entry->rd_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.reqs", entry->wr_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.bytes", entry->wr_bytes);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "wr.times", entry->wr_total_times);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.reqs", entry->flush_req);
-    QEMU_ADD_BLOCK_PARAM_LL(records, nrecords, recordnr, "fl.times", entry->flush_total_times);
+    if (!(tmp->dom = virGetDomain(conn, sample->name, sample->uuid,
+                                  sample->id)))
+        goto cleanup;
 
+    VIR_STEAL_PTR(*record, tmp);
     ret = 0;
+
  cleanup:
+    if (tmp) {
+        virTypedParamsFree(tmp->params, tmp->nparams);
+        VIR_FREE(tmp);
+    }
     return ret;
 }
 
 
-static int
-qemuDomainGetStatsBlockExportHeader(virDomainDiskDefPtr disk,
-                                    virStorageSourcePtr src,
-                                    size_t recordnr,
-                                    virDomainStatsRecordPtr records,
-                                    int *nrecords)
-{
-    int ret = -1;
+static void
+qemuDomainStatsSubNotify(virQEMUDriverPtr driver,
+                         qemuDomainStatsSubPtr sub,
+                         qemuDomainStatsSamplePtr *samples,
+                         size_t nsamples)
+{
+    virHashTablePtr last = NULL;
+    virDomainStatsRecordPtr *records = NULL;
+    int nrecords = 0;
+    virObjectEventPtr event;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    size_t i;
 
-    QEMU_ADD_NAME_PARAM(records, nrecords, "block", "name", recordnr, disk->dst);
+    if (!(last = virHashCreate(nsamples + 1, qemuDomainStatsSampleHashFree)) ||
+        VIR_ALLOC_N(records, nsamples + 1) < 0)
+        goto cleanup;
 
-    if (virStorageSourceIsLocalStorage(src) && src->path)
-        QEMU_ADD_NAME_PARAM(records, nrecords, "block", "path", recordnr, src->path);
-    if (src->id)
-        QEMU_ADD_BLOCK_PARAM_UI(records, nrecords, recordnr, "backingIndex",
-                                src->id);
+    for (i = 0; i < nsamples; i++) {
+        qemuDomainStatsSamplePtr prev = NULL;
+        qemuDomainStatsSamplePtr copy;
 
-    ret = 0;
- cleanup:
-    return ret;
-}
+        virUUIDFormat(samples[i]->uuid, uuidstr);
+        if (sub->last)
+            prev = virHashLookup(sub->last, uuidstr);
 
+        if (qemuDomainStatsSampleDelta(sub->conn, samples[i], prev,
+                                       &records[nrecords]) < 0)
+            goto cleanup;
+        if (records[nrecords])
+            nrecords++;
 
-static int
-qemuDomainGetStatsBlockExportDisk(virDomainDiskDefPtr disk,
-                                  virHashTablePtr stats,
-                                  virHashTablePtr nodestats,
-                                  virDomainStatsRecordPtr records,
-                                  int *nrecords,
-                                  size_t *recordnr,
-                                  bool visitBacking,
-                                  virQEMUDriverPtr driver,
-                                  virQEMUDriverConfigPtr cfg,
-                                  virDomainObjPtr dom,
-                                  bool blockdev)
+        if (!(copy = qemuDomainStatsSampleCopy(samples[i])))
+            goto cleanup;
+        if (virHashAddEntry(last, uuidstr, copy) < 0) {
+            qemuDomainStatsSampleFree(copy);
+            goto cleanup;
+        }
+    }
 
-{
-    char *alias = NULL;
-    virStorageSourcePtr n;
-    const char *frontendalias;
-    const char *backendalias;
-    const char *backendstoragealias;
-    int ret = -1;
+    /* Domains which went away are dropped along with the old table */
+    virHashFree(sub->last);
+    VIR_STEAL_PTR(sub->last, last);
 
-    for (n = disk->src; virStorageSourceIsBacking(n); n = n->backingStore) {
-        if (blockdev) {
-            frontendalias = QEMU_DOMAIN_DISK_PRIVATE(disk)->qomName;
-            backendalias = n->nodeformat;
-            backendstoragealias = n->nodestorage;
-        } else {
-            /* alias may be NULL if the VM is not running */
-            if (disk->info.alias &&
-                !(alias = qemuDomainStorageAlias(disk->info.alias, n->id)))
-                goto cleanup;
+    if (nrecords == 0)
+        goto cleanup;
 
-            qemuDomainGetStatsOneBlockRefreshNamed(n, alias, stats, nodestats);
+    if (!(event = virDomainStatsEventNew(sub->key, records, nrecords)))
+        goto cleanup;
+    records = NULL;
 
-            frontendalias = alias;
-            backendalias = alias;
-            backendstoragealias = alias;
-        }
+    virObjectEventStateQueue(driver->domainEventState, event);
 
-        if (qemuDomainGetStatsBlockExportHeader(disk, n, *recordnr,
-                                                records, nrecords) < 0)
-            goto cleanup;
+ cleanup:
+    virHashFree(last);
+    virDomainStatsRecordListFree(records);
+}
 
-        /* The following stats make sense only for the frontend device */
-        if (n == disk->src) {
-            if (qemuDomainGetStatsBlockExportFrontend(frontendalias, stats, *recordnr,
-                                                      records, nrecords) < 0)
-                goto cleanup;
-        }
 
-        if (qemuDomainGetStatsOneBlock(driver, cfg, dom, records, nrecords,
-                                       backendalias, n, *recordnr,
-                                       stats) < 0)
-            goto cleanup;
+static void
+qemuDomainStatsSubsSample(virQEMUDriverPtr driver,
+                          qemuDomainStatsSubPtr *due,
+                          size_t ndue)
+{
+    size_t i;
+    size_t j;
 
-        if (qemuDomainGetStatsBlockExportBackendStorage(backendstoragealias,
-                                                        stats, *recordnr,
-                                                        records, nrecords) < 0)
-            goto cleanup;
+    for (i = 0; i < ndue; i++) {
+        qemuDomainStatsSamplePtr *samples = NULL;
+        size_t nsamples = 0;
+        int rc;
 
-        VIR_FREE(alias);
-        (*recordnr)++;
+        if (!due[i])
+            continue;
 
-        if (!visitBacking)
-            break;
-    }
+        rc = qemuDomainStatsSampleAll(driver, due[i]->stats, due[i]->flags,
+                                      &samples, &nsamples);
+        if (rc < 0) {
+            VIR_WARN("Unable to sample domain stats: %s",
+                     virGetLastErrorMessage());
+            virResetLastError();
+        }
 
-    ret = 0;
+        for (j = ndue; j-- > i;) {
+            if (!due[j] ||
+                due[j]->stats != due[i]->stats ||
+                due[j]->flags != due[i]->flags)
+                continue;
 
- cleanup:
-    VIR_FREE(alias);
-    return ret;
+            if (rc == 0)
+                qemuDomainStatsSubNotify(driver, due[j], samples, nsamples);
+
+            virObjectUnref(due[j]);
+            due[j] = NULL;
+        }
+
+        qemuDomainStatsSampleListFree(samples, nsamples);
+    }
 }
 
 
-static int
-qemuDomainGetStatsBlock(virQEMUDriverPtr driver,
-                        virDomainObjPtr dom,
-                        virDomainStatsRecordPtr record,
-                        int *maxparams,
-                        unsigned int privflags)
+static void
+qemuDomainStatsThread(void *opaque)
 {
-    size_t i;
-    int ret = -1;
-    int rc;
-    virHashTablePtr stats = NULL;
-    virHashTablePtr nodestats = NULL;
-    virJSONValuePtr nodedata = NULL;
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
-    bool fetchnodedata = virQEMUCapsGet(priv->qemuCaps,
-                                        QEMU_CAPS_QUERY_NAMED_BLOCK_NODES) && !blockdev;
-    int count_index = -1;
-    size_t visited = 0;
-    bool visitBacking = !!(privflags & QEMU_DOMAIN_STATS_BACKING);
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
 
-    if (HAVE_JOB(privflags) && virDomainObjIsActive(dom)) {
-        qemuDomainObjEnterMonitor(driver, dom);
+    virObjectLock(subs);
 
-        rc = qemuMonitorGetAllBlockStatsInfo(priv->mon, &stats, visitBacking);
+    while (!subs->quit) {
+        qemuDomainStatsSubPtr *due = NULL;
+        size_t ndue = 0;
+        unsigned long long now;
+        unsigned long long next = 0;
+        size_t i;
 
-        if (rc >= 0) {
-            if (blockdev)
-                rc = qemuMonitorBlockStatsUpdateCapacityBlockdev(priv->mon, stats);
-            else
-                ignore_value(qemuMonitorBlockStatsUpdateCapacity(priv->mon, stats,
-                                                                 visitBacking));
+        if (virTimeMillisNow(&now) < 0) {
+            VIR_WARN("Unable to get current time: %s",
+                     virGetLastErrorMessage());
+            break;
         }
 
-        if (fetchnodedata)
-            nodedata = qemuMonitorQueryNamedBlockNodes(priv->mon);
+        for (i = 0; i < subs->nsubs; i++) {
+            qemuDomainStatsSubPtr sub = subs->subs[i];
 
-        if (qemuDomainObjExitMonitor(driver, dom) < 0)
-            goto cleanup;
+            if (sub->next <= now) {
+                qemuDomainStatsSubPtr ref = virObjectRef(sub);
 
-        /* failure to retrieve stats is fine at this point */
-        if (rc < 0 || (fetchnodedata && !nodedata))
-            virResetLastError();
-    }
+                if (VIR_APPEND_ELEMENT(due, ndue, ref) < 0)
+                    virObjectUnref(ref);
 
-    if (nodedata &&
-        !(nodestats = qemuBlockGetNodeData(nodedata)))
-        goto cleanup;
+                /* Skip the samples we were too late for */
+                sub->next += sub->interval;
+                if (sub->next <= now)
+                    sub->next = now + sub->interval;
+            }
 
-    /* When listing backing chains, it's easier to fix up the count
-     * after the iteration than it is to iterate twice; but we still
-     * want count listed first.  */
-    count_index = record->nparams;
-    QEMU_ADD_COUNT_PARAM(record, maxparams, "block", 0);
+            if (!next || sub->next < next)
+                next = sub->next;
+        }
+
+        if (ndue) {
+            virObjectUnlock(subs);
+            qemuDomainStatsSubsSample(driver, due, ndue);
+            VIR_FREE(due);
+            virObjectLock(subs);
+            continue;
+        }
 
-    for (i = 0; i < dom->def->ndisks; i++) {
-        if (qemuDomainGetStatsBlockExportDisk(dom->def->disks[i], stats, nodestats,
-                                              record, maxparams, &visited,
-                                              visitBacking, driver, cfg, dom,
-                                              blockdev) < 0)
-            goto cleanup;
+        if (next)
+            ignore_value(virCondWaitUntil(&subs->cond, &subs->parent.lock,
+                                          next));
+        else
+            ignore_value(virCondWait(&subs->cond, &subs->parent.lock));
     }
 
-    record->params[count_index].value.ui = visited;
-    ret = 0;
-
- cleanup:
-    virHashFree(stats);
-    virHashFree(nodestats);
-    virJSONValueFree(nodedata);
-    virObjectUnref(cfg);
-    return ret;
+    virObjectUnlock(subs);
 }
 
-#undef QEMU_ADD_BLOCK_PARAM_LL
 
-#undef QEMU_ADD_BLOCK_PARAM_ULL
+/* How often the pressure thread looks for triggers of domains which
+ * were stopped, in milliseconds */
+#define QEMU_DOMAIN_PRESSURE_PRUNE_INTERVAL 5000
 
-#undef QEMU_ADD_NAME_PARAM
+/* Drop the triggers whose domain is no longer running the qemu process
+ * they were registered for. Called by the pressure thread with @subs
+ * unlocked. */
+static void
+qemuDomainStatsPressurePrune(virQEMUDriverPtr driver)
+{
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
+    qemuDomainPressureTrigger *check = NULL;
+    size_t ncheck;
+    bool *stale = NULL;
+    size_t i;
+    size_t j;
 
-#undef QEMU_ADD_COUNT_PARAM
+    virObjectLock(subs);
+    ncheck = subs->ntriggers;
+    if (ncheck &&
+        VIR_ALLOC_N(check, ncheck) == 0 &&
+        VIR_ALLOC_N(stale, ncheck) == 0) {
+        for (i = 0; i < ncheck; i++) {
+            memcpy(check[i].uuid, subs->triggers[i]->uuid, VIR_UUID_BUFLEN);
+            check[i].pid = subs->triggers[i]->pid;
+        }
+    } else {
+        ncheck = 0;
+    }
+    virObjectUnlock(subs);
 
-static int
-qemuDomainGetStatsPerfOneEvent(virPerfPtr perf,
-                               virPerfEventType type,
-                               virDomainStatsRecordPtr record,
-                               int *maxparams)
-{
-    char param_name[VIR_TYPED_PARAM_FIELD_LENGTH];
-    uint64_t value = 0;
+    for (i = 0; i < ncheck; i++) {
+        virDomainObjPtr vm;
 
-    if (virPerfReadEvent(perf, type, &value) < 0)
-        return -1;
+        vm = virDomainObjListFindByUUID(driver->domains, check[i].uuid);
+        if (!vm || !virDomainObjIsActive(vm) || vm->pid != check[i].pid)
+            stale[i] = true;
+        virDomainObjEndAPI(&vm);
+    }
 
-    snprintf(param_name, VIR_TYPED_PARAM_FIELD_LENGTH, "perf.%s",
-             virPerfEventTypeToString(type));
+    virObjectLock(subs);
+    for (i = 0; i < ncheck; i++) {
+        if (!stale[i])
+            continue;
 
-    if (virTypedParamsAddULLong(&record->params,
-                                &record->nparams,
-                                maxparams,
-                                param_name,
-                                value) < 0)
-        return -1;
+        for (j = 0; j < subs->ntriggers; j++) {
+            qemuDomainPressureTriggerPtr trigger = subs->triggers[j];
 
-    return 0;
+            if (trigger->pid == check[i].pid &&
+                memcmp(trigger->uuid, check[i].uuid, VIR_UUID_BUFLEN) == 0) {
+                qemuDomainPressureTriggerFree(trigger);
+                VIR_DELETE_ELEMENT(subs->triggers, j, subs->ntriggers);
+                break;
+            }
+        }
+    }
+    virObjectUnlock(subs);
+
+    VIR_FREE(check);
+    VIR_FREE(stale);
 }
 
-static int
-qemuDomainGetStatsPerf(virQEMUDriverPtr driver ATTRIBUTE_UNUSED,
-                       virDomainObjPtr dom,
-                       virDomainStatsRecordPtr record,
-                       int *maxparams,
-                       unsigned int privflags ATTRIBUTE_UNUSED)
+
+/* Wait for PSI triggers to fire and make the subscriptions which
+ * include the pressure stats due immediately. The kernel reports a
+ * trigger at most once per window, which bounds the extra sampling. */
+static void
+qemuDomainStatsPressureThread(void *opaque)
 {
-    size_t i;
-    qemuDomainObjPrivatePtr priv = dom->privateData;
-    int ret = -1;
+    virQEMUDriverPtr driver = opaque;
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
+    struct pollfd *fds = NULL;
+    unsigned long long lastPrune = 0;
+    char ebuf[1024];
+
+    virObjectLock(subs);
+
+    while (!subs->quit) {
+        size_t ntriggers = subs->ntriggers;
+        size_t nfds = 1 + ntriggers * VIR_CGROUP_PRESSURE_LAST;
+        unsigned long long now;
+        bool triggered = false;
+        size_t i;
+        size_t j;
+        int rc;
 
-    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
-        if (!virPerfEventIsEnabled(priv->perf, i))
-             continue;
+        if (VIR_REALLOC_N(fds, nfds) < 0) {
+            VIR_WARN("Unable to watch pressure triggers: %s",
+                     virGetLastErrorMessage());
+            break;
+        }
 
-        if (qemuDomainGetStatsPerfOneEvent(priv->perf, i,
-                                           record, maxparams) < 0)
-            goto cleanup;
-    }
+        fds[0].fd = subs->pressureWakeup[0];
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        for (i = 0; i < ntriggers; i++) {
+            for (j = 0; j < VIR_CGROUP_PRESSURE_LAST; j++) {
+                struct pollfd *pfd = fds + 1 + i * VIR_CGROUP_PRESSURE_LAST + j;
 
-    ret = 0;
+                pfd->fd = subs->triggers[i]->fds[j];
+                pfd->events = POLLPRI;
+                pfd->revents = 0;
+            }
+        }
 
- cleanup:
-    return ret;
-}
+        virObjectUnlock(subs);
 
-typedef int
-(*qemuDomainGetStatsFunc)(virQEMUDriverPtr driver,
-                          virDomainObjPtr dom,
-                          virDomainStatsRecordPtr record,
-                          int *maxparams,
-                          unsigned int flags);
+        rc = poll(fds, nfds, QEMU_DOMAIN_PRESSURE_PRUNE_INTERVAL);
+        if (rc < 0 && errno != EINTR && errno != EAGAIN)
+            VIR_WARN("Unable to poll pressure triggers: %s",
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
 
-struct qemuDomainGetStatsWorker {
-    qemuDomainGetStatsFunc func;
-    unsigned int stats;
-    bool monitor;
-};
+        virObjectLock(subs);
 
-static struct qemuDomainGetStatsWorker qemuDomainGetStatsWorkers[] = {
-    { qemuDomainGetStatsState, VIR_DOMAIN_STATS_STATE, false },
-    { qemuDomainGetStatsCpu, VIR_DOMAIN_STATS_CPU_TOTAL, false },
-    { qemuDomainGetStatsBalloon, VIR_DOMAIN_STATS_BALLOON, true },
-    { qemuDomainGetStatsVcpu, VIR_DOMAIN_STATS_VCPU, true },
-    { qemuDomainGetStatsInterface, VIR_DOMAIN_STATS_INTERFACE, false },
-    { qemuDomainGetStatsBlock, VIR_DOMAIN_STATS_BLOCK, true },
-    { qemuDomainGetStatsPerf, VIR_DOMAIN_STATS_PERF, false },
-    { NULL, 0, false }
-};
+        if (virTimeMillisNow(&now) < 0) {
+            VIR_WARN("Unable to get current time: %s",
+                     virGetLastErrorMessage());
+            break;
+        }
 
+        if (fds[0].revents & POLLIN) {
+            char buf[64];
 
-static int
-qemuDomainGetStatsCheckSupport(unsigned int *stats,
-                               bool enforce)
-{
-    unsigned int supportedstats = 0;
-    size_t i;
+            while (saferead(subs->pressureWakeup[0], buf, sizeof(buf)) > 0)
+                ;
+        }
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
-        supportedstats |= qemuDomainGetStatsWorkers[i].stats;
+        /* Triggers are only ever removed by this thread, so the ones
+         * polled above are still the first @ntriggers */
+        for (i = rc > 0 ? ntriggers : 0; i-- > 0;) {
+            bool gone = false;
 
-    if (*stats == 0) {
-        *stats = supportedstats;
-        return 0;
-    }
+            for (j = 0; j < VIR_CGROUP_PRESSURE_LAST; j++) {
+                short revents = fds[1 + i * VIR_CGROUP_PRESSURE_LAST + j].revents;
 
-    if (enforce &&
-        *stats & ~supportedstats) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                       _("Stats types bits 0x%x are not supported by this daemon"),
-                       *stats & ~supportedstats);
-        return -1;
-    }
+                if (revents & (POLLERR | POLLHUP | POLLNVAL))
+                    gone = true;
+                else if (revents & POLLPRI)
+                    triggered = true;
+            }
 
-    *stats &= supportedstats;
-    return 0;
-}
+            /* The cgroup was removed along with the qemu process */
+            if (gone) {
+                qemuDomainPressureTriggerFree(subs->triggers[i]);
+                VIR_DELETE_ELEMENT(subs->triggers, i, subs->ntriggers);
+            }
+        }
 
+        if (triggered) {
+            for (i = 0; i < subs->nsubs; i++) {
+                qemuDomainStatsSubPtr sub = subs->subs[i];
 
-static bool
-qemuDomainGetStatsNeedMonitor(unsigned int stats)
-{
-    size_t i;
+                if ((sub->stats & VIR_DOMAIN_STATS_PRESSURE) &&
+                    sub->next > now)
+                    sub->next = now;
+            }
+            virCondSignal(&subs->cond);
+        }
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++)
-        if (stats & qemuDomainGetStatsWorkers[i].stats &&
-            qemuDomainGetStatsWorkers[i].monitor)
-            return true;
+        if (now - lastPrune >= QEMU_DOMAIN_PRESSURE_PRUNE_INTERVAL) {
+            virObjectUnlock(subs);
+            qemuDomainStatsPressurePrune(driver);
+            virObjectLock(subs);
+            lastPrune = now;
+        }
+    }
 
-    return false;
+    virObjectUnlock(subs);
+    VIR_FREE(fds);
 }
 
 
-static int
-qemuDomainGetStats(virConnectPtr conn,
-                   virDomainObjPtr dom,
-                   unsigned int stats,
-                   virDomainStatsRecordPtr *record,
-                   unsigned int flags)
+/**
+ * qemuDomainStatsPressureWatch:
+ * @driver: qemu driver
+ * @vm: domain object, locked and active
+ * @resources: mask of virCgroupPressureResource with PSI available
+ *
+ * Register PSI triggers for @resources of @vm unless that was done for
+ * its current qemu process already, so that stats subscriptions get
+ * sampled as soon as the domain stalls for pressure_trigger_stall_ms.
+ * Failures are only logged, the subscriptions keep their interval.
+ */
+static void
+qemuDomainStatsPressureWatch(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             unsigned int resources)
 {
-    int maxparams = 0;
-    virDomainStatsRecordPtr tmp;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainPressureTriggerPtr trigger = NULL;
+    unsigned long long stall = cfg->pressureTriggerStall * 1000ULL;
+    unsigned long long window = cfg->pressureTriggerWindow * 1000ULL;
+    char ebuf[1024];
+    char c = 0;
     size_t i;
-    int ret = -1;
 
-    if (VIR_ALLOC(tmp) < 0)
+    if (!stall)
         goto cleanup;
 
-    for (i = 0; qemuDomainGetStatsWorkers[i].func; i++) {
-        if (stats & qemuDomainGetStatsWorkers[i].stats) {
-            if (qemuDomainGetStatsWorkers[i].func(conn->privateData, dom, tmp,
-                                                  &maxparams, flags) < 0)
-                goto cleanup;
+    virObjectLock(subs);
+
+    if (subs->quit)
+        goto unlock;
+
+    for (i = 0; i < subs->ntriggers; i++) {
+        if (subs->triggers[i]->pid == vm->pid &&
+            memcmp(subs->triggers[i]->uuid, vm->def->uuid,
+                   VIR_UUID_BUFLEN) == 0)
+            goto unlock;
+    }
+
+    if (!subs->pressureStarted) {
+        if (pipe2(subs->pressureWakeup, O_CLOEXEC | O_NONBLOCK) < 0) {
+            VIR_WARN("Unable to create pressure trigger wakeup pipe: %s",
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
+            goto unlock;
         }
+
+        if (virThreadCreate(&subs->pressureThread, true,
+                            qemuDomainStatsPressureThread, driver) < 0) {
+            VIR_WARN("Unable to create pressure trigger thread");
+            VIR_FORCE_CLOSE(subs->pressureWakeup[0]);
+            VIR_FORCE_CLOSE(subs->pressureWakeup[1]);
+            goto unlock;
+        }
+        subs->pressureStarted = true;
     }
 
-    if (!(tmp->dom = virGetDomain(conn, dom->def->name,
-                                  dom->def->uuid, dom->def->id)))
-        goto cleanup;
+    if (VIR_ALLOC(trigger) < 0)
+        goto unlock;
 
-    *record = tmp;
-    tmp = NULL;
-    ret = 0;
+    memcpy(trigger->uuid, vm->def->uuid, VIR_UUID_BUFLEN);
+    trigger->pid = vm->pid;
 
- cleanup:
-    if (tmp) {
-        virTypedParamsFree(tmp->params, tmp->nparams);
-        VIR_FREE(tmp);
+    /* Even if no trigger could be registered the entry is kept, so
+     * that it's not retried on every sample of this qemu process */
+    for (i = 0; i < VIR_CGROUP_PRESSURE_LAST; i++) {
+        trigger->fds[i] = -1;
+
+        if (!(resources & (1 << i)))
+            continue;
+
+        trigger->fds[i] = virCgroupOpenPressureTrigger(priv->cgroup, i, false,
+                                                       stall, window);
+        if (trigger->fds[i] < 0) {
+            VIR_WARN("Unable to register %s pressure trigger of domain %s: %s",
+                     virCgroupPressureResourceTypeToString(i),
+                     vm->def->name, virGetLastErrorMessage());
+        }
     }
 
-    return ret;
+    if (VIR_APPEND_ELEMENT(subs->triggers, subs->ntriggers, trigger) < 0)
+        goto unlock;
+
+    ignore_value(safewrite(subs->pressureWakeup[1], &c, 1));
+
+ unlock:
+    virObjectUnlock(subs);
+ cleanup:
+    qemuDomainPressureTriggerFree(trigger);
+    virResetLastError();
+    virObjectUnref(cfg);
 }
 
 
 static int
-qemuConnectGetAllDomainStats(virConnectPtr conn,
-                             virDomainPtr *doms,
-                             unsigned int ndoms,
-                             unsigned int stats,
-                             virDomainStatsRecordPtr **retStats,
-                             unsigned int flags)
+qemuConnectDomainStatsRegister(virConnectPtr conn,
+                               unsigned int stats,
+                               unsigned int interval,
+                               virConnectDomainStatsCallback cb,
+                               void *opaque,
+                               virFreeCallback freecb,
+                               unsigned int flags)
 {
     virQEMUDriverPtr driver = conn->privateData;
-    virDomainObjPtr *vms = NULL;
-    virDomainObjPtr vm;
-    size_t nvms;
-    virDomainStatsRecordPtr *tmpstats = NULL;
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
+    qemuDomainStatsSubPtr sub = NULL;
     bool enforce = !!(flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
-    int nstats = 0;
-    size_t i;
     int ret = -1;
-    unsigned int privflags = 0;
-    unsigned int domflags = 0;
-    unsigned int lflags = flags & (VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
-                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
-                                   VIR_CONNECT_LIST_DOMAINS_FILTERS_STATE);
 
     virCheckFlags(VIR_CONNECT_LIST_DOMAINS_FILTERS_ACTIVE |
                   VIR_CONNECT_LIST_DOMAINS_FILTERS_PERSISTENT |
@@ -20616,78 +23159,109 @@ qemuConnectGetAllDomainStats(virConnectPtr conn,
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING |
                   VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS, -1);
 
-    if (virConnectGetAllDomainStatsEnsureACL(conn) < 0)
+    if (virConnectDomainStatsRegisterEnsureACL(conn) < 0)
         return -1;
 
     if (qemuDomainGetStatsCheckSupport(&stats, enforce) < 0)
         return -1;
 
-    if (ndoms) {
-        if (virDomainObjListConvert(driver->domains, conn, doms, ndoms, &vms,
-                                    &nvms, virConnectGetAllDomainStatsCheckACL,
-                                    lflags, true) < 0)
-            return -1;
-    } else {
-        if (virDomainObjListCollect(driver->domains, conn, &vms, &nvms,
-                                    virConnectGetAllDomainStatsCheckACL,
-                                    lflags) < 0)
-            return -1;
+    /* Sampling never waits for a job, and the stats were checked
+     * already, so subscriptions differing only in these flags can
+     * share samples */
+    flags &= ~(VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT |
+               VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS);
+
+    virObjectLock(subs);
+
+    if (subs->quit) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("driver is shutting down"));
+        goto cleanup;
     }
 
-    if (VIR_ALLOC_N(tmpstats, nvms + 1) < 0)
+    if (!(sub = virObjectNew(qemuDomainStatsSubClass)))
         goto cleanup;
 
-    if (qemuDomainGetStatsNeedMonitor(stats))
-        privflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
+    sub->conn = virObjectRef(conn);
+    sub->stats = stats;
+    sub->flags = flags;
+    sub->interval = interval;
+    if (virAsprintf(&sub->key, "%u", ++subs->lastKey) < 0 ||
+        virTimeMillisNow(&sub->next) < 0)
+        goto cleanup;
 
-    for (i = 0; i < nvms; i++) {
-        virDomainStatsRecordPtr tmp = NULL;
-        domflags = 0;
-        vm = vms[i];
+    if (!subs->started) {
+        if (virThreadCreate(&subs->thread, true,
+                            qemuDomainStatsThread, driver) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create domain stats thread"));
+            goto cleanup;
+        }
+        subs->started = true;
+    }
 
-        virObjectLock(vm);
+    /* Make room first, so that nothing can fail once the callback
+     * owns @opaque */
+    if (VIR_RESIZE_N(subs->subs, subs->nsubs, subs->nsubs, 1) < 0)
+        goto cleanup;
 
-        if (HAVE_JOB(privflags)) {
-            int rv;
+    if (virDomainStatsEventStateRegisterID(conn, driver->domainEventState,
+                                           sub->key, cb, opaque, freecb,
+                                           &sub->callbackID) < 0)
+        goto cleanup;
 
-            if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_NOWAIT)
-                rv = qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_QUERY);
-            else
-                rv = qemuDomainObjBeginJob(driver, vm, QEMU_JOB_QUERY);
+    VIR_APPEND_ELEMENT_INPLACE(subs->subs, subs->nsubs, sub);
+    virCondSignal(&subs->cond);
 
-            if (rv == 0)
-                domflags |= QEMU_DOMAIN_STATS_HAVE_JOB;
-        }
-        /* else: without a job it's still possible to gather some data */
+    ret = subs->subs[subs->nsubs - 1]->callbackID;
+
+ cleanup:
+    virObjectUnref(sub);
+    virObjectUnlock(subs);
+    return ret;
+}
 
-        if (flags & VIR_CONNECT_GET_ALL_DOMAINS_STATS_BACKING)
-            domflags |= QEMU_DOMAIN_STATS_BACKING;
-        if (qemuDomainGetStats(conn, vm, stats, &tmp, domflags) < 0) {
-            if (HAVE_JOB(domflags) && vm)
-                qemuDomainObjEndJob(driver, vm);
 
-            virObjectUnlock(vm);
-            goto cleanup;
-        }
+static int
+qemuConnectDomainStatsDeregister(virConnectPtr conn,
+                                 int callbackID)
+{
+    virQEMUDriverPtr driver = conn->privateData;
+    qemuDomainStatsSubsPtr subs = driver->statsSubs;
+    size_t i;
+    int ret = -1;
 
-        if (tmp)
-            tmpstats[nstats++] = tmp;
+    if (virConnectDomainStatsDeregisterEnsureACL(conn) < 0)
+        return -1;
 
-        if (HAVE_JOB(domflags))
-            qemuDomainObjEndJob(driver, vm);
+    virObjectLock(subs);
 
-        virObjectUnlock(vm);
+    for (i = 0; i < subs->nsubs; i++) {
+        if (subs->subs[i]->conn == conn &&
+            subs->subs[i]->callbackID == callbackID)
+            break;
     }
 
-    *retStats = tmpstats;
-    tmpstats = NULL;
+    if (i == subs->nsubs) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("domain stats callback %d not registered"),
+                       callbackID);
+        goto cleanup;
+    }
 
-    ret = nstats;
+    if (virObjectEventStateDeregisterID(conn, driver->domainEventState,
+                                        callbackID, true) < 0)
+        goto cleanup;
 
- cleanup:
-    virDomainStatsRecordListFree(tmpstats);
-    virObjectListFreeCount(vms, nvms);
+    /* The sampling thread may still hold a reference for a moment;
+     * whatever it queues then has no callback to go to */
+    virObjectUnref(subs->subs[i]);
+    VIR_DELETE_ELEMENT(subs->subs, i, subs->nsubs);
+
+    ret = 0;
 
+ cleanup:
+    virObjectUnlock(subs);
     return ret;
 }
 
@@ -21186,6 +23760,9 @@ static int qemuDomainRename(virDomainPtr dom,
         goto endjob;
     }
 
+    if (qemuDomainSnapshotLoadIfNeeded(vm) < 0)
+        goto endjob;
+
     if (virDomainSnapshotObjListNum(vm->snapshots, NULL, 0) > 0) {
         virReportError(VIR_ERR_OPERATION_INVALID,
                        "%s", _("cannot rename domain with snapshots"));
@@ -22011,6 +24588,17 @@ static virHypervisorDriver qemuHypervisorDriver = {
     .connectBaselineHypervisorCPU = qemuConnectBaselineHypervisorCPU, /* 4.4.0 */
     .nodeGetSEVInfo = qemuNodeGetSEVInfo, /* 4.5.0 */
     .domainGetLaunchSecurityInfo = qemuDomainGetLaunchSecurityInfo, /* 4.5.0 */
+    .connectDomainStatsRegister = qemuConnectDomainStatsRegister, /* 4.10.0 */
+    .connectDomainStatsDeregister = qemuConnectDomainStatsDeregister, /* 4.10.0 */
+    .connectMigrateDomains = qemuConnectMigrateDomains, /* 4.10.0 */
+    .domainCheckpointCreateXML = qemuDomainCheckpointCreateXML, /* 4.10.0 */
+    .domainCheckpointGetXMLDesc = qemuDomainCheckpointGetXMLDesc, /* 4.10.0 */
+    .domainListAllCheckpoints = qemuDomainListAllCheckpoints, /* 4.10.0 */
+    .domainCheckpointLookupByName = qemuDomainCheckpointLookupByName, /* 4.10.0 */
+    .domainCheckpointDelete = qemuDomainCheckpointDelete, /* 4.10.0 */
+    .domainBackupBegin = qemuDomainBackupBegin, /* 4.10.0 */
+    .domainAttachDevices = qemuDomainAttachDevices, /* 4.10.0 */
+    .connectGetDomainsChangedSince = qemuConnectGetDomainsChangedSince, /* 4.10.0 */
 };
 
 
@@ -51,6 +51,7 @@
 #include "virfdstream.h"
 #include "viruuid.h"
 #include "virtime.h"
+#include "virevent.h"
 #include "locking/domain_lock.h"
 #include "rpc/virnetsocket.h"
 #include "virstoragefile.h"
@@ -60,9 +61,15 @@
 #include "virtypedparam.h"
 #include "virprocess.h"
 #include "nwfilter_conf.h"
+#include "dirname.h"
 
 #define VIR_FROM_THIS VIR_FROM_QEMU
 
+/* How long (in milliseconds) migration statistics fetched from QEMU can be
+ * reused for reporting job info before a new query-migrate is issued. The
+ * cache is invalidated earlier by MIGRATION and MIGRATION_PASS events. */
+#define QEMU_MIGRATION_STATS_MAX_AGE 250
+
 VIR_LOG_INIT("qemu.qemu_migration");
 
 VIR_ENUM_IMPL(qemuMigrationJobPhase, QEMU_MIGRATION_PHASE_LAST,
@@ -883,6 +890,76 @@ qemuMigrationSrcNBDStorageCopyDriveMirror(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * qemuMigrationSrcNBDStorageCopyBalance:
+ * @driver: qemu driver
+ * @vm: domain
+ * @speed: aggregate bandwidth limit for all mirrors in bytes/s
+ * @notReady: number of mirrors which were not ready when last balanced
+ *
+ * Every mirror starts with an equal share of @speed. Once some of them reach
+ * the ready state and only need to mirror guest writes, the mirrors still
+ * performing their initial copy split the whole @speed among themselves.
+ * Nothing is changed unless the number of mirrors which are not ready yet
+ * dropped below @notReady, which is updated accordingly.
+ *
+ * Returns 0 on success, -1 if the domain died.
+ */
+static int
+qemuMigrationSrcNBDStorageCopyBalance(virQEMUDriverPtr driver,
+                                      virDomainObjPtr vm,
+                                      unsigned long long speed,
+                                      size_t *notReady)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    unsigned long long share;
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+
+        if (QEMU_DOMAIN_DISK_PRIVATE(disk)->migrating &&
+            disk->mirrorState != VIR_DOMAIN_DISK_MIRROR_STATE_READY)
+            count++;
+    }
+
+    if (speed == 0 || count == 0 || count >= *notReady)
+        return 0;
+
+    *notReady = count;
+    share = speed / count;
+
+    VIR_DEBUG("Limiting %zu disk mirrors which are not ready to %llu B/s each",
+              count, share);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm,
+                                       QEMU_ASYNC_JOB_MIGRATION_OUT) < 0)
+        return -1;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+        char *diskAlias;
+
+        if (!QEMU_DOMAIN_DISK_PRIVATE(disk)->migrating ||
+            disk->mirrorState == VIR_DOMAIN_DISK_MIRROR_STATE_READY)
+            continue;
+
+        if (!(diskAlias = qemuAliasDiskDriveFromDisk(disk)))
+            break;
+
+        if (qemuMonitorBlockJobSetSpeed(priv->mon, diskAlias, share) < 0) {
+            VIR_WARN("Unable to change speed of disk mirror %s", disk->dst);
+            virResetLastError();
+        }
+        qemuBlockJobInfoInvalidate(disk);
+        VIR_FREE(diskAlias);
+    }
+
+    return qemuDomainObjExitMonitor(driver, vm);
+}
+
+
 /**
  * qemuMigrationSrcNBDStorageCopy:
  * @driver: qemu driver
@@ -894,6 +971,8 @@ qemuMigrationSrcNBDStorageCopyDriveMirror(virQEMUDriverPtr driver,
  *
  * Migrate non-shared storage using the NBD protocol to the server running
  * inside the qemu process on dst and wait until the copy converges.
+ * The @speed limit is shared by all disks, see
+ * qemuMigrationSrcNBDStorageCopyBalance.
  * On success update @migrate_flags so we don't tell 'migrate' command
  * to do the very same operation. On failure, the caller is
  * expected to call qemuMigrationSrcNBDCopyCancel to stop all
@@ -921,7 +1000,9 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
     size_t i;
     char *diskAlias = NULL;
     unsigned long long mirror_speed = speed;
+    unsigned long long disk_speed;
     unsigned int mirror_flags = VIR_DOMAIN_BLOCK_REBASE_REUSE_EXT;
+    size_t ncopy = 0;
     int rv;
     virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
@@ -942,6 +1023,21 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
     if (*migrate_flags & QEMU_MONITOR_MIGRATE_NON_SHARED_INC)
         mirror_flags |= VIR_DOMAIN_BLOCK_REBASE_SHALLOW;
 
+    for (i = 0; i < vm->def->ndisks; i++) {
+        if (qemuMigrationAnyCopyDisk(vm->def->disks[i],
+                                     nmigrate_disks, migrate_disks))
+            ncopy++;
+    }
+
+    /* Start with an equal share of the bandwidth for each disk; zero
+     * means unlimited and stays as is. */
+    disk_speed = mirror_speed;
+    if (ncopy > 1 && disk_speed) {
+        disk_speed /= ncopy;
+        if (disk_speed == 0)
+            disk_speed = 1;
+    }
+
     for (i = 0; i < vm->def->ndisks; i++) {
         virDomainDiskDefPtr disk = vm->def->disks[i];
         qemuDomainDiskPrivatePtr diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
@@ -960,13 +1056,13 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
             rc = qemuMigrationSrcNBDStorageCopyBlockdev(driver, vm,
                                                         disk, diskAlias,
                                                         host, port,
-                                                        mirror_speed,
+                                                        disk_speed,
                                                         mirror_flags,
                                                         tlsAlias);
         } else {
             rc = qemuMigrationSrcNBDStorageCopyDriveMirror(driver, vm, diskAlias,
                                                            host, port,
-                                                           mirror_speed,
+                                                           disk_speed,
                                                            mirror_flags);
         }
 
@@ -976,6 +1072,7 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
         }
 
         VIR_FREE(diskAlias);
+        qemuBlockJobStarted(disk);
         diskPriv->migrating = true;
 
         if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
@@ -1002,6 +1099,10 @@ qemuMigrationSrcNBDStorageCopy(virQEMUDriverPtr driver,
             goto cleanup;
         }
 
+        if (qemuMigrationSrcNBDStorageCopyBalance(driver, vm, mirror_speed,
+                                                  &ncopy) < 0)
+            goto cleanup;
+
         if (virDomainObjWait(vm) < 0)
             goto cleanup;
     }
@@ -1075,6 +1176,9 @@ qemuMigrationSrcIsAllowed(virQEMUDriverPtr driver,
 
     /* perform these checks only when migrating to remote hosts */
     if (remote) {
+        if (qemuDomainSnapshotLoadIfNeeded(vm) < 0)
+            return false;
+
         nsnapshots = virDomainSnapshotObjListNum(vm->snapshots, NULL, 0);
         if (nsnapshots < 0)
             return false;
@@ -1372,6 +1476,56 @@ qemuMigrationAnyFetchStats(virQEMUDriverPtr driver,
         return -1;
 
     jobInfo->stats.mig = stats;
+    if (virTimeMillisNow(&jobInfo->statsFetched) < 0)
+        jobInfo->statsFetched = 0;
+
+    return 0;
+}
+
+
+/**
+ * qemuMigrationAnyFetchCachedStats:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @asyncJob: async job the caller is part of
+ * @jobInfo: copy of the current job info to fill in
+ *
+ * Fills in migration statistics in @jobInfo while avoiding a monitor round
+ * trip when the statistics cached in the current job are recent enough and
+ * no migration event arrived since they were fetched. Freshly fetched
+ * statistics are stored back in the current job for subsequent callers.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMigrationAnyFetchCachedStats(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 qemuDomainAsyncJob asyncJob,
+                                 qemuDomainJobInfoPtr jobInfo)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr current = priv->job.current;
+    unsigned long long now;
+
+    if (current && current->statsFetched &&
+        virTimeMillisNow(&now) == 0 &&
+        now >= current->statsFetched &&
+        now - current->statsFetched < QEMU_MIGRATION_STATS_MAX_AGE) {
+        VIR_DEBUG("Reusing migration statistics fetched %llu ms ago",
+                  now - current->statsFetched);
+        jobInfo->stats.mig = current->stats.mig;
+        jobInfo->statsFetched = current->statsFetched;
+        return 0;
+    }
+
+    if (qemuMigrationAnyFetchStats(driver, vm, asyncJob, jobInfo, NULL) < 0)
+        return -1;
+
+    /* The job may have finished while we were talking to the monitor. */
+    if (priv->job.current) {
+        priv->job.current->stats.mig = jobInfo->stats.mig;
+        priv->job.current->statsFetched = jobInfo->statsFetched;
+    }
 
     return 0;
 }
@@ -1563,6 +1717,95 @@ qemuMigrationAnyCompleted(virQEMUDriverPtr driver,
 /* Returns 0 on success, -2 when migration needs to be cancelled, or -1 when
  * QEMU reports failed migration.
  */
+/**
+ * qemuMigrationSrcAutoDowntime:
+ * @driver: qemu driver
+ * @vm: domain
+ * @asyncJob: migration job
+ * @iteration: the last pass over memory this function acted upon
+ *
+ * Raises the downtime limit of a migration which is not expected to converge
+ * so that it can finish, up to migration_max_auto_downtime from qemu.conf.
+ * It is only evaluated once per pass over domain's memory.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuMigrationSrcAutoDowntime(virQEMUDriverPtr driver,
+                             virDomainObjPtr vm,
+                             qemuDomainAsyncJob asyncJob,
+                             unsigned long long *iteration)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    qemuMigrationParamsPtr migParams = NULL;
+    unsigned long long maxDowntime = cfg->migrationMaxAutoDowntime;
+    unsigned long long downtime;
+    unsigned long long needed;
+    unsigned long long estimate;
+    int rc;
+    int ret = -1;
+
+    if (maxDowntime == 0 ||
+        jobInfo->status != QEMU_DOMAIN_JOB_STATUS_MIGRATING ||
+        jobInfo->stats.mig.ram_iteration < 2 ||
+        jobInfo->stats.mig.ram_iteration == *iteration) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    *iteration = jobInfo->stats.mig.ram_iteration;
+
+    /* Polling already keeps the statistics up to date */
+    if (events &&
+        qemuMigrationAnyFetchStats(driver, vm, asyncJob, jobInfo, NULL) < 0)
+        goto cleanup;
+
+    if (jobInfo->stats.mig.ram_bps == 0 ||
+        qemuDomainJobInfoEstimateConvergence(jobInfo, &estimate)) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* Time needed to send the rest of memory with the domain paused */
+    needed = jobInfo->stats.mig.ram_remaining * 1000 /
+             jobInfo->stats.mig.ram_bps;
+    needed = MIN(MAX(needed, 1), maxDowntime);
+
+    if (qemuMigrationParamsFetch(driver, vm, asyncJob, &migParams) < 0)
+        goto cleanup;
+
+    if (qemuMigrationParamsGetULL(migParams,
+                                  QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
+                                  &downtime) != 0 ||
+        needed <= downtime) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Migration is not converging at iteration %llu, raising "
+              "downtime limit from %llums to %llums",
+              *iteration, downtime, needed);
+
+    if (qemuDomainObjEnterMonitorAsync(driver, vm, asyncJob) < 0)
+        goto cleanup;
+
+    rc = qemuMonitorSetMigrationDowntime(priv->mon, needed);
+
+    if (qemuDomainObjExitMonitor(driver, vm) < 0 || rc < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    qemuMigrationParamsFree(migParams);
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
 static int
 qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
                                   virDomainObjPtr vm,
@@ -1573,6 +1816,7 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
     qemuDomainObjPrivatePtr priv = vm->privateData;
     qemuDomainJobInfoPtr jobInfo = priv->job.current;
     bool events = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_MIGRATION_EVENT);
+    unsigned long long iteration = 0;
     int rv;
 
     jobInfo->status = QEMU_DOMAIN_JOB_STATUS_MIGRATING;
@@ -1582,6 +1826,13 @@ qemuMigrationSrcWaitForCompletion(virQEMUDriverPtr driver,
         if (rv < 0)
             return rv;
 
+        if (asyncJob == QEMU_ASYNC_JOB_MIGRATION_OUT &&
+            qemuMigrationSrcAutoDowntime(driver, vm, asyncJob, &iteration) < 0) {
+            VIR_WARN("Unable to adjust migration downtime of domain %s",
+                     vm->def->name);
+            virResetLastError();
+        }
+
         if (events) {
             if (virDomainObjWait(vm) < 0) {
                 if (virDomainObjIsActive(vm))
@@ -1977,6 +2228,13 @@ qemuMigrationSrcBeginPhase(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
+    if (flags & VIR_MIGRATE_PARALLEL && flags & VIR_MIGRATE_TUNNELLED) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("parallel migration is not supported with "
+                         "tunnelled migration"));
+        goto cleanup;
+    }
+
     if (flags & (VIR_MIGRATE_NON_SHARED_DISK | VIR_MIGRATE_NON_SHARED_INC)) {
         bool has_drive_mirror =  virQEMUCapsGet(priv->qemuCaps,
                                                 QEMU_CAPS_DRIVE_MIRROR);
@@ -2341,6 +2599,13 @@ qemuMigrationDstPrepareAny(virQEMUDriverPtr driver,
         goto cleanup;
     }
 
+    if (flags & VIR_MIGRATE_PARALLEL && flags & VIR_MIGRATE_TUNNELLED) {
+        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED, "%s",
+                       _("parallel migration is not supported with "
+                         "tunnelled migration"));
+        goto cleanup;
+    }
+
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto cleanup;
 
@@ -3083,7 +3348,18 @@ struct _qemuMigrationSpec {
     } fwd;
 };
 
-#define TUNNEL_SEND_BUF_SIZE 65536
+/* Data read from QEMU is queued in a ring of TUNNEL_SEND_BUF_COUNT buffers
+ * and sent to the destination by a separate thread, so that reading the next
+ * chunk from QEMU overlaps with sending the previous one over the stream. */
+#define TUNNEL_SEND_BUF_SIZE (1024 * 1024)
+#define TUNNEL_SEND_BUF_COUNT 4
+
+typedef struct _qemuMigrationIOBuf qemuMigrationIOBuf;
+typedef qemuMigrationIOBuf *qemuMigrationIOBufPtr;
+struct _qemuMigrationIOBuf {
+    char *data;
+    size_t len;
+};
 
 typedef struct _qemuMigrationIOThread qemuMigrationIOThread;
 typedef qemuMigrationIOThread *qemuMigrationIOThreadPtr;
@@ -3094,21 +3370,121 @@ struct _qemuMigrationIOThread {
     virError err;
     int wakeupRecvFD;
     int wakeupSendFD;
+
+    /* The following members are shared with the sender thread and
+     * protected by @lock */
+    virMutex lock;
+    virCond cond;
+    qemuMigrationIOBuf bufs[TUNNEL_SEND_BUF_COUNT];
+    size_t head; /* the oldest buffer waiting to be sent */
+    size_t count; /* number of buffers waiting to be sent */
+    bool done; /* no more buffers will be queued */
+    bool aborted; /* queued buffers should be discarded */
+    bool sendFailed;
+    virError sendErr;
 };
 
+
+static void qemuMigrationSrcIOSendFunc(void *arg)
+{
+    qemuMigrationIOThreadPtr data = arg;
+
+    virMutexLock(&data->lock);
+
+    for (;;) {
+        qemuMigrationIOBufPtr buf;
+        const char *ptr;
+        size_t len;
+
+        while (data->count == 0 && !data->done && !data->aborted)
+            ignore_value(virCondWait(&data->cond, &data->lock));
+
+        if (data->count == 0 || data->aborted)
+            break;
+
+        buf = &data->bufs[data->head];
+        virMutexUnlock(&data->lock);
+
+        /* virStreamSend may consume less than requested */
+        ptr = buf->data;
+        len = buf->len;
+        while (len > 0) {
+            int nbytes = virStreamSend(data->st, ptr, len);
+
+            if (nbytes < 0) {
+                virMutexLock(&data->lock);
+                virCopyLastError(&data->sendErr);
+                virResetLastError();
+                data->sendFailed = true;
+                virCondBroadcast(&data->cond);
+                goto cleanup;
+            }
+
+            ptr += nbytes;
+            len -= nbytes;
+        }
+
+        virMutexLock(&data->lock);
+        data->head = (data->head + 1) % TUNNEL_SEND_BUF_COUNT;
+        data->count--;
+        virCondBroadcast(&data->cond);
+    }
+
+ cleanup:
+    virMutexUnlock(&data->lock);
+}
+
+
+/* Waits for the sender thread to send all queued buffers (or to discard
+ * them if @abort is true) and to finish. Returns true if all data was sent
+ * successfully. */
+static bool
+qemuMigrationSrcIOStopSender(qemuMigrationIOThreadPtr data,
+                             virThreadPtr sender,
+                             bool abort)
+{
+    bool failed;
+
+    virMutexLock(&data->lock);
+    data->aborted = abort;
+    data->done = true;
+    virCondBroadcast(&data->cond);
+    virMutexUnlock(&data->lock);
+
+    virThreadJoin(sender);
+
+    virMutexLock(&data->lock);
+    failed = data->sendFailed;
+    virMutexUnlock(&data->lock);
+
+    return !failed;
+}
+
+
 static void qemuMigrationSrcIOFunc(void *arg)
 {
     qemuMigrationIOThreadPtr data = arg;
-    char *buffer = NULL;
+    virThread sender;
+    bool senderRunning = false;
     struct pollfd fds[2];
     int timeout = -1;
     virErrorPtr err = NULL;
+    size_t i;
 
     VIR_DEBUG("Running migration tunnel; stream=%p, sock=%d",
               data->st, data->sock);
 
-    if (VIR_ALLOC_N(buffer, TUNNEL_SEND_BUF_SIZE) < 0)
+    for (i = 0; i < TUNNEL_SEND_BUF_COUNT; i++) {
+        if (VIR_ALLOC_N(data->bufs[i].data, TUNNEL_SEND_BUF_SIZE) < 0)
+            goto abrt;
+    }
+
+    if (virThreadCreate(&sender, true, qemuMigrationSrcIOSendFunc, data) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create migration tunnel thread"));
         goto abrt;
+    }
+    senderRunning = true;
 
     fds[0].fd = data->sock;
     fds[1].fd = data->wakeupRecvFD;
@@ -3157,12 +3533,33 @@ static void qemuMigrationSrcIOFunc(void *arg)
         }
 
         if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
-            int nbytes;
+            qemuMigrationIOBufPtr buf;
+            ssize_t nbytes;
+            bool failed;
+
+            /* Wait for a free buffer */
+            virMutexLock(&data->lock);
+            while (data->count == TUNNEL_SEND_BUF_COUNT && !data->sendFailed)
+                ignore_value(virCondWait(&data->cond, &data->lock));
+            failed = data->sendFailed;
+            buf = &data->bufs[(data->head + data->count) % TUNNEL_SEND_BUF_COUNT];
+            virMutexUnlock(&data->lock);
+
+            if (failed)
+                goto error;
+
+            /* A single read so that we never block waiting for a full
+             * buffer once QEMU is done sending data. */
+            do {
+                nbytes = read(data->sock, buf->data, TUNNEL_SEND_BUF_SIZE);
+            } while (nbytes < 0 && errno == EINTR);
 
-            nbytes = saferead(data->sock, buffer, TUNNEL_SEND_BUF_SIZE);
             if (nbytes > 0) {
-                if (virStreamSend(data->st, buffer, nbytes) < 0)
-                    goto error;
+                virMutexLock(&data->lock);
+                buf->len = nbytes;
+                data->count++;
+                virCondBroadcast(&data->cond);
+                virMutexUnlock(&data->lock);
             } else if (nbytes < 0) {
                 virReportSystemError(errno, "%s",
                         _("tunnelled migration failed to read from qemu"));
@@ -3174,13 +3571,15 @@ static void qemuMigrationSrcIOFunc(void *arg)
         }
     }
 
+    senderRunning = false;
+    if (!qemuMigrationSrcIOStopSender(data, &sender, false))
+        goto error;
+
     if (virStreamFinish(data->st) < 0)
         goto error;
 
     VIR_FORCE_CLOSE(data->sock);
-    VIR_FREE(buffer);
-
-    return;
+    goto cleanup;
 
  abrt:
     err = virSaveLastError();
@@ -3188,6 +3587,10 @@ static void qemuMigrationSrcIOFunc(void *arg)
         virFreeError(err);
         err = NULL;
     }
+    if (senderRunning) {
+        senderRunning = false;
+        ignore_value(qemuMigrationSrcIOStopSender(data, &sender, true));
+    }
     virStreamAbort(data->st);
     if (err) {
         virSetError(err);
@@ -3195,13 +3598,24 @@ static void qemuMigrationSrcIOFunc(void *arg)
     }
 
  error:
+    if (senderRunning)
+        ignore_value(qemuMigrationSrcIOStopSender(data, &sender, true));
+
+    /* Report the error from the sender thread unless we have our own */
+    if (data->sendFailed && !virGetLastError())
+        virSetError(&data->sendErr);
+
     /* Let the source qemu know that the transfer cant continue anymore.
      * Don't copy the error for EPIPE as destination has the actual error. */
     VIR_FORCE_CLOSE(data->sock);
     if (!virLastErrorIsSystemErrno(EPIPE))
         virCopyLastError(&data->err);
     virResetLastError();
-    VIR_FREE(buffer);
+
+ cleanup:
+    for (i = 0; i < TUNNEL_SEND_BUF_COUNT; i++)
+        VIR_FREE(data->bufs[i].data);
+    virResetError(&data->sendErr);
 }
 
 
@@ -3221,6 +3635,21 @@ qemuMigrationSrcStartTunnel(virStreamPtr st,
     if (VIR_ALLOC(io) < 0)
         goto error;
 
+    if (virMutexInit(&io->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        VIR_FREE(io);
+        goto error;
+    }
+
+    if (virCondInit(&io->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize condition"));
+        virMutexDestroy(&io->lock);
+        VIR_FREE(io);
+        goto error;
+    }
+
     io->st = st;
     io->sock = sock;
     io->wakeupRecvFD = wakeupFD[0];
@@ -3231,6 +3660,8 @@ qemuMigrationSrcStartTunnel(virStreamPtr st,
                         io) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to create migration thread"));
+        virCondDestroy(&io->cond);
+        virMutexDestroy(&io->lock);
         goto error;
     }
 
@@ -3273,6 +3704,8 @@ qemuMigrationSrcStopTunnel(qemuMigrationIOThreadPtr io, bool error)
  cleanup:
     VIR_FORCE_CLOSE(io->wakeupSendFD);
     VIR_FORCE_CLOSE(io->wakeupRecvFD);
+    virCondDestroy(&io->cond);
+    virMutexDestroy(&io->lock);
     VIR_FREE(io);
     return rv;
 }
@@ -4360,6 +4793,287 @@ qemuMigrationSrcConnectionClosed(virConnectPtr conn,
 }
 
 
+/* Upper bound on idle connections kept by qemuMigrationConnPool */
+#define QEMU_MIGRATION_CONN_POOL_MAX 16
+
+/* How often idle connections are checked for expiry, in milliseconds */
+#define QEMU_MIGRATION_CONN_POOL_CHECK 1000
+
+typedef struct _qemuMigrationConnPoolEntry qemuMigrationConnPoolEntry;
+typedef qemuMigrationConnPoolEntry *qemuMigrationConnPoolEntryPtr;
+struct _qemuMigrationConnPoolEntry {
+    char *uri;
+    virConnectPtr conn;
+    unsigned long long expires;
+};
+
+struct _qemuMigrationConnPool {
+    virObjectLockable parent;
+
+    int timer;
+    bool closed;
+
+    qemuMigrationConnPoolEntry *entries;
+    size_t nentries;
+};
+
+static virClassPtr qemuMigrationConnPoolClass;
+
+static void qemuMigrationConnPoolDispose(void *obj);
+
+static int
+qemuMigrationConnPoolOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuMigrationConnPool, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuMigrationConnPool)
+
+
+static void
+qemuMigrationConnPoolEntryListFree(qemuMigrationConnPoolEntryPtr entries,
+                                   size_t nentries)
+{
+    size_t i;
+
+    for (i = 0; i < nentries; i++) {
+        VIR_FREE(entries[i].uri);
+        virObjectUnref(entries[i].conn);
+    }
+    VIR_FREE(entries);
+}
+
+
+static void
+qemuMigrationConnPoolCloseThread(void *opaque)
+{
+    qemuMigrationConnPoolEntryPtr entries = opaque;
+    size_t nentries = 0;
+
+    /* The list is terminated by an entry without a connection */
+    while (entries[nentries].conn)
+        nentries++;
+
+    qemuMigrationConnPoolEntryListFree(entries, nentries);
+}
+
+
+static void
+qemuMigrationConnPoolExpire(int timer ATTRIBUTE_UNUSED,
+                            void *opaque)
+{
+    qemuMigrationConnPoolPtr pool = opaque;
+    qemuMigrationConnPoolEntryPtr expired = NULL;
+    size_t nexpired = 0;
+    unsigned long long now;
+    virThread thread;
+    size_t i;
+
+    if (virTimeMillisNow(&now) < 0)
+        return;
+
+    virObjectLock(pool);
+
+    /* Reserve one more entry to terminate the list for the closing thread */
+    if (VIR_ALLOC_N(expired, pool->nentries + 1) < 0) {
+        virObjectUnlock(pool);
+        return;
+    }
+
+    for (i = 0; i < pool->nentries;) {
+        if (pool->entries[i].expires <= now ||
+            virConnectIsAlive(pool->entries[i].conn) != 1) {
+            expired[nexpired++] = pool->entries[i];
+            ignore_value(VIR_DELETE_ELEMENT(pool->entries, i, pool->nentries));
+        } else {
+            i++;
+        }
+    }
+
+    if (pool->nentries == 0 && pool->timer >= 0) {
+        virEventRemoveTimeout(pool->timer);
+        pool->timer = -1;
+    }
+
+    virObjectUnlock(pool);
+
+    if (nexpired == 0) {
+        VIR_FREE(expired);
+        return;
+    }
+
+    VIR_DEBUG("Closing %zu idle migration connections", nexpired);
+
+    /* Closing a remote connection talks to the remote daemon, which must
+     * not block the event loop we are called from. */
+    if (virThreadCreate(&thread, false,
+                        qemuMigrationConnPoolCloseThread, expired) < 0) {
+        VIR_WARN("Unable to create thread for closing migration connections");
+        qemuMigrationConnPoolEntryListFree(expired, nexpired);
+    }
+}
+
+
+static void
+qemuMigrationConnPoolDispose(void *obj)
+{
+    qemuMigrationConnPoolPtr pool = obj;
+
+    qemuMigrationConnPoolEntryListFree(pool->entries, pool->nentries);
+}
+
+
+qemuMigrationConnPoolPtr
+qemuMigrationConnPoolNew(void)
+{
+    qemuMigrationConnPoolPtr pool;
+
+    if (qemuMigrationConnPoolInitialize() < 0)
+        return NULL;
+
+    if (!(pool = virObjectLockableNew(qemuMigrationConnPoolClass)))
+        return NULL;
+
+    pool->timer = -1;
+
+    return pool;
+}
+
+
+/**
+ * qemuMigrationConnPoolClose:
+ * @pool: connection pool
+ *
+ * Closes all idle connections in @pool and makes sure no more connections
+ * are put into it. Called when the driver is shutting down.
+ */
+void
+qemuMigrationConnPoolClose(qemuMigrationConnPoolPtr pool)
+{
+    qemuMigrationConnPoolEntryPtr entries;
+    size_t nentries;
+
+    virObjectLock(pool);
+    pool->closed = true;
+    if (pool->timer >= 0) {
+        virEventRemoveTimeout(pool->timer);
+        pool->timer = -1;
+    }
+    entries = pool->entries;
+    nentries = pool->nentries;
+    pool->entries = NULL;
+    pool->nentries = 0;
+    virObjectUnlock(pool);
+
+    qemuMigrationConnPoolEntryListFree(entries, nentries);
+}
+
+
+/**
+ * qemuMigrationConnPoolAcquire:
+ * @pool: connection pool
+ * @uri: URI of the destination daemon
+ *
+ * Takes an idle connection to @uri out of @pool. Connections are handed out
+ * exclusively so that each migration can register its own close callback.
+ *
+ * Returns the connection or NULL if there is no usable connection to @uri,
+ * no error is reported in that case.
+ */
+static virConnectPtr
+qemuMigrationConnPoolAcquire(qemuMigrationConnPoolPtr pool,
+                             const char *uri)
+{
+    virConnectPtr conn = NULL;
+    size_t i;
+
+    virObjectLock(pool);
+
+    for (i = pool->nentries; i > 0; i--) {
+        qemuMigrationConnPoolEntryPtr entry = &pool->entries[i - 1];
+
+        if (STRNEQ(entry->uri, uri) ||
+            virConnectIsAlive(entry->conn) != 1)
+            continue;
+
+        conn = entry->conn;
+        VIR_FREE(entry->uri);
+        ignore_value(VIR_DELETE_ELEMENT(pool->entries, i - 1, pool->nentries));
+        break;
+    }
+
+    virObjectUnlock(pool);
+
+    VIR_DEBUG("Reusing cached connection to %s: %p", uri, conn);
+    return conn;
+}
+
+
+/**
+ * qemuMigrationConnPoolRelease:
+ * @pool: connection pool
+ * @uri: URI @conn was opened with
+ * @conn: connection to the destination daemon
+ * @timeout: how long @conn may stay idle, in seconds
+ *
+ * Puts @conn back into @pool, consuming the caller's reference. Unless
+ * another migration to @uri takes it within @timeout seconds, the connection
+ * is closed. Dead connections and connections exceeding the size of the pool
+ * are closed right away.
+ */
+static void
+qemuMigrationConnPoolRelease(qemuMigrationConnPoolPtr pool,
+                             const char *uri,
+                             virConnectPtr conn,
+                             unsigned int timeout)
+{
+    qemuMigrationConnPoolEntry entry = { NULL, conn, 0 };
+
+    if (!conn)
+        return;
+
+    if (timeout == 0 ||
+        virConnectIsAlive(conn) != 1 ||
+        virTimeMillisNow(&entry.expires) < 0 ||
+        VIR_STRDUP_QUIET(entry.uri, uri) < 0)
+        goto error;
+
+    entry.expires += timeout * 1000ull;
+
+    virObjectLock(pool);
+
+    if (pool->closed || pool->nentries >= QEMU_MIGRATION_CONN_POOL_MAX)
+        goto unlock;
+
+    if (pool->timer < 0) {
+        virObjectRef(pool);
+        if ((pool->timer = virEventAddTimeout(QEMU_MIGRATION_CONN_POOL_CHECK,
+                                              qemuMigrationConnPoolExpire,
+                                              pool,
+                                              virObjectFreeCallback)) < 0) {
+            virObjectUnref(pool);
+            goto unlock;
+        }
+    }
+
+    if (VIR_APPEND_ELEMENT_QUIET(pool->entries, pool->nentries, entry) < 0)
+        goto unlock;
+
+    VIR_DEBUG("Caching connection %p to %s for %u seconds", conn, uri, timeout);
+    virObjectUnlock(pool);
+    return;
+
+ unlock:
+    virObjectUnlock(pool);
+ error:
+    VIR_FREE(entry.uri);
+    virObjectUnref(conn);
+}
+
+
 static int virConnectCredType[] = {
     VIR_CRED_AUTHNAME,
     VIR_CRED_PASSPHRASE,
@@ -4389,10 +5103,12 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriverPtr driver,
                                  unsigned long flags,
                                  const char *dname,
                                  unsigned long resource,
-                                 bool *v3proto)
+                                 bool *v3proto,
+                                 virConnectPtr sharedDconn)
 {
     int ret = -1;
     virConnectPtr dconn = NULL;
+    bool closeCallback = false;
     bool p2p;
     virErrorPtr orig_err = NULL;
     bool offline = !!(flags & VIR_MIGRATE_OFFLINE);
@@ -4434,26 +5150,41 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriverPtr driver,
      * destination side is completely setup before we touch the source
      */
 
-    qemuDomainObjEnterRemote(vm);
-    dconn = virConnectOpenAuth(dconnuri, &virConnectAuthConfig, 0);
-    if (qemuDomainObjExitRemote(vm, !offline) < 0)
-        goto cleanup;
+    if (sharedDconn) {
+        /* The owner of the connection takes care of keepalive and of
+         * waking us up when the connection is closed. */
+        dconn = virObjectRef(sharedDconn);
+    } else {
+        bool cached = false;
 
-    if (dconn == NULL) {
-        virReportError(VIR_ERR_OPERATION_FAILED,
-                       _("Failed to connect to remote libvirt URI %s: %s"),
-                       dconnuri, virGetLastErrorMessage());
-        virObjectUnref(cfg);
-        return -1;
-    }
+        qemuDomainObjEnterRemote(vm);
+        if (!(dconn = qemuMigrationConnPoolAcquire(driver->migrationConns,
+                                                   dconnuri)))
+            dconn = virConnectOpenAuth(dconnuri, &virConnectAuthConfig, 0);
+        else
+            cached = true;
+        if (qemuDomainObjExitRemote(vm, !offline) < 0)
+            goto cleanup;
 
-    if (virConnectSetKeepAlive(dconn, cfg->keepAliveInterval,
-                               cfg->keepAliveCount) < 0)
-        goto cleanup;
+        if (dconn == NULL) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("Failed to connect to remote libvirt URI %s: %s"),
+                           dconnuri, virGetLastErrorMessage());
+            virObjectUnref(cfg);
+            return -1;
+        }
 
-    if (virConnectRegisterCloseCallback(dconn, qemuMigrationSrcConnectionClosed,
-                                        vm, NULL) < 0) {
-        goto cleanup;
+        if (!cached &&
+            virConnectSetKeepAlive(dconn, cfg->keepAliveInterval,
+                                   cfg->keepAliveCount) < 0)
+            goto cleanup;
+
+        if (virConnectRegisterCloseCallback(dconn,
+                                            qemuMigrationSrcConnectionClosed,
+                                            vm, NULL) < 0) {
+            goto cleanup;
+        }
+        closeCallback = true;
     }
 
     qemuDomainObjEnterRemote(vm);
@@ -4517,8 +5248,13 @@ qemuMigrationSrcPerformPeer2Peer(virQEMUDriverPtr driver,
  cleanup:
     orig_err = virSaveLastError();
     qemuDomainObjEnterRemote(vm);
-    virConnectUnregisterCloseCallback(dconn, qemuMigrationSrcConnectionClosed);
-    virObjectUnref(dconn);
+    if (closeCallback)
+        virConnectUnregisterCloseCallback(dconn, qemuMigrationSrcConnectionClosed);
+    if (sharedDconn)
+        virObjectUnref(dconn);
+    else
+        qemuMigrationConnPoolRelease(driver->migrationConns, dconnuri, dconn,
+                                     cfg->migrationConnCacheTimeout);
     ignore_value(qemuDomainObjExitRemote(vm, false));
     if (orig_err) {
         virSetError(orig_err);
@@ -4555,7 +5291,8 @@ qemuMigrationSrcPerformJob(virQEMUDriverPtr driver,
                            unsigned long flags,
                            const char *dname,
                            unsigned long resource,
-                           bool v3proto)
+                           bool v3proto,
+                           virConnectPtr sharedDconn)
 {
     virObjectEventPtr event = NULL;
     int ret = -1;
@@ -4584,7 +5321,7 @@ qemuMigrationSrcPerformJob(virQEMUDriverPtr driver,
                                                dconnuri, uri, graphicsuri, listenAddress,
                                                nmigrate_disks, migrate_disks, nbdPort,
                                                migParams, flags, dname, resource,
-                                               &v3proto);
+                                               &v3proto, sharedDconn);
     } else {
         qemuMigrationJobSetPhase(driver, vm, QEMU_MIGRATION_PHASE_PERFORM2);
         ret = qemuMigrationSrcPerformNative(driver, vm, persist_xml, uri, cookiein, cookieinlen,
@@ -4759,7 +5496,8 @@ qemuMigrationSrcPerform(virQEMUDriverPtr driver,
                                           migParams,
                                           cookiein, cookieinlen,
                                           cookieout, cookieoutlen,
-                                          flags, dname, resource, v3proto);
+                                          flags, dname, resource, v3proto,
+                                          NULL);
     } else {
         if (dconnuri) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -4782,9 +5520,288 @@ qemuMigrationSrcPerform(virQEMUDriverPtr driver,
                                               migParams,
                                               cookiein, cookieinlen,
                                               cookieout, cookieoutlen, flags,
-                                              dname, resource, v3proto);
+                                              dname, resource, v3proto, NULL);
+        }
+    }
+}
+
+/* Number of domains migrated at the same time by
+ * qemuMigrationSrcPerformDomains if the caller does not say otherwise. */
+#define QEMU_MIGRATION_DOMAINS_CONCURRENCY 4
+
+typedef struct _qemuMigrationSrcDomainsData qemuMigrationSrcDomainsData;
+typedef qemuMigrationSrcDomainsData *qemuMigrationSrcDomainsDataPtr;
+struct _qemuMigrationSrcDomainsData {
+    virQEMUDriverPtr driver;
+    virConnectPtr conn;
+    virConnectPtr dconn;
+    const char *dconnuri;
+    const char *uri;
+    const char *graphicsuri;
+    const char *listenAddress;
+    size_t nmigrate_disks;
+    const char **migrate_disks;
+    int nbdPort;
+    virTypedParameterPtr params;
+    int nparams;
+    unsigned long flags;
+    unsigned long resource;
+
+    virDomainObjPtr *vms;
+    size_t nvms;
+
+    /* The following members are protected by @lock */
+    virMutex lock;
+    size_t next;
+    size_t nfailed;
+    virErrorPtr error;
+};
+
+
+typedef struct _qemuMigrationSrcDomainsItem qemuMigrationSrcDomainsItem;
+struct _qemuMigrationSrcDomainsItem {
+    virDomainObjPtr vm;
+    unsigned long long memory;
+};
+
+
+static int
+qemuMigrationSrcDomainsCompare(const void *a,
+                               const void *b)
+{
+    const qemuMigrationSrcDomainsItem *ia = a;
+    const qemuMigrationSrcDomainsItem *ib = b;
+
+    if (ia->memory > ib->memory)
+        return -1;
+    if (ia->memory < ib->memory)
+        return 1;
+    return 0;
+}
+
+
+static void
+qemuMigrationSrcDomainsConnectionClosed(virConnectPtr conn,
+                                        int reason,
+                                        void *opaque)
+{
+    qemuMigrationSrcDomainsDataPtr data = opaque;
+    size_t i;
+
+    VIR_DEBUG("conn=%p, reason=%d", conn, reason);
+
+    for (i = 0; i < data->nvms; i++)
+        virDomainObjBroadcast(data->vms[i]);
+}
+
+
+static void
+qemuMigrationSrcDomainsWorker(void *opaque)
+{
+    qemuMigrationSrcDomainsDataPtr data = opaque;
+
+    for (;;) {
+        qemuMigrationParamsPtr migParams;
+        virDomainObjPtr vm;
+        char *name = NULL;
+        int rc = -1;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->nvms) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        vm = data->vms[data->next++];
+        virMutexUnlock(&data->lock);
+
+        /* qemuMigrationSrcPerformJob consumes a locked reference */
+        virObjectRef(vm);
+        virObjectLock(vm);
+        ignore_value(VIR_STRDUP_QUIET(name, vm->def->name));
+
+        VIR_DEBUG("Migrating domain %s", NULLSTR(name));
+
+        if ((migParams = qemuMigrationParamsFromFlags(data->params,
+                                                      data->nparams,
+                                                      data->flags,
+                                                      QEMU_MIGRATION_SOURCE))) {
+            rc = qemuMigrationSrcPerformJob(data->driver, data->conn, vm,
+                                            NULL, NULL, data->dconnuri,
+                                            data->uri, data->graphicsuri,
+                                            data->listenAddress,
+                                            data->nmigrate_disks,
+                                            data->migrate_disks,
+                                            data->nbdPort, migParams,
+                                            NULL, 0, NULL, NULL,
+                                            data->flags, NULL, data->resource,
+                                            true, data->dconn);
+        } else {
+            virDomainObjEndAPI(&vm);
+        }
+        qemuMigrationParamsFree(migParams);
+
+        if (rc < 0) {
+            VIR_WARN("Migration of domain %s failed: %s",
+                     NULLSTR(name), virGetLastErrorMessage());
+
+            virMutexLock(&data->lock);
+            data->nfailed++;
+            if (!data->error)
+                data->error = virSaveLastError();
+            virMutexUnlock(&data->lock);
+            virResetLastError();
+        }
+
+        VIR_FREE(name);
+    }
+}
+
+
+/**
+ * qemuMigrationSrcPerformDomains:
+ * @driver: qemu driver
+ * @conn: connection the migration was requested on
+ * @vms: referenced, unlocked domain objects to migrate
+ * @nvms: number of domains in @vms
+ * @concurrency: maximum number of migrations running at once, 0 for default
+ *
+ * Migrates all domains in @vms to @dconnuri using peer-to-peer migration
+ * over a single connection to the destination. Domains with more memory are
+ * started first so that the longest migrations do not end up running alone
+ * at the very end. The remaining arguments are the same as for
+ * qemuMigrationSrcPerform, except that migration parameters are parsed from
+ * @params separately for each domain.
+ *
+ * Returns 0 if all domains were migrated, -1 otherwise with the error of the
+ * first failed migration set.
+ */
+int
+qemuMigrationSrcPerformDomains(virQEMUDriverPtr driver,
+                               virConnectPtr conn,
+                               virDomainObjPtr *vms,
+                               size_t nvms,
+                               const char *dconnuri,
+                               const char *uri,
+                               const char *graphicsuri,
+                               const char *listenAddress,
+                               size_t nmigrate_disks,
+                               const char **migrate_disks,
+                               int nbdPort,
+                               virTypedParameterPtr params,
+                               int nparams,
+                               unsigned long flags,
+                               unsigned long resource,
+                               unsigned int concurrency)
+{
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuMigrationSrcDomainsData data = {
+        .driver = driver, .conn = conn, .dconnuri = dconnuri, .uri = uri,
+        .graphicsuri = graphicsuri, .listenAddress = listenAddress,
+        .nmigrate_disks = nmigrate_disks, .migrate_disks = migrate_disks,
+        .nbdPort = nbdPort, .params = params, .nparams = nparams,
+        .flags = flags, .resource = resource,
+    };
+    qemuMigrationSrcDomainsItem *items = NULL;
+    virThreadPtr threads = NULL;
+    size_t nthreads = 0;
+    size_t i;
+    bool closeCallback = false;
+    int ret = -1;
+
+    VIR_DEBUG("driver=%p, conn=%p, nvms=%zu, dconnuri=%s, uri=%s, "
+              "flags=0x%lx, resource=%lu, concurrency=%u",
+              driver, conn, nvms, NULLSTR(dconnuri), NULLSTR(uri),
+              flags, resource, concurrency);
+
+    if (virMutexInit(&data.lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        virObjectUnref(cfg);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(items, nvms) < 0 ||
+        VIR_ALLOC_N(data.vms, nvms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        items[i].vm = vms[i];
+        virObjectLock(vms[i]);
+        items[i].memory = virDomainDefGetMemoryTotal(vms[i]->def);
+        virObjectUnlock(vms[i]);
+    }
+
+    qsort(items, nvms, sizeof(*items), qemuMigrationSrcDomainsCompare);
+
+    for (i = 0; i < nvms; i++)
+        data.vms[i] = items[i].vm;
+    data.nvms = nvms;
+
+    if (!(data.dconn = qemuMigrationConnPoolAcquire(driver->migrationConns,
+                                                    dconnuri))) {
+        if (!(data.dconn = virConnectOpenAuth(dconnuri,
+                                              &virConnectAuthConfig, 0))) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("Failed to connect to remote libvirt URI %s: %s"),
+                           dconnuri, virGetLastErrorMessage());
+            goto cleanup;
         }
+
+        if (virConnectSetKeepAlive(data.dconn, cfg->keepAliveInterval,
+                                   cfg->keepAliveCount) < 0)
+            goto cleanup;
     }
+
+    if (virConnectRegisterCloseCallback(data.dconn,
+                                        qemuMigrationSrcDomainsConnectionClosed,
+                                        &data, NULL) < 0)
+        goto cleanup;
+    closeCallback = true;
+
+    if (concurrency == 0)
+        concurrency = QEMU_MIGRATION_DOMAINS_CONCURRENCY;
+    concurrency = MIN(concurrency, nvms);
+
+    /* The calling thread is one of the workers */
+    if (concurrency > 1 && VIR_ALLOC_N(threads, concurrency - 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i + 1 < concurrency; i++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            qemuMigrationSrcDomainsWorker, &data) < 0) {
+            VIR_WARN("Unable to create migration thread, continuing with %zu",
+                     nthreads + 1);
+            break;
+        }
+        nthreads++;
+    }
+
+    qemuMigrationSrcDomainsWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    if (data.nfailed) {
+        VIR_DEBUG("Migration of %zu out of %zu domains failed",
+                  data.nfailed, nvms);
+        virSetError(data.error);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    if (closeCallback)
+        virConnectUnregisterCloseCallback(data.dconn,
+                                          qemuMigrationSrcDomainsConnectionClosed);
+    qemuMigrationConnPoolRelease(driver->migrationConns, dconnuri, data.dconn,
+                                 cfg->migrationConnCacheTimeout);
+    virFreeError(data.error);
+    virMutexDestroy(&data.lock);
+    VIR_FREE(threads);
+    VIR_FREE(data.vms);
+    VIR_FREE(items);
+    virObjectUnref(cfg);
+    return ret;
 }
 
 static int
@@ -5190,6 +6207,37 @@ qemuMigrationDstFinish(virQEMUDriverPtr driver,
 }
 
 
+/**
+ * qemuMigrationSrcCompressorNew:
+ * @compressor: path to the compression program
+ * @inputfd: the uncompressed stream is read from here
+ * @outputfd: the compressed stream is written here
+ * @errbuf: filled with the error output of @compressor
+ *
+ * Returns the command compressing a save or dump image, to be run
+ * asynchronously.
+ */
+virCommandPtr
+qemuMigrationSrcCompressorNew(const char *compressor,
+                              int inputfd,
+                              int *outputfd,
+                              char **errbuf)
+{
+    virCommandPtr cmd = virCommandNewArgList(compressor, "-c", NULL);
+
+    /* zstd compresses on a single thread unless told otherwise,
+     * which would make it the bottleneck of the whole save */
+    if (STREQ(last_component(compressor), "zstd"))
+        virCommandAddArg(cmd, "-T0");
+    virCommandSetInputFD(cmd, inputfd);
+    virCommandSetOutputFD(cmd, outputfd);
+    virCommandSetErrorBuffer(cmd, errbuf);
+    virCommandDoAsyncIO(cmd);
+
+    return cmd;
+}
+
+
 /* Helper function called while vm is active.  */
 int
 qemuMigrationSrcToFile(virQEMUDriverPtr driver, virDomainObjPtr vm,
@@ -5245,18 +6293,8 @@ qemuMigrationSrcToFile(virQEMUDriverPtr driver, virDomainObjPtr vm,
                                     QEMU_MONITOR_MIGRATE_BACKGROUND,
                                     fd);
     } else {
-        const char *prog = compressor;
-        const char *args[] = {
-            prog,
-            "-c",
-            NULL
-        };
-
-        cmd = virCommandNewArgs(args);
-        virCommandSetInputFD(cmd, pipeFD[0]);
-        virCommandSetOutputFD(cmd, &fd);
-        virCommandSetErrorBuffer(cmd, &errbuf);
-        virCommandDoAsyncIO(cmd);
+        cmd = qemuMigrationSrcCompressorNew(compressor, pipeFD[0], &fd,
+                                            &errbuf);
         if (virSetCloseExec(pipeFD[1]) < 0) {
             virReportSystemError(errno, "%s",
                                  _("Unable to set cloexec flag"));
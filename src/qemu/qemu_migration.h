@@ -57,7 +57,8 @@
      VIR_MIGRATE_AUTO_CONVERGE | \
      VIR_MIGRATE_RDMA_PIN_ALL | \
      VIR_MIGRATE_POSTCOPY | \
-     VIR_MIGRATE_TLS)
+     VIR_MIGRATE_TLS | \
+     VIR_MIGRATE_PARALLEL)
 
 /* All supported migration parameters and their types. */
 # define QEMU_MIGRATION_PARAMETERS \
@@ -79,6 +80,7 @@
     VIR_MIGRATE_PARAM_PERSIST_XML,      VIR_TYPED_PARAM_STRING, \
     VIR_MIGRATE_PARAM_AUTO_CONVERGE_INITIAL,        VIR_TYPED_PARAM_INT, \
     VIR_MIGRATE_PARAM_AUTO_CONVERGE_INCREMENT,      VIR_TYPED_PARAM_INT, \
+    VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS,         VIR_TYPED_PARAM_INT, \
     NULL
 
 
@@ -173,6 +175,30 @@ qemuMigrationSrcPerform(virQEMUDriverPtr driver,
                         unsigned long resource,
                         bool v3proto);
 
+qemuMigrationConnPoolPtr
+qemuMigrationConnPoolNew(void);
+
+void
+qemuMigrationConnPoolClose(qemuMigrationConnPoolPtr pool);
+
+int
+qemuMigrationSrcPerformDomains(virQEMUDriverPtr driver,
+                               virConnectPtr conn,
+                               virDomainObjPtr *vms,
+                               size_t nvms,
+                               const char *dconnuri,
+                               const char *uri,
+                               const char *graphicsuri,
+                               const char *listenAddress,
+                               size_t nmigrate_disks,
+                               const char **migrate_disks,
+                               int nbdPort,
+                               virTypedParameterPtr params,
+                               int nparams,
+                               unsigned long flags,
+                               unsigned long resource,
+                               unsigned int concurrency);
+
 virDomainPtr
 qemuMigrationDstFinish(virQEMUDriverPtr driver,
                        virConnectPtr dconn,
@@ -199,6 +225,13 @@ qemuMigrationSrcIsAllowed(virQEMUDriverPtr driver,
                           bool remote,
                           unsigned int flags);
 
+virCommandPtr
+qemuMigrationSrcCompressorNew(const char *compressor,
+                              int inputfd,
+                              int *outputfd,
+                              char **errbuf)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(3) ATTRIBUTE_NONNULL(4);
+
 int
 qemuMigrationSrcToFile(virQEMUDriverPtr driver,
                        virDomainObjPtr vm,
@@ -218,6 +251,12 @@ qemuMigrationAnyFetchStats(virQEMUDriverPtr driver,
                            qemuDomainJobInfoPtr jobInfo,
                            char **error);
 
+int
+qemuMigrationAnyFetchCachedStats(virQEMUDriverPtr driver,
+                                 virDomainObjPtr vm,
+                                 qemuDomainAsyncJob asyncJob,
+                                 qemuDomainJobInfoPtr jobInfo);
+
 int
 qemuMigrationDstErrorInit(virQEMUDriverPtr driver);
 
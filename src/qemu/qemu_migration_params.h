@@ -38,6 +38,7 @@ typedef enum {
     QEMU_MIGRATION_CAP_COMPRESS,
     QEMU_MIGRATION_CAP_PAUSE_BEFORE_SWITCHOVER,
     QEMU_MIGRATION_CAP_LATE_BLOCK_ACTIVATE,
+    QEMU_MIGRATION_CAP_MULTIFD,
 
     QEMU_MIGRATION_CAP_LAST
 } qemuMigrationCapability;
@@ -55,6 +56,7 @@ typedef enum {
     QEMU_MIGRATION_PARAM_DOWNTIME_LIMIT,
     QEMU_MIGRATION_PARAM_BLOCK_INCREMENTAL,
     QEMU_MIGRATION_PARAM_XBZRLE_CACHE_SIZE,
+    QEMU_MIGRATION_PARAM_MULTIFD_CHANNELS,
 
     QEMU_MIGRATION_PARAM_LAST
 } qemuMigrationParam;
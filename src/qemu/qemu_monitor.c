@@ -87,8 +87,11 @@ struct _qemuMonitor {
     qemuMonitorCallbacksPtr cb;
     void *callbackOpaque;
 
-    /* If there's a command being processed this will be
-     * non-NULL */
+    /* Commands sent or being sent to the monitor and not yet
+     * collected by their callers, oldest first. Linked through
+     * their 'next' pointer. They are written in order, so there is
+     * at most one partially written command, followed by the ones
+     * not written yet */
     qemuMonitorMessagePtr msg;
 
     /* Buffer incoming data ready for Text/QMP monitor
@@ -96,6 +99,9 @@ struct _qemuMonitor {
     size_t bufferOffset;
     size_t bufferLength;
     char *buffer;
+    /* Length of the data at the start of buffer already known not
+     * to contain the end of a line */
+    size_t bufferScanned;
 
     /* If anything went wrong, this will be fed back
      * the next monitor msg */
@@ -109,6 +115,9 @@ struct _qemuMonitor {
     /* cache of query-command-line-options results */
     virJSONValuePtr options;
 
+    /* query-named-block-nodes may omit the nested backing images */
+    bool queryNamedBlockNodesFlat;
+
     /* If found, path to the virtio memballoon driver */
     char *balloonpath;
     bool ballooninit;
@@ -178,6 +187,11 @@ VIR_ENUM_IMPL(qemuMonitorMigrationStatus,
               "completed", "failed",
               "cancelling", "cancelled")
 
+VIR_ENUM_IMPL(qemuMonitorJobStatus,
+              QEMU_MONITOR_JOB_STATUS_LAST,
+              "", "created", "running", "paused", "ready", "standby",
+              "waiting", "pending", "aborting", "concluded", "null")
+
 VIR_ENUM_IMPL(qemuMonitorVMStatus,
               QEMU_MONITOR_VM_STATUS_LAST,
               "debug", "inmigrate", "internal-error", "io-error", "paused",
@@ -362,28 +376,27 @@ qemuMonitorOpenUnix(const char *monitor,
     if (retry) {
         if (virTimeBackOffStart(&timebackoff, 1, timeout * 1000) < 0)
             goto error;
-        while (virTimeBackOffWait(&timebackoff)) {
-            ret = connect(monfd, (struct sockaddr *)&addr, sizeof(addr));
 
-            if (ret == 0)
-                break;
+        /* The socket is often there already, don't sleep before
+         * trying to connect to it for the first time. */
+        while ((ret = connect(monfd, (struct sockaddr *)&addr,
+                              sizeof(addr))) < 0) {
+            int err = errno;
 
-            if ((errno == ENOENT || errno == ECONNREFUSED) &&
-                (!cpid || virProcessKill(cpid, 0) == 0)) {
-                /* ENOENT       : Socket may not have shown up yet
-                 * ECONNREFUSED : Leftover socket hasn't been removed yet */
-                continue;
+            if ((err != ENOENT && err != ECONNREFUSED) ||
+                (cpid && virProcessKill(cpid, 0) < 0)) {
+                virReportSystemError(err, "%s",
+                                     _("failed to connect to monitor socket"));
+                goto error;
             }
 
-            virReportSystemError(errno, "%s",
-                                 _("failed to connect to monitor socket"));
-            goto error;
-        }
-
-        if (ret != 0) {
-            virReportSystemError(errno, "%s",
-                                 _("monitor socket did not show up"));
-            goto error;
+            /* ENOENT       : Socket may not have shown up yet
+             * ECONNREFUSED : Leftover socket hasn't been removed yet */
+            if (!virTimeBackOffWait(&timebackoff)) {
+                virReportSystemError(err, "%s",
+                                     _("monitor socket did not show up"));
+                goto error;
+            }
         }
     } else {
         ret = connect(monfd, (struct sockaddr *) &addr, sizeof(addr));
@@ -417,6 +430,79 @@ qemuMonitorOpenPty(const char *monitor)
 }
 
 
+/* Returns the first queued message with data left to write */
+static qemuMonitorMessagePtr
+qemuMonitorMessageToWrite(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (!msg->finished && msg->txOffset < msg->txLength)
+            return msg;
+    }
+
+    return NULL;
+}
+
+
+static bool
+qemuMonitorMessageAnyFinished(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next) {
+        if (msg->finished)
+            return true;
+    }
+
+    return false;
+}
+
+
+/* Wake up the callers of all queued messages, used once the
+ * monitor is broken */
+static void
+qemuMonitorMessageFinishAll(qemuMonitorPtr mon)
+{
+    qemuMonitorMessagePtr msg;
+
+    for (msg = mon->msg; msg; msg = msg->next)
+        msg->finished = true;
+
+    if (mon->msg)
+        virCondBroadcast(&mon->notify);
+}
+
+
+static void
+qemuMonitorMessageQueue(qemuMonitorPtr mon,
+                        qemuMonitorMessagePtr msg)
+{
+    qemuMonitorMessagePtr *tail = &mon->msg;
+
+    while (*tail)
+        tail = &(*tail)->next;
+
+    msg->next = NULL;
+    *tail = msg;
+}
+
+
+static void
+qemuMonitorMessageUnqueue(qemuMonitorPtr mon,
+                          qemuMonitorMessagePtr msg)
+{
+    qemuMonitorMessagePtr *link = &mon->msg;
+
+    while (*link && *link != msg)
+        link = &(*link)->next;
+
+    if (*link)
+        *link = msg->next;
+    msg->next = NULL;
+}
+
+
 /* This method processes data that has been received
  * from the monitor. Looking for async events and
  * replies/errors.
@@ -425,18 +511,20 @@ static int
 qemuMonitorIOProcess(qemuMonitorPtr mon)
 {
     int len;
-    qemuMonitorMessagePtr msg = NULL;
 
-    /* See if there's a message & whether its ready for its reply
-     * ie whether its completed writing all its data */
-    if (mon->msg && mon->msg->txOffset == mon->msg->txLength)
-        msg = mon->msg;
+    /* Large replies arrive in many pieces, don't make the parser rescan
+     * the whole buffer for each of them until a line is complete */
+    if (!memchr(mon->buffer + mon->bufferScanned, '\n',
+                mon->bufferOffset - mon->bufferScanned)) {
+        mon->bufferScanned = mon->bufferOffset;
+        return 0;
+    }
 
 #if DEBUG_IO
 # if DEBUG_RAW_IO
-    char *str1 = qemuMonitorEscapeNonPrintable(msg ? msg->txBuffer : "");
+    char *str1 = qemuMonitorEscapeNonPrintable(mon->msg ? mon->msg->txBuffer : "");
     char *str2 = qemuMonitorEscapeNonPrintable(mon->buffer);
-    VIR_ERROR(_("Process %d %p %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, msg, str1, str2);
+    VIR_ERROR(_("Process %d %p [[[[%s]]][[[%s]]]"), (int)mon->bufferOffset, mon->msg, str1, str2);
     VIR_FREE(str1);
     VIR_FREE(str2);
 # else
@@ -448,8 +536,7 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
                 mon, mon->buffer, mon->bufferOffset);
 
     len = qemuMonitorJSONIOProcess(mon,
-                                   mon->buffer, mon->bufferOffset,
-                                   msg);
+                                   mon->buffer, mon->bufferOffset);
     if (len < 0)
         return -1;
 
@@ -463,14 +550,16 @@ qemuMonitorIOProcess(qemuMonitorPtr mon)
         VIR_FREE(mon->buffer);
         mon->bufferOffset = mon->bufferLength = 0;
     }
+    /* What's left is an incomplete line */
+    mon->bufferScanned = mon->bufferOffset;
 #if DEBUG_IO
     VIR_DEBUG("Process done %d used %d", (int)mon->bufferOffset, len);
 #endif
 
     /* As the monitor mutex was unlocked in qemuMonitorJSONIOProcess()
-     * while dealing with qemu event, mon->msg could be changed which
-     * means the above 'msg' may be invalid, thus we use 'mon->msg' here */
-    if (mon->msg && mon->msg->finished)
+     * while dealing with qemu event, the queue could have changed, thus
+     * it is walked again here */
+    if (qemuMonitorMessageAnyFinished(mon))
         virCondBroadcast(&mon->notify);
     return len;
 }
@@ -525,47 +614,55 @@ qemuMonitorIOWriteWithFD(qemuMonitorPtr mon,
 static int
 qemuMonitorIOWrite(qemuMonitorPtr mon)
 {
-    int done;
-    char *buf;
-    size_t len;
+    qemuMonitorMessagePtr msg;
+    int total = 0;
 
-    /* If no active message, or fully transmitted, the no-op */
-    if (!mon->msg || mon->msg->txOffset == mon->msg->txLength)
-        return 0;
+    /* Write as many of the queued messages as the socket takes,
+     * so that they get processed without waiting for each other */
+    while ((msg = qemuMonitorMessageToWrite(mon))) {
+        int done;
+        char *buf;
+        size_t len;
 
-    if (mon->msg->txFD != -1 && !mon->hasSendFD) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Monitor does not support sending of file descriptors"));
-        return -1;
-    }
+        if (msg->txFD != -1 && !mon->hasSendFD) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Monitor does not support sending of file descriptors"));
+            return -1;
+        }
 
-    buf = mon->msg->txBuffer + mon->msg->txOffset;
-    len = mon->msg->txLength - mon->msg->txOffset;
-    if (mon->msg->txFD == -1)
-        done = write(mon->fd, buf, len);
-    else
-        done = qemuMonitorIOWriteWithFD(mon, buf, len, mon->msg->txFD);
-
-    PROBE(QEMU_MONITOR_IO_WRITE,
-          "mon=%p buf=%s len=%zu ret=%d errno=%d",
-          mon, buf, len, done, done < 0 ? errno : 0);
-
-    if (mon->msg->txFD != -1) {
-        PROBE(QEMU_MONITOR_IO_SEND_FD,
-              "mon=%p fd=%d ret=%d errno=%d",
-              mon, mon->msg->txFD, done, done < 0 ? errno : 0);
-    }
+        buf = msg->txBuffer + msg->txOffset;
+        len = msg->txLength - msg->txOffset;
+        if (msg->txFD == -1)
+            done = write(mon->fd, buf, len);
+        else
+            done = qemuMonitorIOWriteWithFD(mon, buf, len, msg->txFD);
 
-    if (done < 0) {
-        if (errno == EAGAIN)
-            return 0;
+        PROBE(QEMU_MONITOR_IO_WRITE,
+              "mon=%p buf=%s len=%zu ret=%d errno=%d",
+              mon, buf, len, done, done < 0 ? errno : 0);
 
-        virReportSystemError(errno, "%s",
-                             _("Unable to write to monitor"));
-        return -1;
+        if (msg->txFD != -1) {
+            PROBE(QEMU_MONITOR_IO_SEND_FD,
+                  "mon=%p fd=%d ret=%d errno=%d",
+                  mon, msg->txFD, done, done < 0 ? errno : 0);
+        }
+
+        if (done < 0) {
+            if (errno == EAGAIN)
+                return total;
+
+            virReportSystemError(errno, "%s",
+                                 _("Unable to write to monitor"));
+            return -1;
+        }
+        msg->txOffset += done;
+        total += done;
+
+        if (msg->txOffset < msg->txLength)
+            break;
     }
-    mon->msg->txOffset += done;
-    return done;
+
+    return total;
 }
 
 
@@ -582,17 +679,24 @@ qemuMonitorIORead(qemuMonitorPtr mon)
     int ret = 0;
 
     if (avail < 1024) {
+        size_t newlength;
+
         if (mon->bufferLength >= QEMU_MONITOR_MAX_RESPONSE) {
             virReportSystemError(ERANGE,
                                  _("No complete monitor response found in %d bytes"),
                                  QEMU_MONITOR_MAX_RESPONSE);
             return -1;
         }
-        if (VIR_REALLOC_N(mon->buffer,
-                          mon->bufferLength + 1024) < 0)
+
+        /* Grow geometrically so that big replies don't take thousands
+         * of reallocations */
+        newlength = MAX(mon->bufferLength * 2, mon->bufferLength + 1024);
+        newlength = MIN(newlength, QEMU_MONITOR_MAX_RESPONSE);
+
+        if (VIR_REALLOC_N(mon->buffer, newlength) < 0)
             return -1;
-        mon->bufferLength += 1024;
-        avail += 1024;
+        avail += newlength - mon->bufferLength;
+        mon->bufferLength = newlength;
     }
 
     /* Read as much as we can get into our buffer,
@@ -640,7 +744,7 @@ qemuMonitorUpdateWatch(qemuMonitorPtr mon)
     if (mon->lastError.code == VIR_ERR_OK) {
         events |= VIR_EVENT_HANDLE_READABLE;
 
-        if ((mon->msg && mon->msg->txOffset < mon->msg->txLength) &&
+        if (qemuMonitorMessageToWrite(mon) &&
             !mon->waitGreeting)
             events |= VIR_EVENT_HANDLE_WRITABLE;
     }
@@ -763,12 +867,9 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         }
 
         VIR_DEBUG("Error on monitor %s", NULLSTR(mon->lastError.message));
-        /* If IO process resulted in an error & we have a message,
-         * then wakeup that waiter */
-        if (mon->msg && !mon->msg->finished) {
-            mon->msg->finished = 1;
-            virCondSignal(&mon->notify);
-        }
+        /* If IO process resulted in an error & we have messages,
+         * then wakeup their waiters */
+        qemuMonitorMessageFinishAll(mon);
     }
 
     qemuMonitorUpdateWatch(mon);
@@ -781,7 +882,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering EOF callback");
         (eofNotify)(mon, vm, mon->callbackOpaque);
@@ -791,7 +892,7 @@ qemuMonitorIO(int watch, int fd, int events, void *opaque)
         virDomainObjPtr vm = mon->vm;
 
         /* Make sure anyone waiting wakes up now */
-        virCondSignal(&mon->notify);
+        virCondBroadcast(&mon->notify);
         virObjectUnlock(mon);
         VIR_DEBUG("Triggering error callback");
         (errorNotify)(mon, vm, mon->callbackOpaque);
@@ -1011,8 +1112,8 @@ qemuMonitorClose(qemuMonitorPtr mon)
         VIR_FORCE_CLOSE(mon->fd);
     }
 
-    /* In case another thread is waiting for its monitor command to be
-     * processed, we need to wake it up with appropriate error set.
+    /* In case other threads are waiting for their monitor commands to
+     * be processed, we need to wake them up with appropriate error set.
      */
     if (mon->msg) {
         if (mon->lastError.code == VIR_ERR_OK) {
@@ -1028,8 +1129,7 @@ qemuMonitorClose(qemuMonitorPtr mon)
                 virResetLastError();
             }
         }
-        mon->msg->finished = 1;
-        virCondSignal(&mon->notify);
+        qemuMonitorMessageFinishAll(mon);
     }
 
     /* Propagate existing monitor error in case the current thread has no
@@ -1061,10 +1161,12 @@ qemuMonitorResetCommandID(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorSend(qemuMonitorPtr mon,
-                qemuMonitorMessagePtr msg)
+static int
+qemuMonitorSendInternal(qemuMonitorPtr mon,
+                        qemuMonitorMessagePtr *msgs,
+                        size_t nmsgs)
 {
+    size_t i;
     int ret = -1;
 
     /* Check whether qemu quit unexpectedly */
@@ -1075,18 +1177,22 @@ qemuMonitorSend(qemuMonitorPtr mon,
         return -1;
     }
 
-    mon->msg = msg;
-    qemuMonitorUpdateWatch(mon);
+    for (i = 0; i < nmsgs; i++) {
+        PROBE(QEMU_MONITOR_SEND_MSG,
+              "mon=%p msg=%s fd=%d",
+              mon, msgs[i]->txBuffer, msgs[i]->txFD);
 
-    PROBE(QEMU_MONITOR_SEND_MSG,
-          "mon=%p msg=%s fd=%d",
-          mon, mon->msg->txBuffer, mon->msg->txFD);
+        qemuMonitorMessageQueue(mon, msgs[i]);
+    }
+    qemuMonitorUpdateWatch(mon);
 
-    while (!mon->msg->finished) {
-        if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
-            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                           _("Unable to wait on monitor condition"));
-            goto cleanup;
+    for (i = 0; i < nmsgs; i++) {
+        while (!msgs[i]->finished) {
+            if (virCondWait(&mon->notify, &mon->parent.lock) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("Unable to wait on monitor condition"));
+                goto cleanup;
+            }
         }
     }
 
@@ -1100,13 +1206,54 @@ qemuMonitorSend(qemuMonitorPtr mon,
     ret = 0;
 
  cleanup:
-    mon->msg = NULL;
+    for (i = 0; i < nmsgs; i++)
+        qemuMonitorMessageUnqueue(mon, msgs[i]);
     qemuMonitorUpdateWatch(mon);
 
     return ret;
 }
 
 
+/* Returns the oldest of the messages waiting for a reply, the others
+ * are reachable through its 'next' pointer */
+qemuMonitorMessagePtr
+qemuMonitorGetMessages(qemuMonitorPtr mon)
+{
+    return mon->msg;
+}
+
+
+int
+qemuMonitorSend(qemuMonitorPtr mon,
+                qemuMonitorMessagePtr msg)
+{
+    return qemuMonitorSendInternal(mon, &msg, 1);
+}
+
+
+/**
+ * qemuMonitorSendBatch:
+ * @mon: monitor object
+ * @msgs: messages to send
+ * @nmsgs: number of entries in @msgs
+ *
+ * Sends all of @msgs to the monitor without waiting for replies in
+ * between, and waits until all of them are finished. The replies are
+ * matched to the messages by their @id, falling back to the order they
+ * were sent in.
+ *
+ * Returns 0 if all replies were received, -1 on monitor failure. The
+ * replies themselves may still report errors of the single commands.
+ */
+int
+qemuMonitorSendBatch(qemuMonitorPtr mon,
+                     qemuMonitorMessagePtr *msgs,
+                     size_t nmsgs)
+{
+    return qemuMonitorSendInternal(mon, msgs, nmsgs);
+}
+
+
 /**
  * This function returns a new virError object; the caller is responsible
  * for freeing it.
@@ -1135,6 +1282,31 @@ qemuMonitorSetOptions(qemuMonitorPtr mon, virJSONValuePtr options)
 }
 
 
+/**
+ * qemuMonitorSetQueryNamedBlockNodesFlat:
+ * @mon: monitor object
+ * @flat: QEMU supports the 'flat' argument of query-named-block-nodes
+ *
+ * Each node reported by query-named-block-nodes carries the whole backing
+ * chain below it unless 'flat' is requested, which makes the reply grow
+ * with the square of the length of the chains. None of the callers needs
+ * the nested data, they look the nodes up by their name.
+ */
+void
+qemuMonitorSetQueryNamedBlockNodesFlat(qemuMonitorPtr mon,
+                                       bool flat)
+{
+    mon->queryNamedBlockNodesFlat = flat;
+}
+
+
+bool
+qemuMonitorGetQueryNamedBlockNodesFlat(qemuMonitorPtr mon)
+{
+    return mon->queryNamedBlockNodesFlat;
+}
+
+
 /**
  * Search the qom objects for the balloon driver object by its known names
  * of "virtio-balloon-pci" or "virtio-balloon-ccw". The entry for the driver
@@ -1686,6 +1858,22 @@ qemuMonitorEmitPRManagerStatusChanged(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorEmitJobStatusChange(qemuMonitorPtr mon,
+                               const char *jobname,
+                               int status)
+{
+    int ret = -1;
+    VIR_DEBUG("mon=%p, jobname='%s', status=%s", mon, jobname,
+              NULLSTR(qemuMonitorJobStatusTypeToString(status)));
+
+    QEMU_MONITOR_CALLBACK(mon, ret, domainJobStatusChange,
+                          mon->vm, jobname, status);
+
+    return ret;
+}
+
+
 int
 qemuMonitorSetCapabilities(qemuMonitorPtr mon)
 {
@@ -2322,6 +2510,46 @@ qemuMonitorBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
     return qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(mon, stats);
 }
 
+
+/**
+ * qemuMonitorGetAllBlockStatsCapacity:
+ * @mon: monitor object
+ * @ret_stats: pointer that is filled with a hash table containing the stats
+ * @backingChain: recurse into the backing chain of devices
+ * @blockdev: the VM uses -blockdev, stats are keyed by node name
+ *
+ * Same as qemuMonitorGetAllBlockStatsInfo followed by
+ * qemuMonitorBlockStatsUpdateCapacity (or qemuMonitorBlockStatsUpdateCapacityBlockdev
+ * if @blockdev is true), but does not wait for one reply before sending the
+ * other query. The stats are returned even if fetching the capacity fails.
+ *
+ * Returns < 0 on error, count of supported block stats fields on success.
+ */
+int
+qemuMonitorGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                    virHashTablePtr *ret_stats,
+                                    bool backingChain,
+                                    bool blockdev)
+{
+    int ret;
+    VIR_DEBUG("ret_stats=%p, backing=%d, blockdev=%d",
+              ret_stats, backingChain, blockdev);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    if (!(*ret_stats = virHashCreate(10, virHashValueFree)))
+        return -1;
+
+    if ((ret = qemuMonitorJSONGetAllBlockStatsCapacity(mon, *ret_stats,
+                                                       backingChain,
+                                                       blockdev)) < 0) {
+        virHashFree(*ret_stats);
+        *ret_stats = NULL;
+    }
+
+    return ret;
+}
+
 int
 qemuMonitorBlockResize(qemuMonitorPtr mon,
                        const char *device,
@@ -4346,6 +4574,19 @@ qemuMonitorBlockdevDel(qemuMonitorPtr mon,
     return qemuMonitorJSONBlockdevDel(mon, nodename);
 }
 
+
+int
+qemuMonitorBlockDirtyBitmapRemove(qemuMonitorPtr mon,
+                                  const char *node,
+                                  const char *name)
+{
+    VIR_DEBUG("node=%s name=%s", node, name);
+
+    QEMU_CHECK_MONITOR(mon);
+
+    return qemuMonitorJSONBlockDirtyBitmapRemove(mon, node, name);
+}
+
 int
 qemuMonitorBlockdevTrayOpen(qemuMonitorPtr mon,
                             const char *id,
@@ -91,6 +91,7 @@ static void qemuMonitorJSONHandleAcpiOstInfo(qemuMonitorPtr mon, virJSONValuePtr
 static void qemuMonitorJSONHandleBlockThreshold(qemuMonitorPtr mon, virJSONValuePtr data);
 static void qemuMonitorJSONHandleDumpCompleted(qemuMonitorPtr mon, virJSONValuePtr data);
 static void qemuMonitorJSONHandlePRManagerStatusChanged(qemuMonitorPtr mon, virJSONValuePtr data);
+static void qemuMonitorJSONHandleJobStatusChange(qemuMonitorPtr mon, virJSONValuePtr data);
 
 typedef struct {
     const char *type;
@@ -109,6 +110,7 @@ static qemuEventHandler eventHandlers[] = {
     { "DEVICE_TRAY_MOVED", qemuMonitorJSONHandleTrayChange, },
     { "DUMP_COMPLETED", qemuMonitorJSONHandleDumpCompleted, },
     { "GUEST_PANICKED", qemuMonitorJSONHandleGuestPanic, },
+    { "JOB_STATUS_CHANGE", qemuMonitorJSONHandleJobStatusChange, },
     { "MIGRATION", qemuMonitorJSONHandleMigrationStatus, },
     { "MIGRATION_PASS", qemuMonitorJSONHandleMigrationPass, },
     { "NIC_RX_FILTER_CHANGED", qemuMonitorJSONHandleNicRxFilterChanged, },
@@ -185,6 +187,32 @@ qemuMonitorJSONIOProcessEvent(qemuMonitorPtr mon,
     return 0;
 }
 
+/* Finds the message a reply with @id belongs to among the queued
+ * messages starting at @msg. Only messages which were completely
+ * written and did not get a reply yet are considered. In case no
+ * message matches @id, the oldest of them is used since qemu answers
+ * commands in order. */
+static qemuMonitorMessagePtr
+qemuMonitorJSONFindMessage(qemuMonitorMessagePtr msg,
+                           const char *id)
+{
+    qemuMonitorMessagePtr first = NULL;
+
+    for (; msg && msg->txOffset == msg->txLength; msg = msg->next) {
+        if (msg->finished)
+            continue;
+
+        if (!first)
+            first = msg;
+
+        if (id && STREQ_NULLABLE(msg->id, id))
+            return msg;
+    }
+
+    return first;
+}
+
+
 int
 qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                              const char *line,
@@ -195,7 +223,9 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
     VIR_DEBUG("Line [%s]", line);
 
-    if (!(obj = virJSONValueFromString(line)))
+    /* replies and events are short-lived, keep their trees in one
+     * arena instead of a separate allocation per node */
+    if (!(obj = virJSONValueFromStringArena(line)))
         goto cleanup;
 
     if (virJSONValueGetType(obj) != VIR_JSON_TYPE_OBJECT) {
@@ -214,6 +244,8 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
                virJSONValueObjectHasKey(obj, "return") == 1) {
         PROBE(QEMU_MONITOR_RECV_REPLY,
               "mon=%p reply=%s", mon, line);
+        msg = qemuMonitorJSONFindMessage(msg,
+                                         virJSONValueObjectGetString(obj, "id"));
         if (msg) {
             msg->rxObject = obj;
             msg->finished = 1;
@@ -235,8 +267,7 @@ qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                              const char *data,
-                             size_t len,
-                             qemuMonitorMessagePtr msg)
+                             size_t len)
 {
     int used = 0;
     /*VIR_DEBUG("Data %d bytes [%s]", len, data);*/
@@ -251,7 +282,10 @@ int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                 return -1;
             used += got + strlen(LINE_ENDING);
             line[got] = '\0'; /* kill \n */
-            if (qemuMonitorJSONIOProcessLine(mon, line, msg) < 0) {
+            /* The queue is fetched for every line since the monitor
+             * is unlocked while events are dispatched */
+            if (qemuMonitorJSONIOProcessLine(mon, line,
+                                             qemuMonitorGetMessages(mon)) < 0) {
                 VIR_FREE(line);
                 return -1;
             }
@@ -300,6 +334,7 @@ qemuMonitorJSONCommandWithFd(qemuMonitorPtr mon,
         goto cleanup;
     msg.txLength = strlen(msg.txBuffer);
     msg.txFD = scm_fd;
+    msg.id = id;
 
     VIR_DEBUG("Send command '%s' for write with FD %d", cmdstr, scm_fd);
 
@@ -336,6 +371,90 @@ qemuMonitorJSONCommand(qemuMonitorPtr mon,
     return qemuMonitorJSONCommandWithFd(mon, cmd, -1, reply);
 }
 
+
+/**
+ * qemuMonitorJSONCommandBatch:
+ * @mon: monitor object
+ * @cmds: commands to execute
+ * @ncmds: number of entries in @cmds
+ * @replies: array of @ncmds entries filled with the replies
+ *
+ * Sends all of @cmds to the monitor at once, so that qemu can process
+ * them without waiting for a round trip after each one, and collects
+ * the replies. The replies still need to be checked for errors by the
+ * caller.
+ *
+ * Returns 0 on success, -1 on error in which case @replies is cleared.
+ */
+static int
+qemuMonitorJSONCommandBatch(qemuMonitorPtr mon,
+                            virJSONValuePtr *cmds,
+                            size_t ncmds,
+                            virJSONValuePtr *replies)
+{
+    qemuMonitorMessagePtr msgs = NULL;
+    qemuMonitorMessagePtr *msgptrs = NULL;
+    char *cmdstr = NULL;
+    size_t i;
+    int ret = -1;
+
+    memset(replies, 0, sizeof(*replies) * ncmds);
+
+    if (VIR_ALLOC_N(msgs, ncmds) < 0 ||
+        VIR_ALLOC_N(msgptrs, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        msgs[i].txFD = -1;
+        msgptrs[i] = &msgs[i];
+
+        if (!(msgs[i].id = qemuMonitorNextCommandID(mon)))
+            goto cleanup;
+        if (virJSONValueObjectAppendString(cmds[i], "id", msgs[i].id) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Unable to append command 'id' string"));
+            goto cleanup;
+        }
+
+        if (!(cmdstr = virJSONValueToString(cmds[i], false)))
+            goto cleanup;
+        if (virAsprintf(&msgs[i].txBuffer, "%s\r\n", cmdstr) < 0)
+            goto cleanup;
+        msgs[i].txLength = strlen(msgs[i].txBuffer);
+
+        VIR_DEBUG("Send command '%s' for write in batch of %zu",
+                  cmdstr, ncmds);
+        VIR_FREE(cmdstr);
+    }
+
+    if (qemuMonitorSendBatch(mon, msgptrs, ncmds) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncmds; i++) {
+        if (!msgs[i].rxObject) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Missing monitor reply object"));
+            goto cleanup;
+        }
+    }
+
+    for (i = 0; i < ncmds; i++)
+        VIR_STEAL_PTR(replies[i], msgs[i].rxObject);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; msgs && i < ncmds; i++) {
+        VIR_FREE(msgs[i].id);
+        VIR_FREE(msgs[i].txBuffer);
+        virJSONValueFree(msgs[i].rxObject);
+    }
+    VIR_FREE(msgs);
+    VIR_FREE(msgptrs);
+    VIR_FREE(cmdstr);
+    return ret;
+}
+
 /* Ignoring OOM in this method, since we're already reporting
  * a more important error
  *
@@ -1008,6 +1127,8 @@ qemuMonitorJSONHandleBlockJobImpl(qemuMonitorPtr mon,
         type = VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT;
     else if (STREQ(type_str, "mirror"))
         type = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
+    else if (STREQ(type_str, "backup"))
+        type = VIR_DOMAIN_BLOCK_JOB_TYPE_BACKUP;
 
     switch ((virConnectDomainEventBlockJobStatus) event) {
     case VIR_DOMAIN_BLOCK_JOB_COMPLETED:
@@ -1351,6 +1472,35 @@ static void qemuMonitorJSONHandlePRManagerStatusChanged(qemuMonitorPtr mon,
 }
 
 
+static void
+qemuMonitorJSONHandleJobStatusChange(qemuMonitorPtr mon,
+                                     virJSONValuePtr data)
+{
+    const char *jobname;
+    const char *str;
+    int status;
+
+    if (!(jobname = virJSONValueObjectGetString(data, "id"))) {
+        VIR_WARN("missing job id in JOB_STATUS_CHANGE event");
+        return;
+    }
+
+    if (!(str = virJSONValueObjectGetString(data, "status"))) {
+        VIR_WARN("missing status of job %s in JOB_STATUS_CHANGE event",
+                 jobname);
+        return;
+    }
+
+    if ((status = qemuMonitorJobStatusTypeFromString(str)) <= 0) {
+        VIR_WARN("unknown status '%s' of job %s in JOB_STATUS_CHANGE event",
+                 str, jobname);
+        return;
+    }
+
+    qemuMonitorEmitJobStatusChange(mon, jobname, status);
+}
+
+
 int
 qemuMonitorJSONHumanCommandWithFd(qemuMonitorPtr mon,
                                   const char *cmd_str,
@@ -2317,6 +2467,46 @@ int qemuMonitorJSONGetBlockInfo(qemuMonitorPtr mon,
 }
 
 
+static int
+qemuMonitorJSONBlockStatsCollectCounters(virJSONValuePtr stats,
+                                         qemuBlockStatsPtr bstats,
+                                         int *nstats)
+{
+    /* the first four statistics are mandatory */
+    virJSONField fields[] = {
+        { "rd_bytes", VIR_JSON_FIELD_LONG, &bstats->rd_bytes, false },
+        { "wr_bytes", VIR_JSON_FIELD_LONG, &bstats->wr_bytes, false },
+        { "rd_operations", VIR_JSON_FIELD_LONG, &bstats->rd_req, false },
+        { "wr_operations", VIR_JSON_FIELD_LONG, &bstats->wr_req, false },
+        { "rd_total_time_ns", VIR_JSON_FIELD_LONG,
+          &bstats->rd_total_times, false },
+        { "wr_total_time_ns", VIR_JSON_FIELD_LONG,
+          &bstats->wr_total_times, false },
+        { "flush_operations", VIR_JSON_FIELD_LONG,
+          &bstats->flush_req, false },
+        { "flush_total_time_ns", VIR_JSON_FIELD_LONG,
+          &bstats->flush_total_times, false },
+    };
+    size_t i;
+    int rc;
+
+    if ((rc = virJSONValueObjectGetFields(stats, fields,
+                                          ARRAY_CARDINALITY(fields))) < 0)
+        return -1;
+
+    for (i = 0; i < 4; i++) {
+        if (!fields[i].found) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot read %s statistic"), fields[i].key);
+            return -1;
+        }
+    }
+
+    *nstats += rc;
+    return 0;
+}
+
+
 static qemuBlockStatsPtr
 qemuMonitorJSONBlockStatsCollectData(virJSONValuePtr dev,
                                      int *nstats)
@@ -2337,24 +2527,8 @@ qemuMonitorJSONBlockStatsCollectData(virJSONValuePtr dev,
     if (VIR_ALLOC(bstats) < 0)
         goto cleanup;
 
-#define QEMU_MONITOR_BLOCK_STAT_GET(NAME, VAR, MANDATORY) \
-    if (MANDATORY || virJSONValueObjectHasKey(stats, NAME)) { \
-        (*nstats)++; \
-        if (virJSONValueObjectGetNumberLong(stats, NAME, &VAR) < 0) { \
-            virReportError(VIR_ERR_INTERNAL_ERROR, \
-                           _("cannot read %s statistic"), NAME); \
-            goto cleanup; \
-        } \
-    }
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_bytes", bstats->rd_bytes, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_bytes", bstats->wr_bytes, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_operations", bstats->rd_req, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_operations", bstats->wr_req, true);
-    QEMU_MONITOR_BLOCK_STAT_GET("rd_total_time_ns", bstats->rd_total_times, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("wr_total_time_ns", bstats->wr_total_times, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("flush_operations", bstats->flush_req, false);
-    QEMU_MONITOR_BLOCK_STAT_GET("flush_total_time_ns", bstats->flush_total_times, false);
-#undef QEMU_MONITOR_BLOCK_STAT_GET
+    if (qemuMonitorJSONBlockStatsCollectCounters(stats, bstats, nstats) < 0)
+        goto cleanup;
 
     if ((parent = virJSONValueObjectGetObject(dev, "parent")) &&
         (parentstats = virJSONValueObjectGetObject(parent, "stats"))) {
@@ -2450,6 +2624,19 @@ qemuMonitorJSONGetOneBlockStatsInfo(virJSONValuePtr dev,
 }
 
 
+/* see qemuMonitorSetQueryNamedBlockNodesFlat */
+static virJSONValuePtr
+qemuMonitorJSONMakeQueryNamedBlockNodes(qemuMonitorPtr mon)
+{
+    if (qemuMonitorGetQueryNamedBlockNodesFlat(mon))
+        return qemuMonitorJSONMakeCommand("query-named-block-nodes",
+                                          "b:flat", true,
+                                          NULL);
+
+    return qemuMonitorJSONMakeCommand("query-named-block-nodes", NULL);
+}
+
+
 virJSONValuePtr
 qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 {
@@ -2475,19 +2662,14 @@ qemuMonitorJSONQueryBlockstats(qemuMonitorPtr mon)
 }
 
 
-int
-qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
-                                    virHashTablePtr hash,
-                                    bool backingChain)
+static int
+qemuMonitorJSONGetAllBlockStatsInfoParse(virJSONValuePtr devices,
+                                         virHashTablePtr hash,
+                                         bool backingChain)
 {
-    int ret = -1;
     int nstats = 0;
     int rc;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev = virJSONValueArrayGet(devices, i);
@@ -2497,14 +2679,14 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not "
                              "in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         if (!(dev_name = virJSONValueObjectGetString(dev, "device"))) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                            _("blockstats device entry was not "
                              "in expected format"));
-            goto cleanup;
+            return -1;
         }
 
         if (*dev_name == '\0')
@@ -2514,15 +2696,29 @@ qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
                                                  backingChain);
 
         if (rc < 0)
-            goto cleanup;
+            return -1;
 
         if (rc > nstats)
             nstats = rc;
     }
 
-    ret = nstats;
+    return nstats;
+}
+
+
+int
+qemuMonitorJSONGetAllBlockStatsInfo(qemuMonitorPtr mon,
+                                    virHashTablePtr hash,
+                                    bool backingChain)
+{
+    int ret;
+    virJSONValuePtr devices;
+
+    if (!(devices = qemuMonitorJSONQueryBlockstats(mon)))
+        return -1;
+
+    ret = qemuMonitorJSONGetAllBlockStatsInfoParse(devices, hash, backingChain);
 
- cleanup:
     virJSONValueFree(devices);
     return ret;
 }
@@ -2594,17 +2790,12 @@ qemuMonitorJSONBlockStatsUpdateCapacityOne(virJSONValuePtr image,
 }
 
 
-int
-qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
-                                        virHashTablePtr stats,
-                                        bool backingChain)
+static int
+qemuMonitorJSONBlockStatsUpdateCapacityParse(virJSONValuePtr devices,
+                                             virHashTablePtr stats,
+                                             bool backingChain)
 {
-    int ret = -1;
     size_t i;
-    virJSONValuePtr devices;
-
-    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
-        return -1;
 
     for (i = 0; i < virJSONValueArraySize(devices); i++) {
         virJSONValuePtr dev;
@@ -2613,10 +2804,10 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         const char *dev_name;
 
         if (!(dev = qemuMonitorJSONGetBlockDev(devices, i)))
-            goto cleanup;
+            return -1;
 
         if (!(dev_name = qemuMonitorJSONGetBlockDevDevice(dev)))
-            goto cleanup;
+            return -1;
 
         /* drive may be empty */
         if (!(inserted = virJSONValueObjectGetObject(dev, "inserted")) ||
@@ -2626,12 +2817,27 @@ qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
         if (qemuMonitorJSONBlockStatsUpdateCapacityOne(image, dev_name, 0,
                                                        stats,
                                                        backingChain) < 0)
-            goto cleanup;
+            return -1;
     }
 
-    ret = 0;
+    return 0;
+}
+
+
+int
+qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr stats,
+                                        bool backingChain)
+{
+    int ret;
+    virJSONValuePtr devices;
+
+    if (!(devices = qemuMonitorJSONQueryBlock(mon)))
+        return -1;
+
+    ret = qemuMonitorJSONBlockStatsUpdateCapacityParse(devices, stats,
+                                                       backingChain);
 
- cleanup:
     virJSONValueFree(devices);
     return ret;
 }
@@ -2688,6 +2894,84 @@ qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
 }
 
 
+/**
+ * qemuMonitorJSONGetAllBlockStatsCapacity:
+ * @mon: monitor object
+ * @hash: hash table to fill with the stats
+ * @backingChain: recurse into the backing chain of devices
+ * @blockdev: fetch capacity data per node via 'query-named-block-nodes'
+ *
+ * Does the job of qemuMonitorJSONGetAllBlockStatsInfo followed by
+ * qemuMonitorJSONBlockStatsUpdateCapacity (or its blockdev variant),
+ * sending both queries to the monitor as one batch. Failure to fetch
+ * the capacity is not fatal, the I/O stats are returned regardless.
+ *
+ * Returns < 0 on error, count of supported block stats fields on success.
+ */
+int
+qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                        virHashTablePtr hash,
+                                        bool backingChain,
+                                        bool blockdev)
+{
+    virJSONValuePtr cmds[2] = { NULL, NULL };
+    virJSONValuePtr replies[2] = { NULL, NULL };
+    virJSONValuePtr data;
+    size_t i;
+    int nstats;
+    int capacityrc = 0;
+    int ret = -1;
+
+    if (!(cmds[0] = qemuMonitorJSONMakeCommand("query-blockstats", NULL)) ||
+        !(cmds[1] = blockdev ? qemuMonitorJSONMakeQueryNamedBlockNodes(mon) :
+                               qemuMonitorJSONMakeCommand("query-block", NULL)))
+        goto cleanup;
+
+    if (qemuMonitorJSONCommandBatch(mon, cmds, ARRAY_CARDINALITY(cmds),
+                                    replies) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckReply(cmds[0], replies[0],
+                                  VIR_JSON_TYPE_ARRAY) < 0)
+        goto cleanup;
+
+    data = virJSONValueObjectGetArray(replies[0], "return");
+    if ((nstats = qemuMonitorJSONGetAllBlockStatsInfoParse(data, hash,
+                                                           backingChain)) < 0)
+        goto cleanup;
+
+    /* the I/O stats are still useful without the capacity */
+    if (qemuMonitorJSONCheckReply(cmds[1], replies[1],
+                                  VIR_JSON_TYPE_ARRAY) < 0) {
+        capacityrc = -1;
+    } else {
+        data = virJSONValueObjectGetArray(replies[1], "return");
+        if (blockdev)
+            capacityrc = virJSONValueArrayForeachSteal(data,
+                                                       qemuMonitorJSONBlockStatsUpdateCapacityBlockdevWorker,
+                                                       hash);
+        else
+            capacityrc = qemuMonitorJSONBlockStatsUpdateCapacityParse(data, hash,
+                                                                      backingChain);
+    }
+
+    if (capacityrc < 0) {
+        VIR_DEBUG("failed to update block stats capacity: %s",
+                  virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    ret = nstats;
+
+ cleanup:
+    for (i = 0; i < ARRAY_CARDINALITY(cmds); i++) {
+        virJSONValueFree(cmds[i]);
+        virJSONValueFree(replies[i]);
+    }
+    return ret;
+}
+
+
 int qemuMonitorJSONBlockResize(qemuMonitorPtr mon,
                                const char *device,
                                const char *nodename,
@@ -4699,6 +4983,8 @@ qemuMonitorJSONParseBlockJobInfo(virHashTablePtr blockJobs,
         info->type = VIR_DOMAIN_BLOCK_JOB_TYPE_COMMIT;
     else if (STREQ(type, "mirror"))
         info->type = VIR_DOMAIN_BLOCK_JOB_TYPE_COPY;
+    else if (STREQ(type, "backup"))
+        info->type = VIR_DOMAIN_BLOCK_JOB_TYPE_BACKUP;
     else
         info->type = VIR_DOMAIN_BLOCK_JOB_TYPE_UNKNOWN;
 
@@ -8060,7 +8346,7 @@ qemuMonitorJSONQueryNamedBlockNodes(qemuMonitorPtr mon)
     virJSONValuePtr reply = NULL;
     virJSONValuePtr ret = NULL;
 
-    if (!(cmd = qemuMonitorJSONMakeCommand("query-named-block-nodes", NULL)))
+    if (!(cmd = qemuMonitorJSONMakeQueryNamedBlockNodes(mon)))
         return NULL;
 
     if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
@@ -8161,6 +8447,36 @@ qemuMonitorJSONBlockdevDel(qemuMonitorPtr mon,
 }
 
 
+int
+qemuMonitorJSONBlockDirtyBitmapRemove(qemuMonitorPtr mon,
+                                      const char *node,
+                                      const char *name)
+{
+    virJSONValuePtr cmd;
+    virJSONValuePtr reply = NULL;
+    int ret = -1;
+
+    if (!(cmd = qemuMonitorJSONMakeCommand("block-dirty-bitmap-remove",
+                                           "s:node", node,
+                                           "s:name", name,
+                                           NULL)))
+        return -1;
+
+    if (qemuMonitorJSONCommand(mon, cmd, &reply) < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONCheckError(cmd, reply) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(cmd);
+    virJSONValueFree(reply);
+    return ret;
+}
+
+
 int
 qemuMonitorJSONBlockdevTrayOpen(qemuMonitorPtr mon,
                                 const char *id,
@@ -42,8 +42,7 @@ int qemuMonitorJSONIOProcessLine(qemuMonitorPtr mon,
 
 int qemuMonitorJSONIOProcess(qemuMonitorPtr mon,
                              const char *data,
-                             size_t len,
-                             qemuMonitorMessagePtr msg);
+                             size_t len);
 
 int qemuMonitorJSONHumanCommandWithFd(qemuMonitorPtr mon,
                                       const char *cmd,
@@ -95,6 +94,10 @@ int qemuMonitorJSONBlockStatsUpdateCapacity(qemuMonitorPtr mon,
                                             bool backingChain);
 int qemuMonitorJSONBlockStatsUpdateCapacityBlockdev(qemuMonitorPtr mon,
                                                     virHashTablePtr stats);
+int qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorPtr mon,
+                                            virHashTablePtr hash,
+                                            bool backingChain,
+                                            bool blockdev);
 
 int qemuMonitorJSONBlockResize(qemuMonitorPtr mon,
                                const char *device,
@@ -555,6 +558,11 @@ int qemuMonitorJSONBlockdevDel(qemuMonitorPtr mon,
                                const char *nodename)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
+int qemuMonitorJSONBlockDirtyBitmapRemove(qemuMonitorPtr mon,
+                                          const char *node,
+                                          const char *name)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3);
+
 int qemuMonitorJSONBlockdevTrayOpen(qemuMonitorPtr mon,
                                     const char *id,
                                     bool force)
@@ -0,0 +1,705 @@
+/*
+ * qemu_numa.c: QEMU NUMA rebalancing of running domains
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "qemu_numa.h"
+#include "qemu_cgroup.h"
+#include "qemu_domain.h"
+
+#include "c-ctype.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virhash.h"
+#include "virlog.h"
+#include "virnuma.h"
+#include "virprocess.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "viruuid.h"
+
+#define VIR_FROM_THIS VIR_FROM_QEMU
+
+VIR_LOG_INIT("qemu.qemu_numa");
+
+/*
+ * Domains whose vCPU and memory placement was chosen by numad at startup
+ * (placement='auto') are periodically checked against the current load of
+ * the host NUMA nodes.  If the busiest node is loaded more than
+ * numa_rebalance_threshold percent above the idlest one, one domain from
+ * the busiest node is moved, by re-pinning its threads and optionally
+ * migrating its memory through cpuset.mems.  At most one domain is moved
+ * per interval and a moved domain stays put for a number of intervals so
+ * that domains don't bounce between nodes.
+ */
+
+/* Number of intervals a moved domain is left alone */
+#define QEMU_NUMA_BALANCE_COOLDOWN 10
+
+typedef struct _qemuNumaCPUTime qemuNumaCPUTime;
+typedef qemuNumaCPUTime *qemuNumaCPUTimePtr;
+struct _qemuNumaCPUTime {
+    unsigned long long busy;
+    unsigned long long total;
+};
+
+typedef struct _qemuNumaNode qemuNumaNode;
+typedef qemuNumaNode *qemuNumaNodePtr;
+struct _qemuNumaNode {
+    int num;
+    int ncpus;
+    double load; /* share of CPU time spent busy since the last interval */
+    unsigned long long memsize; /* in bytes */
+    unsigned long long memfree; /* in bytes */
+};
+
+/* What is remembered about a domain between two intervals */
+typedef struct _qemuNumaDomain qemuNumaDomain;
+typedef qemuNumaDomain *qemuNumaDomainPtr;
+struct _qemuNumaDomain {
+    pid_t pid;
+    unsigned long long cpuTime; /* in nanoseconds */
+    unsigned int cooldown;
+};
+
+typedef struct _qemuNumaCandidate qemuNumaCandidate;
+typedef qemuNumaCandidate *qemuNumaCandidatePtr;
+struct _qemuNumaCandidate {
+    virDomainObjPtr vm;
+    qemuNumaDomainPtr state;
+    pid_t pid;
+    int node;
+    unsigned long long cpuDelta; /* in nanoseconds */
+    unsigned long long memory; /* in bytes */
+};
+
+struct _qemuNumaBalancer {
+    virMutex lock;
+    virCond cond;
+    virThread thread;
+    bool quit;
+
+    virQEMUDriverPtr driver;
+
+    /* Only accessed by the balancer thread */
+    unsigned long long lastTick;
+    qemuNumaCPUTimePtr times;
+    size_t ntimes;
+    virHashTablePtr domains; /* uuid -> qemuNumaDomain */
+};
+
+
+/* Read the busy and total time of each host CPU from /proc/stat */
+static int
+qemuNumaReadCPUTimes(qemuNumaCPUTimePtr *times,
+                     size_t *ntimes)
+{
+    char *buf = NULL;
+    char *line;
+    char *next;
+    qemuNumaCPUTimePtr list = NULL;
+    size_t nlist = 0;
+    int ret = -1;
+
+    if (virFileReadAll("/proc/stat", 1024 * 1024, &buf) < 0)
+        goto cleanup;
+
+    for (line = buf; line && *line; line = next) {
+        unsigned long long vals[8] = { 0 };
+        unsigned int cpu;
+        char *tmp;
+        size_t i;
+
+        if ((next = strchr(line, '\n')))
+            *next++ = '\0';
+
+        if (!STRPREFIX(line, "cpu") || !c_isdigit(line[3]))
+            continue;
+
+        if (virStrToLong_ui(line + 3, &tmp, 10, &cpu) < 0)
+            continue;
+
+        /* user nice system idle iowait irq softirq steal */
+        for (i = 0; i < ARRAY_CARDINALITY(vals); i++) {
+            if (virStrToLong_ull(tmp, &tmp, 10, &vals[i]) < 0)
+                break;
+        }
+        if (i < 5)
+            continue;
+
+        if (cpu >= nlist &&
+            VIR_EXPAND_N(list, nlist, cpu + 1 - nlist) < 0)
+            goto cleanup;
+
+        for (i = 0; i < ARRAY_CARDINALITY(vals); i++)
+            list[cpu].total += vals[i];
+        list[cpu].busy = list[cpu].total - vals[3] - vals[4];
+    }
+
+    VIR_STEAL_PTR(*times, list);
+    *ntimes = nlist;
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(list);
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/* Fill @nodes with the host NUMA nodes which have both CPUs and memory */
+static int
+qemuNumaGetNodes(qemuNumaBalancerPtr balancer,
+                 virCapsPtr caps,
+                 qemuNumaCPUTimePtr times,
+                 size_t ntimes,
+                 qemuNumaNodePtr *nodes,
+                 size_t *nnodes)
+{
+    qemuNumaNodePtr list = NULL;
+    size_t nlist = 0;
+    size_t i;
+    size_t j;
+
+    if (VIR_ALLOC_N(list, caps->host.nnumaCell) < 0)
+        return -1;
+
+    for (i = 0; i < caps->host.nnumaCell; i++) {
+        virCapsHostNUMACellPtr cell = caps->host.numaCell[i];
+        qemuNumaNodePtr node = list + nlist;
+        unsigned long long busy = 0;
+        unsigned long long total = 0;
+
+        if (cell->ncpus == 0 || cell->mem == 0)
+            continue;
+
+        if (virNumaGetNodeMemory(cell->num, &node->memsize,
+                                 &node->memfree) < 0) {
+            virResetLastError();
+            continue;
+        }
+
+        for (j = 0; j < cell->ncpus; j++) {
+            unsigned int id = cell->cpus[j].id;
+
+            if (id >= ntimes || id >= balancer->ntimes)
+                continue;
+
+            busy += times[id].busy - balancer->times[id].busy;
+            total += times[id].total - balancer->times[id].total;
+        }
+
+        node->num = cell->num;
+        node->ncpus = cell->ncpus;
+        node->load = total ? (double) busy / total : 0;
+        nlist++;
+    }
+
+    *nodes = list;
+    *nnodes = nlist;
+    return 0;
+}
+
+
+static bool
+qemuNumaDomainIsMovable(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainNumatuneMemMode mode;
+
+    if (!virDomainObjIsActive(vm) ||
+        !priv->cgroup ||
+        !priv->autoNodeset ||
+        !priv->autoCpuset ||
+        !virCgroupHasController(priv->cgroup, VIR_CGROUP_CONTROLLER_CPUSET) ||
+        !qemuDomainHasVcpuPids(vm))
+        return false;
+
+    /* Only placements chosen by libvirt itself are changed, and only if
+     * the memory is bound through cpuset.mems: qemu binds the memory of
+     * guest NUMA nodes and memory devices to host nodes on its own */
+    if (vm->def->placement_mode != VIR_DOMAIN_CPU_PLACEMENT_MODE_AUTO ||
+        !virDomainNumatuneHasPlacementAuto(vm->def->numa) ||
+        virDomainNumatuneGetMode(vm->def->numa, -1, &mode) < 0 ||
+        mode != VIR_DOMAIN_NUMATUNE_MEM_STRICT ||
+        virDomainNumaGetNodeCount(vm->def->numa) > 0 ||
+        vm->def->nmems > 0)
+        return false;
+
+    return virBitmapCountBits(priv->autoNodeset) == 1;
+}
+
+
+static int
+qemuNumaSetThreadPlacement(virDomainObjPtr vm,
+                           virCgroupThreadName nameval,
+                           int id,
+                           pid_t pid,
+                           virBitmapPtr cpuset,
+                           const char *mems)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virCgroupPtr cgroup = NULL;
+    int ret = -1;
+
+    if (virCgroupNewThread(priv->cgroup, nameval, id, false, &cgroup) < 0)
+        goto cleanup;
+
+    if (cpuset && qemuSetupCgroupCpusetCpus(cgroup, cpuset) < 0)
+        goto cleanup;
+
+    if (mems && virCgroupSetCpusetMems(cgroup, mems) < 0)
+        goto cleanup;
+
+    if (cpuset && pid > 0 && virProcessSetAffinity(pid, cpuset) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
+/* Apply @cpuset to all threads of @vm which aren't pinned explicitly and
+ * @nodeset as their memory nodes, if @memory is true */
+static int
+qemuNumaSetPlacement(virDomainObjPtr vm,
+                     virBitmapPtr cpuset,
+                     virBitmapPtr nodeset,
+                     bool memory)
+{
+    virDomainDefPtr def = vm->def;
+    char *mems = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (memory && !(mems = virBitmapFormat(nodeset)))
+        goto cleanup;
+
+    if (qemuNumaSetThreadPlacement(vm, VIR_CGROUP_THREAD_EMULATOR, 0, vm->pid,
+                                   def->cputune.emulatorpin ? NULL : cpuset,
+                                   mems) < 0)
+        goto cleanup;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(def, i);
+
+        if (!vcpu->online)
+            continue;
+
+        if (qemuNumaSetThreadPlacement(vm, VIR_CGROUP_THREAD_VCPU, i,
+                                       qemuDomainGetVcpuPid(vm, i),
+                                       vcpu->cpumask ? NULL : cpuset,
+                                       mems) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < def->niothreadids; i++) {
+        virDomainIOThreadIDDefPtr iothread = def->iothreadids[i];
+
+        if (qemuNumaSetThreadPlacement(vm, VIR_CGROUP_THREAD_IOTHREAD,
+                                       iothread->iothread_id,
+                                       iothread->thread_id,
+                                       iothread->cpumask ? NULL : cpuset,
+                                       mems) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(mems);
+    return ret;
+}
+
+
+/* Move @vm, unless it changed meanwhile, to host NUMA node @node */
+static int
+qemuNumaMoveDomain(virQEMUDriverPtr driver,
+                   virQEMUDriverConfigPtr cfg,
+                   virCapsPtr caps,
+                   virDomainObjPtr vm,
+                   pid_t pid,
+                   int node)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr nodeset = NULL;
+    virBitmapPtr cpuset = NULL;
+    int ret = -1;
+
+    virObjectLock(vm);
+
+    /* Don't get in the way of whatever the domain is busy with */
+    if (qemuDomainObjBeginJobNowait(driver, vm, QEMU_JOB_MODIFY) < 0)
+        goto cleanup;
+
+    if (vm->pid != pid || !qemuNumaDomainIsMovable(vm))
+        goto endjob;
+
+    if (!(nodeset = virBitmapNewCopy(priv->autoNodeset)))
+        goto endjob;
+
+    virBitmapClearAll(nodeset);
+    if (virBitmapSetBit(nodeset, node) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("host NUMA node %d out of range"), node);
+        goto endjob;
+    }
+
+    if (!(cpuset = virCapabilitiesGetCpusForNodemask(caps, nodeset)))
+        goto endjob;
+
+    VIR_DEBUG("Moving domain %s to host NUMA node %d", vm->def->name, node);
+
+    if (qemuNumaSetPlacement(vm, cpuset, nodeset,
+                             cfg->numaRebalanceMemory) < 0) {
+        virErrorPtr orig_err = virSaveLastError();
+
+        /* Don't leave the domain spread over both nodes */
+        ignore_value(qemuNumaSetPlacement(vm, priv->autoCpuset,
+                                          priv->autoNodeset,
+                                          cfg->numaRebalanceMemory));
+        virSetError(orig_err);
+        virFreeError(orig_err);
+        goto endjob;
+    }
+
+    virBitmapFree(priv->autoNodeset);
+    VIR_STEAL_PTR(priv->autoNodeset, nodeset);
+    virBitmapFree(priv->autoCpuset);
+    VIR_STEAL_PTR(priv->autoCpuset, cpuset);
+
+    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        VIR_WARN("Unable to save status of domain %s", vm->def->name);
+
+    VIR_INFO("Moved domain %s to host NUMA node %d", vm->def->name, node);
+    ret = 0;
+
+ endjob:
+    qemuDomainObjEndJob(driver, vm);
+
+ cleanup:
+    virObjectUnlock(vm);
+    virBitmapFree(nodeset);
+    virBitmapFree(cpuset);
+    return ret;
+}
+
+
+/* Remember the CPU time of @vm in @domains and fill @cand if it can be
+ * moved in this interval */
+static bool
+qemuNumaSampleDomain(qemuNumaBalancerPtr balancer,
+                     virDomainObjPtr vm,
+                     virHashTablePtr domains,
+                     qemuNumaCandidatePtr cand)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    qemuNumaDomainPtr prev;
+    qemuNumaDomainPtr state = NULL;
+    virCgroupStats stats;
+
+    if (!qemuNumaDomainIsMovable(vm))
+        return false;
+
+    if (virCgroupGetStatsSnapshot(priv->cgroup,
+                                  1 << VIR_CGROUP_CONTROLLER_CPUACCT,
+                                  &stats) < 0 ||
+        !(stats.controllers & (1 << VIR_CGROUP_CONTROLLER_CPUACCT))) {
+        virResetLastError();
+        return false;
+    }
+
+    virUUIDFormat(vm->def->uuid, uuidstr);
+    prev = virHashLookup(balancer->domains, uuidstr);
+
+    if (VIR_ALLOC(state) < 0 ||
+        virHashAddEntry(domains, uuidstr, state) < 0) {
+        VIR_FREE(state);
+        virResetLastError();
+        return false;
+    }
+
+    state->pid = vm->pid;
+    state->cpuTime = stats.cpuUsage;
+
+    /* The first sample of a qemu process is only a baseline */
+    if (!prev || prev->pid != vm->pid || prev->cpuTime > stats.cpuUsage)
+        return false;
+
+    if (prev->cooldown) {
+        state->cooldown = prev->cooldown - 1;
+        return false;
+    }
+
+    cand->vm = vm;
+    cand->state = state;
+    cand->pid = vm->pid;
+    cand->node = virBitmapNextSetBit(priv->autoNodeset, -1);
+    cand->cpuDelta = stats.cpuUsage - prev->cpuTime;
+    cand->memory = virDomainDefGetMemoryTotal(vm->def) * 1024;
+    return true;
+}
+
+
+static void
+qemuNumaBalancerTick(qemuNumaBalancerPtr balancer)
+{
+    virQEMUDriverPtr driver = balancer->driver;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    virCapsPtr caps = NULL;
+    qemuNumaCPUTimePtr times = NULL;
+    size_t ntimes = 0;
+    qemuNumaNodePtr nodes = NULL;
+    size_t nnodes = 0;
+    qemuNumaNodePtr src = NULL;
+    qemuNumaNodePtr dst = NULL;
+    virDomainObjPtr *vms = NULL;
+    size_t nvms = 0;
+    qemuNumaCandidatePtr cands = NULL;
+    size_t ncands = 0;
+    qemuNumaCandidatePtr best = NULL;
+    double bestImbalance = 0;
+    virHashTablePtr domains = NULL;
+    unsigned long long now;
+    unsigned long long elapsed;
+    size_t i;
+
+    if (!(caps = virQEMUDriverGetCapabilities(driver, false)) ||
+        caps->host.nnumaCell < 2)
+        goto cleanup;
+
+    if (virTimeMillisNow(&now) < 0 ||
+        qemuNumaReadCPUTimes(&times, &ntimes) < 0 ||
+        qemuNumaGetNodes(balancer, caps, times, ntimes, &nodes, &nnodes) < 0)
+        goto cleanup;
+
+    elapsed = balancer->lastTick ? now - balancer->lastTick : 0;
+    balancer->lastTick = now;
+    VIR_FREE(balancer->times);
+    VIR_STEAL_PTR(balancer->times, times);
+    balancer->ntimes = ntimes;
+
+    if (!(domains = virHashCreate(16, virHashValueFree)))
+        goto cleanup;
+
+    if (virDomainObjListCollect(driver->domains, NULL, &vms, &nvms, NULL,
+                                VIR_CONNECT_LIST_DOMAINS_ACTIVE) < 0 ||
+        VIR_ALLOC_N(cands, nvms) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvms; i++) {
+        virObjectLock(vms[i]);
+        if (qemuNumaSampleDomain(balancer, vms[i], domains, cands + ncands))
+            ncands++;
+        virObjectUnlock(vms[i]);
+    }
+
+    /* Domains which went away are dropped along with the old table */
+    virHashFree(balancer->domains);
+    VIR_STEAL_PTR(balancer->domains, domains);
+
+    if (!elapsed || !ncands || nnodes < 2)
+        goto cleanup;
+
+    for (i = 0; i < nnodes; i++) {
+        if (!src || nodes[i].load > src->load)
+            src = nodes + i;
+        if (!dst || nodes[i].load < dst->load)
+            dst = nodes + i;
+    }
+
+    VIR_DEBUG("Busiest host NUMA node %d load %.2f, idlest %d load %.2f",
+              src->num, src->load, dst->num, dst->load);
+
+    if ((src->load - dst->load) * 100 < cfg->numaRebalanceThreshold)
+        goto cleanup;
+
+    /* Pick the domain which leaves the two nodes closest to each other */
+    for (i = 0; i < ncands; i++) {
+        qemuNumaCandidatePtr cand = cands + i;
+        double capacity = (double) elapsed * 1000 * 1000;
+        double srcLoad;
+        double dstLoad;
+        double imbalance;
+
+        if (cand->node != src->num)
+            continue;
+
+        if (cfg->numaRebalanceMemory &&
+            dst->memfree < cand->memory + dst->memsize / 20)
+            continue;
+
+        srcLoad = src->load - cand->cpuDelta / (capacity * src->ncpus);
+        dstLoad = dst->load + cand->cpuDelta / (capacity * dst->ncpus);
+
+        /* Moving the domain must not just move the hot spot */
+        if (dstLoad >= src->load)
+            continue;
+
+        imbalance = srcLoad > dstLoad ? srcLoad - dstLoad : dstLoad - srcLoad;
+        if (!best || imbalance < bestImbalance) {
+            best = cand;
+            bestImbalance = imbalance;
+        }
+    }
+
+    if (!best)
+        goto cleanup;
+
+    if (qemuNumaMoveDomain(driver, cfg, caps, best->vm, best->pid,
+                           dst->num) < 0) {
+        VIR_WARN("Unable to move domain %s to host NUMA node %d: %s",
+                 best->vm->def->name, dst->num, virGetLastErrorMessage());
+        virResetLastError();
+        goto cleanup;
+    }
+
+    best->state->cooldown = QEMU_NUMA_BALANCE_COOLDOWN;
+
+ cleanup:
+    virObjectListFreeCount(vms, nvms);
+    virHashFree(domains);
+    VIR_FREE(cands);
+    VIR_FREE(nodes);
+    VIR_FREE(times);
+    virObjectUnref(caps);
+    virObjectUnref(cfg);
+}
+
+
+static void
+qemuNumaBalancerThread(void *opaque)
+{
+    qemuNumaBalancerPtr balancer = opaque;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(balancer->driver);
+    unsigned long long interval = cfg->numaRebalanceInterval * 1000ULL;
+    unsigned long long now = 0;
+    unsigned long long next = 0;
+
+    virObjectUnref(cfg);
+
+    virMutexLock(&balancer->lock);
+
+    while (!balancer->quit) {
+        if (virTimeMillisNow(&now) < 0) {
+            VIR_WARN("Unable to get current time: %s",
+                     virGetLastErrorMessage());
+            break;
+        }
+
+        if (now < next) {
+            if (virCondWaitUntil(&balancer->cond, &balancer->lock, next) < 0 &&
+                errno != ETIMEDOUT) {
+                VIR_WARN("Unable to wait on NUMA rebalancing condition");
+                break;
+            }
+            continue;
+        }
+
+        virMutexUnlock(&balancer->lock);
+        qemuNumaBalancerTick(balancer);
+        virMutexLock(&balancer->lock);
+
+        next = now + interval;
+    }
+
+    virMutexUnlock(&balancer->lock);
+}
+
+
+/**
+ * qemuNumaBalancerNew:
+ * @driver: qemu driver
+ *
+ * Start the thread which moves domains with automatic NUMA placement
+ * between host NUMA nodes, every numa_rebalance_interval seconds.
+ *
+ * Returns the balancer to be freed by qemuNumaBalancerFree, or NULL on
+ * error.
+ */
+qemuNumaBalancerPtr
+qemuNumaBalancerNew(virQEMUDriverPtr driver)
+{
+    qemuNumaBalancerPtr balancer;
+
+    if (VIR_ALLOC(balancer) < 0)
+        return NULL;
+
+    balancer->driver = driver;
+
+    if (virMutexInit(&balancer->lock) < 0) {
+        virReportSystemError(errno, "%s", _("cannot initialize mutex"));
+        VIR_FREE(balancer);
+        return NULL;
+    }
+
+    if (virCondInit(&balancer->cond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("cannot initialize condition variable"));
+        virMutexDestroy(&balancer->lock);
+        VIR_FREE(balancer);
+        return NULL;
+    }
+
+    if (!(balancer->domains = virHashCreate(16, virHashValueFree)))
+        goto error;
+
+    if (virThreadCreate(&balancer->thread, true,
+                        qemuNumaBalancerThread, balancer) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create NUMA rebalancing thread"));
+        goto error;
+    }
+
+    return balancer;
+
+ error:
+    virHashFree(balancer->domains);
+    virCondDestroy(&balancer->cond);
+    virMutexDestroy(&balancer->lock);
+    VIR_FREE(balancer);
+    return NULL;
+}
+
+
+void
+qemuNumaBalancerFree(qemuNumaBalancerPtr balancer)
+{
+    if (!balancer)
+        return;
+
+    virMutexLock(&balancer->lock);
+    balancer->quit = true;
+    virCondSignal(&balancer->cond);
+    virMutexUnlock(&balancer->lock);
+
+    virThreadJoin(&balancer->thread);
+
+    virHashFree(balancer->domains);
+    VIR_FREE(balancer->times);
+    virCondDestroy(&balancer->cond);
+    virMutexDestroy(&balancer->lock);
+    VIR_FREE(balancer);
+}
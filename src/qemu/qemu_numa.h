@@ -0,0 +1,31 @@
+/*
+ * qemu_numa.h: QEMU NUMA rebalancing of running domains
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __QEMU_NUMA_H__
+# define __QEMU_NUMA_H__
+
+# include "qemu_conf.h"
+
+qemuNumaBalancerPtr qemuNumaBalancerNew(virQEMUDriverPtr driver)
+    ATTRIBUTE_NONNULL(1);
+
+void qemuNumaBalancerFree(qemuNumaBalancerPtr balancer);
+
+#endif /* __QEMU_NUMA_H__ */
@@ -38,6 +38,7 @@
 #include "qemu_processpriv.h"
 #include "qemu_alias.h"
 #include "qemu_block.h"
+#include "qemu_blockjob.h"
 #include "qemu_domain.h"
 #include "qemu_domain_address.h"
 #include "qemu_cgroup.h"
@@ -72,6 +73,7 @@
 #include "virnetdevmidonet.h"
 #include "virbitmap.h"
 #include "viratomic.h"
+#include "virthreadpool.h"
 #include "virnuma.h"
 #include "virstring.h"
 #include "virhostdev.h"
@@ -106,6 +108,9 @@ qemuProcessRemoveDomainStatus(virQEMUDriverPtr driver,
     if (virAsprintf(&file, "%s/%s.xml", cfg->stateDir, vm->def->name) < 0)
         goto cleanup;
 
+    virDomainSaveStatusDiscard(cfg->stateDir, vm);
+    qemuDomainStatusJournalRemove(driver, vm);
+
     if (unlink(file) < 0 && errno != ENOENT && errno != ENOTDIR)
         VIR_WARN("Failed to remove domain XML for %s: %s",
                  vm->def->name, virStrerror(errno, ebuf, sizeof(ebuf)));
@@ -410,7 +415,8 @@ qemuProcessHandleReset(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     if (priv->agent)
         qemuAgentNotifyEvent(priv->agent, QEMU_AGENT_EVENT_RESET);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                    vm, driver->caps) < 0)
         VIR_WARN("Failed to save status on vm %s", vm->def->name);
 
     if (vm->def->onReboot == VIR_DOMAIN_LIFECYCLE_ACTION_DESTROY ||
@@ -615,7 +621,8 @@ qemuProcessHandleShutdown(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                               VIR_DOMAIN_EVENT_SHUTDOWN,
                                               detail);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+    if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                    vm, driver->caps) < 0) {
         VIR_WARN("Unable to save status on vm %s after state change",
                  vm->def->name);
     }
@@ -684,7 +691,8 @@ qemuProcessHandleStop(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -736,7 +744,8 @@ qemuProcessHandleResume(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                                   VIR_DOMAIN_EVENT_RESUMED,
                                                   eventDetail);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after state change",
                      vm->def->name);
         }
@@ -780,7 +789,8 @@ qemuProcessHandleRTCChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         offset += vm->def->clock.data.variable.adjustment0;
         vm->def->clock.data.variable.adjustment = offset;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0)
            VIR_WARN("unable to save domain status with RTC change");
     }
 
@@ -823,7 +833,8 @@ qemuProcessHandleWatchdog(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after watchdog event",
                      vm->def->name);
         }
@@ -915,7 +926,8 @@ qemuProcessHandleIOError(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
             VIR_WARN("Unable to release lease on %s", vm->def->name);
         VIR_DEBUG("Preserving lock state '%s'", NULLSTR(priv->lockState));
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0)
             VIR_WARN("Unable to save status on vm %s after IO error", vm->def->name);
     }
     virObjectUnlock(vm);
@@ -951,6 +963,8 @@ qemuProcessHandleBlockJob(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         goto error;
     diskPriv = QEMU_DOMAIN_DISK_PRIVATE(disk);
 
+    qemuBlockJobStateUpdate(disk, status);
+
     if (diskPriv->blockJobSync) {
         /* We have a SYNC API waiting for this event, dispatch it back */
         diskPriv->blockJobType = type;
@@ -1096,7 +1110,8 @@ qemuProcessHandleTrayChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         else if (reason == VIR_DOMAIN_EVENT_TRAY_CHANGE_CLOSE)
             disk->tray_status = VIR_DOMAIN_DISK_TRAY_CLOSED;
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after tray moved event",
                      vm->def->name);
         }
@@ -1136,7 +1151,8 @@ qemuProcessHandlePMWakeup(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                                   VIR_DOMAIN_EVENT_STARTED,
                                                   VIR_DOMAIN_EVENT_STARTED_WAKEUP);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after wakeup event",
                      vm->def->name);
         }
@@ -1174,7 +1190,8 @@ qemuProcessHandlePMSuspend(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_MEMORY);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1207,8 +1224,10 @@ qemuProcessHandleBalloonChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     VIR_DEBUG("Updating balloon from %lld to %lld kb",
               vm->def->mem.cur_balloon, actual);
     vm->def->mem.cur_balloon = actual;
+    qemuDomainBalloonStatsInvalidate(vm);
 
-    if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0)
+    if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                    vm, driver->caps) < 0)
         VIR_WARN("unable to save domain status with balloon change");
 
     virObjectUnlock(vm);
@@ -1243,7 +1262,8 @@ qemuProcessHandlePMSuspendDisk(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED,
                                      VIR_DOMAIN_EVENT_PMSUSPENDED_DISK);
 
-        if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, vm, driver->caps) < 0) {
+        if (virDomainSaveStatusDeferred(driver->xmlopt, cfg->stateDir,
+                                        vm, driver->caps) < 0) {
             VIR_WARN("Unable to save status on vm %s after suspend event",
                      vm->def->name);
         }
@@ -1573,6 +1593,7 @@ qemuProcessHandleMigrationStatus(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
     }
 
     priv->job.current->stats.mig.status = status;
+    priv->job.current->statsFetched = 0;
     virDomainObjBroadcast(vm);
 
  cleanup:
@@ -1601,6 +1622,12 @@ qemuProcessHandleMigrationPass(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
+    if (priv->job.current) {
+        priv->job.current->stats.mig.ram_iteration = pass;
+        priv->job.current->statsFetched = 0;
+    }
+    virDomainObjBroadcast(vm);
+
     virObjectEventStateQueue(driver->domainEventState,
                          virDomainEventMigrationIterationNewFromObj(vm, pass));
 
@@ -1703,6 +1730,32 @@ qemuProcessHandlePRManagerStatusChanged(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
 }
 
 
+static int
+qemuProcessHandleJobStatusChange(qemuMonitorPtr mon ATTRIBUTE_UNUSED,
+                                 virDomainObjPtr vm,
+                                 const char *jobname,
+                                 int status,
+                                 void *opaque ATTRIBUTE_UNUSED)
+{
+    virDomainDiskDefPtr disk;
+
+    virObjectLock(vm);
+
+    VIR_DEBUG("job '%s' (domain: %p,%s) changed status to %s",
+              jobname, vm, vm->def->name,
+              qemuMonitorJobStatusTypeToString(status));
+
+    /* Block jobs started via -drive have the name of the drive */
+    if ((disk = qemuProcessFindDomainDiskByAliasOrQOM(vm, jobname, NULL)))
+        qemuBlockJobStatusChange(disk, status);
+    else
+        virResetLastError();
+
+    virObjectUnlock(vm);
+    return 0;
+}
+
+
 static qemuMonitorCallbacks monitorCallbacks = {
     .eofNotify = qemuProcessHandleMonitorEOF,
     .errorNotify = qemuProcessHandleMonitorError,
@@ -1732,6 +1785,7 @@ static qemuMonitorCallbacks monitorCallbacks = {
     .domainBlockThreshold = qemuProcessHandleBlockThreshold,
     .domainDumpCompleted = qemuProcessHandleDumpCompleted,
     .domainPRManagerStatusChanged = qemuProcessHandlePRManagerStatusChanged,
+    .domainJobStatusChange = qemuProcessHandleJobStatusChange,
 };
 
 static void
@@ -1835,6 +1889,10 @@ qemuConnectMonitor(virQEMUDriverPtr driver, virDomainObjPtr vm, int asyncJob,
         return -1;
     }
 
+    qemuMonitorSetQueryNamedBlockNodesFlat(priv->mon,
+                                           virQEMUCapsGet(priv->qemuCaps,
+                                                          QEMU_CAPS_QMP_QUERY_NAMED_BLOCK_NODES_FLAT));
+
     if (qemuProcessInitMonitor(driver, vm, asyncJob) < 0)
         return -1;
 
@@ -2584,14 +2642,116 @@ qemuProcessSetupPid(virDomainObjPtr vm,
 static int
 qemuProcessSetupEmulator(virDomainObjPtr vm)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr cpumask = vm->def->cputune.emulatorpin;
+
+    if (!cpumask)
+        cpumask = priv->housekeepingCPUs;
+
     return qemuProcessSetupPid(vm, vm->pid, VIR_CGROUP_THREAD_EMULATOR,
-                               0, vm->def->cputune.emulatorpin,
+                               0, cpumask,
                                vm->def->cputune.emulator_period,
                                vm->def->cputune.emulator_quota,
                                NULL);
 }
 
 
+/**
+ * qemuProcessResctrlMonitorsInit:
+ * @vm: domain object
+ * @resctrl: host resctrl info, NULL when reconnecting
+ *
+ * Set up the resctrl monitoring groups of @vm, see
+ * qemuDomainObjPrivate.resctrlMonitors. With @resctrl the groups are
+ * created, otherwise the ones which exist already are picked up. Running
+ * out of hardware monitoring IDs is not fatal, the domain just isn't
+ * monitored then.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuProcessResctrlMonitorsInit(virDomainObjPtr vm,
+                               virResctrlInfoPtr resctrl)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virResctrlMonitorPtr monitor = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(priv->resctrlMonitors, vm->def->nresctrls + 1) < 0)
+        return -1;
+    priv->nresctrlMonitors = vm->def->nresctrls + 1;
+
+    for (i = 0; i < priv->nresctrlMonitors; i++) {
+        virResctrlAllocPtr alloc = NULL;
+
+        if (i > 0)
+            alloc = vm->def->resctrls[i - 1]->alloc;
+
+        if (!(monitor = virResctrlMonitorNew()))
+            goto cleanup;
+
+        virResctrlMonitorSetAlloc(monitor, alloc);
+
+        if (virResctrlMonitorSetID(monitor,
+                                   alloc ? virResctrlAllocGetID(alloc) :
+                                   "domain") < 0 ||
+            virResctrlMonitorDeterminePath(monitor, priv->machineName) < 0)
+            goto cleanup;
+
+        if (!resctrl) {
+            if (!virResctrlMonitorExists(monitor))
+                virObjectUnref(monitor);
+            else
+                priv->resctrlMonitors[i] = monitor;
+            monitor = NULL;
+            continue;
+        }
+
+        if (virResctrlMonitorCreate(resctrl, monitor,
+                                    priv->machineName) < 0) {
+            VIR_WARN("Unable to create resctrl monitor '%s' of domain %s: %s",
+                     virResctrlMonitorGetID(monitor), vm->def->name,
+                     virGetLastErrorMessage());
+            virResetLastError();
+            virObjectUnref(monitor);
+            monitor = NULL;
+            continue;
+        }
+
+        VIR_STEAL_PTR(priv->resctrlMonitors[i], monitor);
+    }
+
+    /* QEMU did not exec yet, all its threads inherit the group */
+    if (resctrl && priv->resctrlMonitors[0] &&
+        virResctrlMonitorAddPID(priv->resctrlMonitors[0], vm->pid) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(monitor);
+    return ret;
+}
+
+
+static void
+qemuProcessResctrlMonitorsRemove(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    size_t i;
+
+    for (i = 0; i < priv->nresctrlMonitors; i++) {
+        if (!priv->resctrlMonitors[i])
+            continue;
+
+        virResctrlMonitorRemove(priv->resctrlMonitors[i]);
+        virObjectUnref(priv->resctrlMonitors[i]);
+    }
+    VIR_FREE(priv->resctrlMonitors);
+    priv->nresctrlMonitors = 0;
+}
+
+
 static int
 qemuProcessResctrlCreate(virQEMUDriverPtr driver,
                          virDomainObjPtr vm)
@@ -2599,16 +2759,21 @@ qemuProcessResctrlCreate(virQEMUDriverPtr driver,
     int ret = -1;
     size_t i = 0;
     virCapsPtr caps = NULL;
+    virResctrlInfoMonPtr cacheMon = NULL;
+    virResctrlInfoMonPtr bwMon = NULL;
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
 
-    if (!vm->def->nresctrls)
+    if (!vm->def->nresctrls && !cfg->resctrlMonitoring) {
+        virObjectUnref(cfg);
         return 0;
+    }
 
     /* Force capability refresh since resctrl info can change
      * XXX: move cache info into virresctrl so caps are not needed */
     caps = virQEMUDriverGetCapabilities(driver, true);
     if (!caps)
-        return -1;
+        goto cleanup;
 
     for (i = 0; i < vm->def->nresctrls; i++) {
         if (virResctrlAllocCreate(caps->host.resctrl,
@@ -2617,9 +2782,27 @@ qemuProcessResctrlCreate(virQEMUDriverPtr driver,
             goto cleanup;
     }
 
+    if (cfg->resctrlMonitoring) {
+        if (virResctrlInfoGetMonitorPrefix(caps->host.resctrl,
+                   virResctrlMonitorPrefixTypeToString(VIR_RESCTRL_MONITOR_TYPE_CACHE),
+                   &cacheMon) < 0 ||
+            virResctrlInfoGetMonitorPrefix(caps->host.resctrl,
+                   virResctrlMonitorPrefixTypeToString(VIR_RESCTRL_MONITOR_TYPE_MEMBW),
+                   &bwMon) < 0)
+            goto cleanup;
+
+        if (!cacheMon && !bwMon)
+            VIR_DEBUG("Resctrl monitoring is not supported by the host");
+        else if (qemuProcessResctrlMonitorsInit(vm, caps->host.resctrl) < 0)
+            goto cleanup;
+    }
+
     ret = 0;
  cleanup:
+    virResctrlInfoMonFree(cacheMon);
+    virResctrlInfoMonFree(bwMon);
     virObjectUnref(caps);
+    virObjectUnref(cfg);
     return ret;
 }
 
@@ -5314,7 +5497,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
      * report implicit runtime defaults in the XML, like vnc listen/socket
      */
     VIR_DEBUG("Setting current domain def as transient");
-    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm,
+                                    priv->qemuCaps) < 0)
         goto cleanup;
 
     if (flags & VIR_QEMU_PROCESS_START_PRETEND) {
@@ -5323,7 +5507,8 @@ qemuProcessInit(virQEMUDriverPtr driver,
             goto cleanup;
         }
     } else {
-        vm->def->id = qemuDriverAllocateID(driver);
+        virDomainObjListSetID(driver->domains, vm,
+                              qemuDriverAllocateID(driver));
         qemuDomainSetFakeReboot(driver, vm, false);
         virDomainObjSetState(vm, VIR_DOMAIN_PAUSED, VIR_DOMAIN_PAUSED_STARTING_UP);
 
@@ -5422,19 +5607,76 @@ qemuProcessNetworkPrepareDevices(virDomainDefPtr def)
  *
  * Returns 0 on success, -1 on error.
  */
+/**
+ * qemuProcessSetupVcpuPerf:
+ * @vm: domain object
+ * @vcpuid: id of VCPU
+ *
+ * Enable the perf events of @vm on the thread of vCPU @vcpuid if
+ * perf_vcpu_events is set in qemu.conf.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuProcessSetupVcpuPerf(virDomainObjPtr vm,
+                         unsigned int vcpuid)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, vcpuid);
+    qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(priv->driver);
+    size_t i;
+    int ret = -1;
+
+    virPerfFree(vcpupriv->perf);
+    vcpupriv->perf = NULL;
+
+    if (!cfg->perfVcpuEvents || vcpupriv->tid <= 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(vcpupriv->perf = virPerfNew()))
+        goto cleanup;
+
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        if (vm->def->perf.events[i] == VIR_TRISTATE_BOOL_YES &&
+            virPerfEventEnable(vcpupriv->perf, i, vcpupriv->tid) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(cfg);
+    return ret;
+}
+
+
 int
 qemuProcessSetupVcpu(virDomainObjPtr vm,
                      unsigned int vcpuid)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
     pid_t vcpupid = qemuDomainGetVcpuPid(vm, vcpuid);
     virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, vcpuid);
+    virDomainThreadSchedParam sched = vcpu->sched;
     size_t i = 0;
 
+    /* Dedicated vCPUs default to realtime scheduling */
+    if (vm->def->cputune.profile == VIR_DOMAIN_CPUTUNE_PROFILE_DEDICATED &&
+        sched.policy == VIR_PROC_POLICY_NONE) {
+        sched.policy = VIR_PROC_POLICY_FIFO;
+        sched.priority = 1;
+    }
+
     if (qemuProcessSetupPid(vm, vcpupid, VIR_CGROUP_THREAD_VCPU,
                             vcpuid, vcpu->cpumask,
                             vm->def->cputune.period,
                             vm->def->cputune.quota,
-                            &vcpu->sched) < 0)
+                            &sched) < 0)
+        return -1;
+
+    if (qemuProcessSetupVcpuPerf(vm, vcpuid) < 0)
         return -1;
 
     for (i = 0; i < vm->def->nresctrls; i++) {
@@ -5443,6 +5685,11 @@ qemuProcessSetupVcpu(virDomainObjPtr vm,
         if (virBitmapIsBitSet(ct->vcpus, vcpuid)) {
             if (virResctrlAllocAddPID(ct->alloc, vcpupid) < 0)
                 return -1;
+            if (i + 1 < priv->nresctrlMonitors &&
+                priv->resctrlMonitors[i + 1] &&
+                virResctrlMonitorAddPID(priv->resctrlMonitors[i + 1],
+                                        vcpupid) < 0)
+                return -1;
             break;
         }
     }
@@ -5504,10 +5751,20 @@ int
 qemuProcessSetupIOThread(virDomainObjPtr vm,
                          virDomainIOThreadIDDefPtr iothread)
 {
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr cpumask = iothread->cpumask;
+
+    /* automatically assigned IOThreads share the emulator's CPUs */
+    if (!cpumask && vm->def->iothreadsAuto)
+        cpumask = vm->def->cputune.emulatorpin;
+
+    if (!cpumask)
+        cpumask = priv->housekeepingCPUs;
+
     return qemuProcessSetupPid(vm, iothread->thread_id,
                                VIR_CGROUP_THREAD_IOTHREAD,
                                iothread->iothread_id,
-                               iothread->cpumask,
+                               cpumask,
                                vm->def->cputune.iothread_period,
                                vm->def->cputune.iothread_quota,
                                &iothread->sched);
@@ -6070,30 +6327,168 @@ qemuProcessPrepareSEVGuestInput(virDomainObjPtr vm)
 }
 
 
+typedef struct _qemuProcessStorageProbe qemuProcessStorageProbe;
+typedef qemuProcessStorageProbe *qemuProcessStorageProbePtr;
+struct _qemuProcessStorageProbe {
+    virQEMUDriverPtr driver;
+    virDomainObjPtr vm;
+
+    /* vm->def->disks as of the time probing started */
+    virDomainDiskDefPtr *disks;
+    size_t ndisks;
+
+    /* per disk results of qemuDomainDetermineDiskChainProbe */
+    int *rc;
+    virStorageSourcePtr *detected;
+    virErrorPtr *errs;
+
+    virThreadParallelPtr par;
+};
+
+
 static int
-qemuProcessPrepareHostStorage(virQEMUDriverPtr driver,
-                              virDomainObjPtr vm,
-                              unsigned int flags)
+qemuProcessPrepareHostStorageProbeDisk(size_t item,
+                                       void *opaque)
+{
+    qemuProcessStorageProbePtr probe = opaque;
+    virDomainDiskDefPtr disk = probe->disks[item];
+
+    if (virStorageSourceIsEmpty(disk->src))
+        return 0;
+
+    return probe->rc[item] = qemuDomainDetermineDiskChainProbe(probe->driver,
+                                                               probe->vm,
+                                                               disk, true,
+                                                               &probe->detected[item]);
+}
+
+
+/**
+ * qemuProcessPrepareHostStorageStart:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @probe: probe state to initialize
+ *
+ * Starts detecting backing chains of all disks of @vm in the background,
+ * see virThreadParallelStart().  Probing image
+ * metadata is mostly waiting for storage, which is why it runs alongside
+ * the rest of host preparation.  Until qemuProcessPrepareHostStorageFinish
+ * or qemuProcessPrepareHostStorageCancel is called on @probe, the caller
+ * must neither touch the disks of @vm nor unlock it.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuProcessPrepareHostStorageStart(virQEMUDriverPtr driver,
+                                   virDomainObjPtr vm,
+                                   qemuProcessStorageProbePtr probe)
 {
     qemuDomainObjPrivatePtr priv = vm->privateData;
+    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    size_t i;
+
+    memset(probe, 0, sizeof(*probe));
+    probe->driver = driver;
+    probe->vm = vm;
+
+    if (vm->def->ndisks == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(probe->disks, vm->def->ndisks) < 0 ||
+        VIR_ALLOC_N(probe->rc, vm->def->ndisks) < 0 ||
+        VIR_ALLOC_N(probe->detected, vm->def->ndisks) < 0 ||
+        VIR_ALLOC_N(probe->errs, vm->def->ndisks) < 0)
+        return -1;
+
+    for (i = 0; i < vm->def->ndisks; i++) {
+        virDomainDiskDefPtr disk = vm->def->disks[i];
+
+        /* backing chain needs to be redetected if we aren't using blockdev */
+        if (!blockdev && !virStorageSourceIsEmpty(disk->src))
+            virStorageSourceBackingStoreClear(disk->src);
+
+        probe->disks[i] = disk;
+    }
+    probe->ndisks = vm->def->ndisks;
+
+    if (!(probe->par = virThreadParallelStart(probe->ndisks,
+                                              qemuProcessPrepareHostStorageProbeDisk,
+                                              probe, probe->errs)))
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * qemuProcessPrepareHostStorageCancel:
+ * @probe: probe state
+ *
+ * Stops probing disks which were not picked up by any thread yet, waits
+ * for the threads started by qemuProcessPrepareHostStorageStart and frees
+ * @probe.  Safe to be called on a probe which was already finished.
+ */
+static void
+qemuProcessPrepareHostStorageCancel(qemuProcessStorageProbePtr probe)
+{
     size_t i;
+
+    virThreadParallelCancel(probe->par);
+    probe->par = NULL;
+
+    for (i = 0; i < probe->ndisks; i++)
+        virFreeError(probe->errs[i]);
+    VIR_FREE(probe->errs);
+    VIR_FREE(probe->detected);
+    VIR_FREE(probe->rc);
+    VIR_FREE(probe->disks);
+    probe->ndisks = 0;
+}
+
+
+/**
+ * qemuProcessPrepareHostStorageFinish:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @flags: qemuProcessStartFlags
+ * @probe: probe state started by qemuProcessPrepareHostStorageStart
+ *
+ * Waits until all disks are probed and finishes preparing their backing
+ * chains.  This is done one disk at a time in the reverse order, just like
+ * the disks were always processed, so that node names are allocated the
+ * same way and dropping a missing optional disk does not shift any disk
+ * which is still to be processed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuProcessPrepareHostStorageFinish(virQEMUDriverPtr driver,
+                                    virDomainObjPtr vm,
+                                    unsigned int flags,
+                                    qemuProcessStorageProbePtr probe)
+{
     bool cold_boot = flags & VIR_QEMU_PROCESS_START_COLD;
-    bool blockdev = virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV);
+    size_t i;
 
-    for (i = vm->def->ndisks; i > 0; i--) {
+    /* help with whatever disks were not picked up yet */
+    virThreadParallelFinish(probe->par);
+    probe->par = NULL;
+
+    for (i = probe->ndisks; i > 0; i--) {
         size_t idx = i - 1;
         virDomainDiskDefPtr disk = vm->def->disks[idx];
 
         if (virStorageSourceIsEmpty(disk->src))
             continue;
 
-        /* backing chain needs to be redetected if we aren't using blockdev */
-        if (!blockdev)
-            virStorageSourceBackingStoreClear(disk->src);
-
-        if (qemuDomainDetermineDiskChain(driver, vm, disk, true) >= 0)
+        if (probe->rc[idx] == 0 &&
+            qemuDomainDetermineDiskChainFinish(driver, vm, disk,
+                                               probe->detected[idx]) >= 0)
             continue;
 
+        if (probe->errs[idx])
+            virSetError(probe->errs[idx]);
+
         if (qemuDomainCheckDiskStartupPolicy(driver, vm, idx, cold_boot) >= 0)
             continue;
 
@@ -6135,61 +6530,165 @@ qemuProcessOpenVhostVsock(virDomainVsockDefPtr vsock)
 
 
 /**
- * qemuProcessPrepareHost:
- * @driver: qemu driver
+ * qemuProcessStartPhaseBegin:
  * @vm: domain object
- * @flags: qemuProcessStartFlags
- *
- * This function groups all code that modifies host system (which also may
- * update live XML) to prepare environment for a domain which is about to start
- * and it's the only place to do those modifications.
+ * @asyncJob: async job the domain is started in
  *
- * TODO: move all host modification from qemuBuildCommandLine into this function
+ * Starts recording how long the individual phases of starting @vm take
+ * into the statistics of the current job, if it is a plain start job.
+ * Domains started as a part of other jobs, e.g., incoming migration,
+ * report their own statistics.
  */
-int
-qemuProcessPrepareHost(virQEMUDriverPtr driver,
-                       virDomainObjPtr vm,
-                       unsigned int flags)
+static void
+qemuProcessStartPhaseBegin(virDomainObjPtr vm,
+                           qemuDomainAsyncJob asyncJob)
 {
-    int ret = -1;
-    unsigned int hostdev_flags = 0;
     qemuDomainObjPrivatePtr priv = vm->privateData;
-    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
 
-    if (qemuPrepareNVRAM(cfg, vm) < 0)
-        goto cleanup;
+    if (asyncJob != QEMU_ASYNC_JOB_START || !jobInfo ||
+        jobInfo->statsType != QEMU_DOMAIN_JOB_STATS_TYPE_NONE)
+        return;
 
-    if (vm->def->vsock) {
-        if (qemuProcessOpenVhostVsock(vm->def->vsock) < 0)
-            goto cleanup;
+    memset(&jobInfo->stats.start, 0, sizeof(jobInfo->stats.start));
+    if (virTimeMillisNow(&jobInfo->stats.start.mark) < 0) {
+        virResetLastError();
+        return;
     }
-    /* network devices must be "prepared" before hostdevs, because
-     * setting up a network device might create a new hostdev that
-     * will need to be setup.
-     */
-    VIR_DEBUG("Preparing network devices");
-    if (qemuProcessNetworkPrepareDevices(vm->def) < 0)
-        goto cleanup;
 
-    /* Must be run before security labelling */
-    VIR_DEBUG("Preparing host devices");
-    if (!cfg->relaxedACS)
-        hostdev_flags |= VIR_HOSTDEV_STRICT_ACS_CHECK;
-    if (flags & VIR_QEMU_PROCESS_START_NEW)
-        hostdev_flags |= VIR_HOSTDEV_COLD_BOOT;
-    if (qemuHostdevPrepareDomainDevices(driver, vm->def, priv->qemuCaps,
-                                        hostdev_flags) < 0)
-        goto cleanup;
+    jobInfo->statsType = QEMU_DOMAIN_JOB_STATS_TYPE_START;
+}
 
-    VIR_DEBUG("Preparing chr devices");
-    if (virDomainChrDefForeach(vm->def,
-                               true,
-                               qemuProcessPrepareChardevDevice,
-                               NULL) < 0)
-        goto cleanup;
 
-    if (qemuProcessBuildDestroyMemoryPaths(driver, vm, NULL, true) < 0)
-        goto cleanup;
+/**
+ * qemuProcessStartPhaseEnd:
+ * @vm: domain object
+ * @phase: the phase which just finished
+ *
+ * Accounts the time since the end of the previous phase to @phase.
+ */
+static void
+qemuProcessStartPhaseEnd(virDomainObjPtr vm,
+                         qemuDomainJobStartPhase phase)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+    unsigned long long now;
+
+    if (!jobInfo || jobInfo->statsType != QEMU_DOMAIN_JOB_STATS_TYPE_START)
+        return;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    if (now > jobInfo->stats.start.mark)
+        jobInfo->stats.start.phases[phase] += now - jobInfo->stats.start.mark;
+    jobInfo->stats.start.mark = now;
+
+    VIR_DEBUG("vm=%p name=%s start phase %d took %llu ms",
+              vm, vm->def->name, phase, jobInfo->stats.start.phases[phase]);
+}
+
+
+/**
+ * qemuProcessStartPhasesComplete:
+ * @vm: domain object
+ *
+ * Publishes the phase timings of a successful start as statistics of a
+ * completed job so that they can be queried once the job is over.
+ */
+static void
+qemuProcessStartPhasesComplete(virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    qemuDomainJobInfoPtr jobInfo = priv->job.current;
+
+    if (!jobInfo || jobInfo->statsType != QEMU_DOMAIN_JOB_STATS_TYPE_START)
+        return;
+
+    if (qemuDomainJobInfoUpdateTime(jobInfo) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    VIR_FREE(priv->job.completed);
+    if (VIR_ALLOC(priv->job.completed) < 0) {
+        virResetLastError();
+        return;
+    }
+
+    *priv->job.completed = *jobInfo;
+    priv->job.completed->status = QEMU_DOMAIN_JOB_STATUS_COMPLETED;
+}
+
+
+/**
+ * qemuProcessPrepareHost:
+ * @driver: qemu driver
+ * @vm: domain object
+ * @flags: qemuProcessStartFlags
+ *
+ * This function groups all code that modifies host system (which also may
+ * update live XML) to prepare environment for a domain which is about to start
+ * and it's the only place to do those modifications.
+ *
+ * Backing chains of disks are detected by separate threads while the rest
+ * of the host is prepared, nothing else in here depends on them until
+ * external devices are prepared.
+ *
+ * TODO: move all host modification from qemuBuildCommandLine into this function
+ */
+int
+qemuProcessPrepareHost(virQEMUDriverPtr driver,
+                       virDomainObjPtr vm,
+                       unsigned int flags)
+{
+    int ret = -1;
+    unsigned int hostdev_flags = 0;
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuProcessStorageProbe probe = { 0 };
+
+    if (qemuPrepareNVRAM(cfg, vm) < 0)
+        goto cleanup;
+
+    if (vm->def->vsock) {
+        if (qemuProcessOpenVhostVsock(vm->def->vsock) < 0)
+            goto cleanup;
+    }
+    /* network devices must be "prepared" before hostdevs, because
+     * setting up a network device might create a new hostdev that
+     * will need to be setup.
+     */
+    VIR_DEBUG("Preparing network devices");
+    if (qemuProcessNetworkPrepareDevices(vm->def) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Probing disks (host)");
+    if (qemuProcessPrepareHostStorageStart(driver, vm, &probe) < 0)
+        goto cleanup;
+
+    /* Must be run before security labelling */
+    VIR_DEBUG("Preparing host devices");
+    if (!cfg->relaxedACS)
+        hostdev_flags |= VIR_HOSTDEV_STRICT_ACS_CHECK;
+    if (flags & VIR_QEMU_PROCESS_START_NEW)
+        hostdev_flags |= VIR_HOSTDEV_COLD_BOOT;
+    if (qemuHostdevPrepareDomainDevices(driver, vm->def, priv->qemuCaps,
+                                        hostdev_flags) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Preparing chr devices");
+    if (virDomainChrDefForeach(vm->def,
+                               true,
+                               qemuProcessPrepareChardevDevice,
+                               NULL) < 0)
+        goto cleanup;
+
+    if (qemuProcessBuildDestroyMemoryPaths(driver, vm, NULL, true) < 0)
+        goto cleanup;
 
     /* Ensure no historical cgroup for this VM is lying around bogus
      * settings */
@@ -6231,7 +6730,7 @@ qemuProcessPrepareHost(virQEMUDriverPtr driver,
         goto cleanup;
 
     VIR_DEBUG("Preparing disks (host)");
-    if (qemuProcessPrepareHostStorage(driver, vm, flags) < 0)
+    if (qemuProcessPrepareHostStorageFinish(driver, vm, flags, &probe) < 0)
         goto cleanup;
 
     VIR_DEBUG("Preparing external devices");
@@ -6243,6 +6742,7 @@ qemuProcessPrepareHost(virQEMUDriverPtr driver,
 
     ret = 0;
  cleanup:
+    qemuProcessPrepareHostStorageCancel(&probe);
     virObjectUnref(cfg);
     return ret;
 }
@@ -6313,7 +6813,7 @@ qemuProcessSetupDiskThrottlingBlockdev(virQEMUDriverPtr driver,
             continue;
 
         if (qemuMonitorSetBlockIoThrottle(qemuDomainGetMonitor(vm), NULL,
-                                          diskPriv->qomName, &disk->blkdeviotune,
+                                          diskPriv->qomName, disk->blkdeviotune,
                                           true, true, true) < 0)
             goto cleanup;
     }
@@ -6327,6 +6827,205 @@ qemuProcessSetupDiskThrottlingBlockdev(virQEMUDriverPtr driver,
 }
 
 
+/* Huge page size used by guest NUMA node @cell, -1 for a domain without
+ * guest NUMA nodes, or 0 if it isn't backed by huge pages. */
+static unsigned long long
+qemuProcessGetCellHugepageSize(virDomainDefPtr def,
+                               virQEMUDriverConfigPtr cfg,
+                               ssize_t cell)
+{
+    virDomainHugePagePtr hugepage = NULL;
+    bool thisHugepage = false;
+    size_t i;
+
+    for (i = 0; i < def->mem.nhugepages; i++) {
+        if (!def->mem.hugepages[i].nodemask) {
+            if (!hugepage)
+                hugepage = &def->mem.hugepages[i];
+            continue;
+        }
+
+        if (cell < 0)
+            continue;
+
+        if (virBitmapGetBit(def->mem.hugepages[i].nodemask, cell,
+                            &thisHugepage) == 0 && thisHugepage) {
+            hugepage = &def->mem.hugepages[i];
+            break;
+        }
+    }
+
+    if (!hugepage)
+        return 0;
+
+    if (hugepage->size)
+        return hugepage->size;
+
+    /* The default hugetlbfs mount is used */
+    for (i = 0; i < cfg->nhugetlbfs; i++) {
+        if (cfg->hugetlbfs[i].deflt)
+            return cfg->hugetlbfs[i].size;
+    }
+
+    return cfg->nhugetlbfs ? cfg->hugetlbfs[0].size : 0;
+}
+
+
+/**
+ * qemuProcessReserveHugepages:
+ * @vm: domain object
+ * @cfg: driver config
+ * @reservations: filled with the reservations made
+ * @nreservations: number of items in @reservations
+ *
+ * Reserve the huge pages the memory of @vm is backed by so that domains
+ * starting concurrently don't count on the same free pages. The pages
+ * are taken from the host NUMA nodes the memory is bound to in strict
+ * mode, or from any node otherwise. The reservations are supposed to be
+ * released once QEMU mapped the guest memory.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+static int
+qemuProcessReserveHugepages(virDomainObjPtr vm,
+                            virQEMUDriverConfigPtr cfg,
+                            virNumaHugePageReservationPtr **reservations,
+                            size_t *nreservations)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virDomainDefPtr def = vm->def;
+    const long system_pagesize = virGetSystemPageSizeKB();
+    size_t ncells = virDomainNumaGetNodeCount(def->numa);
+    virDomainNumatuneMemMode mode;
+    virBitmapPtr nodeset = NULL;
+    VIR_AUTOFREE(unsigned long long *) sizes = NULL;
+    VIR_AUTOFREE(unsigned long long *) counts = NULL;
+    size_t nsizes = 0;
+    size_t i;
+    size_t j;
+
+    if (!cfg->reserveHugepages ||
+        def->mem.source == VIR_DOMAIN_MEMORY_SOURCE_FILE ||
+        def->mem.nhugepages == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(sizes, MAX(ncells, 1)) < 0 ||
+        VIR_ALLOC_N(counts, MAX(ncells, 1)) < 0)
+        return -1;
+
+    for (i = 0; i < MAX(ncells, 1); i++) {
+        unsigned long long pagesize;
+        unsigned long long mem;
+
+        if (ncells) {
+            pagesize = qemuProcessGetCellHugepageSize(def, cfg, i);
+            mem = virDomainNumaGetNodeMemorySize(def->numa, i);
+        } else {
+            pagesize = qemuProcessGetCellHugepageSize(def, cfg, -1);
+            mem = virDomainDefGetMemoryInitial(def);
+        }
+
+        if (!pagesize || pagesize == system_pagesize)
+            continue;
+
+        for (j = 0; j < nsizes; j++) {
+            if (sizes[j] == pagesize)
+                break;
+        }
+        if (j == nsizes)
+            sizes[nsizes++] = pagesize;
+        counts[j] += VIR_DIV_UP(mem, pagesize);
+    }
+
+    /* Per node bindings would need separate reservations from different
+     * host nodes for each guest node, don't restrict the nodes then */
+    if (!virDomainNumatuneHasPerNodeBinding(def->numa) &&
+        virDomainNumatuneGetMode(def->numa, -1, &mode) == 0 &&
+        mode == VIR_DOMAIN_NUMATUNE_MEM_STRICT &&
+        virDomainNumatuneMaybeGetNodeset(def->numa, priv->autoNodeset,
+                                         &nodeset, -1) < 0)
+        return -1;
+
+    for (i = 0; i < nsizes; i++) {
+        virNumaHugePageReservationPtr res;
+
+        VIR_DEBUG("Reserving %llu huge pages of size %llu KiB for domain %s",
+                  counts[i], sizes[i], def->name);
+
+        if (!(res = virNumaHugePageReserve(sizes[i], nodeset, counts[i],
+                                           cfg->reserveHugepagesTimeout * 1000ull)))
+            return -1;
+
+        if (VIR_APPEND_ELEMENT(*reservations, *nreservations, res) < 0) {
+            virNumaHugePageRelease(res);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * qemuProcessReserveDedicatedCPUs:
+ * @driver: qemu driver object
+ * @vm: domain object
+ *
+ * For domains with the dedicated cputune profile record the host CPUs
+ * their vCPUs are pinned to in the driver wide ledger, remember the
+ * remaining host CPUs for the emulator and I/O threads, and move host
+ * interrupts off the dedicated CPUs.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+qemuProcessReserveDedicatedCPUs(virQEMUDriverPtr driver,
+                                virDomainObjPtr vm)
+{
+    qemuDomainObjPrivatePtr priv = vm->privateData;
+    virBitmapPtr cpus = NULL;
+    size_t i;
+    ssize_t j;
+    int ret = -1;
+
+    if (vm->def->cputune.profile != VIR_DOMAIN_CPUTUNE_PROFILE_DEDICATED)
+        return 0;
+
+    if (!(cpus = virBitmapNewEmpty()))
+        goto cleanup;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
+        virBitmapPtr cpumask = vcpu->cpumask ? vcpu->cpumask : vm->def->cpumask;
+
+        j = -1;
+        while (cpumask && (j = virBitmapNextSetBit(cpumask, j)) >= 0) {
+            if (virBitmapSetBitExpand(cpus, j) < 0)
+                goto cleanup;
+        }
+    }
+
+    virBitmapFree(priv->housekeepingCPUs);
+    priv->housekeepingCPUs = NULL;
+
+    if (qemuDedicatedCPUsReserve(driver, vm->def->name, cpus,
+                                 &priv->housekeepingCPUs) < 0)
+        goto cleanup;
+
+    if (driver->privileged && virHostCPUMoveIRQs(cpus) < 0) {
+        VIR_WARN("Failed to move host interrupts off the CPUs dedicated "
+                 "to domain %s: %s", vm->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(cpus);
+    return ret;
+}
+
+
 /**
  * qemuProcessLaunch:
  *
@@ -6361,6 +7060,8 @@ qemuProcessLaunch(virConnectPtr conn,
     virCapsPtr caps = NULL;
     size_t nnicindexes = 0;
     int *nicindexes = NULL;
+    virNumaHugePageReservationPtr *hugepageReservations = NULL;
+    size_t nhugepageReservations = 0;
     size_t i;
 
     VIR_DEBUG("conn=%p driver=%p vm=%p name=%s if=%d asyncJob=%d "
@@ -6410,6 +7111,15 @@ qemuProcessLaunch(virConnectPtr conn,
     if (qemuExtDevicesStart(driver, vm->def, logCtxt) < 0)
         goto cleanup;
 
+    VIR_DEBUG("Reserving dedicated host CPUs");
+    if (qemuProcessReserveDedicatedCPUs(driver, vm) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Reserving huge pages");
+    if (qemuProcessReserveHugepages(vm, cfg, &hugepageReservations,
+                                    &nhugepageReservations) < 0)
+        goto cleanup;
+
     VIR_DEBUG("Building emulator command line");
     if (!(cmd = qemuBuildCommandLine(driver,
                                      qemuDomainLogContextGetManager(logCtxt),
@@ -6572,6 +7282,8 @@ qemuProcessLaunch(virConnectPtr conn,
         goto cleanup;
     VIR_DEBUG("Handshake complete, child running");
 
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_LAUNCH);
+
     if (rv == -1) /* The VM failed to start; tear filters before taps */
         virDomainConfVMNWFilterTeardown(vm);
 
@@ -6665,6 +7377,11 @@ qemuProcessLaunch(virConnectPtr conn,
     if (ret < 0)
         qemuExtDevicesStop(driver, vm->def);
     qemuDomainSecretDestroy(vm);
+    /* QEMU mapped the guest memory by now, the kernel accounts for the
+     * huge pages it's using */
+    for (i = 0; i < nhugepageReservations; i++)
+        virNumaHugePageRelease(hugepageReservations[i]);
+    VIR_FREE(hugepageReservations);
     virCommandFree(cmd);
     virObjectUnref(logCtxt);
     virObjectUnref(cfg);
@@ -6791,9 +7508,12 @@ qemuProcessStart(virConnectPtr conn,
     if (!migrateFrom && !snapshot)
         flags |= VIR_QEMU_PROCESS_START_NEW;
 
+    qemuProcessStartPhaseBegin(vm, asyncJob);
+
     if (qemuProcessInit(driver, vm, updatedCPU,
                         asyncJob, !!migrateFrom, flags) < 0)
         goto cleanup;
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_INIT);
 
     if (migrateFrom) {
         incoming = qemuProcessIncomingDefNew(priv->qemuCaps, NULL, migrateFrom,
@@ -6804,9 +7524,11 @@ qemuProcessStart(virConnectPtr conn,
 
     if (qemuProcessPrepareDomain(driver, vm, flags) < 0)
         goto stop;
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_PREPARE_DOMAIN);
 
     if (qemuProcessPrepareHost(driver, vm, flags) < 0)
         goto stop;
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_PREPARE_HOST);
 
     if ((rv = qemuProcessLaunch(conn, driver, vm, asyncJob, incoming,
                                 snapshot, vmop, flags)) < 0) {
@@ -6815,6 +7537,7 @@ qemuProcessStart(virConnectPtr conn,
         goto stop;
     }
     relabel = true;
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_MONITOR);
 
     if (incoming &&
         incoming->deferredURI &&
@@ -6838,6 +7561,8 @@ qemuProcessStart(virConnectPtr conn,
         if (qemuProcessRefreshState(driver, vm, asyncJob) < 0)
             goto stop;
     }
+    qemuProcessStartPhaseEnd(vm, QEMU_DOMAIN_JOB_START_PHASE_FINISH);
+    qemuProcessStartPhasesComplete(vm);
 
     ret = 0;
 
@@ -7019,7 +7744,7 @@ void qemuProcessStop(virQEMUDriverPtr driver,
 
     qemuProcessBuildDestroyMemoryPaths(driver, vm, NULL, false);
 
-    vm->def->id = -1;
+    virDomainObjListSetID(driver->domains, vm, -1);
 
     if (virAtomicIntDecAndTest(&driver->nactive) && driver->inhibitCallback)
         driver->inhibitCallback(false, driver->inhibitOpaque);
@@ -7205,6 +7930,20 @@ void qemuProcessStop(virQEMUDriverPtr driver,
     /* Remove resctrl allocation after cgroups are cleaned up which makes it
      * kind of safer (although removing the allocation should work even with
      * pids in tasks file */
+    qemuProcessResctrlMonitorsRemove(vm);
+
+    qemuDedicatedCPUsRelease(driver, vm->def->name);
+    virBitmapFree(priv->housekeepingCPUs);
+    priv->housekeepingCPUs = NULL;
+
+    for (i = 0; i < virDomainDefGetVcpusMax(vm->def); i++) {
+        virDomainVcpuDefPtr vcpu = virDomainDefGetVcpu(vm->def, i);
+        qemuDomainVcpuPrivatePtr vcpupriv = QEMU_DOMAIN_VCPU_PRIVATE(vcpu);
+
+        virPerfFree(vcpupriv->perf);
+        vcpupriv->perf = NULL;
+        qemuDomainVcpuCloseKVMStats(vcpupriv);
+    }
     for (i = 0; i < vm->def->nresctrls; i++)
         virResctrlAllocRemove(vm->def->resctrls[i]->alloc);
 
@@ -7327,10 +8066,10 @@ int qemuProcessAttach(virConnectPtr conn ATTRIBUTE_UNUSED,
      * report implicit runtime defaults in the XML, like vnc listen/socket
      */
     VIR_DEBUG("Setting current domain def as transient");
-    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm) < 0)
+    if (virDomainObjSetDefTransient(caps, driver->xmlopt, vm, NULL) < 0)
         goto error;
 
-    vm->def->id = qemuDriverAllocateID(driver);
+    virDomainObjListSetID(driver->domains, vm, qemuDriverAllocateID(driver));
 
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
@@ -7719,10 +8458,100 @@ qemuProcessRefreshCPU(virQEMUDriverPtr driver,
 }
 
 
-struct qemuProcessReconnectData {
+struct _qemuProcessReconnectQueue {
+    virObjectLockable parent;
+
     virQEMUDriverPtr driver;
-    virDomainObjPtr obj;
+    unsigned int maxWorkers; /* 0 means one worker per domain */
+    size_t nworkers;
+
+    /* domains waiting to be reconnected, the next one first */
+    size_t npending;
+    virDomainObjPtr *pending;
+
+    /* reconnected domains waiting for the refresh of non-essential data */
+    size_t ndeferred;
+    virDomainObjPtr *deferred;
 };
+
+static virClassPtr qemuProcessReconnectQueueClass;
+static void qemuProcessReconnectQueueDispose(void *obj);
+
+static int
+qemuProcessReconnectQueueOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(qemuProcessReconnectQueue, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(qemuProcessReconnectQueue)
+
+
+static void
+qemuProcessReconnectQueueDispose(void *obj)
+{
+    qemuProcessReconnectQueuePtr queue = obj;
+
+    /* every worker holds a reference, so there's nothing queued anymore */
+    VIR_FREE(queue->pending);
+    VIR_FREE(queue->deferred);
+}
+
+
+/*
+ * Queue data which is not needed for @obj to be usable to be refreshed
+ * once all the domains are reconnected. Failure is ignored, the data
+ * is just not refreshed in that case.
+ */
+static void
+qemuProcessReconnectDefer(virQEMUDriverPtr driver,
+                          virDomainObjPtr obj)
+{
+    qemuProcessReconnectQueuePtr queue = driver->reconnectQueue;
+
+    virObjectLock(queue);
+    if (VIR_APPEND_ELEMENT_COPY(queue->deferred, queue->ndeferred, obj) < 0)
+        virResetLastError();
+    else
+        virObjectRef(obj);
+    virObjectUnlock(queue);
+}
+
+
+/**
+ * qemuProcessReconnectPrioritize:
+ * @driver: qemu driver
+ * @vm: locked domain object
+ *
+ * Moves @vm to the front of the reconnect queue because a client is
+ * waiting for it. Does nothing if @vm is not waiting to be reconnected.
+ */
+void
+qemuProcessReconnectPrioritize(virQEMUDriverPtr driver,
+                               virDomainObjPtr vm)
+{
+    qemuProcessReconnectQueuePtr queue = driver->reconnectQueue;
+    size_t i;
+
+    if (!queue)
+        return;
+
+    virObjectLock(queue);
+    for (i = 1; i < queue->npending; i++) {
+        if (queue->pending[i] == vm) {
+            VIR_DEBUG("Reconnecting domain '%s' next", vm->def->name);
+            memmove(queue->pending + 1, queue->pending,
+                    i * sizeof(*queue->pending));
+            queue->pending[0] = vm;
+            break;
+        }
+    }
+    virObjectUnlock(queue);
+}
+
+
 /*
  * Open an existing VM's monitor, re-detect VCPU threads
  * and re-reserve the security labels in use
@@ -7742,12 +8571,10 @@ struct qemuProcessReconnectData {
  * monitor lock, which does not exists in this early phase.
  */
 static void
-qemuProcessReconnect(void *opaque)
+qemuProcessReconnect(virQEMUDriverPtr driver,
+                     virDomainObjPtr obj)
 {
-    struct qemuProcessReconnectData *data = opaque;
-    virQEMUDriverPtr driver = data->driver;
-    virDomainObjPtr obj = data->obj;
-    qemuDomainObjPrivatePtr priv;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
     qemuDomainJobObj oldjob;
     int state;
     int reason;
@@ -7759,14 +8586,22 @@ qemuProcessReconnect(void *opaque)
     bool retry = true;
     bool tryMonReconn = false;
 
-    VIR_FREE(data);
+    /* jobs may be started again, the first one is ours since @obj
+     * stays locked until we begin it */
+    priv->reconnectPending = false;
+    virCondBroadcast(&priv->job.cond);
+
+    if (qemuDomainStatusJournalReplay(driver, obj) < 0) {
+        VIR_WARN("Failed to replay status journal of domain %s: %s",
+                 obj->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
 
     qemuDomainObjRestoreJob(obj, &oldjob);
     if (oldjob.asyncJob == QEMU_ASYNC_JOB_MIGRATION_IN)
         stopFlags |= VIR_QEMU_PROCESS_STOP_MIGRATED;
 
     cfg = virQEMUDriverGetConfig(driver);
-    priv = obj->privateData;
 
     if (!(caps = virQEMUDriverGetCapabilities(driver, false)))
         goto error;
@@ -7902,6 +8737,16 @@ qemuProcessReconnect(void *opaque)
 
     qemuDomainVcpuPersistOrder(obj->def);
 
+    /* Failure to re-enable the perf events of vCPUs should not be fatal */
+    for (i = 0; i < virDomainDefGetVcpusMax(obj->def); i++) {
+        if (virDomainDefGetVcpu(obj->def, i)->online &&
+            qemuProcessSetupVcpuPerf(obj, i) < 0) {
+            VIR_WARN("Unable to enable perf events of vCPU %zu of domain %s: %s",
+                     i, obj->def->name, virGetLastErrorMessage());
+            virResetLastError();
+        }
+    }
+
     if (qemuProcessDetectIOThreadPIDs(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
 
@@ -7915,16 +8760,9 @@ qemuProcessReconnect(void *opaque)
     if (qemuProcessRefreshDisks(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
 
-    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
-        qemuBlockNodeNamesDetect(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
-        goto error;
-
     if (qemuRefreshVirtioChannelState(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
 
-    /* If querying of guest's RTC failed, report error, but do not kill the domain. */
-    qemuRefreshRTC(driver, obj);
-
     if (qemuProcessRefreshBalloonState(driver, obj, QEMU_ASYNC_JOB_NONE) < 0)
         goto error;
 
@@ -7948,6 +8786,17 @@ qemuProcessReconnect(void *opaque)
             goto error;
     }
 
+    if (qemuProcessResctrlMonitorsInit(obj, NULL) < 0)
+        goto error;
+
+    /* Conflicting reservations can only come from domains started by
+     * a different daemon instance, don't kill the domain for that */
+    if (qemuProcessReserveDedicatedCPUs(driver, obj) < 0) {
+        VIR_WARN("Failed to reserve dedicated host CPUs for domain %s: %s",
+                 obj->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
     /* update domain state XML with possibly updated state in virDomainObj */
     if (virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0)
         goto error;
@@ -7972,6 +8821,9 @@ qemuProcessReconnect(void *opaque)
     if (virAtomicIntInc(&driver->nactive) == 1 && driver->inhibitCallback)
         driver->inhibitCallback(true, driver->inhibitOpaque);
 
+    /* node names and RTC are refreshed once all domains are usable */
+    qemuProcessReconnectDefer(driver, obj);
+
  cleanup:
     if (jobStarted) {
         if (!virDomainObjIsActive(obj))
@@ -8011,62 +8863,181 @@ qemuProcessReconnect(void *opaque)
     goto cleanup;
 }
 
+/*
+ * Refresh the data of a reconnected domain which clients can live
+ * without for a while: block node names, which only matter for stats
+ * and threshold events, and the RTC offset. Failures are not fatal.
+ *
+ * This function inherits a locked and ref'd domain object.
+ */
+static void
+qemuProcessReconnectRefresh(virQEMUDriverPtr driver,
+                            virDomainObjPtr obj)
+{
+    qemuDomainObjPrivatePtr priv = obj->privateData;
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+
+    if (qemuDomainObjBeginJob(driver, obj, QEMU_JOB_MODIFY) < 0) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    if (!virDomainObjIsActive(obj))
+        goto endjob;
+
+    VIR_DEBUG("Refreshing reconnected domain '%s'", obj->def->name);
+
+    if (!virQEMUCapsGet(priv->qemuCaps, QEMU_CAPS_BLOCKDEV) &&
+        qemuBlockNodeNamesDetect(driver, obj, QEMU_ASYNC_JOB_NONE) < 0) {
+        VIR_WARN("Failed to detect block node names of domain '%s': %s",
+                 obj->def->name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    /* If querying of guest's RTC failed, report error, but do not kill the domain. */
+    qemuRefreshRTC(driver, obj);
+
+    if (virDomainObjIsActive(obj) &&
+        virDomainSaveStatus(driver->xmlopt, cfg->stateDir, obj, driver->caps) < 0) {
+        VIR_WARN("Failed to save status of domain '%s'", obj->def->name);
+        virResetLastError();
+    }
+
+ endjob:
+    qemuDomainObjEndJob(driver, obj);
+
+ cleanup:
+    virDomainObjEndAPI(&obj);
+    virObjectUnref(cfg);
+}
+
+
+static void
+qemuProcessReconnectWorker(void *opaque)
+{
+    qemuProcessReconnectQueuePtr queue = opaque;
+    virDomainObjPtr obj;
+
+    while (true) {
+        bool deferred = false;
+
+        virObjectLock(queue);
+        if (queue->npending > 0) {
+            obj = queue->pending[0];
+            VIR_DELETE_ELEMENT(queue->pending, 0, queue->npending);
+        } else if (queue->ndeferred > 0) {
+            obj = queue->deferred[0];
+            VIR_DELETE_ELEMENT(queue->deferred, 0, queue->ndeferred);
+            deferred = true;
+        } else {
+            queue->nworkers--;
+            virObjectUnlock(queue);
+            break;
+        }
+        virObjectUnlock(queue);
+
+        if (deferred) {
+            virObjectLock(obj);
+            qemuProcessReconnectRefresh(queue->driver, obj);
+        } else {
+            virNWFilterReadLockFilterUpdates();
+            virObjectLock(obj);
+            qemuProcessReconnect(queue->driver, obj);
+        }
+    }
+
+    virObjectUnref(queue);
+}
+
+
 static int
 qemuProcessReconnectHelper(virDomainObjPtr obj,
                            void *opaque)
 {
     virThread thread;
-    struct qemuProcessReconnectData *src = opaque;
-    struct qemuProcessReconnectData *data;
+    qemuProcessReconnectQueuePtr queue = opaque;
+    qemuDomainObjPrivatePtr priv = obj->privateData;
 
     /* If the VM was inactive, we don't need to reconnect */
     if (!obj->pid)
         return 0;
 
-    if (VIR_ALLOC(data) < 0)
-        return -1;
-
-    memcpy(data, src, sizeof(*data));
-    data->obj = obj;
-
-    virNWFilterReadLockFilterUpdates();
-
-    /* this lock and reference will be eventually transferred to the thread
-     * that handles the reconnect */
+    /* The reference is transferred to the queue. The domain is not
+     * locked while it waits there, which allows APIs that don't need
+     * a job to proceed, but no job may be started before reconnecting
+     * it. */
     virObjectLock(obj);
     virObjectRef(obj);
+    virObjectLock(queue);
 
-    if (virThreadCreate(&thread, false, qemuProcessReconnect, data) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                       _("Could not create thread. QEMU initialization "
-                         "might be incomplete"));
-        /* We can't spawn a thread and thus connect to monitor. Kill qemu.
-         * It's safe to call qemuProcessStop without a job here since there
-         * is no thread that could be doing anything else with the same domain
-         * object.
-         */
-        qemuProcessStop(src->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
-                        QEMU_ASYNC_JOB_NONE, 0);
-        qemuDomainRemoveInactiveJobLocked(src->driver, obj);
+    if (VIR_APPEND_ELEMENT_COPY(queue->pending, queue->npending, obj) < 0)
+        goto error;
 
-        virDomainObjEndAPI(&obj);
-        virNWFilterUnlockFilterUpdates();
-        VIR_FREE(data);
-        return -1;
+    priv->reconnectPending = true;
+
+    if (!queue->maxWorkers || queue->nworkers < queue->maxWorkers) {
+        virObjectRef(queue);
+        if (virThreadCreate(&thread, false,
+                            qemuProcessReconnectWorker, queue) < 0) {
+            virObjectUnref(queue);
+
+            /* workers which are already running will handle @obj */
+            if (queue->nworkers == 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                               _("Could not create thread. QEMU initialization "
+                                 "might be incomplete"));
+                priv->reconnectPending = false;
+                VIR_DELETE_ELEMENT(queue->pending, queue->npending - 1,
+                                   queue->npending);
+                goto error;
+            }
+        } else {
+            queue->nworkers++;
+        }
     }
 
+    virObjectUnlock(queue);
+    virObjectUnlock(obj);
     return 0;
+
+ error:
+    virObjectUnlock(queue);
+    /* We can't spawn a thread and thus connect to monitor. Kill qemu.
+     * It's safe to call qemuProcessStop without a job here since there
+     * is no thread that could be doing anything else with the same domain
+     * object.
+     */
+    qemuProcessStop(queue->driver, obj, VIR_DOMAIN_SHUTOFF_FAILED,
+                    QEMU_ASYNC_JOB_NONE, 0);
+    qemuDomainRemoveInactiveJobLocked(queue->driver, obj);
+
+    virDomainObjEndAPI(&obj);
+    return -1;
 }
 
 /**
  * qemuProcessReconnectAll
  *
  * Try to re-open the resources for live VMs that we care
- * about.
+ * about. The domains are reconnected by at most max_reconnect_workers
+ * threads, a domain a client is waiting for is reconnected first.
  */
 void
 qemuProcessReconnectAll(virQEMUDriverPtr driver)
 {
-    struct qemuProcessReconnectData data = {.driver = driver};
-    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, &data);
+    virQEMUDriverConfigPtr cfg = virQEMUDriverGetConfig(driver);
+    qemuProcessReconnectQueuePtr queue;
+
+    if (qemuProcessReconnectQueueInitialize() < 0 ||
+        !(queue = virObjectLockableNew(qemuProcessReconnectQueueClass)))
+        goto cleanup;
+
+    queue->driver = driver;
+    queue->maxWorkers = cfg->maxReconnectWorkers;
+    driver->reconnectQueue = queue;
+
+    virDomainObjListForEach(driver->domains, qemuProcessReconnectHelper, queue);
+
+ cleanup:
+    virObjectUnref(cfg);
 }
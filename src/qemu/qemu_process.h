@@ -48,6 +48,8 @@ int qemuProcessDestroyMemoryBackingPath(virQEMUDriverPtr driver,
                                         virDomainMemoryDefPtr mem);
 
 void qemuProcessReconnectAll(virQEMUDriverPtr driver);
+void qemuProcessReconnectPrioritize(virQEMUDriverPtr driver,
+                                    virDomainObjPtr vm);
 
 typedef struct _qemuProcessIncomingDef qemuProcessIncomingDef;
 typedef qemuProcessIncomingDef *qemuProcessIncomingDefPtr;
@@ -193,6 +195,8 @@ virDomainDiskDefPtr qemuProcessFindDomainDiskByAliasOrQOM(virDomainObjPtr vm,
 int qemuConnectAgent(virQEMUDriverPtr driver, virDomainObjPtr vm);
 
 
+int qemuProcessSetupVcpuPerf(virDomainObjPtr vm,
+                             unsigned int vcpuid);
 int qemuProcessSetupVcpu(virDomainObjPtr vm,
                          unsigned int vcpuid);
 int qemuProcessSetupIOThread(virDomainObjPtr vm,
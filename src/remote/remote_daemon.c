@@ -53,6 +53,7 @@
 #include "virhook.h"
 #include "viraudit.h"
 #include "virstring.h"
+#include "virtime.h"
 #include "locking/lock_manager.h"
 #include "viraccessmanager.h"
 #include "virutil.h"
@@ -75,6 +76,16 @@ virNetServerProgramPtr qemuProgram = NULL;
 
 volatile bool driversInitialized = false;
 
+/* Set once a re-exec was requested */
+static bool execRestart;
+/* Set if the daemon was started from the state of a previous image */
+static bool execRestarted;
+/* The state of TLS sessions and services cannot be preserved */
+static bool execRestartAllowed = true;
+
+/* Seconds to wait for clients to finish their calls before re-exec */
+#define DAEMON_EXEC_RESTART_DRAIN_TIMEOUT 30
+
 enum {
     VIR_DAEMON_ERR_NONE = 0,
     VIR_DAEMON_ERR_PIDFILE,
@@ -87,6 +98,7 @@ enum {
     VIR_DAEMON_ERR_HOOKS,
     VIR_DAEMON_ERR_AUDIT,
     VIR_DAEMON_ERR_DRIVER,
+    VIR_DAEMON_ERR_REEXEC,
 
     VIR_DAEMON_ERR_LAST
 };
@@ -103,7 +115,8 @@ VIR_ENUM_IMPL(virDaemonErr, VIR_DAEMON_ERR_LAST,
               "Unable to load configuration file",
               "Unable to look for hook scripts",
               "Unable to initialize audit system",
-              "Unable to initialize driver")
+              "Unable to initialize driver",
+              "Unable to re-execute daemon")
 
 static int daemonForkIntoBackground(const char *argv0)
 {
@@ -220,19 +233,19 @@ daemonUnixSocketPaths(struct daemonConfig *config,
     char *rundir = NULL;
 
     if (config->unix_sock_dir) {
-        if (virAsprintf(sockfile, "%s/libvirt-sock", config->unix_sock_dir) < 0)
+        if (virAsprintf(sockfile, "%s/" SOCK_PREFIX "-sock", config->unix_sock_dir) < 0)
             goto cleanup;
 
         if (privileged) {
-            if (virAsprintf(rosockfile, "%s/libvirt-sock-ro", config->unix_sock_dir) < 0 ||
-                virAsprintf(admsockfile, "%s/libvirt-admin-sock", config->unix_sock_dir) < 0)
+            if (virAsprintf(rosockfile, "%s/" SOCK_PREFIX "-sock-ro", config->unix_sock_dir) < 0 ||
+                virAsprintf(admsockfile, "%s/" ADMIN_SOCK_PREFIX "-admin-sock", config->unix_sock_dir) < 0)
                 goto cleanup;
         }
     } else {
         if (privileged) {
-            if (VIR_STRDUP(*sockfile, LOCALSTATEDIR "/run/libvirt/libvirt-sock") < 0 ||
-                VIR_STRDUP(*rosockfile, LOCALSTATEDIR "/run/libvirt/libvirt-sock-ro") < 0 ||
-                VIR_STRDUP(*admsockfile, LOCALSTATEDIR "/run/libvirt/libvirt-admin-sock") < 0)
+            if (VIR_STRDUP(*sockfile, LOCALSTATEDIR "/run/libvirt/" SOCK_PREFIX "-sock") < 0 ||
+                VIR_STRDUP(*rosockfile, LOCALSTATEDIR "/run/libvirt/" SOCK_PREFIX "-sock-ro") < 0 ||
+                VIR_STRDUP(*admsockfile, LOCALSTATEDIR "/run/libvirt/" ADMIN_SOCK_PREFIX "-admin-sock") < 0)
                 goto cleanup;
         } else {
             mode_t old_umask;
@@ -247,8 +260,8 @@ daemonUnixSocketPaths(struct daemonConfig *config,
             }
             umask(old_umask);
 
-            if (virAsprintf(sockfile, "%s/libvirt-sock", rundir) < 0 ||
-                virAsprintf(admsockfile, "%s/libvirt-admin-sock", rundir) < 0)
+            if (virAsprintf(sockfile, "%s/" SOCK_PREFIX "-sock", rundir) < 0 ||
+                virAsprintf(admsockfile, "%s/" ADMIN_SOCK_PREFIX "-admin-sock", rundir) < 0)
                 goto cleanup;
         }
     }
@@ -298,6 +311,17 @@ static int daemonErrorLogFilter(virErrorPtr err, int priority)
 
 static int daemonInitialize(void)
 {
+#if defined(MODULE_NAME)
+    /* A daemon serving a single driver requires its module, and
+     * reaches the secondary drivers through their own daemons */
+    if (remoteSetSplitDaemon(MODULE_NAME) < 0 ||
+        virDriverLoadModule(MODULE_NAME, MODULE_NAME "Register", true) < 0)
+        return -1;
+#elif defined(DAEMON_PROXY)
+    /* All connections are forwarded to the per-driver daemons */
+    if (remoteSetSplitDaemon(NULL) < 0)
+        return -1;
+#else
     /*
      * Note that the order is important: the first ones have a higher
      * priority when calling virStateInitialize. We must register the
@@ -305,62 +329,84 @@ static int daemonInitialize(void)
      * driver, since their resources must be auto-started before any
      * domains can be auto-started.
      */
-#ifdef WITH_NETWORK
+# ifdef WITH_NETWORK
     if (virDriverLoadModule("network", "networkRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_INTERFACE
+# endif
+# ifdef WITH_INTERFACE
     if (virDriverLoadModule("interface", "interfaceRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_STORAGE
+# endif
+# ifdef WITH_STORAGE
     if (virDriverLoadModule("storage", "storageRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_NODE_DEVICES
+# endif
+# ifdef WITH_NODE_DEVICES
     if (virDriverLoadModule("nodedev", "nodedevRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_SECRETS
+# endif
+# ifdef WITH_SECRETS
     if (virDriverLoadModule("secret", "secretRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_NWFILTER
+# endif
+# ifdef WITH_NWFILTER
     if (virDriverLoadModule("nwfilter", "nwfilterRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_LIBXL
+# endif
+# ifdef WITH_LIBXL
     if (virDriverLoadModule("libxl", "libxlRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_QEMU
+# endif
+# ifdef WITH_QEMU
     if (virDriverLoadModule("qemu", "qemuRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_LXC
+# endif
+# ifdef WITH_LXC
     if (virDriverLoadModule("lxc", "lxcRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_UML
+# endif
+# ifdef WITH_UML
     if (virDriverLoadModule("uml", "umlRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_VBOX
+# endif
+# ifdef WITH_VBOX
     if (virDriverLoadModule("vbox", "vboxRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_BHYVE
+# endif
+# ifdef WITH_BHYVE
     if (virDriverLoadModule("bhyve", "bhyveRegister", false) < 0)
         return -1;
-#endif
-#ifdef WITH_VZ
+# endif
+# ifdef WITH_VZ
     if (virDriverLoadModule("vz", "vzRegister", false) < 0)
         return -1;
+# endif
 #endif
     return 0;
 }
 
 
+static int
+daemonSetupSASL(struct daemonConfig *config ATTRIBUTE_UNUSED,
+                const char *sock_path_ro ATTRIBUTE_UNUSED,
+                bool ipsock ATTRIBUTE_UNUSED)
+{
+#if WITH_SASL
+    if (config->auth_unix_rw == REMOTE_AUTH_SASL ||
+        (sock_path_ro && config->auth_unix_ro == REMOTE_AUTH_SASL) ||
+        (ipsock && config->listen_tls && config->auth_tls == REMOTE_AUTH_SASL) ||
+        (ipsock && config->listen_tcp && config->auth_tcp == REMOTE_AUTH_SASL)) {
+        saslCtxt = virNetSASLContextNewServer(
+            (const char *const*)config->sasl_allowed_username_list);
+        if (!saslCtxt)
+            return -1;
+    }
+#endif
+
+    return 0;
+}
+
+
 static int ATTRIBUTE_NONNULL(3)
 daemonSetupNetworking(virNetServerPtr srv,
                       virNetServerPtr srvAdm,
@@ -543,17 +589,8 @@ daemonSetupNetworking(virNetServerPtr srv,
         }
     }
 
-#if WITH_SASL
-    if (config->auth_unix_rw == REMOTE_AUTH_SASL ||
-        (sock_path_ro && config->auth_unix_ro == REMOTE_AUTH_SASL) ||
-        (ipsock && config->listen_tls && config->auth_tls == REMOTE_AUTH_SASL) ||
-        (ipsock && config->listen_tcp && config->auth_tcp == REMOTE_AUTH_SASL)) {
-        saslCtxt = virNetSASLContextNewServer(
-            (const char *const*)config->sasl_allowed_username_list);
-        if (!saslCtxt)
-            goto cleanup;
-    }
-#endif
+    if (daemonSetupSASL(config, sock_path_ro, ipsock) < 0)
+        goto cleanup;
 
     ret = 0;
 
@@ -620,7 +657,7 @@ daemonSetupLogging(struct daemonConfig *config,
     /* Define the default output. This is only applied if there was no setting
      * from either the config or the environment.
      */
-    if (virLogSetDefaultOutput("libvirtd.log", godaemon, privileged) < 0)
+    if (virLogSetDefaultOutput(DAEMON_NAME ".log", godaemon, privileged) < 0)
         return -1;
 
     if (virLogGetNbOutputs() == 0)
@@ -693,7 +730,54 @@ static void daemonReloadHandler(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
     }
 }
 
-static int daemonSetupSignals(virNetDaemonPtr dmn)
+static void daemonExecRestartHandler(virNetDaemonPtr dmn,
+                                     siginfo_t *sig ATTRIBUTE_UNUSED,
+                                     void *opaque ATTRIBUTE_UNUSED)
+{
+    if (!execRestartAllowed) {
+        VIR_WARN("TLS sessions cannot be preserved, re-exec ignored");
+        return;
+    }
+
+    if (!driversInitialized) {
+        VIR_WARN("Drivers are not initialized, re-exec ignored");
+        return;
+    }
+
+    VIR_INFO("Re-executing on SIGUSR1");
+    execRestart = true;
+    virNetDaemonQuit(dmn);
+}
+
+static void daemonLogBufferHandler(virNetDaemonPtr dmn ATTRIBUTE_UNUSED,
+                                   siginfo_t *sig ATTRIBUTE_UNUSED,
+                                   void *opaque)
+{
+    const char *run_dir = opaque;
+    char *buffer = NULL;
+    char *path = NULL;
+
+    if (!(buffer = virLogGetBuffer())) {
+        VIR_WARN("Unable to fetch logging buffer: %s",
+                 virGetLastErrorMessage());
+        return;
+    }
+
+    if (virAsprintf(&path, "%s/" DAEMON_NAME "-log-buffer.txt", run_dir) < 0)
+        goto cleanup;
+
+    if (virFileWriteStr(path, buffer, 0600) < 0)
+        VIR_WARN("Unable to write logging buffer to %s", path);
+    else
+        VIR_INFO("Logging buffer written to %s", path);
+
+ cleanup:
+    VIR_FREE(path);
+    VIR_FREE(buffer);
+}
+
+static int daemonSetupSignals(virNetDaemonPtr dmn,
+                              const char *run_dir)
 {
     if (virNetDaemonAddSignalHandler(dmn, SIGINT, daemonShutdownHandler, NULL) < 0)
         return -1;
@@ -703,6 +787,11 @@ static int daemonSetupSignals(virNetDaemonPtr dmn)
         return -1;
     if (virNetDaemonAddSignalHandler(dmn, SIGHUP, daemonReloadHandler, NULL) < 0)
         return -1;
+    if (virNetDaemonAddSignalHandler(dmn, SIGUSR1, daemonExecRestartHandler, NULL) < 0)
+        return -1;
+    if (virNetDaemonAddSignalHandler(dmn, SIGUSR2, daemonLogBufferHandler,
+                                     (void *) run_dir) < 0)
+        return -1;
     return 0;
 }
 
@@ -784,6 +873,40 @@ handleSystemMessageFunc(DBusConnection *connection ATTRIBUTE_UNUSED,
 #endif
 
 
+/*
+ * Resumes the clients carried over an exec restart, now that the
+ * drivers their connections were opened to are initialized.
+ */
+static void daemonRestoreClients(virNetDaemonPtr dmn)
+{
+    virNetServerPtr srv;
+    virNetServerClientPtr *clients = NULL;
+    int nclients;
+    size_t i;
+
+    if (!(srv = virNetDaemonGetServer(dmn, DAEMON_NAME)))
+        return;
+
+    if ((nclients = virNetServerGetClients(srv, &clients)) < 0) {
+        virObjectUnref(srv);
+        return;
+    }
+
+    for (i = 0; i < nclients; i++) {
+        if (remoteClientRestore(clients[i]) < 0) {
+            VIR_WARN("Unable to restore client %llu: %s",
+                     virNetServerClientGetID(clients[i]),
+                     virGetLastErrorMessage());
+            virNetServerClientImmediateClose(clients[i]);
+        }
+    }
+
+    VIR_INFO("Restored %d clients after re-exec", nclients);
+
+    virObjectListFreeCount(clients, nclients);
+    virObjectUnref(srv);
+}
+
 static void daemonRunStateInit(void *opaque)
 {
     virNetDaemonPtr dmn = opaque;
@@ -810,6 +933,9 @@ static void daemonRunStateInit(void *opaque)
 
     driversInitialized = true;
 
+    if (execRestarted)
+        daemonRestoreClients(dmn);
+
 #ifdef WITH_DBUS
     /* Tie the non-privileged libvirtd to the session/shutdown lifecycle */
     if (!virNetDaemonIsPrivileged(dmn)) {
@@ -849,6 +975,318 @@ static int daemonStateInit(virNetDaemonPtr dmn)
     return 0;
 }
 
+static int
+daemonExecRestartStatePath(bool privileged,
+                           char **state_file)
+{
+    char *rundir = NULL;
+    int ret;
+
+    if (privileged)
+        return VIR_STRDUP(*state_file,
+                          LOCALSTATEDIR "/run/libvirt/" DAEMON_NAME
+                          "-restart-exec.json");
+
+    if (!(rundir = virGetUserRuntimeDirectory()))
+        return -1;
+
+    ret = virAsprintf(state_file, "%s/" DAEMON_NAME "-restart-exec.json", rundir);
+    VIR_FREE(rundir);
+    return ret;
+}
+
+
+static char *
+daemonGetExecRestartMagic(void)
+{
+    char *ret;
+
+    ignore_value(virAsprintf(&ret, "%lld", (long long int)getpid()));
+    return ret;
+}
+
+
+static virNetServerPtr
+daemonNewServerPostExecRestart(virNetDaemonPtr dmn,
+                               const char *name,
+                               virJSONValuePtr object,
+                               void *opaque ATTRIBUTE_UNUSED)
+{
+    if (STREQ(name, DAEMON_NAME)) {
+        return virNetServerNewPostExecRestart(object,
+                                              name,
+                                              remoteClientNew,
+                                              remoteClientNewPostExecRestart,
+                                              remoteClientPreExecRestart,
+                                              remoteClientFree,
+                                              NULL);
+    } else if (STREQ(name, "admin")) {
+        return virNetServerNewPostExecRestart(object,
+                                              name,
+                                              remoteAdmClientNew,
+                                              remoteAdmClientNewPostExecRestart,
+                                              remoteAdmClientPreExecRestart,
+                                              remoteAdmClientFree,
+                                              dmn);
+    } else {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unexpected server name '%s' during restart"),
+                       name);
+        return NULL;
+    }
+}
+
+
+/*
+ * Loads the state saved by daemonPreExecRestart, if it was saved by
+ * the image this process was executed from.
+ *
+ * Returns 1 and fills @dmn if the state was restored, 0 if there was
+ * no state to restore, -1 on error
+ */
+static int
+daemonPostExecRestart(const char *state_file,
+                      virNetDaemonPtr *dmn)
+{
+    const char *serverNames[] = { DAEMON_NAME, "admin" };
+    const char *gotmagic;
+    char *wantmagic = NULL;
+    char *state = NULL;
+    virJSONValuePtr object = NULL;
+    virJSONValuePtr child;
+    int ret = -1;
+
+    if (!virFileExists(state_file)) {
+        VIR_DEBUG("No restart state file %s present", state_file);
+        return 0;
+    }
+
+    VIR_DEBUG("Running post-restart exec");
+
+    if (virFileReadAll(state_file,
+                       1024 * 1024 * 10, /* 10 MB */
+                       &state) < 0)
+        goto cleanup;
+
+    if (!(object = virJSONValueFromString(state)))
+        goto cleanup;
+
+    if (!(gotmagic = virJSONValueObjectGetString(object, "magic"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Missing magic data in JSON document"));
+        goto cleanup;
+    }
+
+    if (!(wantmagic = daemonGetExecRestartMagic()))
+        goto cleanup;
+
+    if (STRNEQ(gotmagic, wantmagic)) {
+        VIR_WARN("Found restart exec file with old magic %s vs wanted %s",
+                 gotmagic, wantmagic);
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(child = virJSONValueObjectGet(object, "daemon"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed daemon data from JSON file"));
+        goto cleanup;
+    }
+
+    if (!(*dmn = virNetDaemonNewPostExecRestart(child,
+                                                ARRAY_CARDINALITY(serverNames),
+                                                serverNames,
+                                                daemonNewServerPostExecRestart,
+                                                NULL)))
+        goto cleanup;
+
+    ret = 1;
+
+ cleanup:
+    unlink(state_file);
+    VIR_FREE(wantmagic);
+    VIR_FREE(state);
+    virJSONValueFree(object);
+    return ret;
+}
+
+
+static void
+daemonDrainTimer(int timer ATTRIBUTE_UNUSED,
+                 void *opaque ATTRIBUTE_UNUSED)
+{
+    /* Only there to wake up the event loop */
+}
+
+
+/*
+ * Returns the number of clients of @srv which are not quiescent yet,
+ * disconnecting them if @disconnect is true
+ */
+static size_t
+daemonDrainServerClients(virNetServerPtr srv,
+                         bool disconnect)
+{
+    virNetServerClientPtr *clients = NULL;
+    int nclients;
+    size_t busy = 0;
+    size_t i;
+
+    virNetServerProcessClients(srv);
+
+    if ((nclients = virNetServerGetClients(srv, &clients)) < 0)
+        return 0;
+
+    for (i = 0; i < nclients; i++) {
+        if (virNetServerClientIsQuiescent(clients[i]))
+            continue;
+
+        busy++;
+        if (disconnect) {
+            VIR_WARN("Client %llu did not finish its calls in time",
+                     virNetServerClientGetID(clients[i]));
+            virNetServerClientClose(clients[i]);
+        }
+    }
+
+    if (disconnect)
+        virNetServerProcessClients(srv);
+
+    virObjectListFreeCount(clients, nclients);
+    return busy;
+}
+
+
+/*
+ * Stops reading calls from all clients and runs the event loop until
+ * the calls in progress are replied to, so that nothing but their
+ * sockets and private data is left to carry over the exec restart.
+ * Clients whose state cannot be carried, or which do not finish their
+ * calls in time, are disconnected.
+ */
+static void
+daemonDrainClients(virNetDaemonPtr dmn)
+{
+    virNetServerPtr *srvs = NULL;
+    ssize_t nsrvs;
+    unsigned long long now;
+    unsigned long long deadline;
+    int timer;
+    size_t i;
+    size_t j;
+
+    if ((nsrvs = virNetDaemonGetServers(dmn, &srvs)) < 0)
+        return;
+
+    for (i = 0; i < nsrvs; i++) {
+        bool remote = STREQ(virNetServerGetName(srvs[i]), DAEMON_NAME);
+        virNetServerClientPtr *clients = NULL;
+        int nclients;
+
+        if ((nclients = virNetServerGetClients(srvs[i], &clients)) < 0)
+            continue;
+
+        for (j = 0; j < nclients; j++) {
+            if (remote && !remoteClientCanExecRestart(clients[j])) {
+                VIR_DEBUG("Client %llu cannot be preserved",
+                          virNetServerClientGetID(clients[j]));
+                virNetServerClientClose(clients[j]);
+            } else {
+                virNetServerClientQuiesce(clients[j]);
+            }
+        }
+
+        virObjectListFreeCount(clients, nclients);
+    }
+
+    if (virTimeMillisNow(&deadline) < 0)
+        goto cleanup;
+    deadline += DAEMON_EXEC_RESTART_DRAIN_TIMEOUT * 1000ull;
+
+    timer = virEventAddTimeout(100, daemonDrainTimer, NULL, NULL);
+
+    while (true) {
+        bool expired = virTimeMillisNow(&now) < 0 || now >= deadline;
+        size_t busy = 0;
+
+        for (i = 0; i < nsrvs; i++)
+            busy += daemonDrainServerClients(srvs[i], expired);
+
+        if (busy == 0 || expired || timer < 0)
+            break;
+
+        VIR_DEBUG("Waiting for %zu clients to finish their calls", busy);
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+
+ cleanup:
+    virObjectListFreeCount(srvs, nsrvs);
+}
+
+
+static int
+daemonPreExecRestart(const char *state_file,
+                     virNetDaemonPtr dmn,
+                     char **argv)
+{
+    virJSONValuePtr object;
+    virJSONValuePtr child;
+    char *state = NULL;
+    char *magic = NULL;
+    int ret = -1;
+
+    VIR_DEBUG("Running pre-restart exec");
+
+    if (!(object = virJSONValueNewObject()))
+        goto cleanup;
+
+    if (!(child = virNetDaemonPreExecRestart(dmn)))
+        goto cleanup;
+
+    if (virJSONValueObjectAppend(object, "daemon", child) < 0) {
+        virJSONValueFree(child);
+        goto cleanup;
+    }
+
+    if (!(magic = daemonGetExecRestartMagic()))
+        goto cleanup;
+
+    if (virJSONValueObjectAppendString(object, "magic", magic) < 0)
+        goto cleanup;
+
+    if (!(state = virJSONValueToString(object, true)))
+        goto cleanup;
+
+    VIR_DEBUG("Saving state %s", state);
+
+    if (virFileWriteStr(state_file, state, 0600) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to save state file %s"),
+                             state_file);
+        goto cleanup;
+    }
+
+    if (execvp(argv[0], argv) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to restart self"));
+        unlink(state_file);
+        goto cleanup;
+    }
+
+    abort(); /* This should be impossible to reach */
+
+ cleanup:
+    VIR_FREE(magic);
+    VIR_FREE(state);
+    virJSONValueFree(object);
+    return ret;
+}
+
+
 static int migrateProfile(void)
 {
     char *old_base = NULL;
@@ -995,25 +1433,26 @@ daemonUsage(const char *argv0, bool privileged)
                   "      Server private key: %s\n"
                   "\n"
                   "    PID file (unless overridden by -p):\n"
-                  "      %s/run/libvirtd.pid\n"
+                  "      %s/run/%s.pid\n"
                   "\n"),
-                LIBVIRTD_CONFIGURATION_FILE,
-                LIBVIRTD_PRIV_UNIX_SOCKET,
-                LIBVIRTD_PRIV_UNIX_SOCKET_RO,
+                SYSCONFDIR "/libvirt/" DAEMON_NAME ".conf",
+                LOCALSTATEDIR "/run/libvirt/" SOCK_PREFIX "-sock",
+                LOCALSTATEDIR "/run/libvirt/" SOCK_PREFIX "-sock-ro",
                 LIBVIRT_CACERT,
                 LIBVIRT_SERVERCERT,
                 LIBVIRT_SERVERKEY,
-                LOCALSTATEDIR);
+                LOCALSTATEDIR,
+                DAEMON_NAME);
     } else {
-        fprintf(stderr, "%s",
+        fprintf(stderr,
                 _("\n"
                   "  Default paths:\n"
                   "\n"
                   "    Configuration file (unless overridden by -f):\n"
-                  "      $XDG_CONFIG_HOME/libvirt/libvirtd.conf\n"
+                  "      $XDG_CONFIG_HOME/libvirt/%s.conf\n"
                   "\n"
                   "    Sockets:\n"
-                  "      $XDG_RUNTIME_DIR/libvirt/libvirt-sock\n"
+                  "      $XDG_RUNTIME_DIR/libvirt/%s-sock\n"
                   "\n"
                   "    TLS:\n"
                   "      CA certificate:     $HOME/.pki/libvirt/cacert.pem\n"
@@ -1021,8 +1460,9 @@ daemonUsage(const char *argv0, bool privileged)
                   "      Server private key: $HOME/.pki/libvirt/serverkey.pem\n"
                   "\n"
                   "    PID file:\n"
-                  "      $XDG_RUNTIME_DIR/libvirt/libvirtd.pid\n"
-                  "\n"));
+                  "      $XDG_RUNTIME_DIR/libvirt/%s.pid\n"
+                  "\n"),
+                DAEMON_NAME, SOCK_PREFIX, DAEMON_NAME);
     }
 }
 
@@ -1035,11 +1475,13 @@ int main(int argc, char **argv) {
     char *remote_config_file = NULL;
     int statuswrite = -1;
     int ret = 1;
+    int rv;
     int pid_file_fd = -1;
     char *pid_file = NULL;
     char *sock_file = NULL;
     char *sock_file_ro = NULL;
     char *sock_file_adm = NULL;
+    char *state_file = NULL;
     int timeout = -1;        /* -t: Shutdown timeout */
     int verbose = 0;
     int godaemon = 0;
@@ -1192,7 +1634,7 @@ int main(int argc, char **argv) {
     if (!pid_file &&
         virPidFileConstructPath(privileged,
                                 LOCALSTATEDIR,
-                                "libvirtd",
+                                DAEMON_NAME,
                                 &pid_file) < 0) {
         VIR_ERROR(_("Can't determine pid file path."));
         exit(EXIT_FAILURE);
@@ -1212,7 +1654,28 @@ int main(int argc, char **argv) {
               NULLSTR(sock_file_ro),
               NULLSTR(sock_file_adm));
 
-    if (godaemon) {
+    if (daemonExecRestartStatePath(privileged, &state_file) < 0) {
+        VIR_ERROR(_("Can't determine restart state file path"));
+        exit(EXIT_FAILURE);
+    }
+    VIR_DEBUG("Decided on restart state file path '%s'", state_file);
+
+    /* The TLS context of the services cannot be carried over */
+    execRestartAllowed = !(ipsock && config->listen_tls);
+
+    if ((rv = daemonPostExecRestart(state_file, &dmn)) < 0) {
+        VIR_ERROR(_("Can't restore state after re-exec: %s"),
+                  virGetLastErrorMessage());
+        ret = VIR_DAEMON_ERR_REEXEC;
+        goto cleanup;
+    }
+
+    /* rv == 1 means we were re-executed and are already running
+     * in the background, with the servers restored from the state
+     * of the previous image */
+    execRestarted = rv == 1;
+
+    if (godaemon && !execRestarted) {
         char ebuf[1024];
 
         if (chdir("/") < 0) {
@@ -1228,6 +1691,14 @@ int main(int argc, char **argv) {
         }
     }
 
+    /* The logger thread must be started in the final daemon process */
+    if (config->log_async &&
+        virLogSetAsync(true) < 0) {
+        VIR_ERROR(_("Can't start logger thread: %s"),
+                  virGetLastErrorMessage());
+        goto cleanup;
+    }
+
     /* Try to claim the pidfile, exiting if we can't */
     if ((pid_file_fd = virPidFileAcquirePath(pid_file, false, getpid())) < 0) {
         ret = VIR_DAEMON_ERR_PIDFILE;
@@ -1267,33 +1738,58 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
-    if (!(dmn = virNetDaemonNew())) {
-        ret = VIR_DAEMON_ERR_DRIVER;
-        goto cleanup;
-    }
+    if (execRestarted) {
+        if (!(srv = virNetDaemonGetServer(dmn, DAEMON_NAME))) {
+            ret = VIR_DAEMON_ERR_REEXEC;
+            goto cleanup;
+        }
+    } else {
+        if (!(dmn = virNetDaemonNew())) {
+            ret = VIR_DAEMON_ERR_DRIVER;
+            goto cleanup;
+        }
 
-    if (!(srv = virNetServerNew("libvirtd", 1,
-                                config->min_workers,
-                                config->max_workers,
-                                config->prio_workers,
-                                config->max_clients,
-                                config->max_anonymous_clients,
-                                config->keepalive_interval,
-                                config->keepalive_count,
-                                config->mdns_adv ? config->mdns_name : NULL,
-                                remoteClientNew,
-                                NULL,
-                                remoteClientFree,
-                                NULL))) {
-        ret = VIR_DAEMON_ERR_INIT;
-        goto cleanup;
+        if (!(srv = virNetServerNew(DAEMON_NAME, 1,
+                                    config->min_workers,
+                                    config->max_workers,
+                                    config->prio_workers,
+                                    config->max_clients,
+                                    config->max_anonymous_clients,
+                                    config->keepalive_interval,
+                                    config->keepalive_count,
+                                    config->mdns_adv ? config->mdns_name : NULL,
+                                    remoteClientNew,
+                                    remoteClientPreExecRestart,
+                                    remoteClientFree,
+                                    NULL))) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
+
+        if (config->io_loops &&
+            virNetServerSetIOLoops(srv, config->io_loops) < 0) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
+
+        if (virNetDaemonAddServer(dmn, srv) < 0) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
     }
 
-    if (virNetDaemonAddServer(dmn, srv) < 0) {
+    if (config->numa_workers &&
+        remoteSetupNodeWorkers(srv, config->numa_workers) < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
     }
 
+    virNetServerSetRequestRateLimits(srv,
+                                     config->client_request_rate,
+                                     config->client_request_burst,
+                                     config->identity_request_rate,
+                                     config->identity_request_burst);
+
     if (daemonInitialize() < 0) {
         ret = VIR_DAEMON_ERR_INIT;
         goto cleanup;
@@ -1340,26 +1836,33 @@ int main(int argc, char **argv) {
         goto cleanup;
     }
 
-    if (!(srvAdm = virNetServerNew("admin", 1,
-                                   config->admin_min_workers,
-                                   config->admin_max_workers,
-                                   0,
-                                   config->admin_max_clients,
-                                   0,
-                                   config->admin_keepalive_interval,
-                                   config->admin_keepalive_count,
-                                   NULL,
-                                   remoteAdmClientNew,
-                                   NULL,
-                                   remoteAdmClientFree,
-                                   dmn))) {
-        ret = VIR_DAEMON_ERR_INIT;
-        goto cleanup;
-    }
+    if (execRestarted) {
+        if (!(srvAdm = virNetDaemonGetServer(dmn, "admin"))) {
+            ret = VIR_DAEMON_ERR_REEXEC;
+            goto cleanup;
+        }
+    } else {
+        if (!(srvAdm = virNetServerNew("admin", 1,
+                                       config->admin_min_workers,
+                                       config->admin_max_workers,
+                                       0,
+                                       config->admin_max_clients,
+                                       0,
+                                       config->admin_keepalive_interval,
+                                       config->admin_keepalive_count,
+                                       NULL,
+                                       remoteAdmClientNew,
+                                       remoteAdmClientPreExecRestart,
+                                       remoteAdmClientFree,
+                                       dmn))) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
 
-    if (virNetDaemonAddServer(dmn, srvAdm) < 0) {
-        ret = VIR_DAEMON_ERR_INIT;
-        goto cleanup;
+        if (virNetDaemonAddServer(dmn, srvAdm) < 0) {
+            ret = VIR_DAEMON_ERR_INIT;
+            goto cleanup;
+        }
     }
 
     if (!(adminProgram = virNetServerProgramNew(ADMIN_PROGRAM,
@@ -1379,7 +1882,7 @@ int main(int argc, char **argv) {
         virNetDaemonAutoShutdown(dmn, timeout);
     }
 
-    if ((daemonSetupSignals(dmn)) < 0) {
+    if ((daemonSetupSignals(dmn, run_dir)) < 0) {
         ret = VIR_DAEMON_ERR_SIGNAL;
         goto cleanup;
     }
@@ -1414,12 +1917,18 @@ int main(int argc, char **argv) {
     virHookCall(VIR_HOOK_DRIVER_DAEMON, "-", VIR_HOOK_DAEMON_OP_START,
                 0, "start", NULL, NULL);
 
-    if (daemonSetupNetworking(srv, srvAdm,
-                              config,
-                              sock_file,
-                              sock_file_ro,
-                              sock_file_adm,
-                              ipsock, privileged) < 0) {
+    /* The services were restored along with the servers */
+    if (execRestarted) {
+        if (daemonSetupSASL(config, sock_file_ro, ipsock) < 0) {
+            ret = VIR_DAEMON_ERR_NETWORK;
+            goto cleanup;
+        }
+    } else if (daemonSetupNetworking(srv, srvAdm,
+                                     config,
+                                     sock_file,
+                                     sock_file_ro,
+                                     sock_file_adm,
+                                     ipsock, privileged) < 0) {
         ret = VIR_DAEMON_ERR_NETWORK;
         goto cleanup;
     }
@@ -1434,14 +1943,9 @@ int main(int argc, char **argv) {
         VIR_FORCE_CLOSE(statuswrite);
     }
 
-    /* Initialize drivers & then start accepting new clients from network */
-    if (daemonStateInit(dmn) < 0) {
-        ret = VIR_DAEMON_ERR_INIT;
-        goto cleanup;
-    }
-
 #if defined(__linux__) && defined(NETLINK_ROUTE)
-    /* Register the netlink event service for NETLINK_ROUTE */
+    /* Register the netlink event service for NETLINK_ROUTE before the
+     * drivers are initialized, so that they can subscribe to it */
     if (virNetlinkEventServiceStart(NETLINK_ROUTE, 0) < 0) {
         ret = VIR_DAEMON_ERR_NETWORK;
         goto cleanup;
@@ -1456,6 +1960,12 @@ int main(int argc, char **argv) {
     }
 #endif
 
+    /* Initialize drivers & then start accepting new clients from network */
+    if (daemonStateInit(dmn) < 0) {
+        ret = VIR_DAEMON_ERR_INIT;
+        goto cleanup;
+    }
+
     /* Run event loop. */
     virNetDaemonRun(dmn);
 
@@ -1464,6 +1974,24 @@ int main(int argc, char **argv) {
     virHookCall(VIR_HOOK_DRIVER_DAEMON, "-", VIR_HOOK_DAEMON_OP_SHUTDOWN,
                 0, "shutdown", NULL, NULL);
 
+    if (execRestart) {
+        /* Only the clients are carried over to the new image. The
+         * drivers are shut down as usual and recover the state of
+         * their objects when initialized again */
+        daemonDrainClients(dmn);
+
+        virNetlinkEventServiceStopAll();
+
+        driversInitialized = false;
+        virStateCleanup();
+
+        if (daemonPreExecRestart(state_file, dmn, argv) < 0) {
+            VIR_ERROR(_("Unable to re-execute daemon: %s"),
+                      virGetLastErrorMessage());
+            ret = VIR_DAEMON_ERR_REEXEC;
+        }
+    }
+
  cleanup:
     /* Keep cleanup order in inverse order of startup */
     virNetDaemonClose(dmn);
@@ -1504,11 +2032,14 @@ int main(int argc, char **argv) {
     VIR_FREE(sock_file);
     VIR_FREE(sock_file_ro);
     VIR_FREE(sock_file_adm);
+    VIR_FREE(state_file);
 
     VIR_FREE(pid_file);
 
     VIR_FREE(remote_config_file);
     daemonConfigFree(config);
 
+    ignore_value(virLogSetAsync(false));
+
     return ret;
 }
@@ -63,7 +63,18 @@ struct daemonClientPrivate {
     size_t nnodeDeviceEventCallbacks;
     daemonClientEventCallbackPtr *secretEventCallbacks;
     size_t nsecretEventCallbacks;
+    daemonClientEventCallbackPtr *domainStatsCallbacks;
+    size_t ndomainStatsCallbacks;
     bool closeRegistered;
+    bool largeStreamPackets; /* Client accepts large stream packets */
+    bool keepalive; /* Client asked for keepalive */
+
+    /* Events waiting to be sent in a single REMOTE_PROC_EVENT_BATCH */
+    bool eventBatch; /* Client accepts event batches */
+    virNetMessagePtr *eventBatchMsgs;
+    size_t neventBatchMsgs;
+    size_t eventBatchBytes;
+    int eventBatchTimer;
 
 # if WITH_SASL
     virNetSASLSessionPtr sasl;
@@ -81,6 +92,10 @@ struct daemonClientPrivate {
     virConnectPtr secretConn;
     virConnectPtr storageConn;
 
+    /* URI of the connection to reopen once the drivers are
+     * initialized again after an exec restart */
+    char *restartURI;
+
     daemonClientStreamPtr streams;
 };
 
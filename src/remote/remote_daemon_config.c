@@ -79,7 +79,7 @@ int
 daemonConfigFilePath(bool privileged, char **configfile)
 {
     if (privileged) {
-        if (VIR_STRDUP(*configfile, SYSCONFDIR "/libvirt/libvirtd.conf") < 0)
+        if (VIR_STRDUP(*configfile, SYSCONFDIR "/libvirt/" DAEMON_NAME ".conf") < 0)
             goto error;
     } else {
         char *configdir = NULL;
@@ -87,7 +87,7 @@ daemonConfigFilePath(bool privileged, char **configfile)
         if (!(configdir = virGetUserConfigDirectory()))
             goto error;
 
-        if (virAsprintf(configfile, "%s/libvirtd.conf", configdir) < 0) {
+        if (virAsprintf(configfile, "%s/" DAEMON_NAME ".conf", configdir) < 0) {
             VIR_FREE(configdir);
             goto error;
         }
@@ -352,8 +352,22 @@ daemonConfigLoadOptions(struct daemonConfig *data,
     if (virConfGetValueUInt(conf, "prio_workers", &data->prio_workers) < 0)
         goto error;
 
+    if (virConfGetValueUInt(conf, "io_loops", &data->io_loops) < 0)
+        goto error;
+
+    if (virConfGetValueUInt(conf, "numa_workers", &data->numa_workers) < 0)
+        goto error;
+
     if (virConfGetValueUInt(conf, "max_client_requests", &data->max_client_requests) < 0)
         goto error;
+    if (virConfGetValueUInt(conf, "client_request_rate", &data->client_request_rate) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "client_request_burst", &data->client_request_burst) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "identity_request_rate", &data->identity_request_rate) < 0)
+        goto error;
+    if (virConfGetValueUInt(conf, "identity_request_burst", &data->identity_request_burst) < 0)
+        goto error;
 
     if (virConfGetValueUInt(conf, "admin_min_workers", &data->admin_min_workers) < 0)
         goto error;
@@ -382,6 +396,8 @@ daemonConfigLoadOptions(struct daemonConfig *data,
         goto error;
     if (virConfGetValueString(conf, "log_outputs", &data->log_outputs) < 0)
         goto error;
+    if (virConfGetValueBool(conf, "log_async", &data->log_async) < 0)
+        goto error;
 
     if (virConfGetValueInt(conf, "keepalive_interval", &data->keepalive_interval) < 0)
         goto error;
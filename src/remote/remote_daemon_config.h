@@ -26,6 +26,25 @@
 
 # include "internal.h"
 
+/*
+ * The sources are built both into libvirtd and into the daemons
+ * serving a single driver, which name themselves, their sockets and
+ * their configuration file after DAEMON_NAME and load only the driver
+ * module MODULE_NAME. virtproxyd loads no driver at all and forwards
+ * every connection arriving on the libvirtd sockets to them.
+ */
+# ifndef DAEMON_NAME
+#  define DAEMON_NAME "libvirtd"
+#  define SOCK_PREFIX "libvirt"
+#  define ADMIN_SOCK_PREFIX "libvirt"
+# endif
+# ifndef SOCK_PREFIX
+#  define SOCK_PREFIX DAEMON_NAME
+# endif
+# ifndef ADMIN_SOCK_PREFIX
+#  define ADMIN_SOCK_PREFIX DAEMON_NAME
+# endif
+
 struct daemonConfig {
     char *host_uuid;
     char *host_uuid_source;
@@ -70,12 +89,19 @@ struct daemonConfig {
     unsigned int max_anonymous_clients;
 
     unsigned int prio_workers;
+    unsigned int io_loops;
+    unsigned int numa_workers;
 
     unsigned int max_client_requests;
+    unsigned int client_request_rate;
+    unsigned int client_request_burst;
+    unsigned int identity_request_rate;
+    unsigned int identity_request_burst;
 
     unsigned int log_level;
     char *log_filters;
     char *log_outputs;
+    bool log_async;
 
     unsigned int audit_level;
     bool audit_logging;
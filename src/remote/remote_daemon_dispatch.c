@@ -52,6 +52,9 @@
 #include "viraccessapicheckqemu.h"
 #include "virpolkit.h"
 #include "virthreadjob.h"
+#include "virhash.h"
+#include "virnuma.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
@@ -92,6 +95,7 @@ static virSecretPtr get_nonnull_secret(virConnectPtr conn, remote_nonnull_secret
 static virNWFilterPtr get_nonnull_nwfilter(virConnectPtr conn, remote_nonnull_nwfilter nwfilter);
 static virNWFilterBindingPtr get_nonnull_nwfilter_binding(virConnectPtr conn, remote_nonnull_nwfilter_binding binding);
 static virDomainSnapshotPtr get_nonnull_domain_snapshot(virDomainPtr dom, remote_nonnull_domain_snapshot snapshot);
+static virDomainCheckpointPtr get_nonnull_domain_checkpoint(virDomainPtr dom, remote_nonnull_domain_checkpoint checkpoint);
 static virNodeDevicePtr get_nonnull_node_device(virConnectPtr conn, remote_nonnull_node_device dev);
 static void make_nonnull_domain(remote_nonnull_domain *dom_dst, virDomainPtr dom_src);
 static void make_nonnull_network(remote_nonnull_network *net_dst, virNetworkPtr net_src);
@@ -103,6 +107,7 @@ static void make_nonnull_secret(remote_nonnull_secret *secret_dst, virSecretPtr
 static void make_nonnull_nwfilter(remote_nonnull_nwfilter *net_dst, virNWFilterPtr nwfilter_src);
 static void make_nonnull_nwfilter_binding(remote_nonnull_nwfilter_binding *binding_dst, virNWFilterBindingPtr binding_src);
 static void make_nonnull_domain_snapshot(remote_nonnull_domain_snapshot *snapshot_dst, virDomainSnapshotPtr snapshot_src);
+static void make_nonnull_domain_checkpoint(remote_nonnull_domain_checkpoint *checkpoint_dst, virDomainCheckpointPtr checkpoint_src);
 
 static int
 remoteSerializeDomainDiskErrors(virDomainDiskErrorPtr errors,
@@ -115,6 +120,188 @@ remoteSerializeDomainDiskErrors(virDomainDiskErrorPtr errors,
 #include "remote_daemon_dispatch_lxc_stubs.h"
 
 
+/* Events queued for a client are sent in a single batch at most
+ * this many milliseconds after the first of them was queued */
+#define REMOTE_EVENT_BATCH_WINDOW 10
+
+/* Bytes of events after which a batch is sent right away */
+#define REMOTE_EVENT_BATCH_BYTES (256 * 1024)
+
+
+/*
+ * Sends the events queued for @client, on their own if there is a
+ * single one. Events are sent under priv->lock, which keeps them
+ * in order with events sent without batching.
+ */
+static void
+remoteEventBatchFlushLocked(virNetServerClientPtr client,
+                            struct daemonClientPrivate *priv)
+{
+    virNetMessagePtr msg = NULL;
+    remote_event_batch_msg data;
+    size_t i;
+
+    memset(&data, 0, sizeof(data));
+
+    if (priv->neventBatchMsgs == 0)
+        return;
+
+    if (priv->eventBatchTimer >= 0)
+        virEventUpdateTimeout(priv->eventBatchTimer, -1);
+
+    if (priv->neventBatchMsgs == 1) {
+        VIR_DEBUG("Queue event %d %zu", priv->eventBatchMsgs[0]->header.proc,
+                  priv->eventBatchMsgs[0]->bufferLength);
+        if (virNetServerClientSendMessage(client, priv->eventBatchMsgs[0]) == 0)
+            priv->eventBatchMsgs[0] = NULL;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(data.events.events_val, priv->neventBatchMsgs) < 0)
+        goto cleanup;
+    data.events.events_len = priv->neventBatchMsgs;
+
+    for (i = 0; i < priv->neventBatchMsgs; i++) {
+        remote_event_batch_event *event = &data.events.events_val[i];
+
+        event->msg.msg_val = priv->eventBatchMsgs[i]->buffer;
+        event->msg.msg_len = priv->eventBatchMsgs[i]->bufferLength;
+    }
+
+    if (!(msg = virNetMessageNew(false)))
+        goto cleanup;
+
+    msg->header.prog = virNetServerProgramGetID(remoteProgram);
+    msg->header.vers = virNetServerProgramGetVersion(remoteProgram);
+    msg->header.proc = REMOTE_PROC_EVENT_BATCH;
+    msg->header.type = VIR_NET_MESSAGE;
+    msg->header.serial = 1;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t)xdr_remote_event_batch_msg,
+                                   &data) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Queue batch of %zu events %zu",
+              priv->neventBatchMsgs, msg->bufferLength);
+    if (virNetServerClientSendMessage(client, msg) < 0)
+        goto cleanup;
+    msg = NULL;
+
+ cleanup:
+    virNetMessageFree(msg);
+    VIR_FREE(data.events.events_val);
+    for (i = 0; i < priv->neventBatchMsgs; i++)
+        virNetMessageFree(priv->eventBatchMsgs[i]);
+    VIR_FREE(priv->eventBatchMsgs);
+    priv->neventBatchMsgs = 0;
+    priv->eventBatchBytes = 0;
+}
+
+
+static void
+remoteEventBatchTimer(int timer ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    virNetServerClientPtr client = opaque;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    virMutexLock(&priv->lock);
+    remoteEventBatchFlushLocked(client, priv);
+    virMutexUnlock(&priv->lock);
+}
+
+
+/*
+ * Queues @msg to be sent to @client in a batch, or sends it right
+ * away if the client does not accept batches or @msg is too large.
+ * Takes ownership of @msg on success.
+ *
+ * Returns 0 on success, -1 on error
+ */
+static int
+remoteEventBatchSend(virNetServerClientPtr client,
+                     virNetServerProgramPtr program,
+                     virNetMessagePtr msg)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    size_t len;
+    int ret = -1;
+
+    virMutexLock(&priv->lock);
+
+    if (!priv->eventBatch || program != remoteProgram ||
+        msg->bufferLength >= REMOTE_EVENT_BATCH_BYTES) {
+        remoteEventBatchFlushLocked(client, priv);
+        goto send;
+    }
+
+    if (priv->eventBatchTimer < 0) {
+        virObjectRef(client);
+        if ((priv->eventBatchTimer =
+             virEventAddTimeout(-1, remoteEventBatchTimer, client,
+                                virObjectFreeCallback)) < 0) {
+            virObjectUnref(client);
+            priv->eventBatch = false;
+            goto send;
+        }
+    }
+
+    if (priv->eventBatchBytes + msg->bufferLength > REMOTE_EVENT_BATCH_BYTES)
+        remoteEventBatchFlushLocked(client, priv);
+
+    len = msg->bufferLength;
+    if (VIR_APPEND_ELEMENT(priv->eventBatchMsgs, priv->neventBatchMsgs,
+                           msg) < 0)
+        goto cleanup;
+    priv->eventBatchBytes += len;
+
+    if (priv->neventBatchMsgs == REMOTE_EVENT_BATCH_EVENTS_MAX)
+        remoteEventBatchFlushLocked(client, priv);
+    else if (priv->neventBatchMsgs == 1)
+        virEventUpdateTimeout(priv->eventBatchTimer,
+                              REMOTE_EVENT_BATCH_WINDOW);
+
+    ret = 0;
+    goto cleanup;
+
+ send:
+    VIR_DEBUG("Queue event %d %zu", msg->header.proc, msg->bufferLength);
+    if (virNetServerClientSendMessage(client, msg) < 0)
+        goto cleanup;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&priv->lock);
+    return ret;
+}
+
+
+/*
+ * Sends the events still queued for @client and stops batching
+ * any further ones.
+ */
+static void
+remoteEventBatchStop(virNetServerClientPtr client,
+                     struct daemonClientPrivate *priv)
+{
+    virMutexLock(&priv->lock);
+    remoteEventBatchFlushLocked(client, priv);
+    priv->eventBatch = false;
+    if (priv->eventBatchTimer >= 0) {
+        virEventRemoveTimeout(priv->eventBatchTimer);
+        priv->eventBatchTimer = -1;
+    }
+    virMutexUnlock(&priv->lock);
+}
+
+
 /* Prototypes */
 static void
 remoteDispatchObjectEventSend(virNetServerClientPtr client,
@@ -1610,6 +1797,67 @@ static virConnectSecretEventGenericCallback secretEventCallbacks[] = {
     VIR_SECRET_EVENT_CALLBACK(remoteRelaySecretEventValueChanged),
 };
 
+static void
+remoteRelayDomainStats(virConnectPtr conn,
+                       virDomainStatsRecordPtr *stats,
+                       int nstats,
+                       void *opaque)
+{
+    daemonClientEventCallbackPtr callback = opaque;
+    remote_domain_event_stats_msg data;
+    size_t i;
+
+    if (callback->callbackID < 0)
+        return;
+
+    VIR_DEBUG("Relaying %d domain stats records, callback %d",
+              nstats, callback->callbackID);
+
+    /* build return data */
+    memset(&data, 0, sizeof(data));
+    data.callbackID = callback->callbackID;
+
+    if (nstats > REMOTE_DOMAIN_LIST_MAX) {
+        VIR_WARN("Dropping %d domain stats records exceeding max limit %d",
+                 nstats - REMOTE_DOMAIN_LIST_MAX, REMOTE_DOMAIN_LIST_MAX);
+        nstats = REMOTE_DOMAIN_LIST_MAX;
+    }
+
+    if (VIR_ALLOC_N(data.retStats.retStats_val, nstats) < 0)
+        return;
+
+    /* Only pass on the domains the client is allowed to see */
+    for (i = 0; i < nstats; i++) {
+        remote_domain_stats_record *dst;
+
+        if (!remoteRelayDomainEventCheckACL(callback->client, conn,
+                                            stats[i]->dom))
+            continue;
+
+        dst = data.retStats.retStats_val + data.retStats.retStats_len;
+        make_nonnull_domain(&dst->dom, stats[i]->dom);
+        data.retStats.retStats_len++;
+
+        if (virTypedParamsSerialize(stats[i]->params, stats[i]->nparams,
+                                    (virTypedParameterRemotePtr *) &dst->params.params_val,
+                                    &dst->params.params_len,
+                                    VIR_TYPED_PARAM_STRING_OKAY) < 0)
+            goto cleanup;
+    }
+
+    if (data.retStats.retStats_len)
+        remoteDispatchObjectEventSend(callback->client, remoteProgram,
+                                      REMOTE_PROC_DOMAIN_EVENT_STATS,
+                                      (xdrproc_t)xdr_remote_domain_event_stats_msg,
+                                      &data);
+    else
+        VIR_FREE(data.retStats.retStats_val);
+    return;
+
+ cleanup:
+    xdr_free((xdrproc_t)xdr_remote_domain_event_stats_msg, (char *) &data);
+}
+
 verify(ARRAY_CARDINALITY(secretEventCallbacks) == VIR_SECRET_EVENT_ID_LAST);
 
 static void
@@ -1721,6 +1969,9 @@ remoteClientFreePrivateCallbacks(struct daemonClientPrivate *priv)
     DEREG_CB(priv->conn, priv->qemuEventCallbacks,
              priv->nqemuEventCallbacks,
              virConnectDomainQemuMonitorEventDeregister, "qemu monitor");
+    DEREG_CB(priv->conn, priv->domainStatsCallbacks,
+             priv->ndomainStatsCallbacks,
+             virConnectDomainStatsDeregister, "domain stats");
 
     if (priv->closeRegistered && priv->conn) {
         if (virConnectUnregisterCloseCallback(priv->conn,
@@ -1760,6 +2011,7 @@ void remoteClientFree(void *data)
     if (priv->storageConn)
         virConnectClose(priv->storageConn);
 
+    VIR_FREE(priv->restartURI);
     VIR_FREE(priv);
 }
 
@@ -1771,6 +2023,8 @@ static void remoteClientCloseFunc(virNetServerClientPtr client)
     daemonRemoveAllClientStreams(priv->streams);
 
     remoteClientFreePrivateCallbacks(priv);
+
+    remoteEventBatchStop(client, priv);
 }
 
 
@@ -1788,10 +2042,265 @@ void *remoteClientNew(virNetServerClientPtr client,
         return NULL;
     }
 
+    priv->eventBatchTimer = -1;
+
     virNetServerClientSetCloseHook(client, remoteClientCloseFunc);
     return priv;
 }
 
+
+/*
+ * Only the connection opened by the client and the features it asked
+ * for are carried over an exec restart. Clients relying on any other
+ * state, which the new daemon could not recreate transparently, have
+ * to reconnect.
+ */
+bool remoteClientCanExecRestart(virNetServerClientPtr client)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    bool ret = false;
+
+    if (virNetServerClientHasTLSSession(client))
+        return false;
+#if WITH_SASL
+    if (virNetServerClientHasSASLSession(client))
+        return false;
+#endif
+
+    virMutexLock(&priv->lock);
+
+#if WITH_SASL
+    if (priv->sasl)
+        goto cleanup;
+#endif
+
+    if (priv->streams ||
+        priv->closeRegistered ||
+        priv->ndomainEventCallbacks ||
+        priv->nnetworkEventCallbacks ||
+        priv->nqemuEventCallbacks ||
+        priv->nstorageEventCallbacks ||
+        priv->nnodeDeviceEventCallbacks ||
+        priv->nsecretEventCallbacks ||
+        priv->ndomainStatsCallbacks)
+        goto cleanup;
+
+    ret = true;
+
+ cleanup:
+    virMutexUnlock(&priv->lock);
+    return ret;
+}
+
+
+virJSONValuePtr remoteClientPreExecRestart(virNetServerClientPtr client,
+                                           void *opaque ATTRIBUTE_UNUSED)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virJSONValuePtr object = NULL;
+    char *uri = NULL;
+
+    if (!remoteClientCanExecRestart(client)) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("client state cannot be preserved across restart"));
+        return NULL;
+    }
+
+    virMutexLock(&priv->lock);
+
+    if (!(object = virJSONValueNewObject()))
+        goto error;
+
+    if (priv->conn) {
+        if (!(uri = virConnectGetURI(priv->conn)))
+            goto error;
+
+        if (virJSONValueObjectAppendString(object, "uri", uri) < 0)
+            goto error;
+    }
+
+    if (virJSONValueObjectAppendBoolean(object, "keepalive",
+                                        priv->keepalive) < 0 ||
+        virJSONValueObjectAppendBoolean(object, "largeStreamPackets",
+                                        priv->largeStreamPackets) < 0 ||
+        virJSONValueObjectAppendBoolean(object, "eventBatch",
+                                        priv->eventBatch) < 0)
+        goto error;
+
+    virMutexUnlock(&priv->lock);
+    VIR_FREE(uri);
+    return object;
+
+ error:
+    virMutexUnlock(&priv->lock);
+    virJSONValueFree(object);
+    VIR_FREE(uri);
+    return NULL;
+}
+
+
+void *remoteClientNewPostExecRestart(virNetServerClientPtr client,
+                                     virJSONValuePtr object,
+                                     void *opaque)
+{
+    struct daemonClientPrivate *priv;
+    const char *uri;
+
+    if (!(priv = remoteClientNew(client, opaque)))
+        return NULL;
+
+    if ((uri = virJSONValueObjectGetString(object, "uri")) &&
+        VIR_STRDUP(priv->restartURI, uri) < 0)
+        goto error;
+
+    ignore_value(virJSONValueObjectGetBoolean(object, "keepalive",
+                                              &priv->keepalive));
+    ignore_value(virJSONValueObjectGetBoolean(object, "largeStreamPackets",
+                                              &priv->largeStreamPackets));
+    ignore_value(virJSONValueObjectGetBoolean(object, "eventBatch",
+                                              &priv->eventBatch));
+
+    /* Calls can only be served once the drivers are initialized
+     * and the connection is restored, see remoteClientRestore */
+    virNetServerClientQuiesce(client);
+
+    return priv;
+
+ error:
+    remoteClientFree(priv);
+    return NULL;
+}
+
+
+/*
+ * Connection to the @scheme secondary driver for a client whose
+ * primary connection @conn lacks it, as in the daemons serving a
+ * single hypervisor driver. The connection goes to the daemon
+ * serving that driver and is shared with the other clients having
+ * the same access. Calls of the client are failed by @conn itself
+ * if no such daemon is running.
+ */
+static virConnectPtr
+remoteOpenSecondaryConn(virConnectPtr conn,
+                        bool local,
+                        const char *scheme,
+                        bool readonly)
+{
+    virConnectPtr ret = NULL;
+    char *uri = NULL;
+
+    if (local)
+        return virObjectRef(conn);
+
+    if (virAsprintf(&uri, "%s:///%s?shared=1", scheme,
+                    geteuid() == 0 ? "system" : "session") == 0)
+        ret = readonly ? virConnectOpenReadOnly(uri) : virConnectOpen(uri);
+
+    if (!ret) {
+        VIR_DEBUG("Cannot reach the %s driver: %s",
+                  scheme, virGetLastErrorMessage());
+        virResetLastError();
+        ret = virObjectRef(conn);
+    }
+
+    VIR_FREE(uri);
+    return ret;
+}
+
+
+/*
+ * Set the connections used for the secondary drivers of the client
+ * @priv. A client of a secondary driver only ever uses that one, so
+ * its connection serves all of them.
+ */
+static void
+remoteClientOpenSecondaryConns(daemonClientPrivatePtr priv,
+                               bool readonly)
+{
+    virConnectPtr conn = priv->conn;
+    const char *scheme = conn->uri ? conn->uri->scheme : NULL;
+    bool secondary = STREQ_NULLABLE(scheme, "interface") ||
+        STREQ_NULLABLE(scheme, "network") ||
+        STREQ_NULLABLE(scheme, "nodedev") ||
+        STREQ_NULLABLE(scheme, "nwfilter") ||
+        STREQ_NULLABLE(scheme, "secret") ||
+        STREQ_NULLABLE(scheme, "storage");
+
+    priv->interfaceConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->interfaceDriver,
+                                "interface", readonly);
+    priv->networkConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->networkDriver,
+                                "network", readonly);
+    priv->nodedevConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->nodeDeviceDriver,
+                                "nodedev", readonly);
+    priv->nwfilterConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->nwfilterDriver,
+                                "nwfilter", readonly);
+    priv->secretConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->secretDriver,
+                                "secret", readonly);
+    priv->storageConn =
+        remoteOpenSecondaryConn(conn, secondary || conn->storageDriver,
+                                "storage", readonly);
+}
+
+
+/*
+ * Reopens the connection of a client carried over an exec restart,
+ * and then resumes serving its calls.
+ */
+int remoteClientRestore(virNetServerClientPtr client)
+{
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+    virIdentityPtr identity = NULL;
+    int ret = -1;
+
+    virMutexLock(&priv->lock);
+
+    if (priv->restartURI) {
+        if (!(identity = virNetServerClientGetIdentity(client)))
+            goto cleanup;
+
+        if (virIdentitySetCurrent(identity) < 0)
+            goto cleanup;
+
+        VIR_DEBUG("Reopening connection to %s", priv->restartURI);
+        priv->conn =
+            virNetServerClientGetReadonly(client)
+            ? virConnectOpenReadOnly(priv->restartURI)
+            : virConnectOpen(priv->restartURI);
+
+        ignore_value(virIdentitySetCurrent(NULL));
+
+        if (!priv->conn)
+            goto cleanup;
+
+        remoteClientOpenSecondaryConns(priv,
+                                       virNetServerClientGetReadonly(client));
+
+        VIR_FREE(priv->restartURI);
+    }
+
+    if (priv->keepalive &&
+        virNetServerClientStartKeepAlive(client) < 0)
+        goto cleanup;
+
+    if (virNetServerClientResume(client) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&priv->lock);
+    virObjectUnref(identity);
+    return ret;
+}
+
 /*----- Functions. -----*/
 
 static int
@@ -1831,12 +2340,7 @@ remoteDispatchConnectOpen(virNetServerPtr server ATTRIBUTE_UNUSED,
     if (priv->conn == NULL)
         goto cleanup;
 
-    priv->interfaceConn = virObjectRef(priv->conn);
-    priv->networkConn = virObjectRef(priv->conn);
-    priv->nodedevConn = virObjectRef(priv->conn);
-    priv->nwfilterConn = virObjectRef(priv->conn);
-    priv->secretConn = virObjectRef(priv->conn);
-    priv->storageConn = virObjectRef(priv->conn);
+    remoteClientOpenSecondaryConns(priv, flags & VIR_CONNECT_RO);
 
     /* force update the @readonly attribute which was inherited from the
      * virNetServerService object - this is important for sockets that are RW
@@ -4074,8 +4578,7 @@ remoteDispatchObjectEventSend(virNetServerClientPtr client,
     if (virNetMessageEncodePayload(msg, proc, data) < 0)
         goto cleanup;
 
-    VIR_DEBUG("Queue event %d %zu", procnr, msg->bufferLength);
-    if (virNetServerClientSendMessage(client, msg) < 0)
+    if (remoteEventBatchSend(client, program, msg) < 0)
         goto cleanup;
 
     xdr_free(proc, data);
@@ -4252,6 +4755,7 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
     struct daemonClientPrivate *priv =
         virNetServerClientGetPrivateData(client);
     virDomainPtr dom = NULL;
+    int eventID = args->eventID & ~VIR_DOMAIN_EVENT_ID_FLAG_COALESCE;
 
     if (!priv->conn) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
@@ -4264,7 +4768,7 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
         !(dom = get_nonnull_domain(priv->conn, *args->dom)))
         goto cleanup;
 
-    if (args->eventID >= VIR_DOMAIN_EVENT_ID_LAST || args->eventID < 0) {
+    if (eventID >= VIR_DOMAIN_EVENT_ID_LAST || eventID < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, _("unsupported event ID %d"),
                        args->eventID);
         goto cleanup;
@@ -4279,7 +4783,7 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
     if (VIR_ALLOC(callback) < 0)
         goto cleanup;
     callback->client = virObjectRef(client);
-    callback->eventID = args->eventID;
+    callback->eventID = eventID;
     callback->callbackID = -1;
     ref = callback;
     if (VIR_APPEND_ELEMENT(priv->domainEventCallbacks,
@@ -4290,7 +4794,7 @@ remoteDispatchConnectDomainEventCallbackRegisterAny(virNetServerPtr server ATTRI
     if ((callbackID = virConnectDomainEventRegisterAny(priv->conn,
                                                        dom,
                                                        args->eventID,
-                                                       domainEventCallbacks[args->eventID],
+                                                       domainEventCallbacks[eventID],
                                                        ref,
                                                        remoteEventCallbackFree)) < 0) {
         VIR_SHRINK_N(priv->domainEventCallbacks,
@@ -4722,6 +5226,9 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
     if (args->feature == VIR_DRV_FEATURE_PROGRAM_KEEPALIVE) {
         if (virNetServerClientStartKeepAlive(client) < 0)
             goto cleanup;
+        virMutexLock(&priv->lock);
+        priv->keepalive = true;
+        virMutexUnlock(&priv->lock);
         supported = 1;
         goto done;
     }
@@ -4735,7 +5242,31 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
     case VIR_DRV_FEATURE_FD_PASSING:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+        supported = 1;
+        break;
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
+        /* Only clients which can receive large packets ask for this */
+        virMutexLock(&priv->lock);
+        priv->largeStreamPackets = true;
+        virMutexUnlock(&priv->lock);
+        supported = 1;
+        break;
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
+        /* Only clients which can unpack event batches ask for this */
+        virMutexLock(&priv->lock);
+        priv->eventBatch = true;
+        virMutexUnlock(&priv->lock);
+        supported = 1;
+        break;
+    case VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION:
+        /* Only clients which can decompress replies ask for this */
+#if WITH_ZSTD
+        virNetServerClientSetPayloadCompression(client, true);
         supported = 1;
+#else
+        supported = 0;
+#endif
         break;
     case VIR_DRV_FEATURE_MIGRATION_V1:
     case VIR_DRV_FEATURE_REMOTE:
@@ -4769,12 +5300,80 @@ static int remoteDispatchConnectSupportsFeature(virNetServerPtr server ATTRIBUTE
 
 
 static int
-remoteDispatchDomainOpenGraphics(virNetServerPtr server ATTRIBUTE_UNUSED,
-                                 virNetServerClientPtr client ATTRIBUTE_UNUSED,
-                                 virNetMessagePtr msg,
-                                 virNetMessageErrorPtr rerr,
-                                 remote_domain_open_graphics_args *args)
-{
+remoteDispatchConnectBatch(virNetServerPtr server,
+                           virNetServerClientPtr client,
+                           virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                           virNetMessageErrorPtr rerr,
+                           remote_connect_batch_args *args)
+{
+    virNetMessagePtr *calls = NULL;
+    size_t ncalls = 0;
+    size_t i;
+    int rv = -1;
+
+    if (VIR_ALLOC_N(calls, args->calls.calls_len) < 0)
+        goto cleanup;
+
+    /* Validate all the calls upfront, so that the batch is either
+     * rejected as a whole, or each of its calls gets a reply */
+    for (i = 0; i < args->calls.calls_len; i++) {
+        remote_connect_batch_call *call = &args->calls.calls_val[i];
+
+        if (!(calls[ncalls] = virNetMessageNew(false)))
+            goto cleanup;
+        ncalls++;
+
+        if (virNetMessageDecodeRaw(calls[i], call->msg.msg_val,
+                                   call->msg.msg_len) < 0)
+            goto cleanup;
+
+        /* File descriptors and stream data can only be sent
+         * in their own message */
+        if (calls[i]->header.type != VIR_NET_CALL) {
+            virReportError(VIR_ERR_RPC,
+                           _("unexpected message type %d in batched call %zu"),
+                           calls[i]->header.type, i);
+            goto cleanup;
+        }
+
+        if (calls[i]->header.prog == REMOTE_PROGRAM &&
+            calls[i]->header.proc == REMOTE_PROC_CONNECT_BATCH) {
+            virReportError(VIR_ERR_RPC,
+                           _("batched call %zu cannot be a batch itself"), i);
+            goto cleanup;
+        }
+    }
+
+    /* Each call replies on its own as soon as it is done. Running
+     * them in this worker one after another keeps a batch from
+     * taking more than its single share of the worker pool */
+    for (i = 0; i < ncalls; i++) {
+        if (virNetServerDispatchMessage(server, client, calls[i]) < 0) {
+            virNetServerClientClose(client);
+            goto cleanup;
+        }
+        calls[i] = NULL;
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    for (i = 0; i < ncalls; i++)
+        virNetMessageFree(calls[i]);
+    VIR_FREE(calls);
+    return rv;
+}
+
+
+static int
+remoteDispatchDomainOpenGraphics(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                 virNetServerClientPtr client ATTRIBUTE_UNUSED,
+                                 virNetMessagePtr msg,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_domain_open_graphics_args *args)
+{
     virDomainPtr dom = NULL;
     int rv = -1;
     int fd = -1;
@@ -5543,6 +6142,173 @@ remoteDispatchDomainMigratePerform3Params(virNetServerPtr server ATTRIBUTE_UNUSE
 }
 
 
+static int
+remoteDispatchConnectListAllDomainsPage(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                        virNetServerClientPtr client,
+                                        virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                        virNetMessageErrorPtr rerr,
+                                        remote_connect_list_all_domains_page_args *args,
+                                        remote_connect_list_all_domains_page_ret *ret)
+{
+    virDomainPtr *doms = NULL;
+    char *next = NULL;
+    int ndoms = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    /* The client is told to keep going as long as there is a cursor,
+     * so a page too large for the protocol can simply be cut short */
+    if ((ndoms = virConnectListAllDomainsPage(priv->conn,
+                                              args->prefix ? *args->prefix : NULL,
+                                              args->cursor ? *args->cursor : NULL,
+                                              MIN(args->maxdomains,
+                                                  REMOTE_DOMAIN_LIST_MAX),
+                                              &doms, &next, args->flags)) < 0)
+        goto cleanup;
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(ret->domains.domains_val, ndoms) < 0)
+            goto cleanup;
+        ret->domains.domains_len = ndoms;
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(ret->domains.domains_val + i, doms[i]);
+    }
+
+    if (next) {
+        if (VIR_ALLOC(ret->next) < 0)
+            goto cleanup;
+        VIR_STEAL_PTR(*ret->next, next);
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectListFreeCount(doms, ndoms);
+    VIR_FREE(next);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectGetDomainsChangedSince(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                            virNetServerClientPtr client,
+                                            virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                            virNetMessageErrorPtr rerr,
+                                            remote_connect_get_domains_changed_since_args *args,
+                                            remote_connect_get_domains_changed_since_ret *ret)
+{
+    virDomainPtr *doms = NULL;
+    unsigned long long generation;
+    int ndoms = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if ((ndoms = virConnectGetDomainsChangedSince(priv->conn, args->generation,
+                                                  &generation, &doms,
+                                                  args->flags)) < 0)
+        goto cleanup;
+
+    /* Like a forgotten generation, this makes the client start over */
+    if (ndoms > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_OPERATION_INVALID,
+                       _("Too many changed domains '%d' for limit '%d'"),
+                       ndoms, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(ret->changed.changed_val, ndoms) < 0)
+            goto cleanup;
+        ret->changed.changed_len = ndoms;
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(ret->changed.changed_val + i, doms[i]);
+    }
+
+    ret->generation = generation;
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectListFreeCount(doms, ndoms);
+    return rv;
+}
+
+
+static int
+remoteDispatchConnectMigrateDomains(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                    virNetServerClientPtr client,
+                                    virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                    virNetMessageErrorPtr rerr,
+                                    remote_connect_migrate_domains_args *args)
+{
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    size_t i;
+    int rv = -1;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->params.params_len > REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many migration parameters '%d' for limit '%d'"),
+                       args->params.params_len, REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->doms.doms_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(priv->conn, args->doms.doms_val[i])))
+            goto cleanup;
+        ndoms++;
+    }
+
+    if (virTypedParamsDeserialize((virTypedParameterRemotePtr) args->params.params_val,
+                                  args->params.params_len,
+                                  0, &params, &nparams) < 0)
+        goto cleanup;
+
+    if (virConnectMigrateDomains(priv->conn, doms, ndoms, args->dconnuri,
+                                 params, nparams, args->concurrency,
+                                 args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virObjectListFree(doms);
+    return rv;
+}
+
+
 static int
 remoteDispatchDomainMigrateFinish3Params(virNetServerPtr server ATTRIBUTE_UNUSED,
                                          virNetServerClientPtr client ATTRIBUTE_UNUSED,
@@ -6289,6 +7055,111 @@ remoteDispatchConnectSecretEventDeregisterAny(virNetServerPtr server ATTRIBUTE_U
     return rv;
 }
 
+static int
+remoteDispatchConnectDomainStatsRegister(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                         virNetServerClientPtr client,
+                                         virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                         virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                         remote_connect_domain_stats_register_args *args,
+                                         remote_connect_domain_stats_register_ret *ret)
+{
+    int callbackID;
+    int rv = -1;
+    daemonClientEventCallbackPtr callback = NULL;
+    daemonClientEventCallbackPtr ref;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    virMutexLock(&priv->lock);
+
+    /* See remoteDispatchConnectSecretEventRegisterAny for why the
+     * incomplete callback is appended before registering */
+    if (VIR_ALLOC(callback) < 0)
+        goto cleanup;
+    callback->client = virObjectRef(client);
+    callback->callbackID = -1;
+    ref = callback;
+    if (VIR_APPEND_ELEMENT(priv->domainStatsCallbacks,
+                           priv->ndomainStatsCallbacks,
+                           callback) < 0)
+        goto cleanup;
+
+    if ((callbackID = virConnectDomainStatsRegister(priv->conn,
+                                                    args->stats,
+                                                    args->interval,
+                                                    remoteRelayDomainStats,
+                                                    ref,
+                                                    remoteEventCallbackFree,
+                                                    args->flags)) < 0) {
+        VIR_SHRINK_N(priv->domainStatsCallbacks,
+                     priv->ndomainStatsCallbacks, 1);
+        callback = ref;
+        goto cleanup;
+    }
+
+    ref->callbackID = callbackID;
+    ret->callbackID = callbackID;
+
+    rv = 0;
+
+ cleanup:
+    remoteEventCallbackFree(callback);
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
+static int
+remoteDispatchConnectDomainStatsDeregister(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                           virNetServerClientPtr client,
+                                           virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                           virNetMessageErrorPtr rerr ATTRIBUTE_UNUSED,
+                                           remote_connect_domain_stats_deregister_args *args)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv =
+        virNetServerClientGetPrivateData(client);
+
+    if (!priv->conn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    virMutexLock(&priv->lock);
+
+    for (i = 0; i < priv->ndomainStatsCallbacks; i++) {
+        if (priv->domainStatsCallbacks[i]->callbackID == args->callbackID)
+            break;
+    }
+    if (i == priv->ndomainStatsCallbacks) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("domain stats callback %d not registered"),
+                       args->callbackID);
+        goto cleanup;
+    }
+
+    if (virConnectDomainStatsDeregister(priv->conn, args->callbackID) < 0)
+        goto cleanup;
+
+    VIR_DELETE_ELEMENT(priv->domainStatsCallbacks, i,
+                       priv->ndomainStatsCallbacks);
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    virMutexUnlock(&priv->lock);
+    return rv;
+}
+
 static int
 qemuDispatchConnectDomainMonitorEventRegister(virNetServerPtr server ATTRIBUTE_UNUSED,
                                               virNetServerClientPtr client,
@@ -6628,18 +7499,166 @@ remoteDispatchNetworkGetDHCPLeases(virNetServerPtr server ATTRIBUTE_UNUSED,
 
 
 static int
-remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
-                                       virNetServerClientPtr client,
-                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
-                                       virNetMessageErrorPtr rerr,
-                                       remote_connect_get_all_domain_stats_args *args,
-                                       remote_connect_get_all_domain_stats_ret *ret)
+remoteDispatchConnectGetAllDHCPLeases(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                      virNetServerClientPtr client,
+                                      virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                      virNetMessageErrorPtr rerr,
+                                      remote_connect_get_all_dhcp_leases_args *args,
+                                      remote_connect_get_all_dhcp_leases_ret *ret)
 {
     int rv = -1;
     size_t i;
     struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
-    virDomainStatsRecordPtr *retStats = NULL;
-    int nrecords = 0;
+    virNetworkDHCPLeasePtr *leases = NULL;
+    virNetworkPtr *nets = NULL;
+    const char **macs = NULL;
+    int nleases = 0;
+
+    if (!priv->networkConn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->nets.nets_len > REMOTE_NETWORK_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many networks '%u' for limit '%d'"),
+                       args->nets.nets_len, REMOTE_NETWORK_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (args->macs.macs_len > REMOTE_NETWORK_DHCP_LEASES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many MAC addresses '%u' for limit '%d'"),
+                       args->macs.macs_len, REMOTE_NETWORK_DHCP_LEASES_MAX);
+        goto cleanup;
+    }
+
+    if (args->nets.nets_len) {
+        if (VIR_ALLOC_N(nets, args->nets.nets_len + 1) < 0)
+            goto cleanup;
+
+        for (i = 0; i < args->nets.nets_len; i++) {
+            if (!(nets[i] = get_nonnull_network(priv->networkConn,
+                                                args->nets.nets_val[i])))
+                goto cleanup;
+        }
+    }
+
+    if (args->macs.macs_len) {
+        if (VIR_ALLOC_N(macs, args->macs.macs_len + 1) < 0)
+            goto cleanup;
+
+        for (i = 0; i < args->macs.macs_len; i++)
+            macs[i] = args->macs.macs_val[i];
+    }
+
+    if ((nleases = virConnectGetAllDHCPLeases(priv->networkConn, nets, macs,
+                                              &leases, args->flags)) < 0)
+        goto cleanup;
+
+    if (nleases > REMOTE_NETWORK_DHCP_LEASES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of leases is %d, which exceeds max limit: %d"),
+                       nleases, REMOTE_NETWORK_DHCP_LEASES_MAX);
+        goto cleanup;
+    }
+
+    if (nleases) {
+        if (VIR_ALLOC_N(ret->leases.leases_val, nleases) < 0)
+            goto cleanup;
+
+        ret->leases.leases_len = nleases;
+
+        for (i = 0; i < nleases; i++) {
+            if (remoteSerializeDHCPLease(ret->leases.leases_val + i, leases[i]) < 0)
+                goto cleanup;
+        }
+    }
+
+    ret->ret = nleases;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    if (leases && nleases > 0)
+        for (i = 0; i < nleases; i++)
+            virNetworkDHCPLeaseFree(leases[i]);
+    VIR_FREE(leases);
+    if (nets) {
+        for (i = 0; i < args->nets.nets_len; i++)
+            virObjectUnref(nets[i]);
+        VIR_FREE(nets);
+    }
+    VIR_FREE(macs);
+    return rv;
+}
+
+
+static int
+remoteDispatchNetworkUpdateBatch(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                 virNetServerClientPtr client,
+                                 virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                 virNetMessageErrorPtr rerr,
+                                 remote_network_update_batch_args *args)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virNetworkUpdateItemPtr items = NULL;
+    virNetworkPtr net = NULL;
+
+    if (!priv->networkConn) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _("connection not open"));
+        goto cleanup;
+    }
+
+    if (args->items.items_len > REMOTE_NETWORK_UPDATE_ITEMS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many network updates '%u' for limit '%d'"),
+                       args->items.items_len, REMOTE_NETWORK_UPDATE_ITEMS_MAX);
+        goto cleanup;
+    }
+
+    if (!(net = get_nonnull_network(priv->networkConn, args->net)))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(items, args->items.items_len) < 0)
+        goto cleanup;
+
+    for (i = 0; i < args->items.items_len; i++) {
+        items[i].command = args->items.items_val[i].command;
+        items[i].section = args->items.items_val[i].section;
+        items[i].parentIndex = args->items.items_val[i].parentIndex;
+        items[i].xml = args->items.items_val[i].xml;
+    }
+
+    if (virNetworkUpdateBatch(net, items, args->items.items_len,
+                              args->flags) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+    VIR_FREE(items);
+    virObjectUnref(net);
+    return rv;
+}
+
+
+static int
+remoteDispatchGetAllDomainStatsRecords(struct daemonClientPrivate *priv,
+                                       remote_nonnull_domain *remote_doms,
+                                       unsigned int ndoms,
+                                       unsigned int stats,
+                                       virDomainStatsRecordPtr **retStats,
+                                       unsigned int flags)
+{
+    size_t i;
+    int nrecords = -1;
     virDomainPtr *doms = NULL;
 
     if (!priv->conn) {
@@ -6647,26 +7666,19 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
         goto cleanup;
     }
 
-    if (args->doms.doms_len) {
-        if (VIR_ALLOC_N(doms, args->doms.doms_len + 1) < 0)
+    if (ndoms) {
+        if (VIR_ALLOC_N(doms, ndoms + 1) < 0)
             goto cleanup;
 
-        for (i = 0; i < args->doms.doms_len; i++) {
-            if (!(doms[i] = get_nonnull_domain(priv->conn, args->doms.doms_val[i])))
+        for (i = 0; i < ndoms; i++) {
+            if (!(doms[i] = get_nonnull_domain(priv->conn, remote_doms[i])))
                 goto cleanup;
         }
 
-        if ((nrecords = virDomainListGetStats(doms,
-                                              args->stats,
-                                              &retStats,
-                                              args->flags)) < 0)
-            goto cleanup;
+        nrecords = virDomainListGetStats(doms, stats, retStats, flags);
     } else {
-        if ((nrecords = virConnectGetAllDomainStats(priv->conn,
-                                                    args->stats,
-                                                    &retStats,
-                                                    args->flags)) < 0)
-            goto cleanup;
+        nrecords = virConnectGetAllDomainStats(priv->conn, stats,
+                                               retStats, flags);
     }
 
     if (nrecords > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
@@ -6674,9 +7686,37 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
                        _("Number of domain stats records is %d, "
                          "which exceeds max limit: %d"),
                        nrecords, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
-        goto cleanup;
+        nrecords = -1;
     }
 
+ cleanup:
+    virObjectListFree(doms);
+    return nrecords;
+}
+
+
+static int
+remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                       virNetServerClientPtr client,
+                                       virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                       virNetMessageErrorPtr rerr,
+                                       remote_connect_get_all_domain_stats_args *args,
+                                       remote_connect_get_all_domain_stats_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+
+    if ((nrecords = remoteDispatchGetAllDomainStatsRecords(priv,
+                                                           args->doms.doms_val,
+                                                           args->doms.doms_len,
+                                                           args->stats,
+                                                           &retStats,
+                                                           args->flags)) < 0)
+        goto cleanup;
+
     if (nrecords) {
         if (VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
             goto cleanup;
@@ -6707,7 +7747,153 @@ remoteDispatchConnectGetAllDomainStats(virNetServerPtr server ATTRIBUTE_UNUSED,
         virNetMessageSaveError(rerr);
 
     virDomainStatsRecordListFree(retStats);
-    virObjectListFree(doms);
+
+    return rv;
+}
+
+
+static int
+remoteSerializePackedTypedParam(virTypedParameterPtr param,
+                                remote_typed_param_value *val)
+{
+    val->type = param->type;
+
+    switch (param->type) {
+    case VIR_TYPED_PARAM_INT:
+        val->remote_typed_param_value_u.i = param->value.i;
+        break;
+    case VIR_TYPED_PARAM_UINT:
+        val->remote_typed_param_value_u.ui = param->value.ui;
+        break;
+    case VIR_TYPED_PARAM_LLONG:
+        val->remote_typed_param_value_u.l = param->value.l;
+        break;
+    case VIR_TYPED_PARAM_ULLONG:
+        val->remote_typed_param_value_u.ul = param->value.ul;
+        break;
+    case VIR_TYPED_PARAM_DOUBLE:
+        val->remote_typed_param_value_u.d = param->value.d;
+        break;
+    case VIR_TYPED_PARAM_BOOLEAN:
+        val->remote_typed_param_value_u.b = param->value.b;
+        break;
+    case VIR_TYPED_PARAM_STRING:
+        if (VIR_STRDUP(val->remote_typed_param_value_u.s, param->value.s) < 0)
+            return -1;
+        break;
+    default:
+        virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                       param->type);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Like remoteDispatchConnectGetAllDomainStats, but every field name is
+ * put into ret->names once and parameters refer to it by index. With
+ * hundreds of domains reporting the same fields this removes most of
+ * the strings from the reply.
+ */
+static int
+remoteDispatchConnectGetAllDomainStatsPacked(virNetServerPtr server ATTRIBUTE_UNUSED,
+                                             virNetServerClientPtr client,
+                                             virNetMessagePtr msg ATTRIBUTE_UNUSED,
+                                             virNetMessageErrorPtr rerr,
+                                             remote_connect_get_all_domain_stats_packed_args *args,
+                                             remote_connect_get_all_domain_stats_packed_ret *ret)
+{
+    int rv = -1;
+    size_t i;
+    size_t j;
+    size_t nnames_max = 0;
+    struct daemonClientPrivate *priv = virNetServerClientGetPrivateData(client);
+    virDomainStatsRecordPtr *retStats = NULL;
+    int nrecords = 0;
+    virHashTablePtr names = NULL;
+
+    if ((nrecords = remoteDispatchGetAllDomainStatsRecords(priv,
+                                                           args->doms.doms_val,
+                                                           args->doms.doms_len,
+                                                           args->stats,
+                                                           &retStats,
+                                                           args->flags)) < 0)
+        goto cleanup;
+
+    if (!nrecords) {
+        rv = 0;
+        goto cleanup;
+    }
+
+    if (!(names = virHashCreate(256, NULL)))
+        goto cleanup;
+
+    if (VIR_ALLOC_N(ret->retStats.retStats_val, nrecords) < 0)
+        goto cleanup;
+    ret->retStats.retStats_len = nrecords;
+
+    for (i = 0; i < nrecords; i++) {
+        remote_packed_domain_stats_record *dst = ret->retStats.retStats_val + i;
+        virDomainStatsRecordPtr src = retStats[i];
+
+        make_nonnull_domain(&dst->dom, src->dom);
+
+        if (src->nparams > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many parameters '%d' for limit '%d'"),
+                           src->nparams, REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+            goto cleanup;
+        }
+
+        if (src->nparams &&
+            VIR_ALLOC_N(dst->params.params_val, src->nparams) < 0)
+            goto cleanup;
+
+        for (j = 0; j < src->nparams; j++) {
+            virTypedParameterPtr param = src->params + j;
+            remote_packed_typed_param *val = dst->params.params_val + j;
+            void *entry = virHashLookup(names, param->field);
+            size_t id = (uintptr_t) entry;
+
+            /* Dictionary entries are stored as index + 1 */
+            if (!id) {
+                if (ret->names.names_len >= REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+                    virReportError(VIR_ERR_RPC,
+                                   _("too many field names for limit '%d'"),
+                                   REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+                    goto cleanup;
+                }
+
+                if (VIR_RESIZE_N(ret->names.names_val, nnames_max,
+                                 ret->names.names_len, 1) < 0 ||
+                    VIR_STRDUP(ret->names.names_val[ret->names.names_len],
+                               param->field) < 0)
+                    goto cleanup;
+
+                id = ++ret->names.names_len;
+
+                if (virHashAddEntry(names, param->field, (void *)(uintptr_t) id) < 0)
+                    goto cleanup;
+            }
+
+            val->name = id - 1;
+            dst->params.params_len++;
+
+            if (remoteSerializePackedTypedParam(param, &val->value) < 0)
+                goto cleanup;
+        }
+    }
+
+    rv = 0;
+
+ cleanup:
+    if (rv < 0)
+        virNetMessageSaveError(rerr);
+
+    virHashFree(names);
+    virDomainStatsRecordListFree(retStats);
 
     return rv;
 }
@@ -7038,13 +8224,184 @@ remoteDispatchStorageVolGetInfoFlags(virNetServerPtr server ATTRIBUTE_UNUSED,
  *
  * NB. If these return NULL then the caller must return an error.
  */
+/* How long the NUMA node of a domain is trusted before its emulator
+ * placement is looked at again, in milliseconds */
+#define REMOTE_NODE_CACHE_TTL (10 * 1000)
+/* Stale entries are dropped once there are this many */
+#define REMOTE_NODE_CACHE_MAX 4096
+
+typedef struct _remoteNodeCacheEntry remoteNodeCacheEntry;
+typedef remoteNodeCacheEntry *remoteNodeCacheEntryPtr;
+struct _remoteNodeCacheEntry {
+    int node;
+    unsigned long long expires;
+};
+
+/* domain UUID -> remoteNodeCacheEntry, NULL unless calls are routed to
+ * NUMA node workers */
+static virHashTablePtr remoteNodeCache;
+static virMutex remoteNodeCacheLock = VIR_MUTEX_INITIALIZER;
+
+
+static int
+remoteNodeCacheEntryExpired(const void *payload,
+                            const void *name ATTRIBUTE_UNUSED,
+                            const void *opaque)
+{
+    const remoteNodeCacheEntry *entry = payload;
+    const unsigned long long *now = opaque;
+
+    return entry->expires <= *now;
+}
+
+
+/**
+ * remoteNodeCacheUpdate:
+ * @dom: domain a call is made on
+ *
+ * Looks up the host NUMA node the emulator of @dom is pinned to unless
+ * that was done recently. It's done by the workers on the first call on
+ * a domain, so that the event loop routing later calls doesn't have to.
+ */
+static void
+remoteNodeCacheUpdate(virDomainPtr dom)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    remoteNodeCacheEntryPtr entry;
+    virErrorPtr orig_err;
+    unsigned char *cpumap = NULL;
+    virBitmapPtr cpus = NULL;
+    unsigned long long now;
+    int maxcpus = virNumaGetMaxCPUs();
+    int maplen = VIR_CPU_MAPLEN(maxcpus);
+    int node = -1;
+    bool fresh;
+
+    if (!remoteNodeCache ||
+        virTimeMillisNowRaw(&now) < 0)
+        return;
+
+    virUUIDFormat(dom->uuid, uuidstr);
+
+    virMutexLock(&remoteNodeCacheLock);
+    fresh = (entry = virHashLookup(remoteNodeCache, uuidstr)) &&
+            entry->expires > now;
+    virMutexUnlock(&remoteNodeCacheLock);
+    if (fresh)
+        return;
+
+    virErrorPreserveLast(&orig_err);
+
+    if (VIR_ALLOC_N_QUIET(cpumap, maplen) == 0 &&
+        virDomainGetEmulatorPinInfo(dom, cpumap, maplen,
+                                    VIR_DOMAIN_AFFECT_LIVE) >= 0 &&
+        (cpus = virBitmapNewData(cpumap, maplen)))
+        node = virNumaGetNodeOfCPUs(cpus);
+
+    VIR_DEBUG("domain %s is on NUMA node %d", dom->name, node);
+
+    virMutexLock(&remoteNodeCacheLock);
+    if (!(entry = virHashLookup(remoteNodeCache, uuidstr))) {
+        if (virHashSize(remoteNodeCache) >= REMOTE_NODE_CACHE_MAX)
+            virHashRemoveSet(remoteNodeCache,
+                             remoteNodeCacheEntryExpired, &now);
+
+        if (VIR_ALLOC_QUIET(entry) == 0 &&
+            virHashAddEntry(remoteNodeCache, uuidstr, entry) < 0)
+            VIR_FREE(entry);
+    }
+    if (entry) {
+        entry->node = node;
+        entry->expires = now + REMOTE_NODE_CACHE_TTL;
+    }
+    virMutexUnlock(&remoteNodeCacheLock);
+
+    virBitmapFree(cpus);
+    VIR_FREE(cpumap);
+    virErrorRestore(&orig_err);
+}
+
+
+/* Tells virNetServer which NUMA node workers to give a call on a domain
+ * to. Runs in the event loop before the arguments are decoded. */
+static int
+remoteJobNode(virNetServerProgramPtr prog ATTRIBUTE_UNUSED,
+              virNetMessagePtr msg,
+              void *opaque ATTRIBUTE_UNUSED)
+{
+    char uuidstr[VIR_UUID_STRING_BUFLEN];
+    remote_nonnull_domain dom;
+    remoteNodeCacheEntryPtr entry;
+    unsigned long long now;
+    int node = -1;
+    XDR xdr;
+
+    memset(&dom, 0, sizeof(dom));
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_DECODE);
+    if (!xdr_remote_nonnull_domain(&xdr, &dom)) {
+        xdr_destroy(&xdr);
+        return -1;
+    }
+    xdr_destroy(&xdr);
+
+    virUUIDFormat((unsigned char *) dom.uuid, uuidstr);
+    xdr_free((xdrproc_t)xdr_remote_nonnull_domain, (char *) &dom);
+
+    if (virTimeMillisNowRaw(&now) < 0)
+        return -1;
+
+    virMutexLock(&remoteNodeCacheLock);
+    if ((entry = virHashLookup(remoteNodeCache, uuidstr)) &&
+        entry->expires > now)
+        node = entry->node;
+    virMutexUnlock(&remoteNodeCacheLock);
+
+    return node;
+}
+
+
+/**
+ * remoteSetupNodeWorkers:
+ * @srv: the server
+ * @nworkers: workers to run on each host NUMA node
+ *
+ * Makes @srv run calls on a domain by workers on the host NUMA node the
+ * emulator of the domain is pinned to.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+remoteSetupNodeWorkers(virNetServerPtr srv,
+                       size_t nworkers)
+{
+    if (!(remoteNodeCache = virHashCreate(64, virHashValueFree)))
+        return -1;
+
+    if (virNetServerSetNodeWorkers(srv, nworkers, remoteJobNode, NULL) < 0) {
+        virHashFree(remoteNodeCache);
+        remoteNodeCache = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static virDomainPtr
 get_nonnull_domain(virConnectPtr conn, remote_nonnull_domain domain)
 {
+    virDomainPtr dom;
+
     /* Should we believe the domain.id sent by the client?  Maybe
      * this should be a check rather than an assignment? XXX
      */
-    return virGetDomain(conn, domain.name, BAD_CAST domain.uuid, domain.id);
+    dom = virGetDomain(conn, domain.name, BAD_CAST domain.uuid, domain.id);
+
+    if (dom)
+        remoteNodeCacheUpdate(dom);
+
+    return dom;
 }
 
 static virNetworkPtr
@@ -7099,6 +8456,12 @@ get_nonnull_domain_snapshot(virDomainPtr dom, remote_nonnull_domain_snapshot sna
     return virGetDomainSnapshot(dom, snapshot.name);
 }
 
+static virDomainCheckpointPtr
+get_nonnull_domain_checkpoint(virDomainPtr dom, remote_nonnull_domain_checkpoint checkpoint)
+{
+    return virGetDomainCheckpoint(dom, checkpoint.name);
+}
+
 static virNodeDevicePtr
 get_nonnull_node_device(virConnectPtr conn, remote_nonnull_node_device dev)
 {
@@ -7179,6 +8542,13 @@ make_nonnull_domain_snapshot(remote_nonnull_domain_snapshot *snapshot_dst, virDo
     make_nonnull_domain(&snapshot_dst->dom, snapshot_src->domain);
 }
 
+static void
+make_nonnull_domain_checkpoint(remote_nonnull_domain_checkpoint *checkpoint_dst, virDomainCheckpointPtr checkpoint_src)
+{
+    ignore_value(VIR_STRDUP_QUIET(checkpoint_dst->name, checkpoint_src->name));
+    make_nonnull_domain(&checkpoint_dst->dom, checkpoint_src->domain);
+}
+
 static int
 remoteSerializeDomainDiskErrors(virDomainDiskErrorPtr errors,
                                 int nerrors,
@@ -27,6 +27,7 @@
 # include "remote_protocol.h"
 # include "rpc/virnetserverprogram.h"
 # include "rpc/virnetserverclient.h"
+# include "rpc/virnetserver.h"
 
 
 extern virNetServerProgramProc remoteProcs[];
@@ -41,5 +42,15 @@ extern size_t qemuNProcs;
 void remoteClientFree(void *data);
 void *remoteClientNew(virNetServerClientPtr client,
                       void *opaque);
+void *remoteClientNewPostExecRestart(virNetServerClientPtr client,
+                                     virJSONValuePtr object,
+                                     void *opaque);
+virJSONValuePtr remoteClientPreExecRestart(virNetServerClientPtr client,
+                                           void *opaque);
+bool remoteClientCanExecRestart(virNetServerClientPtr client);
+int remoteClientRestore(virNetServerClientPtr client);
+
+int remoteSetupNodeWorkers(virNetServerPtr srv,
+                           size_t nworkers);
 
 #endif /* __REMOTE_DAEMON_DISPATCH_H__ */
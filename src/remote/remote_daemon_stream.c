@@ -35,6 +35,10 @@
 
 VIR_LOG_INIT("daemon.stream");
 
+/* How many outgoing packets of one stream can be queued for
+ * transmission to the client at once */
+#define DAEMON_STREAM_TX_WINDOW 2
+
 struct daemonClientStream {
     daemonClientPrivatePtr priv;
     int refs;
@@ -52,6 +56,7 @@ struct daemonClientStream {
 
     virNetMessagePtr rx;
     bool tx;
+    unsigned int txPending; /* Packets queued for transmission */
 
     bool allowSkip;
     size_t dataLen; /* How much data is there remaining until we see a hole */
@@ -95,7 +100,9 @@ daemonStreamUpdateEvents(daemonClientStream *stream)
  * This simply re-enables TX of further data.
  *
  * The idea is to stop the daemon growing without bound due to
- * fast stream, but slow client
+ * fast stream, but slow client. Up to DAEMON_STREAM_TX_WINDOW
+ * packets may be in flight so that the socket doesn't go idle
+ * while we read the next chunk from the stream.
  */
 static void
 daemonStreamMessageFinished(virNetMessagePtr msg,
@@ -105,6 +112,7 @@ daemonStreamMessageFinished(virNetMessagePtr msg,
     VIR_DEBUG("stream=%p proc=%d serial=%u",
               stream, msg->header.proc, msg->header.serial);
 
+    stream->txPending--;
     stream->tx = true;
     daemonStreamUpdateEvents(stream);
 
@@ -213,6 +221,7 @@ daemonStreamEvent(virStreamPtr st, int events, void *opaque)
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
+        stream->txPending++;
         if (virNetServerProgramSendStreamData(stream->prog,
                                               client,
                                               msg,
@@ -830,6 +839,9 @@ daemonStreamHandleRead(virNetServerClientPtr client,
 
     memset(&rerr, 0, sizeof(rerr));
 
+    if (stream->priv->largeStreamPackets)
+        bufferLen = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+
     if (VIR_ALLOC_N(buffer, bufferLen) < 0)
         return -1;
 
@@ -862,6 +874,7 @@ daemonStreamHandleRead(virNetServerClientPtr client,
                 msg->cb = daemonStreamMessageFinished;
                 msg->opaque = stream;
                 stream->refs++;
+                stream->txPending++;
                 if (virNetServerProgramSendStreamHole(stream->prog,
                                                       client,
                                                       msg,
@@ -905,13 +918,15 @@ daemonStreamHandleRead(virNetServerClientPtr client,
         if (stream->allowSkip)
             stream->dataLen -= rv;
 
-        stream->tx = false;
+        if (stream->txPending + 1 >= DAEMON_STREAM_TX_WINDOW)
+            stream->tx = false;
         if (rv == 0)
             stream->recvEOF = true;
 
         msg->cb = daemonStreamMessageFinished;
         msg->opaque = stream;
         stream->refs++;
+        stream->txPending++;
         if (virNetServerProgramSendStreamData(stream->prog,
                                               client,
                                               msg,
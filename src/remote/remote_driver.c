@@ -75,6 +75,30 @@ VIR_LOG_INIT("remote.remote_driver");
 #endif
 
 static bool inside_daemon;
+/* Set in the daemons serving a single driver or forwarding all of them */
+static bool split_daemon;
+static char *split_daemon_module;
+
+/*
+ * The daemons serving a single driver each, listening on sockets
+ * named after them. Connections without URI probe the hypervisor
+ * drivers in this order.
+ */
+static const struct {
+    const char *driver;
+    const char *daemon;
+    bool secondary;
+} remoteSplitDaemons[] = {
+    { "qemu", "virtqemud", false },
+    { "lxc", "virtlxcd", false },
+    { "xen", "virtxend", false },
+    { "interface", "virtinterfaced", true },
+    { "network", "virtnetworkd", true },
+    { "nodedev", "virtnodedevd", true },
+    { "nwfilter", "virtnwfilterd", true },
+    { "secret", "virtsecretd", true },
+    { "storage", "virtstoraged", true },
+};
 
 struct private_data {
     virMutex lock;
@@ -97,11 +121,22 @@ struct private_data {
     bool serverKeepAlive;       /* Does server support keepalive protocol? */
     bool serverEventFilter;     /* Does server support modern event filtering */
     bool serverCloseCallback;   /* Does server support driver close callback */
+    bool serverStreamLargePackets; /* Does server accept large stream packets */
+    bool serverPackedStats;     /* Does server send packed domain stats */
 
     virObjectEventStatePtr eventState;
     virConnectCloseCallbackDataPtr closeCallback;
+
+    /* Set if the connection is shared, see remoteConnectOpenShared */
+    char *sharedKey;            /* Identifies the shareable connections */
+    virConnectPtr eventConn;    /* Not tied to any of the sharers */
 };
 
+/* Connections opened with the shared=1 URI parameter */
+static struct private_data **remoteShared;
+static size_t nremoteShared;
+static virMutex remoteSharedLock = VIR_MUTEX_INITIALIZER;
+
 enum {
     REMOTE_CALL_QEMU              = (1 << 0),
     REMOTE_CALL_LXC               = (1 << 1),
@@ -129,6 +164,21 @@ static int callFull(virConnectPtr conn, struct private_data *priv,
                     int proc_nr,
                     xdrproc_t args_filter, char *args,
                     xdrproc_t ret_filter, char *ret);
+
+struct remoteCallFuture {
+    virNetClientProgramPtr prog;
+    virNetClientFuturePtr future;
+    int serial;
+    int proc_nr;
+};
+
+static int callSubmit(virConnectPtr conn, struct private_data *priv,
+                      unsigned int flags, int proc_nr,
+                      xdrproc_t args_filter, char *args,
+                      struct remoteCallFuture *fut);
+static int callFinish(virConnectPtr conn, struct private_data *priv,
+                      struct remoteCallFuture *fut,
+                      xdrproc_t ret_filter, char *ret);
 static int remoteAuthenticate(virConnectPtr conn, struct private_data *priv,
                               virConnectAuthPtr auth, const char *authtype);
 #if WITH_SASL
@@ -137,6 +187,7 @@ static int remoteAuthSASL(virConnectPtr conn, struct private_data *priv,
 #endif /* WITH_SASL */
 static int remoteAuthPolkit(virConnectPtr conn, struct private_data *priv,
                             virConnectAuthPtr auth);
+static int doRemoteClose(virConnectPtr conn, struct private_data *priv);
 
 static virDomainPtr get_nonnull_domain(virConnectPtr conn, remote_nonnull_domain domain);
 static virNetworkPtr get_nonnull_network(virConnectPtr conn, remote_nonnull_network network);
@@ -148,6 +199,7 @@ static virStorageVolPtr get_nonnull_storage_vol(virConnectPtr conn, remote_nonnu
 static virNodeDevicePtr get_nonnull_node_device(virConnectPtr conn, remote_nonnull_node_device dev);
 static virSecretPtr get_nonnull_secret(virConnectPtr conn, remote_nonnull_secret secret);
 static virDomainSnapshotPtr get_nonnull_domain_snapshot(virDomainPtr domain, remote_nonnull_domain_snapshot snapshot);
+static virDomainCheckpointPtr get_nonnull_domain_checkpoint(virDomainPtr domain, remote_nonnull_domain_checkpoint checkpoint);
 static void make_nonnull_domain(remote_nonnull_domain *dom_dst, virDomainPtr dom_src);
 static void make_nonnull_network(remote_nonnull_network *net_dst, virNetworkPtr net_src);
 static void make_nonnull_interface(remote_nonnull_interface *interface_dst, virInterfacePtr interface_src);
@@ -159,6 +211,7 @@ static void make_nonnull_secret(remote_nonnull_secret *secret_dst, virSecretPtr
 static void make_nonnull_nwfilter(remote_nonnull_nwfilter *nwfilter_dst, virNWFilterPtr nwfilter_src);
 static void make_nonnull_nwfilter_binding(remote_nonnull_nwfilter_binding *binding_dst, virNWFilterBindingPtr binding_src);
 static void make_nonnull_domain_snapshot(remote_nonnull_domain_snapshot *snapshot_dst, virDomainSnapshotPtr snapshot_src);
+static void make_nonnull_domain_checkpoint(remote_nonnull_domain_checkpoint *checkpoint_dst, virDomainCheckpointPtr checkpoint_src);
 
 /*----------------------------------------------------------------------*/
 
@@ -184,6 +237,50 @@ static int remoteSplitURIScheme(virURIPtr uri,
 }
 
 
+/**
+ * remoteSetSplitDaemon:
+ * @module: the driver module the daemon serves, or NULL
+ *
+ * Let the daemon reach the drivers it does not serve through the
+ * daemons serving them: the secondary drivers other than @module,
+ * or all drivers if @module is NULL. Must be called before the
+ * state initialization.
+ */
+int
+remoteSetSplitDaemon(const char *module)
+{
+    split_daemon = true;
+    return VIR_STRDUP(split_daemon_module, module);
+}
+
+
+/*
+ * Whether a daemon may forward a local connection to @driver,
+ * which is NULL for a connection without URI.
+ */
+static bool
+remoteSplitDaemonForwards(const char *driver)
+{
+    size_t i;
+
+    if (!split_daemon)
+        return false;
+
+    if (!split_daemon_module)
+        return true;
+
+    if (STREQ_NULLABLE(driver, split_daemon_module))
+        return false;
+
+    for (i = 0; i < ARRAY_CARDINALITY(remoteSplitDaemons); i++) {
+        if (STREQ_NULLABLE(driver, remoteSplitDaemons[i].driver))
+            return remoteSplitDaemons[i].secondary;
+    }
+
+    return false;
+}
+
+
 static int
 remoteStateInitialize(bool privileged ATTRIBUTE_UNUSED,
                       virStateInhibitCallback callback ATTRIBUTE_UNUSED,
@@ -415,6 +512,11 @@ remoteSecretBuildEventValueChanged(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
                                    virNetClientPtr client ATTRIBUTE_UNUSED,
                                    void *evdata, void *opaque);
 
+static void
+remoteDomainBuildEventStats(virNetClientProgramPtr prog,
+                            virNetClientPtr client,
+                            void *evdata, void *opaque);
+
 static void
 remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog,
                                      virNetClientPtr client,
@@ -425,6 +527,11 @@ remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_U
                                          virNetClientPtr client ATTRIBUTE_UNUSED,
                                          void *evdata, void *opaque);
 
+static void
+remoteEventBatchDispatch(virNetClientProgramPtr prog,
+                         virNetClientPtr client,
+                         void *evdata, void *opaque);
+
 static virNetClientProgramEvent remoteEvents[] = {
     { REMOTE_PROC_DOMAIN_EVENT_LIFECYCLE,
       remoteDomainBuildEventLifecycle,
@@ -631,6 +738,14 @@ static virNetClientProgramEvent remoteEvents[] = {
       remoteDomainBuildEventBlockThreshold,
       sizeof(remote_domain_event_block_threshold_msg),
       (xdrproc_t)xdr_remote_domain_event_block_threshold_msg },
+    { REMOTE_PROC_DOMAIN_EVENT_STATS,
+      remoteDomainBuildEventStats,
+      sizeof(remote_domain_event_stats_msg),
+      (xdrproc_t)xdr_remote_domain_event_stats_msg },
+    { REMOTE_PROC_EVENT_BATCH,
+      remoteEventBatchDispatch,
+      sizeof(remote_event_batch_msg),
+      (xdrproc_t)xdr_remote_event_batch_msg },
 };
 
 static void
@@ -645,6 +760,38 @@ remoteConnectNotifyEventConnectionClosed(virNetClientProgramPtr prog ATTRIBUTE_U
     virConnectCloseCallbackDataCall(priv->closeCallback, msg->reason);
 }
 
+/*
+ * Each event carried by the batch is a complete message, which
+ * is dispatched in order as if it had been received on its own.
+ */
+static void
+remoteEventBatchDispatch(virNetClientProgramPtr prog,
+                         virNetClientPtr client,
+                         void *evdata, void *opaque ATTRIBUTE_UNUSED)
+{
+    remote_event_batch_msg *msg = evdata;
+    size_t i;
+
+    for (i = 0; i < msg->events.events_len; i++) {
+        remote_event_batch_event *ev = &msg->events.events_val[i];
+        virNetMessagePtr event;
+
+        if (!(event = virNetMessageNew(false)))
+            return;
+
+        if (virNetMessageDecodeRaw(event, ev->msg.msg_val,
+                                   ev->msg.msg_len) < 0)
+            VIR_WARN("Dropping malformed event %zu of a batch", i);
+        else if (event->header.proc == REMOTE_PROC_EVENT_BATCH)
+            VIR_WARN("Dropping nested event batch");
+        else
+            virNetClientProgramDispatch(prog, client, event);
+
+        virNetMessageFree(event);
+    }
+}
+
+
 static void
 remoteDomainBuildQemuMonitorEvent(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
                                   virNetClientPtr client ATTRIBUTE_UNUSED,
@@ -673,20 +820,62 @@ remoteClientCloseFunc(virNetClientPtr client ATTRIBUTE_UNUSED,
                                     reason);
 }
 
+/*
+ * Ask the server about all of @features at once, pipelining the
+ * calls, and fill @supported accordingly. A feature the server
+ * could not be asked about is reported as unsupported.
+ */
+static int
+remoteConnectSupportsFeaturesUnlocked(virConnectPtr conn,
+                                      struct private_data *priv,
+                                      const int *features,
+                                      bool *supported,
+                                      size_t nfeatures)
+{
+    struct remoteCallFuture *futs;
+    size_t i;
+
+    if (VIR_ALLOC_N(futs, nfeatures) < 0)
+        return -1;
+
+    for (i = 0; i < nfeatures; i++) {
+        remote_connect_supports_feature_args args = { features[i] };
+
+        supported[i] = false;
+        ignore_value(callSubmit(conn, priv, 0,
+                                REMOTE_PROC_CONNECT_SUPPORTS_FEATURE,
+                                (xdrproc_t)xdr_remote_connect_supports_feature_args,
+                                (char *) &args, &futs[i]));
+    }
+
+    for (i = 0; i < nfeatures; i++) {
+        remote_connect_supports_feature_ret ret = { 0 };
+
+        if (!futs[i].future)
+            continue;
+
+        if (callFinish(conn, priv, &futs[i],
+                       (xdrproc_t)xdr_remote_connect_supports_feature_ret,
+                       (char *) &ret) == 0)
+            supported[i] = ret.supported;
+    }
+
+    VIR_FREE(futs);
+    return 0;
+}
+
 static bool
 remoteConnectSupportsFeatureUnlocked(virConnectPtr conn,
                                      struct private_data *priv,
                                      int feature)
 {
-    remote_connect_supports_feature_args args = { feature };
-    remote_connect_supports_feature_ret ret = { 0 };
-    int rc;
+    bool supported;
 
-    rc = call(conn, priv, 0, REMOTE_PROC_CONNECT_SUPPORTS_FEATURE,
-              (xdrproc_t)xdr_remote_connect_supports_feature_args, (char *) &args,
-              (xdrproc_t)xdr_remote_connect_supports_feature_ret, (char *) &ret);
+    if (remoteConnectSupportsFeaturesUnlocked(conn, priv, &feature,
+                                              &supported, 1) < 0)
+        return false;
 
-    return rc != -1 && ret.supported;
+    return supported;
 }
 
 /* helper macro to ease extraction of arguments from the URI */
@@ -747,6 +936,64 @@ static char *remoteGetUNIXSocketRoot(unsigned int flags)
     return sockname;
 }
 
+#ifndef WIN32
+/*
+ * Pick the socket of the daemon serving @driver, if it is running,
+ * and the socket of libvirtd otherwise. A connection without URI
+ * goes to the first hypervisor daemon running. Inside a daemon,
+ * the connection can only be forwarded to another per-driver daemon.
+ */
+static char *remoteGetUNIXSocket(const char *driver, unsigned int flags)
+{
+    char *rundir = NULL;
+    char *sockname = NULL;
+    size_t i;
+
+    if (flags & VIR_DRV_OPEN_REMOTE_USER) {
+        if (!(rundir = virGetUserRuntimeDirectory()))
+            return NULL;
+    } else {
+        if (VIR_STRDUP(rundir, LOCALSTATEDIR "/run/libvirt") < 0)
+            return NULL;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(remoteSplitDaemons); i++) {
+        if (driver ? STRNEQ(driver, remoteSplitDaemons[i].driver) :
+            remoteSplitDaemons[i].secondary)
+            continue;
+
+        if (virAsprintf(&sockname, "%s/%s-%s", rundir,
+                        remoteSplitDaemons[i].daemon,
+                        flags & VIR_DRV_OPEN_REMOTE_RO &&
+                        !(flags & VIR_DRV_OPEN_REMOTE_USER) ?
+                        "sock-ro" : "sock") < 0)
+            goto cleanup;
+
+        if (virFileExists(sockname)) {
+            VIR_DEBUG("Chosen UNIX sockname %s", sockname);
+            goto cleanup;
+        }
+        VIR_FREE(sockname);
+    }
+
+    if (inside_daemon) {
+        virReportError(VIR_ERR_NO_CONNECT,
+                       _("no daemon is running for the '%s' driver"),
+                       NULLSTR(driver));
+        goto cleanup;
+    }
+
+    if (flags & VIR_DRV_OPEN_REMOTE_USER)
+        sockname = remoteGetUNIXSocketNonRoot();
+    else
+        sockname = remoteGetUNIXSocketRoot(flags);
+
+ cleanup:
+    VIR_FREE(rundir);
+    return sockname;
+}
+#endif /* WIN32 */
+
 /*
  * URIs that this driver needs to handle:
  *
@@ -913,6 +1160,12 @@ doRemoteOpen(virConnectPtr conn,
                 continue;
             }
 
+            if (STRCASEEQ(var->name, "shared")) {
+                /* Strip this param, used by remoteConnectOpen */
+                var->ignore = 1;
+                continue;
+            }
+
             VIR_DEBUG("passing through variable '%s' ('%s') to remote end",
                        var->name, var->value);
         }
@@ -1069,14 +1322,9 @@ doRemoteOpen(virConnectPtr conn,
 
 #ifndef WIN32
     case trans_unix:
-        if (!sockname) {
-            if (flags & VIR_DRV_OPEN_REMOTE_USER)
-                sockname = remoteGetUNIXSocketNonRoot();
-            else
-                sockname = remoteGetUNIXSocketRoot(flags);
-            if (!sockname)
-                goto failed;
-        }
+        if (!sockname &&
+            !(sockname = remoteGetUNIXSocket(driver_str, flags)))
+            goto failed;
 
         if ((flags & VIR_DRV_OPEN_REMOTE_AUTOSTART) &&
             !(daemonPath = virFileFindResourceFull("libvirtd",
@@ -1171,7 +1419,8 @@ doRemoteOpen(virConnectPtr conn,
                                                        REMOTE_PROTOCOL_VERSION,
                                                        remoteEvents,
                                                        ARRAY_CARDINALITY(remoteEvents),
-                                                       conn)))
+                                                       priv->eventConn ?
+                                                       priv->eventConn : conn)))
         goto failed;
     if (!(priv->lxcProgram = virNetClientProgramNew(LXC_PROGRAM,
                                                     LXC_PROTOCOL_VERSION,
@@ -1183,7 +1432,8 @@ doRemoteOpen(virConnectPtr conn,
                                                      QEMU_PROTOCOL_VERSION,
                                                      qemuEvents,
                                                      ARRAY_CARDINALITY(qemuEvents),
-                                                     conn)))
+                                                     priv->eventConn ?
+                                                     priv->eventConn : conn)))
         goto failed;
 
     if (virNetClientAddProgram(priv->client, priv->remoteProgram) < 0 ||
@@ -1239,20 +1489,54 @@ doRemoteOpen(virConnectPtr conn,
     if (!(priv->eventState = virObjectEventStateNew()))
         goto failed;
 
-    priv->serverEventFilter = remoteConnectSupportsFeatureUnlocked(conn,
-                                priv, VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK);
+    {
+        const int features[] = {
+            VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK,
+            VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK,
+            VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS,
+            VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS,
+            /* Asking announces that we can unpack event batches */
+            VIR_DRV_FEATURE_REMOTE_EVENT_BATCH,
+#if WITH_ZSTD
+            /* Asking announces that we can decompress replies */
+            VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION,
+#endif
+        };
+        bool supported[ARRAY_CARDINALITY(features)];
+
+        if (remoteConnectSupportsFeaturesUnlocked(conn, priv, features,
+                                                  supported,
+                                                  ARRAY_CARDINALITY(features)) < 0)
+            goto failed;
+
+        priv->serverEventFilter = supported[0];
+        priv->serverCloseCallback = supported[1];
+        priv->serverStreamLargePackets = supported[2];
+        priv->serverPackedStats = supported[3];
+        if (supported[4])
+            VIR_DEBUG("Server sends events in batches");
+#if WITH_ZSTD
+        if (supported[5])
+            VIR_DEBUG("Server compresses large reply payloads");
+#endif
+    }
+
     if (!priv->serverEventFilter) {
         VIR_INFO("Avoiding server event filtering since it is not "
                  "supported by the server");
     }
 
-    priv->serverCloseCallback = remoteConnectSupportsFeatureUnlocked(conn,
-                                    priv, VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK);
     if (!priv->serverCloseCallback) {
         VIR_INFO("Close callback registering isn't supported "
                  "by the remote side.");
     }
 
+    if (!priv->serverStreamLargePackets) {
+        VIR_INFO("Limiting stream packets to %d bytes since larger ones "
+                 "are not supported by the server",
+                 VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX);
+    }
+
     /* Successful. */
     retcode = VIR_DRV_OPEN_SUCCESS;
 
@@ -1316,6 +1600,83 @@ remoteAllocPrivateData(void)
     return priv;
 }
 
+static void
+remoteFreePrivateData(struct private_data *priv)
+{
+    virObjectUnref(priv->eventConn);
+    VIR_FREE(priv->sharedKey);
+    virMutexDestroy(&priv->lock);
+    VIR_FREE(priv);
+}
+
+/*
+ * Returns 1 if @uri asks for a connection shared with the other
+ * connections of the process to the same URI, 0 if not, and -1
+ * on error.
+ */
+static int
+remoteConnectWantsShared(virURIPtr uri)
+{
+    size_t i;
+    int shared = 0;
+
+    if (!uri)
+        return 0;
+
+    for (i = 0; i < uri->paramsCount; i++) {
+        virURIParamPtr var = &uri->params[i];
+
+        if (STRCASENEQ(var->name, "shared"))
+            continue;
+
+        if (virStrToLong_i(var->value, NULL, 10, &shared) < 0) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("Failed to parse value of URI component %s"),
+                           var->name);
+            return -1;
+        }
+    }
+
+    return shared != 0;
+}
+
+/*
+ * Look for a shared connection matching @key. If there is one, it
+ * is taken over by @conn: its transport, authentication, programs
+ * and event state all serve @conn as well, and it is closed once
+ * the last of its connections is.
+ *
+ * Must be called with remoteSharedLock held.
+ *
+ * Returns true if @conn now uses a shared connection
+ */
+static bool
+remoteConnectOpenShared(virConnectPtr conn,
+                        const char *key)
+{
+    size_t i;
+
+    for (i = 0; i < nremoteShared; i++) {
+        struct private_data *priv = remoteShared[i];
+
+        if (STRNEQ(priv->sharedKey, key))
+            continue;
+
+        remoteDriverLock(priv);
+        if (!priv->client || !virNetClientIsOpen(priv->client)) {
+            remoteDriverUnlock(priv);
+            continue;
+        }
+        VIR_DEBUG("Sharing connection %p for %s", priv, key);
+        priv->localUses++;
+        conn->privateData = priv;
+        remoteDriverUnlock(priv);
+        return true;
+    }
+
+    return false;
+}
+
 static virDrvOpenStatus
 remoteConnectOpen(virConnectPtr conn,
                   virConnectAuthPtr auth,
@@ -1328,19 +1689,54 @@ remoteConnectOpen(virConnectPtr conn,
     const char *autostart = virGetEnvBlockSUID("LIBVIRT_AUTOSTART");
     char *driver = NULL;
     char *transport = NULL;
+    char *sharedKey = NULL;
+    char *uri = NULL;
+    int shared;
 
     if (conn->uri &&
         remoteSplitURIScheme(conn->uri, &driver, &transport) < 0)
         goto cleanup;
 
-    if (inside_daemon && (!conn->uri || !conn->uri->server)) {
+    if (inside_daemon && (!conn->uri || !conn->uri->server) &&
+        !remoteSplitDaemonForwards(driver)) {
         ret = VIR_DRV_OPEN_DECLINED;
         goto cleanup;
     }
 
+    if ((shared = remoteConnectWantsShared(conn->uri)) < 0)
+        goto cleanup;
+
+    /* The URI carries all the transport and authentication settings,
+     * so connections opened with the same URI and access share the
+     * identity they have on the server. Opening under the lock lets
+     * concurrent opens of the same URI share a single connection. */
+    if (shared) {
+        virMutexLock(&remoteSharedLock);
+
+        if (!(uri = virURIFormat(conn->uri)) ||
+            virAsprintf(&sharedKey, "%s %s",
+                        flags & VIR_CONNECT_RO ? "ro" : "rw", uri) < 0)
+            goto cleanup;
+
+        if (remoteConnectOpenShared(conn, sharedKey)) {
+            ret = VIR_DRV_OPEN_SUCCESS;
+            goto cleanup;
+        }
+    }
+
     if (!(priv = remoteAllocPrivateData()))
         goto cleanup;
 
+    if (shared) {
+        if (!(priv->eventConn = virGetConnect())) {
+            remoteDriverUnlock(priv);
+            remoteFreePrivateData(priv);
+            goto cleanup;
+        }
+        priv->eventConn->privateData = priv;
+        VIR_STEAL_PTR(priv->sharedKey, sharedKey);
+    }
+
     if (flags & VIR_CONNECT_RO)
         rflags |= VIR_DRV_OPEN_REMOTE_RO;
 
@@ -1360,7 +1756,7 @@ remoteConnectOpen(virConnectPtr conn,
         geteuid() > 0) {
         VIR_DEBUG("Auto-spawn user daemon instance");
         rflags |= VIR_DRV_OPEN_REMOTE_USER;
-        if (!virIsSUID() &&
+        if (!virIsSUID() && !inside_daemon &&
             (!autostart ||
              STRNEQ(autostart, "0")))
             rflags |= VIR_DRV_OPEN_REMOTE_AUTOSTART;
@@ -1375,7 +1771,7 @@ remoteConnectOpen(virConnectPtr conn,
         if (geteuid() > 0) {
             VIR_DEBUG("Auto-spawn user daemon instance");
             rflags |= VIR_DRV_OPEN_REMOTE_USER;
-            if (!virIsSUID() &&
+            if (!virIsSUID() && !inside_daemon &&
                 (!autostart ||
                  STRNEQ(autostart, "0")))
                 rflags |= VIR_DRV_OPEN_REMOTE_AUTOSTART;
@@ -1386,13 +1782,24 @@ remoteConnectOpen(virConnectPtr conn,
     if (ret != VIR_DRV_OPEN_SUCCESS) {
         conn->privateData = NULL;
         remoteDriverUnlock(priv);
-        VIR_FREE(priv);
+        remoteFreePrivateData(priv);
+    } else if (priv->sharedKey &&
+               VIR_APPEND_ELEMENT_COPY(remoteShared, nremoteShared, priv) < 0) {
+        conn->privateData = NULL;
+        doRemoteClose(conn, priv);
+        remoteDriverUnlock(priv);
+        remoteFreePrivateData(priv);
+        ret = VIR_DRV_OPEN_ERROR;
     } else {
         conn->privateData = priv;
         remoteDriverUnlock(priv);
     }
 
  cleanup:
+    if (shared > 0)
+        virMutexUnlock(&remoteSharedLock);
+    VIR_FREE(sharedKey);
+    VIR_FREE(uri);
     VIR_FREE(driver);
     VIR_FREE(transport);
     return ret;
@@ -1448,19 +1855,37 @@ remoteConnectClose(virConnectPtr conn)
 {
     int ret = 0;
     struct private_data *priv = conn->privateData;
+    bool shared = !!priv->sharedKey;
+
+    /* Keeps other threads from sharing the connection
+     * while it is being closed */
+    if (shared)
+        virMutexLock(&remoteSharedLock);
 
     remoteDriverLock(priv);
     priv->localUses--;
     if (!priv->localUses) {
+        size_t i;
+
+        for (i = 0; i < nremoteShared; i++) {
+            if (remoteShared[i] == priv) {
+                VIR_DELETE_ELEMENT(remoteShared, i, nremoteShared);
+                break;
+            }
+        }
+
         ret = doRemoteClose(conn, priv);
         conn->privateData = NULL;
         remoteDriverUnlock(priv);
-        virMutexDestroy(&priv->lock);
-        VIR_FREE(priv);
+        remoteFreePrivateData(priv);
+        priv = NULL;
     }
     if (priv)
         remoteDriverUnlock(priv);
 
+    if (shared)
+        virMutexUnlock(&remoteSharedLock);
+
     return ret;
 }
 
@@ -5592,6 +6017,69 @@ remoteDomainBuildEventBlockThreshold(virNetClientProgramPtr prog ATTRIBUTE_UNUSE
 }
 
 
+static void
+remoteDomainBuildEventStats(virNetClientProgramPtr prog ATTRIBUTE_UNUSED,
+                            virNetClientPtr client ATTRIBUTE_UNUSED,
+                            void *evdata, void *opaque)
+{
+    virConnectPtr conn = opaque;
+    remote_domain_event_stats_msg *msg = evdata;
+    struct private_data *priv = conn->privateData;
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr *records = NULL;
+    virObjectEventPtr event = NULL;
+    char *key = NULL;
+    size_t i;
+
+    if (msg->retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        VIR_WARN("Number of stats entries is %d, which exceeds max limit: %d",
+                 msg->retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        return;
+    }
+
+    if (VIR_ALLOC_N(records, msg->retStats.retStats_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < msg->retStats.retStats_len; i++) {
+        remote_domain_stats_record *rec = msg->retStats.retStats_val + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        if (virTypedParamsDeserialize((virTypedParameterRemotePtr) rec->params.params_val,
+                                      rec->params.params_len,
+                                      REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX,
+                                      &elem->params,
+                                      &elem->nparams))
+            goto cleanup;
+
+        VIR_STEAL_PTR(records[i], elem);
+    }
+
+    /* The local registration is keyed by the server side callback ID */
+    if (virAsprintf(&key, "%d", msg->callbackID) < 0)
+        goto cleanup;
+
+    if (!(event = virDomainStatsEventNew(key, records,
+                                         msg->retStats.retStats_len)))
+        goto cleanup;
+    records = NULL;
+
+    virObjectEventStateQueueRemote(priv->eventState, event, msg->callbackID);
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        VIR_FREE(elem);
+    }
+    virDomainStatsRecordListFree(records);
+    VIR_FREE(key);
+}
+
+
 static int
 remoteStreamSend(virStreamPtr st,
                  const char *data,
@@ -5607,6 +6095,13 @@ remoteStreamSend(virStreamPtr st,
 
     remoteDriverLock(priv);
     priv->localUses++;
+    if (priv->serverStreamLargePackets) {
+        if (nbytes > VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX)
+            nbytes = VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX;
+    } else {
+        if (nbytes > VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX)
+            nbytes = VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX;
+    }
     remoteDriverUnlock(priv);
 
     rv = virNetClientStreamSendPacket(privst,
@@ -5941,7 +6436,9 @@ remoteConnectDomainEventRegisterAny(virConnectPtr conn,
         } else {
             remote_connect_domain_event_register_any_args args;
 
-            args.eventID = eventID;
+            /* Servers this old cannot coalesce, but the callback we've
+             * just registered locally does that on its own.  */
+            args.eventID = eventID & ~VIR_DOMAIN_EVENT_ID_FLAG_COALESCE;
 
             if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_EVENT_REGISTER_ANY,
                      (xdrproc_t) xdr_remote_connect_domain_event_register_any_args, (char *) &args,
@@ -6643,6 +7140,18 @@ remoteDomainGetDiskErrors(virDomainPtr dom,
 #include "lxc_client_bodies.h"
 #include "qemu_client_bodies.h"
 
+static virNetClientProgramPtr
+callProgram(struct private_data *priv,
+            unsigned int flags)
+{
+    if (flags & REMOTE_CALL_QEMU)
+        return priv->qemuProgram;
+    else if (flags & REMOTE_CALL_LXC)
+        return priv->lxcProgram;
+    else
+        return priv->remoteProgram;
+}
+
 /*
  * Serial a set of arguments into a method call message,
  * send that to the server and wait for reply
@@ -6660,18 +7169,11 @@ callFull(virConnectPtr conn ATTRIBUTE_UNUSED,
          xdrproc_t ret_filter, char *ret)
 {
     int rv;
-    virNetClientProgramPtr prog;
+    virNetClientProgramPtr prog = callProgram(priv, flags);
     int counter = priv->counter++;
     virNetClientPtr client = priv->client;
     priv->localUses++;
 
-    if (flags & REMOTE_CALL_QEMU)
-        prog = priv->qemuProgram;
-    else if (flags & REMOTE_CALL_LXC)
-        prog = priv->lxcProgram;
-    else
-        prog = priv->remoteProgram;
-
     /* Unlock, so that if we get any async events/stream data
      * while processing the RPC, we don't deadlock when our
      * callbacks for those are invoked
@@ -6707,24 +7209,86 @@ call(virConnectPtr conn,
                     ret_filter, ret);
 }
 
-
+/*
+ * Serial a set of arguments into a method call message and
+ * send that to the server without waiting for the reply, which
+ * callFinish collects. Calls submitted one after another are
+ * in flight on the connection at the same time.
+ */
 static int
-remoteDomainGetInterfaceParameters(virDomainPtr domain,
-                                   const char *device,
-                                   virTypedParameterPtr params, int *nparams,
-                                   unsigned int flags)
+callSubmit(virConnectPtr conn ATTRIBUTE_UNUSED,
+           struct private_data *priv,
+           unsigned int flags,
+           int proc_nr,
+           xdrproc_t args_filter, char *args,
+           struct remoteCallFuture *fut)
 {
-    int rv = -1;
-    remote_domain_get_interface_parameters_args args;
-    remote_domain_get_interface_parameters_ret ret;
-    struct private_data *priv = domain->conn->privateData;
+    int rv;
+    virNetClientPtr client = priv->client;
 
+    fut->prog = callProgram(priv, flags);
+    fut->serial = priv->counter++;
+    fut->proc_nr = proc_nr;
+    priv->localUses++;
+
+    remoteDriverUnlock(priv);
+    rv = virNetClientProgramSubmit(fut->prog,
+                                   client,
+                                   fut->serial,
+                                   proc_nr,
+                                   args_filter, args,
+                                   &fut->future);
     remoteDriverLock(priv);
+    priv->localUses--;
 
-    make_nonnull_domain(&args.dom, domain);
-    args.device = (char *)device;
-    args.nparams = *nparams;
-    args.flags = flags;
+    return rv;
+}
+
+/*
+ * Wait for the reply to a call made with callSubmit
+ */
+static int
+callFinish(virConnectPtr conn ATTRIBUTE_UNUSED,
+           struct private_data *priv,
+           struct remoteCallFuture *fut,
+           xdrproc_t ret_filter, char *ret)
+{
+    int rv;
+    virNetClientPtr client = priv->client;
+    priv->localUses++;
+
+    remoteDriverUnlock(priv);
+    rv = virNetClientProgramFinish(fut->prog,
+                                   client,
+                                   fut->future,
+                                   fut->serial,
+                                   fut->proc_nr,
+                                   ret_filter, ret);
+    remoteDriverLock(priv);
+    priv->localUses--;
+    fut->future = NULL;
+
+    return rv;
+}
+
+
+static int
+remoteDomainGetInterfaceParameters(virDomainPtr domain,
+                                   const char *device,
+                                   virTypedParameterPtr params, int *nparams,
+                                   unsigned int flags)
+{
+    int rv = -1;
+    remote_domain_get_interface_parameters_args args;
+    remote_domain_get_interface_parameters_ret ret;
+    struct private_data *priv = domain->conn->privateData;
+
+    remoteDriverLock(priv);
+
+    make_nonnull_domain(&args.dom, domain);
+    args.device = (char *)device;
+    args.nparams = *nparams;
+    args.flags = flags;
 
     memset(&ret, 0, sizeof(ret));
     if (call(domain->conn, priv, 0, REMOTE_PROC_DOMAIN_GET_INTERFACE_PARAMETERS,
@@ -7615,6 +8179,55 @@ remoteSerializeDHCPLease(virNetworkDHCPLeasePtr lease_dst, remote_network_dhcp_l
 }
 
 
+static int
+remoteNetworkUpdateBatch(virNetworkPtr net,
+                         virNetworkUpdateItemPtr items,
+                         unsigned int nitems,
+                         unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    struct private_data *priv = net->conn->privateData;
+    remote_network_update_batch_args args;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+
+    if (nitems > REMOTE_NETWORK_UPDATE_ITEMS_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many network updates '%u' for limit '%d'"),
+                       nitems, REMOTE_NETWORK_UPDATE_ITEMS_MAX);
+        goto cleanup;
+    }
+
+    make_nonnull_network(&args.net, net);
+
+    if (VIR_ALLOC_N(args.items.items_val, nitems) < 0)
+        goto cleanup;
+    for (i = 0; i < nitems; i++) {
+        args.items.items_val[i].command = items[i].command;
+        args.items.items_val[i].section = items[i].section;
+        args.items.items_val[i].parentIndex = items[i].parentIndex;
+        args.items.items_val[i].xml = (char *) items[i].xml;
+    }
+    args.items.items_len = nitems;
+    args.flags = flags;
+
+    if (call(net->conn, priv, 0, REMOTE_PROC_NETWORK_UPDATE_BATCH,
+             (xdrproc_t) xdr_remote_network_update_batch_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    VIR_FREE(args.items.items_val);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 static int
 remoteNetworkGetDHCPLeases(virNetworkPtr net,
                            const char *mac,
@@ -7683,6 +8296,256 @@ remoteNetworkGetDHCPLeases(virNetworkPtr net,
 }
 
 
+static int
+remoteConnectGetAllDHCPLeases(virConnectPtr conn,
+                              virNetworkPtr *nets,
+                              const char **macs,
+                              virNetworkDHCPLeasePtr **leases,
+                              unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    size_t nnets = 0;
+    size_t nmacs = 0;
+    struct private_data *priv = conn->privateData;
+    remote_connect_get_all_dhcp_leases_args args;
+    remote_connect_get_all_dhcp_leases_ret ret;
+    virNetworkDHCPLeasePtr *leases_ret = NULL;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+    memset(&ret, 0, sizeof(ret));
+
+    while (nets && nets[nnets])
+        nnets++;
+    while (macs && macs[nmacs])
+        nmacs++;
+
+    if (nnets > REMOTE_NETWORK_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many networks '%zu' for limit '%d'"),
+                       nnets, REMOTE_NETWORK_LIST_MAX);
+        goto done;
+    }
+
+    if (nmacs > REMOTE_NETWORK_DHCP_LEASES_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many MAC addresses '%zu' for limit '%d'"),
+                       nmacs, REMOTE_NETWORK_DHCP_LEASES_MAX);
+        goto done;
+    }
+
+    if (nnets) {
+        if (VIR_ALLOC_N(args.nets.nets_val, nnets) < 0)
+            goto done;
+        for (i = 0; i < nnets; i++)
+            make_nonnull_network(args.nets.nets_val + i, nets[i]);
+        args.nets.nets_len = nnets;
+    }
+    args.macs.macs_val = (char **) macs;
+    args.macs.macs_len = nmacs;
+    args.flags = flags;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DHCP_LEASES,
+             (xdrproc_t)xdr_remote_connect_get_all_dhcp_leases_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_dhcp_leases_ret, (char *)&ret) == -1)
+        goto done;
+
+    if (ret.leases.leases_len > REMOTE_NETWORK_DHCP_LEASES_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of leases is %d, which exceeds max limit: %d"),
+                       ret.leases.leases_len, REMOTE_NETWORK_DHCP_LEASES_MAX);
+        goto cleanup;
+    }
+
+    if (ret.leases.leases_len &&
+        VIR_ALLOC_N(leases_ret, ret.leases.leases_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.leases.leases_len; i++) {
+        if (VIR_ALLOC(leases_ret[i]) < 0)
+            goto cleanup;
+
+        if (remoteSerializeDHCPLease(leases_ret[i], &ret.leases.leases_val[i]) < 0)
+            goto cleanup;
+    }
+
+    *leases = leases_ret;
+    leases_ret = NULL;
+
+    rv = ret.ret;
+
+ cleanup:
+    if (leases_ret) {
+        for (i = 0; i < ret.leases.leases_len; i++)
+            virNetworkDHCPLeaseFree(leases_ret[i]);
+        VIR_FREE(leases_ret);
+    }
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_dhcp_leases_ret,
+             (char *) &ret);
+
+ done:
+    VIR_FREE(args.nets.nets_val);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+/*
+ * Fetch the records with REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED,
+ * which sends each field name only once per reply.
+ */
+static int
+remoteConnectGetAllDomainStatsPacked(virConnectPtr conn,
+                                     struct private_data *priv,
+                                     virDomainPtr *doms,
+                                     unsigned int ndoms,
+                                     unsigned int stats,
+                                     virDomainStatsRecordPtr **retStats,
+                                     unsigned int flags)
+{
+    int rv = -1;
+    size_t i;
+    size_t j;
+    remote_connect_get_all_domain_stats_packed_args args;
+    remote_connect_get_all_domain_stats_packed_ret ret;
+    virDomainStatsRecordPtr elem = NULL;
+    virDomainStatsRecordPtr *tmpret = NULL;
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms) {
+        if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+            goto cleanup;
+
+        for (i = 0; i < ndoms; i++)
+            make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    }
+    args.doms.doms_len = ndoms;
+
+    args.stats = stats;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    remoteDriverLock(priv);
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_args, (char *)&args,
+             (xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_ret, (char *)&ret) == -1) {
+        remoteDriverUnlock(priv);
+        goto cleanup;
+    }
+    remoteDriverUnlock(priv);
+
+    if (ret.retStats.retStats_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Number of stats entries is %d, which exceeds max limit: %d"),
+                       ret.retStats.retStats_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    *retStats = NULL;
+
+    if (VIR_ALLOC_N(tmpret, ret.retStats.retStats_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.retStats.retStats_len; i++) {
+        remote_packed_domain_stats_record *rec = ret.retStats.retStats_val + i;
+
+        if (VIR_ALLOC(elem) < 0)
+            goto cleanup;
+
+        if (!(elem->dom = get_nonnull_domain(conn, rec->dom)))
+            goto cleanup;
+
+        if (rec->params.params_len > REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX) {
+            virReportError(VIR_ERR_RPC,
+                           _("too many parameters '%u' for limit '%d'"),
+                           rec->params.params_len,
+                           REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX);
+            goto cleanup;
+        }
+
+        if (rec->params.params_len &&
+            VIR_ALLOC_N(elem->params, rec->params.params_len) < 0)
+            goto cleanup;
+
+        for (j = 0; j < rec->params.params_len; j++) {
+            remote_packed_typed_param *src = rec->params.params_val + j;
+            virTypedParameterPtr param = elem->params + j;
+
+            if (src->name >= ret.names.names_len) {
+                virReportError(VIR_ERR_RPC,
+                               _("unknown parameter name index: %u"),
+                               src->name);
+                goto cleanup;
+            }
+
+            if (virStrcpyStatic(param->field,
+                                ret.names.names_val[src->name]) < 0) {
+                virReportError(VIR_ERR_INTERNAL_ERROR,
+                               _("parameter %s too big for destination"),
+                               ret.names.names_val[src->name]);
+                goto cleanup;
+            }
+
+            elem->nparams++;
+            param->type = src->value.type;
+            switch (param->type) {
+            case VIR_TYPED_PARAM_INT:
+                param->value.i = src->value.remote_typed_param_value_u.i;
+                break;
+            case VIR_TYPED_PARAM_UINT:
+                param->value.ui = src->value.remote_typed_param_value_u.ui;
+                break;
+            case VIR_TYPED_PARAM_LLONG:
+                param->value.l = src->value.remote_typed_param_value_u.l;
+                break;
+            case VIR_TYPED_PARAM_ULLONG:
+                param->value.ul = src->value.remote_typed_param_value_u.ul;
+                break;
+            case VIR_TYPED_PARAM_DOUBLE:
+                param->value.d = src->value.remote_typed_param_value_u.d;
+                break;
+            case VIR_TYPED_PARAM_BOOLEAN:
+                param->value.b = src->value.remote_typed_param_value_u.b;
+                break;
+            case VIR_TYPED_PARAM_STRING:
+                if (VIR_STRDUP(param->value.s,
+                               src->value.remote_typed_param_value_u.s) < 0)
+                    goto cleanup;
+                break;
+            default:
+                virReportError(VIR_ERR_RPC, _("unknown parameter type: %d"),
+                               param->type);
+                goto cleanup;
+            }
+        }
+
+        tmpret[i] = elem;
+        elem = NULL;
+    }
+
+    *retStats = tmpret;
+    tmpret = NULL;
+    rv = ret.retStats.retStats_len;
+
+ cleanup:
+    if (elem) {
+        virObjectUnref(elem->dom);
+        virTypedParamsFree(elem->params, elem->nparams);
+        VIR_FREE(elem);
+    }
+    virDomainStatsRecordListFree(tmpret);
+    VIR_FREE(args.doms.doms_val);
+    xdr_free((xdrproc_t)xdr_remote_connect_get_all_domain_stats_packed_ret,
+             (char *) &ret);
+
+    return rv;
+}
+
+
 static int
 remoteConnectGetAllDomainStats(virConnectPtr conn,
                                virDomainPtr *doms,
@@ -7699,6 +8562,10 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
     virDomainStatsRecordPtr elem = NULL;
     virDomainStatsRecordPtr *tmpret = NULL;
 
+    if (priv->serverPackedStats)
+        return remoteConnectGetAllDomainStatsPacked(conn, priv, doms, ndoms,
+                                                    stats, retStats, flags);
+
     memset(&args, 0, sizeof(args));
 
     if (ndoms) {
@@ -7774,6 +8641,279 @@ remoteConnectGetAllDomainStats(virConnectPtr conn,
 }
 
 
+static int
+remoteConnectDomainStatsRegister(virConnectPtr conn,
+                                 unsigned int stats,
+                                 unsigned int interval,
+                                 virConnectDomainStatsCallback callback,
+                                 void *opaque,
+                                 virFreeCallback freecb,
+                                 unsigned int flags)
+{
+    int rv = -1;
+    struct private_data *priv = conn->privateData;
+    remote_connect_domain_stats_register_args args;
+    remote_connect_domain_stats_register_ret ret;
+    remote_connect_domain_stats_deregister_args dargs;
+    int callbackID;
+    char *key = NULL;
+
+    remoteDriverLock(priv);
+
+    /* Every subscription is sampled separately by the server, so unlike
+     * other events there is no local sharing of server side callbacks,
+     * and the server side callback ID is known before registering */
+    args.stats = stats;
+    args.interval = interval;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_domain_stats_register_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (virAsprintf(&key, "%d", ret.callbackID) < 0 ||
+        virDomainStatsEventStateRegisterID(conn, priv->eventState, key,
+                                           callback, opaque, freecb,
+                                           &callbackID) < 0) {
+        dargs.callbackID = ret.callbackID;
+        ignore_value(call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER,
+                          (xdrproc_t) xdr_remote_connect_domain_stats_deregister_args,
+                          (char *) &dargs,
+                          (xdrproc_t) xdr_void, (char *) NULL));
+        goto done;
+    }
+    virObjectEventStateSetRemote(conn, priv->eventState, callbackID,
+                                 ret.callbackID);
+
+    rv = callbackID;
+
+ done:
+    VIR_FREE(key);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectDomainStatsDeregister(virConnectPtr conn,
+                                   int callbackID)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    remote_connect_domain_stats_deregister_args args;
+    int remoteID;
+
+    remoteDriverLock(priv);
+
+    if (virObjectEventStateEventID(conn, priv->eventState,
+                                   callbackID, &remoteID) < 0)
+        goto done;
+
+    if (virObjectEventStateDeregisterID(conn, priv->eventState,
+                                        callbackID, true) < 0)
+        goto done;
+
+    args.callbackID = remoteID;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER,
+             (xdrproc_t) xdr_remote_connect_domain_stats_deregister_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto done;
+
+    rv = 0;
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectListAllDomainsPage(virConnectPtr conn,
+                                const char *prefix,
+                                const char *cursor,
+                                unsigned int maxdomains,
+                                virDomainPtr **domains,
+                                char **next,
+                                unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    remote_connect_list_all_domains_page_args args;
+    remote_connect_list_all_domains_page_ret ret;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    size_t i;
+    int rv = -1;
+
+    remoteDriverLock(priv);
+
+    args.prefix = prefix ? (char **) &prefix : NULL;
+    args.cursor = cursor ? (char **) &cursor : NULL;
+    args.maxdomains = MIN(maxdomains, REMOTE_DOMAIN_LIST_MAX);
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_LIST_ALL_DOMAINS_PAGE,
+             (xdrproc_t) xdr_remote_connect_list_all_domains_page_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_list_all_domains_page_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (ret.domains.domains_len > args.maxdomains) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many remote domains: %d > %u"),
+                       ret.domains.domains_len, args.maxdomains);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(doms, ret.domains.domains_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.domains.domains_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, ret.domains.domains_val[i])))
+            goto cleanup;
+        ndoms++;
+    }
+
+    if (ret.next)
+        VIR_STEAL_PTR(*next, *ret.next);
+    VIR_STEAL_PTR(*domains, doms);
+    rv = ndoms;
+
+ cleanup:
+    virObjectListFreeCount(doms, ndoms);
+    xdr_free((xdrproc_t) xdr_remote_connect_list_all_domains_page_ret, (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectGetDomainsChangedSince(virConnectPtr conn,
+                                    unsigned long long generation,
+                                    unsigned long long *newgeneration,
+                                    virDomainPtr **changed,
+                                    unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    remote_connect_get_domains_changed_since_args args;
+    remote_connect_get_domains_changed_since_ret ret;
+    virDomainPtr *doms = NULL;
+    size_t ndoms = 0;
+    size_t i;
+    int rv = -1;
+
+    remoteDriverLock(priv);
+
+    args.generation = generation;
+    args.flags = flags;
+
+    memset(&ret, 0, sizeof(ret));
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_GET_DOMAINS_CHANGED_SINCE,
+             (xdrproc_t) xdr_remote_connect_get_domains_changed_since_args, (char *) &args,
+             (xdrproc_t) xdr_remote_connect_get_domains_changed_since_ret, (char *) &ret) == -1)
+        goto done;
+
+    if (ret.changed.changed_len > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("too many remote domains: %d > %d"),
+                       ret.changed.changed_len, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(doms, ret.changed.changed_len + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ret.changed.changed_len; i++) {
+        if (!(doms[i] = get_nonnull_domain(conn, ret.changed.changed_val[i])))
+            goto cleanup;
+        ndoms++;
+    }
+
+    *newgeneration = ret.generation;
+    VIR_STEAL_PTR(*changed, doms);
+    rv = ndoms;
+
+ cleanup:
+    virObjectListFreeCount(doms, ndoms);
+    xdr_free((xdrproc_t) xdr_remote_connect_get_domains_changed_since_ret, (char *) &ret);
+
+ done:
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
+static int
+remoteConnectMigrateDomains(virConnectPtr conn,
+                            virDomainPtr *doms,
+                            unsigned int ndoms,
+                            const char *dconnuri,
+                            virTypedParameterPtr params,
+                            int nparams,
+                            unsigned int concurrency,
+                            unsigned int flags)
+{
+    struct private_data *priv = conn->privateData;
+    int rv = -1;
+    size_t i;
+    remote_connect_migrate_domains_args args;
+
+    remoteDriverLock(priv);
+
+    memset(&args, 0, sizeof(args));
+
+    if (ndoms > REMOTE_DOMAIN_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many domains '%u' for limit '%d'"),
+                       ndoms, REMOTE_DOMAIN_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (nparams > REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("Too many migration parameters '%d' for limit '%d'"),
+                       nparams, REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(args.doms.doms_val, ndoms) < 0)
+        goto cleanup;
+    for (i = 0; i < ndoms; i++)
+        make_nonnull_domain(args.doms.doms_val + i, doms[i]);
+    args.doms.doms_len = ndoms;
+
+    args.dconnuri = (char *) dconnuri;
+    args.concurrency = concurrency;
+    args.flags = flags;
+
+    if (virTypedParamsSerialize(params, nparams,
+                                (virTypedParameterRemotePtr *) &args.params.params_val,
+                                &args.params.params_len,
+                                VIR_TYPED_PARAM_STRING_OKAY) < 0)
+        goto cleanup;
+
+    if (call(conn, priv, 0, REMOTE_PROC_CONNECT_MIGRATE_DOMAINS,
+             (xdrproc_t) xdr_remote_connect_migrate_domains_args, (char *) &args,
+             (xdrproc_t) xdr_void, (char *) NULL) == -1)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    virTypedParamsRemoteFree((virTypedParameterRemotePtr) args.params.params_val,
+                             args.params.params_len);
+    VIR_FREE(args.doms.doms_val);
+    remoteDriverUnlock(priv);
+    return rv;
+}
+
+
 static int
 remoteNodeAllocPages(virConnectPtr conn,
                      unsigned int npages,
@@ -8220,6 +9360,12 @@ get_nonnull_domain_snapshot(virDomainPtr domain, remote_nonnull_domain_snapshot
     return virGetDomainSnapshot(domain, snapshot.name);
 }
 
+static virDomainCheckpointPtr
+get_nonnull_domain_checkpoint(virDomainPtr domain, remote_nonnull_domain_checkpoint checkpoint)
+{
+    return virGetDomainCheckpoint(domain, checkpoint.name);
+}
+
 
 /* Make remote_nonnull_domain and remote_nonnull_network. */
 static void
@@ -8295,6 +9441,13 @@ make_nonnull_domain_snapshot(remote_nonnull_domain_snapshot *snapshot_dst, virDo
     make_nonnull_domain(&snapshot_dst->dom, snapshot_src->domain);
 }
 
+static void
+make_nonnull_domain_checkpoint(remote_nonnull_domain_checkpoint *checkpoint_dst, virDomainCheckpointPtr checkpoint_src)
+{
+    checkpoint_dst->name = checkpoint_src->name;
+    make_nonnull_domain(&checkpoint_dst->dom, checkpoint_src->domain);
+}
+
 /*----------------------------------------------------------------------*/
 
 unsigned long remoteVersion(void)
@@ -8536,7 +9689,19 @@ static virHypervisorDriver hypervisor_driver = {
     .connectCompareHypervisorCPU = remoteConnectCompareHypervisorCPU, /* 4.4.0 */
     .connectBaselineHypervisorCPU = remoteConnectBaselineHypervisorCPU, /* 4.4.0 */
     .nodeGetSEVInfo = remoteNodeGetSEVInfo, /* 4.5.0 */
-    .domainGetLaunchSecurityInfo = remoteDomainGetLaunchSecurityInfo /* 4.5.0 */
+    .domainGetLaunchSecurityInfo = remoteDomainGetLaunchSecurityInfo, /* 4.5.0 */
+    .connectDomainStatsRegister = remoteConnectDomainStatsRegister, /* 4.10.0 */
+    .connectDomainStatsDeregister = remoteConnectDomainStatsDeregister, /* 4.10.0 */
+    .connectMigrateDomains = remoteConnectMigrateDomains, /* 4.10.0 */
+    .domainCheckpointCreateXML = remoteDomainCheckpointCreateXML, /* 4.10.0 */
+    .domainCheckpointGetXMLDesc = remoteDomainCheckpointGetXMLDesc, /* 4.10.0 */
+    .domainListAllCheckpoints = remoteDomainListAllCheckpoints, /* 4.10.0 */
+    .domainCheckpointLookupByName = remoteDomainCheckpointLookupByName, /* 4.10.0 */
+    .domainCheckpointDelete = remoteDomainCheckpointDelete, /* 4.10.0 */
+    .domainBackupBegin = remoteDomainBackupBegin, /* 4.10.0 */
+    .domainAttachDevices = remoteDomainAttachDevices, /* 4.10.0 */
+    .connectListAllDomainsPage = remoteConnectListAllDomainsPage, /* 4.10.0 */
+    .connectGetDomainsChangedSince = remoteConnectGetDomainsChangedSince, /* 4.10.0 */
 };
 
 static virNetworkDriver network_driver = {
@@ -8562,6 +9727,8 @@ static virNetworkDriver network_driver = {
     .networkIsActive = remoteNetworkIsActive, /* 0.7.3 */
     .networkIsPersistent = remoteNetworkIsPersistent, /* 0.7.3 */
     .networkGetDHCPLeases = remoteNetworkGetDHCPLeases, /* 1.2.6 */
+    .networkUpdateBatch = remoteNetworkUpdateBatch, /* 4.10.0 */
+    .connectGetAllDHCPLeases = remoteConnectGetAllDHCPLeases, /* 4.10.0 */
 };
 
 static virInterfaceDriver interface_driver = {
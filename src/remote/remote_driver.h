@@ -31,6 +31,8 @@ int remoteRegister (void);
 
 unsigned long remoteVersion(void);
 
+int remoteSetSplitDaemon(const char *module);
+
 # define LIBVIRTD_LISTEN_ADDR NULL
 # define LIBVIRTD_TLS_PORT "16514"
 # define LIBVIRTD_TCP_PORT "16509"
@@ -142,6 +142,9 @@ const REMOTE_DOMAIN_MEMORY_STATS_MAX = 1024;
 /* Upper limit on lists of domain snapshots. */
 const REMOTE_DOMAIN_SNAPSHOT_LIST_MAX = 16384;
 
+/* Upper limit on lists of domain checkpoints. */
+const REMOTE_DOMAIN_CHECKPOINT_LIST_MAX = 16384;
+
 /* Maximum length of a block peek buffer message.
  * Note applications need to be aware of this limit and issue multiple
  * requests for large amounts of data.
@@ -232,9 +235,15 @@ const REMOTE_CONNECT_CPU_MODELS_MAX = 8192;
 /* Upper limit on number of mountpoints to frozen */
 const REMOTE_DOMAIN_FSFREEZE_MOUNTPOINTS_MAX = 256;
 
+/* Upper limit on number of devices attached at once */
+const REMOTE_DOMAIN_ATTACH_DEVICES_MAX = 1024;
+
 /* Upper limit on the maximum number of leases in one lease file */
 const REMOTE_NETWORK_DHCP_LEASES_MAX = 65536;
 
+/* Upper limit on the number of updates in one network update batch */
+const REMOTE_NETWORK_UPDATE_ITEMS_MAX = 16384;
+
 /* Upper limit on count of parameters returned via bulk stats API */
 const REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX = 262144;
 
@@ -262,6 +271,18 @@ const REMOTE_NODE_SEV_INFO_MAX = 64;
 /* Upper limit on number of launch security information entries */
 const REMOTE_DOMAIN_LAUNCH_SECURITY_INFO_PARAMS_MAX = 64;
 
+/* Upper limit on number of calls carried by a single batch */
+const REMOTE_CONNECT_BATCH_CALLS_MAX = 4096;
+
+/* Upper limit on the size of a single call carried by a batch */
+const REMOTE_CONNECT_BATCH_CALL_MAX = 262144;
+
+/* Upper limit on number of events carried by a single event batch */
+const REMOTE_EVENT_BATCH_EVENTS_MAX = 1024;
+
+/* Upper limit on the size of a single event carried by an event batch */
+const REMOTE_EVENT_BATCH_EVENT_MAX = 262144;
+
 /* UUID.  VIR_UUID_BUFLEN definition comes from libvirt.h */
 typedef opaque remote_uuid[VIR_UUID_BUFLEN];
 
@@ -327,6 +348,12 @@ struct remote_nonnull_domain_snapshot {
     remote_nonnull_domain dom;
 };
 
+/* A checkpoint which may not be NULL. */
+struct remote_nonnull_domain_checkpoint {
+    remote_nonnull_string name;
+    remote_nonnull_domain dom;
+};
+
 /* A domain or network which may be NULL. */
 typedef remote_nonnull_domain *remote_domain;
 typedef remote_nonnull_network *remote_network;
@@ -1283,6 +1310,12 @@ struct remote_domain_attach_device_flags_args {
     unsigned int flags;
 };
 
+struct remote_domain_attach_devices_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xmls<REMOTE_DOMAIN_ATTACH_DEVICES_MAX>; /* (const char **) */
+    unsigned int flags;
+};
+
 struct remote_domain_detach_device_args {
     remote_nonnull_domain dom;
     remote_nonnull_string xml;
@@ -1507,6 +1540,19 @@ struct remote_network_update_args {
     unsigned int flags;
 };
 
+struct remote_network_update_item {
+    unsigned int command;
+    unsigned int section;
+    int parentIndex;
+    remote_nonnull_string xml;
+};
+
+struct remote_network_update_batch_args {
+    remote_nonnull_network net;
+    remote_network_update_item items<REMOTE_NETWORK_UPDATE_ITEMS_MAX>;
+    unsigned int flags;
+};
+
 struct remote_network_create_args {
     remote_nonnull_network net;
 };
@@ -2919,6 +2965,28 @@ struct remote_connect_list_all_domains_ret { /* insert@1 */
     unsigned int ret;
 };
 
+struct remote_connect_list_all_domains_page_args {
+    remote_string prefix;
+    remote_string cursor;
+    unsigned int maxdomains;
+    unsigned int flags;
+};
+
+struct remote_connect_list_all_domains_page_ret {
+    remote_nonnull_domain domains<REMOTE_DOMAIN_LIST_MAX>;
+    remote_string next;
+};
+
+struct remote_connect_get_domains_changed_since_args {
+    unsigned hyper generation;
+    unsigned int flags;
+};
+
+struct remote_connect_get_domains_changed_since_ret {
+    remote_nonnull_domain changed<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned hyper generation;
+};
+
 struct remote_connect_list_all_storage_pools_args {
     int need_results;
     unsigned int flags;
@@ -3298,6 +3366,17 @@ struct remote_network_get_dhcp_leases_ret {
     unsigned int ret;
 };
 
+struct remote_connect_get_all_dhcp_leases_args {
+    remote_nonnull_network nets<REMOTE_NETWORK_LIST_MAX>;
+    remote_nonnull_string macs<REMOTE_NETWORK_DHCP_LEASES_MAX>;
+    unsigned int flags;
+};
+
+struct remote_connect_get_all_dhcp_leases_ret {
+    remote_network_dhcp_lease leases<REMOTE_NETWORK_DHCP_LEASES_MAX>;
+    unsigned int ret;
+};
+
 struct remote_domain_stats_record {
     remote_nonnull_domain dom;
     remote_typed_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
@@ -3557,6 +3636,135 @@ struct remote_connect_list_all_nwfilter_bindings_ret { /* insert@1 */
     unsigned int ret;
 };
 
+/* A complete RPC call message, length word and header included,
+ * exactly as it would be sent on its own */
+struct remote_connect_batch_call {
+    opaque msg<REMOTE_CONNECT_BATCH_CALL_MAX>;
+};
+
+/* Each of the calls is dispatched as if received on its own, and
+ * sends its own reply tagged with its own serial. The reply to the
+ * batch itself is only sent once all of them have been replied to. */
+struct remote_connect_batch_args {
+    remote_connect_batch_call calls<REMOTE_CONNECT_BATCH_CALLS_MAX>;
+};
+
+/* A complete event message, length word and header included,
+ * exactly as it would be sent on its own */
+struct remote_event_batch_event {
+    opaque msg<REMOTE_EVENT_BATCH_EVENT_MAX>;
+};
+
+/* Events queued for a client over a short period, to be
+ * dispatched in order as if each was received on its own */
+struct remote_event_batch_msg {
+    remote_event_batch_event events<REMOTE_EVENT_BATCH_EVENTS_MAX>;
+};
+
+struct remote_connect_domain_stats_register_args {
+    unsigned int stats;
+    unsigned int interval;
+    unsigned int flags;
+};
+
+struct remote_connect_domain_stats_register_ret {
+    int callbackID;
+};
+
+struct remote_connect_domain_stats_deregister_args {
+    int callbackID;
+};
+
+struct remote_domain_event_stats_msg {
+    int callbackID;
+    remote_domain_stats_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
+struct remote_connect_migrate_domains_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    remote_nonnull_string dconnuri;
+    remote_typed_param params<REMOTE_DOMAIN_MIGRATE_PARAM_LIST_MAX>;
+    unsigned int concurrency;
+    unsigned int flags;
+};
+
+struct remote_domain_checkpoint_create_xml_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string xml_desc;
+    unsigned int flags;
+};
+
+struct remote_domain_checkpoint_create_xml_ret {
+    remote_nonnull_domain_checkpoint checkpoint;
+};
+
+struct remote_domain_checkpoint_get_xml_desc_args {
+    remote_nonnull_domain_checkpoint checkpoint;
+    unsigned int flags;
+};
+
+struct remote_domain_checkpoint_get_xml_desc_ret {
+    remote_nonnull_string xml;
+};
+
+struct remote_domain_list_all_checkpoints_args {
+    remote_nonnull_domain dom;
+    int need_results;
+    unsigned int flags;
+};
+
+struct remote_domain_list_all_checkpoints_ret { /* insert@1 */
+    remote_nonnull_domain_checkpoint checkpoints<REMOTE_DOMAIN_CHECKPOINT_LIST_MAX>;
+    int ret;
+};
+
+struct remote_domain_checkpoint_lookup_by_name_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string name;
+    unsigned int flags;
+};
+
+struct remote_domain_checkpoint_lookup_by_name_ret {
+    remote_nonnull_domain_checkpoint checkpoint;
+};
+
+struct remote_domain_checkpoint_delete_args {
+    remote_nonnull_domain_checkpoint checkpoint;
+    unsigned int flags;
+};
+
+struct remote_domain_backup_begin_args {
+    remote_nonnull_domain dom;
+    remote_nonnull_string backup_xml;
+    remote_string checkpoint_xml;
+    unsigned int flags;
+};
+
+/* REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED is only called when the
+ * server supports VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS. Each field
+ * name is sent once in the names array of the reply and parameters refer
+ * to it by its index there. */
+struct remote_connect_get_all_domain_stats_packed_args {
+    remote_nonnull_domain doms<REMOTE_DOMAIN_LIST_MAX>;
+    unsigned int stats;
+    unsigned int flags;
+};
+
+struct remote_packed_typed_param {
+    unsigned int name;
+    remote_typed_param_value value;
+};
+
+struct remote_packed_domain_stats_record {
+    remote_nonnull_domain dom;
+    remote_packed_typed_param params<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+};
+
+struct remote_connect_get_all_domain_stats_packed_ret {
+    remote_nonnull_string names<REMOTE_CONNECT_GET_ALL_DOMAIN_STATS_MAX>;
+    remote_packed_domain_stats_record retStats<REMOTE_DOMAIN_LIST_MAX>;
+};
+
 /*----- Protocol. -----*/
 
 /* Define the program number, protocol version and procedure numbers here. */
@@ -3581,13 +3789,16 @@ enum remote_procedure {
      *   <paramnumber> specifies at which offset the stream parameter is inserted
      *   in the function parameter list.
      *
-     * - @priority: low|high
+     * - @priority: low|high|bulk
      *
      *   Each API that might eventually access hypervisor's monitor (and thus
      *   block) MUST fall into low priority. However, there are some exceptions
      *   to this rule, e.g. domainDestroy. Other APIs MAY be marked as high
      *   priority. If in doubt, it's safe to choose low. Low is taken as default,
-     *   and thus can be left out.
+     *   and thus can be left out. APIs which typically keep a worker busy for
+     *   a long time, like saving a domain or collecting the statistics of all
+     *   domains, SHOULD be marked as bulk so that the number of workers they
+     *   can take at once may be limited.
      *
      * - @acl: <object>:<permission>
      * - @acl: <object>:<permission>:<flagname>
@@ -3974,12 +4185,14 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:core_dump
      */
     REMOTE_PROC_DOMAIN_CORE_DUMP = 53,
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:start
      * @acl: domain:write
      */
@@ -3987,6 +4200,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:hibernate
      */
     REMOTE_PROC_DOMAIN_SAVE = 55,
@@ -4152,6 +4366,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: storage_pool:format
      */
     REMOTE_PROC_STORAGE_POOL_BUILD = 79,
@@ -4178,6 +4393,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: storage_pool:refresh
      */
     REMOTE_PROC_STORAGE_POOL_REFRESH = 83,
@@ -4467,6 +4683,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: storage_vol:create
      */
     REMOTE_PROC_STORAGE_VOL_CREATE_XML_FROM = 125,
@@ -4750,6 +4967,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: storage_vol:format
      */
     REMOTE_PROC_STORAGE_VOL_WIPE = 165,
@@ -4867,6 +5085,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:hibernate
      */
     REMOTE_PROC_DOMAIN_MANAGED_SAVE = 182,
@@ -5205,12 +5424,14 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:hibernate
      */
     REMOTE_PROC_DOMAIN_SAVE_FLAGS = 232,
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:start
      * @acl: domain:write
      */
@@ -5383,6 +5604,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: storage_vol:format
      */
     REMOTE_PROC_STORAGE_VOL_WIPE_PATTERN = 259,
@@ -5874,6 +6096,7 @@ enum remote_procedure {
 
     /**
      * @generate: both
+     * @priority: bulk
      * @acl: domain:core_dump
      */
     REMOTE_PROC_DOMAIN_CORE_DUMP_WITH_FORMAT = 334,
@@ -5935,6 +6158,7 @@ enum remote_procedure {
 
     /**
      * @generate: none
+     * @priority: bulk
      * @acl: connect:search_domains
      * @aclfilter: domain:read
      */
@@ -6312,5 +6536,130 @@ enum remote_procedure {
      * @acl: connect:search_nwfilter_bindings
      * @aclfilter: nwfilter_binding:getattr
      */
-    REMOTE_PROC_CONNECT_LIST_ALL_NWFILTER_BINDINGS = 401
+    REMOTE_PROC_CONNECT_LIST_ALL_NWFILTER_BINDINGS = 401,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_CONNECT_BATCH = 402,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_REGISTER = 403,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:read
+     */
+    REMOTE_PROC_CONNECT_DOMAIN_STATS_DEREGISTER = 404,
+
+    /**
+     * @generate: both
+     * @acl: none
+     */
+    REMOTE_PROC_DOMAIN_EVENT_STATS = 405,
+
+    /**
+     * @generate: none
+     * @acl: domain:migrate
+     */
+    REMOTE_PROC_CONNECT_MIGRATE_DOMAINS = 406,
+
+    /**
+     * @generate: both
+     * @acl: domain:snapshot
+     */
+    REMOTE_PROC_DOMAIN_CHECKPOINT_CREATE_XML = 407,
+
+    /**
+     * @generate: both
+     * @priority: high
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_CHECKPOINT_GET_XML_DESC = 408,
+
+    /**
+     * @generate: both
+     * @priority: high
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_LIST_ALL_CHECKPOINTS = 409,
+
+    /**
+     * @generate: both
+     * @priority: high
+     * @acl: domain:read
+     */
+    REMOTE_PROC_DOMAIN_CHECKPOINT_LOOKUP_BY_NAME = 410,
+
+    /**
+     * @generate: both
+     * @acl: domain:snapshot
+     */
+    REMOTE_PROC_DOMAIN_CHECKPOINT_DELETE = 411,
+
+    /**
+     * @generate: both
+     * @acl: domain:snapshot
+     * @acl: domain:block_write
+     */
+    REMOTE_PROC_DOMAIN_BACKUP_BEGIN = 412,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: network:write
+     * @acl: network:save:!VIR_NETWORK_UPDATE_AFFECT_CONFIG|VIR_NETWORK_UPDATE_AFFECT_LIVE
+     * @acl: network:save:VIR_NETWORK_UPDATE_AFFECT_CONFIG
+     */
+    REMOTE_PROC_NETWORK_UPDATE_BATCH = 413,
+
+    /**
+     * @generate: both
+     * @acl: domain:write
+     * @acl: domain:save:!VIR_DOMAIN_AFFECT_CONFIG|VIR_DOMAIN_AFFECT_LIVE
+     * @acl: domain:save:VIR_DOMAIN_AFFECT_CONFIG
+     */
+    REMOTE_PROC_DOMAIN_ATTACH_DEVICES = 414,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     */
+    REMOTE_PROC_CONNECT_LIST_ALL_DOMAINS_PAGE = 415,
+
+    /**
+     * @generate: none
+     * @priority: high
+     * @acl: connect:search_domains
+     * @aclfilter: domain:getattr
+     */
+    REMOTE_PROC_CONNECT_GET_DOMAINS_CHANGED_SINCE = 416,
+
+    /**
+     * @generate: none
+     * @priority: bulk
+     * @acl: connect:search_domains
+     * @aclfilter: domain:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DOMAIN_STATS_PACKED = 417,
+
+    /**
+     * @generate: none
+     * @acl: none
+     */
+    REMOTE_PROC_EVENT_BATCH = 418,
+
+    /**
+     * @generate: none
+     * @acl: connect:search_networks
+     * @aclfilter: network:read
+     */
+    REMOTE_PROC_CONNECT_GET_ALL_DHCP_LEASES = 419
 };
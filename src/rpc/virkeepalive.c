@@ -36,6 +36,9 @@
 
 VIR_LOG_INIT("rpc.keepalive");
 
+/* Number of one second slots in the keepalive timer wheel */
+#define VIR_KEEPALIVE_WHEEL_SLOTS 64
+
 struct _virKeepAlive {
     virObjectLockable parent;
 
@@ -44,7 +47,16 @@ struct _virKeepAlive {
     unsigned int countToDeath;
     time_t lastPacketReceived;
     time_t intervalStart;
-    int timer;
+
+    /* Timer wheel fields, protected by the lock of the wheel except
+     * for @active which is protected by the lock of this object */
+    bool active;
+    bool linked;
+    time_t due;
+    size_t slot;
+    virKeepAlivePtr prev;
+    virKeepAlivePtr next;
+    virKeepAlivePtr nextExpired;
 
     virKeepAliveSendFunc sendCB;
     virKeepAliveDeadFunc deadCB;
@@ -53,8 +65,29 @@ struct _virKeepAlive {
 };
 
 
+/*
+ * Rather than each keepalive object owning an event loop timer, all of
+ * them are kept in a timing wheel with one second slots driven by a
+ * single timer which only runs while the wheel is not empty. Lock
+ * ordering is keepalive object, then wheel, then event loop.
+ */
+typedef struct _virKeepAliveWheel virKeepAliveWheel;
+struct _virKeepAliveWheel {
+    virMutex lock;
+    int timer;
+    size_t nentries;
+    time_t lastTick;
+    virKeepAlivePtr slots[VIR_KEEPALIVE_WHEEL_SLOTS];
+};
+
+static virKeepAliveWheel virKeepAliveTimers = {
+    .lock = VIR_MUTEX_INITIALIZER,
+    .timer = -1,
+};
+
 static virClassPtr virKeepAliveClass;
 static void virKeepAliveDispose(void *obj);
+static void virKeepAliveExpire(virKeepAlivePtr ka);
 
 static int virKeepAliveOnceInit(void)
 {
@@ -66,6 +99,125 @@ static int virKeepAliveOnceInit(void)
 
 VIR_ONCE_GLOBAL_INIT(virKeepAlive)
 
+
+/* Must be called with the wheel locked */
+static void
+virKeepAliveWheelUnlink(virKeepAlivePtr ka)
+{
+    virKeepAliveWheel *wheel = &virKeepAliveTimers;
+
+    if (!ka->linked)
+        return;
+
+    if (ka->prev)
+        ka->prev->next = ka->next;
+    else
+        wheel->slots[ka->slot] = ka->next;
+    if (ka->next)
+        ka->next->prev = ka->prev;
+
+    ka->prev = ka->next = NULL;
+    ka->linked = false;
+    wheel->nentries--;
+}
+
+
+static void
+virKeepAliveWheelTick(int timer,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    virKeepAliveWheel *wheel = &virKeepAliveTimers;
+    virKeepAlivePtr expired = NULL;
+    virKeepAlivePtr ka;
+    time_t now = time(NULL);
+    time_t t;
+    size_t n;
+
+    virMutexLock(&wheel->lock);
+
+    for (t = wheel->lastTick + 1, n = 0;
+         t <= now && n < VIR_KEEPALIVE_WHEEL_SLOTS;
+         t++, n++) {
+        virKeepAlivePtr next;
+
+        for (ka = wheel->slots[t % VIR_KEEPALIVE_WHEEL_SLOTS]; ka; ka = next) {
+            next = ka->next;
+            if (ka->due > now)
+                continue;
+
+            virKeepAliveWheelUnlink(ka);
+            virObjectRef(ka);
+            ka->nextExpired = expired;
+            expired = ka;
+        }
+    }
+    wheel->lastTick = now;
+
+    if (wheel->nentries == 0)
+        virEventUpdateTimeout(timer, -1);
+
+    virMutexUnlock(&wheel->lock);
+
+    while ((ka = expired)) {
+        expired = ka->nextExpired;
+        ka->nextExpired = NULL;
+        virKeepAliveExpire(ka);
+        virObjectUnref(ka);
+    }
+}
+
+
+/* Must be called with the wheel locked */
+static int
+virKeepAliveWheelLink(virKeepAlivePtr ka)
+{
+    virKeepAliveWheel *wheel = &virKeepAliveTimers;
+
+    if (wheel->nentries == 0)
+        wheel->lastTick = time(NULL);
+
+    if (wheel->timer < 0) {
+        if ((wheel->timer = virEventAddTimeout(1000, virKeepAliveWheelTick,
+                                               NULL, NULL)) < 0)
+            return -1;
+    } else if (wheel->nentries == 0) {
+        virEventUpdateTimeout(wheel->timer, 1000);
+    }
+
+    /* A slot which has already been processed would not be looked at
+     * again before the wheel turns around */
+    ka->slot = MAX(ka->due, wheel->lastTick + 1) % VIR_KEEPALIVE_WHEEL_SLOTS;
+    ka->prev = NULL;
+    ka->next = wheel->slots[ka->slot];
+    if (ka->next)
+        ka->next->prev = ka;
+    wheel->slots[ka->slot] = ka;
+    ka->linked = true;
+    wheel->nentries++;
+
+    return 0;
+}
+
+
+/* Must be called with @ka locked, after updating ka->due */
+static void
+virKeepAliveSchedule(virKeepAlivePtr ka)
+{
+    int rc;
+
+    if (!ka->active)
+        return;
+
+    virMutexLock(&virKeepAliveTimers.lock);
+    virKeepAliveWheelUnlink(ka);
+    rc = virKeepAliveWheelLink(ka);
+    virMutexUnlock(&virKeepAliveTimers.lock);
+
+    if (rc < 0)
+        VIR_WARN("Failed to schedule keepalive timer for client %p",
+                 ka->client);
+}
+
 static virNetMessagePtr
 virKeepAliveMessage(virKeepAlivePtr ka, int proc)
 {
@@ -121,9 +273,11 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
     if (ka->interval <= 0 || ka->intervalStart == 0)
         return false;
 
+    /* Any packet received since the last ping moved the start of the
+     * interval, there is no need to probe the connection yet */
     if (now - ka->intervalStart < ka->interval) {
-        timeval = ka->interval - (now - ka->intervalStart);
-        virEventUpdateTimeout(ka->timer, timeval * 1000);
+        ka->due = ka->intervalStart + ka->interval;
+        virKeepAliveSchedule(ka);
         return false;
     }
 
@@ -138,45 +292,46 @@ virKeepAliveTimerInternal(virKeepAlivePtr ka,
                   ka->client, ka->count, timeval);
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("connection closed due to keepalive timeout"));
+        ka->due = now + ka->interval;
+        virKeepAliveSchedule(ka);
         return true;
     } else {
         ka->countToDeath--;
         ka->intervalStart = now;
         *msg = virKeepAliveMessage(ka, KEEPALIVE_PROC_PING);
-        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
+        ka->due = now + ka->interval;
+        virKeepAliveSchedule(ka);
         return false;
     }
 }
 
 
+/* Called from the wheel timer with a reference on @ka */
 static void
-virKeepAliveTimer(int timer ATTRIBUTE_UNUSED, void *opaque)
+virKeepAliveExpire(virKeepAlivePtr ka)
 {
-    virKeepAlivePtr ka = opaque;
     virNetMessagePtr msg = NULL;
     bool dead;
     void *client;
 
-    virObjectRef(ka);
     virObjectLock(ka);
 
+    if (!ka->active) {
+        virObjectUnlock(ka);
+        return;
+    }
+
     client = ka->client;
     dead = virKeepAliveTimerInternal(ka, &msg);
 
     virObjectUnlock(ka);
 
-    if (!dead && !msg)
-        goto cleanup;
-
     if (dead) {
         ka->deadCB(client);
-    } else if (ka->sendCB(client, msg) < 0) {
+    } else if (msg && ka->sendCB(client, msg) < 0) {
         VIR_WARN("Failed to send keepalive request to client %p", client);
         virNetMessageFree(msg);
     }
-
- cleanup:
-    virObjectUnref(ka);
 }
 
 
@@ -201,7 +356,6 @@ virKeepAliveNew(int interval,
     ka->interval = interval;
     ka->count = count;
     ka->countToDeath = count;
-    ka->timer = -1;
     ka->client = client;
     ka->sendCB = sendCB;
     ka->deadCB = deadCB;
@@ -236,10 +390,11 @@ virKeepAliveStart(virKeepAlivePtr ka,
     time_t delay;
     int timeout;
     time_t now;
+    int rc;
 
     virObjectLock(ka);
 
-    if (ka->timer >= 0) {
+    if (ka->active) {
         VIR_DEBUG("Keepalive messages already enabled");
         ret = 0;
         goto cleanup;
@@ -279,12 +434,16 @@ virKeepAliveStart(virKeepAlivePtr ka,
     else
         timeout = ka->interval - delay;
     ka->intervalStart = now - (ka->interval - timeout);
-    ka->timer = virEventAddTimeout(timeout * 1000, virKeepAliveTimer,
-                                   ka, virObjectFreeCallback);
-    if (ka->timer < 0)
+    ka->due = now + timeout;
+
+    virMutexLock(&virKeepAliveTimers.lock);
+    rc = virKeepAliveWheelLink(ka);
+    virMutexUnlock(&virKeepAliveTimers.lock);
+    if (rc < 0)
         goto cleanup;
 
-    /* the timer now has another reference to this object */
+    /* the wheel now has another reference to this object */
+    ka->active = true;
     virObjectRef(ka);
     ret = 0;
 
@@ -297,18 +456,25 @@ virKeepAliveStart(virKeepAlivePtr ka,
 void
 virKeepAliveStop(virKeepAlivePtr ka)
 {
+    bool wasActive;
+
     virObjectLock(ka);
 
     PROBE(RPC_KEEPALIVE_STOP,
           "ka=%p client=%p",
           ka, ka->client);
 
-    if (ka->timer > 0) {
-        virEventRemoveTimeout(ka->timer);
-        ka->timer = -1;
+    if ((wasActive = ka->active)) {
+        ka->active = false;
+        virMutexLock(&virKeepAliveTimers.lock);
+        virKeepAliveWheelUnlink(ka);
+        virMutexUnlock(&virKeepAliveTimers.lock);
     }
 
     virObjectUnlock(ka);
+
+    if (wasActive)
+        virObjectUnref(ka);
 }
 
 
@@ -403,9 +569,8 @@ virKeepAliveCheckMessage(virKeepAlivePtr ka,
         }
     }
 
-    if (ka->timer >= 0)
-        virEventUpdateTimeout(ka->timer, ka->interval * 1000);
-
+    /* The timer is left alone, it finds out the connection is alive
+     * from the interval start when it expires */
     virObjectUnlock(ka);
 
     return ret;
@@ -43,6 +43,9 @@
 
 VIR_LOG_INIT("rpc.netclient");
 
+/* Maximum number of queued calls handed to a single writev */
+#define VIR_NET_CLIENT_WRITEV_MAX 16
+
 typedef struct _virNetClientCall virNetClientCall;
 typedef virNetClientCall *virNetClientCallPtr;
 
@@ -62,6 +65,17 @@ struct _virNetClientCall {
 
     virCond cond;
 
+    /* Calls carried inside @msg, see virNetClientSendBatch */
+    virNetMessagePtr *batch;
+    size_t nbatch;
+    size_t nbatchPending;
+
+    /* Calls made with virNetClientSubmit are kept after completion
+     * until their future is freed, unless it was already freed */
+    bool async;
+    bool abandoned;
+    bool failed;
+
     virNetClientCallPtr next;
 };
 
@@ -95,7 +109,8 @@ struct _virNetClient {
      * List of calls currently waiting for dispatch
      * The calls should all have threads waiting for
      * them, except possibly the first call in the list
-     * which might be a partially sent non-blocking call.
+     * which might be a partially sent non-blocking call,
+     * and calls made with virNetClientSubmit.
      */
     virNetClientCallPtr waitDispatch;
     /* True if a thread holds the buck */
@@ -1100,43 +1115,92 @@ int virNetClientGetTLSKeySize(virNetClientPtr client)
 }
 #endif
 
+static bool
+virNetClientCallMatchReply(virNetMessagePtr msg,
+                           virNetMessagePtr reply)
+{
+    return msg->header.prog == reply->header.prog &&
+        msg->header.vers == reply->header.vers &&
+        msg->header.serial == reply->header.serial;
+}
+
+static int
+virNetClientCallCopyReply(virNetClientPtr client,
+                          virNetMessagePtr msg)
+{
+    msg->bufferLength = 0;
+    if (virNetMessageResizeBuffer(msg, client->msg.bufferLength) < 0)
+        return -1;
+
+    memcpy(msg->buffer, client->msg.buffer, client->msg.bufferLength);
+    memcpy(&msg->header, &client->msg.header, sizeof(client->msg.header));
+    msg->bufferLength = client->msg.bufferLength;
+    msg->bufferOffset = client->msg.bufferOffset;
+
+    msg->nfds = client->msg.nfds;
+    msg->fds = client->msg.fds;
+    client->msg.nfds = 0;
+    client->msg.fds = NULL;
+
+    return 0;
+}
+
+/*
+ * A batch is complete once the reply to the batch itself has
+ * arrived, and either all the calls it carried were replied to,
+ * or the batch failed as a whole.
+ */
+static void
+virNetClientCallCheckBatch(virNetClientCallPtr call)
+{
+    if (call->msg->header.type == VIR_NET_CALL)
+        return;
+
+    if (call->nbatchPending == 0 ||
+        call->msg->header.status != VIR_NET_OK)
+        call->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+}
+
 static int
 virNetClientCallDispatchReply(virNetClientPtr client)
 {
     virNetClientCallPtr thecall;
+    size_t i;
 
     /* Ok, definitely got an RPC reply now find
        out which waiting call is associated with it */
-    thecall = client->waitDispatch;
-    while (thecall &&
-           !(thecall->msg->header.prog == client->msg.header.prog &&
-             thecall->msg->header.vers == client->msg.header.vers &&
-             thecall->msg->header.serial == client->msg.header.serial))
-        thecall = thecall->next;
-
-    if (!thecall) {
-        virReportError(VIR_ERR_RPC,
-                       _("no call waiting for reply with prog %d vers %d serial %d"),
-                       client->msg.header.prog, client->msg.header.vers, client->msg.header.serial);
-        return -1;
-    }
+    for (thecall = client->waitDispatch; thecall; thecall = thecall->next) {
+        if (virNetClientCallMatchReply(thecall->msg, &client->msg)) {
+            if (virNetClientCallCopyReply(client, thecall->msg) < 0)
+                return -1;
 
-    if (VIR_REALLOC_N(thecall->msg->buffer, client->msg.bufferLength) < 0)
-        return -1;
+            if (thecall->batch)
+                virNetClientCallCheckBatch(thecall);
+            else
+                thecall->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+            return 0;
+        }
 
-    memcpy(thecall->msg->buffer, client->msg.buffer, client->msg.bufferLength);
-    memcpy(&thecall->msg->header, &client->msg.header, sizeof(client->msg.header));
-    thecall->msg->bufferLength = client->msg.bufferLength;
-    thecall->msg->bufferOffset = client->msg.bufferOffset;
+        /* Batched calls are left as VIR_NET_CALL until replied to */
+        for (i = 0; i < thecall->nbatch; i++) {
+            virNetMessagePtr msg = thecall->batch[i];
 
-    thecall->msg->nfds = client->msg.nfds;
-    thecall->msg->fds = client->msg.fds;
-    client->msg.nfds = 0;
-    client->msg.fds = NULL;
+            if (msg->header.type == VIR_NET_CALL &&
+                virNetClientCallMatchReply(msg, &client->msg)) {
+                if (virNetClientCallCopyReply(client, msg) < 0)
+                    return -1;
 
-    thecall->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+                thecall->nbatchPending--;
+                virNetClientCallCheckBatch(thecall);
+                return 0;
+            }
+        }
+    }
 
-    return 0;
+    virReportError(VIR_ERR_RPC,
+                   _("no call waiting for reply with prog %d vers %d serial %d"),
+                   client->msg.header.prog, client->msg.header.vers, client->msg.header.serial);
+    return -1;
 }
 
 static int virNetClientCallDispatchMessage(virNetClientPtr client)
@@ -1296,6 +1360,62 @@ virNetClientCallDispatch(virNetClientPtr client)
 }
 
 
+/*
+ * Write out the data of @thecall, along with the data of any further
+ * calls queued behind it which are waiting to transmit, in a single
+ * writev. Gathering stops after a call which carries FDs, since those
+ * are only sent once all of the message data has gone out.
+ *
+ * Returns the number of bytes written, 0 on EAGAIN and -1 on error
+ */
+static ssize_t
+virNetClientIOWriteBuffers(virNetClientPtr client,
+                           virNetClientCallPtr thecall)
+{
+    struct iovec iov[VIR_NET_CLIENT_WRITEV_MAX];
+    int niov = 0;
+    virNetClientCallPtr call;
+    ssize_t ret;
+    size_t done;
+
+    for (call = thecall;
+         call && niov < ARRAY_CARDINALITY(iov);
+         call = call->next) {
+        if (call->mode != VIR_NET_CLIENT_MODE_WAIT_TX)
+            continue;
+
+        if (call->msg->bufferOffset < call->msg->bufferLength) {
+            iov[niov].iov_base = call->msg->buffer + call->msg->bufferOffset;
+            iov[niov].iov_len = call->msg->bufferLength - call->msg->bufferOffset;
+            niov++;
+        }
+
+        if (call->msg->nfds)
+            break;
+    }
+
+    ret = virNetSocketWritev(client->sock, iov, niov);
+    if (ret <= 0)
+        return ret;
+
+    done = ret;
+    for (call = thecall; call && done; call = call->next) {
+        size_t len;
+
+        if (call->mode != VIR_NET_CLIENT_MODE_WAIT_TX)
+            continue;
+
+        len = call->msg->bufferLength - call->msg->bufferOffset;
+        if (len > done)
+            len = done;
+        call->msg->bufferOffset += len;
+        done -= len;
+    }
+
+    return ret;
+}
+
+
 static ssize_t
 virNetClientIOWriteMessage(virNetClientPtr client,
                            virNetClientCallPtr thecall)
@@ -1303,13 +1423,9 @@ virNetClientIOWriteMessage(virNetClientPtr client,
     ssize_t ret = 0;
 
     if (thecall->msg->bufferOffset < thecall->msg->bufferLength) {
-        ret = virNetSocketWrite(client->sock,
-                                thecall->msg->buffer + thecall->msg->bufferOffset,
-                                thecall->msg->bufferLength - thecall->msg->bufferOffset);
+        ret = virNetClientIOWriteBuffers(client, thecall);
         if (ret <= 0)
             return ret;
-
-        thecall->msg->bufferOffset += ret;
     }
 
     if (thecall->msg->bufferOffset == thecall->msg->bufferLength) {
@@ -1370,8 +1486,8 @@ virNetClientIOReadMessage(virNetClientPtr client)
 
     /* Start by reading length word */
     if (client->msg.bufferLength == 0) {
-        client->msg.bufferLength = 4;
-        if (VIR_ALLOC_N(client->msg.buffer, client->msg.bufferLength) < 0)
+        if (virNetMessageResizeBuffer(&client->msg,
+                                      VIR_NET_MESSAGE_LEN_MAX) < 0)
             return -ENOMEM;
     }
 
@@ -1515,6 +1631,13 @@ static bool virNetClientIOEventLoopRemoveDone(virNetClientCallPtr call,
     if (call->haveThread) {
         VIR_DEBUG("Waking up sleep %p", call);
         virCondSignal(&call->cond);
+    } else if (call->async && !call->abandoned) {
+        VIR_DEBUG("Keeping completed call %p for its future", call);
+    } else if (call->async) {
+        VIR_DEBUG("Removing completed abandoned call %p", call);
+        virCondDestroy(&call->cond);
+        virNetMessageFree(call->msg);
+        VIR_FREE(call);
     } else {
         VIR_DEBUG("Removing completed call %p", call);
         if (call->expectReply)
@@ -1545,9 +1668,19 @@ virNetClientIOEventLoopRemoveAll(virNetClientCallPtr call,
     if (call == thiscall)
         return false;
 
+    if (call->async && !call->abandoned) {
+        VIR_DEBUG("Failing call %p, left to its future", call);
+        call->failed = true;
+        call->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+        return true;
+    }
+
     VIR_DEBUG("Removing call %p", call);
     virCondDestroy(&call->cond);
-    VIR_FREE(call->msg);
+    if (call->async)
+        virNetMessageFree(call->msg);
+    else
+        VIR_FREE(call->msg);
     VIR_FREE(call);
     return true;
 }
@@ -1862,11 +1995,12 @@ static void virNetClientIOUpdateCallback(virNetClientPtr client,
  * Returns 1 if the call was queued and will be completed later (only
  * for nonBlock == true), 0 if the call was completed and -1 on error.
  */
+static int virNetClientIOProcess(virNetClientPtr client,
+                                 virNetClientCallPtr thiscall);
+
 static int virNetClientIO(virNetClientPtr client,
                           virNetClientCallPtr thiscall)
 {
-    int rv = -1;
-
     VIR_DEBUG("Outgoing message prog=%u version=%u serial=%u proc=%d type=%d length=%zu dispatch=%p",
               thiscall->msg->header.prog,
               thiscall->msg->header.vers,
@@ -1879,6 +2013,19 @@ static int virNetClientIO(virNetClientPtr client,
     /* Stick ourselves on the end of the wait queue */
     virNetClientCallQueue(&client->waitDispatch, thiscall);
 
+    return virNetClientIOProcess(client, thiscall);
+}
+
+
+/*
+ * Process @thiscall, which is already queued, as virNetClientIO
+ * describes.
+ */
+static int virNetClientIOProcess(virNetClientPtr client,
+                                 virNetClientCallPtr thiscall)
+{
+    int rv = -1;
+
     /* Check to see if another thread is dispatching */
     if (client->haveTheBuck) {
         char ignore = 1;
@@ -2106,7 +2253,9 @@ virNetClientQueueNonBlocking(virNetClientPtr client,
 static int virNetClientSendInternal(virNetClientPtr client,
                                     virNetMessagePtr msg,
                                     bool expectReply,
-                                    bool nonBlock)
+                                    bool nonBlock,
+                                    virNetMessagePtr *batch,
+                                    size_t nbatch)
 {
     virNetClientCallPtr call;
     int ret = -1;
@@ -2127,6 +2276,9 @@ static int virNetClientSendInternal(virNetClientPtr client,
         return -1;
 
     call->haveThread = true;
+    call->batch = batch;
+    call->nbatch = nbatch;
+    call->nbatchPending = nbatch;
     ret = virNetClientIO(client, call);
 
     /* If queued, the call will be finished and freed later by another thread;
@@ -2155,7 +2307,37 @@ int virNetClientSendWithReply(virNetClientPtr client,
 {
     int ret;
     virObjectLock(client);
-    ret = virNetClientSendInternal(client, msg, true, false);
+    ret = virNetClientSendInternal(client, msg, true, false, NULL, 0);
+    virObjectUnlock(client);
+    if (ret < 0)
+        return -1;
+    return 0;
+}
+
+
+/*
+ * @msg: a message carrying the calls in @calls
+ * @calls: call messages already encoded inside @msg
+ * @ncalls: number of elements in @calls
+ *
+ * Send @msg synchronously, and wait synchronously for its reply as
+ * well as the replies to all of @calls, which may arrive in any
+ * order. Each of @calls is filled with its own reply. If the batch
+ * failed as a whole, calls which got no reply keep their
+ * VIR_NET_CALL type.
+ *
+ * The caller is responsible for free'ing @msg and @calls
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNetClientSendBatch(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetMessagePtr *calls,
+                          size_t ncalls)
+{
+    int ret;
+    virObjectLock(client);
+    ret = virNetClientSendInternal(client, msg, true, false, calls, ncalls);
     virObjectUnlock(client);
     if (ret < 0)
         return -1;
@@ -2178,7 +2360,7 @@ int virNetClientSendNoReply(virNetClientPtr client,
 {
     int ret;
     virObjectLock(client);
-    ret = virNetClientSendInternal(client, msg, false, false);
+    ret = virNetClientSendInternal(client, msg, false, false, NULL, 0);
     virObjectUnlock(client);
     if (ret < 0)
         return -1;
@@ -2201,11 +2383,209 @@ int virNetClientSendNonBlock(virNetClientPtr client,
 {
     int ret;
     virObjectLock(client);
-    ret = virNetClientSendInternal(client, msg, false, true);
+    ret = virNetClientSendInternal(client, msg, false, true, NULL, 0);
     virObjectUnlock(client);
     return ret;
 }
 
+
+/*
+ * @msg: a message allocated on the heap.
+ * @future: filled with the future of the call
+ *
+ * Send a message expecting a reply, without waiting for either the
+ * message to be sent or the reply to arrive. Any number of calls can
+ * be in flight on the client at a time. Their replies are received
+ * by whichever thread or event loop callback next processes the
+ * client, and can be checked for with virNetClientFuturePoll or
+ * waited for with virNetClientFutureWait.
+ *
+ * On success @msg is owned by @future, and holds the reply once the
+ * call is complete, until @future is freed with virNetClientFutureFree.
+ * Otherwise, the caller is responsible for free'ing @msg.
+ *
+ * Returns 0 on success, -1 on failure
+ */
+int virNetClientSubmit(virNetClientPtr client,
+                       virNetMessagePtr msg,
+                       virNetClientFuturePtr *future)
+{
+    virNetClientCallPtr call = NULL;
+    int ret = -1;
+
+    *future = NULL;
+
+    virObjectLock(client);
+
+    PROBE(RPC_CLIENT_MSG_TX_QUEUE,
+          "client=%p len=%zu prog=%u vers=%u proc=%u type=%u status=%u serial=%u",
+          client, msg->bufferLength,
+          msg->header.prog, msg->header.vers, msg->header.proc,
+          msg->header.type, msg->header.status, msg->header.serial);
+
+    if (!client->sock || client->wantClose) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+        goto cleanup;
+    }
+
+    if (!(call = virNetClientCallNew(msg, true, false)))
+        goto cleanup;
+
+    /* Send what can be sent right away, and detach */
+    call->nonBlock = true;
+    call->async = true;
+    call->haveThread = true;
+    if (virNetClientIO(client, call) < 0) {
+        virCondDestroy(&call->cond);
+        VIR_FREE(call);
+        goto cleanup;
+    }
+
+    *future = call;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+static void
+virNetClientFutureReportFailed(virNetClientPtr client)
+{
+    if (client->error)
+        virSetError(client->error);
+    else
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client socket is closed"));
+}
+
+
+/*
+ * Process @future, without blocking if @nonBlock is true.
+ *
+ * Returns 1 if the call is complete, 0 if it is still in flight
+ * and -1 if it failed.
+ */
+static int
+virNetClientFutureProcess(virNetClientPtr client,
+                          virNetClientFuturePtr future,
+                          bool nonBlock)
+{
+    int rv;
+
+    /* The client may have been closed while the call was
+     * detached in the middle of an event loop iteration */
+    if (future->mode != VIR_NET_CLIENT_MODE_COMPLETE && !client->sock) {
+        virNetClientCallRemove(&client->waitDispatch, future);
+        future->failed = true;
+        future->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+    }
+
+    if (future->mode != VIR_NET_CLIENT_MODE_COMPLETE) {
+        future->nonBlock = nonBlock;
+        future->haveThread = true;
+        rv = virNetClientIOProcess(client, future);
+        future->nonBlock = true;
+        future->haveThread = false;
+
+        if (rv < 0) {
+            future->failed = true;
+            future->mode = VIR_NET_CLIENT_MODE_COMPLETE;
+            return -1;
+        }
+        if (rv == 1)
+            return 0;
+    }
+
+    if (future->failed) {
+        virNetClientFutureReportFailed(client);
+        return -1;
+    }
+
+    return 1;
+}
+
+
+/*
+ * @future: a future filled by virNetClientSubmit
+ *
+ * Check whether the call of @future is complete. When no other
+ * thread or event loop callback is processing the client, this
+ * processes whatever I/O can be done without blocking first.
+ *
+ * Returns 1 if the call is complete, 0 if it is still in flight
+ * and -1 if it failed.
+ */
+int virNetClientFuturePoll(virNetClientPtr client,
+                           virNetClientFuturePtr future)
+{
+    int ret;
+    virObjectLock(client);
+    ret = virNetClientFutureProcess(client, future, true);
+    virObjectUnlock(client);
+    return ret;
+}
+
+
+/*
+ * @future: a future filled by virNetClientSubmit
+ *
+ * Wait for the call of @future to complete.
+ *
+ * Returns 0 on success, -1 if the call failed
+ */
+int virNetClientFutureWait(virNetClientPtr client,
+                           virNetClientFuturePtr future)
+{
+    int ret;
+    virObjectLock(client);
+    ret = virNetClientFutureProcess(client, future, false);
+    virObjectUnlock(client);
+    if (ret < 0)
+        return -1;
+    return 0;
+}
+
+
+/*
+ * @future: a future filled by virNetClientSubmit
+ *
+ * Returns the message of @future, holding the reply once
+ * the call is complete
+ */
+virNetMessagePtr virNetClientFutureGetMessage(virNetClientFuturePtr future)
+{
+    return future->msg;
+}
+
+
+/*
+ * @future: a future filled by virNetClientSubmit
+ *
+ * Free @future along with its message. A call still in flight is
+ * freed once its reply arrives, or the client is closed.
+ */
+void virNetClientFutureFree(virNetClientPtr client,
+                            virNetClientFuturePtr future)
+{
+    if (!future)
+        return;
+
+    virObjectLock(client);
+    if (future->mode == VIR_NET_CLIENT_MODE_COMPLETE || !client->sock) {
+        virNetClientCallRemove(&client->waitDispatch, future);
+        virCondDestroy(&future->cond);
+        virNetMessageFree(future->msg);
+        VIR_FREE(future);
+    } else {
+        VIR_DEBUG("Abandoning call %p still in flight", future);
+        future->abandoned = true;
+    }
+    virObjectUnlock(client);
+}
+
 /*
  * @msg: a message allocated on heap or stack
  *
@@ -2231,7 +2611,7 @@ int virNetClientSendWithReplyStream(virNetClientPtr client,
         return 0;
     }
 
-    ret = virNetClientSendInternal(client, msg, true, false);
+    ret = virNetClientSendInternal(client, msg, true, false, NULL, 0);
     virObjectUnlock(client);
     if (ret < 0)
         return -1;
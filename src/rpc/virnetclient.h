@@ -111,12 +111,32 @@ void virNetClientRemoveStream(virNetClientPtr client,
 int virNetClientSendWithReply(virNetClientPtr client,
                               virNetMessagePtr msg);
 
+int virNetClientSendBatch(virNetClientPtr client,
+                          virNetMessagePtr msg,
+                          virNetMessagePtr *calls,
+                          size_t ncalls);
+
 int virNetClientSendNoReply(virNetClientPtr client,
                             virNetMessagePtr msg);
 
 int virNetClientSendNonBlock(virNetClientPtr client,
                              virNetMessagePtr msg);
 
+int virNetClientSubmit(virNetClientPtr client,
+                       virNetMessagePtr msg,
+                       virNetClientFuturePtr *future);
+
+int virNetClientFuturePoll(virNetClientPtr client,
+                           virNetClientFuturePtr future);
+
+int virNetClientFutureWait(virNetClientPtr client,
+                           virNetClientFuturePtr future);
+
+virNetMessagePtr virNetClientFutureGetMessage(virNetClientFuturePtr future);
+
+void virNetClientFutureFree(virNetClientPtr client,
+                            virNetClientFuturePtr future);
+
 int virNetClientSendWithReplyStream(virNetClientPtr client,
                                     virNetMessagePtr msg,
                                     virNetClientStreamPtr st);
@@ -265,27 +265,32 @@ int virNetClientProgramDispatch(virNetClientProgramPtr prog,
 }
 
 
-int virNetClientProgramCall(virNetClientProgramPtr prog,
-                            virNetClientPtr client,
-                            unsigned serial,
-                            int proc,
-                            size_t noutfds,
-                            int *outfds,
-                            size_t *ninfds,
-                            int **infds,
-                            xdrproc_t args_filter, void *args,
-                            xdrproc_t ret_filter, void *ret)
+/*
+ * @prog: the program the call belongs to
+ * @serial: the serial number of the call
+ * @proc: the procedure to call
+ * @noutfds: number of file descriptors in @outfds
+ * @outfds: file descriptors to pass along with the call
+ * @args_filter: XDR filter for @args
+ * @args: the arguments of the call
+ *
+ * Encodes a complete message calling @proc, ready to be sent.
+ *
+ * Returns the new message, or NULL on error
+ */
+virNetMessagePtr virNetClientProgramNewCall(virNetClientProgramPtr prog,
+                                            unsigned serial,
+                                            int proc,
+                                            size_t noutfds,
+                                            int *outfds,
+                                            xdrproc_t args_filter,
+                                            void *args)
 {
     virNetMessagePtr msg;
     size_t i;
 
-    if (infds)
-        *infds = NULL;
-    if (ninfds)
-        *ninfds = 0;
-
     if (!(msg = virNetMessageNew(false)))
-        return -1;
+        return NULL;
 
     msg->header.prog = prog->program;
     msg->header.vers = prog->version;
@@ -323,8 +328,45 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
     if (virNetMessageEncodePayload(msg, args_filter, args) < 0)
         goto error;
 
-    if (virNetClientSendWithReply(client, msg) < 0)
-        goto error;
+    return msg;
+
+ error:
+    virNetMessageFree(msg);
+    return NULL;
+}
+
+
+/*
+ * @prog: the program the call belongs to
+ * @msg: the reply to the call
+ * @serial: the serial number of the call
+ * @proc: the procedure which was called
+ * @ninfds: filled with the number of file descriptors in @infds
+ * @infds: filled with file descriptors passed along with the reply
+ * @ret_filter: XDR filter for @ret
+ * @ret: filled with the return values of the call
+ *
+ * Validates the reply to a call made with a message from
+ * virNetClientProgramNewCall, and decodes its return values,
+ * or reports the error it carries.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetClientProgramDecodeReply(virNetClientProgramPtr prog,
+                                   virNetMessagePtr msg,
+                                   unsigned serial,
+                                   int proc,
+                                   size_t *ninfds,
+                                   int **infds,
+                                   xdrproc_t ret_filter,
+                                   void *ret)
+{
+    size_t i;
+
+    if (infds)
+        *infds = NULL;
+    if (ninfds)
+        *ninfds = 0;
 
     /* None of these 3 should ever happen here, because
      * virNetClientSend should have validated the reply,
@@ -388,15 +430,131 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
         goto error;
     }
 
-    virNetMessageFree(msg);
-
     return 0;
 
  error:
-    virNetMessageFree(msg);
     if (infds && ninfds) {
         for (i = 0; i < *ninfds; i++)
             VIR_FORCE_CLOSE((*infds)[i]);
     }
     return -1;
 }
+
+
+int virNetClientProgramCall(virNetClientProgramPtr prog,
+                            virNetClientPtr client,
+                            unsigned serial,
+                            int proc,
+                            size_t noutfds,
+                            int *outfds,
+                            size_t *ninfds,
+                            int **infds,
+                            xdrproc_t args_filter, void *args,
+                            xdrproc_t ret_filter, void *ret)
+{
+    virNetMessagePtr msg;
+    int rv = -1;
+
+    if (infds)
+        *infds = NULL;
+    if (ninfds)
+        *ninfds = 0;
+
+    if (!(msg = virNetClientProgramNewCall(prog, serial, proc,
+                                           noutfds, outfds,
+                                           args_filter, args)))
+        return -1;
+
+    if (virNetClientSendWithReply(client, msg) < 0)
+        goto cleanup;
+
+    if (virNetClientProgramDecodeReply(prog, msg, serial, proc,
+                                       ninfds, infds,
+                                       ret_filter, ret) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    virNetMessageFree(msg);
+    return rv;
+}
+
+
+/*
+ * @prog: the program the call belongs to
+ * @client: the client to send the call on
+ * @serial: the serial number of the call
+ * @proc: the procedure to call
+ * @args_filter: XDR filter for @args
+ * @args: the arguments of the call
+ * @future: filled with the future of the call
+ *
+ * Sends a call to @proc without waiting for its reply, which
+ * must be collected with virNetClientProgramFinish.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetClientProgramSubmit(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              unsigned serial,
+                              int proc,
+                              xdrproc_t args_filter, void *args,
+                              virNetClientFuturePtr *future)
+{
+    virNetMessagePtr msg;
+
+    *future = NULL;
+
+    if (!(msg = virNetClientProgramNewCall(prog, serial, proc,
+                                           0, NULL,
+                                           args_filter, args)))
+        return -1;
+
+    if (virNetClientSubmit(client, msg, future) < 0) {
+        virNetMessageFree(msg);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/*
+ * @prog: the program the call belongs to
+ * @client: the client the call was sent on
+ * @future: the future filled by virNetClientProgramSubmit
+ * @serial: the serial number of the call
+ * @proc: the procedure which was called
+ * @ret_filter: XDR filter for @ret
+ * @ret: filled with the return values of the call
+ *
+ * Waits for the reply to a call sent with virNetClientProgramSubmit
+ * and decodes it, then frees @future.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetClientProgramFinish(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              virNetClientFuturePtr future,
+                              unsigned serial,
+                              int proc,
+                              xdrproc_t ret_filter, void *ret)
+{
+    int rv = -1;
+
+    if (virNetClientFutureWait(client, future) < 0)
+        goto cleanup;
+
+    if (virNetClientProgramDecodeReply(prog,
+                                       virNetClientFutureGetMessage(future),
+                                       serial, proc, NULL, NULL,
+                                       ret_filter, ret) < 0)
+        goto cleanup;
+
+    rv = 0;
+
+ cleanup:
+    virNetClientFutureFree(client, future);
+    return rv;
+}
@@ -32,6 +32,9 @@
 typedef struct _virNetClient virNetClient;
 typedef virNetClient *virNetClientPtr;
 
+typedef struct _virNetClientCall virNetClientFuture;
+typedef virNetClientFuture *virNetClientFuturePtr;
+
 typedef struct _virNetClientProgram virNetClientProgram;
 typedef virNetClientProgram *virNetClientProgramPtr;
 
@@ -70,6 +73,23 @@ int virNetClientProgramDispatch(virNetClientProgramPtr prog,
                                 virNetClientPtr client,
                                 virNetMessagePtr msg);
 
+virNetMessagePtr virNetClientProgramNewCall(virNetClientProgramPtr prog,
+                                            unsigned serial,
+                                            int proc,
+                                            size_t noutfds,
+                                            int *outfds,
+                                            xdrproc_t args_filter,
+                                            void *args);
+
+int virNetClientProgramDecodeReply(virNetClientProgramPtr prog,
+                                   virNetMessagePtr msg,
+                                   unsigned serial,
+                                   int proc,
+                                   size_t *ninfds,
+                                   int **infds,
+                                   xdrproc_t ret_filter,
+                                   void *ret);
+
 int virNetClientProgramCall(virNetClientProgramPtr prog,
                             virNetClientPtr client,
                             unsigned serial,
@@ -81,6 +101,19 @@ int virNetClientProgramCall(virNetClientProgramPtr prog,
                             xdrproc_t args_filter, void *args,
                             xdrproc_t ret_filter, void *ret);
 
+int virNetClientProgramSubmit(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              unsigned serial,
+                              int proc,
+                              xdrproc_t args_filter, void *args,
+                              virNetClientFuturePtr *future);
+
+int virNetClientProgramFinish(virNetClientProgramPtr prog,
+                              virNetClientPtr client,
+                              virNetClientFuturePtr future,
+                              unsigned serial,
+                              int proc,
+                              xdrproc_t ret_filter, void *ret);
 
 
 #endif /* __VIR_NET_CLIENT_PROGRAM_H__ */
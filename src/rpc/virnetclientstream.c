@@ -297,8 +297,9 @@ int virNetClientStreamQueuePacket(virNetClientStreamPtr st,
     tmp_msg->buffer = msg->buffer;
     tmp_msg->bufferLength = msg->bufferLength;
     tmp_msg->bufferOffset = msg->bufferOffset;
+    tmp_msg->bufferAlloc = msg->bufferAlloc;
     msg->buffer = NULL;
-    msg->bufferLength = msg->bufferOffset = 0;
+    msg->bufferLength = msg->bufferOffset = msg->bufferAlloc = 0;
 
     virObjectLock(st);
 
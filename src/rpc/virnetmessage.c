@@ -21,6 +21,9 @@
 #include <config.h>
 
 #include <unistd.h>
+#if WITH_ZSTD
+# include <zstd.h>
+#endif
 
 #include "virnetmessage.h"
 #include "viralloc.h"
@@ -34,6 +37,231 @@
 
 VIR_LOG_INIT("rpc.netmessage");
 
+/*
+ * Message buffers are recycled through a process wide pool, split
+ * into size classes, so that the common RPC path does not have to
+ * go back to malloc for every call and reply. Each class holds
+ * buffers of (1 << shift) + VIR_NET_MESSAGE_LEN_MAX bytes, which
+ * lines up with VIR_NET_MESSAGE_INITIAL and the doubling done by
+ * virNetMessageEncodePayload. Larger buffers are never pooled.
+ */
+#define VIR_NET_MESSAGE_POOL_MIN_SHIFT 12 /* 4 KiB */
+#define VIR_NET_MESSAGE_POOL_NCLASSES 9   /* ...up to 1 MiB */
+#define VIR_NET_MESSAGE_POOL_CLASS_BYTES (2 * 1024 * 1024)
+#define VIR_NET_MESSAGE_POOL_CLASS_BUFFERS 64
+
+/*
+ * Reply payloads smaller than this are never worth compressing. Level 1
+ * keeps the cost low enough to be paid on the dispatch path, large XML
+ * documents and domain statistics still shrink several times over.
+ */
+#define VIR_NET_MESSAGE_COMPRESS_MIN (16 * 1024)
+#define VIR_NET_MESSAGE_COMPRESS_LEVEL 1
+
+typedef struct _virNetMessagePoolClass virNetMessagePoolClass;
+struct _virNetMessagePoolClass {
+    size_t nbuffers;
+    char *buffers[VIR_NET_MESSAGE_POOL_CLASS_BUFFERS];
+};
+
+static virMutex virNetMessagePoolLock = VIR_MUTEX_INITIALIZER;
+static virNetMessagePoolClass virNetMessagePool[VIR_NET_MESSAGE_POOL_NCLASSES];
+static virNetMessagePoolStats virNetMessagePoolCounters;
+
+
+static size_t
+virNetMessagePoolClassSize(size_t class)
+{
+    return ((size_t)1 << (VIR_NET_MESSAGE_POOL_MIN_SHIFT + class)) +
+        VIR_NET_MESSAGE_LEN_MAX;
+}
+
+
+static size_t
+virNetMessagePoolClassMax(size_t class)
+{
+    return MIN(VIR_NET_MESSAGE_POOL_CLASS_BUFFERS,
+               VIR_NET_MESSAGE_POOL_CLASS_BYTES /
+               virNetMessagePoolClassSize(class));
+}
+
+
+/*
+ * @len: the minimum size of the buffer
+ * @buf: filled with the new buffer
+ * @alloc: filled with the size of @buf
+ *
+ * Take a buffer able to hold @len bytes from the pool, or allocate a
+ * new one sized to the matching class. Requests beyond the largest
+ * class are allocated with exactly @len bytes.
+ *
+ * Returns 0 on success, -1 on OOM
+ */
+static int
+virNetMessagePoolAcquire(size_t len,
+                         char **buf,
+                         size_t *alloc)
+{
+    size_t class;
+
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_NCLASSES; class++) {
+        if (len <= virNetMessagePoolClassSize(class))
+            break;
+    }
+
+    if (class == VIR_NET_MESSAGE_POOL_NCLASSES) {
+        virMutexLock(&virNetMessagePoolLock);
+        virNetMessagePoolCounters.misses++;
+        virMutexUnlock(&virNetMessagePoolLock);
+
+        if (VIR_ALLOC_N(*buf, len) < 0)
+            return -1;
+        *alloc = len;
+        return 0;
+    }
+
+    *alloc = virNetMessagePoolClassSize(class);
+
+    virMutexLock(&virNetMessagePoolLock);
+    if (virNetMessagePool[class].nbuffers) {
+        *buf = virNetMessagePool[class].buffers[--virNetMessagePool[class].nbuffers];
+        virNetMessagePoolCounters.hits++;
+        virNetMessagePoolCounters.cached--;
+        virNetMessagePoolCounters.cachedBytes -= *alloc;
+        virMutexUnlock(&virNetMessagePoolLock);
+        return 0;
+    }
+    virNetMessagePoolCounters.misses++;
+    virMutexUnlock(&virNetMessagePoolLock);
+
+    return VIR_ALLOC_N(*buf, *alloc);
+}
+
+
+/*
+ * @buf: the buffer to release
+ * @alloc: the size of @buf, or 0 if it was not allocated by the pool
+ *
+ * Give @buf back to the pool if it matches one of the size classes
+ * and the class has room left, otherwise free it.
+ */
+static void
+virNetMessagePoolRelease(char *buf,
+                         size_t alloc)
+{
+    size_t class;
+
+    if (!buf)
+        return;
+
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_NCLASSES; class++) {
+        if (alloc == virNetMessagePoolClassSize(class))
+            break;
+    }
+
+    if (class < VIR_NET_MESSAGE_POOL_NCLASSES) {
+        virMutexLock(&virNetMessagePoolLock);
+        if (virNetMessagePool[class].nbuffers < virNetMessagePoolClassMax(class)) {
+            virNetMessagePool[class].buffers[virNetMessagePool[class].nbuffers++] = buf;
+            virNetMessagePoolCounters.recycled++;
+            virNetMessagePoolCounters.cached++;
+            virNetMessagePoolCounters.cachedBytes += alloc;
+            virMutexUnlock(&virNetMessagePoolLock);
+            return;
+        }
+        virNetMessagePoolCounters.discarded++;
+        virMutexUnlock(&virNetMessagePoolLock);
+    }
+
+    VIR_FREE(buf);
+}
+
+
+/**
+ * virNetMessagePoolGetStats:
+ * @stats: filled with the current statistics
+ *
+ * Report how effective recycling of message buffers has been
+ * so far in this process.
+ */
+void
+virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+{
+    virMutexLock(&virNetMessagePoolLock);
+    *stats = virNetMessagePoolCounters;
+    virMutexUnlock(&virNetMessagePoolLock);
+}
+
+
+/**
+ * virNetMessagePoolDrain:
+ *
+ * Free all buffers currently held by the pool.
+ */
+void
+virNetMessagePoolDrain(void)
+{
+    size_t class;
+
+    virMutexLock(&virNetMessagePoolLock);
+    for (class = 0; class < VIR_NET_MESSAGE_POOL_NCLASSES; class++) {
+        while (virNetMessagePool[class].nbuffers)
+            VIR_FREE(virNetMessagePool[class].buffers[--virNetMessagePool[class].nbuffers]);
+    }
+    virNetMessagePoolCounters.cached = 0;
+    virNetMessagePoolCounters.cachedBytes = 0;
+    virMutexUnlock(&virNetMessagePoolLock);
+}
+
+
+/**
+ * virNetMessageResizeBuffer:
+ * @msg: the message whose buffer to resize
+ * @len: the new length of the buffer
+ *
+ * Make sure the buffer of @msg can hold @len bytes and set
+ * bufferLength accordingly. The first bufferLength bytes of the
+ * existing buffer are preserved. The buffer is taken from the
+ * message pool where possible.
+ *
+ * Returns 0 on success, -1 on OOM
+ */
+int
+virNetMessageResizeBuffer(virNetMessagePtr msg,
+                          size_t len)
+{
+    size_t keep = msg->buffer ? MIN(msg->bufferLength, len) : 0;
+    char *buf = NULL;
+    size_t alloc = 0;
+
+    if (msg->buffer && len <= msg->bufferAlloc) {
+        msg->bufferLength = len;
+        return 0;
+    }
+
+    if (len > virNetMessagePoolClassSize(VIR_NET_MESSAGE_POOL_NCLASSES - 1)) {
+        /* Too large to ever be pooled, let realloc avoid the copy */
+        if (VIR_REALLOC_N(msg->buffer, len) < 0)
+            return -1;
+        msg->bufferAlloc = len;
+        msg->bufferLength = len;
+        return 0;
+    }
+
+    if (virNetMessagePoolAcquire(len, &buf, &alloc) < 0)
+        return -1;
+
+    if (keep)
+        memcpy(buf, msg->buffer, keep);
+
+    virNetMessagePoolRelease(msg->buffer, msg->bufferAlloc);
+    msg->buffer = buf;
+    msg->bufferAlloc = alloc;
+    msg->bufferLength = len;
+    return 0;
+}
+
+
 virNetMessagePtr virNetMessageNew(bool tracked)
 {
     virNetMessagePtr msg;
@@ -62,7 +290,9 @@ virNetMessageClearPayload(virNetMessagePtr msg)
 
     msg->bufferOffset = 0;
     msg->bufferLength = 0;
-    VIR_FREE(msg->buffer);
+    virNetMessagePoolRelease(msg->buffer, msg->bufferAlloc);
+    msg->buffer = NULL;
+    msg->bufferAlloc = 0;
 }
 
 
@@ -152,8 +382,7 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
 
     /* Extend our declared buffer length and carry
        on reading the header + payload */
-    msg->bufferLength += len;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    if (virNetMessageResizeBuffer(msg, msg->bufferLength + len) < 0)
         goto cleanup;
 
     VIR_DEBUG("Got length, now need %zu total (%u more)",
@@ -204,6 +433,9 @@ int virNetMessageDecodeHeader(virNetMessagePtr msg)
 
     msg->bufferOffset += xdr_getpos(&xdr);
 
+    msg->compressed = !!(msg->header.type & VIR_NET_MESSAGE_TYPE_COMPRESSED);
+    msg->header.type &= ~VIR_NET_MESSAGE_TYPE_COMPRESSED;
+
     ret = 0;
 
  cleanup:
@@ -212,6 +444,50 @@ int virNetMessageDecodeHeader(virNetMessagePtr msg)
 }
 
 
+/*
+ * @msg: an empty message to load the packet into
+ * @data: a complete message packet, starting with its length word
+ * @len: the size of @data
+ *
+ * Loads a message packet which was not read from a socket, such
+ * as one carried inside another message, and decodes its header
+ * so that it can be routed like any other incoming message.
+ *
+ * returns 0 if successfully decoded, -1 upon fatal error
+ */
+int virNetMessageDecodeRaw(virNetMessagePtr msg,
+                           const char *data,
+                           size_t len)
+{
+    if (len < VIR_NET_MESSAGE_LEN_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("packet %zu bytes too small, want %d"),
+                       len, VIR_NET_MESSAGE_LEN_MAX);
+        return -1;
+    }
+
+    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_LEN_MAX) < 0)
+        return -1;
+    memcpy(msg->buffer, data, VIR_NET_MESSAGE_LEN_MAX);
+
+    if (virNetMessageDecodeLength(msg) < 0)
+        return -1;
+
+    if (msg->bufferLength != len) {
+        virReportError(VIR_ERR_RPC,
+                       _("packet %zu bytes long, but length word says %zu"),
+                       len, msg->bufferLength);
+        return -1;
+    }
+
+    memcpy(msg->buffer + VIR_NET_MESSAGE_LEN_MAX,
+           data + VIR_NET_MESSAGE_LEN_MAX,
+           len - VIR_NET_MESSAGE_LEN_MAX);
+
+    return virNetMessageDecodeHeader(msg);
+}
+
+
 /*
  * @msg: the outgoing message, whose header to encode
  *
@@ -229,8 +505,12 @@ int virNetMessageEncodeHeader(virNetMessagePtr msg)
     int ret = -1;
     unsigned int len = 0;
 
-    msg->bufferLength = VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+    /* Any existing content is about to be overwritten */
+    msg->bufferLength = 0;
+    msg->compressed = false;
+    msg->compress = false;
+    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL +
+                                  VIR_NET_MESSAGE_LEN_MAX) < 0)
         return ret;
     msg->bufferOffset = 0;
 
@@ -344,12 +624,141 @@ int virNetMessageDecodeNumFDs(virNetMessagePtr msg)
 }
 
 
+#if WITH_ZSTD
+/*
+ * @msg: the outgoing message
+ * @start: offset of the encoded payload in the message buffer
+ *
+ * Replaces the payload between @start and the current offset by its
+ * compressed form, and flags the message type accordingly. The
+ * payload is left untouched if compressing it does not pay off.
+ *
+ * returns 0 on success, -1 upon fatal error
+ */
+static int
+virNetMessageCompressPayload(virNetMessagePtr msg,
+                             size_t start)
+{
+    XDR xdr;
+    size_t len = msg->bufferOffset - start;
+    size_t bound = ZSTD_compressBound(len);
+    size_t clen;
+    unsigned int ulen = len;
+    int type = msg->header.type | VIR_NET_MESSAGE_TYPE_COMPRESSED;
+    char *buf = NULL;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(buf, bound) < 0)
+        return -1;
+
+    clen = ZSTD_compress(buf, bound, msg->buffer + start, len,
+                         VIR_NET_MESSAGE_COMPRESS_LEVEL);
+    if (ZSTD_isError(clen)) {
+        virReportError(VIR_ERR_RPC,
+                       _("Unable to compress message payload: %s"),
+                       ZSTD_getErrorName(clen));
+        goto cleanup;
+    }
+
+    if (clen + VIR_NET_MESSAGE_LEN_MAX >= len) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    /* The type is the fourth word of the header */
+    xdrmem_create(&xdr, msg->buffer + VIR_NET_MESSAGE_LEN_MAX + 12,
+                  4, XDR_ENCODE);
+    if (!xdr_int(&xdr, &type)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode message type"));
+        xdr_destroy(&xdr);
+        goto cleanup;
+    }
+    xdr_destroy(&xdr);
+
+    xdrmem_create(&xdr, msg->buffer + start,
+                  VIR_NET_MESSAGE_LEN_MAX, XDR_ENCODE);
+    if (!xdr_u_int(&xdr, &ulen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to encode payload length"));
+        xdr_destroy(&xdr);
+        goto cleanup;
+    }
+    xdr_destroy(&xdr);
+
+    memcpy(msg->buffer + start + VIR_NET_MESSAGE_LEN_MAX, buf, clen);
+    msg->bufferOffset = start + VIR_NET_MESSAGE_LEN_MAX + clen;
+
+    VIR_DEBUG("Compressed payload from %zu to %zu bytes", len, clen);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+/*
+ * @msg: the incoming message, positioned at its payload
+ * @out: filled with the decompressed payload
+ * @outlen: filled with the size of @out
+ *
+ * returns 0 on success, -1 upon fatal error
+ */
+static int
+virNetMessageDecompressPayload(virNetMessagePtr msg,
+                               char **out,
+                               size_t *outlen)
+{
+    XDR xdr;
+    unsigned int ulen;
+    size_t len;
+    char *buf = NULL;
+
+    xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
+                  msg->bufferLength - msg->bufferOffset, XDR_DECODE);
+    if (!xdr_u_int(&xdr, &ulen)) {
+        virReportError(VIR_ERR_RPC, "%s", _("Unable to decode payload length"));
+        xdr_destroy(&xdr);
+        return -1;
+    }
+    xdr_destroy(&xdr);
+
+    if (ulen > VIR_NET_MESSAGE_MAX) {
+        virReportError(VIR_ERR_RPC,
+                       _("compressed payload expands to %u bytes, "
+                         "more than the %d allowed"),
+                       ulen, VIR_NET_MESSAGE_MAX);
+        return -1;
+    }
+
+    if (VIR_ALLOC_N(buf, ulen ? ulen : 1) < 0)
+        return -1;
+
+    len = ZSTD_decompress(buf, ulen,
+                          msg->buffer + msg->bufferOffset + VIR_NET_MESSAGE_LEN_MAX,
+                          msg->bufferLength - msg->bufferOffset - VIR_NET_MESSAGE_LEN_MAX);
+    if (ZSTD_isError(len) || len != ulen) {
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("Unable to decompress message payload"));
+        VIR_FREE(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *outlen = len;
+    return 0;
+}
+#endif /* WITH_ZSTD */
+
+
 int virNetMessageEncodePayload(virNetMessagePtr msg,
                                xdrproc_t filter,
                                void *data)
 {
     XDR xdr;
     unsigned int msglen;
+#if WITH_ZSTD
+    size_t start = msg->bufferOffset;
+#endif
 
     /* Serialise payload of the message. This assumes that
      * virNetMessageEncodeHeader has already been run, so
@@ -369,9 +778,7 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
 
         xdr_destroy(&xdr);
 
-        msg->bufferLength = newlen + VIR_NET_MESSAGE_LEN_MAX;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageResizeBuffer(msg, newlen + VIR_NET_MESSAGE_LEN_MAX) < 0)
             goto error;
 
         xdrmem_create(&xdr, msg->buffer + msg->bufferOffset,
@@ -384,6 +791,13 @@ int virNetMessageEncodePayload(virNetMessagePtr msg,
     msg->bufferOffset += xdr_getpos(&xdr);
     xdr_destroy(&xdr);
 
+#if WITH_ZSTD
+    if (msg->compress &&
+        msg->bufferOffset - start >= VIR_NET_MESSAGE_COMPRESS_MIN &&
+        virNetMessageCompressPayload(msg, start) < 0)
+        return -1;
+#endif
+
     /* Re-encode the length word. */
     VIR_DEBUG("Encode length as %zu", msg->bufferOffset);
     xdrmem_create(&xdr, msg->buffer, VIR_NET_MESSAGE_HEADER_XDR_LEN, XDR_ENCODE);
@@ -409,6 +823,31 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
                                void *data)
 {
     XDR xdr;
+    char *payload = NULL;
+
+    if (msg->compressed) {
+#if WITH_ZSTD
+        size_t len;
+
+        if (virNetMessageDecompressPayload(msg, &payload, &len) < 0)
+            return -1;
+
+        xdrmem_create(&xdr, payload, len, XDR_DECODE);
+        if (!(*filter)(&xdr, data, 0)) {
+            virReportError(VIR_ERR_RPC, "%s", _("Unable to decode message payload"));
+            goto error;
+        }
+
+        xdr_destroy(&xdr);
+        VIR_FREE(payload);
+        return 0;
+#else
+        virReportError(VIR_ERR_RPC, "%s",
+                       _("received a compressed message payload, but "
+                         "compression support is not available"));
+        return -1;
+#endif
+    }
 
     /* Deserialise payload of the message. This assumes that
      * virNetMessageDecodeHeader has already been run, so
@@ -428,6 +867,7 @@ int virNetMessageDecodePayload(virNetMessagePtr msg,
 
  error:
     xdr_destroy(&xdr);
+    VIR_FREE(payload);
     return -1;
 }
 
@@ -453,9 +893,7 @@ int virNetMessageEncodePayloadRaw(virNetMessagePtr msg,
             return -1;
         }
 
-        msg->bufferLength = msg->bufferOffset + len;
-
-        if (VIR_REALLOC_N(msg->buffer, msg->bufferLength) < 0)
+        if (virNetMessageResizeBuffer(msg, msg->bufferOffset + len) < 0)
             return -1;
 
         VIR_DEBUG("Increased message buffer length = %zu", msg->bufferLength);
@@ -36,10 +36,14 @@ struct _virNetMessage {
 
     char *buffer; /* Initially VIR_NET_MESSAGE_INITIAL + VIR_NET_MESSAGE_LEN_MAX */
                   /* Maximum   VIR_NET_MESSAGE_MAX     + VIR_NET_MESSAGE_LEN_MAX */
+    size_t bufferAlloc; /* Allocated size of buffer, 0 if not from the pool */
     size_t bufferLength;
     size_t bufferOffset;
 
     virNetMessageHeader header;
+    bool compressed; /* Payload received in compressed form */
+    bool compress;   /* Payload may be sent compressed, reset by
+                      * virNetMessageEncodeHeader */
 
     virNetMessageFreeCallback cb;
     void *opaque;
@@ -51,6 +55,25 @@ struct _virNetMessage {
     virNetMessagePtr next;
 };
 
+typedef struct _virNetMessagePoolStats virNetMessagePoolStats;
+typedef virNetMessagePoolStats *virNetMessagePoolStatsPtr;
+
+struct _virNetMessagePoolStats {
+    unsigned long long hits;      /* buffers handed out from the pool */
+    unsigned long long misses;    /* buffers which had to be allocated */
+    unsigned long long recycled;  /* buffers given back to the pool */
+    unsigned long long discarded; /* buffers freed because the pool was full */
+    unsigned long long cached;    /* buffers currently held by the pool */
+    unsigned long long cachedBytes;
+};
+
+void virNetMessagePoolGetStats(virNetMessagePoolStatsPtr stats)
+    ATTRIBUTE_NONNULL(1);
+void virNetMessagePoolDrain(void);
+
+int virNetMessageResizeBuffer(virNetMessagePtr msg,
+                              size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
 virNetMessagePtr virNetMessageNew(bool tracked);
 
@@ -72,6 +95,10 @@ int virNetMessageDecodeLength(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 int virNetMessageDecodeHeader(virNetMessagePtr msg)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+int virNetMessageDecodeRaw(virNetMessagePtr msg,
+                           const char *data,
+                           size_t len)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
 int virNetMessageEncodePayload(virNetMessagePtr msg,
                                xdrproc_t filter,
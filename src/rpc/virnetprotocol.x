@@ -39,6 +39,13 @@ const VIR_NET_MESSAGE_INITIAL = 65536;
  */
 const VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX = 262120;
 
+/*
+ * Max payload of a stream data packet if both sides support
+ * VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS, otherwise stream
+ * packets are limited to VIR_NET_MESSAGE_LEGACY_PAYLOAD_MAX.
+ */
+const VIR_NET_MESSAGE_STREAM_PAYLOAD_MAX = 4194304;
+
 /* Maximum total message size (serialised). */
 const VIR_NET_MESSAGE_MAX = 33554432;
 
@@ -151,6 +158,14 @@ const VIR_NET_MESSAGE_NUM_FDS_MAX = 32;
  *     * status == VIR_NET_OK
  *          <empty>
  *
+ * If VIR_NET_MESSAGE_TYPE_COMPRESSED is set in the type of a call or
+ * reply, the XXX_args, XXX_ret or remote_error data is replaced by
+ *
+ *          u_int   length of the uncompressed data
+ *          byte[]  the zstd compressed data
+ *
+ * Peers only send such messages when the other side asked for
+ * VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION.
  */
 enum virNetMessageType {
     /* client -> server. args from a method call */
@@ -169,6 +184,9 @@ enum virNetMessageType {
     VIR_NET_STREAM_HOLE = 6
 };
 
+/* Flag or-ed into virNetMessageType when the payload is compressed */
+const VIR_NET_MESSAGE_TYPE_COMPRESSED = 65536;
+
 enum virNetMessageStatus {
     /* Status is always VIR_NET_OK for calls.
      * For replies, indicates no error.
@@ -33,6 +33,12 @@
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
+/* Largest block of data we ask to be able to encode at once. Small
+ * blocks have a high overhead with mechanisms like GSSAPI, so we go
+ * well beyond the size of most messages; the mechanism may still
+ * negotiate a smaller one. */
+#define VIR_NET_SASL_MAX_BUFSIZE (1 << 20)
+
 VIR_LOG_INIT("rpc.netsaslcontext");
 
 struct _virNetSASLContext {
@@ -181,8 +187,7 @@ virNetSASLSessionPtr virNetSASLSessionNewClient(virNetSASLContextPtr ctxt ATTRIB
     if (!(sasl = virObjectLockableNew(virNetSASLSessionClass)))
         return NULL;
 
-    /* Arbitrary size for amount of data we can encode in a single block */
-    sasl->maxbufsize = 1 << 16;
+    sasl->maxbufsize = VIR_NET_SASL_MAX_BUFSIZE;
 
     err = sasl_client_new(service,
                           hostname,
@@ -217,8 +222,7 @@ virNetSASLSessionPtr virNetSASLSessionNewServer(virNetSASLContextPtr ctxt ATTRIB
     if (!(sasl = virObjectLockableNew(virNetSASLSessionClass)))
         return NULL;
 
-    /* Arbitrary size for amount of data we can encode in a single block */
-    sasl->maxbufsize = 1 << 16;
+    sasl->maxbufsize = VIR_NET_SASL_MAX_BUFSIZE;
 
     err = sasl_server_new(service,
                           NULL,
@@ -643,6 +647,53 @@ ssize_t virNetSASLSessionEncode(virNetSASLSessionPtr sasl,
     return ret;
 }
 
+/*
+ * Encode the data from all of @iov as a single block, which
+ * must not be longer than virNetSASLSessionGetMaxBufSize.
+ */
+ssize_t virNetSASLSessionEncodev(virNetSASLSessionPtr sasl,
+                                 const struct iovec *iov,
+                                 size_t niov,
+                                 const char **output,
+                                 size_t *outputlen)
+{
+    unsigned outlen = 0;
+    size_t inputLen = 0;
+    size_t i;
+    int err;
+    ssize_t ret = -1;
+
+    for (i = 0; i < niov; i++)
+        inputLen += iov[i].iov_len;
+
+    virObjectLock(sasl);
+    if (inputLen > sasl->maxbufsize) {
+        virReportSystemError(EINVAL,
+                             _("SASL data length %zu too long, max %zu"),
+                             inputLen, sasl->maxbufsize);
+        goto cleanup;
+    }
+
+    err = sasl_encodev(sasl->conn,
+                       iov,
+                       niov,
+                       output,
+                       &outlen);
+    *outputlen = outlen;
+
+    if (err != SASL_OK) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("failed to encode SASL data: %d (%s)"),
+                       err, sasl_errstring(err, NULL, NULL));
+        goto cleanup;
+    }
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(sasl);
+    return ret;
+}
+
 ssize_t virNetSASLSessionDecode(virNetSASLSessionPtr sasl,
                                 const char *input,
                                 size_t inputLen,
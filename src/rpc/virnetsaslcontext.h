@@ -22,6 +22,7 @@
 # define __VIR_NET_CLIENT_SASL_CONTEXT_H__
 
 # include "internal.h"
+# include <sys/uio.h>
 # include <sasl/sasl.h>
 
 # include "virobject.h"
@@ -104,6 +105,12 @@ ssize_t virNetSASLSessionEncode(virNetSASLSessionPtr sasl,
                                 const char **output,
                                 size_t *outputlen);
 
+ssize_t virNetSASLSessionEncodev(virNetSASLSessionPtr sasl,
+                                 const struct iovec *iov,
+                                 size_t niov,
+                                 const char **output,
+                                 size_t *outputlen);
+
 ssize_t virNetSASLSessionDecode(virNetSASLSessionPtr sasl,
                                 const char *input,
                                 size_t inputLen,
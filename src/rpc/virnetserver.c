@@ -29,13 +29,23 @@
 #include "virerror.h"
 #include "virthread.h"
 #include "virthreadpool.h"
+#include "virhash.h"
 #include "virnetservermdns.h"
+#include "virnuma.h"
 #include "virstring.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netserver");
 
+/* Number of requests a call of a bulk procedure counts as when
+ * limiting the request rate */
+#define VIR_NET_SERVER_BULK_REQUEST_COST 10
+
+/* Number of per-identity rate buckets kept before those which have
+ * refilled completely are dropped */
+#define VIR_NET_SERVER_IDENTITY_BUCKETS_MAX 1024
+
 
 typedef struct _virNetServerJob virNetServerJob;
 typedef virNetServerJob *virNetServerJobPtr;
@@ -44,6 +54,15 @@ struct _virNetServerJob {
     virNetServerClientPtr client;
     virNetMessagePtr msg;
     virNetServerProgramPtr prog;
+    unsigned long long queued;
+};
+
+typedef struct _virNetServerIOLoop virNetServerIOLoop;
+typedef virNetServerIOLoop *virNetServerIOLoopPtr;
+
+struct _virNetServerIOLoop {
+    virEventPollLoopPtr loop;
+    virThread thread;
 };
 
 struct _virNetServer {
@@ -54,6 +73,15 @@ struct _virNetServer {
     /* Immutable pointer, self-locking APIs */
     virThreadPoolPtr workers;
 
+    /* Worker pools running on each host NUMA node, NULL for nodes
+     * without CPUs. Calls on domains are given to the pool of the node
+     * nodeWorkersFunc says they are on. Set up before the event loop
+     * runs, immutable afterwards. */
+    size_t nnodeWorkers;
+    virThreadPoolPtr *nodeWorkers;
+    virNetServerJobNodeFunc nodeWorkersFunc;
+    void *nodeWorkersOpaque;
+
     char *mdnsGroupName;
     virNetServerMDNSPtr mdns;
     virNetServerMDNSGroupPtr mdnsGroup;
@@ -71,9 +99,25 @@ struct _virNetServer {
     size_t nclients_unauth;             /* Unauthenticated clients count */
     size_t nclients_unauth_max;         /* Max allowed unauth clients count */
 
+    /* Token bucket limits on the rate of calls, in requests per second
+     * with bursts of up to the given number of requests, zero if
+     * unlimited. One bucket for each client connection and one shared
+     * by all connections of the same identity, keyed by identity. */
+    unsigned int clientRequestRate;
+    unsigned int clientRequestBurst;
+    unsigned int identityRequestRate;
+    unsigned int identityRequestBurst;
+    virHashTablePtr identityBuckets;
+
     int keepaliveInterval;
     unsigned int keepaliveCount;
 
+    /* Event loops running client socket I/O. If empty, it all
+     * runs from the default event loop */
+    size_t nioLoops;
+    virNetServerIOLoopPtr ioLoops;
+    size_t nextIOLoop;
+
     virNetTLSContextPtr tls;
 
     virNetServerClientPrivNew clientPrivNew;
@@ -111,6 +155,145 @@ unsigned long long virNetServerNextClientID(virNetServerPtr srv)
     return val;
 }
 
+/* Find out what identity the calls of @client are accounted to: the
+ * SASL user name, the x509 distinguished name or the UNIX user ID,
+ * in this order. Returns NULL if there is none. */
+static char *
+virNetServerGetRateLimitKey(virNetServerClientPtr client)
+{
+    virIdentityPtr identity;
+    const char *value = NULL;
+    char *key = NULL;
+
+    if (!(identity = virNetServerClientGetIdentity(client)))
+        return NULL;
+
+    if (virIdentityGetAttr(identity, VIR_IDENTITY_ATTR_SASL_USER_NAME,
+                           &value) == 0 && value) {
+        ignore_value(virAsprintf(&key, "sasl:%s", value));
+    } else if (virIdentityGetAttr(identity,
+                                  VIR_IDENTITY_ATTR_X509_DISTINGUISHED_NAME,
+                                  &value) == 0 && value) {
+        ignore_value(virAsprintf(&key, "x509:%s", value));
+    } else if (virIdentityGetAttr(identity, VIR_IDENTITY_ATTR_UNIX_USER_ID,
+                                  &value) == 0 && value) {
+        ignore_value(virAsprintf(&key, "unix:%s", value));
+    }
+
+    virObjectUnref(identity);
+    return key;
+}
+
+
+static int
+virNetServerRateBucketIsFull(const void *payload,
+                             const void *name ATTRIBUTE_UNUSED,
+                             const void *opaque)
+{
+    const virNetServerRateBucket *bucket = payload;
+    const unsigned long long *threshold = opaque;
+
+    /* Not used for long enough to have refilled */
+    return bucket->last < *threshold;
+}
+
+
+/* Must be called with @srv locked */
+static bool
+virNetServerTakeIdentityTokensLocked(virNetServerPtr srv,
+                                     const char *key,
+                                     unsigned int cost,
+                                     unsigned long long now)
+{
+    virNetServerRateBucketPtr bucket;
+    unsigned int burst = srv->identityRequestBurst ?
+        srv->identityRequestBurst : srv->identityRequestRate;
+
+    if (!(bucket = virHashLookup(srv->identityBuckets, key))) {
+        if (virHashSize(srv->identityBuckets) >=
+            VIR_NET_SERVER_IDENTITY_BUCKETS_MAX) {
+            unsigned long long refill = burst * 1000000ull /
+                srv->identityRequestRate;
+            unsigned long long threshold = now > refill ? now - refill : 0;
+
+            virHashRemoveSet(srv->identityBuckets,
+                             virNetServerRateBucketIsFull, &threshold);
+        }
+
+        /* Let the call through rather than failing it if we can't
+         * account it */
+        if (VIR_ALLOC(bucket) < 0)
+            return true;
+        if (virHashAddEntry(srv->identityBuckets, key, bucket) < 0) {
+            VIR_FREE(bucket);
+            return true;
+        }
+    }
+
+    return virNetServerRateBucketTake(bucket, srv->identityRequestRate,
+                                      srv->identityRequestBurst, cost, now);
+}
+
+
+/*
+ * Check whether a call of @client with @priority fits within the
+ * request rate limits of @srv, accounting it if so.
+ *
+ * Returns true if the call may be dispatched, false if it exceeds a
+ * limit and has to be rejected.
+ */
+static bool
+virNetServerCheckRequestRate(virNetServerPtr srv,
+                             virNetServerClientPtr client,
+                             unsigned int priority)
+{
+    unsigned int cost = 1;
+    unsigned int clientRate;
+    unsigned int clientBurst;
+    unsigned long long now;
+    bool limitIdentity;
+    char *key = NULL;
+    bool ret = true;
+
+    virObjectLock(srv);
+    clientRate = srv->clientRequestRate;
+    clientBurst = srv->clientRequestBurst;
+    limitIdentity = srv->identityRequestRate > 0;
+    virObjectUnlock(srv);
+
+    if (!clientRate && !limitIdentity)
+        return true;
+
+    if (!(now = virNetServerProgramTimestamp()))
+        return true;
+
+    if (priority == VIR_THREADPOOL_JOB_BULK)
+        cost = VIR_NET_SERVER_BULK_REQUEST_COST;
+
+    if (clientRate &&
+        !virNetServerClientTakeRequestTokens(client, clientRate, clientBurst,
+                                             cost, now))
+        ret = false;
+
+    if (ret && limitIdentity &&
+        (key = virNetServerGetRateLimitKey(client))) {
+        virObjectLock(srv);
+        if (srv->identityRequestRate)
+            ret = virNetServerTakeIdentityTokensLocked(srv, key, cost, now);
+        virObjectUnlock(srv);
+    }
+
+    if (!ret) {
+        VIR_DEBUG("client=%p identity=%s exceeded the request rate limit",
+                  client, NULLSTR(key));
+        virNetServerClientRejectCall(client);
+    }
+
+    VIR_FREE(key);
+    return ret;
+}
+
+
 static int virNetServerProcessMsg(virNetServerPtr srv,
                                   virNetServerClientPtr client,
                                   virNetServerProgramPtr prog,
@@ -154,6 +337,20 @@ static int virNetServerProcessMsg(virNetServerPtr srv,
     return ret;
 }
 
+static virNetServerProgramPtr
+virNetServerGetProgramLocked(virNetServerPtr srv,
+                             virNetMessagePtr msg)
+{
+    size_t i;
+
+    for (i = 0; i < srv->nprograms; i++) {
+        if (virNetServerProgramMatches(srv->programs[i], msg))
+            return srv->programs[i];
+    }
+
+    return NULL;
+}
+
 static void virNetServerHandleJob(void *jobOpaque, void *opaque)
 {
     virNetServerPtr srv = opaque;
@@ -162,6 +359,9 @@ static void virNetServerHandleJob(void *jobOpaque, void *opaque)
     VIR_DEBUG("server=%p client=%p message=%p prog=%p",
               srv, job->client, job->msg, job->prog);
 
+    if (job->prog)
+        virNetServerProgramRecordQueueTime(job->prog, job->msg, job->queued);
+
     if (virNetServerProcessMsg(srv, job->client, job->prog, job->msg) < 0)
         goto error;
 
@@ -186,26 +386,41 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
 {
     virNetServerPtr srv = opaque;
     virNetServerProgramPtr prog = NULL;
-    unsigned int priority = 0;
-    size_t i;
+    unsigned int priority = VIR_THREADPOOL_JOB_NORMAL;
 
     VIR_DEBUG("server=%p client=%p message=%p",
               srv, client, msg);
 
     virObjectLock(srv);
-    for (i = 0; i < srv->nprograms; i++) {
-        if (virNetServerProgramMatches(srv->programs[i], msg)) {
-            prog = srv->programs[i];
-            break;
-        }
-    }
+    prog = virNetServerGetProgramLocked(srv, msg);
     /* we can unlock @srv since @prog can only become invalid in case
      * of disposing @srv, but let's grab a ref first to ensure nothing
      * disposes of it before we use it. */
     virObjectRef(srv);
     virObjectUnlock(srv);
 
+    if (prog)
+        priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+
+    if (prog &&
+        (msg->header.type == VIR_NET_CALL ||
+         msg->header.type == VIR_NET_CALL_WITH_FDS) &&
+        !virNetServerCheckRequestRate(srv, client, priority)) {
+        virNetMessageError rerr;
+
+        memset(&rerr, 0, sizeof(rerr));
+        virReportError(VIR_ERR_OPERATION_DENIED, "%s",
+                       _("request rate limit exceeded, try again later"));
+        if (virNetServerProgramSendReplyError(prog, client, msg, &rerr,
+                                              &msg->header) < 0)
+            goto error;
+
+        virObjectUnref(srv);
+        return;
+    }
+
     if (virThreadPoolGetMaxWorkers(srv->workers) > 0)  {
+        virThreadPoolPtr pool = srv->workers;
         virNetServerJobPtr job;
 
         if (VIR_ALLOC(job) < 0)
@@ -213,14 +428,26 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
 
         job->client = client;
         job->msg = msg;
+        job->queued = virNetServerProgramTimestamp();
 
-        if (prog) {
+        if (prog)
             job->prog = virObjectRef(prog);
-            priority = virNetServerProgramGetPriority(prog, msg->header.proc);
+
+        /* Urgent and bulk calls stay with the main pool, which has the
+         * priority workers and the bulk worker limit */
+        if (srv->nnodeWorkers && prog &&
+            priority == VIR_THREADPOOL_JOB_NORMAL &&
+            msg->header.type == VIR_NET_CALL &&
+            virNetServerProgramGetDomainArg(prog, msg->header.proc)) {
+            int node = srv->nodeWorkersFunc(prog, msg, srv->nodeWorkersOpaque);
+
+            if (node >= 0 && node < srv->nnodeWorkers &&
+                srv->nodeWorkers[node])
+                pool = srv->nodeWorkers[node];
         }
 
         virObjectRef(client);
-        if (virThreadPoolSendJob(srv->workers, priority, job) < 0) {
+        if (virThreadPoolSendJob(pool, priority, job) < 0) {
             virObjectUnref(client);
             VIR_FREE(job);
             virObjectUnref(prog);
@@ -241,6 +468,44 @@ virNetServerDispatchNewMessage(virNetServerClientPtr client,
 }
 
 
+/**
+ * virNetServerDispatchMessage:
+ * @srv: the server
+ * @client: the client @msg belongs to
+ * @msg: an incoming message, with header already decoded
+ *
+ * Process @msg synchronously in the calling thread instead of
+ * queuing it for the worker pool. This is meant for messages which
+ * were not read from the client socket on their own, but carried
+ * inside another message the caller is handling.
+ *
+ * Upon successful return @msg is released (or more often reused
+ * to send a reply). Upon failure the caller must free it.
+ *
+ * Returns 0 if the message was dispatched, -1 upon fatal error
+ */
+int
+virNetServerDispatchMessage(virNetServerPtr srv,
+                            virNetServerClientPtr client,
+                            virNetMessagePtr msg)
+{
+    virNetServerProgramPtr prog;
+    int ret;
+
+    VIR_DEBUG("server=%p client=%p message=%p",
+              srv, client, msg);
+
+    virObjectLock(srv);
+    prog = virObjectRef(virNetServerGetProgramLocked(srv, msg));
+    virObjectUnlock(srv);
+
+    ret = virNetServerProcessMsg(srv, client, prog, msg);
+
+    virObjectUnref(prog);
+    return ret;
+}
+
+
 /**
  * virNetServerCheckLimits:
  * @srv: server to check limits on
@@ -286,6 +551,20 @@ int virNetServerAddClient(virNetServerPtr srv,
 {
     virObjectLock(srv);
 
+    if (srv->nioLoops) {
+        virNetServerIOLoopPtr ioLoop;
+
+        ioLoop = &srv->ioLoops[srv->nextIOLoop++ % srv->nioLoops];
+        if (virNetServerClientSetEventLoop(client, ioLoop->loop) < 0)
+            goto error;
+    }
+
+    /* Once registered with a separate event loop, the client can
+     * receive messages right away, so it needs its dispatcher */
+    virNetServerClientSetDispatcher(client,
+                                    virNetServerDispatchNewMessage,
+                                    srv);
+
     if (virNetServerClientInit(client) < 0)
         goto error;
 
@@ -300,10 +579,6 @@ int virNetServerAddClient(virNetServerPtr srv,
 
     virNetServerCheckLimits(srv);
 
-    virNetServerClientSetDispatcher(client,
-                                    virNetServerDispatchNewMessage,
-                                    srv);
-
     virNetServerClientInitKeepAlive(client, srv->keepaliveInterval,
                                     srv->keepaliveCount);
 
@@ -344,6 +619,198 @@ static int virNetServerDispatchNewClient(virNetServerServicePtr svc,
 }
 
 
+static void
+virNetServerIOLoopRun(void *opaque)
+{
+    virEventPollLoopPtr loop = opaque;
+
+    if (virEventPollLoopRun(loop) < 0)
+        VIR_ERROR(_("Client I/O event loop failed: %s"),
+                  virGetLastErrorMessage());
+}
+
+
+static void
+virNetServerStopIOLoops(virNetServerIOLoopPtr ioLoops,
+                        size_t nioLoops)
+{
+    size_t i;
+
+    for (i = 0; i < nioLoops; i++)
+        virEventPollLoopQuit(ioLoops[i].loop);
+
+    for (i = 0; i < nioLoops; i++) {
+        virThreadJoin(&ioLoops[i].thread);
+        virObjectUnref(ioLoops[i].loop);
+    }
+}
+
+
+/**
+ * virNetServerSetIOLoops:
+ * @srv: the server
+ * @nloops: number of event loops to spread client socket I/O over
+ *
+ * Start @nloops event loop threads, each with its own set of file
+ * handles and timers, and assign clients added from now on to them
+ * in a round robin fashion. Without this, all clients of @srv are
+ * handled by the default event loop. This can only be done once,
+ * before the server has any clients.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int
+virNetServerSetIOLoops(virNetServerPtr srv,
+                       size_t nloops)
+{
+    virNetServerIOLoopPtr ioLoops = NULL;
+    size_t nioLoops = 0;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (srv->nioLoops || srv->nclients) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("I/O event loops can only be set up before "
+                         "the server has any clients"));
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(ioLoops, nloops) < 0)
+        goto cleanup;
+
+    for (nioLoops = 0; nioLoops < nloops; nioLoops++) {
+        virNetServerIOLoopPtr ioLoop = &ioLoops[nioLoops];
+
+        if (!(ioLoop->loop = virEventPollLoopNew()))
+            goto cleanup;
+
+        if (virThreadCreate(&ioLoop->thread, true,
+                            virNetServerIOLoopRun, ioLoop->loop) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create I/O event loop thread"));
+            virObjectUnref(ioLoop->loop);
+            goto cleanup;
+        }
+    }
+
+    VIR_STEAL_PTR(srv->ioLoops, ioLoops);
+    srv->nioLoops = nloops;
+    nioLoops = 0;
+    ret = 0;
+
+ cleanup:
+    virNetServerStopIOLoops(ioLoops, nioLoops);
+    VIR_FREE(ioLoops);
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
+size_t
+virNetServerGetIOLoops(virNetServerPtr srv)
+{
+    size_t ret;
+
+    virObjectLock(srv);
+    ret = srv->nioLoops;
+    virObjectUnlock(srv);
+
+    return ret;
+}
+
+
+/**
+ * virNetServerSetNodeWorkers:
+ * @srv: the server
+ * @nworkers: workers to run on each host NUMA node
+ * @func: tells the node a call is best run on
+ * @opaque: data for @func
+ *
+ * Sets up a pool of @nworkers workers bound to the CPUs of each host
+ * NUMA node. Calls on a domain are run by the pool @func picks for
+ * them, so that the state of the domain and its monitor socket aren't
+ * touched from a remote node. Everything else, and calls @func doesn't
+ * pick a node for, is left to the main pool. Must be called before the
+ * event loop dispatching calls of @srv runs.
+ *
+ * Returns 0 on success (including hosts without NUMA, where nothing
+ * is set up), -1 on error.
+ */
+int
+virNetServerSetNodeWorkers(virNetServerPtr srv,
+                           size_t nworkers,
+                           virNetServerJobNodeFunc func,
+                           void *opaque)
+{
+    virThreadPoolPtr *pools = NULL;
+    size_t npools = 0;
+    int maxnode;
+    size_t i;
+    int ret = -1;
+
+    virObjectLock(srv);
+
+    if (srv->nnodeWorkers) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("NUMA node workers are already set up"));
+        goto cleanup;
+    }
+
+    if (virThreadPoolGetMaxWorkers(srv->workers) == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("NUMA node workers require a server with workers"));
+        goto cleanup;
+    }
+
+    if (!virNumaIsAvailable() ||
+        (maxnode = virNumaGetMaxNode()) < 1) {
+        VIR_WARN("Host has no NUMA nodes to set up workers for");
+        virResetLastError();
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(pools, maxnode + 1) < 0)
+        goto cleanup;
+    npools = maxnode + 1;
+
+    for (i = 0; i < npools; i++) {
+        VIR_AUTOPTR(virBitmap) cpus = NULL;
+        int rc;
+
+        if (!virNumaNodeIsAvailable(i))
+            continue;
+
+        if ((rc = virNumaGetNodeCPUs(i, &cpus)) == -2 || rc == 0)
+            continue;
+        if (rc < 0)
+            goto cleanup;
+
+        if (!(pools[i] = virThreadPoolNew(nworkers, nworkers, 0,
+                                          virNetServerHandleJob,
+                                          srv)) ||
+            virThreadPoolSetAffinity(pools[i], cpus) < 0)
+            goto cleanup;
+
+        VIR_DEBUG("Started %zu workers on NUMA node %zu", nworkers, i);
+    }
+
+    VIR_STEAL_PTR(srv->nodeWorkers, pools);
+    srv->nnodeWorkers = npools;
+    srv->nodeWorkersFunc = func;
+    srv->nodeWorkersOpaque = opaque;
+    ret = 0;
+
+ cleanup:
+    for (i = 0; pools && i < npools; i++)
+        virThreadPoolFree(pools[i]);
+    VIR_FREE(pools);
+    virObjectUnlock(srv);
+    return ret;
+}
+
+
 virNetServerPtr virNetServerNew(const char *name,
                                 unsigned long long next_client_id,
                                 size_t min_workers,
@@ -424,6 +891,7 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
     unsigned int keepaliveCount;
     unsigned long long next_client_id;
     const char *mdnsGroupName = NULL;
+    unsigned int io_loops = 0;
 
     if (virJSONValueObjectGetNumberUint(object, "min_workers", &min_workers) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -479,6 +947,13 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
         next_client_id = 1;
     }
 
+    if (virJSONValueObjectHasKey(object, "io_loops") &&
+        virJSONValueObjectGetNumberUint(object, "io_loops", &io_loops) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Malformed io_loops data in JSON document"));
+        goto error;
+    }
+
     if (!(srv = virNetServerNew(name, next_client_id,
                                 min_workers, max_workers,
                                 priority_workers, max_clients,
@@ -489,6 +964,9 @@ virNetServerPtr virNetServerNewPostExecRestart(virJSONValuePtr object,
                                 clientPrivFree, clientPrivOpaque)))
         goto error;
 
+    if (io_loops && virNetServerSetIOLoops(srv, io_loops) < 0)
+        goto error;
+
     if (!(services = virJSONValueObjectGet(object, "services"))) {
         virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
                        _("Missing services data in JSON document"));
@@ -631,6 +1109,13 @@ virJSONValuePtr virNetServerPreExecRestart(virNetServerPtr srv)
         goto error;
     }
 
+    if (srv->nioLoops &&
+        virJSONValueObjectAppendNumberUint(object, "io_loops", srv->nioLoops) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot set io_loops data in JSON document"));
+        goto error;
+    }
+
     services = virJSONValueNewArray();
     if (virJSONValueObjectAppend(object, "services", services) < 0) {
         virJSONValueFree(services);
@@ -806,6 +1291,9 @@ void virNetServerDispose(void *obj)
     VIR_FREE(srv->name);
 
     virThreadPoolFree(srv->workers);
+    for (i = 0; i < srv->nnodeWorkers; i++)
+        virThreadPoolFree(srv->nodeWorkers[i]);
+    VIR_FREE(srv->nodeWorkers);
 
     for (i = 0; i < srv->nservices; i++)
         virObjectUnref(srv->services[i]);
@@ -819,8 +1307,13 @@ void virNetServerDispose(void *obj)
         virObjectUnref(srv->clients[i]);
     VIR_FREE(srv->clients);
 
+    virNetServerStopIOLoops(srv->ioLoops, srv->nioLoops);
+    VIR_FREE(srv->ioLoops);
+
     VIR_FREE(srv->mdnsGroupName);
     virNetServerMDNSFree(srv->mdns);
+
+    virHashFree(srv->identityBuckets);
 }
 
 void virNetServerClose(virNetServerPtr srv)
@@ -963,6 +1456,61 @@ virNetServerSetThreadPoolParameters(virNetServerPtr srv,
     return ret;
 }
 
+void
+virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                               virThreadPoolStatsPtr stats,
+                               unsigned int *adaptiveLatency,
+                               size_t *bulkWorkers)
+{
+    virObjectLock(srv);
+    virThreadPoolGetStats(srv->workers, stats);
+    *adaptiveLatency = virThreadPoolGetAdaptiveLatency(srv->workers);
+    *bulkWorkers = virThreadPoolGetBulkWorkers(srv->workers);
+    virObjectUnlock(srv);
+}
+
+int
+virNetServerSetThreadPoolAdaptiveLatency(virNetServerPtr srv,
+                                         unsigned int latency)
+{
+    int ret = -1;
+
+    virObjectLock(srv);
+    if (virThreadPoolGetMaxWorkers(srv->workers) == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("adaptive sizing requires a server with workers"));
+        goto cleanup;
+    }
+
+    virThreadPoolSetAdaptiveLatency(srv->workers, latency);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
+int
+virNetServerSetThreadPoolBulkWorkers(virNetServerPtr srv,
+                                     size_t limit)
+{
+    int ret = -1;
+
+    virObjectLock(srv);
+    if (virThreadPoolGetMaxWorkers(srv->workers) == 0) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("limiting bulk workers requires a server with workers"));
+        goto cleanup;
+    }
+
+    virThreadPoolSetBulkWorkers(srv->workers, limit);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(srv);
+    return ret;
+}
+
 size_t
 virNetServerGetMaxClients(virNetServerPtr srv)
 {
@@ -1040,6 +1588,35 @@ virNetServerGetClients(virNetServerPtr srv,
     return ret;
 }
 
+int
+virNetServerGetPrograms(virNetServerPtr srv,
+                        virNetServerProgramPtr **progs)
+{
+    int ret = -1;
+    size_t i;
+    size_t nprogs = 0;
+    virNetServerProgramPtr *list = NULL;
+
+    virObjectLock(srv);
+
+    for (i = 0; i < srv->nprograms; i++) {
+        virNetServerProgramPtr prog = virObjectRef(srv->programs[i]);
+        if (VIR_APPEND_ELEMENT(list, nprogs, prog) < 0) {
+            virObjectUnref(prog);
+            goto cleanup;
+        }
+    }
+
+    *progs = list;
+    list = NULL;
+    ret = nprogs;
+
+ cleanup:
+    virObjectListFreeCount(list, nprogs);
+    virObjectUnlock(srv);
+    return ret;
+}
+
 virNetServerClientPtr
 virNetServerGetClient(virNetServerPtr srv,
                       unsigned long long id)
@@ -1063,6 +1640,49 @@ virNetServerGetClient(virNetServerPtr srv,
     return ret;
 }
 
+/**
+ * virNetServerSetRequestRateLimits:
+ * @srv: server
+ * @clientRate: calls per second allowed on each client connection
+ * @clientBurst: calls a client connection may make at once
+ * @identityRate: calls per second allowed for each identity
+ * @identityBurst: calls an identity may make at once
+ *
+ * Limit the rate of calls dispatched for the clients of @srv with
+ * token buckets, one for each client connection and one shared by all
+ * connections authenticated as the same user. A zero rate disables
+ * the corresponding limit, a zero burst defaults to the rate. Calls
+ * of bulk procedures count as several requests. Calls over the limits
+ * are failed without being dispatched.
+ */
+void
+virNetServerSetRequestRateLimits(virNetServerPtr srv,
+                                 unsigned int clientRate,
+                                 unsigned int clientBurst,
+                                 unsigned int identityRate,
+                                 unsigned int identityBurst)
+{
+    virObjectLock(srv);
+
+    srv->clientRequestRate = clientRate;
+    srv->clientRequestBurst = clientBurst;
+    srv->identityRequestRate = identityRate;
+    srv->identityRequestBurst = identityBurst;
+
+    /* Buckets sized for the old limits would be wrong for the new ones */
+    virHashFree(srv->identityBuckets);
+    srv->identityBuckets = NULL;
+    if (identityRate &&
+        !(srv->identityBuckets = virHashCreate(32, virHashValueFree))) {
+        VIR_WARN("Failed to create identity rate buckets, not limiting "
+                 "the request rate of identities");
+        srv->identityRequestRate = 0;
+    }
+
+    virObjectUnlock(srv);
+}
+
+
 int
 virNetServerSetClientLimits(virNetServerPtr srv,
                             long long int maxClients,
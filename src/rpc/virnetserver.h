@@ -30,6 +30,7 @@
 # include "virnetserverservice.h"
 # include "virobject.h"
 # include "virjson.h"
+# include "virthreadpool.h"
 
 
 virNetServerPtr virNetServerNew(const char *name,
@@ -75,6 +76,9 @@ int virNetServerSetTLSContext(virNetServerPtr srv,
 
 int virNetServerAddClient(virNetServerPtr srv,
                           virNetServerClientPtr client);
+int virNetServerDispatchMessage(virNetServerPtr srv,
+                                virNetServerClientPtr client,
+                                virNetMessagePtr msg);
 bool virNetServerHasClients(virNetServerPtr srv);
 void virNetServerProcessClients(virNetServerPtr srv);
 void virNetServerSetClientAuthenticated(virNetServerPtr srv, virNetServerClientPtr client);
@@ -98,6 +102,32 @@ int virNetServerSetThreadPoolParameters(virNetServerPtr srv,
                                         long long int maxWorkers,
                                         long long int prioWorkers);
 
+void virNetServerGetThreadPoolStats(virNetServerPtr srv,
+                                    virThreadPoolStatsPtr stats,
+                                    unsigned int *adaptiveLatency,
+                                    size_t *bulkWorkers);
+
+int virNetServerSetThreadPoolAdaptiveLatency(virNetServerPtr srv,
+                                             unsigned int latency);
+
+int virNetServerSetThreadPoolBulkWorkers(virNetServerPtr srv,
+                                         size_t limit);
+
+int virNetServerSetIOLoops(virNetServerPtr srv,
+                           size_t nloops);
+size_t virNetServerGetIOLoops(virNetServerPtr srv);
+
+/* Returns the host NUMA node the object a call in @msg of @prog is on
+ * is closest to, or -1 if there is no telling */
+typedef int (*virNetServerJobNodeFunc)(virNetServerProgramPtr prog,
+                                       virNetMessagePtr msg,
+                                       void *opaque);
+
+int virNetServerSetNodeWorkers(virNetServerPtr srv,
+                               size_t nworkers,
+                               virNetServerJobNodeFunc func,
+                               void *opaque);
+
 unsigned long long virNetServerNextClientID(virNetServerPtr srv);
 
 virNetServerClientPtr virNetServerGetClient(virNetServerPtr srv,
@@ -106,6 +136,9 @@ virNetServerClientPtr virNetServerGetClient(virNetServerPtr srv,
 int virNetServerGetClients(virNetServerPtr srv,
                            virNetServerClientPtr **clients);
 
+int virNetServerGetPrograms(virNetServerPtr srv,
+                            virNetServerProgramPtr **progs);
+
 size_t virNetServerGetMaxClients(virNetServerPtr srv);
 size_t virNetServerGetCurrentClients(virNetServerPtr srv);
 size_t virNetServerGetMaxUnauthClients(virNetServerPtr srv);
@@ -115,4 +148,10 @@ int virNetServerSetClientLimits(virNetServerPtr srv,
                                 long long int maxClients,
                                 long long int maxClientsUnauth);
 
+void virNetServerSetRequestRateLimits(virNetServerPtr srv,
+                                      unsigned int clientRate,
+                                      unsigned int clientBurst,
+                                      unsigned int identityRate,
+                                      unsigned int identityBurst);
+
 #endif /* __VIR_NET_SERVER_H__ */
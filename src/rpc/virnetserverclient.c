@@ -44,6 +44,9 @@
 
 VIR_LOG_INIT("rpc.netserverclient");
 
+/* Maximum number of queued messages handed to a single writev */
+#define VIR_NET_SERVER_CLIENT_WRITEV_MAX 16
+
 /* Allow for filtering of incoming messages to a custom
  * dispatch processing queue, instead of the workers.
  * This allows for certain types of messages to be handled
@@ -73,6 +76,7 @@ struct _virNetServerClient
     int auth;
     bool auth_pending;
     bool readonly;
+    bool compressReplies; /* Peer accepts compressed reply payloads */
     virNetTLSContextPtr tlsCtxt;
     virNetTLSSessionPtr tls;
 #if WITH_SASL
@@ -80,6 +84,8 @@ struct _virNetServerClient
 #endif
     int sockTimer; /* Timer to be fired upon cached data,
                     * so we jump out from poll() immediately */
+    virEventPollLoopPtr loop; /* Loop running socket I/O and sockTimer,
+                               * NULL for the default event loop */
 
 
     virIdentityPtr identity;
@@ -98,9 +104,16 @@ struct _virNetServerClient
      * throttling calculations */
     size_t nrequests;
     size_t nrequests_max;
+
+    /* Request rate limiting, see virNetServerSetRequestRateLimits */
+    virNetServerRateBucket rateBucket;
+    unsigned long long rejectedCalls;
     /* Zero or one messages being received. Zero if
-     * nrequests >= max_clients and throttling */
+     * nrequests >= max_clients and throttling, or
+     * quiesced */
     virNetMessagePtr rx;
+    /* No further messages are read once set */
+    bool quiesced;
     /* Zero or many messages waiting for transmit
      * back to client, including async events */
     virNetMessagePtr tx;
@@ -190,6 +203,19 @@ virNetServerClientCalculateHandleMode(virNetServerClientPtr client)
     return mode;
 }
 
+/*
+ * @client: a locked client object
+ */
+static void virNetServerClientUpdateSockTimer(virNetServerClientPtr client,
+                                              int frequency)
+{
+    if (client->loop)
+        virEventPollLoopUpdateTimeout(client->loop, client->sockTimer,
+                                      frequency);
+    else
+        virEventUpdateTimeout(client->sockTimer, frequency);
+}
+
 /*
  * @server: a locked or unlocked server object
  * @client: a locked client object
@@ -230,7 +256,7 @@ static void virNetServerClientUpdateEvent(virNetServerClientPtr client)
     virNetSocketUpdateIOCallback(client->sock, mode);
 
     if (client->rx && virNetSocketHasCachedData(client->sock))
-        virEventUpdateTimeout(client->sockTimer, 0);
+        virNetServerClientUpdateSockTimer(client, 0);
 }
 
 
@@ -351,7 +377,8 @@ static void virNetServerClientSockTimerFunc(int timer,
     virNetServerClientPtr client = opaque;
     virNetMessagePtr msg = NULL;
     virObjectLock(client);
-    virEventUpdateTimeout(timer, -1);
+    if (client->sockTimer == timer)
+        virNetServerClientUpdateSockTimer(client, -1);
     /* Although client->rx != NULL when this timer is enabled, it might have
      * changed since the client was unlocked in the meantime. */
     if (client->rx)
@@ -415,8 +442,7 @@ virNetServerClientNewInternal(unsigned long long id,
     /* Prepare one for packet receive */
     if (!(client->rx = virNetMessageNew(true)))
         goto error;
-    client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-    if (VIR_ALLOC_N(client->rx->buffer, client->rx->bufferLength) < 0)
+    if (virNetMessageResizeBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX) < 0)
         goto error;
     client->nrequests = 1;
 
@@ -682,6 +708,31 @@ virNetServerClientSetReadonly(virNetServerClientPtr client,
 }
 
 
+bool
+virNetServerClientGetPayloadCompression(virNetServerClientPtr client)
+{
+    bool compress;
+    virObjectLock(client);
+    compress = client->compressReplies;
+    virObjectUnlock(client);
+    return compress;
+}
+
+
+/*
+ * Only to be enabled once the peer has announced it can decompress
+ * payloads, see VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION.
+ */
+void
+virNetServerClientSetPayloadCompression(virNetServerClientPtr client,
+                                        bool compress)
+{
+    virObjectLock(client);
+    client->compressReplies = compress;
+    virObjectUnlock(client);
+}
+
+
 unsigned long long virNetServerClientGetID(virNetServerClientPtr client)
 {
     return client->id;
@@ -930,6 +981,50 @@ void virNetServerClientSetCloseHook(virNetServerClientPtr client,
 }
 
 
+/**
+ * virNetServerClientSetEventLoop:
+ * @client: the client
+ * @loop: the event loop to run the client's socket I/O from
+ *
+ * Move the socket I/O of @client from the default event loop
+ * to @loop. Must be called before virNetServerClientInit.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetServerClientSetEventLoop(virNetServerClientPtr client,
+                                   virEventPollLoopPtr loop)
+{
+    int timer;
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (client->loop) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("client event loop is already set"));
+        goto cleanup;
+    }
+
+    if ((timer = virEventPollLoopAddTimeout(loop, -1,
+                                            virNetServerClientSockTimerFunc,
+                                            client, NULL)) < 0)
+        goto cleanup;
+
+    if (client->sockTimer > 0)
+        virEventRemoveTimeout(client->sockTimer);
+    client->sockTimer = timer;
+    client->loop = virObjectRef(loop);
+
+    if (client->sock)
+        virNetSocketSetEventLoop(client->sock, loop);
+
+    ret = 0;
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 void virNetServerClientSetDispatcher(virNetServerClientPtr client,
                                      virNetServerClientDispatchFunc func,
                                      void *opaque)
@@ -983,8 +1078,13 @@ void virNetServerClientDispose(void *obj)
 #if WITH_SASL
     virObjectUnref(client->sasl);
 #endif
-    if (client->sockTimer > 0)
-        virEventRemoveTimeout(client->sockTimer);
+    if (client->sockTimer > 0) {
+        if (client->loop)
+            virEventPollLoopRemoveTimeout(client->loop, client->sockTimer);
+        else
+            virEventRemoveTimeout(client->sockTimer);
+    }
+    virObjectUnref(client->loop);
     virObjectUnref(client->tls);
     virObjectUnref(client->tlsCtxt);
     virObjectUnref(client->sock);
@@ -1075,6 +1175,97 @@ virNetServerClientIsClosedLocked(virNetServerClientPtr client)
 }
 
 
+/**
+ * virNetServerClientQuiesce:
+ * @client: the client
+ *
+ * Stops reading messages from @client. A message which was partially
+ * received is still read to its end and dispatched, and the replies to
+ * all calls in progress are still sent. Once that happened, the client
+ * is quiescent, see virNetServerClientIsQuiescent.
+ */
+void virNetServerClientQuiesce(virNetServerClientPtr client)
+{
+    virObjectLock(client);
+    client->quiesced = true;
+
+    /* Nothing was read into the receive buffer yet, so drop it */
+    if (client->rx && client->rx->bufferOffset == 0 &&
+        client->rx->bufferLength == VIR_NET_MESSAGE_LEN_MAX) {
+        virNetMessageFree(client->rx);
+        client->rx = NULL;
+        client->nrequests--;
+    }
+
+    virNetServerClientUpdateEvent(client);
+    virObjectUnlock(client);
+}
+
+
+/**
+ * virNetServerClientIsQuiescent:
+ * @client: the client
+ *
+ * Returns true if @client was quiesced and has neither a partially
+ * received message, nor calls in progress, nor messages waiting to
+ * be sent. The state of such a client is entirely described by its
+ * socket and private data.
+ */
+bool virNetServerClientIsQuiescent(virNetServerClientPtr client)
+{
+    bool ret;
+
+    virObjectLock(client);
+    ret = client->quiesced && !client->rx && !client->tx &&
+        client->nrequests == 0;
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
+/**
+ * virNetServerClientResume:
+ * @client: the client
+ *
+ * Resumes reading messages from a client stopped by
+ * virNetServerClientQuiesce.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int virNetServerClientResume(virNetServerClientPtr client)
+{
+    int ret = -1;
+
+    virObjectLock(client);
+
+    if (!client->quiesced) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    client->quiesced = false;
+
+    if (!client->rx && client->nrequests < client->nrequests_max) {
+        if (!(client->rx = virNetMessageNew(true)))
+            goto cleanup;
+        if (virNetMessageResizeBuffer(client->rx, VIR_NET_MESSAGE_LEN_MAX) < 0) {
+            virNetMessageFree(client->rx);
+            client->rx = NULL;
+            goto cleanup;
+        }
+        client->nrequests++;
+    }
+
+    virNetServerClientUpdateEvent(client);
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(client);
+    return ret;
+}
+
+
 void virNetServerClientDelayedClose(virNetServerClientPtr client)
 {
     virObjectLock(client);
@@ -1302,13 +1493,13 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
         }
 
         /* Possibly need to create another receive buffer */
-        if (client->nrequests < client->nrequests_max) {
+        if (!client->quiesced &&
+            client->nrequests < client->nrequests_max) {
             if (!(client->rx = virNetMessageNew(true))) {
                 client->wantClose = true;
             } else {
-                client->rx->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                if (VIR_ALLOC_N(client->rx->buffer,
-                                client->rx->bufferLength) < 0) {
+                if (virNetMessageResizeBuffer(client->rx,
+                                              VIR_NET_MESSAGE_LEN_MAX) < 0) {
                     client->wantClose = true;
                 } else {
                     client->nrequests++;
@@ -1325,6 +1516,13 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
 /*
  * Send client->tx using no encoding
  *
+ * Any further messages already queued behind client->tx are handed
+ * to the socket in the same writev, so a burst of replies and events
+ * does not cost one syscall per message. Gathering stops after a
+ * message which carries FDs, since those are only sent once all of
+ * its data has gone out, and while a SASL session is waiting to be
+ * activated, since it applies to all data after the current message.
+ *
  * Returns:
  *   -1 on error or EOF
  *    0 on EAGAIN
@@ -1332,7 +1530,11 @@ static virNetMessagePtr virNetServerClientDispatchRead(virNetServerClientPtr cli
  */
 static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
 {
+    struct iovec iov[VIR_NET_SERVER_CLIENT_WRITEV_MAX];
+    int niov = 0;
+    virNetMessagePtr msg;
     ssize_t ret;
+    size_t done;
 
     if (client->tx->bufferLength < client->tx->bufferOffset) {
         virReportError(VIR_ERR_RPC,
@@ -1345,13 +1547,37 @@ static ssize_t virNetServerClientWrite(virNetServerClientPtr client)
     if (client->tx->bufferLength == client->tx->bufferOffset)
         return 1;
 
-    ret = virNetSocketWrite(client->sock,
-                            client->tx->buffer + client->tx->bufferOffset,
-                            client->tx->bufferLength - client->tx->bufferOffset);
+    for (msg = client->tx;
+         msg && niov < ARRAY_CARDINALITY(iov);
+         msg = msg->next) {
+        if (msg->bufferOffset < msg->bufferLength) {
+            iov[niov].iov_base = msg->buffer + msg->bufferOffset;
+            iov[niov].iov_len = msg->bufferLength - msg->bufferOffset;
+            niov++;
+        }
+
+        if (msg->nfds)
+            break;
+#if WITH_SASL
+        if (client->sasl)
+            break;
+#endif
+    }
+
+    ret = virNetSocketWritev(client->sock, iov, niov);
     if (ret <= 0)
         return ret; /* -1 error, 0 = egain */
 
-    client->tx->bufferOffset += ret;
+    done = ret;
+    for (msg = client->tx; msg && done; msg = msg->next) {
+        size_t len = msg->bufferLength - msg->bufferOffset;
+
+        if (len > done)
+            len = done;
+        msg->bufferOffset += len;
+        done -= len;
+    }
+
     return ret;
 }
 
@@ -1407,12 +1633,12 @@ virNetServerClientDispatchWrite(virNetServerClientPtr client)
             if (msg->tracked) {
                 client->nrequests--;
                 /* See if the recv queue is currently throttled */
-                if (!client->rx &&
+                if (!client->rx && !client->quiesced &&
                     client->nrequests < client->nrequests_max) {
                     /* Ready to recv more messages */
                     virNetMessageClear(msg);
-                    msg->bufferLength = VIR_NET_MESSAGE_LEN_MAX;
-                    if (VIR_ALLOC_N(msg->buffer, msg->bufferLength) < 0) {
+                    if (virNetMessageResizeBuffer(msg,
+                                                  VIR_NET_MESSAGE_LEN_MAX) < 0) {
                         virNetMessageFree(msg);
                         return;
                     }
@@ -1648,6 +1874,97 @@ virNetServerClientGetTransport(virNetServerClientPtr client)
     return ret;
 }
 
+/**
+ * virNetServerRateBucketTake:
+ * @bucket: token bucket
+ * @rate: requests per second the bucket is refilled with
+ * @burst: capacity of the bucket in requests, 0 to use @rate
+ * @cost: number of requests to take
+ * @now: current monotonic time in microseconds
+ *
+ * Refill @bucket for the time elapsed since it was last used and try
+ * to take @cost requests out of it. A cost larger than the capacity
+ * is reduced to the capacity. A bucket used for the first time is
+ * full.
+ *
+ * Returns true if the requests were taken, false if the bucket does
+ * not hold enough of them.
+ */
+bool
+virNetServerRateBucketTake(virNetServerRateBucketPtr bucket,
+                           unsigned int rate,
+                           unsigned int burst,
+                           unsigned int cost,
+                           unsigned long long now)
+{
+    unsigned long long capacity;
+    unsigned long long elapsed;
+    unsigned long long need;
+
+    if (!burst)
+        burst = rate;
+    capacity = burst * 1000000ull;
+    need = MIN(cost, burst) * 1000000ull;
+
+    if (!bucket->last) {
+        bucket->tokens = capacity;
+    } else if (now > bucket->last) {
+        elapsed = now - bucket->last;
+        if (elapsed >= capacity / rate)
+            bucket->tokens = capacity;
+        else
+            bucket->tokens = MIN(capacity, bucket->tokens + elapsed * rate);
+    }
+    bucket->last = now;
+
+    if (bucket->tokens < need)
+        return false;
+
+    bucket->tokens -= need;
+    return true;
+}
+
+
+bool
+virNetServerClientTakeRequestTokens(virNetServerClientPtr client,
+                                    unsigned int rate,
+                                    unsigned int burst,
+                                    unsigned int cost,
+                                    unsigned long long now)
+{
+    bool ret;
+
+    virObjectLock(client);
+    ret = virNetServerRateBucketTake(&client->rateBucket,
+                                     rate, burst, cost, now);
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
+void
+virNetServerClientRejectCall(virNetServerClientPtr client)
+{
+    virObjectLock(client);
+    client->rejectedCalls++;
+    virObjectUnlock(client);
+}
+
+
+unsigned long long
+virNetServerClientGetRejectedCalls(virNetServerClientPtr client)
+{
+    unsigned long long ret;
+
+    virObjectLock(client);
+    ret = client->rejectedCalls;
+    virObjectUnlock(client);
+
+    return ret;
+}
+
+
 int
 virNetServerClientGetInfo(virNetServerClientPtr client,
                           bool *readonly, char **sock_addr,
@@ -98,6 +98,9 @@ int virNetServerClientGetAuth(virNetServerClientPtr client);
 void virNetServerClientSetAuthLocked(virNetServerClientPtr client, int auth);
 bool virNetServerClientGetReadonly(virNetServerClientPtr client);
 void virNetServerClientSetReadonly(virNetServerClientPtr client, bool readonly);
+bool virNetServerClientGetPayloadCompression(virNetServerClientPtr client);
+void virNetServerClientSetPayloadCompression(virNetServerClientPtr client,
+                                             bool compress);
 unsigned long long virNetServerClientGetID(virNetServerClientPtr client);
 long long virNetServerClientGetTimestamp(virNetServerClientPtr client);
 
@@ -127,6 +130,29 @@ int virNetServerClientGetSELinuxContext(virNetServerClientPtr client,
 
 virIdentityPtr virNetServerClientGetIdentity(virNetServerClientPtr client);
 
+typedef struct _virNetServerRateBucket virNetServerRateBucket;
+typedef virNetServerRateBucket *virNetServerRateBucketPtr;
+
+struct _virNetServerRateBucket {
+    unsigned long long tokens; /* in millionths of a request */
+    unsigned long long last;   /* microseconds, 0 if never used */
+};
+
+bool virNetServerRateBucketTake(virNetServerRateBucketPtr bucket,
+                                unsigned int rate,
+                                unsigned int burst,
+                                unsigned int cost,
+                                unsigned long long now);
+
+bool virNetServerClientTakeRequestTokens(virNetServerClientPtr client,
+                                         unsigned int rate,
+                                         unsigned int burst,
+                                         unsigned int cost,
+                                         unsigned long long now);
+void virNetServerClientRejectCall(virNetServerClientPtr client);
+unsigned long long
+virNetServerClientGetRejectedCalls(virNetServerClientPtr client);
+
 void *virNetServerClientGetPrivateData(virNetServerClientPtr client);
 
 typedef void (*virNetServerClientCloseFunc)(virNetServerClientPtr client);
@@ -134,6 +160,9 @@ typedef void (*virNetServerClientCloseFunc)(virNetServerClientPtr client);
 void virNetServerClientSetCloseHook(virNetServerClientPtr client,
                                     virNetServerClientCloseFunc cf);
 
+int virNetServerClientSetEventLoop(virNetServerClientPtr client,
+                                   virEventPollLoopPtr loop);
+
 void virNetServerClientSetDispatcher(virNetServerClientPtr client,
                                      virNetServerClientDispatchFunc func,
                                      void *opaque);
@@ -141,6 +170,10 @@ void virNetServerClientClose(virNetServerClientPtr client);
 void virNetServerClientCloseLocked(virNetServerClientPtr client);
 bool virNetServerClientIsClosedLocked(virNetServerClientPtr client);
 
+void virNetServerClientQuiesce(virNetServerClientPtr client);
+bool virNetServerClientIsQuiescent(virNetServerClientPtr client);
+int virNetServerClientResume(virNetServerClientPtr client);
+
 void virNetServerClientDelayedClose(virNetServerClientPtr client);
 void virNetServerClientImmediateClose(virNetServerClientPtr client);
 bool virNetServerClientWantCloseLocked(virNetServerClientPtr client);
@@ -27,15 +27,27 @@
 #include "virnetserverclient.h"
 
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
 #include "virthread.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
 VIR_LOG_INIT("rpc.netserverprogram");
 
+/* Counters of one procedure, only ever touched with atomic operations */
+typedef struct _virNetServerProgramProcCounters virNetServerProgramProcCounters;
+typedef virNetServerProgramProcCounters *virNetServerProgramProcCountersPtr;
+struct _virNetServerProgramProcCounters {
+    int calls;
+    int errors;
+    int queue[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
+    int exec[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
+};
+
 struct _virNetServerProgram {
     virObject parent;
 
@@ -43,6 +55,9 @@ struct _virNetServerProgram {
     unsigned version;
     virNetServerProgramProcPtr procs;
     size_t nprocs;
+
+    /* indexed like @procs */
+    virNetServerProgramProcCountersPtr counters;
 };
 
 
@@ -73,6 +88,11 @@ virNetServerProgramPtr virNetServerProgramNew(unsigned program,
     if (!(prog = virObjectNew(virNetServerProgramClass)))
         return NULL;
 
+    if (VIR_ALLOC_N(prog->counters, nprocs) < 0) {
+        virObjectUnref(prog);
+        return NULL;
+    }
+
     prog->program = program;
     prog->version = version;
     prog->procs = procs;
@@ -136,6 +156,167 @@ virNetServerProgramGetPriority(virNetServerProgramPtr prog,
     return proc->priority;
 }
 
+bool
+virNetServerProgramGetDomainArg(virNetServerProgramPtr prog,
+                                int procedure)
+{
+    virNetServerProgramProcPtr proc = virNetServerProgramGetProc(prog, procedure);
+
+    if (!proc)
+        return false;
+
+    return proc->domainArg;
+}
+
+
+/**
+ * virNetServerProgramTimestamp:
+ *
+ * Returns a monotonic timestamp in microseconds for measuring how long
+ * calls take, or 0 if the clock can't be read.
+ */
+unsigned long long
+virNetServerProgramTimestamp(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) < 0)
+        return 0;
+
+    return (ts.tv_sec * 1000000ull) + (ts.tv_nsec / 1000ull);
+#else
+    struct timeval tv;
+
+    if (gettimeofday(&tv, NULL) < 0)
+        return 0;
+
+    return (tv.tv_sec * 1000000ull) + tv.tv_usec;
+#endif
+}
+
+
+static void
+virNetServerProgramCountLatency(int *buckets,
+                                unsigned long long start)
+{
+    unsigned long long now = virNetServerProgramTimestamp();
+    unsigned long long usec;
+    size_t bucket = 0;
+
+    if (!start || now < start)
+        return;
+
+    for (usec = now - start; usec; usec >>= 1) {
+        if (++bucket == VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS - 1)
+            break;
+    }
+
+    virAtomicIntInc(&buckets[bucket]);
+}
+
+
+/**
+ * virNetServerProgramRecordQueueTime:
+ * @prog: the program @msg is for
+ * @msg: a message just picked up by a worker
+ * @queued: virNetServerProgramTimestamp() of when it was queued
+ *
+ * Accounts the time @msg spent waiting for a worker to its procedure.
+ */
+void
+virNetServerProgramRecordQueueTime(virNetServerProgramPtr prog,
+                                   virNetMessagePtr msg,
+                                   unsigned long long queued)
+{
+    if ((msg->header.type != VIR_NET_CALL &&
+         msg->header.type != VIR_NET_CALL_WITH_FDS) ||
+        !virNetServerProgramGetProc(prog, msg->header.proc))
+        return;
+
+    virNetServerProgramCountLatency(prog->counters[msg->header.proc].queue,
+                                    queued);
+}
+
+
+/**
+ * virNetServerProgramGetStats:
+ * @prog: the program
+ * @stats: filled with a newly allocated array of statistics
+ * @nstats: filled with the number of entries in @stats
+ *
+ * Takes a snapshot of the call counters and latency histograms of every
+ * procedure of @prog that was called at least once.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virNetServerProgramGetStats(virNetServerProgramPtr prog,
+                            virNetServerProgramProcStatsPtr *stats,
+                            size_t *nstats)
+{
+    virNetServerProgramProcStatsPtr list = NULL;
+    size_t n = 0;
+    size_t i, j;
+
+    for (i = 0; i < prog->nprocs; i++) {
+        virNetServerProgramProcCountersPtr counters = &prog->counters[i];
+        virNetServerProgramProcStats entry = { .procedure = i };
+
+        if (!(entry.calls = virAtomicIntGet(&counters->calls)))
+            continue;
+
+        entry.errors = virAtomicIntGet(&counters->errors);
+        for (j = 0; j < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; j++) {
+            entry.queue[j] = virAtomicIntGet(&counters->queue[j]);
+            entry.exec[j] = virAtomicIntGet(&counters->exec[j]);
+        }
+
+        if (VIR_APPEND_ELEMENT(list, n, entry) < 0) {
+            VIR_FREE(list);
+            return -1;
+        }
+    }
+
+    *stats = list;
+    *nstats = n;
+    return 0;
+}
+
+
+/**
+ * virNetServerProgramLatencyPercentile:
+ * @buckets: a latency histogram from virNetServerProgramGetStats()
+ * @percent: which percentile to compute, 100 for the maximum
+ *
+ * Returns the upper bound in microseconds of the bucket holding the
+ * requested percentile, or 0 if the histogram is empty.
+ */
+unsigned long long
+virNetServerProgramLatencyPercentile(const unsigned int *buckets,
+                                     unsigned int percent)
+{
+    unsigned long long total = 0;
+    unsigned long long sum = 0;
+    size_t i;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++)
+        total += buckets[i];
+
+    if (!total)
+        return 0;
+
+    for (i = 0; i < VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS; i++) {
+        sum += buckets[i];
+        if (sum * 100 >= total * percent && buckets[i])
+            break;
+    }
+    if (i == VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS)
+        i--;
+
+    return (1ull << i) - 1;
+}
+
 static int
 virNetServerProgramSendError(unsigned program,
                              unsigned version,
@@ -379,6 +560,8 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
     virNetMessageError rerr;
     size_t i;
     virIdentityPtr identity = NULL;
+    virNetServerProgramProcCountersPtr counters;
+    unsigned long long start;
 
     memset(&rerr, 0, sizeof(rerr));
 
@@ -434,7 +617,22 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
      *
      *   'args and 'ret'
      */
+    counters = &prog->counters[msg->header.proc];
+    start = virNetServerProgramTimestamp();
+    PROBE_QUIET(RPC_SERVER_DISPATCH_BEGIN,
+                "client=%p prog=%d vers=%d proc=%d serial=%u",
+                client, msg->header.prog, msg->header.vers,
+                msg->header.proc, msg->header.serial);
     rv = (dispatcher->func)(server, client, msg, &rerr, arg, ret);
+    PROBE_QUIET(RPC_SERVER_DISPATCH_END,
+                "client=%p prog=%d vers=%d proc=%d serial=%u ret=%d",
+                client, msg->header.prog, msg->header.vers,
+                msg->header.proc, msg->header.serial, rv);
+
+    virAtomicIntInc(&counters->calls);
+    if (rv < 0)
+        virAtomicIntInc(&counters->errors);
+    virNetServerProgramCountLatency(counters->exec, start);
 
     if (virIdentitySetCurrent(NULL) < 0)
         goto error;
@@ -480,6 +678,8 @@ virNetServerProgramDispatchCall(virNetServerProgramPtr prog,
         goto error;
     }
 
+    msg->compress = virNetServerClientGetPayloadCompression(client);
+
     if (virNetMessageEncodePayload(msg, dispatcher->ret_filter, ret) < 0) {
         xdr_free(dispatcher->ret_filter, ret);
         goto error;
@@ -583,6 +783,9 @@ int virNetServerProgramSendStreamHole(virNetServerProgramPtr prog,
 }
 
 
-void virNetServerProgramDispose(void *obj ATTRIBUTE_UNUSED)
+void virNetServerProgramDispose(void *obj)
 {
+    virNetServerProgramPtr prog = obj;
+
+    VIR_FREE(prog->counters);
 }
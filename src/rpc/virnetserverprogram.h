@@ -55,6 +55,24 @@ struct _virNetServerProgramProc {
     xdrproc_t ret_filter;
     bool needAuth;
     unsigned int priority;
+    bool domainArg; /* arguments start with the domain the call is on */
+};
+
+/* Latencies are counted in power of two buckets of microseconds: bucket
+ * 0 holds latencies of 0us, bucket N > 0 those in [2^(N-1), 2^N - 1]us
+ * and the last bucket everything above that */
+# define VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS 32
+
+typedef struct _virNetServerProgramProcStats virNetServerProgramProcStats;
+typedef virNetServerProgramProcStats *virNetServerProgramProcStatsPtr;
+struct _virNetServerProgramProcStats {
+    int procedure;
+    unsigned int calls;
+    unsigned int errors;
+    /* from being queued for a worker until the worker picks it up */
+    unsigned int queue[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
+    /* running the dispatch function */
+    unsigned int exec[VIR_NET_SERVER_PROGRAM_LATENCY_BUCKETS];
 };
 
 virNetServerProgramPtr virNetServerProgramNew(unsigned program,
@@ -68,9 +86,26 @@ int virNetServerProgramGetVersion(virNetServerProgramPtr prog);
 unsigned int virNetServerProgramGetPriority(virNetServerProgramPtr prog,
                                             int procedure);
 
+bool virNetServerProgramGetDomainArg(virNetServerProgramPtr prog,
+                                     int procedure);
+
 int virNetServerProgramMatches(virNetServerProgramPtr prog,
                                virNetMessagePtr msg);
 
+unsigned long long virNetServerProgramTimestamp(void);
+
+void virNetServerProgramRecordQueueTime(virNetServerProgramPtr prog,
+                                        virNetMessagePtr msg,
+                                        unsigned long long queued);
+
+int virNetServerProgramGetStats(virNetServerProgramPtr prog,
+                                virNetServerProgramProcStatsPtr *stats,
+                                size_t *nstats);
+
+unsigned long long
+virNetServerProgramLatencyPercentile(const unsigned int *buckets,
+                                     unsigned int percent);
+
 int virNetServerProgramDispatch(virNetServerProgramPtr prog,
                                 virNetServerPtr server,
                                 virNetServerClientPtr client,
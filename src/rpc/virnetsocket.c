@@ -25,6 +25,7 @@
 
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
@@ -71,6 +72,9 @@
 
 #define VIR_FROM_THIS VIR_FROM_RPC
 
+/* Most buffers encoded together in one SASL block */
+#define VIR_NET_SOCKET_SASL_IOV_MAX 16
+
 VIR_LOG_INIT("rpc.netsocket");
 
 struct _virNetSocket {
@@ -85,6 +89,7 @@ struct _virNetSocket {
     bool quietEOF;
 
     /* Event callback fields */
+    virEventPollLoopPtr loop; /* NULL for the default event loop */
     virNetSocketIOFunc func;
     void *opaque;
     virFreeCallback ff;
@@ -95,11 +100,23 @@ struct _virNetSocket {
     char *remoteAddrStrSASL;
     char *remoteAddrStrURI;
 
+    /* Credentials of the peer of a UNIX socket, once looked up */
+    bool peerIdentityValid;
+    uid_t peerUid;
+    gid_t peerGid;
+    pid_t peerPid;
+    unsigned long long peerTimestamp;
+
 #if WITH_GNUTLS
     virNetTLSSessionPtr tlsSession;
 #endif
 #if WITH_SASL
     virNetSASLSessionPtr saslSession;
+    /* Whether data goes through the SASL security layer */
+    bool saslLayer;
+
+    char *saslReadBuf;
+    size_t saslReadBufLength;
 
     const char *saslDecoded;
     size_t saslDecodedLength;
@@ -1320,9 +1337,13 @@ void virNetSocketDispose(void *obj)
           "sock=%p", sock);
 
     if (sock->watch >= 0) {
-        virEventRemoveHandle(sock->watch);
+        if (sock->loop)
+            virEventPollLoopRemoveHandle(sock->loop, sock->watch);
+        else
+            virEventRemoveHandle(sock->watch);
         sock->watch = -1;
     }
+    virObjectUnref(sock->loop);
 
 #ifdef HAVE_SYS_UN_H
     /* If a server socket, then unlink UNIX path */
@@ -1340,6 +1361,7 @@ void virNetSocketDispose(void *obj)
 #endif
 #if WITH_SASL
     virObjectUnref(sock->saslSession);
+    VIR_FREE(sock->saslReadBuf);
 #endif
 
 #if WITH_SSH2
@@ -1422,11 +1444,12 @@ int virNetSocketGetPort(virNetSocketPtr sock)
 
 
 #if defined(SO_PEERCRED)
-int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
-                                uid_t *uid,
-                                gid_t *gid,
-                                pid_t *pid,
-                                unsigned long long *timestamp)
+static int
+virNetSocketReadUNIXIdentity(virNetSocketPtr sock,
+                             uid_t *uid,
+                             gid_t *gid,
+                             pid_t *pid,
+                             unsigned long long *timestamp)
 {
 # if defined(HAVE_STRUCT_SOCKPEERCRED)
     struct sockpeercred cr;
@@ -1436,8 +1459,6 @@ int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
     socklen_t cr_len = sizeof(cr);
     int ret = -1;
 
-    virObjectLock(sock);
-
     if (getsockopt(sock->fd, SOL_SOCKET, SO_PEERCRED, &cr, &cr_len) < 0) {
         virReportSystemError(errno, "%s",
                              _("Failed to get client socket identity"));
@@ -1458,7 +1479,6 @@ int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
     ret = 0;
 
  cleanup:
-    virObjectUnlock(sock);
     return ret;
 }
 #elif defined(LOCAL_PEERCRED)
@@ -1479,18 +1499,17 @@ int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
 #  define VIR_SOL_PEERCRED 0
 # endif
 
-int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
-                                uid_t *uid,
-                                gid_t *gid,
-                                pid_t *pid,
-                                unsigned long long *timestamp)
+static int
+virNetSocketReadUNIXIdentity(virNetSocketPtr sock,
+                             uid_t *uid,
+                             gid_t *gid,
+                             pid_t *pid,
+                             unsigned long long *timestamp)
 {
     struct xucred cr;
     socklen_t cr_len = sizeof(cr);
     int ret = -1;
 
-    virObjectLock(sock);
-
     cr.cr_ngroups = -1;
     if (getsockopt(sock->fd, VIR_SOL_PEERCRED, LOCAL_PEERCRED, &cr, &cr_len) < 0) {
         virReportSystemError(errno, "%s",
@@ -1543,15 +1562,15 @@ int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
     ret = 0;
 
  cleanup:
-    virObjectUnlock(sock);
     return ret;
 }
 #else
-int virNetSocketGetUNIXIdentity(virNetSocketPtr sock ATTRIBUTE_UNUSED,
-                                uid_t *uid ATTRIBUTE_UNUSED,
-                                gid_t *gid ATTRIBUTE_UNUSED,
-                                pid_t *pid ATTRIBUTE_UNUSED,
-                                unsigned long long *timestamp ATTRIBUTE_UNUSED)
+static int
+virNetSocketReadUNIXIdentity(virNetSocketPtr sock ATTRIBUTE_UNUSED,
+                             uid_t *uid ATTRIBUTE_UNUSED,
+                             gid_t *gid ATTRIBUTE_UNUSED,
+                             pid_t *pid ATTRIBUTE_UNUSED,
+                             unsigned long long *timestamp ATTRIBUTE_UNUSED)
 {
     /* XXX Many more OS support UNIX socket credentials we could port to. See dbus ....*/
     virReportSystemError(ENOSYS, "%s",
@@ -1560,6 +1579,41 @@ int virNetSocketGetUNIXIdentity(virNetSocketPtr sock ATTRIBUTE_UNUSED,
 }
 #endif
 
+
+/*
+ * The credentials of the peer of a connected UNIX socket are those
+ * it had when connecting, so they are only looked up once.
+ */
+int virNetSocketGetUNIXIdentity(virNetSocketPtr sock,
+                                uid_t *uid,
+                                gid_t *gid,
+                                pid_t *pid,
+                                unsigned long long *timestamp)
+{
+    int ret = -1;
+
+    virObjectLock(sock);
+
+    if (!sock->peerIdentityValid) {
+        if (virNetSocketReadUNIXIdentity(sock,
+                                         &sock->peerUid, &sock->peerGid,
+                                         &sock->peerPid,
+                                         &sock->peerTimestamp) < 0)
+            goto cleanup;
+        sock->peerIdentityValid = true;
+    }
+
+    *uid = sock->peerUid;
+    *gid = sock->peerGid;
+    *pid = sock->peerPid;
+    *timestamp = sock->peerTimestamp;
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+
 #ifdef WITH_SELINUX
 int virNetSocketGetSELinuxContext(virNetSocketPtr sock,
                                   char **context)
@@ -1650,10 +1704,14 @@ void virNetSocketSetTLSSession(virNetSocketPtr sock,
     virObjectLock(sock);
     virObjectUnref(sock->tlsSession);
     sock->tlsSession = virObjectRef(sess);
-    virNetTLSSessionSetIOCallbacks(sess,
-                                   virNetSocketTLSSessionWrite,
-                                   virNetSocketTLSSessionRead,
-                                   sock);
+    /* Kernel TLS offload is only possible on TCP sockets */
+    if ((VIR_SOCKET_ADDR_FAMILY(&sock->localAddr) != AF_INET &&
+         VIR_SOCKET_ADDR_FAMILY(&sock->localAddr) != AF_INET6) ||
+        !virNetTLSSessionSetFD(sess, sock->fd))
+        virNetTLSSessionSetIOCallbacks(sess,
+                                       virNetSocketTLSSessionWrite,
+                                       virNetSocketTLSSessionRead,
+                                       sock);
     virObjectUnlock(sock);
 }
 #endif
@@ -1662,9 +1720,19 @@ void virNetSocketSetTLSSession(virNetSocketPtr sock,
 void virNetSocketSetSASLSession(virNetSocketPtr sock,
                                 virNetSASLSessionPtr sess)
 {
+    int ssf;
+
     virObjectLock(sock);
     virObjectUnref(sock->saslSession);
     sock->saslSession = virObjectRef(sess);
+
+    /* When TLS or a local socket already protects the data, SASL
+     * is only used for authentication and has no security layer,
+     * so passing the data through it would merely copy it around */
+    if ((ssf = virNetSASLSessionGetKeySize(sess)) < 0)
+        virResetLastError();
+    sock->saslLayer = ssf != 0;
+    VIR_DEBUG("sock=%p ssf=%d saslLayer=%d", sock, ssf, sock->saslLayer);
     virObjectUnlock(sock);
 }
 #endif
@@ -1866,24 +1934,25 @@ static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 
     /* Need to read some more data off the wire */
     if (sock->saslDecoded == NULL) {
-        ssize_t encodedLen = virNetSASLSessionGetMaxBufSize(sock->saslSession);
-        char *encoded;
-        if (VIR_ALLOC_N(encoded, encodedLen) < 0)
-            return -1;
-        encodedLen = virNetSocketReadWire(sock, encoded, encodedLen);
+        ssize_t encodedLen;
 
-        if (encodedLen <= 0) {
-            VIR_FREE(encoded);
-            return encodedLen;
+        /* The buffer is kept as the negotiated size can be large */
+        if (!sock->saslReadBuf) {
+            sock->saslReadBufLength = virNetSASLSessionGetMaxBufSize(sock->saslSession);
+            if (VIR_ALLOC_N(sock->saslReadBuf, sock->saslReadBufLength) < 0)
+                return -1;
         }
 
+        encodedLen = virNetSocketReadWire(sock, sock->saslReadBuf,
+                                          sock->saslReadBufLength);
+
+        if (encodedLen <= 0)
+            return encodedLen;
+
         if (virNetSASLSessionDecode(sock->saslSession,
-                                    encoded, encodedLen,
-                                    &sock->saslDecoded, &sock->saslDecodedLength) < 0) {
-            VIR_FREE(encoded);
+                                    sock->saslReadBuf, encodedLen,
+                                    &sock->saslDecoded, &sock->saslDecodedLength) < 0)
             return -1;
-        }
-        VIR_FREE(encoded);
 
         sock->saslDecodedOffset = 0;
     }
@@ -1906,25 +1975,46 @@ static ssize_t virNetSocketReadSASL(virNetSocketPtr sock, char *buf, size_t len)
 }
 
 
-static ssize_t virNetSocketWriteSASL(virNetSocketPtr sock, const char *buf, size_t len)
+/*
+ * Encode as much of @iov as fits in a single SASL block, which
+ * saves per block overhead when writing many small messages.
+ */
+static ssize_t virNetSocketWriteSASLv(virNetSocketPtr sock,
+                                      const struct iovec *iov,
+                                      int iovcnt)
 {
     int ret;
     size_t tosend = virNetSASLSessionGetMaxBufSize(sock->saslSession);
 
-    /* SASL doesn't necessarily let us send the whole
-       buffer at once */
-    if (tosend > len)
-        tosend = len;
-
     /* Not got any pending encoded data, so we need to encode raw stuff */
     if (sock->saslEncoded == NULL) {
-        if (virNetSASLSessionEncode(sock->saslSession,
-                                    buf, tosend,
-                                    &sock->saslEncoded,
-                                    &sock->saslEncodedLength) < 0)
+        struct iovec blockiov[VIR_NET_SOCKET_SASL_IOV_MAX];
+        size_t nblockiov = 0;
+        size_t rawlen = 0;
+        int i;
+
+        /* SASL doesn't necessarily let us send the whole
+           buffer at once */
+        for (i = 0;
+             i < iovcnt && nblockiov < ARRAY_CARDINALITY(blockiov) &&
+             rawlen < tosend;
+             i++) {
+            if (!iov[i].iov_len)
+                continue;
+            blockiov[nblockiov] = iov[i];
+            if (blockiov[nblockiov].iov_len > tosend - rawlen)
+                blockiov[nblockiov].iov_len = tosend - rawlen;
+            rawlen += blockiov[nblockiov].iov_len;
+            nblockiov++;
+        }
+
+        if (virNetSASLSessionEncodev(sock->saslSession,
+                                     blockiov, nblockiov,
+                                     &sock->saslEncoded,
+                                     &sock->saslEncodedLength) < 0)
             return -1;
 
-        sock->saslEncodedRawLength = tosend;
+        sock->saslEncodedRawLength = rawlen;
         sock->saslEncodedOffset = 0;
     }
 
@@ -1964,6 +2054,14 @@ static ssize_t virNetSocketWriteSASL(virNetSocketPtr sock, const char *buf, size
         return 0;
     }
 }
+
+
+static ssize_t virNetSocketWriteSASL(virNetSocketPtr sock, const char *buf, size_t len)
+{
+    struct iovec iov = { (char *)buf, len };
+
+    return virNetSocketWriteSASLv(sock, &iov, 1);
+}
 #endif
 
 ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len)
@@ -1971,7 +2069,7 @@ ssize_t virNetSocketRead(virNetSocketPtr sock, char *buf, size_t len)
     ssize_t ret;
     virObjectLock(sock);
 #if WITH_SASL
-    if (sock->saslSession)
+    if (sock->saslSession && sock->saslLayer)
         ret = virNetSocketReadSASL(sock, buf, len);
     else
 #endif
@@ -1986,7 +2084,7 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 
     virObjectLock(sock);
 #if WITH_SASL
-    if (sock->saslSession)
+    if (sock->saslSession && sock->saslLayer)
         ret = virNetSocketWriteSASL(sock, buf, len);
     else
 #endif
@@ -1996,6 +2094,101 @@ ssize_t virNetSocketWrite(virNetSocketPtr sock, const char *buf, size_t len)
 }
 
 
+/*
+ * Whether data written to the socket has to pass through a session
+ * layer (TLS, SASL or SSH) instead of going straight to the FD.
+ */
+static bool virNetSocketHasSession(virNetSocketPtr sock ATTRIBUTE_UNUSED)
+{
+#if WITH_GNUTLS
+    if (sock->tlsSession)
+        return true;
+#endif
+#if WITH_SASL
+    if (sock->saslSession && sock->saslLayer)
+        return true;
+#endif
+#if WITH_SSH2
+    if (sock->sshSession)
+        return true;
+#endif
+#if WITH_LIBSSH
+    if (sock->libsshSession)
+        return true;
+#endif
+    return false;
+}
+
+
+/*
+ * Write out the data described by @iov with a single system call,
+ * avoiding the need for callers to coalesce separate buffers. When
+ * a session layer is active on the socket the data has to be
+ * encoded first. A SASL layer encodes as much of @iov as it can in
+ * one block; other layers only write the first non-empty element,
+ * which has the same semantics as virNetSocketWrite.
+ *
+ * Returns the number of bytes written, 0 on EAGAIN and -1 on error
+ */
+ssize_t virNetSocketWritev(virNetSocketPtr sock,
+                           const struct iovec *iov,
+                           int iovcnt)
+{
+    ssize_t ret;
+    int i;
+
+    virObjectLock(sock);
+
+#ifndef WIN32
+    if (!virNetSocketHasSession(sock)) {
+ rewrite:
+        ret = writev(sock->fd, iov, iovcnt);
+
+        if (ret < 0) {
+            if (errno == EINTR)
+                goto rewrite;
+            if (errno == EAGAIN) {
+                ret = 0;
+                goto cleanup;
+            }
+
+            virReportSystemError(errno, "%s",
+                                 _("Cannot write data"));
+            ret = -1;
+            goto cleanup;
+        }
+        if (ret == 0) {
+            virReportSystemError(EIO, "%s",
+                                 _("End of file while writing data"));
+            ret = -1;
+        }
+        goto cleanup;
+    }
+#endif /* !WIN32 */
+
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].iov_len)
+            break;
+    }
+
+    if (i == iovcnt) {
+        ret = 0;
+        goto cleanup;
+    }
+
+#if WITH_SASL
+    if (sock->saslSession && sock->saslLayer)
+        ret = virNetSocketWriteSASLv(sock, iov + i, iovcnt - i);
+    else
+#endif
+        ret = virNetSocketWriteWire(sock, iov[i].iov_base, iov[i].iov_len);
+
+ cleanup:
+    virObjectUnlock(sock);
+    return ret;
+}
+
+
 /*
  * Returns 1 if an FD was sent, 0 if it would block, -1 on error
  */
@@ -2161,6 +2354,28 @@ static void virNetSocketEventFree(void *opaque)
     virObjectUnref(sock);
 }
 
+/**
+ * virNetSocketSetEventLoop:
+ * @sock: the socket
+ * @loop: the event loop to watch @sock from, or NULL
+ *
+ * Make the IO callback of @sock run from @loop instead of the
+ * default event loop. Must be called before the IO callback is
+ * registered.
+ */
+void virNetSocketSetEventLoop(virNetSocketPtr sock,
+                              virEventPollLoopPtr loop)
+{
+    virObjectLock(sock);
+    if (sock->watch >= 0) {
+        VIR_WARN("Watch already registered on socket %p", sock);
+    } else {
+        virObjectUnref(sock->loop);
+        sock->loop = virObjectRef(loop);
+    }
+    virObjectUnlock(sock);
+}
+
 int virNetSocketAddIOCallback(virNetSocketPtr sock,
                               int events,
                               virNetSocketIOFunc func,
@@ -2176,11 +2391,20 @@ int virNetSocketAddIOCallback(virNetSocketPtr sock,
         goto cleanup;
     }
 
-    if ((sock->watch = virEventAddHandle(sock->fd,
-                                         events,
-                                         virNetSocketEventHandle,
-                                         sock,
-                                         virNetSocketEventFree)) < 0) {
+    if (sock->loop)
+        sock->watch = virEventPollLoopAddHandle(sock->loop,
+                                                sock->fd,
+                                                events,
+                                                virNetSocketEventHandle,
+                                                sock,
+                                                virNetSocketEventFree);
+    else
+        sock->watch = virEventAddHandle(sock->fd,
+                                        events,
+                                        virNetSocketEventHandle,
+                                        sock,
+                                        virNetSocketEventFree);
+    if (sock->watch < 0) {
         VIR_DEBUG("Failed to register watch on socket %p", sock);
         goto cleanup;
     }
@@ -2207,7 +2431,10 @@ void virNetSocketUpdateIOCallback(virNetSocketPtr sock,
         return;
     }
 
-    virEventUpdateHandle(sock->watch, events);
+    if (sock->loop)
+        virEventPollLoopUpdateHandle(sock->loop, sock->watch, events);
+    else
+        virEventUpdateHandle(sock->watch, events);
 
     virObjectUnlock(sock);
 }
@@ -2222,7 +2449,10 @@ void virNetSocketRemoveIOCallback(virNetSocketPtr sock)
         return;
     }
 
-    virEventRemoveHandle(sock->watch);
+    if (sock->loop)
+        virEventPollLoopRemoveHandle(sock->loop, sock->watch);
+    else
+        virEventRemoveHandle(sock->watch);
     /* Don't unref @sock, it's done via eventloop callback. */
     sock->watch = -1;
 
@@ -29,6 +29,7 @@
 
 #include "virnettlscontext.h"
 #include "virstring.h"
+#include "virhash.h"
 
 #include "viralloc.h"
 #include "virerror.h"
@@ -41,6 +42,15 @@
 
 #define DH_BITS 2048
 
+/* Number of servers a client remembers sessions to resume for */
+#define VIR_NET_TLS_SESSION_CACHE_MAX 64
+
+/* GnuTLS can hand record encryption over to the kernel once the
+ * handshake is done, if the system configuration enables it */
+#if HAVE_GNUTLS_TRANSPORT_IS_KTLS_ENABLED
+# define VIR_NET_TLS_KTLS 1
+#endif
+
 #define LIBVIRT_PKI_DIR SYSCONFDIR "/pki"
 #define LIBVIRT_CACERT LIBVIRT_PKI_DIR "/CA/cacert.pem"
 #define LIBVIRT_CACRL LIBVIRT_PKI_DIR "/CA/cacrl.pem"
@@ -63,6 +73,11 @@ struct _virNetTLSContext {
     bool requireValidCert;
     const char *const*x509dnWhitelist;
     char *priority;
+
+    /* Server: key of the session tickets handed out to clients */
+    gnutls_datum_t ticketKey;
+    /* Client: identifies the credentials in the session cache */
+    char *cacheKey;
 };
 
 struct _virNetTLSSession {
@@ -77,6 +92,11 @@ struct _virNetTLSSession {
     virNetTLSSessionReadFunc readFunc;
     void *opaque;
     char *x509dname;
+
+    /* Client: key of the session in the session cache, and whether
+     * the peer certificate was accepted, allowing to cache it */
+    char *cacheKey;
+    bool certChecked;
 };
 
 static virClassPtr virNetTLSContextClass;
@@ -84,6 +104,28 @@ static virClassPtr virNetTLSSessionClass;
 static void virNetTLSContextDispose(void *obj);
 static void virNetTLSSessionDispose(void *obj);
 
+/*
+ * Data of the last session to each server, which lets clients
+ * resume it instead of going through a full handshake when
+ * reconnecting. Keyed by the credentials and the server hostname.
+ */
+static virHashTablePtr virNetTLSSessionCache;
+static virMutex virNetTLSSessionCacheLock;
+
+
+static void
+virNetTLSSessionCacheDataFree(void *payload,
+                              const void *name ATTRIBUTE_UNUSED)
+{
+    gnutls_datum_t *data = payload;
+
+    if (!data)
+        return;
+
+    gnutls_free(data->data);
+    VIR_FREE(data);
+}
+
 
 static int virNetTLSContextOnceInit(void)
 {
@@ -93,6 +135,17 @@ static int virNetTLSContextOnceInit(void)
     if (!VIR_CLASS_NEW(virNetTLSSession, virClassForObjectLockable()))
         return -1;
 
+    if (virMutexInit(&virNetTLSSessionCacheLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize mutex"));
+        return -1;
+    }
+
+    if (!(virNetTLSSessionCache =
+          virHashCreate(VIR_NET_TLS_SESSION_CACHE_MAX,
+                        virNetTLSSessionCacheDataFree)))
+        return -1;
+
     return 0;
 }
 
@@ -743,6 +796,20 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
 
         gnutls_certificate_set_dh_params(ctxt->x509cred,
                                          ctxt->dhParams);
+
+        /* Session tickets let clients resume their sessions without
+         * the server keeping any state about them */
+        err = gnutls_session_ticket_key_generate(&ctxt->ticketKey);
+        if (err < 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Unable to generate session ticket key: %s"),
+                           gnutls_strerror(err));
+            goto error;
+        }
+    } else {
+        if (virAsprintf(&ctxt->cacheKey, "%s\n%s",
+                        cacert, NULLSTR(cert)) < 0)
+            goto error;
     }
 
     ctxt->requireValidCert = requireValidCert;
@@ -756,10 +823,7 @@ static virNetTLSContextPtr virNetTLSContextNew(const char *cacert,
     return ctxt;
 
  error:
-    if (isServer)
-        gnutls_dh_params_deinit(ctxt->dhParams);
-    gnutls_certificate_free_credentials(ctxt->x509cred);
-    VIR_FREE(ctxt);
+    virObjectUnref(ctxt);
     return NULL;
 }
 
@@ -1123,6 +1187,7 @@ int virNetTLSContextCheckCertificate(virNetTLSContextPtr ctxt,
         VIR_INFO("Ignoring bad certificate at user request");
     }
 
+    sess->certChecked = true;
     ret = 0;
 
  cleanup:
@@ -1140,8 +1205,15 @@ void virNetTLSContextDispose(void *obj)
           "ctxt=%p", ctxt);
 
     VIR_FREE(ctxt->priority);
-    gnutls_dh_params_deinit(ctxt->dhParams);
-    gnutls_certificate_free_credentials(ctxt->x509cred);
+    VIR_FREE(ctxt->cacheKey);
+    if (ctxt->ticketKey.data) {
+        memset(ctxt->ticketKey.data, 0, ctxt->ticketKey.size);
+        gnutls_free(ctxt->ticketKey.data);
+    }
+    if (ctxt->dhParams)
+        gnutls_dh_params_deinit(ctxt->dhParams);
+    if (ctxt->x509cred)
+        gnutls_certificate_free_credentials(ctxt->x509cred);
 }
 
 
@@ -1179,7 +1251,6 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
     virNetTLSSessionPtr sess;
     int err;
     const char *priority;
-
     VIR_DEBUG("ctxt=%p hostname=%s isServer=%d",
               ctxt, NULLSTR(hostname), ctxt->isServer);
 
@@ -1226,13 +1297,31 @@ virNetTLSSessionPtr virNetTLSSessionNew(virNetTLSContextPtr ctxt,
         gnutls_certificate_server_set_request(sess->session, GNUTLS_CERT_REQUEST);
 
         gnutls_dh_set_prime_bits(sess->session, DH_BITS);
-    }
 
-    gnutls_transport_set_ptr(sess->session, sess);
-    gnutls_transport_set_push_function(sess->session,
-                                       virNetTLSSessionPush);
-    gnutls_transport_set_pull_function(sess->session,
-                                       virNetTLSSessionPull);
+        if ((err = gnutls_session_ticket_enable_server(sess->session,
+                                                       &ctxt->ticketKey)) != 0) {
+            virReportError(VIR_ERR_SYSTEM_ERROR,
+                           _("Failed to enable TLS session tickets: %s"),
+                           gnutls_strerror(err));
+            goto error;
+        }
+    } else if (hostname) {
+        gnutls_datum_t *data;
+
+        if (virAsprintf(&sess->cacheKey, "%s\n%s",
+                        ctxt->cacheKey, hostname) < 0)
+            goto error;
+
+        /* A session the server does not know anymore simply
+         * falls back to a full handshake */
+        virMutexLock(&virNetTLSSessionCacheLock);
+        if ((data = virHashLookup(virNetTLSSessionCache, sess->cacheKey))) {
+            VIR_DEBUG("Trying to resume session to %s", hostname);
+            ignore_value(gnutls_session_set_data(sess->session,
+                                                 data->data, data->size));
+        }
+        virMutexUnlock(&virNetTLSSessionCacheLock);
+    }
 
     sess->isServer = ctxt->isServer;
 
@@ -1257,7 +1346,34 @@ void virNetTLSSessionSetIOCallbacks(virNetTLSSessionPtr sess,
     sess->writeFunc = writeFunc;
     sess->readFunc = readFunc;
     sess->opaque = opaque;
+    gnutls_transport_set_ptr(sess->session, sess);
+    gnutls_transport_set_push_function(sess->session,
+                                       virNetTLSSessionPush);
+    gnutls_transport_set_pull_function(sess->session,
+                                       virNetTLSSessionPull);
+    virObjectUnlock(sess);
+}
+
+
+/*
+ * Let GnuTLS do the I/O of @sess on the socket @fd itself, instead
+ * of going through I/O callbacks. This is what allows it to offload
+ * record encryption to the kernel once the handshake is complete.
+ *
+ * Returns true if @sess uses @fd, or false if kernel offload is not
+ * available and the I/O callbacks must be set instead.
+ */
+bool virNetTLSSessionSetFD(virNetTLSSessionPtr sess ATTRIBUTE_UNUSED,
+                           int fd ATTRIBUTE_UNUSED)
+{
+#ifdef VIR_NET_TLS_KTLS
+    virObjectLock(sess);
+    gnutls_transport_set_int(sess->session, fd);
     virObjectUnlock(sess);
+    return true;
+#else
+    return false;
+#endif
 }
 
 
@@ -1333,7 +1449,12 @@ int virNetTLSSessionHandshake(virNetTLSSessionPtr sess)
     VIR_DEBUG("Ret=%d", ret);
     if (ret == 0) {
         sess->handshakeComplete = true;
-        VIR_DEBUG("Handshake is complete");
+        VIR_DEBUG("Handshake is complete, resumed=%d",
+                  gnutls_session_is_resumed(sess->session));
+#ifdef VIR_NET_TLS_KTLS
+        VIR_DEBUG("Kernel TLS offload=%d",
+                  gnutls_transport_is_ktls_enabled(sess->session));
+#endif
         goto cleanup;
     }
     if (ret == GNUTLS_E_INTERRUPTED || ret == GNUTLS_E_AGAIN) {
@@ -1402,6 +1523,31 @@ const char *virNetTLSSessionGetX509DName(virNetTLSSessionPtr sess)
     return ret;
 }
 
+static void
+virNetTLSSessionCacheStore(virNetTLSSessionPtr sess)
+{
+    gnutls_datum_t *data;
+
+    if (VIR_ALLOC_QUIET(data) < 0)
+        return;
+
+    if (gnutls_session_get_data2(sess->session, data) < 0) {
+        VIR_FREE(data);
+        return;
+    }
+
+    virMutexLock(&virNetTLSSessionCacheLock);
+    if (virHashSize(virNetTLSSessionCache) >= VIR_NET_TLS_SESSION_CACHE_MAX &&
+        !virHashLookup(virNetTLSSessionCache, sess->cacheKey)) {
+        virNetTLSSessionCacheDataFree(data, NULL);
+    } else if (virHashUpdateEntry(virNetTLSSessionCache,
+                                  sess->cacheKey, data) < 0) {
+        virNetTLSSessionCacheDataFree(data, NULL);
+        virResetLastError();
+    }
+    virMutexUnlock(&virNetTLSSessionCacheLock);
+}
+
 void virNetTLSSessionDispose(void *obj)
 {
     virNetTLSSessionPtr sess = obj;
@@ -1409,6 +1555,12 @@ void virNetTLSSessionDispose(void *obj)
     PROBE(RPC_TLS_SESSION_DISPOSE,
           "sess=%p", sess);
 
+    /* Remember the session for the next connection to the server,
+     * by now including any ticket the server sent after the handshake */
+    if (sess->cacheKey && sess->handshakeComplete && sess->certChecked)
+        virNetTLSSessionCacheStore(sess);
+
+    VIR_FREE(sess->cacheKey);
     VIR_FREE(sess->x509dname);
     VIR_FREE(sess->hostname);
     gnutls_deinit(sess->session);
@@ -80,6 +80,9 @@ void virNetTLSSessionSetIOCallbacks(virNetTLSSessionPtr sess,
                                     virNetTLSSessionReadFunc readFunc,
                                     void *opaque);
 
+bool virNetTLSSessionSetFD(virNetTLSSessionPtr sess,
+                           int fd);
+
 ssize_t virNetTLSSessionWrite(virNetTLSSessionPtr sess,
                               const char *buf, size_t len);
 ssize_t virNetTLSSessionRead(virNetTLSSessionPtr sess,
@@ -51,6 +51,8 @@
 #include "virstring.h"
 #include "virscsi.h"
 #include "virmdev.h"
+#include "vircrypto.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -60,6 +62,15 @@ VIR_LOG_INIT("security.security_apparmor");
 #define SECURITY_APPARMOR_NAME          "apparmor"
 #define VIRT_AA_HELPER LIBEXECDIR "/virt-aa-helper"
 
+typedef struct _virSecurityAppArmorData virSecurityAppArmorData;
+typedef virSecurityAppArmorData *virSecurityAppArmorDataPtr;
+
+struct _virSecurityAppArmorData {
+    /* profile name -> checksum of the virt-aa-helper input that
+     * produced the currently loaded profile */
+    virHashTablePtr profiles;
+};
+
 /* Data structure to pass to *FileIterate so we have everything we need */
 struct SDPDOP {
     virSecurityManagerPtr mgr;
@@ -165,19 +176,48 @@ profile_status_file(const char *str)
     return rc;
 }
 
+/*
+ * Loading a profile compiles it by apparmor_parser, which is slow. The
+ * profile only depends on the domain definition and the file being added,
+ * so virt-aa-helper is skipped if it was last run for @profile with the
+ * same input. Returns the checksum of the input for load_profile to
+ * remember once the profile is loaded, or NULL on error.
+ */
+static char *
+load_profile_checksum(const char *xml,
+                      bool create,
+                      const char *fn,
+                      bool append)
+{
+    char *input = NULL;
+    char *checksum = NULL;
+
+    if (virAsprintf(&input, "%s\n%s\n%s", create ? "c" : append ? "F" : "f",
+                    fn ? fn : "", xml) < 0)
+        return NULL;
+
+    ignore_value(virCryptoHashString(VIR_CRYPTO_HASH_SHA256, input,
+                                     &checksum));
+    VIR_FREE(input);
+    return checksum;
+}
+
 /*
  * load (add) a profile. Will create one if necessary
  */
 static int
-load_profile(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+load_profile(virSecurityManagerPtr mgr,
              const char *profile,
              virDomainDefPtr def,
              const char *fn,
              bool append)
 {
+    virSecurityAppArmorDataPtr data = virSecurityManagerGetPrivateData(mgr);
     int rc = -1;
     bool create = true;
     char *xml = NULL;
+    char *checksum = NULL;
+    const char *loaded;
     virCommandPtr cmd = NULL;
 
     xml = virDomainDefFormat(def, NULL, VIR_DOMAIN_DEF_FORMAT_SECURE);
@@ -187,6 +227,17 @@ load_profile(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
     if (profile_status_file(profile) >= 0)
         create = false;
 
+    if (!(checksum = load_profile_checksum(xml, create, fn, append)))
+        goto cleanup;
+
+    if (!create &&
+        (loaded = virHashLookup(data->profiles, profile)) &&
+        STREQ(loaded, checksum)) {
+        VIR_DEBUG("profile '%s' is up to date", profile);
+        rc = 0;
+        goto cleanup;
+    }
+
     cmd = virCommandNewArgList(VIRT_AA_HELPER,
                                create ? "-c" : "-r",
                                "-u", profile, NULL);
@@ -203,10 +254,19 @@ load_profile(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
                            virLogGetDefaultPriority());
 
     virCommandSetInputBuffer(cmd, xml);
-    rc = virCommandRun(cmd, NULL);
+    if ((rc = virCommandRun(cmd, NULL)) < 0) {
+        virHashRemoveEntry(data->profiles, profile);
+        goto cleanup;
+    }
+
+    if (virHashUpdateEntry(data->profiles, profile, checksum) < 0)
+        virHashRemoveEntry(data->profiles, profile);
+    else
+        checksum = NULL;
 
  cleanup:
     VIR_FREE(xml);
+    VIR_FREE(checksum);
     virCommandFree(cmd);
 
     return rc;
@@ -391,14 +451,24 @@ AppArmorSecurityManagerProbe(const char *virtDriver ATTRIBUTE_UNUSED)
  * currently not used.
  */
 static int
-AppArmorSecurityManagerOpen(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED)
+AppArmorSecurityManagerOpen(virSecurityManagerPtr mgr)
 {
+    virSecurityAppArmorDataPtr data = virSecurityManagerGetPrivateData(mgr);
+
+    if (!(data->profiles = virHashCreate(32, virHashValueFree)))
+        return -1;
+
     return 0;
 }
 
 static int
-AppArmorSecurityManagerClose(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED)
+AppArmorSecurityManagerClose(virSecurityManagerPtr mgr)
 {
+    virSecurityAppArmorDataPtr data = virSecurityManagerGetPrivateData(mgr);
+
+    if (data)
+        virHashFree(data->profiles);
+
     return 0;
 }
 
@@ -564,7 +634,7 @@ AppArmorReleaseSecurityLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
 
 
 static int
-AppArmorRestoreSecurityAllLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
+AppArmorRestoreSecurityAllLabel(virSecurityManagerPtr mgr,
                                 virDomainDefPtr def,
                                 bool migrated ATTRIBUTE_UNUSED,
                                 bool chardevStdioLogd ATTRIBUTE_UNUSED)
@@ -577,6 +647,9 @@ AppArmorRestoreSecurityAllLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
         return 0;
 
     if (secdef->type == VIR_DOMAIN_SECLABEL_DYNAMIC) {
+        virSecurityAppArmorDataPtr data = virSecurityManagerGetPrivateData(mgr);
+
+        virHashRemoveEntry(data->profiles, secdef->label);
         if ((rc = remove_profile(secdef->label)) != 0) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("could not remove profile for \'%s\'"),
@@ -1183,7 +1256,7 @@ AppArmorGetBaseLabel(virSecurityManagerPtr mgr ATTRIBUTE_UNUSED,
 }
 
 virSecurityDriver virAppArmorSecurityDriver = {
-    .privateDataLen                     = 0,
+    .privateDataLen                     = sizeof(virSecurityAppArmorData),
     .name                               = SECURITY_APPARMOR_NAME,
     .probe                              = AppArmorSecurityManagerProbe,
     .open                               = AppArmorSecurityManagerOpen,
@@ -186,6 +186,45 @@ static int virSecurityDACSetOwnership(virSecurityManagerPtr mgr,
 static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
                                                   const virStorageSource *src,
                                                   const char *path);
+
+
+static int
+virSecurityDACTransactionRunItem(size_t idx,
+                                 void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr item = list->items[idx];
+
+    /* TODO Implement rollback */
+    if (!item->restore) {
+        return virSecurityDACSetOwnership(list->manager,
+                                          item->src,
+                                          item->path,
+                                          item->uid,
+                                          item->gid);
+    }
+
+    return virSecurityDACRestoreFileLabelInternal(list->manager,
+                                                  item->src,
+                                                  item->path);
+}
+
+
+static bool
+virSecurityDACTransactionItemEqual(size_t a,
+                                   size_t b,
+                                   void *opaque)
+{
+    virSecurityDACChownListPtr list = opaque;
+    virSecurityDACChownItemPtr itemA = list->items[a];
+    virSecurityDACChownItemPtr itemB = list->items[b];
+
+    return itemA->restore == itemB->restore &&
+           itemA->uid == itemB->uid &&
+           itemA->gid == itemB->gid;
+}
+
+
 /**
  * virSecurityDACTransactionRun:
  * @pid: process pid
@@ -194,7 +233,9 @@ static int virSecurityDACRestoreFileLabelInternal(virSecurityManagerPtr mgr,
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
  * the list. Depending on security manager configuration it might lock paths
- * we will relabel.
+ * we will relabel. Distinct paths are relabelled in parallel and repeated
+ * requests for the same path, such as backing images shared by several
+ * disks, are done only once, see virSecurityManagerTransactionRunItems().
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -205,17 +246,21 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
 {
     virSecurityDACChownListPtr list = opaque;
     const char **paths = NULL;
+    const char **keys = NULL;
     size_t npaths = 0;
     size_t i;
     int rv = 0;
     int ret = -1;
 
-    if (VIR_ALLOC_N(paths, list->nItems) < 0)
-        return -1;
+    if (VIR_ALLOC_N(paths, list->nItems) < 0 ||
+        VIR_ALLOC_N(keys, list->nItems) < 0)
+        goto cleanup;
 
     for (i = 0; i < list->nItems; i++) {
         const char *p = list->items[i]->path;
 
+        keys[i] = p;
+
         if (!p ||
             virFileIsDir(p))
             continue;
@@ -226,25 +271,10 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
     if (virSecurityManagerMetadataLock(list->manager, paths, npaths) < 0)
         goto cleanup;
 
-    for (i = 0; i < list->nItems; i++) {
-        virSecurityDACChownItemPtr item = list->items[i];
-
-        /* TODO Implement rollback */
-        if (!item->restore) {
-            rv = virSecurityDACSetOwnership(list->manager,
-                                            item->src,
-                                            item->path,
-                                            item->uid,
-                                            item->gid);
-        } else {
-            rv = virSecurityDACRestoreFileLabelInternal(list->manager,
-                                                        item->src,
-                                                        item->path);
-        }
-
-        if (rv < 0)
-            break;
-    }
+    rv = virSecurityManagerTransactionRunItems(list->nItems, keys,
+                                               virSecurityDACTransactionItemEqual,
+                                               virSecurityDACTransactionRunItem,
+                                               list);
 
     if (virSecurityManagerMetadataUnlock(list->manager, paths, npaths) < 0)
         goto cleanup;
@@ -254,6 +284,7 @@ virSecurityDACTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
 
     ret = 0;
  cleanup:
+    VIR_FREE(keys);
     VIR_FREE(paths);
     return ret;
 }
@@ -31,6 +31,11 @@
 #include "locking/lock_manager.h"
 #include "virfile.h"
 #include "virtime.h"
+#include "virhash.h"
+#include "viratomic.h"
+#include "virthread.h"
+#include "virthreadpool.h"
+#include "virprobe.h"
 
 #define VIR_FROM_THIS VIR_FROM_SECURITY
 
@@ -474,7 +479,13 @@ virSecurityManagerRestoreImageLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainRestoreSecurityImageLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "restore-image", vm->name,
+                    EMPTYSTR(src->path));
         ret = mgr->drv->domainRestoreSecurityImageLabel(mgr, vm, src);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "restore-image", vm->name,
+                    EMPTYSTR(src->path), ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -582,7 +593,13 @@ virSecurityManagerSetImageLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainSetSecurityImageLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "set-image", vm->name,
+                    EMPTYSTR(src->path));
         ret = mgr->drv->domainSetSecurityImageLabel(mgr, vm, src);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "set-image", vm->name,
+                    EMPTYSTR(src->path), ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -601,7 +618,13 @@ virSecurityManagerRestoreHostdevLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainRestoreSecurityHostdevLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "restore-hostdev", vm->name,
+                    EMPTYSTR(vroot));
         ret = mgr->drv->domainRestoreSecurityHostdevLabel(mgr, vm, dev, vroot);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "restore-hostdev", vm->name,
+                    EMPTYSTR(vroot), ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -620,7 +643,13 @@ virSecurityManagerSetHostdevLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainSetSecurityHostdevLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "set-hostdev", vm->name,
+                    EMPTYSTR(vroot));
         ret = mgr->drv->domainSetSecurityHostdevLabel(mgr, vm, dev, vroot);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "set-hostdev", vm->name,
+                    EMPTYSTR(vroot), ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -897,8 +926,14 @@ virSecurityManagerSetAllLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainSetSecurityAllLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "set-all", vm->name,
+                    EMPTYSTR(stdin_path));
         ret = mgr->drv->domainSetSecurityAllLabel(mgr, vm, stdin_path,
                                                   chardevStdioLogd);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "set-all", vm->name,
+                    EMPTYSTR(stdin_path), ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -917,8 +952,14 @@ virSecurityManagerRestoreAllLabel(virSecurityManagerPtr mgr,
     if (mgr->drv->domainRestoreSecurityAllLabel) {
         int ret;
         virObjectLock(mgr);
+        PROBE_QUIET(SECURITY_LABEL_BEGIN, "driver=%s op=%s name=%s path=%s",
+                    mgr->drv->name, "restore-all", vm->name,
+                    "-");
         ret = mgr->drv->domainRestoreSecurityAllLabel(mgr, vm, migrated,
                                                       chardevStdioLogd);
+        PROBE_QUIET(SECURITY_LABEL_END, "driver=%s op=%s name=%s path=%s ret=%d",
+                    mgr->drv->name, "restore-all", vm->name,
+                    "-", ret);
         virObjectUnlock(mgr);
         return ret;
     }
@@ -1402,3 +1443,148 @@ virSecurityManagerMetadataUnlock(virSecurityManagerPtr mgr,
     virMutexUnlock(&lockManagerMutex);
     return ret;
 }
+
+
+typedef struct _virSecurityManagerTransactionRun virSecurityManagerTransactionRun;
+struct _virSecurityManagerTransactionRun {
+    virSecurityManagerTransactionItemFunc func;
+    void *opaque;
+
+    /* items of group N are heads[N], next[heads[N]], ... */
+    size_t *heads;
+    size_t ngroups;
+    ssize_t *next;
+
+    int failed;
+};
+
+
+static int
+virSecurityManagerTransactionRunGroup(size_t group,
+                                      void *opaque)
+{
+    virSecurityManagerTransactionRun *run = opaque;
+    ssize_t i;
+
+    /* no more groups are started once one failed */
+    if (virAtomicIntGet(&run->failed))
+        return 0;
+
+    for (i = run->heads[group]; i >= 0; i = run->next[i]) {
+        if (run->func(i, run->opaque) < 0) {
+            virAtomicIntSet(&run->failed, 1);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * virSecurityManagerTransactionRunItems:
+ * @nitems: number of items in the transaction
+ * @paths: path each item relabels, may contain NULLs
+ * @equal: callback telling whether two items relabel the same way
+ * @func: callback relabelling one item
+ * @opaque: data passed to @func and @equal
+ *
+ * Helper for security drivers committing a transaction.  Items are
+ * grouped by their path: items of one group are relabelled one after
+ * another, in the order they were added, while distinct paths are
+ * relabelled in parallel, see virThreadParallelRun().  An item for
+ * which @equal reports it is the same as the item preceding it in its
+ * group, e.g. a backing image shared by several disks, is dropped.
+ * Items without a path are never grouped or dropped.
+ *
+ * Once @func fails no more groups are started and the error of the first
+ * failed group is reported.
+ *
+ * Returns 0 on success, -1 otherwise.
+ */
+int
+virSecurityManagerTransactionRunItems(size_t nitems,
+                                      const char * const *paths,
+                                      virSecurityManagerTransactionEqualFunc equal,
+                                      virSecurityManagerTransactionItemFunc func,
+                                      void *opaque)
+{
+    virSecurityManagerTransactionRun run = {
+        .func = func, .opaque = opaque,
+    };
+    virErrorPtr *errs = NULL;
+    virHashTablePtr tails = NULL;
+    size_t *tailsArr = NULL;
+    size_t ndropped = 0;
+    size_t i;
+    int ret = -1;
+
+    if (nitems == 0)
+        return 0;
+
+    if (VIR_ALLOC_N(run.heads, nitems) < 0 ||
+        VIR_ALLOC_N(run.next, nitems) < 0 ||
+        VIR_ALLOC_N(tailsArr, nitems) < 0 ||
+        !(tails = virHashCreate(nitems, NULL)))
+        goto cleanup;
+
+    for (i = 0; i < nitems; i++) {
+        /* group number + 1, so that a missing entry reads as 0 */
+        void *entry = paths[i] ? virHashLookup(tails, paths[i]) : NULL;
+        size_t group = (size_t) entry;
+
+        run.next[i] = -1;
+
+        if (group == 0) {
+            run.heads[run.ngroups] = i;
+            tailsArr[run.ngroups] = i;
+            run.ngroups++;
+
+            if (paths[i] &&
+                virHashAddEntry(tails, paths[i],
+                                (void *) run.ngroups) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        group--;
+        if (equal && equal(tailsArr[group], i, opaque)) {
+            ndropped++;
+            continue;
+        }
+
+        run.next[tailsArr[group]] = i;
+        tailsArr[group] = i;
+    }
+
+    VIR_DEBUG("Relabelling %zu paths (%zu items, %zu duplicates dropped)",
+              run.ngroups, nitems, ndropped);
+
+    if (VIR_ALLOC_N(errs, run.ngroups) < 0)
+        goto cleanup;
+
+    if (virThreadParallelRun(run.ngroups,
+                             virSecurityManagerTransactionRunGroup,
+                             &run, errs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < run.ngroups; i++) {
+        if (errs[i]) {
+            virSetError(errs[i]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    if (errs) {
+        for (i = 0; i < run.ngroups; i++)
+            virFreeError(errs[i]);
+    }
+    VIR_FREE(errs);
+    VIR_FREE(run.heads);
+    VIR_FREE(run.next);
+    VIR_FREE(tailsArr);
+    virHashFree(tails);
+    return ret;
+}
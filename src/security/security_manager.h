@@ -206,4 +206,16 @@ int virSecurityManagerMetadataUnlock(virSecurityManagerPtr mgr,
                                      const char * const *paths,
                                      size_t npaths);
 
+typedef int (*virSecurityManagerTransactionItemFunc)(size_t idx,
+                                                     void *opaque);
+typedef bool (*virSecurityManagerTransactionEqualFunc)(size_t a,
+                                                       size_t b,
+                                                       void *opaque);
+
+int virSecurityManagerTransactionRunItems(size_t nitems,
+                                          const char * const *paths,
+                                          virSecurityManagerTransactionEqualFunc equal,
+                                          virSecurityManagerTransactionItemFunc func,
+                                          void *opaque);
+
 #endif /* VIR_SECURITY_MANAGER_H__ */
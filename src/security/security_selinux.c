@@ -197,6 +197,43 @@ static int virSecuritySELinuxSetFileconHelper(const char *path,
                                               bool optional,
                                               bool privileged);
 
+
+typedef struct _virSecuritySELinuxTransactionRunData virSecuritySELinuxTransactionRunData;
+struct _virSecuritySELinuxTransactionRunData {
+    virSecuritySELinuxContextListPtr list;
+    bool privileged;
+};
+
+
+static int
+virSecuritySELinuxTransactionRunItem(size_t idx,
+                                     void *opaque)
+{
+    virSecuritySELinuxTransactionRunData *data = opaque;
+    virSecuritySELinuxContextItemPtr item = data->list->items[idx];
+
+    /* TODO Implement rollback */
+    return virSecuritySELinuxSetFileconHelper(item->path,
+                                              item->tcon,
+                                              item->optional,
+                                              data->privileged);
+}
+
+
+static bool
+virSecuritySELinuxTransactionItemEqual(size_t a,
+                                       size_t b,
+                                       void *opaque)
+{
+    virSecuritySELinuxTransactionRunData *data = opaque;
+    virSecuritySELinuxContextItemPtr itemA = data->list->items[a];
+    virSecuritySELinuxContextItemPtr itemB = data->list->items[b];
+
+    return itemA->optional == itemB->optional &&
+           STREQ(itemA->tcon, itemB->tcon);
+}
+
+
 /**
  * virSecuritySELinuxTransactionRun:
  * @pid: process pid
@@ -204,7 +241,9 @@ static int virSecuritySELinuxSetFileconHelper(const char *path,
  *
  * This is the callback that runs in the same namespace as the domain we are
  * relabelling. For given transaction (@opaque) it relabels all the paths on
- * the list.
+ * the list. Distinct paths are relabelled in parallel and repeated requests
+ * for the same path are done only once, see
+ * virSecurityManagerTransactionRunItems().
  *
  * Returns: 0 on success
  *         -1 otherwise.
@@ -214,19 +253,26 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
                                  void *opaque)
 {
     virSecuritySELinuxContextListPtr list = opaque;
-    bool privileged = virSecurityManagerGetPrivileged(list->manager);
+    virSecuritySELinuxTransactionRunData data = {
+        .list = list,
+        .privileged = virSecurityManagerGetPrivileged(list->manager),
+    };
     const char **paths = NULL;
+    const char **keys = NULL;
     size_t npaths = 0;
     size_t i;
     int rv;
     int ret = -1;
 
-    if (VIR_ALLOC_N(paths, list->nItems) < 0)
-        return -1;
+    if (VIR_ALLOC_N(paths, list->nItems) < 0 ||
+        VIR_ALLOC_N(keys, list->nItems) < 0)
+        goto cleanup;
 
     for (i = 0; i < list->nItems; i++) {
         const char *p = list->items[i]->path;
 
+        keys[i] = p;
+
         if (virFileIsDir(p))
             continue;
 
@@ -236,19 +282,10 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
     if (virSecurityManagerMetadataLock(list->manager, paths, npaths) < 0)
         goto cleanup;
 
-    rv = 0;
-    for (i = 0; i < list->nItems; i++) {
-        virSecuritySELinuxContextItemPtr item = list->items[i];
-
-        /* TODO Implement rollback */
-        if (virSecuritySELinuxSetFileconHelper(item->path,
-                                               item->tcon,
-                                               item->optional,
-                                               privileged) < 0) {
-            rv = -1;
-            break;
-        }
-    }
+    rv = virSecurityManagerTransactionRunItems(list->nItems, keys,
+                                               virSecuritySELinuxTransactionItemEqual,
+                                               virSecuritySELinuxTransactionRunItem,
+                                               &data);
 
     if (virSecurityManagerMetadataUnlock(list->manager, paths, npaths) < 0)
         goto cleanup;
@@ -258,6 +295,7 @@ virSecuritySELinuxTransactionRun(pid_t pid ATTRIBUTE_UNUSED,
 
     ret = 0;
  cleanup:
+    VIR_FREE(keys);
     VIR_FREE(paths);
     return ret;
 }
@@ -1187,6 +1225,19 @@ virSecuritySELinuxSetFileconImpl(const char *path, const char *tcon,
     /* Be aware that this function might run in a separate process.
      * Therefore, any driver state changes would be thrown away. */
 
+    /* Reading the label is much cheaper than writing it, especially
+     * on network filesystems, so don't rewrite a label that's already
+     * in place. */
+    if (getfilecon_raw(path, &econ) >= 0) {
+        bool same = STREQ(tcon, econ);
+
+        freecon(econ);
+        if (same) {
+            VIR_DEBUG("SELinux context on '%s' is already '%s'", path, tcon);
+            return 0;
+        }
+    }
+
     VIR_INFO("Setting SELinux context on '%s' to '%s'", path, tcon);
 
     if (setfilecon_raw(path, (VIR_SELINUX_CTX_CONST char *)tcon) < 0) {
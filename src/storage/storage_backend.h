@@ -106,6 +106,10 @@ struct _virStorageBackend {
     virStorageBackendStartPool startPool;
     virStorageBackendBuildPool buildPool;
     virStorageBackendRefreshPool refreshPool; /* Must be non-NULL */
+    /* refreshPool can keep the volumes found by the previous refresh,
+     * re-probing only those that changed, and the pool is a directory
+     * that can be watched for changes */
+    bool refreshIncremental;
     virStorageBackendStopPool stopPool;
     virStorageBackendDeletePool deletePool;
 
@@ -365,14 +365,14 @@ volStorageBackendRBDRefreshVolInfo(virStorageVolDefPtr vol,
     uint64_t features;
 
     if ((r = rbd_open_read_only(ptr->ioctx, vol->name, &image, NULL)) < 0) {
-        ret = -r;
+        ret = r;
         virReportSystemError(-r, _("failed to open the RBD image '%s'"),
                              vol->name);
         goto cleanup;
     }
 
     if ((r = rbd_stat(image, &info, sizeof(info))) < 0) {
-        ret = -r;
+        ret = r;
         virReportSystemError(-r, _("failed to stat the RBD image '%s'"),
                              vol->name);
         goto cleanup;
@@ -419,6 +419,41 @@ volStorageBackendRBDRefreshVolInfo(virStorageVolDefPtr vol,
     return ret;
 }
 
+struct virStorageBackendRBDRefreshData {
+    virStoragePoolObjPtr pool;
+    virStorageBackendRBDStatePtr ptr;
+    virStorageVolDefPtr *vols;
+};
+
+
+static int
+virStorageBackendRBDRefreshPoolVol(size_t idx,
+                                   void *opaque)
+{
+    struct virStorageBackendRBDRefreshData *data = opaque;
+    int r;
+
+    r = volStorageBackendRBDRefreshVolInfo(data->vols[idx],
+                                           data->pool, data->ptr);
+
+    /* It could be that a volume has been deleted through a different route
+     * then libvirt and that will cause a -ENOENT to be returned.
+     *
+     * Another possibility is that there is something wrong with the placement
+     * group (PG) that RBD image's header is in and that causes -ETIMEDOUT
+     * to be returned.
+     *
+     * Do not error out and simply ignore the volume
+     */
+    if (r == -ENOENT || r == -ETIMEDOUT) {
+        virResetLastError();
+        return -2;
+    }
+
+    return r < 0 ? -1 : 0;
+}
+
+
 static int
 virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
 {
@@ -431,6 +466,12 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     virStorageBackendRBDStatePtr ptr = NULL;
     struct rados_cluster_stat_t clusterstat;
     struct rados_pool_stat_t poolstat;
+    struct virStorageBackendRBDRefreshData data = { .pool = pool };
+    virStorageVolDefPtr vol = NULL;
+    size_t nvols = 0;
+    int *rc = NULL;
+    virErrorPtr *errs = NULL;
+    size_t i;
 
     if (!(ptr = virStorageBackendRBDNewState(pool)))
         goto cleanup;
@@ -470,45 +511,42 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     }
 
     for (name = names; name < names + max_size;) {
-        virStorageVolDefPtr vol;
-
         if (STREQ(name, ""))
             break;
 
-        if (VIR_ALLOC(vol) < 0)
+        if (VIR_ALLOC(vol) < 0 ||
+            VIR_STRDUP(vol->name, name) < 0 ||
+            VIR_APPEND_ELEMENT(data.vols, nvols, vol) < 0)
             goto cleanup;
 
-        if (VIR_STRDUP(vol->name, name) < 0) {
-            VIR_FREE(vol);
-            goto cleanup;
-        }
-
         name += strlen(name) + 1;
+    }
 
-        r = volStorageBackendRBDRefreshVolInfo(vol, pool, ptr);
-
-        /* It could be that a volume has been deleted through a different route
-         * then libvirt and that will cause a -ENOENT to be returned.
-         *
-         * Another possibility is that there is something wrong with the placement
-         * group (PG) that RBD image's header is in and that causes -ETIMEDOUT
-         * to be returned.
-         *
-         * Do not error out and simply ignore the volume
-         */
-        if (r < 0) {
-            if (r == -ENOENT || r == -ETIMEDOUT)
-                continue;
+    /* Opening every image takes a round trip to the cluster, so query
+     * several images at once. The ioctx is shared by all of them. */
+    data.ptr = ptr;
+    if (VIR_ALLOC_N(rc, nvols) < 0 ||
+        VIR_ALLOC_N(errs, nvols) < 0 ||
+        virStorageBackendProbeParallel(nvols,
+                                       virStorageBackendRBDRefreshPoolVol,
+                                       &data, rc, errs) < 0)
+        goto cleanup;
 
-            virStorageVolDefFree(vol);
+    for (i = 0; i < nvols; i++) {
+        if (rc[i] == -2)
+            continue;
+
+        if (rc[i] < 0) {
+            virSetError(errs[i]);
+            virStoragePoolObjClearVols(pool);
             goto cleanup;
         }
 
-        if (virStoragePoolObjAddVol(pool, vol) < 0) {
-            virStorageVolDefFree(vol);
+        if (virStoragePoolObjAddVol(pool, data.vols[i]) < 0) {
             virStoragePoolObjClearVols(pool);
             goto cleanup;
         }
+        data.vols[i] = NULL;
     }
 
     VIR_DEBUG("Found %zu images in RBD pool %s",
@@ -517,6 +555,15 @@ virStorageBackendRBDRefreshPool(virStoragePoolObjPtr pool)
     ret = 0;
 
  cleanup:
+    for (i = 0; i < nvols; i++) {
+        virStorageVolDefFree(data.vols[i]);
+        if (errs)
+            virFreeError(errs[i]);
+    }
+    VIR_FREE(data.vols);
+    VIR_FREE(rc);
+    VIR_FREE(errs);
+    virStorageVolDefFree(vol);
     VIR_FREE(names);
     virStorageBackendRBDFreeState(&ptr);
     return ret;
@@ -1119,6 +1166,10 @@ virStorageBackendRBDResizeVol(virStoragePoolObjPtr pool,
     return ret;
 }
 
+#if LIBRBD_SUPPORTS_WRITESAME
+# define VIR_STORAGE_RBD_WRITESAME_LEN 512
+#endif
+
 static int
 virStorageBackendRBDVolWipeZero(rbd_image_t image,
                                 char *imgname,
@@ -1137,6 +1188,21 @@ virStorageBackendRBDVolWipeZero(rbd_image_t image,
     while (offset < info->size) {
         length = MIN((info->size - offset), (info->obj_size * stripe_count));
 
+#if LIBRBD_SUPPORTS_WRITESAME
+        /* let the OSDs expand the zeroes instead of sending them all */
+        if (length % VIR_STORAGE_RBD_WRITESAME_LEN == 0) {
+            if ((r = rbd_writesame(image, offset, length, writebuf,
+                                   VIR_STORAGE_RBD_WRITESAME_LEN, 0)) >= 0) {
+                VIR_DEBUG("Zeroed %llu bytes of RBD image %s at offset %llu",
+                          length, imgname, offset);
+                offset += length;
+                continue;
+            }
+
+            VIR_DEBUG("writesame failed on RBD image %s: %d", imgname, r);
+        }
+#endif /* LIBRBD_SUPPORTS_WRITESAME */
+
         if ((r = rbd_write(image, offset, length, writebuf)) < 0) {
             virReportSystemError(-r, _("writing %llu bytes failed on "
                                        "RBD image %s at offset %llu"),
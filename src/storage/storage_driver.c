@@ -32,6 +32,9 @@
 #if HAVE_PWD_H
 # include <pwd.h>
 #endif
+#if HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 
 #include "virerror.h"
 #include "datatypes.h"
@@ -50,6 +53,7 @@
 #include "viraccessapicheck.h"
 //#include "dirname.h"
 #include "storage_util.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -58,6 +62,9 @@ VIR_LOG_INIT("storage.storage_driver");
 static virStorageDriverStatePtr driver;
 
 static int storageStateCleanup(void);
+static int storagePoolWatchInit(void);
+static void storagePoolWatchCleanup(void);
+static void storagePoolWatchUpdate(virStoragePoolObjPtr obj);
 
 typedef struct _virStorageVolStreamInfo virStorageVolStreamInfo;
 typedef virStorageVolStreamInfo *virStorageVolStreamInfoPtr;
@@ -117,6 +124,21 @@ virStoragePoolUpdateInactive(virStoragePoolObjPtr *objptr)
 }
 
 
+/*
+ * Refresh the volumes of the active pool @obj.  Backends able to do that
+ * incrementally get to see the volumes found last time, all others start
+ * over with an empty pool.
+ */
+static int
+storagePoolRefreshVols(virStorageBackendPtr backend,
+                       virStoragePoolObjPtr obj)
+{
+    if (!backend->refreshIncremental)
+        virStoragePoolObjClearVols(obj);
+    return backend->refreshPool(obj);
+}
+
+
 static void
 storagePoolUpdateStateCallback(virStoragePoolObjPtr obj,
                                const void *opaque ATTRIBUTE_UNUSED)
@@ -162,6 +184,7 @@ storagePoolUpdateStateCallback(virStoragePoolObjPtr obj,
     }
 
     virStoragePoolObjSetActive(obj, active);
+    storagePoolWatchUpdate(obj);
 
     if (!virStoragePoolObjIsActive(obj))
         virStoragePoolUpdateInactive(&obj);
@@ -218,18 +241,76 @@ storageDriverAutostartCallback(virStoragePoolObjPtr obj,
                            def->name, virGetLastErrorMessage());
         } else {
             virStoragePoolObjSetActive(obj, true);
+            storagePoolWatchUpdate(obj);
         }
         VIR_FREE(stateFile);
     }
 }
 
 
+struct storageDriverAutostartData {
+    virStoragePoolObjPtr *pools;
+    size_t npools;
+};
+
+
+static void
+storageDriverAutostartCollect(virStoragePoolObjPtr obj,
+                              const void *opaque)
+{
+    struct storageDriverAutostartData *data = (void *) opaque;
+
+    if (!virStoragePoolObjIsAutostart(obj) ||
+        virStoragePoolObjIsActive(obj))
+        return;
+
+    if (VIR_APPEND_ELEMENT(data->pools, data->npools, obj) < 0) {
+        /* the pool is started serially below instead */
+        storageDriverAutostartCallback(obj, NULL);
+        return;
+    }
+    virObjectRef(obj);
+}
+
+
+static int
+storageDriverAutostartPool(size_t item,
+                           void *opaque)
+{
+    struct storageDriverAutostartData *data = opaque;
+
+    virObjectLock(data->pools[item]);
+    storageDriverAutostartCallback(data->pools[item], NULL);
+    virObjectUnlock(data->pools[item]);
+
+    return 0;
+}
+
+
+/*
+ * Starting a pool usually means waiting for something external, an
+ * iSCSI login or a mount, so pools are started in parallel.
+ */
 static void
 storageDriverAutostart(void)
 {
+    struct storageDriverAutostartData data = { 0 };
+    size_t i;
+
     virStoragePoolObjListForEach(driver->pools,
-                                 storageDriverAutostartCallback,
-                                 NULL);
+                                 storageDriverAutostartCollect,
+                                 &data);
+
+    if (virThreadParallelRun(data.npools, storageDriverAutostartPool,
+                             &data, NULL) < 0) {
+        VIR_WARN("Failed to autostart storage pools: %s",
+                 virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    for (i = 0; i < data.npools; i++)
+        virObjectUnref(data.pools[i]);
+    VIR_FREE(data.pools);
 }
 
 /**
@@ -253,6 +334,9 @@ storageStateInitialize(bool privileged,
         VIR_FREE(driver);
         return ret;
     }
+    driver->inotifyFD = -1;
+    driver->inotifyWatch = -1;
+    driver->refreshTimer = -1;
     storageDriverLock();
 
     if (!(driver->pools = virStoragePoolObjListNew()))
@@ -298,6 +382,9 @@ storageStateInitialize(bool privileged,
                                         driver->autostartDir) < 0)
         goto error;
 
+    if (storagePoolWatchInit() < 0)
+        goto error;
+
     storagePoolUpdateAllState();
 
     driver->storageEventState = virObjectEventStateNew();
@@ -370,6 +457,8 @@ storageStateCleanup(void)
 
     storageDriverLock();
 
+    storagePoolWatchCleanup();
+
     virObjectUnref(driver->storageEventState);
 
     /* free inactive pools */
@@ -759,6 +848,7 @@ storagePoolCreateXML(virConnectPtr conn,
 
     VIR_INFO("Creating storage pool '%s'", def->name);
     virStoragePoolObjSetActive(obj, true);
+    storagePoolWatchUpdate(obj);
 
     pool = virGetStoragePool(conn, def->name, def->uuid, NULL, NULL);
 
@@ -956,6 +1046,7 @@ storagePoolCreate(virStoragePoolPtr pool,
                                             0);
 
     virStoragePoolObjSetActive(obj, true);
+    storagePoolWatchUpdate(obj);
     ret = 0;
 
  cleanup:
@@ -1063,6 +1154,7 @@ storagePoolDestroy(virStoragePoolPtr pool)
                                             0);
 
     virStoragePoolObjSetActive(obj, false);
+    storagePoolWatchUpdate(obj);
 
     virStoragePoolUpdateInactive(&obj);
 
@@ -1174,8 +1266,7 @@ storagePoolRefresh(virStoragePoolPtr pool,
         goto cleanup;
     }
 
-    virStoragePoolObjClearVols(obj);
-    if (backend->refreshPool(obj) < 0) {
+    if (storagePoolRefreshVols(backend, obj) < 0) {
         char *stateFile = virFileBuildPath(driver->stateDir, def->name, ".xml");
 
         storagePoolRefreshFailCleanup(backend, obj, stateFile);
@@ -1186,6 +1277,7 @@ storagePoolRefresh(virStoragePoolPtr pool,
                                                 VIR_STORAGE_POOL_EVENT_STOPPED,
                                                 0);
         virStoragePoolObjSetActive(obj, false);
+        storagePoolWatchUpdate(obj);
 
         virStoragePoolUpdateInactive(&obj);
 
@@ -1518,9 +1610,13 @@ storageVolLookupByKey(virConnectPtr conn,
         .key = key, .voldef = NULL };
     virStorageVolPtr vol = NULL;
 
-    if ((obj = virStoragePoolObjListSearch(driver->pools,
-                                           storageVolLookupByKeyCallback,
-                                           &data)) && data.voldef) {
+    if (!(obj = virStoragePoolObjFindByVolKey(driver->pools, key,
+                                              &data.voldef)))
+        obj = virStoragePoolObjListSearch(driver->pools,
+                                          storageVolLookupByKeyCallback,
+                                          &data);
+
+    if (obj && data.voldef) {
         def = virStoragePoolObjGetDef(obj);
         if (virStorageVolLookupByKeyEnsureACL(conn, def, data.voldef) == 0) {
             vol = virGetStorageVol(conn, def->name,
@@ -1602,9 +1698,21 @@ storageVolLookupByPath(virConnectPtr conn,
     if (!(data.cleanpath = virFileSanitizePath(path)))
         return NULL;
 
-    if ((obj = virStoragePoolObjListSearch(driver->pools,
-                                           storageVolLookupByPathCallback,
-                                           &data)) && data.voldef) {
+    /* Volumes are usually looked up by the very path they are known
+     * under, only fall back to translating the path to every pool's
+     * stable path when the index does not know it. */
+    if (!(obj = virStoragePoolObjFindByVolPath(driver->pools, data.cleanpath,
+                                               &data.voldef)) &&
+        STRNEQ(path, data.cleanpath))
+        obj = virStoragePoolObjFindByVolPath(driver->pools, path,
+                                             &data.voldef);
+
+    if (!obj)
+        obj = virStoragePoolObjListSearch(driver->pools,
+                                          storageVolLookupByPathCallback,
+                                          &data);
+
+    if (obj && data.voldef) {
         def = virStoragePoolObjGetDef(obj);
 
         if (virStorageVolLookupByPathEnsureACL(conn, def, data.voldef) == 0) {
@@ -2260,23 +2368,20 @@ virStorageBackendPloopRestoreDesc(char *path)
  * @opaque Domain's device information structure.
  */
 static void
-virStorageVolPoolRefreshThread(void *opaque)
+storagePoolRefreshBackground(const char *pool_name)
 {
-    virStorageVolStreamInfoPtr cbdata = opaque;
     virStoragePoolObjPtr obj = NULL;
     virStoragePoolDefPtr def;
     virStorageBackendPtr backend;
     virObjectEventPtr event = NULL;
 
-    if (cbdata->vol_path) {
-        if (virStorageBackendPloopRestoreDesc(cbdata->vol_path) < 0)
-            goto cleanup;
-    }
-    if (!(obj = virStoragePoolObjFindByName(driver->pools,
-                                            cbdata->pool_name)))
+    if (!(obj = virStoragePoolObjFindByName(driver->pools, pool_name)))
         goto cleanup;
     def = virStoragePoolObjGetDef(obj);
 
+    if (!virStoragePoolObjIsActive(obj))
+        goto cleanup;
+
     /* If some thread is building a new volume in the pool, then we cannot
      * clear out all vols and refresh the pool. So we'll just pass. */
     if (virStoragePoolObjGetAsyncjobs(obj) > 0) {
@@ -2287,8 +2392,7 @@ virStorageVolPoolRefreshThread(void *opaque)
     if (!(backend = virStorageBackendForType(def->type)))
         goto cleanup;
 
-    virStoragePoolObjClearVols(obj);
-    if (backend->refreshPool(obj) < 0)
+    if (storagePoolRefreshVols(backend, obj) < 0)
         VIR_DEBUG("Failed to refresh storage pool");
 
     event = virStoragePoolEventRefreshNew(def->name, def->uuid);
@@ -2296,6 +2400,21 @@ virStorageVolPoolRefreshThread(void *opaque)
  cleanup:
     virObjectEventStateQueue(driver->storageEventState, event);
     virStoragePoolObjEndAPI(&obj);
+}
+
+
+static void
+virStorageVolPoolRefreshThread(void *opaque)
+{
+    virStorageVolStreamInfoPtr cbdata = opaque;
+
+    if (cbdata->vol_path &&
+        virStorageBackendPloopRestoreDesc(cbdata->vol_path) < 0)
+        goto cleanup;
+
+    storagePoolRefreshBackground(cbdata->pool_name);
+
+ cleanup:
     virStorageVolPoolRefreshDataFree(cbdata);
 }
 
@@ -2324,6 +2443,275 @@ virStorageVolFDStreamCloseCb(virStreamPtr st ATTRIBUTE_UNUSED,
     virStorageVolPoolRefreshDataFree(opaque);
 }
 
+
+/* How long to collect changes of a watched pool before refreshing it */
+#define STORAGE_POOL_WATCH_DELAY 1000
+/* How often to rescan watched pools anyway, in case a change was missed
+ * (e.g. on network filesystems) or inotify is unavailable */
+#define STORAGE_POOL_WATCH_RESCAN (5 * 60 * 1000)
+
+
+static void
+storagePoolWatchFree(virStoragePoolWatchPtr watch)
+{
+    if (!watch)
+        return;
+
+    VIR_FREE(watch->name);
+    VIR_FREE(watch);
+}
+
+
+static void
+storagePoolWatchRefreshThread(void *opaque)
+{
+    char **names = opaque;
+    size_t i;
+
+    for (i = 0; names[i]; i++)
+        storagePoolRefreshBackground(names[i]);
+    virStringListFree(names);
+
+    virMutexLock(&driver->watchLock);
+    driver->refreshRunning = false;
+    virMutexUnlock(&driver->watchLock);
+}
+
+
+/*
+ * Fires STORAGE_POOL_WATCH_DELAY after a watched directory changed to
+ * refresh the pools that changed, and every STORAGE_POOL_WATCH_RESCAN
+ * otherwise to refresh all watched pools.
+ */
+static void
+storagePoolWatchTimer(int timer,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    char **names = NULL;
+    size_t nnames = 0;
+    size_t i;
+    virThread thread;
+
+    virMutexLock(&driver->watchLock);
+
+    if (driver->refreshRunning) {
+        /* Come back once the previous refresh is done */
+        virEventUpdateTimeout(timer, STORAGE_POOL_WATCH_DELAY);
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC_N(names, driver->nwatches + 1) < 0)
+        goto cleanup;
+
+    for (i = 0; i < driver->nwatches; i++) {
+        virStoragePoolWatchPtr watch = driver->watches[i];
+
+        if (!driver->refreshPending || watch->dirty) {
+            if (VIR_STRDUP(names[nnames], watch->name) < 0)
+                goto cleanup;
+            nnames++;
+        }
+        watch->dirty = false;
+    }
+
+    driver->refreshPending = false;
+    virEventUpdateTimeout(timer, STORAGE_POOL_WATCH_RESCAN);
+
+    if (nnames == 0)
+        goto cleanup;
+
+    if (virThreadCreate(&thread, false, storagePoolWatchRefreshThread,
+                        names) < 0) {
+        VIR_ERROR(_("Failed to create thread to handle pool refresh"));
+        goto cleanup;
+    }
+    names = NULL;
+    driver->refreshRunning = true;
+
+ cleanup:
+    virStringListFree(names);
+    virMutexUnlock(&driver->watchLock);
+}
+
+
+#if HAVE_SYS_INOTIFY_H
+static void
+storagePoolWatchEvent(int watch ATTRIBUTE_UNUSED,
+                      int fd,
+                      int events ATTRIBUTE_UNUSED,
+                      void *opaque ATTRIBUTE_UNUSED)
+{
+    char buf[4096];
+    struct inotify_event e;
+    ssize_t got;
+    size_t off;
+    size_t i;
+    bool changed = false;
+
+    virMutexLock(&driver->watchLock);
+
+    for (;;) {
+        if ((got = read(fd, buf, sizeof(buf))) <= 0) {
+            if (got < 0 && errno == EINTR)
+                continue;
+            break;
+        }
+
+        for (off = 0; off + sizeof(e) <= (size_t) got;
+             off += sizeof(e) + e.len) {
+            memcpy(&e, buf + off, sizeof(e));
+
+            for (i = 0; i < driver->nwatches; i++) {
+                /* On queue overflow we can't tell what changed */
+                if (driver->watches[i]->wd == e.wd ||
+                    e.mask & IN_Q_OVERFLOW) {
+                    driver->watches[i]->dirty = true;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    if (changed && !driver->refreshPending) {
+        driver->refreshPending = true;
+        virEventUpdateTimeout(driver->refreshTimer, STORAGE_POOL_WATCH_DELAY);
+    }
+
+    virMutexUnlock(&driver->watchLock);
+}
+#endif /* HAVE_SYS_INOTIFY_H */
+
+
+static int
+storagePoolWatchInit(void)
+{
+    if (virMutexInit(&driver->watchLock) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("cannot initialize storage pool watch mutex"));
+        return -1;
+    }
+
+#if HAVE_SYS_INOTIFY_H
+    if ((driver->inotifyFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        char ebuf[1024];
+
+        VIR_WARN("Cannot initialize inotify, storage pools will only be "
+                 "rescanned periodically: %s",
+                 virStrerror(errno, ebuf, sizeof(ebuf)));
+    } else if ((driver->inotifyWatch =
+                virEventAddHandle(driver->inotifyFD,
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  storagePoolWatchEvent,
+                                  NULL, NULL)) < 0) {
+        VIR_WARN("Cannot watch inotify file descriptor");
+        VIR_FORCE_CLOSE(driver->inotifyFD);
+    }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+    if ((driver->refreshTimer =
+         virEventAddTimeout(STORAGE_POOL_WATCH_RESCAN,
+                            storagePoolWatchTimer, NULL, NULL)) < 0)
+        VIR_WARN("Cannot add storage pool refresh timer");
+
+    return 0;
+}
+
+
+static void
+storagePoolWatchCleanup(void)
+{
+    size_t i;
+
+    if (driver->refreshTimer >= 0)
+        virEventRemoveTimeout(driver->refreshTimer);
+    if (driver->inotifyWatch >= 0)
+        virEventRemoveHandle(driver->inotifyWatch);
+    VIR_FORCE_CLOSE(driver->inotifyFD);
+
+    for (i = 0; i < driver->nwatches; i++)
+        storagePoolWatchFree(driver->watches[i]);
+    VIR_FREE(driver->watches);
+    driver->nwatches = 0;
+
+    virMutexDestroy(&driver->watchLock);
+}
+
+
+/*
+ * Start or stop watching the directory of pool @obj, depending on whether
+ * it is active and its backend supports incremental refresh.  Failing to
+ * watch is not fatal and reports no error, the pool just isn't refreshed
+ * automatically then.
+ */
+static void
+storagePoolWatchUpdate(virStoragePoolObjPtr obj)
+{
+    virStoragePoolDefPtr def = virStoragePoolObjGetDef(obj);
+    virStorageBackendPtr backend;
+    virStoragePoolWatchPtr watch = NULL;
+    bool want = false;
+    size_t i;
+
+    if (virStoragePoolObjIsActive(obj) &&
+        (backend = virStorageBackendForType(def->type)))
+        want = backend->refreshIncremental;
+
+    virMutexLock(&driver->watchLock);
+
+    for (i = 0; i < driver->nwatches; i++) {
+        if (STREQ(driver->watches[i]->name, def->name))
+            break;
+    }
+
+    if (i < driver->nwatches && !want) {
+        watch = driver->watches[i];
+        VIR_DELETE_ELEMENT(driver->watches, i, driver->nwatches);
+
+#if HAVE_SYS_INOTIFY_H
+        if (watch->wd >= 0) {
+            size_t j;
+
+            /* Watches on the same directory share their descriptor */
+            for (j = 0; j < driver->nwatches; j++) {
+                if (driver->watches[j]->wd == watch->wd)
+                    break;
+            }
+            if (j == driver->nwatches)
+                inotify_rm_watch(driver->inotifyFD, watch->wd);
+        }
+#endif /* HAVE_SYS_INOTIFY_H */
+    } else if (i == driver->nwatches && want) {
+        if (VIR_ALLOC_QUIET(watch) < 0 ||
+            VIR_STRDUP_QUIET(watch->name, def->name) < 0)
+            goto cleanup;
+        watch->wd = -1;
+
+#if HAVE_SYS_INOTIFY_H
+        if (driver->inotifyFD >= 0 &&
+            (watch->wd = inotify_add_watch(driver->inotifyFD,
+                                           def->target.path,
+                                           IN_CREATE | IN_DELETE |
+                                           IN_MOVED_FROM | IN_MOVED_TO |
+                                           IN_CLOSE_WRITE | IN_ATTRIB |
+                                           IN_ONLYDIR)) < 0) {
+            char ebuf[1024];
+
+            VIR_WARN("Cannot watch directory '%s' of storage pool '%s': %s",
+                     def->target.path, def->name,
+                     virStrerror(errno, ebuf, sizeof(ebuf)));
+        }
+#endif /* HAVE_SYS_INOTIFY_H */
+
+        if (VIR_APPEND_ELEMENT_QUIET(driver->watches, driver->nwatches,
+                                     watch) < 0)
+            goto cleanup;
+    }
+
+ cleanup:
+    storagePoolWatchFree(watch);
+    virMutexUnlock(&driver->watchLock);
+}
+
 static int
 storageVolUpload(virStorageVolPtr vol,
                  virStreamPtr stream,
@@ -25,24 +25,273 @@
 
 #include "storage_file_gluster.h"
 #include "viralloc.h"
+#include "virbuffer.h"
 #include "virerror.h"
+#include "virevent.h"
+#include "virhash.h"
 #include "virlog.h"
 #include "virstoragefilebackend.h"
 #include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
 VIR_LOG_INIT("storage.storage_file_gluster");
 
+/* how long an unused connection is kept open, in milliseconds */
+#define VIR_STORAGE_FILE_GLUSTER_CONN_IDLE 30000
+
+
+typedef struct _virStorageFileBackendGlusterConn virStorageFileBackendGlusterConn;
+typedef virStorageFileBackendGlusterConn *virStorageFileBackendGlusterConnPtr;
+
+struct _virStorageFileBackendGlusterConn {
+    glfs_t *vol;
+    size_t refs;
+    unsigned long long idleSince; /* valid if refs is 0 */
+};
 
 typedef struct _virStorageFileBackendGlusterPriv virStorageFileBackendGlusterPriv;
 typedef virStorageFileBackendGlusterPriv *virStorageFileBackendGlusterPrivPtr;
 
 struct _virStorageFileBackendGlusterPriv {
     glfs_t *vol;
+    char *conn; /* key of the connection in glusterConns */
     char *canonpath;
 };
 
+/* Backing chain walks, security labelling and metadata probes initialize
+ * the same gluster sources many times in a row. Connections are shared
+ * by all sources with the same volume and servers and closed once they
+ * were unused for VIR_STORAGE_FILE_GLUSTER_CONN_IDLE. */
+static virMutex glusterConnsLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr glusterConns;
+static int glusterConnsTimer = -1;
+
+
+static void
+virStorageFileBackendGlusterConnFree(virStorageFileBackendGlusterConnPtr conn)
+{
+    if (!conn)
+        return;
+
+    glfs_fini(conn->vol);
+    VIR_FREE(conn);
+}
+
+
+static int
+virStorageFileBackendGlusterConnExpired(const void *payload,
+                                        const void *name ATTRIBUTE_UNUSED,
+                                        const void *opaque)
+{
+    const virStorageFileBackendGlusterConn *conn = payload;
+    const unsigned long long *now = opaque;
+
+    return conn->refs == 0 &&
+           conn->idleSince + VIR_STORAGE_FILE_GLUSTER_CONN_IDLE <= *now;
+}
+
+
+static int
+virStorageFileBackendGlusterConnIdle(const void *payload,
+                                     const void *name ATTRIBUTE_UNUSED,
+                                     const void *opaque ATTRIBUTE_UNUSED)
+{
+    const virStorageFileBackendGlusterConn *conn = payload;
+
+    return conn->refs == 0;
+}
+
+
+struct virStorageFileBackendGlusterConnsExpireData {
+    unsigned long long now;
+    virStorageFileBackendGlusterConnPtr *next;
+};
+
+
+static int
+virStorageFileBackendGlusterConnCollect(void *payload,
+                                        const void *name ATTRIBUTE_UNUSED,
+                                        void *opaque)
+{
+    struct virStorageFileBackendGlusterConnsExpireData *data = opaque;
+
+    if (virStorageFileBackendGlusterConnExpired(payload, NULL, &data->now))
+        *(data->next++) = payload;
+
+    return 0;
+}
+
+
+/* Closes the connections which were idle for long enough. Must be called
+ * with glusterConnsLock held, which is released before closing them. */
+static void
+virStorageFileBackendGlusterConnsExpireUnlock(void)
+{
+    struct virStorageFileBackendGlusterConnsExpireData data;
+    virStorageFileBackendGlusterConnPtr *expired = NULL;
+    size_t i;
+
+    if (!glusterConns ||
+        virTimeMillisNow(&data.now) < 0 ||
+        VIR_ALLOC_N(expired, virHashSize(glusterConns) + 1) < 0)
+        goto unlock;
+
+    /* the table doesn't free its entries, so that the connections can be
+     * closed without holding the lock */
+    data.next = expired;
+    virHashForEach(glusterConns, virStorageFileBackendGlusterConnCollect,
+                   &data);
+    virHashRemoveSet(glusterConns, virStorageFileBackendGlusterConnExpired,
+                     &data.now);
+
+    if (glusterConnsTimer >= 0 &&
+        !virHashSearch(glusterConns, virStorageFileBackendGlusterConnIdle,
+                       NULL, NULL)) {
+        virEventRemoveTimeout(glusterConnsTimer);
+        glusterConnsTimer = -1;
+    }
+
+ unlock:
+    virMutexUnlock(&glusterConnsLock);
+
+    for (i = 0; expired && expired[i]; i++) {
+        VIR_DEBUG("closing idle gluster connection %p", expired[i]->vol);
+        virStorageFileBackendGlusterConnFree(expired[i]);
+    }
+    VIR_FREE(expired);
+}
+
+
+static void
+virStorageFileBackendGlusterConnsTimer(int timer ATTRIBUTE_UNUSED,
+                                       void *opaque ATTRIBUTE_UNUSED)
+{
+    virMutexLock(&glusterConnsLock);
+    virStorageFileBackendGlusterConnsExpireUnlock();
+}
+
+
+static char *
+virStorageFileBackendGlusterConnKey(virStorageSourcePtr src)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAsprintf(&buf, "%s", src->volume);
+
+    for (i = 0; i < src->nhosts; i++) {
+        virStorageNetHostDefPtr host = src->hosts + i;
+
+        virBufferAsprintf(&buf, "|%s:",
+                          virStorageNetHostTransportTypeToString(host->transport));
+        if (host->transport == VIR_STORAGE_NET_HOST_TRANS_UNIX)
+            virBufferAsprintf(&buf, "%s", NULLSTR(host->socket));
+        else
+            virBufferAsprintf(&buf, "%s:%u", NULLSTR(host->name), host->port);
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+/* Returns a referenced connection for @key, or NULL if there is none */
+static glfs_t *
+virStorageFileBackendGlusterConnAcquire(const char *key)
+{
+    virStorageFileBackendGlusterConnPtr conn;
+    glfs_t *ret = NULL;
+
+    virMutexLock(&glusterConnsLock);
+
+    if (glusterConns && (conn = virHashLookup(glusterConns, key))) {
+        conn->refs++;
+        ret = conn->vol;
+    }
+
+    virMutexUnlock(&glusterConnsLock);
+    return ret;
+}
+
+
+/* Adds the connection @vol for @key to the cache with one reference. If a
+ * connection for @key was added meanwhile, it is used and @vol is closed.
+ * Returns the connection to use, or NULL on error with @vol closed. */
+static glfs_t *
+virStorageFileBackendGlusterConnAdd(const char *key,
+                                    glfs_t *vol)
+{
+    virStorageFileBackendGlusterConnPtr conn = NULL;
+    glfs_t *ret = NULL;
+
+    virMutexLock(&glusterConnsLock);
+
+    if (!glusterConns &&
+        !(glusterConns = virHashCreate(8, NULL)))
+        goto cleanup;
+
+    if ((conn = virHashLookup(glusterConns, key))) {
+        conn->refs++;
+        ret = conn->vol;
+        conn = NULL;
+        goto cleanup;
+    }
+
+    if (VIR_ALLOC(conn) < 0)
+        goto cleanup;
+
+    conn->vol = vol;
+    conn->refs = 1;
+
+    if (virHashAddEntry(glusterConns, key, conn) < 0) {
+        VIR_FREE(conn);
+        goto cleanup;
+    }
+
+    ret = vol;
+    vol = NULL;
+
+ cleanup:
+    virMutexUnlock(&glusterConnsLock);
+    if (vol)
+        glfs_fini(vol);
+    return ret;
+}
+
+
+static void
+virStorageFileBackendGlusterConnRelease(const char *key)
+{
+    virStorageFileBackendGlusterConnPtr conn;
+
+    virMutexLock(&glusterConnsLock);
+
+    if (!glusterConns || !(conn = virHashLookup(glusterConns, key)) ||
+        --conn->refs > 0) {
+        virMutexUnlock(&glusterConnsLock);
+        return;
+    }
+
+    if (virTimeMillisNow(&conn->idleSince) < 0)
+        conn->idleSince = 0;
+
+    /* without an event loop there's nothing to expire idle connections
+     * later, so close it right away */
+    if (glusterConnsTimer < 0 &&
+        (glusterConnsTimer = virEventAddTimeout(VIR_STORAGE_FILE_GLUSTER_CONN_IDLE,
+                                                virStorageFileBackendGlusterConnsTimer,
+                                                NULL, NULL)) < 0)
+        conn->idleSince = 0;
+
+    virStorageFileBackendGlusterConnsExpireUnlock();
+}
+
+
 static void
 virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
 {
@@ -51,8 +300,9 @@ virStorageFileBackendGlusterDeinit(virStorageSourcePtr src)
     VIR_DEBUG("deinitializing gluster storage file %p (gluster://%s:%u/%s%s)",
               src, src->hosts->name, src->hosts->port, src->volume, src->path);
 
-    if (priv->vol)
-        glfs_fini(priv->vol);
+    if (priv->conn)
+        virStorageFileBackendGlusterConnRelease(priv->conn);
+    VIR_FREE(priv->conn);
     VIR_FREE(priv->canonpath);
 
     VIR_FREE(priv);
@@ -117,6 +367,15 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
               src, priv, src->volume, src->path,
               (unsigned int)src->drv->uid, (unsigned int)src->drv->gid);
 
+    if (!(priv->conn = virStorageFileBackendGlusterConnKey(src)))
+        goto error;
+
+    if ((priv->vol = virStorageFileBackendGlusterConnAcquire(priv->conn))) {
+        VIR_DEBUG("reusing gluster connection %p", priv->vol);
+        src->drv->priv = priv;
+        return 0;
+    }
+
     if (!(priv->vol = glfs_new(src->volume))) {
         virReportOOMError();
         goto error;
@@ -134,6 +393,10 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
         goto error;
     }
 
+    if (!(priv->vol = virStorageFileBackendGlusterConnAdd(priv->conn,
+                                                          priv->vol)))
+        goto error;
+
     src->drv->priv = priv;
 
     return 0;
@@ -141,6 +404,7 @@ virStorageFileBackendGlusterInit(virStorageSourcePtr src)
  error:
     if (priv->vol)
         glfs_fini(priv->vol);
+    VIR_FREE(priv->conn);
     VIR_FREE(priv);
 
     return -1;
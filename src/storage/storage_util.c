@@ -72,6 +72,7 @@
 #include "virstring.h"
 #include "virxml.h"
 #include "virfdstream.h"
+#include "virthreadpool.h"
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
@@ -101,6 +102,84 @@ reflinkCloneFile(int dest_fd ATTRIBUTE_UNUSED,
 #endif
 
 
+/*
+ * Let the kernel copy up to @len bytes from the current position of
+ * @src_fd to the current position of @dest_fd, which avoids bouncing
+ * the data through userspace and allows filesystems to offload the copy.
+ *
+ * Returns the number of bytes copied, 0 at the end of @src_fd, or -1
+ * with errno set.
+ */
+#if HAVE_COPY_FILE_RANGE
+static ssize_t
+virStorageBackendCopyFileRange(int dest_fd, int src_fd, size_t len)
+{
+    ssize_t ret;
+
+    do {
+        ret = copy_file_range(src_fd, NULL, dest_fd, NULL, len, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    return ret;
+}
+#else
+static ssize_t
+virStorageBackendCopyFileRange(int dest_fd ATTRIBUTE_UNUSED,
+                               int src_fd ATTRIBUTE_UNUSED,
+                               size_t len ATTRIBUTE_UNUSED)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif
+
+
+/*
+ * Find out how much of the next @len bytes at @pos in @fd is data.
+ * On return @inData tells whether the range starts with data or with
+ * a hole and @extent holds the length of that range, which is 0 at the
+ * end of the file.
+ *
+ * Returns 0 on success, -1 if the file does not support seeking for
+ * holes. In both cases the position in @fd is restored to @pos.
+ */
+static int
+virStorageBackendCopyExtent(int fd,
+                            off_t pos,
+                            unsigned long long len,
+                            bool *inData,
+                            unsigned long long *extent)
+{
+    off_t data;
+    off_t hole;
+    off_t end;
+    int ret = -1;
+
+    if ((data = lseek(fd, pos, SEEK_DATA)) < 0) {
+        /* ENXIO means we are in the trailing hole or past EOF */
+        if (errno != ENXIO ||
+            (end = lseek(fd, 0, SEEK_END)) < 0)
+            goto cleanup;
+        *inData = false;
+        *extent = end > pos ? MIN(len, end - pos) : 0;
+    } else if (data > pos) {
+        *inData = false;
+        *extent = MIN(len, data - pos);
+    } else {
+        if ((hole = lseek(fd, pos, SEEK_HOLE)) < 0)
+            goto cleanup;
+        *inData = true;
+        *extent = hole > pos ? MIN(len, hole - pos) : len;
+    }
+
+    ret = 0;
+ cleanup:
+    if (lseek(fd, pos, SEEK_SET) < 0)
+        ret = -1;
+    return ret;
+}
+
+
 static int ATTRIBUTE_NONNULL(2)
 virStorageBackendCopyToFD(virStorageVolDefPtr vol,
                           virStorageVolDefPtr inputvol,
@@ -118,6 +197,10 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
     char *zerobuf = NULL;
     char *buf = NULL;
     struct stat st;
+    off_t pos = 0;
+    bool seek_holes = want_sparse;
+    bool offload = true;
+    unsigned long long extent = 0;
 
     if ((inputfd = open(inputvol->target.path, O_RDONLY)) < 0) {
         ret = -errno;
@@ -161,11 +244,81 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
 
     while (amtread != 0) {
         int amtleft;
+        size_t len;
+
+        /* Skip over holes in the input without reading them if the
+         * filesystem can tell us where they are. The output is either
+         * a block device (which is never sparse) or a file that has
+         * been truncated to its final size already */
+        if (seek_holes && extent == 0 && *total > 0) {
+            bool inData;
+
+            if (virStorageBackendCopyExtent(inputfd, pos, *total,
+                                            &inData, &extent) < 0) {
+                VIR_DEBUG("cannot seek for holes in '%s', will scan for "
+                          "zero blocks instead", inputvol->target.path);
+                seek_holes = false;
+                extent = 0;
+            } else if (!inData && extent == 0) {
+                break;
+            } else if (!inData) {
+                if (lseek(inputfd, extent, SEEK_CUR) < 0 ||
+                    lseek(fd, extent, SEEK_CUR) < 0) {
+                    ret = -errno;
+                    virReportSystemError(errno,
+                                         _("cannot skip hole in '%s'"),
+                                         inputvol->target.path);
+                    goto cleanup;
+                }
+                pos += extent;
+                *total -= extent;
+                extent = 0;
+                continue;
+            }
+        }
+
+        /* If we don't have to look for zero blocks the kernel can do
+         * the copy for us */
+        if (offload && (!want_sparse || seek_holes) && *total > 0) {
+            unsigned long long want = seek_holes ? extent : *total;
+            ssize_t got;
+
+            if (want > SSIZE_MAX)
+                want = SSIZE_MAX;
+
+            if ((got = virStorageBackendCopyFileRange(fd, inputfd, want)) > 0) {
+                pos += got;
+                *total -= got;
+                if (seek_holes)
+                    extent -= got;
+                continue;
+            }
+
+            if (got < 0 && errno != ENOSYS && errno != EXDEV &&
+                errno != EINVAL && errno != EOPNOTSUPP) {
+                ret = -errno;
+                virReportSystemError(errno,
+                                     _("failed to copy '%s' to '%s'"),
+                                     inputvol->target.path,
+                                     vol->target.path);
+                goto cleanup;
+            }
 
-        if (*total < rbytes)
-            rbytes = *total;
+            /* Either EOF, or the kernel can't copy between these files
+             * in which case we fall back to read()/write() below */
+            if (got < 0)
+                offload = false;
+            else
+                break;
+        }
+
+        len = rbytes;
+        if (*total < len)
+            len = *total;
+        if (seek_holes && extent < len)
+            len = extent;
 
-        if ((amtread = saferead(inputfd, buf, rbytes)) < 0) {
+        if ((amtread = saferead(inputfd, buf, len)) < 0) {
             ret = -errno;
             virReportSystemError(errno,
                                  _("failed reading from file '%s'"),
@@ -173,6 +326,9 @@ virStorageBackendCopyToFD(virStorageVolDefPtr vol,
             goto cleanup;
         }
         *total -= amtread;
+        pos += amtread;
+        if (seek_holes)
+            extent -= amtread;
 
         /* Loop over amt read in 512 byte increments, looking for sparse
          * blocks */
@@ -2586,6 +2742,71 @@ storageBackendVolZeroSparseFileLocal(const char *path,
 }
 
 
+/*
+ * Try to make the device or file zero the @len bytes at @offset of @fd
+ * rather than writing them, which takes hours for multi-TB volumes.
+ * Block devices are asked to write zeroes, which lets the kernel use
+ * write-same or unmap where the storage guarantees zeroes afterwards.
+ * Regular files get the range deallocated, like sparse files are wiped
+ * in storageBackendVolZeroSparseFileLocal.
+ *
+ * Returns 0 if the range reads as zeroes now, -1 if it has to be written.
+ */
+static int
+storageBackendWipeLocalOffload(const char *path,
+                               int fd,
+                               off_t offset,
+                               unsigned long long len)
+{
+#ifdef __linux__
+    struct stat st;
+    char ebuf[1024];
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+
+# ifdef BLKZEROOUT
+    if (S_ISBLK(st.st_mode)) {
+        uint64_t range[2] = { offset, len };
+
+        if (ioctl(fd, BLKZEROOUT, range) == 0) {
+            VIR_DEBUG("Zeroed out %llu bytes of '%s'", len, path);
+            return 0;
+        }
+
+        VIR_DEBUG("Cannot zero out '%s': %s",
+                  path, virStrerror(errno, ebuf, sizeof(ebuf)));
+        return -1;
+    }
+# endif /* BLKZEROOUT */
+
+# if defined(FALLOC_FL_PUNCH_HOLE) && defined(FALLOC_FL_KEEP_SIZE)
+    if (S_ISREG(st.st_mode)) {
+#  ifdef FALLOC_FL_ZERO_RANGE
+        if (fallocate(fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE,
+                      offset, len) == 0) {
+            VIR_DEBUG("Zeroed range of %llu bytes of '%s'", len, path);
+            return 0;
+        }
+#  endif /* FALLOC_FL_ZERO_RANGE */
+
+        if (fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                      offset, len) == 0) {
+            VIR_DEBUG("Punched hole of %llu bytes into '%s'", len, path);
+            return 0;
+        }
+
+        VIR_DEBUG("Cannot deallocate range of '%s': %s",
+                  path, virStrerror(errno, ebuf, sizeof(ebuf)));
+        return -1;
+    }
+# endif /* FALLOC_FL_PUNCH_HOLE && FALLOC_FL_KEEP_SIZE */
+#endif /* __linux__ */
+
+    return -1;
+}
+
+
 static int
 storageBackendWipeLocal(const char *path,
                         int fd,
@@ -2623,6 +2844,9 @@ storageBackendWipeLocal(const char *path,
     VIR_DEBUG("wiping start: %zd len: %llu", (ssize_t)size, wipe_len);
 
     remaining = wipe_len;
+    if (storageBackendWipeLocalOffload(path, fd, size, wipe_len) == 0)
+        remaining = 0;
+
     while (remaining > 0) {
 
         write_size = (writebuf_length < remaining) ? writebuf_length : remaining;
@@ -3640,9 +3864,149 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol)
 }
 
 
+typedef struct _virStorageBackendProbeData virStorageBackendProbeData;
+struct _virStorageBackendProbeData {
+    virStorageBackendProbeFunc func;
+    void *opaque;
+    int *rc;
+};
+
+
+static int
+virStorageBackendProbeItem(size_t item,
+                           void *opaque)
+{
+    virStorageBackendProbeData *data = opaque;
+
+    return (data->rc[item] = data->func(item, data->opaque)) == -1 ? -1 : 0;
+}
+
+
+/*
+ * Call @func for each of the @nitems items in parallel, see
+ * virThreadParallelRun(), and store its return value in @rc.  @func must
+ * not touch the pool object, the volumes it probes are supposed to be
+ * added by the caller afterwards.  For items where @func returned -1
+ * the error it reported is stored in @errs and must be freed by the
+ * caller.
+ *
+ * Returns 0 on success, -1 if the worker threads could not be set up.
+ */
+int
+virStorageBackendProbeParallel(size_t nitems,
+                               virStorageBackendProbeFunc func,
+                               void *opaque,
+                               int *rc,
+                               virErrorPtr *errs)
+{
+    virStorageBackendProbeData data = {
+        .func = func, .opaque = opaque, .rc = rc,
+    };
+
+    return virThreadParallelRun(nitems, virStorageBackendProbeItem,
+                                &data, errs);
+}
+
+
+static void
+virStorageBackendStampVol(virStorageVolDefPtr vol)
+{
+    struct stat sb;
+
+    memset(&vol->stamp, 0, sizeof(vol->stamp));
+    if (stat(vol->target.path, &sb) < 0)
+        return;
+
+    vol->stamp.valid = true;
+    vol->stamp.dev = sb.st_dev;
+    vol->stamp.ino = sb.st_ino;
+    vol->stamp.size = sb.st_size;
+    vol->stamp.mtime = get_stat_mtime(&sb);
+    vol->stamp.ctime = get_stat_ctime(&sb);
+}
+
+
+/*
+ * Returns true if the already known volume @name was probed from the very
+ * same file and the file did not change since. Otherwise the volume is
+ * removed from @pool, so that it can be probed again.
+ */
+static bool
+virStorageBackendRefreshLocalKeep(virStoragePoolObjPtr pool,
+                                  const char *name)
+{
+    virStorageVolDefPtr vol;
+    struct stat sb;
+    struct timespec mtime;
+    struct timespec ctime;
+
+    if (!(vol = virStorageVolDefFindByName(pool, name)))
+        return false;
+
+    if (vol->stamp.valid && stat(vol->target.path, &sb) == 0) {
+        mtime = get_stat_mtime(&sb);
+        ctime = get_stat_ctime(&sb);
+
+        if (vol->stamp.dev == sb.st_dev &&
+            vol->stamp.ino == sb.st_ino &&
+            vol->stamp.size == (unsigned long long) sb.st_size &&
+            vol->stamp.mtime.tv_sec == mtime.tv_sec &&
+            vol->stamp.mtime.tv_nsec == mtime.tv_nsec &&
+            vol->stamp.ctime.tv_sec == ctime.tv_sec &&
+            vol->stamp.ctime.tv_nsec == ctime.tv_nsec)
+            return true;
+    }
+
+    virStoragePoolObjRemoveVol(pool, vol);
+    return false;
+}
+
+
+struct virStorageBackendRefreshLocalData {
+    virHashTablePtr seen;
+    virStorageVolDefPtr *gone;
+    size_t ngone;
+};
+
+
+static int
+virStorageBackendRefreshLocalProbe(size_t idx,
+                                   void *opaque)
+{
+    virStorageVolDefPtr vol = ((virStorageVolDefPtr *) opaque)[idx];
+
+    /* Stamp before probing, so that changes made meanwhile are
+     * picked up by the next incremental refresh */
+    virStorageBackendStampVol(vol);
+
+    return virStorageBackendRefreshVolTargetUpdate(vol);
+}
+
+
+static int
+virStorageBackendRefreshLocalGone(virStorageVolDefPtr vol,
+                                  const void *opaque)
+{
+    struct virStorageBackendRefreshLocalData *data =
+        (struct virStorageBackendRefreshLocalData *) opaque;
+
+    if (virHashLookup(data->seen, vol->name))
+        return 0;
+
+    return VIR_APPEND_ELEMENT(data->gone, data->ngone, vol);
+}
+
+
 /**
  * Iterate over the pool's directory and enumerate all disk images
  * within it. This is non-recursive.
+ *
+ * If the pool is not empty, the refresh is incremental: volumes that were
+ * probed before and whose file did not change (as far as its inode, size
+ * and timestamps can tell) are kept as they are, the rest is probed again
+ * and volumes whose file disappeared are removed.
+ *
+ * Files are probed in parallel, see virStorageBackendProbeParallel().
  */
 int
 virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
@@ -3653,22 +4017,41 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     struct statvfs sb;
     struct stat statbuf;
     virStorageVolDefPtr vol = NULL;
+    virStorageVolDefPtr *vols = NULL;
+    size_t nvols = 0;
+    int *rc = NULL;
+    virErrorPtr *errs = NULL;
     virStorageSourcePtr target = NULL;
+    struct virStorageBackendRefreshLocalData data = { 0 };
+    size_t nkept = 0;
+    size_t i;
     int direrr;
     int fd = -1, ret = -1;
 
+    if (virStoragePoolObjGetVolumesCount(pool) > 0 &&
+        !(data.seen = virHashCreate(256, NULL)))
+        goto cleanup;
+
     if (virDirOpen(&dir, def->target.path) < 0)
         goto cleanup;
 
     while ((direrr = virDirRead(dir, &ent, def->target.path)) > 0) {
-        int err;
-
         if (virStringHasControlChars(ent->d_name)) {
             VIR_WARN("Ignoring file '%s' with control characters under '%s'",
                      ent->d_name, def->target.path);
             continue;
         }
 
+        if (data.seen) {
+            if (virHashAddEntry(data.seen, ent->d_name, (void *) 1) < 0)
+                goto cleanup;
+
+            if (virStorageBackendRefreshLocalKeep(pool, ent->d_name)) {
+                nkept++;
+                continue;
+            }
+        }
+
         if (VIR_ALLOC(vol) < 0)
             goto cleanup;
 
@@ -3683,25 +4066,48 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
         if (VIR_STRDUP(vol->key, vol->target.path) < 0)
             goto cleanup;
 
-        if ((err = virStorageBackendRefreshVolTargetUpdate(vol)) < 0) {
-            if (err == -2) {
-                /* Silently ignore non-regular files,
-                 * eg 'lost+found', dangling symbolic link */
-                virStorageVolDefFree(vol);
-                vol = NULL;
-                continue;
-            }
+        if (VIR_APPEND_ELEMENT(vols, nvols, vol) < 0)
             goto cleanup;
-        }
-
-        if (virStoragePoolObjAddVol(pool, vol) < 0)
-            goto cleanup;
-        vol = NULL;
     }
     if (direrr < 0)
         goto cleanup;
     VIR_DIR_CLOSE(dir);
 
+    if (VIR_ALLOC_N(rc, nvols) < 0 ||
+        VIR_ALLOC_N(errs, nvols) < 0 ||
+        virStorageBackendProbeParallel(nvols,
+                                       virStorageBackendRefreshLocalProbe,
+                                       vols, rc, errs) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nvols; i++) {
+        if (rc[i] == -2) {
+            /* Silently ignore non-regular files,
+             * eg 'lost+found', dangling symbolic link */
+            continue;
+        } else if (rc[i] < 0) {
+            virSetError(errs[i]);
+            goto cleanup;
+        }
+
+        if (virStoragePoolObjAddVol(pool, vols[i]) < 0)
+            goto cleanup;
+        vols[i] = NULL;
+    }
+
+    if (data.seen) {
+        if (virStoragePoolObjForEachVolume(pool,
+                                           virStorageBackendRefreshLocalGone,
+                                           &data) < 0)
+            goto cleanup;
+
+        for (i = 0; i < data.ngone; i++)
+            virStoragePoolObjRemoveVol(pool, data.gone[i]);
+
+        VIR_DEBUG("Refreshed pool '%s' incrementally: %zu volumes kept, "
+                  "%zu removed", def->name, nkept, data.ngone);
+    }
+
     if (VIR_ALLOC(target))
         goto cleanup;
 
@@ -3749,6 +4155,16 @@ virStorageBackendRefreshLocal(virStoragePoolObjPtr pool)
     VIR_FORCE_CLOSE(fd);
     virStorageVolDefFree(vol);
     virStorageSourceFree(target);
+    virHashFree(data.seen);
+    VIR_FREE(data.gone);
+    for (i = 0; i < nvols; i++) {
+        virStorageVolDefFree(vols[i]);
+        if (errs)
+            virFreeError(errs[i]);
+    }
+    VIR_FREE(vols);
+    VIR_FREE(rc);
+    VIR_FREE(errs);
     if (ret < 0)
         virStoragePoolObjClearVols(pool);
     return ret;
@@ -3793,7 +4209,8 @@ virStorageBackendSCSISerial(const char *dev)
 
 
 /*
- * Attempt to create a new LUN
+ * Attempt to create a new LUN, the volume is returned in @volret and is
+ * not added to @pool yet
  *
  * Returns:
  *
@@ -3808,7 +4225,8 @@ virStorageBackendSCSINewLun(virStoragePoolObjPtr pool,
                             uint32_t bus,
                             uint32_t target,
                             uint32_t lun,
-                            const char *dev)
+                            const char *dev,
+                            virStorageVolDefPtr *volret)
 {
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     virStorageVolDefPtr vol = NULL;
@@ -3880,13 +4298,7 @@ virStorageBackendSCSINewLun(virStoragePoolObjPtr pool,
     if (!(vol->key = virStorageBackendSCSISerial(vol->target.path)))
         goto cleanup;
 
-    def->capacity += vol->target.capacity;
-    def->allocation += vol->target.allocation;
-
-    if (virStoragePoolObjAddVol(pool, vol) < 0)
-        goto cleanup;
-    vol = NULL;
-
+    VIR_STEAL_PTR(*volret, vol);
     retval = 0;
 
  cleanup:
@@ -4097,7 +4509,7 @@ getDeviceType(uint32_t host,
  *
  * Returns:
  *
- *  0  => Found a valid entry
+ *  0  => Found a valid entry, its volume is returned in @vol
  *  -1 => Some sort of fatal error
  *  -2 => non-fatal error or a non-disk entry
  */
@@ -4106,7 +4518,8 @@ processLU(virStoragePoolObjPtr pool,
           uint32_t host,
           uint32_t bus,
           uint32_t target,
-          uint32_t lun)
+          uint32_t lun,
+          virStorageVolDefPtr *vol)
 {
     int retval = -1;
     int device_type;
@@ -4138,7 +4551,7 @@ processLU(virStoragePoolObjPtr pool,
     }
 
     retval = virStorageBackendSCSINewLun(pool, host, bus, target, lun,
-                                         block_device);
+                                         block_device, vol);
     if (retval < 0) {
         VIR_DEBUG("Failed to create new storage volume for %u:%u:%u:%u",
                   host, bus, target, lun);
@@ -4154,18 +4567,51 @@ processLU(virStoragePoolObjPtr pool,
 }
 
 
+typedef struct _virStorageBackendSCSILU virStorageBackendSCSILU;
+struct _virStorageBackendSCSILU {
+    uint32_t bus;
+    uint32_t target;
+    uint32_t lun;
+    virStorageVolDefPtr vol;
+};
+
+struct virStorageBackendSCSIFindLUsData {
+    virStoragePoolObjPtr pool;
+    uint32_t host;
+    virStorageBackendSCSILU *lus;
+};
+
+
+static int
+virStorageBackendSCSIProbeLU(size_t idx,
+                             void *opaque)
+{
+    struct virStorageBackendSCSIFindLUsData *data = opaque;
+    virStorageBackendSCSILU *lu = &data->lus[idx];
+
+    return processLU(data->pool, data->host,
+                     lu->bus, lu->target, lu->lun, &lu->vol);
+}
+
+
 int
 virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
                               uint32_t scanhost)
 {
     virStoragePoolDefPtr def = virStoragePoolObjGetDef(pool);
     int retval = 0;
-    uint32_t bus, target, lun;
+    virStorageBackendSCSILU lu = { 0 };
+    struct virStorageBackendSCSIFindLUsData data = {
+        .pool = pool, .host = scanhost };
+    size_t nlus = 0;
+    int *rc = NULL;
+    virErrorPtr *errs = NULL;
     const char *device_path = "/sys/bus/scsi/devices";
     DIR *devicedir = NULL;
     struct dirent *lun_dirent = NULL;
     char devicepattern[64];
     int found = 0;
+    size_t i;
 
     VIR_DEBUG("Discovering LUs on host %u", scanhost);
 
@@ -4177,32 +4623,69 @@ virStorageBackendSCSIFindLUs(virStoragePoolObjPtr pool,
     snprintf(devicepattern, sizeof(devicepattern), "%u:%%u:%%u:%%u\n", scanhost);
 
     while ((retval = virDirRead(devicedir, &lun_dirent, device_path)) > 0) {
-        int rc;
-
         if (sscanf(lun_dirent->d_name, devicepattern,
-                   &bus, &target, &lun) != 3) {
+                   &lu.bus, &lu.target, &lu.lun) != 3) {
             continue;
         }
 
         VIR_DEBUG("Found possible LU '%s'", lun_dirent->d_name);
 
-        rc = processLU(pool, scanhost, bus, target, lun);
-        if (rc == -1) {
+        if (VIR_APPEND_ELEMENT(data.lus, nlus, lu) < 0) {
             retval = -1;
             break;
         }
-        if (rc == 0)
-            found++;
     }
 
     VIR_DIR_CLOSE(devicedir);
 
     if (retval < 0)
-        return -1;
+        goto cleanup;
+
+    /* Looking up the devices and their serial numbers takes a while,
+     * do that for all LUs at once */
+    if (VIR_ALLOC_N(rc, nlus) < 0 ||
+        VIR_ALLOC_N(errs, nlus) < 0 ||
+        virStorageBackendProbeParallel(nlus, virStorageBackendSCSIProbeLU,
+                                       &data, rc, errs) < 0) {
+        retval = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < nlus; i++) {
+        virStorageVolDefPtr vol = data.lus[i].vol;
+
+        if (rc[i] == -1) {
+            virSetError(errs[i]);
+            retval = -1;
+            goto cleanup;
+        }
+        if (rc[i] < 0)
+            continue;
+
+        def->capacity += vol->target.capacity;
+        def->allocation += vol->target.allocation;
+
+        if (virStoragePoolObjAddVol(pool, vol) < 0) {
+            retval = -1;
+            goto cleanup;
+        }
+        data.lus[i].vol = NULL;
+        found++;
+    }
 
     VIR_DEBUG("Found %d LUs for pool %s", found, def->name);
+    retval = found;
 
-    return found;
+ cleanup:
+    for (i = 0; i < nlus; i++) {
+        virStorageVolDefFree(data.lus[i].vol);
+        if (errs)
+            virFreeError(errs[i]);
+    }
+    VIR_FREE(data.lus);
+    VIR_FREE(rc);
+    VIR_FREE(errs);
+    return retval;
 }
 
 
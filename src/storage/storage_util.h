@@ -92,6 +92,14 @@ virStorageBackendRefreshVolTargetUpdate(virStorageVolDefPtr vol);
 
 int virStorageBackendRefreshLocal(virStoragePoolObjPtr pool);
 
+typedef int (*virStorageBackendProbeFunc)(size_t idx, void *opaque);
+
+int virStorageBackendProbeParallel(size_t nitems,
+                                   virStorageBackendProbeFunc func,
+                                   void *opaque,
+                                   int *rc,
+                                   virErrorPtr *errs);
+
 int virStorageUtilGlusterExtractPoolSources(const char *host,
                                             const char *xml,
                                             virStoragePoolSourceListPtr list,
@@ -119,6 +119,10 @@ struct _testDriver {
     virDomainObjListPtr domains;
     virNetworkObjListPtr networks;
     virObjectEventStatePtr eventState;
+
+    /* immutable after opening, simulated latencies in milliseconds */
+    unsigned int statsLatency;
+    unsigned int eventLatency;
 };
 typedef struct _testDriver testDriver;
 typedef testDriver *testDriverPtr;
@@ -630,6 +634,70 @@ testDomainGenerateIfnames(virDomainDefPtr domdef)
 }
 
 
+typedef struct _testDelayedEvent testDelayedEvent;
+typedef testDelayedEvent *testDelayedEventPtr;
+struct _testDelayedEvent {
+    virObjectEventStatePtr state;
+    virObjectEventPtr event;
+};
+
+static void
+testDelayedEventFire(int timer, void *opaque)
+{
+    testDelayedEventPtr data = opaque;
+
+    virObjectEventStateQueue(data->state, data->event);
+    data->event = NULL;
+    virEventRemoveTimeout(timer);
+}
+
+static void
+testDelayedEventFree(void *opaque)
+{
+    testDelayedEventPtr data = opaque;
+
+    virObjectUnref(data->state);
+    virObjectUnref(data->event);
+    VIR_FREE(data);
+}
+
+/* Queue @event, after the simulated event latency if there is one */
+static void
+testObjectEventQueue(testDriverPtr driver,
+                     virObjectEventPtr event)
+{
+    testDelayedEventPtr data;
+
+    if (!event)
+        return;
+
+    if (driver->eventLatency == 0 || VIR_ALLOC(data) < 0) {
+        virObjectEventStateQueue(driver->eventState, event);
+        return;
+    }
+
+    data->state = virObjectRef(driver->eventState);
+    data->event = event;
+
+    if (virEventAddTimeout(driver->eventLatency, testDelayedEventFire,
+                           data, testDelayedEventFree) < 0) {
+        /* Without an event loop the event cannot be delayed */
+        data->event = NULL;
+        testDelayedEventFree(data);
+        virObjectEventStateQueue(driver->eventState, event);
+    }
+}
+
+
+/* Simulate a hypervisor taking some time to collect statistics */
+static void
+testStatsDelay(testDriverPtr driver)
+{
+    if (driver->statsLatency > 0)
+        usleep(driver->statsLatency * 1000ULL);
+}
+
+
 static void
 testDomainShutdownState(virDomainPtr domain,
                         virDomainObjPtr privdom,
@@ -651,11 +719,12 @@ testDomainStartState(testDriverPtr privconn,
     int ret = -1;
 
     virDomainObjSetState(dom, VIR_DOMAIN_RUNNING, reason);
-    dom->def->id = virAtomicIntAdd(&privconn->nextDomID, 1);
+    virDomainObjListSetID(privconn->domains, dom,
+                          virAtomicIntAdd(&privconn->nextDomID, 1));
 
     if (virDomainObjSetDefTransient(privconn->caps,
                                     privconn->xmlopt,
-                                    dom) < 0) {
+                                    dom, NULL) < 0) {
         goto cleanup;
     }
 
@@ -1354,6 +1423,289 @@ testOpenDefault(virConnectPtr conn)
     goto cleanup;
 }
 
+/*
+ * test:///scale creates a large number of synthetic domains for load
+ * testing API clients. A single template domain is parsed from XML once
+ * and every domain is then built from it without any further XML parsing.
+ * Running domains don't get a separate live copy of their definition, the
+ * persistent definition is used as live one until the domain is stopped.
+ */
+#define TEST_SCALE_DOMAINS 1000
+#define TEST_SCALE_DISKS 1
+
+typedef struct _testScaleParams testScaleParams;
+struct _testScaleParams {
+    unsigned int domains;
+    unsigned int running;
+    unsigned int disks;
+    unsigned int statsLatency;
+    unsigned int eventLatency;
+};
+
+static int
+testScaleParseParams(virURIPtr uri,
+                     testScaleParams *params)
+{
+    size_t i;
+    size_t j;
+    bool running = false;
+    struct {
+        const char *name;
+        unsigned int *value;
+    } names[] = {
+        { "domains", &params->domains },
+        { "running", &params->running },
+        { "disks", &params->disks },
+        { "statsLatency", &params->statsLatency },
+        { "eventLatency", &params->eventLatency },
+    };
+
+    params->domains = TEST_SCALE_DOMAINS;
+    params->disks = TEST_SCALE_DISKS;
+
+    for (i = 0; i < uri->paramsCount; i++) {
+        virURIParamPtr param = &uri->params[i];
+
+        for (j = 0; j < ARRAY_CARDINALITY(names); j++) {
+            if (STREQ(param->name, names[j].name))
+                break;
+        }
+
+        if (j == ARRAY_CARDINALITY(names)) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("unknown parameter '%s' for test:///scale"),
+                           param->name);
+            return -1;
+        }
+
+        if (virStrToLong_uip(param->value, NULL, 10, names[j].value) < 0) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("invalid value '%s' of parameter '%s'"),
+                           param->value, param->name);
+            return -1;
+        }
+
+        if (names[j].value == &params->running)
+            running = true;
+    }
+
+    if (!running || params->running > params->domains)
+        params->running = params->domains;
+
+    return 0;
+}
+
+
+static virDomainDefPtr
+testScaleTemplateNew(testDriverPtr privconn,
+                     unsigned int disks)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virDomainDefPtr def = NULL;
+    char *xml = NULL;
+    char *dst = NULL;
+    size_t i;
+
+    virBufferAddLit(&buf, "<domain type='test'>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, "<name>scale</name>\n");
+    virBufferAddLit(&buf, "<uuid>6695eb01-f6a4-8304-79aa-000000000000</uuid>\n");
+    virBufferAddLit(&buf, "<memory>1048576</memory>\n");
+    virBufferAddLit(&buf, "<vcpu>1</vcpu>\n");
+    virBufferAddLit(&buf, "<os>\n");
+    virBufferAddLit(&buf, "  <type>hvm</type>\n");
+    virBufferAddLit(&buf, "</os>\n");
+    virBufferAddLit(&buf, "<devices>\n");
+    virBufferAdjustIndent(&buf, 2);
+
+    for (i = 0; i < disks; i++) {
+        if (!(dst = virIndexToDiskName(i, "vd")))
+            goto cleanup;
+
+        virBufferAddLit(&buf, "<disk type='file' device='disk'>\n");
+        virBufferAsprintf(&buf, "  <source file='/scale/%s.img'/>\n", dst);
+        virBufferAsprintf(&buf, "  <target dev='%s' bus='virtio'/>\n", dst);
+        virBufferAddLit(&buf, "</disk>\n");
+        VIR_FREE(dst);
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</devices>\n");
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domain>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    xml = virBufferContentAndReset(&buf);
+
+    def = virDomainDefParseString(xml, privconn->caps, privconn->xmlopt, NULL,
+                                  VIR_DOMAIN_DEF_PARSE_INACTIVE);
+
+ cleanup:
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(xml);
+    VIR_FREE(dst);
+    return def;
+}
+
+
+static virDomainDefPtr
+testScaleDomainDefNew(testDriverPtr privconn,
+                      virDomainDefPtr tmpl,
+                      size_t idx)
+{
+    virDomainDefPtr def;
+    virDomainDiskDefPtr disk = NULL;
+    size_t i;
+
+    if (!(def = virDomainDefNew()))
+        return NULL;
+
+    def->virtType = tmpl->virtType;
+    def->os.type = tmpl->os.type;
+    def->os.arch = tmpl->os.arch;
+    def->onReboot = tmpl->onReboot;
+    def->onPoweroff = tmpl->onPoweroff;
+    def->onCrash = tmpl->onCrash;
+    virDomainDefSetMemoryTotal(def, virDomainDefGetMemoryTotal(tmpl));
+    def->mem.cur_balloon = tmpl->mem.cur_balloon;
+
+    /* The index makes up the last bytes of the UUID */
+    memcpy(def->uuid, tmpl->uuid, VIR_UUID_BUFLEN);
+    def->uuid[VIR_UUID_BUFLEN - 4] = (idx >> 24) & 0xff;
+    def->uuid[VIR_UUID_BUFLEN - 3] = (idx >> 16) & 0xff;
+    def->uuid[VIR_UUID_BUFLEN - 2] = (idx >> 8) & 0xff;
+    def->uuid[VIR_UUID_BUFLEN - 1] = idx & 0xff;
+
+    if (virAsprintf(&def->name, "%s-%zu", tmpl->name, idx) < 0 ||
+        VIR_STRDUP(def->os.machine, tmpl->os.machine) < 0 ||
+        virDomainDefSetVcpusMax(def, virDomainDefGetVcpusMax(tmpl),
+                                privconn->xmlopt) < 0 ||
+        virDomainDefSetVcpus(def, virDomainDefGetVcpus(tmpl)) < 0)
+        goto error;
+
+    for (i = 0; i < tmpl->ndisks; i++) {
+        virDomainDiskDefPtr orig = tmpl->disks[i];
+
+        if (!(disk = virDomainDiskDefNew(privconn->xmlopt)))
+            goto error;
+
+        virStorageSourceFree(disk->src);
+        if (!(disk->src = virStorageSourceCopy(orig->src, false)))
+            goto error;
+
+        VIR_FREE(disk->src->path);
+        if (virAsprintf(&disk->src->path, "/scale/%s/%s.img",
+                        def->name, orig->dst) < 0 ||
+            VIR_STRDUP(disk->dst, orig->dst) < 0)
+            goto error;
+
+        disk->device = orig->device;
+        disk->bus = orig->bus;
+
+        if (VIR_APPEND_ELEMENT(def->disks, def->ndisks, disk) < 0)
+            goto error;
+    }
+
+    if (virDomainDefPostParse(def, privconn->caps,
+                              VIR_DOMAIN_DEF_PARSE_INACTIVE,
+                              privconn->xmlopt, NULL) < 0)
+        goto error;
+
+    return def;
+
+ error:
+    virDomainDiskDefFree(disk);
+    virDomainDefFree(def);
+    return NULL;
+}
+
+
+static int
+testScaleDomains(testDriverPtr privconn,
+                 testScaleParams *params)
+{
+    int ret = -1;
+    virDomainDefPtr tmpl = NULL;
+    virDomainDefPtr def = NULL;
+    virDomainObjPtr obj = NULL;
+    size_t i;
+
+    if (!(tmpl = testScaleTemplateNew(privconn, params->disks)))
+        goto cleanup;
+
+    for (i = 0; i < params->domains; i++) {
+        if (!(def = testScaleDomainDefNew(privconn, tmpl, i)))
+            goto cleanup;
+
+        if (!(obj = virDomainObjListAdd(privconn->domains, def,
+                                        privconn->xmlopt, 0, NULL)))
+            goto cleanup;
+        def = NULL;
+
+        obj->persistent = 1;
+
+        if (i < params->running) {
+            virDomainObjSetState(obj, VIR_DOMAIN_RUNNING,
+                                 VIR_DOMAIN_RUNNING_BOOTED);
+            virDomainObjListSetID(privconn->domains, obj,
+                                  virAtomicIntAdd(&privconn->nextDomID, 1));
+        } else {
+            virDomainObjSetState(obj, VIR_DOMAIN_SHUTOFF,
+                                 VIR_DOMAIN_SHUTOFF_UNKNOWN);
+        }
+
+        virDomainObjEndAPI(&obj);
+    }
+
+    ret = 0;
+ cleanup:
+    virDomainObjEndAPI(&obj);
+    virDomainDefFree(def);
+    virDomainDefFree(tmpl);
+    return ret;
+}
+
+
+/* No shared state between simultaneous test:///scale connections */
+static int
+testOpenScale(virConnectPtr conn)
+{
+    testDriverPtr privconn;
+    testScaleParams params;
+
+    memset(&params, 0, sizeof(params));
+
+    if (testScaleParseParams(conn->uri, &params) < 0)
+        return VIR_DRV_OPEN_ERROR;
+
+    if (!(privconn = testDriverNew()))
+        return VIR_DRV_OPEN_ERROR;
+
+    testDriverLock(privconn);
+    conn->privateData = privconn;
+
+    memmove(&privconn->nodeInfo, &defaultNodeInfo, sizeof(defaultNodeInfo));
+    privconn->statsLatency = params.statsLatency;
+    privconn->eventLatency = params.eventLatency;
+
+    if (!(privconn->caps = testBuildCapabilities(conn)))
+        goto error;
+
+    if (testScaleDomains(privconn, &params) < 0)
+        goto error;
+
+    testDriverUnlock(privconn);
+
+    return VIR_DRV_OPEN_SUCCESS;
+
+ error:
+    testDriverFree(privconn);
+    conn->privateData = NULL;
+    return VIR_DRV_OPEN_ERROR;
+}
+
 static int
 testConnectAuthenticate(virConnectPtr conn,
                         virConnectAuthPtr auth)
@@ -1450,6 +1802,8 @@ testConnectOpen(virConnectPtr conn,
 
     if (STREQ(conn->uri->path, "/default"))
         ret = testOpenDefault(conn);
+    else if (STREQ(conn->uri->path, "/scale"))
+        ret = testOpenScale(conn);
     else
         ret = testOpenFromFile(conn,
                                conn->uri->path);
@@ -1678,7 +2032,7 @@ testDomainCreateXML(virConnectPtr conn, const char *xml,
 
  cleanup:
     virDomainObjEndAPI(&dom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virDomainDefFree(def);
     testDriverUnlock(privconn);
     return ret;
@@ -1777,7 +2131,7 @@ static int testDomainDestroyFlags(virDomainPtr domain,
     ret = 0;
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -1811,7 +2165,7 @@ static int testDomainResume(virDomainPtr domain)
 
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -1841,7 +2195,7 @@ static int testDomainSuspend(virDomainPtr domain)
 
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -1876,7 +2230,7 @@ static int testDomainShutdownFlags(virDomainPtr domain,
     ret = 0;
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -1944,7 +2298,7 @@ static int testDomainReboot(virDomainPtr domain,
     ret = 0;
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -2088,7 +2442,7 @@ testDomainSaveFlags(virDomainPtr domain, const char *path,
         unlink(path);
     }
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -2191,7 +2545,7 @@ testDomainRestoreFlags(virConnectPtr conn,
     VIR_FREE(xml);
     VIR_FORCE_CLOSE(fd);
     virDomainObjEndAPI(&dom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -2261,7 +2615,7 @@ static int testDomainCoreDumpWithFormat(virDomainPtr domain,
  cleanup:
     VIR_FORCE_CLOSE(fd);
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -2635,8 +2989,8 @@ testDomainRenameCallback(virDomainObjPtr privdom,
  cleanup:
     VIR_FREE(old_dom_name);
     VIR_FREE(new_dom_name);
-    virObjectEventStateQueue(driver->eventState, event_old);
-    virObjectEventStateQueue(driver->eventState, event_new);
+    testObjectEventQueue(driver, event_old);
+    testObjectEventQueue(driver, event_new);
     return ret;
 }
 
@@ -2771,7 +3125,7 @@ static virDomainPtr testDomainDefineXMLFlags(virConnectPtr conn,
     virDomainDefFree(def);
     virDomainDefFree(oldDef);
     virDomainObjEndAPI(&dom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -2825,7 +3179,7 @@ static int testDomainSetMetadata(virDomainPtr dom,
     if (ret == 0) {
         virObjectEventPtr ev = NULL;
         ev = virDomainEventMetadataChangeNewFromObj(privdom, type, uri);
-        virObjectEventStateQueue(privconn->eventState, ev);
+        testObjectEventQueue(privconn, ev);
     }
 
     virDomainObjEndAPI(&privdom);
@@ -2980,7 +3334,7 @@ static int testDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
 
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     testDriverUnlock(privconn);
     return ret;
 }
@@ -3046,7 +3400,7 @@ static int testDomainUndefineFlags(virDomainPtr domain,
 
  cleanup:
     virDomainObjEndAPI(&privdom);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return ret;
 }
 
@@ -3189,6 +3543,8 @@ static int testDomainBlockStats(virDomainPtr domain,
         return ret;
     }
 
+    testStatsDelay(domain->conn->privateData);
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return ret;
 
@@ -3233,6 +3589,8 @@ testDomainInterfaceStats(virDomainPtr domain,
     int ret = -1;
 
 
+    testStatsDelay(domain->conn->privateData);
+
     if (!(privdom = testDomObjFromDomain(domain)))
         return -1;
 
@@ -3471,7 +3829,7 @@ testNetworkCreateXML(virConnectPtr conn, const char *xml)
 
  cleanup:
     virNetworkDefFree(newDef);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virNetworkObjEndAPI(&obj);
     return net;
 }
@@ -3504,7 +3862,7 @@ testNetworkDefineXML(virConnectPtr conn,
 
  cleanup:
     virNetworkDefFree(newDef);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virNetworkObjEndAPI(&obj);
     return net;
 }
@@ -3535,19 +3893,17 @@ testNetworkUndefine(virNetworkPtr net)
     ret = 0;
 
  cleanup:
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virNetworkObjEndAPI(&obj);
     return ret;
 }
 
 
 static int
-testNetworkUpdate(virNetworkPtr net,
-                  unsigned int command,
-                  unsigned int section,
-                  int parentIndex,
-                  const char *xml,
-                  unsigned int flags)
+testNetworkUpdateBatch(virNetworkPtr net,
+                       virNetworkUpdateItemPtr items,
+                       unsigned int nitems,
+                       unsigned int flags)
 {
     testDriverPtr privconn = net->conn->privateData;
     virNetworkObjPtr obj = NULL;
@@ -3574,7 +3930,7 @@ testNetworkUpdate(virNetworkPtr net,
     }
 
     /* update the network config in memory/on disk */
-    if (virNetworkObjUpdate(obj, command, section, parentIndex, xml, flags) < 0)
+    if (virNetworkObjUpdateBatch(obj, items, nitems, flags) < 0)
        goto cleanup;
 
     ret = 0;
@@ -3584,6 +3940,25 @@ testNetworkUpdate(virNetworkPtr net,
 }
 
 
+static int
+testNetworkUpdate(virNetworkPtr net,
+                  unsigned int command,
+                  unsigned int section,
+                  int parentIndex,
+                  const char *xml,
+                  unsigned int flags)
+{
+    virNetworkUpdateItem item = {
+        .command = command,
+        .section = section,
+        .parentIndex = parentIndex,
+        .xml = xml,
+    };
+
+    return testNetworkUpdateBatch(net, &item, 1, flags);
+}
+
+
 static int
 testNetworkCreate(virNetworkPtr net)
 {
@@ -3610,7 +3985,7 @@ testNetworkCreate(virNetworkPtr net)
     ret = 0;
 
  cleanup:
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virNetworkObjEndAPI(&obj);
     return ret;
 }
@@ -3639,7 +4014,7 @@ testNetworkDestroy(virNetworkPtr net)
     ret = 0;
 
  cleanup:
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virNetworkObjEndAPI(&obj);
     return ret;
 }
@@ -4407,7 +4782,7 @@ testStoragePoolCreate(virStoragePoolPtr pool,
                                             VIR_STORAGE_POOL_EVENT_STARTED,
                                             0);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virStoragePoolObjEndAPI(&obj);
     return 0;
 }
@@ -4554,7 +4929,7 @@ testStoragePoolCreateXML(virConnectPtr conn,
 
  cleanup:
     virStoragePoolDefFree(newDef);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virStoragePoolObjEndAPI(&obj);
     testDriverUnlock(privconn);
     return pool;
@@ -4603,7 +4978,7 @@ testStoragePoolDefineXML(virConnectPtr conn,
 
  cleanup:
     virStoragePoolDefFree(newDef);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virStoragePoolObjEndAPI(&obj);
     testDriverUnlock(privconn);
     return pool;
@@ -4627,7 +5002,7 @@ testStoragePoolUndefine(virStoragePoolPtr pool)
     virStoragePoolObjRemove(privconn->pools, obj);
     virObjectUnref(obj);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return 0;
 }
 
@@ -4651,7 +5026,7 @@ testStoragePoolBuild(virStoragePoolPtr pool,
 
     virStoragePoolObjEndAPI(&obj);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return 0;
 }
 
@@ -4685,7 +5060,7 @@ testDestroyVport(testDriverPtr privconn,
     virNodeDeviceObjListRemove(privconn->devs, obj);
     virObjectUnref(obj);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     return 0;
 }
 
@@ -4725,7 +5100,7 @@ testStoragePoolDestroy(virStoragePoolPtr pool)
     ret = 0;
 
  cleanup:
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virStoragePoolObjEndAPI(&obj);
     return ret;
 }
@@ -4748,7 +5123,7 @@ testStoragePoolDelete(virStoragePoolPtr pool,
                                             VIR_STORAGE_POOL_EVENT_DELETED,
                                             0);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
 
     virStoragePoolObjEndAPI(&obj);
     return 0;
@@ -4770,7 +5145,7 @@ testStoragePoolRefresh(virStoragePoolPtr pool,
 
     event = virStoragePoolEventRefreshNew(pool->name, pool->uuid);
 
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virStoragePoolObjEndAPI(&obj);
     return 0;
 }
@@ -5566,7 +5941,7 @@ testNodeDeviceMockCreateVport(testDriverPtr driver,
     event = virNodeDeviceEventLifecycleNew(objdef->name,
                                            VIR_NODE_DEVICE_EVENT_CREATED,
                                            0);
-    virObjectEventStateQueue(driver->eventState, event);
+    testObjectEventQueue(driver, event);
 
  cleanup:
     VIR_FREE(xml);
@@ -5678,7 +6053,7 @@ testNodeDeviceDestroy(virNodeDevicePtr dev)
 
  cleanup:
     virNodeDeviceObjEndAPI(&obj);
-    virObjectEventStateQueue(driver->eventState, event);
+    testObjectEventQueue(driver, event);
     VIR_FREE(wwnn);
     VIR_FREE(wwpn);
     return ret;
@@ -5863,6 +6238,21 @@ static int testConnectListAllDomains(virConnectPtr conn,
                                   NULL, flags);
 }
 
+static int
+testConnectGetDomainsChangedSince(virConnectPtr conn,
+                                  unsigned long long generation,
+                                  unsigned long long *newgeneration,
+                                  virDomainPtr **changed,
+                                  unsigned int flags)
+{
+    testDriverPtr privconn = conn->privateData;
+
+    virCheckFlags(0, -1);
+
+    return virDomainObjListExportChanged(privconn->domains, conn, generation,
+                                         newgeneration, changed, NULL);
+}
+
 static int
 testNodeGetCPUMap(virConnectPtr conn ATTRIBUTE_UNUSED,
                   unsigned char **cpumap,
@@ -5955,7 +6345,7 @@ testDomainManagedSave(virDomainPtr dom, unsigned int flags)
     ret = 0;
  cleanup:
     virDomainObjEndAPI(&vm);
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
 
     return ret;
 }
@@ -6472,7 +6862,7 @@ testDomainSnapshotCreateXML(virDomainPtr domain,
         }
         virDomainObjEndAPI(&vm);
     }
-    virObjectEventStateQueue(privconn->eventState, event);
+    testObjectEventQueue(privconn, event);
     virDomainSnapshotDefFree(def);
     return snapshot;
 }
@@ -6713,7 +7103,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
                 event = virDomainEventLifecycleNewFromObj(vm,
                             VIR_DOMAIN_EVENT_STOPPED,
                             VIR_DOMAIN_EVENT_STOPPED_FROM_SNAPSHOT);
-                virObjectEventStateQueue(privconn->eventState, event);
+                testObjectEventQueue(privconn, event);
                 goto load;
             }
 
@@ -6792,7 +7182,7 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
             /* Flush first event, now do transition 2 or 3 */
             bool paused = (flags & VIR_DOMAIN_SNAPSHOT_REVERT_PAUSED) != 0;
 
-            virObjectEventStateQueue(privconn->eventState, event);
+            testObjectEventQueue(privconn, event);
             event = virDomainEventLifecycleNewFromObj(vm,
                             VIR_DOMAIN_EVENT_STARTED,
                             VIR_DOMAIN_EVENT_STARTED_FROM_SNAPSHOT);
@@ -6808,8 +7198,8 @@ testDomainRevertToSnapshot(virDomainSnapshotPtr snapshot,
     ret = 0;
  cleanup:
     if (event) {
-        virObjectEventStateQueue(privconn->eventState, event);
-        virObjectEventStateQueue(privconn->eventState, event2);
+        testObjectEventQueue(privconn, event);
+        testObjectEventQueue(privconn, event2);
     } else {
         virObjectUnref(event2);
     }
@@ -6837,6 +7227,7 @@ static virHypervisorDriver testHypervisorDriver = {
     .connectListDomains = testConnectListDomains, /* 0.1.1 */
     .connectNumOfDomains = testConnectNumOfDomains, /* 0.1.1 */
     .connectListAllDomains = testConnectListAllDomains, /* 0.9.13 */
+    .connectGetDomainsChangedSince = testConnectGetDomainsChangedSince, /* 4.10.0 */
     .domainCreateXML = testDomainCreateXML, /* 0.1.4 */
     .domainLookupByID = testDomainLookupByID, /* 0.1.1 */
     .domainLookupByUUID = testDomainLookupByUUID, /* 0.1.1 */
@@ -6948,6 +7339,7 @@ static virNetworkDriver testNetworkDriver = {
     .networkSetAutostart = testNetworkSetAutostart, /* 0.3.2 */
     .networkIsActive = testNetworkIsActive, /* 0.7.3 */
     .networkIsPersistent = testNetworkIsPersistent, /* 0.7.3 */
+    .networkUpdateBatch = testNetworkUpdateBatch, /* 4.10.0 */
 };
 
 static virInterfaceDriver testInterfaceDriver = {
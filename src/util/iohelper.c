@@ -41,32 +41,203 @@
 
 #define VIR_FROM_THIS VIR_FROM_STORAGE
 
+#define IOHELPER_QUEUE_DEPTH_DEFAULT 4
+#define IOHELPER_QUEUE_DEPTH_MAX 64
+#define IOHELPER_CHUNK_SIZE_DEFAULT (1024 * 1024)
+#define IOHELPER_CHUNK_SIZE_MAX (64 * 1024 * 1024)
+#define IOHELPER_ALIGN (64 * 1024)
+
+typedef struct _runIOBuffer runIOBuffer;
+struct _runIOBuffer {
+    void *base; /* Location to be freed */
+    char *buf; /* Aligned location within base */
+    ssize_t len;
+};
+
+/*
+ * Reading from the source and writing to the destination are done by
+ * two threads which hand buffers to each other through a ring of
+ * @depth buffers, so that a slow write to disk doesn't stall reading
+ * the stream from QEMU and vice versa.
+ *
+ * The queue is shared by both threads, each holding a reference. If
+ * writing fails the reader thread might be blocked in read() for a
+ * while, so whichever thread drops the last reference frees it.
+ */
+typedef struct _runIOQueue runIOQueue;
+struct _runIOQueue {
+    virMutex lock;
+    virCond cond;
+    int refs;
+
+    int fdin;
+    bool directRead;
+
+    size_t buflen;
+    size_t depth;
+    runIOBuffer *bufs;
+    size_t head; /* next buffer to be filled by the reader */
+    size_t tail; /* next buffer to be written out */
+    size_t nfilled;
+
+    bool eof;
+    bool quit;
+    int readErrno;
+};
+
+
+static void
+runIOQueueUnref(runIOQueue *q)
+{
+    size_t i;
+    bool last;
+
+    virMutexLock(&q->lock);
+    last = --q->refs == 0;
+    virMutexUnlock(&q->lock);
+
+    if (!last)
+        return;
+
+    for (i = 0; i < q->depth; i++)
+        VIR_FREE(q->bufs[i].base);
+    VIR_FREE(q->bufs);
+    virCondDestroy(&q->cond);
+    virMutexDestroy(&q->lock);
+    VIR_FREE(q);
+}
+
+
 static int
-runIO(const char *path, int fd, int oflags)
+runIOBufferAlloc(runIOBuffer *buf, size_t buflen)
 {
-    VIR_AUTOFREE(void *) base = NULL; /* Location to be freed */
-    char *buf = NULL; /* Aligned location within base */
-    size_t buflen = 1024*1024;
-    intptr_t alignMask = 64*1024 - 1;
-    int ret = -1;
-    int fdin, fdout;
-    const char *fdinname, *fdoutname;
-    unsigned long long total = 0;
-    bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
-    off_t end = 0;
+    intptr_t alignMask = IOHELPER_ALIGN - 1;
 
 #if HAVE_POSIX_MEMALIGN
-    if (posix_memalign(&base, alignMask + 1, buflen)) {
+    if (posix_memalign(&buf->base, alignMask + 1, buflen)) {
         virReportOOMError();
-        goto cleanup;
+        return -1;
     }
-    buf = base;
+    buf->buf = buf->base;
 #else
-    if (VIR_ALLOC_N(buf, buflen + alignMask) < 0)
-        goto cleanup;
-    base = buf;
-    buf = (char *) (((intptr_t) base + alignMask) & ~alignMask);
+    if (VIR_ALLOC_N(buf->buf, buflen + alignMask) < 0)
+        return -1;
+    buf->base = buf->buf;
+    buf->buf = (char *) (((intptr_t) buf->base + alignMask) & ~alignMask);
 #endif
+    return 0;
+}
+
+
+static runIOQueue *
+runIOQueueNew(int fdin, bool directRead, size_t depth, size_t buflen)
+{
+    runIOQueue *q;
+    size_t i;
+
+    if (VIR_ALLOC(q) < 0)
+        return NULL;
+
+    if (virMutexInit(&q->lock) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init mutex"));
+        VIR_FREE(q);
+        return NULL;
+    }
+
+    if (virCondInit(&q->cond) < 0) {
+        virReportSystemError(errno, "%s", _("unable to init condition"));
+        virMutexDestroy(&q->lock);
+        VIR_FREE(q);
+        return NULL;
+    }
+
+    q->refs = 1;
+    q->fdin = fdin;
+    q->directRead = directRead;
+    q->buflen = buflen;
+
+    if (VIR_ALLOC_N(q->bufs, depth) < 0)
+        goto error;
+    q->depth = depth;
+
+    for (i = 0; i < depth; i++) {
+        if (runIOBufferAlloc(&q->bufs[i], buflen) < 0)
+            goto error;
+    }
+
+    return q;
+
+ error:
+    runIOQueueUnref(q);
+    return NULL;
+}
+
+
+static void
+runIOReader(void *opaque)
+{
+    runIOQueue *q = opaque;
+
+    virMutexLock(&q->lock);
+    while (!q->quit) {
+        runIOBuffer *buf;
+        ssize_t got;
+
+        if (q->nfilled == q->depth) {
+            ignore_value(virCondWait(&q->cond, &q->lock));
+            continue;
+        }
+
+        /* The writer never touches buffers which are not filled yet */
+        buf = &q->bufs[q->head];
+        virMutexUnlock(&q->lock);
+
+        /* If we read with O_DIRECT from file we can't use saferead as
+         * it can lead to unaligned read after reading last bytes.
+         * If we write with O_DIRECT use should use saferead so that
+         * writes will be aligned.
+         * In other cases using saferead reduces number of syscalls.
+         */
+        if (q->directRead) {
+            while ((got = read(q->fdin, buf->buf, q->buflen)) < 0 &&
+                   errno == EINTR)
+                ;
+        } else {
+            got = saferead(q->fdin, buf->buf, q->buflen);
+        }
+
+        virMutexLock(&q->lock);
+        if (got <= 0) {
+            if (got < 0)
+                q->readErrno = errno;
+            q->eof = true;
+            virCondSignal(&q->cond);
+            break;
+        }
+
+        buf->len = got;
+        q->head = (q->head + 1) % q->depth;
+        q->nfilled++;
+        virCondSignal(&q->cond);
+    }
+    virMutexUnlock(&q->lock);
+
+    runIOQueueUnref(q);
+}
+
+
+static int
+runIO(const char *path, int fd, int oflags, size_t depth, size_t buflen)
+{
+    intptr_t alignMask = IOHELPER_ALIGN - 1;
+    int ret = -1;
+    int fdin, fdout;
+    const char *fdinname, *fdoutname;
+    unsigned long long total = 0;
+    bool direct = O_DIRECT && ((oflags & O_DIRECT) != 0);
+    off_t end = 0;
+    runIOQueue *q = NULL;
+    virThread reader;
 
     switch (oflags & O_ACCMODE) {
     case O_RDONLY:
@@ -104,29 +275,33 @@ runIO(const char *path, int fd, int oflags)
         goto cleanup;
     }
 
+    if (!(q = runIOQueueNew(fdin, fdin == fd && direct, depth, buflen)))
+        goto cleanup;
+
+    q->refs++;
+    if (virThreadCreate(&reader, false, runIOReader, q) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to create reader thread"));
+        q->refs--;
+        goto cleanup;
+    }
+
+    virMutexLock(&q->lock);
     while (1) {
+        runIOBuffer *buf;
         ssize_t got;
 
-        /* If we read with O_DIRECT from file we can't use saferead as
-         * it can lead to unaligned read after reading last bytes.
-         * If we write with O_DIRECT use should use saferead so that
-         * writes will be aligned.
-         * In other cases using saferead reduces number of syscalls.
-         */
-        if (fdin == fd && direct) {
-            if ((got = read(fdin, buf, buflen)) < 0 &&
-                errno == EINTR)
-                continue;
-        } else {
-            got = saferead(fdin, buf, buflen);
+        if (q->nfilled == 0) {
+            if (q->eof)
+                break;
+            ignore_value(virCondWait(&q->cond, &q->lock));
+            continue;
         }
 
-        if (got < 0) {
-            virReportSystemError(errno, _("Unable to read %s"), fdinname);
-            goto cleanup;
-        }
-        if (got == 0)
-            break;
+        /* The reader never touches buffers which are not written yet */
+        buf = &q->bufs[q->tail];
+        got = buf->len;
+        virMutexUnlock(&q->lock);
 
         total += got;
 
@@ -134,9 +309,9 @@ runIO(const char *path, int fd, int oflags)
         if (got < buflen && direct && fdout == fd) {
             ssize_t aligned_got = (got + alignMask) & ~alignMask;
 
-            memset(buf + got, 0, aligned_got - got);
+            memset(buf->buf + got, 0, aligned_got - got);
 
-            if (safewrite(fdout, buf, aligned_got) < 0) {
+            if (safewrite(fdout, buf->buf, aligned_got) < 0) {
                 virReportSystemError(errno, _("Unable to write %s"), fdoutname);
                 goto cleanup;
             }
@@ -146,15 +321,28 @@ runIO(const char *path, int fd, int oflags)
                 goto cleanup;
             }
 
+            virMutexLock(&q->lock);
             break;
         }
 
-        if (safewrite(fdout, buf, got) < 0) {
+        if (safewrite(fdout, buf->buf, got) < 0) {
             virReportSystemError(errno, _("Unable to write %s"), fdoutname);
             goto cleanup;
         }
+
+        virMutexLock(&q->lock);
+        q->tail = (q->tail + 1) % q->depth;
+        q->nfilled--;
+        virCondSignal(&q->cond);
     }
 
+    if (q->readErrno) {
+        virReportSystemError(q->readErrno, _("Unable to read %s"), fdinname);
+        virMutexUnlock(&q->lock);
+        goto cleanup;
+    }
+    virMutexUnlock(&q->lock);
+
     /* Ensure all data is written */
     if (fdatasync(fdout) < 0) {
         if (errno != EINVAL && errno != EROFS) {
@@ -167,6 +355,14 @@ runIO(const char *path, int fd, int oflags)
     ret = 0;
 
  cleanup:
+    if (q) {
+        /* Tell the reader to stop, if it hasn't already */
+        virMutexLock(&q->lock);
+        q->quit = true;
+        virCondSignal(&q->cond);
+        virMutexUnlock(&q->lock);
+        runIOQueueUnref(q);
+    }
     if (VIR_CLOSE(fd) < 0 &&
         ret == 0) {
         virReportSystemError(errno, _("Unable to close %s"), path);
@@ -183,7 +379,8 @@ usage(int status)
     if (status) {
         fprintf(stderr, _("%s: try --help for more details"), program_name);
     } else {
-        printf(_("Usage: %s FILENAME FD\n"), program_name);
+        printf(_("Usage: %s FILENAME FD [QUEUE-DEPTH CHUNK-SIZE]\n"),
+               program_name);
     }
     exit(status);
 }
@@ -194,6 +391,8 @@ main(int argc, char **argv)
     const char *path;
     int oflags = -1;
     int fd = -1;
+    unsigned int depth = IOHELPER_QUEUE_DEPTH_DEFAULT;
+    unsigned int buflen = IOHELPER_CHUNK_SIZE_DEFAULT;
 
     program_name = argv[0];
 
@@ -208,7 +407,23 @@ main(int argc, char **argv)
 
     if (argc > 1 && STREQ(argv[1], "--help"))
         usage(EXIT_SUCCESS);
-    if (argc == 3) { /* FILENAME FD */
+    if (argc == 5) { /* FILENAME FD QUEUE-DEPTH CHUNK-SIZE */
+        if (virStrToLong_uip(argv[3], NULL, 10, &depth) < 0 ||
+            depth == 0 || depth > IOHELPER_QUEUE_DEPTH_MAX) {
+            fprintf(stderr, _("%s: malformed queue depth %s"),
+                    program_name, argv[3]);
+            exit(EXIT_FAILURE);
+        }
+        /* Writes with O_DIRECT need whole aligned chunks */
+        if (virStrToLong_uip(argv[4], NULL, 10, &buflen) < 0 ||
+            buflen == 0 || buflen > IOHELPER_CHUNK_SIZE_MAX ||
+            buflen % IOHELPER_ALIGN != 0) {
+            fprintf(stderr, _("%s: malformed chunk size %s"),
+                    program_name, argv[4]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (argc == 3 || argc == 5) { /* FILENAME FD */
         if (virStrToLong_i(argv[2], NULL, 10, &fd) < 0) {
             fprintf(stderr, _("%s: malformed fd %s"),
                     program_name, argv[3]);
@@ -232,7 +447,7 @@ main(int argc, char **argv)
         usage(EXIT_FAILURE);
     }
 
-    if (fd < 0 || runIO(path, fd, oflags) < 0)
+    if (fd < 0 || runIO(path, fd, oflags, depth, buflen) < 0)
         goto error;
 
     return 0;
@@ -23,8 +23,10 @@
 #include <config.h>
 
 #include "viralloc.h"
+#include "viratomic.h"
 #include "virlog.h"
 #include "virerror.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -105,6 +107,238 @@ void virAllocTestHook(void (*func)(int, void*) ATTRIBUTE_UNUSED,
 #endif
 
 
+/* Allocation profiling. Call-sites are kept in a fixed size open
+ * addressing table so that recording a sample never allocates memory. */
+#define VIR_ALLOC_PROFILE_SITES 4096
+#define VIR_ALLOC_PROFILE_PROBES 32
+
+static int virAllocProfileRate;
+static int virAllocProfileTick;
+static virMutex virAllocProfileLock;
+static virAllocProfileEntry virAllocProfileDomains[VIR_ERR_DOMAIN_LAST];
+static virAllocProfileEntry virAllocProfileSites[VIR_ALLOC_PROFILE_SITES];
+static unsigned long long virAllocProfileDropped;
+
+static int
+virAllocProfileOnceInit(void)
+{
+    return virMutexInit(&virAllocProfileLock);
+}
+
+VIR_ONCE_GLOBAL_INIT(virAllocProfile)
+
+
+static size_t
+virAllocProfileHash(const char *filename,
+                    size_t linenr)
+{
+    size_t hash = linenr * 2654435761u;
+
+    for (; *filename; filename++)
+        hash = (hash ^ (unsigned char) *filename) * 16777619;
+
+    return hash;
+}
+
+
+/**
+ * virAllocProfileRecord:
+ * @domcode: error domain code
+ * @filename: caller's filename
+ * @funcname: caller's funcname
+ * @linenr: caller's line number
+ * @size: number of bytes allocated
+ *
+ * Accounts an allocation of @size bytes to the given call-site and error
+ * domain, if allocation profiling is enabled. Only every n-th call is
+ * sampled, with n being the rate passed to virAllocProfileSetRate; the
+ * samples are scaled accordingly.
+ */
+void
+virAllocProfileRecord(int domcode,
+                      const char *filename,
+                      const char *funcname,
+                      size_t linenr,
+                      size_t size)
+{
+    unsigned int rate = virAtomicIntGet(&virAllocProfileRate);
+    virAllocProfileEntryPtr site = NULL;
+    size_t hash;
+    size_t i;
+
+    if (rate == 0)
+        return;
+
+    if (rate > 1 &&
+        (unsigned int) virAtomicIntInc(&virAllocProfileTick) % rate != 0)
+        return;
+
+    if (domcode < 0 || domcode >= VIR_ERR_DOMAIN_LAST)
+        domcode = VIR_FROM_NONE;
+    if (!filename)
+        filename = "unknown";
+
+    hash = virAllocProfileHash(filename, linenr);
+
+    virMutexLock(&virAllocProfileLock);
+
+    virAllocProfileDomains[domcode].domcode = domcode;
+    virAllocProfileDomains[domcode].allocs += rate;
+    virAllocProfileDomains[domcode].bytes += (unsigned long long) size * rate;
+
+    for (i = 0; i < VIR_ALLOC_PROFILE_PROBES; i++) {
+        virAllocProfileEntryPtr tmp;
+
+        tmp = &virAllocProfileSites[(hash + i) % VIR_ALLOC_PROFILE_SITES];
+
+        if (!tmp->filename) {
+            tmp->domcode = domcode;
+            tmp->filename = filename;
+            tmp->funcname = funcname;
+            tmp->linenr = linenr;
+        } else if (tmp->linenr != linenr || STRNEQ(tmp->filename, filename)) {
+            continue;
+        }
+
+        site = tmp;
+        break;
+    }
+
+    if (site) {
+        site->allocs += rate;
+        site->bytes += (unsigned long long) size * rate;
+    } else {
+        virAllocProfileDropped += rate;
+    }
+
+    virMutexUnlock(&virAllocProfileLock);
+}
+
+
+/**
+ * virAllocProfileSetRate:
+ * @rate: sample every @rate-th allocation, 0 disables profiling
+ * @reset: whether to clear the data collected so far
+ *
+ * Enables or disables allocation profiling. The filenames and
+ * function names recorded point to the callers' static strings, so
+ * the data must not outlive the modules that did the allocations.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virAllocProfileSetRate(unsigned int rate,
+                       bool reset)
+{
+    if (virAllocProfileInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virAllocProfileLock);
+    if (reset) {
+        memset(virAllocProfileDomains, 0, sizeof(virAllocProfileDomains));
+        memset(virAllocProfileSites, 0, sizeof(virAllocProfileSites));
+        virAllocProfileDropped = 0;
+    }
+    virAtomicIntSet(&virAllocProfileRate, rate);
+    virMutexUnlock(&virAllocProfileLock);
+
+    VIR_DEBUG("Allocation profiling rate set to %u", rate);
+    return 0;
+}
+
+
+unsigned int
+virAllocProfileGetRate(void)
+{
+    return virAtomicIntGet(&virAllocProfileRate);
+}
+
+
+static int
+virAllocProfileCompareBytes(const void *a,
+                            const void *b)
+{
+    const virAllocProfileEntry *ea = a;
+    const virAllocProfileEntry *eb = b;
+
+    if (ea->bytes > eb->bytes)
+        return -1;
+    return ea->bytes < eb->bytes;
+}
+
+
+static size_t
+virAllocProfileCopy(virAllocProfileEntryPtr dst,
+                    const virAllocProfileEntry *src,
+                    size_t nsrc)
+{
+    size_t n = 0;
+    size_t i;
+
+    for (i = 0; i < nsrc; i++) {
+        if (src[i].allocs)
+            dst[n++] = src[i];
+    }
+
+    return n;
+}
+
+
+/**
+ * virAllocProfileGetStats:
+ * @domains: filled with accounting per error domain
+ * @ndomains: number of entries in @domains
+ * @sites: filled with accounting per call-site
+ * @nsites: number of entries in @sites
+ * @dropped: number of allocations which couldn't be attributed to a
+ *           call-site because the table was full
+ *
+ * Collects the allocation profile gathered so far. Only domains and
+ * call-sites which saw any allocation are returned, sorted by the number
+ * of bytes allocated in descending order. The caller has to free @domains
+ * and @sites.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virAllocProfileGetStats(virAllocProfileEntryPtr *domains,
+                        size_t *ndomains,
+                        virAllocProfileEntryPtr *sites,
+                        size_t *nsites,
+                        unsigned long long *dropped)
+{
+    virAllocProfileEntryPtr tmpdomains = NULL;
+    virAllocProfileEntryPtr tmpsites = NULL;
+
+    if (virAllocProfileInitialize() < 0)
+        return -1;
+
+    /* allocate upfront, no memory may be allocated with the lock held */
+    if (VIR_ALLOC_N(tmpdomains, VIR_ERR_DOMAIN_LAST) < 0 ||
+        VIR_ALLOC_N(tmpsites, VIR_ALLOC_PROFILE_SITES) < 0) {
+        VIR_FREE(tmpdomains);
+        return -1;
+    }
+
+    virMutexLock(&virAllocProfileLock);
+    *ndomains = virAllocProfileCopy(tmpdomains, virAllocProfileDomains,
+                                    VIR_ERR_DOMAIN_LAST);
+    *nsites = virAllocProfileCopy(tmpsites, virAllocProfileSites,
+                                  VIR_ALLOC_PROFILE_SITES);
+    *dropped = virAllocProfileDropped;
+    virMutexUnlock(&virAllocProfileLock);
+
+    qsort(tmpdomains, *ndomains, sizeof(*tmpdomains),
+          virAllocProfileCompareBytes);
+    qsort(tmpsites, *nsites, sizeof(*tmpsites),
+          virAllocProfileCompareBytes);
+
+    *domains = tmpdomains;
+    *sites = tmpsites;
+    return 0;
+}
+
+
 /**
  * virAlloc:
  * @ptrptr: pointer to pointer for address of allocated memory
@@ -146,6 +380,7 @@ int virAlloc(void *ptrptr,
             virReportOOMErrorFull(domcode, filename, funcname, linenr);
         return -1;
     }
+    virAllocProfileRecord(domcode, filename, funcname, linenr, size);
     return 0;
 }
 
@@ -193,6 +428,7 @@ int virAllocN(void *ptrptr,
             virReportOOMErrorFull(domcode, filename, funcname, linenr);
         return -1;
     }
+    virAllocProfileRecord(domcode, filename, funcname, linenr, size * count);
     return 0;
 }
 
@@ -248,6 +484,7 @@ int virReallocN(void *ptrptr,
         return -1;
     }
     *(void**)ptrptr = tmp;
+    virAllocProfileRecord(domcode, filename, funcname, linenr, size * count);
     return 0;
 }
 
@@ -562,6 +799,7 @@ int virAllocVar(void *ptrptr,
             virReportOOMErrorFull(domcode, filename, funcname, linenr);
         return -1;
     }
+    virAllocProfileRecord(domcode, filename, funcname, linenr, alloc_size);
     return 0;
 }
 
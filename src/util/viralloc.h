@@ -592,6 +592,33 @@ void virDispose(void *ptrptr, size_t count, size_t element_size, size_t *countpt
                                      sizeof(*(ptr)), NULL)
 
 
+typedef struct _virAllocProfileEntry virAllocProfileEntry;
+typedef virAllocProfileEntry *virAllocProfileEntryPtr;
+struct _virAllocProfileEntry {
+    int domcode; /* VIR_FROM_* */
+    const char *filename; /* NULL for per domain entries */
+    const char *funcname;
+    size_t linenr;
+    unsigned long long allocs;
+    unsigned long long bytes;
+};
+
+void virAllocProfileRecord(int domcode,
+                           const char *filename,
+                           const char *funcname,
+                           size_t linenr,
+                           size_t size);
+int virAllocProfileSetRate(unsigned int rate,
+                           bool reset);
+unsigned int virAllocProfileGetRate(void);
+int virAllocProfileGetStats(virAllocProfileEntryPtr *domains,
+                            size_t *ndomains,
+                            virAllocProfileEntryPtr *sites,
+                            size_t *nsites,
+                            unsigned long long *dropped)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_NONNULL(4) ATTRIBUTE_NONNULL(5);
+
 void virAllocTestInit(void);
 int virAllocTestCount(void);
 void virAllocTestOOM(int n, int m);
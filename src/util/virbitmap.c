@@ -28,6 +28,7 @@
 #include "virbitmap.h"
 #include "virbuffer.h"
 #include "c-ctype.h"
+#include "count-leading-zeros.h"
 #include "count-one-bits.h"
 #include "virstring.h"
 #include "virutil.h"
@@ -218,6 +219,39 @@ virBitmapExpand(virBitmapPtr map,
 }
 
 
+/**
+ * virBitmapSetRange:
+ * @bitmap: Pointer to bitmap
+ * @start: first bit position to set
+ * @last: last bit position to set
+ *
+ * Set bit positions @start to @last, both included, a unit at a time.
+ * The caller must make sure that @last < @bitmap->nbits.
+ */
+static void
+virBitmapSetRange(virBitmapPtr bitmap,
+                  size_t start,
+                  size_t last)
+{
+    size_t first = VIR_BITMAP_UNIT_OFFSET(start);
+    size_t end = VIR_BITMAP_UNIT_OFFSET(last);
+    unsigned long headMask = -1UL << VIR_BITMAP_BIT_OFFSET(start);
+    unsigned long tailMask = -1UL >> (VIR_BITMAP_BITS_PER_UNIT - 1 -
+                                      VIR_BITMAP_BIT_OFFSET(last));
+    size_t i;
+
+    if (first == end) {
+        bitmap->map[first] |= headMask & tailMask;
+        return;
+    }
+
+    bitmap->map[first] |= headMask;
+    for (i = first + 1; i < end; i++)
+        bitmap->map[i] = -1UL;
+    bitmap->map[end] |= tailMask;
+}
+
+
 /**
  * virBitmapSetBitExpand:
  * @bitmap: Pointer to bitmap
@@ -416,36 +450,32 @@ virBitmapFormat(virBitmapPtr bitmap)
 {
     virBuffer buf = VIR_BUFFER_INITIALIZER;
     bool first = true;
-    int start, cur, prev;
+    ssize_t start, last;
 
-    if (!bitmap || (cur = virBitmapNextSetBit(bitmap, -1)) < 0) {
+    if (!bitmap || (start = virBitmapNextSetBit(bitmap, -1)) < 0) {
         char *ret;
         ignore_value(VIR_STRDUP(ret, ""));
         return ret;
     }
 
-    start = prev = cur;
-    while (prev >= 0) {
-        cur = virBitmapNextSetBit(bitmap, prev);
-
-        if (cur == prev + 1) {
-            prev = cur;
-            continue;
-        }
-
-        /* cur < 0 or cur > prev + 1 */
+    /* Find whole runs of set bits rather than visiting every bit, both
+     * searches skip a unit at a time */
+    while (start >= 0) {
+        if ((last = virBitmapNextClearBit(bitmap, start)) < 0)
+            last = bitmap->nbits;
+        last--;
 
         if (!first)
             virBufferAddLit(&buf, ",");
         else
             first = false;
 
-        if (prev == start)
-            virBufferAsprintf(&buf, "%d", start);
+        if (last == start)
+            virBufferAsprintf(&buf, "%zd", start);
         else
-            virBufferAsprintf(&buf, "%d-%d", start, prev);
+            virBufferAsprintf(&buf, "%zd-%zd", start, last);
 
-        start = prev = cur;
+        start = virBitmapNextSetBit(bitmap, last);
     }
 
     if (virBufferError(&buf)) {
@@ -489,7 +519,6 @@ virBitmapParseSeparator(const char *str,
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!(*bitmap = virBitmapNew(bitmapSize)))
@@ -549,10 +578,10 @@ virBitmapParseSeparator(const char *str,
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBit(*bitmap, i) < 0)
-                    goto error;
-            }
+            if (last >= (*bitmap)->nbits)
+                goto error;
+
+            virBitmapSetRange(*bitmap, start, last);
 
             virSkipSpaces(&cur);
         }
@@ -625,7 +654,6 @@ virBitmapParseUnlimited(const char *str)
     bool neg = false;
     const char *cur = str;
     char *tmp;
-    size_t i;
     int start, last;
 
     if (!(bitmap = virBitmapNewEmpty()))
@@ -685,10 +713,10 @@ virBitmapParseUnlimited(const char *str)
 
             cur = tmp;
 
-            for (i = start; i <= last; i++) {
-                if (virBitmapSetBitExpand(bitmap, i) < 0)
-                    goto error;
-            }
+            if (bitmap->nbits <= last && virBitmapExpand(bitmap, last) < 0)
+                goto error;
+
+            virBitmapSetRange(bitmap, start, last);
 
             virSkipSpaces(&cur);
         }
@@ -1040,7 +1068,6 @@ virBitmapNextSetBit(virBitmapPtr bitmap,
 ssize_t
 virBitmapLastSetBit(virBitmapPtr bitmap)
 {
-    ssize_t i;
     int unusedBits;
     ssize_t sz;
     unsigned long bits;
@@ -1070,12 +1097,7 @@ virBitmapLastSetBit(virBitmapPtr bitmap)
     return -1;
 
  found:
-    for (i = VIR_BITMAP_BITS_PER_UNIT - 1; i >= 0; i--) {
-        if (bits & 1UL << i)
-            return i + sz * VIR_BITMAP_BITS_PER_UNIT;
-    }
-
-    return -1;
+    return (sz + 1) * VIR_BITMAP_BITS_PER_UNIT - 1 - count_leading_zeros_l(bits);
 }
 
 
@@ -144,6 +144,12 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
 
     size = buf->use + len + 1000;
 
+    /* Grow geometrically, so that formatting a multi-megabyte document
+     * (e.g. capabilities of a large NUMA host) doesn't end up copying
+     * the content around on every few kilobytes appended. */
+    if (buf->size <= INT_MAX / 2 && size < buf->size * 2)
+        size = buf->size * 2;
+
     if (VIR_REALLOC_N_QUIET(buf->content, size) < 0) {
         virBufferSetError(buf, errno);
         return -1;
@@ -152,6 +158,28 @@ virBufferGrow(virBufferPtr buf, unsigned int len)
     return 0;
 }
 
+/**
+ * virBufferSizeHint:
+ * @buf: the buffer
+ * @len: how many more bytes are expected to be added
+ *
+ * Make room for @len more bytes in @buf at once, so that building up
+ * a document whose size is roughly known in advance doesn't need to
+ * reallocate the buffer over and over. Allocation failure is recorded
+ * in @buf like with any other addition.
+ */
+void
+virBufferSizeHint(virBufferPtr buf, size_t len)
+{
+    if (!buf || buf->error || !len)
+        return;
+
+    if (len >= INT_MAX - buf->use)
+        return;
+
+    ignore_value(virBufferGrow(buf, len));
+}
+
 /**
  * virBufferAdd:
  * @buf: the buffer to append to
@@ -438,6 +466,77 @@ virBufferVasprintf(virBufferPtr buf, const char *format, va_list argptr)
 VIR_WARNINGS_NO_WLOGICALOP_STRCHR
 
 
+/* What virBufferEscapeString replaces characters with: NULL for
+ * characters copied as they are, "" for control characters silently
+ * dropped. Characters over 0x80 are likely to give problems with UTF-8
+ * XML, but since our strings don't have an encoding it's hard to handle
+ * them properly and we have to assume they are UTF-8 too. */
+static const char *const virBufferXMLEscapes[256] = {
+    [0x01] = "", [0x02] = "", [0x03] = "", [0x04] = "",
+    [0x05] = "", [0x06] = "", [0x07] = "", [0x08] = "",
+    /* \t and \n are kept */
+    [0x0B] = "", [0x0C] = "",
+    /* \r is kept */
+    [0x0E] = "", [0x0F] = "", [0x10] = "", [0x11] = "",
+    [0x12] = "", [0x13] = "", [0x14] = "", [0x15] = "",
+    [0x16] = "", [0x17] = "", [0x18] = "", [0x19] = "",
+    ['"'] = "&quot;",
+    ['&'] = "&amp;",
+    ['\''] = "&apos;",
+    ['<'] = "&lt;",
+    ['>'] = "&gt;",
+};
+
+
+/* Returns the length of @str once escaped for XML */
+static size_t
+virBufferEscapeXMLLength(const char *str)
+{
+    size_t len = 0;
+    const char *rep;
+
+    for (; *str; str++) {
+        if ((rep = virBufferXMLEscapes[(unsigned char) *str]))
+            len += strlen(rep);
+        else
+            len++;
+    }
+
+    return len;
+}
+
+
+/* Writes @str escaped for XML to @out, copying runs of characters which
+ * don't need any escaping at once. Returns the end of the written data,
+ * which is not terminated. */
+static char *
+virBufferEscapeXMLCopy(char *out, const char *str)
+{
+    const char *span;
+    const char *rep;
+    size_t len;
+
+    while (*str) {
+        span = str;
+        while (*str && !virBufferXMLEscapes[(unsigned char) *str])
+            str++;
+
+        memcpy(out, span, str - span);
+        out += str - span;
+
+        if (!*str)
+            break;
+
+        rep = virBufferXMLEscapes[(unsigned char) *str++];
+        len = strlen(rep);
+        memcpy(out, rep, len);
+        out += len;
+    }
+
+    return out;
+}
+
+
 /**
  * virBufferEscapeString:
  * @buf: the buffer to append to
@@ -452,17 +551,12 @@ VIR_WARNINGS_NO_WLOGICALOP_STRCHR
 void
 virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
 {
-    int len;
     VIR_AUTOFREE(char *) escaped = NULL;
+    const char *conv;
+    size_t prefixlen;
+    size_t suffixlen;
+    size_t len;
     char *out;
-    const char *cur;
-    const char forbidden_characters[] = {
-        0x01,   0x02,   0x03,   0x04,   0x05,   0x06,   0x07,   0x08,
-        /*\t*/  /*\n*/  0x0B,   0x0C,   /*\r*/  0x0E,   0x0F,   0x10,
-        0x11,   0x12,   0x13,   0x14,   0x15,   0x16,   0x17,   0x18,
-        0x19,   '"',    '&',    '\'',   '<',    '>',
-        '\0'
-    };
 
     if ((format == NULL) || (buf == NULL) || (str == NULL))
         return;
@@ -470,69 +564,46 @@ virBufferEscapeString(virBufferPtr buf, const char *format, const char *str)
     if (buf->error)
         return;
 
-    len = strlen(str);
-    if (strcspn(str, forbidden_characters) == len) {
-        virBufferAsprintf(buf, format, str);
+    len = virBufferEscapeXMLLength(str);
+
+    if (len >= INT_MAX / 2) {
+        virBufferSetError(buf, ENOMEM);
         return;
     }
 
-    if (xalloc_oversized(6, len) ||
-        VIR_ALLOC_N_QUIET(escaped, 6 * len + 1) < 0) {
-        virBufferSetError(buf, errno);
+    /* Unless @format has other conversions than the one "%s", the
+     * result is written straight into the buffer */
+    conv = strstr(format, "%s");
+    prefixlen = conv ? conv - format : 0;
+    if (conv &&
+        !memchr(format, '%', prefixlen) &&
+        !strchr(conv + 2, '%')) {
+        suffixlen = strlen(conv + 2);
+
+        virBufferAddLit(buf, ""); /* auto-indent */
+
+        if (virBufferGrow(buf, prefixlen + len + suffixlen + 1) < 0)
+            return;
+
+        out = buf->content + buf->use;
+        memcpy(out, format, prefixlen);
+        out = virBufferEscapeXMLCopy(out + prefixlen, str);
+        memcpy(out, conv + 2, suffixlen + 1);
+        buf->use = out + suffixlen - buf->content;
         return;
     }
 
-    cur = str;
-    out = escaped;
-    while (*cur != 0) {
-        if (*cur == '<') {
-            *out++ = '&';
-            *out++ = 'l';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '>') {
-            *out++ = '&';
-            *out++ = 'g';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '&') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'm';
-            *out++ = 'p';
-            *out++ = ';';
-        } else if (*cur == '"') {
-            *out++ = '&';
-            *out++ = 'q';
-            *out++ = 'u';
-            *out++ = 'o';
-            *out++ = 't';
-            *out++ = ';';
-        } else if (*cur == '\'') {
-            *out++ = '&';
-            *out++ = 'a';
-            *out++ = 'p';
-            *out++ = 'o';
-            *out++ = 's';
-            *out++ = ';';
-        } else if (!strchr(forbidden_characters, *cur)) {
-            /*
-             * default case, just copy !
-             * Note that character over 0x80 are likely to give problem
-             * with UTF-8 XML, but since our string don't have an encoding
-             * it's hard to handle properly we have to assume it's UTF-8 too
-             */
-            *out++ = *cur;
-        } else {
-            /* silently ignore control characters */
-        }
-        cur++;
+    if (VIR_ALLOC_N_QUIET(escaped, len + 1) < 0) {
+        virBufferSetError(buf, errno);
+        return;
     }
-    *out = 0;
+
+    *virBufferEscapeXMLCopy(escaped, str) = '\0';
 
     virBufferAsprintf(buf, format, escaped);
 }
 
+
 /**
  * virBufferEscapeSexpr:
  * @buf: the buffer to append to
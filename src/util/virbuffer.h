@@ -73,6 +73,7 @@ int virBufferCheckErrorInternal(const virBuffer *buf,
     virBufferCheckErrorInternal(buf, VIR_FROM_THIS, __FILE__, __FUNCTION__, \
     __LINE__)
 unsigned int virBufferUse(const virBuffer *buf);
+void virBufferSizeHint(virBufferPtr buf, size_t len);
 void virBufferAdd(virBufferPtr buf, const char *str, int len);
 void virBufferAddBuffer(virBufferPtr buf, virBufferPtr toadd);
 void virBufferAddChar(virBufferPtr buf, char c);
@@ -57,6 +57,7 @@
 #include "virtypedparam.h"
 #include "virhostcpu.h"
 #include "virthread.h"
+#include "virprobe.h"
 
 VIR_LOG_INIT("util.cgroup");
 
@@ -65,6 +66,9 @@ VIR_LOG_INIT("util.cgroup");
 #define CGROUP_NB_TOTAL_CPU_STAT_PARAM 3
 #define CGROUP_NB_PER_CPU_STAT_PARAM   1
 
+VIR_ENUM_IMPL(virCgroupPressureResource, VIR_CGROUP_PRESSURE_LAST,
+              "cpu", "memory", "io");
+
 VIR_ENUM_IMPL(virCgroupController, VIR_CGROUP_CONTROLLER_LAST,
               "cpu", "cpuacct", "cpuset", "memory", "devices",
               "freezer", "blkio", "net_cls", "perf_event",
@@ -463,25 +467,31 @@ virCgroupSetValueStr(virCgroupPtr group,
 {
     VIR_AUTOFREE(char *) keypath = NULL;
     char *tmp = NULL;
+    int ret = -1;
 
     if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
         return -1;
 
     VIR_DEBUG("Set value '%s' to '%s'", keypath, value);
+    PROBE_QUIET(CGROUP_SET_VALUE_BEGIN, "path=%s value=%s", keypath, value);
     if (virFileWriteStr(keypath, value, 0) < 0) {
         if (errno == EINVAL &&
             (tmp = strrchr(keypath, '/'))) {
             virReportSystemError(errno,
                                  _("Invalid value '%s' for '%s'"),
                                  value, tmp + 1);
-            return -1;
+            goto cleanup;
         }
         virReportSystemError(errno,
                              _("Unable to write to '%s'"), keypath);
-        return -1;
+        goto cleanup;
     }
 
-    return 0;
+    ret = 0;
+ cleanup:
+    PROBE_QUIET(CGROUP_SET_VALUE_END, "path=%s value=%s ret=%d",
+                keypath, value, ret);
+    return ret;
 }
 
 
@@ -620,6 +630,166 @@ virCgroupGetValueU64(virCgroupPtr group,
 }
 
 
+static void
+virCgroupStatFDFree(void *payload,
+                    const void *name ATTRIBUTE_UNUSED)
+{
+    int *fd = payload;
+
+    VIR_FORCE_CLOSE(*fd);
+    VIR_FREE(fd);
+}
+
+
+static int
+virCgroupGetStatValueStrInternal(virCgroupPtr group,
+                                 int controller,
+                                 const char *key,
+                                 bool optional,
+                                 char **value)
+{
+    VIR_AUTOFREE(char *) keypath = NULL;
+    VIR_AUTOFREE(char *) buf = NULL;
+    size_t maxlen = 1024 * 1024;
+    size_t buflen = 1024;
+    size_t len = 0;
+    ssize_t got;
+    int *fd;
+
+    *value = NULL;
+
+    if (virCgroupPathOfController(group, controller, key, &keypath) < 0)
+        return -1;
+
+    if (!group->statFDs &&
+        !(group->statFDs = virHashCreate(8, virCgroupStatFDFree)))
+        return -1;
+
+    if (!(fd = virHashLookup(group->statFDs, keypath))) {
+        if (VIR_ALLOC(fd) < 0)
+            return -1;
+
+        if ((*fd = open(keypath, O_RDONLY | O_CLOEXEC)) < 0) {
+            int save_errno = errno;
+
+            VIR_FREE(fd);
+            if (optional && save_errno == ENOENT)
+                return 1;
+            virReportSystemError(save_errno,
+                                 _("Unable to read from '%s'"), keypath);
+            return -1;
+        }
+
+        if (virHashAddEntry(group->statFDs, keypath, fd) < 0) {
+            virCgroupStatFDFree(fd, NULL);
+            return -1;
+        }
+    }
+
+    VIR_DEBUG("Get stat value %s", keypath);
+
+    if (VIR_ALLOC_N(buf, buflen) < 0)
+        return -1;
+
+    while ((got = pread(*fd, buf + len, buflen - len - 1, len)) > 0) {
+        len += got;
+        if (len + 1 < buflen)
+            continue;
+
+        if (buflen >= maxlen) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("File '%s' is too large"), keypath);
+            return -1;
+        }
+        if (VIR_REALLOC_N(buf, buflen * 2) < 0)
+            return -1;
+        buflen *= 2;
+    }
+
+    if (got < 0) {
+        virReportSystemError(errno,
+                             _("Unable to read from '%s'"), keypath);
+        /* the file might have been replaced, open it again next time */
+        virHashRemoveEntry(group->statFDs, keypath);
+        return -1;
+    }
+
+    buf[len] = '\0';
+
+    /* Terminated with '\n' has sometimes harmful effects to the caller */
+    if (len > 0 && buf[len - 1] == '\n')
+        buf[len - 1] = '\0';
+
+    VIR_STEAL_PTR(*value, buf);
+    return 0;
+}
+
+
+/**
+ * virCgroupGetStatValueStr:
+ * @group: the cgroup
+ * @controller: cgroup controller holding @key
+ * @key: name of the statistics file
+ * @value: filled with the file contents
+ *
+ * Same as virCgroupGetValueStr, but meant for statistics files which are
+ * sampled over and over, such as cpuacct.usage or cpu.stat.  The file
+ * is kept open in @group and re-read from offset 0 on subsequent calls,
+ * so that a sample costs a single read instead of open, read and close.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupGetStatValueStr(virCgroupPtr group,
+                         int controller,
+                         const char *key,
+                         char **value)
+{
+    return virCgroupGetStatValueStrInternal(group, controller, key,
+                                            false, value);
+}
+
+
+/**
+ * virCgroupGetOptionalStatValueStr:
+ *
+ * Same as virCgroupGetStatValueStr, but a missing file is not an error.
+ *
+ * Returns 0 on success, 1 if the file does not exist, -1 on error.
+ */
+int
+virCgroupGetOptionalStatValueStr(virCgroupPtr group,
+                                 int controller,
+                                 const char *key,
+                                 char **value)
+{
+    return virCgroupGetStatValueStrInternal(group, controller, key,
+                                            true, value);
+}
+
+
+int
+virCgroupGetStatValueU64(virCgroupPtr group,
+                         int controller,
+                         const char *key,
+                         unsigned long long int *value)
+{
+    VIR_AUTOFREE(char *) strval = NULL;
+
+    if (virCgroupGetStatValueStr(group, controller, key, &strval) < 0)
+        return -1;
+
+    if (virStrToLong_ull(strval, NULL, 10, value) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Unable to parse '%s' as an integer"),
+                       strval);
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virCgroupMakeGroup(virCgroupPtr parent,
                    virCgroupPtr group,
@@ -1241,6 +1411,9 @@ virCgroupNewMachine(const char *name,
 
     *group = NULL;
 
+    PROBE_QUIET(CGROUP_NEW_MACHINE_BEGIN, "name=%s drivername=%s",
+                name, drivername);
+
     if ((rv = virCgroupNewMachineSystemd(name,
                                          drivername,
                                          uuid,
@@ -1251,18 +1424,17 @@ virCgroupNewMachine(const char *name,
                                          nicindexes,
                                          partition,
                                          controllers,
-                                         group)) == 0)
-        return 0;
-
-    if (rv == -1)
-        return -1;
+                                         group)) == -2)
+        rv = virCgroupNewMachineManual(name,
+                                       drivername,
+                                       pidleader,
+                                       partition,
+                                       controllers,
+                                       group);
 
-    return virCgroupNewMachineManual(name,
-                                     drivername,
-                                     pidleader,
-                                     partition,
-                                     controllers,
-                                     group);
+    PROBE_QUIET(CGROUP_NEW_MACHINE_END, "name=%s drivername=%s ret=%d",
+                name, drivername, rv);
+    return rv;
 }
 
 
@@ -1302,6 +1474,8 @@ virCgroupFree(virCgroupPtr *group)
     VIR_FREE((*group)->unified.mountPoint);
     VIR_FREE((*group)->unified.placement);
 
+    virHashFree((*group)->statFDs);
+
     VIR_FREE((*group)->path);
     VIR_FREE(*group);
 }
@@ -2415,15 +2589,21 @@ int
 virCgroupRemove(virCgroupPtr group)
 {
     size_t i;
+    int ret = -1;
+
+    PROBE_QUIET(CGROUP_REMOVE_BEGIN, "path=%s", group->path);
 
     for (i = 0; i < VIR_CGROUP_BACKEND_TYPE_LAST; i++) {
         if (group->backends[i] &&
             group->backends[i]->remove(group) < 0) {
-            return -1;
+            goto cleanup;
         }
     }
 
-    return 0;
+    ret = 0;
+ cleanup:
+    PROBE_QUIET(CGROUP_REMOVE_END, "path=%s ret=%d", group->path, ret);
+    return ret;
 }
 
 
@@ -2699,6 +2879,159 @@ virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
 }
 
 
+/**
+ * virCgroupGetStatsSnapshot:
+ * @group: the cgroup to sample
+ * @controllers: bitmask of 1 << virCgroupController to sample, only
+ *               VIR_CGROUP_CONTROLLER_CPUACCT, VIR_CGROUP_CONTROLLER_MEMORY
+ *               and VIR_CGROUP_CONTROLLER_BLKIO are supported
+ * @stats: filled with the sampled values
+ *
+ * Read the usage statistics of all requested controllers in one go.  Each
+ * statistics file is read only once per sample, with its descriptor kept
+ * open in @group for the next sample.  Controllers which are not available
+ * in @group are skipped, @stats->controllers tells which were sampled.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virCgroupGetStatsSnapshot(virCgroupPtr group,
+                          unsigned int controllers,
+                          virCgroupStatsPtr stats)
+{
+    size_t i;
+    size_t j;
+
+    memset(stats, 0, sizeof(*stats));
+
+    controllers &= (1 << VIR_CGROUP_CONTROLLER_CPUACCT) |
+                   (1 << VIR_CGROUP_CONTROLLER_MEMORY) |
+                   (1 << VIR_CGROUP_CONTROLLER_BLKIO);
+
+    for (i = 0; i < VIR_CGROUP_BACKEND_TYPE_LAST; i++) {
+        virCgroupBackendPtr backend = group->backends[i];
+        unsigned int backendControllers = 0;
+
+        if (!backend)
+            continue;
+
+        for (j = 0; j < VIR_CGROUP_CONTROLLER_LAST; j++) {
+            if ((controllers & (1 << j)) &&
+                !(stats->controllers & (1 << j)) &&
+                backend->hasController(group, j))
+                backendControllers |= 1 << j;
+        }
+
+        if (!backendControllers)
+            continue;
+
+        if (!backend->getStatsSnapshot) {
+            virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                           _("operation '%s' not supported"),
+                           "getStatsSnapshot");
+            return -1;
+        }
+
+        if (backend->getStatsSnapshot(group, backendControllers, stats) < 0)
+            return -1;
+
+        stats->controllers |= backendControllers;
+    }
+
+    return 0;
+}
+
+
+static int
+virCgroupPressureResourceController(virCgroupPressureResource resource)
+{
+    switch (resource) {
+    case VIR_CGROUP_PRESSURE_CPU:
+        return VIR_CGROUP_CONTROLLER_CPUACCT;
+    case VIR_CGROUP_PRESSURE_MEMORY:
+        return VIR_CGROUP_CONTROLLER_MEMORY;
+    case VIR_CGROUP_PRESSURE_IO:
+        return VIR_CGROUP_CONTROLLER_BLKIO;
+    case VIR_CGROUP_PRESSURE_LAST:
+        break;
+    }
+
+    return -1;
+}
+
+
+/**
+ * virCgroupGetPressure:
+ * @group: the cgroup to query
+ * @resource: which resource to report the pressure of
+ * @pressure: filled with the pressure stall information
+ *
+ * Read the pressure stall information (PSI) of @resource in @group.  This
+ * is only available with cgroup v2 on kernels with PSI enabled.
+ *
+ * Returns 0 on success, 1 if PSI is not available for @resource in @group
+ * (without reporting an error), -1 on error.
+ */
+int
+virCgroupGetPressure(virCgroupPtr group,
+                     virCgroupPressureResource resource,
+                     virCgroupPressurePtr pressure)
+{
+    int controller = virCgroupPressureResourceController(resource);
+    virCgroupBackendPtr backend;
+
+    memset(pressure, 0, sizeof(*pressure));
+
+    if (controller < 0 ||
+        !(backend = virCgroupBackendForController(group, controller)) ||
+        !backend->getPressure)
+        return 1;
+
+    return backend->getPressure(group, controller, resource, pressure);
+}
+
+
+/**
+ * virCgroupOpenPressureTrigger:
+ * @group: the cgroup to watch
+ * @resource: which resource to watch
+ * @full: watch the time all tasks were stalled instead of at least one
+ * @stall: stall time in microseconds which arms the trigger
+ * @window: time window in microseconds over which @stall is measured
+ *
+ * Register a PSI trigger for @resource in @group.  The returned file
+ * descriptor reports POLLPRI each time the tasks in @group were stalled
+ * for more than @stall microseconds within a @window, and POLLERR once
+ * the cgroup is gone.  The trigger is unregistered by closing the
+ * descriptor.
+ *
+ * Returns the file descriptor, or -1 on error.
+ */
+int
+virCgroupOpenPressureTrigger(virCgroupPtr group,
+                             virCgroupPressureResource resource,
+                             bool full,
+                             unsigned long long stall,
+                             unsigned long long window)
+{
+    int controller = virCgroupPressureResourceController(resource);
+    virCgroupBackendPtr backend;
+
+    if (controller < 0 ||
+        !(backend = virCgroupBackendForController(group, controller)) ||
+        !backend->openPressureTrigger) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED,
+                       _("pressure stall information of '%s' is not "
+                         "supported by this cgroup"),
+                       virCgroupPressureResourceTypeToString(resource));
+        return -1;
+    }
+
+    return backend->openPressureTrigger(group, controller, resource,
+                                        full, stall, window);
+}
+
+
 int
 virCgroupSetFreezerState(virCgroupPtr group, const char *state)
 {
@@ -3477,6 +3810,40 @@ virCgroupGetDomainTotalCpuStats(virCgroupPtr group ATTRIBUTE_UNUSED,
 }
 
 
+int
+virCgroupGetStatsSnapshot(virCgroupPtr group ATTRIBUTE_UNUSED,
+                          unsigned int controllers ATTRIBUTE_UNUSED,
+                          virCgroupStatsPtr stats ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
+int
+virCgroupGetPressure(virCgroupPtr group ATTRIBUTE_UNUSED,
+                     virCgroupPressureResource resource ATTRIBUTE_UNUSED,
+                     virCgroupPressurePtr pressure)
+{
+    memset(pressure, 0, sizeof(*pressure));
+    return 1;
+}
+
+
+int
+virCgroupOpenPressureTrigger(virCgroupPtr group ATTRIBUTE_UNUSED,
+                             virCgroupPressureResource resource ATTRIBUTE_UNUSED,
+                             bool full ATTRIBUTE_UNUSED,
+                             unsigned long long stall ATTRIBUTE_UNUSED,
+                             unsigned long long window ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("Control groups not supported on this platform"));
+    return -1;
+}
+
+
 int
 virCgroupSetFreezerState(virCgroupPtr group ATTRIBUTE_UNUSED,
                          const char *state ATTRIBUTE_UNUSED)
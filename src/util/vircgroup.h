@@ -256,6 +256,73 @@ int virCgroupGetCpuacctPercpuUsage(virCgroupPtr group, char **usage);
 int virCgroupGetCpuacctStat(virCgroupPtr group, unsigned long long *user,
                             unsigned long long *sys);
 
+typedef struct _virCgroupStats virCgroupStats;
+typedef virCgroupStats *virCgroupStatsPtr;
+struct _virCgroupStats {
+    /* bitmask of 1 << virCgroupController which were sampled */
+    unsigned int controllers;
+
+    /* VIR_CGROUP_CONTROLLER_CPUACCT, in nanoseconds */
+    unsigned long long cpuUsage;
+    unsigned long long cpuUser;
+    unsigned long long cpuSystem;
+
+    /* VIR_CGROUP_CONTROLLER_MEMORY, in KiB */
+    unsigned long memoryUsage;
+
+    /* VIR_CGROUP_CONTROLLER_BLKIO, summed over all devices */
+    long long blkioBytesRead;
+    long long blkioBytesWrite;
+    long long blkioRequestsRead;
+    long long blkioRequestsWrite;
+};
+
+int virCgroupGetStatsSnapshot(virCgroupPtr group,
+                              unsigned int controllers,
+                              virCgroupStatsPtr stats);
+
+typedef enum {
+    VIR_CGROUP_PRESSURE_CPU,
+    VIR_CGROUP_PRESSURE_MEMORY,
+    VIR_CGROUP_PRESSURE_IO,
+
+    VIR_CGROUP_PRESSURE_LAST
+} virCgroupPressureResource;
+
+VIR_ENUM_DECL(virCgroupPressureResource);
+
+typedef struct _virCgroupPressureStall virCgroupPressureStall;
+typedef virCgroupPressureStall *virCgroupPressureStallPtr;
+struct _virCgroupPressureStall {
+    /* share of time stalled over the last 10, 60 and 300 seconds,
+     * in percent */
+    double avg10;
+    double avg60;
+    double avg300;
+    /* total stall time, in microseconds */
+    unsigned long long total;
+};
+
+typedef struct _virCgroupPressure virCgroupPressure;
+typedef virCgroupPressure *virCgroupPressurePtr;
+struct _virCgroupPressure {
+    /* at least one task stalled */
+    virCgroupPressureStall some;
+    /* all tasks stalled at once, not reported for cpu by older kernels */
+    bool hasFull;
+    virCgroupPressureStall full;
+};
+
+int virCgroupGetPressure(virCgroupPtr group,
+                         virCgroupPressureResource resource,
+                         virCgroupPressurePtr pressure);
+
+int virCgroupOpenPressureTrigger(virCgroupPtr group,
+                                 virCgroupPressureResource resource,
+                                 bool full,
+                                 unsigned long long stall,
+                                 unsigned long long window);
+
 int virCgroupSetFreezerState(virCgroupPtr group, const char *state);
 int virCgroupGetFreezerState(virCgroupPtr group, char **state);
 
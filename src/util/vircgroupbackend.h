@@ -318,6 +318,25 @@ typedef int
                              unsigned long long *user,
                              unsigned long long *sys);
 
+typedef int
+(*virCgroupGetStatsSnapshotCB)(virCgroupPtr group,
+                               unsigned int controllers,
+                               virCgroupStatsPtr stats);
+
+typedef int
+(*virCgroupGetPressureCB)(virCgroupPtr group,
+                          int controller,
+                          virCgroupPressureResource resource,
+                          virCgroupPressurePtr pressure);
+
+typedef int
+(*virCgroupOpenPressureTriggerCB)(virCgroupPtr group,
+                                  int controller,
+                                  virCgroupPressureResource resource,
+                                  bool full,
+                                  unsigned long long stall,
+                                  unsigned long long window);
+
 typedef int
 (*virCgroupSetFreezerStateCB)(virCgroupPtr group,
                               const char *state);
@@ -417,6 +436,10 @@ struct _virCgroupBackend {
     virCgroupGetCpuacctPercpuUsageCB getCpuacctPercpuUsage;
     virCgroupGetCpuacctStatCB getCpuacctStat;
 
+    virCgroupGetStatsSnapshotCB getStatsSnapshot;
+    virCgroupGetPressureCB getPressure;
+    virCgroupOpenPressureTriggerCB openPressureTrigger;
+
     virCgroupSetFreezerStateCB setFreezerState;
     virCgroupGetFreezerStateCB getFreezerState;
 
@@ -31,6 +31,7 @@
 
 # include "vircgroup.h"
 # include "vircgroupbackend.h"
+# include "virhash.h"
 
 struct _virCgroupV1Controller {
     int type;
@@ -60,6 +61,10 @@ struct _virCgroup {
 
     virCgroupV1Controller legacy[VIR_CGROUP_CONTROLLER_LAST];
     virCgroupV2Controller unified;
+
+    /* file path -> open file descriptor of statistics files which are
+     * read repeatedly, see virCgroupGetStatValueStr */
+    virHashTablePtr statFDs;
 };
 
 int virCgroupSetValueStr(virCgroupPtr group,
@@ -72,6 +77,21 @@ int virCgroupGetValueStr(virCgroupPtr group,
                          const char *key,
                          char **value);
 
+int virCgroupGetStatValueStr(virCgroupPtr group,
+                             int controller,
+                             const char *key,
+                             char **value);
+
+int virCgroupGetOptionalStatValueStr(virCgroupPtr group,
+                                     int controller,
+                                     const char *key,
+                                     char **value);
+
+int virCgroupGetStatValueU64(virCgroupPtr group,
+                             int controller,
+                             const char *key,
+                             unsigned long long int *value);
+
 int virCgroupSetValueU64(virCgroupPtr group,
                          int controller,
                          const char *key,
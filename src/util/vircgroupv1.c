@@ -986,14 +986,14 @@ virCgroupV1GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     /* sum up all entries of the same kind, from all devices */
@@ -1076,14 +1076,14 @@ virCgroupV1GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_service_bytes", &str1) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_service_bytes", &str1) < 0)
         return -1;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "blkio.throttle.io_serviced", &str2) < 0)
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "blkio.throttle.io_serviced", &str2) < 0)
         return -1;
 
     if (!(str3 = virCgroupGetBlockDevString(path)))
@@ -1529,9 +1529,9 @@ virCgroupV1GetMemoryUsage(virCgroupPtr group,
 {
     long long unsigned int usage_in_bytes;
     int ret;
-    ret = virCgroupGetValueU64(group,
-                               VIR_CGROUP_CONTROLLER_MEMORY,
-                               "memory.usage_in_bytes", &usage_in_bytes);
+    ret = virCgroupGetStatValueU64(group,
+                                   VIR_CGROUP_CONTROLLER_MEMORY,
+                                   "memory.usage_in_bytes", &usage_in_bytes);
     if (ret == 0)
         *kb = (unsigned long) usage_in_bytes >> 10;
     return ret;
@@ -1867,9 +1867,9 @@ static int
 virCgroupV1GetCpuacctUsage(virCgroupPtr group,
                            unsigned long long *usage)
 {
-    return virCgroupGetValueU64(group,
-                                VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage", usage);
+    return virCgroupGetStatValueU64(group,
+                                    VIR_CGROUP_CONTROLLER_CPUACCT,
+                                    "cpuacct.usage", usage);
 }
 
 
@@ -1877,8 +1877,8 @@ static int
 virCgroupV1GetCpuacctPercpuUsage(virCgroupPtr group,
                                  char **usage)
 {
-    return virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                                "cpuacct.usage_percpu", usage);
+    return virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                    "cpuacct.usage_percpu", usage);
 }
 
 
@@ -1891,8 +1891,8 @@ virCgroupV1GetCpuacctStat(virCgroupPtr group,
     char *p;
     static double scale = -1.0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpuacct.stat", &str) < 0)
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpuacct.stat", &str) < 0)
         return -1;
 
     if (!(p = STRSKIP(str, "user ")) ||
@@ -2017,6 +2017,36 @@ virCgroupV1GetCpusetCpus(virCgroupPtr group,
 }
 
 
+static int
+virCgroupV1GetStatsSnapshot(virCgroupPtr group,
+                            unsigned int controllers,
+                            virCgroupStatsPtr stats)
+{
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_CPUACCT)) {
+        if (virCgroupV1GetCpuacctUsage(group, &stats->cpuUsage) < 0 ||
+            virCgroupV1GetCpuacctStat(group, &stats->cpuUser,
+                                      &stats->cpuSystem) < 0)
+            return -1;
+    }
+
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_MEMORY)) {
+        if (virCgroupV1GetMemoryUsage(group, &stats->memoryUsage) < 0)
+            return -1;
+    }
+
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_BLKIO)) {
+        if (virCgroupV1GetBlkioIoServiced(group,
+                                          &stats->blkioBytesRead,
+                                          &stats->blkioBytesWrite,
+                                          &stats->blkioRequestsRead,
+                                          &stats->blkioRequestsWrite) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
 virCgroupBackend virCgroupV1Backend = {
     .type = VIR_CGROUP_BACKEND_TYPE_V1,
 
@@ -2082,6 +2112,8 @@ virCgroupBackend virCgroupV1Backend = {
     .getCpuacctPercpuUsage = virCgroupV1GetCpuacctPercpuUsage,
     .getCpuacctStat = virCgroupV1GetCpuacctStat,
 
+    .getStatsSnapshot = virCgroupV1GetStatsSnapshot,
+
     .setFreezerState = virCgroupV1SetFreezerState,
     .getFreezerState = virCgroupV1GetFreezerState,
 
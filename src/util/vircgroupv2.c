@@ -596,9 +596,9 @@ virCgroupV2GetBlkioIoServiced(virCgroupPtr group,
     *requests_read = 0;
     *requests_write = 0;
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -656,9 +656,9 @@ virCgroupV2GetBlkioIoDeviceServiced(virCgroupPtr group,
         requests_write
     };
 
-    if (virCgroupGetValueStr(group,
-                             VIR_CGROUP_CONTROLLER_BLKIO,
-                             "io.stat", &str1) < 0) {
+    if (virCgroupGetStatValueStr(group,
+                                 VIR_CGROUP_CONTROLLER_BLKIO,
+                                 "io.stat", &str1) < 0) {
         return -1;
     }
 
@@ -1120,9 +1120,9 @@ virCgroupV2GetMemoryUsage(virCgroupPtr group,
                           unsigned long *kb)
 {
     unsigned long long usage_in_bytes;
-    int ret = virCgroupGetValueU64(group,
-                                   VIR_CGROUP_CONTROLLER_MEMORY,
-                                   "memory.current", &usage_in_bytes);
+    int ret = virCgroupGetStatValueU64(group,
+                                       VIR_CGROUP_CONTROLLER_MEMORY,
+                                       "memory.current", &usage_in_bytes);
     if (ret == 0)
         *kb = (unsigned long) usage_in_bytes >> 10;
     return ret;
@@ -1455,82 +1455,214 @@ virCgroupV2SupportsCpuBW(virCgroupPtr cgroup)
 }
 
 
+/* Parse the value of @key from the contents of cpu.stat, converted
+ * from microseconds to nanoseconds. */
 static int
-virCgroupV2GetCpuacctUsage(virCgroupPtr group,
-                           unsigned long long *usage)
+virCgroupV2ParseCpuStat(const char *str,
+                        const char *key,
+                        unsigned long long *value)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    char *tmp;
+    const char *tmp = str;
+    size_t keylen = strlen(key);
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
-        return -1;
+    while ((tmp = strstr(tmp, key))) {
+        if ((tmp == str || tmp[-1] == '\n') && tmp[keylen] == ' ')
+            break;
+        tmp += keylen;
     }
 
-    if (!(tmp = strstr(str, "usage_usec "))) {
+    if (!tmp) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu usage stat '%s'"), str);
+                       _("cannot parse '%s' from cpu stat '%s'"), key, str);
         return -1;
     }
-    tmp += strlen("usage_usec ");
+    tmp += keylen + 1;
 
-    if (virStrToLong_ull(tmp, &tmp, 10, usage) < 0) {
+    if (virStrToLong_ull(tmp, NULL, 10, value) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Failed to parse value '%s' as number."), tmp);
         return -1;
     }
 
-    *usage *= 1000;
+    *value *= 1000;
 
     return 0;
 }
 
 
+static int
+virCgroupV2GetCpuacctUsage(virCgroupPtr group,
+                           unsigned long long *usage)
+{
+    VIR_AUTOFREE(char *) str = NULL;
+
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpu.stat", &str) < 0) {
+        return -1;
+    }
+
+    return virCgroupV2ParseCpuStat(str, "usage_usec", usage);
+}
+
+
 static int
 virCgroupV2GetCpuacctStat(virCgroupPtr group,
                           unsigned long long *user,
                           unsigned long long *sys)
 {
     VIR_AUTOFREE(char *) str = NULL;
-    char *tmp;
-    unsigned long long userVal = 0;
-    unsigned long long sysVal = 0;
 
-    if (virCgroupGetValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
-                             "cpu.stat", &str) < 0) {
+    if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                 "cpu.stat", &str) < 0) {
         return -1;
     }
 
-    if (!(tmp = strstr(str, "user_usec "))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu user stat '%s'"), str);
+    if (virCgroupV2ParseCpuStat(str, "user_usec", user) < 0 ||
+        virCgroupV2ParseCpuStat(str, "system_usec", sys) < 0)
         return -1;
+
+    return 0;
+}
+
+
+static int
+virCgroupV2GetStatsSnapshot(virCgroupPtr group,
+                            unsigned int controllers,
+                            virCgroupStatsPtr stats)
+{
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_CPUACCT)) {
+        VIR_AUTOFREE(char *) str = NULL;
+
+        /* usage, user and system time all come from a single read */
+        if (virCgroupGetStatValueStr(group, VIR_CGROUP_CONTROLLER_CPUACCT,
+                                     "cpu.stat", &str) < 0)
+            return -1;
+
+        if (virCgroupV2ParseCpuStat(str, "usage_usec", &stats->cpuUsage) < 0 ||
+            virCgroupV2ParseCpuStat(str, "user_usec", &stats->cpuUser) < 0 ||
+            virCgroupV2ParseCpuStat(str, "system_usec", &stats->cpuSystem) < 0)
+            return -1;
+    }
+
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_MEMORY)) {
+        if (virCgroupV2GetMemoryUsage(group, &stats->memoryUsage) < 0)
+            return -1;
     }
-    tmp += strlen("user_usec ");
 
-    if (virStrToLong_ull(tmp, &tmp, 10, &userVal) < 0) {
+    if (controllers & (1 << VIR_CGROUP_CONTROLLER_BLKIO)) {
+        if (virCgroupV2GetBlkioIoServiced(group,
+                                          &stats->blkioBytesRead,
+                                          &stats->blkioBytesWrite,
+                                          &stats->blkioRequestsRead,
+                                          &stats->blkioRequestsWrite) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virCgroupV2ParsePressureLine(const char *line,
+                             virCgroupPressureStallPtr stall)
+{
+    const char *tmp;
+
+    if (!(tmp = strstr(line, "avg10=")) ||
+        virStrToDouble(tmp + strlen("avg10="), NULL, &stall->avg10) < 0 ||
+        !(tmp = strstr(line, "avg60=")) ||
+        virStrToDouble(tmp + strlen("avg60="), NULL, &stall->avg60) < 0 ||
+        !(tmp = strstr(line, "avg300=")) ||
+        virStrToDouble(tmp + strlen("avg300="), NULL, &stall->avg300) < 0 ||
+        !(tmp = strstr(line, "total=")) ||
+        virStrToLong_ull(tmp + strlen("total="), NULL, 10, &stall->total) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to parse value '%s' as number."), tmp);
+                       _("cannot parse pressure stall line '%s'"), line);
         return -1;
     }
 
-    if (!(tmp = strstr(str, "system_usec "))) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("cannot parse cpu sys stat '%s'"), str);
+    return 0;
+}
+
+
+static int
+virCgroupV2GetPressure(virCgroupPtr group,
+                       int controller,
+                       virCgroupPressureResource resource,
+                       virCgroupPressurePtr pressure)
+{
+    VIR_AUTOFREE(char *) key = NULL;
+    VIR_AUTOFREE(char *) str = NULL;
+    char **lines = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (virAsprintf(&key, "%s.pressure",
+                    virCgroupPressureResourceTypeToString(resource)) < 0)
+        return -1;
+
+    /* The files don't exist without CONFIG_PSI or with psi=0 */
+    if ((rc = virCgroupGetOptionalStatValueStr(group, controller,
+                                               key, &str)) != 0)
+        return rc;
+
+    if (!(lines = virStringSplit(str, "\n", 0)))
         return -1;
+
+    for (i = 0; lines[i]; i++) {
+        if (STRPREFIX(lines[i], "some ")) {
+            if (virCgroupV2ParsePressureLine(lines[i], &pressure->some) < 0)
+                goto cleanup;
+        } else if (STRPREFIX(lines[i], "full ")) {
+            if (virCgroupV2ParsePressureLine(lines[i], &pressure->full) < 0)
+                goto cleanup;
+            pressure->hasFull = true;
+        }
     }
-    tmp += strlen("system_usec ");
 
-    if (virStrToLong_ull(tmp, &tmp, 10, &sysVal) < 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to parse value '%s' as number."), tmp);
+    ret = 0;
+ cleanup:
+    virStringListFree(lines);
+    return ret;
+}
+
+
+static int
+virCgroupV2OpenPressureTrigger(virCgroupPtr group,
+                               int controller,
+                               virCgroupPressureResource resource,
+                               bool full,
+                               unsigned long long stall,
+                               unsigned long long window)
+{
+    VIR_AUTOFREE(char *) key = NULL;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) trigger = NULL;
+    int fd = -1;
+
+    if (virAsprintf(&key, "%s.pressure",
+                    virCgroupPressureResourceTypeToString(resource)) < 0 ||
+        virCgroupV2PathOfController(group, controller, key, &path) < 0 ||
+        virAsprintf(&trigger, "%s %llu %llu",
+                    full ? "full" : "some", stall, window) < 0)
+        return -1;
+
+    if ((fd = open(path, O_RDWR | O_NONBLOCK | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("Unable to open '%s'"), path);
         return -1;
     }
 
-    *user = userVal * 1000;
-    *sys = sysVal * 1000;
+    /* The trigger stays registered for as long as @fd is open */
+    if (safewrite(fd, trigger, strlen(trigger) + 1) < 0) {
+        virReportSystemError(errno,
+                             _("Unable to register pressure trigger '%s' "
+                               "in '%s'"), trigger, path);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
 
-    return 0;
+    return fd;
 }
 
 
@@ -1592,6 +1724,10 @@ virCgroupBackend virCgroupV2Backend = {
 
     .getCpuacctUsage = virCgroupV2GetCpuacctUsage,
     .getCpuacctStat = virCgroupV2GetCpuacctStat,
+
+    .getStatsSnapshot = virCgroupV2GetStatsSnapshot,
+    .getPressure = virCgroupV2GetPressure,
+    .openPressureTrigger = virCgroupV2OpenPressureTrigger,
 };
 
 
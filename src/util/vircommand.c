@@ -29,6 +29,9 @@
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+# include <spawn.h>
+#endif
 
 #if WITH_CAPNG
 # include <cap-ng.h>
@@ -52,6 +55,7 @@
 #include "virbuffer.h"
 #include "virthread.h"
 #include "virstring.h"
+#include "virbitmap.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -490,6 +494,322 @@ virExecCommon(virCommandPtr cmd, gid_t *groups, int ngroups)
     return ret;
 }
 
+# ifdef __linux__
+/* On Linux, we can utilize procfs and read the table of opened
+ * FDs and selectively close only those FDs we don't want to pass
+ * onto child process (well, the one we will exec soon since this
+ * is called from the child). */
+static int
+virCommandMassCloseGetFDsLinux(virBitmapPtr fds)
+{
+    DIR *dp = NULL;
+    struct dirent *entry;
+    const char *dirName = "/proc/self/fd";
+    int rc;
+    int ret = -1;
+
+    if (virDirOpen(&dp, dirName) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dp, &entry, dirName)) > 0) {
+        int fd;
+
+        if (virStrToLong_i(entry->d_name, NULL, 10, &fd) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("unable to parse FD: %s"),
+                           entry->d_name);
+            goto cleanup;
+        }
+
+        ignore_value(virBitmapSetBit(fds, fd));
+    }
+
+    if (rc < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_DIR_CLOSE(dp);
+    return ret;
+}
+
+#  define virCommandMassCloseGetFDs virCommandMassCloseGetFDsLinux
+
+# else /* !__linux__ */
+
+static int
+virCommandMassCloseGetFDsGeneric(virBitmapPtr fds)
+{
+    virBitmapSetAll(fds);
+    return 0;
+}
+
+#  define virCommandMassCloseGetFDs virCommandMassCloseGetFDsGeneric
+
+# endif /* !__linux__ */
+
+# ifdef HAVE_CLOSE_RANGE
+static bool
+virCommandMassCloseKeepFD(virCommandPtr cmd,
+                          int fd,
+                          int childin,
+                          int childout,
+                          int childerr)
+{
+    return fd == childin || fd == childout || fd == childerr ||
+        virCommandFDIsSet(cmd, fd);
+}
+
+/**
+ * virCommandMassCloseRange:
+ *
+ * Close everything but the FDs to be kept with a few close_range()
+ * calls.
+ *
+ * Returns 0 on success, 1 if close_range() is not supported by the
+ * kernel and no FD was closed, -1 otherwise (with error reported).
+ */
+static int
+virCommandMassCloseRange(virCommandPtr cmd,
+                         int childin,
+                         int childout,
+                         int childerr)
+{
+    unsigned int lastfd = STDERR_FILENO;
+    int maxfd = MAX(childin, MAX(childout, childerr));
+    int fd;
+    size_t i;
+
+    for (i = 0; i < cmd->npassfd; i++)
+        maxfd = MAX(maxfd, cmd->passfd[i].fd);
+
+    for (fd = STDERR_FILENO + 1; fd <= maxfd; fd++) {
+        if (!virCommandMassCloseKeepFD(cmd, fd, childin, childout, childerr))
+            continue;
+
+        if (fd > lastfd + 1 && close_range(lastfd + 1, fd - 1, 0) < 0)
+            goto error;
+
+        lastfd = fd;
+    }
+
+    if (close_range(lastfd + 1, ~0U, 0) < 0)
+        goto error;
+
+    for (i = 0; i < cmd->npassfd; i++) {
+        fd = cmd->passfd[i].fd;
+
+        if (fd == childin || fd == childout || fd == childerr)
+            continue;
+
+        if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+    }
+
+    return 0;
+
+ error:
+    /* The kernel either has close_range() or not, so nothing was
+     * closed yet if it's missing. */
+    if (errno == ENOSYS)
+        return 1;
+
+    virReportSystemError(errno, "%s", _("Unable to mass close FDs"));
+    return -1;
+}
+# endif /* HAVE_CLOSE_RANGE */
+
+/**
+ * virCommandMassClose:
+ *
+ * Close all FDs the child should not inherit. This is called
+ * from the child, which may have a huge FD limit, so only open
+ * FDs are closed where the platform tells which those are.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+static int
+virCommandMassClose(virCommandPtr cmd,
+                    int childin,
+                    int childout,
+                    int childerr)
+{
+    VIR_AUTOPTR(virBitmap) fds = NULL;
+    int openmax = sysconf(_SC_OPEN_MAX);
+    int fd = STDERR_FILENO;
+
+# ifdef HAVE_CLOSE_RANGE
+    int rc;
+
+    if ((rc = virCommandMassCloseRange(cmd, childin, childout, childerr)) <= 0)
+        return rc;
+# endif
+
+    if (openmax < 0) {
+        virReportSystemError(errno,  "%s",
+                             _("sysconf(_SC_OPEN_MAX) failed"));
+        return -1;
+    }
+
+    if (!(fds = virBitmapNew(openmax)))
+        return -1;
+
+    if (virCommandMassCloseGetFDs(fds) < 0)
+        return -1;
+
+    while ((fd = virBitmapNextSetBit(fds, fd)) >= 0) {
+        if (fd == childin || fd == childout || fd == childerr)
+            continue;
+        if (!virCommandFDIsSet(cmd, fd)) {
+            int tmpfd = fd;
+            VIR_MASS_CLOSE(tmpfd);
+        } else if (virSetInherit(fd, true) < 0) {
+            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+# ifdef HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+/*
+ * virCommandCanSpawn:
+ *
+ * Commands which need nothing but their standard FDs set up
+ * before exec() can be started with posix_spawn() which, unlike
+ * fork(), does not have to copy the page tables of the (possibly
+ * huge) daemon.
+ */
+static bool
+virCommandCanSpawn(virCommandPtr cmd,
+                   int childin,
+                   int childout,
+                   int childerr)
+{
+#  if defined(WITH_SECDRIVER_SELINUX)
+    if (cmd->seLinuxLabel)
+        return false;
+#  endif
+#  if defined(WITH_SECDRIVER_APPARMOR)
+    if (cmd->appArmorProfile)
+        return false;
+#  endif
+
+    /* A dup2() onto the very same FD would not clear its
+     * close-on-exec flag with every libc, prepareStdFd() does. */
+    return !cmd->hook &&
+        !cmd->handshake &&
+        !cmd->npassfd &&
+        !cmd->pwd &&
+        !cmd->mask &&
+        !(cmd->flags & (VIR_EXEC_DAEMON |
+                        VIR_EXEC_CLEAR_CAPS |
+                        VIR_EXEC_LISTEN_FDS)) &&
+        cmd->uid == (uid_t)-1 &&
+        cmd->gid == (gid_t)-1 &&
+        !cmd->capabilities &&
+        !cmd->maxMemLock &&
+        !cmd->maxProcesses &&
+        !cmd->maxFiles &&
+        !cmd->setMaxCore &&
+        childin != STDIN_FILENO &&
+        childout != STDOUT_FILENO &&
+        childerr != STDERR_FILENO;
+}
+
+static pid_t
+virExecSpawn(virCommandPtr cmd,
+             const char *binary,
+             int childin,
+             int childout,
+             int childerr)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawnattr_t attr;
+    sigset_t sigdef;
+    sigset_t sigmask;
+    pid_t pid = -1;
+    int rc;
+
+    if ((rc = posix_spawn_file_actions_init(&actions)) != 0) {
+        virReportSystemError(rc, "%s",
+                             _("unable to initialize spawn file actions"));
+        return -1;
+    }
+
+    if ((rc = posix_spawnattr_init(&attr)) != 0) {
+        virReportSystemError(rc, "%s",
+                             _("unable to initialize spawn attributes"));
+        posix_spawn_file_actions_destroy(&actions);
+        return -1;
+    }
+
+    /* Just like virFork(), reset all signal handlers to their
+     * defaults and unblock all signals in the child */
+    sigfillset(&sigdef);
+    sigemptyset(&sigmask);
+
+    if ((rc = posix_spawn_file_actions_adddup2(&actions, childin,
+                                               STDIN_FILENO)) != 0 ||
+        (rc = posix_spawn_file_actions_adddup2(&actions, childout,
+                                               STDOUT_FILENO)) != 0 ||
+        (rc = posix_spawn_file_actions_adddup2(&actions, childerr,
+                                               STDERR_FILENO)) != 0 ||
+        (rc = posix_spawn_file_actions_addclosefrom_np(&actions,
+                                                       STDERR_FILENO + 1)) != 0 ||
+        (rc = posix_spawnattr_setsigdefault(&attr, &sigdef)) != 0 ||
+        (rc = posix_spawnattr_setsigmask(&attr, &sigmask)) != 0 ||
+        (rc = posix_spawnattr_setflags(&attr,
+                                       POSIX_SPAWN_SETSIGDEF |
+                                       POSIX_SPAWN_SETSIGMASK)) != 0) {
+        virReportSystemError(rc, "%s",
+                             _("unable to set up child process"));
+        goto cleanup;
+    }
+
+    VIR_DEBUG("Spawning %s", binary);
+
+    if ((rc = posix_spawn(&pid, binary, &actions, &attr, cmd->args,
+                          cmd->env ? cmd->env : environ)) != 0) {
+        virReportSystemError(rc, _("cannot execute binary %s"),
+                             cmd->args[0]);
+        pid = -1;
+    }
+
+ cleanup:
+    posix_spawnattr_destroy(&attr);
+    posix_spawn_file_actions_destroy(&actions);
+    return pid;
+}
+
+# else /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
+static bool
+virCommandCanSpawn(virCommandPtr cmd ATTRIBUTE_UNUSED,
+                   int childin ATTRIBUTE_UNUSED,
+                   int childout ATTRIBUTE_UNUSED,
+                   int childerr ATTRIBUTE_UNUSED)
+{
+    return false;
+}
+
+static pid_t
+virExecSpawn(virCommandPtr cmd ATTRIBUTE_UNUSED,
+             const char *binary ATTRIBUTE_UNUSED,
+             int childin ATTRIBUTE_UNUSED,
+             int childout ATTRIBUTE_UNUSED,
+             int childerr ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENOSYS, "%s",
+                         _("posix_spawn is not supported on this platform"));
+    return -1;
+}
+
+# endif /* !HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
 /*
  * virExec:
  * @cmd virCommandPtr containing all information about the program to
@@ -499,13 +819,12 @@ static int
 virExec(virCommandPtr cmd)
 {
     pid_t pid;
-    int null = -1, fd, openmax;
+    int null = -1;
     int pipeout[2] = {-1, -1};
     int pipeerr[2] = {-1, -1};
     int childin = cmd->infd;
     int childout = -1;
     int childerr = -1;
-    int tmpfd;
     VIR_AUTOFREE(char *) binarystr = NULL;
     const char *binary = NULL;
     int ret;
@@ -585,7 +904,10 @@ virExec(virCommandPtr cmd)
     if ((ngroups = virGetGroupList(cmd->uid, cmd->gid, &groups)) < 0)
         goto cleanup;
 
-    pid = virFork();
+    if (virCommandCanSpawn(cmd, childin, childout, childerr))
+        pid = virExecSpawn(cmd, binary, childin, childout, childerr);
+    else
+        pid = virFork();
 
     if (pid < 0)
         goto cleanup;
@@ -611,23 +933,9 @@ virExec(virCommandPtr cmd)
     if (cmd->mask)
         umask(cmd->mask);
     ret = EXIT_CANCELED;
-    openmax = sysconf(_SC_OPEN_MAX);
-    if (openmax < 0) {
-        virReportSystemError(errno,  "%s",
-                             _("sysconf(_SC_OPEN_MAX) failed"));
+
+    if (virCommandMassClose(cmd, childin, childout, childerr) < 0)
         goto fork_error;
-    }
-    for (fd = 3; fd < openmax; fd++) {
-        if (fd == childin || fd == childout || fd == childerr)
-            continue;
-        if (!virCommandFDIsSet(cmd, fd)) {
-            tmpfd = fd;
-            VIR_MASS_CLOSE(tmpfd);
-        } else if (virSetInherit(fd, true) < 0) {
-            virReportSystemError(errno, _("failed to preserve fd %d"), fd);
-            goto fork_error;
-        }
-    }
 
     if (prepareStdFd(childin, STDIN_FILENO) < 0) {
         virReportSystemError(errno,
@@ -2877,6 +3185,210 @@ virCommandDoAsyncIO(virCommandPtr cmd)
     cmd->flags |= VIR_EXEC_ASYNC_IO | VIR_EXEC_NONBLOCK;
 }
 
+
+struct _virCommandBatch {
+    char *binary;
+    unsigned int flags;
+    bool oom;
+
+    size_t ncmds;
+    virCommandPtr *cmds;
+};
+
+/**
+ * virCommandBatchNew:
+ * @binary: iproute2 tool to run (e.g. ip or tc)
+ * @flags: bitwise-OR of virCommandBatchFlags
+ *
+ * Create a batch of invocations of @binary. The tools of iproute2
+ * can read any number of commands from their standard input when
+ * run with '-batch -', so with a batch only one process is spawned
+ * for a whole sequence of commands.
+ *
+ * Unless VIR_COMMAND_BATCH_FORCE is set, the commands after the
+ * first failing one are not run.
+ *
+ * Returns the new batch, or NULL on OOM (with error reported).
+ */
+virCommandBatchPtr
+virCommandBatchNew(const char *binary,
+                   unsigned int flags)
+{
+    virCommandBatchPtr batch;
+
+    if (VIR_ALLOC(batch) < 0 ||
+        VIR_STRDUP(batch->binary, binary) < 0) {
+        virCommandBatchFree(batch);
+        return NULL;
+    }
+
+    batch->flags = flags;
+    return batch;
+}
+
+/**
+ * virCommandBatchAdd:
+ * @batch: batch to extend
+ *
+ * Append a new command to @batch. The returned command is owned by
+ * @batch and has @binary as its first argument; only its arguments
+ * are to be modified by the caller. Errors are delayed until
+ * virCommandBatchRun.
+ *
+ * Returns the new command, or NULL on OOM.
+ */
+virCommandPtr
+virCommandBatchAdd(virCommandBatchPtr batch)
+{
+    virCommandPtr cmd;
+
+    if (!(cmd = virCommandNew(batch->binary)) ||
+        VIR_APPEND_ELEMENT_QUIET(batch->cmds, batch->ncmds, cmd) < 0) {
+        virCommandFree(cmd);
+        batch->oom = true;
+        return NULL;
+    }
+
+    return cmd;
+}
+
+/* iproute2 splits batch lines on whitespace and interprets quotes,
+ * backslashes and comments, which we don't bother escaping. */
+static bool
+virCommandBatchIsSafe(virCommandBatchPtr batch)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < batch->ncmds; i++) {
+        virCommandPtr cmd = batch->cmds[i];
+
+        /* Let virCommandRun report the error */
+        if (cmd->has_error)
+            return false;
+
+        for (j = 1; j < cmd->nargs; j++) {
+            if (!*cmd->args[j] || strpbrk(cmd->args[j], " \t\n\"'\\#"))
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/* Run the commands of @batch one by one, which is what we fall back
+ * to whenever they can't be passed to a single process. */
+static int
+virCommandBatchRunEach(virCommandBatchPtr batch,
+                       int *exitstatus)
+{
+    bool force = batch->flags & VIR_COMMAND_BATCH_FORCE;
+    int status = 0;
+    size_t i;
+
+    for (i = 0; i < batch->ncmds; i++) {
+        int rc = 0;
+
+        if (virCommandRun(batch->cmds[i],
+                          exitstatus || force ? &rc : NULL) < 0)
+            return -1;
+
+        if (rc != 0) {
+            status = rc;
+            if (!force)
+                break;
+        }
+    }
+
+    if (exitstatus) {
+        *exitstatus = status;
+    } else if (status) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Child process (%s) unexpected exit status %d"),
+                       batch->binary, status);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * virCommandBatchRun:
+ * @batch: batch to run
+ * @exitstatus: optional status collection
+ *
+ * Run all commands of @batch and wait for completion. The meaning
+ * of the return value and of @exitstatus is the same as for
+ * virCommandRun, with @exitstatus being the status of the tool
+ * that run the command(s).
+ */
+int
+virCommandBatchRun(virCommandBatchPtr batch,
+                   int *exitstatus)
+{
+    VIR_AUTOPTR(virCommand) cmd = NULL;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+    size_t j;
+
+    if (!batch || batch->oom) {
+        virReportOOMError();
+        return -1;
+    }
+
+    /* Single commands don't gain anything from batching, and tests
+     * want to see the individual commands in dry run mode. */
+    if (batch->ncmds <= 1 || dryRunBuffer || dryRunCallback ||
+        !virCommandBatchIsSafe(batch))
+        return virCommandBatchRunEach(batch, exitstatus);
+
+    for (i = 0; i < batch->ncmds; i++) {
+        virCommandPtr line = batch->cmds[i];
+
+        for (j = 1; j < line->nargs; j++) {
+            if (j > 1)
+                virBufferAddChar(&buf, ' ');
+            virBufferAdd(&buf, line->args[j], -1);
+        }
+        virBufferAddChar(&buf, '\n');
+    }
+
+    if (virBufferCheckError(&buf) < 0)
+        return -1;
+
+    cmd = virCommandNew(batch->binary);
+    if (batch->flags & VIR_COMMAND_BATCH_FORCE)
+        virCommandAddArg(cmd, "-force");
+    virCommandAddArgList(cmd, "-batch", "-", NULL);
+    virCommandSetInputBuffer(cmd, virBufferCurrentContent(&buf));
+
+    VIR_DEBUG("Running %zu commands of %s in a batch",
+              batch->ncmds, batch->binary);
+
+    if (virCommandRun(cmd, exitstatus) < 0) {
+        virBufferFreeAndReset(&buf);
+        return -1;
+    }
+
+    virBufferFreeAndReset(&buf);
+    return 0;
+}
+
+void
+virCommandBatchFree(virCommandBatchPtr batch)
+{
+    size_t i;
+
+    if (!batch)
+        return;
+
+    for (i = 0; i < batch->ncmds; i++)
+        virCommandFree(batch->cmds[i]);
+    VIR_FREE(batch->cmds);
+    VIR_FREE(batch->binary);
+    VIR_FREE(batch);
+}
+
 /**
  * virCommandSetDryRun:
  * @buf: buffer to store stringified commands
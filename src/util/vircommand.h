@@ -219,6 +219,27 @@ int virCommandRunNul(virCommandPtr cmd,
                      virCommandRunNulFunc func,
                      void *data);
 
+typedef struct _virCommandBatch virCommandBatch;
+typedef virCommandBatch *virCommandBatchPtr;
+
+typedef enum {
+    /* Keep going after a command failed */
+    VIR_COMMAND_BATCH_FORCE = (1 << 0),
+} virCommandBatchFlags;
+
+virCommandBatchPtr virCommandBatchNew(const char *binary,
+                                      unsigned int flags)
+    ATTRIBUTE_NONNULL(1);
+
+virCommandPtr virCommandBatchAdd(virCommandBatchPtr batch)
+    ATTRIBUTE_NONNULL(1);
+
+int virCommandBatchRun(virCommandBatchPtr batch,
+                       int *exitstatus) ATTRIBUTE_RETURN_CHECK;
+
+void virCommandBatchFree(virCommandBatchPtr batch);
+
 VIR_DEFINE_AUTOPTR_FUNC(virCommand, virCommandFree)
+VIR_DEFINE_AUTOPTR_FUNC(virCommandBatch, virCommandBatchFree)
 
 #endif /* __VIR_COMMAND_H__ */
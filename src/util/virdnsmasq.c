@@ -36,7 +36,9 @@
 #include "virdnsmasq.h"
 #include "virutil.h"
 #include "vircommand.h"
+#include "vircrypto.h"
 #include "viralloc.h"
+#include "virhash.h"
 #include "virerror.h"
 #include "virlog.h"
 #include "virfile.h"
@@ -48,6 +50,7 @@ VIR_LOG_INIT("util.dnsmasq");
 
 #define DNSMASQ_HOSTSFILE_SUFFIX "hostsfile"
 #define DNSMASQ_ADDNHOSTSFILE_SUFFIX "addnhosts"
+#define DNSMASQ_HOSTSDIR_SUFFIX "d"
 
 static void
 dhcphostFree(dnsmasqDhcpHost *host)
@@ -81,6 +84,7 @@ addnhostsFree(dnsmasqAddnHostsfile *addnhostsfile)
     }
 
     VIR_FREE(addnhostsfile->path);
+    VIR_FREE(addnhostsfile->dir);
 
     VIR_FREE(addnhostsfile);
 }
@@ -160,6 +164,10 @@ addnhostsNew(const char *name,
     if (!(addnhostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
 
+    if (virAsprintf(&addnhostsfile->dir, "%s.%s", addnhostsfile->path,
+                    DNSMASQ_HOSTSDIR_SUFFIX) < 0)
+        goto error;
+
     return addnhostsfile;
 
  error:
@@ -290,6 +298,7 @@ hostsfileFree(dnsmasqHostsfile *hostsfile)
     }
 
     VIR_FREE(hostsfile->path);
+    VIR_FREE(hostsfile->dir);
 
     VIR_FREE(hostsfile);
 }
@@ -373,6 +382,11 @@ hostsfileNew(const char *name,
 
     if (!(hostsfile->path = virBufferContentAndReset(&buf)))
         goto error;
+
+    if (virAsprintf(&hostsfile->dir, "%s.%s", hostsfile->path,
+                    DNSMASQ_HOSTSDIR_SUFFIX) < 0)
+        goto error;
+
     return hostsfile;
 
  error:
@@ -451,6 +465,177 @@ hostsfileSave(dnsmasqHostsfile *hostsfile)
     return 0;
 }
 
+static int
+hostsdirWriteEntry(void *payload,
+                   const void *name,
+                   void *opaque)
+{
+    const char *dir = opaque;
+    const char *line = payload;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) tmp = NULL;
+    VIR_AUTOFREE(char *) content = NULL;
+
+    /* dnsmasq ignores files starting with a dot, so it only reads
+     * the entry once it is complete */
+    if (virAsprintf(&path, "%s/%s", dir, (const char *)name) < 0 ||
+        virAsprintf(&tmp, "%s/.%s", dir, (const char *)name) < 0 ||
+        virAsprintf(&content, "%s\n", line) < 0)
+        return -1;
+
+    if (virFileWriteStr(tmp, content, 0644) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%s'"), tmp);
+        unlink(tmp);
+        return -1;
+    }
+
+    if (rename(tmp, path) < 0) {
+        virReportSystemError(errno, _("cannot write config file '%s'"), path);
+        unlink(tmp);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Make @dir contain one file per entry of @lines. The files are named
+ * after the hash of their contents, so entries which didn't change are
+ * left alone and dnsmasq, which watches the directory using inotify,
+ * only reads the added ones. dnsmasq keeps the entries of removed files
+ * until it gets SIGHUP, @removed is set to true if there were any.
+ */
+static int
+hostsdirSync(const char *dir,
+             char **lines,
+             size_t nlines,
+             bool *removed)
+{
+    virHashTablePtr wanted = NULL;
+    struct dirent *ent;
+    DIR *dh = NULL;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    if (virFileMakePath(dir) < 0) {
+        virReportSystemError(errno, _("cannot create config directory '%s'"),
+                             dir);
+        return -1;
+    }
+
+    if (!(wanted = virHashCreate(nlines + 1, NULL)))
+        goto cleanup;
+
+    for (i = 0; i < nlines; i++) {
+        VIR_AUTOFREE(char *) name = NULL;
+
+        if (virCryptoHashString(VIR_CRYPTO_HASH_SHA256, lines[i], &name) < 0 ||
+            virHashUpdateEntry(wanted, name, lines[i]) < 0)
+            goto cleanup;
+    }
+
+    if (virDirOpen(&dh, dir) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dh, &ent, dir)) > 0) {
+        VIR_AUTOFREE(char *) path = NULL;
+
+        if (virHashLookup(wanted, ent->d_name)) {
+            ignore_value(virHashRemoveEntry(wanted, ent->d_name));
+            continue;
+        }
+
+        if (virAsprintf(&path, "%s/%s", dir, ent->d_name) < 0)
+            goto cleanup;
+
+        if (unlink(path) < 0 && errno != ENOENT) {
+            virReportSystemError(errno, _("cannot remove config file '%s'"),
+                                 path);
+            goto cleanup;
+        }
+
+        /* leftovers of an interrupted write were never read by dnsmasq */
+        if (ent->d_name[0] != '.')
+            *removed = true;
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    if (virHashForEach(wanted, hostsdirWriteEntry, (void *)dir) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dh);
+    virHashFree(wanted);
+    return ret;
+}
+
+static int
+hostsdirDelete(const char *dir)
+{
+    if (!virFileIsDir(dir))
+        return 0;
+
+    return virFileDeleteTree(dir);
+}
+
+static int
+hostsfileSaveDir(dnsmasqHostsfile *hostsfile,
+                 bool *removed)
+{
+    VIR_AUTOFREE(char **) lines = NULL;
+    size_t i;
+
+    if (VIR_ALLOC_N(lines, hostsfile->nhosts + 1) < 0)
+        return -1;
+
+    for (i = 0; i < hostsfile->nhosts; i++)
+        lines[i] = hostsfile->hosts[i].host;
+
+    if (hostsdirSync(hostsfile->dir, lines, hostsfile->nhosts, removed) < 0)
+        return -1;
+
+    return genericFileDelete(hostsfile->path);
+}
+
+static int
+addnhostsSaveDir(dnsmasqAddnHostsfile *addnhostsfile,
+                 bool *removed)
+{
+    char **lines = NULL;
+    size_t i, j;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(lines, addnhostsfile->nhosts + 1) < 0)
+        return -1;
+
+    /* same format as addnhostsWrite() */
+    for (i = 0; i < addnhostsfile->nhosts; i++) {
+        dnsmasqAddnHost *host = &addnhostsfile->hosts[i];
+        virBuffer buf = VIR_BUFFER_INITIALIZER;
+
+        virBufferAsprintf(&buf, "%s\t", host->ip);
+        for (j = 0; j < host->nhostnames; j++)
+            virBufferAsprintf(&buf, "%s\t", host->hostnames[j]);
+
+        if (virBufferCheckError(&buf) < 0)
+            goto cleanup;
+        lines[i] = virBufferContentAndReset(&buf);
+    }
+
+    if (hostsdirSync(addnhostsfile->dir, lines, addnhostsfile->nhosts,
+                     removed) < 0)
+        goto cleanup;
+
+    ret = genericFileDelete(addnhostsfile->path);
+
+ cleanup:
+    virStringListFree(lines);
+    return ret;
+}
+
 /**
  * dnsmasqContextNew:
  *
@@ -549,23 +734,56 @@ dnsmasqAddHost(dnsmasqContext *ctx,
  */
 int
 dnsmasqSave(const dnsmasqContext *ctx)
+{
+    bool reload;
+
+    return dnsmasqSaveChanges(ctx, &reload);
+}
+
+/**
+ * dnsmasqSaveChanges:
+ * @ctx: pointer to the dnsmasq context for each network
+ * @reload: set to true if dnsmasq has to be reloaded
+ *
+ * Saves all the configurations associated with a context to disk, like
+ * dnsmasqSave(). With @ctx->hostsdir only the files of added or removed
+ * entries are touched, and dnsmasq picks added entries up by itself.
+ * It needs a reload using dnsmasqReload() only if @reload is set.
+ */
+int
+dnsmasqSaveChanges(const dnsmasqContext *ctx,
+                   bool *reload)
 {
     int ret = 0;
 
+    *reload = !ctx->hostsdir;
+
     if (virFileMakePath(ctx->config_dir) < 0) {
         virReportSystemError(errno, _("cannot create config directory '%s'"),
                              ctx->config_dir);
         return -1;
     }
 
-    if (ctx->hostsfile)
-        ret = hostsfileSave(ctx->hostsfile);
-    if (ret == 0) {
-        if (ctx->addnhostsfile)
-            ret = addnhostsSave(ctx->addnhostsfile);
+    if (ctx->hostsdir) {
+        if (ctx->hostsfile)
+            ret = hostsfileSaveDir(ctx->hostsfile, reload);
+        if (ret == 0 && ctx->addnhostsfile)
+            ret = addnhostsSaveDir(ctx->addnhostsfile, reload);
+        return ret;
     }
 
-    return ret;
+    /* drop the directories of a dnsmasq that supported them, so that
+     * they are not mistaken for the current format */
+    if (ctx->hostsfile &&
+        (hostsdirDelete(ctx->hostsfile->dir) < 0 ||
+         hostsfileSave(ctx->hostsfile) < 0))
+        return -1;
+    if (ctx->addnhostsfile &&
+        (hostsdirDelete(ctx->addnhostsfile->dir) < 0 ||
+         addnhostsSave(ctx->addnhostsfile) < 0))
+        return -1;
+
+    return 0;
 }
 
 
@@ -580,10 +798,14 @@ dnsmasqDelete(const dnsmasqContext *ctx)
 {
     int ret = 0;
 
-    if (ctx->hostsfile)
-        ret = genericFileDelete(ctx->hostsfile->path);
-    if (ctx->addnhostsfile)
-        ret = genericFileDelete(ctx->addnhostsfile->path);
+    if (ctx->hostsfile &&
+        (genericFileDelete(ctx->hostsfile->path) < 0 ||
+         hostsdirDelete(ctx->hostsfile->dir) < 0))
+        ret = -1;
+    if (ctx->addnhostsfile &&
+        (genericFileDelete(ctx->addnhostsfile->path) < 0 ||
+         hostsdirDelete(ctx->addnhostsfile->dir) < 0))
+        ret = -1;
 
     return ret;
 }
@@ -683,6 +905,10 @@ dnsmasqCapsSetFromBuffer(dnsmasqCapsPtr caps, const char *buf)
     if (strstr(buf, "--ra-param"))
         dnsmasqCapsSet(caps, DNSMASQ_CAPS_RA_PARAM);
 
+    /* inotify watched directories, dnsmasq 2.73 and newer */
+    if (strstr(buf, "--dhcp-hostsdir") && strstr(buf, "--hostsdir"))
+        dnsmasqCapsSet(caps, DNSMASQ_CAPS_HOSTSDIR);
+
     VIR_INFO("dnsmasq version is %d.%d, --bind-dynamic is %spresent, "
              "SO_BINDTODEVICE is %sin use, --ra-param is %spresent",
              (int)caps->version / 1000000,
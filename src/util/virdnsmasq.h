@@ -43,6 +43,7 @@ typedef struct
     dnsmasqDhcpHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's dhcp-hostsdir. */
 } dnsmasqHostsfile;
 
 typedef struct
@@ -59,6 +60,7 @@ typedef struct
     dnsmasqAddnHost *hosts;
 
     char            *path;  /* Absolute path of dnsmasq's hostsfile. */
+    char            *dir;   /* Absolute path of dnsmasq's hostsdir. */
 } dnsmasqAddnHostsfile;
 
 typedef struct
@@ -66,12 +68,14 @@ typedef struct
     char                 *config_dir;
     dnsmasqHostsfile     *hostsfile;
     dnsmasqAddnHostsfile *addnhostsfile;
+    bool                 hostsdir; /* save one file per host in dirs */
 } dnsmasqContext;
 
 typedef enum {
    DNSMASQ_CAPS_BIND_DYNAMIC = 0, /* support for --bind-dynamic */
    DNSMASQ_CAPS_BINDTODEVICE = 1, /* uses SO_BINDTODEVICE for --bind-interfaces */
    DNSMASQ_CAPS_RA_PARAM = 2,     /* support for --ra-param */
+   DNSMASQ_CAPS_HOSTSDIR = 3,     /* support for --dhcp-hostsdir and --hostsdir */
 
    DNSMASQ_CAPS_LAST,             /* this must always be the last item */
 } dnsmasqCapsFlags;
@@ -93,6 +97,8 @@ int              dnsmasqAddHost(dnsmasqContext *ctx,
                                 virSocketAddr *ip,
                                 const char *name);
 int              dnsmasqSave(const dnsmasqContext *ctx);
+int              dnsmasqSaveChanges(const dnsmasqContext *ctx,
+                                    bool *reload);
 int              dnsmasqDelete(const dnsmasqContext *ctx);
 int              dnsmasqReload(pid_t pid);
 
@@ -53,7 +53,6 @@ static virLogPriority virErrorLevelPriority(virErrorLevel level)
 }
 
 
-VIR_ENUM_DECL(virErrorDomain)
 VIR_ENUM_IMPL(virErrorDomain, VIR_ERR_DOMAIN_LAST,
               "", /* 0 */
               "Xen Driver",
@@ -136,6 +135,7 @@ VIR_ENUM_IMPL(virErrorDomain, VIR_ERR_DOMAIN_LAST,
               "Perf", /* 65 */
               "Libssh transport layer",
               "Resource control",
+              "Domain Checkpoint",
               )
 
 
@@ -1509,6 +1509,18 @@ virErrorMsg(virErrorNumber error, const char *info)
             else
                 errmsg = _("Network filter binding not found: %s");
             break;
+        case VIR_ERR_INVALID_DOMAIN_CHECKPOINT:
+            if (info == NULL)
+                errmsg = _("Invalid checkpoint");
+            else
+                errmsg = _("Invalid checkpoint: %s");
+            break;
+        case VIR_ERR_NO_DOMAIN_CHECKPOINT:
+            if (info == NULL)
+                errmsg = _("Domain checkpoint not found");
+            else
+                errmsg = _("Domain checkpoint not found: %s");
+            break;
     }
     return errmsg;
 }
@@ -201,6 +201,10 @@ void virSetErrorLogPriorityFunc(virErrorLogPriorityFunc func);
 
 void virErrorSetErrnoFromLastError(void);
 
+/* same as VIR_ENUM_DECL(virErrorDomain), which isn't available here */
+const char *virErrorDomainTypeToString(int type);
+int virErrorDomainTypeFromString(const char *type);
+
 bool virLastErrorIsSystemErrno(int errnum);
 
 void virErrorPreserveLast(virErrorPtr *saveerr);
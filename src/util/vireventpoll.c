@@ -27,6 +27,9 @@
 #include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#ifdef HAVE_SYS_EPOLL_H
+# include <sys/epoll.h>
+#endif
 
 #include "virthread.h"
 #include "virlog.h"
@@ -37,6 +40,9 @@
 #include "virerror.h"
 #include "virprobe.h"
 #include "virtime.h"
+#include "virobject.h"
+#include "virhash.h"
+#include "virhashcode.h"
 
 #define EVENT_DEBUG(fmt, ...) VIR_DEBUG(fmt, __VA_ARGS__)
 
@@ -44,7 +50,7 @@
 
 VIR_LOG_INIT("util.eventpoll");
 
-static int virEventPollInterruptLocked(void);
+static int virEventPollInterruptLocked(virEventPollLoopPtr loop);
 
 /* State for a single file handle being monitored */
 struct virEventPollHandle {
@@ -55,8 +61,22 @@ struct virEventPollHandle {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    /* Next handle watching the same file descriptor */
+    struct virEventPollHandle *next;
 };
 
+/* State shared by all handles watching the same file descriptor */
+struct virEventPollFD {
+    int fd;
+    int events;       /* Union of the events of all live handles */
+    bool registered;  /* Registered with epoll using @events */
+    bool unpollable;  /* Refused by epoll, treated as always ready */
+    struct virEventPollHandle *handles;
+};
+
+/* Marks a timer as not being in the timer heap */
+#define EVENT_NO_HEAP SIZE_MAX
+
 /* State for a single timer being generated */
 struct virEventPollTimeout {
     int timer;
@@ -66,84 +86,395 @@ struct virEventPollTimeout {
     virFreeCallback ff;
     void *opaque;
     int deleted;
+    bool due;         /* Waiting to be dispatched in this iteration */
+    size_t heapIndex; /* Position in the timer heap, or EVENT_NO_HEAP */
 };
 
-/* Allocate extra slots for virEventPollHandle/virEventPollTimeout
-   records in this multiple */
-#define EVENT_ALLOC_EXTENT 10
+/* Upper limit of events to fetch with a single epoll_wait() */
+#define EVENT_EPOLL_MAX_EVENTS 256
+
+/* State for an event loop */
+struct _virEventPollLoop {
+    virObjectLockable parent;
 
-/* State for the main event loop */
-struct virEventPollLoop {
-    virMutex lock;
     int running;
+    bool quit;
     virThread leader;
     int wakeupfd[2];
-    size_t handlesCount;
-    size_t handlesAlloc;
-    struct virEventPollHandle *handles;
-    size_t timeoutsCount;
-    size_t timeoutsAlloc;
-    struct virEventPollTimeout *timeouts;
+    /* Unique ID for the next FD watch to be registered */
+    int nextWatch;
+    /* Unique ID for the next timer to be registered */
+    int nextTimer;
+
+    /* epoll instance, or -1 when falling back to poll() */
+    int epollfd;
+#ifdef HAVE_SYS_EPOLL_H
+    size_t epollEventsAlloc;
+    struct epoll_event *epollEvents;
+#endif
+
+    /* Live handles, indexed by watch */
+    virHashTablePtr handles;
+    /* struct virEventPollFD, indexed by file descriptor */
+    virHashTablePtr fds;
+    /* File descriptors which epoll refused to watch */
+    size_t nunpollable;
+    int *unpollable;
+    /* Number of handles not yet purged, live or deleted */
+    size_t nhandles;
+    /* Deleted handles waiting for their free callback */
+    size_t ndeletedHandles;
+    size_t deletedHandlesAlloc;
+    struct virEventPollHandle **deletedHandles;
+
+    /* Live timers, indexed by timer ID */
+    virHashTablePtr timeouts;
+    /* Number of timers not yet purged, live or deleted */
+    size_t ntimeouts;
+    /* Min heap of enabled timers, ordered by expiry time */
+    size_t nheap;
+    size_t heapAlloc;
+    struct virEventPollTimeout **heap;
+    /* Timers collected for dispatch */
+    size_t dueAlloc;
+    struct virEventPollTimeout **due;
+    /* Deleted timers waiting for their free callback */
+    size_t ndeletedTimeouts;
+    size_t deletedTimeoutsAlloc;
+    struct virEventPollTimeout **deletedTimeouts;
 };
 
-/* Only have one event loop */
-static struct virEventPollLoop eventLoop;
+static virClassPtr virEventPollLoopClass;
+static void virEventPollLoopDispose(void *obj);
+
+static int virEventPollLoopOnceInit(void)
+{
+    if (!VIR_CLASS_NEW(virEventPollLoop, virClassForObjectLockable()))
+        return -1;
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virEventPollLoop)
+
+/* The default event loop, used by virEventRegisterDefaultImpl */
+static virEventPollLoopPtr eventLoop;
+
+
+/* Watch IDs, timer IDs and file descriptors are used as hash keys
+ * directly. They are shifted by one as fd 0 would be a NULL key. */
+static const void *
+virEventPollKey(int id)
+{
+    return (const void *)(intptr_t)(id + 1);
+}
+
+static uint32_t
+virEventPollKeyCode(const void *name, uint32_t seed)
+{
+    intptr_t id = (intptr_t)name;
+    return virHashCodeGen(&id, sizeof(id), seed);
+}
+
+static bool
+virEventPollKeyEqual(const void *namea, const void *nameb)
+{
+    return namea == nameb;
+}
+
+static void *
+virEventPollKeyCopy(const void *name)
+{
+    return (void *)name;
+}
+
+static virHashTablePtr
+virEventPollHashNew(void)
+{
+    return virHashCreateFull(64, NULL,
+                             virEventPollKeyCode,
+                             virEventPollKeyEqual,
+                             virEventPollKeyCopy,
+                             NULL);
+}
+
+
+#ifdef HAVE_SYS_EPOLL_H
+static int
+virEventPollToEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & POLLIN)
+        ret |= EPOLLIN;
+    if (events & POLLOUT)
+        ret |= EPOLLOUT;
+    if (events & POLLERR)
+        ret |= EPOLLERR;
+    if (events & POLLHUP)
+        ret |= EPOLLHUP;
+    return ret;
+}
+
+static int
+virEventPollFromEpollEvents(int events)
+{
+    int ret = 0;
+    if (events & EPOLLIN)
+        ret |= POLLIN;
+    if (events & EPOLLOUT)
+        ret |= POLLOUT;
+    if (events & EPOLLERR)
+        ret |= POLLERR;
+    if (events & EPOLLHUP)
+        ret |= POLLHUP;
+    return ret;
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
+/*
+ * Forget that epoll refused to watch @f, so that it stops being
+ * reported as always ready.
+ */
+static void
+virEventPollDropUnpollable(virEventPollLoopPtr loop,
+                           struct virEventPollFD *f)
+{
+    size_t i;
+
+    if (!f->unpollable)
+        return;
+
+    for (i = 0; i < loop->nunpollable; i++) {
+        if (loop->unpollable[i] == f->fd) {
+            VIR_DELETE_ELEMENT(loop->unpollable, i, loop->nunpollable);
+            break;
+        }
+    }
+    f->unpollable = false;
+}
+
+
+/*
+ * Bring the epoll registration of @f in line with the events
+ * its handles are interested in. File descriptors which epoll
+ * does not support, such as regular files, are always readable
+ * and writable for poll(), so they are remembered and reported
+ * as ready on every iteration instead.
+ *
+ * returns 0 on success, -1 on error
+ */
+static int
+virEventPollUpdateFD(virEventPollLoopPtr loop,
+                     struct virEventPollFD *f)
+{
+    struct virEventPollHandle *h;
+    int events = 0;
+
+    for (h = f->handles; h; h = h->next) {
+        if (!h->deleted)
+            events |= h->events;
+    }
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Nobody is interested in the FD anymore, don't keep the loop
+     * spinning on it */
+    if (!events)
+        virEventPollDropUnpollable(loop, f);
+
+    if (loop->epollfd >= 0 && !f->unpollable &&
+        (events != f->events || f->registered != !!events)) {
+        struct epoll_event ev;
+        int op;
+
+        memset(&ev, 0, sizeof(ev));
+        ev.events = virEventPollToEpollEvents(events);
+        ev.data.fd = f->fd;
+
+        if (!events)
+            op = EPOLL_CTL_DEL;
+        else if (f->registered)
+            op = EPOLL_CTL_MOD;
+        else
+            op = EPOLL_CTL_ADD;
+
+        if (epoll_ctl(loop->epollfd, op, f->fd, &ev) < 0) {
+            /* The kernel drops the registration by itself when the
+             * file is closed, so the FD number might have been reused
+             * since, or be gone for good */
+            if (op == EPOLL_CTL_MOD && errno == ENOENT) {
+                op = EPOLL_CTL_ADD;
+            } else if (op == EPOLL_CTL_ADD && errno == EEXIST) {
+                op = EPOLL_CTL_MOD;
+            } else if (op == EPOLL_CTL_DEL) {
+                op = -1;
+            } else if (op == EPOLL_CTL_ADD && errno == EPERM) {
+                if (VIR_APPEND_ELEMENT_COPY(loop->unpollable,
+                                            loop->nunpollable, f->fd) < 0)
+                    return -1;
+                f->unpollable = true;
+                op = -1;
+            } else {
+                goto error;
+            }
+
+            if (op >= 0 && epoll_ctl(loop->epollfd, op, f->fd, &ev) < 0)
+                goto error;
+        }
+
+        f->registered = events && !f->unpollable;
+    }
+#endif /* HAVE_SYS_EPOLL_H */
+
+    f->events = events;
+    return 0;
+
+#ifdef HAVE_SYS_EPOLL_H
+ error:
+    virReportSystemError(errno,
+                         _("Unable to update epoll watch of handle %d"),
+                         f->fd);
+    return -1;
+#endif
+}
+
+/*
+ * Link @h to the state of its file descriptor.
+ *
+ * returns 0 on success, -1 on error
+ */
+static int
+virEventPollAttachHandle(virEventPollLoopPtr loop,
+                         struct virEventPollHandle *h)
+{
+    struct virEventPollFD *f;
+    struct virEventPollHandle **tail;
+
+    if (!(f = virHashLookup(loop->fds, virEventPollKey(h->fd)))) {
+        if (VIR_ALLOC(f) < 0)
+            return -1;
+        f->fd = h->fd;
+        if (virHashAddEntry(loop->fds, virEventPollKey(h->fd), f) < 0) {
+            VIR_FREE(f);
+            return -1;
+        }
+    }
+
+    for (tail = &f->handles; *tail; tail = &(*tail)->next)
+        ;
+    *tail = h;
+
+    if (virEventPollUpdateFD(loop, f) < 0) {
+        *tail = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Unlink a purged @h from the state of its file descriptor,
+ * dropping the latter if no other handle uses it.
+ */
+static void
+virEventPollDetachHandle(virEventPollLoopPtr loop,
+                         struct virEventPollHandle *h)
+{
+    struct virEventPollFD *f;
+    struct virEventPollHandle **prev;
+
+    if (!(f = virHashLookup(loop->fds, virEventPollKey(h->fd))))
+        return;
+
+    for (prev = &f->handles; *prev; prev = &(*prev)->next) {
+        if (*prev == h) {
+            *prev = h->next;
+            break;
+        }
+    }
+
+    if (f->handles)
+        return;
 
-/* Unique ID for the next FD watch to be registered */
-static int nextWatch = 1;
+    virEventPollDropUnpollable(loop, f);
+    virHashRemoveEntry(loop->fds, virEventPollKey(f->fd));
+    VIR_FREE(f);
+}
 
-/* Unique ID for the next timer to be registered */
-static int nextTimer = 1;
+/*
+ * With poll() every change needs the loop to rebuild its pollfd
+ * array, while epoll picks up changes to its set right away. Only
+ * unpollable file descriptors need the loop to recalculate its
+ * timeout.
+ */
+static void
+virEventPollInterruptForHandle(virEventPollLoopPtr loop)
+{
+    if (loop->epollfd < 0 || loop->nunpollable)
+        virEventPollInterruptLocked(loop);
+}
 
 /*
  * Register a callback for monitoring file handle events.
  * NB, it *must* be safe to call this from within a callback
- * For this reason we only ever append to existing list.
  */
-int virEventPollAddHandle(int fd, int events,
-                          virEventHandleCallback cb,
-                          void *opaque,
-                          virFreeCallback ff)
+int virEventPollLoopAddHandle(virEventPollLoopPtr loop,
+                              int fd, int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff)
 {
+    struct virEventPollHandle *h;
     int watch;
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.handlesCount == eventLoop.handlesAlloc) {
-        EVENT_DEBUG("Used %zu handle slots, adding at least %d more",
-                    eventLoop.handlesAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.handles, eventLoop.handlesAlloc,
-                         eventLoop.handlesCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
+
+    virObjectLock(loop);
+
+    /* Make sure removing the handle later on cannot fail */
+    if (VIR_RESIZE_N(loop->deletedHandles, loop->deletedHandlesAlloc,
+                     loop->nhandles, 1) < 0 ||
+        VIR_ALLOC(h) < 0) {
+        virObjectUnlock(loop);
+        return -1;
     }
 
-    watch = nextWatch++;
+    watch = loop->nextWatch++;
 
-    eventLoop.handles[eventLoop.handlesCount].watch = watch;
-    eventLoop.handles[eventLoop.handlesCount].fd = fd;
-    eventLoop.handles[eventLoop.handlesCount].events =
-                                         virEventPollToNativeEvents(events);
-    eventLoop.handles[eventLoop.handlesCount].cb = cb;
-    eventLoop.handles[eventLoop.handlesCount].ff = ff;
-    eventLoop.handles[eventLoop.handlesCount].opaque = opaque;
-    eventLoop.handles[eventLoop.handlesCount].deleted = 0;
+    h->watch = watch;
+    h->fd = fd;
+    h->events = virEventPollToNativeEvents(events);
+    h->cb = cb;
+    h->ff = ff;
+    h->opaque = opaque;
 
-    eventLoop.handlesCount++;
+    if (virHashAddEntry(loop->handles, virEventPollKey(watch), h) < 0) {
+        VIR_FREE(h);
+        virObjectUnlock(loop);
+        return -1;
+    }
+
+    if (virEventPollAttachHandle(loop, h) < 0) {
+        virHashRemoveEntry(loop->handles, virEventPollKey(watch));
+        VIR_FREE(h);
+        virObjectUnlock(loop);
+        return -1;
+    }
 
-    virEventPollInterruptLocked();
+    loop->nhandles++;
+
+    virEventPollInterruptForHandle(loop);
 
     PROBE(EVENT_POLL_ADD_HANDLE,
           "watch=%d fd=%d events=%d cb=%p opaque=%p ff=%p",
           watch, fd, events, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    virObjectUnlock(loop);
 
     return watch;
 }
 
-void virEventPollUpdateHandle(int watch, int events)
+void virEventPollLoopUpdateHandle(virEventPollLoopPtr loop,
+                                  int watch, int events)
 {
-    size_t i;
-    bool found = false;
+    struct virEventPollHandle *h;
     PROBE(EVENT_POLL_UPDATE_HANDLE,
           "watch=%d events=%d",
           watch, events);
@@ -153,31 +484,31 @@ void virEventPollUpdateHandle(int watch, int events)
         return;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].watch == watch) {
-            eventLoop.handles[i].events =
-                    virEventPollToNativeEvents(events);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    virObjectLock(loop);
+    if (!(h = virHashLookup(loop->handles, virEventPollKey(watch)))) {
+        virObjectUnlock(loop);
+        VIR_WARN("Got update for non-existent handle watch %d", watch);
+        return;
     }
-    virMutexUnlock(&eventLoop.lock);
 
-    if (!found)
-        VIR_WARN("Got update for non-existent handle watch %d", watch);
+    h->events = virEventPollToNativeEvents(events);
+    if (virEventPollUpdateFD(loop, virHashLookup(loop->fds,
+                                                 virEventPollKey(h->fd))) < 0)
+        VIR_WARN("Failed to update handle watch %d: %s",
+                 watch, virGetLastErrorMessage());
+    virEventPollInterruptForHandle(loop);
+    virObjectUnlock(loop);
 }
 
 /*
  * Unregister a callback from a file handle
  * NB, it *must* be safe to call this from within a callback
- * For this reason we only ever set a flag in the existing list.
+ * For this reason we only ever set a flag on the handle.
  * Actual deletion will be done out-of-band
  */
-int virEventPollRemoveHandle(int watch)
+int virEventPollLoopRemoveHandle(virEventPollLoopPtr loop, int watch)
 {
-    size_t i;
+    struct virEventPollHandle *h;
     PROBE(EVENT_POLL_REMOVE_HANDLE,
           "watch=%d",
           watch);
@@ -187,76 +518,173 @@ int virEventPollRemoveHandle(int watch)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].deleted)
-            continue;
+    virObjectLock(loop);
+    if (!(h = virHashSteal(loop->handles, virEventPollKey(watch)))) {
+        virObjectUnlock(loop);
+        return -1;
+    }
 
-        if (eventLoop.handles[i].watch == watch) {
-            EVENT_DEBUG("mark delete %zu %d", i, eventLoop.handles[i].fd);
-            eventLoop.handles[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    EVENT_DEBUG("mark delete %d %d", h->watch, h->fd);
+    h->deleted = 1;
+    loop->deletedHandles[loop->ndeletedHandles++] = h;
+
+    /* Stop watching the FD right away, the caller may close it */
+    if (virEventPollUpdateFD(loop, virHashLookup(loop->fds,
+                                                 virEventPollKey(h->fd))) < 0)
+        VIR_WARN("Failed to remove handle watch %d: %s",
+                 watch, virGetLastErrorMessage());
+
+    virEventPollInterruptLocked(loop);
+    virObjectUnlock(loop);
+    return 0;
+}
+
+
+/*
+ * Helpers maintaining the heap of enabled timers, which keeps
+ * the timer expiring next at its root.
+ */
+static void
+virEventPollHeapSet(virEventPollLoopPtr loop,
+                    size_t i,
+                    struct virEventPollTimeout *t)
+{
+    loop->heap[i] = t;
+    t->heapIndex = i;
+}
+
+static void
+virEventPollHeapSiftUp(virEventPollLoopPtr loop, size_t i)
+{
+    struct virEventPollTimeout *t = loop->heap[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (loop->heap[parent]->expiresAt <= t->expiresAt)
+            break;
+        virEventPollHeapSet(loop, i, loop->heap[parent]);
+        i = parent;
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
+    virEventPollHeapSet(loop, i, t);
+}
+
+static void
+virEventPollHeapSiftDown(virEventPollLoopPtr loop, size_t i)
+{
+    struct virEventPollTimeout *t = loop->heap[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= loop->nheap)
+            break;
+        if (child + 1 < loop->nheap &&
+            loop->heap[child + 1]->expiresAt < loop->heap[child]->expiresAt)
+            child++;
+        if (t->expiresAt <= loop->heap[child]->expiresAt)
+            break;
+        virEventPollHeapSet(loop, i, loop->heap[child]);
+        i = child;
+    }
+    virEventPollHeapSet(loop, i, t);
+}
+
+/* Room for all timers is reserved when adding them */
+static void
+virEventPollHeapPush(virEventPollLoopPtr loop,
+                     struct virEventPollTimeout *t)
+{
+    virEventPollHeapSet(loop, loop->nheap++, t);
+    virEventPollHeapSiftUp(loop, t->heapIndex);
+}
+
+static void
+virEventPollHeapRemove(virEventPollLoopPtr loop,
+                       struct virEventPollTimeout *t)
+{
+    size_t i = t->heapIndex;
+
+    t->heapIndex = EVENT_NO_HEAP;
+    if (i == --loop->nheap)
+        return;
+
+    virEventPollHeapSet(loop, i, loop->heap[loop->nheap]);
+    virEventPollHeapSiftUp(loop, i);
+    virEventPollHeapSiftDown(loop, loop->heap[i]->heapIndex);
+}
+
+/* Put @t at the right place in the heap after its expiry changed */
+static void
+virEventPollHeapUpdate(virEventPollLoopPtr loop,
+                       struct virEventPollTimeout *t)
+{
+    if (t->heapIndex != EVENT_NO_HEAP)
+        virEventPollHeapRemove(loop, t);
+    if (t->frequency >= 0)
+        virEventPollHeapPush(loop, t);
 }
 
 
 /*
  * Register a callback for a timer event
  * NB, it *must* be safe to call this from within a callback
- * For this reason we only ever append to existing list.
  */
-int virEventPollAddTimeout(int frequency,
-                           virEventTimeoutCallback cb,
-                           void *opaque,
-                           virFreeCallback ff)
+int virEventPollLoopAddTimeout(virEventPollLoopPtr loop,
+                               int frequency,
+                               virEventTimeoutCallback cb,
+                               void *opaque,
+                               virFreeCallback ff)
 {
+    struct virEventPollTimeout *t;
     unsigned long long now;
     int ret;
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    virMutexLock(&eventLoop.lock);
-    if (eventLoop.timeoutsCount == eventLoop.timeoutsAlloc) {
-        EVENT_DEBUG("Used %zu timeout slots, adding at least %d more",
-                    eventLoop.timeoutsAlloc, EVENT_ALLOC_EXTENT);
-        if (VIR_RESIZE_N(eventLoop.timeouts, eventLoop.timeoutsAlloc,
-                         eventLoop.timeoutsCount, EVENT_ALLOC_EXTENT) < 0) {
-            virMutexUnlock(&eventLoop.lock);
-            return -1;
-        }
+    virObjectLock(loop);
+
+    /* Make sure nothing done with the timer later on can fail */
+    if (VIR_RESIZE_N(loop->heap, loop->heapAlloc, loop->ntimeouts, 1) < 0 ||
+        VIR_RESIZE_N(loop->due, loop->dueAlloc, loop->ntimeouts, 1) < 0 ||
+        VIR_RESIZE_N(loop->deletedTimeouts, loop->deletedTimeoutsAlloc,
+                     loop->ntimeouts, 1) < 0 ||
+        VIR_ALLOC(t) < 0) {
+        virObjectUnlock(loop);
+        return -1;
     }
 
-    eventLoop.timeouts[eventLoop.timeoutsCount].timer = nextTimer++;
-    eventLoop.timeouts[eventLoop.timeoutsCount].frequency = frequency;
-    eventLoop.timeouts[eventLoop.timeoutsCount].cb = cb;
-    eventLoop.timeouts[eventLoop.timeoutsCount].ff = ff;
-    eventLoop.timeouts[eventLoop.timeoutsCount].opaque = opaque;
-    eventLoop.timeouts[eventLoop.timeoutsCount].deleted = 0;
-    eventLoop.timeouts[eventLoop.timeoutsCount].expiresAt =
-        frequency >= 0 ? frequency + now : 0;
+    t->timer = loop->nextTimer++;
+    t->frequency = frequency;
+    t->cb = cb;
+    t->ff = ff;
+    t->opaque = opaque;
+    t->heapIndex = EVENT_NO_HEAP;
+    t->expiresAt = frequency >= 0 ? frequency + now : 0;
+
+    if (virHashAddEntry(loop->timeouts, virEventPollKey(t->timer), t) < 0) {
+        VIR_FREE(t);
+        virObjectUnlock(loop);
+        return -1;
+    }
+
+    loop->ntimeouts++;
+    virEventPollHeapUpdate(loop, t);
 
-    eventLoop.timeoutsCount++;
-    ret = nextTimer-1;
-    virEventPollInterruptLocked();
+    ret = t->timer;
+    virEventPollInterruptLocked(loop);
 
     PROBE(EVENT_POLL_ADD_TIMEOUT,
           "timer=%d frequency=%d cb=%p opaque=%p ff=%p",
           ret, frequency, cb, opaque, ff);
-    virMutexUnlock(&eventLoop.lock);
+    virObjectUnlock(loop);
     return ret;
 }
 
-void virEventPollUpdateTimeout(int timer, int frequency)
+void virEventPollLoopUpdateTimeout(virEventPollLoopPtr loop,
+                                   int timer, int frequency)
 {
+    struct virEventPollTimeout *t;
     unsigned long long now;
-    size_t i;
-    bool found = false;
     PROBE(EVENT_POLL_UPDATE_TIMEOUT,
           "timer=%d frequency=%d",
           timer, frequency);
@@ -269,34 +697,32 @@ void virEventPollUpdateTimeout(int timer, int frequency)
     if (virTimeMillisNow(&now) < 0)
         return;
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].frequency = frequency;
-            eventLoop.timeouts[i].expiresAt =
-                frequency >= 0 ? frequency + now : 0;
-            VIR_DEBUG("Set timer freq=%d expires=%llu", frequency,
-                      eventLoop.timeouts[i].expiresAt);
-            virEventPollInterruptLocked();
-            found = true;
-            break;
-        }
+    virObjectLock(loop);
+    if (!(t = virHashLookup(loop->timeouts, virEventPollKey(timer)))) {
+        virObjectUnlock(loop);
+        VIR_WARN("Got update for non-existent timer %d", timer);
+        return;
     }
-    virMutexUnlock(&eventLoop.lock);
 
-    if (!found)
-        VIR_WARN("Got update for non-existent timer %d", timer);
+    t->frequency = frequency;
+    t->expiresAt = frequency >= 0 ? frequency + now : 0;
+    /* The new expiry time decides when it fires next */
+    t->due = false;
+    virEventPollHeapUpdate(loop, t);
+    VIR_DEBUG("Set timer freq=%d expires=%llu", frequency, t->expiresAt);
+    virEventPollInterruptLocked(loop);
+    virObjectUnlock(loop);
 }
 
 /*
  * Unregister a callback for a timer
  * NB, it *must* be safe to call this from within a callback
- * For this reason we only ever set a flag in the existing list.
+ * For this reason we only ever set a flag on the timer.
  * Actual deletion will be done out-of-band
  */
-int virEventPollRemoveTimeout(int timer)
+int virEventPollLoopRemoveTimeout(virEventPollLoopPtr loop, int timer)
 {
-    size_t i;
+    struct virEventPollTimeout *t;
     PROBE(EVENT_POLL_REMOVE_TIMEOUT,
           "timer=%d",
           timer);
@@ -306,48 +732,40 @@ int virEventPollRemoveTimeout(int timer)
         return -1;
     }
 
-    virMutexLock(&eventLoop.lock);
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-
-        if (eventLoop.timeouts[i].timer == timer) {
-            eventLoop.timeouts[i].deleted = 1;
-            virEventPollInterruptLocked();
-            virMutexUnlock(&eventLoop.lock);
-            return 0;
-        }
+    virObjectLock(loop);
+    if (!(t = virHashSteal(loop->timeouts, virEventPollKey(timer)))) {
+        virObjectUnlock(loop);
+        return -1;
     }
-    virMutexUnlock(&eventLoop.lock);
-    return -1;
+
+    t->deleted = 1;
+    if (t->heapIndex != EVENT_NO_HEAP)
+        virEventPollHeapRemove(loop, t);
+    loop->deletedTimeouts[loop->ndeletedTimeouts++] = t;
+    virEventPollInterruptLocked(loop);
+    virObjectUnlock(loop);
+    return 0;
 }
 
-/* Iterates over all registered timeouts and determine which
- * will be the first to expire.
+/* Determine when the first of the enabled timers expires.
  * @timeout: filled with expiry time of soonest timer, or -1 if
  *           no timeout is pending
  * returns: 0 on success, -1 on error
  */
-static int virEventPollCalculateTimeout(int *timeout)
+static int virEventPollCalculateTimeout(virEventPollLoopPtr loop,
+                                        int *timeout)
 {
     unsigned long long then = 0;
-    size_t i;
-    EVENT_DEBUG("Calculate expiry of %zu timers", eventLoop.timeoutsCount);
-    /* Figure out if we need a timeout */
-    for (i = 0; i < eventLoop.timeoutsCount; i++) {
-        if (eventLoop.timeouts[i].deleted)
-            continue;
-        if (eventLoop.timeouts[i].frequency < 0)
-            continue;
 
-        EVENT_DEBUG("Got a timeout scheduled for %llu", eventLoop.timeouts[i].expiresAt);
-        if (then == 0 ||
-            eventLoop.timeouts[i].expiresAt < then)
-            then = eventLoop.timeouts[i].expiresAt;
-    }
+    EVENT_DEBUG("Calculate expiry of %zu timers", loop->nheap);
+    if (loop->nheap)
+        then = loop->heap[0]->expiresAt;
 
     /* Calculate how long we should wait for a timeout if needed */
-    if (then > 0) {
+    if (loop->nunpollable) {
+        /* These are always ready, so don't block at all */
+        *timeout = 0;
+    } else if (then > 0) {
         unsigned long long now;
 
         if (virTimeMillisNow(&now) < 0)
@@ -370,90 +788,123 @@ static int virEventPollCalculateTimeout(int *timeout)
     return 0;
 }
 
+
+struct virEventPollMakePollFDsData {
+    struct pollfd *fds;
+    struct virEventPollHandle **handles;
+    int nfds;
+};
+
+static int
+virEventPollMakePollFD(void *payload,
+                       const void *name ATTRIBUTE_UNUSED,
+                       void *opaque)
+{
+    struct virEventPollHandle *h = payload;
+    struct virEventPollMakePollFDsData *data = opaque;
+
+    EVENT_DEBUG("Prepare w=%d, f=%d e=%d", h->watch, h->fd, h->events);
+    if (!h->events)
+        return 0;
+
+    data->fds[data->nfds].fd = h->fd;
+    data->fds[data->nfds].events = h->events;
+    data->fds[data->nfds].revents = 0;
+    data->handles[data->nfds] = h;
+    data->nfds++;
+    return 0;
+}
+
 /*
  * Allocate a pollfd array containing data for all registered
- * file handles. The caller must free the returned data struct
- * returns: the pollfd array, or NULL on error
+ * file handles, along with the matching array of handles.
+ * The caller must free both arrays.
+ * returns: 0 on success, -1 on error
  */
-static struct pollfd *virEventPollMakePollFDs(int *nfds) {
-    struct pollfd *fds;
-    size_t i;
-
-    *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        if (eventLoop.handles[i].events && !eventLoop.handles[i].deleted)
-            (*nfds)++;
-    }
+static int virEventPollMakePollFDs(virEventPollLoopPtr loop,
+                                   struct pollfd **fds,
+                                   struct virEventPollHandle ***handles,
+                                   int *nfds)
+{
+    struct virEventPollMakePollFDsData data = { NULL, NULL, 0 };
+    ssize_t nhandles = virHashSize(loop->handles);
 
     /* Setup the poll file handle data structs */
-    if (VIR_ALLOC_N(fds, *nfds) < 0)
-        return NULL;
-
-    *nfds = 0;
-    for (i = 0; i < eventLoop.handlesCount; i++) {
-        EVENT_DEBUG("Prepare n=%zu w=%d, f=%d e=%d d=%d", i,
-                    eventLoop.handles[i].watch,
-                    eventLoop.handles[i].fd,
-                    eventLoop.handles[i].events,
-                    eventLoop.handles[i].deleted);
-        if (!eventLoop.handles[i].events || eventLoop.handles[i].deleted)
-            continue;
-        fds[*nfds].fd = eventLoop.handles[i].fd;
-        fds[*nfds].events = eventLoop.handles[i].events;
-        fds[*nfds].revents = 0;
-        (*nfds)++;
+    if (VIR_ALLOC_N(data.fds, nhandles) < 0 ||
+        VIR_ALLOC_N(data.handles, nhandles) < 0) {
+        VIR_FREE(data.fds);
+        return -1;
     }
 
-    return fds;
+    virHashForEach(loop->handles, virEventPollMakePollFD, &data);
+
+    *fds = data.fds;
+    *handles = data.handles;
+    *nfds = data.nfds;
+    return 0;
 }
 
 
 /*
- * Iterate over all timers and determine if any have expired.
- * Invoke the user supplied callback for each timer whose
- * expiry time is met, and schedule the next timeout. Does
- * not try to 'catch up' on time if the actual expiry time
- * was later than the requested time.
+ * Determine which timers have expired and invoke the user
+ * supplied callback for each of them, and schedule the next
+ * timeout. Does not try to 'catch up' on time if the actual
+ * expiry time was later than the requested time.
  *
  * This method must cope with new timers being registered
  * by a callback, and must skip any timers marked as deleted.
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchTimeouts(void)
+static int virEventPollDispatchTimeouts(virEventPollLoopPtr loop)
 {
     unsigned long long now;
+    size_t ndue = 0;
     size_t i;
-    /* Save this now - it may be changed during dispatch */
-    int ntimeouts = eventLoop.timeoutsCount;
-    VIR_DEBUG("Dispatch %d", ntimeouts);
 
     if (virTimeMillisNow(&now) < 0)
         return -1;
 
-    for (i = 0; i < ntimeouts; i++) {
-        if (eventLoop.timeouts[i].deleted || eventLoop.timeouts[i].frequency < 0)
+    /* Add 20ms fuzz so we don't pointlessly spin doing
+     * <10ms sleeps, particularly on kernels with low HZ
+     * it is fine that a timer expires 20ms earlier than
+     * requested
+     *
+     * Collect all expired timers before running any callback,
+     * so a timer with zero frequency only fires once per
+     * iteration
+     */
+    while (loop->nheap && loop->heap[0]->expiresAt <= (now+20)) {
+        struct virEventPollTimeout *t = loop->heap[0];
+
+        virEventPollHeapRemove(loop, t);
+        t->expiresAt = now + t->frequency;
+        t->due = true;
+        loop->due[ndue++] = t;
+    }
+
+    for (i = 0; i < ndue; i++)
+        virEventPollHeapPush(loop, loop->due[i]);
+
+    VIR_DEBUG("Dispatch %zu", ndue);
+
+    for (i = 0; i < ndue; i++) {
+        struct virEventPollTimeout *t = loop->due[i];
+        virEventTimeoutCallback cb = t->cb;
+        int timer = t->timer;
+        void *opaque = t->opaque;
+
+        /* Might have been changed or deleted by an earlier callback */
+        if (!t->due || t->deleted)
             continue;
+        t->due = false;
 
-        /* Add 20ms fuzz so we don't pointlessly spin doing
-         * <10ms sleeps, particularly on kernels with low HZ
-         * it is fine that a timer expires 20ms earlier than
-         * requested
-         */
-        if (eventLoop.timeouts[i].expiresAt <= (now+20)) {
-            virEventTimeoutCallback cb = eventLoop.timeouts[i].cb;
-            int timer = eventLoop.timeouts[i].timer;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            eventLoop.timeouts[i].expiresAt =
-                now + eventLoop.timeouts[i].frequency;
-
-            PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
-                  "timer=%d",
-                  timer);
-            virMutexUnlock(&eventLoop.lock);
-            (cb)(timer, opaque);
-            virMutexLock(&eventLoop.lock);
-        }
+        PROBE(EVENT_POLL_DISPATCH_TIMEOUT,
+              "timer=%d",
+              timer);
+        virObjectUnlock(loop);
+        (cb)(timer, opaque);
+        virObjectLock(loop);
     }
     return 0;
 }
@@ -469,41 +920,36 @@ static int virEventPollDispatchTimeouts(void)
  *
  * Returns 0 upon success, -1 if an error occurred
  */
-static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
+static int virEventPollDispatchHandles(virEventPollLoopPtr loop,
+                                       int nfds, struct pollfd *fds,
+                                       struct virEventPollHandle **handles)
 {
-    size_t i, n;
+    size_t n;
     VIR_DEBUG("Dispatch %d", nfds);
 
-    /* NB, use nfds not eventLoop.handlesCount, because new
-     * fds might be added on end of list, and they're not
-     * in the fds array we've got */
-    for (i = 0, n = 0; n < nfds && i < eventLoop.handlesCount; n++) {
-        while (i < eventLoop.handlesCount &&
-               (eventLoop.handles[i].fd != fds[n].fd ||
-                eventLoop.handles[i].events == 0)) {
-            i++;
-        }
-        if (i == eventLoop.handlesCount)
-            break;
+    /* NB, handles are only purged after dispatch, so all entries
+     * of @handles stay valid, while new ones are not included */
+    for (n = 0; n < nfds; n++) {
+        struct virEventPollHandle *h = handles[n];
 
-        VIR_DEBUG("i=%zu w=%d", i, eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].deleted) {
-            EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", i,
-                        eventLoop.handles[i].watch, eventLoop.handles[i].fd);
+        VIR_DEBUG("n=%zu w=%d", n, h->watch);
+        if (h->deleted) {
+            EVENT_DEBUG("Skip deleted n=%zu w=%d f=%d", n,
+                        h->watch, h->fd);
             continue;
         }
 
         if (fds[n].revents) {
-            virEventHandleCallback cb = eventLoop.handles[i].cb;
-            int watch = eventLoop.handles[i].watch;
-            void *opaque = eventLoop.handles[i].opaque;
+            virEventHandleCallback cb = h->cb;
+            int watch = h->watch;
+            void *opaque = h->opaque;
             int hEvents = virEventPollFromNativeEvents(fds[n].revents);
             PROBE(EVENT_POLL_DISPATCH_HANDLE,
                   "watch=%d events=%d",
                   watch, hEvents);
-            virMutexUnlock(&eventLoop.lock);
+            virObjectUnlock(loop);
             (cb)(watch, fds[n].fd, hEvents, opaque);
-            virMutexLock(&eventLoop.lock);
+            virObjectLock(loop);
         }
     }
 
@@ -511,52 +957,95 @@ static int virEventPollDispatchHandles(int nfds, struct pollfd *fds)
 }
 
 
+/* Invoke the callbacks of all handles watching @fd which are
+ * interested in @revents, skipping handles registered after
+ * the loop started waiting, i.e. with watch >= @maxWatch.
+ */
+static void
+virEventPollDispatchFD(virEventPollLoopPtr loop,
+                       int fd,
+                       int revents,
+                       int maxWatch)
+{
+    struct virEventPollFD *f;
+    struct virEventPollHandle *h;
+
+    if (!(f = virHashLookup(loop->fds, virEventPollKey(fd))))
+        return;
+
+    /* NB, handles are only purged after dispatch, so the list
+     * stays valid while the lock is dropped for the callback */
+    for (h = f->handles; h; h = h->next) {
+        int hEvents;
+
+        if (h->deleted || !h->events || h->watch >= maxWatch)
+            continue;
+
+        /* Errors and hangups are reported regardless of the
+         * requested events, just like poll() does */
+        if (!(hEvents = revents & (h->events | POLLERR | POLLHUP | POLLNVAL)))
+            continue;
+
+        hEvents = virEventPollFromNativeEvents(hEvents);
+        PROBE(EVENT_POLL_DISPATCH_HANDLE,
+              "watch=%d events=%d",
+              h->watch, hEvents);
+        virObjectUnlock(loop);
+        (h->cb)(h->watch, fd, hEvents, h->opaque);
+        virObjectLock(loop);
+    }
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void
+virEventPollDispatchEpoll(virEventPollLoopPtr loop,
+                          int nevents,
+                          int maxWatch)
+{
+    size_t i;
+    VIR_DEBUG("Dispatch %d", nevents);
+
+    for (i = 0; i < nevents; i++) {
+        int fd = loop->epollEvents[i].data.fd;
+        int revents = virEventPollFromEpollEvents(loop->epollEvents[i].events);
+
+        virEventPollDispatchFD(loop, fd, revents, maxWatch);
+    }
+
+    /* Like poll(), report unpollable FDs as always ready. The list
+     * may change whenever the lock is dropped, hence the indexing */
+    for (i = 0; i < loop->nunpollable; i++)
+        virEventPollDispatchFD(loop, loop->unpollable[i],
+                               POLLIN | POLLOUT, maxWatch);
+}
+#endif /* HAVE_SYS_EPOLL_H */
+
+
 /* Used post dispatch to actually remove any timers that
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupTimeouts(void)
+static void virEventPollCleanupTimeouts(virEventPollLoopPtr loop)
 {
-    size_t i;
-    size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.timeoutsCount);
+    VIR_DEBUG("Cleanup %zu", loop->ndeletedTimeouts);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.timeoutsCount;) {
-        if (!eventLoop.timeouts[i].deleted) {
-            i++;
-            continue;
-        }
+    while (loop->ndeletedTimeouts) {
+        struct virEventPollTimeout *t;
+
+        t = loop->deletedTimeouts[--loop->ndeletedTimeouts];
+        loop->ntimeouts--;
 
         PROBE(EVENT_POLL_PURGE_TIMEOUT,
               "timer=%d",
-              eventLoop.timeouts[i].timer);
-        if (eventLoop.timeouts[i].ff) {
-            virFreeCallback ff = eventLoop.timeouts[i].ff;
-            void *opaque = eventLoop.timeouts[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
+              t->timer);
+        if (t->ff) {
+            virFreeCallback ff = t->ff;
+            void *opaque = t->opaque;
+            virObjectUnlock(loop);
             ff(opaque);
-            virMutexLock(&eventLoop.lock);
-        }
-
-        if ((i+1) < eventLoop.timeoutsCount) {
-            size_t count = eventLoop.timeoutsCount - (i+1);
-            memmove(eventLoop.timeouts+i,
-                    eventLoop.timeouts+i+1,
-                    sizeof(struct virEventPollTimeout)*count);
+            virObjectLock(loop);
         }
-        eventLoop.timeoutsCount--;
-    }
-
-    /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.timeoutsAlloc - eventLoop.timeoutsCount;
-    if (eventLoop.timeoutsCount == 0 ||
-        (gap > eventLoop.timeoutsCount && gap > EVENT_ALLOC_EXTENT)) {
-        EVENT_DEBUG("Found %zu out of %zu timeout slots used, releasing %zu",
-                    eventLoop.timeoutsCount, eventLoop.timeoutsAlloc, gap);
-        VIR_SHRINK_N(eventLoop.timeouts, eventLoop.timeoutsAlloc, gap);
+        VIR_FREE(t);
     }
 }
 
@@ -564,48 +1053,28 @@ static void virEventPollCleanupTimeouts(void)
  * were previously marked as deleted. This asynchronous
  * cleanup is needed to make dispatch re-entrant safe.
  */
-static void virEventPollCleanupHandles(void)
+static void virEventPollCleanupHandles(virEventPollLoopPtr loop)
 {
-    size_t i;
-    size_t gap;
-    VIR_DEBUG("Cleanup %zu", eventLoop.handlesCount);
+    VIR_DEBUG("Cleanup %zu", loop->ndeletedHandles);
 
-    /* Remove deleted entries, shuffling down remaining
-     * entries as needed to form contiguous series
-     */
-    for (i = 0; i < eventLoop.handlesCount;) {
-        if (!eventLoop.handles[i].deleted) {
-            i++;
-            continue;
-        }
+    while (loop->ndeletedHandles) {
+        struct virEventPollHandle *h;
+
+        h = loop->deletedHandles[--loop->ndeletedHandles];
+        loop->nhandles--;
+        virEventPollDetachHandle(loop, h);
 
         PROBE(EVENT_POLL_PURGE_HANDLE,
               "watch=%d",
-              eventLoop.handles[i].watch);
-        if (eventLoop.handles[i].ff) {
-            virFreeCallback ff = eventLoop.handles[i].ff;
-            void *opaque = eventLoop.handles[i].opaque;
-            virMutexUnlock(&eventLoop.lock);
+              h->watch);
+        if (h->ff) {
+            virFreeCallback ff = h->ff;
+            void *opaque = h->opaque;
+            virObjectUnlock(loop);
             ff(opaque);
-            virMutexLock(&eventLoop.lock);
-        }
-
-        if ((i+1) < eventLoop.handlesCount) {
-            size_t count = eventLoop.handlesCount - (i+1);
-            memmove(eventLoop.handles+i,
-                    eventLoop.handles+i+1,
-                    sizeof(struct virEventPollHandle)*count);
+            virObjectLock(loop);
         }
-        eventLoop.handlesCount--;
-    }
-
-    /* Release some memory if we've got a big chunk free */
-    gap = eventLoop.handlesAlloc - eventLoop.handlesCount;
-    if (eventLoop.handlesCount == 0 ||
-        (gap > eventLoop.handlesCount && gap > EVENT_ALLOC_EXTENT)) {
-        EVENT_DEBUG("Found %zu out of %zu handles slots used, releasing %zu",
-                    eventLoop.handlesCount, eventLoop.handlesAlloc, gap);
-        VIR_SHRINK_N(eventLoop.handles, eventLoop.handlesAlloc, gap);
+        VIR_FREE(h);
     }
 }
 
@@ -613,36 +1082,58 @@ static void virEventPollCleanupHandles(void)
  * Run a single iteration of the event loop, blocking until
  * at least one file handle has an event, or a timer expires
  */
-int virEventPollRunOnce(void)
+int virEventPollLoopRunOnce(virEventPollLoopPtr loop)
 {
     VIR_AUTOFREE(struct pollfd *) fds = NULL;
-    int ret, timeout, nfds;
+    VIR_AUTOFREE(struct virEventPollHandle **) handles = NULL;
+    int ret, timeout, nfds = 0;
+    int maxWatch;
 
-    virMutexLock(&eventLoop.lock);
-    eventLoop.running = 1;
-    virThreadSelf(&eventLoop.leader);
+    virObjectLock(loop);
+    loop->running = 1;
+    virThreadSelf(&loop->leader);
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
-    if (!(fds = virEventPollMakePollFDs(&nfds)) ||
-        virEventPollCalculateTimeout(&timeout) < 0)
+    if (virEventPollCalculateTimeout(loop, &timeout) < 0)
         goto error;
 
-    virMutexUnlock(&eventLoop.lock);
+    maxWatch = loop->nextWatch;
+
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->epollfd >= 0) {
+        nfds = MIN(MAX(virHashSize(loop->fds), 1), EVENT_EPOLL_MAX_EVENTS);
+
+        if (VIR_RESIZE_N(loop->epollEvents, loop->epollEventsAlloc,
+                         0, nfds) < 0)
+            goto error;
+    }
+#endif /* HAVE_SYS_EPOLL_H */
+
+    if (loop->epollfd < 0 &&
+        virEventPollMakePollFDs(loop, &fds, &handles, &nfds) < 0)
+        goto error;
+
+    virObjectUnlock(loop);
 
  retry:
     PROBE(EVENT_POLL_RUN,
           "nhandles=%d timeout=%d",
           nfds, timeout);
-    ret = poll(fds, nfds, timeout);
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->epollfd >= 0)
+        ret = epoll_wait(loop->epollfd, loop->epollEvents, nfds, timeout);
+    else
+#endif /* HAVE_SYS_EPOLL_H */
+        ret = poll(fds, nfds, timeout);
     if (ret < 0) {
         EVENT_DEBUG("Poll got error event %d", errno);
         if (errno == EINTR || errno == EAGAIN)
             goto retry;
 #ifdef __APPLE__
         if (errno == EBADF) {
-            virMutexLock(&eventLoop.lock);
+            virObjectLock(loop);
             goto cleanup;
         }
 #endif
@@ -652,26 +1143,31 @@ int virEventPollRunOnce(void)
     }
     EVENT_DEBUG("Poll got %d event(s)", ret);
 
-    virMutexLock(&eventLoop.lock);
-    if (virEventPollDispatchTimeouts() < 0)
+    virObjectLock(loop);
+    if (virEventPollDispatchTimeouts(loop) < 0)
         goto error;
 
-    if (ret > 0 &&
-        virEventPollDispatchHandles(nfds, fds) < 0)
+#ifdef HAVE_SYS_EPOLL_H
+    if (loop->epollfd >= 0)
+        virEventPollDispatchEpoll(loop, ret, maxWatch);
+#endif /* HAVE_SYS_EPOLL_H */
+
+    if (loop->epollfd < 0 && ret > 0 &&
+        virEventPollDispatchHandles(loop, nfds, fds, handles) < 0)
         goto error;
 
-    virEventPollCleanupTimeouts();
-    virEventPollCleanupHandles();
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
 
 #ifdef __APPLE__
  cleanup:
 #endif
-    eventLoop.running = 0;
-    virMutexUnlock(&eventLoop.lock);
+    loop->running = 0;
+    virObjectUnlock(loop);
     return 0;
 
  error:
-    virMutexUnlock(&eventLoop.lock);
+    virObjectUnlock(loop);
     return -1;
 }
 
@@ -679,68 +1175,267 @@ int virEventPollRunOnce(void)
 static void virEventPollHandleWakeup(int watch ATTRIBUTE_UNUSED,
                                      int fd,
                                      int events ATTRIBUTE_UNUSED,
-                                     void *opaque ATTRIBUTE_UNUSED)
+                                     void *opaque)
 {
+    virEventPollLoopPtr loop = opaque;
     char c;
-    virMutexLock(&eventLoop.lock);
+    virObjectLock(loop);
     ignore_value(saferead(fd, &c, sizeof(c)));
-    virMutexUnlock(&eventLoop.lock);
+    virObjectUnlock(loop);
 }
 
-int virEventPollInit(void)
+
+/*
+ * Allocate a new event loop, independent from the default one
+ * and from any other loop. It has its own set of file handles
+ * and timers, and is driven by calling virEventPollLoopRunOnce
+ * or virEventPollLoopRun from a thread of the caller's choice.
+ */
+virEventPollLoopPtr virEventPollLoopNew(void)
 {
-    if (virMutexInit(&eventLoop.lock) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("Unable to initialize mutex"));
-        return -1;
+    virEventPollLoopPtr loop;
+
+    if (virEventPollLoopInitialize() < 0)
+        return NULL;
+
+    if (!(loop = virObjectLockableNew(virEventPollLoopClass)))
+        return NULL;
+
+    loop->wakeupfd[0] = loop->wakeupfd[1] = -1;
+    loop->epollfd = -1;
+    loop->nextWatch = 1;
+    loop->nextTimer = 1;
+
+    if (!(loop->handles = virEventPollHashNew()) ||
+        !(loop->fds = virEventPollHashNew()) ||
+        !(loop->timeouts = virEventPollHashNew()))
+        goto error;
+
+#ifdef HAVE_SYS_EPOLL_H
+    /* Some sandboxes forbid epoll, in which case poll() still works */
+    if ((loop->epollfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        char ebuf[1024];
+        VIR_WARN("Unable to create epoll instance, falling back to poll: %s",
+                 virStrerror(errno, ebuf, sizeof(ebuf)));
     }
+#endif /* HAVE_SYS_EPOLL_H */
 
-    if (pipe2(eventLoop.wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
+    if (pipe2(loop->wakeupfd, O_CLOEXEC | O_NONBLOCK) < 0) {
         virReportSystemError(errno, "%s",
                              _("Unable to setup wakeup pipe"));
-        return -1;
+        goto error;
     }
 
-    if (virEventPollAddHandle(eventLoop.wakeupfd[0],
-                              VIR_EVENT_HANDLE_READABLE,
-                              virEventPollHandleWakeup, NULL, NULL) < 0) {
+    if (virEventPollLoopAddHandle(loop, loop->wakeupfd[0],
+                                  VIR_EVENT_HANDLE_READABLE,
+                                  virEventPollHandleWakeup,
+                                  loop, NULL) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to add handle %d to event loop"),
-                       eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[0]);
-        VIR_FORCE_CLOSE(eventLoop.wakeupfd[1]);
-        return -1;
+                       loop->wakeupfd[0]);
+        goto error;
+    }
+
+    return loop;
+
+ error:
+    virObjectUnref(loop);
+    return NULL;
+}
+
+
+static int
+virEventPollDisposeHandle(const void *payload,
+                          const void *name ATTRIBUTE_UNUSED,
+                          const void *opaque)
+{
+    struct virEventPollHandle *h = (struct virEventPollHandle *)payload;
+    virEventPollLoopPtr loop = (virEventPollLoopPtr)opaque;
+
+    h->deleted = 1;
+    loop->deletedHandles[loop->ndeletedHandles++] = h;
+    return 1;
+}
+
+static int
+virEventPollDisposeTimeout(const void *payload,
+                           const void *name ATTRIBUTE_UNUSED,
+                           const void *opaque)
+{
+    struct virEventPollTimeout *t = (struct virEventPollTimeout *)payload;
+    virEventPollLoopPtr loop = (virEventPollLoopPtr)opaque;
+
+    t->deleted = 1;
+    loop->deletedTimeouts[loop->ndeletedTimeouts++] = t;
+    return 1;
+}
+
+static void virEventPollLoopDispose(void *obj)
+{
+    virEventPollLoopPtr loop = obj;
+
+    /* Nobody can be running the loop anymore, so just
+     * purge whatever is left registered */
+    virObjectLock(loop);
+    if (loop->handles)
+        virHashRemoveSet(loop->handles, virEventPollDisposeHandle, loop);
+    if (loop->timeouts)
+        virHashRemoveSet(loop->timeouts, virEventPollDisposeTimeout, loop);
+
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
+    virObjectUnlock(loop);
+
+    virHashFree(loop->handles);
+    virHashFree(loop->fds);
+    virHashFree(loop->timeouts);
+    VIR_FREE(loop->unpollable);
+    VIR_FREE(loop->deletedHandles);
+    VIR_FREE(loop->heap);
+    VIR_FREE(loop->due);
+    VIR_FREE(loop->deletedTimeouts);
+#ifdef HAVE_SYS_EPOLL_H
+    VIR_FREE(loop->epollEvents);
+#endif
+    VIR_FORCE_CLOSE(loop->epollfd);
+    VIR_FORCE_CLOSE(loop->wakeupfd[0]);
+    VIR_FORCE_CLOSE(loop->wakeupfd[1]);
+}
+
+
+/*
+ * Run iterations of @loop until virEventPollLoopQuit is called.
+ * Handles and timers deleted in the meantime are purged before
+ * returning, so their free callbacks are not left pending.
+ *
+ * returns -1 if the event monitoring failed
+ */
+int virEventPollLoopRun(virEventPollLoopPtr loop)
+{
+    int ret = 0;
+
+    virObjectLock(loop);
+    while (!loop->quit) {
+        virObjectUnlock(loop);
+        if (virEventPollLoopRunOnce(loop) < 0) {
+            virObjectLock(loop);
+            ret = -1;
+            break;
+        }
+        virObjectLock(loop);
     }
 
+    virEventPollCleanupTimeouts(loop);
+    virEventPollCleanupHandles(loop);
+    virObjectUnlock(loop);
+
+    return ret;
+}
+
+
+/*
+ * Ask the thread in virEventPollLoopRun to return.
+ */
+void virEventPollLoopQuit(virEventPollLoopPtr loop)
+{
+    char c = '\0';
+
+    virObjectLock(loop);
+    loop->quit = true;
+    /* Write unconditionally, since the loop thread might be just
+     * about to enter poll() without having set 'running' yet */
+    ignore_value(safewrite(loop->wakeupfd[1], &c, sizeof(c)));
+    virObjectUnlock(loop);
+}
+
+
+int virEventPollInit(void)
+{
+    if (eventLoop)
+        return 0;
+
+    if (!(eventLoop = virEventPollLoopNew()))
+        return -1;
+
     return 0;
 }
 
-static int virEventPollInterruptLocked(void)
+static int virEventPollInterruptLocked(virEventPollLoopPtr loop)
 {
     char c = '\0';
 
-    if (!eventLoop.running ||
-        virThreadIsSelf(&eventLoop.leader)) {
-        VIR_DEBUG("Skip interrupt, %d %llu", eventLoop.running,
-                  virThreadID(&eventLoop.leader));
+    if (!loop->running ||
+        virThreadIsSelf(&loop->leader)) {
+        VIR_DEBUG("Skip interrupt, %d %llu", loop->running,
+                  virThreadID(&loop->leader));
         return 0;
     }
 
     VIR_DEBUG("Interrupting");
-    if (safewrite(eventLoop.wakeupfd[1], &c, sizeof(c)) != sizeof(c))
+    if (safewrite(loop->wakeupfd[1], &c, sizeof(c)) != sizeof(c))
         return -1;
     return 0;
 }
 
-int virEventPollInterrupt(void)
+int virEventPollLoopInterrupt(virEventPollLoopPtr loop)
 {
     int ret;
-    virMutexLock(&eventLoop.lock);
-    ret = virEventPollInterruptLocked();
-    virMutexUnlock(&eventLoop.lock);
+    virObjectLock(loop);
+    ret = virEventPollInterruptLocked(loop);
+    virObjectUnlock(loop);
     return ret;
 }
 
+
+/*
+ * The APIs below operate on the default event loop
+ */
+int virEventPollAddHandle(int fd, int events,
+                          virEventHandleCallback cb,
+                          void *opaque,
+                          virFreeCallback ff)
+{
+    return virEventPollLoopAddHandle(eventLoop, fd, events, cb, opaque, ff);
+}
+
+void virEventPollUpdateHandle(int watch, int events)
+{
+    virEventPollLoopUpdateHandle(eventLoop, watch, events);
+}
+
+int virEventPollRemoveHandle(int watch)
+{
+    return virEventPollLoopRemoveHandle(eventLoop, watch);
+}
+
+int virEventPollAddTimeout(int frequency,
+                           virEventTimeoutCallback cb,
+                           void *opaque,
+                           virFreeCallback ff)
+{
+    return virEventPollLoopAddTimeout(eventLoop, frequency, cb, opaque, ff);
+}
+
+void virEventPollUpdateTimeout(int timer, int frequency)
+{
+    virEventPollLoopUpdateTimeout(eventLoop, timer, frequency);
+}
+
+int virEventPollRemoveTimeout(int timer)
+{
+    return virEventPollLoopRemoveTimeout(eventLoop, timer);
+}
+
+int virEventPollRunOnce(void)
+{
+    return virEventPollLoopRunOnce(eventLoop);
+}
+
+int virEventPollInterrupt(void)
+{
+    return virEventPollLoopInterrupt(eventLoop);
+}
+
 int
 virEventPollToNativeEvents(int events)
 {
@@ -26,6 +26,9 @@
 
 # include "internal.h"
 
+typedef struct _virEventPollLoop virEventPollLoop;
+typedef virEventPollLoop *virEventPollLoopPtr;
+
 /**
  * virEventPollAddHandle: register a callback for monitoring file handle events
  *
@@ -129,4 +132,47 @@ int virEventPollToNativeEvents(int events);
 int virEventPollInterrupt(void);
 
 
+/*
+ * The virEventPollLoop APIs below mirror the ones above, but operate
+ * on a private event loop rather than the default one. Each loop has
+ * its own set of file handles and timers, and watch and timer IDs are
+ * only unique within a single loop.
+ */
+virEventPollLoopPtr virEventPollLoopNew(void);
+
+int virEventPollLoopAddHandle(virEventPollLoopPtr loop,
+                              int fd, int events,
+                              virEventHandleCallback cb,
+                              void *opaque,
+                              virFreeCallback ff);
+void virEventPollLoopUpdateHandle(virEventPollLoopPtr loop,
+                                  int watch, int events);
+int virEventPollLoopRemoveHandle(virEventPollLoopPtr loop, int watch);
+
+int virEventPollLoopAddTimeout(virEventPollLoopPtr loop,
+                               int frequency,
+                               virEventTimeoutCallback cb,
+                               void *opaque,
+                               virFreeCallback ff);
+void virEventPollLoopUpdateTimeout(virEventPollLoopPtr loop,
+                                   int timer, int frequency);
+int virEventPollLoopRemoveTimeout(virEventPollLoopPtr loop, int timer);
+
+int virEventPollLoopRunOnce(virEventPollLoopPtr loop);
+int virEventPollLoopInterrupt(virEventPollLoopPtr loop);
+
+/**
+ * virEventPollLoopRun: run iterations of the event loop
+ *
+ * @loop: the loop to run
+ *
+ * Blocks the caller until virEventPollLoopQuit is called
+ * for @loop.
+ *
+ * returns -1 if the event monitoring failed
+ */
+int virEventPollLoopRun(virEventPollLoopPtr loop);
+void virEventPollLoopQuit(virEventPollLoopPtr loop);
+
+
 #endif /* __VIRTD_EVENT_H__ */
@@ -64,6 +64,7 @@ struct _virFDStreamMsg {
     union {
         struct {
             char *buf;
+            size_t size;    /* allocated size of @buf */
             size_t len;
             size_t offset;
         } data;
@@ -111,6 +112,12 @@ struct virFDStreamData {
     bool threadAbort;
     bool threadDoRead;
     virFDStreamMsgPtr msg;
+
+    /* Buffer of the last consumed data message, kept around for
+     * the next one so that we don't have to allocate and fault in
+     * a new buffer for every chunk */
+    char *spareBuf;
+    size_t spareSize;
 };
 
 static virClassPtr virFDStreamDataClass;
@@ -125,6 +132,7 @@ virFDStreamDataDispose(void *obj)
     VIR_DEBUG("obj=%p", fdst);
     virFreeError(fdst->threadErr);
     virFDStreamMsgQueueFree(&fdst->msg);
+    VIR_FREE(fdst->spareBuf);
 }
 
 static int virFDStreamDataOnceInit(void)
@@ -209,6 +217,65 @@ virFDStreamMsgFree(virFDStreamMsgPtr msg)
 }
 
 
+/**
+ * virFDStreamMsgBufGet:
+ * @fdst: the stream
+ * @msg: data message
+ * @len: number of bytes needed
+ *
+ * Give @msg a data buffer of at least @len bytes, reusing the spare
+ * buffer of @fdst if it is large enough. Must be called with @fdst
+ * locked.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+static int
+virFDStreamMsgBufGet(virFDStreamDataPtr fdst,
+                     virFDStreamMsgPtr msg,
+                     size_t len)
+{
+    msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
+
+    if (fdst->spareBuf && fdst->spareSize >= len) {
+        VIR_STEAL_PTR(msg->stream.data.buf, fdst->spareBuf);
+        msg->stream.data.size = fdst->spareSize;
+        return 0;
+    }
+
+    if (VIR_ALLOC_N(msg->stream.data.buf, len) < 0)
+        return -1;
+    msg->stream.data.size = len;
+    return 0;
+}
+
+
+/**
+ * virFDStreamMsgRecycle:
+ * @fdst: the stream
+ * @msg: consumed message
+ *
+ * Free @msg, keeping its data buffer as the spare buffer of @fdst.
+ * Must be called with @fdst locked.
+ */
+static void
+virFDStreamMsgRecycle(virFDStreamDataPtr fdst,
+                      virFDStreamMsgPtr msg)
+{
+    if (!msg)
+        return;
+
+    if (msg->type == VIR_FDSTREAM_MSG_TYPE_DATA &&
+        msg->stream.data.buf &&
+        fdst->spareSize <= msg->stream.data.size) {
+        VIR_FREE(fdst->spareBuf);
+        VIR_STEAL_PTR(fdst->spareBuf, msg->stream.data.buf);
+        fdst->spareSize = msg->stream.data.size;
+    }
+
+    virFDStreamMsgFree(msg);
+}
+
+
 static void
 virFDStreamMsgQueueFree(virFDStreamMsgPtr *queue)
 {
@@ -431,7 +498,6 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
     virFDStreamMsgPtr msg = NULL;
     int inData = 0;
     long long sectionLen = 0;
-    char *buf = NULL;
     ssize_t got;
 
     if (sparse && *dataLen == 0) {
@@ -472,20 +538,17 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
             buflen > *dataLen)
             buflen = *dataLen;
 
-        if (VIR_ALLOC_N(buf, buflen) < 0)
+        if (virFDStreamMsgBufGet(fdst, msg, buflen) < 0)
             goto error;
 
-        if ((got = saferead(fdin, buf, buflen)) < 0) {
+        if ((got = saferead(fdin, msg->stream.data.buf, buflen)) < 0) {
             virReportSystemError(errno,
                                  _("Unable to read %s"),
                                  fdinname);
             goto error;
         }
 
-        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
-        msg->stream.data.buf = buf;
         msg->stream.data.len = got;
-        buf = NULL;
         if (sparse)
             *dataLen -= got;
     }
@@ -496,8 +559,7 @@ virFDStreamThreadDoRead(virFDStreamDataPtr fdst,
     return got;
 
  error:
-    VIR_FREE(buf);
-    virFDStreamMsgFree(msg);
+    virFDStreamMsgRecycle(fdst, msg);
     return -1;
 }
 
@@ -561,7 +623,7 @@ virFDStreamThreadDoWrite(virFDStreamDataPtr fdst,
 
     if (pop) {
         virFDStreamMsgQueuePop(fdst, fdin, fdinname);
-        virFDStreamMsgFree(msg);
+        virFDStreamMsgRecycle(fdst, msg);
     }
 
     return got;
@@ -792,8 +854,6 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
     }
 
     if (fdst->thread) {
-        char *buf;
-
         if (fdst->threadQuit || fdst->threadErr) {
 
             /* virStreamSend will virResetLastError possibly set
@@ -806,12 +866,10 @@ static int virFDStreamWrite(virStreamPtr st, const char *bytes, size_t nbytes)
         }
 
         if (VIR_ALLOC(msg) < 0 ||
-            VIR_ALLOC_N(buf, nbytes) < 0)
+            virFDStreamMsgBufGet(fdst, msg, nbytes) < 0)
             goto cleanup;
 
-        memcpy(buf, bytes, nbytes);
-        msg->type = VIR_FDSTREAM_MSG_TYPE_DATA;
-        msg->stream.data.buf = buf;
+        memcpy(msg->stream.data.buf, bytes, nbytes);
         msg->stream.data.len = nbytes;
 
         virFDStreamMsgQueuePush(fdst, msg, fdst->fd, "pipe");
@@ -923,7 +981,7 @@ static int virFDStreamRead(virStreamPtr st, char *bytes, size_t nbytes)
         msg->stream.data.offset += nbytes;
         if (msg->stream.data.offset == msg->stream.data.len) {
             virFDStreamMsgQueuePop(fdst, fdst->fd, "pipe");
-            virFDStreamMsgFree(msg);
+            virFDStreamMsgRecycle(fdst, msg);
         }
 
         ret = nbytes;
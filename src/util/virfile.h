@@ -367,6 +367,8 @@ int virFileReadValueInt(int *value, const char *format, ...)
  ATTRIBUTE_FMT_PRINTF(2, 3);
 int virFileReadValueUint(unsigned int *value, const char *format, ...)
  ATTRIBUTE_FMT_PRINTF(2, 3);
+int virFileReadValueUllong(unsigned long long *value, const char *format, ...)
+ ATTRIBUTE_FMT_PRINTF(2, 3);
 int virFileReadValueBitmap(virBitmapPtr *value, const char *format, ...)
  ATTRIBUTE_FMT_PRINTF(2, 3);
 int virFileReadValueScaledInt(unsigned long long *value, const char *format, ...)
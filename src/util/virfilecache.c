@@ -34,10 +34,16 @@
 #include "virlog.h"
 #include "virobject.h"
 #include "virstring.h"
+#include "virthreadpool.h"
+#include "virtime.h"
 
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -48,6 +54,10 @@ struct _virFileCache {
     virObjectLockable parent;
 
     virHashTablePtr table;
+    /* name -> time in ms until which the data is trusted to be valid */
+    virHashTablePtr validUntil;
+    /* inotify descriptor watching the paths listed by watchPaths(), or -1 */
+    int watchFd;
 
     char *dir;
     char *suffix;
@@ -58,6 +68,21 @@ struct _virFileCache {
 };
 
 
+/* How long the result of isValid() is trusted, in milliseconds. Changes
+ * of the watched paths are noticed right away, other changes only after
+ * the longer interval. */
+#define VIR_FILE_CACHE_VALID_INTERVAL 1000
+#define VIR_FILE_CACHE_WATCHED_INTERVAL (10 * 60 * 1000)
+
+typedef struct _virFileCachePrefetchData virFileCachePrefetchData;
+typedef virFileCachePrefetchData *virFileCachePrefetchDataPtr;
+struct _virFileCachePrefetchData {
+    virFileCachePtr cache;
+    const char **names;
+    void **data;
+    size_t nnames;
+};
+
 static virClassPtr virFileCacheClass;
 
 
@@ -78,6 +103,8 @@ virFileCacheDispose(void *obj)
     VIR_FREE(cache->suffix);
 
     virHashFree(cache->table);
+    virHashFree(cache->validUntil);
+    VIR_FORCE_CLOSE(cache->watchFd);
 
     virFileCachePrivFree(cache);
 }
@@ -125,6 +152,126 @@ virFileCacheGetFileName(virFileCachePtr cache,
 }
 
 
+#ifdef HAVE_SYS_INOTIFY_H
+/* Forgets all validation results once any of the watched paths changed,
+ * the events don't say which data is affected. */
+static void
+virFileCacheCheckWatches(virFileCachePtr cache)
+{
+    char buf[4096]; /* only the presence of events matters */
+    bool changed = false;
+
+    if (cache->watchFd < 0)
+        return;
+
+    while (read(cache->watchFd, buf, sizeof(buf)) > 0)
+        changed = true;
+
+    if (changed) {
+        VIR_DEBUG("Watched paths changed, revalidating cached data");
+        virHashRemoveAll(cache->validUntil);
+    }
+}
+
+
+/* Returns 0 if changes of all paths listed for @data are watched. */
+static int
+virFileCacheWatch(virFileCachePtr cache,
+                  void *data)
+{
+    VIR_AUTOPTR(virString) paths = NULL;
+    size_t i;
+
+    if (cache->watchFd < 0 ||
+        !(paths = cache->handlers.watchPaths(data, cache->priv))) {
+        virResetLastError();
+        return -1;
+    }
+
+    for (i = 0; paths[i]; i++) {
+        VIR_AUTOFREE(char *) parent = NULL;
+
+        if (inotify_add_watch(cache->watchFd, paths[i],
+                              IN_MASK_ADD | IN_ATTRIB | IN_CLOSE_WRITE |
+                              IN_MODIFY | IN_MOVE_SELF | IN_DELETE_SELF) >= 0)
+            continue;
+
+        /* wait for a missing path to appear */
+        if (errno == ENOENT &&
+            VIR_STRDUP_QUIET(parent, paths[i]) > 0)
+            virFileRemoveLastComponent(parent);
+
+        if (!parent ||
+            inotify_add_watch(cache->watchFd, parent,
+                              IN_MASK_ADD | IN_CREATE | IN_MOVED_TO) < 0) {
+            VIR_DEBUG("Cannot watch '%s'", paths[i]);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+#else /* !HAVE_SYS_INOTIFY_H */
+static void
+virFileCacheCheckWatches(virFileCachePtr cache ATTRIBUTE_UNUSED)
+{
+}
+
+
+static int
+virFileCacheWatch(virFileCachePtr cache ATTRIBUTE_UNUSED,
+                  void *data ATTRIBUTE_UNUSED)
+{
+    return -1;
+}
+#endif /* !HAVE_SYS_INOTIFY_H */
+
+
+/* Calls the isValid() handler unless @data was validated recently enough
+ * and none of the paths it depends on changed since. */
+static bool
+virFileCacheIsValid(virFileCachePtr cache,
+                    const char *name,
+                    void *data)
+{
+    unsigned long long *until;
+    unsigned long long now;
+    unsigned long long interval = VIR_FILE_CACHE_VALID_INTERVAL;
+
+    virFileCacheCheckWatches(cache);
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return cache->handlers.isValid(data, cache->priv);
+    }
+
+    /* the second check guards against the clock going backwards */
+    if ((until = virHashLookup(cache->validUntil, name)) &&
+        now < *until && *until - now <= VIR_FILE_CACHE_WATCHED_INTERVAL)
+        return true;
+
+    if (!cache->handlers.isValid(data, cache->priv)) {
+        virHashRemoveEntry(cache->validUntil, name);
+        return false;
+    }
+
+    if (virFileCacheWatch(cache, data) == 0)
+        interval = VIR_FILE_CACHE_WATCHED_INTERVAL;
+
+    if (!until) {
+        if (VIR_ALLOC_QUIET(until) < 0 ||
+            virHashAddEntry(cache->validUntil, name, until) < 0) {
+            VIR_FREE(until);
+            virResetLastError();
+            return true;
+        }
+    }
+    *until = now + interval;
+
+    return true;
+}
+
+
 static int
 virFileCacheLoad(virFileCachePtr cache,
                  const char *name,
@@ -159,7 +306,7 @@ virFileCacheLoad(virFileCachePtr cache,
         goto cleanup;
     }
 
-    if (!cache->handlers.isValid(loadData, cache->priv)) {
+    if (!virFileCacheIsValid(cache, name, loadData)) {
         VIR_DEBUG("Outdated cached capabilities '%s' for '%s'", file, name);
         unlink(file);
         ret = 0;
@@ -242,9 +389,21 @@ virFileCacheNew(const char *dir,
     if (!(cache = virObjectNew(virFileCacheClass)))
         return NULL;
 
-    if (!(cache->table = virHashCreate(10, virObjectFreeHashData)))
+    cache->watchFd = -1;
+
+    if (!(cache->table = virHashCreate(10, virObjectFreeHashData)) ||
+        !(cache->validUntil = virHashCreate(10, virHashValueFree)))
         goto cleanup;
 
+#ifdef HAVE_SYS_INOTIFY_H
+    if (handlers->watchPaths &&
+        (cache->watchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        char ebuf[1024];
+        VIR_DEBUG("Cannot watch cached data: %s",
+                  virStrerror(errno, ebuf, sizeof(ebuf)));
+    }
+#endif
+
     if (VIR_STRDUP(cache->dir, dir) < 0)
         goto cleanup;
 
@@ -266,7 +425,7 @@ virFileCacheValidate(virFileCachePtr cache,
                      const char *name,
                      void **data)
 {
-    if (*data && !cache->handlers.isValid(*data, cache->priv)) {
+    if (*data && !virFileCacheIsValid(cache, name, *data)) {
         VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
                   *data, NULLSTR(name));
         if (name)
@@ -349,6 +508,115 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
 }
 
 
+static int
+virFileCachePrefetchName(size_t item,
+                         void *opaque)
+{
+    virFileCachePrefetchDataPtr prefetch = opaque;
+    const char *name = prefetch->names[item];
+
+    VIR_DEBUG("Prefetching data for '%s'", name);
+    if (!(prefetch->data[item] = virFileCacheNewData(prefetch->cache, name))) {
+        VIR_WARN("Failed to prefetch data for '%s': %s",
+                 name, virGetLastErrorMessage());
+        virResetLastError();
+    }
+
+    return 0;
+}
+
+
+/**
+ * virFileCachePrefetch:
+ * @cache: existing cache object
+ * @names: names of the data which will be looked up shortly
+ * @nnames: number of items in @names
+ *
+ * Makes sure data for all @names is present in the cache.  Unlike
+ * virFileCacheLookup() the data which is missing or no longer valid is
+ * created by several threads in parallel and without holding the cache
+ * lock, therefore the newData(), loadFile() and saveFile() handlers of
+ * @cache must be safe to call concurrently for different names.
+ * Failing to create some data is not an error, virFileCacheLookup()
+ * will just try again and report the failure.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char **names,
+                     size_t nnames)
+{
+    virFileCachePrefetchData prefetch = { .cache = cache };
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(prefetch.names, nnames) < 0 ||
+        VIR_ALLOC_N(prefetch.data, nnames) < 0)
+        goto cleanup;
+
+    virObjectLock(cache);
+    for (i = 0; i < nnames; i++) {
+        void *data = virHashLookup(cache->table, names[i]);
+
+        if (data && !virFileCacheIsValid(cache, names[i], data)) {
+            VIR_DEBUG("Cached data '%p' no longer valid for '%s'",
+                      data, names[i]);
+            virHashRemoveEntry(cache->table, names[i]);
+            data = NULL;
+        }
+
+        if (data)
+            continue;
+
+        for (j = 0; j < prefetch.nnames; j++) {
+            if (STREQ(prefetch.names[j], names[i]))
+                break;
+        }
+
+        if (j == prefetch.nnames)
+            prefetch.names[prefetch.nnames++] = names[i];
+    }
+    virObjectUnlock(cache);
+
+    if (prefetch.nnames == 0) {
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (virThreadParallelRun(prefetch.nnames, virFileCachePrefetchName,
+                             &prefetch, NULL) < 0)
+        goto cleanup;
+
+    virObjectLock(cache);
+    for (i = 0; i < prefetch.nnames; i++) {
+        if (!prefetch.data[i] ||
+            virHashLookup(cache->table, prefetch.names[i]))
+            continue;
+
+        VIR_DEBUG("Caching data '%p' for '%s'",
+                  prefetch.data[i], prefetch.names[i]);
+        if (virHashAddEntry(cache->table, prefetch.names[i],
+                            prefetch.data[i]) < 0) {
+            virObjectUnlock(cache);
+            goto cleanup;
+        }
+        prefetch.data[i] = NULL;
+    }
+    virObjectUnlock(cache);
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < prefetch.nnames; i++)
+        virObjectUnref(prefetch.data[i]);
+    VIR_FREE(prefetch.names);
+    VIR_FREE(prefetch.data);
+    return ret;
+}
+
+
 /**
  * virFileCacheGetPriv:
  * @cache: existing cache object
@@ -412,6 +680,7 @@ virFileCacheInsertData(virFileCachePtr cache,
 
     virObjectLock(cache);
 
+    virHashRemoveEntry(cache->validUntil, name);
     ret = virHashUpdateEntry(cache->table, name, data);
 
     virObjectUnlock(cache);
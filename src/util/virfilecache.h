@@ -36,7 +36,7 @@ typedef virFileCache *virFileCachePtr;
  * @priv: private data created together with cache
  *
  * Validates the cached data whether it needs to be refreshed
- * or no.
+ * or no.  A positive result is reused for a short while.
  *
  * Returns *true* if it's valid or *false* if not valid.
  */
@@ -51,6 +51,8 @@ typedef bool
  *
  * Creates a new data based on the @name.  The returned data must be
  * an instance of virObject.
+ * The function may be called by several threads at the same time for
+ * different names, see virFileCachePrefetch().
  *
  * Returns data object or NULL on error.
  */
@@ -98,6 +100,21 @@ typedef int
 typedef void
 (*virFileCachePrivFreePtr)(void *priv);
 
+/**
+ * virFileCacheWatchPathsPtr:
+ * @data: data object
+ * @priv: private data created together with cache
+ *
+ * Lists the files whose changes may make @data invalid.  If all of them
+ * can be watched, the result of isValid() is trusted for longer since
+ * any change of these files is noticed immediately.  Optional.
+ *
+ * Returns a NULL terminated list of paths or NULL on error.
+ */
+typedef char **
+(*virFileCacheWatchPathsPtr)(void *data,
+                             void *priv);
+
 typedef struct _virFileCacheHandlers virFileCacheHandlers;
 typedef virFileCacheHandlers *virFileCacheHandlersPtr;
 struct _virFileCacheHandlers {
@@ -106,6 +123,7 @@ struct _virFileCacheHandlers {
     virFileCacheLoadFilePtr loadFile;
     virFileCacheSaveFilePtr saveFile;
     virFileCachePrivFreePtr privFree;
+    virFileCacheWatchPathsPtr watchPaths;
 };
 
 virFileCachePtr
@@ -122,6 +140,11 @@ virFileCacheLookupByFunc(virFileCachePtr cache,
                          virHashSearcher iter,
                          const void *iterData);
 
+int
+virFileCachePrefetch(virFileCachePtr cache,
+                     const char **names,
+                     size_t nnames);
+
 void *
 virFileCacheGetPriv(virFileCachePtr cache);
 
@@ -50,6 +50,12 @@ VIR_ENUM_IMPL(virFirewallLayerCommand, VIR_FIREWALL_LAYER_LAST,
               IPTABLES_PATH,
               IP6TABLES_PATH);
 
+VIR_ENUM_DECL(virFirewallLayerRestore)
+VIR_ENUM_IMPL(virFirewallLayerRestore, VIR_FIREWALL_LAYER_LAST,
+              EBTABLES_PATH "-restore",
+              IPTABLES_PATH "-restore",
+              IP6TABLES_PATH "-restore");
+
 VIR_ENUM_DECL(virFirewallLayerFirewallD)
 VIR_ENUM_IMPL(virFirewallLayerFirewallD, VIR_FIREWALL_LAYER_LAST,
               "eb", "ipv4", "ipv6")
@@ -106,7 +112,22 @@ VIR_ONCE_GLOBAL_INIT(virFirewall)
 static bool iptablesUseLock;
 static bool ip6tablesUseLock;
 static bool ebtablesUseLock;
-static bool lockOverride; /* true to avoid lock probes */
+static bool lockOverride; /* true to avoid lock and restore probes */
+
+/* Whether the *-restore tool of each layer can be used for batching,
+ * and how many batches in a row it failed to load while the very
+ * same rules applied one by one were fine */
+static bool restoreUsable[VIR_FIREWALL_LAYER_LAST];
+static unsigned int restoreFailures[VIR_FIREWALL_LAYER_LAST];
+static bool restoreOverride; /* true to assume *-restore tools exist */
+
+#define VIR_FIREWALL_RESTORE_MAX_FAILURES 3
+
+void
+virFirewallSetRestoreOverride(bool usable)
+{
+    restoreOverride = usable;
+}
 
 void
 virFirewallSetLockOverride(bool avoid)
@@ -150,6 +171,26 @@ virFirewallCheckUpdateLocking(void)
                                ebtablesArgs);
 }
 
+static void
+virFirewallCheckUpdateRestore(void)
+{
+    size_t i;
+
+    for (i = 0; i < VIR_FIREWALL_LAYER_LAST; i++) {
+        const char *bin = virFirewallLayerRestoreTypeToString(i);
+
+        restoreFailures[i] = 0;
+        if (restoreOverride)
+            restoreUsable[i] = true;
+        else if (lockOverride)
+            restoreUsable[i] = false;
+        else
+            restoreUsable[i] = virFileIsExecutable(bin);
+        VIR_DEBUG("%s %s be used for batching rules",
+                  bin, restoreUsable[i] ? "will" : "won't");
+    }
+}
+
 static int
 virFirewallValidateBackend(virFirewallBackend backend)
 {
@@ -198,6 +239,7 @@ virFirewallValidateBackend(virFirewallBackend backend)
     currentBackend = backend;
 
     virFirewallCheckUpdateLocking();
+    virFirewallCheckUpdateRestore();
 
     return 0;
 }
@@ -846,23 +888,217 @@ virFirewallApplyRule(virFirewallPtr firewall,
     return 0;
 }
 
+/*
+ * Format @rule as a line of *-restore input into @buf and store
+ * the table it operates on in @table. Returns true on success,
+ * false if the rule can't be expressed that way.
+ */
+static bool
+virFirewallRuleToRestoreLine(virFirewallRulePtr rule,
+                             virBufferPtr buf,
+                             const char **table)
+{
+    bool first = true;
+    size_t i = 0;
+
+    *table = "filter";
+
+    /* The restore tools take care of locking on their own */
+    if (rule->argsLen &&
+        (STREQ(rule->args[0], "-w") || STREQ(rule->args[0], "--concurrent")))
+        i++;
+
+    for (; i < rule->argsLen; i++) {
+        const char *arg = rule->args[i];
+
+        if ((STREQ(arg, "-t") || STREQ(arg, "--table")) &&
+            i + 1 < rule->argsLen) {
+            *table = rule->args[++i];
+            continue;
+        }
+
+        if (!*arg || strchr(arg, '\n'))
+            return false;
+
+        if (!first)
+            virBufferAddChar(buf, ' ');
+        first = false;
+
+        if (strpbrk(arg, " \t\"'\\#")) {
+            /* ebtables-restore has no notion of quoting */
+            if (rule->layer == VIR_FIREWALL_LAYER_ETHERNET)
+                return false;
+            virBufferAddChar(buf, '"');
+            virBufferEscape(buf, '\\', "\"\\", "%s", arg);
+            virBufferAddChar(buf, '"');
+        } else {
+            virBufferAdd(buf, arg, -1);
+        }
+    }
+
+    if (first)
+        return false;
+
+    virBufferAddChar(buf, '\n');
+    return true;
+}
+
+
+/*
+ * Collect the longest run of @rules which can be loaded with one
+ * *-restore invocation: they must be of the same layer, operate on
+ * the same table, not care about output and not ignore errors.
+ * The restore input is stored in @input. Returns the number of
+ * rules in the run.
+ */
+static size_t
+virFirewallBatchRules(virFirewallRulePtr *rules,
+                      size_t nrules,
+                      bool ignoreErrors,
+                      char **input)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virFirewallLayer layer = rules[0]->layer;
+    const char *table = NULL;
+    size_t n;
+
+    *input = NULL;
+
+    if (ignoreErrors || layer >= VIR_FIREWALL_LAYER_LAST ||
+        !restoreUsable[layer])
+        return 0;
+
+    for (n = 0; n < nrules; n++) {
+        virBuffer line = VIR_BUFFER_INITIALIZER;
+        const char *ruleTable;
+
+        if (rules[n]->layer != layer ||
+            rules[n]->queryCB ||
+            rules[n]->ignoreErrors)
+            break;
+
+        if (!virFirewallRuleToRestoreLine(rules[n], &line, &ruleTable) ||
+            (table && STRNEQ(table, ruleTable))) {
+            virBufferFreeAndReset(&line);
+            break;
+        }
+
+        if (!table) {
+            table = ruleTable;
+            virBufferAsprintf(&buf, "*%s\n", table);
+        }
+        virBufferAddBuffer(&buf, &line);
+    }
+
+    /* Not worth spawning a restore tool for a single rule */
+    if (n < 2) {
+        virBufferFreeAndReset(&buf);
+        return 0;
+    }
+
+    if (layer != VIR_FIREWALL_LAYER_ETHERNET)
+        virBufferAddLit(&buf, "COMMIT\n");
+
+    if (virBufferCheckError(&buf) < 0) {
+        virResetLastError();
+        return 0;
+    }
+
+    *input = virBufferContentAndReset(&buf);
+    return n;
+}
+
+
+/*
+ * Load @input with the *-restore tool of @layer. The restore tools
+ * commit a table atomically, so on failure nothing has been applied
+ * and the caller can fall back to applying the rules one by one.
+ * Returns 0 on success, -1 on failure with no error reported.
+ */
+static int
+virFirewallApplyRestoreDirect(virFirewallLayer layer,
+                              const char *input,
+                              size_t nrules)
+{
+    const char *bin = virFirewallLayerRestoreTypeToString(layer);
+    VIR_AUTOPTR(virCommand) cmd = NULL;
+    VIR_AUTOFREE(char *) error = NULL;
+    int status;
+
+    VIR_INFO("Applying %zu rules with %s", nrules, bin);
+    VIR_DEBUG("Restore input '%s'", input);
+
+    cmd = virCommandNewArgList(bin, "--noflush", NULL);
+    virCommandSetInputBuffer(cmd, input);
+    virCommandSetErrorBuffer(cmd, &error);
+
+    if (virCommandRun(cmd, &status) < 0) {
+        virResetLastError();
+        return -1;
+    }
+
+    if (status != 0) {
+        VIR_DEBUG("%s failed with status %d: %s",
+                  bin, status, NULLSTR(error));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 virFirewallApplyGroup(virFirewallPtr firewall,
                       size_t idx)
 {
     virFirewallGroupPtr group = firewall->groups[idx];
     bool ignoreErrors = (group->actionFlags & VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS);
+    bool batch = (group->actionFlags & VIR_FIREWALL_TRANSACTION_BATCH) &&
+        currentBackend == VIR_FIREWALL_BACKEND_DIRECT;
     size_t i;
 
     VIR_INFO("Starting transaction for firewall=%p group=%p flags=0x%x",
              firewall, group, group->actionFlags);
     firewall->currentGroup = idx;
     group->addingRollback = false;
-    for (i = 0; i < group->naction; i++) {
-        if (virFirewallApplyRule(firewall,
-                                 group->action[i],
-                                 ignoreErrors) < 0)
-            return -1;
+    for (i = 0; i < group->naction;) {
+        VIR_AUTOFREE(char *) input = NULL;
+        virFirewallLayer layer = group->action[i]->layer;
+        size_t n = 1;
+        size_t j;
+
+        if (batch &&
+            (n = virFirewallBatchRules(group->action + i,
+                                       group->naction - i,
+                                       ignoreErrors, &input)) > 0) {
+            if (virFirewallApplyRestoreDirect(layer, input, n) == 0) {
+                restoreFailures[layer] = 0;
+                i += n;
+                continue;
+            }
+        }
+        n = MAX(n, 1);
+
+        /* Either batching was not possible or the batch was
+         * rejected; in the latter case the rules are replayed one by
+         * one to get accurate error reporting */
+        for (j = 0; j < n; j++) {
+            if (virFirewallApplyRule(firewall,
+                                     group->action[i + j],
+                                     ignoreErrors) < 0)
+                return -1;
+        }
+
+        /* The individual rules were fine, so the restore tool does
+         * not grok what we fed it. Stop using it after a few tries */
+        if (n > 1 &&
+            ++restoreFailures[layer] >= VIR_FIREWALL_RESTORE_MAX_FAILURES) {
+            VIR_WARN("Disabling batching of firewall rules with %s",
+                     virFirewallLayerRestoreTypeToString(layer));
+            restoreUsable[layer] = false;
+        }
+
+        i += n;
     }
     return 0;
 }
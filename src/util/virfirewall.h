@@ -99,6 +99,9 @@ typedef enum {
     /* Ignore all errors when applying rules, so no
      * rollback block will be required */
     VIR_FIREWALL_TRANSACTION_IGNORE_ERRORS = (1 << 0),
+    /* Load consecutive rules with a single iptables-restore or
+     * ebtables-restore run where the direct backend allows it */
+    VIR_FIREWALL_TRANSACTION_BATCH = (1 << 1),
 } virFirewallTransactionFlags;
 
 void virFirewallStartTransaction(virFirewallPtr firewall,
@@ -42,4 +42,6 @@ typedef enum {
 
 int virFirewallSetBackend(virFirewallBackend backend);
 
+void virFirewallSetRestoreOverride(bool usable);
+
 #endif /* __VIR_FIREWALL_PRIV_H__ */
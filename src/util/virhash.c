@@ -29,12 +29,17 @@
 #include "virrandom.h"
 #include "virstring.h"
 #include "virobject.h"
+#include "viratomic.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 VIR_LOG_INIT("util.hash");
 
 #define MAX_HASH_LEN 8
+#define MAX_HASH_SIZE (8 * 2048 * 128)
+
+/* Number of buckets migrated by each modification while growing */
+#define HASH_REHASH_STEP 32
 
 /* #define DEBUG_GROW */
 
@@ -49,6 +54,23 @@ struct _virHashEntry {
     void *payload;
 };
 
+/*
+ * A single slot in an open addressing hash table
+ */
+typedef struct _virHashSlot virHashSlot;
+typedef virHashSlot *virHashSlotPtr;
+struct _virHashSlot {
+    uint32_t code;
+    uint16_t dist; /* distance from the home slot plus one, 0 if unused */
+    bool inlineKey;
+    bool deleted;
+    void *payload;
+    union {
+        void *ptr;
+        char str[16];
+    } key;
+};
+
 /*
  * The entire hash table
  */
@@ -57,6 +79,27 @@ struct _virHashTable {
     uint32_t seed;
     size_t size;
     size_t nbElems;
+    /* While growing, entries not yet moved to @table still live in
+     * @oldtable. Buckets below @rehashidx have been moved already. */
+    virHashEntryPtr *oldtable;
+    size_t oldsize;
+    size_t rehashidx;
+    /* Bucket migration is paused while an iteration is running so
+     * that entries are neither skipped nor visited twice. Callers may
+     * iterate concurrently under a read lock, hence the counter is
+     * only ever updated atomically and readers never write anything
+     * else: rehashing and compaction are left to the modifications,
+     * which the callers serialize against any iteration. */
+    volatile int iterators;
+    /* Open addressing tables use @slots instead of @table. @size
+     * is then the number of slots, always a power of two. */
+    virHashSlotPtr slots;
+    size_t ndeleted;
+    bool inlineKeys;
+    /* entries and buckets (or slots) last added to the global usage
+     * counters, see virHashAccount */
+    size_t accEntries;
+    size_t accBuckets;
     virHashDataFree dataFree;
     virHashKeyCode keyCode;
     virHashKeyEqual keyEqual;
@@ -64,17 +107,32 @@ struct _virHashTable {
     virHashKeyFree keyFree;
 };
 
-struct _virHashAtomic {
-    virObjectLockable parent;
+typedef struct _virHashAtomicShard virHashAtomicShard;
+typedef virHashAtomicShard *virHashAtomicShardPtr;
+struct _virHashAtomicShard {
+    virMutex lock;
     virHashTablePtr hash;
 };
 
+struct _virHashAtomic {
+    virObject parent;
+    uint32_t seed;
+    size_t nshards;
+    virHashAtomicShardPtr *shards;
+};
+
 static virClassPtr virHashAtomicClass;
 static void virHashAtomicDispose(void *obj);
 
+/* Process wide usage of hash tables, indexed by whether the tables
+ * use open addressing */
+static int virHashUsageTables;
+static int virHashUsageEntries[2];
+static int virHashUsageBuckets[2];
+
 static int virHashAtomicOnceInit(void)
 {
-    if (!VIR_CLASS_NEW(virHashAtomic, virClassForObjectLockable()))
+    if (!VIR_CLASS_NEW(virHashAtomic, virClassForObject()))
         return -1;
 
     return 0;
@@ -120,6 +178,123 @@ virHashComputeKey(const virHashTable *table, const void *name)
     return value % table->size;
 }
 
+
+/**
+ * virHashAccount:
+ * @table: the hash table
+ * @release: whether @table is being freed
+ *
+ * Bring the process wide usage counters up to date with the current
+ * number of entries and buckets of @table. Called after operations
+ * which may have changed them.
+ */
+static void
+virHashAccount(virHashTablePtr table, bool release)
+{
+    bool open = !!table->slots;
+    size_t entries = 0;
+    size_t buckets = 0;
+
+    if (!release) {
+        entries = table->nbElems;
+        buckets = table->size + table->oldsize;
+    }
+
+    if (entries != table->accEntries) {
+        virAtomicIntAdd(&virHashUsageEntries[open],
+                        (int)(entries - table->accEntries));
+        table->accEntries = entries;
+    }
+
+    if (buckets != table->accBuckets) {
+        virAtomicIntAdd(&virHashUsageBuckets[open],
+                        (int)(buckets - table->accBuckets));
+        table->accBuckets = buckets;
+    }
+}
+
+
+/**
+ * virHashGetUsage:
+ * @tables: filled with the number of hash tables in use
+ * @entries: filled with the number of entries stored in them
+ * @bytes: filled with the approximate memory used by them
+ *
+ * Reports how much the hash tables of this process hold. @bytes
+ * covers the tables, their buckets and entries but neither the keys
+ * nor the payloads.
+ */
+void
+virHashGetUsage(size_t *tables,
+                size_t *entries,
+                unsigned long long *bytes)
+{
+    int chainedEntries = virAtomicIntGet(&virHashUsageEntries[0]);
+    int openEntries = virAtomicIntGet(&virHashUsageEntries[1]);
+    int ntables = virAtomicIntGet(&virHashUsageTables);
+
+    *tables = ntables;
+    *entries = chainedEntries + openEntries;
+    *bytes = (unsigned long long)ntables * sizeof(virHashTable) +
+        (unsigned long long)chainedEntries * sizeof(virHashEntry) +
+        (unsigned long long)virAtomicIntGet(&virHashUsageBuckets[0]) *
+        sizeof(virHashEntryPtr) +
+        (unsigned long long)virAtomicIntGet(&virHashUsageBuckets[1]) *
+        sizeof(virHashSlot);
+}
+
+
+/*
+ * virHashBucket:
+ * @table: the hash table
+ * @i: bucket index
+ *
+ * Returns the @i-th bucket counting over the current and, while
+ * growing, the old bucket array, or NULL past the last bucket.
+ */
+static virHashEntryPtr *
+virHashBucket(const virHashTable *table, size_t i)
+{
+    if (i < table->size)
+        return &table->table[i];
+    i -= table->size;
+    if (table->oldtable && i < table->oldsize)
+        return &table->oldtable[i];
+    return NULL;
+}
+
+
+/*
+ * virHashFindEntry:
+ * @table: the hash table
+ * @name: the name of the userdata
+ *
+ * Returns a pointer to the link pointing to the entry for @name,
+ * or NULL if there is no such entry.
+ */
+static virHashEntryPtr *
+virHashFindEntry(const virHashTable *table, const void *name)
+{
+    uint32_t value = table->keyCode(name, table->seed);
+    virHashEntryPtr *nextptr;
+
+    for (nextptr = &table->table[value % table->size]; *nextptr;
+         nextptr = &(*nextptr)->next) {
+        if (table->keyEqual((*nextptr)->name, name))
+            return nextptr;
+    }
+
+    if (table->oldtable && value % table->oldsize >= table->rehashidx) {
+        for (nextptr = &table->oldtable[value % table->oldsize]; *nextptr;
+             nextptr = &(*nextptr)->next) {
+            if (table->keyEqual((*nextptr)->name, name))
+                return nextptr;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * virHashCreateFull:
  * @size: the size of the hash table
@@ -162,6 +337,9 @@ virHashTablePtr virHashCreateFull(ssize_t size,
         return NULL;
     }
 
+    virAtomicIntInc(&virHashUsageTables);
+    virHashAccount(table, false);
+
     return table;
 }
 
@@ -186,23 +364,124 @@ virHashTablePtr virHashCreate(ssize_t size, virHashDataFree dataFree)
 }
 
 
+/**
+ * virHashCreateOpen:
+ * @size: the expected number of entries
+ * @dataFree: callback to free data
+ *
+ * Create a new virHashTablePtr using open addressing rather than
+ * chaining. Keys are strings, as for virHashCreate, and short ones
+ * are stored inline. Such tables need less memory and do fewer
+ * allocations and pointer dereferences, but growing them moves all
+ * entries at once.
+ *
+ * Returns the newly created object, or NULL if an error occurred.
+ */
+virHashTablePtr virHashCreateOpen(ssize_t size, virHashDataFree dataFree)
+{
+    virHashTablePtr table = NULL;
+    size_t slots = 8;
+
+    if (size <= 0)
+        size = 256;
+
+    while (slots * 7 < size * 8)
+        slots *= 2;
+
+    if (VIR_ALLOC(table) < 0)
+        return NULL;
+
+    table->seed = virRandomBits(32);
+    table->size = slots;
+    table->nbElems = 0;
+    table->dataFree = dataFree;
+    table->keyCode = virHashStrCode;
+    table->keyEqual = virHashStrEqual;
+    table->keyCopy = virHashStrCopy;
+    table->keyFree = virHashStrFree;
+    table->inlineKeys = true;
+
+    if (VIR_ALLOC_N(table->slots, slots) < 0) {
+        VIR_FREE(table);
+        return NULL;
+    }
+
+    virAtomicIntInc(&virHashUsageTables);
+    virHashAccount(table, false);
+
+    return table;
+}
+
+
+/**
+ * virHashAtomicNewSharded:
+ * @size: the size of each shard's hash table
+ * @nshards: the number of shards
+ * @dataFree: callback to free data
+ *
+ * Create a new virHashAtomicPtr whose entries are spread over
+ * @nshards hash tables, each protected by its own lock, so that
+ * threads working on different keys rarely contend.
+ *
+ * Returns the newly created object, or NULL if an error occurred.
+ */
 virHashAtomicPtr
-virHashAtomicNew(ssize_t size,
-                 virHashDataFree dataFree)
+virHashAtomicNewSharded(ssize_t size,
+                        size_t nshards,
+                        virHashDataFree dataFree)
 {
     virHashAtomicPtr hash;
+    size_t i;
 
     if (virHashAtomicInitialize() < 0)
         return NULL;
 
-    if (!(hash = virObjectLockableNew(virHashAtomicClass)))
+    if (nshards == 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("hash table needs at least one shard"));
         return NULL;
+    }
 
-    if (!(hash->hash = virHashCreate(size, dataFree))) {
-        virObjectUnref(hash);
+    if (!(hash = virObjectNew(virHashAtomicClass)))
         return NULL;
+
+    hash->seed = virRandomBits(32);
+
+    if (VIR_ALLOC_N(hash->shards, nshards) < 0)
+        goto error;
+    hash->nshards = nshards;
+
+    for (i = 0; i < nshards; i++) {
+        virHashAtomicShardPtr shard;
+
+        if (VIR_ALLOC(shard) < 0)
+            goto error;
+
+        if (virMutexInit(&shard->lock) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to initialize mutex"));
+            VIR_FREE(shard);
+            goto error;
+        }
+        hash->shards[i] = shard;
+
+        if (!(shard->hash = virHashCreate(size, dataFree)))
+            goto error;
     }
+
     return hash;
+
+ error:
+    virObjectUnref(hash);
+    return NULL;
+}
+
+
+virHashAtomicPtr
+virHashAtomicNew(ssize_t size,
+                 virHashDataFree dataFree)
+{
+    return virHashAtomicNewSharded(size, 1, dataFree);
 }
 
 
@@ -210,8 +489,67 @@ static void
 virHashAtomicDispose(void *obj)
 {
     virHashAtomicPtr hash = obj;
+    size_t i;
+
+    for (i = 0; i < hash->nshards; i++) {
+        if (!hash->shards[i])
+            continue;
+        virHashFree(hash->shards[i]->hash);
+        virMutexDestroy(&hash->shards[i]->lock);
+        VIR_FREE(hash->shards[i]);
+    }
+    VIR_FREE(hash->shards);
+}
+
+
+static virHashAtomicShardPtr
+virHashAtomicGetShard(virHashAtomicPtr hash, const void *name)
+{
+    if (hash->nshards == 1 || !name)
+        return hash->shards[0];
+
+    return hash->shards[virHashStrCode(name, hash->seed) % hash->nshards];
+}
+
+
+/**
+ * virHashRehashStep:
+ * @table: the hash table
+ *
+ * Move the next few buckets left over from a previous virHashGrow
+ * to the new bucket array, so that the cost of growing is spread
+ * over later modifications of the table.
+ */
+static void
+virHashRehashStep(virHashTablePtr table)
+{
+    size_t n;
+
+    if (!table->oldtable || virAtomicIntGet(&table->iterators))
+        return;
+
+    for (n = 0; n < HASH_REHASH_STEP && table->rehashidx < table->oldsize; n++) {
+        virHashEntryPtr iter = table->oldtable[table->rehashidx];
+        while (iter) {
+            virHashEntryPtr next = iter->next;
+            size_t key = virHashComputeKey(table, iter->name);
+
+            iter->next = table->table[key];
+            table->table[key] = iter;
+            iter = next;
+        }
+        table->oldtable[table->rehashidx++] = NULL;
+    }
 
-    virHashFree(hash->hash);
+    if (table->rehashidx == table->oldsize) {
+#ifdef DEBUG_GROW
+        VIR_DEBUG("virHashGrow : from %zu to %zu done, %zu elems",
+                  table->oldsize, table->size, table->nbElems);
+#endif
+        VIR_FREE(table->oldtable);
+        table->oldsize = 0;
+        table->rehashidx = 0;
+    }
 }
 
 
@@ -220,64 +558,389 @@ virHashAtomicDispose(void *obj)
  * @table: the hash table
  * @size: the new size of the hash table
  *
- * resize the hash table
+ * resize the hash table. Only the new bucket array is allocated
+ * here, entries are moved over incrementally by virHashRehashStep.
+ * Nothing is done if the table is still being grown.
  *
  * Returns 0 in case of success, -1 in case of failure
  */
 static int
 virHashGrow(virHashTablePtr table, size_t size)
 {
-    size_t oldsize, i;
-    virHashEntryPtr *oldtable;
-
-#ifdef DEBUG_GROW
-    size_t nbElem = 0;
-#endif
+    virHashEntryPtr *newtable;
 
     if (table == NULL)
         return -1;
     if (size < 8)
         return -1;
-    if (size > 8 * 2048)
+    if (size > MAX_HASH_SIZE)
         return -1;
 
-    oldsize = table->size;
-    oldtable = table->table;
-    if (oldtable == NULL)
-        return -1;
+    if (table->oldtable)
+        return 0;
 
-    if (VIR_ALLOC_N(table->table, size) < 0) {
-        table->table = oldtable;
+    if (VIR_ALLOC_N(newtable, size) < 0)
         return -1;
-    }
-    table->size = size;
-
-    for (i = 0; i < oldsize; i++) {
-        virHashEntryPtr iter = oldtable[i];
-        while (iter) {
-            virHashEntryPtr next = iter->next;
-            size_t key = virHashComputeKey(table, iter->name);
 
-            iter->next = table->table[key];
-            table->table[key] = iter;
+    table->oldtable = table->table;
+    table->oldsize = table->size;
+    table->rehashidx = 0;
+    table->table = newtable;
+    table->size = size;
 
 #ifdef DEBUG_GROW
-            nbElem++;
+    VIR_DEBUG("virHashGrow : from %zu to %zu, %zu elems", table->oldsize,
+              size, table->nbElems);
 #endif
-            iter = next;
+
+    virHashRehashStep(table);
+
+    return 0;
+}
+
+/*
+ * Open addressing tables
+ *
+ * Instead of chaining separately allocated entries, tables created
+ * by virHashCreateOpen store entries directly in an array of slots
+ * probed linearly. Robin Hood insertion keeps probe sequences short
+ * and lets lookups stop early, the hash code stored in each slot
+ * avoids most key comparisons and short string keys are stored in
+ * the slot itself, so that a lookup usually touches a single cache
+ * line.
+ *
+ * Iterators may remove the current element, so while an iteration
+ * is running removed slots are only marked deleted. They are
+ * dropped by shifting the following slots back once the last
+ * iteration has finished.
+ */
+
+/**
+ * virHashOpenSlotName:
+ * @slot: a used slot
+ *
+ * Returns the key stored in @slot.
+ */
+static const void *
+virHashOpenSlotName(const virHashSlot *slot)
+{
+    return slot->inlineKey ? slot->key.str : slot->key.ptr;
+}
+
+
+/**
+ * virHashOpenFind:
+ * @table: the hash table
+ * @name: the name of the userdata
+ * @code: the hash code of @name
+ *
+ * Returns the slot holding @name, or NULL if there is none.
+ */
+static virHashSlotPtr
+virHashOpenFind(const virHashTable *table, const void *name, uint32_t code)
+{
+    size_t mask = table->size - 1;
+    size_t i = code & mask;
+    uint16_t dist;
+
+    for (dist = 1; ; dist++, i = (i + 1) & mask) {
+        virHashSlotPtr slot = &table->slots[i];
+
+        /* An empty slot, or one closer to its home than we are to
+         * ours, means the entry would have been stored before it. */
+        if (slot->dist < dist)
+            return NULL;
+
+        if (!slot->deleted && slot->code == code &&
+            table->keyEqual(virHashOpenSlotName(slot), name))
+            return slot;
+    }
+}
+
+
+/**
+ * virHashOpenInsert:
+ * @slots: the slot array
+ * @size: number of slots in @slots
+ * @entry: the entry to store
+ *
+ * Store @entry using Robin Hood insertion, i.e. take over the slot
+ * of any entry which is closer to its home slot and carry on with
+ * that one instead. @slots must have at least one free slot and
+ * must not contain deleted slots.
+ */
+static void
+virHashOpenInsert(virHashSlotPtr slots, size_t size, virHashSlot entry)
+{
+    size_t mask = size - 1;
+    size_t i = entry.code & mask;
+
+    for (entry.dist = 1; ; entry.dist++, i = (i + 1) & mask) {
+        virHashSlot tmp;
+
+        if (slots[i].dist == 0) {
+            slots[i] = entry;
+            return;
+        }
+
+        if (slots[i].dist < entry.dist) {
+            tmp = slots[i];
+            slots[i] = entry;
+            entry = tmp;
         }
     }
+}
+
+
+/**
+ * virHashOpenShiftBack:
+ * @table: the hash table
+ * @i: index of the slot to free
+ *
+ * Free slot @i by moving the following entries which are not in
+ * their home slot one slot back.
+ */
+static void
+virHashOpenShiftBack(virHashTablePtr table, size_t i)
+{
+    size_t mask = table->size - 1;
+
+    for (;;) {
+        size_t next = (i + 1) & mask;
 
-    VIR_FREE(oldtable);
+        if (table->slots[next].dist <= 1) {
+            memset(&table->slots[i], 0, sizeof(table->slots[i]));
+            return;
+        }
+
+        table->slots[i] = table->slots[next];
+        table->slots[i].dist--;
+        i = next;
+    }
+}
+
+
+/**
+ * virHashOpenCompact:
+ * @table: the hash table
+ *
+ * Drop the slots marked deleted during an iteration.
+ */
+static void
+virHashOpenCompact(virHashTablePtr table)
+{
+    size_t i;
+
+    if (virAtomicIntGet(&table->iterators) || !table->ndeleted)
+        return;
+
+    for (i = 0; i < table->size; i++) {
+        while (table->slots[i].dist && table->slots[i].deleted)
+            virHashOpenShiftBack(table, i);
+    }
+
+    table->ndeleted = 0;
+}
+
+
+/**
+ * virHashOpenGrow:
+ * @table: the hash table
+ * @size: the new number of slots, a power of two
+ *
+ * Move all entries to a new slot array of @size slots.
+ *
+ * Returns 0 in case of success, -1 in case of failure
+ */
+static int
+virHashOpenGrow(virHashTablePtr table, size_t size)
+{
+    virHashSlotPtr slots;
+    size_t i;
+
+    if (VIR_ALLOC_N(slots, size) < 0)
+        return -1;
+
+    for (i = 0; i < table->size; i++) {
+        if (table->slots[i].dist)
+            virHashOpenInsert(slots, size, table->slots[i]);
+    }
 
 #ifdef DEBUG_GROW
-    VIR_DEBUG("virHashGrow : from %d to %d, %ld elems", oldsize,
-              size, nbElem);
+    VIR_DEBUG("virHashOpenGrow : from %zu to %zu, %zu elems", table->size,
+              size, table->nbElems);
 #endif
 
+    VIR_FREE(table->slots);
+    table->slots = slots;
+    table->size = size;
+
     return 0;
 }
 
+
+static void
+virHashOpenRemoveSlot(virHashTablePtr table, virHashSlotPtr slot)
+{
+    if (table->dataFree)
+        table->dataFree(slot->payload, virHashOpenSlotName(slot));
+    if (!slot->inlineKey && table->keyFree)
+        table->keyFree(slot->key.ptr);
+    table->nbElems--;
+
+    if (virAtomicIntGet(&table->iterators)) {
+        slot->deleted = true;
+        table->ndeleted++;
+    } else {
+        virHashOpenShiftBack(table, slot - table->slots);
+    }
+}
+
+
+static void
+virHashOpenFree(virHashTablePtr table)
+{
+    size_t i;
+
+    for (i = 0; i < table->size; i++) {
+        virHashSlotPtr slot = &table->slots[i];
+
+        if (!slot->dist || slot->deleted)
+            continue;
+
+        if (table->dataFree)
+            table->dataFree(slot->payload, virHashOpenSlotName(slot));
+        if (!slot->inlineKey && table->keyFree)
+            table->keyFree(slot->key.ptr);
+    }
+
+    VIR_FREE(table->slots);
+}
+
+
+static int
+virHashOpenAddOrUpdateEntry(virHashTablePtr table, const void *name,
+                            void *userdata,
+                            bool is_update)
+{
+    virHashSlot entry = { 0 };
+    virHashSlotPtr slot;
+    size_t len;
+
+    entry.code = table->keyCode(name, table->seed);
+
+    /* Check for duplicate entry */
+    if ((slot = virHashOpenFind(table, name, entry.code))) {
+        if (is_update) {
+            if (table->dataFree)
+                table->dataFree(slot->payload, virHashOpenSlotName(slot));
+            slot->payload = userdata;
+            return 0;
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Duplicate key"));
+            return -1;
+        }
+    }
+
+    /* Keep the load factor below 7/8 */
+    if ((table->nbElems + table->ndeleted + 1) * 8 > table->size * 7 &&
+        virHashOpenGrow(table, table->size * 2) < 0)
+        return -1;
+
+    if (table->inlineKeys &&
+        (len = strlen(name)) < sizeof(entry.key.str)) {
+        memcpy(entry.key.str, name, len + 1);
+        entry.inlineKey = true;
+    } else if (!(entry.key.ptr = table->keyCopy(name))) {
+        return -1;
+    }
+    entry.payload = userdata;
+
+    virHashOpenInsert(table->slots, table->size, entry);
+    table->nbElems++;
+
+    return 0;
+}
+
+
+static int
+virHashOpenForEach(virHashTablePtr table, virHashIterator iter, void *data)
+{
+    size_t i;
+    int ret = -1;
+
+    virAtomicIntInc(&table->iterators);
+    for (i = 0; i < table->size; i++) {
+        virHashSlotPtr slot = &table->slots[i];
+
+        if (!slot->dist || slot->deleted)
+            continue;
+
+        if (iter(slot->payload, virHashOpenSlotName(slot), data) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    /* only an iteration removing entries, which cannot run
+     * concurrently with another, leaves slots to compact */
+    if (virAtomicIntDecAndTest(&table->iterators))
+        virHashOpenCompact(table);
+    return ret;
+}
+
+
+static ssize_t
+virHashOpenRemoveSet(virHashTablePtr table,
+                     virHashSearcher iter,
+                     const void *data)
+{
+    size_t i, count = 0;
+
+    virAtomicIntInc(&table->iterators);
+    for (i = 0; i < table->size; i++) {
+        virHashSlotPtr slot = &table->slots[i];
+
+        if (!slot->dist || slot->deleted)
+            continue;
+
+        if (iter(slot->payload, virHashOpenSlotName(slot), data)) {
+            virHashOpenRemoveSlot(table, slot);
+            count++;
+        }
+    }
+    if (virAtomicIntDecAndTest(&table->iterators))
+        virHashOpenCompact(table);
+
+    return count;
+}
+
+
+static void *
+virHashOpenSearch(virHashTablePtr table,
+                  virHashSearcher iter,
+                  const void *data,
+                  void **name)
+{
+    size_t i;
+
+    for (i = 0; i < table->size; i++) {
+        virHashSlotPtr slot = &table->slots[i];
+
+        if (!slot->dist || slot->deleted)
+            continue;
+
+        if (iter(slot->payload, virHashOpenSlotName(slot), data)) {
+            if (name)
+                *name = table->keyCopy(virHashOpenSlotName(slot));
+            return slot->payload;
+        }
+    }
+
+    return NULL;
+}
+
 /**
  * virHashFree:
  * @table: the hash table
@@ -290,11 +953,22 @@ virHashFree(virHashTablePtr table)
 {
     size_t i;
 
+    virHashEntryPtr *bucket;
+
     if (table == NULL)
         return;
 
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr iter = table->table[i];
+    virHashAccount(table, true);
+    virAtomicIntAdd(&virHashUsageTables, -1);
+
+    if (table->slots) {
+        virHashOpenFree(table);
+        VIR_FREE(table);
+        return;
+    }
+
+    for (i = 0; (bucket = virHashBucket(table, i)); i++) {
+        virHashEntryPtr iter = *bucket;
         while (iter) {
             virHashEntryPtr next = iter->next;
 
@@ -307,6 +981,7 @@ virHashFree(virHashTablePtr table)
         }
     }
 
+    VIR_FREE(table->oldtable);
     VIR_FREE(table->table);
     VIR_FREE(table);
 }
@@ -317,31 +992,41 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
                         bool is_update)
 {
     size_t key, len = 0;
+    virHashEntryPtr *nextptr;
     virHashEntryPtr entry;
     void *new_name;
+    int ret;
 
     if ((table == NULL) || (name == NULL))
         return -1;
 
-    key = virHashComputeKey(table, name);
+    if (table->slots) {
+        ret = virHashOpenAddOrUpdateEntry(table, name, userdata, is_update);
+        virHashAccount(table, false);
+        return ret;
+    }
+
+    virHashRehashStep(table);
 
     /* Check for duplicate entry */
-    for (entry = table->table[key]; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name)) {
-            if (is_update) {
-                if (table->dataFree)
-                    table->dataFree(entry->payload, entry->name);
-                entry->payload = userdata;
-                return 0;
-            } else {
-                virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
-                               _("Duplicate key"));
-                return -1;
-            }
+    if ((nextptr = virHashFindEntry(table, name))) {
+        entry = *nextptr;
+        if (is_update) {
+            if (table->dataFree)
+                table->dataFree(entry->payload, entry->name);
+            entry->payload = userdata;
+            return 0;
+        } else {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Duplicate key"));
+            return -1;
         }
-        len++;
     }
 
+    key = virHashComputeKey(table, name);
+    for (entry = table->table[key]; entry; entry = entry->next)
+        len++;
+
     if (VIR_ALLOC(entry) < 0 || !(new_name = table->keyCopy(name))) {
         VIR_FREE(entry);
         return -1;
@@ -357,6 +1042,8 @@ virHashAddOrUpdateEntry(virHashTablePtr table, const void *name,
     if (len > MAX_HASH_LEN)
         virHashGrow(table, MAX_HASH_LEN * table->size);
 
+    virHashAccount(table, false);
+
     return 0;
 }
 
@@ -401,11 +1088,12 @@ virHashAtomicUpdate(virHashAtomicPtr table,
                     const void *name,
                     void *userdata)
 {
+    virHashAtomicShardPtr shard = virHashAtomicGetShard(table, name);
     int ret;
 
-    virObjectLock(table);
-    ret = virHashAddOrUpdateEntry(table->hash, name, userdata, true);
-    virObjectUnlock(table);
+    virMutexLock(&shard->lock);
+    ret = virHashAddOrUpdateEntry(shard->hash, name, userdata, true);
+    virMutexUnlock(&shard->lock);
 
     return ret;
 }
@@ -423,18 +1111,21 @@ virHashAtomicUpdate(virHashAtomicPtr table,
 void *
 virHashLookup(const virHashTable *table, const void *name)
 {
-    size_t key;
-    virHashEntryPtr entry;
+    virHashEntryPtr *nextptr;
 
     if (!table || !name)
         return NULL;
 
-    key = virHashComputeKey(table, name);
-    for (entry = table->table[key]; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name))
-            return entry->payload;
+    if (table->slots) {
+        virHashSlotPtr slot;
+
+        slot = virHashOpenFind(table, name, table->keyCode(name, table->seed));
+        return slot ? slot->payload : NULL;
     }
-    return NULL;
+
+    if (!(nextptr = virHashFindEntry(table, name)))
+        return NULL;
+    return (*nextptr)->payload;
 }
 
 
@@ -464,11 +1155,12 @@ void *
 virHashAtomicSteal(virHashAtomicPtr table,
                    const void *name)
 {
+    virHashAtomicShardPtr shard = virHashAtomicGetShard(table, name);
     void *data;
 
-    virObjectLock(table);
-    data = virHashSteal(table->hash, name);
-    virObjectUnlock(table);
+    virMutexLock(&shard->lock);
+    data = virHashSteal(shard->hash, name);
+    virMutexUnlock(&shard->lock);
 
     return data;
 }
@@ -529,22 +1221,32 @@ virHashRemoveEntry(virHashTablePtr table, const void *name)
     if (table == NULL || name == NULL)
         return -1;
 
-    nextptr = table->table + virHashComputeKey(table, name);
-    for (entry = *nextptr; entry; entry = entry->next) {
-        if (table->keyEqual(entry->name, name)) {
-            if (table->dataFree)
-                table->dataFree(entry->payload, entry->name);
-            if (table->keyFree)
-                table->keyFree(entry->name);
-            *nextptr = entry->next;
-            VIR_FREE(entry);
-            table->nbElems--;
-            return 0;
-        }
-        nextptr = &entry->next;
+    if (table->slots) {
+        virHashSlotPtr slot;
+
+        if (!(slot = virHashOpenFind(table, name,
+                                     table->keyCode(name, table->seed))))
+            return -1;
+        virHashOpenRemoveSlot(table, slot);
+        virHashAccount(table, false);
+        return 0;
     }
 
-    return -1;
+    virHashRehashStep(table);
+
+    if (!(nextptr = virHashFindEntry(table, name)))
+        return -1;
+
+    entry = *nextptr;
+    if (table->dataFree)
+        table->dataFree(entry->payload, entry->name);
+    if (table->keyFree)
+        table->keyFree(entry->name);
+    *nextptr = entry->next;
+    VIR_FREE(entry);
+    table->nbElems--;
+    virHashAccount(table, false);
+    return 0;
 }
 
 
@@ -566,13 +1268,18 @@ int
 virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 {
     size_t i;
+    virHashEntryPtr *bucket;
     int ret = -1;
 
     if (table == NULL || iter == NULL)
         return -1;
 
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr entry = table->table[i];
+    if (table->slots)
+        return virHashOpenForEach(table, iter, data);
+
+    virAtomicIntInc(&table->iterators);
+    for (i = 0; (bucket = virHashBucket(table, i)); i++) {
+        virHashEntryPtr entry = *bucket;
         while (entry) {
             virHashEntryPtr next = entry->next;
             ret = iter(entry->payload, entry->name, data);
@@ -586,6 +1293,7 @@ virHashForEach(virHashTablePtr table, virHashIterator iter, void *data)
 
     ret = 0;
  cleanup:
+    ignore_value(virAtomicIntDecAndTest(&table->iterators));
     return ret;
 }
 
@@ -608,13 +1316,21 @@ virHashRemoveSet(virHashTablePtr table,
                  virHashSearcher iter,
                  const void *data)
 {
-    size_t i, count = 0;
+    size_t i;
+    ssize_t count = 0;
+    virHashEntryPtr *bucket;
 
     if (table == NULL || iter == NULL)
         return -1;
 
-    for (i = 0; i < table->size; i++) {
-        virHashEntryPtr *nextptr = table->table + i;
+    if (table->slots) {
+        count = virHashOpenRemoveSet(table, iter, data);
+        virHashAccount(table, false);
+        return count;
+    }
+
+    for (i = 0; (bucket = virHashBucket(table, i)); i++) {
+        virHashEntryPtr *nextptr = bucket;
 
         while (*nextptr) {
             virHashEntryPtr entry = *nextptr;
@@ -633,6 +1349,7 @@ virHashRemoveSet(virHashTablePtr table,
         }
     }
 
+    virHashAccount(table, false);
     return count;
 }
 
@@ -680,6 +1397,7 @@ void *virHashSearch(const virHashTable *ctable,
                     void **name)
 {
     size_t i;
+    virHashEntryPtr *bucket;
 
     /* Cast away const for internal detection of misuse.  */
     virHashTablePtr table = (virHashTablePtr)ctable;
@@ -687,9 +1405,12 @@ void *virHashSearch(const virHashTable *ctable,
     if (table == NULL || iter == NULL)
         return NULL;
 
-    for (i = 0; i < table->size; i++) {
+    if (table->slots)
+        return virHashOpenSearch(table, iter, data, name);
+
+    for (i = 0; (bucket = virHashBucket(table, i)); i++) {
         virHashEntryPtr entry;
-        for (entry = table->table[i]; entry; entry = entry->next) {
+        for (entry = *bucket; entry; entry = entry->next) {
             if (iter(entry->payload, entry->name, data)) {
                 if (name)
                     *name = table->keyCopy(entry->name);
@@ -107,8 +107,13 @@ typedef void (*virHashKeyFree)(void *name);
  */
 virHashTablePtr virHashCreate(ssize_t size,
                               virHashDataFree dataFree);
+virHashTablePtr virHashCreateOpen(ssize_t size,
+                                  virHashDataFree dataFree);
 virHashAtomicPtr virHashAtomicNew(ssize_t size,
                                   virHashDataFree dataFree);
+virHashAtomicPtr virHashAtomicNewSharded(ssize_t size,
+                                         size_t nshards,
+                                         virHashDataFree dataFree);
 virHashTablePtr virHashCreateFull(ssize_t size,
                                   virHashDataFree dataFree,
                                   virHashKeyCode keyCode,
@@ -118,6 +123,9 @@ virHashTablePtr virHashCreateFull(ssize_t size,
 void virHashFree(virHashTablePtr table);
 ssize_t virHashSize(const virHashTable *table);
 ssize_t virHashTableSize(const virHashTable *table);
+void virHashGetUsage(size_t *tables,
+                     size_t *entries,
+                     unsigned long long *bytes);
 
 /*
  * Add a new entry to the hash table.
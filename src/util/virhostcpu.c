@@ -53,6 +53,7 @@
 #include "virstring.h"
 #include "virnuma.h"
 #include "virlog.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -192,11 +193,12 @@ virHostCPUGetStatsFreeBSD(int cpuNum,
 #ifdef __linux__
 # define CPUINFO_PATH "/proc/cpuinfo"
 # define PROCSTAT_PATH "/proc/stat"
+# define PROC_IRQ_PATH "/proc/irq"
 
 # define LINUX_NB_CPU_STATS 4
 
-int
-virHostCPUGetSocket(unsigned int cpu, unsigned int *socket)
+static int
+virHostCPUReadSocket(unsigned int cpu, unsigned int *socket)
 {
     int tmp;
     int ret = virFileReadValueInt(&tmp,
@@ -220,8 +222,8 @@ virHostCPUGetSocket(unsigned int cpu, unsigned int *socket)
     return 0;
 }
 
-int
-virHostCPUGetCore(unsigned int cpu, unsigned int *core)
+static int
+virHostCPUReadCore(unsigned int cpu, unsigned int *core)
 {
     int ret = virFileReadValueUint(core,
                                    "%s/cpu/cpu%u/topology/core_id",
@@ -236,8 +238,8 @@ virHostCPUGetCore(unsigned int cpu, unsigned int *core)
     return 0;
 }
 
-virBitmapPtr
-virHostCPUGetSiblingsList(unsigned int cpu)
+static virBitmapPtr
+virHostCPUReadSiblingsList(unsigned int cpu)
 {
     virBitmapPtr ret = NULL;
     int rv = -1;
@@ -255,13 +257,220 @@ virHostCPUGetSiblingsList(unsigned int cpu)
     return ret;
 }
 
+
+/*
+ * The host CPU topology is walked by every capabilities refresh and every
+ * node info query, and each CPU costs several sysfs reads.  The topology
+ * only changes on CPU or memory hotplug, so it is read once and kept here
+ * until either virHostCPUInvalidateTopologyCache() is called (the node
+ * device driver does so for udev events of the cpu and memory subsystems)
+ * or the list of online CPUs no longer matches the one the cache was built
+ * for, which catches hotplug even without udev.
+ */
+typedef struct _virHostCPUCacheEntry virHostCPUCacheEntry;
+typedef virHostCPUCacheEntry *virHostCPUCacheEntryPtr;
+struct _virHostCPUCacheEntry {
+    bool valid;
+    unsigned int socket;
+    unsigned int core;
+    virBitmapPtr siblings;
+};
+
+static virMutex virHostCPUCacheLock;
+static char *virHostCPUCacheOnline;
+static virHostCPUCacheEntryPtr virHostCPUCacheCPUs;
+static size_t virHostCPUCacheNCPUs;
+
+static bool virHostCPUCacheInfoValid;
+static virArch virHostCPUCacheInfoArch;
+static unsigned int virHostCPUCacheInfoCPUs;
+static unsigned int virHostCPUCacheInfoMHz;
+static unsigned int virHostCPUCacheInfoNodes;
+static unsigned int virHostCPUCacheInfoSockets;
+static unsigned int virHostCPUCacheInfoCores;
+static unsigned int virHostCPUCacheInfoThreads;
+
+static int
+virHostCPUCacheOnceInit(void)
+{
+    if (virMutexInit(&virHostCPUCacheLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize host CPU cache mutex"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virHostCPUCache)
+
+
+static void
+virHostCPUCacheResetLocked(void)
+{
+    size_t i;
+
+    for (i = 0; i < virHostCPUCacheNCPUs; i++)
+        virBitmapFree(virHostCPUCacheCPUs[i].siblings);
+    VIR_FREE(virHostCPUCacheCPUs);
+    virHostCPUCacheNCPUs = 0;
+    VIR_FREE(virHostCPUCacheOnline);
+    virHostCPUCacheInfoValid = false;
+}
+
+
+/* Drop the cache if the set of online CPUs changed since it was built.
+ * Returns true if the cache can be used, false if the online CPUs can't
+ * be determined and the caller has to read sysfs directly. */
+static bool
+virHostCPUCacheValidateLocked(void)
+{
+    char *online = NULL;
+
+    if (virFileReadAllQuiet(SYSFS_SYSTEM_PATH "/cpu/online",
+                            8 * 1024, &online) < 0) {
+        virHostCPUCacheResetLocked();
+        return false;
+    }
+
+    if (STRNEQ_NULLABLE(online, virHostCPUCacheOnline)) {
+        if (virHostCPUCacheOnline)
+            VIR_DEBUG("Online host CPUs changed, dropping topology cache");
+        virHostCPUCacheResetLocked();
+        virHostCPUCacheOnline = online;
+    } else {
+        VIR_FREE(online);
+    }
+
+    return true;
+}
+
+
+/* Returns 1 and fills @entry if the topology of @cpu is cached, 0 if the
+ * cache can't be used, -1 on error. */
+static int
+virHostCPUCacheLookupLocked(unsigned int cpu,
+                            virHostCPUCacheEntryPtr *entry)
+{
+    virHostCPUCacheEntryPtr tmp;
+
+    if (!virHostCPUCacheValidateLocked())
+        return 0;
+
+    if (cpu >= virHostCPUCacheNCPUs &&
+        VIR_EXPAND_N(virHostCPUCacheCPUs, virHostCPUCacheNCPUs,
+                     cpu + 1 - virHostCPUCacheNCPUs) < 0)
+        return -1;
+
+    tmp = &virHostCPUCacheCPUs[cpu];
+
+    if (!tmp->valid) {
+        if (virHostCPUReadSocket(cpu, &tmp->socket) < 0 ||
+            virHostCPUReadCore(cpu, &tmp->core) < 0)
+            return -1;
+
+        virBitmapFree(tmp->siblings);
+        if (!(tmp->siblings = virHostCPUReadSiblingsList(cpu)))
+            return -1;
+
+        tmp->valid = true;
+    }
+
+    *entry = tmp;
+    return 1;
+}
+
+
+int
+virHostCPUGetSocket(unsigned int cpu, unsigned int *socket)
+{
+    virHostCPUCacheEntryPtr entry = NULL;
+    int ret = -1;
+    int rc;
+
+    if (virHostCPUCacheInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virHostCPUCacheLock);
+
+    if ((rc = virHostCPUCacheLookupLocked(cpu, &entry)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        ret = virHostCPUReadSocket(cpu, socket);
+        goto cleanup;
+    }
+
+    *socket = entry->socket;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virHostCPUCacheLock);
+    return ret;
+}
+
+
+int
+virHostCPUGetCore(unsigned int cpu, unsigned int *core)
+{
+    virHostCPUCacheEntryPtr entry = NULL;
+    int ret = -1;
+    int rc;
+
+    if (virHostCPUCacheInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virHostCPUCacheLock);
+
+    if ((rc = virHostCPUCacheLookupLocked(cpu, &entry)) < 0)
+        goto cleanup;
+
+    if (rc == 0) {
+        ret = virHostCPUReadCore(cpu, core);
+        goto cleanup;
+    }
+
+    *core = entry->core;
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virHostCPUCacheLock);
+    return ret;
+}
+
+
+virBitmapPtr
+virHostCPUGetSiblingsList(unsigned int cpu)
+{
+    virHostCPUCacheEntryPtr entry = NULL;
+    virBitmapPtr ret = NULL;
+    int rc;
+
+    if (virHostCPUCacheInitialize() < 0)
+        return NULL;
+
+    virMutexLock(&virHostCPUCacheLock);
+
+    if ((rc = virHostCPUCacheLookupLocked(cpu, &entry)) < 0)
+        goto cleanup;
+
+    if (rc == 0)
+        ret = virHostCPUReadSiblingsList(cpu);
+    else
+        ret = virBitmapNewCopy(entry->siblings);
+
+ cleanup:
+    virMutexUnlock(&virHostCPUCacheLock);
+    return ret;
+}
+
 static unsigned long
 virHostCPUCountThreadSiblings(unsigned int cpu)
 {
     virBitmapPtr siblings_map;
     unsigned long ret = 0;
 
-    if (!(siblings_map = virHostCPUGetSiblingsList(cpu)))
+    if (!(siblings_map = virHostCPUReadSiblingsList(cpu)))
         goto cleanup;
 
     ret = virBitmapCountBits(siblings_map);
@@ -333,7 +542,7 @@ virHostCPUParseNode(const char *node,
         if (!virBitmapIsBitSet(online_cpus_map, cpu))
             continue;
 
-        if (virHostCPUGetSocket(cpu, &sock) < 0)
+        if (virHostCPUReadSocket(cpu, &sock) < 0)
             goto cleanup;
 
         if (virBitmapSetBitExpand(sockets_map, sock) < 0)
@@ -381,7 +590,7 @@ virHostCPUParseNode(const char *node,
 
         processors++;
 
-        if (virHostCPUGetSocket(cpu, &sock) < 0)
+        if (virHostCPUReadSocket(cpu, &sock) < 0)
             goto cleanup;
         if (!virBitmapIsBitSet(sockets_map, sock)) {
             virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
@@ -394,7 +603,7 @@ virHostCPUParseNode(const char *node,
             /* logical cpu is equivalent to a core on s390 */
             core = cpu;
         } else {
-            if (virHostCPUGetCore(cpu, &core) < 0)
+            if (virHostCPUReadCore(cpu, &core) < 0)
                 goto cleanup;
         }
 
@@ -921,12 +1130,32 @@ virHostCPUGetInfo(virArch hostarch ATTRIBUTE_UNUSED,
 {
 #ifdef __linux__
     int ret = -1;
-    FILE *cpuinfo = fopen(CPUINFO_PATH, "r");
+    FILE *cpuinfo = NULL;
+    bool cacheable;
 
-    if (!cpuinfo) {
+    if (virHostCPUCacheInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virHostCPUCacheLock);
+
+    cacheable = virHostCPUCacheValidateLocked();
+
+    if (cacheable && virHostCPUCacheInfoValid &&
+        virHostCPUCacheInfoArch == hostarch) {
+        *cpus = virHostCPUCacheInfoCPUs;
+        *mhz = virHostCPUCacheInfoMHz;
+        *nodes = virHostCPUCacheInfoNodes;
+        *sockets = virHostCPUCacheInfoSockets;
+        *cores = virHostCPUCacheInfoCores;
+        *threads = virHostCPUCacheInfoThreads;
+        ret = 0;
+        goto cleanup;
+    }
+
+    if (!(cpuinfo = fopen(CPUINFO_PATH, "r"))) {
         virReportSystemError(errno,
                              _("cannot open %s"), CPUINFO_PATH);
-        return -1;
+        goto cleanup;
     }
 
     ret = virHostCPUGetInfoPopulateLinux(cpuinfo, hostarch,
@@ -935,7 +1164,19 @@ virHostCPUGetInfo(virArch hostarch ATTRIBUTE_UNUSED,
     if (ret < 0)
         goto cleanup;
 
+    if (cacheable) {
+        virHostCPUCacheInfoValid = true;
+        virHostCPUCacheInfoArch = hostarch;
+        virHostCPUCacheInfoCPUs = *cpus;
+        virHostCPUCacheInfoMHz = *mhz;
+        virHostCPUCacheInfoNodes = *nodes;
+        virHostCPUCacheInfoSockets = *sockets;
+        virHostCPUCacheInfoCores = *cores;
+        virHostCPUCacheInfoThreads = *threads;
+    }
+
  cleanup:
+    virMutexUnlock(&virHostCPUCacheLock);
     VIR_FORCE_FCLOSE(cpuinfo);
     return ret;
 #elif defined(__FreeBSD__) || defined(__APPLE__)
@@ -1255,3 +1496,113 @@ virHostCPUGetMicrocodeVersion(void)
 }
 
 #endif /* __linux__ */
+
+
+/**
+ * virHostCPUMoveIRQs:
+ * @cpus: host CPUs to move interrupts off
+ *
+ * Change the affinity of every host interrupt which may be delivered to
+ * any of @cpus so that it's delivered to the remaining CPUs only.
+ * Interrupts allowed on @cpus only and those the kernel doesn't allow to
+ * move (e.g. managed interrupts) are left alone.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virHostCPUMoveIRQs(virBitmapPtr cpus ATTRIBUTE_UNUSED)
+{
+#ifdef __linux__
+    DIR *dir = NULL;
+    struct dirent *ent;
+    virBitmapPtr affinity = NULL;
+    char *path = NULL;
+    char *str = NULL;
+    char ebuf[1024];
+    unsigned int irq;
+    size_t moved = 0;
+    int direrr;
+    int rc;
+    int ret = -1;
+
+    if (virDirOpen(&dir, PROC_IRQ_PATH) < 0)
+        return -1;
+
+    while ((direrr = virDirRead(dir, &ent, PROC_IRQ_PATH)) > 0) {
+        if (virStrToLong_ui(ent->d_name, NULL, 10, &irq) < 0)
+            continue;
+
+        virBitmapFree(affinity);
+        affinity = NULL;
+        VIR_FREE(path);
+        VIR_FREE(str);
+
+        if ((rc = virFileReadValueBitmap(&affinity, "%s/%u/smp_affinity_list",
+                                         PROC_IRQ_PATH, irq)) == -2)
+            continue;
+        if (rc < 0)
+            goto cleanup;
+
+        if (!virBitmapOverlaps(affinity, cpus))
+            continue;
+
+        virBitmapSubtract(affinity, cpus);
+        if (virBitmapIsAllClear(affinity)) {
+            VIR_DEBUG("IRQ %u is delivered to the given CPUs only", irq);
+            continue;
+        }
+
+        if (virAsprintf(&path, "%s/%u/smp_affinity_list",
+                        PROC_IRQ_PATH, irq) < 0 ||
+            !(str = virBitmapFormat(affinity)))
+            goto cleanup;
+
+        /* Managed and per-CPU interrupts refuse changes, that's fine */
+        if (virFileWriteStr(path, str, 0) < 0) {
+            VIR_DEBUG("Cannot change affinity of IRQ %u: %s",
+                      irq, virStrerror(errno, ebuf, sizeof(ebuf)));
+            continue;
+        }
+
+        moved++;
+    }
+    if (direrr < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Moved %zu IRQs", moved);
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    virBitmapFree(affinity);
+    VIR_FREE(path);
+    VIR_FREE(str);
+    return ret;
+#else
+    virReportSystemError(ENOSYS, "%s",
+                         _("changing IRQ affinity is not supported "
+                           "on this platform"));
+    return -1;
+#endif
+}
+
+
+/**
+ * virHostCPUInvalidateTopologyCache:
+ *
+ * Drop the cached host CPU topology, so that it's read again from sysfs
+ * the next time it's needed.  To be called whenever CPUs or memory were
+ * hotplugged or unplugged.
+ */
+void
+virHostCPUInvalidateTopologyCache(void)
+{
+#ifdef __linux__
+    if (virHostCPUCacheInitialize() < 0)
+        return;
+
+    virMutexLock(&virHostCPUCacheLock);
+    virHostCPUCacheResetLocked();
+    virMutexUnlock(&virHostCPUCacheLock);
+#endif
+}
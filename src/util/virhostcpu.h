@@ -68,4 +68,8 @@ int virHostCPUGetOnline(unsigned int cpu, bool *online);
 
 unsigned int virHostCPUGetMicrocodeVersion(void);
 
+void virHostCPUInvalidateTopologyCache(void);
+
+int virHostCPUMoveIRQs(virBitmapPtr cpus);
+
 #endif /* __VIR_HOSTCPU_H__*/
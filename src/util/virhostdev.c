@@ -38,6 +38,7 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "virnetdev.h"
+#include "virthreadpool.h"
 #include "configmake.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -627,6 +628,177 @@ virHostdevRestoreNetConfig(virDomainHostdevDefPtr hostdev,
     }
 }
 
+
+typedef enum {
+    VIR_HOSTDEV_PCI_OP_DETACH,
+    VIR_HOSTDEV_PCI_OP_RESET,
+} virHostdevPCIOp;
+
+typedef struct _virHostdevPCIWork virHostdevPCIWork;
+typedef virHostdevPCIWork *virHostdevPCIWorkPtr;
+struct _virHostdevPCIWork {
+    virHostdevManagerPtr mgr;
+    virPCIDeviceListPtr pcidevs;
+    virHostdevPCIOp op;
+
+    size_t *group;      /* group each device in @pcidevs belongs to */
+    size_t ngroups;
+    bool *done;         /* devices @op succeeded on */
+};
+
+
+/*
+ * Devices in one group are processed serially, distinct groups in
+ * parallel. Devices sharing an IOMMU group can't be isolated from
+ * each other, and devices sharing a bus might be hit by the same
+ * secondary bus reset, so either condition merges groups.
+ */
+static int
+virHostdevPCIWorkGroup(virHostdevPCIWorkPtr work)
+{
+    size_t n = virPCIDeviceListCount(work->pcidevs);
+    VIR_AUTOFREE(int *) iommu = NULL;
+    size_t i;
+    size_t j;
+
+    if (VIR_ALLOC_N(iommu, n) < 0)
+        return -1;
+
+    for (i = 0; i < n; i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(work->pcidevs, i);
+        virPCIDeviceAddressPtr addr = virPCIDeviceGetAddress(pci);
+
+        /* -2 means there's no IOMMU group, rely on the bus then */
+        if ((iommu[i] = virPCIDeviceAddressGetIOMMUGroupNum(addr)) == -1)
+            return -1;
+
+        for (j = 0; j < i; j++) {
+            virPCIDevicePtr other = virPCIDeviceListGet(work->pcidevs, j);
+            virPCIDeviceAddressPtr otherAddr = virPCIDeviceGetAddress(other);
+
+            if ((iommu[i] >= 0 && iommu[i] == iommu[j]) ||
+                (addr->domain == otherAddr->domain &&
+                 addr->bus == otherAddr->bus))
+                break;
+        }
+
+        if (j < i)
+            work->group[i] = work->group[j];
+        else
+            work->group[i] = work->ngroups++;
+    }
+
+    return 0;
+}
+
+
+static int
+virHostdevPCIRunGroup(size_t g,
+                      void *opaque)
+{
+    virHostdevPCIWorkPtr work = opaque;
+    size_t n = virPCIDeviceListCount(work->pcidevs);
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(work->pcidevs, i);
+        int rc = 0;
+
+        if (work->group[i] != g)
+            continue;
+
+        switch (work->op) {
+        case VIR_HOSTDEV_PCI_OP_DETACH:
+            if (!virPCIDeviceGetManaged(pci))
+                continue;
+
+            /* The bookkeeping lists are not touched here, the
+             * caller updates them once all workers are done */
+            VIR_DEBUG("Detaching managed PCI device %s",
+                      virPCIDeviceGetName(pci));
+            rc = virPCIDeviceDetach(pci, NULL, NULL);
+            break;
+
+        case VIR_HOSTDEV_PCI_OP_RESET:
+            /* We can avoid looking up the actual device here, because
+             * performing a PCI reset on a device doesn't require any
+             * information other than the address, which 'pci' already
+             * contains. The lists are only read, and the caller holds
+             * their locks for us. */
+            VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
+            rc = virPCIDeviceReset(pci, work->mgr->activePCIHostdevs,
+                                   work->mgr->inactivePCIHostdevs);
+            break;
+        }
+
+        if (rc < 0)
+            return -1;
+
+        work->done[i] = true;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Run @op on all devices in @pcidevs, spreading the work across
+ * several threads where the devices are independent of each other.
+ * On return, @done tells which devices @op succeeded on, even on
+ * failure.
+ *
+ * Pre-condition: inactivePCIHostdevs & activePCIHostdevs
+ * are locked
+ *
+ * Returns 0 on success, -1 with an error reported if @op failed on
+ * any of the devices.
+ */
+static int
+virHostdevPCIRunParallel(virHostdevManagerPtr mgr,
+                         virPCIDeviceListPtr pcidevs,
+                         virHostdevPCIOp op,
+                         bool *done)
+{
+    size_t n = virPCIDeviceListCount(pcidevs);
+    virHostdevPCIWork work = {
+        .mgr = mgr, .pcidevs = pcidevs, .op = op, .done = done,
+    };
+    VIR_AUTOFREE(virErrorPtr *) errs = NULL;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(work.group, n) < 0 ||
+        VIR_ALLOC_N(errs, n) < 0)
+        goto cleanup;
+
+    if (virHostdevPCIWorkGroup(&work) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Processing %zu PCI devices in %zu groups", n, work.ngroups);
+
+    if (virThreadParallelRun(work.ngroups, virHostdevPCIRunGroup,
+                             &work, errs) < 0)
+        goto cleanup;
+
+    ret = 0;
+    for (i = 0; i < work.ngroups; i++) {
+        if (!errs[i])
+            continue;
+
+        if (ret == 0) {
+            virErrorRestore(&errs[i]);
+            ret = -1;
+        } else {
+            virFreeError(errs[i]);
+        }
+    }
+
+ cleanup:
+    VIR_FREE(work.group);
+    return ret;
+}
+
+
 int
 virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
                             const char *drv_name,
@@ -641,6 +813,8 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
     size_t i;
     int ret = -1;
     virPCIDeviceAddressPtr devAddr = NULL;
+    VIR_AUTOFREE(bool *) done = NULL;
+    int rc;
 
     if (!nhostdevs)
         return 0;
@@ -710,22 +884,39 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
 
     /* Step 2: detach managed devices and make sure unmanaged devices
      *         have already been taken care of */
+    if (VIR_ALLOC_N(done, virPCIDeviceListCount(pcidevs)) < 0)
+        goto cleanup;
+
+    /* Binding to the stub driver can take a while, so managed devices
+     * are detached in parallel; none of them is active, as checked in
+     * step 1 */
+    rc = virHostdevPCIRunParallel(mgr, pcidevs,
+                                  VIR_HOSTDEV_PCI_OP_DETACH, done);
+
+    /* We can't look up the actual device because it has not been
+     * created yet: insert a copy of 'pci' into the list of inactive
+     * devices, and that copy will be the actual device going forward.
+     * This has to happen for every device detached above, even if some
+     * other failed, so that they are reattached below */
     for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
         virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
 
-        if (virPCIDeviceGetManaged(pci)) {
+        if (!done[i] || virPCIDeviceListFind(mgr->inactivePCIHostdevs, pci))
+            continue;
 
-            /* We can't look up the actual device because it has not been
-             * created yet: virPCIDeviceDetach() will insert a copy of 'pci'
-             * into the list of inactive devices, and that copy will be the
-             * actual device going forward */
-            VIR_DEBUG("Detaching managed PCI device %s",
-                      virPCIDeviceGetName(pci));
-            if (virPCIDeviceDetach(pci,
-                                   mgr->activePCIHostdevs,
-                                   mgr->inactivePCIHostdevs) < 0)
-                goto reattachdevs;
-        } else {
+        VIR_DEBUG("Adding PCI device %s to inactive list",
+                  virPCIDeviceGetName(pci));
+        if (virPCIDeviceListAddCopy(mgr->inactivePCIHostdevs, pci) < 0)
+            rc = -1;
+    }
+
+    if (rc < 0)
+        goto reattachdevs;
+
+    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
+        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
+
+        if (!virPCIDeviceGetManaged(pci)) {
             VIR_AUTOFREE(char *) driverPath = NULL;
             VIR_AUTOFREE(char *) driverName = NULL;
             int stub;
@@ -778,18 +969,11 @@ virHostdevPreparePCIDevices(virHostdevManagerPtr mgr,
      * been marked as inactive */
 
     /* Step 3: Now that all the PCI hostdevs have been detached, we
-     * can safely reset them */
-    for (i = 0; i < virPCIDeviceListCount(pcidevs); i++) {
-        virPCIDevicePtr pci = virPCIDeviceListGet(pcidevs, i);
-
-        /* We can avoid looking up the actual device here, because performing
-         * a PCI reset on a device doesn't require any information other than
-         * the address, which 'pci' already contains */
-        VIR_DEBUG("Resetting PCI device %s", virPCIDeviceGetName(pci));
-        if (virPCIDeviceReset(pci, mgr->activePCIHostdevs,
-                              mgr->inactivePCIHostdevs) < 0)
-            goto reattachdevs;
-    }
+     * can safely reset them, again in parallel where possible */
+    memset(done, 0, sizeof(*done) * virPCIDeviceListCount(pcidevs));
+    if (virHostdevPCIRunParallel(mgr, pcidevs,
+                                 VIR_HOSTDEV_PCI_OP_RESET, done) < 0)
+        goto reattachdevs;
 
     /* Step 4: For SRIOV network devices, Now that we have detached the
      * the network device, set the new netdev config */
@@ -24,7 +24,8 @@
 
 #include <regex.h>
 
-#include "viriscsi.h"
+#define __VIR_ISCSI_PRIV_H_ALLOW__
+#include "viriscsipriv.h"
 
 #include "viralloc.h"
 #include "vircommand.h"
@@ -38,6 +39,9 @@
 
 VIR_LOG_INIT("util.iscsi");
 
+#define ISCSI_SESSION_SYSFS "/sys/class/iscsi_session"
+#define SCSI_HOST_SYSFS "/sys/class/scsi_host"
+
 
 static int
 virISCSIScanTargetsInternal(const char *portal,
@@ -66,9 +70,72 @@ virISCSIExtractSession(char **const groups,
 }
 
 
+/* virISCSIGetSessionSysfs:
+ * @sysfs_prefix: sysfs path of the iSCSI sessions, NULL for the default
+ * @devpath: target IQN
+ * @session: filled with the session number, if found
+ *
+ * Looks up the session logged into @devpath in sysfs, which saves
+ * running iscsiadm for what is a few reads of sysfs attributes.
+ *
+ * Returns 1 if sysfs knows the iSCSI sessions (@session is NULL if
+ * none matches), 0 if the iSCSI transport class isn't there and the
+ * caller has to ask iscsiadm, -1 on error.
+ */
+static int
+virISCSIGetSessionSysfs(const char *sysfs_prefix,
+                        const char *devpath,
+                        char **session)
+{
+    const char *prefix = sysfs_prefix ? sysfs_prefix : ISCSI_SESSION_SYSFS;
+    DIR *dir = NULL;
+    struct dirent *entry;
+    int direrr;
+    int ret = -1;
+
+    *session = NULL;
+
+    if (!virFileIsDir(prefix))
+        return 0;
+
+    if (virDirOpen(&dir, prefix) < 0)
+        return -1;
+
+    while ((direrr = virDirRead(dir, &entry, prefix)) > 0) {
+        VIR_AUTOFREE(char *) target = NULL;
+
+        if (!STRPREFIX(entry->d_name, "session"))
+            continue;
+
+        if (virFileReadValueString(&target, "%s/%s/targetname",
+                                   prefix, entry->d_name) < 0) {
+            /* the session may have gone away meanwhile */
+            virResetLastError();
+            continue;
+        }
+
+        if (STREQ(target, devpath)) {
+            if (VIR_STRDUP(*session, entry->d_name + strlen("session")) < 0)
+                goto cleanup;
+            break;
+        }
+    }
+    if (direrr < 0)
+        goto cleanup;
+
+    VIR_DEBUG("sysfs session for '%s': %s", devpath, NULLSTR(*session));
+    ret = 1;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
 char *
-virISCSIGetSession(const char *devpath,
-                   bool probe)
+virISCSIGetSessionInternal(const char *sysfs_prefix,
+                           const char *devpath,
+                           bool probe)
 {
     /*
      * # iscsiadm --mode session
@@ -88,10 +155,23 @@ virISCSIGetSession(const char *devpath,
         .devpath = devpath,
     };
     int exitstatus = 0;
+    int rc;
     VIR_AUTOFREE(char *) error = NULL;
+    VIR_AUTOPTR(virCommand) cmd = NULL;
 
-    VIR_AUTOPTR(virCommand) cmd = virCommandNewArgList(ISCSIADM, "--mode",
-                                                       "session", NULL);
+    if ((rc = virISCSIGetSessionSysfs(sysfs_prefix, devpath,
+                                      &cbdata.session)) < 0)
+        return NULL;
+
+    if (rc > 0) {
+        if (!cbdata.session && !probe)
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("cannot find iSCSI session for target '%s'"),
+                           devpath);
+        return cbdata.session;
+    }
+
+    cmd = virCommandNewArgList(ISCSIADM, "--mode", "session", NULL);
     virCommandSetErrorBuffer(cmd, &error);
 
     if (virCommandRunRegex(cmd,
@@ -111,6 +191,14 @@ virISCSIGetSession(const char *devpath,
 }
 
 
+char *
+virISCSIGetSession(const char *devpath,
+                   bool probe)
+{
+    return virISCSIGetSessionInternal(NULL, devpath, probe);
+}
+
+
 
 #define IQN_FOUND 1
 #define IQN_MISSING 0
@@ -346,14 +434,79 @@ virISCSIConnectionLogout(const char *portal,
 }
 
 
+/* virISCSIRescanLUNsSysfs:
+ * @session: session number
+ *
+ * Asks the SCSI midlayer to scan the LUNs of just the target behind
+ * @session by writing "<channel> <id> -" into the scan file of its
+ * SCSI host.
+ *
+ * Returns 1 if the scan was done, 0 if the caller has to fall back to
+ * iscsiadm.
+ */
+static int
+virISCSIRescanLUNsSysfs(const char *session)
+{
+    DIR *dir = NULL;
+    struct dirent *entry;
+    unsigned int host, channel, id;
+    bool found = false;
+    int ret = 0;
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) scan = NULL;
+    VIR_AUTOFREE(char *) value = NULL;
+
+    if (virAsprintf(&path, ISCSI_SESSION_SYSFS "/session%s/device",
+                    session) < 0)
+        goto cleanup;
+
+    if (!virFileIsDir(path) ||
+        virDirOpenQuiet(&dir, path) < 0)
+        goto cleanup;
+
+    while (virDirRead(dir, &entry, NULL) > 0) {
+        if (sscanf(entry->d_name, "target%u:%u:%u",
+                   &host, &channel, &id) == 3) {
+            found = true;
+            break;
+        }
+    }
+    if (!found)
+        goto cleanup;
+
+    if (virAsprintf(&scan, SCSI_HOST_SYSFS "/host%u/scan", host) < 0 ||
+        virAsprintf(&value, "%u %u -", channel, id) < 0)
+        goto cleanup;
+
+    VIR_DEBUG("Scanning '%s' with '%s'", scan, value);
+    if (virFileWriteStr(scan, value, 0) < 0) {
+        VIR_DEBUG("Unable to write '%s', errno=%d", scan, errno);
+        goto cleanup;
+    }
+
+    ret = 1;
+
+ cleanup:
+    /* any failure here just means iscsiadm has to do it */
+    virResetLastError();
+    VIR_DIR_CLOSE(dir);
+    return ret;
+}
+
+
 int
 virISCSIRescanLUNs(const char *session)
 {
-    VIR_AUTOPTR(virCommand) cmd = virCommandNewArgList(ISCSIADM,
-                                                       "--mode", "session",
-                                                       "-r", session,
-                                                       "-R",
-                                                       NULL);
+    VIR_AUTOPTR(virCommand) cmd = NULL;
+
+    if (virISCSIRescanLUNsSysfs(session) > 0)
+        return 0;
+
+    cmd = virCommandNewArgList(ISCSIADM,
+                               "--mode", "session",
+                               "-r", session,
+                               "-R",
+                               NULL);
     return virCommandRun(cmd, NULL);
 }
 
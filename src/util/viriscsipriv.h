@@ -0,0 +1,35 @@
+/*
+ * viriscsipriv.h: helper APIs for managing iSCSI (for testing only)
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_ISCSI_PRIV_H_ALLOW__
+# error "viriscsipriv.h may only be included by viriscsi.c or test suites"
+#endif
+
+#ifndef __VIR_ISCSI_PRIV_H__
+# define __VIR_ISCSI_PRIV_H__
+
+# include "viriscsi.h"
+
+char *
+virISCSIGetSessionInternal(const char *sysfs_prefix,
+                           const char *devpath,
+                           bool probe)
+    ATTRIBUTE_NONNULL(2);
+
+#endif /* __VIR_ISCSI_PRIV_H__ */
@@ -24,10 +24,16 @@
 #include <config.h>
 
 #include "virjson.h"
+#include "viratomic.h"
+#include "c-ctype.h"
 #include "virerror.h"
+#include "virhashcode.h"
 #include "virlog.h"
+#include "virrandom.h"
 #include "virstring.h"
+#include "virthread.h"
 #include "virutil.h"
+#include "intprops.h"
 
 #if WITH_YAJL
 # include <yajl/yajl_gen.h>
@@ -59,30 +65,103 @@ typedef virJSONObjectPair *virJSONObjectPairPtr;
 typedef struct _virJSONArray virJSONArray;
 typedef virJSONArray *virJSONArrayPtr;
 
+typedef struct _virJSONArenaChunk virJSONArenaChunk;
+typedef virJSONArenaChunk *virJSONArenaChunkPtr;
+
+typedef struct _virJSONArena virJSONArena;
+typedef virJSONArena *virJSONArenaPtr;
+
 
 struct _virJSONObjectPair {
-    char *key;
+    const char *key; /* interned unless allocated from an arena */
     virJSONValuePtr value;
 };
 
 struct _virJSONObject {
     size_t npairs;
     virJSONObjectPairPtr pairs;
+
+    /* Objects with many members get a hash index of their keys: an open
+     * addressing table of @nindex slots, each holding a position in
+     * @pairs plus one or 0 if empty. NULL for small objects. */
+    size_t nindex;
+    size_t *index;
 };
 
+#define VIR_JSON_OBJECT_INDEX_MIN 16
+
 struct _virJSONArray {
     size_t nvalues;
     virJSONValuePtr *values;
 };
 
+/* Trees parsed by virJSONValueFromStringArena have all their nodes,
+ * strings and member arrays carved out of a few big chunks owned by
+ * an arena. Only the root of such a tree and subtrees stolen from it
+ * hold a reference to the arena, which is released as a whole once
+ * the last of them is freed. Values which were created elsewhere and
+ * appended into an arena tree are tracked in @foreign to be freed
+ * along with the arena. */
+struct _virJSONArenaChunk {
+    virJSONArenaChunkPtr next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct _virJSONArena {
+    int refs;
+
+    /* Once the tree is handed out to the caller, allocations may
+     * come from any of the threads owning a part of it */
+    bool sealed;
+    virMutex lock;
+
+    size_t chunkSize;
+    virJSONArenaChunkPtr chunks;
+
+    size_t nforeign;
+    virJSONValuePtr *foreign;
+};
+
+/* Process wide usage of JSON values allocated individually and of
+ * arenas together with the memory of their chunks */
+static int virJSONUsageValues;
+static int virJSONUsageArenas;
+static int virJSONUsageArenaBytes;
+
+#define VIR_JSON_ARENA_CHUNK_MIN 4096
+#define VIR_JSON_ARENA_CHUNK_MAX (1024 * 1024)
+#define VIR_JSON_ARENA_ALIGN 8
+
+typedef enum {
+    VIR_JSON_NUMBER_TEXT = 0, /* only the textual form is known */
+    VIR_JSON_NUMBER_LONG,
+    VIR_JSON_NUMBER_ULONG,
+    VIR_JSON_NUMBER_DOUBLE,
+} virJSONNumberKind;
+
+typedef struct _virJSONNumber virJSONNumber;
+typedef virJSONNumber *virJSONNumberPtr;
+struct _virJSONNumber {
+    int kind; /* enum virJSONNumberKind */
+    char *str; /* textual form, formatted on demand for binary numbers */
+    union {
+        long long l;
+        unsigned long long ul;
+        double d;
+    } val;
+};
+
 struct _virJSONValue {
     int type; /* enum virJSONType */
+    virJSONArenaPtr arena; /* NULL unless the value lives in an arena */
 
     union {
         virJSONObject object;
         virJSONArray array;
         char *string;
-        char *number; /* int/float/etc format is context defined so we can't parse it here :-( */
+        virJSONNumber number;
         int boolean;
     } data;
 };
@@ -92,7 +171,7 @@ typedef struct _virJSONParserState virJSONParserState;
 typedef virJSONParserState *virJSONParserStatePtr;
 struct _virJSONParserState {
     virJSONValuePtr value;
-    char *key;
+    const char *key;
 };
 
 typedef struct _virJSONParser virJSONParser;
@@ -102,9 +181,413 @@ struct _virJSONParser {
     virJSONParserStatePtr state;
     size_t nstate;
     int wrap;
+    virJSONArenaPtr arena;
 };
 
 
+static virJSONArenaPtr
+virJSONArenaNew(size_t sizeHint)
+{
+    virJSONArenaPtr arena;
+
+    if (VIR_ALLOC(arena) < 0)
+        return NULL;
+
+    if (virMutexInit(&arena->lock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to init JSON arena mutex"));
+        VIR_FREE(arena);
+        return NULL;
+    }
+
+    arena->refs = 1;
+    arena->chunkSize = MIN(MAX(sizeHint, VIR_JSON_ARENA_CHUNK_MIN),
+                           VIR_JSON_ARENA_CHUNK_MAX);
+    virAtomicIntInc(&virJSONUsageArenas);
+
+    return arena;
+}
+
+
+static void
+virJSONArenaRef(virJSONArenaPtr arena)
+{
+    virAtomicIntInc(&arena->refs);
+}
+
+
+static void
+virJSONArenaUnref(virJSONArenaPtr arena)
+{
+    virJSONArenaChunkPtr chunk;
+    size_t i;
+
+    if (!virAtomicIntDecAndTest(&arena->refs))
+        return;
+
+    for (i = 0; i < arena->nforeign; i++)
+        virJSONValueFree(arena->foreign[i]);
+    VIR_FREE(arena->foreign);
+
+    while ((chunk = arena->chunks)) {
+        arena->chunks = chunk->next;
+        virAtomicIntAdd(&virJSONUsageArenaBytes,
+                        -(int)(sizeof(*chunk) + chunk->size));
+        VIR_FREE(chunk);
+    }
+    virAtomicIntAdd(&virJSONUsageArenas, -1);
+
+    virMutexDestroy(&arena->lock);
+    VIR_FREE(arena);
+}
+
+
+static void *
+virJSONArenaAlloc(virJSONArenaPtr arena,
+                  size_t size)
+{
+    virJSONArenaChunkPtr chunk;
+    void *ret = NULL;
+
+    size = VIR_ROUND_UP(size, VIR_JSON_ARENA_ALIGN);
+
+    if (arena->sealed)
+        virMutexLock(&arena->lock);
+
+    chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        size_t chunkSize = MAX(arena->chunkSize, size);
+
+        if (VIR_ALLOC_VAR(chunk, char, chunkSize) < 0)
+            goto cleanup;
+
+        chunk->size = chunkSize;
+        virAtomicIntAdd(&virJSONUsageArenaBytes,
+                        sizeof(*chunk) + chunkSize);
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+        arena->chunkSize = MIN(arena->chunkSize * 2, VIR_JSON_ARENA_CHUNK_MAX);
+    }
+
+    ret = chunk->data + chunk->used;
+    chunk->used += size;
+
+ cleanup:
+    if (arena->sealed)
+        virMutexUnlock(&arena->lock);
+    return ret;
+}
+
+
+static char *
+virJSONArenaStrndup(virJSONArenaPtr arena,
+                    const char *str,
+                    size_t len)
+{
+    char *ret;
+
+    if (!(ret = virJSONArenaAlloc(arena, len + 1)))
+        return NULL;
+
+    memcpy(ret, str, len);
+    ret[len] = '\0';
+    return ret;
+}
+
+
+static virJSONValuePtr
+virJSONArenaNewValue(virJSONArenaPtr arena,
+                     virJSONType type)
+{
+    virJSONValuePtr val;
+
+    if (!(val = virJSONArenaAlloc(arena, sizeof(*val))))
+        return NULL;
+
+    memset(val, 0, sizeof(*val));
+    val->type = type;
+    val->arena = arena;
+
+    return val;
+}
+
+
+/* Make room for one more element in an array of @count elements of
+ * @size bytes living in @arena. The capacity of such arrays is the
+ * power of two following @count, which has to be at least @count
+ * even after elements are removed in place. */
+static int
+virJSONArenaGrow(virJSONArenaPtr arena,
+                 void **ptr,
+                 size_t count,
+                 size_t size)
+{
+    void *tmp;
+
+    if (count && (count & (count - 1)))
+        return 0;
+
+    if (!(tmp = virJSONArenaAlloc(arena, size * (count ? count * 2 : 1))))
+        return -1;
+
+    if (count)
+        memcpy(tmp, *ptr, size * count);
+    *ptr = tmp;
+    return 0;
+}
+
+
+static int
+virJSONArenaAddForeign(virJSONArenaPtr arena,
+                       virJSONValuePtr value)
+{
+    int ret;
+
+    virMutexLock(&arena->lock);
+    ret = VIR_APPEND_ELEMENT(arena->foreign, arena->nforeign, value);
+    virMutexUnlock(&arena->lock);
+
+    return ret;
+}
+
+
+static void
+virJSONArenaRemoveForeign(virJSONArenaPtr arena,
+                          virJSONValuePtr value)
+{
+    size_t i;
+
+    virMutexLock(&arena->lock);
+    for (i = 0; i < arena->nforeign; i++) {
+        if (arena->foreign[i] == value) {
+            VIR_DELETE_ELEMENT(arena->foreign, i, arena->nforeign);
+            break;
+        }
+    }
+    virMutexUnlock(&arena->lock);
+}
+
+
+/* Account for @value being taken out of @container: a member of the
+ * same arena now keeps the arena alive on its own while foreign values
+ * are no longer freed by it */
+static void
+virJSONValueDetach(virJSONValuePtr container,
+                   virJSONValuePtr value)
+{
+    if (!container->arena || !value)
+        return;
+
+    if (value->arena == container->arena)
+        virJSONArenaRef(container->arena);
+    else
+        virJSONArenaRemoveForeign(container->arena, value);
+}
+
+
+/* Counterpart of virJSONValueDetach once @value was successfully put
+ * into @container */
+static void
+virJSONValueAdopt(virJSONValuePtr container,
+                  virJSONValuePtr value)
+{
+    if (container->arena && value->arena == container->arena)
+        virJSONArenaUnref(container->arena);
+}
+
+
+/* Lets @container free @value, returns -1 if that isn't possible */
+static int
+virJSONValueAdoptPrepare(virJSONValuePtr container,
+                         virJSONValuePtr value)
+{
+    if (!container->arena || value->arena == container->arena)
+        return 0;
+
+    return virJSONArenaAddForeign(container->arena, value);
+}
+
+
+static uint32_t virJSONObjectIndexSeed;
+
+static int
+virJSONObjectIndexOnceInit(void)
+{
+    virJSONObjectIndexSeed = virRandomBits(32);
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virJSONObjectIndex)
+
+
+static void
+virJSONObjectIndexFree(virJSONValuePtr object)
+{
+    if (!object->arena)
+        VIR_FREE(object->data.object.index);
+    object->data.object.index = NULL;
+    object->data.object.nindex = 0;
+}
+
+
+static void
+virJSONObjectIndexAdd(virJSONObjectPtr obj,
+                      size_t pos)
+{
+    size_t mask = obj->nindex - 1;
+    size_t slot = virHashCodeGen(obj->pairs[pos].key,
+                                 strlen(obj->pairs[pos].key),
+                                 virJSONObjectIndexSeed) & mask;
+
+    while (obj->index[slot])
+        slot = (slot + 1) & mask;
+
+    obj->index[slot] = pos + 1;
+}
+
+
+/* (Re)build the index of @object so that it fits @npairs members */
+static int
+virJSONObjectIndexBuild(virJSONValuePtr object,
+                        size_t npairs)
+{
+    virJSONObjectPtr obj = &object->data.object;
+    size_t nindex = VIR_JSON_OBJECT_INDEX_MIN * 2;
+    size_t *index;
+    size_t i;
+
+    if (virJSONObjectIndexInitialize() < 0)
+        return -1;
+
+    /* keep the table at most half full */
+    while (nindex < npairs * 2)
+        nindex *= 2;
+
+    if (object->arena) {
+        if (!(index = virJSONArenaAlloc(object->arena,
+                                        sizeof(*index) * nindex)))
+            return -1;
+        memset(index, 0, sizeof(*index) * nindex);
+    } else {
+        if (VIR_ALLOC_N(index, nindex) < 0)
+            return -1;
+    }
+
+    virJSONObjectIndexFree(object);
+    obj->index = index;
+    obj->nindex = nindex;
+
+    for (i = 0; i < obj->npairs; i++)
+        virJSONObjectIndexAdd(obj, i);
+
+    return 0;
+}
+
+
+static ssize_t
+virJSONValueObjectFindKey(virJSONValuePtr object,
+                          const char *key)
+{
+    virJSONObjectPtr obj = &object->data.object;
+    size_t i;
+
+    if (obj->index) {
+        size_t mask = obj->nindex - 1;
+        size_t slot = virHashCodeGen(key, strlen(key),
+                                     virJSONObjectIndexSeed) & mask;
+
+        for (; obj->index[slot]; slot = (slot + 1) & mask) {
+            if (STREQ(obj->pairs[obj->index[slot] - 1].key, key))
+                return obj->index[slot] - 1;
+        }
+
+        return -1;
+    }
+
+    for (i = 0; i < obj->npairs; i++) {
+        if (STREQ(obj->pairs[i].key, key))
+            return i;
+    }
+
+    return -1;
+}
+
+
+static int
+virJSONValueObjectInsert(virJSONValuePtr object,
+                         const char *key,
+                         virJSONValuePtr value)
+{
+    virJSONObjectPtr obj = &object->data.object;
+
+    if (object->arena) {
+        if (virJSONArenaGrow(object->arena, (void **)&obj->pairs,
+                             obj->npairs, sizeof(*obj->pairs)) < 0)
+            return -1;
+    } else {
+        if (VIR_REALLOC_N(obj->pairs, obj->npairs + 1) < 0)
+            return -1;
+    }
+
+    if (obj->npairs + 1 >= VIR_JSON_OBJECT_INDEX_MIN &&
+        (obj->npairs + 1) * 2 > obj->nindex &&
+        virJSONObjectIndexBuild(object, obj->npairs + 1) < 0)
+        return -1;
+
+    obj->pairs[obj->npairs].key = key;
+    obj->pairs[obj->npairs].value = value;
+    if (obj->index)
+        virJSONObjectIndexAdd(obj, obj->npairs);
+    obj->npairs++;
+
+    return 0;
+}
+
+
+static int
+virJSONValueArrayInsert(virJSONValuePtr array,
+                        virJSONValuePtr value)
+{
+    virJSONArrayPtr arr = &array->data.array;
+
+    if (array->arena) {
+        if (virJSONArenaGrow(array->arena, (void **)&arr->values,
+                             arr->nvalues, sizeof(*arr->values)) < 0)
+            return -1;
+    } else {
+        if (VIR_REALLOC_N(arr->values, arr->nvalues + 1) < 0)
+            return -1;
+    }
+
+    arr->values[arr->nvalues] = value;
+    arr->nvalues++;
+
+    return 0;
+}
+
+
+static void
+virJSONValueObjectDeletePair(virJSONValuePtr object,
+                             size_t i)
+{
+    if (object->arena) {
+        VIR_DELETE_ELEMENT_INPLACE(object->data.object.pairs, i,
+                                   object->data.object.npairs);
+    } else {
+        virStringInternRelease(object->data.object.pairs[i].key);
+        VIR_DELETE_ELEMENT(object->data.object.pairs, i,
+                           object->data.object.npairs);
+    }
+
+    /* the positions of the following members changed; lookups fall
+     * back to scanning the members if the index can't be rebuilt */
+    if (object->data.object.index &&
+        (object->data.object.npairs < VIR_JSON_OBJECT_INDEX_MIN ||
+         virJSONObjectIndexBuild(object, object->data.object.npairs) < 0))
+        virJSONObjectIndexFree(object);
+}
+
+
 virJSONType
 virJSONValueGetType(const virJSONValue *value)
 {
@@ -402,6 +885,45 @@ virJSONValueObjectCreate(virJSONValuePtr *obj, ...)
 }
 
 
+/**
+ * virJSONValueGetUsage:
+ * @values: filled with the number of JSON values allocated individually
+ * @arenas: filled with the number of arenas holding parsed trees
+ * @bytes: filled with the approximate memory used by both
+ *
+ * Reports how much memory the JSON values of this process use. For
+ * individually allocated values only the value structs themselves are
+ * accounted, not the strings and arrays they point to.
+ */
+void
+virJSONValueGetUsage(size_t *values,
+                     size_t *arenas,
+                     unsigned long long *bytes)
+{
+    int nvalues = virAtomicIntGet(&virJSONUsageValues);
+
+    *values = nvalues;
+    *arenas = virAtomicIntGet(&virJSONUsageArenas);
+    *bytes = (unsigned long long)nvalues * sizeof(virJSONValue) +
+        virAtomicIntGet(&virJSONUsageArenaBytes);
+}
+
+
+static virJSONValuePtr
+virJSONValueAlloc(virJSONType type)
+{
+    virJSONValuePtr val;
+
+    if (VIR_ALLOC(val) < 0)
+        return NULL;
+
+    val->type = type;
+    virAtomicIntInc(&virJSONUsageValues);
+
+    return val;
+}
+
+
 void
 virJSONValueFree(virJSONValuePtr value)
 {
@@ -409,13 +931,20 @@ virJSONValueFree(virJSONValuePtr value)
     if (!value)
         return;
 
+    /* the whole tree goes away with the arena */
+    if (value->arena) {
+        virJSONArenaUnref(value->arena);
+        return;
+    }
+
     switch ((virJSONType) value->type) {
     case VIR_JSON_TYPE_OBJECT:
         for (i = 0; i < value->data.object.npairs; i++) {
-            VIR_FREE(value->data.object.pairs[i].key);
+            virStringInternRelease(value->data.object.pairs[i].key);
             virJSONValueFree(value->data.object.pairs[i].value);
         }
         VIR_FREE(value->data.object.pairs);
+        VIR_FREE(value->data.object.index);
         break;
     case VIR_JSON_TYPE_ARRAY:
         for (i = 0; i < value->data.array.nvalues; i++)
@@ -426,13 +955,14 @@ virJSONValueFree(virJSONValuePtr value)
         VIR_FREE(value->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        VIR_FREE(value->data.number);
+        VIR_FREE(value->data.number.str);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
     case VIR_JSON_TYPE_NULL:
         break;
     }
 
+    virAtomicIntAdd(&virJSONUsageValues, -1);
     VIR_FREE(value);
 }
 
@@ -453,12 +983,11 @@ virJSONValueNewString(const char *data)
     if (!data)
         return virJSONValueNewNull();
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_STRING)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_STRING;
     if (VIR_STRDUP(val->data.string, data) < 0) {
-        VIR_FREE(val);
+        virJSONValueFree(val);
         return NULL;
     }
 
@@ -475,12 +1004,11 @@ virJSONValueNewStringLen(const char *data,
     if (!data)
         return virJSONValueNewNull();
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_STRING)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_STRING;
     if (VIR_STRNDUP(val->data.string, data, length) < 0) {
-        VIR_FREE(val);
+        virJSONValueFree(val);
         return NULL;
     }
 
@@ -489,16 +1017,17 @@ virJSONValueNewStringLen(const char *data,
 
 
 static virJSONValuePtr
-virJSONValueNewNumber(const char *data)
+virJSONValueNewNumber(const virJSONNumber *number)
 {
     virJSONValuePtr val;
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_NUMBER)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_NUMBER;
-    if (VIR_STRDUP(val->data.number, data) < 0) {
-        VIR_FREE(val);
+    val->data.number.kind = number->kind;
+    val->data.number.val = number->val;
+    if (VIR_STRDUP(val->data.number.str, number->str) < 0) {
+        virJSONValueFree(val);
         return NULL;
     }
 
@@ -509,62 +1038,195 @@ virJSONValueNewNumber(const char *data)
 virJSONValuePtr
 virJSONValueNewNumberInt(int data)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    if (virAsprintf(&str, "%i", data) < 0)
-        return NULL;
-    return virJSONValueNewNumber(str);
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_LONG, .val.l = data };
+
+    return virJSONValueNewNumber(&number);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberUint(unsigned int data)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    if (virAsprintf(&str, "%u", data) < 0)
-        return NULL;
-    return virJSONValueNewNumber(str);
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_LONG, .val.l = data };
+
+    return virJSONValueNewNumber(&number);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberLong(long long data)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    if (virAsprintf(&str, "%lld", data) < 0)
-        return NULL;
-    return virJSONValueNewNumber(str);
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_LONG, .val.l = data };
+
+    return virJSONValueNewNumber(&number);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberUlong(unsigned long long data)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    if (virAsprintf(&str, "%llu", data) < 0)
-        return NULL;
-    return virJSONValueNewNumber(str);
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_ULONG, .val.ul = data };
+
+    if (data <= LLONG_MAX) {
+        number.kind = VIR_JSON_NUMBER_LONG;
+        number.val.l = data;
+    }
+
+    return virJSONValueNewNumber(&number);
 }
 
 
 virJSONValuePtr
 virJSONValueNewNumberDouble(double data)
 {
-    VIR_AUTOFREE(char *) str = NULL;
-    if (virDoubleToStr(&str, data) < 0)
-        return NULL;
-    return virJSONValueNewNumber(str);
-}
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_DOUBLE, .val.d = data };
 
+    return virJSONValueNewNumber(&number);
+}
 
-virJSONValuePtr
-virJSONValueNewBoolean(int boolean_)
-{
-    virJSONValuePtr val;
 
-    if (VIR_ALLOC(val) < 0)
+/**
+ * virJSONNumberParseInteger:
+ * @str: textual form of a JSON number (not NUL terminated)
+ * @len: length of @str
+ * @number: filled with the binary form
+ *
+ * Numbers which are plain integers fitting into 64 bits are converted
+ * once and kept in binary form only since formatting them back yields
+ * the very same text. Anything else (fractions, exponents, "-0", huge
+ * values) is left for the caller to store as text.
+ *
+ * Returns 0 if @str was converted, -1 otherwise (no error is reported).
+ */
+static int
+virJSONNumberParseInteger(const char *str,
+                          size_t len,
+                          virJSONNumberPtr number)
+{
+    char buf[INT_BUFSIZE_BOUND(long long)];
+    size_t start = 0;
+    size_t i;
+
+    if (len >= sizeof(buf))
+        return -1;
+
+    if (len && str[0] == '-')
+        start = 1;
+
+    /* reject "-0" and leading zeros which would not survive formatting */
+    if (start == len ||
+        (str[start] == '0' && (start || len > 1)))
+        return -1;
+
+    for (i = start; i < len; i++) {
+        if (!c_isdigit(str[i]))
+            return -1;
+    }
+
+    memcpy(buf, str, len);
+    buf[len] = '\0';
+
+    memset(number, 0, sizeof(*number));
+    if (virStrToLong_ll(buf, NULL, 10, &number->val.l) == 0) {
+        number->kind = VIR_JSON_NUMBER_LONG;
+        return 0;
+    }
+
+    if (!start &&
+        virStrToLong_ull(buf, NULL, 10, &number->val.ul) == 0) {
+        number->kind = VIR_JSON_NUMBER_ULONG;
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/**
+ * virJSONValueNumberFormat:
+ * @value: JSON number
+ * @buf: scratch buffer
+ * @buflen: size of @buf, at least INT_BUFSIZE_BOUND(long long)
+ *
+ * Returns the textual form of @value. Integers are formatted into @buf
+ * unless a textual form is already known, other numbers get their
+ * textual form cached in @value. Returns NULL on OOM.
+ */
+static const char *
+virJSONValueNumberFormat(virJSONValuePtr value,
+                         char *buf,
+                         size_t buflen)
+{
+    virJSONNumberPtr number = &value->data.number;
+    char *str = NULL;
+
+    if (number->str)
+        return number->str;
+
+    switch ((virJSONNumberKind) number->kind) {
+    case VIR_JSON_NUMBER_LONG:
+        snprintf(buf, buflen, "%lld", number->val.l);
+        return buf;
+    case VIR_JSON_NUMBER_ULONG:
+        snprintf(buf, buflen, "%llu", number->val.ul);
+        return buf;
+    case VIR_JSON_NUMBER_DOUBLE:
+        if (virDoubleToStr(&str, number->val.d) < 0)
+            return NULL;
+        break;
+    case VIR_JSON_NUMBER_TEXT:
+        return NULL;
+    }
+
+    if (value->arena) {
+        number->str = virJSONArenaStrndup(value->arena, str, strlen(str));
+        VIR_FREE(str);
+    } else {
+        number->str = str;
+    }
+
+    return number->str;
+}
+
+
+/**
+ * virJSONValueNumberText:
+ * @value: JSON number
+ *
+ * Like virJSONValueNumberFormat, but the textual form is always cached
+ * in @value so that the returned string lives as long as @value does.
+ */
+static const char *
+virJSONValueNumberText(virJSONValuePtr value)
+{
+    virJSONNumberPtr number = &value->data.number;
+    char buf[INT_BUFSIZE_BOUND(long long)];
+    const char *str;
+
+    if (!(str = virJSONValueNumberFormat(value, buf, sizeof(buf))))
+        return NULL;
+
+    if (str != buf)
+        return str;
+
+    if (value->arena) {
+        number->str = virJSONArenaStrndup(value->arena, buf, strlen(buf));
+    } else {
+        ignore_value(VIR_STRDUP(number->str, buf));
+    }
+
+    return number->str;
+}
+
+
+virJSONValuePtr
+virJSONValueNewBoolean(int boolean_)
+{
+    virJSONValuePtr val;
+
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_BOOLEAN)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_BOOLEAN;
     val->data.boolean = boolean_;
 
     return val;
@@ -576,10 +1238,9 @@ virJSONValueNewNull(void)
 {
     virJSONValuePtr val;
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_NULL)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_NULL;
 
     return val;
 }
@@ -590,10 +1251,9 @@ virJSONValueNewArray(void)
 {
     virJSONValuePtr val;
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_ARRAY)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_ARRAY;
 
     return val;
 }
@@ -604,10 +1264,9 @@ virJSONValueNewObject(void)
 {
     virJSONValuePtr val;
 
-    if (VIR_ALLOC(val) < 0)
+    if (!(val = virJSONValueAlloc(VIR_JSON_TYPE_OBJECT)))
         return NULL;
 
-    val->type = VIR_JSON_TYPE_OBJECT;
 
     return val;
 }
@@ -618,7 +1277,7 @@ virJSONValueObjectAppend(virJSONValuePtr object,
                          const char *key,
                          virJSONValuePtr value)
 {
-    char *newkey;
+    const char *newkey;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
@@ -626,18 +1285,29 @@ virJSONValueObjectAppend(virJSONValuePtr object,
     if (virJSONValueObjectHasKey(object, key))
         return -1;
 
-    if (VIR_STRDUP(newkey, key) < 0)
+    if (object->arena) {
+        if (!(newkey = virJSONArenaStrndup(object->arena, key, strlen(key))))
+            return -1;
+    } else {
+        if (!(newkey = virStringIntern(key)))
+            return -1;
+    }
+
+    if (virJSONValueAdoptPrepare(object, value) < 0) {
+        if (!object->arena)
+            virStringInternRelease(newkey);
         return -1;
+    }
 
-    if (VIR_REALLOC_N(object->data.object.pairs,
-                      object->data.object.npairs + 1) < 0) {
-        VIR_FREE(newkey);
+    if (virJSONValueObjectInsert(object, newkey, value) < 0) {
+        if (object->arena)
+            virJSONArenaRemoveForeign(object->arena, value);
+        else
+            virStringInternRelease(newkey);
         return -1;
     }
 
-    object->data.object.pairs[object->data.object.npairs].key = newkey;
-    object->data.object.pairs[object->data.object.npairs].value = value;
-    object->data.object.npairs++;
+    virJSONValueAdopt(object, value);
 
     return 0;
 }
@@ -777,12 +1447,16 @@ virJSONValueArrayAppend(virJSONValuePtr array,
     if (array->type != VIR_JSON_TYPE_ARRAY)
         return -1;
 
-    if (VIR_REALLOC_N(array->data.array.values,
-                      array->data.array.nvalues + 1) < 0)
+    if (virJSONValueAdoptPrepare(array, value) < 0)
+        return -1;
+
+    if (virJSONValueArrayInsert(array, value) < 0) {
+        if (array->arena)
+            virJSONArenaRemoveForeign(array->arena, value);
         return -1;
+    }
 
-    array->data.array.values[array->data.array.nvalues] = value;
-    array->data.array.nvalues++;
+    virJSONValueAdopt(array, value);
 
     return 0;
 }
@@ -792,17 +1466,10 @@ int
 virJSONValueObjectHasKey(virJSONValuePtr object,
                          const char *key)
 {
-    size_t i;
-
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return 1;
-    }
-
-    return 0;
+    return virJSONValueObjectFindKey(object, key) >= 0;
 }
 
 
@@ -810,17 +1477,15 @@ virJSONValuePtr
 virJSONValueObjectGet(virJSONValuePtr object,
                       const char *key)
 {
-    size_t i;
+    ssize_t i;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key))
-            return object->data.object.pairs[i].value;
-    }
+    if ((i = virJSONValueObjectFindKey(object, key)) < 0)
+        return NULL;
 
-    return NULL;
+    return object->data.object.pairs[i].value;
 }
 
 
@@ -828,21 +1493,18 @@ static virJSONValuePtr
 virJSONValueObjectSteal(virJSONValuePtr object,
                         const char *key)
 {
-    size_t i;
+    ssize_t i;
     virJSONValuePtr obj = NULL;
 
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return NULL;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            VIR_STEAL_PTR(obj, object->data.object.pairs[i].value);
-            VIR_FREE(object->data.object.pairs[i].key);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            break;
-        }
-    }
+    if ((i = virJSONValueObjectFindKey(object, key)) < 0)
+        return NULL;
+
+    VIR_STEAL_PTR(obj, object->data.object.pairs[i].value);
+    virJSONValueObjectDeletePair(object, i);
+    virJSONValueDetach(object, obj);
 
     return obj;
 }
@@ -870,11 +1532,10 @@ virJSONValueObjectStealByType(virJSONValuePtr object,
                               const char *key,
                               virJSONType type)
 {
-    virJSONValuePtr value = virJSONValueObjectSteal(object, key);
+    if (!virJSONValueObjectGetByType(object, key, type))
+        return NULL;
 
-    if (value && value->type == type)
-        return value;
-    return NULL;
+    return virJSONValueObjectSteal(object, key);
 }
 
 
@@ -910,7 +1571,8 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
                             const char *key,
                             virJSONValuePtr *value)
 {
-    size_t i;
+    ssize_t i;
+    virJSONValuePtr val;
 
     if (value)
         *value = NULL;
@@ -918,21 +1580,19 @@ virJSONValueObjectRemoveKey(virJSONValuePtr object,
     if (object->type != VIR_JSON_TYPE_OBJECT)
         return -1;
 
-    for (i = 0; i < object->data.object.npairs; i++) {
-        if (STREQ(object->data.object.pairs[i].key, key)) {
-            if (value) {
-                *value = object->data.object.pairs[i].value;
-                object->data.object.pairs[i].value = NULL;
-            }
-            VIR_FREE(object->data.object.pairs[i].key);
-            virJSONValueFree(object->data.object.pairs[i].value);
-            VIR_DELETE_ELEMENT(object->data.object.pairs, i,
-                               object->data.object.npairs);
-            return 1;
-        }
-    }
+    if ((i = virJSONValueObjectFindKey(object, key)) < 0)
+        return 0;
 
-    return 0;
+    val = object->data.object.pairs[i].value;
+
+    virJSONValueObjectDeletePair(object, i);
+    virJSONValueDetach(object, val);
+
+    if (value)
+        *value = val;
+    else
+        virJSONValueFree(val);
+    return 1;
 }
 
 
@@ -1002,9 +1662,16 @@ virJSONValueArraySteal(virJSONValuePtr array,
 
     ret = array->data.array.values[element];
 
-    VIR_DELETE_ELEMENT(array->data.array.values,
-                       element,
-                       array->data.array.nvalues);
+    if (array->arena)
+        VIR_DELETE_ELEMENT_INPLACE(array->data.array.values,
+                                   element,
+                                   array->data.array.nvalues);
+    else
+        VIR_DELETE_ELEMENT(array->data.array.values,
+                           element,
+                           array->data.array.nvalues);
+
+    virJSONValueDetach(array, ret);
 
     return ret;
 }
@@ -1042,13 +1709,28 @@ virJSONValueArrayForeachSteal(virJSONValuePtr array,
         return -1;
 
     for (i = 0; i < array->data.array.nvalues; i++) {
-        if ((rc = cb(i, array->data.array.values[i], opaque)) < 0) {
+        virJSONValuePtr val = array->data.array.values[i];
+        bool nested = array->arena && val->arena == array->arena;
+
+        /* the callback may free the value right away, so members of the
+         * arena get their reference upfront */
+        if (nested)
+            virJSONArenaRef(array->arena);
+
+        rc = cb(i, val, opaque);
+
+        if (rc == 0) {
+            if (array->arena && !nested)
+                virJSONArenaRemoveForeign(array->arena, val);
+            array->data.array.values[i] = NULL;
+        } else if (nested) {
+            virJSONArenaUnref(array->arena);
+        }
+
+        if (rc < 0) {
             ret = -1;
             break;
         }
-
-        if (rc == 0)
-            array->data.array.values[i] = NULL;
     }
 
     /* condense the remaining entries at the beginning */
@@ -1081,18 +1763,39 @@ virJSONValueGetNumberString(virJSONValuePtr number)
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return NULL;
 
-    return number->data.number;
+    return virJSONValueNumberText(number);
 }
 
 
+/* The getters below convert binary numbers directly, following the
+ * semantics of the virStrToLong_* function used for textual ones. */
 int
 virJSONValueGetNumberInt(virJSONValuePtr number,
                          int *value)
 {
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_i(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        if (number->data.number.val.l < INT_MIN ||
+            number->data.number.val.l > INT_MAX)
+            return -1;
+        *value = number->data.number.val.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        return -1;
+    case VIR_JSON_NUMBER_DOUBLE:
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToLong_i(str, NULL, 10, value);
 }
 
 
@@ -1100,10 +1803,32 @@ int
 virJSONValueGetNumberUint(virJSONValuePtr number,
                           unsigned int *value)
 {
+    long long l;
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ui(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        l = number->data.number.val.l;
+        /* negative numbers wrap around like with virStrToLong_ui */
+        if ((l < 0 && -(unsigned long long) l > UINT_MAX) ||
+            l > UINT_MAX)
+            return -1;
+        *value = l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        return -1;
+    case VIR_JSON_NUMBER_DOUBLE:
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToLong_ui(str, NULL, 10, value);
 }
 
 
@@ -1111,10 +1836,26 @@ int
 virJSONValueGetNumberLong(virJSONValuePtr number,
                           long long *value)
 {
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ll(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        *value = number->data.number.val.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        return -1;
+    case VIR_JSON_NUMBER_DOUBLE:
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToLong_ll(str, NULL, 10, value);
 }
 
 
@@ -1122,10 +1863,58 @@ int
 virJSONValueGetNumberUlong(virJSONValuePtr number,
                            unsigned long long *value)
 {
+    const char *str;
+
+    if (number->type != VIR_JSON_TYPE_NUMBER)
+        return -1;
+
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        *value = number->data.number.val.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        *value = number->data.number.val.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToLong_ull(str, NULL, 10, value);
+}
+
+
+/* Like virJSONValueGetNumberUlong, but rejects negative numbers */
+static int
+virJSONValueGetNumberUlongp(virJSONValuePtr number,
+                            unsigned long long *value)
+{
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToLong_ull(number->data.number, NULL, 10, value);
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        if (number->data.number.val.l < 0)
+            return -1;
+        *value = number->data.number.val.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        *value = number->data.number.val.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToLong_ullp(str, NULL, 10, value);
 }
 
 
@@ -1133,10 +1922,29 @@ int
 virJSONValueGetNumberDouble(virJSONValuePtr number,
                             double *value)
 {
+    const char *str;
+
     if (number->type != VIR_JSON_TYPE_NUMBER)
         return -1;
 
-    return virStrToDouble(number->data.number, NULL, value);
+    switch ((virJSONNumberKind) number->data.number.kind) {
+    case VIR_JSON_NUMBER_LONG:
+        *value = number->data.number.val.l;
+        return 0;
+    case VIR_JSON_NUMBER_ULONG:
+        *value = number->data.number.val.ul;
+        return 0;
+    case VIR_JSON_NUMBER_DOUBLE:
+        *value = number->data.number.val.d;
+        return 0;
+    case VIR_JSON_NUMBER_TEXT:
+        break;
+    }
+
+    if (!(str = virJSONValueNumberText(number)))
+        return -1;
+
+    return virStrToDouble(str, NULL, value);
 }
 
 
@@ -1186,8 +1994,7 @@ virJSONValueGetArrayAsBitmap(const virJSONValue *val,
     for (i = 0; i < val->data.array.nvalues; i++) {
         elem = val->data.array.values[i];
 
-        if (elem->type != VIR_JSON_TYPE_NUMBER ||
-            virStrToLong_ullp(elem->data.number, NULL, 10, &elems[i]) < 0)
+        if (virJSONValueGetNumberUlongp(elem, &elems[i]) < 0)
             return -1;
 
         if (elems[i] > maxelem)
@@ -1276,7 +2083,7 @@ virJSONValueObjectGetStringOrNumber(virJSONValuePtr object,
     if (val->type == VIR_JSON_TYPE_STRING)
         return val->data.string;
     else if (val->type == VIR_JSON_TYPE_NUMBER)
-        return val->data.number;
+        return virJSONValueNumberText(val);
 
     return NULL;
 }
@@ -1441,6 +2248,128 @@ virJSONValueObjectForeachKeyValue(virJSONValuePtr object,
 }
 
 
+static int
+virJSONValueGetField(virJSONFieldPtr field,
+                     virJSONValuePtr value)
+{
+    const char *str;
+    virJSONType type;
+    int rc = 0;
+
+    switch (field->type) {
+    case VIR_JSON_FIELD_STRING:
+        if ((str = virJSONValueGetString(value)))
+            *(const char **)field->value = str;
+        else
+            rc = -1;
+        break;
+    case VIR_JSON_FIELD_INT:
+        rc = virJSONValueGetNumberInt(value, field->value);
+        break;
+    case VIR_JSON_FIELD_UINT:
+        rc = virJSONValueGetNumberUint(value, field->value);
+        break;
+    case VIR_JSON_FIELD_LONG:
+        rc = virJSONValueGetNumberLong(value, field->value);
+        break;
+    case VIR_JSON_FIELD_ULONG:
+        rc = virJSONValueGetNumberUlong(value, field->value);
+        break;
+    case VIR_JSON_FIELD_DOUBLE:
+        rc = virJSONValueGetNumberDouble(value, field->value);
+        break;
+    case VIR_JSON_FIELD_BOOLEAN:
+        rc = virJSONValueGetBoolean(value, field->value);
+        break;
+    case VIR_JSON_FIELD_OBJECT:
+    case VIR_JSON_FIELD_ARRAY:
+        type = field->type == VIR_JSON_FIELD_OBJECT ?
+               VIR_JSON_TYPE_OBJECT : VIR_JSON_TYPE_ARRAY;
+        if (value->type == type)
+            *(virJSONValuePtr *)field->value = value;
+        else
+            rc = -1;
+        break;
+    }
+
+    if (rc < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("JSON member '%s' has unexpected value"),
+                       field->key);
+        return -1;
+    }
+
+    field->found = true;
+    return 0;
+}
+
+
+/**
+ * virJSONValueObjectGetFields:
+ * @object: JSON object to read from
+ * @fields: array of fields to fill
+ * @nfields: number of entries in @fields
+ *
+ * Looks up all keys listed in @fields and stores their values converted
+ * to the requested type at the location each field points to, visiting
+ * the members of @object only once. The 'found' member of each field
+ * tells whether the key was present; values for missing keys are left
+ * untouched.
+ *
+ * Returns the number of fields found or -1 with an error reported if
+ * @object is not an object or one of the values can't be converted.
+ */
+int
+virJSONValueObjectGetFields(virJSONValuePtr object,
+                            virJSONFieldPtr fields,
+                            size_t nfields)
+{
+    virJSONObjectPtr obj = &object->data.object;
+    size_t i;
+    size_t j;
+    int found = 0;
+
+    for (j = 0; j < nfields; j++)
+        fields[j].found = false;
+
+    if (object->type != VIR_JSON_TYPE_OBJECT) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("JSON value is not an object"));
+        return -1;
+    }
+
+    /* with an index, direct lookups beat comparing every member */
+    if (obj->index) {
+        for (j = 0; j < nfields; j++) {
+            ssize_t pos = virJSONValueObjectFindKey(object, fields[j].key);
+
+            if (pos < 0)
+                continue;
+
+            if (virJSONValueGetField(&fields[j], obj->pairs[pos].value) < 0)
+                return -1;
+            found++;
+        }
+
+        return found;
+    }
+
+    for (i = 0; i < obj->npairs && found < nfields; i++) {
+        for (j = 0; j < nfields; j++) {
+            if (fields[j].found || STRNEQ(obj->pairs[i].key, fields[j].key))
+                continue;
+
+            if (virJSONValueGetField(&fields[j], obj->pairs[i].value) < 0)
+                return -1;
+            found++;
+            break;
+        }
+    }
+
+    return found;
+}
+
+
 virJSONValuePtr
 virJSONValueCopy(const virJSONValue *in)
 {
@@ -1486,7 +2415,7 @@ virJSONValueCopy(const virJSONValue *in)
         out = virJSONValueNewString(in->data.string);
         break;
     case VIR_JSON_TYPE_NUMBER:
-        out = virJSONValueNewNumber(in->data.number);
+        out = virJSONValueNewNumber(&in->data.number);
         break;
     case VIR_JSON_TYPE_BOOLEAN:
         out = virJSONValueNewBoolean(in->data.boolean);
@@ -1505,6 +2434,97 @@ virJSONValueCopy(const virJSONValue *in)
 
 
 #if WITH_YAJL
+/* Values created by the parser in arena mode go away with the arena
+ * in case of failure */
+static void
+virJSONParserFreeValue(virJSONParserPtr parser,
+                       virJSONValuePtr value)
+{
+    if (!parser->arena)
+        virJSONValueFree(value);
+}
+
+
+static void
+virJSONParserFreeKey(virJSONParserPtr parser,
+                     const char **key)
+{
+    if (!parser->arena)
+        virStringInternRelease(*key);
+    *key = NULL;
+}
+
+
+static virJSONValuePtr
+virJSONParserNewValue(virJSONParserPtr parser,
+                      virJSONType type)
+{
+    if (parser->arena)
+        return virJSONArenaNewValue(parser->arena, type);
+
+    switch (type) {
+    case VIR_JSON_TYPE_OBJECT:
+        return virJSONValueNewObject();
+    case VIR_JSON_TYPE_ARRAY:
+        return virJSONValueNewArray();
+    case VIR_JSON_TYPE_NULL:
+        return virJSONValueNewNull();
+    case VIR_JSON_TYPE_BOOLEAN:
+    case VIR_JSON_TYPE_STRING:
+    case VIR_JSON_TYPE_NUMBER:
+        break;
+    }
+
+    return NULL;
+}
+
+
+static virJSONValuePtr
+virJSONParserNewStringLen(virJSONParserPtr parser,
+                          virJSONType type,
+                          const char *str,
+                          size_t len)
+{
+    virJSONValuePtr value;
+    virJSONNumber number = { .kind = VIR_JSON_NUMBER_TEXT };
+    char *tmp;
+
+    if (type == VIR_JSON_TYPE_NUMBER &&
+        virJSONNumberParseInteger(str, len, &number) == 0) {
+        if (!parser->arena)
+            return virJSONValueNewNumber(&number);
+
+        if (!(value = virJSONArenaNewValue(parser->arena, type)))
+            return NULL;
+        value->data.number = number;
+        return value;
+    }
+
+    if (!parser->arena) {
+        if (type == VIR_JSON_TYPE_STRING)
+            return virJSONValueNewStringLen(str, len);
+
+        if (VIR_STRNDUP(tmp, str, len) < 0)
+            return NULL;
+        number.str = tmp;
+        value = virJSONValueNewNumber(&number);
+        VIR_FREE(tmp);
+        return value;
+    }
+
+    if (!(tmp = virJSONArenaStrndup(parser->arena, str, len)) ||
+        !(value = virJSONArenaNewValue(parser->arena, type)))
+        return NULL;
+
+    if (type == VIR_JSON_TYPE_STRING)
+        value->data.string = tmp;
+    else
+        value->data.number.str = tmp;
+
+    return value;
+}
+
+
 static int
 virJSONParserInsertValue(virJSONParserPtr parser,
                          virJSONValuePtr value)
@@ -1527,12 +2547,12 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueObjectAppend(state->value,
-                                         state->key,
-                                         value) < 0)
+            /* the key was interned or allocated in the arena already */
+            if (virJSONValueObjectHasKey(state->value, state->key) ||
+                virJSONValueObjectInsert(state->value,
+                                         state->key, value) < 0)
                 return -1;
-
-            VIR_FREE(state->key);
+            state->key = NULL;
         }   break;
 
         case VIR_JSON_TYPE_ARRAY: {
@@ -1541,9 +2561,14 @@ virJSONParserInsertValue(virJSONParserPtr parser,
                 return -1;
             }
 
-            if (virJSONValueArrayAppend(state->value,
-                                        value) < 0)
-                return -1;
+            if (parser->arena) {
+                if (virJSONValueArrayInsert(state->value, value) < 0)
+                    return -1;
+            } else {
+                if (virJSONValueArrayAppend(state->value,
+                                            value) < 0)
+                    return -1;
+            }
         }   break;
 
         default:
@@ -1560,7 +2585,7 @@ static int
 virJSONParserHandleNull(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewNull();
+    virJSONValuePtr value = virJSONParserNewValue(parser, VIR_JSON_TYPE_NULL);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1568,7 +2593,7 @@ virJSONParserHandleNull(void *ctx)
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1581,15 +2606,23 @@ virJSONParserHandleBoolean(void *ctx,
                            int boolean_)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewBoolean(boolean_);
+    virJSONValuePtr value;
 
     VIR_DEBUG("parser=%p boolean=%d", parser, boolean_);
 
+    if (parser->arena) {
+        if ((value = virJSONArenaNewValue(parser->arena,
+                                          VIR_JSON_TYPE_BOOLEAN)))
+            value->data.boolean = boolean_;
+    } else {
+        value = virJSONValueNewBoolean(boolean_);
+    }
+
     if (!value)
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1603,21 +2636,17 @@ virJSONParserHandleNumber(void *ctx,
                           yajl_size_t l)
 {
     virJSONParserPtr parser = ctx;
-    char *str;
-    virJSONValuePtr value;
-
-    if (VIR_STRNDUP(str, s, l) < 0)
-        return -1;
-    value = virJSONValueNewNumber(str);
-    VIR_FREE(str);
+    virJSONValuePtr value = virJSONParserNewStringLen(parser,
+                                                      VIR_JSON_TYPE_NUMBER,
+                                                      s, l);
 
-    VIR_DEBUG("parser=%p str=%s", parser, str);
+    VIR_DEBUG("parser=%p value=%p", parser, value);
 
     if (!value)
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1631,8 +2660,10 @@ virJSONParserHandleString(void *ctx,
                           yajl_size_t stringLen)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewStringLen((const char *)stringVal,
-                                                     stringLen);
+    virJSONValuePtr value = virJSONParserNewStringLen(parser,
+                                                      VIR_JSON_TYPE_STRING,
+                                                      (const char *)stringVal,
+                                                      stringLen);
 
     VIR_DEBUG("parser=%p str=%p", parser, (const char *)stringVal);
 
@@ -1640,7 +2671,7 @@ virJSONParserHandleString(void *ctx,
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1664,8 +2695,16 @@ virJSONParserHandleMapKey(void *ctx,
     state = &parser->state[parser->nstate-1];
     if (state->key)
         return 0;
-    if (VIR_STRNDUP(state->key, (const char *)stringVal, stringLen) < 0)
-        return 0;
+    if (parser->arena) {
+        if (!(state->key = virJSONArenaStrndup(parser->arena,
+                                               (const char *)stringVal,
+                                               stringLen)))
+            return 0;
+    } else {
+        if (!(state->key = virStringInternLen((const char *)stringVal,
+                                              stringLen)))
+            return 0;
+    }
     return 1;
 }
 
@@ -1674,7 +2713,7 @@ static int
 virJSONParserHandleStartMap(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewObject();
+    virJSONValuePtr value = virJSONParserNewValue(parser, VIR_JSON_TYPE_OBJECT);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1682,7 +2721,7 @@ virJSONParserHandleStartMap(void *ctx)
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1712,7 +2751,7 @@ virJSONParserHandleEndMap(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserFreeKey(parser, &state->key);
         return 0;
     }
 
@@ -1726,7 +2765,7 @@ static int
 virJSONParserHandleStartArray(void *ctx)
 {
     virJSONParserPtr parser = ctx;
-    virJSONValuePtr value = virJSONValueNewArray();
+    virJSONValuePtr value = virJSONParserNewValue(parser, VIR_JSON_TYPE_ARRAY);
 
     VIR_DEBUG("parser=%p", parser);
 
@@ -1734,7 +2773,7 @@ virJSONParserHandleStartArray(void *ctx)
         return 0;
 
     if (virJSONParserInsertValue(parser, value) < 0) {
-        virJSONValueFree(value);
+        virJSONParserFreeValue(parser, value);
         return 0;
     }
 
@@ -1763,7 +2802,7 @@ virJSONParserHandleEndArray(void *ctx)
 
     state = &(parser->state[parser->nstate-1]);
     if (state->key) {
-        VIR_FREE(state->key);
+        virJSONParserFreeKey(parser, &state->key);
         return 0;
     }
 
@@ -1788,12 +2827,488 @@ static const yajl_callbacks parserCallbacks = {
 };
 
 
+static void
+virJSONParserClear(virJSONParserPtr parser)
+{
+    size_t i;
+
+    for (i = 0; i < parser->nstate; i++)
+        virJSONParserFreeKey(parser, &parser->state[i].key);
+    VIR_FREE(parser->state);
+    parser->nstate = 0;
+
+    if (parser->arena) {
+        virJSONArenaUnref(parser->arena);
+        parser->arena = NULL;
+    }
+}
+
+
+# if ENABLE_JSON_SCANNER
+/*
+ * A scanner for the common shape of documents, feeding the same callbacks
+ * as yajl.  Strings are skipped a word at a time, so the long quoted
+ * values found in large QMP replies cost little more than a memchr.
+ * The scanner gives up on anything it does not handle exactly like yajl
+ * (surrogate pairs, embedded NULs, unusual white space and all syntax
+ * errors), in which case yajl parses the document again and reports
+ * the error if there is one.
+ */
+typedef struct _virJSONScanner virJSONScanner;
+typedef virJSONScanner *virJSONScannerPtr;
+struct _virJSONScanner {
+    virJSONParserPtr parser;
+    const char *cur;
+    const char *end;
+    char *scratch; /* unescaped copy of the current string */
+    size_t nscratch;
+};
+
+# define VIR_JSON_SCANNER_ONES 0x0101010101010101ULL
+# define VIR_JSON_SCANNER_HIGH 0x8080808080808080ULL
+
+/* Whether any byte of @word needs a closer look inside a string: a quote,
+ * a backslash, a control character or the start of a UTF-8 sequence. */
+static bool
+virJSONScannerWordSpecial(uint64_t word)
+{
+    uint64_t quote = word ^ (VIR_JSON_SCANNER_ONES * '"');
+    uint64_t backslash = word ^ (VIR_JSON_SCANNER_ONES * '\\');
+
+    return (((quote - VIR_JSON_SCANNER_ONES) & ~quote) |
+            ((backslash - VIR_JSON_SCANNER_ONES) & ~backslash) |
+            (word - VIR_JSON_SCANNER_ONES * 0x20) |
+            word) & VIR_JSON_SCANNER_HIGH;
+}
+
+
+static void
+virJSONScannerSkipSpace(virJSONScannerPtr sc)
+{
+    while (sc->cur < sc->end &&
+           (*sc->cur == ' ' || *sc->cur == '\n' ||
+            *sc->cur == '\r' || *sc->cur == '\t'))
+        sc->cur++;
+}
+
+
+/* Returns the length of the UTF-8 sequence at @p, or 0 if it is not one
+ * yajl would accept. */
+static size_t
+virJSONScannerUTF8Length(const unsigned char *p,
+                         const unsigned char *end)
+{
+    size_t len;
+    size_t i;
+
+    if ((p[0] >> 5) == 0x6)
+        len = 2;
+    else if ((p[0] >> 4) == 0xe)
+        len = 3;
+    else if ((p[0] >> 3) == 0x1e)
+        len = 4;
+    else
+        return 0;
+
+    if (end - p < len)
+        return 0;
+
+    for (i = 1; i < len; i++) {
+        if ((p[i] >> 6) != 0x2)
+            return 0;
+    }
+
+    return len;
+}
+
+
+static int
+virJSONScannerHexDigit(char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+
+/* Unescapes the string at @start up to the closing quote at @sc->cur
+ * into the scratch buffer. */
+static int
+virJSONScannerUnescape(virJSONScannerPtr sc,
+                       const char *start,
+                       size_t *len)
+{
+    const char *p = start;
+    size_t n = 0;
+
+    /* the unescaped string is never longer than the escaped one */
+    if (VIR_RESIZE_N(sc->scratch, sc->nscratch, 0, sc->cur - start) < 0)
+        return -1;
+
+    while (p < sc->cur) {
+        const char *backslash = memchr(p, '\\', sc->cur - p);
+        unsigned int codepoint = 0;
+        size_t i;
+
+        if (!backslash)
+            backslash = sc->cur;
+
+        memcpy(sc->scratch + n, p, backslash - p);
+        n += backslash - p;
+        p = backslash;
+        if (p == sc->cur)
+            break;
+
+        switch (p[1]) {
+        case '"':
+        case '\\':
+        case '/':
+            sc->scratch[n++] = p[1];
+            break;
+        case 'b':
+            sc->scratch[n++] = '\b';
+            break;
+        case 'f':
+            sc->scratch[n++] = '\f';
+            break;
+        case 'n':
+            sc->scratch[n++] = '\n';
+            break;
+        case 'r':
+            sc->scratch[n++] = '\r';
+            break;
+        case 't':
+            sc->scratch[n++] = '\t';
+            break;
+        case 'u':
+            for (i = 2; i < 6; i++) {
+                int digit = virJSONScannerHexDigit(p[i]);
+
+                if (digit < 0)
+                    return -1;
+                codepoint = codepoint << 4 | digit;
+            }
+
+            /* leave NULs and surrogates to yajl */
+            if (codepoint == 0 ||
+                (codepoint >= 0xd800 && codepoint <= 0xdfff))
+                return -1;
+
+            if (codepoint < 0x80) {
+                sc->scratch[n++] = codepoint;
+            } else if (codepoint < 0x800) {
+                sc->scratch[n++] = 0xc0 | (codepoint >> 6);
+                sc->scratch[n++] = 0x80 | (codepoint & 0x3f);
+            } else {
+                sc->scratch[n++] = 0xe0 | (codepoint >> 12);
+                sc->scratch[n++] = 0x80 | ((codepoint >> 6) & 0x3f);
+                sc->scratch[n++] = 0x80 | (codepoint & 0x3f);
+            }
+            p += 4;
+            break;
+        default:
+            return -1;
+        }
+        p += 2;
+    }
+
+    *len = n;
+    return 0;
+}
+
+
+/* Scans the string starting after the opening quote at @sc->cur and calls
+ * the string or map key callback for it. */
+static int
+virJSONScannerString(virJSONScannerPtr sc,
+                     bool key)
+{
+    const char *start = ++sc->cur;
+    const unsigned char *str = (const unsigned char *)start;
+    bool escaped = false;
+    size_t len;
+
+    for (;;) {
+        unsigned char c;
+        size_t seq;
+
+        while (sc->end - sc->cur >= sizeof(uint64_t)) {
+            uint64_t word;
+
+            memcpy(&word, sc->cur, sizeof(word));
+            if (virJSONScannerWordSpecial(word))
+                break;
+            sc->cur += sizeof(word);
+        }
+
+        if (sc->cur == sc->end)
+            return -1;
+
+        c = *sc->cur;
+        if (c == '"')
+            break;
+
+        if (c == '\\') {
+            /* the escaped character is checked when unescaping */
+            if (sc->end - sc->cur < 2)
+                return -1;
+            sc->cur += 2;
+            escaped = true;
+        } else if (c < 0x20) {
+            return -1;
+        } else if (c < 0x80) {
+            sc->cur++;
+        } else {
+            if (!(seq = virJSONScannerUTF8Length((const unsigned char *)sc->cur,
+                                                 (const unsigned char *)sc->end)))
+                return -1;
+            sc->cur += seq;
+        }
+    }
+
+    if (escaped) {
+        if (virJSONScannerUnescape(sc, start, &len) < 0)
+            return -1;
+        str = (const unsigned char *)sc->scratch;
+    } else {
+        len = sc->cur - start;
+    }
+    sc->cur++;
+
+    if (key)
+        return virJSONParserHandleMapKey(sc->parser, str, len) ? 0 : -1;
+    return virJSONParserHandleString(sc->parser, str, len) ? 0 : -1;
+}
+
+
+static bool
+virJSONScannerDigit(virJSONScannerPtr sc)
+{
+    return sc->cur < sc->end && c_isdigit(*sc->cur);
+}
+
+
+static int
+virJSONScannerNumber(virJSONScannerPtr sc)
+{
+    const char *start = sc->cur;
+
+    if (*sc->cur == '-')
+        sc->cur++;
+
+    if (!virJSONScannerDigit(sc))
+        return -1;
+    if (*sc->cur++ != '0') {
+        while (virJSONScannerDigit(sc))
+            sc->cur++;
+    }
+
+    if (sc->cur < sc->end && *sc->cur == '.') {
+        sc->cur++;
+        if (!virJSONScannerDigit(sc))
+            return -1;
+        while (virJSONScannerDigit(sc))
+            sc->cur++;
+    }
+
+    if (sc->cur < sc->end && (*sc->cur == 'e' || *sc->cur == 'E')) {
+        sc->cur++;
+        if (sc->cur < sc->end && (*sc->cur == '+' || *sc->cur == '-'))
+            sc->cur++;
+        if (!virJSONScannerDigit(sc))
+            return -1;
+        while (virJSONScannerDigit(sc))
+            sc->cur++;
+    }
+
+    return virJSONParserHandleNumber(sc->parser, start,
+                                     sc->cur - start) ? 0 : -1;
+}
+
+
+static bool
+virJSONScannerLiteral(virJSONScannerPtr sc,
+                      const char *literal)
+{
+    size_t len = strlen(literal);
+
+    if (sc->end - sc->cur < len ||
+        memcmp(sc->cur, literal, len) != 0)
+        return false;
+
+    sc->cur += len;
+    return true;
+}
+
+
+static int
+virJSONScannerValue(virJSONScannerPtr sc)
+{
+    virJSONParserPtr parser = sc->parser;
+
+    switch (*sc->cur) {
+    case '{':
+        sc->cur++;
+        return virJSONParserHandleStartMap(parser) ? 0 : -1;
+    case '[':
+        sc->cur++;
+        return virJSONParserHandleStartArray(parser) ? 0 : -1;
+    case '"':
+        return virJSONScannerString(sc, false);
+    case 't':
+        if (!virJSONScannerLiteral(sc, "true"))
+            return -1;
+        return virJSONParserHandleBoolean(parser, 1) ? 0 : -1;
+    case 'f':
+        if (!virJSONScannerLiteral(sc, "false"))
+            return -1;
+        return virJSONParserHandleBoolean(parser, 0) ? 0 : -1;
+    case 'n':
+        if (!virJSONScannerLiteral(sc, "null"))
+            return -1;
+        return virJSONParserHandleNull(parser) ? 0 : -1;
+    default:
+        return virJSONScannerNumber(sc);
+    }
+}
+
+
+typedef enum {
+    VIR_JSON_SCANNER_VALUE,
+    VIR_JSON_SCANNER_FIRST_VALUE, /* first array member or empty array */
+    VIR_JSON_SCANNER_KEY,
+    VIR_JSON_SCANNER_FIRST_KEY, /* first object member or empty object */
+    VIR_JSON_SCANNER_NEXT, /* after a value */
+} virJSONScannerState;
+
+
+static int
+virJSONScannerRun(virJSONScannerPtr sc)
+{
+    virJSONParserPtr parser = sc->parser;
+    virJSONScannerState state = VIR_JSON_SCANNER_VALUE;
+
+    for (;;) {
+        char c;
+
+        virJSONScannerSkipSpace(sc);
+
+        switch (state) {
+        case VIR_JSON_SCANNER_FIRST_VALUE:
+            if (sc->cur < sc->end && *sc->cur == ']') {
+                sc->cur++;
+                if (!virJSONParserHandleEndArray(parser))
+                    return -1;
+                state = VIR_JSON_SCANNER_NEXT;
+                break;
+            }
+            ATTRIBUTE_FALLTHROUGH;
+        case VIR_JSON_SCANNER_VALUE:
+            if (sc->cur == sc->end)
+                return -1;
+            c = *sc->cur;
+            if (virJSONScannerValue(sc) < 0)
+                return -1;
+            if (c == '{')
+                state = VIR_JSON_SCANNER_FIRST_KEY;
+            else if (c == '[')
+                state = VIR_JSON_SCANNER_FIRST_VALUE;
+            else
+                state = VIR_JSON_SCANNER_NEXT;
+            break;
+
+        case VIR_JSON_SCANNER_FIRST_KEY:
+            if (sc->cur < sc->end && *sc->cur == '}') {
+                sc->cur++;
+                if (!virJSONParserHandleEndMap(parser))
+                    return -1;
+                state = VIR_JSON_SCANNER_NEXT;
+                break;
+            }
+            ATTRIBUTE_FALLTHROUGH;
+        case VIR_JSON_SCANNER_KEY:
+            if (sc->cur == sc->end || *sc->cur != '"' ||
+                virJSONScannerString(sc, true) < 0)
+                return -1;
+            virJSONScannerSkipSpace(sc);
+            if (sc->cur == sc->end || *sc->cur != ':')
+                return -1;
+            sc->cur++;
+            state = VIR_JSON_SCANNER_VALUE;
+            break;
+
+        case VIR_JSON_SCANNER_NEXT:
+            if (!parser->nstate)
+                return sc->cur == sc->end ? 0 : -1;
+            if (sc->cur == sc->end)
+                return -1;
+
+            if (parser->state[parser->nstate - 1].value->type ==
+                VIR_JSON_TYPE_OBJECT) {
+                if (*sc->cur == ',') {
+                    state = VIR_JSON_SCANNER_KEY;
+                } else if (*sc->cur != '}' ||
+                           !virJSONParserHandleEndMap(parser)) {
+                    return -1;
+                }
+            } else {
+                if (*sc->cur == ',') {
+                    state = VIR_JSON_SCANNER_VALUE;
+                } else if (*sc->cur != ']' ||
+                           !virJSONParserHandleEndArray(parser)) {
+                    return -1;
+                }
+            }
+            sc->cur++;
+            break;
+        }
+    }
+}
+
+
+static virJSONValuePtr
+virJSONValueScan(const char *jsonstring,
+                 size_t len,
+                 bool useArena)
+{
+    virJSONParser parser = { NULL, NULL, 0, 0, NULL };
+    virJSONScanner sc = { &parser, jsonstring, jsonstring + len, NULL, 0 };
+    virJSONValuePtr ret = NULL;
+
+    if (useArena &&
+        !(parser.arena = virJSONArenaNew(len * 2)))
+        return NULL;
+
+    if (virJSONScannerRun(&sc) < 0) {
+        VIR_DEBUG("scanner gave up at offset %zu",
+                  (size_t)(sc.cur - jsonstring));
+        virJSONParserFreeValue(&parser, parser.head);
+    } else {
+        ret = parser.head;
+        if (parser.arena) {
+            parser.arena->sealed = true;
+            parser.arena = NULL;
+        }
+    }
+
+    virJSONParserClear(&parser);
+    VIR_FREE(sc.scratch);
+    return ret;
+}
+# endif /* ENABLE_JSON_SCANNER */
+
+
 /* XXX add an incremental streaming parser - yajl trivially supports it */
-virJSONValuePtr
-virJSONValueFromString(const char *jsonstring)
+static virJSONValuePtr
+virJSONValueFromStringInternal(const char *jsonstring,
+                               bool useArena)
 {
     yajl_handle hand;
-    virJSONParser parser = { NULL, NULL, 0, 0 };
+    virJSONParser parser = { NULL, NULL, 0, 0, NULL };
     virJSONValuePtr ret = NULL;
     int rc;
     size_t len = strlen(jsonstring);
@@ -1804,6 +3319,18 @@ virJSONValueFromString(const char *jsonstring)
 
     VIR_DEBUG("string=%s", jsonstring);
 
+# if ENABLE_JSON_SCANNER
+    if ((ret = virJSONValueScan(jsonstring, len, useArena))) {
+        VIR_DEBUG("result=%p", ret);
+        return ret;
+    }
+# endif
+
+    /* the tree takes about twice the space of its textual form */
+    if (useArena &&
+        !(parser.arena = virJSONArenaNew(len * 2)))
+        return NULL;
+
 # ifdef WITH_YAJL2
     hand = yajl_alloc(&parserCallbacks, NULL, &parser);
 # else
@@ -1842,7 +3369,7 @@ virJSONValueFromString(const char *jsonstring)
                        _("cannot parse json %s: %s"),
                        jsonstring, (const char*) errstr);
         yajl_free_error(hand, errstr);
-        virJSONValueFree(parser.head);
+        virJSONParserFreeValue(&parser, parser.head);
         goto cleanup;
     }
 
@@ -1850,9 +3377,14 @@ virJSONValueFromString(const char *jsonstring)
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("cannot parse json %s: unterminated string/map/array"),
                        jsonstring);
-        virJSONValueFree(parser.head);
+        virJSONParserFreeValue(&parser, parser.head);
     } else {
         ret = parser.head;
+        /* the reference to the arena is owned by the tree from now on */
+        if (parser.arena) {
+            parser.arena->sealed = true;
+            parser.arena = NULL;
+        }
 # ifndef WITH_YAJL2
         /* Undo the array wrapping above */
         tmp = ret;
@@ -1868,13 +3400,7 @@ virJSONValueFromString(const char *jsonstring)
 
  cleanup:
     yajl_free(hand);
-
-    if (parser.nstate) {
-        size_t i;
-        for (i = 0; i < parser.nstate; i++)
-            VIR_FREE(parser.state[i].key);
-        VIR_FREE(parser.state);
-    }
+    virJSONParserClear(&parser);
 
     VIR_DEBUG("result=%p", ret);
 
@@ -1882,6 +3408,32 @@ virJSONValueFromString(const char *jsonstring)
 }
 
 
+virJSONValuePtr
+virJSONValueFromString(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, false);
+}
+
+
+/**
+ * virJSONValueFromStringArena:
+ * @jsonstring: string to parse
+ *
+ * Same as virJSONValueFromString, but the whole tree is allocated from
+ * a few large chunks which are released at once when the tree is freed.
+ * This is meant for short-lived data such as monitor replies. Subtrees
+ * stolen from the tree remain valid, but they keep the memory of the
+ * whole tree allocated until they are freed as well.
+ *
+ * Returns the parsed tree or NULL on error.
+ */
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring)
+{
+    return virJSONValueFromStringInternal(jsonstring, true);
+}
+
+
 static int
 virJSONValueToStringOne(virJSONValuePtr object,
                         yajl_gen g)
@@ -1923,11 +3475,14 @@ virJSONValueToStringOne(virJSONValuePtr object,
             return -1;
         break;
 
-    case VIR_JSON_TYPE_NUMBER:
-        if (yajl_gen_number(g, object->data.number,
-                            strlen(object->data.number)) != yajl_gen_status_ok)
+    case VIR_JSON_TYPE_NUMBER: {
+        char buf[INT_BUFSIZE_BOUND(long long)];
+        const char *str;
+
+        if (!(str = virJSONValueNumberFormat(object, buf, sizeof(buf))) ||
+            yajl_gen_number(g, str, strlen(str)) != yajl_gen_status_ok)
             return -1;
-        break;
+    }   break;
 
     case VIR_JSON_TYPE_BOOLEAN:
         if (yajl_gen_bool(g, object->data.boolean) != yajl_gen_status_ok)
@@ -2008,6 +3563,15 @@ virJSONValueFromString(const char *jsonstring ATTRIBUTE_UNUSED)
 }
 
 
+virJSONValuePtr
+virJSONValueFromStringArena(const char *jsonstring ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("No JSON parser implementation is available"));
+    return NULL;
+}
+
+
 char *
 virJSONValueToString(virJSONValuePtr object ATTRIBUTE_UNUSED,
                      bool pretty ATTRIBUTE_UNUSED)
@@ -45,6 +45,9 @@ typedef virJSONValue *virJSONValuePtr;
 
 void virJSONValueFree(virJSONValuePtr value);
 void virJSONValueHashFree(void *opaque, const void *name);
+void virJSONValueGetUsage(size_t *values,
+                          size_t *arenas,
+                          unsigned long long *bytes);
 
 virJSONType virJSONValueGetType(const virJSONValue *value);
 
@@ -140,6 +143,7 @@ int virJSONValueObjectRemoveKey(virJSONValuePtr object, const char *key,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
 
 virJSONValuePtr virJSONValueFromString(const char *jsonstring);
+virJSONValuePtr virJSONValueFromStringArena(const char *jsonstring);
 char *virJSONValueToString(virJSONValuePtr object,
                            bool pretty);
 
@@ -151,6 +155,31 @@ int virJSONValueObjectForeachKeyValue(virJSONValuePtr object,
                                       virJSONValueObjectIteratorFunc cb,
                                       void *opaque);
 
+typedef enum {
+    VIR_JSON_FIELD_STRING, /* const char ** */
+    VIR_JSON_FIELD_INT, /* int * */
+    VIR_JSON_FIELD_UINT, /* unsigned int * */
+    VIR_JSON_FIELD_LONG, /* long long * */
+    VIR_JSON_FIELD_ULONG, /* unsigned long long * */
+    VIR_JSON_FIELD_DOUBLE, /* double * */
+    VIR_JSON_FIELD_BOOLEAN, /* bool * */
+    VIR_JSON_FIELD_OBJECT, /* virJSONValuePtr * */
+    VIR_JSON_FIELD_ARRAY, /* virJSONValuePtr * */
+} virJSONFieldType;
+
+typedef struct _virJSONField virJSONField;
+typedef virJSONField *virJSONFieldPtr;
+struct _virJSONField {
+    const char *key;
+    virJSONFieldType type;
+    void *value; /* where to store the value, see virJSONFieldType */
+    bool found; /* filled by virJSONValueObjectGetFields */
+};
+
+int virJSONValueObjectGetFields(virJSONValuePtr object,
+                                virJSONFieldPtr fields,
+                                size_t nfields);
+
 virJSONValuePtr virJSONValueCopy(const virJSONValue *in);
 
 char *virJSONStringReformat(const char *jsonstr, bool pretty);
@@ -25,12 +25,19 @@
 #include "virlease.h"
 
 #include <time.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "virfile.h"
 #include "virstring.h"
 #include "virerror.h"
 #include "viralloc.h"
 #include "virutil.h"
+#include "virmacmap.h"
+#include "virobject.h"
+#include "virsocketaddr.h"
 
 #define VIR_FROM_THIS VIR_FROM_NETWORK
 
@@ -49,6 +56,31 @@
 #define EMPTY_STR(s) ((s) ? (s) : "*")
 
 
+/*
+ * Layout of the lease index file: the header is followed by the
+ * records sorted by key and name and then by the string table
+ * holding the NUL terminated names.
+ */
+#define VIR_LEASE_INDEX_MAGIC "LVLEASE"
+#define VIR_LEASE_INDEX_VERSION 1
+
+typedef struct _virLeaseIndexHeader virLeaseIndexHeader;
+struct _virLeaseIndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nrecords;
+};
+
+struct _virLeaseIndex {
+    void *map;
+    size_t len;
+    const virLeaseIndexRecord *records;
+    size_t nrecords;
+    const char *strings;
+    size_t nstrings;
+};
+
+
 int
 virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
                             const char *custom_lease_file,
@@ -275,3 +307,405 @@ virLeaseNew(virJSONValuePtr *lease_ret,
     lease_new = NULL;
     return 0;
 }
+
+
+typedef struct _virLeaseIndexEntry virLeaseIndexEntry;
+typedef virLeaseIndexEntry *virLeaseIndexEntryPtr;
+struct _virLeaseIndexEntry {
+    virLeaseIndexRecord rec;
+    const char *name;
+    size_t seq;
+};
+
+typedef struct _virLeaseIndexBuilder virLeaseIndexBuilder;
+typedef virLeaseIndexBuilder *virLeaseIndexBuilderPtr;
+struct _virLeaseIndexBuilder {
+    virJSONValuePtr leases;
+    virLeaseIndexEntryPtr entries;
+    size_t nentries;
+    size_t nstrings;
+};
+
+
+static int
+virLeaseIndexBuilderAdd(virLeaseIndexBuilderPtr builder,
+                        virLeaseIndexKey key,
+                        const char *name,
+                        virJSONValuePtr lease)
+{
+    virLeaseIndexEntry entry;
+    const char *ip;
+    long long expirytime;
+    virSocketAddr sa;
+
+    memset(&entry, 0, sizeof(entry));
+
+    if (!(ip = virJSONValueObjectGetString(lease, "ip-address")) ||
+        virJSONValueObjectGetNumberLong(lease, "expiry-time", &expirytime) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("failed to parse json"));
+        return -1;
+    }
+
+    if (virSocketAddrParse(&sa, ip, AF_UNSPEC) < 0)
+        return -1;
+
+    entry.rec.expirytime = expirytime;
+    entry.rec.key = key;
+    entry.rec.family = VIR_SOCKET_ADDR_FAMILY(&sa);
+    if (entry.rec.family == AF_INET)
+        memcpy(entry.rec.addr, &sa.data.inet4.sin_addr.s_addr, 4);
+    else
+        memcpy(entry.rec.addr, &sa.data.inet6.sin6_addr.s6_addr, 16);
+    entry.name = name;
+    entry.seq = builder->nentries;
+
+    return VIR_APPEND_ELEMENT(builder->entries, builder->nentries, entry);
+}
+
+
+static int
+virLeaseIndexAddDomain(void *payload,
+                       const void *name,
+                       void *opaque)
+{
+    virLeaseIndexBuilderPtr builder = opaque;
+    const char *const *macs = payload;
+    size_t i;
+
+    for (i = 0; i < virJSONValueArraySize(builder->leases); i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(builder->leases, i);
+        const char *mac = virJSONValueObjectGetString(lease, "mac-address");
+
+        if (!mac || !virStringListHasString((const char **) macs, mac))
+            continue;
+
+        if (virLeaseIndexBuilderAdd(builder, VIR_LEASE_INDEX_KEY_DOMAIN,
+                                    name, lease) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virLeaseIndexEntryCompare(const void *a,
+                          const void *b)
+{
+    const virLeaseIndexEntry *ea = a;
+    const virLeaseIndexEntry *eb = b;
+    int rc;
+
+    if (ea->rec.key != eb->rec.key)
+        return ea->rec.key < eb->rec.key ? -1 : 1;
+
+    if ((rc = strcmp(ea->name, eb->name)) != 0)
+        return rc;
+
+    /* keep the order of the lease files for the same name */
+    return ea->seq < eb->seq ? -1 : ea->seq > eb->seq;
+}
+
+
+static int
+virLeaseIndexWrite(int fd,
+                   const void *opaque)
+{
+    const virLeaseIndexBuilder *builder = opaque;
+    virLeaseIndexHeader header;
+    size_t i;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, VIR_LEASE_INDEX_MAGIC, sizeof(header.magic));
+    header.version = VIR_LEASE_INDEX_VERSION;
+    header.nrecords = builder->nentries;
+
+    if (safewrite(fd, &header, sizeof(header)) != sizeof(header))
+        return -1;
+
+    for (i = 0; i < builder->nentries; i++) {
+        const virLeaseIndexRecord *rec = &builder->entries[i].rec;
+
+        if (safewrite(fd, rec, sizeof(*rec)) != sizeof(*rec))
+            return -1;
+    }
+
+    for (i = 0; i < builder->nentries; i++) {
+        const char *name = builder->entries[i].name;
+        size_t len = strlen(name) + 1;
+
+        if (safewrite(fd, name, len) != len)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virLeaseIndexBuild:
+ * @lease_dir: directory with the custom lease and MAC map files
+ * @index_file: path of the index, NULL for @lease_dir/leases.idx
+ *
+ * Read all the *.status custom lease files and *.macs MAC map files
+ * in @lease_dir and write an index that allows looking up the leases
+ * by hostname or domain name without parsing them. Anybody changing
+ * one of those files must rebuild the index afterwards. If that fails
+ * the stale index is removed so that readers go back to the files.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virLeaseIndexBuild(const char *lease_dir,
+                   const char *index_file)
+{
+    VIR_AUTOFREE(char *) path = NULL;
+    VIR_AUTOFREE(char *) lock_file = NULL;
+    virLeaseIndexBuilder builder;
+    virMacMapPtr *macmaps = NULL;
+    size_t nmacmaps = 0;
+    struct dirent *entry;
+    DIR *dir = NULL;
+    int lock_fd = -1;
+    bool locked = false;
+    size_t i;
+    int rc;
+    int ret = -1;
+
+    memset(&builder, 0, sizeof(builder));
+
+    if (!index_file) {
+        if (!(path = virFileBuildPath(lease_dir, VIR_LEASE_INDEX_FILE, NULL)))
+            return -1;
+        index_file = path;
+    }
+
+    /* leaseshelper and libvirtd may rebuild the index at the same time */
+    if (virAsprintf(&lock_file, "%s.lock", index_file) < 0)
+        return -1;
+
+    if ((lock_fd = open(lock_file, O_RDWR | O_CREAT, 0644)) < 0) {
+        virReportSystemError(errno, _("cannot open file '%s'"), lock_file);
+        goto cleanup;
+    }
+
+    if (virFileLock(lock_fd, false, 0, 1, true) < 0) {
+        virReportSystemError(errno, _("cannot lock file '%s'"), lock_file);
+        goto cleanup;
+    }
+    locked = true;
+
+    if (!(builder.leases = virJSONValueNewArray()))
+        goto cleanup;
+
+    if (virDirOpen(&dir, lease_dir) < 0)
+        goto cleanup;
+
+    while ((rc = virDirRead(dir, &entry, lease_dir)) > 0) {
+        VIR_AUTOFREE(char *) file = NULL;
+        virMacMapPtr macmap;
+
+        if (!virFileHasSuffix(entry->d_name, ".status") &&
+            !virFileHasSuffix(entry->d_name, ".macs"))
+            continue;
+
+        if (!(file = virFileBuildPath(lease_dir, entry->d_name, NULL)))
+            goto cleanup;
+
+        if (virFileHasSuffix(entry->d_name, ".status")) {
+            if (virLeaseReadCustomLeaseFile(builder.leases, file,
+                                            NULL, NULL) < 0)
+                goto cleanup;
+            continue;
+        }
+
+        if (!(macmap = virMacMapNew(file)))
+            goto cleanup;
+
+        if (VIR_APPEND_ELEMENT(macmaps, nmacmaps, macmap) < 0) {
+            virObjectUnref(macmap);
+            goto cleanup;
+        }
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    for (i = 0; i < virJSONValueArraySize(builder.leases); i++) {
+        virJSONValuePtr lease = virJSONValueArrayGet(builder.leases, i);
+        const char *hostname = virJSONValueObjectGetString(lease, "hostname");
+
+        if (hostname &&
+            virLeaseIndexBuilderAdd(&builder, VIR_LEASE_INDEX_KEY_HOSTNAME,
+                                    hostname, lease) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < nmacmaps; i++) {
+        if (virMacMapForEach(macmaps[i], virLeaseIndexAddDomain, &builder) < 0)
+            goto cleanup;
+    }
+
+    /* the names point into the lease and MAC map objects still alive */
+    if (builder.nentries)
+        qsort(builder.entries, builder.nentries, sizeof(*builder.entries),
+              virLeaseIndexEntryCompare);
+
+    for (i = 0; i < builder.nentries; i++) {
+        builder.entries[i].rec.name = builder.nstrings;
+        builder.nstrings += strlen(builder.entries[i].name) + 1;
+    }
+
+    if (virFileRewrite(index_file, 0644, virLeaseIndexWrite, &builder) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0 && locked)
+        unlink(index_file);
+    VIR_FREE(builder.entries);
+    virJSONValueFree(builder.leases);
+    while (nmacmaps)
+        virObjectUnref(macmaps[--nmacmaps]);
+    VIR_FREE(macmaps);
+    VIR_DIR_CLOSE(dir);
+    VIR_FORCE_CLOSE(lock_fd);
+    return ret;
+}
+
+
+/**
+ * virLeaseIndexOpen:
+ * @index_file: path of the index
+ *
+ * Map the lease index written by virLeaseIndexBuild() into memory.
+ * A missing index is not reported as an error; callers are expected
+ * to read the lease files instead.
+ *
+ * Returns the index or NULL if it is missing or can't be used.
+ */
+virLeaseIndexPtr
+virLeaseIndexOpen(const char *index_file)
+{
+    virLeaseIndexPtr idx = NULL;
+    const virLeaseIndexHeader *header;
+    struct stat sb;
+    size_t avail;
+    int fd;
+
+    if ((fd = open(index_file, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+
+    if (fstat(fd, &sb) < 0 || sb.st_size < (off_t) sizeof(*header))
+        goto error;
+
+    if (VIR_ALLOC_QUIET(idx) < 0)
+        goto error;
+
+    idx->len = sb.st_size;
+    if ((idx->map = mmap(NULL, idx->len, PROT_READ,
+                         MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        idx->map = NULL;
+        goto error;
+    }
+    VIR_FORCE_CLOSE(fd);
+
+    header = idx->map;
+    if (memcmp(header->magic, VIR_LEASE_INDEX_MAGIC,
+               sizeof(header->magic)) != 0 ||
+        header->version != VIR_LEASE_INDEX_VERSION)
+        goto error;
+
+    avail = idx->len - sizeof(*header);
+    if (header->nrecords > avail / sizeof(virLeaseIndexRecord))
+        goto error;
+
+    VIR_WARNINGS_NO_CAST_ALIGN
+    idx->records = (const virLeaseIndexRecord *)(header + 1);
+    VIR_WARNINGS_RESET
+    idx->nrecords = header->nrecords;
+    idx->strings = (const char *)(idx->records + idx->nrecords);
+    idx->nstrings = avail - idx->nrecords * sizeof(virLeaseIndexRecord);
+
+    /* make sure that no name runs past the end of the map */
+    if (idx->nstrings && idx->strings[idx->nstrings - 1] != '\0')
+        goto error;
+
+    return idx;
+
+ error:
+    VIR_FORCE_CLOSE(fd);
+    virLeaseIndexClose(idx);
+    return NULL;
+}
+
+
+void
+virLeaseIndexClose(virLeaseIndexPtr idx)
+{
+    if (!idx)
+        return;
+
+    if (idx->map)
+        munmap(idx->map, idx->len);
+    VIR_FREE(idx);
+}
+
+
+/**
+ * virLeaseIndexLookup:
+ * @idx: lease index
+ * @key: what @name is
+ * @name: hostname or domain name
+ * @records: filled with the first record found
+ * @nrecords: filled with the number of records found
+ *
+ * Binary search @idx for the records of @name. The records, which
+ * may include expired leases, stay valid until @idx is closed.
+ *
+ * Returns 0 on success (even if nothing was found), -1 if the index
+ * is corrupted.
+ */
+int
+virLeaseIndexLookup(virLeaseIndexPtr idx,
+                    virLeaseIndexKey key,
+                    const char *name,
+                    const virLeaseIndexRecord **records,
+                    size_t *nrecords)
+{
+    size_t lo = 0;
+    size_t hi = idx->nrecords;
+    size_t i;
+
+    *records = NULL;
+    *nrecords = 0;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const virLeaseIndexRecord *rec = &idx->records[mid];
+
+        if (rec->name >= idx->nstrings)
+            return -1;
+
+        if (rec->key < key ||
+            (rec->key == key && strcmp(idx->strings + rec->name, name) < 0))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    for (i = lo; i < idx->nrecords; i++) {
+        const virLeaseIndexRecord *rec = &idx->records[i];
+
+        if (rec->name >= idx->nstrings)
+            return -1;
+
+        if (rec->key != key || STRNEQ(idx->strings + rec->name, name))
+            break;
+    }
+
+    *records = &idx->records[lo];
+    *nrecords = i - lo;
+    return 0;
+}
@@ -25,6 +25,33 @@
 
 # include "virjson.h"
 
+# define VIR_LEASE_INDEX_FILE "leases.idx"
+
+typedef enum {
+    VIR_LEASE_INDEX_KEY_HOSTNAME, /* hostname the guest asked the lease for */
+    VIR_LEASE_INDEX_KEY_DOMAIN,   /* domain name from the MAC map files */
+
+    VIR_LEASE_INDEX_KEY_LAST
+} virLeaseIndexKey;
+
+/*
+ * The lease index is only ever read on the host that wrote it and
+ * therefore uses the host's byte order.
+ */
+typedef struct _virLeaseIndexRecord virLeaseIndexRecord;
+typedef virLeaseIndexRecord *virLeaseIndexRecordPtr;
+struct _virLeaseIndexRecord {
+    int64_t expirytime;
+    uint32_t key;       /* virLeaseIndexKey */
+    uint32_t name;      /* offset of the name in the string table */
+    int32_t family;     /* AF_INET or AF_INET6 */
+    uint8_t addr[16];   /* network byte order */
+    uint32_t reserved;
+};
+
+typedef struct _virLeaseIndex virLeaseIndex;
+typedef virLeaseIndex *virLeaseIndexPtr;
+
 int virLeaseReadCustomLeaseFile(virJSONValuePtr leases_array_new,
                                 const char *custom_lease_file,
                                 const char *ip_to_delete,
@@ -41,4 +68,17 @@ int virLeaseNew(virJSONValuePtr *lease_ret,
                 const char *hostname,
                 const char *iaid,
                 const char *server_duid);
+
+int virLeaseIndexBuild(const char *lease_dir,
+                       const char *index_file);
+
+virLeaseIndexPtr virLeaseIndexOpen(const char *index_file);
+
+void virLeaseIndexClose(virLeaseIndexPtr idx);
+
+int virLeaseIndexLookup(virLeaseIndexPtr idx,
+                        virLeaseIndexKey key,
+                        const char *name,
+                        const virLeaseIndexRecord **records,
+                        size_t *nrecords);
 #endif /* __VIR_LEASE_H */
@@ -77,7 +77,7 @@ static char virLogHostname[HOST_NAME_MAX+1];
 
 VIR_ENUM_DECL(virLogDestination);
 VIR_ENUM_IMPL(virLogDestination, VIR_LOG_TO_OUTPUT_LAST,
-              "stderr", "syslog", "file", "journald");
+              "stderr", "syslog", "file", "journald", "buffer");
 
 /*
  * Filters are used to refine the rules on what to keep or drop
@@ -129,6 +129,45 @@ static void virLogOutputToFd(virLogSourcePtr src,
                              const char *rawstr,
                              const char *str,
                              void *data);
+static void virLogFlushQueue(void);
+
+
+/*
+ * Messages waiting for the logger thread, see virLogSetAsync
+ */
+typedef struct _virLogQueuedMessage virLogQueuedMessage;
+typedef virLogQueuedMessage *virLogQueuedMessagePtr;
+struct _virLogQueuedMessage {
+    virLogSourcePtr source;
+    virLogPriority priority;
+    const char *filename;
+    int linenr;
+    const char *funcname;
+    unsigned int flags;
+    char timestamp[VIR_TIME_STRING_BUFLEN];
+    char *str;
+    char *msg;
+};
+
+/* Once the queue is full, threads emit their messages synchronously */
+#define VIR_LOG_QUEUE_MAX 4096
+
+/* Number of messages written by a single writev() */
+#define VIR_LOG_WRITEV_MAX 32
+
+static virMutex virLogQueueMutex;
+static virCond virLogQueueCond;
+static virLogQueuedMessagePtr virLogQueue[VIR_LOG_QUEUE_MAX];
+static size_t virLogQueueHead;
+static size_t virLogQueueCount;
+static bool virLogQueueQuit;
+static bool virLogAsync;
+static pid_t virLogAsyncPid;
+static virThread virLogThread;
+
+/* Only accessed with virLogMutex held */
+static virLogQueuedMessagePtr virLogBatch[VIR_LOG_QUEUE_MAX];
+static bool virLogInitMessageStderr = true;
 
 
 /*
@@ -265,6 +304,10 @@ virLogOnceInit(void)
     if (virMutexInit(&virLogMutex) < 0)
         return -1;
 
+    if (virMutexInit(&virLogQueueMutex) < 0 ||
+        virCondInit(&virLogQueueCond) < 0)
+        return -1;
+
     virLogLock();
     virLogDefaultPriority = VIR_LOG_DEFAULT;
 
@@ -397,6 +440,9 @@ virLogFilterListFree(virLogFilterPtr *list, int count)
 static void
 virLogResetOutputs(void)
 {
+    /* queued messages belong to the outputs being removed */
+    virLogFlushQueue();
+
     virLogOutputListFree(virLogOutputs, virLogNbOutputs);
     virLogOutputs = NULL;
     virLogNbOutputs = 0;
@@ -520,6 +566,297 @@ virLogSourceUpdate(virLogSourcePtr source)
     virLogUnlock();
 }
 
+
+static void
+virLogOutputInitMessage(virLogOutputFunc f,
+                        const char *timestamp,
+                        void *data)
+{
+    const char *rawinitmsg;
+    char *hoststr = NULL;
+    char *initmsg = NULL;
+
+    if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
+        f(&virLogSelf, VIR_LOG_INFO,
+          __FILE__, __LINE__, __func__,
+          timestamp, NULL, 0, rawinitmsg, initmsg, data);
+    VIR_FREE(initmsg);
+    if (virLogHostnameString(&hoststr, &initmsg) >= 0)
+        f(&virLogSelf, VIR_LOG_INFO,
+          __FILE__, __LINE__, __func__,
+          timestamp, NULL, 0, hoststr, initmsg, data);
+    VIR_FREE(hoststr);
+    VIR_FREE(initmsg);
+}
+
+
+static void
+virLogWritevFd(int fd,
+               struct iovec *iov,
+               size_t niov)
+{
+    while (niov > 0) {
+        ssize_t done = writev(fd, iov, niov);
+
+        if (done < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+
+        while (niov > 0 && done >= (ssize_t) iov->iov_len) {
+            done -= iov->iov_len;
+            iov++;
+            niov--;
+        }
+
+        if (niov > 0) {
+            iov->iov_base = (char *) iov->iov_base + done;
+            iov->iov_len -= done;
+        }
+    }
+}
+
+
+/*
+ * Pass @nmsgs messages to a single output. Messages for fd based outputs
+ * are written with as few writev() calls as possible.
+ */
+static void
+virLogEmitTo(virLogOutputFunc f,
+             void *data,
+             virLogPriority priority,
+             bool *logInitMessage,
+             virLogQueuedMessagePtr *msgs,
+             size_t nmsgs,
+             virLogMetadataPtr metadata)
+{
+    static char separator[] = ": ";
+    struct iovec iov[VIR_LOG_WRITEV_MAX * 3];
+    size_t niov = 0;
+    int fd = -1;
+    size_t i;
+
+    if (f == virLogOutputToFd)
+        fd = (intptr_t) data;
+
+    for (i = 0; i < nmsgs; i++) {
+        virLogQueuedMessagePtr m = msgs[i];
+
+        if (m->priority < priority)
+            continue;
+
+        if (*logInitMessage) {
+            virLogOutputInitMessage(f, m->timestamp, data);
+            *logInitMessage = false;
+        }
+
+        if (fd < 0 || (m->flags & VIR_LOG_STACK_TRACE)) {
+            virLogWritevFd(fd, iov, niov);
+            niov = 0;
+            f(m->source, m->priority,
+              m->filename, m->linenr, m->funcname,
+              m->timestamp, metadata, m->flags,
+              m->str, m->msg, data);
+            continue;
+        }
+
+        iov[niov].iov_base = m->timestamp;
+        iov[niov++].iov_len = strlen(m->timestamp);
+        iov[niov].iov_base = separator;
+        iov[niov++].iov_len = strlen(separator);
+        iov[niov].iov_base = m->msg;
+        iov[niov++].iov_len = strlen(m->msg);
+
+        if (niov == ARRAY_CARDINALITY(iov)) {
+            virLogWritevFd(fd, iov, niov);
+            niov = 0;
+        }
+    }
+
+    if (fd >= 0)
+        virLogWritevFd(fd, iov, niov);
+}
+
+
+/*
+ * Push the messages to the outputs defined, if none exist then
+ * use stderr. Must be called with virLogMutex held.
+ */
+static void
+virLogEmit(virLogQueuedMessagePtr *msgs,
+           size_t nmsgs,
+           virLogMetadataPtr metadata)
+{
+    size_t i;
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        virLogEmitTo(virLogOutputs[i]->f, virLogOutputs[i]->data,
+                     virLogOutputs[i]->priority,
+                     &virLogOutputs[i]->logInitMessage,
+                     msgs, nmsgs, metadata);
+    }
+
+    if (virLogNbOutputs == 0) {
+        virLogEmitTo(virLogOutputToFd, (void *) STDERR_FILENO,
+                     VIR_LOG_DEBUG, &virLogInitMessageStderr,
+                     msgs, nmsgs, metadata);
+    }
+}
+
+
+static void
+virLogQueuedMessageFree(virLogQueuedMessagePtr m)
+{
+    if (!m)
+        return;
+
+    VIR_FREE(m->str);
+    VIR_FREE(m->msg);
+    VIR_FREE(m);
+}
+
+
+/*
+ * Hand @entry over to the logger thread. On success the strings of
+ * @entry are owned by the queue.
+ *
+ * Returns 0 on success, -1 if the message has to be emitted synchronously.
+ */
+static int
+virLogEnqueue(virLogQueuedMessagePtr entry)
+{
+    virLogQueuedMessagePtr copy;
+    int ret = -1;
+
+    if (VIR_ALLOC_QUIET(copy) < 0)
+        return -1;
+    *copy = *entry;
+
+    virMutexLock(&virLogQueueMutex);
+    if (virLogAsync && virLogQueueCount < VIR_LOG_QUEUE_MAX) {
+        size_t tail = (virLogQueueHead + virLogQueueCount) % VIR_LOG_QUEUE_MAX;
+
+        virLogQueue[tail] = copy;
+        if (virLogQueueCount++ == 0)
+            virCondSignal(&virLogQueueCond);
+        ret = 0;
+    }
+    virMutexUnlock(&virLogQueueMutex);
+
+    if (ret < 0) {
+        VIR_FREE(copy);
+    } else {
+        entry->str = NULL;
+        entry->msg = NULL;
+    }
+    return ret;
+}
+
+
+/*
+ * Emit all queued messages. Must be called with virLogMutex held, which
+ * guarantees that messages are emitted in the order they were queued.
+ */
+static void
+virLogFlushQueue(void)
+{
+    size_t nmsgs;
+    size_t i;
+
+    /* A forked child must not touch the parent's queue */
+    if (virLogAsyncPid != getpid())
+        return;
+
+    virMutexLock(&virLogQueueMutex);
+    for (nmsgs = 0; nmsgs < virLogQueueCount; nmsgs++)
+        virLogBatch[nmsgs] = virLogQueue[(virLogQueueHead + nmsgs) % VIR_LOG_QUEUE_MAX];
+    virLogQueueHead = (virLogQueueHead + nmsgs) % VIR_LOG_QUEUE_MAX;
+    virLogQueueCount = 0;
+    virMutexUnlock(&virLogQueueMutex);
+
+    if (nmsgs == 0)
+        return;
+
+    virLogEmit(virLogBatch, nmsgs, NULL);
+
+    for (i = 0; i < nmsgs; i++) {
+        virLogQueuedMessageFree(virLogBatch[i]);
+        virLogBatch[i] = NULL;
+    }
+}
+
+
+static void
+virLogThreadMain(void *opaque ATTRIBUTE_UNUSED)
+{
+    virMutexLock(&virLogQueueMutex);
+    while (true) {
+        while (virLogQueueCount == 0 && !virLogQueueQuit)
+            ignore_value(virCondWait(&virLogQueueCond, &virLogQueueMutex));
+
+        if (virLogQueueCount == 0)
+            break;
+        virMutexUnlock(&virLogQueueMutex);
+
+        virLogLock();
+        virLogFlushQueue();
+        virLogUnlock();
+
+        virMutexLock(&virLogQueueMutex);
+    }
+    virMutexUnlock(&virLogQueueMutex);
+}
+
+
+/**
+ * virLogSetAsync:
+ * @async: whether messages should be emitted by a dedicated thread
+ *
+ * When enabled, messages below VIR_LOG_ERROR are queued and written
+ * to the outputs by a logger thread, so that threads logging heavily
+ * don't serialize on the outputs. Errors, messages with metadata and
+ * messages requiring a stack trace are still emitted synchronously,
+ * after flushing the queue. Disabling flushes the queue and stops the
+ * logger thread, which should be done before the process exits.
+ *
+ * Returns 0 if successful, -1 in case of error.
+ */
+int
+virLogSetAsync(bool async)
+{
+    if (virLogInitialize() < 0)
+        return -1;
+
+    if (async == virLogAsync)
+        return 0;
+
+    if (async) {
+        virLogQueueQuit = false;
+        virLogAsyncPid = getpid();
+        if (virThreadCreate(&virLogThread, true, virLogThreadMain, NULL) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create logger thread"));
+            return -1;
+        }
+    }
+
+    virLogLock();
+    virMutexLock(&virLogQueueMutex);
+    virLogAsync = async;
+    if (!async) {
+        virLogQueueQuit = true;
+        virCondSignal(&virLogQueueCond);
+    }
+    virMutexUnlock(&virLogQueueMutex);
+    virLogUnlock();
+
+    if (!async)
+        virThreadJoin(&virLogThread);
+
+    return 0;
+}
+
 /**
  * virLogMessage:
  * @source: where is that message coming from
@@ -576,14 +913,11 @@ virLogVMessage(virLogSourcePtr source,
                const char *fmt,
                va_list vargs)
 {
-    static bool logInitMessageStderr = true;
-    char *str = NULL;
-    char *msg = NULL;
-    char timestamp[VIR_TIME_STRING_BUFLEN];
-    int ret;
-    size_t i;
+    virLogQueuedMessage entry;
+    virLogQueuedMessagePtr entryPtr = &entry;
     int saved_errno = errno;
-    unsigned int filterflags = 0;
+
+    memset(&entry, 0, sizeof(entry));
 
     if (virLogInitialize() < 0)
         return;
@@ -603,84 +937,43 @@ virLogVMessage(virLogSourcePtr source,
         virLogSourceUpdate(source);
     if (priority < source->priority)
         goto cleanup;
-    filterflags = source->flags;
+
+    entry.source = source;
+    entry.priority = priority;
+    entry.filename = filename;
+    entry.linenr = linenr;
+    entry.funcname = funcname;
+    entry.flags = source->flags;
 
     /*
      * serialize the error message, add level and timestamp
      */
-    if (virVasprintfQuiet(&str, fmt, vargs) < 0)
+    if (virVasprintfQuiet(&entry.str, fmt, vargs) < 0)
         goto cleanup;
 
-    ret = virLogFormatString(&msg, linenr, funcname, priority, str);
-    if (ret < 0)
+    if (virLogFormatString(&entry.msg, linenr, funcname, priority, entry.str) < 0)
         goto cleanup;
 
-    if (virTimeStringNowRaw(timestamp) < 0)
-        timestamp[0] = '\0';
+    if (virTimeStringNowRaw(entry.timestamp) < 0)
+        entry.timestamp[0] = '\0';
 
-    virLogLock();
+    /* Same as above, virLogAsync is only read unlocked as a hint */
+    if (virLogAsync &&
+        priority < VIR_LOG_ERROR &&
+        !metadata &&
+        !(entry.flags & VIR_LOG_STACK_TRACE) &&
+        virLogAsyncPid == getpid() &&
+        virLogEnqueue(&entry) == 0)
+        goto cleanup;
 
-    /*
-     * Push the message to the outputs defined, if none exist then
-     * use stderr.
-     */
-    for (i = 0; i < virLogNbOutputs; i++) {
-        if (priority >= virLogOutputs[i]->priority) {
-            if (virLogOutputs[i]->logInitMessage) {
-                const char *rawinitmsg;
-                char *hoststr = NULL;
-                char *initmsg = NULL;
-                if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                        __FILE__, __LINE__, __func__,
-                                        timestamp, NULL, 0, rawinitmsg, initmsg,
-                                        virLogOutputs[i]->data);
-                VIR_FREE(initmsg);
-                if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                    virLogOutputs[i]->f(&virLogSelf, VIR_LOG_INFO,
-                                        __FILE__, __LINE__, __func__,
-                                        timestamp, NULL, 0, hoststr, initmsg,
-                                        virLogOutputs[i]->data);
-                VIR_FREE(hoststr);
-                VIR_FREE(initmsg);
-                virLogOutputs[i]->logInitMessage = false;
-            }
-            virLogOutputs[i]->f(source, priority,
-                                filename, linenr, funcname,
-                                timestamp, metadata, filterflags,
-                                str, msg, virLogOutputs[i]->data);
-        }
-    }
-    if (virLogNbOutputs == 0) {
-        if (logInitMessageStderr) {
-            const char *rawinitmsg;
-            char *hoststr = NULL;
-            char *initmsg = NULL;
-            if (virLogVersionString(&rawinitmsg, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, rawinitmsg, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(initmsg);
-            if (virLogHostnameString(&hoststr, &initmsg) >= 0)
-                virLogOutputToFd(&virLogSelf, VIR_LOG_INFO,
-                                 __FILE__, __LINE__, __func__,
-                                 timestamp, NULL, 0, hoststr, initmsg,
-                                 (void *) STDERR_FILENO);
-            VIR_FREE(hoststr);
-            VIR_FREE(initmsg);
-            logInitMessageStderr = false;
-        }
-        virLogOutputToFd(source, priority,
-                         filename, linenr, funcname,
-                         timestamp, metadata, filterflags,
-                         str, msg, (void *) STDERR_FILENO);
-    }
+    virLogLock();
+    virLogFlushQueue();
+    virLogEmit(&entryPtr, 1, metadata);
     virLogUnlock();
 
  cleanup:
-    VIR_FREE(str);
-    VIR_FREE(msg);
+    VIR_FREE(entry.str);
+    VIR_FREE(entry.msg);
     errno = saved_errno;
 }
 
@@ -752,6 +1045,171 @@ virLogNewOutputToStderr(virLogPriority priority)
 }
 
 
+/*
+ * The buffer output keeps the most recent messages in memory, to be
+ * fetched with virLogGetBuffer. Its size is limited by what fits into
+ * a single RPC string.
+ */
+#define VIR_LOG_BUFFER_MIN 4096
+#define VIR_LOG_BUFFER_MAX (4 * 1024 * 1024 - 1)
+
+typedef struct _virLogBuffer virLogBuffer;
+typedef virLogBuffer *virLogBufferPtr;
+struct _virLogBuffer {
+    char *data;
+    size_t size;
+    size_t pos;         /* where the next byte is stored */
+    bool wrapped;       /* whether the whole buffer is in use */
+};
+
+
+static void
+virLogBufferAppend(virLogBufferPtr buf,
+                   const char *str,
+                   size_t len)
+{
+    while (len > 0) {
+        size_t n = MIN(len, buf->size - buf->pos);
+
+        memcpy(buf->data + buf->pos, str, n);
+        str += n;
+        len -= n;
+        buf->pos += n;
+
+        if (buf->pos == buf->size) {
+            buf->pos = 0;
+            buf->wrapped = true;
+        }
+    }
+}
+
+
+/* Always called with virLogMutex held, so no further locking is needed */
+static void
+virLogOutputToBuffer(virLogSourcePtr source ATTRIBUTE_UNUSED,
+                     virLogPriority priority ATTRIBUTE_UNUSED,
+                     const char *filename ATTRIBUTE_UNUSED,
+                     int linenr ATTRIBUTE_UNUSED,
+                     const char *funcname ATTRIBUTE_UNUSED,
+                     const char *timestamp,
+                     virLogMetadataPtr metadata ATTRIBUTE_UNUSED,
+                     unsigned int flags ATTRIBUTE_UNUSED,
+                     const char *rawstr ATTRIBUTE_UNUSED,
+                     const char *str,
+                     void *data)
+{
+    virLogBufferPtr buf = data;
+
+    virLogBufferAppend(buf, timestamp, strlen(timestamp));
+    virLogBufferAppend(buf, ": ", 2);
+    virLogBufferAppend(buf, str, strlen(str));
+}
+
+
+static void
+virLogCloseBuffer(void *data)
+{
+    virLogBufferPtr buf = data;
+
+    if (!buf)
+        return;
+
+    VIR_FREE(buf->data);
+    VIR_FREE(buf);
+}
+
+
+static virLogOutputPtr
+virLogNewOutputToBuffer(virLogPriority priority,
+                        const char *size)
+{
+    virLogBufferPtr buf = NULL;
+    virLogOutputPtr ret = NULL;
+    unsigned int bytes;
+
+    if (virStrToLong_uip(size, NULL, 10, &bytes) < 0 ||
+        bytes < VIR_LOG_BUFFER_MIN || bytes > VIR_LOG_BUFFER_MAX) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Invalid log buffer size '%s', must be between "
+                         "%u and %u bytes"),
+                       size, VIR_LOG_BUFFER_MIN, VIR_LOG_BUFFER_MAX);
+        return NULL;
+    }
+
+    if (VIR_ALLOC(buf) < 0 ||
+        VIR_ALLOC_N(buf->data, bytes) < 0)
+        goto error;
+    buf->size = bytes;
+
+    if (!(ret = virLogOutputNew(virLogOutputToBuffer, virLogCloseBuffer,
+                                buf, priority, VIR_LOG_TO_BUFFER, size)))
+        goto error;
+
+    return ret;
+
+ error:
+    virLogCloseBuffer(buf);
+    return NULL;
+}
+
+
+/**
+ * virLogGetBuffer:
+ *
+ * Fetch the messages recorded by the buffer output, oldest first. If
+ * older messages were overwritten already, the partially overwritten
+ * message is skipped.
+ *
+ * Returns the messages, or NULL if no buffer output is defined or in
+ * case of error.
+ */
+char *
+virLogGetBuffer(void)
+{
+    virLogBufferPtr buf = NULL;
+    char *ret = NULL;
+    size_t i;
+
+    if (virLogInitialize() < 0)
+        return NULL;
+
+    /* Reporting errors logs too, so don't do that with the lock held */
+    virLogLock();
+    virLogFlushQueue();
+
+    for (i = 0; i < virLogNbOutputs; i++) {
+        if (virLogOutputs[i]->dest == VIR_LOG_TO_BUFFER) {
+            buf = virLogOutputs[i]->data;
+            break;
+        }
+    }
+
+    if (buf && VIR_ALLOC_N_QUIET(ret, buf->size + 1) == 0) {
+        if (buf->wrapped) {
+            char *nl;
+
+            memcpy(ret, buf->data + buf->pos, buf->size - buf->pos);
+            memcpy(ret + buf->size - buf->pos, buf->data, buf->pos);
+
+            if ((nl = strchr(ret, '\n')))
+                memmove(ret, nl + 1, strlen(nl + 1) + 1);
+        } else {
+            memcpy(ret, buf->data, buf->pos);
+        }
+    }
+    virLogUnlock();
+
+    if (!buf) {
+        virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                       _("no buffer logging output is defined"));
+    } else if (!ret) {
+        virReportOOMError();
+    }
+
+    return ret;
+}
+
+
 static virLogOutputPtr
 virLogNewOutputToFile(virLogPriority priority,
                       const char *file)
@@ -1199,6 +1657,7 @@ virLogGetOutputs(void)
         switch (dest) {
             case VIR_LOG_TO_SYSLOG:
             case VIR_LOG_TO_FILE:
+            case VIR_LOG_TO_BUFFER:
                 virBufferAsprintf(&outputbuf, "%d:%s:%s",
                                   virLogOutputs[i]->priority,
                                   virLogDestinationTypeToString(dest),
@@ -1355,7 +1814,8 @@ virLogOutputNew(virLogOutputFunc f,
     virLogOutputPtr ret = NULL;
     char *ndup = NULL;
 
-    if (dest == VIR_LOG_TO_SYSLOG || dest == VIR_LOG_TO_FILE) {
+    if (dest == VIR_LOG_TO_SYSLOG || dest == VIR_LOG_TO_FILE ||
+        dest == VIR_LOG_TO_BUFFER) {
         if (!name) {
             virReportError(VIR_ERR_INVALID_ARG, "%s",
                            _("Missing auxiliary data in output definition"));
@@ -1611,7 +2071,8 @@ virLogParseOutput(const char *src)
     if (((dest == VIR_LOG_TO_STDERR ||
           dest == VIR_LOG_TO_JOURNALD) && count != 2) ||
         ((dest == VIR_LOG_TO_FILE ||
-          dest == VIR_LOG_TO_SYSLOG) && count != 3)) {
+          dest == VIR_LOG_TO_SYSLOG ||
+          dest == VIR_LOG_TO_BUFFER) && count != 3)) {
         virReportError(VIR_ERR_INVALID_ARG,
                        _("Output '%s' does not meet the format requirements "
                          "for destination type '%s'"), src, tokens[1]);
@@ -1646,6 +2107,9 @@ virLogParseOutput(const char *src)
         ret = virLogNewOutputToJournald(prio);
 #endif
         break;
+    case VIR_LOG_TO_BUFFER:
+        ret = virLogNewOutputToBuffer(prio, tokens[2]);
+        break;
     case VIR_LOG_TO_OUTPUT_LAST:
         break;
     }
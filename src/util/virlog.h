@@ -55,6 +55,7 @@ typedef enum {
     VIR_LOG_TO_SYSLOG,
     VIR_LOG_TO_FILE,
     VIR_LOG_TO_JOURNALD,
+    VIR_LOG_TO_BUFFER,
     VIR_LOG_TO_OUTPUT_LAST,
 } virLogDestination;
 
@@ -191,6 +192,8 @@ int virLogSetOutputs(const char *outputs);
 int virLogSetFilters(const char *filters);
 char *virLogGetDefaultOutput(void);
 int virLogSetDefaultOutput(const char *fname, bool godaemon, bool privileged);
+int virLogSetAsync(bool async);
+char *virLogGetBuffer(void);
 
 /*
  * Internal logging API
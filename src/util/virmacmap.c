@@ -395,3 +395,29 @@ virMacMapDumpStr(virMacMapPtr mgr,
     virObjectUnlock(mgr);
     return ret;
 }
+
+
+/**
+ * virMacMapForEach:
+ * @mgr: mac map
+ * @iter: function called for each domain
+ * @opaque: data passed to @iter
+ *
+ * Call @iter for each domain in @mgr. The name passed to @iter is
+ * the domain name, the payload the NULL terminated list of its MAC
+ * addresses.
+ *
+ * Returns the number of domains iterated over, -1 on error.
+ */
+int
+virMacMapForEach(virMacMapPtr mgr,
+                 virHashIterator iter,
+                 void *opaque)
+{
+    int ret;
+
+    virObjectLock(mgr);
+    ret = virHashForEach(mgr->macs, iter, opaque);
+    virObjectUnlock(mgr);
+    return ret;
+}
@@ -24,6 +24,8 @@
 #ifndef __VIR_MACMAP_H__
 # define __VIR_MACMAP_H__
 
+# include "virhash.h"
+
 typedef struct virMacMap virMacMap;
 typedef virMacMap *virMacMapPtr;
 
@@ -49,4 +51,8 @@ int virMacMapWriteFile(virMacMapPtr mgr,
 
 int virMacMapDumpStr(virMacMapPtr mgr,
                      char **str);
+
+int virMacMapForEach(virMacMapPtr mgr,
+                     virHashIterator iter,
+                     void *opaque);
 #endif /* __VIR_MACMAPPING_H__ */
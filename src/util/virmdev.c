@@ -23,7 +23,9 @@
 #include "virlog.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virstring.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -53,6 +55,20 @@ VIR_ENUM_IMPL(virMediatedDeviceModel, VIR_MDEV_MODEL_TYPE_LAST,
 
 static virClassPtr virMediatedDeviceListClass;
 
+/*
+ * The attributes of mdev types are read for every PCI parent on each
+ * node device refresh and for every mdev a domain is started with,
+ * while the only one of them that ever changes is available_instances
+ * and that only changes when an mdev is created or removed. The table is
+ * only kept while somebody who is told about that (the udev node device
+ * driver) has enabled it and calls virMediatedDeviceTypeCacheInvalidate()
+ * on mdev udev events.
+ */
+#define VIR_MDEV_TYPE_CACHE_TABLE_SIZE 32
+
+static virMutex virMediatedDeviceTypeCacheLock;
+static virHashTablePtr virMediatedDeviceTypeCache; /* NULL while disabled */
+
 static void
 virMediatedDeviceListDispose(void *obj);
 
@@ -62,6 +78,12 @@ virMediatedOnceInit(void)
     if (!VIR_CLASS_NEW(virMediatedDeviceList, virClassForObjectLockable()))
         return -1;
 
+    if (virMutexInit(&virMediatedDeviceTypeCacheLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize mdev type cache mutex"));
+        return -1;
+    }
+
     return 0;
 }
 
@@ -73,30 +95,24 @@ static int
 virMediatedDeviceGetSysfsDeviceAPI(virMediatedDevicePtr dev,
                                    char **device_api)
 {
-    VIR_AUTOFREE(char *) buf = NULL;
-    VIR_AUTOFREE(char *) file = NULL;
-    char *tmp = NULL;
+    VIR_AUTOFREE(char *) link = NULL;
+    VIR_AUTOFREE(char *) typepath = NULL;
+    VIR_AUTOPTR(virMediatedDeviceType) type = NULL;
 
-    if (virAsprintf(&file, "%s/mdev_type/device_api", dev->path) < 0)
+    if (virAsprintf(&link, "%s/mdev_type", dev->path) < 0)
         return -1;
 
-    /* TODO - make this a generic method to access sysfs files for various
-     * kinds of devices
-     */
-    if (!virFileExists(file)) {
-        virReportSystemError(errno, _("failed to read '%s'"), file);
+    /* resolve the type, so that its attributes come from the same cache
+     * entry as when the parent device is enumerated */
+    if (virFileResolveLink(link, &typepath) < 0) {
+        virReportSystemError(errno, _("failed to resolve '%s'"), link);
         return -1;
     }
 
-    if (virFileReadAll(file, 1024, &buf) < 0)
+    if (virMediatedDeviceTypeReadAttrs(typepath, &type) < 0)
         return -1;
 
-    if ((tmp = strchr(buf, '\n')))
-        *tmp = '\0';
-
-    *device_api = buf;
-    buf = NULL;
-
+    VIR_STEAL_PTR(*device_api, type->device_api);
     return 0;
 }
 
@@ -488,11 +504,140 @@ virMediatedDeviceTypeFree(virMediatedDeviceTypePtr type)
 }
 
 
+static void
+virMediatedDeviceTypeCacheFree(void *payload,
+                               const void *name ATTRIBUTE_UNUSED)
+{
+    virMediatedDeviceTypeFree(payload);
+}
+
+
+static virMediatedDeviceTypePtr
+virMediatedDeviceTypeCopy(const virMediatedDeviceType *src)
+{
+    VIR_AUTOPTR(virMediatedDeviceType) dst = NULL;
+    virMediatedDeviceTypePtr ret;
+
+    if (VIR_ALLOC(dst) < 0 ||
+        VIR_STRDUP(dst->id, src->id) < 0 ||
+        VIR_STRDUP(dst->name, src->name) < 0 ||
+        VIR_STRDUP(dst->device_api, src->device_api) < 0)
+        return NULL;
+    dst->available_instances = src->available_instances;
+
+    VIR_STEAL_PTR(ret, dst);
+    return ret;
+}
+
+
+/* Returns 1 and a copy of the cached type in @type, 0 if the cache is
+ * disabled or doesn't know @sysfspath, -1 on error */
+static int
+virMediatedDeviceTypeCacheGet(const char *sysfspath,
+                              virMediatedDeviceTypePtr *type)
+{
+    virMediatedDeviceTypePtr cached;
+    int ret = 0;
+
+    if (virMediatedInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virMediatedDeviceTypeCacheLock);
+    if (virMediatedDeviceTypeCache &&
+        (cached = virHashLookup(virMediatedDeviceTypeCache, sysfspath)))
+        ret = (*type = virMediatedDeviceTypeCopy(cached)) ? 1 : -1;
+    virMutexUnlock(&virMediatedDeviceTypeCacheLock);
+
+    return ret;
+}
+
+
+static void
+virMediatedDeviceTypeCacheSet(const char *sysfspath,
+                              const virMediatedDeviceType *type)
+{
+    virMediatedDeviceTypePtr copy;
+
+    virMutexLock(&virMediatedDeviceTypeCacheLock);
+    if (virMediatedDeviceTypeCache &&
+        (copy = virMediatedDeviceTypeCopy(type)) &&
+        virHashUpdateEntry(virMediatedDeviceTypeCache, sysfspath, copy) < 0) {
+        virMediatedDeviceTypeFree(copy);
+    }
+    /* not caching is never fatal */
+    virResetLastError();
+    virMutexUnlock(&virMediatedDeviceTypeCacheLock);
+}
+
+
+/**
+ * virMediatedDeviceTypeCacheSetEnabled:
+ * @enabled: whether to cache the attributes of mdev types
+ *
+ * Enable or disable caching of mdev type attributes read from sysfs.
+ * Whoever enables the cache has to call
+ * virMediatedDeviceTypeCacheInvalidate() whenever mediated devices are
+ * created or removed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virMediatedDeviceTypeCacheSetEnabled(bool enabled)
+{
+    int ret = -1;
+
+    if (virMediatedInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virMediatedDeviceTypeCacheLock);
+
+    if (!enabled) {
+        virHashFree(virMediatedDeviceTypeCache);
+        virMediatedDeviceTypeCache = NULL;
+    } else if (!virMediatedDeviceTypeCache &&
+               !(virMediatedDeviceTypeCache =
+                 virHashCreate(VIR_MDEV_TYPE_CACHE_TABLE_SIZE,
+                               virMediatedDeviceTypeCacheFree))) {
+        goto cleanup;
+    }
+
+    VIR_DEBUG("mdev type cache %s", enabled ? "enabled" : "disabled");
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virMediatedDeviceTypeCacheLock);
+    return ret;
+}
+
+
+/**
+ * virMediatedDeviceTypeCacheInvalidate:
+ *
+ * Drop all cached mdev type attributes, so that they're read again
+ * from sysfs the next time they're needed.
+ */
+void
+virMediatedDeviceTypeCacheInvalidate(void)
+{
+    if (virMediatedInitialize() < 0)
+        return;
+
+    virMutexLock(&virMediatedDeviceTypeCacheLock);
+    if (virMediatedDeviceTypeCache)
+        virHashRemoveAll(virMediatedDeviceTypeCache);
+    virMutexUnlock(&virMediatedDeviceTypeCacheLock);
+}
+
+
 int
 virMediatedDeviceTypeReadAttrs(const char *sysfspath,
                                virMediatedDeviceTypePtr *type)
 {
     VIR_AUTOPTR(virMediatedDeviceType) tmp = NULL;
+    int cached;
+
+    if ((cached = virMediatedDeviceTypeCacheGet(sysfspath, type)) != 0)
+        return cached < 0 ? -1 : 0;
 
 #define MDEV_GET_SYSFS_ATTR(attr, dst, cb, optional) \
     do { \
@@ -518,6 +663,8 @@ virMediatedDeviceTypeReadAttrs(const char *sysfspath,
 
 #undef MDEV_GET_SYSFS_ATTR
 
+    virMediatedDeviceTypeCacheSet(sysfspath, tmp);
+
     VIR_STEAL_PTR(*type, tmp);
 
     return 0;
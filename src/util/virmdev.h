@@ -137,6 +137,12 @@ int
 virMediatedDeviceTypeReadAttrs(const char *sysfspath,
                                virMediatedDeviceTypePtr *type);
 
+int
+virMediatedDeviceTypeCacheSetEnabled(bool enabled);
+
+void
+virMediatedDeviceTypeCacheInvalidate(void);
+
 VIR_DEFINE_AUTOPTR_FUNC(virMediatedDevice, virMediatedDeviceFree)
 VIR_DEFINE_AUTOPTR_FUNC(virMediatedDeviceType, virMediatedDeviceTypeFree)
 
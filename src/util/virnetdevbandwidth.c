@@ -23,15 +23,55 @@
 #include <config.h>
 #include <unistd.h>
 
-#include "virnetdevbandwidth.h"
+#define __VIR_NETDEV_BANDWIDTH_PRIV_H_ALLOW__
+#include "virnetdevbandwidthpriv.h"
 #include "vircommand.h"
 #include "viralloc.h"
 #include "virerror.h"
+#include "virlog.h"
 #include "virstring.h"
 #include "virutil.h"
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+# include <linux/if_ether.h>
+# include <linux/pkt_cls.h>
+# include <linux/pkt_sched.h>
+
+# include "virnetdev.h"
+# include "virnetlink.h"
+#endif
+
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.netdevbandwidth");
+
+static virNetDevBandwidthBackend currentBackend = VIR_NETDEV_BANDWIDTH_BACKEND_AUTOMATIC;
+
+int
+virNetDevBandwidthSetBackend(virNetDevBandwidthBackend backend)
+{
+#if !defined(__linux__) || !defined(HAVE_LIBNL)
+    if (backend == VIR_NETDEV_BANDWIDTH_BACKEND_NETLINK) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("netlink traffic control backend is not available"));
+        return -1;
+    }
+#endif
+
+    currentBackend = backend;
+    return 0;
+}
+
+static bool
+virNetDevBandwidthUseNetlink(void)
+{
+#if defined(__linux__) && defined(HAVE_LIBNL)
+    return currentBackend != VIR_NETDEV_BANDWIDTH_BACKEND_TC;
+#else
+    return false;
+#endif
+}
+
 void
 virNetDevBandwidthFree(virNetDevBandwidthPtr def)
 {
@@ -43,9 +83,8 @@ virNetDevBandwidthFree(virNetDevBandwidthPtr def)
     VIR_FREE(def);
 }
 
-static void
-virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
-                                       const virNetDevBandwidthRate *rate)
+static unsigned long long
+virNetDevBandwidthOptimalQuantum(const virNetDevBandwidthRate *rate)
 {
     const unsigned long long mtu = 1500;
     unsigned long long r2q;
@@ -62,10 +101,756 @@ virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
     if (!r2q)
         r2q = 1;
 
+    return r2q;
+}
+
+static void
+virNetDevBandwidthCmdAddOptimalQuantum(virCommandPtr cmd,
+                                       const virNetDevBandwidthRate *rate)
+{
     virCommandAddArg(cmd, "quantum");
-    virCommandAddArgFormat(cmd, "%llu", r2q);
+    virCommandAddArgFormat(cmd, "%llu",
+                           virNetDevBandwidthOptimalQuantum(rate));
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/* The tc command line counts rates in 'kbps' (1000 bytes per
+ * second) and sizes in 'kb' (1024 bytes); stick to the same units
+ * so that both backends set up exactly the same hierarchy. */
+# define VIR_NETDEV_BANDWIDTH_RATE_UNIT 1000ULL
+# define VIR_NETDEV_BANDWIDTH_SIZE_UNIT 1024ULL
+
+/* Default HTB burst when none is given, as tc computes it on
+ * kernels with high resolution timers. */
+# define VIR_NETDEV_BANDWIDTH_HTB_MTU 1600
+
+/* The maximum packet size accepted by the ingress policer. */
+# define VIR_NETDEV_BANDWIDTH_POLICE_MTU (64 * 1024)
+
+/* Packet scheduler time is expressed in ticks of 64ns
+ * (PSCHED_SHIFT), which is what tc reads from /proc/net/psched. */
+# define VIR_NETDEV_BANDWIDTH_TICK_NS 64
+
+# define VIR_NETDEV_BANDWIDTH_HANDLE(maj, min) \
+    TC_H_MAKE((maj) << 16, (min))
+
+/* u32 filter handles are written as "800::%u" on the tc command
+ * line, but tc parses the node ID as hexadecimal. Compute the very
+ * same handle so that filters created by either backend can be
+ * found by the other. */
+static int
+virNetDevBandwidthNLFilterHandle(unsigned int id,
+                                 uint32_t *handle)
+{
+    unsigned int node = 0;
+    unsigned int shift = 0;
+
+    /* tc refuses node IDs that don't fit into 12 bits */
+    if (id >= 1000) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("filter ID %u is out of range"), id);
+        return -1;
+    }
+
+    do {
+        node |= (id % 10) << shift;
+        shift += 4;
+        id /= 10;
+    } while (id);
+
+    *handle = (0x800U << 20) | node;
+    return 0;
+}
+
+/* Time it takes to send @size bytes at @rate bytes per second */
+static uint32_t
+virNetDevBandwidthNLXmitTime(uint32_t rate,
+                             unsigned long long size)
+{
+    double ticks;
+
+    if (!rate)
+        return 0;
+
+    ticks = (double) size * 1000000000 / rate / VIR_NETDEV_BANDWIDTH_TICK_NS;
+    if (ticks >= UINT32_MAX)
+        return UINT32_MAX;
+
+    return ticks;
+}
+
+static uint32_t
+virNetDevBandwidthNLRate(unsigned long long kbps)
+{
+    if (kbps >= UINT32_MAX / VIR_NETDEV_BANDWIDTH_RATE_UNIT)
+        return UINT32_MAX;
+
+    return kbps * VIR_NETDEV_BANDWIDTH_RATE_UNIT;
+}
+
+/* Fill in the rate table older kernels need to compute
+ * transmission times, the same way tc does. */
+static void
+virNetDevBandwidthNLCalcRateTable(struct tc_ratespec *rate,
+                                  uint32_t *rtab,
+                                  unsigned int mtu)
+{
+    unsigned int cell_log = 0;
+    size_t i;
+
+    while ((mtu >> cell_log) > 255)
+        cell_log++;
+
+    for (i = 0; i < TC_RTAB_SIZE / sizeof(*rtab); i++)
+        rtab[i] = virNetDevBandwidthNLXmitTime(rate->rate,
+                                               (i + 1) << cell_log);
+
+    rate->cell_align = -1;
+    rate->cell_log = cell_log;
+}
+
+static struct nl_msg *
+virNetDevBandwidthNLMsgNew(int type,
+                           unsigned int flags,
+                           int ifindex,
+                           uint32_t parent,
+                           uint32_t handle,
+                           uint32_t info,
+                           const char *kind)
+{
+    struct tcmsg tcm = {
+        .tcm_family = AF_UNSPEC,
+        .tcm_ifindex = ifindex,
+        .tcm_parent = parent,
+        .tcm_handle = handle,
+        .tcm_info = info,
+    };
+    struct nl_msg *nl_msg;
+
+    if (!(nl_msg = nlmsg_alloc_simple(type, NLM_F_REQUEST | flags))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &tcm, sizeof(tcm), NLMSG_ALIGNTO) < 0 ||
+        (kind && nla_put_string(nl_msg, TCA_KIND, kind) < 0)) {
+        nlmsg_free(nl_msg);
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    return nl_msg;
+}
+
+/**
+ * virNetDevBandwidthNLCommand:
+ * @ifname: interface the message applies to
+ * @nl_msg: traffic control message
+ * @ignore_errors: whether the kernel refusing the request is fatal
+ *
+ * Send @nl_msg to the kernel and wait for its acknowledgement.
+ * Deleting objects which are not there is not an error for the tc
+ * backend either, so callers removing things set @ignore_errors.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthNLCommand(const char *ifname,
+                            struct nl_msg *nl_msg,
+                            bool ignore_errors)
+{
+    unsigned int buflen;
+    int error;
+    VIR_AUTOFREE(struct nlmsghdr *) resp = NULL;
+
+    if (virNetlinkCommand(nl_msg, &resp, &buflen, 0, 0, NETLINK_ROUTE, 0) < 0)
+        return -1;
+
+    if ((error = virNetlinkGetErrorCode(resp, buflen)) < 0) {
+        if (ignore_errors) {
+            VIR_DEBUG("Ignoring traffic control error on '%s': %d",
+                      ifname, error);
+            virResetLastError();
+            return 0;
+        }
+
+        virReportSystemError(-error,
+                             _("unable to set up traffic control on '%s'"),
+                             ifname);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int
+virNetDevBandwidthNLQdiscDel(const char *ifname,
+                             int ifindex,
+                             uint32_t parent,
+                             uint32_t handle)
+{
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_DELQDISC, 0, ifindex,
+                                              parent, handle, 0, NULL)))
+        return -1;
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, true);
+}
+
+/**
+ * virNetDevBandwidthNLQdiscAdd:
+ * @ifname: interface name
+ * @ifindex: index of @ifname
+ * @parent: handle of parent class
+ * @handle: handle of the new qdisc
+ * @kind: qdisc type
+ * @opttype: attribute to nest @opt in, or 0 to pass @opt as is
+ * @opt: qdisc options (may be NULL)
+ * @optlen: size of @opt
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthNLQdiscAdd(const char *ifname,
+                             int ifindex,
+                             uint32_t parent,
+                             uint32_t handle,
+                             const char *kind,
+                             int opttype,
+                             const void *opt,
+                             size_t optlen)
+{
+    struct nlattr *options;
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_NEWQDISC,
+                                              NLM_F_CREATE | NLM_F_EXCL,
+                                              ifindex, parent, handle,
+                                              0, kind)))
+        return -1;
+
+    if (opt && !opttype) {
+        if (nla_put(nl_msg, TCA_OPTIONS, optlen, opt) < 0)
+            goto buffer_too_small;
+    } else if (opt) {
+        if (!(options = nla_nest_start(nl_msg, TCA_OPTIONS)) ||
+            nla_put(nl_msg, opttype, optlen, opt) < 0)
+            goto buffer_too_small;
+        nla_nest_end(nl_msg, options);
+    }
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, false);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLQdiscAddHTB(const char *ifname,
+                                int ifindex,
+                                uint32_t defcls)
+{
+    struct tc_htb_glob glob = {
+        .version = TC_HTB_PROTOVER,
+        .rate2quantum = 10,
+        .defcls = defcls,
+    };
+
+    return virNetDevBandwidthNLQdiscAdd(ifname, ifindex, TC_H_ROOT,
+                                        VIR_NETDEV_BANDWIDTH_HANDLE(1, 0),
+                                        "htb", TCA_HTB_INIT,
+                                        &glob, sizeof(glob));
+}
+
+static int
+virNetDevBandwidthNLQdiscAddSFQ(const char *ifname,
+                                int ifindex,
+                                uint32_t parent,
+                                uint32_t handle)
+{
+    struct tc_sfq_qopt opt = { .perturb_period = 10 };
+
+    return virNetDevBandwidthNLQdiscAdd(ifname, ifindex, parent, handle,
+                                        "sfq", 0, &opt, sizeof(opt));
 }
 
+/**
+ * virNetDevBandwidthNLClass:
+ * @ifname: interface name
+ * @ifindex: index of @ifname
+ * @create: whether to create a new class or change an existing one
+ * @parent: handle of parent class
+ * @classid: handle of the class
+ * @rate: guaranteed rate in kbytes/s
+ * @ceil: maximum rate in kbytes/s (0 for @rate)
+ * @burst: burst size in kbytes (0 for default)
+ * @quantum: class quantum
+ *
+ * Create or change the HTB class @classid.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthNLClass(const char *ifname,
+                          int ifindex,
+                          bool create,
+                          uint32_t parent,
+                          uint32_t classid,
+                          unsigned long long rate,
+                          unsigned long long ceil,
+                          unsigned long long burst,
+                          unsigned long long quantum)
+{
+    struct tc_htb_opt opt = { 0 };
+    uint32_t rtab[TC_RTAB_SIZE / sizeof(uint32_t)];
+    uint32_t ctab[TC_RTAB_SIZE / sizeof(uint32_t)];
+    struct nlattr *options;
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    opt.rate.rate = virNetDevBandwidthNLRate(rate);
+    opt.ceil.rate = virNetDevBandwidthNLRate(ceil ? ceil : rate);
+    opt.buffer = virNetDevBandwidthNLXmitTime(opt.rate.rate,
+                                              burst ?
+                                              burst * VIR_NETDEV_BANDWIDTH_SIZE_UNIT :
+                                              VIR_NETDEV_BANDWIDTH_HTB_MTU);
+    opt.cbuffer = virNetDevBandwidthNLXmitTime(opt.ceil.rate,
+                                               VIR_NETDEV_BANDWIDTH_HTB_MTU);
+    opt.quantum = MIN(quantum, UINT32_MAX);
+
+    virNetDevBandwidthNLCalcRateTable(&opt.rate, rtab,
+                                      VIR_NETDEV_BANDWIDTH_HTB_MTU);
+    virNetDevBandwidthNLCalcRateTable(&opt.ceil, ctab,
+                                      VIR_NETDEV_BANDWIDTH_HTB_MTU);
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_NEWTCLASS,
+                                              create ?
+                                              NLM_F_CREATE | NLM_F_EXCL : 0,
+                                              ifindex, parent, classid,
+                                              0, "htb")))
+        return -1;
+
+    if (!(options = nla_nest_start(nl_msg, TCA_OPTIONS)) ||
+        nla_put(nl_msg, TCA_HTB_PARMS, sizeof(opt), &opt) < 0 ||
+        nla_put(nl_msg, TCA_HTB_RTAB, sizeof(rtab), rtab) < 0 ||
+        nla_put(nl_msg, TCA_HTB_CTAB, sizeof(ctab), ctab) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return -1;
+    }
+    nla_nest_end(nl_msg, options);
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, false);
+}
+
+static int
+virNetDevBandwidthNLClassDel(const char *ifname,
+                             int ifindex,
+                             uint32_t classid)
+{
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_DELTCLASS, 0, ifindex,
+                                              0, classid, 0, NULL)))
+        return -1;
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, true);
+}
+
+/* Put the given 32 bits wide key into @sel, just like tc's 'match u32'
+ * and 'match u16' selectors do. */
+static void
+virNetDevBandwidthNLU32Key(struct tc_u32_sel *sel,
+                           uint32_t val,
+                           uint32_t mask,
+                           int off)
+{
+    struct tc_u32_key *key = &sel->keys[sel->nkeys++];
+
+    key->val = htonl(val);
+    key->mask = htonl(mask);
+    key->off = off;
+}
+
+/**
+ * virNetDevBandwidthNLFilterAdd:
+ * @ifname: interface name
+ * @ifindex: index of @ifname
+ * @parent: handle of qdisc to attach the filter to
+ * @prio: filter priority
+ * @protocol: filter protocol (host byte order)
+ * @handle: filter handle
+ * @kind: filter type, "fw" or "u32"
+ * @classid: where to place the traffic
+ * @sel: u32 selector (NULL for fw filter)
+ * @police: ingress policer parameters (may be NULL)
+ * @rtab: rate table for @police
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+static int
+virNetDevBandwidthNLFilterAdd(const char *ifname,
+                              int ifindex,
+                              uint32_t parent,
+                              unsigned int prio,
+                              unsigned int protocol,
+                              uint32_t handle,
+                              const char *kind,
+                              uint32_t classid,
+                              const struct tc_u32_sel *sel,
+                              const struct tc_police *police,
+                              const uint32_t *rtab)
+{
+    struct nlattr *options;
+    struct nlattr *nest;
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_NEWTFILTER,
+                                              NLM_F_CREATE | NLM_F_EXCL,
+                                              ifindex, parent, handle,
+                                              TC_H_MAKE(prio << 16,
+                                                        htons(protocol)),
+                                              kind)))
+        return -1;
+
+    if (!(options = nla_nest_start(nl_msg, TCA_OPTIONS)))
+        goto buffer_too_small;
+
+    if (!sel) {
+        if (nla_put_u32(nl_msg, TCA_FW_CLASSID, classid) < 0)
+            goto buffer_too_small;
+    } else {
+        if (nla_put(nl_msg, TCA_U32_SEL,
+                    sizeof(*sel) + sel->nkeys * sizeof(sel->keys[0]),
+                    sel) < 0 ||
+            nla_put_u32(nl_msg, TCA_U32_CLASSID, classid) < 0)
+            goto buffer_too_small;
+
+        if (police) {
+            if (!(nest = nla_nest_start(nl_msg, TCA_U32_POLICE)) ||
+                nla_put(nl_msg, TCA_POLICE_TBF, sizeof(*police), police) < 0 ||
+                nla_put(nl_msg, TCA_POLICE_RATE, TC_RTAB_SIZE, rtab) < 0)
+                goto buffer_too_small;
+            nla_nest_end(nl_msg, nest);
+        }
+    }
+
+    nla_nest_end(nl_msg, options);
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, false);
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLFilterDel(const char *ifname,
+                              int ifindex,
+                              unsigned int prio,
+                              uint32_t handle)
+{
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = virNetDevBandwidthNLMsgNew(RTM_DELTFILTER, 0, ifindex,
+                                              0, handle,
+                                              TC_H_MAKE(prio << 16, 0),
+                                              "u32")))
+        return -1;
+
+    return virNetDevBandwidthNLCommand(ifname, nl_msg, true);
+}
+
+/* Netlink counterpart of virNetDevBandwidthManipulateFilter */
+static int
+virNetDevBandwidthNLManipulateFilter(const char *ifname,
+                                     int ifindex,
+                                     const virMacAddr *ifmac_ptr,
+                                     unsigned int id,
+                                     bool remove_old,
+                                     bool create_new)
+{
+    uint32_t handle;
+    unsigned char ifmac[VIR_MAC_BUFLEN];
+    VIR_AUTOFREE(struct tc_u32_sel *) sel = NULL;
+
+    if (virNetDevBandwidthNLFilterHandle(id, &handle) < 0)
+        return -1;
+
+    if (remove_old &&
+        virNetDevBandwidthNLFilterDel(ifname, ifindex, 2, handle) < 0)
+        return -1;
+
+    if (!create_new)
+        return 0;
+
+    if (VIR_ALLOC_VAR(sel, struct tc_u32_key, 3) < 0)
+        return -1;
+
+    virMacAddrGetRaw(ifmac_ptr, ifmac);
+
+    /* Match the IPv4 ethertype and the source MAC address, exactly
+     * like the tc backend does. Offsets of u16 keys are rounded
+     * down to the enclosing 32 bits word. */
+    sel->flags = TC_U32_TERMINAL;
+    virNetDevBandwidthNLU32Key(sel, ETH_P_IP, 0xffff, -4);
+    virNetDevBandwidthNLU32Key(sel,
+                               (ifmac[2] << 24) | (ifmac[3] << 16) |
+                               (ifmac[4] << 8) | ifmac[5],
+                               0xffffffff, -12);
+    virNetDevBandwidthNLU32Key(sel, (ifmac[0] << 8) | ifmac[1],
+                               0xffff, -16);
+
+    return virNetDevBandwidthNLFilterAdd(ifname, ifindex, 0, 2, ETH_P_IP,
+                                         handle, "u32",
+                                         VIR_NETDEV_BANDWIDTH_HANDLE(1, id),
+                                         sel, NULL, NULL);
+}
+
+static int
+virNetDevBandwidthNLClear(const char *ifname)
+{
+    int ifindex;
+
+    if (virNetDevExists(ifname) != 1) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0 ||
+        virNetDevBandwidthNLQdiscDel(ifname, ifindex, TC_H_ROOT, 0) < 0 ||
+        virNetDevBandwidthNLQdiscDel(ifname, ifindex, TC_H_INGRESS,
+                                     TC_H_MAKE(TC_H_INGRESS, 0)) < 0)
+        return -1;
+
+    return 0;
+}
+
+/* Netlink counterpart of virNetDevBandwidthSet, see the
+ * description there. */
+static int
+virNetDevBandwidthNLSet(const char *ifname,
+                        const virNetDevBandwidthRate *rx,
+                        const virNetDevBandwidthRate *tx,
+                        bool hierarchical_class)
+{
+    int ifindex;
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
+        return -1;
+
+    if (tx && tx->average) {
+        uint32_t root = VIR_NETDEV_BANDWIDTH_HANDLE(1, 0);
+        uint32_t parent = root;
+        uint32_t leaf = VIR_NETDEV_BANDWIDTH_HANDLE(1, 1);
+        unsigned long long quantum = virNetDevBandwidthOptimalQuantum(tx);
+
+        if (virNetDevBandwidthNLQdiscAddHTB(ifname, ifindex,
+                                            hierarchical_class ? 2 : 1) < 0)
+            return -1;
+
+        if (hierarchical_class) {
+            parent = leaf;
+            leaf = VIR_NETDEV_BANDWIDTH_HANDLE(1, 2);
+
+            if (virNetDevBandwidthNLClass(ifname, ifindex, true, root, parent,
+                                          tx->average, tx->peak, 0,
+                                          quantum) < 0)
+                return -1;
+        }
+
+        if (virNetDevBandwidthNLClass(ifname, ifindex, true, parent, leaf,
+                                      tx->average, tx->peak, tx->burst,
+                                      quantum) < 0 ||
+            virNetDevBandwidthNLQdiscAddSFQ(ifname, ifindex, leaf,
+                                            VIR_NETDEV_BANDWIDTH_HANDLE(2, 0)) < 0 ||
+            virNetDevBandwidthNLFilterAdd(ifname, ifindex, root, 1, ETH_P_ALL,
+                                          1, "fw", 1, NULL, NULL, NULL) < 0)
+            return -1;
+    }
+
+    if (rx) {
+        struct tc_police police = {
+            .action = TC_POLICE_SHOT,
+            .mtu = VIR_NETDEV_BANDWIDTH_POLICE_MTU,
+        };
+        uint32_t rtab[TC_RTAB_SIZE / sizeof(uint32_t)];
+        unsigned long long burst = rx->burst ? rx->burst : rx->average;
+        VIR_AUTOFREE(struct tc_u32_sel *) sel = NULL;
+
+        if (VIR_ALLOC_VAR(sel, struct tc_u32_key, 1) < 0)
+            return -1;
+
+        /* Match all ingress traffic */
+        sel->flags = TC_U32_TERMINAL;
+        virNetDevBandwidthNLU32Key(sel, 0, 0, 0);
+
+        police.rate.rate = virNetDevBandwidthNLRate(rx->average);
+        police.burst = virNetDevBandwidthNLXmitTime(police.rate.rate,
+                                                    burst * VIR_NETDEV_BANDWIDTH_SIZE_UNIT);
+        virNetDevBandwidthNLCalcRateTable(&police.rate, rtab, police.mtu);
+
+        if (virNetDevBandwidthNLQdiscAdd(ifname, ifindex, TC_H_INGRESS,
+                                         TC_H_MAKE(TC_H_INGRESS, 0),
+                                         "ingress", 0, NULL, 0) < 0 ||
+            virNetDevBandwidthNLFilterAdd(ifname, ifindex,
+                                          TC_H_MAKE(TC_H_INGRESS, 0),
+                                          0, ETH_P_ALL, 0, "u32", 1,
+                                          sel, &police, rtab) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int
+virNetDevBandwidthNLPlug(const char *brname,
+                         const virMacAddr *ifmac_ptr,
+                         const virNetDevBandwidthRate *rate,
+                         unsigned long long ceil,
+                         unsigned int id)
+{
+    int ifindex;
+    uint32_t classid = VIR_NETDEV_BANDWIDTH_HANDLE(1, id);
+
+    if (virNetDevGetIndex(brname, &ifindex) < 0)
+        return -1;
+
+    if (virNetDevBandwidthNLClass(brname, ifindex, true,
+                                  VIR_NETDEV_BANDWIDTH_HANDLE(1, 1), classid,
+                                  rate->floor, ceil, 0,
+                                  virNetDevBandwidthOptimalQuantum(rate)) < 0 ||
+        virNetDevBandwidthNLQdiscAddSFQ(brname, ifindex, classid,
+                                        VIR_NETDEV_BANDWIDTH_HANDLE(id, 0)) < 0 ||
+        virNetDevBandwidthNLManipulateFilter(brname, ifindex, ifmac_ptr,
+                                             id, false, true) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+virNetDevBandwidthNLUnplug(const char *brname,
+                           unsigned int id)
+{
+    int ifindex;
+
+    if (virNetDevGetIndex(brname, &ifindex) < 0)
+        return -1;
+
+    /* Like the tc backend, try to remove as much as possible */
+    if (virNetDevBandwidthNLQdiscDel(brname, ifindex, 0,
+                                     VIR_NETDEV_BANDWIDTH_HANDLE(id, 0)) < 0 ||
+        virNetDevBandwidthNLManipulateFilter(brname, ifindex, NULL,
+                                             id, true, false) < 0 ||
+        virNetDevBandwidthNLClassDel(brname, ifindex,
+                                     VIR_NETDEV_BANDWIDTH_HANDLE(1, id)) < 0)
+        return -1;
+
+    return 0;
+}
+
+static int
+virNetDevBandwidthNLUpdateRate(const char *ifname,
+                               unsigned int id,
+                               const virNetDevBandwidthRate *rate,
+                               unsigned long long new_rate)
+{
+    int ifindex;
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
+        return -1;
+
+    return virNetDevBandwidthNLClass(ifname, ifindex, false, 0,
+                                     VIR_NETDEV_BANDWIDTH_HANDLE(1, id),
+                                     new_rate,
+                                     rate->peak ? rate->peak : rate->average,
+                                     0, virNetDevBandwidthOptimalQuantum(rate));
+}
+
+static int
+virNetDevBandwidthNLUpdateFilter(const char *ifname,
+                                 const virMacAddr *ifmac_ptr,
+                                 unsigned int id)
+{
+    int ifindex;
+
+    if (virNetDevGetIndex(ifname, &ifindex) < 0)
+        return -1;
+
+    return virNetDevBandwidthNLManipulateFilter(ifname, ifindex, ifmac_ptr,
+                                                id, true, true);
+}
+
+#else /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+# if defined(__linux__) && !defined(HAVE_LIBNL)
+static const char *unsupported = N_("libnl was not available at build time");
+# else
+static const char *unsupported = N_("not supported on non-linux platforms");
+# endif
+
+static int
+virNetDevBandwidthNLClear(const char *ifname ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLSet(const char *ifname ATTRIBUTE_UNUSED,
+                        const virNetDevBandwidthRate *rx ATTRIBUTE_UNUSED,
+                        const virNetDevBandwidthRate *tx ATTRIBUTE_UNUSED,
+                        bool hierarchical_class ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLPlug(const char *brname ATTRIBUTE_UNUSED,
+                         const virMacAddr *ifmac_ptr ATTRIBUTE_UNUSED,
+                         const virNetDevBandwidthRate *rate ATTRIBUTE_UNUSED,
+                         unsigned long long ceil ATTRIBUTE_UNUSED,
+                         unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLUnplug(const char *brname ATTRIBUTE_UNUSED,
+                           unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLUpdateRate(const char *ifname ATTRIBUTE_UNUSED,
+                               unsigned int id ATTRIBUTE_UNUSED,
+                               const virNetDevBandwidthRate *rate ATTRIBUTE_UNUSED,
+                               unsigned long long new_rate ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+static int
+virNetDevBandwidthNLUpdateFilter(const char *ifname ATTRIBUTE_UNUSED,
+                                 const virMacAddr *ifmac_ptr ATTRIBUTE_UNUSED,
+                                 unsigned int id ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+#endif /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
 /**
  * virNetDevBandwidthManipulateFilter:
  * @ifname: interface to operate on
@@ -200,7 +985,8 @@ virNetDevBandwidthSet(const char *ifname,
 {
     int ret = -1;
     virNetDevBandwidthRatePtr rx = NULL, tx = NULL; /* From domain POV */
-    virCommandPtr cmd = NULL;
+    virCommandBatchPtr batch = NULL;
+    virCommandPtr cmd;
     char *average = NULL;
     char *peak = NULL;
     char *burst = NULL;
@@ -235,6 +1021,14 @@ virNetDevBandwidthSet(const char *ifname,
 
     virNetDevBandwidthClear(ifname);
 
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLSet(ifname, rx, tx, hierarchical_class);
+
+    /* The whole hierarchy is set up by a single tc process, which
+     * stops at the first failing command. */
+    if (!(batch = virCommandBatchNew(TC, 0)))
+        goto cleanup;
+
     if (tx && tx->average) {
         if (virAsprintf(&average, "%llukbps", tx->average) < 0)
             goto cleanup;
@@ -245,12 +1039,10 @@ virNetDevBandwidthSet(const char *ifname,
             (virAsprintf(&burst, "%llukb", tx->burst) < 0))
             goto cleanup;
 
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
         virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "root",
                              "handle", "1:", "htb", "default",
                              hierarchical_class ? "2" : "1", NULL);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
 
         /* If we are creating a hierarchical class, all non guaranteed traffic
          * goes to the 1:2 class which will adjust 'rate' dynamically as NICs
@@ -316,17 +1108,13 @@ virNetDevBandwidthSet(const char *ifname,
          * it before you dig into the code.
          */
         if (hierarchical_class) {
-            virCommandFree(cmd);
-            cmd = virCommandNew(TC);
+            cmd = virCommandBatchAdd(batch);
             virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
                                  "1:", "classid", "1:1", "htb", "rate", average,
                                  "ceil", peak ? peak : average, NULL);
             virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-            if (virCommandRun(cmd, NULL) < 0)
-                goto cleanup;
         }
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
         virCommandAddArgList(cmd, "class", "add", "dev", ifname, "parent",
                              hierarchical_class ? "1:1" : "1:", "classid",
                              hierarchical_class ? "1:2" : "1:1", "htb",
@@ -338,28 +1126,18 @@ virNetDevBandwidthSet(const char *ifname,
             virCommandAddArgList(cmd, "burst", burst, NULL);
 
         virNetDevBandwidthCmdAddOptimalQuantum(cmd, tx);
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
         virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname, "parent",
                              hierarchical_class ? "1:2" : "1:1",
                              "handle", "2:", "sfq", "perturb",
                              "10", NULL);
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
         virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
                              "1:0", "protocol", "all", "prio", "1", "handle",
                              "1", "fw", "flowid", "1", NULL);
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
         VIR_FREE(average);
         VIR_FREE(peak);
         VIR_FREE(burst);
@@ -371,31 +1149,26 @@ virNetDevBandwidthSet(const char *ifname,
         if (virAsprintf(&burst, "%llukb", rx->burst ? rx->burst : rx->average) < 0)
             goto cleanup;
 
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
             virCommandAddArgList(cmd, "qdisc", "add", "dev", ifname,
                                  "ingress", NULL);
 
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
-
-        virCommandFree(cmd);
-        cmd = virCommandNew(TC);
+        cmd = virCommandBatchAdd(batch);
         /* Set filter to match all ingress traffic */
         virCommandAddArgList(cmd, "filter", "add", "dev", ifname, "parent",
                              "ffff:", "protocol", "all", "u32", "match", "u32",
                              "0", "0", "police", "rate", average,
                              "burst", burst, "mtu", "64kb", "drop", "flowid",
                              ":1", NULL);
-
-        if (virCommandRun(cmd, NULL) < 0)
-            goto cleanup;
     }
 
+    if (virCommandBatchRun(batch, NULL) < 0)
+        goto cleanup;
+
     ret = 0;
 
  cleanup:
-    virCommandFree(cmd);
+    virCommandBatchFree(batch);
     VIR_FREE(average);
     VIR_FREE(peak);
     VIR_FREE(burst);
@@ -415,30 +1188,24 @@ virNetDevBandwidthSet(const char *ifname,
 int
 virNetDevBandwidthClear(const char *ifname)
 {
-    int ret = 0;
     int dummy; /* for ignoring the exit status */
-    virCommandPtr cmd = NULL;
+    VIR_AUTOPTR(virCommandBatch) batch = NULL;
 
     if (!ifname)
        return 0;
 
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc", "del", "dev", ifname, "root", NULL);
-
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
-
-    virCommandFree(cmd);
-
-    cmd = virCommandNew(TC);
-    virCommandAddArgList(cmd, "qdisc",  "del", "dev", ifname, "ingress", NULL);
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLClear(ifname);
 
-    if (virCommandRun(cmd, &dummy) < 0)
-        ret = -1;
+    if (!(batch = virCommandBatchNew(TC, VIR_COMMAND_BATCH_FORCE)))
+        return -1;
 
-    virCommandFree(cmd);
+    virCommandAddArgList(virCommandBatchAdd(batch),
+                         "qdisc", "del", "dev", ifname, "root", NULL);
+    virCommandAddArgList(virCommandBatchAdd(batch),
+                         "qdisc",  "del", "dev", ifname, "ingress", NULL);
 
-    return ret;
+    return virCommandBatchRun(batch, &dummy);
 }
 
 /*
@@ -557,7 +1324,8 @@ virNetDevBandwidthPlug(const char *brname,
                        unsigned int id)
 {
     int ret = -1;
-    virCommandPtr cmd = NULL;
+    virCommandBatchPtr batch = NULL;
+    virCommandPtr cmd;
     char *class_id = NULL;
     char *qdisc_id = NULL;
     char *floor = NULL;
@@ -579,6 +1347,13 @@ virNetDevBandwidthPlug(const char *brname,
         return -1;
     }
 
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLPlug(brname, ifmac_ptr, bandwidth->in,
+                                        net_bandwidth->in->peak ?
+                                        net_bandwidth->in->peak :
+                                        net_bandwidth->in->average,
+                                        id);
+
     if (virAsprintf(&class_id, "1:%x", id) < 0 ||
         virAsprintf(&qdisc_id, "%x:", id) < 0 ||
         virAsprintf(&floor, "%llukbps", bandwidth->in->floor) < 0 ||
@@ -587,22 +1362,21 @@ virNetDevBandwidthPlug(const char *brname,
                     net_bandwidth->in->average) < 0)
         goto cleanup;
 
-    cmd = virCommandNew(TC);
+    if (!(batch = virCommandBatchNew(TC, 0)))
+        goto cleanup;
+
+    cmd = virCommandBatchAdd(batch);
     virCommandAddArgList(cmd, "class", "add", "dev", brname, "parent", "1:1",
                          "classid", class_id, "htb", "rate", floor,
                          "ceil", ceil, NULL);
     virNetDevBandwidthCmdAddOptimalQuantum(cmd, bandwidth->in);
 
-    if (virCommandRun(cmd, NULL) < 0)
-        goto cleanup;
-
-    virCommandFree(cmd);
-    cmd = virCommandNew(TC);
+    cmd = virCommandBatchAdd(batch);
     virCommandAddArgList(cmd, "qdisc", "add", "dev", brname, "parent",
                          class_id, "handle", qdisc_id, "sfq", "perturb",
                          "10", NULL);
 
-    if (virCommandRun(cmd, NULL) < 0)
+    if (virCommandBatchRun(batch, NULL) < 0)
         goto cleanup;
 
     if (virNetDevBandwidthManipulateFilter(brname, ifmac_ptr, id,
@@ -616,7 +1390,7 @@ virNetDevBandwidthPlug(const char *brname,
     VIR_FREE(floor);
     VIR_FREE(qdisc_id);
     VIR_FREE(class_id);
-    virCommandFree(cmd);
+    virCommandBatchFree(batch);
     return ret;
 }
 
@@ -644,6 +1418,9 @@ virNetDevBandwidthUnplug(const char *brname,
         return -1;
     }
 
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLUnplug(brname, id);
+
     if (virAsprintf(&class_id, "1:%x", id) < 0 ||
         virAsprintf(&qdisc_id, "%x:", id) < 0)
         goto cleanup;
@@ -704,6 +1481,10 @@ virNetDevBandwidthUpdateRate(const char *ifname,
     char *rate = NULL;
     char *ceil = NULL;
 
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLUpdateRate(ifname, id, bandwidth->in,
+                                              new_rate);
+
     if (virAsprintf(&class_id, "1:%x", id) < 0 ||
         virAsprintf(&rate, "%llukbps", new_rate) < 0 ||
         virAsprintf(&ceil, "%llukbps", bandwidth->in->peak ?
@@ -755,6 +1536,9 @@ virNetDevBandwidthUpdateFilter(const char *ifname,
     int ret = -1;
     char *class_id = NULL;
 
+    if (virNetDevBandwidthUseNetlink())
+        return virNetDevBandwidthNLUpdateFilter(ifname, ifmac_ptr, id);
+
     if (virAsprintf(&class_id, "1:%x", id) < 0)
         goto cleanup;
 
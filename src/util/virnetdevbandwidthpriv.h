@@ -0,0 +1,41 @@
+/*
+ * virnetdevbandwidthpriv.h: helpers for testing bandwidth management
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef __VIR_NETDEV_BANDWIDTH_PRIV_H_ALLOW__
+# error "virnetdevbandwidthpriv.h may only be included by virnetdevbandwidth.c or test suites"
+#endif
+
+#ifndef __VIR_NETDEV_BANDWIDTH_PRIV_H__
+# define __VIR_NETDEV_BANDWIDTH_PRIV_H__
+
+# include "virnetdevbandwidth.h"
+
+typedef enum {
+    VIR_NETDEV_BANDWIDTH_BACKEND_AUTOMATIC,
+    VIR_NETDEV_BANDWIDTH_BACKEND_TC,
+    VIR_NETDEV_BANDWIDTH_BACKEND_NETLINK,
+
+    VIR_NETDEV_BANDWIDTH_BACKEND_LAST,
+} virNetDevBandwidthBackend;
+
+int virNetDevBandwidthSetBackend(virNetDevBandwidthBackend backend);
+
+#endif /* __VIR_NETDEV_BANDWIDTH_PRIV_H__ */
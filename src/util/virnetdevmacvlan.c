@@ -568,7 +568,10 @@ virNetDevMacVLanVPortProfileCallback(struct nlmsghdr *hdr,
 
     data = nlmsg_data(hdr);
 
-    /* Quickly decide if we want this or not */
+    /* Quickly decide if we want this or not, the service may be
+     * handing us the link state broadcasts as well */
+    if (hdr->nlmsg_type != RTM_SETLINK)
+        return; /* we only care for RTM_SETLINK */
 
     if (virPidFileReadPath(LLDPAD_PID_FILE, &lldpad_pid) < 0)
         return;
@@ -577,8 +580,6 @@ virNetDevMacVLanVPortProfileCallback(struct nlmsghdr *hdr,
 
     if (hdr->nlmsg_pid != lldpad_pid && hdr->nlmsg_pid != virip_pid)
         return; /* we only care for lldpad and virip messages */
-    if (hdr->nlmsg_type != RTM_SETLINK)
-        return; /* we only care for RTM_SETLINK */
     if (*handled)
         return; /* if it has been handled - dont handle again */
 
@@ -34,6 +34,7 @@
 #include "virmacaddr.h"
 #include "virstring.h"
 #include "virlog.h"
+#include "virovsdb.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -125,6 +126,378 @@ virNetDevOpenvswitchConstructVlans(virCommandPtr cmd, virNetDevVlanPtr virtVlan)
     return ret;
 }
 
+/*
+ * When ovsdb-server is reachable, the functions below talk to it over
+ * a connection kept open for the lifetime of the process instead of
+ * running ovs-vsctl, which costs a fork and exec and a new OVSDB
+ * connection per operation. ovs-vsctl is used when OVSDB can't be
+ * reached.
+ */
+
+/* Append @value to @array. @value is consumed, and may be NULL, in
+ * which case this fails. */
+static int
+virNetDevOpenvswitchOVSDBArrayAppend(virJSONValuePtr array,
+                                     virJSONValuePtr value)
+{
+    if (!value || virJSONValueArrayAppend(array, value) < 0) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Add @key to @obj, same as virNetDevOpenvswitchOVSDBArrayAppend. */
+static int
+virNetDevOpenvswitchOVSDBObjectAppend(virJSONValuePtr obj,
+                                      const char *key,
+                                      virJSONValuePtr value)
+{
+    if (!value || virJSONValueObjectAppend(obj, key, value) < 0) {
+        virJSONValueFree(value);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static virJSONValuePtr
+virNetDevOpenvswitchOVSDBUUID(const char *type,
+                              const char *uuid)
+{
+    return virOVSDBArrayNew(2,
+                            virJSONValueNewString(type),
+                            virJSONValueNewString(uuid));
+}
+
+
+static virJSONValuePtr
+virNetDevOpenvswitchOVSDBEmptySet(void)
+{
+    return virOVSDBArrayNew(2,
+                            virJSONValueNewString("set"),
+                            virJSONValueNewArray());
+}
+
+
+/*
+ * Store the name and @column of the rows of @table named @name, or of
+ * all rows if @name is NULL, in @rows.
+ */
+static int
+virNetDevOpenvswitchOVSDBSelect(const char *table,
+                                const char *name,
+                                const char *column,
+                                virJSONValuePtr *rows)
+{
+    VIR_AUTOPTR(virJSONValue) txn = NULL;
+    VIR_AUTOPTR(virJSONValue) results = NULL;
+    virJSONValuePtr where = NULL;
+    virJSONValuePtr columns = NULL;
+    virJSONValuePtr op = NULL;
+    virJSONValuePtr tmp;
+    int ret = -1;
+
+    if (name)
+        where = virOVSDBWhereName(name);
+    else
+        where = virJSONValueNewArray();
+    columns = virOVSDBArrayNew(2,
+                               virJSONValueNewString("name"),
+                               virJSONValueNewString(column));
+
+    if (!(txn = virOVSDBTransactionNew()) ||
+        virJSONValueObjectCreate(&op,
+                                 "s:op", "select",
+                                 "s:table", table,
+                                 "a:where", &where,
+                                 "a:columns", &columns,
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0 ||
+        virOVSDBTransact(txn, virNetDevOpenvswitchTimeout, &results) < 0 ||
+        !(tmp = virOVSDBResultGetRows(results, 0)) ||
+        !(*rows = virJSONValueCopy(tmp)))
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(where);
+    virJSONValueFree(columns);
+    return ret;
+}
+
+
+/*
+ * Append the operation removing port @ifname from its bridge to @txn,
+ * if there's such port. Rows no longer referenced are garbage
+ * collected by OVSDB, so this deletes the port and its interface too.
+ */
+static int
+virNetDevOpenvswitchOVSDBDelPort(virJSONValuePtr txn,
+                                 const char *ifname)
+{
+    VIR_AUTOPTR(virJSONValue) rows = NULL;
+    virJSONValuePtr where = NULL;
+    virJSONValuePtr mutations = NULL;
+    virJSONValuePtr op = NULL;
+    const char *uuid;
+    int ret = -1;
+
+    if (virNetDevOpenvswitchOVSDBSelect("Port", ifname, "_uuid", &rows) < 0)
+        return -1;
+
+    if (virJSONValueArraySize(rows) == 0)
+        return 0;
+
+    if (!(uuid = virOVSDBUUIDGet(virJSONValueObjectGet(virJSONValueArrayGet(rows, 0),
+                                                       "_uuid")))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("malformed OVSDB row of port %s"), ifname);
+        return -1;
+    }
+
+    where = virOVSDBArrayNew(1,
+                             virOVSDBArrayNew(3,
+                                              virJSONValueNewString("ports"),
+                                              virJSONValueNewString("includes"),
+                                              virNetDevOpenvswitchOVSDBUUID("uuid", uuid)));
+    mutations = virOVSDBArrayNew(1,
+                                 virOVSDBArrayNew(3,
+                                                  virJSONValueNewString("ports"),
+                                                  virJSONValueNewString("delete"),
+                                                  virNetDevOpenvswitchOVSDBUUID("uuid", uuid)));
+
+    if (virJSONValueObjectCreate(&op,
+                                 "s:op", "mutate",
+                                 "s:table", "Bridge",
+                                 "a:where", &where,
+                                 "a:mutations", &mutations,
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(where);
+    virJSONValueFree(mutations);
+    return ret;
+}
+
+
+/*
+ * Add the Port columns of the VLAN configuration @virtVlan to @row.
+ * With @clear, the columns not used by @virtVlan are cleared.
+ */
+static int
+virNetDevOpenvswitchOVSDBVlanColumns(virJSONValuePtr row,
+                                     virNetDevVlanPtr virtVlan,
+                                     bool clear)
+{
+    virJSONValuePtr trunks = NULL;
+    const char *mode = NULL;
+    int tag = -1;
+    size_t i;
+
+    if (virtVlan && virtVlan->nTags) {
+        switch (virtVlan->nativeMode) {
+        case VIR_NATIVE_VLAN_MODE_TAGGED:
+            mode = "native-tagged";
+            tag = virtVlan->nativeTag;
+            break;
+        case VIR_NATIVE_VLAN_MODE_UNTAGGED:
+            mode = "native-untagged";
+            tag = virtVlan->nativeTag;
+            break;
+        case VIR_NATIVE_VLAN_MODE_DEFAULT:
+        default:
+            break;
+        }
+
+        if (virtVlan->trunk) {
+            if (!(trunks = virJSONValueNewArray()))
+                return -1;
+
+            for (i = 0; i < virtVlan->nTags; i++) {
+                if (virNetDevOpenvswitchOVSDBArrayAppend(trunks,
+                                                         virJSONValueNewNumberUint(virtVlan->tag[i])) < 0) {
+                    virJSONValueFree(trunks);
+                    return -1;
+                }
+            }
+
+            if (!(trunks = virOVSDBArrayNew(2, virJSONValueNewString("set"),
+                                            trunks)))
+                return -1;
+        } else {
+            tag = virtVlan->tag[0];
+        }
+    }
+
+    if (!trunks && clear)
+        trunks = virNetDevOpenvswitchOVSDBEmptySet();
+
+    if ((trunks || clear) &&
+        virNetDevOpenvswitchOVSDBObjectAppend(row, "trunks", trunks) < 0)
+        return -1;
+
+    if (tag >= 0 || clear) {
+        if (virNetDevOpenvswitchOVSDBObjectAppend(row, "tag",
+                                                  tag >= 0 ?
+                                                  virJSONValueNewNumberInt(tag) :
+                                                  virNetDevOpenvswitchOVSDBEmptySet()) < 0)
+            return -1;
+    }
+
+    if (mode || clear) {
+        if (virNetDevOpenvswitchOVSDBObjectAppend(row, "vlan_mode",
+                                                  mode ?
+                                                  virJSONValueNewString(mode) :
+                                                  virNetDevOpenvswitchOVSDBEmptySet()) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virNetDevOpenvswitchOVSDBMapAppend(virJSONValuePtr pairs,
+                                   const char *key,
+                                   const char *value)
+{
+    return virNetDevOpenvswitchOVSDBArrayAppend(pairs,
+                                                virOVSDBArrayNew(2,
+                                                                 virJSONValueNewString(key),
+                                                                 virJSONValueNewString(value)));
+}
+
+
+/*
+ * The equivalent of
+ *   ovs-vsctl -- --if-exists del-port IFNAME -- add-port BRNAME IFNAME
+ *             VLAN... -- set Interface IFNAME external-ids:...
+ * as a single OVSDB transaction.
+ */
+static int
+virNetDevOpenvswitchOVSDBAddPort(const char *brname,
+                                 const char *ifname,
+                                 const char *macaddrstr,
+                                 const char *ifuuidstr,
+                                 const char *vmuuidstr,
+                                 const char *profileID,
+                                 virNetDevVlanPtr virtVlan)
+{
+    VIR_AUTOPTR(virJSONValue) txn = NULL;
+    virJSONValuePtr pairs = NULL;
+    virJSONValuePtr extids = NULL;
+    virJSONValuePtr interfaces = NULL;
+    virJSONValuePtr row = NULL;
+    virJSONValuePtr rows = NULL;
+    virJSONValuePtr where = NULL;
+    virJSONValuePtr columns = NULL;
+    virJSONValuePtr mutations = NULL;
+    virJSONValuePtr op = NULL;
+    int ret = -1;
+
+    if (!(txn = virOVSDBTransactionNew()) ||
+        virNetDevOpenvswitchOVSDBDelPort(txn, ifname) < 0)
+        goto cleanup;
+
+    /* Make the whole transaction fail if the bridge doesn't exist */
+    if (virJSONValueObjectCreate(&row, "s:name", brname, NULL) < 0)
+        goto cleanup;
+    rows = virOVSDBArrayNew(1, row);
+    row = NULL;
+    where = virOVSDBWhereName(brname);
+    columns = virOVSDBArrayNew(1, virJSONValueNewString("name"));
+
+    if (virJSONValueObjectCreate(&op,
+                                 "s:op", "wait",
+                                 "s:table", "Bridge",
+                                 "i:timeout", 0,
+                                 "a:where", &where,
+                                 "a:columns", &columns,
+                                 "s:until", "==",
+                                 "a:rows", &rows,
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0)
+        goto cleanup;
+
+    if (!(pairs = virJSONValueNewArray()) ||
+        virNetDevOpenvswitchOVSDBMapAppend(pairs, "attached-mac", macaddrstr) < 0 ||
+        virNetDevOpenvswitchOVSDBMapAppend(pairs, "iface-id", ifuuidstr) < 0 ||
+        virNetDevOpenvswitchOVSDBMapAppend(pairs, "vm-id", vmuuidstr) < 0 ||
+        (profileID[0] != '\0' &&
+         virNetDevOpenvswitchOVSDBMapAppend(pairs, "port-profile", profileID) < 0) ||
+        virNetDevOpenvswitchOVSDBMapAppend(pairs, "iface-status", "active") < 0)
+        goto cleanup;
+    extids = virOVSDBArrayNew(2, virJSONValueNewString("map"), pairs);
+    pairs = NULL;
+
+    if (virJSONValueObjectCreate(&row,
+                                 "s:name", ifname,
+                                 "a:external_ids", &extids,
+                                 NULL) < 0 ||
+        virJSONValueObjectCreate(&op,
+                                 "s:op", "insert",
+                                 "s:table", "Interface",
+                                 "a:row", &row,
+                                 "s:uuid-name", "iface",
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0)
+        goto cleanup;
+
+    interfaces = virNetDevOpenvswitchOVSDBUUID("named-uuid", "iface");
+    if (virJSONValueObjectCreate(&row,
+                                 "s:name", ifname,
+                                 "a:interfaces", &interfaces,
+                                 NULL) < 0 ||
+        virNetDevOpenvswitchOVSDBVlanColumns(row, virtVlan, false) < 0 ||
+        virJSONValueObjectCreate(&op,
+                                 "s:op", "insert",
+                                 "s:table", "Port",
+                                 "a:row", &row,
+                                 "s:uuid-name", "port",
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0)
+        goto cleanup;
+
+    where = virOVSDBWhereName(brname);
+    mutations = virOVSDBArrayNew(1,
+                                 virOVSDBArrayNew(3,
+                                                  virJSONValueNewString("ports"),
+                                                  virJSONValueNewString("insert"),
+                                                  virNetDevOpenvswitchOVSDBUUID("named-uuid",
+                                                                                "port")));
+    if (virJSONValueObjectCreate(&op,
+                                 "s:op", "mutate",
+                                 "s:table", "Bridge",
+                                 "a:where", &where,
+                                 "a:mutations", &mutations,
+                                 NULL) < 0 ||
+        virOVSDBTransactionAppend(txn, op) < 0)
+        goto cleanup;
+
+    ret = virOVSDBTransact(txn, virNetDevOpenvswitchTimeout, NULL);
+
+ cleanup:
+    virJSONValueFree(pairs);
+    virJSONValueFree(extids);
+    virJSONValueFree(interfaces);
+    virJSONValueFree(row);
+    virJSONValueFree(rows);
+    virJSONValueFree(where);
+    virJSONValueFree(columns);
+    virJSONValueFree(mutations);
+    return ret;
+}
+
+
 /**
  * virNetDevOpenvswitchAddPort:
  * @brname: the bridge name
@@ -156,6 +529,19 @@ int virNetDevOpenvswitchAddPort(const char *brname, const char *ifname,
     virUUIDFormat(ovsport->interfaceID, ifuuidstr);
     virUUIDFormat(vmuuid, vmuuidstr);
 
+    if (virOVSDBAvailable()) {
+        if (virNetDevOpenvswitchOVSDBAddPort(brname, ifname, macaddrstr,
+                                             ifuuidstr, vmuuidstr,
+                                             ovsport->profileID,
+                                             virtVlan) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to add port %s to OVS bridge %s"),
+                           ifname, brname);
+            return -1;
+        }
+        return 0;
+    }
+
     if (virAsprintf(&attachedmac_ex_id, "external-ids:attached-mac=\"%s\"",
                     macaddrstr) < 0)
         return -1;
@@ -220,6 +606,20 @@ int virNetDevOpenvswitchRemovePort(const char *brname ATTRIBUTE_UNUSED, const ch
 {
     VIR_AUTOPTR(virCommand) cmd = NULL;
 
+    if (virOVSDBAvailable()) {
+        VIR_AUTOPTR(virJSONValue) txn = NULL;
+
+        if (!(txn = virOVSDBTransactionNew()) ||
+            virNetDevOpenvswitchOVSDBDelPort(txn, ifname) < 0 ||
+            (virJSONValueArraySize(txn) > 1 &&
+             virOVSDBTransact(txn, virNetDevOpenvswitchTimeout, NULL) < 0)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to delete port %s from OVS"), ifname);
+            return -1;
+        }
+        return 0;
+    }
+
     cmd = virCommandNew(OVSVSCTL);
     virNetDevOpenvswitchAddTimeout(cmd);
     virCommandAddArgList(cmd, "--", "--if-exists", "del-port", ifname, NULL);
@@ -304,6 +704,127 @@ int virNetDevOpenvswitchSetMigrateData(char *migrate, const char *ifname)
     return 0;
 }
 
+/*
+ * Fill @stats from the statistics column of the Interface table @row.
+ * Returns -1 if @row doesn't have any statistics, without reporting an
+ * error.
+ */
+static int
+virNetDevOpenvswitchOVSDBParseStats(virJSONValuePtr row,
+                                    virDomainInterfaceStatsPtr stats)
+{
+    virJSONValuePtr statistics = virJSONValueObjectGet(row, "statistics");
+    bool gotStats = false;
+
+#define GET_STAT(name, member) \
+    do { \
+        virJSONValuePtr val = virOVSDBMapLookup(statistics, name); \
+        if (!val || virJSONValueGetNumberLong(val, &stats->member) < 0) \
+            stats->member = -1; \
+        else \
+            gotStats = true; \
+    } while (0)
+
+    /* The TX/RX fields appear to be swapped here
+     * because this is the host view. */
+    GET_STAT("rx_bytes", tx_bytes);
+    GET_STAT("rx_packets", tx_packets);
+    GET_STAT("rx_errors", tx_errs);
+    GET_STAT("rx_dropped", tx_drop);
+    GET_STAT("tx_bytes", rx_bytes);
+    GET_STAT("tx_packets", rx_packets);
+    GET_STAT("tx_errors", rx_errs);
+    GET_STAT("tx_dropped", rx_drop);
+
+#undef GET_STAT
+
+    return gotStats ? 0 : -1;
+}
+
+
+/**
+ * virNetDevOpenvswitchInterfaceStatsAll:
+ *
+ * Retrieves the stats of all OVS interfaces with a single OVSDB
+ * request. Only available if OVSDB can be reached directly.
+ *
+ * Returns a hash table mapping interface names to their stats, or NULL
+ * on failure.
+ */
+virHashTablePtr
+virNetDevOpenvswitchInterfaceStatsAll(void)
+{
+    VIR_AUTOPTR(virJSONValue) rows = NULL;
+    virDomainInterfaceStatsPtr stats = NULL;
+    virHashTablePtr table = NULL;
+    size_t i;
+
+    if (!virOVSDBAvailable()) {
+        virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                       _("OVSDB is not reachable"));
+        return NULL;
+    }
+
+    if (virNetDevOpenvswitchOVSDBSelect("Interface", NULL, "statistics",
+                                        &rows) < 0)
+        return NULL;
+
+    if (!(table = virHashCreate(64, virHashValueFree)))
+        return NULL;
+
+    for (i = 0; i < virJSONValueArraySize(rows); i++) {
+        virJSONValuePtr row = virJSONValueArrayGet(rows, i);
+        const char *name;
+
+        if (!(name = virJSONValueObjectGetString(row, "name")))
+            continue;
+
+        if (VIR_ALLOC(stats) < 0)
+            goto error;
+
+        if (virNetDevOpenvswitchOVSDBParseStats(row, stats) < 0) {
+            VIR_FREE(stats);
+            continue;
+        }
+
+        if (virHashUpdateEntry(table, name, stats) < 0)
+            goto error;
+        stats = NULL;
+    }
+
+    return table;
+
+ error:
+    VIR_FREE(stats);
+    virHashFree(table);
+    return NULL;
+}
+
+
+/**
+ * virNetDevOpenvswitchInterfaceStatsLookup:
+ * @table: stats returned by virNetDevOpenvswitchInterfaceStatsAll
+ * @ifname: the name of the interface
+ * @stats: the retreived domain interface stat
+ *
+ * Returns 0 on success, -1 if @ifname is not in @table, without
+ * reporting an error.
+ */
+int
+virNetDevOpenvswitchInterfaceStatsLookup(virHashTablePtr table,
+                                         const char *ifname,
+                                         virDomainInterfaceStatsPtr stats)
+{
+    virDomainInterfaceStatsPtr tmp;
+
+    if (!(tmp = virHashLookup(table, ifname)))
+        return -1;
+
+    *stats = *tmp;
+    return 0;
+}
+
+
 /**
  * virNetDevOpenvswitchInterfaceStats:
  * @ifname: the name of the interface
@@ -322,6 +843,29 @@ virNetDevOpenvswitchInterfaceStats(const char *ifname,
     VIR_AUTOPTR(virCommand) cmd = NULL;
     VIR_AUTOFREE(char *) output = NULL;
 
+    if (virOVSDBAvailable()) {
+        VIR_AUTOPTR(virJSONValue) rows = NULL;
+
+        if (virNetDevOpenvswitchOVSDBSelect("Interface", ifname, "statistics",
+                                            &rows) < 0)
+            return -1;
+
+        if (virJSONValueArraySize(rows) == 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Interface not found"));
+            return -1;
+        }
+
+        if (virNetDevOpenvswitchOVSDBParseStats(virJSONValueArrayGet(rows, 0),
+                                                stats) < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("Interface doesn't have any statistics"));
+            return -1;
+        }
+
+        return 0;
+    }
+
     /* Just ensure the interface exists in ovs */
     cmd = virCommandNew(OVSVSCTL);
     virNetDevOpenvswitchAddTimeout(cmd);
@@ -465,6 +1009,26 @@ virNetDevOpenvswitchGetVhostuserIfname(const char *path,
     }
 
     tmpIfname++;
+
+    if (virOVSDBAvailable()) {
+        VIR_AUTOPTR(virJSONValue) rows = NULL;
+
+        if (virNetDevOpenvswitchOVSDBSelect("Interface", tmpIfname, "name",
+                                            &rows) < 0)
+            goto cleanup;
+
+        if (virJSONValueArraySize(rows) == 0) {
+            /* it's not a openvswitch vhostuser interface. */
+            ret = 0;
+            goto cleanup;
+        }
+
+        if (VIR_STRDUP(*ifname, tmpIfname) < 0)
+            goto cleanup;
+        ret = 1;
+        goto cleanup;
+    }
+
     cmd = virCommandNew(OVSVSCTL);
     virNetDevOpenvswitchAddTimeout(cmd);
     virCommandAddArgList(cmd, "get", "Interface", tmpIfname, "name", NULL);
@@ -498,6 +1062,37 @@ int virNetDevOpenvswitchUpdateVlan(const char *ifname,
 {
     VIR_AUTOPTR(virCommand) cmd = NULL;
 
+    if (virOVSDBAvailable()) {
+        VIR_AUTOPTR(virJSONValue) txn = NULL;
+        virJSONValuePtr row = virJSONValueNewObject();
+        virJSONValuePtr where = virOVSDBWhereName(ifname);
+        virJSONValuePtr op = NULL;
+        int rc = -1;
+
+        if (row &&
+            virNetDevOpenvswitchOVSDBVlanColumns(row, virtVlan, true) == 0 &&
+            (txn = virOVSDBTransactionNew()) &&
+            virJSONValueObjectCreate(&op,
+                                     "s:op", "update",
+                                     "s:table", "Port",
+                                     "a:where", &where,
+                                     "a:row", &row,
+                                     NULL) == 1 &&
+            virOVSDBTransactionAppend(txn, op) == 0)
+            rc = virOVSDBTransact(txn, virNetDevOpenvswitchTimeout, NULL);
+
+        virJSONValueFree(row);
+        virJSONValueFree(where);
+
+        if (rc < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Unable to set vlan configuration on port %s"),
+                           ifname);
+            return -1;
+        }
+        return 0;
+    }
+
     cmd = virCommandNew(OVSVSCTL);
     virNetDevOpenvswitchAddTimeout(cmd);
     virCommandAddArgList(cmd,
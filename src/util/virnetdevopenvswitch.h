@@ -30,6 +30,7 @@
 # include "internal.h"
 # include "virnetdevvportprofile.h"
 # include "virnetdevvlan.h"
+# include "virhash.h"
 
 # define VIR_NETDEV_OVS_DEFAULT_TIMEOUT 5
 
@@ -60,6 +61,14 @@ int virNetDevOpenvswitchInterfaceStats(const char *ifname,
                                        virDomainInterfaceStatsPtr stats)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
+virHashTablePtr virNetDevOpenvswitchInterfaceStatsAll(void);
+
+int virNetDevOpenvswitchInterfaceStatsLookup(virHashTablePtr table,
+                                             const char *ifname,
+                                             virDomainInterfaceStatsPtr stats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(3)
+    ATTRIBUTE_RETURN_CHECK;
+
 int virNetDevOpenvswitchInterfaceGetMaster(const char *ifname, char **master)
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
 
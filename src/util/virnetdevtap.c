@@ -28,6 +28,7 @@
 #include "virnetdevbridge.h"
 #include "virnetdevmidonet.h"
 #include "virnetdevopenvswitch.h"
+#include "virnetlink.h"
 #include "virerror.h"
 #include "virfile.h"
 #include "viralloc.h"
@@ -43,6 +44,9 @@
 #include <fcntl.h>
 #ifdef __linux__
 # include <linux/if_tun.h>    /* IFF_TUN, IFF_NO_PI */
+# ifdef HAVE_LIBNL
+#  include <linux/rtnetlink.h>
+# endif
 #elif defined(__FreeBSD__)
 # include <net/if_mib.h>
 # include <sys/sysctl.h>
@@ -234,6 +238,7 @@ int virNetDevTapCreate(char **ifname,
     struct ifreq ifr;
     int ret = -1;
     int fd;
+    bool vnetHdr = false;
 
     if (!tunpath)
         tunpath = "/dev/net/tun";
@@ -262,8 +267,12 @@ int virNetDevTapCreate(char **ifname,
         }
 
 # ifdef IFF_VNET_HDR
-        if ((flags &  VIR_NETDEV_TAP_CREATE_VNET_HDR) &&
-            virNetDevProbeVnetHdr(fd))
+        /* All the queues are opened from the same tun device, so
+         * probing the first one is enough */
+        if (i == 0)
+            vnetHdr = (flags & VIR_NETDEV_TAP_CREATE_VNET_HDR) &&
+                      virNetDevProbeVnetHdr(fd);
+        if (vnetHdr)
             ifr.ifr_flags |= IFF_VNET_HDR;
 # endif
 
@@ -557,6 +566,75 @@ virNetDevTapAttachBridge(const char *tapname,
 }
 
 
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/* Like virNetDevTapAttachBridge() for a plain Linux bridge, followed
+ * by setting the interface up (or down), except that the MAC address,
+ * MTU, bridge port and state of @tapname are all set with a single
+ * netlink request.
+ */
+static int
+virNetDevTapSetupBridgePort(const char *tapname,
+                            const char *brname,
+                            const virMacAddr *tapmac,
+                            unsigned int mtu,
+                            unsigned int *actualMTU,
+                            bool online)
+{
+    int master;
+    int error;
+    virNetlinkSetLinkData data = {
+        .mac = tapmac,
+        .mtu = &mtu,
+        .master = &master,
+        .online = &online,
+    };
+
+    /* Use the MTU of the bridge unless asked to use another one, see
+     * virNetDevTapAttachBridge() */
+    if (mtu == 0) {
+        int brmtu = virNetDevGetMTU(brname);
+
+        if (brmtu < 0)
+            return -1;
+        mtu = brmtu;
+    }
+
+    if (virNetDevGetIndex(brname, &master) < 0)
+        return -1;
+
+    if (virNetlinkSetLink(tapname, &data, &error) < 0) {
+        if (error < 0)
+            virReportSystemError(-error,
+                                 _("Unable to add bridge %s port %s"),
+                                 brname, tapname);
+        return -1;
+    }
+
+    if (actualMTU)
+        *actualMTU = mtu;
+
+    return 0;
+}
+#else /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+static int
+virNetDevTapSetupBridgePort(const char *tapname,
+                            const char *brname,
+                            const virMacAddr *tapmac,
+                            unsigned int mtu,
+                            unsigned int *actualMTU,
+                            bool online)
+{
+    if (virNetDevSetMAC(tapname, tapmac) < 0 ||
+        virNetDevTapAttachBridge(tapname, brname, NULL, NULL, NULL, NULL,
+                                 mtu, actualMTU) < 0 ||
+        virNetDevSetOnline(tapname, online) < 0)
+        return -1;
+
+    return 0;
+}
+#endif /* !(defined(__linux__) && defined(HAVE_LIBNL)) */
+
+
 /**
  * virNetDevTapCreateInBridgePort:
  * @brname: the bridge name
@@ -634,16 +712,25 @@ int virNetDevTapCreateInBridgePort(const char *brname,
         tapmac.addr[0] = 0xFE; /* Discourage bridge from using TAP dev MAC */
     }
 
-    if (virNetDevSetMAC(*ifname, &tapmac) < 0)
-        goto error;
+    if (virtPortProfile) {
+        if (virNetDevSetMAC(*ifname, &tapmac) < 0)
+            goto error;
 
-    if (virNetDevTapAttachBridge(*ifname, brname, macaddr, vmuuid,
-                                 virtPortProfile, virtVlan, mtu, actualMTU) < 0) {
-        goto error;
-    }
+        if (virNetDevTapAttachBridge(*ifname, brname, macaddr, vmuuid,
+                                     virtPortProfile, virtVlan, mtu,
+                                     actualMTU) < 0) {
+            goto error;
+        }
 
-    if (virNetDevSetOnline(*ifname, !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
-        goto error;
+        if (virNetDevSetOnline(*ifname,
+                               !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
+            goto error;
+    } else {
+        if (virNetDevTapSetupBridgePort(*ifname, brname, &tapmac, mtu,
+                                        actualMTU,
+                                        !!(flags & VIR_NETDEV_TAP_CREATE_IFUP)) < 0)
+            goto error;
+    }
 
     if (virNetDevSetCoalesce(*ifname, coalesce, false) < 0)
         goto error;
@@ -659,6 +746,200 @@ int virNetDevTapCreateInBridgePort(const char *brname,
 
 /*-------------------- interface stats --------------------*/
 
+static void
+virNetDevTapInterfaceStatsSet(virDomainInterfaceStatsPtr stats,
+                              bool swapped,
+                              long long rx_bytes,
+                              long long rx_packets,
+                              long long rx_errs,
+                              long long rx_drop,
+                              long long tx_bytes,
+                              long long tx_packets,
+                              long long tx_errs,
+                              long long tx_drop)
+{
+    if (swapped) {
+        stats->rx_bytes = tx_bytes;
+        stats->rx_packets = tx_packets;
+        stats->rx_errs = tx_errs;
+        stats->rx_drop = tx_drop;
+        stats->tx_bytes = rx_bytes;
+        stats->tx_packets = rx_packets;
+        stats->tx_errs = rx_errs;
+        stats->tx_drop = rx_drop;
+    } else {
+        stats->rx_bytes = rx_bytes;
+        stats->rx_packets = rx_packets;
+        stats->rx_errs = rx_errs;
+        stats->rx_drop = rx_drop;
+        stats->tx_bytes = tx_bytes;
+        stats->tx_packets = tx_packets;
+        stats->tx_errs = tx_errs;
+        stats->tx_drop = tx_drop;
+    }
+}
+
+
+#if defined(__linux__) && defined(HAVE_LIBNL)
+/* Fill @stats from the IFLA_STATS64 (or the older 32 bit IFLA_STATS)
+ * attribute of a RTM_NEWLINK message. Returns -1 if neither is present. */
+static int
+virNetDevTapInterfaceStatsParse(struct nlattr **tb,
+                                virDomainInterfaceStatsPtr stats,
+                                bool swapped)
+{
+    if (tb[IFLA_STATS64] &&
+        nla_len(tb[IFLA_STATS64]) >= (int) sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 s64;
+
+        /* The attribute payload is only guaranteed to be 4 byte aligned */
+        memcpy(&s64, nla_data(tb[IFLA_STATS64]), sizeof(s64));
+        virNetDevTapInterfaceStatsSet(stats, swapped,
+                                      s64.rx_bytes, s64.rx_packets,
+                                      s64.rx_errors, s64.rx_dropped,
+                                      s64.tx_bytes, s64.tx_packets,
+                                      s64.tx_errors, s64.tx_dropped);
+        return 0;
+    }
+
+    if (tb[IFLA_STATS] &&
+        nla_len(tb[IFLA_STATS]) >= (int) sizeof(struct rtnl_link_stats)) {
+        struct rtnl_link_stats *s32 = nla_data(tb[IFLA_STATS]);
+
+        virNetDevTapInterfaceStatsSet(stats, swapped,
+                                      s32->rx_bytes, s32->rx_packets,
+                                      s32->rx_errors, s32->rx_dropped,
+                                      s32->tx_bytes, s32->tx_packets,
+                                      s32->tx_errors, s32->tx_dropped);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+static int
+virNetDevTapInterfaceStatsAllCallback(const struct nlmsghdr *resp,
+                                      void *opaque)
+{
+    virHashTablePtr table = opaque;
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL, };
+    virDomainInterfaceStatsPtr stats = NULL;
+    const char *ifname;
+
+    if (resp->nlmsg_type != RTM_NEWLINK)
+        return 0;
+
+    if (nlmsg_parse((struct nlmsghdr *) resp, sizeof(struct ifinfomsg),
+                    tb, IFLA_MAX, NULL) < 0 ||
+        !tb[IFLA_IFNAME])
+        return 0;
+
+    ifname = nla_data(tb[IFLA_IFNAME]);
+
+    if (VIR_ALLOC(stats) < 0)
+        return -1;
+
+    if (virNetDevTapInterfaceStatsParse(tb, stats, false) < 0) {
+        VIR_FREE(stats);
+        return 0;
+    }
+
+    if (virHashUpdateEntry(table, ifname, stats) < 0) {
+        VIR_FREE(stats);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virNetDevTapInterfaceStatsAll:
+ *
+ * Fetch the RX/TX statistics of all host interfaces with a single
+ * netlink dump. Meant for callers which need the statistics of many
+ * interfaces at once, see virNetDevTapInterfaceStatsLookup.
+ *
+ * Returns a hash table mapping interface names to the statistics from
+ * host POV, or NULL on error.
+ */
+virHashTablePtr
+virNetDevTapInterfaceStatsAll(void)
+{
+    virHashTablePtr table = NULL;
+    struct ifinfomsg ifinfo = {
+        .ifi_family = AF_UNSPEC,
+    };
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+
+    if (!(nl_msg = nlmsg_alloc_simple(RTM_GETLINK,
+                                      NLM_F_REQUEST | NLM_F_DUMP))) {
+        virReportOOMError();
+        return NULL;
+    }
+
+    if (nlmsg_append(nl_msg, &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("allocated netlink buffer is too small"));
+        return NULL;
+    }
+
+    if (!(table = virHashCreate(64, virHashValueFree)))
+        return NULL;
+
+    if (virNetlinkDumpCommand(nl_msg, virNetDevTapInterfaceStatsAllCallback,
+                              0, 0, NETLINK_ROUTE, 0, table) < 0) {
+        virHashFree(table);
+        return NULL;
+    }
+
+    return table;
+}
+
+
+/**
+ * virNetDevTapInterfaceStats:
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Fetch RX/TX statistics for given named interface (@ifname) and
+ * store them at @stats. The returned statistics are always from
+ * domain POV. Because in some cases this means swapping RX/TX in
+ * the stats and in others this means no swapping (consider TAP
+ * vs macvtap) caller might choose if the returned stats should
+ * be @swapped or not.
+ *
+ * Returns 0 on success, -1 otherwise (with error reported).
+ */
+int
+virNetDevTapInterfaceStats(const char *ifname,
+                           virDomainInterfaceStatsPtr stats,
+                           bool swapped)
+{
+    struct nlattr *tb[IFLA_MAX + 1] = { NULL, };
+    VIR_AUTOFREE(void *) nlData = NULL;
+
+    if (!ifname) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Interface name not provided"));
+        return -1;
+    }
+
+    if (virNetlinkDumpLink(ifname, -1, &nlData, tb, 0, 0) < 0)
+        return -1;
+
+    if (virNetDevTapInterfaceStatsParse(tb, stats, swapped) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("no statistics reported for interface '%s'"),
+                       ifname);
+        return -1;
+    }
+
+    return 0;
+}
+#elif defined(__linux__)
 /**
  * virNetDevTapInterfaceStats:
  * @ifname: interface
@@ -674,7 +955,6 @@ int virNetDevTapCreateInBridgePort(const char *brname,
  *
  * Returns 0 on success, -1 otherwise (with error reported).
  */
-#ifdef __linux__
 int
 virNetDevTapInterfaceStats(const char *ifname,
                            virDomainInterfaceStatsPtr stats,
@@ -727,25 +1007,11 @@ virNetDevTapInterfaceStats(const char *ifname,
                        &dummy, &dummy, &dummy, &dummy) != 16)
                 continue;
 
-            if (swapped) {
-                stats->rx_bytes = tx_bytes;
-                stats->rx_packets = tx_packets;
-                stats->rx_errs = tx_errs;
-                stats->rx_drop = tx_drop;
-                stats->tx_bytes = rx_bytes;
-                stats->tx_packets = rx_packets;
-                stats->tx_errs = rx_errs;
-                stats->tx_drop = rx_drop;
-            } else {
-                stats->rx_bytes = rx_bytes;
-                stats->rx_packets = rx_packets;
-                stats->rx_errs = rx_errs;
-                stats->rx_drop = rx_drop;
-                stats->tx_bytes = tx_bytes;
-                stats->tx_packets = tx_packets;
-                stats->tx_errs = tx_errs;
-                stats->tx_drop = tx_drop;
-            }
+            virNetDevTapInterfaceStatsSet(stats, swapped,
+                                          rx_bytes, rx_packets,
+                                          rx_errs, rx_drop,
+                                          tx_bytes, tx_packets,
+                                          tx_errs, tx_drop);
 
             VIR_FORCE_FCLOSE(fp);
             return 0;
@@ -840,3 +1106,49 @@ virNetDevTapInterfaceStats(const char *ifname ATTRIBUTE_UNUSED,
 }
 
 #endif /* __linux__ */
+
+#if !defined(__linux__) || !defined(HAVE_LIBNL)
+virHashTablePtr
+virNetDevTapInterfaceStatsAll(void)
+{
+    virReportError(VIR_ERR_OPERATION_INVALID, "%s",
+                   _("dumping interface stats is not supported "
+                     "on this platform"));
+    return NULL;
+}
+#endif
+
+
+/**
+ * virNetDevTapInterfaceStatsLookup:
+ * @table: statistics returned by virNetDevTapInterfaceStatsAll
+ * @ifname: interface
+ * @stats: where to store statistics
+ * @swapped: whether to swap RX/TX fields
+ *
+ * Like virNetDevTapInterfaceStats, but take the statistics of @ifname
+ * from @table.
+ *
+ * Returns 0 on success, -1 if @ifname is not in @table. No error is
+ * reported in that case, so that the caller can fall back to
+ * virNetDevTapInterfaceStats, e.g. for interfaces created after @table
+ * was filled.
+ */
+int
+virNetDevTapInterfaceStatsLookup(virHashTablePtr table,
+                                 const char *ifname,
+                                 virDomainInterfaceStatsPtr stats,
+                                 bool swapped)
+{
+    virDomainInterfaceStatsPtr host;
+
+    if (!(host = virHashLookup(table, ifname)))
+        return -1;
+
+    virNetDevTapInterfaceStatsSet(stats, swapped,
+                                  host->rx_bytes, host->rx_packets,
+                                  host->rx_errs, host->rx_drop,
+                                  host->tx_bytes, host->tx_packets,
+                                  host->tx_errs, host->tx_drop);
+    return 0;
+}
@@ -598,6 +598,75 @@ virNetlinkNewLink(const char *ifname,
 }
 
 
+/**
+ * virNetlinkSetLink:
+ *
+ * @ifname: name of the link
+ * @data: the settings to change, NULL members are left alone
+ * @error: netlink error code
+ *
+ * Change the MAC address, MTU, master device and up state of the link
+ * @ifname in a single RTM_SETLINK request, instead of one ioctl (each
+ * on a new socket) per setting. The kernel applies them in this order,
+ * so the MAC address is set before the link becomes a bridge port.
+ *
+ * Returns 0 on success, -1 on error. Additionally, if the @error is
+ * non-zero, then the kernel rejected the request, but no error message
+ * is generated leaving it up to the caller to handle the condition.
+ */
+int
+virNetlinkSetLink(const char *ifname,
+                  virNetlinkSetLinkDataPtr data,
+                  int *error)
+{
+    unsigned int buflen;
+    struct ifinfomsg ifinfo = { .ifi_family = AF_UNSPEC };
+    VIR_AUTOPTR(virNetlinkMsg) nl_msg = NULL;
+    VIR_AUTOFREE(struct nlmsghdr *) resp = NULL;
+
+    *error = 0;
+
+    VIR_DEBUG("Setting up interface '%s'", ifname);
+
+    if (data->online) {
+        ifinfo.ifi_change = IFF_UP;
+        if (*data->online)
+            ifinfo.ifi_flags = IFF_UP;
+    }
+
+    nl_msg = nlmsg_alloc_simple(RTM_SETLINK, NLM_F_REQUEST);
+    if (!nl_msg) {
+        virReportOOMError();
+        return -1;
+    }
+
+    if (nlmsg_append(nl_msg,  &ifinfo, sizeof(ifinfo), NLMSG_ALIGNTO) < 0)
+        goto buffer_too_small;
+
+    NETLINK_MSG_PUT(nl_msg, IFLA_IFNAME, (strlen(ifname) + 1), ifname);
+
+    if (data->mac)
+        NETLINK_MSG_PUT(nl_msg, IFLA_ADDRESS, VIR_MAC_BUFLEN, data->mac);
+    if (data->mtu)
+        NETLINK_MSG_PUT(nl_msg, IFLA_MTU, sizeof(uint32_t), data->mtu);
+    if (data->master)
+        NETLINK_MSG_PUT(nl_msg, IFLA_MASTER, sizeof(uint32_t), data->master);
+
+    if (virNetlinkCommand(nl_msg, &resp, &buflen, 0, 0, NETLINK_ROUTE, 0) < 0)
+        return -1;
+
+    if ((*error = virNetlinkGetErrorCode(resp, buflen)) < 0)
+        return -1;
+
+    return 0;
+
+ buffer_too_small:
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                   _("allocated netlink buffer is too small"));
+    return -1;
+}
+
+
 /**
  * virNetlinkDelLink:
  *
@@ -996,6 +1065,52 @@ int virNetlinkEventServiceLocalPid(unsigned int protocol)
 }
 
 
+/**
+ * virNetlinkEventServiceAddMembership:
+ *
+ * @protocol: netlink protocol
+ * @group:    broadcast group to join in
+ *
+ * Make the running netlink event service of @protocol receive the
+ * messages broadcast to @group too, in addition to the groups it was
+ * started with. Its clients are then handed those messages as well.
+ *
+ * Returns -1 on error, 0 upon success
+ */
+int
+virNetlinkEventServiceAddMembership(unsigned int protocol,
+                                    unsigned int group)
+{
+    virNetlinkEventSrvPrivatePtr srv;
+    int ret = -1;
+
+    if (protocol >= MAX_LINKS) {
+        virReportSystemError(EINVAL,
+                             _("invalid protocol argument: %d"), protocol);
+        return -1;
+    }
+
+    if (!(srv = server[protocol])) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("netlink event service not running"));
+        return -1;
+    }
+
+    virNetlinkEventServerLock(srv);
+
+    if (nl_socket_add_membership(srv->netlinknh, group) < 0) {
+        virReportSystemError(errno,
+                             _("cannot add netlink membership %u"), group);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetlinkEventServerUnlock(srv);
+    return ret;
+}
+
+
 /**
  * virNetlinkEventServiceStart:
  *
@@ -1303,6 +1418,16 @@ virNetlinkNewLink(const char *ifname ATTRIBUTE_UNUSED,
 }
 
 
+int
+virNetlinkSetLink(const char *ifname ATTRIBUTE_UNUSED,
+                  virNetlinkSetLinkDataPtr data ATTRIBUTE_UNUSED,
+                  int *error ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
+
 int
 virNetlinkGetNeighbor(void **nlData ATTRIBUTE_UNUSED,
                       uint32_t src_pid ATTRIBUTE_UNUSED,
@@ -1360,6 +1485,13 @@ int virNetlinkEventServiceLocalPid(unsigned int protocol ATTRIBUTE_UNUSED)
     return -1;
 }
 
+int virNetlinkEventServiceAddMembership(unsigned int protocol ATTRIBUTE_UNUSED,
+                                        unsigned int group ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_INTERNAL_ERROR, "%s", _(unsupported));
+    return -1;
+}
+
 /**
  * virNetlinkEventAddClient: register a callback for handling of
  * netlink messages
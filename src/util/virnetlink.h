@@ -101,6 +101,19 @@ int virNetlinkNewLink(const char *ifname,
                       virNetlinkNewLinkDataPtr data,
                       int *error);
 
+typedef struct _virNetlinkSetLinkData virNetlinkSetLinkData;
+typedef virNetlinkSetLinkData *virNetlinkSetLinkDataPtr;
+struct _virNetlinkSetLinkData {
+    const virMacAddr *mac;          /* The MAC address of the device */
+    const unsigned int *mtu;        /* The MTU of the device */
+    const int *master;              /* The index of the master (bridge) */
+    const bool *online;             /* Whether the device is up */
+};
+
+int virNetlinkSetLink(const char *ifname,
+                      virNetlinkSetLinkDataPtr data,
+                      int *error);
+
 typedef int (*virNetlinkDelLinkFallback)(const char *ifname);
 
 int virNetlinkDelLink(const char *ifname, virNetlinkDelLinkFallback fallback);
@@ -149,6 +162,12 @@ bool virNetlinkEventServiceIsRunning(unsigned int protocol);
  */
 int virNetlinkEventServiceLocalPid(unsigned int protocol);
 
+/**
+ * virNetlinkEventServiceAddMembership: join a running monitor to another broadcast group
+ */
+int virNetlinkEventServiceAddMembership(unsigned int protocol,
+                                        unsigned int group);
+
 /**
  * virNetlinkEventAddClient: register a callback for handling of netlink messages
  */
@@ -36,6 +36,8 @@
 
 #include <sys/types.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #include "virnuma.h"
 #include "vircommand.h"
@@ -46,6 +48,9 @@
 #include "virstring.h"
 #include "virfile.h"
 #include "virhostmem.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "intprops.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -530,6 +535,195 @@ virNumaGetHugePageInfoDir(char **path, int node)
     }
 }
 
+/*
+ * The pool files of each node and huge page size are opened once and
+ * re-read with pread(), so that frequent queries, e.g. from
+ * virNodeGetFreePages() or domain startup, don't walk sysfs paths every
+ * time.  The same table keeps track of huge pages reserved by
+ * virNumaHugePageReserve() for domains which are starting.
+ */
+typedef struct _virNumaHugePagePool virNumaHugePagePool;
+typedef virNumaHugePagePool *virNumaHugePagePoolPtr;
+struct _virNumaHugePagePool {
+    int node;                   /* -1 for the host wide pool */
+    unsigned int page_size;     /* in KiB */
+    int nrFD;                   /* nr_hugepages */
+    int freeFD;                 /* free_hugepages */
+    int resvFD;                 /* resv_hugepages, host wide pool only */
+    unsigned long long reserved; /* pages held by reservations */
+};
+
+struct _virNumaHugePageReservation {
+    unsigned int page_size;
+    unsigned long long count;
+    size_t nnodes;
+    int *nodes;
+    unsigned long long *counts;
+};
+
+static virMutex virNumaHugePageLock;
+static virCond virNumaHugePageCond;
+static virNumaHugePagePoolPtr *virNumaHugePagePools;
+static size_t virNumaHugePageNPools;
+
+static int
+virNumaHugePageOnceInit(void)
+{
+    if (virMutexInit(&virNumaHugePageLock) < 0 ||
+        virCondInit(&virNumaHugePageCond) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to initialize huge page accounting"));
+        return -1;
+    }
+
+    return 0;
+}
+
+VIR_ONCE_GLOBAL_INIT(virNumaHugePage)
+
+
+static int
+virNumaHugePagePoolOpen(int node,
+                        unsigned int page_size,
+                        const char *name,
+                        bool optional)
+{
+    VIR_AUTOFREE(char *) path = NULL;
+    int fd;
+
+    if (virNumaGetHugePageInfoPath(&path, node, page_size, NULL) < 0)
+        return -1;
+
+    VIR_FREE(path);
+    if (virNumaGetHugePageInfoPath(&path, node, page_size, name) < 0) {
+        if (optional) {
+            virResetLastError();
+            return -2;
+        }
+        return -1;
+    }
+
+    if ((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        virReportSystemError(errno, _("unable to open '%s'"), path);
+        return -1;
+    }
+
+    return fd;
+}
+
+
+static void
+virNumaHugePagePoolFree(virNumaHugePagePoolPtr pool)
+{
+    if (!pool)
+        return;
+
+    VIR_FORCE_CLOSE(pool->nrFD);
+    VIR_FORCE_CLOSE(pool->freeFD);
+    VIR_FORCE_CLOSE(pool->resvFD);
+    VIR_FREE(pool);
+}
+
+
+/* Look up the pool of @page_size on @node, opening its files on first
+ * use. Must be called with virNumaHugePageLock held. */
+static virNumaHugePagePoolPtr
+virNumaHugePagePoolGet(int node,
+                       unsigned int page_size)
+{
+    virNumaHugePagePoolPtr pool = NULL;
+    size_t i;
+
+    for (i = 0; i < virNumaHugePageNPools; i++) {
+        if (virNumaHugePagePools[i]->node == node &&
+            virNumaHugePagePools[i]->page_size == page_size)
+            return virNumaHugePagePools[i];
+    }
+
+    if (VIR_ALLOC(pool) < 0)
+        return NULL;
+
+    pool->node = node;
+    pool->page_size = page_size;
+    pool->nrFD = pool->freeFD = pool->resvFD = -1;
+
+    if ((pool->nrFD = virNumaHugePagePoolOpen(node, page_size,
+                                              "nr_hugepages", false)) < 0 ||
+        (pool->freeFD = virNumaHugePagePoolOpen(node, page_size,
+                                                "free_hugepages", false)) < 0)
+        goto error;
+
+    /* The kernel reports huge pages promised to mappings which weren't
+     * faulted in yet only for the host wide pool */
+    if (node == -1 &&
+        (pool->resvFD = virNumaHugePagePoolOpen(node, page_size,
+                                                "resv_hugepages", true)) == -1)
+        goto error;
+    if (pool->resvFD < 0)
+        pool->resvFD = -1;
+
+    if (VIR_APPEND_ELEMENT(virNumaHugePagePools, virNumaHugePageNPools,
+                           pool) < 0)
+        goto error;
+
+    return virNumaHugePagePools[virNumaHugePageNPools - 1];
+
+ error:
+    virNumaHugePagePoolFree(pool);
+    return NULL;
+}
+
+
+static int
+virNumaHugePagePoolRead(virNumaHugePagePoolPtr pool,
+                        int fd,
+                        unsigned long long *value)
+{
+    char buf[INT_BUFSIZE_BOUND(unsigned long long) + 1];
+    ssize_t got;
+    char *end;
+
+    if ((got = pread(fd, buf, sizeof(buf) - 1, 0)) < 0) {
+        virReportSystemError(errno,
+                             _("unable to read huge page pool info of "
+                               "page size %u on node %d"),
+                             pool->page_size, pool->node);
+        return -1;
+    }
+    buf[got] = '\0';
+
+    if (virStrToLong_ull(buf, &end, 10, value) < 0 ||
+        *end != '\n') {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("unable to parse: %s"),
+                       buf);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* Number of free pages in @pool which are neither promised to mappings
+ * nor reserved. Must be called with virNumaHugePageLock held. */
+static int
+virNumaHugePagePoolAvailable(virNumaHugePagePoolPtr pool,
+                             unsigned long long *avail)
+{
+    unsigned long long page_free;
+    unsigned long long resv = 0;
+
+    if (virNumaHugePagePoolRead(pool, pool->freeFD, &page_free) < 0 ||
+        (pool->resvFD >= 0 &&
+         virNumaHugePagePoolRead(pool, pool->resvFD, &resv) < 0))
+        return -1;
+
+    resv += pool->reserved;
+    *avail = page_free > resv ? page_free - resv : 0;
+    return 0;
+}
+
+
 /**
  * virNumaGetHugePageInfo:
  * @node: NUMA node id
@@ -554,47 +748,30 @@ virNumaGetHugePageInfo(int node,
                        unsigned long long *page_avail,
                        unsigned long long *page_free)
 {
-    char *end;
-    VIR_AUTOFREE(char *) path = NULL;
-    VIR_AUTOFREE(char *) buf = NULL;
+    virNumaHugePagePoolPtr pool;
+    int ret = -1;
 
-    if (page_avail) {
-        if (virNumaGetHugePageInfoPath(&path, node,
-                                       page_size, "nr_hugepages") < 0)
-            return -1;
+    if (virNumaHugePageInitialize() < 0)
+        return -1;
 
-        if (virFileReadAll(path, 1024, &buf) < 0)
-            return -1;
+    virMutexLock(&virNumaHugePageLock);
 
-        if (virStrToLong_ull(buf, &end, 10, page_avail) < 0 ||
-            *end != '\n') {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("unable to parse: %s"),
-                           buf);
-            return -1;
-        }
-        VIR_FREE(buf);
-        VIR_FREE(path);
-    }
+    if (!(pool = virNumaHugePagePoolGet(node, page_size)))
+        goto cleanup;
 
-    if (page_free) {
-        if (virNumaGetHugePageInfoPath(&path, node,
-                                       page_size, "free_hugepages") < 0)
-            return -1;
+    if (page_avail &&
+        virNumaHugePagePoolRead(pool, pool->nrFD, page_avail) < 0)
+        goto cleanup;
 
-        if (virFileReadAll(path, 1024, &buf) < 0)
-            return -1;
+    if (page_free &&
+        virNumaHugePagePoolRead(pool, pool->freeFD, page_free) < 0)
+        goto cleanup;
 
-        if (virStrToLong_ull(buf, &end, 10, page_free) < 0 ||
-            *end != '\n') {
-            virReportError(VIR_ERR_INTERNAL_ERROR,
-                           _("unable to parse: %s"),
-                           buf);
-            return -1;
-        }
-    }
+    ret = 0;
 
-    return 0;
+ cleanup:
+    virMutexUnlock(&virNumaHugePageLock);
+    return ret;
 }
 
 /**
@@ -906,6 +1083,198 @@ virNumaSetPagePoolSize(int node,
 }
 
 
+
+/**
+ * virNumaHugePageReserve:
+ * @page_size: huge page size in KiB
+ * @nodeset: host NUMA nodes the pages may come from, NULL for any node
+ * @count: number of huge pages needed
+ * @timeout: how long to wait for enough free pages, in milliseconds
+ *
+ * Set aside @count huge pages of @page_size for a process which is
+ * about to map them, so that concurrently starting processes can't
+ * count on the same free pages.  Pages already promised by the kernel
+ * to existing mappings and pages reserved by other callers are not
+ * considered free.  If there are not enough free pages, wait up to
+ * @timeout milliseconds for other pages to be released.
+ *
+ * The reservation should be released by virNumaHugePageRelease once
+ * the process mapped its memory.
+ *
+ * Returns the reservation on success, NULL with an error reported
+ * otherwise.
+ */
+virNumaHugePageReservationPtr
+virNumaHugePageReserve(unsigned int page_size,
+                       virBitmapPtr nodeset,
+                       unsigned long long count,
+                       unsigned long long timeout)
+{
+    virNumaHugePageReservationPtr res = NULL;
+    virNumaHugePagePoolPtr host;
+    unsigned long long deadline = 0;
+    unsigned long long avail = 0;
+    VIR_AUTOFREE(unsigned long long *) nodeAvail = NULL;
+    ssize_t node = -1;
+    size_t i;
+
+    if (virNumaHugePageInitialize() < 0)
+        return NULL;
+
+    if (VIR_ALLOC(res) < 0)
+        return NULL;
+
+    res->page_size = page_size;
+    res->count = count;
+
+    if (nodeset) {
+        while ((node = virBitmapNextSetBit(nodeset, node)) >= 0) {
+            int id = node;
+
+            if (VIR_APPEND_ELEMENT(res->nodes, res->nnodes, id) < 0)
+                goto error;
+        }
+        if (VIR_ALLOC_N(res->counts, res->nnodes) < 0 ||
+            VIR_ALLOC_N(nodeAvail, res->nnodes) < 0)
+            goto error;
+    }
+
+    if (timeout && virTimeMillisNow(&deadline) < 0)
+        goto error;
+    deadline += timeout;
+
+    virMutexLock(&virNumaHugePageLock);
+
+    if (!(host = virNumaHugePagePoolGet(-1, page_size)))
+        goto unlock;
+
+    while (true) {
+        unsigned long long now = 0;
+        unsigned long long nodeTotal = 0;
+
+        if (virNumaHugePagePoolAvailable(host, &avail) < 0)
+            goto unlock;
+
+        for (i = 0; i < res->nnodes; i++) {
+            virNumaHugePagePoolPtr pool;
+
+            nodeAvail[i] = 0;
+
+            /* A node without this page size can't contribute */
+            if (!(pool = virNumaHugePagePoolGet(res->nodes[i], page_size))) {
+                virResetLastError();
+                continue;
+            }
+
+            if (virNumaHugePagePoolAvailable(pool, &nodeAvail[i]) < 0)
+                goto unlock;
+            nodeTotal += nodeAvail[i];
+        }
+
+        if (res->nnodes)
+            avail = MIN(avail, nodeTotal);
+
+        if (avail >= count)
+            break;
+
+        if (timeout && virTimeMillisNow(&now) < 0)
+            goto unlock;
+
+        if (now >= deadline) {
+            virReportError(VIR_ERR_OPERATION_FAILED,
+                           _("not enough free huge pages of size %u KiB: "
+                             "%llu needed, %llu available"),
+                           page_size, count, avail);
+            goto unlock;
+        }
+
+        VIR_DEBUG("Waiting for %llu huge pages of size %u KiB, %llu available",
+                  count, page_size, avail);
+
+        /* Pages freed by exiting processes don't wake us up, so check
+         * again every second */
+        if (virCondWaitUntil(&virNumaHugePageCond, &virNumaHugePageLock,
+                             MIN(deadline, now + 1000)) < 0 &&
+            errno != ETIMEDOUT) {
+            virReportSystemError(errno, "%s",
+                                 _("unable to wait for free huge pages"));
+            goto unlock;
+        }
+    }
+
+    /* Charge the nodes with most free pages first */
+    host->reserved += count;
+    avail = count;
+    while (avail) {
+        size_t best = 0;
+
+        for (i = 1; i < res->nnodes; i++) {
+            if (nodeAvail[i] > nodeAvail[best])
+                best = i;
+        }
+        if (!res->nnodes || !nodeAvail[best])
+            break;
+
+        res->counts[best] = MIN(avail, nodeAvail[best]);
+        nodeAvail[best] -= res->counts[best];
+        avail -= res->counts[best];
+        virNumaHugePagePoolGet(res->nodes[best], page_size)->reserved +=
+            res->counts[best];
+    }
+
+    virMutexUnlock(&virNumaHugePageLock);
+
+    VIR_DEBUG("Reserved %llu huge pages of size %u KiB", count, page_size);
+    return res;
+
+ unlock:
+    virMutexUnlock(&virNumaHugePageLock);
+ error:
+    VIR_FREE(res->nodes);
+    VIR_FREE(res->counts);
+    VIR_FREE(res);
+    return NULL;
+}
+
+
+/**
+ * virNumaHugePageRelease:
+ * @res: reservation returned by virNumaHugePageReserve
+ *
+ * Return the huge pages of @res to the free pages considered by
+ * further reservations and free @res.
+ */
+void
+virNumaHugePageRelease(virNumaHugePageReservationPtr res)
+{
+    virNumaHugePagePoolPtr pool;
+    size_t i;
+
+    if (!res)
+        return;
+
+    virMutexLock(&virNumaHugePageLock);
+
+    /* The pools were looked up by virNumaHugePageReserve already */
+    if ((pool = virNumaHugePagePoolGet(-1, res->page_size)))
+        pool->reserved -= MIN(pool->reserved, res->count);
+
+    for (i = 0; i < res->nnodes; i++) {
+        if (!res->counts[i] ||
+            !(pool = virNumaHugePagePoolGet(res->nodes[i], res->page_size)))
+            continue;
+        pool->reserved -= MIN(pool->reserved, res->counts[i]);
+    }
+
+    virCondBroadcast(&virNumaHugePageCond);
+    virMutexUnlock(&virNumaHugePageLock);
+
+    VIR_FREE(res->nodes);
+    VIR_FREE(res->counts);
+    VIR_FREE(res);
+}
+
+
 #else /* #ifdef __linux__ */
 int
 virNumaGetPageInfo(int node ATTRIBUTE_UNUSED,
@@ -943,6 +1312,24 @@ virNumaSetPagePoolSize(int node ATTRIBUTE_UNUSED,
                    _("page pool allocation is not supported on this platform"));
     return -1;
 }
+
+
+virNumaHugePageReservationPtr
+virNumaHugePageReserve(unsigned int page_size ATTRIBUTE_UNUSED,
+                       virBitmapPtr nodeset ATTRIBUTE_UNUSED,
+                       unsigned long long count ATTRIBUTE_UNUSED,
+                       unsigned long long timeout ATTRIBUTE_UNUSED)
+{
+    virReportError(VIR_ERR_OPERATION_UNSUPPORTED, "%s",
+                   _("huge page reservation is not supported on this platform"));
+    return NULL;
+}
+
+
+void
+virNumaHugePageRelease(virNumaHugePageReservationPtr res ATTRIBUTE_UNUSED)
+{
+}
 #endif /* #ifdef __linux__ */
 
 bool
@@ -995,3 +1382,47 @@ virNumaGetHostMemoryNodeset(void)
 
     return nodeset;
 }
+
+
+/**
+ * virNumaGetNodeOfCPUs:
+ * @cpus: map of host CPUs
+ *
+ * Returns the NUMA node all of @cpus belong to, -1 if they span several
+ * nodes, are empty or the topology is unknown. No error is reported.
+ */
+int
+virNumaGetNodeOfCPUs(virBitmapPtr cpus)
+{
+    virErrorPtr orig_err;
+    int maxnode;
+    int ret = -1;
+    size_t i;
+
+    virErrorPreserveLast(&orig_err);
+
+    if (virBitmapIsAllClear(cpus) ||
+        !virNumaIsAvailable() ||
+        (maxnode = virNumaGetMaxNode()) < 0)
+        goto cleanup;
+
+    for (i = 0; i <= maxnode; i++) {
+        VIR_AUTOPTR(virBitmap) nodecpus = NULL;
+        VIR_AUTOPTR(virBitmap) rest = NULL;
+
+        if (!virNumaNodeIsAvailable(i) ||
+            virNumaGetNodeCPUs(i, &nodecpus) < 0 ||
+            !(rest = virBitmapNewCopy(cpus)))
+            continue;
+
+        virBitmapSubtract(rest, nodecpus);
+        if (virBitmapIsAllClear(rest)) {
+            ret = i;
+            break;
+        }
+    }
+
+ cleanup:
+    virErrorRestore(&orig_err);
+    return ret;
+}
@@ -48,6 +48,7 @@ int virNumaGetNodeMemory(int node,
 unsigned int virNumaGetMaxCPUs(void);
 
 int virNumaGetNodeCPUs(int node, virBitmapPtr *cpus) ATTRIBUTE_NOINLINE;
+int virNumaGetNodeOfCPUs(virBitmapPtr cpus);
 
 int virNumaGetPageInfo(int node,
                        unsigned int page_size,
@@ -64,4 +65,14 @@ int virNumaSetPagePoolSize(int node,
                            unsigned int page_size,
                            unsigned long long page_count,
                            bool add);
+
+typedef struct _virNumaHugePageReservation virNumaHugePageReservation;
+typedef virNumaHugePageReservation *virNumaHugePageReservationPtr;
+
+virNumaHugePageReservationPtr
+virNumaHugePageReserve(unsigned int page_size,
+                       virBitmapPtr nodeset,
+                       unsigned long long count,
+                       unsigned long long timeout);
+void virNumaHugePageRelease(virNumaHugePageReservationPtr res);
 #endif /* __VIR_NUMA_H__ */
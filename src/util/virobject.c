@@ -44,9 +44,18 @@ struct _virClass {
     char *name;
     size_t objectSize;
 
+    /* number of live instances of exactly this class */
+    int instances;
+    virClassPtr next;
+
     virObjectDisposeCallback dispose;
 };
 
+/* Classes are never freed, all of them are kept on this list so that
+ * the daemon can report what its memory is spent on */
+static virClassPtr virClassList;
+static virMutex virClassListLock = VIR_MUTEX_INITIALIZER;
+
 #define VIR_OBJECT_NOTVALID(obj) (!obj || ((obj->u.s.magic & 0xFFFF0000) != 0xCAFE0000))
 
 #define VIR_OBJECT_USAGE_PRINT_WARNING(anyobj, objclass) \
@@ -189,6 +198,11 @@ virClassNew(virClassPtr parent,
     klass->objectSize = objectSize;
     klass->dispose = dispose;
 
+    virMutexLock(&virClassListLock);
+    klass->next = virClassList;
+    virClassList = klass;
+    virMutexUnlock(&virClassListLock);
+
     return klass;
 
  error:
@@ -244,6 +258,7 @@ virObjectNew(virClassPtr klass)
     obj->u.s.magic = klass->magic;
     obj->klass = klass;
     virAtomicIntSet(&obj->u.s.refs, 1);
+    virAtomicIntInc(&klass->instances);
 
     PROBE(OBJECT_NEW, "obj=%p classname=%s", obj, obj->klass->name);
 
@@ -345,6 +360,7 @@ virObjectUnref(void *anyobj)
     if (lastRef) {
         PROBE(OBJECT_DISPOSE, "obj=%p", obj);
         virClassPtr klass = obj->klass;
+        virAtomicIntAdd(&klass->instances, -1);
         while (klass) {
             if (klass->dispose)
                 klass->dispose(obj);
@@ -384,6 +400,26 @@ virObjectRef(void *anyobj)
 }
 
 
+/**
+ * virObjectGetRefs:
+ * @anyobj: any instance of virObjectPtr
+ *
+ * Returns the current reference count of @anyobj, or 0 if it is
+ * not a valid object. The count may change right after it was
+ * read unless the caller prevents others from taking references.
+ */
+int
+virObjectGetRefs(void *anyobj)
+{
+    virObjectPtr obj = anyobj;
+
+    if (VIR_OBJECT_NOTVALID(obj))
+        return 0;
+
+    return virAtomicIntGet(&obj->u.s.refs);
+}
+
+
 static virObjectLockablePtr
 virObjectGetLockableObj(void *anyobj)
 {
@@ -561,6 +597,78 @@ virClassName(virClassPtr klass)
 }
 
 
+static int
+virClassStatsCompare(const void *a,
+                     const void *b)
+{
+    const virClassStats *sa = a;
+    const virClassStats *sb = b;
+    unsigned long long bytesa = sa->instances * sa->objectSize;
+    unsigned long long bytesb = sb->instances * sb->objectSize;
+
+    if (bytesa != bytesb)
+        return bytesa < bytesb ? 1 : -1;
+    return strcmp(sa->name, sb->name);
+}
+
+
+/**
+ * virClassGetStats:
+ * @stats: filled with a newly allocated array of class statistics
+ * @nstats: filled with the number of entries in @stats
+ *
+ * Reports the number of live instances of every class which has
+ * any, sorted by the memory occupied by the object structs, largest
+ * first. Instances of derived classes are accounted to the derived
+ * class only. Memory the objects point to is not included.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virClassGetStats(virClassStatsPtr *stats,
+                 size_t *nstats)
+{
+    virClassPtr klass;
+    size_t nclasses = 0;
+    size_t n = 0;
+    int ret = -1;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    virMutexLock(&virClassListLock);
+
+    for (klass = virClassList; klass; klass = klass->next)
+        nclasses++;
+
+    if (VIR_ALLOC_N(*stats, nclasses) < 0)
+        goto cleanup;
+
+    for (klass = virClassList; klass; klass = klass->next) {
+        int instances = virAtomicIntGet(&klass->instances);
+
+        if (instances <= 0)
+            continue;
+
+        (*stats)[n].name = klass->name;
+        (*stats)[n].objectSize = klass->objectSize;
+        (*stats)[n].instances = instances;
+        n++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virClassListLock);
+
+    if (ret == 0) {
+        qsort(*stats, n, sizeof(**stats), virClassStatsCompare);
+        *nstats = n;
+    }
+    return ret;
+}
+
+
 /**
  * virObjectFreeCallback:
  * @opaque: a pointer to a virObject instance
@@ -67,6 +67,14 @@ struct _virObjectRWLockable {
     virRWLock lock;
 };
 
+typedef struct _virClassStats virClassStats;
+typedef virClassStats *virClassStatsPtr;
+struct _virClassStats {
+    const char *name; /* owned by the class, which is never freed */
+    size_t objectSize;
+    size_t instances;
+};
+
 virClassPtr virClassForObject(void);
 virClassPtr virClassForObjectLockable(void);
 virClassPtr virClassForObjectRWLockable(void);
@@ -90,6 +98,11 @@ const char *
 virClassName(virClassPtr klass)
     ATTRIBUTE_NONNULL(1);
 
+int
+virClassGetStats(virClassStatsPtr *stats,
+                 size_t *nstats)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2);
+
 bool
 virClassIsDerivedFrom(virClassPtr klass,
                       virClassPtr parent)
@@ -105,6 +118,9 @@ virObjectUnref(void *obj);
 void *
 virObjectRef(void *obj);
 
+int
+virObjectGetRefs(void *obj);
+
 bool
 virObjectIsClass(void *obj,
                  virClassPtr klass)
@@ -0,0 +1,697 @@
+/*
+ * virovsdb.c: minimal OVSDB management protocol client
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The OVSDB management protocol is described by RFC 7047. Only the
+ * parts needed to run transactions against the Open_vSwitch database
+ * over the local unix socket of ovsdb-server are implemented. A single
+ * connection is shared by the whole process, so that managing ports
+ * doesn't need to spawn an ovs-vsctl process for every operation.
+ */
+
+#include <config.h>
+
+#include <poll.h>
+#include "c-ctype.h"
+#include <sys/socket.h>
+#ifdef HAVE_SYS_UN_H
+# include <sys/un.h>
+#endif
+
+#define __VIR_OVSDB_PRIV_H_ALLOW__ 1
+#include "virovsdbpriv.h"
+
+#include "viralloc.h"
+#include "virerror.h"
+#include "virfile.h"
+#include "virlog.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+VIR_LOG_INIT("util.ovsdb");
+
+#define VIR_OVSDB_SOCKET LOCALSTATEDIR "/run/openvswitch/db.sock"
+#define VIR_OVSDB_DATABASE "Open_vSwitch"
+
+typedef struct _virOVSDBClient virOVSDBClient;
+typedef virOVSDBClient *virOVSDBClientPtr;
+struct _virOVSDBClient {
+    int fd;
+    unsigned long long serial;
+
+    /* received data not yet parsed into a message */
+    char *rbuf;
+    size_t rlen;
+    size_t ralloc;
+};
+
+static virMutex virOVSDBLock = VIR_MUTEX_INITIALIZER;
+static virOVSDBClient virOVSDBConn = { .fd = -1 };
+
+
+/**
+ * virOVSDBMessageLength:
+ * @buf: received data
+ * @len: length of @buf
+ *
+ * OVSDB messages are JSON objects sent back to back without any
+ * framing, so the end of a message has to be found by matching the
+ * braces outside of strings.
+ *
+ * Returns the length of the first complete message in @buf including
+ * any leading whitespace, 0 if @buf doesn't contain a complete message
+ * yet, or -1 if @buf doesn't start with a JSON object.
+ */
+ssize_t
+virOVSDBMessageLength(const char *buf,
+                      size_t len)
+{
+    size_t depth = 0;
+    bool instr = false;
+    bool escape = false;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        char c = buf[i];
+
+        if (instr) {
+            if (escape)
+                escape = false;
+            else if (c == '\\')
+                escape = true;
+            else if (c == '"')
+                instr = false;
+            continue;
+        }
+
+        if (depth == 0) {
+            if (c_isspace(c))
+                continue;
+            if (c != '{')
+                return -1;
+        }
+
+        switch (c) {
+        case '"':
+            instr = true;
+            break;
+        case '{':
+        case '[':
+            depth++;
+            break;
+        case '}':
+        case ']':
+            if (--depth == 0)
+                return i + 1;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+static void
+virOVSDBDisconnect(virOVSDBClientPtr client)
+{
+    VIR_FORCE_CLOSE(client->fd);
+    VIR_FREE(client->rbuf);
+    client->rlen = 0;
+    client->ralloc = 0;
+}
+
+
+#ifdef HAVE_SYS_UN_H
+static int
+virOVSDBConnect(virOVSDBClientPtr client,
+                bool report)
+{
+    struct sockaddr_un addr = {
+        .sun_family = AF_UNIX,
+    };
+    int fd = -1;
+
+    if (virStrcpyStatic(addr.sun_path, VIR_OVSDB_SOCKET) < 0) {
+        if (report)
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("OVSDB socket path '%s' too long"),
+                           VIR_OVSDB_SOCKET);
+        return -1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        if (report)
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create OVSDB socket"));
+        return -1;
+    }
+
+    if (virSetCloseExec(fd) < 0 ||
+        connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        if (report)
+            virReportSystemError(errno,
+                                 _("Unable to connect to OVSDB socket '%s'"),
+                                 VIR_OVSDB_SOCKET);
+        else
+            VIR_DEBUG("Unable to connect to OVSDB socket '%s': errno=%d",
+                      VIR_OVSDB_SOCKET, errno);
+        VIR_FORCE_CLOSE(fd);
+        return -1;
+    }
+
+    VIR_DEBUG("Connected to OVSDB at '%s'", VIR_OVSDB_SOCKET);
+    client->fd = fd;
+    return 0;
+}
+#else /* !HAVE_SYS_UN_H */
+static int
+virOVSDBConnect(virOVSDBClientPtr client ATTRIBUTE_UNUSED,
+                bool report)
+{
+    if (report)
+        virReportSystemError(ENOSYS, "%s",
+                             _("OVSDB is not supported on this platform"));
+    return -1;
+}
+#endif /* !HAVE_SYS_UN_H */
+
+
+/* Wait until @fd is ready for @events. Returns -1 with error reported
+ * if that didn't happen before @deadline. */
+static int
+virOVSDBWait(int fd,
+             short events,
+             unsigned long long deadline)
+{
+    struct pollfd pfd = { .fd = fd, .events = events };
+    unsigned long long now;
+    int rc;
+
+    do {
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+
+        if (now >= deadline) {
+            virReportError(VIR_ERR_OPERATION_TIMEOUT, "%s",
+                           _("timed out waiting for OVSDB"));
+            return -1;
+        }
+
+        rc = poll(&pfd, 1, deadline - now);
+    } while (rc == 0 || (rc < 0 && errno == EINTR));
+
+    if (rc < 0) {
+        virReportSystemError(errno, "%s", _("Unable to poll OVSDB socket"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virOVSDBSend(virOVSDBClientPtr client,
+             virJSONValuePtr msg,
+             unsigned long long deadline,
+             bool *retry)
+{
+    VIR_AUTOFREE(char *) str = NULL;
+    size_t len;
+    size_t done = 0;
+
+    if (!(str = virJSONValueToString(msg, false)))
+        return -1;
+
+    VIR_DEBUG("Send OVSDB message %s", str);
+
+    len = strlen(str);
+    while (done < len) {
+        ssize_t n;
+
+        if (virOVSDBWait(client->fd, POLLOUT, deadline) < 0)
+            return -1;
+
+        if ((n = send(client->fd, str + done, len - done, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            /* the server went away since the previous call */
+            *retry = done == 0 && (errno == EPIPE || errno == ECONNRESET);
+            virReportSystemError(errno, "%s",
+                                 _("Unable to send message to OVSDB"));
+            return -1;
+        }
+        done += n;
+    }
+
+    return 0;
+}
+
+
+static int
+virOVSDBReceive(virOVSDBClientPtr client,
+                unsigned long long id,
+                unsigned long long deadline,
+                virJSONValuePtr *reply,
+                bool *retry)
+{
+    bool received = false;
+    ssize_t len;
+
+    while (true) {
+        ssize_t n;
+
+        while ((len = virOVSDBMessageLength(client->rbuf, client->rlen)) > 0) {
+            VIR_AUTOFREE(char *) str = NULL;
+            VIR_AUTOPTR(virJSONValue) msg = NULL;
+            unsigned long long msgid;
+
+            if (VIR_STRNDUP(str, client->rbuf, len) < 0)
+                return -1;
+            memmove(client->rbuf, client->rbuf + len, client->rlen - len);
+            client->rlen -= len;
+
+            VIR_DEBUG("Received OVSDB message %s", str);
+
+            if (!(msg = virJSONValueFromString(str)))
+                return -1;
+
+            /* the server probes idle connections */
+            if (STREQ_NULLABLE(virJSONValueObjectGetString(msg, "method"),
+                               "echo")) {
+                VIR_AUTOPTR(virJSONValue) echo = NULL;
+                virJSONValuePtr params = virJSONValueObjectStealArray(msg, "params");
+                virJSONValuePtr echoid = NULL;
+
+                ignore_value(virJSONValueObjectRemoveKey(msg, "id", &echoid));
+
+                if (virJSONValueObjectCreate(&echo,
+                                             "a:result", &params,
+                                             "n:error",
+                                             "a:id", &echoid,
+                                             NULL) < 0 ||
+                    virOVSDBSend(client, echo, deadline, retry) < 0) {
+                    virJSONValueFree(params);
+                    virJSONValueFree(echoid);
+                    return -1;
+                }
+                continue;
+            }
+
+            if (virJSONValueObjectGetNumberUlong(msg, "id", &msgid) == 0 &&
+                msgid == id) {
+                VIR_STEAL_PTR(*reply, msg);
+                return 0;
+            }
+        }
+
+        if (len < 0) {
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("malformed message received from OVSDB"));
+            return -1;
+        }
+
+        if (virOVSDBWait(client->fd, POLLIN, deadline) < 0)
+            return -1;
+
+        if (VIR_RESIZE_N(client->rbuf, client->ralloc, client->rlen, 1024) < 0)
+            return -1;
+
+        if ((n = read(client->fd, client->rbuf + client->rlen,
+                      client->ralloc - client->rlen)) < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            *retry = !received && errno == ECONNRESET;
+            virReportSystemError(errno, "%s",
+                                 _("Unable to receive message from OVSDB"));
+            return -1;
+        }
+
+        if (n == 0) {
+            *retry = !received;
+            virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                           _("OVSDB closed the connection"));
+            return -1;
+        }
+
+        client->rlen += n;
+        received = true;
+    }
+}
+
+
+/* Check the reply to a transaction for errors, which are reported as an
+ * object with an "error" member either in place of the result of the
+ * operation which failed, or after the results of all operations if
+ * the commit failed. */
+static int
+virOVSDBCheckResults(virJSONValuePtr reply)
+{
+    virJSONValuePtr results;
+    size_t i;
+
+    if (!virJSONValueObjectIsNull(reply, "error")) {
+        virJSONValuePtr error = virJSONValueObjectGet(reply, "error");
+        VIR_AUTOFREE(char *) str = NULL;
+
+        if (!error || !(str = virJSONValueToString(error, false)))
+            return -1;
+
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("OVSDB request failed: %s"), str);
+        return -1;
+    }
+
+    if (!(results = virJSONValueObjectGetArray(reply, "result"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("OVSDB reply is missing the transaction result"));
+        return -1;
+    }
+
+    for (i = 0; i < virJSONValueArraySize(results); i++) {
+        virJSONValuePtr result = virJSONValueArrayGet(results, i);
+        const char *error;
+        const char *details;
+
+        if (!virJSONValueIsObject(result) ||
+            !(error = virJSONValueObjectGetString(result, "error")))
+            continue;
+
+        if ((details = virJSONValueObjectGetString(result, "details")))
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("OVSDB transaction failed: %s: %s"),
+                           error, details);
+        else
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("OVSDB transaction failed: %s"), error);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/* NULL safe lookup of the string at @idx of @array */
+static const char *
+virOVSDBArrayGetString(virJSONValuePtr array,
+                       unsigned int idx)
+{
+    virJSONValuePtr val;
+
+    if (!virJSONValueIsArray(array) ||
+        !(val = virJSONValueArrayGet(array, idx)))
+        return NULL;
+
+    return virJSONValueGetString(val);
+}
+
+
+/**
+ * virOVSDBAvailable:
+ *
+ * Check whether ovsdb-server is reachable, connecting to it unless
+ * already connected. Doesn't report any error, callers are expected to
+ * fall back to ovs-vsctl if OVSDB isn't available.
+ *
+ * Returns true if transactions can be sent to OVSDB.
+ */
+bool
+virOVSDBAvailable(void)
+{
+    bool ret;
+
+    virMutexLock(&virOVSDBLock);
+    if (virOVSDBConn.fd < 0)
+        ignore_value(virOVSDBConnect(&virOVSDBConn, false));
+    ret = virOVSDBConn.fd >= 0;
+    virMutexUnlock(&virOVSDBLock);
+
+    return ret;
+}
+
+
+/**
+ * virOVSDBTransactionNew:
+ *
+ * Returns the parameters of a new, empty transaction against the
+ * Open_vSwitch database, to be filled in with virOVSDBTransactionAppend.
+ */
+virJSONValuePtr
+virOVSDBTransactionNew(void)
+{
+    virJSONValuePtr txn;
+
+    if (!(txn = virJSONValueNewArray()))
+        return NULL;
+
+    if (virJSONValueArrayAppend(txn,
+                                virJSONValueNewString(VIR_OVSDB_DATABASE)) < 0) {
+        virJSONValueFree(txn);
+        return NULL;
+    }
+
+    return txn;
+}
+
+
+/**
+ * virOVSDBTransactionAppend:
+ * @txn: transaction returned by virOVSDBTransactionNew
+ * @op: operation
+ *
+ * Add @op to @txn. The operation is consumed, even on failure. A NULL
+ * @op, e.g. because building it failed, makes this fail as well.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virOVSDBTransactionAppend(virJSONValuePtr txn,
+                          virJSONValuePtr op)
+{
+    if (!op)
+        return -1;
+
+    if (virJSONValueArrayAppend(txn, op) < 0) {
+        virJSONValueFree(op);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+/**
+ * virOVSDBTransact:
+ * @txn: transaction returned by virOVSDBTransactionNew
+ * @timeout: timeout in seconds
+ * @results: filled in with the array of operation results (optional)
+ *
+ * Run @txn. The operations are either all applied or, if any of them
+ * fails, none are. If the connection turns out to be closed by the
+ * server before the transaction was sent, it's sent again over a new
+ * connection.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virOVSDBTransact(virJSONValuePtr txn,
+                 unsigned int timeout,
+                 virJSONValuePtr *results)
+{
+    virOVSDBClientPtr client = &virOVSDBConn;
+    VIR_AUTOPTR(virJSONValue) reply = NULL;
+    unsigned long long deadline;
+    size_t attempt;
+    int ret = -1;
+
+    if (virTimeMillisNow(&deadline) < 0)
+        return -1;
+    deadline += timeout * 1000ull;
+
+    virMutexLock(&virOVSDBLock);
+
+    for (attempt = 0; ; attempt++) {
+        VIR_AUTOPTR(virJSONValue) msg = NULL;
+        VIR_AUTOPTR(virJSONValue) params = NULL;
+        bool retry = false;
+        unsigned long long id;
+
+        if (client->fd < 0 && virOVSDBConnect(client, true) < 0)
+            goto cleanup;
+
+        id = ++client->serial;
+
+        if (!(params = virJSONValueCopy(txn)) ||
+            virJSONValueObjectCreate(&msg,
+                                     "s:method", "transact",
+                                     "a:params", &params,
+                                     "U:id", id,
+                                     NULL) < 0)
+            goto cleanup;
+
+        if (virOVSDBSend(client, msg, deadline, &retry) == 0 &&
+            virOVSDBReceive(client, id, deadline, &reply, &retry) == 0)
+            break;
+
+        virOVSDBDisconnect(client);
+
+        if (!retry || attempt > 0)
+            goto cleanup;
+
+        VIR_DEBUG("OVSDB connection was closed, reconnecting");
+        virResetLastError();
+    }
+
+    if (virOVSDBCheckResults(reply) < 0)
+        goto cleanup;
+
+    if (results)
+        *results = virJSONValueObjectStealArray(reply, "result");
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virOVSDBLock);
+    return ret;
+}
+
+
+/**
+ * virOVSDBArrayNew:
+ * @n: number of elements
+ * @...: @n elements
+ *
+ * Create an array of the @n elements, which are consumed. Any of the
+ * elements may be NULL, in which case creating the array fails. This
+ * allows nesting calls without checking each result.
+ *
+ * Returns the array, or NULL on error.
+ */
+virJSONValuePtr
+virOVSDBArrayNew(size_t n, ...)
+{
+    virJSONValuePtr array = virJSONValueNewArray();
+    va_list args;
+    size_t i;
+
+    va_start(args, n);
+    for (i = 0; i < n; i++) {
+        virJSONValuePtr elem = va_arg(args, virJSONValuePtr);
+
+        if (!array || !elem || virJSONValueArrayAppend(array, elem) < 0) {
+            virJSONValueFree(elem);
+            virJSONValueFree(array);
+            array = NULL;
+        }
+    }
+    va_end(args);
+
+    return array;
+}
+
+
+/**
+ * virOVSDBWhereName:
+ * @name: row name
+ *
+ * Returns the condition matching the row named @name.
+ */
+virJSONValuePtr
+virOVSDBWhereName(const char *name)
+{
+    return virOVSDBArrayNew(1,
+                            virOVSDBArrayNew(3,
+                                             virJSONValueNewString("name"),
+                                             virJSONValueNewString("=="),
+                                             virJSONValueNewString(name)));
+}
+
+
+/**
+ * virOVSDBResultGetRows:
+ * @results: transaction results returned by virOVSDBTransact
+ * @op: index of a "select" operation in the transaction
+ *
+ * Returns the rows selected by operation @op, or NULL with error
+ * reported if the result is malformed.
+ */
+virJSONValuePtr
+virOVSDBResultGetRows(virJSONValuePtr results,
+                      size_t op)
+{
+    virJSONValuePtr result;
+    virJSONValuePtr rows;
+
+    if (!(result = virJSONValueArrayGet(results, op)) ||
+        !(rows = virJSONValueObjectGetArray(result, "rows"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("OVSDB reply is missing the selected rows"));
+        return NULL;
+    }
+
+    return rows;
+}
+
+
+/**
+ * virOVSDBMapLookup:
+ * @map: OVSDB map, ["map", [[key, value], ...]]
+ * @key: key to look up
+ *
+ * Returns the value of @key in @map, or NULL if not found.
+ */
+virJSONValuePtr
+virOVSDBMapLookup(virJSONValuePtr map,
+                  const char *key)
+{
+    virJSONValuePtr pairs;
+    size_t i;
+
+    if (STRNEQ_NULLABLE(virOVSDBArrayGetString(map, 0), "map") ||
+        !(pairs = virJSONValueArrayGet(map, 1)) ||
+        !virJSONValueIsArray(pairs))
+        return NULL;
+
+    for (i = 0; i < virJSONValueArraySize(pairs); i++) {
+        virJSONValuePtr pair = virJSONValueArrayGet(pairs, i);
+
+        if (STREQ_NULLABLE(virOVSDBArrayGetString(pair, 0), key))
+            return virJSONValueArrayGet(pair, 1);
+    }
+
+    return NULL;
+}
+
+
+/**
+ * virOVSDBUUIDGet:
+ * @uuid: OVSDB UUID, ["uuid", "<uuid>"]
+ *
+ * Returns the string form of @uuid, or NULL if @uuid isn't an UUID.
+ */
+const char *
+virOVSDBUUIDGet(virJSONValuePtr uuid)
+{
+    if (STRNEQ_NULLABLE(virOVSDBArrayGetString(uuid, 0), "uuid"))
+        return NULL;
+
+    return virOVSDBArrayGetString(uuid, 1);
+}
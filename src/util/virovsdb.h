@@ -0,0 +1,55 @@
+/*
+ * virovsdb.h: minimal OVSDB management protocol client
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __VIR_OVSDB_H__
+# define __VIR_OVSDB_H__
+
+# include "internal.h"
+# include "virjson.h"
+
+bool virOVSDBAvailable(void);
+
+virJSONValuePtr virOVSDBTransactionNew(void);
+
+int virOVSDBTransactionAppend(virJSONValuePtr txn,
+                              virJSONValuePtr op)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+int virOVSDBTransact(virJSONValuePtr txn,
+                     unsigned int timeout,
+                     virJSONValuePtr *results)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_RETURN_CHECK;
+
+virJSONValuePtr virOVSDBArrayNew(size_t n, ...);
+
+virJSONValuePtr virOVSDBWhereName(const char *name)
+    ATTRIBUTE_NONNULL(1);
+
+virJSONValuePtr virOVSDBResultGetRows(virJSONValuePtr results,
+                                      size_t op)
+    ATTRIBUTE_NONNULL(1);
+
+virJSONValuePtr virOVSDBMapLookup(virJSONValuePtr map,
+                                  const char *key)
+    ATTRIBUTE_NONNULL(2);
+
+const char *virOVSDBUUIDGet(virJSONValuePtr uuid);
+
+#endif /* __VIR_OVSDB_H__ */
@@ -38,6 +38,7 @@
 #include "vircommand.h"
 #include "virerror.h"
 #include "virfile.h"
+#include "virhash.h"
 #include "virkmod.h"
 #include "virstring.h"
 #include "virutil.h"
@@ -48,6 +49,8 @@ VIR_LOG_INIT("util.pci");
 #define PCI_ID_LEN 10   /* "XXXX XXXX" */
 #define PCI_ADDR_LEN 13 /* "XXXX:XX:XX.X" */
 
+#define VIR_PCI_DEVICE_LIST_INDEX_SIZE 32
+
 VIR_ENUM_IMPL(virPCIELinkSpeed, VIR_PCIE_LINK_SPEED_LAST,
               "", "2.5", "5", "8", "16")
 
@@ -94,6 +97,9 @@ struct _virPCIDeviceList {
 
     size_t count;
     virPCIDevicePtr *devs;
+
+    /* the devices in @devs, keyed by their name */
+    virHashTablePtr index;
 };
 
 
@@ -197,17 +203,270 @@ static virClassPtr virPCIDeviceListClass;
 
 static void virPCIDeviceListDispose(void *obj);
 
+/*
+ * Vendor/product IDs and IOMMU groups of PCI devices only change when
+ * devices are removed or added, yet their sysfs files are read over and
+ * over by domain startup and node device enumeration. Since there is no
+ * cheap way to tell whether the data is still valid, it is only cached
+ * while somebody who is told about hotplug (the udev node device
+ * driver) has enabled the cache and calls virPCIDeviceCacheInvalidate()
+ * on every PCI udev event.
+ */
+#define VIR_PCI_CACHE_TABLE_SIZE 128
+#define VIR_PCI_CACHE_UNKNOWN -3
+
+typedef struct _virPCIDeviceCacheEntry virPCIDeviceCacheEntry;
+typedef virPCIDeviceCacheEntry *virPCIDeviceCacheEntryPtr;
+struct _virPCIDeviceCacheEntry {
+    char id[PCI_ID_LEN];    /* empty if not known */
+
+    int iommuGroup;         /* VIR_PCI_CACHE_UNKNOWN if not known */
+
+    bool haveGroupAddrs;
+    size_t ngroupAddrs;
+    virPCIDeviceAddressPtr groupAddrs;
+};
+
+static virMutex virPCICacheLock;
+static virHashTablePtr virPCICache; /* NULL while disabled */
+
 static int virPCIOnceInit(void)
 {
     if (!VIR_CLASS_NEW(virPCIDeviceList, virClassForObjectLockable()))
         return -1;
 
+    if (virMutexInit(&virPCICacheLock) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("unable to initialize PCI device cache mutex"));
+        return -1;
+    }
+
     return 0;
 }
 
 VIR_ONCE_GLOBAL_INIT(virPCI)
 
 
+static void
+virPCIDeviceCacheEntryFree(void *payload,
+                           const void *name ATTRIBUTE_UNUSED)
+{
+    virPCIDeviceCacheEntryPtr entry = payload;
+
+    VIR_FREE(entry->groupAddrs);
+    VIR_FREE(entry);
+}
+
+
+/* Returns the cache entry for @name, creating it if needed, or NULL if
+ * the cache is disabled. Failing to allocate is not an error, the
+ * caller just goes to sysfs. */
+static virPCIDeviceCacheEntryPtr
+virPCIDeviceCacheGetLocked(const char *name)
+{
+    virPCIDeviceCacheEntryPtr entry;
+
+    if (!virPCICache)
+        return NULL;
+
+    if ((entry = virHashLookup(virPCICache, name)))
+        return entry;
+
+    if (VIR_ALLOC_QUIET(entry) < 0)
+        return NULL;
+    entry->iommuGroup = VIR_PCI_CACHE_UNKNOWN;
+
+    if (virHashAddEntry(virPCICache, name, entry) < 0) {
+        virResetLastError();
+        VIR_FREE(entry);
+        return NULL;
+    }
+
+    return entry;
+}
+
+
+/* Failing to initialize is not an error here either, the caller
+ * just doesn't get to use the cache */
+static bool
+virPCIDeviceCacheLock(void)
+{
+    if (virPCIInitialize() < 0) {
+        virResetLastError();
+        return false;
+    }
+
+    virMutexLock(&virPCICacheLock);
+    return true;
+}
+
+
+static bool
+virPCIDeviceCacheGetID(const char *name,
+                       char *id)
+{
+    virPCIDeviceCacheEntryPtr entry;
+    bool ret = false;
+
+    if (!virPCIDeviceCacheLock())
+        return false;
+    if ((entry = virPCIDeviceCacheGetLocked(name)) && *entry->id) {
+        memcpy(id, entry->id, PCI_ID_LEN);
+        ret = true;
+    }
+    virMutexUnlock(&virPCICacheLock);
+
+    return ret;
+}
+
+
+static void
+virPCIDeviceCacheSetID(const char *name,
+                       const char *id)
+{
+    virPCIDeviceCacheEntryPtr entry;
+
+    if (!virPCIDeviceCacheLock())
+        return;
+    if ((entry = virPCIDeviceCacheGetLocked(name)))
+        memcpy(entry->id, id, PCI_ID_LEN);
+    virMutexUnlock(&virPCICacheLock);
+}
+
+
+static int
+virPCIDeviceCacheGetIOMMUGroup(const char *name)
+{
+    virPCIDeviceCacheEntryPtr entry;
+    int ret = VIR_PCI_CACHE_UNKNOWN;
+
+    if (!virPCIDeviceCacheLock())
+        return ret;
+    if ((entry = virPCIDeviceCacheGetLocked(name)))
+        ret = entry->iommuGroup;
+    virMutexUnlock(&virPCICacheLock);
+
+    return ret;
+}
+
+
+static void
+virPCIDeviceCacheSetIOMMUGroup(const char *name,
+                               int group)
+{
+    virPCIDeviceCacheEntryPtr entry;
+
+    if (!virPCIDeviceCacheLock())
+        return;
+    if ((entry = virPCIDeviceCacheGetLocked(name)))
+        entry->iommuGroup = group;
+    virMutexUnlock(&virPCICacheLock);
+}
+
+
+/* Hands out a copy of the cached addresses of all devices in the same
+ * IOMMU group as @name */
+static bool
+virPCIDeviceCacheGetGroupAddrs(const char *name,
+                               virPCIDeviceAddressPtr *addrs,
+                               size_t *naddrs)
+{
+    virPCIDeviceCacheEntryPtr entry;
+    bool ret = false;
+
+    if (!virPCIDeviceCacheLock())
+        return false;
+    if ((entry = virPCIDeviceCacheGetLocked(name)) &&
+        entry->haveGroupAddrs &&
+        VIR_ALLOC_N_QUIET(*addrs, entry->ngroupAddrs) == 0) {
+        memcpy(*addrs, entry->groupAddrs,
+               sizeof(*entry->groupAddrs) * entry->ngroupAddrs);
+        *naddrs = entry->ngroupAddrs;
+        ret = true;
+    }
+    virMutexUnlock(&virPCICacheLock);
+
+    return ret;
+}
+
+
+static void
+virPCIDeviceCacheSetGroupAddrs(const char *name,
+                               virPCIDeviceAddressPtr addrs,
+                               size_t naddrs)
+{
+    virPCIDeviceCacheEntryPtr entry;
+
+    if (!virPCIDeviceCacheLock())
+        return;
+    if ((entry = virPCIDeviceCacheGetLocked(name)) &&
+        !entry->haveGroupAddrs &&
+        VIR_ALLOC_N_QUIET(entry->groupAddrs, naddrs) == 0) {
+        memcpy(entry->groupAddrs, addrs, sizeof(*addrs) * naddrs);
+        entry->ngroupAddrs = naddrs;
+        entry->haveGroupAddrs = true;
+    }
+    virMutexUnlock(&virPCICacheLock);
+}
+
+
+/**
+ * virPCIDeviceCacheSetEnabled:
+ * @enabled: whether to cache PCI device information
+ *
+ * Enable or disable caching of PCI device information read from sysfs.
+ * Whoever enables the cache has to call virPCIDeviceCacheInvalidate()
+ * whenever PCI devices are added or removed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPCIDeviceCacheSetEnabled(bool enabled)
+{
+    int ret = -1;
+
+    if (virPCIInitialize() < 0)
+        return -1;
+
+    virMutexLock(&virPCICacheLock);
+
+    if (!enabled) {
+        virHashFree(virPCICache);
+        virPCICache = NULL;
+    } else if (!virPCICache &&
+               !(virPCICache = virHashCreate(VIR_PCI_CACHE_TABLE_SIZE,
+                                             virPCIDeviceCacheEntryFree))) {
+        goto cleanup;
+    }
+
+    VIR_DEBUG("PCI device cache %s", enabled ? "enabled" : "disabled");
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&virPCICacheLock);
+    return ret;
+}
+
+
+/**
+ * virPCIDeviceCacheInvalidate:
+ *
+ * Drop all cached PCI device information, so that it's read again
+ * from sysfs the next time it's needed.
+ */
+void
+virPCIDeviceCacheInvalidate(void)
+{
+    if (virPCIInitialize() < 0)
+        return;
+
+    virMutexLock(&virPCICacheLock);
+    if (virPCICache)
+        virHashRemoveAll(virPCICache);
+    virMutexUnlock(&virPCICacheLock);
+}
+
+
 static char *
 virPCIDriverDir(const char *driver)
 {
@@ -1779,23 +2038,27 @@ virPCIDeviceNew(unsigned int domain,
         goto cleanup;
     }
 
-    vendor  = virPCIDeviceReadID(dev, "vendor");
-    product = virPCIDeviceReadID(dev, "device");
+    if (!virPCIDeviceCacheGetID(dev->name, dev->id)) {
+        vendor  = virPCIDeviceReadID(dev, "vendor");
+        product = virPCIDeviceReadID(dev, "device");
 
-    if (!vendor || !product) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Failed to read product/vendor ID for %s"),
-                       dev->name);
-        goto cleanup;
-    }
+        if (!vendor || !product) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("Failed to read product/vendor ID for %s"),
+                           dev->name);
+            goto cleanup;
+        }
 
-    /* strings contain '0x' prefix */
-    if (snprintf(dev->id, sizeof(dev->id), "%s %s", &vendor[2],
-                 &product[2]) >= sizeof(dev->id)) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("dev->id buffer overflow: %s %s"),
-                       &vendor[2], &product[2]);
-        goto cleanup;
+        /* strings contain '0x' prefix */
+        if (snprintf(dev->id, sizeof(dev->id), "%s %s", &vendor[2],
+                     &product[2]) >= sizeof(dev->id)) {
+            virReportError(VIR_ERR_INTERNAL_ERROR,
+                           _("dev->id buffer overflow: %s %s"),
+                           &vendor[2], &product[2]);
+            goto cleanup;
+        }
+
+        virPCIDeviceCacheSetID(dev->name, dev->id);
     }
 
     VIR_DEBUG("%s %s: initialized", dev->id, dev->name);
@@ -1971,6 +2234,11 @@ virPCIDeviceListNew(void)
     if (!(list = virObjectLockableNew(virPCIDeviceListClass)))
         return NULL;
 
+    if (!(list->index = virHashCreate(VIR_PCI_DEVICE_LIST_INDEX_SIZE, NULL))) {
+        virObjectUnref(list);
+        return NULL;
+    }
+
     return list;
 }
 
@@ -1987,6 +2255,7 @@ virPCIDeviceListDispose(void *obj)
 
     list->count = 0;
     VIR_FREE(list->devs);
+    virHashFree(list->index);
 }
 
 int
@@ -1998,7 +2267,16 @@ virPCIDeviceListAdd(virPCIDeviceListPtr list,
                        _("Device %s is already in use"), dev->name);
         return -1;
     }
-    return VIR_APPEND_ELEMENT(list->devs, list->count, dev);
+
+    if (virHashAddEntry(list->index, dev->name, dev) < 0)
+        return -1;
+
+    if (VIR_APPEND_ELEMENT(list->devs, list->count, dev) < 0) {
+        virHashRemoveEntry(list->index, dev->name);
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -2047,6 +2325,7 @@ virPCIDeviceListStealIndex(virPCIDeviceListPtr list,
 
     ret = list->devs[idx];
     VIR_DELETE_ELEMENT(list->devs, idx, list->count);
+    virHashRemoveEntry(list->index, ret->name);
     return ret;
 }
 
@@ -2067,14 +2346,17 @@ virPCIDeviceListDel(virPCIDeviceListPtr list,
 int
 virPCIDeviceListFindIndex(virPCIDeviceListPtr list, virPCIDevicePtr dev)
 {
+    virPCIDevicePtr other;
     size_t i;
 
+    /* Spare the scan if the device isn't in the list at all, which
+     * is by far the most common case for callers checking whether a
+     * device is in use */
+    if (!(other = virHashLookup(list->index, dev->name)))
+        return -1;
+
     for (i = 0; i < list->count; i++) {
-        virPCIDevicePtr other = list->devs[i];
-        if (other->address.domain   == dev->address.domain &&
-            other->address.bus      == dev->address.bus    &&
-            other->address.slot     == dev->address.slot   &&
-            other->address.function == dev->address.function)
+        if (list->devs[i] == other)
             return i;
     }
     return -1;
@@ -2088,29 +2370,20 @@ virPCIDeviceListFindByIDs(virPCIDeviceListPtr list,
                           unsigned int slot,
                           unsigned int function)
 {
-    size_t i;
+    char name[PCI_ADDR_LEN];
 
-    for (i = 0; i < list->count; i++) {
-        virPCIDevicePtr other = list->devs[i];
-        if (other->address.domain   == domain &&
-            other->address.bus      == bus    &&
-            other->address.slot     == slot   &&
-            other->address.function == function)
-            return list->devs[i];
-    }
-    return NULL;
+    if (snprintf(name, sizeof(name), "%.4x:%.2x:%.2x.%.1x",
+                 domain, bus, slot, function) >= sizeof(name))
+        return NULL;
+
+    return virHashLookup(list->index, name);
 }
 
 
 virPCIDevicePtr
 virPCIDeviceListFind(virPCIDeviceListPtr list, virPCIDevicePtr dev)
 {
-    int idx;
-
-    if ((idx = virPCIDeviceListFindIndex(list, dev)) >= 0)
-        return list->devs[idx];
-    else
-        return NULL;
+    return virHashLookup(list->index, dev->name);
 }
 
 
@@ -2172,14 +2445,28 @@ virPCIDeviceAddressIOMMUGroupIterate(virPCIDeviceAddressPtr orig,
                                      void *opaque)
 {
     VIR_AUTOFREE(char *) groupPath = NULL;
+    VIR_AUTOFREE(virPCIDeviceAddressPtr) addrs = NULL;
+    size_t naddrs = 0;
+    char name[PCI_ADDR_LEN];
     DIR *groupDir = NULL;
     int ret = -1;
     struct dirent *ent;
     int direrr;
+    size_t i;
+
+    if (snprintf(name, sizeof(name), "%.4x:%.2x:%.2x.%.1x", orig->domain,
+                 orig->bus, orig->slot, orig->function) >= sizeof(name)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("PCI address buffer overflow: %.4x:%.2x:%.2x.%.1x"),
+                       orig->domain, orig->bus, orig->slot, orig->function);
+        goto cleanup;
+    }
+
+    if (virPCIDeviceCacheGetGroupAddrs(name, &addrs, &naddrs))
+        goto iterate;
 
     if (virAsprintf(&groupPath,
-                    PCI_SYSFS "devices/%04x:%02x:%02x.%x/iommu_group/devices",
-                    orig->domain, orig->bus, orig->slot, orig->function) < 0)
+                    PCI_SYSFS "devices/%s/iommu_group/devices", name) < 0)
         goto cleanup;
 
     if (virDirOpenQuiet(&groupDir, groupPath) < 0) {
@@ -2198,12 +2485,20 @@ virPCIDeviceAddressIOMMUGroupIterate(virPCIDeviceAddressPtr orig,
             goto cleanup;
         }
 
-        if ((actor)(&newDev, opaque) < 0)
+        if (VIR_APPEND_ELEMENT(addrs, naddrs, newDev) < 0)
             goto cleanup;
     }
     if (direrr < 0)
         goto cleanup;
 
+    virPCIDeviceCacheSetGroupAddrs(name, addrs, naddrs);
+
+ iterate:
+    for (i = 0; i < naddrs; i++) {
+        if ((actor)(&addrs[i], opaque) < 0)
+            goto cleanup;
+    }
+
     ret = 0;
 
  cleanup:
@@ -2326,15 +2621,21 @@ virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceAddressPtr addr)
     VIR_AUTOFREE(char *) groupPath = NULL;
     const char *groupNumStr;
     unsigned int groupNum;
+    int cached;
 
     if (virAsprintf(&devName, "%.4x:%.2x:%.2x.%.1x", addr->domain,
                     addr->bus, addr->slot, addr->function) < 0)
         return -1;
 
+    if ((cached = virPCIDeviceCacheGetIOMMUGroup(devName)) != VIR_PCI_CACHE_UNKNOWN)
+        return cached;
+
     if (!(devPath = virPCIFile(devName, "iommu_group")))
         return -1;
-    if (virFileIsLink(devPath) != 1)
+    if (virFileIsLink(devPath) != 1) {
+        virPCIDeviceCacheSetIOMMUGroup(devName, -2);
         return -2;
+    }
     if (virFileResolveLink(devPath, &groupPath) < 0) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
                        _("Unable to resolve device %s iommu_group symlink %s"),
@@ -2351,6 +2652,7 @@ virPCIDeviceAddressGetIOMMUGroupNum(virPCIDeviceAddressPtr addr)
         return -1;
     }
 
+    virPCIDeviceCacheSetIOMMUGroup(devName, groupNum);
     return groupNum;
 }
 
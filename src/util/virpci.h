@@ -160,6 +160,9 @@ virPCIDeviceListFindByIDs(virPCIDeviceListPtr list,
 int virPCIDeviceListFindIndex(virPCIDeviceListPtr list,
                               virPCIDevicePtr dev);
 
+int virPCIDeviceCacheSetEnabled(bool enabled);
+void virPCIDeviceCacheInvalidate(void);
+
 /*
  * Callback that will be invoked once for each file
  * associated with / used for PCI host device access.
@@ -51,6 +51,9 @@ VIR_ENUM_IMPL(virPerfEvent, VIR_PERF_EVENT_LAST,
 struct virPerfEvent {
     int fd;
     bool enabled;
+    /* Kernel assigned ID of the event in the group of @fd, 0 if the event
+     * was opened on its own */
+    uint64_t id;
     union {
         /* cmt */
         struct {
@@ -60,8 +63,19 @@ struct virPerfEvent {
 };
 typedef struct virPerfEvent *virPerfEventPtr;
 
+/*
+ * Events are put into one perf event group led by a dummy software event
+ * so that the counters of all of them are read with a single read() of
+ * the group leader. Events the kernel refuses to add to the group, e.g.
+ * because they belong to a different PMU or the group would not fit
+ * onto the hardware counters at once, are opened and read on their own.
+ */
 struct _virPerf {
     struct virPerfEvent events[VIR_PERF_EVENT_LAST];
+    /* Group leader, -1 if not opened yet */
+    int groupFd;
+    /* Set if the group leader could not be opened */
+    bool groupUnsupported;
 };
 
 #if defined(__linux__) && defined(HAVE_SYS_SYSCALL_H)
@@ -171,6 +185,11 @@ static struct virPerfEventAttr attrs[] = {
 verify(ARRAY_CARDINALITY(attrs) == VIR_PERF_EVENT_LAST);
 typedef struct virPerfEventAttr *virPerfEventAttrPtr;
 
+/* PERF_COUNT_SW_DUMMY is missing in older kernel headers */
+# define VIR_PERF_COUNT_SW_DUMMY 9
+
+# define VIR_PERF_GROUP_READ_FORMAT (PERF_FORMAT_GROUP | PERF_FORMAT_ID)
+
 
 static int
 virPerfRdtAttrInit(void)
@@ -199,6 +218,72 @@ virPerfRdtAttrInit(void)
 }
 
 
+static void
+virPerfGroupOpen(virPerfPtr perf,
+                 pid_t pid)
+{
+# ifdef PERF_EVENT_IOC_ID
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.inherit = 1;
+    attr.type = PERF_TYPE_SOFTWARE;
+    attr.config = VIR_PERF_COUNT_SW_DUMMY;
+    attr.read_format = VIR_PERF_GROUP_READ_FORMAT;
+
+    perf->groupFd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+    if (perf->groupFd >= 0)
+        return;
+
+    VIR_DEBUG("Unable to open perf event group leader, errno=%d", errno);
+# endif /* PERF_EVENT_IOC_ID */
+    perf->groupUnsupported = true;
+}
+
+
+/* Try to add the event described by @attr to the group of @perf */
+static int
+virPerfGroupAddEvent(virPerfPtr perf,
+                     virPerfEventType type,
+                     struct perf_event_attr *attr,
+                     pid_t pid)
+{
+# ifdef PERF_EVENT_IOC_ID
+    virPerfEventPtr event = &perf->events[type];
+
+    if (perf->groupFd < 0 && !perf->groupUnsupported)
+        virPerfGroupOpen(perf, pid);
+
+    if (perf->groupFd < 0)
+        return -1;
+
+    attr->read_format = VIR_PERF_GROUP_READ_FORMAT;
+    event->fd = syscall(__NR_perf_event_open, attr, pid, -1,
+                        perf->groupFd, 0);
+    attr->read_format = 0;
+
+    if (event->fd < 0) {
+        VIR_DEBUG("Unable to add perf event %s to the group, errno=%d",
+                  virPerfEventTypeToString(type), errno);
+        return -1;
+    }
+
+    if (ioctl(event->fd, PERF_EVENT_IOC_ID, &event->id) < 0) {
+        VIR_DEBUG("Unable to get ID of perf event %s, errno=%d",
+                  virPerfEventTypeToString(type), errno);
+        VIR_FORCE_CLOSE(event->fd);
+        event->id = 0;
+        return -1;
+    }
+
+    return 0;
+# else /* !PERF_EVENT_IOC_ID */
+    return -1;
+# endif /* !PERF_EVENT_IOC_ID */
+}
+
+
 int
 virPerfEventEnable(virPerfPtr perf,
                    virPerfEventType type,
@@ -242,7 +327,8 @@ virPerfEventEnable(virPerfPtr perf,
     attr.type = event_attr->attrType;
     attr.config = event_attr->attrConfig;
 
-    event->fd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
+    if (virPerfGroupAddEvent(perf, type, &attr, pid) < 0)
+        event->fd = syscall(__NR_perf_event_open, &attr, pid, -1, -1, 0);
     if (event->fd < 0) {
         virReportSystemError(errno,
                              _("unable to open host cpu perf event for %s"),
@@ -262,6 +348,7 @@ virPerfEventEnable(virPerfPtr perf,
 
  error:
     VIR_FORCE_CLOSE(event->fd);
+    event->id = 0;
     return -1;
 }
 
@@ -282,6 +369,7 @@ virPerfEventDisable(virPerfPtr perf,
     }
 
     event->enabled = false;
+    event->id = 0;
     VIR_FORCE_CLOSE(event->fd);
     return 0;
 }
@@ -292,18 +380,78 @@ bool virPerfEventIsEnabled(virPerfPtr perf,
     return perf && perf->events[type].enabled;
 }
 
+/* Fill @values with the counters of the enabled events of the group */
+static int
+virPerfReadGroup(virPerfPtr perf,
+                 uint64_t *values)
+{
+    /* nr, followed by a value and ID pair per event including the
+     * group leader */
+    uint64_t buf[1 + 2 * (VIR_PERF_EVENT_LAST + 1)];
+    ssize_t got;
+    size_t i;
+    size_t j;
+
+    if ((got = saferead(perf->groupFd, buf, sizeof(buf))) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to read perf event group"));
+        return -1;
+    }
+
+    if ((size_t) got < sizeof(buf[0]) ||
+        (size_t) got < sizeof(buf[0]) * (1 + 2 * buf[0])) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Short read of perf event group"));
+        return -1;
+    }
+
+    for (i = 0; i < buf[0]; i++) {
+        for (j = 0; j < VIR_PERF_EVENT_LAST; j++) {
+            if (perf->events[j].enabled &&
+                perf->events[j].id == buf[2 + 2 * i]) {
+                values[j] = buf[1 + 2 * i];
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+virPerfReadOne(virPerfPtr perf,
+               virPerfEventType type,
+               uint64_t *value)
+{
+    virPerfEventPtr event = &perf->events[type];
+
+    if (saferead(event->fd, value, sizeof(uint64_t)) < 0) {
+        virReportSystemError(errno, "%s",
+                             _("Unable to read cache data"));
+        return -1;
+    }
+
+    return 0;
+}
+
+
 int
 virPerfReadEvent(virPerfPtr perf,
                  virPerfEventType type,
                  uint64_t *value)
 {
     virPerfEventPtr event = &perf->events[type];
+    uint64_t values[VIR_PERF_EVENT_LAST] = { 0 };
+
     if (!event->enabled)
         return -1;
 
-    if (saferead(event->fd, value, sizeof(uint64_t)) < 0) {
-        virReportSystemError(errno, "%s",
-                             _("Unable to read cache data"));
+    if (event->id) {
+        if (virPerfReadGroup(perf, values) < 0)
+            return -1;
+        *value = values[type];
+    } else if (virPerfReadOne(perf, type, value) < 0) {
         return -1;
     }
 
@@ -313,6 +461,48 @@ virPerfReadEvent(virPerfPtr perf,
     return 0;
 }
 
+
+/**
+ * virPerfReadEvents:
+ * @perf: perf events
+ * @values: array of VIR_PERF_EVENT_LAST items
+ *
+ * Read the counters of all enabled events of @perf into @values, indexed
+ * by virPerfEventType. The events put into the group are read at once.
+ * Items of disabled events are left untouched.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virPerfReadEvents(virPerfPtr perf,
+                  uint64_t *values)
+{
+    bool grouped = false;
+    size_t i;
+
+    for (i = 0; i < VIR_PERF_EVENT_LAST; i++) {
+        virPerfEventPtr event = &perf->events[i];
+
+        if (!event->enabled)
+            continue;
+
+        if (!event->id) {
+            if (virPerfReadOne(perf, i, &values[i]) < 0)
+                return -1;
+        } else {
+            grouped = true;
+        }
+    }
+
+    if (grouped && virPerfReadGroup(perf, values) < 0)
+        return -1;
+
+    if (perf->events[VIR_PERF_EVENT_CMT].enabled)
+        values[VIR_PERF_EVENT_CMT] *= perf->events[VIR_PERF_EVENT_CMT].efields.cmt.scale;
+
+    return 0;
+}
+
 #else
 static int
 virPerfRdtAttrInit(void)
@@ -357,6 +547,15 @@ virPerfReadEvent(virPerfPtr perf ATTRIBUTE_UNUSED,
     return -1;
 }
 
+int
+virPerfReadEvents(virPerfPtr perf ATTRIBUTE_UNUSED,
+                  uint64_t *values ATTRIBUTE_UNUSED)
+{
+    virReportSystemError(ENXIO, "%s",
+                         _("Perf not supported on this platform"));
+    return -1;
+}
+
 #endif
 
 virPerfPtr
@@ -372,6 +571,7 @@ virPerfNew(void)
         perf->events[i].fd = -1;
         perf->events[i].enabled = false;
     }
+    perf->groupFd = -1;
 
     if (virPerfRdtAttrInit() < 0)
         virResetLastError();
@@ -392,5 +592,6 @@ virPerfFree(virPerfPtr perf)
             virPerfEventDisable(perf, i);
     }
 
+    VIR_FORCE_CLOSE(perf->groupFd);
     VIR_FREE(perf);
 }
@@ -85,6 +85,9 @@ int virPerfReadEvent(virPerfPtr perf,
                      virPerfEventType type,
                      uint64_t *value);
 
+int virPerfReadEvents(virPerfPtr perf,
+                      uint64_t *values);
+
 VIR_DEFINE_AUTOPTR_FUNC(virPerf, virPerfFree)
 
 #endif /* __VIR_PERF_H__ */
@@ -32,16 +32,24 @@
 #include "virerror.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 #define VIR_PORT_ALLOCATOR_NUM_PORTS 65536
 
+/* How long ports found in use by somebody else are skipped without
+ * probing them again, in milliseconds */
+#define VIR_PORT_ALLOCATOR_BUSY_TIMEOUT (30 * 1000)
+
 typedef struct _virPortAllocator virPortAllocator;
 typedef virPortAllocator *virPortAllocatorPtr;
 struct _virPortAllocator {
     virObjectLockable parent;
-    virBitmapPtr bitmap;
+    virBitmapPtr bitmap;    /* ports handed out */
+    virBitmapPtr released;  /* ports given back, tried first */
+    virBitmapPtr busy;      /* ports recently found in use by others */
+    unsigned long long busySince; /* when @busy was last emptied */
 };
 
 struct _virPortAllocatorRange {
@@ -49,6 +57,7 @@ struct _virPortAllocatorRange {
 
     unsigned short start;
     unsigned short end;
+    unsigned short next;    /* where the search for a fresh port resumes */
 };
 
 static virClassPtr virPortAllocatorClass;
@@ -60,6 +69,8 @@ virPortAllocatorDispose(void *obj)
     virPortAllocatorPtr pa = obj;
 
     virBitmapFree(pa->bitmap);
+    virBitmapFree(pa->released);
+    virBitmapFree(pa->busy);
 }
 
 static virPortAllocatorPtr
@@ -70,7 +81,9 @@ virPortAllocatorNew(void)
     if (!(pa = virObjectLockableNew(virPortAllocatorClass)))
         return NULL;
 
-    if (!(pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)))
+    if (!(pa->bitmap = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)) ||
+        !(pa->released = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)) ||
+        !(pa->busy = virBitmapNew(VIR_PORT_ALLOCATOR_NUM_PORTS)))
         goto error;
 
     return pa;
@@ -111,6 +124,7 @@ virPortAllocatorRangeNew(const char *name,
 
     range->start = start;
     range->end = end;
+    range->next = start;
 
     if (VIR_STRDUP(range->name, name) < 0)
         goto error;
@@ -211,12 +225,61 @@ virPortAllocatorGet(void)
     return virPortAllocatorInstance;
 }
 
+/*
+ * Check that nobody else uses @port by binding to it and reserve it if
+ * so. Returns 1 if the port was reserved, 0 if it is in use, or -1 on
+ * error.
+ */
+static int
+virPortAllocatorTryPort(virPortAllocatorPtr pa,
+                        unsigned short port)
+{
+    bool used = false, v6used = false;
+
+    if (virPortAllocatorBindToPort(&v6used, port, AF_INET6) < 0 ||
+        virPortAllocatorBindToPort(&used, port, AF_INET) < 0)
+        return -1;
+
+    ignore_value(virBitmapClearBit(pa->released, port));
+
+    if (used || v6used) {
+        ignore_value(virBitmapSetBit(pa->busy, port));
+        return 0;
+    }
+
+    /* Add port to bitmap of reserved ports */
+    if (virBitmapSetBit(pa->bitmap, port) < 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Failed to reserve port %d"), port);
+        return -1;
+    }
+
+    return 1;
+}
+
+/*
+ * Ports are looked for in this order:
+ *
+ *  - the lowest port of @range given back by virPortAllocatorRelease,
+ *  - the ports of @range following the one handed out last, skipping
+ *    ports that were found in use by others recently,
+ *  - if that fails too, all ports of @range not handed out by us, as
+ *    ports found in use may have been freed in the meantime.
+ *
+ * So that most allocations need a single test bind even if many ports
+ * of the range are taken.
+ */
 int
-virPortAllocatorAcquire(const virPortAllocatorRange *range,
+virPortAllocatorAcquire(virPortAllocatorRangePtr range,
                         unsigned short *port)
 {
     int ret = -1;
+    int rc;
+    ssize_t pos;
+    size_t nports = range->end - range->start + 1;
     size_t i;
+    size_t pass;
+    unsigned long long now;
     virPortAllocatorPtr pa = virPortAllocatorGet();
 
     *port = 0;
@@ -226,33 +289,56 @@ virPortAllocatorAcquire(const virPortAllocatorRange *range,
 
     virObjectLock(pa);
 
-    for (i = range->start; i <= range->end && !*port; i++) {
-        bool used = false, v6used = false;
+    if (virTimeMillisNow(&now) < 0)
+        goto cleanup;
+
+    if (now - pa->busySince > VIR_PORT_ALLOCATOR_BUSY_TIMEOUT) {
+        virBitmapClearAll(pa->busy);
+        pa->busySince = now;
+    }
 
-        if (virBitmapIsBitSet(pa->bitmap, i))
+    pos = range->start - 1;
+    while ((pos = virBitmapNextSetBit(pa->released, pos)) >= 0 &&
+           pos <= range->end) {
+        if (virBitmapIsBitSet(pa->bitmap, pos))
             continue;
 
-        if (virPortAllocatorBindToPort(&v6used, i, AF_INET6) < 0 ||
-            virPortAllocatorBindToPort(&used, i, AF_INET) < 0)
+        if ((rc = virPortAllocatorTryPort(pa, pos)) < 0)
             goto cleanup;
 
-        if (!used && !v6used) {
-            /* Add port to bitmap of reserved ports */
-            if (virBitmapSetBit(pa->bitmap, i) < 0) {
-                virReportError(VIR_ERR_INTERNAL_ERROR,
-                               _("Failed to reserve port %zu"), i);
-                goto cleanup;
-            }
-            *port = i;
+        if (rc > 0) {
+            *port = pos;
             ret = 0;
+            goto cleanup;
         }
     }
 
-    if (*port == 0) {
-        virReportError(VIR_ERR_INTERNAL_ERROR,
-                       _("Unable to find an unused port in range '%s' (%d-%d)"),
-                       range->name, range->start, range->end);
+    for (pass = 0; pass < 2; pass++) {
+        for (i = 0; i < nports; i++) {
+            unsigned short candidate = range->next;
+
+            if (candidate < range->start || candidate > range->end)
+                candidate = range->start;
+            range->next = candidate == range->end ? range->start : candidate + 1;
+
+            if (virBitmapIsBitSet(pa->bitmap, candidate) ||
+                (pass == 0 && virBitmapIsBitSet(pa->busy, candidate)))
+                continue;
+
+            if ((rc = virPortAllocatorTryPort(pa, candidate)) < 0)
+                goto cleanup;
+
+            if (rc > 0) {
+                *port = candidate;
+                ret = 0;
+                goto cleanup;
+            }
+        }
     }
+
+    virReportError(VIR_ERR_INTERNAL_ERROR,
+                   _("Unable to find an unused port in range '%s' (%d-%d)"),
+                   range->name, range->start, range->end);
  cleanup:
     virObjectUnlock(pa);
     return ret;
@@ -279,6 +365,8 @@ virPortAllocatorRelease(unsigned short port)
         goto cleanup;
     }
 
+    ignore_value(virBitmapSetBit(pa->released, port));
+
     ret = 0;
  cleanup:
     virObjectUnlock(pa);
@@ -303,6 +391,8 @@ virPortAllocatorSetUsed(unsigned short port)
         goto cleanup;
     }
 
+    ignore_value(virBitmapClearBit(pa->released, port));
+
     ret = 0;
  cleanup:
     virObjectUnlock(pa);
@@ -35,7 +35,7 @@ virPortAllocatorRangeNew(const char *name,
 
 void virPortAllocatorRangeFree(virPortAllocatorRangePtr range);
 
-int virPortAllocatorAcquire(const virPortAllocatorRange *range,
+int virPortAllocatorAcquire(virPortAllocatorRangePtr range,
                             unsigned short *port);
 
 int virPortAllocatorRelease(unsigned short port);
@@ -414,6 +414,143 @@ int virProcessKillPainfully(pid_t pid, bool force)
     return virProcessKillPainfullyDelay(pid, force, 0);
 }
 
+/**
+ * virProcessStatFileInit:
+ * @file: the cached stat file
+ *
+ * Initialize @file so that the first virProcessStatFileRead opens it.
+ */
+void
+virProcessStatFileInit(virProcessStatFilePtr file)
+{
+    file->pid = 0;
+    file->tid = 0;
+    file->fd = -1;
+}
+
+
+/**
+ * virProcessStatFileClose:
+ * @file: the cached stat file
+ *
+ * Close the descriptor cached in @file, if any.
+ */
+void
+virProcessStatFileClose(virProcessStatFilePtr file)
+{
+    VIR_FORCE_CLOSE(file->fd);
+    file->pid = 0;
+    file->tid = 0;
+}
+
+
+static int
+virProcessStatFileOpen(virProcessStatFilePtr file,
+                       pid_t pid,
+                       pid_t tid,
+                       const char *name)
+{
+    char *path = NULL;
+    int save_errno;
+    int ret;
+
+    /* In general, we cannot assume pid_t fits in int; but /proc parsing
+     * is specific to Linux where int works fine.  */
+    if (tid)
+        ret = virAsprintfQuiet(&path, "/proc/%d/task/%d/%s",
+                               (int)pid, (int)tid, name);
+    else
+        ret = virAsprintfQuiet(&path, "/proc/%d/%s", (int)pid, name);
+    if (ret < 0) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    save_errno = errno;
+    VIR_FREE(path);
+
+    if (file->fd < 0) {
+        errno = save_errno;
+        return -1;
+    }
+
+    file->pid = pid;
+    file->tid = tid;
+    return 0;
+}
+
+
+/**
+ * virProcessStatFileRead:
+ * @file: the cached stat file
+ * @pid: process id
+ * @tid: thread id within @pid, or 0 to read the file of the process
+ * @name: file name, e.g. "stat" or "sched"
+ * @buf: buffer to fill
+ * @buflen: size of @buf
+ *
+ * Read the contents of /proc/@pid/task/@tid/@name (or /proc/@pid/@name)
+ * into @buf, which is always NUL terminated.  The file descriptor is kept
+ * open in @file and subsequent calls read it again from offset 0, which
+ * avoids the open and close syscalls for every sample.  The descriptor is
+ * reopened when @pid or @tid change or when the task it refers to is gone.
+ *
+ * No error is reported, callers are expected to use errno.
+ *
+ * Returns the number of bytes read, or -1 with errno set.
+ */
+ssize_t
+virProcessStatFileRead(virProcessStatFilePtr file,
+                       pid_t pid,
+                       pid_t tid,
+                       const char *name,
+                       char *buf,
+                       size_t buflen)
+{
+    bool opened = false;
+    size_t len;
+    ssize_t got = 0;
+    int save_errno;
+
+    if (buflen < 2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (file->fd >= 0 && (file->pid != pid || file->tid != tid))
+        virProcessStatFileClose(file);
+
+    while (true) {
+        if (file->fd < 0) {
+            if (virProcessStatFileOpen(file, pid, tid, name) < 0)
+                return -1;
+            opened = true;
+        }
+
+        len = 0;
+        while (len < buflen - 1 &&
+               (got = pread(file->fd, buf + len, buflen - 1 - len, len)) > 0)
+            len += got;
+
+        if (len > 0) {
+            buf[len] = '\0';
+            return len;
+        }
+
+        /* The task went away, possibly with its id now used by another
+         * one, so retry with a fresh descriptor unless it's fresh already */
+        save_errno = got == 0 ? ESRCH : errno;
+        virProcessStatFileClose(file);
+
+        if (opened) {
+            errno = save_errno;
+            return -1;
+        }
+    }
+}
+
+
 #if HAVE_SCHED_GETAFFINITY
 
 int virProcessSetAffinity(pid_t pid, virBitmapPtr map)
@@ -68,6 +68,26 @@ int virProcessGetPids(pid_t pid, size_t *npids, pid_t **pids);
 int virProcessGetStartTime(pid_t pid,
                            unsigned long long *timestamp);
 
+/* Cached descriptor of a file in /proc/<pid>[/task/<tid>] which is
+ * sampled repeatedly, such as stat or sched */
+typedef struct _virProcessStatFile virProcessStatFile;
+typedef virProcessStatFile *virProcessStatFilePtr;
+struct _virProcessStatFile {
+    pid_t pid;
+    pid_t tid;
+    int fd;
+};
+
+void virProcessStatFileInit(virProcessStatFilePtr file);
+void virProcessStatFileClose(virProcessStatFilePtr file);
+ssize_t virProcessStatFileRead(virProcessStatFilePtr file,
+                               pid_t pid,
+                               pid_t tid,
+                               const char *name,
+                               char *buf,
+                               size_t buflen)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(4) ATTRIBUTE_NONNULL(5);
+
 int virProcessGetNamespaces(pid_t pid,
                             size_t *nfdlist,
                             int **fdlist);
@@ -36,8 +36,9 @@ VIR_LOG_INIT("util.virresctrl")
 
 
 /* Resctrl is short for Resource Control.  It might be implemented for various
- * resources. Currently this supports cache allocation technology (aka CAT) and
- * memory bandwidth allocation (aka MBA). More resources technologies may be
+ * resources. Currently this supports cache allocation technology (aka CAT),
+ * memory bandwidth allocation (aka MBA) and the monitoring of cache occupancy
+ * and memory bandwidth (aka CMT and MBM). More resources technologies may be
  * added in the future.
  */
 
@@ -105,6 +106,7 @@ typedef virResctrlAllocMemBW *virResctrlAllocMemBWPtr;
 /* Class definitions and initializations */
 static virClassPtr virResctrlInfoClass;
 static virClassPtr virResctrlAllocClass;
+static virClassPtr virResctrlMonitorClass;
 
 
 /* virResctrlInfo */
@@ -364,6 +366,41 @@ virResctrlAllocDispose(void *obj)
 }
 
 
+/* virResctrlMonitor */
+
+/*
+ * virResctrlMonitor represents one monitoring group, a directory under
+ * the mon_groups directory of the resource group of an allocation, or of
+ * /sys/fs/resctrl itself for tasks using the default allocation.  The
+ * kernel accounts the cache occupancy and memory bandwidth of the tasks
+ * in the group separately for each last level cache, in
+ * mon_data/mon_L3_<cache id>/.
+ */
+struct _virResctrlMonitor {
+    virObject parent;
+
+    /* The allocation the monitored tasks belong to, NULL for the default
+     * allocation */
+    virResctrlAllocPtr alloc;
+    /* The identifier (any unique string for now) */
+    char *id;
+    /* libvirt-generated path in /sys/fs/resctrl for this particular
+     * monitor */
+    char *path;
+};
+
+
+static void
+virResctrlMonitorDispose(void *obj)
+{
+    virResctrlMonitorPtr monitor = obj;
+
+    virObjectUnref(monitor->alloc);
+    VIR_FREE(monitor->id);
+    VIR_FREE(monitor->path);
+}
+
+
 /* Global initialization for classes */
 static int
 virResctrlOnceInit(void)
@@ -374,6 +411,9 @@ virResctrlOnceInit(void)
     if (!VIR_CLASS_NEW(virResctrlAlloc, virClassForObject()))
         return -1;
 
+    if (!VIR_CLASS_NEW(virResctrlMonitor, virClassForObject()))
+        return -1;
+
     return 0;
 }
 
@@ -2345,3 +2385,317 @@ virResctrlAllocRemove(virResctrlAllocPtr alloc)
 
     return ret;
 }
+
+
+/* virResctrlMonitor-related definitions */
+virResctrlMonitorPtr
+virResctrlMonitorNew(void)
+{
+    if (virResctrlInitialize() < 0)
+        return NULL;
+
+    return virObjectNew(virResctrlMonitorClass);
+}
+
+
+/**
+ * virResctrlMonitorSetAlloc:
+ * @monitor: Pointer to a resctrl monitor
+ * @alloc: the allocation the monitored tasks use
+ *
+ * Place @monitor into the resource group of @alloc. Monitors without an
+ * allocation are created for tasks using the default allocation. Must be
+ * called before the directory of @monitor is determined.
+ */
+void
+virResctrlMonitorSetAlloc(virResctrlMonitorPtr monitor,
+                          virResctrlAllocPtr alloc)
+{
+    virObjectUnref(monitor->alloc);
+    monitor->alloc = virObjectRef(alloc);
+}
+
+
+int
+virResctrlMonitorSetID(virResctrlMonitorPtr monitor,
+                       const char *id)
+{
+    if (!id) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Resctrl monitor 'id' cannot be NULL"));
+        return -1;
+    }
+
+    VIR_FREE(monitor->id);
+    return VIR_STRDUP(monitor->id, id);
+}
+
+
+const char *
+virResctrlMonitorGetID(virResctrlMonitorPtr monitor)
+{
+    return monitor->id;
+}
+
+
+int
+virResctrlMonitorDeterminePath(virResctrlMonitorPtr monitor,
+                               const char *machinename)
+{
+    const char *parent = SYSFS_RESCTRL_PATH;
+
+    if (!monitor->id) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Resctrl monitor ID must be set before creation"));
+        return -1;
+    }
+
+    if (monitor->alloc) {
+        if (virResctrlAllocDeterminePath(monitor->alloc, machinename) < 0)
+            return -1;
+        parent = monitor->alloc->path;
+    }
+
+    if (!monitor->path &&
+        virAsprintf(&monitor->path, "%s/mon_groups/%s-%s",
+                    parent, machinename, monitor->id) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+bool
+virResctrlMonitorExists(virResctrlMonitorPtr monitor)
+{
+    return monitor->path && virFileExists(monitor->path);
+}
+
+
+/* This creates the directory of the monitor, which must not exist yet.
+ * The allocation the monitor is placed in must already exist. */
+int
+virResctrlMonitorCreate(virResctrlInfoPtr resctrl,
+                        virResctrlMonitorPtr monitor,
+                        const char *machinename)
+{
+    int ret = -1;
+    int lockfd = -1;
+
+    if (!resctrl || !resctrl->monitor_info) {
+        virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
+                       _("Resource monitoring is not supported on this host"));
+        return -1;
+    }
+
+    if (virResctrlMonitorDeterminePath(monitor, machinename) < 0)
+        return -1;
+
+    if (virFileExists(monitor->path)) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("Path '%s' for resctrl monitor exists"),
+                       monitor->path);
+        return -1;
+    }
+
+    lockfd = virResctrlLockWrite();
+    if (lockfd < 0)
+        return -1;
+
+    /* The kernel refuses to create more monitoring groups than there are
+     * RMIDs with ENOSPC */
+    if (mkdir(monitor->path, 0777) < 0) {
+        virReportSystemError(errno,
+                             _("Cannot create resctrl monitor directory '%s'"),
+                             monitor->path);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virResctrlUnlock(lockfd);
+    return ret;
+}
+
+
+int
+virResctrlMonitorAddPID(virResctrlMonitorPtr monitor,
+                        pid_t pid)
+{
+    VIR_AUTOFREE(char *) tasks = NULL;
+    VIR_AUTOFREE(char *) pidstr = NULL;
+
+    if (!monitor->path) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot add pid to non-existing resctrl monitor"));
+        return -1;
+    }
+
+    if (virAsprintf(&tasks, "%s/tasks", monitor->path) < 0)
+        return -1;
+
+    if (virAsprintf(&pidstr, "%lld", (long long int) pid) < 0)
+        return -1;
+
+    /* A task moved into a monitoring group also joins the resource group
+     * the monitoring group belongs to */
+    if (virFileWriteStr(tasks, pidstr, 0) < 0) {
+        virReportSystemError(errno,
+                             _("Cannot write pid in tasks file '%s'"),
+                             tasks);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+int
+virResctrlMonitorRemove(virResctrlMonitorPtr monitor)
+{
+    int ret = 0;
+
+    if (!monitor->path)
+        return 0;
+
+    VIR_DEBUG("Removing resctrl monitor %s", monitor->path);
+    if (rmdir(monitor->path) != 0 && errno != ENOENT) {
+        ret = -errno;
+        VIR_ERROR(_("Unable to remove %s (%d)"), monitor->path, errno);
+    }
+
+    return ret;
+}
+
+
+void
+virResctrlMonitorFreeStats(virResctrlMonitorStatsPtr *stats,
+                           size_t nstats)
+{
+    size_t i;
+
+    if (!stats)
+        return;
+
+    for (i = 0; i < nstats; i++) {
+        if (!stats[i])
+            continue;
+
+        virStringListFree(stats[i]->features);
+        VIR_FREE(stats[i]->vals);
+        VIR_FREE(stats[i]);
+    }
+
+    VIR_FREE(stats);
+}
+
+
+static int
+virResctrlMonitorStatsSorter(const void *a,
+                             const void *b)
+{
+    const virResctrlMonitorStats *sa = *(const virResctrlMonitorStats **)a;
+    const virResctrlMonitorStats *sb = *(const virResctrlMonitorStats **)b;
+
+    if (sa->id < sb->id)
+        return -1;
+    return sa->id > sb->id;
+}
+
+
+/**
+ * virResctrlMonitorGetStats:
+ * @monitor: Pointer to a resctrl monitor
+ * @resources: NULL terminated list of the monitoring features to read,
+ *             e.g. "llc_occupancy" or "mbm_total_bytes"
+ * @stats: filled with one record per last level cache, sorted by cache id
+ * @nstats: number of records in @stats
+ *
+ * Read the counters of @monitor. Features of @resources the host does not
+ * provide are left out of the records.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virResctrlMonitorGetStats(virResctrlMonitorPtr monitor,
+                          const char **resources,
+                          virResctrlMonitorStatsPtr **stats,
+                          size_t *nstats)
+{
+    VIR_AUTOFREE(char *) datapath = NULL;
+    virResctrlMonitorStatsPtr stat = NULL;
+    struct dirent *ent = NULL;
+    DIR *dirp = NULL;
+    size_t i;
+    int rv;
+    int ret = -1;
+
+    *stats = NULL;
+    *nstats = 0;
+
+    if (!monitor->path) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       _("Cannot get statistics of non-existing resctrl monitor"));
+        return -1;
+    }
+
+    if (virAsprintf(&datapath, "%s/mon_data", monitor->path) < 0)
+        return -1;
+
+    if (virDirOpen(&dirp, datapath) < 0)
+        return -1;
+
+    while ((rv = virDirRead(dirp, &ent, datapath)) > 0) {
+        unsigned int id;
+
+        if (ent->d_type != DT_DIR)
+            continue;
+
+        /* Only the last level cache is monitored by the kernel */
+        if (!STRPREFIX(ent->d_name, "mon_L3_") ||
+            virStrToLong_uip(ent->d_name + strlen("mon_L3_"), NULL, 10,
+                             &id) < 0)
+            continue;
+
+        if (VIR_ALLOC(stat) < 0)
+            goto cleanup;
+        stat->id = id;
+
+        for (i = 0; resources[i]; i++) {
+            unsigned long long val;
+
+            rv = virFileReadValueUllong(&val, "%s/%s/%s", datapath,
+                                        ent->d_name, resources[i]);
+            if (rv == -2)
+                continue;
+            if (rv < 0)
+                goto cleanup;
+
+            if (virStringListAdd(&stat->features, resources[i]) < 0 ||
+                VIR_APPEND_ELEMENT(stat->vals, stat->nvals, val) < 0)
+                goto cleanup;
+        }
+
+        if (VIR_APPEND_ELEMENT(*stats, *nstats, stat) < 0)
+            goto cleanup;
+    }
+    if (rv < 0)
+        goto cleanup;
+
+    qsort(*stats, *nstats, sizeof(**stats), virResctrlMonitorStatsSorter);
+
+    ret = 0;
+ cleanup:
+    if (stat) {
+        virStringListFree(stat->features);
+        VIR_FREE(stat->vals);
+        VIR_FREE(stat);
+    }
+    if (ret < 0) {
+        virResctrlMonitorFreeStats(*stats, *nstats);
+        *stats = NULL;
+        *nstats = 0;
+    }
+    VIR_DIR_CLOSE(dirp);
+    return ret;
+}
@@ -185,4 +185,66 @@ int
 virResctrlInfoGetMonitorPrefix(virResctrlInfoPtr resctrl,
                                const char *prefix,
                                virResctrlInfoMonPtr *monitor);
+
+/* Monitor-related things */
+typedef struct _virResctrlMonitor virResctrlMonitor;
+typedef virResctrlMonitor *virResctrlMonitorPtr;
+
+typedef struct _virResctrlMonitorStats virResctrlMonitorStats;
+typedef virResctrlMonitorStats *virResctrlMonitorStatsPtr;
+struct _virResctrlMonitorStats {
+    /* The system assigned cache ID of the statistical record */
+    unsigned int id;
+    /* NULL terminated list of the names of the counters, e.g.
+     * "llc_occupancy" */
+    char **features;
+    /* Values of the counters, @vals[0] is the value of @features[0] and
+     * so on */
+    unsigned long long *vals;
+    /* Number of items in @vals */
+    size_t nvals;
+};
+
+virResctrlMonitorPtr
+virResctrlMonitorNew(void);
+
+void
+virResctrlMonitorSetAlloc(virResctrlMonitorPtr monitor,
+                          virResctrlAllocPtr alloc);
+
+int
+virResctrlMonitorSetID(virResctrlMonitorPtr monitor,
+                       const char *id);
+
+const char *
+virResctrlMonitorGetID(virResctrlMonitorPtr monitor);
+
+int
+virResctrlMonitorDeterminePath(virResctrlMonitorPtr monitor,
+                               const char *machinename);
+
+bool
+virResctrlMonitorExists(virResctrlMonitorPtr monitor);
+
+int
+virResctrlMonitorCreate(virResctrlInfoPtr resctrl,
+                        virResctrlMonitorPtr monitor,
+                        const char *machinename);
+
+int
+virResctrlMonitorAddPID(virResctrlMonitorPtr monitor,
+                        pid_t pid);
+
+int
+virResctrlMonitorRemove(virResctrlMonitorPtr monitor);
+
+int
+virResctrlMonitorGetStats(virResctrlMonitorPtr monitor,
+                          const char **resources,
+                          virResctrlMonitorStatsPtr **stats,
+                          size_t *nstats);
+
+void
+virResctrlMonitorFreeStats(virResctrlMonitorStatsPtr *stats,
+                           size_t nstats);
 #endif /*  __VIR_RESCTRL_H__ */
@@ -38,6 +38,10 @@ VIR_LOG_INIT("util.rotatingfile");
 
 #define VIR_MAX_MAX_BACKUP 32
 
+/* Size of the bounce buffer used by virRotatingFileWriterAppendFD
+ * when the data can't be spliced straight into the file */
+#define VIR_ROTATING_FILE_BUFSIZE 8192
+
 typedef struct virRotatingFileWriterEntry virRotatingFileWriterEntry;
 typedef virRotatingFileWriterEntry *virRotatingFileWriterEntryPtr;
 
@@ -57,6 +61,7 @@ struct virRotatingFileWriter {
     size_t maxbackup;
     mode_t mode;
     size_t maxlen;
+    bool nosplice;
 };
 
 
@@ -108,7 +113,11 @@ virRotatingFileWriterEntryNew(const char *path,
     if (VIR_ALLOC(entry) < 0)
         return NULL;
 
-    if ((entry->fd = open(path, O_CREAT|O_APPEND|O_WRONLY|O_CLOEXEC, mode)) < 0) {
+    /* Not using O_APPEND since splice() refuses to write to such
+     * files. virRotatingFileWriterSeekEnd takes care of moving to
+     * the end of file prior to each write instead, so that we still
+     * cope with the file being truncated behind our back. */
+    if ((entry->fd = open(path, O_CREAT|O_WRONLY|O_CLOEXEC, mode)) < 0) {
         virReportSystemError(errno,
                              _("Unable to open file: %s"), path);
         goto error;
@@ -421,6 +430,28 @@ virRotatingFileWriterRollover(virRotatingFileWriterPtr file)
 }
 
 
+/*
+ * Position the file offset at the end of the current file. If the
+ * file was truncated by a third party (e.g. logrotate copytruncate),
+ * this also resynchronizes our idea of the current position.
+ */
+static int
+virRotatingFileWriterSeekEnd(virRotatingFileWriterPtr file)
+{
+    off_t pos;
+
+    if ((pos = lseek(file->entry->fd, 0, SEEK_END)) == (off_t)-1) {
+        virReportSystemError(errno,
+                             _("Unable to determine current file offset: %s"),
+                             file->basepath);
+        return -1;
+    }
+
+    file->entry->pos = pos;
+    return 0;
+}
+
+
 /**
  * virRotatingFileWriterAppend:
  * @file: the file context
@@ -439,6 +470,10 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
 {
     ssize_t ret = 0;
     size_t i;
+
+    if (virRotatingFileWriterSeekEnd(file) < 0)
+        return -1;
+
     while (len) {
         size_t towrite = len;
         bool forceRollover = false;
@@ -503,6 +538,90 @@ virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
 }
 
 
+/**
+ * virRotatingFileWriterAppendFD:
+ * @file: the file context
+ * @fd: the non-blocking pipe to read data from
+ * @len: the maximum number of bytes to transfer
+ *
+ * Move up to @len bytes of data available in @fd to the file,
+ * performing rollover of the files if their size would exceed
+ * the limit. Where supported, the data is spliced from @fd into
+ * the file without being copied through a userspace buffer;
+ * close to the size limit, the data is read and handed over to
+ * virRotatingFileWriterAppend so that lines are not split across
+ * separate files.
+ *
+ * Returns the number of bytes transferred, 0 if @fd hit end of
+ * file or has no data available right now, or -1 on error
+ */
+ssize_t
+virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                              int fd,
+                              size_t len)
+{
+    char buf[VIR_ROTATING_FILE_BUFSIZE];
+    ssize_t got;
+
+    if (virRotatingFileWriterSeekEnd(file) < 0)
+        return -1;
+
+#ifdef HAVE_SPLICE
+    if (!file->nosplice &&
+        file->entry->pos <= file->maxlen &&
+        len <= file->maxlen - file->entry->pos) {
+        do {
+            got = splice(fd, NULL, file->entry->fd, NULL, len,
+                         SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        } while (got < 0 && errno == EINTR);
+
+        if (got >= 0) {
+            file->entry->pos += got;
+            file->entry->len += got;
+            return got;
+        }
+
+        if (errno == EAGAIN)
+            return 0;
+
+        if (errno != EINVAL && errno != ENOSYS) {
+            virReportSystemError(errno,
+                                 _("Unable to write to file %s"),
+                                 file->basepath);
+            return -1;
+        }
+
+        /* The filesystem the file lives on doesn't implement
+         * splicing, don't bother trying again */
+        VIR_DEBUG("Unable to splice into %s, using read/write",
+                  file->basepath);
+        file->nosplice = true;
+    }
+#endif /* HAVE_SPLICE */
+
+    do {
+        got = read(fd, buf, MIN(len, sizeof(buf)));
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0) {
+        if (errno == EAGAIN)
+            return 0;
+
+        virReportSystemError(errno, "%s",
+                             _("Unable to read from pipe"));
+        return -1;
+    }
+
+    if (got == 0)
+        return 0;
+
+    if (virRotatingFileWriterAppend(file, buf, got) != got)
+        return -1;
+
+    return got;
+}
+
+
 /**
  * virRotatingFileReaderSeek
  * @file: the file context
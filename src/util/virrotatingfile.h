@@ -47,6 +47,9 @@ off_t virRotatingFileWriterGetOffset(virRotatingFileWriterPtr file);
 ssize_t virRotatingFileWriterAppend(virRotatingFileWriterPtr file,
                                     const char *buf,
                                     size_t len);
+ssize_t virRotatingFileWriterAppendFD(virRotatingFileWriterPtr file,
+                                      int fd,
+                                      size_t len);
 
 int virRotatingFileReaderSeek(virRotatingFileReaderPtr file,
                               ino_t inode,
@@ -40,6 +40,7 @@
 #include "virutil.h"
 #include "viruri.h"
 #include "dirname.h"
+#include "stat-time.h"
 #include "virbuffer.h"
 #include "virjson.h"
 #include "virstorageencryption.h"
@@ -4790,6 +4791,206 @@ virStorageFileReportBrokenChain(int errcode,
 }
 
 
+/*
+ * Headers of images read while following backing chains are cached
+ * process wide, so that base images shared by many domains are not
+ * read again on every domain start, block job or pool refresh. An
+ * entry is only used while the image still has the same device, inode,
+ * modification time and size, and is read by the same user. Images
+ * modified in the last few seconds are never cached, as a change made
+ * within the granularity of the modification time wouldn't be noticed.
+ * Block devices are never cached either, as writing to them doesn't
+ * change their modification time.
+ */
+#define VIR_STORAGE_FILE_HEADER_CACHE_MAX 128
+#define VIR_STORAGE_FILE_HEADER_CACHE_SETTLE 2 /* seconds */
+
+typedef struct _virStorageFileHeaderCacheEntry virStorageFileHeaderCacheEntry;
+typedef virStorageFileHeaderCacheEntry *virStorageFileHeaderCacheEntryPtr;
+struct _virStorageFileHeaderCacheEntry {
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    off_t size;
+    uid_t uid;
+    gid_t gid;
+
+    char *buf;
+    size_t len;
+    unsigned long long lastUsed;
+};
+
+static virMutex virStorageFileHeaderCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virStorageFileHeaderCache;
+static unsigned long long virStorageFileHeaderCacheTick;
+
+
+static void
+virStorageFileHeaderCacheEntryFree(void *payload,
+                                   const void *name ATTRIBUTE_UNUSED)
+{
+    virStorageFileHeaderCacheEntryPtr entry = payload;
+
+    if (!entry)
+        return;
+
+    VIR_FREE(entry->buf);
+    VIR_FREE(entry);
+}
+
+
+static bool
+virStorageFileHeaderCacheEntryMatch(virStorageFileHeaderCacheEntryPtr entry,
+                                    const struct stat *st,
+                                    uid_t uid,
+                                    gid_t gid)
+{
+    struct timespec mtime = get_stat_mtime(st);
+
+    return entry->dev == st->st_dev &&
+           entry->ino == st->st_ino &&
+           entry->mtime.tv_sec == mtime.tv_sec &&
+           entry->mtime.tv_nsec == mtime.tv_nsec &&
+           entry->size == st->st_size &&
+           entry->uid == uid &&
+           entry->gid == gid;
+}
+
+
+struct virStorageFileHeaderCacheOldest {
+    const char *name;
+    unsigned long long lastUsed;
+};
+
+
+static int
+virStorageFileHeaderCacheFindOldest(void *payload,
+                                    const void *name,
+                                    void *opaque)
+{
+    virStorageFileHeaderCacheEntryPtr entry = payload;
+    struct virStorageFileHeaderCacheOldest *oldest = opaque;
+
+    if (!oldest->name || entry->lastUsed < oldest->lastUsed) {
+        oldest->name = name;
+        oldest->lastUsed = entry->lastUsed;
+    }
+
+    return 0;
+}
+
+
+/*
+ * Stores a copy of the @len bytes of @buf read from the image @name.
+ * Failing to do so is not an error, the header will just be read
+ * again next time.
+ */
+static void
+virStorageFileHeaderCacheAdd(const char *name,
+                             const struct stat *st,
+                             uid_t uid,
+                             gid_t gid,
+                             const char *buf,
+                             size_t len)
+{
+    virStorageFileHeaderCacheEntryPtr entry = NULL;
+
+    if (VIR_ALLOC_QUIET(entry) < 0 ||
+        VIR_ALLOC_N_QUIET(entry->buf, len ? len : 1) < 0) {
+        virStorageFileHeaderCacheEntryFree(entry, NULL);
+        return;
+    }
+
+    entry->dev = st->st_dev;
+    entry->ino = st->st_ino;
+    entry->mtime = get_stat_mtime(st);
+    entry->size = st->st_size;
+    entry->uid = uid;
+    entry->gid = gid;
+    memcpy(entry->buf, buf, len);
+    entry->len = len;
+
+    virMutexLock(&virStorageFileHeaderCacheLock);
+
+    if (!virStorageFileHeaderCache &&
+        !(virStorageFileHeaderCache =
+          virHashCreate(VIR_STORAGE_FILE_HEADER_CACHE_MAX,
+                        virStorageFileHeaderCacheEntryFree))) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    if (!virHashLookup(virStorageFileHeaderCache, name) &&
+        virHashSize(virStorageFileHeaderCache) >= VIR_STORAGE_FILE_HEADER_CACHE_MAX) {
+        struct virStorageFileHeaderCacheOldest oldest = { NULL, 0 };
+
+        virHashForEach(virStorageFileHeaderCache,
+                       virStorageFileHeaderCacheFindOldest, &oldest);
+        if (oldest.name)
+            virHashRemoveEntry(virStorageFileHeaderCache, oldest.name);
+    }
+
+    entry->lastUsed = ++virStorageFileHeaderCacheTick;
+    if (virHashUpdateEntry(virStorageFileHeaderCache, name, entry) < 0) {
+        virResetLastError();
+        goto cleanup;
+    }
+    entry = NULL;
+
+ cleanup:
+    virMutexUnlock(&virStorageFileHeaderCacheLock);
+    virStorageFileHeaderCacheEntryFree(entry, NULL);
+}
+
+
+/*
+ * Reads the header of the initialized @src, known as @name, into @buf,
+ * the way virStorageFileRead does, unless a cached copy is still valid.
+ */
+static ssize_t
+virStorageFileReadHeader(virStorageSourcePtr src,
+                         const char *name,
+                         uid_t uid,
+                         gid_t gid,
+                         char **buf)
+{
+    virStorageFileHeaderCacheEntryPtr entry;
+    struct stat st;
+    bool cacheable = false;
+    ssize_t len = -1;
+
+    if (virStorageFileStat(src, &st) == 0 && S_ISREG(st.st_mode))
+        cacheable = time(NULL) - get_stat_mtime(&st).tv_sec >=
+                    VIR_STORAGE_FILE_HEADER_CACHE_SETTLE;
+
+    if (cacheable) {
+        virMutexLock(&virStorageFileHeaderCacheLock);
+        if (virStorageFileHeaderCache &&
+            (entry = virHashLookup(virStorageFileHeaderCache, name)) &&
+            virStorageFileHeaderCacheEntryMatch(entry, &st, uid, gid) &&
+            VIR_ALLOC_N_QUIET(*buf, entry->len ? entry->len : 1) == 0) {
+            memcpy(*buf, entry->buf, entry->len);
+            len = entry->len;
+            entry->lastUsed = ++virStorageFileHeaderCacheTick;
+        }
+        virMutexUnlock(&virStorageFileHeaderCacheLock);
+
+        if (len >= 0) {
+            VIR_DEBUG("using cached header of '%s'", name);
+            return len;
+        }
+    }
+
+    if ((len = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER, buf)) < 0)
+        return len;
+
+    if (cacheable)
+        virStorageFileHeaderCacheAdd(name, &st, uid, gid, *buf, len);
+
+    return len;
+}
+
+
 /* Recursive workhorse for virStorageFileGetMetadata.  */
 static int
 virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
@@ -4837,8 +5038,8 @@ virStorageFileGetMetadataRecurse(virStorageSourcePtr src,
     if (virHashAddEntry(cycle, uniqueName, (void *)1) < 0)
         goto cleanup;
 
-    if ((headerLen = virStorageFileRead(src, 0, VIR_STORAGE_MAX_HEADER,
-                                        &buf)) < 0) {
+    if ((headerLen = virStorageFileReadHeader(src, uniqueName, uid, gid,
+                                              &buf)) < 0) {
         if (headerLen == -2)
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("storage file reading is not supported for "
@@ -31,7 +31,9 @@
 #include "viralloc.h"
 #include "virbuffer.h"
 #include "virerror.h"
+#include "virhashcode.h"
 #include "virlog.h"
+#include "virrandom.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -961,6 +963,9 @@ virStrdup(char **dest,
             virReportOOMErrorFull(domcode, filename, funcname, linenr);
         return -1;
     }
+    if (virAllocProfileGetRate())
+        virAllocProfileRecord(domcode, filename, funcname, linenr,
+                              strlen(*dest) + 1);
 
     return 1;
 }
@@ -1007,6 +1012,9 @@ virStrndup(char **dest,
             virReportOOMErrorFull(domcode, filename, funcname, linenr);
         return -1;
     }
+    if (virAllocProfileGetRate())
+        virAllocProfileRecord(domcode, filename, funcname, linenr,
+                              strlen(*dest) + 1);
 
    return 1;
 }
@@ -1481,3 +1489,169 @@ virStringParsePort(const char *str,
 
     return 0;
 }
+
+
+/*
+ * Interned strings are shared, reference counted copies of strings which
+ * are repeated across many objects, such as the keys of JSON objects.
+ */
+typedef struct _virStringInternEntry virStringInternEntry;
+typedef virStringInternEntry *virStringInternEntryPtr;
+struct _virStringInternEntry {
+    virStringInternEntryPtr next;
+    size_t refs;
+    uint32_t hash;
+    char *str; /* points right after the entry */
+};
+
+#define VIR_STRING_INTERN_MIN_BUCKETS 256
+
+static virMutex virStringInternLock = VIR_MUTEX_INITIALIZER;
+static virStringInternEntryPtr *virStringInternBuckets;
+static size_t virStringInternNBuckets;
+static size_t virStringInternNEntries;
+static uint32_t virStringInternSeed;
+
+
+/* Must be called with virStringInternLock held. */
+static int
+virStringInternGrow(void)
+{
+    virStringInternEntryPtr *buckets;
+    size_t nbuckets = virStringInternNBuckets ? virStringInternNBuckets * 2 :
+                      VIR_STRING_INTERN_MIN_BUCKETS;
+    size_t i;
+
+    if (VIR_ALLOC_N_QUIET(buckets, nbuckets) < 0)
+        return -1;
+
+    if (!virStringInternBuckets)
+        virStringInternSeed = virRandomBits(32);
+
+    for (i = 0; i < virStringInternNBuckets; i++) {
+        virStringInternEntryPtr entry = virStringInternBuckets[i];
+
+        while (entry) {
+            virStringInternEntryPtr next = entry->next;
+            size_t slot = entry->hash & (nbuckets - 1);
+
+            entry->next = buckets[slot];
+            buckets[slot] = entry;
+            entry = next;
+        }
+    }
+
+    VIR_FREE(virStringInternBuckets);
+    virStringInternBuckets = buckets;
+    virStringInternNBuckets = nbuckets;
+    return 0;
+}
+
+
+/**
+ * virStringInternLen:
+ * @str: string to intern
+ * @len: length of @str, which does not need to be NUL terminated
+ *
+ * Returns a shared copy of the first @len bytes of @str which must be
+ * released by virStringInternRelease. Equal strings interned at the same
+ * time are represented by the same pointer. Returns NULL and reports
+ * an error on failure.
+ */
+const char *
+virStringInternLen(const char *str,
+                   size_t len)
+{
+    virStringInternEntryPtr entry;
+    uint32_t hash;
+    const char *ret = NULL;
+
+    len = strnlen(str, len);
+
+    virMutexLock(&virStringInternLock);
+
+    /* keep at most two entries per bucket on average */
+    if (virStringInternNEntries >= virStringInternNBuckets * 2 &&
+        virStringInternGrow() < 0 && !virStringInternNBuckets) {
+        virReportOOMError();
+        goto cleanup;
+    }
+
+    hash = virHashCodeGen(str, len, virStringInternSeed);
+    for (entry = virStringInternBuckets[hash & (virStringInternNBuckets - 1)];
+         entry; entry = entry->next) {
+        if (entry->hash == hash &&
+            strncmp(entry->str, str, len) == 0 && !entry->str[len]) {
+            entry->refs++;
+            ret = entry->str;
+            goto cleanup;
+        }
+    }
+
+    if (VIR_ALLOC_VAR(entry, char, len + 1) < 0)
+        goto cleanup;
+
+    entry->str = (char *)(entry + 1);
+    memcpy(entry->str, str, len);
+    entry->refs = 1;
+    entry->hash = hash;
+    entry->next = virStringInternBuckets[hash & (virStringInternNBuckets - 1)];
+    virStringInternBuckets[hash & (virStringInternNBuckets - 1)] = entry;
+    virStringInternNEntries++;
+    ret = entry->str;
+
+ cleanup:
+    virMutexUnlock(&virStringInternLock);
+    return ret;
+}
+
+
+/**
+ * virStringIntern:
+ * @str: NUL terminated string to intern
+ *
+ * Same as virStringInternLen for the whole of @str.
+ */
+const char *
+virStringIntern(const char *str)
+{
+    return virStringInternLen(str, strlen(str));
+}
+
+
+/**
+ * virStringInternRelease:
+ * @str: string returned by virStringIntern or NULL
+ *
+ * Drops a reference to an interned string, freeing it with the last one.
+ */
+void
+virStringInternRelease(const char *str)
+{
+    virStringInternEntryPtr *link = NULL;
+    uint32_t hash;
+
+    if (!str)
+        return;
+
+    virMutexLock(&virStringInternLock);
+
+    if (virStringInternBuckets) {
+        hash = virHashCodeGen(str, strlen(str), virStringInternSeed);
+        link = &virStringInternBuckets[hash & (virStringInternNBuckets - 1)];
+        while (*link && (*link)->str != str)
+            link = &(*link)->next;
+    }
+
+    if (!link || !*link) {
+        VIR_WARN("Releasing string '%s' which was not interned", str);
+    } else if (--(*link)->refs == 0) {
+        virStringInternEntryPtr entry = *link;
+
+        *link = entry->next;
+        virStringInternNEntries--;
+        VIR_FREE(entry);
+    }
+
+    virMutexUnlock(&virStringInternLock);
+}
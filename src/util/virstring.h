@@ -310,6 +310,13 @@ int virStringParsePort(const char *str,
                        unsigned int *port)
     ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
 
+const char *virStringIntern(const char *str)
+    ATTRIBUTE_NONNULL(1);
+const char *virStringInternLen(const char *str,
+                               size_t len)
+    ATTRIBUTE_NONNULL(1);
+void virStringInternRelease(const char *str);
+
 VIR_DEFINE_AUTOPTR_FUNC(virString, virStringListFree)
 
 #endif /* __VIR_STRING_H__ */
@@ -28,11 +28,22 @@
 
 #include "virthreadpool.h"
 #include "viralloc.h"
+#include "viratomic.h"
+#include "virbitmap.h"
+#include "virprocess.h"
 #include "virthread.h"
 #include "virerror.h"
+#include "virtime.h"
+#include "virlog.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
+VIR_LOG_INIT("util.threadpool");
+
+/* How long an ordinary worker has to stay idle before an adaptive
+ * pool retires it, in milliseconds. */
+#define VIR_THREADPOOL_IDLE_TIMEOUT (30 * 1000)
+
 typedef struct _virThreadPoolJob virThreadPoolJob;
 typedef virThreadPoolJob *virThreadPoolJobPtr;
 
@@ -40,6 +51,8 @@ struct _virThreadPoolJob {
     virThreadPoolJobPtr prev;
     virThreadPoolJobPtr next;
     unsigned int priority;
+    unsigned long long queued;
+    unsigned long long started;
 
     void *data;
 };
@@ -62,6 +75,20 @@ struct _virThreadPool {
     void *jobOpaque;
     virThreadPoolJobList jobList;
     size_t jobQueueDepth;
+    virThreadPoolJobPtr running;
+
+    unsigned long long jobsDone;
+    unsigned long long jobWaitTime;
+    unsigned long long workersBusyTime;
+    unsigned int adaptiveLatency;
+
+    size_t maxBulkWorkers;
+    size_t nBulkRunning;
+
+    /* CPUs the workers run on, applied by each worker before its next
+     * job once affinityGen changes */
+    virBitmapPtr affinity;
+    unsigned int affinityGen;
 
     virMutex mutex;
     virCond cond;
@@ -93,6 +120,82 @@ static inline bool virThreadPoolWorkerQuitHelper(size_t count, size_t limit)
     return count > limit;
 }
 
+static unsigned long long
+virThreadPoolNow(void)
+{
+    unsigned long long now;
+
+    if (virTimeMillisNowRaw(&now) < 0)
+        return 0;
+    return now;
+}
+
+/* Test whether the oldest queued job has been waiting for a worker
+ * longer than the adaptive latency target allows. */
+static bool
+virThreadPoolJobQueueStalled(virThreadPoolPtr pool,
+                             unsigned long long now)
+{
+    return pool->jobList.head &&
+           now > pool->jobList.head->queued &&
+           now - pool->jobList.head->queued > pool->adaptiveLatency;
+}
+
+/* Find the job a worker should take next: priority workers only run
+ * high priority jobs and ordinary workers skip bulk jobs while the
+ * limit of workers running them has been reached. */
+static virThreadPoolJobPtr
+virThreadPoolNextJob(virThreadPoolPtr pool,
+                     bool priority)
+{
+    virThreadPoolJobPtr job;
+
+    if (priority)
+        return pool->jobList.firstPrio;
+
+    if (!pool->maxBulkWorkers || pool->nBulkRunning < pool->maxBulkWorkers)
+        return pool->jobList.head;
+
+    for (job = pool->jobList.head; job; job = job->next) {
+        if (job->priority != VIR_THREADPOOL_JOB_BULK)
+            break;
+    }
+
+    return job;
+}
+
+static int
+virThreadPoolExpand(virThreadPoolPtr pool, size_t gain, bool priority);
+
+/* Wait for a job to arrive. Adaptive pools time the wait out so that
+ * surplus ordinary workers can be retired. Returns 1 if the worker
+ * should quit because it was idle for too long, 0 if it was woken up
+ * and -1 on error. */
+static int
+virThreadPoolWorkerWait(virThreadPoolPtr pool,
+                        virCondPtr cond,
+                        bool priority)
+{
+    unsigned long long now;
+
+    if (priority || !pool->adaptiveLatency)
+        return virCondWait(cond, &pool->mutex);
+
+    now = virThreadPoolNow();
+    if (virCondWaitUntil(cond, &pool->mutex,
+                         now + VIR_THREADPOOL_IDLE_TIMEOUT) < 0) {
+        if (errno != ETIMEDOUT)
+            return -1;
+        if (pool->adaptiveLatency && pool->nWorkers > pool->minWorkers) {
+            VIR_DEBUG("Retiring idle worker of %s, %zu workers left",
+                      pool->jobFuncName, pool->nWorkers - 1);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 static void virThreadPoolWorker(void *opaque)
 {
     struct virThreadPoolWorkerData *data = opaque;
@@ -102,6 +205,7 @@ static void virThreadPoolWorker(void *opaque)
     size_t *curWorkers = priority ? &pool->nPrioWorkers : &pool->nWorkers;
     size_t *maxLimit = priority ? &pool->maxPrioWorkers : &pool->maxWorkers;
     virThreadPoolJobPtr job = NULL;
+    unsigned int affinityGen = 0;
 
     VIR_FREE(data);
 
@@ -117,11 +221,10 @@ static void virThreadPoolWorker(void *opaque)
         if (virThreadPoolWorkerQuitHelper(*curWorkers, *maxLimit))
             goto out;
         while (!pool->quit &&
-               ((!priority && !pool->jobList.head) ||
-                (priority && !pool->jobList.firstPrio))) {
+               !(job = virThreadPoolNextJob(pool, priority))) {
             if (!priority)
                 pool->freeWorkers++;
-            if (virCondWait(cond, &pool->mutex) < 0) {
+            if (virThreadPoolWorkerWait(pool, cond, priority) != 0) {
                 if (!priority)
                     pool->freeWorkers--;
                 goto out;
@@ -136,16 +239,10 @@ static void virThreadPoolWorker(void *opaque)
         if (pool->quit)
             break;
 
-        if (priority) {
-            job = pool->jobList.firstPrio;
-        } else {
-            job = pool->jobList.head;
-        }
-
         if (job == pool->jobList.firstPrio) {
             virThreadPoolJobPtr tmp = job->next;
             while (tmp) {
-                if (tmp->priority)
+                if (tmp->priority == VIR_THREADPOOL_JOB_HIGH)
                     break;
                 tmp = tmp->next;
             }
@@ -162,11 +259,62 @@ static void virThreadPoolWorker(void *opaque)
             pool->jobList.tail = job->prev;
 
         pool->jobQueueDepth--;
+        if (job->priority == VIR_THREADPOOL_JOB_BULK)
+            pool->nBulkRunning++;
+
+        job->started = virThreadPoolNow();
+        if (job->started > job->queued)
+            pool->jobWaitTime += job->started - job->queued;
+
+        job->prev = NULL;
+        job->next = pool->running;
+        if (pool->running)
+            pool->running->prev = job;
+        pool->running = job;
+
+        /* The job we've just taken waited too long and there is more
+         * work queued behind it, so bring in another worker. */
+        if (!priority && pool->adaptiveLatency &&
+            pool->nWorkers < pool->maxWorkers &&
+            job->started > job->queued &&
+            job->started - job->queued > pool->adaptiveLatency &&
+            pool->jobList.head) {
+            VIR_DEBUG("Job queue of %s waited %llums, adding a worker",
+                      pool->jobFuncName, job->started - job->queued);
+            if (virThreadPoolExpand(pool, 1, false) < 0)
+                VIR_WARN("Failed to add a worker to the %s pool",
+                         pool->jobFuncName);
+        }
+
+        if (affinityGen != pool->affinityGen) {
+            affinityGen = pool->affinityGen;
+            if (pool->affinity &&
+                virProcessSetAffinity(0, pool->affinity) < 0)
+                VIR_WARN("Failed to set CPU affinity of a %s worker",
+                         pool->jobFuncName);
+        }
 
         virMutexUnlock(&pool->mutex);
         (pool->jobFunc)(job->data, pool->jobOpaque);
-        VIR_FREE(job);
         virMutexLock(&pool->mutex);
+
+        pool->workersBusyTime += virThreadPoolNow() - job->started;
+        pool->jobsDone++;
+
+        /* Bulk jobs may have been skipped while this one was running */
+        if (job->priority == VIR_THREADPOOL_JOB_BULK) {
+            pool->nBulkRunning--;
+            if (pool->jobList.head)
+                virCondSignal(&pool->cond);
+        }
+
+        if (job->prev)
+            job->prev->next = job->next;
+        else
+            pool->running = job->next;
+        if (job->next)
+            job->next->prev = job->prev;
+        VIR_FREE(job);
     }
 
  out:
@@ -295,6 +443,7 @@ void virThreadPoolFree(virThreadPoolPtr pool)
     }
 
     VIR_FREE(pool->workers);
+    virBitmapFree(pool->affinity);
     virMutexUnlock(&pool->mutex);
     virMutexDestroy(&pool->mutex);
     virCondDestroy(&pool->quit_cond);
@@ -373,8 +522,140 @@ size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool)
     return ret;
 }
 
+/**
+ * virThreadPoolGetStats:
+ * @pool: thread pool
+ * @stats: filled with the current statistics
+ *
+ * Fill @stats with the current load of @pool: the age of the oldest
+ * queued and running job, the number of busy workers and the counters
+ * accumulated since the pool was created. All times are given in
+ * milliseconds.
+ */
+void
+virThreadPoolGetStats(virThreadPoolPtr pool,
+                      virThreadPoolStatsPtr stats)
+{
+    unsigned long long now = virThreadPoolNow();
+    virThreadPoolJobPtr job;
+
+    memset(stats, 0, sizeof(*stats));
+
+    virMutexLock(&pool->mutex);
+
+    if (pool->jobList.head && now > pool->jobList.head->queued)
+        stats->jobQueueOldestAge = now - pool->jobList.head->queued;
+
+    for (job = pool->running; job; job = job->next) {
+        if (now > job->started &&
+            now - job->started > stats->jobLongestRunning)
+            stats->jobLongestRunning = now - job->started;
+        stats->busyWorkers++;
+    }
+
+    stats->jobsDone = pool->jobsDone;
+    stats->jobWaitTime = pool->jobWaitTime;
+    stats->workersBusyTime = pool->workersBusyTime;
+
+    virMutexUnlock(&pool->mutex);
+}
+
+unsigned int virThreadPoolGetAdaptiveLatency(virThreadPoolPtr pool)
+{
+    unsigned int ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->adaptiveLatency;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
+/**
+ * virThreadPoolSetAdaptiveLatency:
+ * @pool: thread pool
+ * @latency: queue latency target in milliseconds, 0 to disable
+ *
+ * Switch @pool to adaptive sizing: instead of spawning a new worker
+ * whenever all of them are busy, the pool only grows once queued jobs
+ * wait longer than @latency, and ordinary workers idle for a while are
+ * retired again, always staying within the minWorkers and maxWorkers
+ * limits.
+ */
+void
+virThreadPoolSetAdaptiveLatency(virThreadPoolPtr pool,
+                                unsigned int latency)
+{
+    virMutexLock(&pool->mutex);
+    pool->adaptiveLatency = latency;
+    /* Make idle workers pick up the new wait mode */
+    virCondBroadcast(&pool->cond);
+    virMutexUnlock(&pool->mutex);
+}
+
+size_t virThreadPoolGetBulkWorkers(virThreadPoolPtr pool)
+{
+    size_t ret;
+
+    virMutexLock(&pool->mutex);
+    ret = pool->maxBulkWorkers;
+    virMutexUnlock(&pool->mutex);
+
+    return ret;
+}
+
+/**
+ * virThreadPoolSetBulkWorkers:
+ * @pool: thread pool
+ * @limit: maximum number of workers running bulk jobs, 0 for no limit
+ *
+ * Limit how many ordinary workers of @pool may be running jobs sent
+ * with VIR_THREADPOOL_JOB_BULK priority at once. Further bulk jobs
+ * stay queued while other jobs queued after them are picked up, so
+ * that long running jobs cannot take all workers.
+ */
+void
+virThreadPoolSetBulkWorkers(virThreadPoolPtr pool,
+                            size_t limit)
+{
+    virMutexLock(&pool->mutex);
+    pool->maxBulkWorkers = limit;
+    /* Let idle workers pick up bulk jobs allowed by the new limit */
+    virCondBroadcast(&pool->cond);
+    virMutexUnlock(&pool->mutex);
+}
+
+/**
+ * virThreadPoolSetAffinity:
+ * @pool: thread pool
+ * @cpus: CPUs to run the workers on
+ *
+ * Make the workers of @pool run on @cpus only, for instance to keep
+ * them close to the memory of the jobs they are given. Workers apply
+ * the new affinity before running their next job.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+virThreadPoolSetAffinity(virThreadPoolPtr pool,
+                         virBitmapPtr cpus)
+{
+    virBitmapPtr copy;
+
+    if (!(copy = virBitmapNewCopy(cpus)))
+        return -1;
+
+    virMutexLock(&pool->mutex);
+    virBitmapFree(pool->affinity);
+    pool->affinity = copy;
+    pool->affinityGen++;
+    virMutexUnlock(&pool->mutex);
+
+    return 0;
+}
+
 /*
- * @priority - job priority
+ * @priority - job priority, one of virThreadPoolJobPriority
  * Return: 0 on success, -1 otherwise
  */
 int virThreadPoolSendJob(virThreadPoolPtr pool,
@@ -382,12 +663,23 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
                          void *jobData)
 {
     virThreadPoolJobPtr job;
+    unsigned long long now = virThreadPoolNow();
+    bool expand;
 
     virMutexLock(&pool->mutex);
     if (pool->quit)
         goto error;
 
-    if (pool->freeWorkers - pool->jobQueueDepth <= 0 &&
+    /* An adaptive pool only grows once queued jobs start missing the
+     * latency target, otherwise spawn a worker whenever all of them
+     * are busy. */
+    if (pool->adaptiveLatency)
+        expand = pool->nWorkers == 0 ||
+                 virThreadPoolJobQueueStalled(pool, now);
+    else
+        expand = pool->freeWorkers - pool->jobQueueDepth <= 0;
+
+    if (expand &&
         pool->nWorkers < pool->maxWorkers &&
         virThreadPoolExpand(pool, 1, false) < 0)
         goto error;
@@ -397,6 +689,7 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
 
     job->data = jobData;
     job->priority = priority;
+    job->queued = now;
 
     job->prev = pool->jobList.tail;
     if (pool->jobList.tail)
@@ -406,13 +699,13 @@ int virThreadPoolSendJob(virThreadPoolPtr pool,
     if (!pool->jobList.head)
         pool->jobList.head = job;
 
-    if (priority && !pool->jobList.firstPrio)
+    if (priority == VIR_THREADPOOL_JOB_HIGH && !pool->jobList.firstPrio)
         pool->jobList.firstPrio = job;
 
     pool->jobQueueDepth++;
 
     virCondSignal(&pool->cond);
-    if (priority)
+    if (priority == VIR_THREADPOOL_JOB_HIGH)
         virCondSignal(&pool->prioCond);
 
     virMutexUnlock(&pool->mutex);
@@ -481,3 +774,181 @@ virThreadPoolSetParameters(virThreadPoolPtr pool,
     virMutexUnlock(&pool->mutex);
     return -1;
 }
+
+
+/* Upper bound of threads virThreadParallel processes items on */
+#define VIR_THREAD_PARALLEL_WORKERS 8
+
+struct _virThreadParallel {
+    virThreadParallelFunc func;
+    void *opaque;
+    size_t nitems;
+    int next;
+    virErrorPtr *errs;
+
+    virThread workers[VIR_THREAD_PARALLEL_WORKERS];
+    size_t nworkers;
+};
+
+
+static void
+virThreadParallelWorker(void *opaque)
+{
+    virThreadParallelPtr par = opaque;
+    size_t i;
+
+    while ((i = virAtomicIntAdd(&par->next, 1)) < par->nitems) {
+        if (par->func(i, par->opaque) < 0) {
+            /* errors are per thread, hand it over to the caller */
+            if (par->errs)
+                par->errs[i] = virSaveLastError();
+            virResetLastError();
+        }
+    }
+}
+
+
+static virThreadParallelPtr
+virThreadParallelNew(size_t nitems,
+                     virThreadParallelFunc func,
+                     void *opaque,
+                     virErrorPtr *errs,
+                     bool caller)
+{
+    virThreadParallelPtr par;
+    size_t nthreads = MIN(nitems, VIR_THREAD_PARALLEL_WORKERS);
+
+    if (nitems > INT_MAX) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       _("too many items to process in parallel: %zu"),
+                       nitems);
+        return NULL;
+    }
+
+    if (VIR_ALLOC(par) < 0)
+        return NULL;
+
+    par->func = func;
+    par->opaque = opaque;
+    par->nitems = nitems;
+    par->errs = errs;
+
+    /* the calling thread is one of the workers */
+    if (caller && nthreads > 0)
+        nthreads--;
+
+    /* whatever no thread could be created for is left to the caller */
+    while (par->nworkers < nthreads &&
+           virThreadCreate(&par->workers[par->nworkers], true,
+                           virThreadParallelWorker, par) == 0)
+        par->nworkers++;
+
+    VIR_DEBUG("Processing %zu items on %zu threads", nitems, par->nworkers);
+
+    return par;
+}
+
+
+/**
+ * virThreadParallelRun:
+ * @nitems: number of items
+ * @func: callback processing one item
+ * @opaque: data passed to @func
+ * @errs: array of @nitems errors, or NULL
+ *
+ * Calls @func for each of the @nitems items, on up to
+ * VIR_THREAD_PARALLEL_WORKERS threads including the calling one, and
+ * waits for all of them to be processed.  Items are picked up in
+ * order, but they may be processed in any.  If @func fails on an
+ * item, the error it reported is stored at the item's index in @errs
+ * and must be freed by the caller, or dropped if @errs is NULL.
+ *
+ * Returns 0 on success, -1 if the items could not be processed at all.
+ */
+int
+virThreadParallelRun(size_t nitems,
+                     virThreadParallelFunc func,
+                     void *opaque,
+                     virErrorPtr *errs)
+{
+    virThreadParallelPtr par;
+
+    if (nitems == 0)
+        return 0;
+
+    if (!(par = virThreadParallelNew(nitems, func, opaque, errs, true)))
+        return -1;
+
+    virThreadParallelFinish(par);
+    return 0;
+}
+
+
+/**
+ * virThreadParallelStart:
+ * @nitems: number of items
+ * @func: callback processing one item
+ * @opaque: data passed to @func
+ * @errs: array of @nitems errors, or NULL
+ *
+ * Like virThreadParallelRun, but the items are processed in the
+ * background while the calling thread is free to do something else
+ * until it calls virThreadParallelFinish or virThreadParallelCancel.
+ *
+ * Returns the processing state, or NULL on error.
+ */
+virThreadParallelPtr
+virThreadParallelStart(size_t nitems,
+                       virThreadParallelFunc func,
+                       void *opaque,
+                       virErrorPtr *errs)
+{
+    return virThreadParallelNew(nitems, func, opaque, errs, false);
+}
+
+
+static void
+virThreadParallelFree(virThreadParallelPtr par)
+{
+    size_t i;
+
+    for (i = 0; i < par->nworkers; i++)
+        virThreadJoin(&par->workers[i]);
+    VIR_FREE(par);
+}
+
+
+/**
+ * virThreadParallelFinish:
+ * @par: processing state
+ *
+ * Helps processing the items not picked up by any thread yet, waits
+ * until all of them are processed and frees @par.
+ */
+void
+virThreadParallelFinish(virThreadParallelPtr par)
+{
+    if (!par)
+        return;
+
+    virThreadParallelWorker(par);
+    virThreadParallelFree(par);
+}
+
+
+/**
+ * virThreadParallelCancel:
+ * @par: processing state
+ *
+ * Skips the items not picked up by any thread yet, waits until those
+ * being processed are done and frees @par.
+ */
+void
+virThreadParallelCancel(virThreadParallelPtr par)
+{
+    if (!par)
+        return;
+
+    virAtomicIntSet(&par->next, par->nitems);
+    virThreadParallelFree(par);
+}
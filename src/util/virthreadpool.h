@@ -27,12 +27,33 @@
 # define __VIR_THREADPOOL_H__
 
 # include "internal.h"
+# include "virbitmap.h"
 
 typedef struct _virThreadPool virThreadPool;
 typedef virThreadPool *virThreadPoolPtr;
 
 typedef void (*virThreadPoolJobFunc)(void *jobdata, void *opaque);
 
+/* Values of the @priority argument of virThreadPoolSendJob */
+typedef enum {
+    VIR_THREADPOOL_JOB_NORMAL = 0, /* run by ordinary workers */
+    VIR_THREADPOOL_JOB_HIGH = 1,   /* run by ordinary or priority workers */
+    VIR_THREADPOOL_JOB_BULK = 2,   /* run by a limited number of ordinary
+                                    * workers, see virThreadPoolSetBulkWorkers */
+} virThreadPoolJobPriority;
+
+typedef struct _virThreadPoolStats virThreadPoolStats;
+typedef virThreadPoolStats *virThreadPoolStatsPtr;
+
+struct _virThreadPoolStats {
+    size_t busyWorkers;                 /* workers running a job */
+    unsigned long long jobQueueOldestAge; /* ms the oldest queued job waits */
+    unsigned long long jobLongestRunning; /* ms the oldest running job runs */
+    unsigned long long jobsDone;        /* jobs finished */
+    unsigned long long jobWaitTime;     /* total ms jobs spent queued */
+    unsigned long long workersBusyTime; /* total ms workers spent in jobs */
+};
+
 # define virThreadPoolNew(min, max, prio, func, opaque) \
     virThreadPoolNewFull(min, max, prio, func, #func, opaque)
 
@@ -49,6 +70,11 @@ size_t virThreadPoolGetPriorityWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetCurrentWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetFreeWorkers(virThreadPoolPtr pool);
 size_t virThreadPoolGetJobQueueDepth(virThreadPoolPtr pool);
+unsigned int virThreadPoolGetAdaptiveLatency(virThreadPoolPtr pool);
+size_t virThreadPoolGetBulkWorkers(virThreadPoolPtr pool);
+
+void virThreadPoolGetStats(virThreadPoolPtr pool,
+                           virThreadPoolStatsPtr stats);
 
 void virThreadPoolFree(virThreadPoolPtr pool);
 
@@ -62,4 +88,32 @@ int virThreadPoolSetParameters(virThreadPoolPtr pool,
                                long long int maxWorkers,
                                long long int prioWorkers);
 
+void virThreadPoolSetAdaptiveLatency(virThreadPoolPtr pool,
+                                     unsigned int latency);
+
+void virThreadPoolSetBulkWorkers(virThreadPoolPtr pool,
+                                 size_t limit);
+
+int virThreadPoolSetAffinity(virThreadPoolPtr pool,
+                             virBitmapPtr cpus);
+
+typedef struct _virThreadParallel virThreadParallel;
+typedef virThreadParallel *virThreadParallelPtr;
+
+typedef int (*virThreadParallelFunc)(size_t item, void *opaque);
+
+int virThreadParallelRun(size_t nitems,
+                         virThreadParallelFunc func,
+                         void *opaque,
+                         virErrorPtr *errs)
+    ATTRIBUTE_NONNULL(2) ATTRIBUTE_RETURN_CHECK;
+
+virThreadParallelPtr virThreadParallelStart(size_t nitems,
+                                            virThreadParallelFunc func,
+                                            void *opaque,
+                                            virErrorPtr *errs)
+    ATTRIBUTE_NONNULL(2);
+void virThreadParallelFinish(virThreadParallelPtr par);
+void virThreadParallelCancel(virThreadParallelPtr par);
+
 #endif
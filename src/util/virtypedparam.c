@@ -28,6 +28,7 @@
 #include "virutil.h"
 #include "virerror.h"
 #include "virstring.h"
+#include "virhash.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -47,13 +48,6 @@ VIR_ENUM_IMPL(virTypedParameter, VIR_TYPED_PARAM_LAST,
  * internal utility functions (those in libvirt_private.syms) may
  * report errors that the caller will dispatch.  */
 
-static int
-virTypedParamsSortName(const void *left, const void *right)
-{
-    const virTypedParameter *param_left = left, *param_right = right;
-    return strcmp(param_left->field, param_right->field);
-}
-
 /* Validate that PARAMS contains only recognized parameter names with
  * correct types, and with no duplicates except for parameters
  * specified with VIR_TYPED_PARAM_MULTIPLE flag in type.
@@ -65,83 +59,94 @@ virTypedParamsValidate(virTypedParameterPtr params, int nparams, ...)
 {
     va_list ap;
     int ret = -1;
-    size_t i, j;
-    const char *name, *last_name = NULL;
+    size_t i;
+    const char *name;
     int type;
     size_t nkeys = 0, nkeysalloc = 0;
-    virTypedParameterPtr sorted = NULL, keys = NULL;
+    struct {
+        const char *name;
+        int type;
+        bool multiple;
+        bool seen;
+    } *keys = NULL;
+    virHashTablePtr table = NULL;
 
     va_start(ap, nparams);
 
-    if (VIR_ALLOC_N(sorted, nparams) < 0)
-        goto cleanup;
-
-    /* Here we intentionally don't copy values */
-    memcpy(sorted, params, sizeof(*params) * nparams);
-    qsort(sorted, nparams, sizeof(*sorted), virTypedParamsSortName);
-
     name = va_arg(ap, const char *);
     while (name) {
         type = va_arg(ap, int);
         if (VIR_RESIZE_N(keys, nkeysalloc, nkeys, 1) < 0)
             goto cleanup;
 
-        if (virStrcpyStatic(keys[nkeys].field, name) < 0) {
+        if (strlen(name) >= VIR_TYPED_PARAM_FIELD_LENGTH) {
             virReportError(VIR_ERR_INTERNAL_ERROR,
                            _("Field name '%s' too long"), name);
             goto cleanup;
         }
 
+        keys[nkeys].name = name;
         keys[nkeys].type = type & ~VIR_TYPED_PARAM_MULTIPLE;
-        /* Value is not used anyway */
-        keys[nkeys].value.i = type & VIR_TYPED_PARAM_MULTIPLE;
+        keys[nkeys].multiple = !!(type & VIR_TYPED_PARAM_MULTIPLE);
 
         nkeys++;
         name = va_arg(ap, const char *);
     }
 
-    qsort(keys, nkeys, sizeof(*keys), virTypedParamsSortName);
-
-    for (i = 0, j = 0; i < nparams && j < nkeys;) {
-        if (STRNEQ(sorted[i].field, keys[j].field)) {
-            j++;
-        } else {
-            if (STREQ_NULLABLE(last_name, sorted[i].field) &&
-                !(keys[j].value.i & VIR_TYPED_PARAM_MULTIPLE)) {
-                virReportError(VIR_ERR_INVALID_ARG,
-                               _("parameter '%s' occurs multiple times"),
-                               sorted[i].field);
-                goto cleanup;
-            }
-            if (sorted[i].type != keys[j].type) {
-                const char *badtype;
-
-                badtype = virTypedParameterTypeToString(sorted[i].type);
-                if (!badtype)
-                    badtype = virTypedParameterTypeToString(0);
-                virReportError(VIR_ERR_INVALID_ARG,
-                               _("invalid type '%s' for parameter '%s', "
-                                 "expected '%s'"),
-                               badtype, sorted[i].field,
-                               virTypedParameterTypeToString(keys[j].type));
-                goto cleanup;
-            }
-            last_name = sorted[i].field;
-            i++;
-        }
+    if (nparams == 0) {
+        ret = 0;
+        goto cleanup;
     }
 
-    if (j == nkeys && i != nparams) {
-        virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
-                       _("parameter '%s' not supported"),
-                       sorted[i].field);
+    /* Keys are stored as index + 1 so that NULL means unknown */
+    if (!(table = virHashCreate(nkeys, NULL)))
         goto cleanup;
+
+    for (i = 0; i < nkeys; i++) {
+        if (virHashUpdateEntry(table, keys[i].name, (void *)(uintptr_t)(i + 1)) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++) {
+        void *entry = virHashLookup(table, params[i].field);
+        size_t j = (uintptr_t) entry;
+
+        if (!j) {
+            virReportError(VIR_ERR_ARGUMENT_UNSUPPORTED,
+                           _("parameter '%s' not supported"),
+                           params[i].field);
+            goto cleanup;
+        }
+        j--;
+
+        if (keys[j].seen && !keys[j].multiple) {
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("parameter '%s' occurs multiple times"),
+                           params[i].field);
+            goto cleanup;
+        }
+
+        if (params[i].type != keys[j].type) {
+            const char *badtype;
+
+            badtype = virTypedParameterTypeToString(params[i].type);
+            if (!badtype)
+                badtype = virTypedParameterTypeToString(0);
+            virReportError(VIR_ERR_INVALID_ARG,
+                           _("invalid type '%s' for parameter '%s', "
+                             "expected '%s'"),
+                           badtype, params[i].field,
+                           virTypedParameterTypeToString(keys[j].type));
+            goto cleanup;
+        }
+
+        keys[j].seen = true;
     }
 
     ret = 0;
  cleanup:
     va_end(ap);
-    VIR_FREE(sorted);
+    virHashFree(table);
     VIR_FREE(keys);
     return ret;
 }
@@ -173,6 +178,231 @@ virTypedParamsCheck(virTypedParameterPtr params,
     return true;
 }
 
+
+struct _virTypedParamsIndex {
+    virHashTablePtr fields; /* field name -> first parameter of that name */
+};
+
+
+/**
+ * virTypedParamsIndexNew:
+ * @params: array of typed parameters
+ * @nparams: number of parameters in the @params array
+ *
+ * Builds an index for looking up parameters of @params by name in
+ * constant time, which pays off for callers doing many lookups in a
+ * long list, such as a domain stats record. The index refers to @params
+ * which must not be changed or freed while it is used.
+ *
+ * Returns the index or NULL on error.
+ */
+virTypedParamsIndexPtr
+virTypedParamsIndexNew(virTypedParameterPtr params,
+                       int nparams)
+{
+    virTypedParamsIndexPtr idx;
+    size_t i;
+
+    if (VIR_ALLOC(idx) < 0)
+        return NULL;
+
+    if (!(idx->fields = virHashCreate(nparams, NULL)))
+        goto error;
+
+    /* Like virTypedParamsGet, return the first occurrence of a name */
+    for (i = 0; i < nparams; i++) {
+        if (virHashLookup(idx->fields, params[i].field))
+            continue;
+
+        if (virHashAddEntry(idx->fields, params[i].field, &params[i]) < 0)
+            goto error;
+    }
+
+    return idx;
+
+ error:
+    virTypedParamsIndexFree(idx);
+    return NULL;
+}
+
+
+void
+virTypedParamsIndexFree(virTypedParamsIndexPtr idx)
+{
+    if (!idx)
+        return;
+
+    virHashFree(idx->fields);
+    VIR_FREE(idx);
+}
+
+
+/**
+ * virTypedParamsIndexGet:
+ * @idx: index built by virTypedParamsIndexNew
+ * @name: name of the parameter to find
+ *
+ * Returns the first parameter called @name or NULL if there is none.
+ */
+virTypedParameterPtr
+virTypedParamsIndexGet(virTypedParamsIndexPtr idx,
+                       const char *name)
+{
+    return virHashLookup(idx->fields, name);
+}
+
+
+static int
+virTypedParamsIndexGetTyped(virTypedParamsIndexPtr idx,
+                            const char *name,
+                            int type,
+                            virTypedParameterPtr *param)
+{
+    if (!(*param = virTypedParamsIndexGet(idx, name)))
+        return 0;
+
+    if ((*param)->type != type) {
+        virReportError(VIR_ERR_INVALID_ARG,
+                       _("Invalid type '%s' requested for parameter '%s', "
+                         "actual type is '%s'"),
+                       virTypedParameterTypeToString(type),
+                       name,
+                       virTypedParameterTypeToString((*param)->type));
+        return -1;
+    }
+
+    return 1;
+}
+
+
+/* The getters below behave like their virTypedParamsGet* counterparts:
+ * they return 1 on success, 0 when no parameter called @name exists, or
+ * -1 with an error reported if it does not have the expected type. */
+int
+virTypedParamsIndexGetInt(virTypedParamsIndexPtr idx,
+                          const char *name,
+                          int *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_INT,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.i;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetUInt(virTypedParamsIndexPtr idx,
+                           const char *name,
+                           unsigned int *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_UINT,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.ui;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetLLong(virTypedParamsIndexPtr idx,
+                            const char *name,
+                            long long *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_LLONG,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.l;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetULLong(virTypedParamsIndexPtr idx,
+                             const char *name,
+                             unsigned long long *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_ULLONG,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.ul;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetDouble(virTypedParamsIndexPtr idx,
+                             const char *name,
+                             double *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_DOUBLE,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.d;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetBoolean(virTypedParamsIndexPtr idx,
+                              const char *name,
+                              int *value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_BOOLEAN,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = !!param->value.b;
+    return 1;
+}
+
+
+int
+virTypedParamsIndexGetString(virTypedParamsIndexPtr idx,
+                             const char *name,
+                             const char **value)
+{
+    virTypedParameterPtr param;
+    int rc;
+
+    if ((rc = virTypedParamsIndexGetTyped(idx, name, VIR_TYPED_PARAM_STRING,
+                                          &param)) <= 0)
+        return rc;
+
+    if (value)
+        *value = param->value.s;
+    return 1;
+}
+
 char *
 virTypedParameterToString(virTypedParameterPtr param)
 {
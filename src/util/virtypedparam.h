@@ -69,6 +69,36 @@ bool virTypedParamsCheck(virTypedParameterPtr params,
                          const char **names,
                          int nnames);
 
+typedef struct _virTypedParamsIndex virTypedParamsIndex;
+typedef virTypedParamsIndex *virTypedParamsIndexPtr;
+
+virTypedParamsIndexPtr virTypedParamsIndexNew(virTypedParameterPtr params,
+                                              int nparams);
+void virTypedParamsIndexFree(virTypedParamsIndexPtr idx);
+virTypedParameterPtr virTypedParamsIndexGet(virTypedParamsIndexPtr idx,
+                                            const char *name);
+int virTypedParamsIndexGetInt(virTypedParamsIndexPtr idx,
+                              const char *name,
+                              int *value);
+int virTypedParamsIndexGetUInt(virTypedParamsIndexPtr idx,
+                               const char *name,
+                               unsigned int *value);
+int virTypedParamsIndexGetLLong(virTypedParamsIndexPtr idx,
+                                const char *name,
+                                long long *value);
+int virTypedParamsIndexGetULLong(virTypedParamsIndexPtr idx,
+                                 const char *name,
+                                 unsigned long long *value);
+int virTypedParamsIndexGetDouble(virTypedParamsIndexPtr idx,
+                                 const char *name,
+                                 double *value);
+int virTypedParamsIndexGetBoolean(virTypedParamsIndexPtr idx,
+                                  const char *name,
+                                  int *value);
+int virTypedParamsIndexGetString(virTypedParamsIndexPtr idx,
+                                 const char *name,
+                                 const char **value);
+
 int
 virTypedParamsGetStringList(virTypedParameterPtr params,
                             int nparams,
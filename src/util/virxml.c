@@ -33,6 +33,8 @@
 #include "viralloc.h"
 #include "virfile.h"
 #include "virstring.h"
+#include "virhash.h"
+#include "virthread.h"
 
 #define VIR_FROM_THIS VIR_FROM_XML
 
@@ -45,6 +47,112 @@ struct virParserData {
     int domcode;
 };
 
+/* Most XPath expressions are string literals which are evaluated over
+ * and over again while parsing, so they are compiled only once. The cache
+ * is bounded since some callers format their expressions. Entries are
+ * never removed, a compiled expression can be evaluated by multiple
+ * threads at once. */
+#define VIR_XPATH_CACHE_MAX 4096
+
+static virMutex virXPathCacheLock = VIR_MUTEX_INITIALIZER;
+static virHashTablePtr virXPathCache;
+
+
+static void
+virXPathCacheFree(void *payload,
+                  const void *name ATTRIBUTE_UNUSED)
+{
+    xmlXPathFreeCompExpr(payload);
+}
+
+
+/* Returns a cached compiled @xpath or NULL if it isn't cached */
+static xmlXPathCompExprPtr
+virXPathCacheLookup(const char *xpath)
+{
+    xmlXPathCompExprPtr comp = NULL;
+
+    virMutexLock(&virXPathCacheLock);
+    if (virXPathCache)
+        comp = virHashLookup(virXPathCache, xpath);
+    virMutexUnlock(&virXPathCacheLock);
+
+    return comp;
+}
+
+
+/* Adds @comp to the cache unless it's full. Returns the cached compiled
+ * expression, which might have been added by another thread meanwhile,
+ * or NULL if @comp wasn't cached. */
+static xmlXPathCompExprPtr
+virXPathCacheAdd(const char *xpath,
+                 xmlXPathCompExprPtr comp)
+{
+    xmlXPathCompExprPtr ret = NULL;
+
+    virMutexLock(&virXPathCacheLock);
+
+    if (!virXPathCache &&
+        !(virXPathCache = virHashCreate(256, virXPathCacheFree))) {
+        virResetLastError();
+        goto cleanup;
+    }
+
+    if ((ret = virHashLookup(virXPathCache, xpath)))
+        goto cleanup;
+
+    if (virHashSize(virXPathCache) >= VIR_XPATH_CACHE_MAX)
+        goto cleanup;
+
+    if (virHashAddEntry(virXPathCache, xpath, comp) < 0) {
+        virResetLastError();
+        goto cleanup;
+    }
+    ret = comp;
+
+ cleanup:
+    virMutexUnlock(&virXPathCacheLock);
+    return ret;
+}
+
+
+/**
+ * virXPathEval:
+ * @xpath: the XPath string to evaluate
+ * @ctxt: an XPath context
+ *
+ * Same as xmlXPathEval, but reuses the compiled @xpath if it was
+ * evaluated before.
+ *
+ * Returns the resulting XPath object or NULL on error.
+ */
+static xmlXPathObjectPtr
+virXPathEval(const char *xpath,
+             xmlXPathContextPtr ctxt)
+{
+    xmlXPathCompExprPtr comp;
+    xmlXPathCompExprPtr cached;
+    xmlXPathObjectPtr obj;
+
+    if ((cached = virXPathCacheLookup(xpath)))
+        return xmlXPathCompiledEval(cached, ctxt);
+
+    /* not compiled with @ctxt as that would tie @comp to the dictionary
+     * of its document */
+    if (!(comp = xmlXPathCompile(BAD_CAST xpath)))
+        return NULL;
+
+    if ((cached = virXPathCacheAdd(xpath, comp))) {
+        if (cached != comp)
+            xmlXPathFreeCompExpr(comp);
+        return xmlXPathCompiledEval(cached, ctxt);
+    }
+
+    obj = xmlXPathCompiledEval(comp, ctxt);
+    xmlXPathFreeCompExpr(comp);
+    return obj;
+}
+
 
 /**
  * virXPathString:
@@ -70,7 +178,7 @@ virXPathString(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_STRING) ||
         (obj->stringval == NULL) || (obj->stringval[0] == 0)) {
@@ -147,7 +255,7 @@ virXPathNumber(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NUMBER) ||
         (isnan(obj->floatval))) {
@@ -176,7 +284,7 @@ virXPathLongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -281,7 +389,7 @@ virXPathULongBase(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -397,7 +505,7 @@ virXPathULongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -443,7 +551,7 @@ virXPathLongLong(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj != NULL) && (obj->type == XPATH_STRING) &&
         (obj->stringval != NULL) && (obj->stringval[0] != 0)) {
@@ -569,7 +677,7 @@ virXPathBoolean(const char *xpath,
         return -1;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_BOOLEAN) ||
         (obj->boolval < 0) || (obj->boolval > 1)) {
@@ -606,7 +714,7 @@ virXPathNode(const char *xpath,
         return NULL;
     }
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if ((obj == NULL) || (obj->type != XPATH_NODESET) ||
         (obj->nodesetval == NULL) || (obj->nodesetval->nodeNr <= 0) ||
@@ -650,7 +758,7 @@ virXPathNodeSet(const char *xpath,
         *list = NULL;
 
     relnode = ctxt->node;
-    obj = xmlXPathEval(BAD_CAST xpath, ctxt);
+    obj = virXPathEval(xpath, ctxt);
     ctxt->node = relnode;
     if (obj == NULL)
         return 0;
@@ -1053,7 +1053,6 @@ vzConnectDomainEventDeregisterAny(virConnectPtr conn,
 static int
 vzDomainSuspend(virDomainPtr domain)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1074,7 +1073,7 @@ vzDomainSuspend(virDomainPtr domain)
     if (prlsdkPause(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1090,7 +1089,6 @@ vzDomainSuspend(virDomainPtr domain)
 static int
 vzDomainResume(virDomainPtr domain)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1111,7 +1109,7 @@ vzDomainResume(virDomainPtr domain)
     if (prlsdkResume(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1127,7 +1125,6 @@ vzDomainResume(virDomainPtr domain)
 static int
 vzDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1150,7 +1147,7 @@ vzDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
     if (prlsdkStart(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1166,7 +1163,6 @@ vzDomainCreateWithFlags(virDomainPtr domain, unsigned int flags)
 static int
 vzDomainDestroyFlags(virDomainPtr domain, unsigned int flags)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1189,7 +1185,7 @@ vzDomainDestroyFlags(virDomainPtr domain, unsigned int flags)
     if (prlsdkKill(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1211,7 +1207,6 @@ vzDomainDestroy(virDomainPtr dom)
 static int
 vzDomainShutdownFlags(virDomainPtr domain, unsigned int flags)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1234,7 +1229,7 @@ vzDomainShutdownFlags(virDomainPtr domain, unsigned int flags)
     if (prlsdkStop(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1255,7 +1250,6 @@ static int vzDomainShutdown(virDomainPtr dom)
 static int
 vzDomainReboot(virDomainPtr domain, unsigned int flags)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom;
     int ret = -1;
     bool job = false;
@@ -1278,7 +1272,7 @@ vzDomainReboot(virDomainPtr domain, unsigned int flags)
     if (prlsdkRestart(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -1388,7 +1382,6 @@ vzDomainHasManagedSaveImage(virDomainPtr domain, unsigned int flags)
 static int
 vzDomainManagedSave(virDomainPtr domain, unsigned int flags)
 {
-    vzConnPtr privconn = domain->conn->privateData;
     virDomainObjPtr dom = NULL;
     int state, reason;
     int ret = -1;
@@ -1419,7 +1412,7 @@ vzDomainManagedSave(virDomainPtr domain, unsigned int flags)
     if (prlsdkSuspend(dom) < 0)
         goto cleanup;
 
-    if (prlsdkUpdateDomain(privconn->driver, dom) < 0)
+    if (prlsdkUpdateDomainState(dom) < 0)
         goto cleanup;
 
     ret = 0;
@@ -3064,6 +3057,10 @@ vzConnectSupportsFeature(virConnectPtr conn ATTRIBUTE_UNUSED, int feature)
     case VIR_DRV_FEATURE_REMOTE:
     case VIR_DRV_FEATURE_REMOTE_CLOSE_CALLBACK:
     case VIR_DRV_FEATURE_REMOTE_EVENT_CALLBACK:
+    case VIR_DRV_FEATURE_REMOTE_STREAM_LARGE_PACKETS:
+    case VIR_DRV_FEATURE_REMOTE_PAYLOAD_COMPRESSION:
+    case VIR_DRV_FEATURE_REMOTE_PACKED_DOMAIN_STATS:
+    case VIR_DRV_FEATURE_REMOTE_EVENT_BATCH:
     case VIR_DRV_FEATURE_TYPED_PARAM_STRING:
     case VIR_DRV_FEATURE_XML_MIGRATABLE:
     default:
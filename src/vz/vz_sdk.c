@@ -2082,6 +2082,25 @@ prlsdkUpdateDomain(vzDriverPtr driver, virDomainObjPtr dom)
     return prlsdkLoadDomain(driver, pdom->sdkdom, dom) ? 0 : -1;
 }
 
+/*
+ * Refresh only the state of a domain after a lifecycle operation, its
+ * configuration being kept up to date by PET_DSP_EVT_VM_CONFIG_CHANGED
+ * events. This takes a single job instead of refreshing the config and
+ * converting it again as prlsdkUpdateDomain does.
+ */
+int
+prlsdkUpdateDomainState(virDomainObjPtr dom)
+{
+    vzDomObjPtr pdom = dom->privateData;
+    VIRTUAL_MACHINE_STATE domainState;
+
+    if (prlsdkGetDomainState(dom, pdom->sdkdom, &domainState) < 0)
+        return -1;
+
+    prlsdkConvertDomainState(domainState, pdom->id, dom);
+    return 0;
+}
+
 static void
 prlsdkSendEvent(vzDriverPtr driver,
                 virDomainObjPtr dom,
@@ -263,6 +263,8 @@ vzCheckDiskAddressDriveUnsupportedParams(virDomainDiskDefPtr disk)
 static int
 vzCheckDiskUnsupportedParams(virDomainDiskDefPtr disk)
 {
+    const virDomainBlockIoTuneInfo *iotune = virDomainDiskGetBlockIoTune(disk);
+
     if (disk->device != VIR_DOMAIN_DISK_DEVICE_DISK &&
         disk->device != VIR_DOMAIN_DISK_DEVICE_CDROM) {
 
@@ -280,12 +282,12 @@ vzCheckDiskUnsupportedParams(virDomainDiskDefPtr disk)
         return -1;
     }
 
-    if (disk->blkdeviotune.total_bytes_sec ||
-        disk->blkdeviotune.read_bytes_sec ||
-        disk->blkdeviotune.write_bytes_sec ||
-        disk->blkdeviotune.total_iops_sec ||
-        disk->blkdeviotune.read_iops_sec ||
-        disk->blkdeviotune.write_iops_sec) {
+    if (iotune->total_bytes_sec ||
+        iotune->read_bytes_sec ||
+        iotune->write_bytes_sec ||
+        iotune->total_iops_sec ||
+        iotune->read_iops_sec ||
+        iotune->write_iops_sec) {
 
         virReportError(VIR_ERR_CONFIG_UNSUPPORTED, "%s",
                        _("Setting disk io limits is not "
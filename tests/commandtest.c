@@ -30,6 +30,8 @@
 #include "internal.h"
 #include "viralloc.h"
 #include "vircommand.h"
+#define __VIR_COMMAND_PRIV_H_ALLOW__
+#include "vircommandpriv.h"
 #include "virfile.h"
 #include "virpidfile.h"
 #include "virerror.h"
@@ -1135,6 +1137,84 @@ static int test25(const void *unused ATTRIBUTE_UNUSED)
 }
 
 
+static void
+test26DryRunCallback(const char *const*args,
+                     const char *const*env ATTRIBUTE_UNUSED,
+                     const char *input ATTRIBUTE_UNUSED,
+                     char **output ATTRIBUTE_UNUSED,
+                     char **error ATTRIBUTE_UNUSED,
+                     int *status,
+                     void *opaque ATTRIBUTE_UNUSED)
+{
+    if (STREQ(args[1], "fail"))
+        *status = 1;
+}
+
+/*
+ * Run a batch of commands in dry run mode, where they are run one
+ * by one, with and without carrying on after a failed command.
+ */
+static int test26(const void *unused ATTRIBUTE_UNUSED)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    const char *expected[] = {
+        "ip link set dev eth0 up\n"
+        "ip fail\n",
+
+        "ip link set dev eth0 up\n"
+        "ip fail\n"
+        "ip link del dev veth0\n",
+    };
+    char *actual = NULL;
+    int status = 0;
+    int ret = -1;
+    size_t i;
+
+    virCommandSetDryRun(&buf, test26DryRunCallback, NULL);
+
+    for (i = 0; i < ARRAY_CARDINALITY(expected); i++) {
+        VIR_AUTOPTR(virCommandBatch) batch = NULL;
+
+        if (!(batch = virCommandBatchNew("ip",
+                                         i ? VIR_COMMAND_BATCH_FORCE : 0)))
+            goto cleanup;
+
+        virCommandAddArgList(virCommandBatchAdd(batch),
+                             "link", "set", "dev", "eth0", "up", NULL);
+        virCommandAddArg(virCommandBatchAdd(batch), "fail");
+        virCommandAddArgList(virCommandBatchAdd(batch),
+                             "link", "del", "dev", "veth0", NULL);
+
+        if (virCommandBatchRun(batch, NULL) == 0) {
+            fprintf(stderr, "Batch should have failed\n");
+            goto cleanup;
+        }
+
+        if (virCommandBatchRun(batch, &status) < 0 || status != 1) {
+            fprintf(stderr, "Unexpected batch status %d\n", status);
+            goto cleanup;
+        }
+
+        /* Each batch was run twice */
+        actual = virBufferContentAndReset(&buf);
+        if (!actual ||
+            !STRPREFIX(actual, expected[i]) ||
+            STRNEQ(actual + strlen(expected[i]), expected[i])) {
+            virTestDifference(stderr, expected[i], NULLSTR(actual));
+            goto cleanup;
+        }
+        VIR_FREE(actual);
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
 static void virCommandThreadWorker(void *opaque)
 {
     virCommandTestDataPtr test = opaque;
@@ -1288,6 +1368,7 @@ mymain(void)
     DO_TEST(test23);
     DO_TEST(test24);
     DO_TEST(test25);
+    DO_TEST(test26);
 
     virMutexLock(&test->lock);
     if (test->running) {
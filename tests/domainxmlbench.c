@@ -0,0 +1,470 @@
+#include <config.h>
+
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virfile.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* each benchmark is repeated until it ran for at least this long */
+#define BENCH_MIN_MILLIS 2000
+#define BENCH_SYNTHETIC_DEVICES 500
+#define BENCH_MAX_FILE (1024 * 1024)
+/* a busy host with both the live and the persistent definition of each */
+#define BENCH_RSS_DOMAINS 2000
+
+static virCapsPtr caps;
+static virDomainXMLOptionPtr xmlopt;
+
+static const unsigned int parseFlags = VIR_DOMAIN_DEF_PARSE_INACTIVE |
+                                       VIR_DOMAIN_DEF_PARSE_SKIP_VALIDATE;
+static const unsigned int formatFlags = VIR_DOMAIN_DEF_FORMAT_SECURE |
+                                        VIR_DOMAIN_DEF_FORMAT_INACTIVE;
+
+typedef struct _testBenchCorpus testBenchCorpus;
+typedef testBenchCorpus *testBenchCorpusPtr;
+struct _testBenchCorpus {
+    const char *name;
+    size_t nxmls;
+    char **xmls;
+    virDomainDefPtr *defs;
+    size_t bytes;
+};
+
+
+static void
+testBenchCorpusClear(testBenchCorpusPtr corpus)
+{
+    size_t i;
+
+    for (i = 0; i < corpus->nxmls; i++) {
+        VIR_FREE(corpus->xmls[i]);
+        virDomainDefFree(corpus->defs[i]);
+    }
+    VIR_FREE(corpus->xmls);
+    VIR_FREE(corpus->defs);
+    corpus->nxmls = 0;
+    corpus->bytes = 0;
+}
+
+
+/* Takes ownership of @xml if it can be parsed */
+static int
+testBenchCorpusAdd(testBenchCorpusPtr corpus,
+                   char **xml)
+{
+    virDomainDefPtr def;
+
+    if (!(def = virDomainDefParseString(*xml, caps, xmlopt, NULL,
+                                        parseFlags))) {
+        virResetLastError();
+        return 0;
+    }
+
+    if (VIR_REALLOC_N(corpus->defs, corpus->nxmls + 1) < 0 ||
+        VIR_REALLOC_N(corpus->xmls, corpus->nxmls + 1) < 0) {
+        virDomainDefFree(def);
+        return -1;
+    }
+
+    corpus->bytes += strlen(*xml);
+    corpus->defs[corpus->nxmls] = def;
+    VIR_STEAL_PTR(corpus->xmls[corpus->nxmls], *xml);
+    corpus->nxmls++;
+    return 1;
+}
+
+
+static int
+testBenchLoadDir(testBenchCorpusPtr corpus,
+                 const char *dirname)
+{
+    DIR *dir = NULL;
+    struct dirent *ent;
+    char *path = NULL;
+    char *xml = NULL;
+    size_t skipped = 0;
+    int rc;
+    int ret = -1;
+
+    if (virDirOpen(&dir, dirname) < 0)
+        return -1;
+
+    while ((rc = virDirRead(dir, &ent, dirname)) > 0) {
+        if (!virFileHasSuffix(ent->d_name, ".xml"))
+            continue;
+
+        if (virAsprintf(&path, "%s/%s", dirname, ent->d_name) < 0 ||
+            virFileReadAll(path, BENCH_MAX_FILE, &xml) < 0)
+            goto cleanup;
+
+        /* the corpus contains definitions which are meant to fail or
+         * need a particular driver, they are not interesting here */
+        if ((rc = testBenchCorpusAdd(corpus, &xml)) < 0)
+            goto cleanup;
+        if (rc == 0)
+            skipped++;
+
+        VIR_FREE(path);
+        VIR_FREE(xml);
+    }
+    if (rc < 0)
+        goto cleanup;
+
+    VIR_TEST_DEBUG("%s: loaded %zu definitions, skipped %zu",
+                   dirname, corpus->nxmls, skipped);
+    ret = 0;
+
+ cleanup:
+    VIR_DIR_CLOSE(dir);
+    VIR_FREE(path);
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static char *
+testBenchSyntheticXML(size_t ndevices)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *dst;
+    size_t i;
+
+    virBufferAddLit(&buf, "<domain type='kvm'>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, "<name>synthetic</name>\n");
+    virBufferAddLit(&buf, "<uuid>c7a5fdbd-edaf-9455-926a-d65c16db1809</uuid>\n");
+    virBufferAddLit(&buf, "<memory unit='KiB'>4194304</memory>\n");
+    virBufferAddLit(&buf, "<vcpu placement='static'>4</vcpu>\n");
+    virBufferAddLit(&buf, "<os>\n");
+    virBufferAddLit(&buf, "  <type arch='x86_64' machine='pc'>hvm</type>\n");
+    virBufferAddLit(&buf, "</os>\n");
+    virBufferAddLit(&buf, "<devices>\n");
+    virBufferAdjustIndent(&buf, 2);
+    virBufferAddLit(&buf, "<emulator>/usr/bin/acme-virt</emulator>\n");
+
+    for (i = 0; i < ndevices / 2; i++) {
+        if (!(dst = virIndexToDiskName(i, "vd"))) {
+            virBufferFreeAndReset(&buf);
+            return NULL;
+        }
+
+        virBufferAddLit(&buf, "<disk type='file' device='disk'>\n");
+        virBufferAddLit(&buf, "  <driver name='qemu' type='qcow2' cache='none'/>\n");
+        virBufferAsprintf(&buf,
+                          "  <source file='/var/lib/libvirt/images/disk%zu.qcow2'/>\n",
+                          i);
+        virBufferAsprintf(&buf, "  <target dev='%s' bus='virtio'/>\n", dst);
+        virBufferAddLit(&buf, "</disk>\n");
+        VIR_FREE(dst);
+    }
+
+    for (i = ndevices / 2; i < ndevices; i++) {
+        virBufferAddLit(&buf, "<interface type='network'>\n");
+        virBufferAsprintf(&buf, "  <mac address='52:54:00:%02zx:%02zx:%02zx'/>\n",
+                          (i >> 16) & 0xff, (i >> 8) & 0xff, i & 0xff);
+        virBufferAddLit(&buf, "  <source network='default'/>\n");
+        virBufferAddLit(&buf, "  <model type='virtio'/>\n");
+        virBufferAddLit(&buf, "</interface>\n");
+    }
+
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</devices>\n");
+    virBufferAdjustIndent(&buf, -2);
+    virBufferAddLit(&buf, "</domain>\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static long
+testBenchPeakRSS(void)
+{
+    struct rusage ru;
+
+    if (getrusage(RUSAGE_SELF, &ru) < 0)
+        return -1;
+
+    return ru.ru_maxrss;
+}
+
+
+/* Current resident set size in KiB, or -1 if it can't be told */
+static long
+testBenchCurrentRSS(void)
+{
+    char *buf = NULL;
+    char *end;
+    unsigned long size;
+    unsigned long resident;
+    long ret = -1;
+
+    if (virFileReadAllQuiet("/proc/self/statm", 1024, &buf) < 0 ||
+        virStrToLong_ul(buf, &end, 10, &size) < 0 ||
+        virStrToLong_ul(end, &end, 10, &resident) < 0)
+        goto cleanup;
+
+    ret = resident * virGetSystemPageSizeKB();
+
+ cleanup:
+    VIR_FREE(buf);
+    return ret;
+}
+
+
+static void
+testBenchReport(const char *corpus,
+                const char *op,
+                size_t ops,
+                size_t bytes,
+                unsigned long long millis)
+{
+    double secs = millis / 1000.0;
+
+#ifdef TEST_OOM
+    VIR_TEST_VERBOSE("\n%s %s: %.1f ops/s, %.1f MiB/s, %.1f allocs/op, "
+                     "peak RSS %ld KiB",
+                     corpus, op, ops / secs, bytes / secs / (1024 * 1024),
+                     (double) virAllocTestCount() / ops, testBenchPeakRSS());
+#else
+    VIR_TEST_VERBOSE("\n%s %s: %.1f ops/s, %.1f MiB/s, peak RSS %ld KiB",
+                     corpus, op, ops / secs, bytes / secs / (1024 * 1024),
+                     testBenchPeakRSS());
+#endif
+}
+
+
+static int
+testBenchParse(const void *opaque)
+{
+    const testBenchCorpus *corpus = opaque;
+    unsigned long long start;
+    unsigned long long now;
+    virDomainDefPtr def;
+    size_t ops = 0;
+    size_t bytes = 0;
+    size_t i;
+
+    if (!virTestGetPerf())
+        return EXIT_AM_SKIP;
+
+    if (corpus->nxmls == 0 ||
+        virTimeMillisNow(&start) < 0)
+        return -1;
+
+    virAllocTestInit();
+
+    do {
+        for (i = 0; i < corpus->nxmls; i++) {
+            if (!(def = virDomainDefParseString(corpus->xmls[i], caps, xmlopt,
+                                                NULL, parseFlags)))
+                return -1;
+            virDomainDefFree(def);
+        }
+        ops += corpus->nxmls;
+        bytes += corpus->bytes;
+
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+    } while (now - start < BENCH_MIN_MILLIS);
+
+    testBenchReport(corpus->name, "parse", ops, bytes, now - start);
+    return 0;
+}
+
+
+static int
+testBenchFormat(const void *opaque)
+{
+    const testBenchCorpus *corpus = opaque;
+    unsigned long long start;
+    unsigned long long now;
+    char *xml;
+    size_t ops = 0;
+    size_t bytes = 0;
+    size_t i;
+
+    if (!virTestGetPerf())
+        return EXIT_AM_SKIP;
+
+    if (corpus->nxmls == 0 ||
+        virTimeMillisNow(&start) < 0)
+        return -1;
+
+    virAllocTestInit();
+
+    do {
+        for (i = 0; i < corpus->nxmls; i++) {
+            if (!(xml = virDomainDefFormat(corpus->defs[i], caps, formatFlags)))
+                return -1;
+            bytes += strlen(xml);
+            VIR_FREE(xml);
+        }
+        ops += corpus->nxmls;
+
+        if (virTimeMillisNow(&now) < 0)
+            return -1;
+    } while (now - start < BENCH_MIN_MILLIS);
+
+    testBenchReport(corpus->name, "format", ops, bytes, now - start);
+    return 0;
+}
+
+
+/* Keep BENCH_RSS_DOMAINS pairs of definitions around at once, as the
+ * drivers do for persistent running domains, and see how much memory
+ * they take. */
+static int
+testBenchRSS(const void *opaque)
+{
+    const testBenchCorpus *corpus = opaque;
+    virDomainDefPtr *defs = NULL;
+    size_t ndefs = BENCH_RSS_DOMAINS * 2;
+    long before;
+    long after;
+    size_t i;
+    int ret = -1;
+
+    if (!virTestGetPerf())
+        return EXIT_AM_SKIP;
+
+    if ((before = testBenchCurrentRSS()) < 0)
+        return EXIT_AM_SKIP;
+
+    if (corpus->nxmls == 0 ||
+        VIR_ALLOC_N(defs, ndefs) < 0)
+        return -1;
+
+    for (i = 0; i < ndefs; i++) {
+        const char *xml = corpus->xmls[(i / 2) % corpus->nxmls];
+
+        if (!(defs[i] = virDomainDefParseString(xml, caps, xmlopt, NULL,
+                                                parseFlags)))
+            goto cleanup;
+    }
+
+    if ((after = testBenchCurrentRSS()) < 0)
+        goto cleanup;
+
+    VIR_TEST_VERBOSE("\n%s rss: %d domains, %.1f KiB/domain",
+                     corpus->name, BENCH_RSS_DOMAINS,
+                     (double) (after - before) / BENCH_RSS_DOMAINS);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < ndefs; i++)
+        virDomainDefFree(defs[i]);
+    VIR_FREE(defs);
+    return ret;
+}
+
+
+/* Make sure the synthetic definition survives a round trip, so that the
+ * benchmark doesn't silently measure something else once the parser
+ * starts rejecting it. */
+static int
+testBenchSynthetic(const void *opaque)
+{
+    const testBenchCorpus *corpus = opaque;
+    virDomainDefPtr def = NULL;
+    char *first = NULL;
+    char *second = NULL;
+    int ret = -1;
+
+    if (corpus->nxmls != 1 ||
+        corpus->defs[0]->ndisks + corpus->defs[0]->nnets !=
+        BENCH_SYNTHETIC_DEVICES) {
+        VIR_TEST_VERBOSE("\nsynthetic definition was not parsed correctly");
+        return -1;
+    }
+
+    if (!(first = virDomainDefFormat(corpus->defs[0], caps, formatFlags)) ||
+        !(def = virDomainDefParseString(first, caps, xmlopt, NULL,
+                                        parseFlags)) ||
+        !(second = virDomainDefFormat(def, caps, formatFlags)))
+        goto cleanup;
+
+    if (virTestCompareToString(first, second) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virDomainDefFree(def);
+    VIR_FREE(first);
+    VIR_FREE(second);
+    return ret;
+}
+
+
+static int
+mymain(void)
+{
+    testBenchCorpus argv = { .name = "qemuxml2argvdata" };
+    testBenchCorpus synthetic = { .name = "synthetic" };
+    char *dir = NULL;
+    char *xml = NULL;
+    int ret = 0;
+
+    if (!(caps = virTestGenericCapsInit()) ||
+        !(xmlopt = virTestGenericDomainXMLConfInit()))
+        return EXIT_FAILURE;
+
+    if (!(xml = testBenchSyntheticXML(BENCH_SYNTHETIC_DEVICES)) ||
+        testBenchCorpusAdd(&synthetic, &xml) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("synthetic round trip", testBenchSynthetic,
+                   &synthetic) < 0)
+        ret = -1;
+
+    /* loading the corpus takes a while, don't bother unless asked to */
+    if (virTestGetPerf()) {
+        if (virAsprintf(&dir, "%s/qemuxml2argvdata", abs_srcdir) < 0 ||
+            testBenchLoadDir(&argv, dir) < 0) {
+            ret = -1;
+            goto cleanup;
+        }
+    }
+
+#define DO_TEST_BENCH(label, corpus) \
+    do { \
+        if (virTestRun(label " parse", testBenchParse, &corpus) < 0) \
+            ret = -1; \
+        if (virTestRun(label " format", testBenchFormat, &corpus) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_BENCH("qemuxml2argvdata", argv);
+    DO_TEST_BENCH("synthetic", synthetic);
+
+    /* the synthetic definition is far larger than any real one, 2000 pairs
+     * of it would only show how much memory the test machine has */
+    if (virTestRun("qemuxml2argvdata rss", testBenchRSS, &argv) < 0)
+        ret = -1;
+
+ cleanup:
+    testBenchCorpusClear(&argv);
+    testBenchCorpusClear(&synthetic);
+    VIR_FREE(xml);
+    VIR_FREE(dir);
+    virObjectUnref(caps);
+    virObjectUnref(xmlopt);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -0,0 +1,641 @@
+/*
+ * driverbench.c: public API benchmark against the test driver
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <time.h>
+
+#include "testutils.h"
+#include "internal.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virerror.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Defaults, each of them can be overridden from the environment:
+ *
+ *   VIR_BENCH_URI       connection URI, e.g. test+unix:///default to go
+ *                       through a running libvirtd and the RPC layer
+ *   VIR_BENCH_DOMAINS   number of transient domains to create
+ *   VIR_BENCH_THREADS   number of concurrent clients per workload
+ *   VIR_BENCH_MILLIS    how long each workload runs
+ */
+#define BENCH_URI "test:///default"
+#define BENCH_DOMAINS 2000
+#define BENCH_SMOKE_DOMAINS 10
+#define BENCH_THREADS 4
+#define BENCH_MILLIS 2000
+
+/* how long to wait for an event before declaring it lost */
+#define BENCH_EVENT_TIMEOUT 5000
+
+static const char *benchURI;
+static unsigned int benchDomains;
+static unsigned int benchThreads;
+static unsigned int benchMillis;
+
+static virConnectPtr conn;
+static virDomainPtr *domains;
+static size_t ndomains;
+
+static int eventQuit;
+static virThread eventThread;
+static int eventTimer = -1;
+
+typedef struct _testBenchWorker testBenchWorker;
+typedef testBenchWorker *testBenchWorkerPtr;
+
+typedef int (*testBenchOp)(testBenchWorkerPtr worker);
+
+struct _testBenchWorker {
+    virThread thread;
+    virConnectPtr conn;
+    size_t id;
+    size_t next;
+    unsigned long long deadline;
+    testBenchOp op;
+
+    /* latencies of the individual calls, in microseconds */
+    unsigned long long *lat;
+    size_t nlat;
+    size_t nlat_max;
+    size_t bytes;
+    bool failed;
+
+    /* used by the event workload only */
+    virMutex lock;
+    virCond cond;
+    virDomainPtr dom;
+    int callback;
+    int seen;
+};
+
+typedef struct _testBenchWorkload testBenchWorkload;
+struct _testBenchWorkload {
+    const char *name;
+    testBenchOp op;
+    int (*prepare)(testBenchWorkerPtr worker);
+    void (*finish)(testBenchWorkerPtr worker);
+};
+
+
+static unsigned int
+testBenchGetEnv(const char *name,
+                unsigned int def)
+{
+    const char *str;
+    unsigned int val;
+
+    if (!(str = getenv(name)) ||
+        virStrToLong_ui(str, NULL, 10, &val) < 0 ||
+        val == 0)
+        return def;
+
+    return val;
+}
+
+
+static unsigned long long
+testBenchNowMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+
+static int
+testBenchCompareLat(const void *a,
+                    const void *b)
+{
+    unsigned long long la = *(const unsigned long long *)a;
+    unsigned long long lb = *(const unsigned long long *)b;
+
+    if (la < lb)
+        return -1;
+    return la > lb;
+}
+
+
+static virDomainPtr
+testBenchNextDomain(testBenchWorkerPtr worker)
+{
+    virDomainPtr dom = domains[worker->next % ndomains];
+
+    worker->next += benchThreads;
+    return dom;
+}
+
+
+static int
+testBenchOpList(testBenchWorkerPtr worker)
+{
+    virDomainPtr *doms = NULL;
+    int ndoms;
+    int i;
+
+    if ((ndoms = virConnectListAllDomains(worker->conn, &doms, 0)) < 0)
+        return -1;
+
+    for (i = 0; i < ndoms; i++)
+        virObjectUnref(doms[i]);
+    VIR_FREE(doms);
+
+    if ((size_t) ndoms < ndomains) {
+        VIR_TEST_VERBOSE("\nlisted %d domains, expected at least %zu",
+                         ndoms, ndomains);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testBenchOpDumpXML(testBenchWorkerPtr worker)
+{
+    char *xml;
+
+    if (!(xml = virDomainGetXMLDesc(testBenchNextDomain(worker), 0)))
+        return -1;
+
+    worker->bytes += strlen(xml);
+    VIR_FREE(xml);
+    return 0;
+}
+
+
+static int
+testBenchOpStats(testBenchWorkerPtr worker)
+{
+    virDomainStatsRecordPtr *records = NULL;
+    int nrecords;
+
+    if ((nrecords = virConnectGetAllDomainStats(worker->conn, 0,
+                                                &records, 0)) < 0)
+        return -1;
+
+    virDomainStatsRecordListFree(records);
+    return 0;
+}
+
+
+static int
+testBenchOpStream(testBenchWorkerPtr worker)
+{
+    virStreamPtr st = NULL;
+    char *mime = NULL;
+    char buf[64 * 1024];
+    int got;
+    int ret = -1;
+
+    if (!(st = virStreamNew(worker->conn, 0)) ||
+        !(mime = virDomainScreenshot(testBenchNextDomain(worker), st, 0, 0)))
+        goto cleanup;
+
+    while ((got = virStreamRecv(st, buf, sizeof(buf))) > 0)
+        worker->bytes += got;
+
+    if (got < 0 || virStreamFinish(st) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    if (ret < 0 && st)
+        virStreamAbort(st);
+    virObjectUnref(st);
+    VIR_FREE(mime);
+    return ret;
+}
+
+
+static int
+testBenchEventCallback(virConnectPtr c ATTRIBUTE_UNUSED,
+                       virDomainPtr dom ATTRIBUTE_UNUSED,
+                       int event ATTRIBUTE_UNUSED,
+                       int detail ATTRIBUTE_UNUSED,
+                       void *opaque)
+{
+    testBenchWorkerPtr worker = opaque;
+
+    virMutexLock(&worker->lock);
+    worker->seen++;
+    virCondSignal(&worker->cond);
+    virMutexUnlock(&worker->lock);
+    return 0;
+}
+
+
+/* Every worker owns a single domain which it keeps pausing and resuming,
+ * so the latency covers the call and the delivery of the lifecycle event
+ * back to the client. */
+static int
+testBenchEventPrepare(testBenchWorkerPtr worker)
+{
+    if (worker->id >= ndomains) {
+        VIR_TEST_VERBOSE("\nnot enough domains for %u event workers",
+                         benchThreads);
+        return -1;
+    }
+
+    if (virMutexInit(&worker->lock) < 0)
+        return -1;
+    if (virCondInit(&worker->cond) < 0) {
+        virMutexDestroy(&worker->lock);
+        return -1;
+    }
+
+    worker->dom = domains[worker->id];
+    worker->callback =
+        virConnectDomainEventRegisterAny(worker->conn, worker->dom,
+                                         VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                         VIR_DOMAIN_EVENT_CALLBACK(testBenchEventCallback),
+                                         worker, NULL);
+    if (worker->callback < 0) {
+        virCondDestroy(&worker->cond);
+        virMutexDestroy(&worker->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void
+testBenchEventFinish(testBenchWorkerPtr worker)
+{
+    virConnectDomainEventDeregisterAny(worker->conn, worker->callback);
+    /* leave the domain running for the other workloads */
+    virDomainResume(worker->dom);
+    virResetLastError();
+    virCondDestroy(&worker->cond);
+    virMutexDestroy(&worker->lock);
+}
+
+
+static int
+testBenchOpEvent(testBenchWorkerPtr worker)
+{
+    unsigned long long until;
+    int seen;
+    int rc;
+    int ret = -1;
+
+    virMutexLock(&worker->lock);
+    seen = worker->seen;
+    virMutexUnlock(&worker->lock);
+
+    if (worker->next++ % 2 == 0)
+        rc = virDomainSuspend(worker->dom);
+    else
+        rc = virDomainResume(worker->dom);
+    if (rc < 0)
+        return -1;
+
+    if (virTimeMillisNow(&until) < 0)
+        return -1;
+    until += BENCH_EVENT_TIMEOUT;
+
+    virMutexLock(&worker->lock);
+    while (worker->seen == seen) {
+        if (virCondWaitUntil(&worker->cond, &worker->lock, until) < 0) {
+            if (errno == ETIMEDOUT)
+                VIR_TEST_VERBOSE("\nevent for %s was not delivered",
+                                 virDomainGetName(worker->dom));
+            goto cleanup;
+        }
+    }
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&worker->lock);
+    return ret;
+}
+
+
+static void
+testBenchWorkerRun(void *opaque)
+{
+    testBenchWorkerPtr worker = opaque;
+    unsigned long long start;
+    unsigned long long end;
+
+    do {
+        if (VIR_RESIZE_N(worker->lat, worker->nlat_max, worker->nlat, 1) < 0)
+            goto error;
+
+        start = testBenchNowMicros();
+        if (worker->op(worker) < 0)
+            goto error;
+        end = testBenchNowMicros();
+
+        worker->lat[worker->nlat++] = end - start;
+    } while (end / 1000 < worker->deadline);
+
+    return;
+
+ error:
+    VIR_TEST_DEBUG("worker %zu failed: %s", worker->id,
+                   virGetLastErrorMessage());
+    worker->failed = true;
+}
+
+
+static void
+testBenchReport(const char *name,
+                unsigned long long *lat,
+                size_t nlat,
+                size_t bytes,
+                unsigned long long micros,
+                int allocs)
+{
+    double secs = micros / 1000000.0;
+
+    qsort(lat, nlat, sizeof(*lat), testBenchCompareLat);
+
+    VIR_TEST_VERBOSE("\n%s: %u threads, %.1f ops/s, p50 %llu us, "
+                     "p99 %llu us, max %llu us, %.1f KiB/s",
+                     name, benchThreads, nlat / secs,
+                     lat[nlat / 2], lat[nlat * 99 / 100], lat[nlat - 1],
+                     bytes / secs / 1024);
+    /* the counter is not thread safe, so it is a lower bound only once
+     * there's more than one client */
+    if (allocs >= 0)
+        VIR_TEST_VERBOSE(", %.1f allocs/op", (double) allocs / nlat);
+}
+
+
+static int
+testBenchRunWorkload(const void *opaque)
+{
+    const testBenchWorkload *workload = opaque;
+    testBenchWorkerPtr workers = NULL;
+    unsigned long long *lat = NULL;
+    unsigned long long start;
+    unsigned long long end;
+    size_t nlat = 0;
+    size_t bytes = 0;
+    size_t nprepared = 0;
+    size_t nstarted = 0;
+    size_t i;
+    int allocs = -1;
+    int ret = -1;
+
+    if (!virTestGetPerf())
+        return EXIT_AM_SKIP;
+
+    if (VIR_ALLOC_N(workers, benchThreads) < 0)
+        return -1;
+
+    for (i = 0; i < benchThreads; i++) {
+        workers[i].id = i;
+        workers[i].next = i;
+        workers[i].op = workload->op;
+        if (!(workers[i].conn = virConnectOpen(benchURI)))
+            goto cleanup;
+        if (workload->prepare && workload->prepare(&workers[i]) < 0) {
+            virObjectUnref(workers[i].conn);
+            workers[i].conn = NULL;
+            goto cleanup;
+        }
+        nprepared++;
+    }
+
+    /* stop early if the operation is not supported at all, rather than
+     * reporting a bunch of failed threads */
+    if (workload->op(&workers[0]) < 0) {
+        if (virGetLastErrorCode() == VIR_ERR_NO_SUPPORT ||
+            virGetLastErrorCode() == VIR_ERR_SYSTEM_ERROR) {
+            VIR_TEST_DEBUG("%s: %s, skipping", workload->name,
+                           virGetLastErrorMessage());
+            ret = EXIT_AM_SKIP;
+        }
+        goto cleanup;
+    }
+    workers[0].bytes = 0;
+
+#ifdef TEST_OOM
+    virAllocTestInit();
+#endif
+
+    start = testBenchNowMicros();
+    for (i = 0; i < benchThreads; i++) {
+        workers[i].deadline = start / 1000 + benchMillis;
+        if (virThreadCreate(&workers[i].thread, true,
+                            testBenchWorkerRun, &workers[i]) < 0)
+            goto cleanup;
+        nstarted++;
+    }
+
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i].thread);
+    nstarted = 0;
+    end = testBenchNowMicros();
+
+#ifdef TEST_OOM
+    allocs = virAllocTestCount();
+#endif
+
+    for (i = 0; i < benchThreads; i++) {
+        if (workers[i].failed)
+            goto cleanup;
+        if (VIR_EXPAND_N(lat, nlat, workers[i].nlat) < 0)
+            goto cleanup;
+        memcpy(lat + nlat - workers[i].nlat, workers[i].lat,
+               sizeof(*lat) * workers[i].nlat);
+        bytes += workers[i].bytes;
+    }
+
+    testBenchReport(workload->name, lat, nlat, bytes,
+                    end - start, allocs);
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i].thread);
+    for (i = 0; i < nprepared; i++) {
+        if (workload->finish)
+            workload->finish(&workers[i]);
+        virObjectUnref(workers[i].conn);
+        VIR_FREE(workers[i].lat);
+    }
+    VIR_FREE(workers);
+    VIR_FREE(lat);
+    return ret;
+}
+
+
+static void
+testBenchEventTimer(int timer ATTRIBUTE_UNUSED,
+                    void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+testBenchEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!virAtomicIntGet(&eventQuit)) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+static int
+testBenchCreateDomains(unsigned int count)
+{
+    char *xml = NULL;
+    virDomainPtr dom;
+    size_t i;
+    int ret = -1;
+
+    if (VIR_ALLOC_N(domains, count) < 0)
+        return -1;
+
+    for (i = 0; i < count; i++) {
+        if (virAsprintf(&xml,
+                        "<domain type='test'>"
+                        "  <name>bench-%zu</name>"
+                        "  <memory>1048576</memory>"
+                        "  <vcpu>1</vcpu>"
+                        "  <os><type>hvm</type></os>"
+                        "  <devices>"
+                        "    <disk type='file' device='disk'>"
+                        "      <source file='/var/lib/libvirt/images/bench-%zu.img'/>"
+                        "      <target dev='vda' bus='virtio'/>"
+                        "    </disk>"
+                        "    <interface type='network'>"
+                        "      <source network='default'/>"
+                        "    </interface>"
+                        "  </devices>"
+                        "</domain>", i, i) < 0)
+            goto cleanup;
+
+        if (!(dom = virDomainCreateXML(conn, xml, 0)))
+            goto cleanup;
+
+        domains[ndomains++] = dom;
+        VIR_FREE(xml);
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(xml);
+    return ret;
+}
+
+
+static void
+testBenchDestroyDomains(void)
+{
+    size_t i;
+
+    for (i = 0; i < ndomains; i++) {
+        virDomainDestroy(domains[i]);
+        virObjectUnref(domains[i]);
+    }
+    VIR_FREE(domains);
+    ndomains = 0;
+}
+
+
+/* Cheap sanity check of the workloads which runs even without
+ * VIR_TEST_PERF, so that the benchmark doesn't bitrot. */
+static int
+testBenchSmoke(const void *opaque ATTRIBUTE_UNUSED)
+{
+    testBenchWorker worker = { .conn = conn };
+
+    if (testBenchOpList(&worker) < 0 ||
+        testBenchOpDumpXML(&worker) < 0 ||
+        testBenchOpStats(&worker) < 0)
+        return -1;
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    static const testBenchWorkload workloads[] = {
+        { "list-all-domains", testBenchOpList, NULL, NULL },
+        { "dumpxml", testBenchOpDumpXML, NULL, NULL },
+        { "get-all-domain-stats", testBenchOpStats, NULL, NULL },
+        { "lifecycle-events", testBenchOpEvent,
+          testBenchEventPrepare, testBenchEventFinish },
+        { "screenshot-stream", testBenchOpStream, NULL, NULL },
+    };
+    size_t i;
+    int ret = 0;
+
+    if (!(benchURI = getenv("VIR_BENCH_URI")))
+        benchURI = BENCH_URI;
+    benchThreads = testBenchGetEnv("VIR_BENCH_THREADS", BENCH_THREADS);
+    benchMillis = testBenchGetEnv("VIR_BENCH_MILLIS", BENCH_MILLIS);
+    if (virTestGetPerf())
+        benchDomains = testBenchGetEnv("VIR_BENCH_DOMAINS", BENCH_DOMAINS);
+    else
+        benchDomains = BENCH_SMOKE_DOMAINS;
+
+    if (virEventRegisterDefaultImpl() < 0 ||
+        (eventTimer = virEventAddTimeout(100, testBenchEventTimer,
+                                         NULL, NULL)) < 0 ||
+        virThreadCreate(&eventThread, true, testBenchEventLoop, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (!(conn = virConnectOpen(benchURI))) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (testBenchCreateDomains(benchDomains) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    VIR_TEST_DEBUG("%s: created %zu domains", benchURI, ndomains);
+
+    if (virTestRun("smoke", testBenchSmoke, NULL) < 0)
+        ret = -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(workloads); i++) {
+        if (virTestRun(workloads[i].name, testBenchRunWorkload,
+                       &workloads[i]) < 0)
+            ret = -1;
+    }
+
+ cleanup:
+    testBenchDestroyDomains();
+    virObjectUnref(conn);
+    virAtomicIntSet(&eventQuit, 1);
+    virThreadJoin(&eventThread);
+    virEventRemoveTimeout(eventTimer);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -37,6 +37,7 @@
 #include "virlog.h"
 #include "virutil.h"
 #include "vireventpoll.h"
+#include "virobject.h"
 
 VIR_LOG_INIT("tests.eventtest");
 
@@ -309,6 +310,142 @@ resetAll(void)
     }
 }
 
+struct testPrivateLoopData {
+    virEventPollLoopPtr loop;
+    int pipeFD[2];
+    int watch;
+    int fired;
+};
+
+static void
+testPrivateLoopReader(int watch, int fd,
+                      int events ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    struct testPrivateLoopData *data = opaque;
+    char one;
+
+    if (watch == data->watch &&
+        saferead(fd, &one, 1) == 1)
+        data->fired++;
+
+    virEventPollLoopQuit(data->loop);
+}
+
+static void
+testPrivateLoopThread(void *opaque)
+{
+    ignore_value(virEventPollLoopRun(opaque));
+}
+
+static int
+testPrivateLoop(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testPrivateLoopData data = { .pipeFD = { -1, -1 } };
+    virThread thread;
+    char one = '1';
+    int ret = -1;
+
+    if (pipe(data.pipeFD) < 0)
+        return -1;
+
+    if (!(data.loop = virEventPollLoopNew()))
+        goto cleanup;
+
+    if ((data.watch = virEventPollLoopAddHandle(data.loop, data.pipeFD[0],
+                                                VIR_EVENT_HANDLE_READABLE,
+                                                testPrivateLoopReader,
+                                                &data, NULL)) < 0)
+        goto cleanup;
+
+    if (virThreadCreate(&thread, true, testPrivateLoopThread, data.loop) < 0)
+        goto cleanup;
+
+    if (safewrite(data.pipeFD[1], &one, 1) != 1) {
+        virEventPollLoopQuit(data.loop);
+        virThreadJoin(&thread);
+        goto cleanup;
+    }
+
+    virThreadJoin(&thread);
+
+    if (data.fired != 1) {
+        fprintf(stderr, "Handle fired %d times, expected once\n", data.fired);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(data.loop);
+    VIR_FORCE_CLOSE(data.pipeFD[0]);
+    VIR_FORCE_CLOSE(data.pipeFD[1]);
+    return ret;
+}
+
+struct testTimerOrderData {
+    virEventPollLoopPtr loop;
+    int fired[4];
+    int nfired;
+};
+
+static void
+testTimerOrderCallback(int timer, void *opaque)
+{
+    struct testTimerOrderData *data = opaque;
+
+    if (data->nfired < ARRAY_CARDINALITY(data->fired))
+        data->fired[data->nfired] = timer;
+    data->nfired++;
+
+    virEventPollLoopUpdateTimeout(data->loop, timer, -1);
+    if (data->nfired == ARRAY_CARDINALITY(data->fired))
+        virEventPollLoopQuit(data->loop);
+}
+
+static int
+testTimerOrder(const void *opaque ATTRIBUTE_UNUSED)
+{
+    struct testTimerOrderData data = { 0 };
+    /* Registered out of order, expected to fire by expiry time */
+    int timeouts[] = { 80, 20, 60, 40 };
+    int ids[ARRAY_CARDINALITY(timeouts)];
+    int expect[] = { 1, 3, 2, 0 };
+    size_t i;
+    int ret = -1;
+
+    if (!(data.loop = virEventPollLoopNew()))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(timeouts); i++) {
+        if ((ids[i] = virEventPollLoopAddTimeout(data.loop, timeouts[i],
+                                                 testTimerOrderCallback,
+                                                 &data, NULL)) < 0)
+            goto cleanup;
+    }
+
+    if (virEventPollLoopRun(data.loop) < 0)
+        goto cleanup;
+
+    if (data.nfired != ARRAY_CARDINALITY(expect)) {
+        fprintf(stderr, "%d timers fired, expected %zu\n",
+                data.nfired, ARRAY_CARDINALITY(expect));
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(expect); i++) {
+        if (data.fired[i] != ids[expect[i]]) {
+            fprintf(stderr, "Timer %d fired as #%zu, expected timer %d\n",
+                    data.fired[i], i, ids[expect[i]]);
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virObjectUnref(data.loop);
+    return ret;
+}
+
 static int
 mymain(void)
 {
@@ -522,6 +659,14 @@ mymain(void)
     if (finishJob("Write duplicate", 1, -1) != EXIT_SUCCESS)
         return EXIT_FAILURE;
 
+    /* A private loop must run independently of the default one,
+     * which is still busy in eventThreadLoop */
+    if (virTestRun("Private loop", testPrivateLoop, NULL) < 0)
+        return EXIT_FAILURE;
+
+    if (virTestRun("Timer order", testTimerOrder, NULL) < 0)
+        return EXIT_FAILURE;
+
     /* pthread_kill(eventThread, SIGTERM); */
 
     return EXIT_SUCCESS;
@@ -94,6 +94,7 @@ mymain(void)
         TEST_COMPARE_DOM_XML2XML_RESULT_FAIL_PARSE);
 
     DO_TEST("perf");
+    DO_TEST("startup-priority");
 
     DO_TEST("vcpus-individual");
     DO_TEST("disk-network-http");
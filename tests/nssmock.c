@@ -31,6 +31,7 @@
 # include "configmake.h"
 # include "virstring.h"
 # include "viralloc.h"
+# include "virlease.h"
 
 static int (*real_open)(const char *path, int flags, ...);
 static DIR * (*real_opendir)(const char *name);
@@ -56,7 +57,12 @@ static int
 getrealpath(char **newpath,
             const char *path)
 {
-    if (STRPREFIX(path, LEASEDIR)) {
+    const char *index_file = getenv("LIBVIRT_NSS_TEST_LEASE_INDEX");
+
+    if (index_file && STREQ(path, LEASEDIR VIR_LEASE_INDEX_FILE)) {
+        if (VIR_STRDUP_QUIET(*newpath, index_file) < 0)
+            return -1;
+    } else if (STRPREFIX(path, LEASEDIR)) {
         if (virAsprintfQuiet(newpath, "%s/nssdata/%s",
                              abs_srcdir,
                              path + strlen(LEASEDIR)) < 0) {
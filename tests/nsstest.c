@@ -26,6 +26,8 @@
 
 # include <arpa/inet.h>
 # include "libvirt_nss.h"
+# include "virfile.h"
+# include "virlease.h"
 # include "virsocketaddr.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
@@ -169,7 +171,7 @@ testGetHostByName(const void *opaque)
 }
 
 static int
-mymain(void)
+testLookups(void)
 {
     int ret = 0;
 
@@ -194,6 +196,48 @@ mymain(void)
     DO_TEST("suse", AF_INET, "192.168.122.3");
 # endif /* defined(LIBVIRT_NSS_GUEST) */
 
+# undef DO_TEST
+
+    return ret;
+}
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    char *tmpdir = NULL;
+    char *index_file = NULL;
+    char template[] = abs_builddir "/nsstestdata-XXXXXX";
+
+    /* No index, the lease files are parsed */
+    if (testLookups() < 0)
+        ret = -1;
+
+    /* The same lookups answered from the lease index */
+    if (!(tmpdir = mkdtemp(template))) {
+        fprintf(stderr, "Cannot create temporary directory\n");
+        return EXIT_FAILURE;
+    }
+
+    if (virAsprintf(&index_file, "%s/%s", tmpdir, VIR_LEASE_INDEX_FILE) < 0 ||
+        virLeaseIndexBuild(abs_srcdir "/nssdata", index_file) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (setenv("LIBVIRT_NSS_TEST_LEASE_INDEX", index_file, 1) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (testLookups() < 0)
+        ret = -1;
+
+ cleanup:
+    unsetenv("LIBVIRT_NSS_TEST_LEASE_INDEX");
+    if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
+        virFileDeleteTree(tmpdir);
+    VIR_FREE(index_file);
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
@@ -0,0 +1,234 @@
+/*
+ * nwfilternftablestest.c: Test nftables rule generation
+ *
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+#include "nwfilter/nwfilter_nftables_driver.h"
+#include "virbuffer.h"
+
+#define __VIR_COMMAND_PRIV_H_ALLOW__
+#include "vircommandpriv.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+
+typedef int (*testNWFilterNFTablesFunc)(void);
+
+struct testInfo {
+    testNWFilterNFTablesFunc func;
+    const char *expected;
+};
+
+
+/* the scripts loaded by nft are passed on its stdin */
+static void
+testNWFilterNFTablesDryRun(const char *const*args ATTRIBUTE_UNUSED,
+                           const char *const*env ATTRIBUTE_UNUSED,
+                           const char *input,
+                           char **output ATTRIBUTE_UNUSED,
+                           char **error ATTRIBUTE_UNUSED,
+                           int *status ATTRIBUTE_UNUSED,
+                           void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (input)
+        virBufferAdd(buf, input, -1);
+}
+
+
+static int
+testNWFilterNFTables(const void *opaque)
+{
+    const struct testInfo *info = opaque;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *actual = NULL;
+    int ret = -1;
+
+    virCommandSetDryRun(NULL, testNWFilterNFTablesDryRun, &buf);
+
+    if (info->func() < 0)
+        goto cleanup;
+
+    if (virBufferError(&buf))
+        goto cleanup;
+
+    actual = virBufferContentAndReset(&buf);
+
+    if (STRNEQ_NULLABLE(actual, info->expected)) {
+        virTestDifference(stderr, info->expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virBufferFreeAndReset(&buf);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
+static int
+testNWFilterNFTablesInit(void)
+{
+    return nftables_driver.init(true);
+}
+
+
+static int
+testNWFilterNFTablesApplyBasicRules(void)
+{
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+
+    return nftables_driver.applyBasicRules("vnet0", &mac);
+}
+
+
+static int
+testNWFilterNFTablesApplyDHCPOnlyRules(void)
+{
+    virMacAddr mac = { .addr = { 0x10, 0x20, 0x30, 0x40, 0x50, 0x60 } };
+    const char *servers[] = { "192.168.122.1", "10.17.3.1" };
+    virNWFilterVarValue val = {
+        .valType = NWFILTER_VALUE_TYPE_ARRAY,
+        .u = {
+            .array = {
+                .values = (char **)servers,
+                .nValues = 2,
+            },
+        },
+    };
+
+    return nftables_driver.applyDHCPOnlyRules("vnet0", &mac, &val, false);
+}
+
+
+static int
+testNWFilterNFTablesApplyDropAllRules(void)
+{
+    return nftables_driver.applyDropAllRules("vnet0");
+}
+
+
+static int
+testNWFilterNFTablesAllTeardown(void)
+{
+    return nftables_driver.allTeardown("vnet0");
+}
+
+
+#define NFT "bridge libvirt_nwfilter"
+
+static const struct testInfo tests[] = {
+    { testNWFilterNFTablesInit,
+      "add table " NFT "\n"
+      "add map " NFT " from-vm-if { type ifname : verdict; }\n"
+      "add chain " NFT " from-vm { type filter hook prerouting priority -300; }\n"
+      "flush chain " NFT " from-vm\n"
+      "add rule " NFT " from-vm iifname vmap @from-vm-if\n"
+      "add map " NFT " to-vm-if { type ifname : verdict; }\n"
+      "add chain " NFT " to-vm { type filter hook postrouting priority 300; }\n"
+      "flush chain " NFT " to-vm\n"
+      "add rule " NFT " to-vm oifname vmap @to-vm-if\n" },
+    { testNWFilterNFTablesApplyBasicRules,
+      "add chain " NFT " a/from/vnet0\n"
+      "add chain " NFT " from/vnet0\n"
+      "add element " NFT " from-vm-if { \"vnet0\" : jump from/vnet0 }\n"
+      "add rule " NFT " from/vnet0 jump a/from/vnet0\n"
+      "add rule " NFT " a/from/vnet0 ether saddr != 10:20:30:40:50:60 drop\n"
+      "add rule " NFT " a/from/vnet0 ether type 0x0800 accept\n"
+      "add rule " NFT " a/from/vnet0 ether type 0x0806 accept\n"
+      "add rule " NFT " a/from/vnet0 drop\n" },
+    { testNWFilterNFTablesApplyDHCPOnlyRules,
+      "flush chain " NFT " from/vnet0\n"
+      "flush chain " NFT " a/from/vnet0\n"
+      "delete chain " NFT " a/from/vnet0\n"
+      "add chain " NFT " a/from/vnet0\n"
+      "add rule " NFT " from/vnet0 jump a/from/vnet0\n"
+      "add chain " NFT " a/to/vnet0\n"
+      "add chain " NFT " to/vnet0\n"
+      "add element " NFT " to-vm-if { \"vnet0\" : jump to/vnet0 }\n"
+      "add rule " NFT " to/vnet0 jump a/to/vnet0\n"
+      "add rule " NFT " a/from/vnet0 ether saddr 10:20:30:40:50:60 "
+      "ether type 0x0800 ip protocol udp udp sport 68 udp dport 67 accept\n"
+      "add rule " NFT " a/from/vnet0 drop\n"
+      "add rule " NFT " a/to/vnet0 ether daddr 10:20:30:40:50:60 "
+      "ether type 0x0800 ip protocol udp ip saddr 192.168.122.1 "
+      "udp sport 67 udp dport 68 accept\n"
+      "add rule " NFT " a/to/vnet0 ether daddr ff:ff:ff:ff:ff:ff "
+      "ether type 0x0800 ip protocol udp ip saddr 192.168.122.1 "
+      "udp sport 67 udp dport 68 accept\n"
+      "add rule " NFT " a/to/vnet0 ether daddr 10:20:30:40:50:60 "
+      "ether type 0x0800 ip protocol udp ip saddr 10.17.3.1 "
+      "udp sport 67 udp dport 68 accept\n"
+      "add rule " NFT " a/to/vnet0 ether daddr ff:ff:ff:ff:ff:ff "
+      "ether type 0x0800 ip protocol udp ip saddr 10.17.3.1 "
+      "udp sport 67 udp dport 68 accept\n"
+      "add rule " NFT " a/to/vnet0 drop\n" },
+    { testNWFilterNFTablesApplyDropAllRules,
+      "flush chain " NFT " from/vnet0\n"
+      "flush chain " NFT " to/vnet0\n"
+      "flush chain " NFT " a/from/vnet0\n"
+      "flush chain " NFT " a/to/vnet0\n"
+      "delete chain " NFT " a/from/vnet0\n"
+      "delete chain " NFT " a/to/vnet0\n"
+      "add chain " NFT " a/from/vnet0\n"
+      "add rule " NFT " from/vnet0 jump a/from/vnet0\n"
+      "add chain " NFT " a/to/vnet0\n"
+      "add rule " NFT " to/vnet0 jump a/to/vnet0\n"
+      "add rule " NFT " a/from/vnet0 drop\n"
+      "add rule " NFT " a/to/vnet0 drop\n" },
+    { testNWFilterNFTablesAllTeardown,
+      "delete element " NFT " from-vm-if { \"vnet0\" }\n"
+      "delete element " NFT " to-vm-if { \"vnet0\" }\n"
+      "flush chain " NFT " from/vnet0\n"
+      "flush chain " NFT " to/vnet0\n"
+      "flush chain " NFT " a/from/vnet0\n"
+      "flush chain " NFT " a/to/vnet0\n"
+      "delete chain " NFT " a/from/vnet0\n"
+      "delete chain " NFT " a/to/vnet0\n"
+      "delete chain " NFT " from/vnet0\n"
+      "delete chain " NFT " to/vnet0\n" },
+};
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+    size_t i;
+
+    /* the steps build on each other */
+    for (i = 0; i < ARRAY_CARDINALITY(tests); i++) {
+        if (virTestRun("nftables", testNWFilterNFTables, &tests[i]) < 0) {
+            ret = -1;
+            break;
+        }
+    }
+
+    nftables_driver.shutdown();
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
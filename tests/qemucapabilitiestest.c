@@ -135,6 +135,64 @@ testQemuCapsCopy(const void *opaque)
 }
 
 
+static int
+testQemuCapsBinary(const void *opaque)
+{
+    int ret = -1;
+    const testQemuData *data = opaque;
+    virArch arch = virArchFromString(data->archName);
+    char *capsFile = NULL;
+    virCapsPtr caps = NULL;
+    virQEMUCapsPtr orig = NULL;
+    virQEMUCapsPtr loaded = NULL;
+    char *binary = NULL;
+    size_t len;
+    char *actual = NULL;
+
+    if (virAsprintf(&capsFile, "%s/qemucapabilitiesdata/%s.%s.xml",
+                    abs_srcdir, data->base, data->archName) < 0)
+        goto cleanup;
+
+    if (!(caps = virCapabilitiesNew(arch, false, false)))
+        goto cleanup;
+
+    if (!(orig = qemuTestParseCapabilities(caps, capsFile)))
+        goto cleanup;
+
+    if (virQEMUCapsFormatCacheBinary(orig, &binary, &len) < 0 ||
+        !(loaded = virQEMUCapsNew()) ||
+        virQEMUCapsLoadCacheBinary(arch, loaded, binary, len) < 0)
+        goto cleanup;
+
+    if (!(actual = virQEMUCapsFormatCache(loaded)))
+        goto cleanup;
+
+    if (virTestCompareToFile(actual, capsFile) < 0)
+        goto cleanup;
+
+    /* a truncated cache must be refused */
+    virObjectUnref(loaded);
+    if (!(loaded = virQEMUCapsNew()))
+        goto cleanup;
+
+    if (virQEMUCapsLoadCacheBinary(arch, loaded, binary, len - 1) == 0) {
+        VIR_TEST_VERBOSE("truncated capabilities cache was loaded\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(capsFile);
+    virObjectUnref(caps);
+    virObjectUnref(orig);
+    virObjectUnref(loaded);
+    VIR_FREE(binary);
+    VIR_FREE(actual);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -161,6 +219,9 @@ mymain(void)
         if (virTestRun("copy " name "(" arch ")", \
                        testQemuCapsCopy, &data) < 0) \
             ret = -1; \
+        if (virTestRun("binary " name "(" arch ")", \
+                       testQemuCapsBinary, &data) < 0) \
+            ret = -1; \
     } while (0)
 
     /* Keep this in sync with qemucaps2xmltest */
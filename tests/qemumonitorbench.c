@@ -0,0 +1,734 @@
+/*
+ * qemumonitorbench.c: load test for the QEMU monitor code
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include <time.h>
+
+#include "testutils.h"
+#include "testutilsqemu.h"
+#include "qemumonitortestutils.h"
+#include "viralloc.h"
+#include "viratomic.h"
+#include "virbuffer.h"
+#include "virerror.h"
+#include "virstring.h"
+#include "virthread.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Defaults, each of them can be overridden from the environment:
+ *
+ *   VIR_BENCH_MONITORS  number of simulated QEMU processes
+ *   VIR_BENCH_THREADS   number of threads talking to the monitors
+ *   VIR_BENCH_MILLIS    how long each workload runs
+ *   VIR_BENCH_DISKS     disks per simulated domain
+ *   VIR_BENCH_VCPUS     vCPUs per simulated domain
+ *   VIR_BENCH_EVENTS    events per storm
+ */
+#define BENCH_MONITORS 200
+#define BENCH_SMOKE_MONITORS 2
+#define BENCH_THREADS 8
+#define BENCH_MILLIS 2000
+#define BENCH_DISKS 16
+#define BENCH_VCPUS 32
+#define BENCH_EVENTS 500
+
+static unsigned int benchMonitors;
+static unsigned int benchThreads;
+static unsigned int benchMillis;
+static unsigned int benchDisks;
+static unsigned int benchVcpus;
+static unsigned int benchEvents;
+
+static virQEMUDriver driver;
+
+static char *replyBlockstats;
+static char *replyBlock;
+static char *replyCpus;
+
+static int eventQuit;
+static virThread eventThread;
+static int eventTimer = -1;
+
+static const char *stormEvents[] = {
+    "{\"event\": \"RTC_CHANGE\", \"data\": {\"offset\": 42}, "
+    "\"timestamp\": {\"seconds\": 1539000000, \"microseconds\": 1}}",
+    "{\"event\": \"BALLOON_CHANGE\", \"data\": {\"actual\": 1073741824}, "
+    "\"timestamp\": {\"seconds\": 1539000000, \"microseconds\": 2}}",
+    "{\"event\": \"BLOCK_WRITE_THRESHOLD\", \"data\": "
+    "{\"node-name\": \"#block001\", \"amount-exceeded\": 65536, "
+    "\"write-threshold\": 1073741824}, "
+    "\"timestamp\": {\"seconds\": 1539000000, \"microseconds\": 3}}",
+};
+
+typedef struct _testBenchWorker testBenchWorker;
+typedef testBenchWorker *testBenchWorkerPtr;
+
+typedef int (*testBenchOp)(qemuMonitorTestPtr test);
+
+struct _testBenchWorker {
+    virThread thread;
+    size_t id;
+    qemuMonitorTestPtr *tests;
+    size_t ntests;
+    size_t next;
+    unsigned long long deadline;
+    testBenchOp op;
+
+    /* latencies of the individual calls, in microseconds */
+    unsigned long long *lat;
+    size_t nlat;
+    size_t nlat_max;
+    bool failed;
+};
+
+typedef struct _testBenchWorkload testBenchWorkload;
+struct _testBenchWorkload {
+    const char *name;
+    testBenchOp op;
+    size_t *events;
+};
+
+static testBenchWorkerPtr workers;
+static size_t nworkers;
+
+
+static unsigned int
+testBenchGetEnv(const char *name,
+                unsigned int def)
+{
+    const char *str;
+    unsigned int val;
+
+    if (!(str = getenv(name)) ||
+        virStrToLong_ui(str, NULL, 10, &val) < 0 ||
+        val == 0)
+        return def;
+
+    return val;
+}
+
+
+static unsigned long long
+testBenchNowMicros(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+
+static int
+testBenchCompareLat(const void *a,
+                    const void *b)
+{
+    unsigned long long la = *(const unsigned long long *)a;
+    unsigned long long lb = *(const unsigned long long *)b;
+
+    if (la < lb)
+        return -1;
+    return la > lb;
+}
+
+
+static void
+testBenchFormatStats(virBufferPtr buf,
+                     size_t seed)
+{
+    virBufferAsprintf(buf,
+                      "{\"flush_total_time_ns\": %zu, "
+                      "\"wr_highest_offset\": %zu, "
+                      "\"wr_total_time_ns\": %zu, "
+                      "\"failed_wr_operations\": 0, "
+                      "\"failed_rd_operations\": 0, "
+                      "\"wr_merged\": 0, "
+                      "\"wr_bytes\": %zu, "
+                      "\"timed_stats\": [], "
+                      "\"failed_flush_operations\": 0, "
+                      "\"account_invalid\": true, "
+                      "\"rd_total_time_ns\": %zu, "
+                      "\"flush_operations\": %zu, "
+                      "\"wr_operations\": %zu, "
+                      "\"rd_merged\": 0, "
+                      "\"rd_bytes\": %zu, "
+                      "\"invalid_flush_operations\": 0, "
+                      "\"account_failed\": true, "
+                      "\"idle_time_ns\": %zu, "
+                      "\"rd_operations\": %zu, "
+                      "\"invalid_wr_operations\": 0, "
+                      "\"invalid_rd_operations\": 0}",
+                      seed * 1031, seed * 4096, seed * 7919, seed * 65536,
+                      seed * 6151, seed * 13, seed * 127, seed * 131072,
+                      seed * 1000003, seed * 251);
+}
+
+
+/* The replies mimic what QEMU 3.0 returns for a domain with a qcow2 disk
+ * on top of a backing image per disk, so that the parsers are exercised
+ * with realistically sized JSON documents. */
+static char *
+testBenchBlockstatsReply(size_t ndisks)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < ndisks; i++) {
+        if (i)
+            virBufferAddLit(&buf, ", ");
+        virBufferAsprintf(&buf,
+                          "{\"device\": \"drive-virtio-disk%zu\", "
+                          "\"node-name\": \"#block%03zu\", \"stats\": ",
+                          i, i * 3);
+        testBenchFormatStats(&buf, i + 1);
+        virBufferAsprintf(&buf,
+                          ", \"parent\": {\"node-name\": \"#block%03zu\", "
+                          "\"stats\": ", i * 3 + 1);
+        testBenchFormatStats(&buf, i + 2);
+        virBufferAsprintf(&buf,
+                          "}, \"backing\": {\"node-name\": \"#block%03zu\", "
+                          "\"stats\": ", i * 3 + 2);
+        testBenchFormatStats(&buf, i + 3);
+        virBufferAddLit(&buf, "}}");
+    }
+    virBufferAddLit(&buf, "]}");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static char *
+testBenchBlockReply(size_t ndisks)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < ndisks; i++) {
+        if (i)
+            virBufferAddLit(&buf, ", ");
+        virBufferAsprintf(&buf,
+                          "{\"io-status\": \"ok\", "
+                          "\"device\": \"drive-virtio-disk%zu\", "
+                          "\"locked\": false, \"removable\": false, "
+                          "\"inserted\": {\"iops_rd\": 0, "
+                          "\"detect_zeroes\": \"off\", "
+                          "\"image\": {\"virtual-size\": 21474836480, "
+                          "\"filename\": \"/var/lib/libvirt/images/disk%zu.qcow2\", "
+                          "\"cluster-size\": 65536, \"format\": \"qcow2\", "
+                          "\"actual-size\": %zu, \"dirty-flag\": false, "
+                          "\"backing-filename\": \"/var/lib/libvirt/images/base%zu.qcow2\", "
+                          "\"backing-image\": {\"virtual-size\": 21474836480, "
+                          "\"filename\": \"/var/lib/libvirt/images/base%zu.qcow2\", "
+                          "\"format\": \"raw\", \"actual-size\": 21474836480, "
+                          "\"dirty-flag\": false}}, "
+                          "\"iops_wr\": 0, \"ro\": false, "
+                          "\"node-name\": \"#block%03zu\", "
+                          "\"backing_file_depth\": 1, \"drv\": \"qcow2\", "
+                          "\"iops\": 0, \"bps_wr\": 0, \"write_threshold\": 0, "
+                          "\"backing_file\": \"/var/lib/libvirt/images/base%zu.qcow2\", "
+                          "\"encrypted\": false, \"bps\": 0, \"bps_rd\": 0, "
+                          "\"cache\": {\"no-flush\": false, \"direct\": true, "
+                          "\"writeback\": true}, "
+                          "\"file\": \"/var/lib/libvirt/images/disk%zu.qcow2\", "
+                          "\"encryption_key_missing\": false}, "
+                          "\"qdev\": \"/machine/peripheral/virtio-disk%zu/virtio-backend\", "
+                          "\"type\": \"unknown\"}",
+                          i, i, (i + 1) * 196608, i, i, i * 3, i, i, i);
+    }
+    virBufferAddLit(&buf, "]}");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static char *
+testBenchCpusReply(size_t nvcpus)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    size_t i;
+
+    virBufferAddLit(&buf, "{\"return\": [");
+    for (i = 0; i < nvcpus; i++) {
+        if (i)
+            virBufferAddLit(&buf, ", ");
+        virBufferAsprintf(&buf,
+                          "{\"arch\": \"x86\", \"thread-id\": %zu, "
+                          "\"props\": {\"core-id\": 0, \"thread-id\": 0, "
+                          "\"socket-id\": %zu}, "
+                          "\"qom-path\": \"/machine/unattached/device[%zu]\", "
+                          "\"cpu-index\": %zu, \"target\": \"x86_64\"}",
+                          10000 + i, i, i, i);
+    }
+    virBufferAddLit(&buf, "]}");
+
+    if (virBufferCheckError(&buf) < 0)
+        return NULL;
+
+    return virBufferContentAndReset(&buf);
+}
+
+
+static int
+testBenchOpStats(qemuMonitorTestPtr test)
+{
+    qemuMonitorPtr mon = qemuMonitorTestGetMonitor(test);
+    qemuMonitorCPUInfoPtr vcpus = NULL;
+    virHashTablePtr stats = NULL;
+    int ret = -1;
+
+    /* the monitor calls done by qemuConnectGetAllDomainStats for the
+     * block and vcpu groups */
+    virObjectLock(mon);
+    if (qemuMonitorGetAllBlockStatsInfo(mon, &stats, true) < 0 ||
+        qemuMonitorBlockStatsUpdateCapacity(mon, stats, true) < 0 ||
+        qemuMonitorGetCPUInfo(mon, &vcpus, benchVcpus, false, true) < 0)
+        goto cleanup;
+
+    if (virHashSize(stats) < (ssize_t) benchDisks) {
+        VIR_TEST_VERBOSE("\ngot stats for %zd disks, expected %u",
+                         virHashSize(stats), benchDisks);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(mon);
+    virHashFree(stats);
+    qemuMonitorCPUInfoFree(vcpus, benchVcpus);
+    return ret;
+}
+
+
+/* Replies and events are delivered in order, so once query-status
+ * returns the whole storm was processed by the monitor. */
+static int
+testBenchOpEvents(qemuMonitorTestPtr test)
+{
+    qemuMonitorPtr mon = qemuMonitorTestGetMonitor(test);
+    bool running;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < benchEvents; i++) {
+        if (qemuMonitorTestEmitEvent(test,
+                                     stormEvents[i % ARRAY_CARDINALITY(stormEvents)]) < 0)
+            return -1;
+    }
+
+    virObjectLock(mon);
+    if (qemuMonitorGetStatus(mon, &running, NULL) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnlock(mon);
+    return ret;
+}
+
+
+static qemuMonitorTestPtr
+testBenchConnect(void)
+{
+    qemuMonitorTestPtr test;
+    qemuMonitorPtr mon;
+    bool running;
+
+    if (!(test = qemuMonitorTestNew(true, driver.xmlopt, NULL, &driver,
+                                    NULL, NULL)))
+        return NULL;
+
+    if (qemuMonitorTestSetReply(test, "qmp_capabilities",
+                                "{\"return\": {}}") < 0 ||
+        qemuMonitorTestSetReply(test, "query-status",
+                                "{\"return\": {\"status\": \"running\", "
+                                "\"singlestep\": false, "
+                                "\"running\": true}}") < 0 ||
+        qemuMonitorTestSetReply(test, "query-blockstats",
+                                replyBlockstats) < 0 ||
+        qemuMonitorTestSetReply(test, "query-block", replyBlock) < 0 ||
+        qemuMonitorTestSetReply(test, "query-cpus-fast", replyCpus) < 0)
+        goto error;
+
+    /* roughly what qemuProcessReconnect does with the monitor before
+     * querying the domain state in detail */
+    mon = qemuMonitorTestGetMonitor(test);
+    if (qemuMonitorSetCapabilities(mon) < 0 ||
+        qemuMonitorGetStatus(mon, &running, NULL) < 0)
+        goto error;
+
+    /* from now on callers lock the monitor around each call, just like
+     * qemuDomainObjEnterMonitor does */
+    virObjectUnlock(mon);
+    return test;
+
+ error:
+    qemuMonitorTestFree(test);
+    return NULL;
+}
+
+
+static void
+testBenchWorkerConnect(void *opaque)
+{
+    testBenchWorkerPtr worker = opaque;
+    unsigned long long start;
+    size_t i;
+
+    for (i = 0; i < worker->ntests; i++) {
+        start = testBenchNowMicros();
+        if (!(worker->tests[i] = testBenchConnect()))
+            goto error;
+        worker->lat[worker->nlat++] = testBenchNowMicros() - start;
+    }
+
+    return;
+
+ error:
+    VIR_TEST_DEBUG("worker %zu failed to connect: %s", worker->id,
+                   virGetLastErrorMessage());
+    worker->failed = true;
+}
+
+
+static void
+testBenchWorkerRun(void *opaque)
+{
+    testBenchWorkerPtr worker = opaque;
+    qemuMonitorTestPtr test;
+    unsigned long long start;
+    unsigned long long end;
+
+    do {
+        if (VIR_RESIZE_N(worker->lat, worker->nlat_max, worker->nlat, 1) < 0)
+            goto error;
+
+        test = worker->tests[worker->next++ % worker->ntests];
+
+        start = testBenchNowMicros();
+        if (worker->op(test) < 0)
+            goto error;
+        end = testBenchNowMicros();
+
+        worker->lat[worker->nlat++] = end - start;
+    } while (end / 1000 < worker->deadline);
+
+    return;
+
+ error:
+    VIR_TEST_DEBUG("worker %zu failed: %s", worker->id,
+                   virGetLastErrorMessage());
+    worker->failed = true;
+}
+
+
+static void
+testBenchReport(const char *name,
+                unsigned long long *lat,
+                size_t nlat,
+                size_t events,
+                unsigned long long micros,
+                int allocs)
+{
+    double secs = micros / 1000000.0;
+
+    qsort(lat, nlat, sizeof(*lat), testBenchCompareLat);
+
+    VIR_TEST_VERBOSE("\n%s: %u monitors, %zu threads, %.1f ops/s, "
+                     "p50 %llu us, p99 %llu us, max %llu us",
+                     name, benchMonitors, nworkers, nlat / secs,
+                     lat[nlat / 2], lat[nlat * 99 / 100], lat[nlat - 1]);
+    if (events)
+        VIR_TEST_VERBOSE(", %.1f events/s", nlat * events / secs);
+    /* the counter is not thread safe, so it is a lower bound only once
+     * there's more than one thread */
+    if (allocs >= 0)
+        VIR_TEST_VERBOSE(", %.1f allocs/op", (double) allocs / nlat);
+}
+
+
+static int
+testBenchCollect(const char *name,
+                 size_t events,
+                 unsigned long long micros,
+                 int allocs)
+{
+    unsigned long long *lat = NULL;
+    size_t nlat = 0;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nworkers; i++) {
+        if (workers[i].failed)
+            goto cleanup;
+        if (VIR_EXPAND_N(lat, nlat, workers[i].nlat) < 0)
+            goto cleanup;
+        memcpy(lat + nlat - workers[i].nlat, workers[i].lat,
+               sizeof(*lat) * workers[i].nlat);
+        workers[i].nlat = 0;
+    }
+
+    if (virTestGetPerf())
+        testBenchReport(name, lat, nlat, events, micros, allocs);
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(lat);
+    return ret;
+}
+
+
+static int
+testBenchRunThreads(virThreadFunc func)
+{
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    for (i = 0; i < nworkers; i++) {
+        if (virThreadCreate(&workers[i].thread, true,
+                            func, &workers[i]) < 0)
+            goto cleanup;
+        nstarted++;
+    }
+
+    ret = 0;
+
+ cleanup:
+    for (i = 0; i < nstarted; i++)
+        virThreadJoin(&workers[i].thread);
+    return ret;
+}
+
+
+/* Connecting all the monitors is what the driver does on startup, when
+ * it reconnects to the running domains in parallel. */
+static int
+testBenchReconnect(const void *opaque ATTRIBUTE_UNUSED)
+{
+    unsigned long long start;
+    size_t i;
+    int allocs = -1;
+
+    for (i = 0; i < nworkers; i++) {
+        workers[i].ntests = benchMonitors / nworkers +
+                            (i < benchMonitors % nworkers);
+        if (VIR_ALLOC_N(workers[i].tests, workers[i].ntests) < 0 ||
+            VIR_RESIZE_N(workers[i].lat, workers[i].nlat_max, 0,
+                         workers[i].ntests) < 0)
+            return -1;
+    }
+
+#ifdef TEST_OOM
+    virAllocTestInit();
+#endif
+
+    start = testBenchNowMicros();
+    if (testBenchRunThreads(testBenchWorkerConnect) < 0)
+        return -1;
+
+#ifdef TEST_OOM
+    allocs = virAllocTestCount();
+#endif
+
+    return testBenchCollect("reconnect", 0, testBenchNowMicros() - start,
+                            allocs);
+}
+
+
+static int
+testBenchRunWorkload(const void *opaque)
+{
+    const testBenchWorkload *workload = opaque;
+    unsigned long long start;
+    unsigned long long end;
+    size_t i;
+    int allocs = -1;
+
+    /* without VIR_TEST_PERF make sure the workload works at all */
+    if (!virTestGetPerf()) {
+        for (i = 0; i < nworkers; i++) {
+            if (workers[i].ntests > 0 &&
+                workload->op(workers[i].tests[0]) < 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    for (i = 0; i < nworkers; i++) {
+        workers[i].op = workload->op;
+        workers[i].next = 0;
+    }
+
+#ifdef TEST_OOM
+    virAllocTestInit();
+#endif
+
+    start = testBenchNowMicros();
+    for (i = 0; i < nworkers; i++)
+        workers[i].deadline = start / 1000 + benchMillis;
+
+    if (testBenchRunThreads(testBenchWorkerRun) < 0)
+        return -1;
+    end = testBenchNowMicros();
+
+#ifdef TEST_OOM
+    allocs = virAllocTestCount();
+#endif
+
+    return testBenchCollect(workload->name,
+                            workload->events ? *workload->events : 0,
+                            end - start, allocs);
+}
+
+
+static void
+testBenchEventTimer(int timer ATTRIBUTE_UNUSED,
+                    void *opaque ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+testBenchEventLoop(void *opaque ATTRIBUTE_UNUSED)
+{
+    while (!virAtomicIntGet(&eventQuit)) {
+        if (virEventRunDefaultImpl() < 0)
+            break;
+    }
+}
+
+
+static void
+testBenchCleanup(void)
+{
+    qemuMonitorTestPtr test;
+    size_t i;
+    size_t j;
+
+    /* the monitors can only go away once nobody dispatches their events */
+    if (eventTimer != -1) {
+        virAtomicIntSet(&eventQuit, 1);
+        virThreadJoin(&eventThread);
+        virEventRemoveTimeout(eventTimer);
+    }
+
+    for (i = 0; i < nworkers; i++) {
+        for (j = 0; j < workers[i].ntests; j++) {
+            if (!(test = workers[i].tests[j]))
+                continue;
+            /* qemuMonitorTestFree expects the monitor to be locked */
+            virObjectLock(qemuMonitorTestGetMonitor(test));
+            qemuMonitorTestFree(test);
+        }
+        VIR_FREE(workers[i].tests);
+        VIR_FREE(workers[i].lat);
+    }
+    VIR_FREE(workers);
+}
+
+
+static int
+mymain(void)
+{
+    size_t events;
+    const testBenchWorkload workloads[] = {
+        { "domain-stats", testBenchOpStats, NULL },
+        { "event-storm", testBenchOpEvents, &events },
+    };
+    size_t i;
+    int ret = 0;
+
+#if !WITH_YAJL
+    fputs("libvirt not compiled with JSON support, skipping this test\n", stderr);
+    return EXIT_AM_SKIP;
+#endif
+
+    benchThreads = testBenchGetEnv("VIR_BENCH_THREADS", BENCH_THREADS);
+    benchMillis = testBenchGetEnv("VIR_BENCH_MILLIS", BENCH_MILLIS);
+    benchDisks = testBenchGetEnv("VIR_BENCH_DISKS", BENCH_DISKS);
+    benchVcpus = testBenchGetEnv("VIR_BENCH_VCPUS", BENCH_VCPUS);
+    benchEvents = testBenchGetEnv("VIR_BENCH_EVENTS", BENCH_EVENTS);
+    if (virTestGetPerf())
+        benchMonitors = testBenchGetEnv("VIR_BENCH_MONITORS", BENCH_MONITORS);
+    else
+        benchMonitors = BENCH_SMOKE_MONITORS;
+    events = benchEvents;
+
+    nworkers = MIN(benchThreads, benchMonitors);
+
+    if (virThreadInitialize() < 0 ||
+        qemuTestDriverInit(&driver) < 0)
+        return EXIT_FAILURE;
+
+    virEventRegisterDefaultImpl();
+    qemuMonitorTestSetSharedEventLoop(true);
+
+    if (!(replyBlockstats = testBenchBlockstatsReply(benchDisks)) ||
+        !(replyBlock = testBenchBlockReply(benchDisks)) ||
+        !(replyCpus = testBenchCpusReply(benchVcpus)) ||
+        VIR_ALLOC_N(workers, nworkers) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < nworkers; i++)
+        workers[i].id = i;
+
+    if ((eventTimer = virEventAddTimeout(100, testBenchEventTimer,
+                                         NULL, NULL)) < 0 ||
+        virThreadCreate(&eventThread, true, testBenchEventLoop, NULL) < 0) {
+        if (eventTimer != -1)
+            virEventRemoveTimeout(eventTimer);
+        eventTimer = -1;
+        ret = -1;
+        goto cleanup;
+    }
+
+    if (virTestRun("reconnect", testBenchReconnect, NULL) < 0) {
+        ret = -1;
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(workloads); i++) {
+        if (virTestRun(workloads[i].name, testBenchRunWorkload,
+                       &workloads[i]) < 0)
+            ret = -1;
+    }
+
+ cleanup:
+    testBenchCleanup();
+    VIR_FREE(replyBlockstats);
+    VIR_FREE(replyBlock);
+    VIR_FREE(replyCpus);
+    qemuTestDriverFree(&driver);
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
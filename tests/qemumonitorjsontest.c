@@ -1858,6 +1858,146 @@ testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsInfo(const void *data)
 }
 
 
+static int
+testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsCapacity(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    virHashTablePtr blockstats = NULL;
+    qemuBlockStatsPtr stats;
+    int ret = -1;
+
+    if (!test)
+        return -1;
+
+    if (!(blockstats = virHashCreate(10, virHashValueFree)))
+        goto cleanup;
+
+    /* both commands are sent before the first reply is read */
+    if (qemuMonitorTestAddItem(test, "query-blockstats",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"device\": \"drive-virtio-disk0\","
+                               "            \"stats\": {"
+                               "                \"wr_bytes\": 2845696,"
+                               "                \"rd_bytes\": 28505088"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-block",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"device\": \"drive-virtio-disk0\","
+                               "            \"inserted\": {"
+                               "                \"image\": {"
+                               "                    \"virtual-size\": 10737418240,"
+                               "                    \"actual-size\": 5368709120"
+                               "                }"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorTestGetMonitor(test),
+                                                blockstats, false, false) < 0)
+        goto cleanup;
+
+    if (!(stats = virHashLookup(blockstats, "virtio-disk0"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block stats for device 'virtio-disk0' is missing");
+        goto cleanup;
+    }
+
+    if (stats->rd_bytes != 28505088 || stats->wr_bytes != 2845696 ||
+        stats->capacity != 10737418240ULL ||
+        stats->physical != 5368709120ULL) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unexpected stats: rd_bytes=%lld wr_bytes=%lld "
+                       "capacity=%llu physical=%llu",
+                       stats->rd_bytes, stats->wr_bytes,
+                       stats->capacity, stats->physical);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorTestFree(test);
+    virHashFree(blockstats);
+    return ret;
+}
+
+
+static int
+testQemuMonitorJSONqemuMonitorJSONGetAllBlockStatsCapacityError(const void *data)
+{
+    virDomainXMLOptionPtr xmlopt = (virDomainXMLOptionPtr)data;
+    qemuMonitorTestPtr test = qemuMonitorTestNewSimple(true, xmlopt);
+    virHashTablePtr blockstats = NULL;
+    qemuBlockStatsPtr stats;
+    int ret = -1;
+
+    if (!test)
+        return -1;
+
+    if (!(blockstats = virHashCreate(10, virHashValueFree)))
+        goto cleanup;
+
+    /* a failed 'query-block' must not drop the I/O stats */
+    if (qemuMonitorTestAddItem(test, "query-blockstats",
+                               "{"
+                               "    \"return\": ["
+                               "        {"
+                               "            \"device\": \"drive-virtio-disk0\","
+                               "            \"stats\": {"
+                               "                \"wr_bytes\": 2845696,"
+                               "                \"rd_bytes\": 28505088"
+                               "            }"
+                               "        }"
+                               "    ]"
+                               "}") < 0 ||
+        qemuMonitorTestAddItem(test, "query-block",
+                               "{"
+                               "    \"error\": {"
+                               "        \"class\": \"GenericError\","
+                               "        \"desc\": \"something went wrong\""
+                               "    }"
+                               "}") < 0)
+        goto cleanup;
+
+    if (qemuMonitorJSONGetAllBlockStatsCapacity(qemuMonitorTestGetMonitor(test),
+                                                blockstats, false, false) < 0)
+        goto cleanup;
+
+    if (!(stats = virHashLookup(blockstats, "virtio-disk0"))) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "block stats for device 'virtio-disk0' is missing");
+        goto cleanup;
+    }
+
+    if (stats->rd_bytes != 28505088 || stats->wr_bytes != 2845696 ||
+        stats->capacity != 0 || stats->physical != 0) {
+        virReportError(VIR_ERR_INTERNAL_ERROR,
+                       "unexpected stats: rd_bytes=%lld wr_bytes=%lld "
+                       "capacity=%llu physical=%llu",
+                       stats->rd_bytes, stats->wr_bytes,
+                       stats->capacity, stats->physical);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    qemuMonitorTestFree(test);
+    virHashFree(blockstats);
+    return ret;
+}
+
+
 static int
 testQemuMonitorJSONqemuMonitorJSONGetMigrationCacheSize(const void *data)
 {
@@ -3008,6 +3148,8 @@ mymain(void)
     DO_TEST(qemuMonitorJSONGetBalloonInfo);
     DO_TEST(qemuMonitorJSONGetBlockInfo);
     DO_TEST(qemuMonitorJSONGetAllBlockStatsInfo);
+    DO_TEST(qemuMonitorJSONGetAllBlockStatsCapacity);
+    DO_TEST(qemuMonitorJSONGetAllBlockStatsCapacityError);
     DO_TEST(qemuMonitorJSONGetMigrationCacheSize);
     DO_TEST(qemuMonitorJSONGetMigrationStats);
     DO_TEST(qemuMonitorJSONGetChardevInfo);
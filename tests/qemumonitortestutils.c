@@ -76,8 +76,13 @@ struct _qemuMonitorTest {
 
     virDomainObjPtr vm;
     virHashTablePtr qapischema;
+
+    /* canned replies used once @items are exhausted */
+    virHashTablePtr replies;
 };
 
+static bool qemuMonitorTestSharedLoop;
+
 
 static void
 qemuMonitorTestItemFree(qemuMonitorTestItemPtr item)
@@ -244,6 +249,34 @@ qemuMonitorReportError(qemuMonitorTestPtr test, const char *errmsg, ...)
 }
 
 
+static int
+qemuMonitorTestProcessCommandReply(qemuMonitorTestPtr test,
+                                   const char *cmdstr)
+{
+    virJSONValuePtr val = NULL;
+    const char *cmdname;
+    const char *reply;
+    int ret = -1;
+
+    if (!(val = virJSONValueFromString(cmdstr)))
+        return -1;
+
+    if (!(cmdname = virJSONValueObjectGetString(val, "execute"))) {
+        ret = qemuMonitorReportError(test, "Missing command name in %s", cmdstr);
+        goto cleanup;
+    }
+
+    if ((reply = virHashLookup(test->replies, cmdname)))
+        ret = qemuMonitorTestAddResponse(test, reply);
+    else
+        ret = qemuMonitorTestAddUnexpectedErrorResponse(test, cmdstr);
+
+ cleanup:
+    virJSONValueFree(val);
+    return ret;
+}
+
+
 static int
 qemuMonitorTestProcessCommand(qemuMonitorTestPtr test,
                               const char *cmdstr)
@@ -253,6 +286,8 @@ qemuMonitorTestProcessCommand(qemuMonitorTestPtr test,
     VIR_DEBUG("Processing string from monitor handler: '%s", cmdstr);
 
     if (test->nitems == 0) {
+        if (test->replies && test->json)
+            return qemuMonitorTestProcessCommandReply(test, cmdstr);
         return qemuMonitorTestAddUnexpectedErrorResponse(test, cmdstr);
     } else {
         qemuMonitorTestItemPtr item = test->items[0];
@@ -449,6 +484,7 @@ qemuMonitorTestFree(qemuMonitorTestPtr test)
     for (i = 0; i < test->nitems; i++)
         qemuMonitorTestItemFree(test->items[i]);
     VIR_FREE(test->items);
+    virHashFree(test->replies);
 
     if (test->tmpdir && rmdir(test->tmpdir) < 0)
         VIR_WARN("Failed to remove tempdir: %s", strerror(errno));
@@ -498,6 +534,106 @@ qemuMonitorTestItemGetPrivateData(qemuMonitorTestItemPtr item)
 }
 
 
+/**
+ * qemuMonitorTestSetReply:
+ * @test: test monitor object
+ * @command_name: name of the QMP command
+ * @response: reply to send
+ *
+ * Unlike the items added by qemuMonitorTestAddItem and friends, which are
+ * consumed in order, @response is sent back every time @command_name is
+ * issued once there are no more items queued. This allows a test monitor
+ * to serve an arbitrary number of commands, e.g. when generating load.
+ * A later call for the same @command_name replaces the reply.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorTestSetReply(qemuMonitorTestPtr test,
+                        const char *command_name,
+                        const char *response)
+{
+    char *copy = NULL;
+    int ret = -1;
+
+    if (VIR_STRDUP(copy, response) < 0)
+        return -1;
+
+    virMutexLock(&test->lock);
+
+    if (!test->replies &&
+        !(test->replies = virHashCreate(10, virHashValueFree)))
+        goto cleanup;
+
+    if (virHashUpdateEntry(test->replies, command_name, copy) < 0)
+        goto cleanup;
+    copy = NULL;
+
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&test->lock);
+    VIR_FREE(copy);
+    return ret;
+}
+
+
+/**
+ * qemuMonitorTestEmitEvent:
+ * @test: test monitor object
+ * @event: JSON formatted QMP event
+ *
+ * Queues @event to be sent to the monitor client right away, independently
+ * of any command being processed.
+ *
+ * Returns 0 on success, -1 on error.
+ */
+int
+qemuMonitorTestEmitEvent(qemuMonitorTestPtr test,
+                         const char *event)
+{
+    int ret = -1;
+
+    virMutexLock(&test->lock);
+
+    if (!test->client) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "test monitor is not connected");
+        goto cleanup;
+    }
+
+    if (qemuMonitorTestAddResponse(test, event) < 0)
+        goto cleanup;
+
+    virNetSocketUpdateIOCallback(test->client,
+                                 VIR_EVENT_HANDLE_READABLE |
+                                 VIR_EVENT_HANDLE_WRITABLE);
+    ret = 0;
+
+ cleanup:
+    virMutexUnlock(&test->lock);
+    return ret;
+}
+
+
+/**
+ * qemuMonitorTestSetSharedEventLoop:
+ * @shared: whether to share the event loop
+ *
+ * Every test monitor normally spawns a thread iterating the default event
+ * loop, which is fine as long as there's just one monitor at a time. As the
+ * loop can't be iterated from multiple threads at once, callers creating
+ * many monitors (e.g. load generators) have to enable @shared and run the
+ * event loop themselves. Monitors created in that mode must only be freed
+ * once the loop no longer runs.
+ */
+void
+qemuMonitorTestSetSharedEventLoop(bool shared)
+{
+    qemuMonitorTestSharedLoop = shared;
+}
+
+
 typedef struct _qemuMonitorTestCommandArgs qemuMonitorTestCommandArgs;
 typedef qemuMonitorTestCommandArgs *qemuMonitorTestCommandArgsPtr;
 struct _qemuMonitorTestCommandArgs {
@@ -1195,6 +1331,9 @@ qemuMonitorCommonTestInit(qemuMonitorTestPtr test)
                                   NULL) < 0)
         goto error;
 
+    if (qemuMonitorTestSharedLoop)
+        return 0;
+
     virMutexLock(&test->lock);
     if (virThreadCreate(&test->thread,
                         true,
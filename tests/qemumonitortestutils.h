@@ -67,6 +67,15 @@ int qemuMonitorTestAddItemParams(qemuMonitorTestPtr test,
                                  ...)
     ATTRIBUTE_SENTINEL;
 
+int qemuMonitorTestSetReply(qemuMonitorTestPtr test,
+                            const char *command_name,
+                            const char *response);
+
+int qemuMonitorTestEmitEvent(qemuMonitorTestPtr test,
+                             const char *event);
+
+void qemuMonitorTestSetSharedEventLoop(bool shared);
+
 int qemuMonitorTestAddItemExpect(qemuMonitorTestPtr test,
                                  const char *cmdname,
                                  const char *cmdargs,
@@ -1719,6 +1719,8 @@ mymain(void)
     DO_TEST("iothreads-ids-partial", QEMU_CAPS_OBJECT_IOTHREAD);
     DO_TEST_FAILURE("iothreads-nocap", NONE);
     DO_TEST("iothreads-disk", QEMU_CAPS_OBJECT_IOTHREAD);
+    DO_TEST("iothreads-disk-auto", QEMU_CAPS_OBJECT_IOTHREAD,
+            QEMU_CAPS_VIRTIO_BLK_NUM_QUEUES);
     DO_TEST("iothreads-disk-virtio-ccw", QEMU_CAPS_OBJECT_IOTHREAD,
             QEMU_CAPS_CCW, QEMU_CAPS_VIRTIO_S390);
     DO_TEST("iothreads-virtio-scsi-pci", QEMU_CAPS_VIRTIO_SCSI,
@@ -2948,6 +2950,10 @@ mymain(void)
             QEMU_CAPS_KVM);
     DO_TEST("fd-memory-numa-topology3", QEMU_CAPS_OBJECT_MEMORY_FILE,
             QEMU_CAPS_KVM);
+    DO_TEST("fd-memory-numa-prealloc-threads", QEMU_CAPS_OBJECT_MEMORY_FILE,
+            QEMU_CAPS_OBJECT_MEMORY_PREALLOC_THREADS, QEMU_CAPS_KVM);
+    DO_TEST_FAILURE("fd-memory-numa-prealloc-threads",
+                    QEMU_CAPS_OBJECT_MEMORY_FILE, QEMU_CAPS_KVM);
 
     DO_TEST("fd-memory-no-numa-topology", QEMU_CAPS_OBJECT_MEMORY_FILE,
             QEMU_CAPS_KVM);
@@ -478,6 +478,7 @@ mymain(void)
     DO_TEST("cputune-iothreadsched", NONE);
     DO_TEST("cputune-iothreadsched-zeropriority", NONE);
     DO_TEST("cputune-numatune", NONE);
+    DO_TEST("cputune-profile-dedicated", NONE);
     DO_TEST("vcpu-placement-static",
             QEMU_CAPS_KVM,
             QEMU_CAPS_OBJECT_IOTHREAD);
@@ -488,6 +489,8 @@ mymain(void)
     DO_TEST("iothreads-ids-partial", NONE);
     DO_TEST("cputune-iothreads", NONE);
     DO_TEST("iothreads-disk", NONE);
+    DO_TEST("iothreads-disk-auto", QEMU_CAPS_OBJECT_IOTHREAD,
+            QEMU_CAPS_VIRTIO_BLK_NUM_QUEUES);
     DO_TEST("iothreads-disk-virtio-ccw",
             QEMU_CAPS_CCW, QEMU_CAPS_VIRTIO_S390);
     DO_TEST("iothreads-virtio-scsi-pci",
@@ -1224,6 +1227,7 @@ mymain(void)
     DO_TEST_STATUS("migration-out-params");
     DO_TEST_STATUS("migration-out-nbd-tls");
     DO_TEST_STATUS("disk-secinfo-upgrade");
+    DO_TEST_STATUS("journal");
 
     DO_TEST("vhost-vsock", QEMU_CAPS_DEVICE_VHOST_VSOCK);
     DO_TEST("vhost-vsock-auto", QEMU_CAPS_DEVICE_VHOST_VSOCK);
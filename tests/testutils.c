@@ -61,6 +61,7 @@ VIR_LOG_INIT("tests.testutils");
 static unsigned int testDebug = -1;
 static unsigned int testVerbose = -1;
 static unsigned int testExpensive = -1;
+static unsigned int testPerf = -1;
 static unsigned int testRegenerate = -1;
 
 #ifdef TEST_OOM
@@ -946,6 +947,14 @@ virTestGetExpensive(void)
     return testExpensive;
 }
 
+unsigned int
+virTestGetPerf(void)
+{
+    if (testPerf == -1)
+        testPerf = virTestGetFlag("VIR_TEST_PERF");
+    return testPerf;
+}
+
 unsigned int
 virTestGetRegenerate(void)
 {
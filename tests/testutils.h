@@ -88,6 +88,7 @@ int virTestCompareToULL(unsigned long long content,
 unsigned int virTestGetDebug(void);
 unsigned int virTestGetVerbose(void);
 unsigned int virTestGetExpensive(void);
+unsigned int virTestGetPerf(void);
 unsigned int virTestGetRegenerate(void);
 
 # define VIR_TEST_DEBUG(...) \
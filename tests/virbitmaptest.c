@@ -25,6 +25,10 @@
 #include "testutils.h"
 
 #include "virbitmap.h"
+#include "virstring.h"
+#include "virtime.h"
+
+#define BENCH_MIN_MILLIS 1000
 
 static int
 test1(const void *data ATTRIBUTE_UNUSED)
@@ -741,6 +745,173 @@ test14(const void *opaque)
 }
 
 
+/* ranges crossing unit boundaries survive parsing and formatting */
+static int
+test15(const void *opaque)
+{
+    const char *str = opaque;
+    virBitmapPtr map = NULL;
+    virBitmapPtr unlimited = NULL;
+    char *formatted = NULL;
+    int ret = -1;
+
+    if (virBitmapParse(str, &map, 1024) < 0 ||
+        !(unlimited = virBitmapParseUnlimited(str)))
+        goto cleanup;
+
+    if (!(formatted = virBitmapFormat(map)))
+        goto cleanup;
+
+    if (STRNEQ(formatted, str)) {
+        fprintf(stderr, "\n expected bitmap '%s', got '%s'\n",
+                str, formatted);
+        goto cleanup;
+    }
+    VIR_FREE(formatted);
+
+    if (!(formatted = virBitmapFormat(unlimited)))
+        goto cleanup;
+
+    if (STRNEQ(formatted, str)) {
+        fprintf(stderr, "\n expected unlimited bitmap '%s', got '%s'\n",
+                str, formatted);
+        goto cleanup;
+    }
+
+    if (virBitmapLastSetBit(map) != virBitmapSize(unlimited) - 1) {
+        fprintf(stderr, "\n last set bit of '%s' is %zd\n",
+                str, virBitmapLastSetBit(map));
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(map);
+    virBitmapFree(unlimited);
+    VIR_FREE(formatted);
+    return ret;
+}
+
+
+typedef struct {
+    const char *name;
+    size_t size;
+    size_t stride; /* a run of set bits starts every @stride bits */
+    size_t run;
+} testBitmapBenchData;
+
+typedef int (*testBitmapBenchFunc)(virBitmapPtr map, virBitmapPtr other);
+
+static int
+testBitmapBenchFormatParse(virBitmapPtr map,
+                           virBitmapPtr other ATTRIBUTE_UNUSED)
+{
+    char *str;
+    virBitmapPtr parsed = NULL;
+    int ret;
+
+    if (!(str = virBitmapFormat(map)))
+        return -1;
+
+    ret = virBitmapParse(str, &parsed, virBitmapSize(map));
+
+    virBitmapFree(parsed);
+    VIR_FREE(str);
+    return ret;
+}
+
+static int
+testBitmapBenchIterate(virBitmapPtr map,
+                       virBitmapPtr other ATTRIBUTE_UNUSED)
+{
+    ssize_t pos = -1;
+    size_t n = 0;
+
+    while ((pos = virBitmapNextSetBit(map, pos)) >= 0)
+        n++;
+
+    return n == virBitmapCountBits(map) ? 0 : -1;
+}
+
+static int
+testBitmapBenchIntersect(virBitmapPtr map,
+                         virBitmapPtr other)
+{
+    virBitmapIntersect(other, map);
+    return virBitmapOverlaps(other, map) ? 0 : -1;
+}
+
+static int
+testBitmapBenchLast(virBitmapPtr map,
+                    virBitmapPtr other ATTRIBUTE_UNUSED)
+{
+    return virBitmapLastSetBit(map) >= 0 ? 0 : -1;
+}
+
+static int
+testBitmapBench(const void *opaque)
+{
+    const testBitmapBenchData *data = opaque;
+    struct {
+        const char *name;
+        testBitmapBenchFunc func;
+    } ops[] = {
+        { "format+parse", testBitmapBenchFormatParse },
+        { "iterate", testBitmapBenchIterate },
+        { "intersect", testBitmapBenchIntersect },
+        { "last-set-bit", testBitmapBenchLast },
+    };
+    virBitmapPtr map = NULL;
+    virBitmapPtr other = NULL;
+    unsigned long long start;
+    unsigned long long now;
+    size_t count;
+    size_t i;
+    size_t j;
+    int ret = -1;
+
+    if (!virTestGetPerf())
+        return EXIT_AM_SKIP;
+
+    if (!(map = virBitmapNew(data->size)))
+        goto cleanup;
+
+    for (i = 0; i < data->size; i += data->stride) {
+        for (j = i; j < i + data->run && j < data->size; j++)
+            ignore_value(virBitmapSetBit(map, j));
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(ops); i++) {
+        count = 0;
+
+        if (virTimeMillisNow(&start) < 0)
+            goto cleanup;
+
+        do {
+            virBitmapFree(other);
+            if (!(other = virBitmapNewCopy(map)) ||
+                ops[i].func(map, other) < 0)
+                goto cleanup;
+            count++;
+
+            if (virTimeMillisNow(&now) < 0)
+                goto cleanup;
+        } while (now - start < BENCH_MIN_MILLIS);
+
+        VIR_TEST_VERBOSE("\n%s %s: %.1f ops/s", data->name, ops[i].name,
+                         count * 1000.0 / (now - start));
+    }
+
+    ret = 0;
+
+ cleanup:
+    virBitmapFree(map);
+    virBitmapFree(other);
+    return ret;
+}
+
+
 #define TESTBINARYOP(A, B, RES, FUNC) \
     testBinaryOpData.a = A; \
     testBinaryOpData.b = B; \
@@ -798,6 +969,29 @@ mymain(void)
     TESTBINARYOP("0-3", "0,^0", "0-3", test14);
     TESTBINARYOP("0,2", "1,3", "0,2", test14);
 
+    virTestCounterReset("test15-");
+    if (virTestRun(virTestCounterNext(), test15, "5") < 0)
+        ret = -1;
+    if (virTestRun(virTestCounterNext(), test15, "0-63") < 0)
+        ret = -1;
+    if (virTestRun(virTestCounterNext(), test15, "3-70,128-191,200") < 0)
+        ret = -1;
+    if (virTestRun(virTestCounterNext(), test15, "1,3,5-6,100-1023") < 0)
+        ret = -1;
+
+#define TESTBENCH(NAME, SIZE, STRIDE, RUN) \
+    do { \
+        testBitmapBenchData benchData = { NAME, SIZE, STRIDE, RUN }; \
+        if (virTestRun("bench " NAME, testBitmapBench, &benchData) < 0) \
+            ret = -1; \
+    } while (0)
+
+    /* a 4096 CPU host with a few pinned CPUs, NUMA node like blocks
+     * and the port allocator range */
+    TESTBENCH("cpus-sparse", 4096, 512, 1);
+    TESTBENCH("cpus-blocks", 4096, 256, 64);
+    TESTBENCH("ports", 65536, 1000, 3);
+
     return ret;
 }
 
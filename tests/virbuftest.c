@@ -505,6 +505,11 @@ mymain(void)
                    "<c>\n  <el>,,&apos;..&apos;,,</el>\n</c>");
     DO_TEST_ESCAPE("\x01\x01\x02\x03\x05\x08",
                    "<c>\n  <el></el>\n</c>");
+    DO_TEST_ESCAPE("", "<c>\n  <el></el>\n</c>");
+    DO_TEST_ESCAPE("plain\ttext\n",
+                   "<c>\n  <el>plain\ttext\n</el>\n</c>");
+    DO_TEST_ESCAPE("a<b\x02c",
+                   "<c>\n  <el>a&lt;bc</el>\n</c>");
 
 #define DO_TEST_ESCAPEN(data, expect) \
     do { \
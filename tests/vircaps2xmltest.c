@@ -25,6 +25,7 @@
 #include "capabilities.h"
 #include "virbitmap.h"
 #include "virfilewrapper.h"
+#include "virhostcpu.h"
 
 
 #define VIR_FROM_THIS VIR_FROM_NONE
@@ -56,6 +57,8 @@ test_virCapabilities(const void *opaque)
                     abs_srcdir, data->filename) < 0)
         goto cleanup;
 
+    /* Each test case uses a different fake sysfs */
+    virHostCPUInvalidateTopologyCache();
     virFileWrapperAddPrefix("/sys/devices/system", system);
     virFileWrapperAddPrefix("/sys/fs/resctrl", resctrl);
     caps = virCapabilitiesNew(data->arch, data->offlineMigrate, data->liveMigrate);
@@ -68,6 +71,7 @@ test_virCapabilities(const void *opaque)
         goto cleanup;
 
     virFileWrapperClearPrefixes();
+    virHostCPUInvalidateTopologyCache();
 
     if (!(capsXML = virCapabilitiesFormatXML(caps)))
         goto cleanup;
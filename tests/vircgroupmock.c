@@ -271,6 +271,9 @@ static int make_controller_v2(const char *path, mode_t mode)
     MAKE_FILE("memory.current", "1455321088\n");
     MAKE_FILE("memory.high", "max\n");
     MAKE_FILE("memory.max", "max\n");
+    MAKE_FILE("memory.pressure",
+              "some avg10=1.50 avg60=0.75 avg300=0.25 total=123456\n"
+              "full avg10=0.50 avg60=0.25 avg300=0.10 total=6543\n");
     MAKE_FILE("memory.stat",
               "anon 0\n"
               "file 0\n"
@@ -604,6 +604,50 @@ static int testCgroupNewForSelfUnified(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+static int testCgroupGetPressure(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupPressure pressure;
+    int rv;
+    int ret = -1;
+
+    if (virCgroupNewSelf(&cgroup) < 0) {
+        fprintf(stderr, "Cannot create cgroup for self\n");
+        goto cleanup;
+    }
+
+    if ((rv = virCgroupGetPressure(cgroup, VIR_CGROUP_PRESSURE_MEMORY,
+                                   &pressure)) != 0) {
+        fprintf(stderr, "Could not retrieve memory pressure: %d\n", rv);
+        goto cleanup;
+    }
+
+    if (pressure.some.avg10 != 1.5 ||
+        pressure.some.avg60 != 0.75 ||
+        pressure.some.avg300 != 0.25 ||
+        pressure.some.total != 123456 ||
+        !pressure.hasFull ||
+        pressure.full.avg10 != 0.5 ||
+        pressure.full.total != 6543) {
+        fprintf(stderr, "Wrong memory pressure values\n");
+        goto cleanup;
+    }
+
+    /* no cpu.pressure in the fake cgroup, as without CONFIG_PSI */
+    if ((rv = virCgroupGetPressure(cgroup, VIR_CGROUP_PRESSURE_CPU,
+                                   &pressure)) != 1) {
+        fprintf(stderr, "Unexpected result for missing cpu pressure: %d\n",
+                rv);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
+
 static int testCgroupNewForSelfHybrid(const void *args ATTRIBUTE_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -802,6 +846,64 @@ static int testCgroupGetMemoryUsage(const void *args ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testCgroupGetStatsSnapshot(const void *args ATTRIBUTE_UNUSED)
+{
+    virCgroupPtr cgroup = NULL;
+    virCgroupStats stats;
+    unsigned int controllers = (1 << VIR_CGROUP_CONTROLLER_CPUACCT) |
+                               (1 << VIR_CGROUP_CONTROLLER_MEMORY) |
+                               (1 << VIR_CGROUP_CONTROLLER_BLKIO);
+    double scale = 1000000000.0 / sysconf(_SC_CLK_TCK);
+    size_t i;
+    int rv, ret = -1;
+
+    if ((rv = virCgroupNewPartition("/virtualmachines", true,
+                                    controllers, &cgroup)) < 0) {
+        fprintf(stderr, "Could not create /virtualmachines cgroup: %d\n", -rv);
+        goto cleanup;
+    }
+
+    /* the second sample re-reads the cached file descriptors */
+    for (i = 0; i < 2; i++) {
+        if (virCgroupGetStatsSnapshot(cgroup, controllers, &stats) < 0) {
+            fprintf(stderr, "Could not retrieve stats snapshot for /virtualmachines cgroup\n");
+            goto cleanup;
+        }
+
+        if (stats.controllers != controllers) {
+            fprintf(stderr, "Wrong controllers in stats snapshot: %x\n",
+                    stats.controllers);
+            goto cleanup;
+        }
+
+        if (stats.cpuUsage != 2787788855799582ULL ||
+            stats.cpuUser != (unsigned long long)(216687025 * scale) ||
+            stats.cpuSystem != (unsigned long long)(43421396 * scale)) {
+            fprintf(stderr, "Wrong cpu values in stats snapshot\n");
+            goto cleanup;
+        }
+
+        if (stats.memoryUsage != 1421212UL) {
+            fprintf(stderr, "Wrong memory usage in stats snapshot\n");
+            goto cleanup;
+        }
+
+        if (stats.blkioBytesRead != 119084214273LL ||
+            stats.blkioBytesWrite != 822880960513LL ||
+            stats.blkioRequestsRead != 9665167 ||
+            stats.blkioRequestsWrite != 73283807) {
+            fprintf(stderr, "Wrong blkio values in stats snapshot\n");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+
+ cleanup:
+    virCgroupFree(&cgroup);
+    return ret;
+}
+
 static int testCgroupGetBlkioIoServiced(const void *args ATTRIBUTE_UNUSED)
 {
     virCgroupPtr cgroup = NULL;
@@ -1035,6 +1137,9 @@ mymain(void)
     if (virTestRun("virCgroupGetMemoryUsage works", testCgroupGetMemoryUsage, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("virCgroupGetStatsSnapshot works", testCgroupGetStatsSnapshot, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("virCgroupGetPercpuStats works", testCgroupGetPercpuStats, NULL) < 0)
         ret = -1;
     cleanupFakeFS(fakerootdir);
@@ -1060,6 +1165,8 @@ mymain(void)
         ret = -1;
     if (virTestRun("Cgroup available (unified)", testCgroupAvailable, (void*)0x1) < 0)
         ret = -1;
+    if (virTestRun("virCgroupGetPressure works (unified)", testCgroupGetPressure, NULL) < 0)
+        ret = -1;
     cleanupFakeFS(fakerootdir);
 
     /* cgroup hybrid */
@@ -200,6 +200,80 @@ testFileCache(const void *opaque)
 }
 
 
+static int
+testFileCachePrefetch(const void *opaque)
+{
+    int ret = -1;
+    virFileCachePtr cache = (virFileCachePtr) opaque;
+    testFileCacheObjPtr obj = NULL;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(cache);
+    const char *names[] = { "cachePrefetch1", "cachePrefetch2",
+                            "cachePrefetch1" };
+    size_t i;
+
+    testPriv->dataSaved = false;
+    testPriv->newData = "ddd\n";
+    testPriv->expectData = "ddd\n";
+
+    if (virFileCachePrefetch(cache, names, ARRAY_CARDINALITY(names)) < 0) {
+        fprintf(stderr, "Prefetching data failed.\n");
+        goto cleanup;
+    }
+
+    if (!testPriv->dataSaved) {
+        fprintf(stderr, "Expect prefetched data to be saved.\n");
+        goto cleanup;
+    }
+
+    /* the data has to be cached now, no new data may be created */
+    testPriv->newData = NULL;
+
+    for (i = 0; i < ARRAY_CARDINALITY(names); i++) {
+        if (!(obj = virFileCacheLookup(cache, names[i])) ||
+            !obj->data || STRNEQ(testPriv->expectData, obj->data)) {
+            fprintf(stderr, "Data for '%s' was not prefetched.\n", names[i]);
+            goto cleanup;
+        }
+        virObjectUnref(obj);
+        obj = NULL;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(obj);
+    return ret;
+}
+
+
+static int
+testFileCacheRecent(const void *opaque)
+{
+    int ret = -1;
+    virFileCachePtr cache = (virFileCachePtr) opaque;
+    testFileCacheObjPtr obj = NULL;
+    testFileCachePrivPtr testPriv = virFileCacheGetPriv(cache);
+
+    /* "cacheValid" was validated just now, so it is not checked again
+     * even though the handler would refuse it */
+    testPriv->dataSaved = false;
+    testPriv->newData = "zzz\n";
+    testPriv->expectData = "zzz\n";
+
+    if (!(obj = virFileCacheLookup(cache, "cacheValid")) ||
+        !obj->data || STRNEQ(obj->data, "aaa\n") || testPriv->dataSaved) {
+        fprintf(stderr, "Recently validated data was revalidated.\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(obj);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -225,9 +299,16 @@ mymain(void)
     /* The cache file name is created using:
      * '$ echo -n $TEST_NAME | sha256sum' */
     TEST_RUN("cacheValid", NULL, "aaa\n", false);
+
+    if (virTestRun("cacheRecent", testFileCacheRecent, cache) < 0)
+        ret = -1;
+
     TEST_RUN("cacheInvalid", "bbb\n", "bbb\n", true);
     TEST_RUN("cacheMissing", "ccc\n", "ccc\n", true);
 
+    if (virTestRun("cachePrefetch", testFileCachePrefetch, cache) < 0)
+        ret = -1;
+
     virObjectUnref(cache);
 
     return ret != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
@@ -1123,6 +1123,126 @@ testFirewallQuery(const void *opaque ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static void
+testFirewallBatchHook(const char *const*args ATTRIBUTE_UNUSED,
+                      const char *const*env ATTRIBUTE_UNUSED,
+                      const char *input,
+                      char **output ATTRIBUTE_UNUSED,
+                      char **error ATTRIBUTE_UNUSED,
+                      int *status,
+                      void *opaque)
+{
+    virBufferPtr buf = opaque;
+
+    if (!input)
+        return;
+
+    virBufferAdd(buf, input, -1);
+
+    /* Fake the restore tool rejecting batches with this IP addr */
+    if (strstr(input, "192.168.122.255"))
+        *status = 1;
+}
+
+static int
+testFirewallBatch(const void *opaque)
+{
+    virBuffer cmdbuf = VIR_BUFFER_INITIALIZER;
+    virFirewallPtr fw = NULL;
+    int ret = -1;
+    const char *actual = NULL;
+    const char *expected =
+        IPTABLES_PATH "-restore --noflush\n"
+        "*filter\n"
+        "-A INPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A INPUT --source-host !192.168.122.1 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_PATH "-restore --noflush\n"
+        "*nat\n"
+        "-A POSTROUTING --out-interface virbr0 --jump MASQUERADE\n"
+        "-A POSTROUTING -m comment --comment \"libvirt \\\"nat\\\"\" --jump ACCEPT\n"
+        "COMMIT\n"
+        EBTABLES_PATH " -t nat -A PREROUTING --jump ACCEPT\n"
+        IPTABLES_PATH "-restore --noflush\n"
+        "*filter\n"
+        "-A OUTPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        "-A OUTPUT --source-host 192.168.122.255 --jump REJECT\n"
+        "COMMIT\n"
+        IPTABLES_PATH " -A OUTPUT --source-host 192.168.122.1 --jump ACCEPT\n"
+        IPTABLES_PATH " -A OUTPUT --source-host 192.168.122.255 --jump REJECT\n";
+    const struct testFirewallData *data = opaque;
+
+    fwDisabled = data->fwDisabled;
+    virFirewallSetRestoreOverride(true);
+    if (virFirewallSetBackend(data->tryBackend) < 0)
+        goto cleanup;
+
+    virCommandSetDryRun(&cmdbuf, testFirewallBatchHook, &cmdbuf);
+
+    fw = virFirewallNew();
+
+    virFirewallStartTransaction(fw, VIR_FIREWALL_TRANSACTION_BATCH);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "INPUT",
+                       "--source-host", "!192.168.122.1",
+                       "--jump", "REJECT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-t", "nat",
+                       "-A", "POSTROUTING",
+                       "--out-interface", "virbr0",
+                       "--jump", "MASQUERADE", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-t", "nat",
+                       "-A", "POSTROUTING",
+                       "-m", "comment", "--comment", "libvirt \"nat\"",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_ETHERNET,
+                       "-t", "nat",
+                       "-A", "PREROUTING",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--source-host", "192.168.122.1",
+                       "--jump", "ACCEPT", NULL);
+
+    virFirewallAddRule(fw, VIR_FIREWALL_LAYER_IPV4,
+                       "-A", "OUTPUT",
+                       "--source-host", "192.168.122.255",
+                       "--jump", "REJECT", NULL);
+
+    if (virFirewallApply(fw) < 0)
+        goto cleanup;
+
+    if (virBufferError(&cmdbuf))
+        goto cleanup;
+
+    actual = virBufferCurrentContent(&cmdbuf);
+
+    if (STRNEQ_NULLABLE(expected, actual)) {
+        fprintf(stderr, "Unexected command execution\n");
+        virTestDifference(stderr, expected, actual);
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virBufferFreeAndReset(&cmdbuf);
+    virCommandSetDryRun(NULL, NULL, NULL);
+    virFirewallSetRestoreOverride(false);
+    virFirewallFree(fw);
+    return ret;
+}
+
 static bool
 hasNetfilterTools(void)
 {
@@ -1192,6 +1312,7 @@ mymain(void)
     RUN_TEST("many rollback", testFirewallManyRollback);
     RUN_TEST("chained rollback", testFirewallChainedRollback);
     RUN_TEST("query transaction", testFirewallQuery);
+    RUN_TEST_DIRECT("batch transaction", testFirewallBatch);
 
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
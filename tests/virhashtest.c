@@ -8,19 +8,33 @@
 #include "testutils.h"
 #include "viralloc.h"
 #include "virlog.h"
+#include "virobject.h"
 #include "virstring.h"
+#include "virtime.h"
 
 #define VIR_FROM_THIS VIR_FROM_NONE
 
 VIR_LOG_INIT("tests.hashtest");
 
+/* Whether the tests use open addressing tables */
+static bool testOpen;
+
+static virHashTablePtr
+testHashCreate(ssize_t size)
+{
+    if (testOpen)
+        return virHashCreateOpen(size, NULL);
+    return virHashCreate(size, NULL);
+}
+
+
 static virHashTablePtr
 testHashInit(int size)
 {
     virHashTablePtr hash;
     ssize_t i;
 
-    if (!(hash = virHashCreate(size, NULL)))
+    if (!(hash = testHashCreate(size)))
         return NULL;
 
     /* entires are added in reverse order so that they will be linked in
@@ -112,6 +126,126 @@ testHashGrow(const void *data)
 }
 
 
+#define INCREMENTAL_KEYS 4000
+
+static int
+testHashIncrementalCheck(virHashTablePtr hash, size_t nkeys, bool odd)
+{
+    char key[32];
+    size_t i;
+
+    for (i = 0; i < nkeys; i++) {
+        void *payload;
+
+        snprintf(key, sizeof(key), "key-%zu", i);
+        payload = virHashLookup(hash, key);
+
+        if (odd && i % 2 == 0) {
+            if (payload) {
+                VIR_TEST_VERBOSE("\nentry \"%s\" was not removed\n", key);
+                return -1;
+            }
+        } else if (payload != (void *)(uintptr_t)(i + 1)) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be found\n", key);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+static int
+testHashRemoveForEachEven(void *payload,
+                          const void *name,
+                          void *data)
+{
+    virHashTablePtr hash = data;
+
+    if (((uintptr_t)payload - 1) % 2 == 0)
+        virHashRemoveEntry(hash, name);
+    return 0;
+}
+
+
+static int
+testHashGrowIncremental(const void *data ATTRIBUTE_UNUSED)
+{
+    virHashTablePtr hash;
+    char key[32];
+    size_t i;
+    int ret = -1;
+
+    if (!(hash = testHashCreate(8)))
+        return -1;
+
+    /* Entries must stay reachable while buckets are still being
+     * moved from the old bucket array to the new one */
+    for (i = 0; i < INCREMENTAL_KEYS; i++) {
+        snprintf(key, sizeof(key), "key-%zu", i);
+        if (virHashAddEntry(hash, key, (void *)(uintptr_t)(i + 1)) < 0)
+            goto cleanup;
+
+        if (i % 97 == 0 &&
+            testHashIncrementalCheck(hash, i + 1, false) < 0)
+            goto cleanup;
+    }
+
+    if (testHashCheckCount(hash, INCREMENTAL_KEYS) < 0 ||
+        testHashIncrementalCheck(hash, INCREMENTAL_KEYS, false) < 0)
+        goto cleanup;
+
+    if (virHashForEach(hash, testHashRemoveForEachEven, hash) < 0)
+        goto cleanup;
+
+    if (testHashCheckCount(hash, INCREMENTAL_KEYS / 2) < 0 ||
+        testHashIncrementalCheck(hash, INCREMENTAL_KEYS, true) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    return ret;
+}
+
+
+static int
+testHashAtomicSharded(const void *data ATTRIBUTE_UNUSED)
+{
+    virHashAtomicPtr hash;
+    size_t i;
+    int ret = -1;
+
+    if (!(hash = virHashAtomicNewSharded(0, 8, NULL)))
+        return -1;
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids); i++) {
+        if (virHashAtomicUpdate(hash, uuids[i], (void *) uuids[i]) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids); i++) {
+        if (virHashAtomicSteal(hash, uuids[i]) != uuids[i]) {
+            VIR_TEST_VERBOSE("\nentry \"%s\" could not be stolen\n",
+                             uuids[i]);
+            goto cleanup;
+        }
+    }
+
+    if (virHashAtomicSteal(hash, uuids[0])) {
+        VIR_TEST_VERBOSE("\nentry \"%s\" was stolen twice\n", uuids[0]);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virObjectUnref(hash);
+    return ret;
+}
+
+
 static int
 testHashUpdate(const void *data ATTRIBUTE_UNUSED)
 {
@@ -332,6 +466,61 @@ testHashRemoveSet(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testHashUsage(const void *data ATTRIBUTE_UNUSED)
+{
+    virHashTablePtr hash = NULL;
+    size_t tables, entries, baseTables, baseEntries;
+    unsigned long long bytes, baseBytes;
+    size_t i;
+    int ret = -1;
+
+    virHashGetUsage(&baseTables, &baseEntries, &baseBytes);
+
+    if (!(hash = testHashInit(0)))
+        return -1;
+
+    virHashGetUsage(&tables, &entries, &bytes);
+    if (tables != baseTables + 1 ||
+        entries != baseEntries + ARRAY_CARDINALITY(uuids) ||
+        bytes <= baseBytes) {
+        VIR_TEST_VERBOSE("\nunexpected usage after filling: %zu tables, "
+                         "%zu entries, %llu bytes\n", tables, entries, bytes);
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(uuids_subset); i++) {
+        if (virHashRemoveEntry(hash, uuids_subset[i]) < 0)
+            goto cleanup;
+    }
+
+    virHashGetUsage(&tables, &entries, &bytes);
+    if (entries != baseEntries + ARRAY_CARDINALITY(uuids) -
+        ARRAY_CARDINALITY(uuids_subset)) {
+        VIR_TEST_VERBOSE("\nunexpected number of entries after removal: "
+                         "%zu\n", entries);
+        goto cleanup;
+    }
+
+    virHashFree(hash);
+    hash = NULL;
+
+    virHashGetUsage(&tables, &entries, &bytes);
+    if (tables != baseTables || entries != baseEntries ||
+        bytes != baseBytes) {
+        VIR_TEST_VERBOSE("\nusage not released: %zu tables, %zu entries, "
+                         "%llu bytes\n", tables, entries, bytes);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    return ret;
+}
+
+
 const int testSearchIndex = ARRAY_CARDINALITY(uuids_subset) / 2;
 
 static int
@@ -398,7 +587,7 @@ testHashGetItems(const void *data ATTRIBUTE_UNUSED)
     char value2[] = "2";
     char value3[] = "3";
 
-    if (!(hash = virHashCreate(0, NULL)) ||
+    if (!(hash = testHashCreate(0)) ||
         virHashAddEntry(hash, keya, value3) < 0 ||
         virHashAddEntry(hash, keyc, value1) < 0 ||
         virHashAddEntry(hash, keyb, value2) < 0) {
@@ -468,8 +657,8 @@ testHashEqual(const void *data ATTRIBUTE_UNUSED)
     char value3_u[] = "O";
     char value4_u[] = "P";
 
-    if (!(hash1 = virHashCreate(0, NULL)) ||
-        !(hash2 = virHashCreate(0, NULL)) ||
+    if (!(hash1 = testHashCreate(0)) ||
+        !(hash2 = testHashCreate(0)) ||
         virHashAddEntry(hash1, keya, value1_l) < 0 ||
         virHashAddEntry(hash1, keyb, value2_l) < 0 ||
         virHashAddEntry(hash1, keyc, value3_l) < 0 ||
@@ -513,15 +702,144 @@ testHashEqual(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+#define BENCH_KEYS 100000
+#define BENCH_ROUNDS 10
+
+typedef struct {
+    char str[VIR_UUID_STRING_BUFLEN];
+} testHashBenchKey;
+
+
+static void
+testHashBenchKeys(testHashBenchKey *keys, bool uuid)
+{
+    static const char *const aliases[] = {
+        "virtio-disk", "net", "hostdev", "ua-", "pci.", "scsi0-0-0-",
+    };
+    uint64_t state = 0x853c49e6748fea9bULL;
+    size_t i;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        if (uuid) {
+            uint64_t a, b;
+
+            /* xorshift64, good enough for key material */
+            state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+            a = state;
+            state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+            b = state;
+
+            snprintf(keys[i].str, sizeof(keys[i].str),
+                     "%08x-%04x-4%03x-%04x-%012llx",
+                     (unsigned int)(a >> 32), (unsigned int)(a >> 16) & 0xffff,
+                     (unsigned int)a & 0xfff, (unsigned int)(b >> 48),
+                     (unsigned long long)b & 0xffffffffffffULL);
+        } else {
+            snprintf(keys[i].str, sizeof(keys[i].str), "%s%zu",
+                     aliases[i % ARRAY_CARDINALITY(aliases)],
+                     i / ARRAY_CARDINALITY(aliases));
+        }
+    }
+}
+
+
+static int
+testHashBenchRun(const char *label,
+                 bool open,
+                 const testHashBenchKey *keys)
+{
+    unsigned long long start, added, looked, removed;
+    virHashTablePtr hash;
+    size_t i, j;
+    int ret = -1;
+
+    if (virTimeMillisNow(&start) < 0)
+        return -1;
+
+    if (!(hash = open ? virHashCreateOpen(0, NULL) : virHashCreate(0, NULL)))
+        return -1;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        if (virHashAddEntry(hash, keys[i].str, (void *) keys[i].str) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&added) < 0)
+        goto cleanup;
+
+    for (j = 0; j < BENCH_ROUNDS; j++) {
+        for (i = 0; i < BENCH_KEYS; i++) {
+            if (virHashLookup(hash, keys[i].str) != keys[i].str) {
+                VIR_TEST_VERBOSE("\nentry \"%s\" could not be found\n",
+                                 keys[i].str);
+                goto cleanup;
+            }
+        }
+    }
+
+    if (virTimeMillisNow(&looked) < 0)
+        goto cleanup;
+
+    for (i = 0; i < BENCH_KEYS; i++) {
+        if (virHashRemoveEntry(hash, keys[i].str) < 0)
+            goto cleanup;
+    }
+
+    if (virTimeMillisNow(&removed) < 0)
+        goto cleanup;
+
+    VIR_TEST_VERBOSE("\n%s %s: add %llums, %d lookups %llums, remove %llums",
+                     open ? "open" : "chained", label,
+                     added - start, BENCH_ROUNDS * BENCH_KEYS,
+                     looked - added, removed - looked);
+
+    ret = 0;
+
+ cleanup:
+    virHashFree(hash);
+    return ret;
+}
+
+
+static int
+testHashBenchmark(const void *data)
+{
+    const struct testInfo *info = data;
+    testHashBenchKey *keys = NULL;
+    bool uuid = STREQ(info->data, "uuid");
+    int ret = -1;
+
+    if (!virTestGetExpensive())
+        return EXIT_AM_SKIP;
+
+    if (VIR_ALLOC_N(keys, BENCH_KEYS) < 0)
+        return -1;
+
+    testHashBenchKeys(keys, uuid);
+
+    if (testHashBenchRun(info->data, false, keys) < 0 ||
+        testHashBenchRun(info->data, true, keys) < 0)
+        goto cleanup;
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(keys);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
     int ret = 0;
+    size_t i;
 
 #define DO_TEST_FULL(name, cmd, data, count) \
     do { \
         struct testInfo info = { data, count }; \
-        if (virTestRun(name, testHash ## cmd, &info) < 0) \
+        if (virTestRun(testOpen ? "Open " name : name, \
+                       testHash ## cmd, &info) < 0) \
             ret = -1; \
     } while (0)
 
@@ -537,18 +855,30 @@ mymain(void)
 #define DO_TEST(name, cmd) \
     DO_TEST_FULL(name, cmd, NULL, -1)
 
-    DO_TEST_COUNT("Grow", Grow, 1);
-    DO_TEST_COUNT("Grow", Grow, 10);
-    DO_TEST_COUNT("Grow", Grow, 42);
-    DO_TEST("Update", Update);
-    DO_TEST("Remove", Remove);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
-    DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
-    DO_TEST("Steal", Steal);
-    DO_TEST("RemoveSet", RemoveSet);
-    DO_TEST("Search", Search);
-    DO_TEST("GetItems", GetItems);
-    DO_TEST("Equal", Equal);
+    /* Run the tests against chained and open addressing tables */
+    for (i = 0; i < 2; i++) {
+        testOpen = i == 1;
+
+        DO_TEST_COUNT("Grow", Grow, 1);
+        DO_TEST_COUNT("Grow", Grow, 10);
+        DO_TEST_COUNT("Grow", Grow, 42);
+        DO_TEST("Grow incremental", GrowIncremental);
+        DO_TEST("Update", Update);
+        DO_TEST("Remove", Remove);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, Some);
+        DO_TEST_DATA("Remove in ForEach", RemoveForEach, All);
+        DO_TEST("Steal", Steal);
+        DO_TEST("RemoveSet", RemoveSet);
+        DO_TEST("Search", Search);
+        DO_TEST("GetItems", GetItems);
+        DO_TEST("Equal", Equal);
+        DO_TEST("Usage", Usage);
+    }
+    testOpen = false;
+
+    DO_TEST("Atomic sharded", AtomicSharded);
+    DO_TEST_FULL("Benchmark(uuid)", Benchmark, (void *) "uuid", BENCH_KEYS);
+    DO_TEST_FULL("Benchmark(alias)", Benchmark, (void *) "alias", BENCH_KEYS);
 
     return (ret == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
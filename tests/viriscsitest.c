@@ -30,9 +30,10 @@ main(void)
 }
 #else
 # define __VIR_COMMAND_PRIV_H_ALLOW__
+# define __VIR_ISCSI_PRIV_H_ALLOW__
 
 # include "vircommandpriv.h"
-# include "viriscsi.h"
+# include "viriscsipriv.h"
 
 # define VIR_FROM_THIS VIR_FROM_NONE
 
@@ -206,21 +207,49 @@ struct testSessionInfo {
     const char *device_path;
     bool output_version;
     const char *expected_session;
+    bool sysfs;
 };
 
+static void testIscsiadmUnexpectedCb(const char *const*args ATTRIBUTE_UNUSED,
+                                     const char *const*env ATTRIBUTE_UNUSED,
+                                     const char *input ATTRIBUTE_UNUSED,
+                                     char **output ATTRIBUTE_UNUSED,
+                                     char **error ATTRIBUTE_UNUSED,
+                                     int *status,
+                                     void *opaque)
+{
+    bool *called = opaque;
+
+    *called = true;
+    *status = -1;
+}
+
 static int
 testISCSIGetSession(const void *data)
 {
     const struct testSessionInfo *info = data;
     struct testIscsiadmCbData cbData = { 0 };
     char *actual_session = NULL;
+    bool called = false;
     int ret = -1;
 
     cbData.output_version = info->output_version;
 
-    virCommandSetDryRun(NULL, testIscsiadmCb, &cbData);
+    if (info->sysfs) {
+        virCommandSetDryRun(NULL, testIscsiadmUnexpectedCb, &called);
+        actual_session = virISCSIGetSessionInternal(abs_srcdir "/viriscsidata/iscsi_session",
+                                                    info->device_path, true);
+    } else {
+        virCommandSetDryRun(NULL, testIscsiadmCb, &cbData);
+        actual_session = virISCSIGetSessionInternal(abs_srcdir "/viriscsidata/nonexistent",
+                                                    info->device_path, true);
+    }
 
-    actual_session = virISCSIGetSession(info->device_path, true);
+    if (called) {
+        virReportError(VIR_ERR_INTERNAL_ERROR, "%s",
+                       "iscsiadm was run despite sysfs data");
+        goto cleanup;
+    }
 
     if (STRNEQ_NULLABLE(actual_session, info->expected_session)) {
         virReportError(VIR_ERR_INTERNAL_ERROR,
@@ -320,7 +349,7 @@ mymain(void)
 
 # define DO_SESSION_TEST(name, session) \
     do { \
-        struct testSessionInfo info = {name, false, session}; \
+        struct testSessionInfo info = {name, false, session, false}; \
         if (virTestRun("ISCSI get session test" name, \
                        testISCSIGetSession, &info) < 0) \
             rv = -1; \
@@ -328,6 +357,10 @@ mymain(void)
         if (virTestRun("ISCSI get (non-flash) session test" name, \
                        testISCSIGetSession, &info) < 0) \
             rv = -1; \
+        info.sysfs = true; \
+        if (virTestRun("ISCSI get sysfs session test" name, \
+                       testISCSIGetSession, &info) < 0) \
+            rv = -1; \
     } while (0)
 
     DO_SESSION_TEST("iqn.2004-06.example:example1:iscsi.test", "1");
@@ -472,6 +472,212 @@ testJSONObjectFormatSteal(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int
+testJSONArenaSteal(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr array = NULL;
+    virJSONValuePtr elem = NULL;
+    virJSONValuePtr wrap = NULL;
+    char *formatted = NULL;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromStringArena(info->doc))) {
+        VIR_TEST_VERBOSE("Fail to parse %s\n", info->doc);
+        goto cleanup;
+    }
+
+    if (!(array = virJSONValueObjectStealArray(json, "return")) ||
+        !(elem = virJSONValueArraySteal(array, 0))) {
+        VIR_TEST_VERBOSE("Failed to steal members of the parsed tree\n");
+        goto cleanup;
+    }
+
+    /* values stolen from the tree have to outlive its root */
+    virJSONValueFree(json);
+    json = NULL;
+
+    if (virJSONValueArrayAppend(array, elem) < 0) {
+        VIR_TEST_VERBOSE("Failed to move the element back\n");
+        goto cleanup;
+    }
+    elem = NULL;
+
+    if (virJSONValueObjectAppendString(virJSONValueArrayGet(array, 0),
+                                       "added", "value") < 0 ||
+        virJSONValueObjectCreate(&wrap, "a:list", &array, NULL) < 0) {
+        VIR_TEST_VERBOSE("Failed to modify the stolen values\n");
+        goto cleanup;
+    }
+
+    if (!(formatted = virJSONValueToString(wrap, false))) {
+        VIR_TEST_VERBOSE("Failed to format json data\n");
+        goto cleanup;
+    }
+
+    if (STRNEQ(info->expect, formatted)) {
+        virTestDifference(stderr, info->expect, formatted);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FREE(formatted);
+    virJSONValueFree(json);
+    virJSONValueFree(array);
+    virJSONValueFree(elem);
+    virJSONValueFree(wrap);
+    return ret;
+}
+
+
+static int
+testJSONLargeObject(const void *data ATTRIBUTE_UNUSED)
+{
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr val = NULL;
+    char key[32];
+    unsigned long long num = 0;
+    const char *str = NULL;
+    size_t i;
+    int ret = -1;
+    virJSONField fields[] = {
+        { "key42", VIR_JSON_FIELD_ULONG, &num, false },
+        { "name", VIR_JSON_FIELD_STRING, &str, false },
+        { "missing", VIR_JSON_FIELD_LONG, NULL, false },
+    };
+
+    if (!(json = virJSONValueNewObject()))
+        goto cleanup;
+
+    /* enough members for the object to be indexed */
+    for (i = 0; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectAppendNumberUlong(json, key, i) < 0) {
+            VIR_TEST_VERBOSE("Failed to append '%s'\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virJSONValueObjectAppendString(json, "name", "test") < 0 ||
+        virJSONValueObjectAppendString(json, "key7", "dup") == 0) {
+        VIR_TEST_VERBOSE("Unexpected result of appending keys\n");
+        goto cleanup;
+    }
+
+    if (virJSONValueObjectRemoveKey(json, "key0", NULL) != 1 ||
+        virJSONValueObjectRemoveKey(json, "key0", NULL) != 0) {
+        VIR_TEST_VERBOSE("Failed to remove 'key0'\n");
+        goto cleanup;
+    }
+
+    for (i = 1; i < 100; i++) {
+        snprintf(key, sizeof(key), "key%zu", i);
+        if (virJSONValueObjectGetNumberUlong(json, key, &num) < 0 || num != i) {
+            VIR_TEST_VERBOSE("Failed to look up '%s'\n", key);
+            goto cleanup;
+        }
+    }
+
+    if (virJSONValueObjectGetFields(json, fields,
+                                    ARRAY_CARDINALITY(fields)) != 2 ||
+        !fields[0].found || num != 42 ||
+        !fields[1].found || STRNEQ_NULLABLE(str, "test") ||
+        fields[2].found) {
+        VIR_TEST_VERBOSE("Unexpected result of virJSONValueObjectGetFields\n");
+        goto cleanup;
+    }
+
+    if (!(val = virJSONValueCopy(json)) ||
+        virJSONValueObjectKeysNumber(val) != 100 ||
+        !virJSONValueObjectHasKey(val, "key99")) {
+        VIR_TEST_VERBOSE("Failed to copy large object\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    virJSONValueFree(val);
+    return ret;
+}
+
+
+static int
+testJSONNumbers(const void *data)
+{
+    const struct testInfo *info = data;
+    virJSONValuePtr json = NULL;
+    virJSONValuePtr num = NULL;
+    char *formatted = NULL;
+    int i;
+    unsigned int ui;
+    long long l;
+    unsigned long long ul;
+    double d;
+    int ret = -1;
+
+    if (!(json = virJSONValueFromStringArena(info->doc))) {
+        VIR_TEST_VERBOSE("Fail to parse %s\n", info->doc);
+        goto cleanup;
+    }
+
+    /* numbers kept in binary form have to behave like textual ones */
+    if (virJSONValueGetNumberInt(virJSONValueArrayGet(json, 1), &i) < 0 ||
+        i != -1 ||
+        virJSONValueGetNumberUint(virJSONValueArrayGet(json, 1), &ui) < 0 ||
+        ui != UINT_MAX ||
+        virJSONValueGetNumberUlong(virJSONValueArrayGet(json, 1), &ul) < 0 ||
+        ul != ULLONG_MAX ||
+        virJSONValueGetNumberInt(virJSONValueArrayGet(json, 2), &i) == 0 ||
+        virJSONValueGetNumberUint(virJSONValueArrayGet(json, 2), &ui) < 0 ||
+        ui != UINT_MAX ||
+        virJSONValueGetNumberLong(virJSONValueArrayGet(json, 3), &l) == 0 ||
+        virJSONValueGetNumberUlong(virJSONValueArrayGet(json, 3), &ul) < 0 ||
+        ul != ULLONG_MAX ||
+        virJSONValueGetNumberLong(virJSONValueArrayGet(json, 4), &l) < 0 ||
+        l != LLONG_MIN ||
+        virJSONValueGetNumberInt(virJSONValueArrayGet(json, 5), &i) == 0 ||
+        virJSONValueGetNumberDouble(virJSONValueArrayGet(json, 5), &d) < 0 ||
+        d != 1.5) {
+        VIR_TEST_VERBOSE("Unexpected result of number getters\n");
+        goto cleanup;
+    }
+
+    if (STRNEQ_NULLABLE(virJSONValueGetNumberString(virJSONValueArrayGet(json, 3)),
+                        "18446744073709551615") ||
+        STRNEQ_NULLABLE(virJSONValueGetNumberString(virJSONValueArrayGet(json, 6)),
+                        "-0")) {
+        VIR_TEST_VERBOSE("Unexpected textual form of numbers\n");
+        goto cleanup;
+    }
+
+    if (!(num = virJSONValueNewNumberUlong(ULLONG_MAX)) ||
+        virJSONValueArrayAppend(json, num) < 0) {
+        virJSONValueFree(num);
+        goto cleanup;
+    }
+
+    if (!(formatted = virJSONValueToString(json, false)))
+        goto cleanup;
+
+    if (STRNEQ(formatted, info->expect)) {
+        virTestDifference(stderr, info->expect, formatted);
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virJSONValueFree(json);
+    VIR_FREE(formatted);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -550,6 +756,20 @@ mymain(void)
     DO_TEST_FULL("add and remove", AddRemove,
                  "[ 1 ]", NULL, false);
 
+    DO_TEST_FULL("large object", LargeObject, NULL, NULL, true);
+    DO_TEST_FULL("numbers", Numbers,
+                 "[0, -1, 4294967295, 18446744073709551615,"
+                 " -9223372036854775808, 1.5, -0, 1e3]",
+                 "[0,-1,4294967295,18446744073709551615,"
+                 "-9223372036854775808,1.5,-0,1e3,18446744073709551615]",
+                 true);
+    DO_TEST_FULL("steal from arena", ArenaSteal,
+                 "{\"return\": [{\"name\": \"quit\"}, {\"name\": \"eject\"}],"
+                 "\"id\": \"libvirt-1\"}",
+                 "{\"list\":[{\"name\":\"eject\",\"added\":\"value\"},"
+                 "{\"name\":\"quit\"}]}",
+                 true);
+
     DO_TEST_FULL("copy and free", Copy,
                  "{\"return\": [{\"name\": \"quit\"}, {\"name\": \"eject\"},"
                  "{\"name\": \"change\"}, {\"name\": \"screendump\"},"
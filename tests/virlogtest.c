@@ -144,6 +144,9 @@ mymain(void)
     TEST_PARSE_OUTPUTS_FAIL("foo:stderr", 1);
     TEST_PARSE_OUTPUTS_FAIL("1:bar", 1);
     TEST_PARSE_OUTPUTS_FAIL("1:stderr:foobar", 1);
+    TEST_PARSE_OUTPUTS("1:buffer:65536 3:stderr", 2);
+    TEST_PARSE_OUTPUTS_FAIL("1:buffer", 1);
+    TEST_PARSE_OUTPUTS_FAIL("1:buffer:16", 1);
     TEST_PARSE_FILTERS("1:foo", 1);
     TEST_PARSE_FILTERS("1:foo 2:bar  3:foobar", 3);
     TEST_PARSE_FILTERS_FAIL("5:foo", 1);
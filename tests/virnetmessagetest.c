@@ -521,6 +521,193 @@ static int testMessagePayloadStreamEncode(const void *args ATTRIBUTE_UNUSED)
 }
 
 
+static int testMessagePoolRecycle(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = NULL;
+    virNetMessagePoolStats before;
+    virNetMessagePoolStats after;
+    char *buffer;
+    int ret = -1;
+
+    virNetMessagePoolDrain();
+
+    if (!(msg = virNetMessageNew(true)))
+        goto cleanup;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    buffer = msg->buffer;
+    virNetMessageClearPayload(msg);
+
+    virNetMessagePoolGetStats(&before);
+    if (before.cached != 1) {
+        VIR_DEBUG("Expected 1 cached buffer, got %llu", before.cached);
+        goto cleanup;
+    }
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    virNetMessagePoolGetStats(&after);
+    if (msg->buffer != buffer ||
+        after.hits != before.hits + 1 ||
+        after.cached != 0) {
+        VIR_DEBUG("Buffer was not reused from the pool");
+        goto cleanup;
+    }
+
+    /* Growing must keep the existing content */
+    memset(msg->buffer, 'x', msg->bufferLength);
+    if (virNetMessageResizeBuffer(msg, VIR_NET_MESSAGE_INITIAL * 4) < 0)
+        goto cleanup;
+
+    if (msg->bufferLength != VIR_NET_MESSAGE_INITIAL * 4 ||
+        msg->buffer[VIR_NET_MESSAGE_INITIAL] != 'x') {
+        VIR_DEBUG("Buffer content was not preserved when growing");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    virNetMessagePoolDrain();
+    return ret;
+}
+
+static int testMessageDecodeRaw(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = virNetMessageNew(false);
+    static char input_buf [] =  {
+        0x00, 0x00, 0x00, 0x20,  /* Length */
+        0x11, 0x22, 0x33, 0x44,  /* Program */
+        0x00, 0x00, 0x00, 0x01,  /* Version */
+        0x00, 0x00, 0x06, 0x66,  /* Procedure */
+        0x00, 0x00, 0x00, 0x00,  /* Type */
+        0x00, 0x00, 0x00, 0x99,  /* Serial */
+        0x00, 0x00, 0x00, 0x00,  /* Status */
+        0x00, 0x00, 0x00, 0x2a,  /* Payload */
+    };
+    int ret = -1;
+
+    if (!msg)
+        return -1;
+
+    /* Length word not matching the size of the packet */
+    if (virNetMessageDecodeRaw(msg, input_buf, sizeof(input_buf) - 4) == 0) {
+        VIR_DEBUG("Truncated packet was not rejected");
+        goto cleanup;
+    }
+
+    virNetMessageClear(msg);
+
+    if (virNetMessageDecodeRaw(msg, input_buf, sizeof(input_buf)) < 0) {
+        VIR_DEBUG("Failed to decode raw message");
+        goto cleanup;
+    }
+
+    if (msg->bufferLength != sizeof(input_buf) ||
+        msg->bufferOffset != sizeof(input_buf) - 4) {
+        VIR_DEBUG("Expect length %zu offset %zu got %zu %zu",
+                  sizeof(input_buf), sizeof(input_buf) - 4,
+                  msg->bufferLength, msg->bufferOffset);
+        goto cleanup;
+    }
+
+    if (msg->header.prog != 0x11223344 ||
+        msg->header.proc != 0x666 ||
+        msg->header.type != VIR_NET_CALL ||
+        msg->header.serial != 0x99) {
+        VIR_DEBUG("Unexpected header prog %d proc %d type %d serial %d",
+                  msg->header.prog, msg->header.proc,
+                  msg->header.type, msg->header.serial);
+        goto cleanup;
+    }
+
+    if (memcmp(msg->buffer, input_buf, sizeof(input_buf)) != 0) {
+        VIR_DEBUG("Message content was not copied");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virNetMessageFree(msg);
+    return ret;
+}
+
+#if WITH_ZSTD
+static int testMessagePayloadCompress(const void *args ATTRIBUTE_UNUSED)
+{
+    virNetMessagePtr msg = virNetMessageNew(true);
+    virNetMessagePtr copy = virNetMessageNew(true);
+    char *in = NULL;
+    char *out = NULL;
+    size_t len = 256 * 1024;
+    int ret = -1;
+
+    if (!msg || !copy)
+        goto cleanup;
+
+    if (VIR_ALLOC_N(in, len + 1) < 0)
+        goto cleanup;
+    memset(in, 'x', len);
+
+    msg->header.prog = 0x11223344;
+    msg->header.vers = 0x01;
+    msg->header.proc = 0x666;
+    msg->header.type = VIR_NET_REPLY;
+    msg->header.serial = 0x99;
+    msg->header.status = VIR_NET_OK;
+
+    if (virNetMessageEncodeHeader(msg) < 0)
+        goto cleanup;
+
+    msg->compress = true;
+
+    if (virNetMessageEncodePayload(msg,
+                                   (xdrproc_t)xdr_virNetMessageNonnullString,
+                                   &in) < 0)
+        goto cleanup;
+
+    if (msg->bufferLength >= len) {
+        VIR_DEBUG("Payload was not compressed, length %zu",
+                  msg->bufferLength);
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodeRaw(copy, msg->buffer, msg->bufferLength) < 0) {
+        VIR_DEBUG("Failed to decode compressed message header");
+        goto cleanup;
+    }
+
+    if (!copy->compressed || copy->header.type != VIR_NET_REPLY) {
+        VIR_DEBUG("Expected compressed reply, got compressed=%d type %d",
+                  copy->compressed, copy->header.type);
+        goto cleanup;
+    }
+
+    if (virNetMessageDecodePayload(copy,
+                                   (xdrproc_t)xdr_virNetMessageNonnullString,
+                                   &out) < 0) {
+        VIR_DEBUG("Failed to decode compressed payload");
+        goto cleanup;
+    }
+
+    if (STRNEQ_NULLABLE(in, out)) {
+        VIR_DEBUG("Decompressed payload does not match");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    VIR_FREE(in);
+    VIR_FREE(out);
+    virNetMessageFree(msg);
+    virNetMessageFree(copy);
+    return ret;
+}
+#endif /* WITH_ZSTD */
+
 static int
 mymain(void)
 {
@@ -543,6 +730,17 @@ mymain(void)
     if (virTestRun("Message Payload Stream Encode", testMessagePayloadStreamEncode, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Message Pool Recycle", testMessagePoolRecycle, NULL) < 0)
+        ret = -1;
+
+    if (virTestRun("Message Decode Raw", testMessageDecodeRaw, NULL) < 0)
+        ret = -1;
+
+#if WITH_ZSTD
+    if (virTestRun("Message Payload Compress", testMessagePayloadCompress, NULL) < 0)
+        ret = -1;
+#endif
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
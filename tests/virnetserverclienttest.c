@@ -160,6 +160,46 @@ static int testIdentity(const void *opaque ATTRIBUTE_UNUSED)
 }
 
 
+static int testRateBucket(const void *opaque ATTRIBUTE_UNUSED)
+{
+    virNetServerRateBucket bucket = { 0 };
+    unsigned long long now = 1000000;
+    size_t i;
+
+    /* 2 requests per second, bursts of 4 */
+    for (i = 0; i < 4; i++) {
+        if (!virNetServerRateBucketTake(&bucket, 2, 4, 1, now)) {
+            VIR_TEST_DEBUG("Request %zu of the initial burst refused\n", i);
+            return -1;
+        }
+    }
+
+    if (virNetServerRateBucketTake(&bucket, 2, 4, 1, now)) {
+        VIR_TEST_DEBUG("Request over the burst allowed\n");
+        return -1;
+    }
+
+    /* Half a second later one request was added back */
+    now += 500000;
+    if (!virNetServerRateBucketTake(&bucket, 2, 4, 1, now) ||
+        virNetServerRateBucketTake(&bucket, 2, 4, 1, now)) {
+        VIR_TEST_DEBUG("Bucket not refilled by exactly one request\n");
+        return -1;
+    }
+
+    /* A long pause refills it up to the burst size only, and a cost
+     * larger than the burst is capped to it */
+    now += 3600 * 1000000ull;
+    if (!virNetServerRateBucketTake(&bucket, 2, 4, 10, now) ||
+        virNetServerRateBucketTake(&bucket, 2, 4, 1, now)) {
+        VIR_TEST_DEBUG("Bucket not refilled to its burst size\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
 static int
 mymain(void)
 {
@@ -170,6 +210,10 @@ mymain(void)
                    testIdentity, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rate bucket",
+                   testRateBucket, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 VIR_TEST_MAIN_PRELOAD(mymain, abs_builddir "/.libs/virnetserverclientmock.so")
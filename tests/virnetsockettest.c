@@ -446,6 +446,69 @@ static int testSocketCommandFail(const void *data ATTRIBUTE_UNUSED)
     return ret;
 }
 
+static int testSocketWritev(const void *data ATTRIBUTE_UNUSED)
+{
+    virNetSocketPtr csock = NULL; /* Client socket */
+    virNetSocketPtr ssock = NULL; /* Server socket */
+    int fds[2] = { -1, -1 };
+    char head[] = "header";
+    char body[] = "payload";
+    char buf[100];
+    const char *expect = "headerpayload";
+    struct iovec iov[3];
+    ssize_t len = strlen(expect);
+    ssize_t got = 0;
+    int ret = -1;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        virReportSystemError(errno, "%s", "Cannot create socket pair");
+        goto cleanup;
+    }
+
+    if (virNetSocketNewConnectSockFD(fds[0], &csock) < 0)
+        goto cleanup;
+    fds[0] = -1;
+    if (virNetSocketNewConnectSockFD(fds[1], &ssock) < 0)
+        goto cleanup;
+    fds[1] = -1;
+
+    virNetSocketSetBlocking(csock, true);
+    virNetSocketSetBlocking(ssock, true);
+
+    iov[0].iov_base = head;
+    iov[0].iov_len = strlen(head);
+    iov[1].iov_base = NULL;
+    iov[1].iov_len = 0;
+    iov[2].iov_base = body;
+    iov[2].iov_len = strlen(body);
+
+    if (virNetSocketWritev(csock, iov, ARRAY_CARDINALITY(iov)) != len) {
+        VIR_DEBUG("Expected a single write of %zd bytes", len);
+        goto cleanup;
+    }
+
+    while (got < len) {
+        ssize_t rv = virNetSocketRead(ssock, buf + got, sizeof(buf) - got);
+        if (rv <= 0)
+            goto cleanup;
+        got += rv;
+    }
+
+    if (got != len || memcmp(buf, expect, len) != 0) {
+        VIR_DEBUG("Unexpected data received");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    VIR_FORCE_CLOSE(fds[0]);
+    VIR_FORCE_CLOSE(fds[1]);
+    virObjectUnref(csock);
+    virObjectUnref(ssock);
+    return ret;
+}
+
 struct testSSHData {
     const char *nodename;
     const char *service;
@@ -569,6 +632,8 @@ mymain(void)
         ret = -1;
     if (virTestRun("Socket External Command /dev/does-not-exist", testSocketCommandFail, NULL) < 0)
         ret = -1;
+    if (virTestRun("Socket Writev", testSocketWritev, NULL) < 0)
+        ret = -1;
 
     struct testSSHData sshData1 = {
         .nodename = "somehost",
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2018 Red Hat, Inc.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#include "testutils.h"
+
+#define __VIR_OVSDB_PRIV_H_ALLOW__
+#include "virovsdbpriv.h"
+#include "virstring.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+struct testMessageLengthData {
+    const char *buf;
+    ssize_t len;
+};
+
+
+static int
+testMessageLength(const void *opaque)
+{
+    const struct testMessageLengthData *data = opaque;
+    ssize_t len = virOVSDBMessageLength(data->buf, strlen(data->buf));
+
+    if (len != data->len) {
+        fprintf(stderr, "expected %zd, got %zd\n", data->len, len);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+testMapLookup(const void *opaque ATTRIBUTE_UNUSED)
+{
+    VIR_AUTOPTR(virJSONValue) map = NULL;
+    virJSONValuePtr val;
+    long long num;
+
+    if (!(map = virJSONValueFromString("[\"map\", [[\"rx_bytes\", 1234], "
+                                       "[\"tx_bytes\", 5678]]]")))
+        return -1;
+
+    if (!(val = virOVSDBMapLookup(map, "tx_bytes")) ||
+        virJSONValueGetNumberLong(val, &num) < 0 ||
+        num != 5678) {
+        fprintf(stderr, "unexpected value of tx_bytes\n");
+        return -1;
+    }
+
+    if (virOVSDBMapLookup(map, "rx_errors") ||
+        virOVSDBMapLookup(NULL, "rx_bytes")) {
+        fprintf(stderr, "unexpected value of a missing key\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+mymain(void)
+{
+    int ret = 0;
+
+#define DO_TEST_LENGTH(_buf, _len) \
+    do { \
+        struct testMessageLengthData data = { .buf = _buf, .len = _len }; \
+        if (virTestRun("message length " _buf, testMessageLength, &data) < 0) \
+            ret = -1; \
+    } while (0)
+
+    DO_TEST_LENGTH("", 0);
+    DO_TEST_LENGTH("{\"id\": 1", 0);
+    DO_TEST_LENGTH("{\"id\": 1}", 9);
+    DO_TEST_LENGTH("  {\"id\": 1}{\"id\": 2}", 11);
+    DO_TEST_LENGTH("{\"result\": [{\"rows\": []}], \"id\": 1}", 35);
+    DO_TEST_LENGTH("{\"details\": \"} ]\"}", 18);
+    DO_TEST_LENGTH("{\"details\": \"\\\"}\"}", 18);
+    DO_TEST_LENGTH("{\"details\": \"\\\\\"}", 17);
+    DO_TEST_LENGTH("[1]", -1);
+    DO_TEST_LENGTH("\"id\"", -1);
+
+    if (virTestRun("map lookup", testMapLookup, NULL) < 0)
+        ret = -1;
+
+    return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+VIR_TEST_MAIN(mymain)
@@ -236,6 +236,59 @@ testVirPCIDeviceIsAssignable(const void *opaque)
     return ret;
 }
 
+static int
+testVirPCIDeviceCache(const void *opaque)
+{
+    const struct testPCIDevData *data = opaque;
+    int ret = -1;
+    virPCIDevicePtr dev = NULL;
+    virPCIDeviceListPtr list = NULL;
+    size_t i;
+
+    if (virPCIDeviceCacheSetEnabled(true) < 0 ||
+        !(list = virPCIDeviceListNew()))
+        goto cleanup;
+
+    /* The second round is served from the cache, the third one goes
+     * to sysfs again after invalidation */
+    for (i = 0; i < 3; i++) {
+        if (i == 2)
+            virPCIDeviceCacheInvalidate();
+
+        if (!(dev = virPCIDeviceNew(data->domain, data->bus,
+                                    data->slot, data->function)))
+            goto cleanup;
+
+        if (virPCIDeviceListAdd(list, dev) < 0)
+            goto cleanup;
+
+        if (virPCIDeviceListFindByIDs(list, data->domain, data->bus,
+                                      data->slot, data->function) != dev) {
+            fprintf(stderr, "Device %s not found in list\n",
+                    virPCIDeviceGetName(dev));
+            dev = NULL;
+            goto cleanup;
+        }
+
+        virPCIDeviceListDel(list, dev);
+        dev = NULL;
+
+        if (virPCIDeviceListCount(list) != 0 ||
+            virPCIDeviceListFindByIDs(list, data->domain, data->bus,
+                                      data->slot, data->function)) {
+            fprintf(stderr, "Device still present in list\n");
+            goto cleanup;
+        }
+    }
+
+    ret = 0;
+ cleanup:
+    virPCIDeviceFree(dev);
+    virObjectUnref(list);
+    ignore_value(virPCIDeviceCacheSetEnabled(false));
+    return ret;
+}
+
 static int
 testVirPCIDeviceDetachSingle(const void *opaque)
 {
@@ -446,6 +499,8 @@ mymain(void)
     DO_TEST_PCI(testVirPCIDeviceReattachSingle, 0, 0x0a, 3, 0);
     DO_TEST_PCI_DRIVER(0, 0x0a, 3, 0, NULL);
 
+    DO_TEST_PCI(testVirPCIDeviceCache, 5, 0x90, 1, 0);
+
     if (getenv("LIBVIRT_SKIP_CLEANUP") == NULL)
         virFileDeleteTree(fakerootdir);
 
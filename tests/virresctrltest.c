@@ -77,6 +77,58 @@ test_virResctrlGetUnused(const void *opaque)
 }
 
 
+static int
+test_virResctrlMonitorGetStats(const void *opaque ATTRIBUTE_UNUSED)
+{
+    char *resctrl_dir = NULL;
+    const char *features[] = {"llc_occupancy", "mbm_total_bytes",
+                              "mbm_local_bytes", NULL};
+    virResctrlMonitorPtr monitor = NULL;
+    virResctrlMonitorStatsPtr *stats = NULL;
+    size_t nstats = 0;
+    int ret = -1;
+
+    if (virAsprintf(&resctrl_dir, "%s/virresctrldata/monitor",
+                    abs_srcdir) < 0)
+        goto cleanup;
+
+    virFileWrapperAddPrefix("/sys/fs/resctrl", resctrl_dir);
+
+    if (!(monitor = virResctrlMonitorNew()) ||
+        virResctrlMonitorSetID(monitor, "domain") < 0 ||
+        virResctrlMonitorDeterminePath(monitor, "qemu-1-test") < 0 ||
+        virResctrlMonitorGetStats(monitor, features, &stats, &nstats) < 0)
+        goto cleanup;
+
+    if (nstats != 2 ||
+        stats[0]->id != 0 || stats[1]->id != 1) {
+        VIR_TEST_DEBUG("Unexpected cache banks\n");
+        goto cleanup;
+    }
+
+    /* mbm_local_bytes is not provided by the fake host */
+    if (stats[0]->nvals != 2 ||
+        STRNEQ(stats[0]->features[0], "llc_occupancy") ||
+        stats[0]->vals[0] != 1146880 ||
+        STRNEQ(stats[0]->features[1], "mbm_total_bytes") ||
+        stats[0]->vals[1] != 8681062400ULL ||
+        stats[1]->nvals != 2 ||
+        stats[1]->vals[0] != 491520 ||
+        stats[1]->vals[1] != 23068672) {
+        VIR_TEST_DEBUG("Unexpected monitor statistics\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virFileWrapperClearPrefixes();
+    virResctrlMonitorFreeStats(stats, nstats);
+    virObjectUnref(monitor);
+    VIR_FREE(resctrl_dir);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -95,6 +147,9 @@ mymain(void)
     DO_TEST_UNUSED("resctrl-skx");
     DO_TEST_UNUSED("resctrl-skx-twocaches");
 
+    if (virTestRun("Monitor stats", test_virResctrlMonitorGetStats, NULL) < 0)
+        ret = -1;
+
     return ret;
 }
 
@@ -24,6 +24,7 @@
 #include <fcntl.h>
 
 #include "virrotatingfile.h"
+#include "virfile.h"
 #include "virlog.h"
 #include "testutils.h"
 
@@ -380,6 +381,68 @@ static int testRotatingFileWriterRolloverOne(const void *data ATTRIBUTE_UNUSED)
 }
 
 
+static int testRotatingFileWriterRolloverFD(const void *data ATTRIBUTE_UNUSED)
+{
+    virRotatingFileWriterPtr file;
+    int ret = -1;
+    int pipefd[2] = { -1, -1 };
+    char buf[512];
+    size_t i;
+    ssize_t len;
+    size_t total = 0;
+
+    if (testRotatingFileInitFiles((off_t)-1,
+                                  (off_t)-1,
+                                  (off_t)-1) < 0)
+        return -1;
+
+    file = virRotatingFileWriterNew(FILENAME,
+                                    1024,
+                                    2,
+                                    false,
+                                    0700);
+    if (!file)
+        goto cleanup;
+
+    if (pipe(pipefd) < 0 ||
+        virSetNonBlock(pipefd[0]) < 0)
+        goto cleanup;
+
+    memset(buf, 0x5e, sizeof(buf));
+
+    for (i = 0; i < 3; i++) {
+        if (safewrite(pipefd[1], buf, sizeof(buf)) != sizeof(buf))
+            goto cleanup;
+    }
+
+    /* Deliberately not a divisor of the file size, so that both
+     * the spliced and the bounce buffer paths get exercised */
+    while ((len = virRotatingFileWriterAppendFD(file, pipefd[0], 600)) > 0)
+        total += len;
+
+    if (len < 0 || total != 3 * sizeof(buf)) {
+        fprintf(stderr, "Expected %zu bytes transferred not %zu\n",
+                3 * sizeof(buf), total);
+        goto cleanup;
+    }
+
+    if (testRotatingFileWriterAssertFileSizes(512,
+                                              1024,
+                                              (off_t)-1) < 0)
+        goto cleanup;
+
+    ret = 0;
+ cleanup:
+    VIR_FORCE_CLOSE(pipefd[0]);
+    VIR_FORCE_CLOSE(pipefd[1]);
+    virRotatingFileWriterFree(file);
+    unlink(FILENAME);
+    unlink(FILENAME0);
+    unlink(FILENAME1);
+    return ret;
+}
+
+
 static int testRotatingFileWriterRolloverAppend(const void *data ATTRIBUTE_UNUSED)
 {
     virRotatingFileWriterPtr file;
@@ -713,6 +776,9 @@ mymain(void)
     if (virTestRun("Rotating file write rollover one", testRotatingFileWriterRolloverOne, NULL) < 0)
         ret = -1;
 
+    if (virTestRun("Rotating file write rollover from pipe", testRotatingFileWriterRolloverFD, NULL) < 0)
+        ret = -1;
+
     if (virTestRun("Rotating file write rollover append", testRotatingFileWriterRolloverAppend, NULL) < 0)
         ret = -1;
 
@@ -792,6 +792,48 @@ static int testFilterChars(const void *args)
     return ret;
 }
 
+static int
+testStringIntern(const void *args ATTRIBUTE_UNUSED)
+{
+    const char *a = NULL;
+    const char *b = NULL;
+    const char *c = NULL;
+    const char *d = NULL;
+    int ret = -1;
+
+    if (!(a = virStringIntern("rd_bytes")) ||
+        !(b = virStringInternLen("rd_bytes, wr_bytes", 8)) ||
+        !(c = virStringIntern("wr_bytes")))
+        goto cleanup;
+
+    if (a != b || a == c || STRNEQ(a, "rd_bytes") || STRNEQ(c, "wr_bytes")) {
+        fprintf(stderr, "Unexpected interned strings '%s' '%s' '%s'\n",
+                a, b, c);
+        goto cleanup;
+    }
+
+    /* the string stays around until the last reference is released */
+    virStringInternRelease(b);
+    b = NULL;
+    if (!(d = virStringIntern("rd_bytes")))
+        goto cleanup;
+
+    if (d != a) {
+        fprintf(stderr, "String was not shared after a release\n");
+        goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virStringInternRelease(a);
+    virStringInternRelease(b);
+    virStringInternRelease(c);
+    virStringInternRelease(d);
+    return ret;
+}
+
+
 static int
 mymain(void)
 {
@@ -1126,6 +1168,9 @@ mymain(void)
     TEST_FILTER_CHARS(NULL, NULL, NULL);
     TEST_FILTER_CHARS("hello 123 hello", "helo", "hellohello");
 
+    if (virTestRun("virStringIntern", testStringIntern, NULL) < 0)
+        ret = -1;
+
     return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
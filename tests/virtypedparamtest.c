@@ -125,6 +125,51 @@ testTypedParamsFilter(const void *opaque ATTRIBUTE_UNUSED)
     return rv;
 }
 
+static int
+testTypedParamsIndex(const void *opaque ATTRIBUTE_UNUSED)
+{
+    int rv = -1;
+    unsigned int ui;
+    const char *str = NULL;
+    virTypedParamsIndexPtr idx = NULL;
+    virTypedParameter params[] = {
+        { .field = "bar", .type = VIR_TYPED_PARAM_UINT,
+          .value = { .ui = 1 } },
+        { .field = "foo", .type = VIR_TYPED_PARAM_STRING,
+          .value = { .s = (char*)"foo1"} },
+        { .field = "bar", .type = VIR_TYPED_PARAM_UINT,
+          .value = { .ui = 2 } },
+        { .field = "foobar", .type = VIR_TYPED_PARAM_INT }
+    };
+
+    if (!(idx = virTypedParamsIndexNew(params, ARRAY_CARDINALITY(params))))
+        goto cleanup;
+
+    /* the first occurrence wins, as with virTypedParamsGet */
+    if (virTypedParamsIndexGet(idx, "bar") != &params[0] ||
+        virTypedParamsIndexGet(idx, "foobar") != &params[3] ||
+        virTypedParamsIndexGet(idx, "zzz") != NULL)
+        goto cleanup;
+
+    if (virTypedParamsIndexGetUInt(idx, "bar", &ui) != 1 || ui != 1)
+        goto cleanup;
+
+    if (virTypedParamsIndexGetString(idx, "foo", &str) != 1 ||
+        STRNEQ_NULLABLE(str, "foo1"))
+        goto cleanup;
+
+    if (virTypedParamsIndexGetString(idx, "zzz", &str) != 0)
+        goto cleanup;
+
+    if (virTypedParamsIndexGetUInt(idx, "foobar", &ui) != -1)
+        goto cleanup;
+
+    rv = 0;
+ cleanup:
+    virTypedParamsIndexFree(idx);
+    return rv;
+}
+
 static int
 testTypedParamsAddStringList(const void *opaque ATTRIBUTE_UNUSED)
 {
@@ -301,6 +346,9 @@ mymain(void)
     if (virTestRun("Add string list", testTypedParamsAddStringList, NULL) < 0)
         rv = -1;
 
+    if (virTestRun("Index", testTypedParamsIndex, NULL) < 0)
+        rv = -1;
+
     if (rv < 0)
         return EXIT_FAILURE;
     return EXIT_SUCCESS;
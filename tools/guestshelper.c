@@ -0,0 +1,664 @@
+/*
+ * guestshelper.c: shut down, save or start many guests concurrently
+ *                 on behalf of libvirt-guests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ *
+ * The guests are handled by a pool of worker threads, one request in
+ * flight per thread. Completion of a shutdown is learned from the
+ * lifecycle events delivered to the main thread, the domains are never
+ * polled.
+ */
+
+#include <config.h>
+
+#include <getopt.h>
+#include <stdlib.h>
+
+#include "internal.h"
+#include "viralloc.h"
+#include "virerror.h"
+#include "virgettext.h"
+#include "virstring.h"
+#include "virthread.h"
+#include "virtime.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Longest wait for the host load to drop before a guest is started
+ * anyway, in milliseconds */
+#define GUESTS_HELPER_LOAD_WAIT (300 * 1000)
+
+/* Interval of the progress messages while shutting down, in milliseconds */
+#define GUESTS_HELPER_PROGRESS 5000
+
+typedef enum {
+    GUESTS_HELPER_SHUTDOWN,
+    GUESTS_HELPER_SAVE,
+    GUESTS_HELPER_START,
+
+    GUESTS_HELPER_LAST
+} guestsHelperAction;
+
+VIR_ENUM_DECL(guestsHelperAction)
+VIR_ENUM_IMPL(guestsHelperAction, GUESTS_HELPER_LAST,
+              "shutdown",
+              "save",
+              "start")
+
+typedef enum {
+    GUEST_PENDING,
+    GUEST_ACTIVE,
+    GUEST_DONE,
+    GUEST_FAILED,
+} guestState;
+
+typedef struct _guestsHelperGuest guestsHelperGuest;
+typedef guestsHelperGuest *guestsHelperGuestPtr;
+struct _guestsHelperGuest {
+    const char *uuid;
+    virDomainPtr dom;
+    const char *name;
+    guestState state;
+};
+
+typedef struct _guestsHelper guestsHelper;
+typedef guestsHelper *guestsHelperPtr;
+struct _guestsHelper {
+    virConnectPtr conn;
+    guestsHelperAction action;
+    unsigned int flags;
+    bool syncTime;
+    unsigned long long deadline;  /* shutdown, 0 for no timeout */
+    unsigned int delay;           /* start, milliseconds */
+    double maxload;               /* start, 0 for no limit */
+
+    virMutex lock;
+    virCond cond;                 /* signalled when a shutdown completes */
+    guestsHelperGuestPtr guests;
+    size_t nguests;
+    size_t next;                  /* first guest no worker took yet */
+    size_t nworkers;              /* workers still running */
+    unsigned long long nextStart;
+    bool timedOut;
+    bool failed;
+
+    int wakeTimer;
+    bool quit;
+};
+
+
+static void
+guestsHelperResetError(guestsHelperGuestPtr guest)
+{
+    fprintf(stderr, _("%s: %s\n"), NULLSTR(guest->name),
+            virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
+static void
+guestsHelperDomainLifecycle(virConnectPtr conn ATTRIBUTE_UNUSED,
+                            virDomainPtr dom,
+                            int event,
+                            int detail ATTRIBUTE_UNUSED,
+                            void *opaque)
+{
+    guestsHelperPtr helper = opaque;
+    char uuid[VIR_UUID_STRING_BUFLEN];
+    size_t i;
+
+    if (event != VIR_DOMAIN_EVENT_STOPPED ||
+        virDomainGetUUIDString(dom, uuid) < 0)
+        return;
+
+    virMutexLock(&helper->lock);
+    for (i = 0; i < helper->nguests; i++) {
+        guestsHelperGuestPtr guest = &helper->guests[i];
+
+        if (guest->state == GUEST_ACTIVE && STREQ(guest->uuid, uuid)) {
+            guest->state = GUEST_DONE;
+            virCondBroadcast(&helper->cond);
+            break;
+        }
+    }
+    virMutexUnlock(&helper->lock);
+}
+
+
+/* Returns 1 if the shutdown completed, 0 if the guest was still running
+ * at the deadline and -1 on error. */
+static int
+guestsHelperShutdown(guestsHelperPtr helper,
+                     guestsHelperGuestPtr guest)
+{
+    int ret = -1;
+    int active;
+
+    printf(_("Starting shutdown on guest: %s\n"), guest->name);
+
+    /* The lifecycle callback is registered already, so a guest which
+     * stops from now on can't be missed */
+    virMutexLock(&helper->lock);
+    guest->state = GUEST_ACTIVE;
+    virMutexUnlock(&helper->lock);
+
+    if (virDomainShutdown(guest->dom) < 0) {
+        /* it may have stopped on its own in the meantime */
+        if ((active = virDomainIsActive(guest->dom)) != 0)
+            return -1;
+        virResetLastError();
+        goto done;
+    }
+
+    virMutexLock(&helper->lock);
+    while (guest->state == GUEST_ACTIVE && !helper->timedOut) {
+        if (helper->deadline) {
+            if (virCondWaitUntil(&helper->cond, &helper->lock,
+                                 helper->deadline) < 0) {
+                if (errno != ETIMEDOUT)
+                    break;
+                if (!helper->timedOut) {
+                    printf("%s\n",
+                           _("Timeout expired while shutting down domains"));
+                    helper->timedOut = true;
+                }
+            }
+        } else if (virCondWait(&helper->cond, &helper->lock) < 0) {
+            break;
+        }
+    }
+    ret = guest->state == GUEST_DONE ? 1 : 0;
+    virMutexUnlock(&helper->lock);
+
+    if (ret == 0) {
+        printf(_("Shutdown of guest %s failed to complete in time.\n"),
+               guest->name);
+        return 0;
+    }
+
+ done:
+    printf(_("Shutdown of guest %s complete.\n"), guest->name);
+    return 1;
+}
+
+
+static int
+guestsHelperSave(guestsHelperPtr helper,
+                 guestsHelperGuestPtr guest)
+{
+    printf(_("Suspending %s: ...\n"), guest->name);
+
+    if (virDomainManagedSave(guest->dom, helper->flags) < 0)
+        return -1;
+
+    printf(_("Suspending %s: done\n"), guest->name);
+    return 1;
+}
+
+
+static int
+guestsHelperGetLoad(double *load)
+{
+#ifdef HAVE_GETLOADAVG
+    if (getloadavg(load, 1) == 1)
+        return 0;
+#endif
+    return -1;
+}
+
+
+/* Spaces the starts by the configured delay and holds them back while
+ * the host is loaded above the limit, for at most
+ * GUESTS_HELPER_LOAD_WAIT. Called with the lock held. */
+static void
+guestsHelperStartWait(guestsHelperPtr helper)
+{
+    unsigned long long now;
+    unsigned long long giveUp;
+    double load;
+
+    if (virTimeMillisNow(&now) < 0) {
+        virResetLastError();
+        return;
+    }
+    giveUp = now + GUESTS_HELPER_LOAD_WAIT;
+
+    while (now < helper->nextStart ||
+           (helper->maxload > 0 && now < giveUp &&
+            guestsHelperGetLoad(&load) == 0 && load > helper->maxload)) {
+        /* check the load again every second */
+        unsigned long long until = now + 1000;
+
+        if (now < helper->nextStart)
+            until = helper->nextStart;
+
+        /* nobody signals the condition while starting, it only releases
+         * the lock for the other workers while this one waits */
+        ignore_value(virCondWaitUntil(&helper->cond, &helper->lock, until));
+
+        if (virTimeMillisNow(&now) < 0) {
+            virResetLastError();
+            return;
+        }
+    }
+
+    helper->nextStart = now + helper->delay;
+}
+
+
+static int
+guestsHelperStart(guestsHelperPtr helper,
+                  guestsHelperGuestPtr guest)
+{
+    int active;
+
+    if ((active = virDomainIsActive(guest->dom)) < 0)
+        return -1;
+
+    if (active) {
+        printf(_("Resuming guest %s: already active\n"), guest->name);
+        return 1;
+    }
+
+    virMutexLock(&helper->lock);
+    guestsHelperStartWait(helper);
+    virMutexUnlock(&helper->lock);
+
+    if (virDomainCreateWithFlags(guest->dom, helper->flags) < 0)
+        return -1;
+
+    printf(_("Resuming guest %s: done\n"), guest->name);
+
+    if (helper->syncTime &&
+        virDomainSetTime(guest->dom, 0, 0, VIR_DOMAIN_TIME_SYNC) < 0)
+        virResetLastError();
+
+    return 1;
+}
+
+
+static void
+guestsHelperWorker(void *opaque)
+{
+    guestsHelperPtr helper = opaque;
+
+    virMutexLock(&helper->lock);
+
+    while (helper->next < helper->nguests && !helper->timedOut) {
+        guestsHelperGuestPtr guest = &helper->guests[helper->next++];
+        int rc = -1;
+
+        virMutexUnlock(&helper->lock);
+
+        if ((guest->dom = virDomainLookupByUUIDString(helper->conn,
+                                                      guest->uuid)) &&
+            (guest->name = virDomainGetName(guest->dom))) {
+            switch (helper->action) {
+            case GUESTS_HELPER_SHUTDOWN:
+                rc = guestsHelperShutdown(helper, guest);
+                break;
+            case GUESTS_HELPER_SAVE:
+                rc = guestsHelperSave(helper, guest);
+                break;
+            case GUESTS_HELPER_START:
+                rc = guestsHelperStart(helper, guest);
+                break;
+            case GUESTS_HELPER_LAST:
+                break;
+            }
+        }
+
+        if (rc < 0)
+            guestsHelperResetError(guest);
+
+        virMutexLock(&helper->lock);
+        if (rc > 0) {
+            guest->state = GUEST_DONE;
+        } else {
+            guest->state = GUEST_FAILED;
+            helper->failed = true;
+        }
+    }
+
+    /* the last one out wakes up the event loop */
+    if (--helper->nworkers == 0)
+        virEventUpdateTimeout(helper->wakeTimer, 0);
+
+    virMutexUnlock(&helper->lock);
+}
+
+
+static void
+guestsHelperWakeTimer(int timer ATTRIBUTE_UNUSED,
+                      void *opaque)
+{
+    guestsHelperPtr helper = opaque;
+
+    virMutexLock(&helper->lock);
+    if (helper->nworkers == 0)
+        helper->quit = true;
+    virMutexUnlock(&helper->lock);
+}
+
+
+static void
+guestsHelperProgressTimer(int timer ATTRIBUTE_UNUSED,
+                          void *opaque)
+{
+    guestsHelperPtr helper = opaque;
+    unsigned long long now;
+    size_t left = 0;
+    size_t i;
+
+    virMutexLock(&helper->lock);
+    for (i = 0; i < helper->nguests; i++) {
+        if (helper->guests[i].state == GUEST_PENDING ||
+            helper->guests[i].state == GUEST_ACTIVE)
+            left++;
+    }
+
+    if (left && !helper->timedOut) {
+        if (helper->deadline && virTimeMillisNow(&now) == 0) {
+            printf(_("Waiting for %zu guests to shut down, %llu seconds left\n"),
+                   left, now < helper->deadline ?
+                   (helper->deadline - now) / 1000 : 0);
+        } else {
+            printf(_("Waiting for %zu guests to shut down\n"), left);
+        }
+    }
+    virMutexUnlock(&helper->lock);
+}
+
+
+static void
+guestsHelperConnectClosed(virConnectPtr conn ATTRIBUTE_UNUSED,
+                          int reason ATTRIBUTE_UNUSED,
+                          void *opaque)
+{
+    guestsHelperPtr helper = opaque;
+
+    fprintf(stderr, "%s", _("connection to the hypervisor was closed\n"));
+
+    /* wake up the workers waiting for shutdowns, no event will come */
+    virMutexLock(&helper->lock);
+    helper->timedOut = true;
+    helper->failed = true;
+    virCondBroadcast(&helper->cond);
+    virMutexUnlock(&helper->lock);
+}
+
+
+static void
+show_help(FILE *out, const char *argv0)
+{
+    fprintf(out,
+            _("\n"
+              "syntax: %s [OPTIONS] shutdown|save|start UUID...\n"
+              "\n"
+              " Options:\n"
+              "   -c, --connect URI      Hypervisor connection URI\n"
+              "   -p, --parallel N       Number of guests handled at once,\n"
+              "                          0 for all of them (default 0)\n"
+              "   -t, --timeout SECS     Time limit for shutting down all\n"
+              "                          the guests, 0 for none (default 0)\n"
+              "   -d, --delay SECS       Minimum delay between starts\n"
+              "   -l, --max-load LOAD    Hold starts while the load average\n"
+              "                          of the host is above LOAD\n"
+              "   -b, --bypass-cache     Bypass the file system cache\n"
+              "   -s, --sync-time        Sync the time of started guests\n"
+              "   -h, --help             Display command line help\n"
+              "   -v, --version          Display command version\n"
+              "\n"),
+            argv0);
+}
+
+static void
+show_version(FILE *out, const char *argv0)
+{
+    fprintf(out, "version: %s %s\n", argv0, VERSION);
+}
+
+static const struct option argOptions[] = {
+    { "connect", 1, NULL, 'c', },
+    { "parallel", 1, NULL, 'p', },
+    { "timeout", 1, NULL, 't', },
+    { "delay", 1, NULL, 'd', },
+    { "max-load", 1, NULL, 'l', },
+    { "bypass-cache", 0, NULL, 'b', },
+    { "sync-time", 0, NULL, 's', },
+    { "help", 0, NULL, 'h', },
+    { "version", 0, NULL, 'v', },
+    { NULL, 0, NULL, '\0', }
+};
+
+int
+main(int argc, char **argv)
+{
+    guestsHelper helper = { 0 };
+    const char *uri = NULL;
+    unsigned int parallel = 0;
+    unsigned int timeout = 0;
+    bool bypassCache = false;
+    virThreadPtr workers = NULL;
+    size_t nworkers = 0;
+    int lifecycleID = -1;
+    int progressTimer = -1;
+    int action;
+    int ret = EXIT_FAILURE;
+    size_t i;
+    int c;
+
+    if (virGettextInitialize() < 0 ||
+        virInitialize() < 0)
+        return EXIT_FAILURE;
+
+    while ((c = getopt_long(argc, argv, "c:p:t:d:l:bshv",
+                            argOptions, NULL)) != -1) {
+        switch (c) {
+        case 'c':
+            uri = optarg;
+            break;
+
+        case 'p':
+            if (virStrToLong_uip(optarg, NULL, 10, &parallel) < 0) {
+                fprintf(stderr, _("%s: invalid number of guests '%s'\n"),
+                        argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 't':
+            if (virStrToLong_uip(optarg, NULL, 10, &timeout) < 0) {
+                fprintf(stderr, _("%s: invalid timeout '%s'\n"),
+                        argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'd':
+            if (virStrToLong_uip(optarg, NULL, 10, &helper.delay) < 0 ||
+                helper.delay > UINT_MAX / 1000) {
+                fprintf(stderr, _("%s: invalid delay '%s'\n"),
+                        argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            helper.delay *= 1000;
+            break;
+
+        case 'l':
+            if (virStrToDouble(optarg, NULL, &helper.maxload) < 0 ||
+                helper.maxload < 0) {
+                fprintf(stderr, _("%s: invalid load '%s'\n"),
+                        argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'b':
+            bypassCache = true;
+            break;
+
+        case 's':
+            helper.syncTime = true;
+            break;
+
+        case 'v':
+            show_version(stdout, argv[0]);
+            return EXIT_SUCCESS;
+
+        case 'h':
+            show_help(stdout, argv[0]);
+            return EXIT_SUCCESS;
+
+        case '?':
+        default:
+            show_help(stderr, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind >= argc ||
+        (action = guestsHelperActionTypeFromString(argv[optind])) < 0) {
+        show_help(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+    helper.action = action;
+    helper.wakeTimer = -1;
+    optind++;
+
+    if (optind == argc)
+        return EXIT_SUCCESS;
+
+    if (bypassCache) {
+        if (helper.action == GUESTS_HELPER_SAVE)
+            helper.flags |= VIR_DOMAIN_SAVE_BYPASS_CACHE;
+        else if (helper.action == GUESTS_HELPER_START)
+            helper.flags |= VIR_DOMAIN_START_BYPASS_CACHE;
+    }
+
+    /* one output line per guest, even when redirected to a log */
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    if (virMutexInit(&helper.lock) < 0 ||
+        virCondInit(&helper.cond) < 0) {
+        fprintf(stderr, _("%s: cannot initialize locks\n"), argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    helper.nguests = argc - optind;
+    if (VIR_ALLOC_N(helper.guests, helper.nguests) < 0)
+        goto cleanup;
+    for (i = 0; i < helper.nguests; i++)
+        helper.guests[i].uuid = argv[optind + i];
+
+    if (virEventRegisterDefaultImpl() < 0 ||
+        (helper.wakeTimer = virEventAddTimeout(-1, guestsHelperWakeTimer,
+                                               &helper, NULL)) < 0)
+        goto cleanup;
+
+    if (!(helper.conn = virConnectOpen(uri)))
+        goto cleanup;
+
+    if (virConnectRegisterCloseCallback(helper.conn,
+                                        guestsHelperConnectClosed,
+                                        &helper, NULL) < 0)
+        goto cleanup;
+
+    if (helper.action == GUESTS_HELPER_SHUTDOWN) {
+        if ((lifecycleID = virConnectDomainEventRegisterAny(helper.conn, NULL,
+                                                            VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                                            VIR_DOMAIN_EVENT_CALLBACK(guestsHelperDomainLifecycle),
+                                                            &helper, NULL)) < 0)
+            goto cleanup;
+
+        if ((progressTimer = virEventAddTimeout(GUESTS_HELPER_PROGRESS,
+                                                guestsHelperProgressTimer,
+                                                &helper, NULL)) < 0)
+            goto cleanup;
+
+        if (timeout) {
+            if (virTimeMillisNow(&helper.deadline) < 0)
+                goto cleanup;
+            helper.deadline += timeout * 1000ULL;
+        }
+    }
+
+    if (parallel == 0 || parallel > helper.nguests)
+        parallel = helper.nguests;
+
+    if (VIR_ALLOC_N(workers, parallel) < 0)
+        goto cleanup;
+
+    virMutexLock(&helper.lock);
+    for (nworkers = 0; nworkers < parallel; nworkers++) {
+        if (virThreadCreate(&workers[nworkers], true,
+                            guestsHelperWorker, &helper) < 0) {
+            virReportSystemError(errno, "%s",
+                                 _("Unable to create worker thread"));
+            helper.next = helper.nguests;
+            break;
+        }
+        helper.nworkers++;
+    }
+    if (helper.nworkers == 0)
+        helper.quit = true;
+    virMutexUnlock(&helper.lock);
+
+    /* the events and keepalives of the connection are processed here
+     * while the workers wait for the hypervisor */
+    while (!helper.quit) {
+        if (virEventRunDefaultImpl() < 0) {
+            virMutexLock(&helper.lock);
+            helper.timedOut = true;
+            virCondBroadcast(&helper.cond);
+            virMutexUnlock(&helper.lock);
+            break;
+        }
+    }
+
+    for (i = 0; i < nworkers; i++)
+        virThreadJoin(&workers[i]);
+
+    if (nworkers == parallel && !helper.failed)
+        ret = EXIT_SUCCESS;
+
+ cleanup:
+    if (ret != EXIT_SUCCESS && virGetLastError())
+        fprintf(stderr, _("%s: %s\n"), argv[0], virGetLastErrorMessage());
+
+    VIR_FREE(workers);
+    if (progressTimer >= 0)
+        virEventRemoveTimeout(progressTimer);
+    if (helper.wakeTimer >= 0)
+        virEventRemoveTimeout(helper.wakeTimer);
+    for (i = 0; i < helper.nguests; i++) {
+        if (helper.guests[i].dom)
+            virDomainFree(helper.guests[i].dom);
+    }
+    VIR_FREE(helper.guests);
+    if (helper.conn) {
+        if (lifecycleID >= 0)
+            virConnectDomainEventDeregisterAny(helper.conn, lifecycleID);
+        virConnectUnregisterCloseCallback(helper.conn,
+                                          guestsHelperConnectClosed);
+        virConnectClose(helper.conn);
+    }
+    virCondDestroy(&helper.cond);
+    virMutexDestroy(&helper.lock);
+
+    return ret;
+}
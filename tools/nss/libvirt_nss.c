@@ -76,12 +76,47 @@ do { \
 #define LIBVIRT_ALIGN(x) (((x) + __SIZEOF_POINTER__ - 1) & ~(__SIZEOF_POINTER__ - 1))
 #define FAMILY_ADDRESS_SIZE(family) ((family) == AF_INET6 ? 16 : 4)
 
+#if !defined(LIBVIRT_NSS_GUEST)
+# define LEASE_INDEX_KEY VIR_LEASE_INDEX_KEY_HOSTNAME
+#else
+# define LEASE_INDEX_KEY VIR_LEASE_INDEX_KEY_DOMAIN
+#endif
+
 typedef struct {
     unsigned char addr[16];
     int af;
 } leaseAddress;
 
 
+static int
+appendAddrRaw(leaseAddress **tmpAddress,
+              size_t *ntmpAddress,
+              int family,
+              const void *addr)
+{
+    size_t i;
+
+    for (i = 0; i < *ntmpAddress; i++) {
+        if (memcmp((*tmpAddress)[i].addr, addr,
+                   FAMILY_ADDRESS_SIZE(family)) == 0) {
+            DEBUG("IP address already in the list");
+            return 0;
+        }
+    }
+
+    if (VIR_REALLOC_N_QUIET(*tmpAddress, *ntmpAddress + 1) < 0) {
+        ERROR("Out of memory");
+        return -1;
+    }
+
+    (*tmpAddress)[*ntmpAddress].af = family;
+    memcpy((*tmpAddress)[*ntmpAddress].addr, addr,
+           FAMILY_ADDRESS_SIZE(family));
+    (*ntmpAddress)++;
+    return 0;
+}
+
+
 static int
 appendAddr(leaseAddress **tmpAddress,
            size_t *ntmpAddress,
@@ -92,7 +127,6 @@ appendAddr(leaseAddress **tmpAddress,
     const char *ipAddr;
     virSocketAddr sa;
     int family;
-    size_t i;
 
     if (!(ipAddr = virJSONValueObjectGetString(lease, "ip-address"))) {
         ERROR("ip-address field missing for %s", name);
@@ -113,31 +147,10 @@ appendAddr(leaseAddress **tmpAddress,
         goto cleanup;
     }
 
-    for (i = 0; i < *ntmpAddress; i++) {
-        if (memcmp((*tmpAddress)[i].addr,
-                   (family == AF_INET ?
-                    (void *) &sa.data.inet4.sin_addr.s_addr :
-                    (void *) &sa.data.inet6.sin6_addr.s6_addr),
-                   FAMILY_ADDRESS_SIZE(family)) == 0) {
-            DEBUG("IP address already in the list");
-            ret = 0;
-            goto cleanup;
-        }
-    }
-
-    if (VIR_REALLOC_N_QUIET(*tmpAddress, *ntmpAddress + 1) < 0) {
-        ERROR("Out of memory");
-        goto cleanup;
-    }
-
-    (*tmpAddress)[*ntmpAddress].af = family;
-    memcpy((*tmpAddress)[*ntmpAddress].addr,
-           (family == AF_INET ?
-            (void *) &sa.data.inet4.sin_addr.s_addr :
-            (void *) &sa.data.inet6.sin6_addr.s6_addr),
-           FAMILY_ADDRESS_SIZE(family));
-    (*ntmpAddress)++;
-    ret = 0;
+    ret = appendAddrRaw(tmpAddress, ntmpAddress, family,
+                        (family == AF_INET ?
+                         (void *) &sa.data.inet4.sin_addr.s_addr :
+                         (void *) &sa.data.inet6.sin6_addr.s6_addr));
  cleanup:
     return ret;
 }
@@ -215,6 +228,78 @@ findLeaseInJSON(leaseAddress **tmpAddress,
 }
 
 
+/**
+ * findLeaseInIndex:
+ * @tmpAddress: array of addresses to append to
+ * @ntmpAddress: number of elements in @tmpAddress
+ * @name: domain name to lookup
+ * @af: address family
+ * @found: whether @name has been found
+ *
+ * Lookup @name in the lease index maintained by libvirt, which
+ * doesn't require reading the lease files.
+ *
+ * Returns -1 if the index is missing or unusable
+ *          0 on success
+ */
+static int
+findLeaseInIndex(leaseAddress **tmpAddress,
+                 size_t *ntmpAddress,
+                 const char *name,
+                 int af,
+                 bool *found)
+{
+    virLeaseIndexPtr idx;
+    const virLeaseIndexRecord *records;
+    size_t nrecords;
+    size_t i;
+    time_t currtime;
+    int ret = -1;
+
+    if (!(idx = virLeaseIndexOpen(LEASEDIR VIR_LEASE_INDEX_FILE))) {
+        DEBUG("No usable lease index");
+        return -1;
+    }
+
+    if ((currtime = time(NULL)) == (time_t) - 1) {
+        ERROR("Failed to get current system time");
+        goto cleanup;
+    }
+
+    if (virLeaseIndexLookup(idx, LEASE_INDEX_KEY, name,
+                            &records, &nrecords) < 0) {
+        ERROR("Lease index is corrupted");
+        goto cleanup;
+    }
+
+    for (i = 0; i < nrecords; i++) {
+        /* Do not report expired lease */
+        if (records[i].expirytime < (long long) currtime) {
+            DEBUG("Skipping expired lease for %s", name);
+            continue;
+        }
+
+        DEBUG("Found record for %s", name);
+        *found = true;
+
+        if (af != AF_UNSPEC && af != records[i].family) {
+            DEBUG("Skipping address which family is %d, %d requested",
+                  records[i].family, af);
+            continue;
+        }
+
+        if (appendAddrRaw(tmpAddress, ntmpAddress,
+                          records[i].family, records[i].addr) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+ cleanup:
+    virLeaseIndexClose(idx);
+    return ret;
+}
+
+
 /**
  * findLease:
  * @name: domain name to lookup
@@ -263,6 +348,14 @@ findLease(const char *name,
         goto cleanup;
     }
 
+    if (findLeaseInIndex(&tmpAddress, &ntmpAddress, name, af, found) == 0)
+        goto done;
+
+    /* No index, read all the lease files */
+    VIR_FREE(tmpAddress);
+    ntmpAddress = 0;
+    *found = false;
+
     if (virDirOpenQuiet(&dir, leaseDir) < 0) {
         ERROR("Failed to open dir '%s'", leaseDir);
         goto cleanup;
@@ -335,6 +428,7 @@ findLease(const char *name,
 
 #endif /* defined(LIBVIRT_NSS_GUEST) */
 
+ done:
     *address = tmpAddress;
     *naddress = ntmpAddress;
     tmpAddress = NULL;
@@ -0,0 +1,365 @@
+/*
+ * virsh-checkpoint.c: Commands to manage domain checkpoints and backups
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include "virsh-checkpoint.h"
+
+#include "internal.h"
+#include "viralloc.h"
+#include "virfile.h"
+#include "virsh-util.h"
+#include "virstring.h"
+
+/*
+ * "checkpoint-create" command
+ */
+static const vshCmdInfo info_checkpoint_create[] = {
+    {.name = "help",
+     .data = N_("Create a checkpoint from XML")
+    },
+    {.name = "desc",
+     .data = N_("Start tracking the disk changes of a domain from now on.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_checkpoint_create[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    {.name = "xmlfile",
+     .type = VSH_OT_STRING,
+     .help = N_("domain checkpoint XML")
+    },
+    {.name = "redefine",
+     .type = VSH_OT_BOOL,
+     .help = N_("redefine metadata for existing checkpoint")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdCheckpointCreate(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+    bool ret = false;
+    const char *from = NULL;
+    char *buffer = NULL;
+    unsigned int flags = 0;
+
+    if (vshCommandOptBool(cmd, "redefine"))
+        flags |= VIR_DOMAIN_CHECKPOINT_CREATE_REDEFINE;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        goto cleanup;
+
+    if (vshCommandOptStringReq(ctl, cmd, "xmlfile", &from) < 0)
+        goto cleanup;
+    if (!from) {
+        buffer = vshStrdup(ctl, "<domaincheckpoint/>");
+    } else {
+        if (virFileReadAll(from, VSH_MAX_XML_FILE, &buffer) < 0) {
+            vshSaveLibvirtError();
+            goto cleanup;
+        }
+    }
+
+    if (!(checkpoint = virDomainCheckpointCreateXML(dom, buffer, flags)))
+        goto cleanup;
+
+    vshPrintExtra(ctl, _("Domain checkpoint %s created"),
+                  virDomainCheckpointGetName(checkpoint));
+    vshPrintExtra(ctl, "\n");
+    ret = true;
+
+ cleanup:
+    if (checkpoint)
+        virDomainCheckpointFree(checkpoint);
+    VIR_FREE(buffer);
+    virshDomainFree(dom);
+
+    return ret;
+}
+
+/*
+ * "checkpoint-delete" command
+ */
+static const vshCmdInfo info_checkpoint_delete[] = {
+    {.name = "help",
+     .data = N_("Delete a domain checkpoint")
+    },
+    {.name = "desc",
+     .data = N_("Checkpoint Delete")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_checkpoint_delete[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    {.name = "checkpointname",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("checkpoint name")
+    },
+    {.name = "metadata",
+     .type = VSH_OT_BOOL,
+     .help = N_("delete only libvirt metadata, leaving the bitmaps behind")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdCheckpointDelete(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+    bool ret = false;
+    const char *name = NULL;
+    unsigned int flags = 0;
+
+    if (vshCommandOptBool(cmd, "metadata"))
+        flags |= VIR_DOMAIN_CHECKPOINT_DELETE_METADATA_ONLY;
+
+    if (vshCommandOptStringReq(ctl, cmd, "checkpointname", &name) < 0)
+        return false;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (!(checkpoint = virDomainCheckpointLookupByName(dom, name, 0)))
+        goto cleanup;
+
+    if (virDomainCheckpointDelete(checkpoint, flags) < 0) {
+        vshError(ctl, _("Failed to delete checkpoint %s"), name);
+        goto cleanup;
+    }
+
+    vshPrintExtra(ctl, _("Domain checkpoint %s deleted\n"), name);
+    ret = true;
+
+ cleanup:
+    if (checkpoint)
+        virDomainCheckpointFree(checkpoint);
+    virshDomainFree(dom);
+
+    return ret;
+}
+
+/*
+ * "checkpoint-dumpxml" command
+ */
+static const vshCmdInfo info_checkpoint_dumpxml[] = {
+    {.name = "help",
+     .data = N_("Dump XML for a domain checkpoint")
+    },
+    {.name = "desc",
+     .data = N_("Checkpoint Dump XML")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_checkpoint_dumpxml[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    {.name = "checkpointname",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("checkpoint name")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdCheckpointDumpXML(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    virDomainCheckpointPtr checkpoint = NULL;
+    bool ret = false;
+    const char *name = NULL;
+    char *xml = NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, "checkpointname", &name) < 0)
+        return false;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if (!(checkpoint = virDomainCheckpointLookupByName(dom, name, 0)))
+        goto cleanup;
+
+    if (!(xml = virDomainCheckpointGetXMLDesc(checkpoint, 0)))
+        goto cleanup;
+
+    vshPrint(ctl, "%s", xml);
+    ret = true;
+
+ cleanup:
+    VIR_FREE(xml);
+    if (checkpoint)
+        virDomainCheckpointFree(checkpoint);
+    virshDomainFree(dom);
+
+    return ret;
+}
+
+/*
+ * "checkpoint-list" command
+ */
+static const vshCmdInfo info_checkpoint_list[] = {
+    {.name = "help",
+     .data = N_("List checkpoints for a domain")
+    },
+    {.name = "desc",
+     .data = N_("Checkpoint List")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_checkpoint_list[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    {.name = NULL}
+};
+
+static bool
+cmdCheckpointList(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    virDomainCheckpointPtr *checkpoints = NULL;
+    int ncheckpoints;
+    bool ret = false;
+    size_t i;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    if ((ncheckpoints = virDomainListAllCheckpoints(dom, &checkpoints, 0)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ncheckpoints; i++)
+        vshPrint(ctl, "%s\n", virDomainCheckpointGetName(checkpoints[i]));
+
+    ret = true;
+
+ cleanup:
+    if (checkpoints) {
+        for (i = 0; i < ncheckpoints; i++)
+            virDomainCheckpointFree(checkpoints[i]);
+        VIR_FREE(checkpoints);
+    }
+    virshDomainFree(dom);
+
+    return ret;
+}
+
+/*
+ * "backup-begin" command
+ */
+static const vshCmdInfo info_backup_begin[] = {
+    {.name = "help",
+     .data = N_("Start a disk backup of a live domain")
+    },
+    {.name = "desc",
+     .data = N_("Use XML to start a full or incremental disk backup of a live "
+                "domain, optionally creating a checkpoint")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_backup_begin[] = {
+    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    {.name = "backupxml",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("domain backup XML"),
+    },
+    {.name = "checkpointxml",
+     .type = VSH_OT_STRING,
+     .help = N_("domain checkpoint XML"),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdBackupBegin(vshControl *ctl, const vshCmd *cmd)
+{
+    virDomainPtr dom = NULL;
+    bool ret = false;
+    const char *backup_from = NULL;
+    const char *check_from = NULL;
+    char *backup_buffer = NULL;
+    char *check_buffer = NULL;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        goto cleanup;
+
+    if (vshCommandOptStringReq(ctl, cmd, "backupxml", &backup_from) < 0 ||
+        vshCommandOptStringReq(ctl, cmd, "checkpointxml", &check_from) < 0)
+        goto cleanup;
+
+    if (virFileReadAll(backup_from, VSH_MAX_XML_FILE, &backup_buffer) < 0 ||
+        (check_from &&
+         virFileReadAll(check_from, VSH_MAX_XML_FILE, &check_buffer) < 0)) {
+        vshSaveLibvirtError();
+        goto cleanup;
+    }
+
+    if (virDomainBackupBegin(dom, backup_buffer, check_buffer, 0) < 0)
+        goto cleanup;
+
+    vshPrintExtra(ctl, "%s", _("Backup started\n"));
+    ret = true;
+
+ cleanup:
+    VIR_FREE(backup_buffer);
+    VIR_FREE(check_buffer);
+    virshDomainFree(dom);
+
+    return ret;
+}
+
+const vshCmdDef checkpointCmds[] = {
+    {.name = "backup-begin",
+     .handler = cmdBackupBegin,
+     .opts = opts_backup_begin,
+     .info = info_backup_begin,
+     .flags = 0
+    },
+    {.name = "checkpoint-create",
+     .handler = cmdCheckpointCreate,
+     .opts = opts_checkpoint_create,
+     .info = info_checkpoint_create,
+     .flags = 0
+    },
+    {.name = "checkpoint-delete",
+     .handler = cmdCheckpointDelete,
+     .opts = opts_checkpoint_delete,
+     .info = info_checkpoint_delete,
+     .flags = 0
+    },
+    {.name = "checkpoint-dumpxml",
+     .handler = cmdCheckpointDumpXML,
+     .opts = opts_checkpoint_dumpxml,
+     .info = info_checkpoint_dumpxml,
+     .flags = 0
+    },
+    {.name = "checkpoint-list",
+     .handler = cmdCheckpointList,
+     .opts = opts_checkpoint_list,
+     .info = info_checkpoint_list,
+     .flags = 0
+    },
+    {.name = NULL}
+};
@@ -39,6 +39,7 @@
 #include "virmacaddr.h"
 #include "virxml.h"
 #include "virstring.h"
+#include "virjson.h"
 #include "vsh-table.h"
 
 VIR_ENUM_DECL(virshDomainIOError)
@@ -917,7 +918,7 @@ static const vshCmdInfo info_domblkstat[] = {
 };
 
 static const vshCmdOptDef opts_domblkstat[] = {
-    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    VIRSH_COMMON_OPT_DOMAIN_BULK(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
     {.name = "device",
      .type = VSH_OT_STRING,
      .flags = VSH_OFLAG_EMPTY_OK,
@@ -928,6 +929,7 @@ static const vshCmdOptDef opts_domblkstat[] = {
      .type = VSH_OT_BOOL,
      .help = N_("print a more human readable output")
     },
+    VIRSH_COMMON_OPT_BULK,
     {.name = NULL}
 };
 
@@ -963,17 +965,19 @@ static const struct _domblkstat_sequence domblkstat_output[] = {
 
 #define DOMBLKSTAT_LEGACY_PRINT(ID, VALUE) \
     if (VALUE >= 0) \
-        vshPrint(ctl, "%s %-*s %lld\n", device, \
-                 human ? 31 : 0, \
-                 human ? _(domblkstat_output[ID].human) \
-                 : domblkstat_output[ID].legacy, \
-                 VALUE);
+        virBufferAsprintf(buf, "%s %-*s %lld\n", device, \
+                          human ? 31 : 0, \
+                          human ? _(domblkstat_output[ID].human) \
+                          : domblkstat_output[ID].legacy, \
+                          VALUE);
 
 static bool
-cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
+virshDomainFormatBlkstat(vshControl *ctl,
+                         const vshCmd *cmd,
+                         virDomainPtr dom,
+                         virBufferPtr buf)
 {
-    virDomainPtr dom;
-    const char *name = NULL, *device = NULL;
+    const char *device = NULL;
     virDomainBlockStatsStruct stats;
     virTypedParameterPtr params = NULL;
     virTypedParameterPtr par = NULL;
@@ -984,9 +988,6 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
     bool ret = false;
     bool human = vshCommandOptBool(cmd, "human"); /* human readable output */
 
-    if (!(dom = virshCommandOptDomain(ctl, cmd, &name)))
-        return false;
-
     /* device argument is optional now. if it's missing, supply empty
        string to denote 'all devices'. A NULL device arg would violate
        API contract.
@@ -1005,21 +1006,18 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
      */
     if (rc < 0) {
         /* try older API if newer is not supported */
-        if (last_error->code != VIR_ERR_NO_SUPPORT)
+        if (virGetLastErrorCode() != VIR_ERR_NO_SUPPORT)
             goto cleanup;
 
-        vshResetLibvirtError();
+        virResetLastError();
 
         if (virDomainBlockStats(dom, device, &stats,
-                                sizeof(stats)) == -1) {
-            vshError(ctl, _("Failed to get block stats %s %s"),
-                     name, device);
+                                sizeof(stats)) == -1)
             goto cleanup;
-        }
 
         /* human friendly output */
         if (human) {
-            vshPrint(ctl, N_("Device: %s\n"), device);
+            virBufferAsprintf(buf, N_("Device: %s\n"), device);
             device = "";
         }
 
@@ -1031,14 +1029,12 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
     } else {
         params = vshCalloc(ctl, nparams, sizeof(*params));
 
-        if (virDomainBlockStatsFlags(dom, device, params, &nparams, 0) < 0) {
-            vshError(ctl, _("Failed to get block stats for domain '%s' device '%s'"), name, device);
+        if (virDomainBlockStatsFlags(dom, device, params, &nparams, 0) < 0)
             goto cleanup;
-        }
 
         /* set for prettier output */
         if (human) {
-            vshPrint(ctl, N_("Device: %s\n"), device);
+            virBufferAsprintf(buf, N_("Device: %s\n"), device);
             device = "";
         }
 
@@ -1064,8 +1060,8 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
             if (!field)
                 field = domblkstat_output[i].field;
 
-            vshPrint(ctl, "%s %-*s %s\n", device,
-                     human ? 31 : 0, field, value);
+            virBufferAsprintf(buf, "%s %-*s %s\n", device,
+                              human ? 31 : 0, field, value);
 
             VIR_FREE(value);
         }
@@ -1076,7 +1072,7 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
                 continue;
 
             value = vshGetTypedParamValue(ctl, params+i);
-            vshPrint(ctl, "%s %s %s\n", device, params[i].field, value);
+            virBufferAsprintf(buf, "%s %s %s\n", device, params[i].field, value);
             VIR_FREE(value);
         }
     }
@@ -1085,11 +1081,17 @@ cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
 
  cleanup:
     VIR_FREE(params);
-    virshDomainFree(dom);
     return ret;
 }
 #undef DOMBLKSTAT_LEGACY_PRINT
 
+static bool
+cmdDomblkstat(vshControl *ctl, const vshCmd *cmd)
+{
+    return virshDomainBulkRun(ctl, cmd, VIR_CONNECT_LIST_DOMAINS_ACTIVE,
+                              true, virshDomainFormatBlkstat);
+}
+
 /*
  * "domifstat" command
  */
@@ -1098,72 +1100,116 @@ static const vshCmdInfo info_domifstat[] = {
      .data = N_("get network interface stats for a domain")
     },
     {.name = "desc",
-     .data = N_("Get network interface stats for a running domain.")
+     .data = N_("Get network interface stats for a running domain. "
+                "Without an interface, the stats of every interface "
+                "of the domain are reported.")
     },
     {.name = NULL}
 };
 
 static const vshCmdOptDef opts_domifstat[] = {
-    VIRSH_COMMON_OPT_DOMAIN_FULL(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
+    VIRSH_COMMON_OPT_DOMAIN_BULK(VIR_CONNECT_LIST_DOMAINS_ACTIVE),
     {.name = "interface",
-     .type = VSH_OT_DATA,
-     .flags = VSH_OFLAG_REQ,
+     .type = VSH_OT_STRING,
      .completer = virshDomainInterfaceCompleter,
      .help = N_("interface device specified by name or MAC Address")
     },
+    VIRSH_COMMON_OPT_BULK,
     {.name = NULL}
 };
 
 static bool
-cmdDomIfstat(vshControl *ctl, const vshCmd *cmd)
+virshDomainFormatIfstatOne(virDomainPtr dom,
+                           const char *device,
+                           virBufferPtr buf)
 {
-    virDomainPtr dom;
-    const char *name = NULL, *device = NULL;
     virDomainInterfaceStatsStruct stats;
-    bool ret = false;
 
-    if (!(dom = virshCommandOptDomain(ctl, cmd, &name)))
+    if (virDomainInterfaceStats(dom, device, &stats, sizeof(stats)) == -1)
         return false;
 
-    if (vshCommandOptStringReq(ctl, cmd, "interface", &device) < 0)
-        goto cleanup;
-
-    if (virDomainInterfaceStats(dom, device, &stats, sizeof(stats)) == -1) {
-        vshError(ctl, _("Failed to get interface stats %s %s"), name, device);
-        goto cleanup;
-    }
-
     if (stats.rx_bytes >= 0)
-        vshPrint(ctl, "%s rx_bytes %lld\n", device, stats.rx_bytes);
+        virBufferAsprintf(buf, "%s rx_bytes %lld\n", device, stats.rx_bytes);
 
     if (stats.rx_packets >= 0)
-        vshPrint(ctl, "%s rx_packets %lld\n", device, stats.rx_packets);
+        virBufferAsprintf(buf, "%s rx_packets %lld\n", device, stats.rx_packets);
 
     if (stats.rx_errs >= 0)
-        vshPrint(ctl, "%s rx_errs %lld\n", device, stats.rx_errs);
+        virBufferAsprintf(buf, "%s rx_errs %lld\n", device, stats.rx_errs);
 
     if (stats.rx_drop >= 0)
-        vshPrint(ctl, "%s rx_drop %lld\n", device, stats.rx_drop);
+        virBufferAsprintf(buf, "%s rx_drop %lld\n", device, stats.rx_drop);
 
     if (stats.tx_bytes >= 0)
-        vshPrint(ctl, "%s tx_bytes %lld\n", device, stats.tx_bytes);
+        virBufferAsprintf(buf, "%s tx_bytes %lld\n", device, stats.tx_bytes);
 
     if (stats.tx_packets >= 0)
-        vshPrint(ctl, "%s tx_packets %lld\n", device, stats.tx_packets);
+        virBufferAsprintf(buf, "%s tx_packets %lld\n", device, stats.tx_packets);
 
     if (stats.tx_errs >= 0)
-        vshPrint(ctl, "%s tx_errs %lld\n", device, stats.tx_errs);
+        virBufferAsprintf(buf, "%s tx_errs %lld\n", device, stats.tx_errs);
 
     if (stats.tx_drop >= 0)
-        vshPrint(ctl, "%s tx_drop %lld\n", device, stats.tx_drop);
+        virBufferAsprintf(buf, "%s tx_drop %lld\n", device, stats.tx_drop);
+
+    return true;
+}
+
+static bool
+virshDomainFormatIfstat(vshControl *ctl,
+                        const vshCmd *cmd,
+                        virDomainPtr dom,
+                        virBufferPtr buf)
+{
+    const char *device = NULL;
+    xmlDocPtr xml = NULL;
+    xmlXPathContextPtr ctxt = NULL;
+    xmlNodePtr *nodes = NULL;
+    char *target = NULL;
+    int ninterfaces;
+    size_t i;
+    bool ret = false;
+
+    if (vshCommandOptStringReq(ctl, cmd, "interface", &device) < 0)
+        return false;
+
+    if (device)
+        return virshDomainFormatIfstatOne(dom, device, buf);
+
+    if (virshDomainGetXMLFromDom(ctl, dom, 0, &xml, &ctxt) < 0)
+        return false;
+
+    if ((ninterfaces = virXPathNodeSet("./devices/interface/target",
+                                       ctxt, &nodes)) < 0)
+        goto cleanup;
+
+    for (i = 0; i < ninterfaces; i++) {
+        if (!(target = virXMLPropString(nodes[i], "dev")))
+            continue;
+
+        if (!virshDomainFormatIfstatOne(dom, target, buf))
+            goto cleanup;
+
+        VIR_FREE(target);
+    }
 
     ret = true;
 
  cleanup:
-    virshDomainFree(dom);
+    VIR_FREE(target);
+    VIR_FREE(nodes);
+    xmlXPathFreeContext(ctxt);
+    xmlFreeDoc(xml);
     return ret;
 }
 
+static bool
+cmdDomIfstat(vshControl *ctl, const vshCmd *cmd)
+{
+    return virshDomainBulkRun(ctl, cmd, VIR_CONNECT_LIST_DOMAINS_ACTIVE,
+                              true, virshDomainFormatIfstat);
+}
+
 /*
  * "domblkerror" command
  */
@@ -1239,15 +1285,18 @@ static const vshCmdInfo info_dominfo[] = {
 };
 
 static const vshCmdOptDef opts_dominfo[] = {
-    VIRSH_COMMON_OPT_DOMAIN_FULL(0),
+    VIRSH_COMMON_OPT_DOMAIN_BULK(0),
+    VIRSH_COMMON_OPT_BULK,
     {.name = NULL}
 };
 
 static bool
-cmdDominfo(vshControl *ctl, const vshCmd *cmd)
+virshDomainFormatInfo(vshControl *ctl,
+                      const vshCmd *cmd ATTRIBUTE_UNUSED,
+                      virDomainPtr dom,
+                      virBufferPtr buf)
 {
     virDomainInfo info;
-    virDomainPtr dom;
     virSecurityModel secmodel;
     virSecurityLabelPtr seclabel;
     int persistent = 0;
@@ -1258,47 +1307,44 @@ cmdDominfo(vshControl *ctl, const vshCmd *cmd)
     int has_managed_save = 0;
     virshControlPtr priv = ctl->privData;
 
-    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
-        return false;
-
     id = virDomainGetID(dom);
     if (id == ((unsigned int)-1))
-        vshPrint(ctl, "%-15s %s\n", _("Id:"), "-");
+        virBufferAsprintf(buf, "%-15s %s\n", _("Id:"), "-");
     else
-        vshPrint(ctl, "%-15s %d\n", _("Id:"), id);
-    vshPrint(ctl, "%-15s %s\n", _("Name:"), virDomainGetName(dom));
+        virBufferAsprintf(buf, "%-15s %d\n", _("Id:"), id);
+    virBufferAsprintf(buf, "%-15s %s\n", _("Name:"), virDomainGetName(dom));
 
     if (virDomainGetUUIDString(dom, &uuid[0]) == 0)
-        vshPrint(ctl, "%-15s %s\n", _("UUID:"), uuid);
+        virBufferAsprintf(buf, "%-15s %s\n", _("UUID:"), uuid);
 
     if ((str = virDomainGetOSType(dom))) {
-        vshPrint(ctl, "%-15s %s\n", _("OS Type:"), str);
+        virBufferAsprintf(buf, "%-15s %s\n", _("OS Type:"), str);
         VIR_FREE(str);
     }
 
     if (virDomainGetInfo(dom, &info) == 0) {
-        vshPrint(ctl, "%-15s %s\n", _("State:"),
-                 virshDomainStateToString(info.state));
+        virBufferAsprintf(buf, "%-15s %s\n", _("State:"),
+                          virshDomainStateToString(info.state));
 
-        vshPrint(ctl, "%-15s %d\n", _("CPU(s):"), info.nrVirtCpu);
+        virBufferAsprintf(buf, "%-15s %d\n", _("CPU(s):"), info.nrVirtCpu);
 
         if (info.cpuTime != 0) {
             double cpuUsed = info.cpuTime;
 
             cpuUsed /= 1000000000.0;
 
-            vshPrint(ctl, "%-15s %.1lfs\n", _("CPU time:"), cpuUsed);
+            virBufferAsprintf(buf, "%-15s %.1lfs\n", _("CPU time:"), cpuUsed);
         }
 
         if (info.maxMem != UINT_MAX)
-            vshPrint(ctl, "%-15s %lu KiB\n", _("Max memory:"),
-                 info.maxMem);
+            virBufferAsprintf(buf, "%-15s %lu KiB\n", _("Max memory:"),
+                              info.maxMem);
         else
-            vshPrint(ctl, "%-15s %s\n", _("Max memory:"),
-                 _("no limit"));
+            virBufferAsprintf(buf, "%-15s %s\n", _("Max memory:"),
+                              _("no limit"));
 
-        vshPrint(ctl, "%-15s %lu KiB\n", _("Used memory:"),
-                 info.memory);
+        virBufferAsprintf(buf, "%-15s %lu KiB\n", _("Used memory:"),
+                          info.memory);
 
     } else {
         ret = false;
@@ -1309,61 +1355,65 @@ cmdDominfo(vshControl *ctl, const vshCmd *cmd)
     vshDebug(ctl, VSH_ERR_DEBUG, "Domain persistent flag value: %d\n",
              persistent);
     if (persistent < 0)
-        vshPrint(ctl, "%-15s %s\n", _("Persistent:"), _("unknown"));
+        virBufferAsprintf(buf, "%-15s %s\n", _("Persistent:"), _("unknown"));
     else
-        vshPrint(ctl, "%-15s %s\n", _("Persistent:"), persistent ? _("yes") : _("no"));
+        virBufferAsprintf(buf, "%-15s %s\n", _("Persistent:"),
+                          persistent ? _("yes") : _("no"));
 
     /* Check and display whether the domain autostarts or not */
     if (!virDomainGetAutostart(dom, &autostart)) {
-        vshPrint(ctl, "%-15s %s\n", _("Autostart:"),
-                 autostart ? _("enable") : _("disable"));
+        virBufferAsprintf(buf, "%-15s %s\n", _("Autostart:"),
+                          autostart ? _("enable") : _("disable"));
     }
 
     has_managed_save = virDomainHasManagedSaveImage(dom, 0);
     if (has_managed_save < 0)
-        vshPrint(ctl, "%-15s %s\n", _("Managed save:"), _("unknown"));
+        virBufferAsprintf(buf, "%-15s %s\n", _("Managed save:"), _("unknown"));
     else
-        vshPrint(ctl, "%-15s %s\n", _("Managed save:"),
-                 has_managed_save ? _("yes") : _("no"));
+        virBufferAsprintf(buf, "%-15s %s\n", _("Managed save:"),
+                          has_managed_save ? _("yes") : _("no"));
 
     /* Security model and label information */
     memset(&secmodel, 0, sizeof(secmodel));
     if (virNodeGetSecurityModel(priv->conn, &secmodel) == -1) {
-        if (last_error->code != VIR_ERR_NO_SUPPORT) {
-            virshDomainFree(dom);
+        if (virGetLastErrorCode() != VIR_ERR_NO_SUPPORT)
             return false;
-        } else {
-            vshResetLibvirtError();
-        }
+        else
+            virResetLastError();
     } else {
         /* Only print something if a security model is active */
         if (secmodel.model[0] != '\0') {
-            vshPrint(ctl, "%-15s %s\n", _("Security model:"), secmodel.model);
-            vshPrint(ctl, "%-15s %s\n", _("Security DOI:"), secmodel.doi);
+            virBufferAsprintf(buf, "%-15s %s\n", _("Security model:"),
+                              secmodel.model);
+            virBufferAsprintf(buf, "%-15s %s\n", _("Security DOI:"),
+                              secmodel.doi);
 
             /* Security labels are only valid for active domains */
-            if (VIR_ALLOC(seclabel) < 0) {
-                virshDomainFree(dom);
+            if (VIR_ALLOC(seclabel) < 0)
                 return false;
-            }
 
             if (virDomainGetSecurityLabel(dom, seclabel) == -1) {
-                virshDomainFree(dom);
                 VIR_FREE(seclabel);
                 return false;
             } else {
                 if (seclabel->label[0] != '\0')
-                    vshPrint(ctl, "%-15s %s (%s)\n", _("Security label:"),
-                             seclabel->label, seclabel->enforcing ? "enforcing" : "permissive");
+                    virBufferAsprintf(buf, "%-15s %s (%s)\n",
+                                      _("Security label:"), seclabel->label,
+                                      seclabel->enforcing ? "enforcing" : "permissive");
             }
 
             VIR_FREE(seclabel);
         }
     }
-    virshDomainFree(dom);
     return ret;
 }
 
+static bool
+cmdDominfo(vshControl *ctl, const vshCmd *cmd)
+{
+    return virshDomainBulkRun(ctl, cmd, 0, false, virshDomainFormatInfo);
+}
+
 /*
  * "domstate" command
  */
@@ -2066,6 +2116,22 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report domain perf event statistics"),
     },
+    {.name = "pressure",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain pressure stall statistics"),
+    },
+    {.name = "resctrl",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain resctrl cache and memory bandwidth monitoring statistics"),
+    },
+    {.name = "vcpu-kvm",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain vCPU steal time and KVM statistics"),
+    },
+    {.name = "jobs",
+     .type = VSH_OT_BOOL,
+     .help = N_("report domain job and monitor accounting"),
+    },
     {.name = "list-active",
      .type = VSH_OT_BOOL,
      .help = N_("list only active domains"),
@@ -2114,20 +2180,25 @@ static const vshCmdOptDef opts_domstats[] = {
      .type = VSH_OT_BOOL,
      .help = N_("report only stats that are accessible instantly"),
     },
+    {.name = "json",
+     .type = VSH_OT_BOOL,
+     .help = N_("format the stats as a JSON array"),
+    },
     VIRSH_COMMON_OPT_DOMAIN_OT_ARGV(N_("list of domains to get stats for"), 0),
     {.name = NULL}
 };
 
 
 static bool
-virshDomainStatsPrintRecord(vshControl *ctl ATTRIBUTE_UNUSED,
-                            virDomainStatsRecordPtr record,
-                            bool raw ATTRIBUTE_UNUSED)
+virshDomainStatsFormatRecord(vshControl *ctl,
+                             virDomainStatsRecordPtr record,
+                             bool raw ATTRIBUTE_UNUSED,
+                             virBufferPtr buf)
 {
     char *param;
     size_t i;
 
-    vshPrint(ctl, "Domain: '%s'\n", virDomainGetName(record->dom));
+    virBufferAsprintf(buf, "Domain: '%s'\n", virDomainGetName(record->dom));
 
     /* XXX: Implement pretty-printing */
 
@@ -2135,7 +2206,7 @@ virshDomainStatsPrintRecord(vshControl *ctl ATTRIBUTE_UNUSED,
         if (!(param = vshGetTypedParamValue(ctl, record->params + i)))
             return false;
 
-        vshPrint(ctl, "  %s=%s\n", record->params[i].field, param);
+        virBufferAsprintf(buf, "  %s=%s\n", record->params[i].field, param);
 
         VIR_FREE(param);
     }
@@ -2143,6 +2214,127 @@ virshDomainStatsPrintRecord(vshControl *ctl ATTRIBUTE_UNUSED,
     return true;
 }
 
+static virJSONValuePtr
+virshDomainStatsRecordToJSON(virDomainStatsRecordPtr record)
+{
+    virJSONValuePtr ret = NULL;
+    virJSONValuePtr params = NULL;
+    size_t i;
+    int rc = 0;
+
+    if (!(ret = virJSONValueNewObject()) ||
+        !(params = virJSONValueNewObject()))
+        goto error;
+
+    for (i = 0; i < record->nparams && rc == 0; i++) {
+        virTypedParameterPtr par = record->params + i;
+
+        switch ((virTypedParameterType) par->type) {
+        case VIR_TYPED_PARAM_INT:
+            rc = virJSONValueObjectAppendNumberInt(params, par->field,
+                                                   par->value.i);
+            break;
+        case VIR_TYPED_PARAM_UINT:
+            rc = virJSONValueObjectAppendNumberUint(params, par->field,
+                                                    par->value.ui);
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+            rc = virJSONValueObjectAppendNumberLong(params, par->field,
+                                                    par->value.l);
+            break;
+        case VIR_TYPED_PARAM_ULLONG:
+            rc = virJSONValueObjectAppendNumberUlong(params, par->field,
+                                                     par->value.ul);
+            break;
+        case VIR_TYPED_PARAM_DOUBLE:
+            rc = virJSONValueObjectAppendNumberDouble(params, par->field,
+                                                      par->value.d);
+            break;
+        case VIR_TYPED_PARAM_BOOLEAN:
+            rc = virJSONValueObjectAppendBoolean(params, par->field,
+                                                 par->value.b);
+            break;
+        case VIR_TYPED_PARAM_STRING:
+            rc = virJSONValueObjectAppendString(params, par->field,
+                                                par->value.s);
+            break;
+        case VIR_TYPED_PARAM_LAST:
+        default:
+            break;
+        }
+    }
+
+    if (rc < 0 ||
+        virJSONValueObjectAppendString(ret, "domain",
+                                       virDomainGetName(record->dom)) < 0 ||
+        virJSONValueObjectAppend(ret, "stats", params) < 0)
+        goto error;
+
+    return ret;
+
+ error:
+    virJSONValueFree(params);
+    virJSONValueFree(ret);
+    return NULL;
+}
+
+/* Format all the records at once, rather than printing field by field */
+static bool
+virshDomainStatsFormat(vshControl *ctl,
+                       virDomainStatsRecordPtr *records,
+                       bool raw,
+                       bool json)
+{
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    virJSONValuePtr array = NULL;
+    virDomainStatsRecordPtr *next;
+    char *str = NULL;
+    bool ret = false;
+
+    if (json) {
+        if (!(array = virJSONValueNewArray()))
+            goto cleanup;
+
+        for (next = records; *next; next++) {
+            virJSONValuePtr obj;
+
+            if (!(obj = virshDomainStatsRecordToJSON(*next)))
+                goto cleanup;
+
+            if (virJSONValueArrayAppend(array, obj) < 0) {
+                virJSONValueFree(obj);
+                goto cleanup;
+            }
+        }
+
+        if (!(str = virJSONValueToString(array, true)))
+            goto cleanup;
+    } else {
+        for (next = records; *next; next++) {
+            if (next != records)
+                virBufferAddLit(&buf, "\n");
+
+            if (!virshDomainStatsFormatRecord(ctl, *next, raw, &buf))
+                goto cleanup;
+        }
+
+        if (virBufferCheckError(&buf) < 0)
+            goto cleanup;
+
+        str = virBufferContentAndReset(&buf);
+    }
+
+    if (str)
+        vshPrint(ctl, "%s", str);
+    ret = true;
+
+ cleanup:
+    VIR_FREE(str);
+    virBufferFreeAndReset(&buf);
+    virJSONValueFree(array);
+    return ret;
+}
+
 static bool
 cmdDomstats(vshControl *ctl, const vshCmd *cmd)
 {
@@ -2151,7 +2343,6 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     virDomainPtr dom;
     size_t ndoms = 0;
     virDomainStatsRecordPtr *records = NULL;
-    virDomainStatsRecordPtr *next;
     bool raw = vshCommandOptBool(cmd, "raw");
     int flags = 0;
     const vshCmdOpt *opt = NULL;
@@ -2179,6 +2370,18 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
     if (vshCommandOptBool(cmd, "perf"))
         stats |= VIR_DOMAIN_STATS_PERF;
 
+    if (vshCommandOptBool(cmd, "pressure"))
+        stats |= VIR_DOMAIN_STATS_PRESSURE;
+
+    if (vshCommandOptBool(cmd, "resctrl"))
+        stats |= VIR_DOMAIN_STATS_RESCTRL;
+
+    if (vshCommandOptBool(cmd, "vcpu-kvm"))
+        stats |= VIR_DOMAIN_STATS_VCPU_KVM;
+
+    if (vshCommandOptBool(cmd, "jobs"))
+        stats |= VIR_DOMAIN_STATS_JOBS;
+
     if (vshCommandOptBool(cmd, "list-active"))
         flags |= VIR_CONNECT_GET_ALL_DOMAINS_STATS_ACTIVE;
 
@@ -2240,14 +2443,9 @@ cmdDomstats(vshControl *ctl, const vshCmd *cmd)
            goto cleanup;
     }
 
-    next = records;
-    while (*next) {
-        if (!virshDomainStatsPrintRecord(ctl, *next, raw))
-            goto cleanup;
-
-        if (*(++next))
-            vshPrint(ctl, "\n");
-    }
+    if (!virshDomainStatsFormat(ctl, records, raw,
+                                vshCommandOptBool(cmd, "json")))
+        goto cleanup;
 
     ret = true;
  cleanup:
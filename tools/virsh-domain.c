@@ -2566,7 +2566,8 @@ VIR_ENUM_IMPL(virshDomainBlockJob,
               N_("Block Pull"),
               N_("Block Copy"),
               N_("Block Commit"),
-              N_("Active Block Commit"))
+              N_("Active Block Commit"),
+              N_("Backup"))
 
 static const char *
 virshDomainBlockJobToString(int type)
@@ -6038,6 +6039,10 @@ static const vshCmdOptDef opts_domjobinfo[] = {
      .type = VSH_OT_BOOL,
      .help = N_("return statistics of a recently completed job")
     },
+    {.name = "accounting",
+     .type = VSH_OT_BOOL,
+     .help = N_("return cumulative job and monitor accounting of the domain")
+    },
     {.name = NULL}
 };
 
@@ -6078,9 +6083,89 @@ virshDomainJobOperationToString(int op)
     return str ? _(str) : _("unknown");
 }
 
+static bool
+virshDomjobinfoAccounting(vshControl *ctl,
+                          virDomainPtr dom)
+{
+    static const struct {
+        const char *field;
+        const char *label;
+        const char *unit;
+    } totals[] = {
+        { "job.wait.count", N_("Jobs acquired:"), "" },
+        { "job.wait.time", N_("Job wait time:"), " ms" },
+        { "job.wait.timeouts", N_("Job timeouts:"), "" },
+        { "monitor.calls", N_("Monitor calls:"), "" },
+        { "monitor.time", N_("Monitor time:"), " ms" },
+    };
+    virDomainPtr domlist[] = { dom, NULL };
+    virDomainStatsRecordPtr *records = NULL;
+    virDomainStatsRecordPtr record;
+    unsigned long long value;
+    unsigned long long held;
+    unsigned int njobs = 0;
+    const char *name;
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    bool ret = false;
+    size_t i;
+
+    if (virDomainListGetStats(domlist, VIR_DOMAIN_STATS_JOBS, &records,
+                              VIR_CONNECT_GET_ALL_DOMAINS_STATS_ENFORCE_STATS) < 0)
+        goto cleanup;
+
+    if (!(record = records[0])) {
+        vshError(ctl, "%s", _("no job accounting returned for the domain"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < ARRAY_CARDINALITY(totals); i++) {
+        if (virTypedParamsGetULLong(record->params, record->nparams,
+                                    totals[i].field, &value) > 0)
+            vshPrint(ctl, "%-17s %llu%s\n", _(totals[i].label), value,
+                     totals[i].unit);
+    }
+
+    ignore_value(virTypedParamsGetUInt(record->params, record->nparams,
+                                       "job.count", &njobs));
+    for (i = 0; i < njobs; i++) {
+        snprintf(field, sizeof(field), "job.%zu.name", i);
+        if (virTypedParamsGetString(record->params, record->nparams,
+                                    field, &name) <= 0)
+            continue;
+        snprintf(field, sizeof(field), "job.%zu.count", i);
+        if (virTypedParamsGetULLong(record->params, record->nparams,
+                                    field, &value) <= 0)
+            continue;
+        snprintf(field, sizeof(field), "job.%zu.time", i);
+        if (virTypedParamsGetULLong(record->params, record->nparams,
+                                    field, &held) <= 0)
+            continue;
+
+        vshPrint(ctl, _("Job %s: %llu jobs held for %llu ms\n"),
+                 name, value, held);
+    }
+
+    ret = true;
+
+ cleanup:
+    virDomainStatsRecordListFree(records);
+    return ret;
+}
+
 static bool
 cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
 {
+    static const struct {
+        const char *field;
+        const char *label;
+    } startPhases[] = {
+        { VIR_DOMAIN_JOB_START_TIME_INIT, N_("Start init:") },
+        { VIR_DOMAIN_JOB_START_TIME_PREPARE_DOMAIN, N_("Start prepare domain:") },
+        { VIR_DOMAIN_JOB_START_TIME_PREPARE_HOST, N_("Start prepare host:") },
+        { VIR_DOMAIN_JOB_START_TIME_LAUNCH, N_("Start launch:") },
+        { VIR_DOMAIN_JOB_START_TIME_MONITOR, N_("Start monitor:") },
+        { VIR_DOMAIN_JOB_START_TIME_FINISH, N_("Start finish:") },
+    };
     virDomainJobInfo info;
     virDomainPtr dom;
     bool ret = false;
@@ -6093,10 +6178,18 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
     int ivalue;
     int op;
     int rc;
+    size_t i;
+
+    VSH_EXCLUSIVE_OPTIONS("completed", "accounting");
 
     if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
         return false;
 
+    if (vshCommandOptBool(cmd, "accounting")) {
+        ret = virshDomjobinfoAccounting(ctl, dom);
+        goto cleanup;
+    }
+
     if (vshCommandOptBool(cmd, "completed"))
         flags |= VIR_DOMAIN_JOB_STATS_COMPLETED;
 
@@ -6233,6 +6326,14 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         } else if (rc) {
             vshPrint(ctl, "%-17s %-12llu\n", _("Iteration:"), value);
         }
+
+        if ((rc = virTypedParamsGetULLong(params, nparams,
+                                          VIR_DOMAIN_JOB_MEMORY_CONVERGE_TIME,
+                                          &value)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            vshPrint(ctl, "%-17s %-12llu ms\n", _("Converge time:"), value);
+        }
     }
 
     if (info.fileTotal || info.fileRemaining || info.fileProcessed) {
@@ -6351,6 +6452,16 @@ cmdDomjobinfo(vshControl *ctl, const vshCmd *cmd)
         vshPrint(ctl, "%-17s %-13d\n", _("Auto converge throttle:"), ivalue);
     }
 
+    for (i = 0; i < ARRAY_CARDINALITY(startPhases); i++) {
+        if ((rc = virTypedParamsGetULLong(params, nparams,
+                                          startPhases[i].field,
+                                          &value)) < 0) {
+            goto save_error;
+        } else if (rc) {
+            vshPrint(ctl, "%-17s %-12llu ms\n", _(startPhases[i].label), value);
+        }
+    }
+
     ret = true;
 
  cleanup:
@@ -10450,6 +10561,14 @@ static const vshCmdOptDef opts_migrate[] = {
      .type = VSH_OT_BOOL,
      .help = N_("use TLS for migration")
     },
+    {.name = "parallel",
+     .type = VSH_OT_BOOL,
+     .help = N_("enable parallel migration")
+    },
+    {.name = "parallel-connections",
+     .type = VSH_OT_INT,
+     .help = N_("number of connections for parallel migration")
+    },
     {.name = NULL}
 };
 
@@ -10646,6 +10765,15 @@ doMigrate(void *opaque)
             goto save_error;
     }
 
+    if ((rv = vshCommandOptInt(ctl, cmd, "parallel-connections", &intOpt)) < 0) {
+        goto out;
+    } else if (rv > 0) {
+        if (virTypedParamsAddInt(&params, &nparams, &maxparams,
+                                 VIR_MIGRATE_PARAM_PARALLEL_CONNECTIONS,
+                                 intOpt) < 0)
+            goto save_error;
+    }
+
     if (vshCommandOptBool(cmd, "live"))
         flags |= VIR_MIGRATE_LIVE;
     if (vshCommandOptBool(cmd, "p2p"))
@@ -10694,6 +10822,9 @@ doMigrate(void *opaque)
     if (vshCommandOptBool(cmd, "tls"))
         flags |= VIR_MIGRATE_TLS;
 
+    if (vshCommandOptBool(cmd, "parallel"))
+        flags |= VIR_MIGRATE_PARALLEL;
+
     if (flags & VIR_MIGRATE_PEER2PEER || vshCommandOptBool(cmd, "direct")) {
         if (virDomainMigrateToURI3(dom, desturi, params, nparams, flags) == 0)
             ret = '0';
@@ -11726,6 +11857,10 @@ static const vshCmdOptDef opts_detach_device[] = {
     VIRSH_COMMON_OPT_DOMAIN_CONFIG,
     VIRSH_COMMON_OPT_DOMAIN_LIVE,
     VIRSH_COMMON_OPT_DOMAIN_CURRENT,
+    {.name = "async",
+     .type = VSH_OT_BOOL,
+     .help = N_("don't wait for the guest to release the device")
+    },
     {.name = NULL}
 };
 
@@ -11760,6 +11895,9 @@ cmdDetachDevice(vshControl *ctl, const vshCmd *cmd)
         virDomainIsActive(dom) == 1)
         flags |= VIR_DOMAIN_AFFECT_LIVE;
 
+    if (vshCommandOptBool(cmd, "async"))
+        flags |= VIR_DOMAIN_DEVICE_MODIFY_ASYNC;
+
     if (vshCommandOptStringReq(ctl, cmd, "file", &from) < 0)
         goto cleanup;
 
@@ -11778,7 +11916,10 @@ cmdDetachDevice(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    vshPrintExtra(ctl, "%s", _("Device detached successfully\n"));
+    if (flags & VIR_DOMAIN_DEVICE_MODIFY_ASYNC)
+        vshPrintExtra(ctl, "%s", _("Device detach request sent successfully\n"));
+    else
+        vshPrintExtra(ctl, "%s", _("Device detached successfully\n"));
     funcRet = true;
 
  cleanup:
@@ -23,6 +23,7 @@
 #include "virfile.h"
 #include "virstring.h"
 #include "viralloc.h"
+#include "virthread.h"
 
 static virDomainPtr
 virshLookupDomainInternal(vshControl *ctl,
@@ -284,3 +285,259 @@ virshDomainGetXML(vshControl *ctl,
 
     return ret;
 }
+
+
+typedef struct _virshDomainBulkJob virshDomainBulkJob;
+typedef virshDomainBulkJob *virshDomainBulkJobPtr;
+struct _virshDomainBulkJob {
+    virDomainPtr dom;
+    virBuffer buf;
+    bool ok;
+    char *error;
+};
+
+typedef struct _virshDomainBulkData virshDomainBulkData;
+typedef virshDomainBulkData *virshDomainBulkDataPtr;
+struct _virshDomainBulkData {
+    vshControl *ctl;
+    const vshCmd *cmd;
+    virshDomainBulkFunc func;
+
+    virMutex lock;
+    virshDomainBulkJobPtr jobs;
+    size_t njobs;
+    size_t next; /* protected by @lock */
+};
+
+
+/* Errors raised by the workers are thread local and picked up by the
+ * workers themselves, the global error of virsh is left alone while
+ * they run. Hence callbacks must reset the errors they recover from
+ * with virResetLastError(), not vshResetLibvirtError(). */
+static void
+virshDomainBulkErrorHandler(void *opaque ATTRIBUTE_UNUSED,
+                            virErrorPtr error ATTRIBUTE_UNUSED)
+{
+}
+
+
+static void
+virshDomainBulkWorker(void *opaque)
+{
+    virshDomainBulkDataPtr data = opaque;
+
+    for (;;) {
+        virshDomainBulkJobPtr job;
+
+        virMutexLock(&data->lock);
+        if (data->next == data->njobs) {
+            virMutexUnlock(&data->lock);
+            break;
+        }
+        job = &data->jobs[data->next++];
+        virMutexUnlock(&data->lock);
+
+        virResetLastError();
+        job->ok = data->func(data->ctl, data->cmd, job->dom, &job->buf);
+        if (!job->ok)
+            ignore_value(VIR_STRDUP_QUIET(job->error,
+                                          virGetLastErrorMessage()));
+    }
+}
+
+
+/* Returns 1 if every domain is to be handled, 0 if only the one given
+ * by "domain" is, or -1 on invalid options. */
+static int
+virshDomainBulkRequested(vshControl *ctl,
+                         const vshCmd *cmd)
+{
+    bool all = vshCommandOptBool(cmd, "all");
+
+    if (all && vshCommandOptBool(cmd, "domain")) {
+        vshError(ctl, "%s", _("Options --domain and --all are mutually "
+                              "exclusive"));
+        return -1;
+    }
+
+    if (!all && vshCommandOptBool(cmd, "parallel")) {
+        vshError(ctl, "%s", _("Option --parallel requires option --all"));
+        return -1;
+    }
+
+    if (!all && !vshCommandOptBool(cmd, "domain")) {
+        vshError(ctl, "%s", _("Either option --domain or --all is required"));
+        return -1;
+    }
+
+    return all ? 1 : 0;
+}
+
+
+static bool
+virshDomainBulkRunOne(vshControl *ctl,
+                      const vshCmd *cmd,
+                      virshDomainBulkFunc func)
+{
+    virDomainPtr dom;
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char *str = NULL;
+    bool ret;
+
+    if (!(dom = virshCommandOptDomain(ctl, cmd, NULL)))
+        return false;
+
+    /* @func only resets the thread local error when recovering */
+    if ((ret = func(ctl, cmd, dom, &buf)))
+        vshResetLibvirtError();
+
+    /* Print what was formatted even if @func failed half way through */
+    if (virBufferCheckError(&buf) < 0)
+        ret = false;
+    else if ((str = virBufferContentAndReset(&buf)))
+        vshPrint(ctl, "%s", str);
+    VIR_FREE(str);
+
+    virBufferFreeAndReset(&buf);
+    virshDomainFree(dom);
+    return ret;
+}
+
+
+/**
+ * virshDomainBulkRun:
+ * @ctl: virsh control structure
+ * @cmd: command being run
+ * @flags: bitwise-OR of virConnectListAllDomainsFlags
+ * @header: whether to precede the output of each domain with its name
+ * @func: callback formatting the output for one domain
+ *
+ * Runs @func for the domain given by the "domain" option of @cmd and
+ * prints the output it formatted. If @cmd has the "all" option, @func
+ * is run for every domain listed with @flags instead, using as many
+ * concurrent calls over the connection as requested by the "parallel"
+ * option. The output formatted by @func is then printed in the order of
+ * the domains once all of them are done, along with the errors of the
+ * domains @func failed for.
+ *
+ * Returns true if @func succeeded for every domain.
+ */
+bool
+virshDomainBulkRun(vshControl *ctl,
+                   const vshCmd *cmd,
+                   unsigned int flags,
+                   bool header,
+                   virshDomainBulkFunc func)
+{
+    virshControlPtr priv = ctl->privData;
+    virshDomainBulkData data;
+    virDomainPtr *doms = NULL;
+    virThreadPtr threads = NULL;
+    unsigned int parallel = 1;
+    size_t nthreads = 0;
+    size_t i;
+    int ndoms;
+    bool ret = false;
+
+    memset(&data, 0, sizeof(data));
+
+    switch (virshDomainBulkRequested(ctl, cmd)) {
+    case -1:
+        return false;
+    case 0:
+        return virshDomainBulkRunOne(ctl, cmd, func);
+    }
+
+    if (vshCommandOptUInt(ctl, cmd, "parallel", &parallel) < 0)
+        return false;
+
+    if (parallel == 0) {
+        vshError(ctl, "%s", _("number of parallel calls must be positive"));
+        return false;
+    }
+
+    if ((ndoms = virConnectListAllDomains(priv->conn, &doms, flags)) < 0) {
+        vshError(ctl, "%s", _("Failed to list domains"));
+        return false;
+    }
+
+    if (ndoms == 0) {
+        VIR_FREE(doms);
+        return true;
+    }
+
+    data.ctl = ctl;
+    data.cmd = cmd;
+    data.func = func;
+    data.jobs = vshCalloc(ctl, ndoms, sizeof(*data.jobs));
+    data.njobs = ndoms;
+    for (i = 0; i < ndoms; i++)
+        data.jobs[i].dom = doms[i];
+
+    if (virMutexInit(&data.lock) < 0) {
+        vshError(ctl, "%s", _("cannot initialize mutex"));
+        goto cleanup;
+    }
+
+    if (parallel > data.njobs)
+        parallel = data.njobs;
+
+    vshResetLibvirtError();
+    virSetErrorFunc(NULL, virshDomainBulkErrorHandler);
+
+    threads = vshCalloc(ctl, parallel, sizeof(*threads));
+    for (nthreads = 0; nthreads < parallel; nthreads++) {
+        if (virThreadCreate(&threads[nthreads], true,
+                            virshDomainBulkWorker, &data) < 0)
+            break;
+    }
+
+    /* Handle the domains left over in this thread if no worker started */
+    if (nthreads == 0)
+        virshDomainBulkWorker(&data);
+
+    for (i = 0; i < nthreads; i++)
+        virThreadJoin(&threads[i]);
+
+    virSetErrorFunc(NULL, vshErrorHandler);
+
+    ret = true;
+    for (i = 0; i < data.njobs; i++) {
+        virshDomainBulkJobPtr job = &data.jobs[i];
+        char *str;
+
+        if (!job->ok) {
+            vshError(ctl, _("Failed to handle domain '%s': %s"),
+                     virDomainGetName(job->dom), NULLSTR(job->error));
+            ret = false;
+            continue;
+        }
+
+        if (virBufferCheckError(&job->buf) < 0) {
+            ret = false;
+            continue;
+        }
+
+        if (header)
+            vshPrint(ctl, "Domain: '%s'\n", virDomainGetName(job->dom));
+        if ((str = virBufferContentAndReset(&job->buf)))
+            vshPrint(ctl, "%s", str);
+        VIR_FREE(str);
+
+        if (i + 1 < data.njobs)
+            vshPrint(ctl, "\n");
+    }
+
+    virMutexDestroy(&data.lock);
+
+ cleanup:
+    for (i = 0; i < data.njobs; i++) {
+        virBufferFreeAndReset(&data.jobs[i].buf);
+        VIR_FREE(data.jobs[i].error);
+        virshDomainFree(data.jobs[i].dom);
+    }
+    VIR_FREE(data.jobs);
+    VIR_FREE(threads);
+    VIR_FREE(doms);
+    return ret;
+}
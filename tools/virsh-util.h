@@ -20,6 +20,7 @@
 # define VIRSH_UTIL_H
 
 # include "virsh.h"
+# include "virbuffer.h"
 
 # include <libxml/parser.h>
 # include <libxml/xpath.h>
@@ -104,4 +105,18 @@ virshDomainGetXML(vshControl *ctl,
     ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(4)
     ATTRIBUTE_NONNULL(5) ATTRIBUTE_RETURN_CHECK;
 
+typedef bool
+(*virshDomainBulkFunc)(vshControl *ctl,
+                       const vshCmd *cmd,
+                       virDomainPtr dom,
+                       virBufferPtr buf);
+
+bool
+virshDomainBulkRun(vshControl *ctl,
+                   const vshCmd *cmd,
+                   unsigned int flags,
+                   bool header,
+                   virshDomainBulkFunc func)
+    ATTRIBUTE_NONNULL(1) ATTRIBUTE_NONNULL(2) ATTRIBUTE_NONNULL(5);
+
 #endif /* VIRSH_UTIL_H */
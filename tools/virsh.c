@@ -65,6 +65,7 @@
 #include "virsh-pool.h"
 #include "virsh-secret.h"
 #include "virsh-snapshot.h"
+#include "virsh-checkpoint.h"
 #include "virsh-volume.h"
 
 /* Gnulib doesn't guarantee SA_SIGINFO support.  */
@@ -845,6 +846,7 @@ static const vshCmdGrp cmdGroups[] = {
     {VIRSH_CMD_GRP_NODEDEV, "nodedev", nodedevCmds},
     {VIRSH_CMD_GRP_SECRET, "secret", secretCmds},
     {VIRSH_CMD_GRP_SNAPSHOT, "snapshot", snapshotCmds},
+    {VIRSH_CMD_GRP_CHECKPOINT, "checkpoint", checkpointCmds},
     {VIRSH_CMD_GRP_STORAGE_POOL, "pool", storagePoolCmds},
     {VIRSH_CMD_GRP_STORAGE_VOL, "volume", storageVolCmds},
     {VIRSH_CMD_GRP_VIRSH, "virsh", virshCmds},
@@ -55,6 +55,7 @@
 # define VIRSH_CMD_GRP_NWFILTER         "Network Filter"
 # define VIRSH_CMD_GRP_SECRET           "Secret"
 # define VIRSH_CMD_GRP_SNAPSHOT         "Snapshot"
+# define VIRSH_CMD_GRP_CHECKPOINT       "Checkpoint"
 # define VIRSH_CMD_GRP_HOST_AND_HV      "Host and Hypervisor"
 # define VIRSH_CMD_GRP_VIRSH            "Virsh itself"
 
@@ -82,6 +83,27 @@
 # define VIRSH_COMMON_OPT_DOMAIN_FULL(cflags) \
     VIRSH_COMMON_OPT_DOMAIN(N_("domain name, id or uuid"), cflags)
 
+/* For commands handling either one domain or, with --all, every
+ * domain, see virshDomainBulkRun */
+# define VIRSH_COMMON_OPT_DOMAIN_BULK(cflags) \
+    {.name = "domain", \
+     .type = VSH_OT_STRING, \
+     .help = N_("domain name, id or uuid"), \
+     .completer = virshDomainNameCompleter, \
+     .completer_flags = cflags, \
+    }
+
+# define VIRSH_COMMON_OPT_BULK \
+    {.name = "all", \
+     .type = VSH_OT_BOOL, \
+     .help = N_("handle every domain") \
+    }, \
+    {.name = "parallel", \
+     .type = VSH_OT_INT, \
+     .flags = VSH_OFLAG_REQ_OPT, \
+     .help = N_("number of domains handled concurrently with --all") \
+    }
+
 # define VIRSH_COMMON_OPT_CONFIG(_helpstr) \
     {.name = "config", \
      .type = VSH_OT_BOOL, \
@@ -473,8 +473,14 @@ cmdSrvThreadpoolInfo(vshControl *ctl, const vshCmd *cmd)
         goto cleanup;
     }
 
-    for (i = 0; i < nparams; i++)
-        vshPrint(ctl, "%-15s: %u\n", params[i].field, params[i].value.ui);
+    for (i = 0; i < nparams; i++) {
+        char *value = vshGetTypedParamValue(ctl, &params[i]);
+
+        if (!value)
+            goto cleanup;
+        vshPrint(ctl, "%-17s: %s\n", params[i].field, value);
+        VIR_FREE(value);
+    }
 
     ret = true;
 
@@ -520,6 +526,16 @@ static const vshCmdOptDef opts_srv_threadpool_set[] = {
      .type = VSH_OT_INT,
      .help = N_("Change the current number of priority workers"),
     },
+    {.name = "adaptive-latency",
+     .type = VSH_OT_INT,
+     .help = N_("Queue latency target in milliseconds for adaptive sizing, "
+                "0 disables it"),
+    },
+    {.name = "bulk-workers",
+     .type = VSH_OT_INT,
+     .help = N_("Limit the number of workers running bulk procedures, "
+                "0 disables the limit"),
+    },
     {.name = NULL}
 };
 
@@ -552,13 +568,16 @@ cmdSrvThreadpoolSet(vshControl *ctl, const vshCmd *cmd)
     PARSE_CMD_TYPED_PARAM("max-workers", VIR_THREADPOOL_WORKERS_MAX);
     PARSE_CMD_TYPED_PARAM("min-workers", VIR_THREADPOOL_WORKERS_MIN);
     PARSE_CMD_TYPED_PARAM("priority-workers", VIR_THREADPOOL_WORKERS_PRIORITY);
+    PARSE_CMD_TYPED_PARAM("adaptive-latency", VIR_THREADPOOL_ADAPTIVE_LATENCY);
+    PARSE_CMD_TYPED_PARAM("bulk-workers", VIR_THREADPOOL_WORKERS_BULK);
 
 #undef PARSE_CMD_TYPED_PARAM
 
     if (!nparams) {
         vshError(ctl, "%s",
                  _("At least one of options --min-workers, --max-workers, "
-                   "--priority-workers is mandatory "));
+                   "--priority-workers, --adaptive-latency, "
+                   "--bulk-workers is mandatory "));
             goto cleanup;
     }
 
@@ -896,6 +915,105 @@ cmdSrvClientsInfo(vshControl *ctl, const vshCmd *cmd)
     return ret;
 }
 
+/* --------------------
+ * Command srv-rpc-stats
+ * --------------------
+ */
+
+static const vshCmdInfo info_srv_rpc_stats[] = {
+    {.name = "help",
+     .data = N_("get server's per-procedure RPC statistics")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve call counts and latencies of RPC procedures "
+                "dispatched by <server>.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_srv_rpc_stats[] = {
+    {.name = "server",
+     .type = VSH_OT_DATA,
+     .flags = VSH_OFLAG_REQ,
+     .completer = vshAdmServerCompleter,
+     .help = N_("Server to retrieve the RPC statistics from."),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdSrvRPCStats(vshControl *ctl, const vshCmd *cmd)
+{
+    static const char *columns[] = {
+        "program", "procedure", "calls", "errors",
+        "queue.p50", "queue.p99", "exec.p50", "exec.p99", "exec.max",
+    };
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int count = 0;
+    size_t i, j;
+    const char *srvname = NULL;
+    virAdmServerPtr srv = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr table = NULL;
+
+    if (vshCommandOptStringReq(ctl, cmd, "server", &srvname) < 0)
+        return false;
+
+    if (!(srv = virAdmConnectLookupServer(priv->conn, srvname, 0)))
+        goto cleanup;
+
+    if (virAdmServerGetRPCStats(srv, &params, &nparams, 0) < 0 ||
+        virTypedParamsGetUInt(params, nparams, "rpc.count", &count) < 0) {
+        vshError(ctl, "%s", _("Unable to retrieve RPC statistics "
+                              "from server"));
+        goto cleanup;
+    }
+
+    table = vshTableNew(_("Program"), _("Procedure"), _("Calls"),
+                        _("Errors"), _("Queue p50 (us)"), _("Queue p99 (us)"),
+                        _("Exec p50 (us)"), _("Exec p99 (us)"),
+                        _("Exec max (us)"), NULL);
+    if (!table)
+        goto cleanup;
+
+    for (i = 0; i < count; i++) {
+        char *values[ARRAY_CARDINALITY(columns)] = { NULL };
+        int rc = -1;
+
+        for (j = 0; j < ARRAY_CARDINALITY(columns); j++) {
+            char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+            virTypedParameterPtr param;
+
+            snprintf(field, sizeof(field), "rpc.%zu.%s", i, columns[j]);
+            if (!(param = virTypedParamsGet(params, nparams, field)) ||
+                !(values[j] = vshGetTypedParamValue(ctl, param)))
+                goto row_cleanup;
+        }
+
+        rc = vshTableRowAppend(table, values[0], values[1], values[2],
+                               values[3], values[4], values[5], values[6],
+                               values[7], values[8], NULL);
+
+     row_cleanup:
+        for (j = 0; j < ARRAY_CARDINALITY(columns); j++)
+            VIR_FREE(values[j]);
+        if (rc < 0)
+            goto cleanup;
+    }
+
+    vshTablePrintToStdout(table, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(table);
+    virTypedParamsFree(params, nparams);
+    virAdmServerFree(srv);
+    return ret;
+}
+
 /* -----------------------
  * Command srv-clients-set
  * -----------------------
@@ -1109,6 +1227,371 @@ cmdDaemonLogOutputs(vshControl *ctl, const vshCmd *cmd)
     return true;
 }
 
+/* ----------------------------
+ * Command daemon-msgpool-stats
+ * ----------------------------
+ */
+static const vshCmdInfo info_daemon_msgpool_stats[] = {
+    {.name = "help",
+     .data = N_("get statistics of the daemon's message buffer pool")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve statistics about how well the daemon recycles RPC "
+                "message buffers.")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonMsgpoolStats(vshControl *ctl, const vshCmd *cmd ATTRIBUTE_UNUSED)
+{
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    size_t i;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (virAdmConnectGetMessagePoolStats(priv->conn, &params,
+                                         &nparams, 0) < 0) {
+        vshError(ctl, "%s",
+                 _("Unable to get daemon message pool statistics"));
+        goto cleanup;
+    }
+
+    for (i = 0; i < nparams; i++)
+        vshPrint(ctl, "%-15s: %llu\n", params[i].field, params[i].value.ul);
+
+    ret = true;
+
+ cleanup:
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* ----------------------------
+ * Command daemon-alloc-profile
+ * ----------------------------
+ */
+static const vshCmdInfo info_daemon_alloc_profile[] = {
+    {.name = "help",
+     .data = N_("control profiling of the daemon's memory allocations")
+    },
+    {.name = "desc",
+     .data = N_("Enable or disable accounting of memory allocations per "
+                "call-site and subsystem.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_alloc_profile[] = {
+    {.name = "rate",
+     .type = VSH_OT_INT,
+     .flags = VSH_OFLAG_REQ,
+     .help = N_("sample every <rate>-th allocation, 0 disables profiling"),
+    },
+    {.name = "reset",
+     .type = VSH_OT_BOOL,
+     .help = N_("clear the data collected so far"),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonAllocProfile(vshControl *ctl, const vshCmd *cmd)
+{
+    unsigned int rate = 0;
+    unsigned int flags = 0;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptUInt(ctl, cmd, "rate", &rate) < 0)
+        return false;
+
+    if (vshCommandOptBool(cmd, "reset"))
+        flags |= VIR_ADMIN_ALLOC_PROFILE_RESET;
+
+    if (virAdmConnectSetAllocProfile(priv->conn, rate, flags) < 0) {
+        vshError(ctl, "%s", _("Unable to change allocation profiling"));
+        return false;
+    }
+
+    return true;
+}
+
+/* --------------------------
+ * Command daemon-alloc-stats
+ * --------------------------
+ */
+static const vshCmdInfo info_daemon_alloc_stats[] = {
+    {.name = "help",
+     .data = N_("get the daemon's allocation profile")
+    },
+    {.name = "desc",
+     .data = N_("Show how much memory the daemon allocated per subsystem "
+                "and call-site since allocation profiling was enabled.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_alloc_stats[] = {
+    {.name = "top",
+     .type = VSH_OT_INT,
+     .help = N_("number of call-sites to show, 0 shows all (default 20)"),
+    },
+    {.name = NULL}
+};
+
+/* Append one row per "<prefix>.<num>" group of @params, made of the
+ * values of the "<prefix>.<num>.<column>" fields, to @table. At most
+ * @limit rows are added unless @limit is 0. */
+static int
+vshAdmStatsTable(vshControl *ctl,
+                 virTypedParameterPtr params,
+                 int nparams,
+                 const char *prefix,
+                 const char **columns,
+                 size_t ncolumns,
+                 unsigned int limit,
+                 vshTablePtr table)
+{
+    char field[VIR_TYPED_PARAM_FIELD_LENGTH];
+    unsigned int count = 0;
+    size_t i, j;
+
+    snprintf(field, sizeof(field), "%s.count", prefix);
+    if (virTypedParamsGetUInt(params, nparams, field, &count) < 0)
+        return -1;
+
+    if (limit && limit < count)
+        count = limit;
+
+    for (i = 0; i < count; i++) {
+        char *values[5] = { NULL };
+        int rc = -1;
+
+        for (j = 0; j < ncolumns; j++) {
+            virTypedParameterPtr param;
+
+            snprintf(field, sizeof(field), "%s.%zu.%s", prefix, i, columns[j]);
+            if (!(param = virTypedParamsGet(params, nparams, field)) ||
+                !(values[j] = vshGetTypedParamValue(ctl, param)))
+                goto row_cleanup;
+        }
+
+        rc = vshTableRowAppend(table, values[0], values[1], values[2],
+                               values[3], values[4], NULL);
+
+     row_cleanup:
+        for (j = 0; j < ncolumns; j++)
+            VIR_FREE(values[j]);
+        if (rc < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static bool
+cmdDaemonAllocStats(vshControl *ctl, const vshCmd *cmd)
+{
+    static const char *domainColumns[] = { "name", "allocs", "bytes" };
+    static const char *siteColumns[] = {
+        "allocs", "bytes", "function", "file", "line",
+    };
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int rate = 0;
+    unsigned long long dropped = 0;
+    unsigned int top = 20;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr domains = NULL;
+    vshTablePtr sites = NULL;
+
+    if (vshCommandOptUInt(ctl, cmd, "top", &top) < 0)
+        return false;
+
+    if (virAdmConnectGetAllocStats(priv->conn, &params, &nparams, 0) < 0 ||
+        virTypedParamsGetUInt(params, nparams, "rate", &rate) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "dropped", &dropped) < 0) {
+        vshError(ctl, "%s", _("Unable to get daemon allocation profile"));
+        goto cleanup;
+    }
+
+    if (rate)
+        vshPrint(ctl, "%-15s: %u\n", _("Sampling rate"), rate);
+    else
+        vshPrint(ctl, "%-15s: %s\n", _("Sampling rate"), _("disabled"));
+    vshPrint(ctl, "%-15s: %llu\n\n", _("Unattributed"), dropped);
+
+    if (!(domains = vshTableNew(_("Subsystem"), _("Allocations"),
+                                _("Bytes"), NULL)) ||
+        !(sites = vshTableNew(_("Allocations"), _("Bytes"), _("Function"),
+                              _("File"), _("Line"), NULL)))
+        goto cleanup;
+
+    if (vshAdmStatsTable(ctl, params, nparams, "domain",
+                              domainColumns, ARRAY_CARDINALITY(domainColumns),
+                              0, domains) < 0 ||
+        vshAdmStatsTable(ctl, params, nparams, "site",
+                              siteColumns, ARRAY_CARDINALITY(siteColumns),
+                              top, sites) < 0) {
+        vshError(ctl, "%s", _("Unable to parse daemon allocation profile"));
+        goto cleanup;
+    }
+
+    vshTablePrintToStdout(domains, ctl);
+    vshPrint(ctl, "\n");
+    vshTablePrintToStdout(sites, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(domains);
+    vshTableFree(sites);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* ---------------------------
+ * Command daemon-memory-stats
+ * ---------------------------
+ */
+static const vshCmdInfo info_daemon_memory_stats[] = {
+    {.name = "help",
+     .data = N_("get the daemon's memory usage per object class")
+    },
+    {.name = "desc",
+     .data = N_("Show the number of live objects of every object class "
+                "along with the memory used by hash tables and JSON values.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_memory_stats[] = {
+    {.name = "top",
+     .type = VSH_OT_INT,
+     .help = N_("number of object classes to show, 0 shows all (default 20)"),
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonMemoryStats(vshControl *ctl, const vshCmd *cmd)
+{
+    static const char *classColumns[] = { "name", "instances", "bytes" };
+    bool ret = false;
+    virTypedParameterPtr params = NULL;
+    int nparams = 0;
+    unsigned int top = 20;
+    unsigned long long classBytes = 0;
+    unsigned long long hashTables = 0, hashEntries = 0, hashBytes = 0;
+    unsigned long long jsonValues = 0, jsonArenas = 0, jsonBytes = 0;
+    vshAdmControlPtr priv = ctl->privData;
+    vshTablePtr classes = NULL;
+
+    if (vshCommandOptUInt(ctl, cmd, "top", &top) < 0)
+        return false;
+
+    if (virAdmConnectGetMemoryStats(priv->conn, &params, &nparams, 0) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "class.bytes",
+                                &classBytes) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "hash.tables",
+                                &hashTables) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "hash.entries",
+                                &hashEntries) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "hash.bytes",
+                                &hashBytes) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "json.values",
+                                &jsonValues) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "json.arenas",
+                                &jsonArenas) < 0 ||
+        virTypedParamsGetULLong(params, nparams, "json.bytes",
+                                &jsonBytes) < 0) {
+        vshError(ctl, "%s", _("Unable to get daemon memory statistics"));
+        goto cleanup;
+    }
+
+    vshPrint(ctl, "%-15s: %llu bytes\n", _("Objects"), classBytes);
+    vshPrint(ctl, "%-15s: %llu bytes (%llu tables, %llu entries)\n",
+             _("Hash tables"), hashBytes, hashTables, hashEntries);
+    vshPrint(ctl, "%-15s: %llu bytes (%llu values, %llu arenas)\n\n",
+             _("JSON"), jsonBytes, jsonValues, jsonArenas);
+
+    if (!(classes = vshTableNew(_("Class"), _("Instances"), _("Bytes"), NULL)))
+        goto cleanup;
+
+    if (vshAdmStatsTable(ctl, params, nparams, "class",
+                              classColumns, ARRAY_CARDINALITY(classColumns),
+                              top, classes) < 0) {
+        vshError(ctl, "%s", _("Unable to parse daemon memory statistics"));
+        goto cleanup;
+    }
+
+    vshTablePrintToStdout(classes, ctl);
+
+    ret = true;
+
+ cleanup:
+    vshTableFree(classes);
+    virTypedParamsFree(params, nparams);
+    return ret;
+}
+
+/* ------------------------
+ * Command daemon-log-dump
+ * ------------------------
+ */
+static const vshCmdInfo info_daemon_log_dump[] = {
+    {.name = "help",
+     .data = N_("fetch the messages kept by the daemon's logging buffer")
+    },
+    {.name = "desc",
+     .data = N_("Retrieve the most recent messages recorded by the 'buffer' "
+                "logging output of the daemon.")
+    },
+    {.name = NULL}
+};
+
+static const vshCmdOptDef opts_daemon_log_dump[] = {
+    {.name = "file",
+     .type = VSH_OT_STRING,
+     .help = N_("write the messages to a file instead of standard output")
+    },
+    {.name = NULL}
+};
+
+static bool
+cmdDaemonLogDump(vshControl *ctl, const vshCmd *cmd)
+{
+    bool ret = false;
+    char *buffer = NULL;
+    const char *file = NULL;
+    vshAdmControlPtr priv = ctl->privData;
+
+    if (vshCommandOptStringReq(ctl, cmd, "file", &file) < 0)
+        return false;
+
+    if (virAdmConnectGetLoggingBuffer(priv->conn, &buffer, 0) < 0) {
+        vshError(ctl, "%s", _("Unable to get daemon logging buffer"));
+        goto cleanup;
+    }
+
+    if (file) {
+        if (virFileWriteStr(file, buffer, 0600) < 0) {
+            vshError(ctl, _("Unable to write '%s'"), file);
+            goto cleanup;
+        }
+    } else {
+        vshPrint(ctl, "%s", buffer);
+    }
+
+    ret = true;
+
+ cleanup:
+    VIR_FREE(buffer);
+    return ret;
+}
+
 static void *
 vshAdmConnectionHandler(vshControl *ctl)
 {
@@ -1424,6 +1907,24 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_threadpool_info,
      .flags = 0
     },
+    {.name = "daemon-msgpool-stats",
+     .handler = cmdDaemonMsgpoolStats,
+     .opts = NULL,
+     .info = info_daemon_msgpool_stats,
+     .flags = 0
+    },
+    {.name = "daemon-alloc-stats",
+     .handler = cmdDaemonAllocStats,
+     .opts = opts_daemon_alloc_stats,
+     .info = info_daemon_alloc_stats,
+     .flags = 0
+    },
+    {.name = "daemon-memory-stats",
+     .handler = cmdDaemonMemoryStats,
+     .opts = opts_daemon_memory_stats,
+     .info = info_daemon_memory_stats,
+     .flags = 0
+    },
     {.name = "srv-clients-list",
      .flags = VSH_CMD_FLAG_ALIAS,
      .alias = "client-list"
@@ -1450,6 +1951,16 @@ static const vshCmdDef monitoringCmds[] = {
      .info = info_srv_clients_info,
      .flags = 0
     },
+    {.name = "srv-rpc-stats",
+     .flags = VSH_CMD_FLAG_ALIAS,
+     .alias = "server-rpc-stats"
+    },
+    {.name = "server-rpc-stats",
+     .handler = cmdSrvRPCStats,
+     .opts = opts_srv_rpc_stats,
+     .info = info_srv_rpc_stats,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
@@ -1492,6 +2003,18 @@ static const vshCmdDef managementCmds[] = {
      .info = info_daemon_log_outputs,
      .flags = 0
     },
+    {.name = "daemon-log-dump",
+     .handler = cmdDaemonLogDump,
+     .opts = opts_daemon_log_dump,
+     .info = info_daemon_log_dump,
+     .flags = 0
+    },
+    {.name = "daemon-alloc-profile",
+     .handler = cmdDaemonAllocProfile,
+     .opts = opts_daemon_alloc_profile,
+     .info = info_daemon_alloc_profile,
+     .flags = 0
+    },
     {.name = NULL}
 };
 
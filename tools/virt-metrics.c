@@ -0,0 +1,1106 @@
+/*
+ * virt-metrics.c: serve host, domain and daemon statistics in
+ *                 OpenMetrics text format
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+
+#ifdef HAVE_LIBINTL_H
+# include <libintl.h>
+#endif /* HAVE_LIBINTL_H */
+#include <getopt.h>
+#include <signal.h>
+
+#include "internal.h"
+#include "c-ctype.h"
+#include "libvirt/libvirt-admin.h"
+#include "rpc/virnetsocket.h"
+#include "viralloc.h"
+#include "virbuffer.h"
+#include "virerror.h"
+#include "virgettext.h"
+#include "virhash.h"
+#include "virstring.h"
+#include "virtime.h"
+#include "virtypedparam.h"
+#include "virutil.h"
+
+#define VIR_FROM_THIS VIR_FROM_NONE
+
+/* Scrapers send short GET requests, anything bigger is refused */
+#define VIRT_METRICS_REQUEST_MAX 8192
+#define VIRT_METRICS_CLIENTS_MAX 64
+
+#define VIRT_METRICS_CONTENT_TYPE \
+    "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+/*
+ * The cached state of one domain. The stats subscription only delivers
+ * the typed parameters which changed since the previous sample, those
+ * are merged into @params which thus always holds the latest value of
+ * every statistic.
+ */
+typedef struct _virtMetricsDomain virtMetricsDomain;
+typedef virtMetricsDomain *virtMetricsDomainPtr;
+struct _virtMetricsDomain {
+    char *name;
+    virTypedParameterPtr params;
+    size_t nparams;
+    size_t maxparams;
+    /* where the previous merge left off, samples keep the order */
+    size_t cursor;
+};
+
+typedef struct _virtMetrics virtMetrics;
+typedef virtMetrics *virtMetricsPtr;
+struct _virtMetrics {
+    virConnectPtr conn;
+    virAdmConnectPtr admin;
+    unsigned int interval; /* in milliseconds */
+
+    /* UUID string -> virtMetricsDomainPtr */
+    virHashTablePtr domains;
+    unsigned long long domainsSampled;
+
+    virNodeCPUStatsPtr cpu;
+    int ncpu;
+    virNodeMemoryStatsPtr mem;
+    int nmem;
+    virTypedParameterPtr daemonMemory;
+    int ndaemonMemory;
+    virTypedParameterPtr daemonMsgpool;
+    int ndaemonMsgpool;
+
+    /* rendered once per change and shared by all scrapes */
+    char *body;
+    bool dirty;
+
+    size_t nclients;
+    bool quit;
+    bool failed;
+};
+
+typedef struct _virtMetricsClient virtMetricsClient;
+typedef virtMetricsClient *virtMetricsClientPtr;
+struct _virtMetricsClient {
+    virtMetricsPtr metrics;
+    virNetSocketPtr sock;
+    bool closed;
+
+    char request[VIRT_METRICS_REQUEST_MAX + 1];
+    size_t requestLen;
+
+    char *response;
+    size_t responseLen;
+    size_t responseOff;
+};
+
+/* All metrics sharing a name have to be emitted in one block */
+typedef struct _virtMetricsFamily virtMetricsFamily;
+typedef virtMetricsFamily *virtMetricsFamilyPtr;
+struct _virtMetricsFamily {
+    char *name;
+    virBuffer buf;
+};
+
+typedef struct _virtMetricsRender virtMetricsRender;
+typedef virtMetricsRender *virtMetricsRenderPtr;
+struct _virtMetricsRender {
+    virHashTablePtr index;
+    virtMetricsFamilyPtr *families;
+    size_t nfamilies;
+};
+
+
+static void
+virtMetricsDomainFree(void *opaque,
+                      const void *name ATTRIBUTE_UNUSED)
+{
+    virtMetricsDomainPtr dom = opaque;
+
+    if (!dom)
+        return;
+
+    virTypedParamsFree(dom->params, dom->nparams);
+    VIR_FREE(dom->name);
+    VIR_FREE(dom);
+}
+
+
+static int
+virtMetricsParamAssign(virTypedParameterPtr dst,
+                       const virTypedParameter *src)
+{
+    if (dst->type == VIR_TYPED_PARAM_STRING)
+        VIR_FREE(dst->value.s);
+
+    *dst = *src;
+    if (src->type == VIR_TYPED_PARAM_STRING &&
+        VIR_STRDUP(dst->value.s, src->value.s) < 0) {
+        dst->type = VIR_TYPED_PARAM_INT;
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static int
+virtMetricsDomainMerge(virtMetricsDomainPtr dom,
+                       virDomainStatsRecordPtr record)
+{
+    const char *name = virDomainGetName(record->dom);
+    int i;
+
+    if (name && STRNEQ_NULLABLE(dom->name, name)) {
+        VIR_FREE(dom->name);
+        if (VIR_STRDUP(dom->name, name) < 0)
+            return -1;
+    }
+
+    for (i = 0; i < record->nparams; i++) {
+        virTypedParameterPtr param = &record->params[i];
+        ssize_t found = -1;
+        size_t n;
+
+        for (n = 0; n < dom->nparams; n++) {
+            size_t k = (dom->cursor + n) % dom->nparams;
+
+            if (STREQ(dom->params[k].field, param->field)) {
+                found = k;
+                break;
+            }
+        }
+
+        if (found < 0) {
+            if (VIR_RESIZE_N(dom->params, dom->maxparams,
+                             dom->nparams, 1) < 0)
+                return -1;
+            found = dom->nparams++;
+            memset(&dom->params[found], 0, sizeof(dom->params[found]));
+        }
+
+        if (virtMetricsParamAssign(&dom->params[found], param) < 0)
+            return -1;
+        dom->cursor = found + 1;
+    }
+
+    return 0;
+}
+
+
+static void
+virtMetricsDomainStats(virConnectPtr conn ATTRIBUTE_UNUSED,
+                       virDomainStatsRecordPtr *stats,
+                       int nstats,
+                       void *opaque)
+{
+    virtMetricsPtr metrics = opaque;
+    char uuid[VIR_UUID_STRING_BUFLEN];
+    int i;
+
+    for (i = 0; i < nstats; i++) {
+        virtMetricsDomainPtr dom;
+
+        if (virDomainGetUUIDString(stats[i]->dom, uuid) < 0)
+            continue;
+
+        if (!(dom = virHashLookup(metrics->domains, uuid))) {
+            if (VIR_ALLOC(dom) < 0 ||
+                virHashAddEntry(metrics->domains, uuid, dom) < 0) {
+                VIR_FREE(dom);
+                continue;
+            }
+        }
+
+        if (virtMetricsDomainMerge(dom, stats[i]) < 0)
+            fprintf(stderr, _("failed to record statistics of domain %s\n"),
+                    uuid);
+    }
+
+    ignore_value(virTimeMillisNow(&metrics->domainsSampled));
+    metrics->dirty = true;
+}
+
+
+static int
+virtMetricsDomainLifecycle(virConnectPtr conn ATTRIBUTE_UNUSED,
+                           virDomainPtr dom,
+                           int event,
+                           int detail ATTRIBUTE_UNUSED,
+                           void *opaque)
+{
+    virtMetricsPtr metrics = opaque;
+    char uuid[VIR_UUID_STRING_BUFLEN];
+
+    /* Stats samples only carry what changed, so a domain which went
+     * away has to be dropped here. Stopped persistent domains are
+     * still reported, transient ones are gone. */
+    if (event != VIR_DOMAIN_EVENT_UNDEFINED &&
+        !(event == VIR_DOMAIN_EVENT_STOPPED &&
+          virDomainIsPersistent(dom) == 0))
+        return 0;
+
+    if (virDomainGetUUIDString(dom, uuid) < 0)
+        return 0;
+
+    if (virHashRemoveEntry(metrics->domains, uuid) == 0)
+        metrics->dirty = true;
+
+    return 0;
+}
+
+
+static void
+virtMetricsResetError(const char *what)
+{
+    fprintf(stderr, _("failed to sample %s: %s\n"),
+            what, virGetLastErrorMessage());
+    virResetLastError();
+}
+
+
+static void
+virtMetricsSampleHost(virtMetricsPtr metrics)
+{
+    virNodeCPUStatsPtr cpu = NULL;
+    virNodeMemoryStatsPtr mem = NULL;
+    int ncpu = 0;
+    int nmem = 0;
+
+    if (virNodeGetCPUStats(metrics->conn, VIR_NODE_CPU_STATS_ALL_CPUS,
+                           NULL, &ncpu, 0) < 0 ||
+        VIR_ALLOC_N(cpu, ncpu) < 0 ||
+        virNodeGetCPUStats(metrics->conn, VIR_NODE_CPU_STATS_ALL_CPUS,
+                           cpu, &ncpu, 0) < 0) {
+        virtMetricsResetError("host CPU statistics");
+        VIR_FREE(cpu);
+        ncpu = 0;
+    }
+
+    if (virNodeGetMemoryStats(metrics->conn, VIR_NODE_MEMORY_STATS_ALL_CELLS,
+                              NULL, &nmem, 0) < 0 ||
+        VIR_ALLOC_N(mem, nmem) < 0 ||
+        virNodeGetMemoryStats(metrics->conn, VIR_NODE_MEMORY_STATS_ALL_CELLS,
+                              mem, &nmem, 0) < 0) {
+        virtMetricsResetError("host memory statistics");
+        VIR_FREE(mem);
+        nmem = 0;
+    }
+
+    VIR_FREE(metrics->cpu);
+    metrics->cpu = cpu;
+    metrics->ncpu = ncpu;
+    VIR_FREE(metrics->mem);
+    metrics->mem = mem;
+    metrics->nmem = nmem;
+}
+
+
+static void
+virtMetricsSampleDaemon(virtMetricsPtr metrics)
+{
+    virTypedParamsFree(metrics->daemonMemory, metrics->ndaemonMemory);
+    metrics->daemonMemory = NULL;
+    metrics->ndaemonMemory = 0;
+    virTypedParamsFree(metrics->daemonMsgpool, metrics->ndaemonMsgpool);
+    metrics->daemonMsgpool = NULL;
+    metrics->ndaemonMsgpool = 0;
+
+    if (!metrics->admin)
+        return;
+
+    if (virAdmConnectGetMemoryStats(metrics->admin, &metrics->daemonMemory,
+                                    &metrics->ndaemonMemory, 0) < 0)
+        virtMetricsResetError("daemon memory statistics");
+
+    if (virAdmConnectGetMessagePoolStats(metrics->admin,
+                                         &metrics->daemonMsgpool,
+                                         &metrics->ndaemonMsgpool, 0) < 0)
+        virtMetricsResetError("daemon message pool statistics");
+}
+
+
+static void
+virtMetricsSampleTimer(int timer ATTRIBUTE_UNUSED,
+                       void *opaque)
+{
+    virtMetricsPtr metrics = opaque;
+
+    virtMetricsSampleHost(metrics);
+    virtMetricsSampleDaemon(metrics);
+    metrics->dirty = true;
+}
+
+
+static void
+virtMetricsBufferEscapeLabel(virBufferPtr buf,
+                             const char *value)
+{
+    const char *cur;
+
+    for (cur = value; *cur; cur++) {
+        if (*cur == '\\' || *cur == '"')
+            virBufferAsprintf(buf, "\\%c", *cur);
+        else if (*cur == '\n')
+            virBufferAddLit(buf, "\\n");
+        else
+            virBufferAddChar(buf, *cur);
+    }
+}
+
+
+/* Turn @str into a valid metric or label name in place */
+static void
+virtMetricsSanitizeName(char *str)
+{
+    for (; *str; str++) {
+        if (!c_isalnum(*str) && *str != '_' && *str != ':')
+            *str = '_';
+    }
+}
+
+
+static virtMetricsFamilyPtr
+virtMetricsRenderFamily(virtMetricsRenderPtr render,
+                        const char *name)
+{
+    virtMetricsFamilyPtr family;
+
+    if ((family = virHashLookup(render->index, name)))
+        return family;
+
+    if (VIR_ALLOC(family) < 0 ||
+        VIR_STRDUP(family->name, name) < 0 ||
+        virHashAddEntry(render->index, name, family) < 0)
+        goto error;
+
+    if (VIR_APPEND_ELEMENT(render->families, render->nfamilies, family) < 0) {
+        /* the index does not own the families */
+        virHashSteal(render->index, name);
+        goto error;
+    }
+
+    return family;
+
+ error:
+    if (family)
+        VIR_FREE(family->name);
+    VIR_FREE(family);
+    return NULL;
+}
+
+
+static int
+virtMetricsRenderValue(virtMetricsRenderPtr render,
+                       const char *name,
+                       const char *labels,
+                       const char *labelName,
+                       const char *labelValue,
+                       const char *value)
+{
+    virtMetricsFamilyPtr family;
+
+    if (!(family = virtMetricsRenderFamily(render, name)))
+        return -1;
+
+    virBufferAdd(&family->buf, name, -1);
+    if ((labels && *labels) || labelName) {
+        virBufferAddChar(&family->buf, '{');
+        if (labels && *labels) {
+            virBufferAdd(&family->buf, labels, -1);
+            if (labelName)
+                virBufferAddChar(&family->buf, ',');
+        }
+        if (labelName) {
+            virBufferAsprintf(&family->buf, "%s=\"", labelName);
+            virtMetricsBufferEscapeLabel(&family->buf, labelValue);
+            virBufferAddChar(&family->buf, '"');
+        }
+        virBufferAddChar(&family->buf, '}');
+    }
+    virBufferAsprintf(&family->buf, " %s\n", value);
+
+    return 0;
+}
+
+
+static int
+virtMetricsRenderULLong(virtMetricsRenderPtr render,
+                        const char *name,
+                        const char *labels,
+                        unsigned long long value)
+{
+    char str[32];
+
+    snprintf(str, sizeof(str), "%llu", value);
+    return virtMetricsRenderValue(render, name, labels, NULL, NULL, str);
+}
+
+
+/*
+ * Render the numeric typed parameters in @params as metrics named
+ * after the field, prefixed by @prefix. Fields of the form
+ * "<group>.<num>.<rest>", such as "block.0.rd.bytes", become the
+ * metric "<prefix>_<group>_<rest>" with a "<group>" label holding the
+ * value of "<group>.<num>.name" if there is one, or <num> otherwise.
+ */
+static int
+virtMetricsRenderParams(virtMetricsRenderPtr render,
+                        const char *prefix,
+                        const char *labels,
+                        virTypedParameterPtr params,
+                        int nparams)
+{
+    char lastGroup[VIR_TYPED_PARAM_FIELD_LENGTH] = "";
+    char label[VIR_TYPED_PARAM_FIELD_LENGTH];
+    const char *labelValue = NULL;
+    char *value = NULL;
+    char *name = NULL;
+    virTypedParamsIndexPtr fields = NULL;
+    int ret = -1;
+    int i;
+
+    for (i = 0; i < nparams; i++) {
+        const char *field = params[i].field;
+        const char *dot = strchr(field, '.');
+        const char *labelName = NULL;
+        unsigned long idx;
+        char *end;
+
+        VIR_FREE(value);
+        VIR_FREE(name);
+
+        switch ((virTypedParameterType) params[i].type) {
+        case VIR_TYPED_PARAM_INT:
+            ignore_value(virAsprintf(&value, "%d", params[i].value.i));
+            break;
+        case VIR_TYPED_PARAM_UINT:
+            ignore_value(virAsprintf(&value, "%u", params[i].value.ui));
+            break;
+        case VIR_TYPED_PARAM_LLONG:
+            ignore_value(virAsprintf(&value, "%lld", params[i].value.l));
+            break;
+        case VIR_TYPED_PARAM_ULLONG:
+            ignore_value(virAsprintf(&value, "%llu", params[i].value.ul));
+            break;
+        case VIR_TYPED_PARAM_DOUBLE:
+            ignore_value(virDoubleToStr(&value, params[i].value.d));
+            break;
+        case VIR_TYPED_PARAM_BOOLEAN:
+            ignore_value(VIR_STRDUP(value, params[i].value.b ? "1" : "0"));
+            break;
+        case VIR_TYPED_PARAM_STRING:
+        case VIR_TYPED_PARAM_LAST:
+            continue;
+        }
+
+        if (!value)
+            goto cleanup;
+
+        if (dot && c_isdigit(dot[1]) &&
+            virStrToLong_ul(dot + 1, &end, 10, &idx) == 0 &&
+            *end == '.' && end[1]) {
+            size_t grouplen = end - field;
+
+            /* stats of one device are consecutive, so looking up
+             * the name once per group is enough; records with many
+             * devices are long, hence the index */
+            if (grouplen >= sizeof(lastGroup) ||
+                STRNEQLEN(lastGroup, field, grouplen) ||
+                lastGroup[grouplen] != '\0') {
+                char key[VIR_TYPED_PARAM_FIELD_LENGTH];
+                const char *devname = NULL;
+
+                if (!fields && !(fields = virTypedParamsIndexNew(params, nparams)))
+                    goto cleanup;
+
+                virStrncpy(lastGroup, field, grouplen, sizeof(lastGroup));
+                snprintf(key, sizeof(key), "%s.name", lastGroup);
+                if (virTypedParamsIndexGetString(fields, key, &devname) <= 0)
+                    devname = NULL;
+                labelValue = devname ? devname : lastGroup + (dot + 1 - field);
+            }
+
+            virStrncpy(label, field, dot - field, sizeof(label));
+            virtMetricsSanitizeName(label);
+            labelName = label;
+
+            if (virAsprintf(&name, "%s_%s_%s", prefix, label, end + 1) < 0)
+                goto cleanup;
+        } else {
+            if (virAsprintf(&name, "%s_%s", prefix, field) < 0)
+                goto cleanup;
+        }
+        virtMetricsSanitizeName(name);
+
+        if (virtMetricsRenderValue(render, name, labels, labelName,
+                                   labelValue, value) < 0)
+            goto cleanup;
+    }
+
+    ret = 0;
+
+ cleanup:
+    virTypedParamsIndexFree(fields);
+    VIR_FREE(value);
+    VIR_FREE(name);
+    return ret;
+}
+
+
+struct virtMetricsRenderDomainData {
+    virtMetricsRenderPtr render;
+    int ret;
+};
+
+static int
+virtMetricsRenderDomain(void *payload,
+                        const void *uuid,
+                        void *opaque)
+{
+    struct virtMetricsRenderDomainData *data = opaque;
+    virtMetricsDomainPtr dom = payload;
+    virBuffer labels = VIR_BUFFER_INITIALIZER;
+    char *str = NULL;
+
+    virBufferAddLit(&labels, "domain=\"");
+    virtMetricsBufferEscapeLabel(&labels, dom->name ? dom->name : "");
+    virBufferAsprintf(&labels, "\",uuid=\"%s\"", (const char *) uuid);
+
+    if (virBufferCheckError(&labels) < 0 ||
+        !(str = virBufferContentAndReset(&labels)) ||
+        virtMetricsRenderParams(data->render, "libvirt_domain", str,
+                                dom->params, dom->nparams) < 0)
+        data->ret = -1;
+
+    virBufferFreeAndReset(&labels);
+    VIR_FREE(str);
+    return data->ret;
+}
+
+
+static char *
+virtMetricsRenderBody(virtMetricsPtr metrics)
+{
+    virtMetricsRender render = { 0 };
+    struct virtMetricsRenderDomainData data = { &render, 0 };
+    virBuffer buf = VIR_BUFFER_INITIALIZER;
+    char name[VIR_NODE_CPU_STATS_FIELD_LENGTH + 32];
+    char *ret = NULL;
+    size_t i;
+
+    if (!(render.index = virHashCreate(256, NULL)))
+        return NULL;
+
+    if (virtMetricsRenderULLong(&render, "libvirt_up", NULL, 1) < 0 ||
+        virtMetricsRenderULLong(&render, "libvirt_domain_count", NULL,
+                                virHashSize(metrics->domains)) < 0 ||
+        virtMetricsRenderULLong(&render,
+                                "libvirt_domain_sample_timestamp_seconds",
+                                NULL, metrics->domainsSampled / 1000) < 0)
+        goto cleanup;
+
+    if (virHashForEach(metrics->domains, virtMetricsRenderDomain, &data) < 0 ||
+        data.ret < 0)
+        goto cleanup;
+
+    for (i = 0; i < metrics->ncpu; i++) {
+        snprintf(name, sizeof(name), "libvirt_node_cpu_%s_nanoseconds",
+                 metrics->cpu[i].field);
+        virtMetricsSanitizeName(name);
+        if (virtMetricsRenderULLong(&render, name, NULL,
+                                    metrics->cpu[i].value) < 0)
+            goto cleanup;
+    }
+
+    for (i = 0; i < metrics->nmem; i++) {
+        snprintf(name, sizeof(name), "libvirt_node_memory_%s_bytes",
+                 metrics->mem[i].field);
+        virtMetricsSanitizeName(name);
+        if (virtMetricsRenderULLong(&render, name, NULL,
+                                    metrics->mem[i].value * 1024) < 0)
+            goto cleanup;
+    }
+
+    if (virtMetricsRenderParams(&render, "libvirt_daemon_memory", NULL,
+                                metrics->daemonMemory,
+                                metrics->ndaemonMemory) < 0 ||
+        virtMetricsRenderParams(&render, "libvirt_daemon_msgpool", NULL,
+                                metrics->daemonMsgpool,
+                                metrics->ndaemonMsgpool) < 0)
+        goto cleanup;
+
+    for (i = 0; i < render.nfamilies; i++) {
+        virtMetricsFamilyPtr family = render.families[i];
+        char *samples;
+
+        if (virBufferCheckError(&family->buf) < 0)
+            goto cleanup;
+
+        samples = virBufferContentAndReset(&family->buf);
+        virBufferAsprintf(&buf, "# TYPE %s unknown\n", family->name);
+        virBufferAdd(&buf, samples, -1);
+        VIR_FREE(samples);
+    }
+    virBufferAddLit(&buf, "# EOF\n");
+
+    if (virBufferCheckError(&buf) < 0)
+        goto cleanup;
+
+    ret = virBufferContentAndReset(&buf);
+
+ cleanup:
+    for (i = 0; i < render.nfamilies; i++) {
+        virBufferFreeAndReset(&render.families[i]->buf);
+        VIR_FREE(render.families[i]->name);
+        VIR_FREE(render.families[i]);
+    }
+    VIR_FREE(render.families);
+    virHashFree(render.index);
+    virBufferFreeAndReset(&buf);
+    return ret;
+}
+
+
+static const char *
+virtMetricsBody(virtMetricsPtr metrics)
+{
+    char *body;
+
+    if (metrics->body && !metrics->dirty)
+        return metrics->body;
+
+    if (!(body = virtMetricsRenderBody(metrics))) {
+        virtMetricsResetError("metrics");
+        return metrics->body;
+    }
+
+    VIR_FREE(metrics->body);
+    metrics->body = body;
+    metrics->dirty = false;
+
+    return metrics->body;
+}
+
+
+static void
+virtMetricsClientFree(void *opaque)
+{
+    virtMetricsClientPtr client = opaque;
+
+    client->metrics->nclients--;
+    virObjectUnref(client->sock);
+    VIR_FREE(client->response);
+    VIR_FREE(client);
+}
+
+
+static void
+virtMetricsClientClose(virtMetricsClientPtr client)
+{
+    if (client->closed)
+        return;
+
+    client->closed = true;
+    virNetSocketRemoveIOCallback(client->sock);
+    virNetSocketClose(client->sock);
+}
+
+
+static int
+virtMetricsClientRespond(virtMetricsClientPtr client,
+                         const char *status,
+                         const char *type,
+                         const char *body,
+                         bool head)
+{
+    size_t len = strlen(body);
+
+    if (virAsprintf(&client->response,
+                    "HTTP/1.0 %s\r\n"
+                    "Content-Type: %s\r\n"
+                    "Content-Length: %zu\r\n"
+                    "Connection: close\r\n"
+                    "\r\n"
+                    "%s",
+                    status, type, len, head ? "" : body) < 0)
+        return -1;
+
+    client->responseLen = strlen(client->response);
+    client->responseOff = 0;
+    virNetSocketUpdateIOCallback(client->sock, VIR_EVENT_HANDLE_WRITABLE);
+
+    return 0;
+}
+
+
+static int
+virtMetricsClientHandleRequest(virtMetricsClientPtr client)
+{
+    char *method = client->request;
+    char *path;
+    char *end;
+    const char *body;
+    bool head;
+
+    if (!(path = strchr(method, ' ')))
+        goto bad;
+    *path++ = '\0';
+    if (!(end = strpbrk(path, " \r\n")))
+        goto bad;
+    *end = '\0';
+
+    head = STREQ(method, "HEAD");
+    if (!head && STRNEQ(method, "GET"))
+        return virtMetricsClientRespond(client, "405 Method Not Allowed",
+                                        "text/plain", "Method not allowed\n",
+                                        false);
+
+    if (STRNEQ(path, "/metrics") && !STRPREFIX(path, "/metrics?"))
+        return virtMetricsClientRespond(client, "404 Not Found",
+                                        "text/plain",
+                                        "Metrics are served at /metrics\n",
+                                        head);
+
+    if (!(body = virtMetricsBody(client->metrics)))
+        return virtMetricsClientRespond(client, "500 Internal Server Error",
+                                        "text/plain",
+                                        "Failed to collect metrics\n", head);
+
+    return virtMetricsClientRespond(client, "200 OK",
+                                    VIRT_METRICS_CONTENT_TYPE, body, head);
+
+ bad:
+    return virtMetricsClientRespond(client, "400 Bad Request", "text/plain",
+                                    "Bad request\n", false);
+}
+
+
+static void
+virtMetricsClientEvent(virNetSocketPtr sock,
+                       int events,
+                       void *opaque)
+{
+    virtMetricsClientPtr client = opaque;
+    ssize_t got;
+
+    if (client->closed)
+        return;
+
+    if (events & (VIR_EVENT_HANDLE_ERROR | VIR_EVENT_HANDLE_HANGUP))
+        goto close;
+
+    if (client->response) {
+        if (!(events & VIR_EVENT_HANDLE_WRITABLE))
+            return;
+
+        if ((got = virNetSocketWrite(sock,
+                                     client->response + client->responseOff,
+                                     client->responseLen -
+                                     client->responseOff)) < 0)
+            goto close;
+
+        client->responseOff += got;
+        if (client->responseOff == client->responseLen)
+            goto close;
+        return;
+    }
+
+    if (!(events & VIR_EVENT_HANDLE_READABLE))
+        return;
+
+    if ((got = virNetSocketRead(sock, client->request + client->requestLen,
+                                VIRT_METRICS_REQUEST_MAX -
+                                client->requestLen)) < 0)
+        goto close;
+
+    client->requestLen += got;
+    client->request[client->requestLen] = '\0';
+
+    if (strstr(client->request, "\r\n\r\n") ||
+        strstr(client->request, "\n\n")) {
+        if (virtMetricsClientHandleRequest(client) < 0)
+            goto close;
+    } else if (client->requestLen == VIRT_METRICS_REQUEST_MAX) {
+        if (virtMetricsClientRespond(client, "400 Bad Request", "text/plain",
+                                     "Request too large\n", false) < 0)
+            goto close;
+    }
+    return;
+
+ close:
+    virResetLastError();
+    virtMetricsClientClose(client);
+}
+
+
+static void
+virtMetricsAccept(virNetSocketPtr sock,
+                  int events ATTRIBUTE_UNUSED,
+                  void *opaque)
+{
+    virtMetricsPtr metrics = opaque;
+    virNetSocketPtr clientsock = NULL;
+    virtMetricsClientPtr client = NULL;
+
+    if (virNetSocketAccept(sock, &clientsock) < 0) {
+        virtMetricsResetError("connection");
+        return;
+    }
+
+    /* no pending connection after all */
+    if (!clientsock)
+        return;
+
+    if (metrics->nclients >= VIRT_METRICS_CLIENTS_MAX ||
+        virNetSocketSetBlocking(clientsock, false) < 0 ||
+        VIR_ALLOC(client) < 0)
+        goto error;
+
+    virNetSocketSetQuietEOF(clientsock);
+    client->metrics = metrics;
+    client->sock = clientsock;
+
+    if (virNetSocketAddIOCallback(clientsock, VIR_EVENT_HANDLE_READABLE,
+                                  virtMetricsClientEvent, client,
+                                  virtMetricsClientFree) < 0)
+        goto error;
+
+    metrics->nclients++;
+    return;
+
+ error:
+    virResetLastError();
+    VIR_FREE(client);
+    virNetSocketClose(clientsock);
+    virObjectUnref(clientsock);
+}
+
+
+static void
+virtMetricsConnectClosed(virConnectPtr conn ATTRIBUTE_UNUSED,
+                         int reason ATTRIBUTE_UNUSED,
+                         void *opaque)
+{
+    virtMetricsPtr metrics = opaque;
+
+    fprintf(stderr, "%s", _("connection to the hypervisor was closed\n"));
+    metrics->failed = true;
+    metrics->quit = true;
+}
+
+
+static void
+show_help(FILE *out, const char *argv0)
+{
+    fprintf(out,
+            _("\n"
+              "syntax: %s [OPTIONS]\n"
+              "\n"
+              " Options:\n"
+              "   -c, --connect URI    Hypervisor connection URI\n"
+              "   -a, --admin[=URI]    Also export stats of the daemon\n"
+              "   -l, --listen ADDR    Address to listen on (default localhost)\n"
+              "   -p, --port PORT      Port to listen on (default 9177)\n"
+              "   -i, --interval SECS  Sampling interval (default 15)\n"
+              "   -h, --help           Display command line help\n"
+              "   -v, --version        Display command version\n"
+              "\n"),
+            argv0);
+}
+
+static void
+show_version(FILE *out, const char *argv0)
+{
+    fprintf(out, "version: %s %s\n", argv0, VERSION);
+}
+
+static const struct option argOptions[] = {
+    { "connect", 1, NULL, 'c', },
+    { "admin", 2, NULL, 'a', },
+    { "listen", 1, NULL, 'l', },
+    { "port", 1, NULL, 'p', },
+    { "interval", 1, NULL, 'i', },
+    { "help", 0, NULL, 'h', },
+    { "version", 0, NULL, 'v', },
+    { NULL, 0, NULL, '\0', }
+};
+
+int
+main(int argc, char **argv)
+{
+    virtMetrics metrics = { 0 };
+    const char *uri = NULL;
+    const char *adminURI = NULL;
+    bool admin = false;
+    const char *listenAddr = "localhost";
+    const char *port = "9177";
+    unsigned int interval = 15;
+    virNetSocketPtr *socks = NULL;
+    size_t nsocks = 0;
+    int lifecycleID = -1;
+    int statsID = -1;
+    int timer = -1;
+    int ret = EXIT_FAILURE;
+    size_t i;
+    int c;
+
+    if (virGettextInitialize() < 0 ||
+        virInitialize() < 0)
+        return EXIT_FAILURE;
+
+    while ((c = getopt_long(argc, argv, "c:a::l:p:i:hv",
+                            argOptions, NULL)) != -1) {
+        switch (c) {
+        case 'c':
+            uri = optarg;
+            break;
+
+        case 'a':
+            admin = true;
+            adminURI = optarg;
+            break;
+
+        case 'l':
+            listenAddr = optarg;
+            break;
+
+        case 'p':
+            port = optarg;
+            break;
+
+        case 'i':
+            if (virStrToLong_uip(optarg, NULL, 10, &interval) < 0 ||
+                interval == 0 || interval > UINT_MAX / 1000) {
+                fprintf(stderr, _("%s: invalid interval '%s'\n"),
+                        argv[0], optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'v':
+            show_version(stdout, argv[0]);
+            return EXIT_SUCCESS;
+
+        case 'h':
+            show_help(stdout, argv[0]);
+            return EXIT_SUCCESS;
+
+        case '?':
+        default:
+            show_help(stderr, argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (optind < argc) {
+        fprintf(stderr, _("%s: too many command line arguments\n"), argv[0]);
+        show_help(stderr, argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    /* clients going away while the metrics are written out */
+    signal(SIGPIPE, SIG_IGN);
+
+    metrics.interval = interval * 1000;
+
+    if (virEventRegisterDefaultImpl() < 0 ||
+        !(metrics.domains = virHashCreate(256, virtMetricsDomainFree)))
+        goto cleanup;
+
+    if (!(metrics.conn = virConnectOpen(uri)))
+        goto cleanup;
+
+    if (admin && !(metrics.admin = virAdmConnectOpen(adminURI, 0)))
+        goto cleanup;
+
+    if (virConnectRegisterCloseCallback(metrics.conn,
+                                        virtMetricsConnectClosed,
+                                        &metrics, NULL) < 0)
+        goto cleanup;
+
+    if ((lifecycleID = virConnectDomainEventRegisterAny(metrics.conn, NULL,
+                                                        VIR_DOMAIN_EVENT_ID_LIFECYCLE,
+                                                        VIR_DOMAIN_EVENT_CALLBACK(virtMetricsDomainLifecycle),
+                                                        &metrics, NULL)) < 0)
+        goto cleanup;
+
+    /* A single subscription serves all scrapers: the domains are
+     * sampled once per interval no matter how often we are scraped */
+    if ((statsID = virConnectDomainStatsRegister(metrics.conn, 0,
+                                                 metrics.interval,
+                                                 virtMetricsDomainStats,
+                                                 &metrics, NULL, 0)) < 0)
+        goto cleanup;
+
+    virtMetricsSampleTimer(-1, &metrics);
+    if ((timer = virEventAddTimeout(metrics.interval, virtMetricsSampleTimer,
+                                    &metrics, NULL)) < 0)
+        goto cleanup;
+
+    if (virNetSocketNewListenTCP(listenAddr, port, AF_UNSPEC,
+                                 &socks, &nsocks) < 0)
+        goto cleanup;
+
+    for (i = 0; i < nsocks; i++) {
+        if (virNetSocketListen(socks[i], 0) < 0 ||
+            virNetSocketAddIOCallback(socks[i], VIR_EVENT_HANDLE_READABLE,
+                                      virtMetricsAccept, &metrics, NULL) < 0)
+            goto cleanup;
+    }
+
+    while (!metrics.quit) {
+        if (virEventRunDefaultImpl() < 0)
+            goto cleanup;
+    }
+
+    if (!metrics.failed)
+        ret = EXIT_SUCCESS;
+
+ cleanup:
+    if (ret != EXIT_SUCCESS && virGetLastErrorMessage())
+        fprintf(stderr, _("%s: %s\n"), argv[0], virGetLastErrorMessage());
+
+    for (i = 0; i < nsocks; i++) {
+        virNetSocketRemoveIOCallback(socks[i]);
+        virNetSocketClose(socks[i]);
+        virObjectUnref(socks[i]);
+    }
+    VIR_FREE(socks);
+    if (timer >= 0)
+        virEventRemoveTimeout(timer);
+    if (metrics.conn) {
+        if (statsID >= 0)
+            virConnectDomainStatsDeregister(metrics.conn, statsID);
+        if (lifecycleID >= 0)
+            virConnectDomainEventDeregisterAny(metrics.conn, lifecycleID);
+        virConnectUnregisterCloseCallback(metrics.conn,
+                                          virtMetricsConnectClosed);
+        virConnectClose(metrics.conn);
+    }
+    if (metrics.admin)
+        virAdmConnectClose(metrics.admin);
+    virHashFree(metrics.domains);
+    VIR_FREE(metrics.cpu);
+    VIR_FREE(metrics.mem);
+    virTypedParamsFree(metrics.daemonMemory, metrics.ndaemonMemory);
+    virTypedParamsFree(metrics.daemonMsgpool, metrics.ndaemonMsgpool);
+    VIR_FREE(metrics.body);
+
+    return ret;
+}